@@ -0,0 +1,29 @@
+# BXBITS.COM: a loop of shifts and bit scans, as decompressors and bitmap code use them.
+# The shifts' flags are always overwritten before being looked at.
+# Each iteration executes 12 instructions.
+
+	.intel_syntax noprefix
+	.code16
+	.text
+	.globl _start
+_start:
+	mov	ecx, 4000000
+	mov	eax, 0x12345678
+	xor	edx, edx
+	mov	si, 0x8421
+1:
+	mov	ebx, eax
+	shl	ebx, cl
+	shr	eax, 3
+	add	eax, ebx
+	sar	si, 1
+	xor	si, ax
+	bsf	edi, eax
+	bsr	bx, si
+	add	dx, di
+	add	dx, bx
+	dec	ecx
+	jnz	1b
+
+	mov	ax, 0x4c00
+	int	0x21
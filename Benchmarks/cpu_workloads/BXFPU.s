@@ -0,0 +1,34 @@
+# BXFPU.COM: a floating-point kernel of multiplies, square roots, memory operands
+# and integer conversions. Each iteration executes 9 instructions.
+
+	.intel_syntax noprefix
+	.code16
+	.text
+	.globl _start
+_start:
+	fninit
+	fld1
+	fld	qword ptr [factor]
+	mov	ecx, 5000000
+1:
+	fmul	st(1), st
+	fld	st(1)
+	fsqrt
+	fadd	qword ptr [total]
+	fstp	qword ptr [total]
+	fld	qword ptr [total]
+	fistp	dword ptr [rounded]
+	dec	ecx
+	jnz	1b
+
+	fninit
+	mov	ax, 0x4c00
+	int	0x21
+
+	.balign	8
+factor:
+	.double	1.0000001
+total:
+	.double	0.0
+rounded:
+	.long	0
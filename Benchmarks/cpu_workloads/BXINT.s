@@ -0,0 +1,29 @@
+# BXINT.COM: a tight loop of register and memory integer arithmetic.
+# Each iteration executes 8 instructions.
+
+	.intel_syntax noprefix
+	.code16
+	.text
+	.globl _start
+_start:
+	mov	ecx, 8000000
+	xor	ax, ax
+	mov	bx, 0x1234
+	xor	dx, dx
+	xor	si, si
+	xor	di, di
+1:
+	add	ax, bx
+	xor	dx, ax
+	rol	bx, 1
+	sub	si, dx
+	add	word ptr [scratch], ax
+	inc	di
+	dec	ecx
+	jnz	1b
+
+	mov	ax, 0x4c00
+	int	0x21
+
+scratch:
+	.word	0
@@ -0,0 +1,184 @@
+# BXPAGING.COM: switches to 16-bit protected mode with paging enabled, then repeatedly marks
+# one of four pages not-present and writes to it. The page fault handler marks the page present
+# again and returns to retry the write. Each iteration executes 10 instructions in the loop
+# and 12 in the fault handler. Returns to real mode afterward, and exits with an error code of 1
+# without doing anything if the CPU is already in protected or virtual 8086 mode.
+
+	.intel_syntax noprefix
+	.code16
+	.text
+	.globl _start
+
+	.set	CODE_SELECTOR, 0x08
+	.set	DATA_SELECTOR, 0x10
+
+_start:
+	smsw	ax
+	test	al, 1
+	jnz	fail
+
+	cli
+
+	# EBX = the linear address of our segment
+	xor	ebx, ebx
+	mov	bx, cs
+	mov	word ptr [real_segment], bx
+	shl	ebx, 4
+
+	# Base our code and data descriptors on our segment, so offsets stay the same in protected mode
+	mov	eax, ebx
+	mov	word ptr [gdt_code+2], ax
+	mov	word ptr [gdt_data+2], ax
+	shr	eax, 16
+	mov	byte ptr [gdt_code+4], al
+	mov	byte ptr [gdt_data+4], al
+
+	lea	eax, [ebx+gdt]
+	mov	dword ptr [gdtr+2], eax
+	lea	eax, [ebx+idt]
+	mov	dword ptr [idtr+2], eax
+
+	# The page directory goes on the first page boundary after our code, then the page table,
+	# then the four pages we'll be faulting on.
+	lea	eax, [ebx+end_of_code+0xfff]
+	and	eax, 0xfffff000
+	mov	dword ptr [directory_address], eax
+	mov	edi, eax
+	sub	edi, ebx
+	mov	word ptr [directory_offset], di
+
+	xor	eax, eax
+	mov	cx, 1024
+	rep stosd
+
+	# Identity-map the first 4MB
+	mov	word ptr [table_offset], di
+	mov	eax, 3
+	mov	cx, 1024
+2:
+	stosd
+	add	eax, 0x1000
+	loop	2b
+
+	mov	di, word ptr [directory_offset]
+	mov	eax, dword ptr [directory_address]
+	add	eax, 0x1000 + 3
+	mov	dword ptr [di], eax
+
+	lgdt	[gdtr]
+	lidt	[idtr]
+	mov	eax, dword ptr [directory_address]
+	mov	cr3, eax
+	mov	eax, cr0
+	or	eax, 0x80000001
+	mov	cr0, eax
+	ljmp	CODE_SELECTOR, offset protected_mode
+
+protected_mode:
+	mov	ax, DATA_SELECTOR
+	mov	ds, ax
+	mov	es, ax
+	mov	ss, ax
+
+	# SI = the page table entry for the first fault page, DI = its offset in our segment
+	mov	eax, dword ptr [directory_address]
+	add	eax, 0x2000
+	shr	eax, 12
+	shl	ax, 2
+	add	ax, word ptr [table_offset]
+	mov	si, ax
+	mov	di, word ptr [directory_offset]
+	add	di, 0x2000
+
+	mov	ebp, 200000
+3:
+	mov	bx, bp
+	and	bx, 3
+	shl	bx, 2
+	and	byte ptr [si+bx], 0xfe
+	mov	eax, cr3
+	mov	cr3, eax
+	shl	bx, 10
+	mov	word ptr [di+bx], bp
+	dec	ebp
+	jnz	3b
+
+	# Back to real mode, with the real-mode interrupt table
+	mov	eax, cr0
+	and	eax, 0x7ffffffe
+	mov	cr0, eax
+	push	word ptr [real_segment]
+	push	offset real_mode
+	retf
+
+real_mode:
+	mov	ax, cs
+	mov	ds, ax
+	mov	es, ax
+	mov	ss, ax
+	lidt	[real_idtr]
+	sti
+
+	mov	ax, 0x4c00
+	int	0x21
+
+fail:
+	mov	ax, 0x4c01
+	int	0x21
+
+
+# Marks the faulting page present again. Interrupts reach us through a 386 gate,
+# so the error code and return address are 32 bits wide.
+page_fault:
+	push	eax
+	push	bx
+	mov	eax, cr2
+	shr	eax, 12
+	shl	ax, 2
+	mov	bx, ax
+	add	bx, word ptr [table_offset]
+	or	byte ptr [bx], 1
+	pop	bx
+	pop	eax
+	add	sp, 4
+	iretd
+
+
+	.balign	8
+gdt:
+	.quad	0
+gdt_code:
+	.word	0xffff, 0
+	.byte	0, 0x9a, 0, 0
+gdt_data:
+	.word	0xffff, 0
+	.byte	0, 0x92, 0, 0
+gdt_end:
+
+idt:
+	.fill	14, 8, 0
+	.word	page_fault, CODE_SELECTOR
+	.byte	0, 0x8e
+	.word	0
+idt_end:
+
+gdtr:
+	.word	gdt_end - gdt - 1
+	.long	0
+idtr:
+	.word	idt_end - idt - 1
+	.long	0
+real_idtr:
+	.word	0x3ff
+	.long	0
+
+real_segment:
+	.word	0
+directory_offset:
+	.word	0
+table_offset:
+	.word	0
+directory_address:
+	.long	0
+
+end_of_code:
@@ -0,0 +1,23 @@
+# BXSMC.COM: a loop that rewrites the immediate operand of one of its own instructions
+# before executing it, as self-modifying games do. Each iteration executes 6 instructions.
+
+	.intel_syntax noprefix
+	.code16
+	.text
+	.globl _start
+_start:
+	mov	ecx, 1000000
+	xor	ax, ax
+	xor	bx, bx
+	xor	dx, dx
+1:
+	inc	bl
+	mov	byte ptr [patch+1], bl
+patch:
+	add	al, 0
+	add	dx, ax
+	dec	ecx
+	jnz	1b
+
+	mov	ax, 0x4c00
+	int	0x21
@@ -0,0 +1,40 @@
+# BXSTRING.COM: repeated block fills, copies and compares over 16KB buffers.
+# Each iteration executes 36864 repeated string operations and 14 other instructions.
+
+	.intel_syntax noprefix
+	.code16
+	.text
+	.globl _start
+
+	.set	SOURCE, 0x2000
+	.set	DESTINATION, 0x6000
+
+_start:
+	cld
+	mov	edx, 2000
+1:
+	mov	di, DESTINATION
+	mov	cx, 8192
+	mov	ax, 0x5555
+	rep stosw
+
+	mov	si, SOURCE
+	mov	di, DESTINATION
+	mov	cx, 8192
+	rep movsw
+
+	mov	si, SOURCE
+	mov	di, DESTINATION
+	mov	cx, 4096
+	rep movsd
+
+	mov	si, SOURCE
+	mov	di, DESTINATION
+	mov	cx, 16384
+	repe cmpsb
+
+	dec	edx
+	jnz	1b
+
+	mov	ax, 0x4c00
+	int	0x21
@@ -0,0 +1,84 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+//The guest programs run by BXCPUBenchmark, assembled from the .s files alongside this one with:
+//  as --32 -o NAME.o NAME.s && ld -m elf_i386 -Ttext 0x100 --oformat binary -o NAME.COM NAME.o
+//Regenerate this file whenever those sources change.
+
+#ifndef BOXER_CPU_WORKLOADS_H
+#define BOXER_CPU_WORKLOADS_H
+
+
+static unsigned char BXINT_COM[41] = {
+	0x66, 0xb9, 0x00, 0x12, 0x7a, 0x00, 0x31, 0xc0, 0xbb, 0x34, 0x12, 0x31, 0xd2, 0x31, 0xf6, 0x31,
+	0xff, 0x01, 0xd8, 0x31, 0xc2, 0xd1, 0xc3, 0x29, 0xd6, 0x01, 0x06, 0x27, 0x01, 0x47, 0x66, 0x49,
+	0x75, 0xef, 0xb8, 0x00, 0x4c, 0xcd, 0x21, 0x00, 0x00,
+};
+
+static unsigned char BXSTRING_COM[61] = {
+	0xfc, 0x66, 0xba, 0xd0, 0x07, 0x00, 0x00, 0xbf, 0x00, 0x60, 0xb9, 0x00, 0x20, 0xb8, 0x55, 0x55,
+	0xf3, 0xab, 0xbe, 0x00, 0x20, 0xbf, 0x00, 0x60, 0xb9, 0x00, 0x20, 0xf3, 0xa5, 0xbe, 0x00, 0x20,
+	0xbf, 0x00, 0x60, 0xb9, 0x00, 0x10, 0x66, 0xf3, 0xa5, 0xbe, 0x00, 0x20, 0xbf, 0x00, 0x60, 0xb9,
+	0x00, 0x40, 0xf3, 0xa6, 0x66, 0x4a, 0x75, 0xcf, 0xb8, 0x00, 0x4c, 0xcd, 0x21,
+};
+
+static unsigned char BXFPU_COM[68] = {
+	0xdb, 0xe3, 0xd9, 0xe8, 0xdd, 0x06, 0x30, 0x01, 0x66, 0xb9, 0x40, 0x4b, 0x4c, 0x00, 0xdc, 0xc9,
+	0xd9, 0xc1, 0xd9, 0xfa, 0xdc, 0x06, 0x38, 0x01, 0xdd, 0x1e, 0x38, 0x01, 0xdd, 0x06, 0x38, 0x01,
+	0xdb, 0x1e, 0x40, 0x01, 0x66, 0x49, 0x75, 0xe6, 0xdb, 0xe3, 0xb8, 0x00, 0x4c, 0xcd, 0x21, 0x90,
+	0x9b, 0xf2, 0xd7, 0x1a, 0x00, 0x00, 0xf0, 0x3f, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00,
+};
+
+static unsigned char BXSMC_COM[31] = {
+	0x66, 0xb9, 0x40, 0x42, 0x0f, 0x00, 0x31, 0xc0, 0x31, 0xdb, 0x31, 0xd2, 0xfe, 0xc3, 0x88, 0x1e,
+	0x13, 0x01, 0x04, 0x00, 0x01, 0xc2, 0x66, 0x49, 0x75, 0xf2, 0xb8, 0x00, 0x4c, 0xcd, 0x21,
+};
+
+static unsigned char BXPAGING_COM[500] = {
+	0x0f, 0x01, 0xe0, 0xa8, 0x01, 0x0f, 0x85, 0x17, 0x01, 0xfa, 0x66, 0x31, 0xdb, 0x8c, 0xcb, 0x89,
+	0x1e, 0xea, 0x02, 0x66, 0xc1, 0xe3, 0x04, 0x66, 0x89, 0xd8, 0xa3, 0x52, 0x02, 0xa3, 0x5a, 0x02,
+	0x66, 0xc1, 0xe8, 0x10, 0xa2, 0x54, 0x02, 0xa2, 0x5c, 0x02, 0x67, 0x66, 0x8d, 0x83, 0x48, 0x02,
+	0x00, 0x00, 0x66, 0xa3, 0xda, 0x02, 0x67, 0x66, 0x8d, 0x83, 0x60, 0x02, 0x00, 0x00, 0x66, 0xa3,
+	0xe0, 0x02, 0x67, 0x66, 0x8d, 0x83, 0xf3, 0x12, 0x00, 0x00, 0x66, 0x25, 0x00, 0xf0, 0xff, 0xff,
+	0x66, 0xa3, 0xf0, 0x02, 0x66, 0x89, 0xc7, 0x66, 0x29, 0xdf, 0x89, 0x3e, 0xec, 0x02, 0x66, 0x31,
+	0xc0, 0xb9, 0x00, 0x04, 0x66, 0xf3, 0xab, 0x89, 0x3e, 0xee, 0x02, 0x66, 0xb8, 0x03, 0x00, 0x00,
+	0x00, 0xb9, 0x00, 0x04, 0x66, 0xab, 0x66, 0x05, 0x00, 0x10, 0x00, 0x00, 0xe2, 0xf6, 0x8b, 0x3e,
+	0xec, 0x02, 0x66, 0xa1, 0xf0, 0x02, 0x66, 0x05, 0x03, 0x10, 0x00, 0x00, 0x66, 0x89, 0x05, 0x0f,
+	0x01, 0x16, 0xd8, 0x02, 0x0f, 0x01, 0x1e, 0xde, 0x02, 0x66, 0xa1, 0xf0, 0x02, 0x0f, 0x22, 0xd8,
+	0x0f, 0x20, 0xc0, 0x66, 0x0d, 0x01, 0x00, 0x00, 0x80, 0x0f, 0x22, 0xc0, 0xea, 0xb1, 0x01, 0x08,
+	0x00, 0xb8, 0x10, 0x00, 0x8e, 0xd8, 0x8e, 0xc0, 0x8e, 0xd0, 0x66, 0xa1, 0xf0, 0x02, 0x66, 0x05,
+	0x00, 0x20, 0x00, 0x00, 0x66, 0xc1, 0xe8, 0x0c, 0xc1, 0xe0, 0x02, 0x03, 0x06, 0xee, 0x02, 0x89,
+	0xc6, 0x8b, 0x3e, 0xec, 0x02, 0x81, 0xc7, 0x00, 0x20, 0x66, 0xbd, 0x40, 0x0d, 0x03, 0x00, 0x89,
+	0xeb, 0x83, 0xe3, 0x03, 0xc1, 0xe3, 0x02, 0x80, 0x20, 0xfe, 0x0f, 0x20, 0xd8, 0x0f, 0x22, 0xd8,
+	0xc1, 0xe3, 0x0a, 0x89, 0x29, 0x66, 0x4d, 0x75, 0xe6, 0x0f, 0x20, 0xc0, 0x66, 0x25, 0xfe, 0xff,
+	0xff, 0x7f, 0x0f, 0x22, 0xc0, 0xff, 0x36, 0xea, 0x02, 0x68, 0x0d, 0x02, 0xcb, 0x8c, 0xc8, 0x8e,
+	0xd8, 0x8e, 0xc0, 0x8e, 0xd0, 0x0f, 0x01, 0x1e, 0xe4, 0x02, 0xfb, 0xb8, 0x00, 0x4c, 0xcd, 0x21,
+	0xb8, 0x01, 0x4c, 0xcd, 0x21, 0x66, 0x50, 0x53, 0x0f, 0x20, 0xd0, 0x66, 0xc1, 0xe8, 0x0c, 0xc1,
+	0xe0, 0x02, 0x89, 0xc3, 0x03, 0x1e, 0xee, 0x02, 0x80, 0x0f, 0x01, 0x5b, 0x66, 0x58, 0x83, 0xc4,
+	0x04, 0x66, 0xcf, 0x8d, 0xb4, 0x00, 0x00, 0x90, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0xff, 0xff, 0x00, 0x00, 0x00, 0x9a, 0x00, 0x00, 0xff, 0xff, 0x00, 0x00, 0x00, 0x92, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x25, 0x02, 0x08, 0x00, 0x00, 0x8e, 0x00, 0x00, 0x17, 0x00, 0x00, 0x00, 0x00, 0x00, 0x77, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0xff, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00,
+};
+
+static unsigned char BXBITS_COM[55] = {
+	0x66, 0xb9, 0x00, 0x09, 0x3d, 0x00, 0x66, 0xb8, 0x78, 0x56, 0x34, 0x12, 0x66, 0x31, 0xd2, 0xbe,
+	0x21, 0x84, 0x66, 0x89, 0xc3, 0x66, 0xd3, 0xe3, 0x66, 0xc1, 0xe8, 0x03, 0x66, 0x01, 0xd8, 0xd1,
+	0xfe, 0x31, 0xc6, 0x66, 0x0f, 0xbc, 0xf8, 0x0f, 0xbd, 0xde, 0x01, 0xfa, 0x01, 0xda, 0x66, 0x49,
+	0x75, 0xe0, 0xb8, 0x00, 0x4c, 0xcd, 0x21,
+};
+
+#endif
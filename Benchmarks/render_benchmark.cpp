@@ -0,0 +1,491 @@
+/*
+ *  Copyright (C) 2002-2010  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+//--Added: a standalone microbenchmark for the render path, built as the Render Benchmark target.
+//Feeds synthetic frames (and optionally raw captured ones) through every scaler and bit depth
+//combination in render_scalers.cpp, and through the VGA line handlers in vga_draw.cpp, and
+//reports the time per source pixel and the bytes moved per frame for each.
+//
+//Usage: render_benchmark [-n frames] [-only name] [-capture path width height bpp]...
+//	-n			the number of frames to time for each case (default 200)
+//	-only		only run cases whose name contains this text
+//	-capture	also run the scalers over a raw framebuffer dump: width*height pixels of
+//				bpp 8, 15, 16 or 32, tightly packed in host byte order
+//
+//Scalers are timed both with every line changed since the previous frame, which is the
+//cost of redrawing the whole screen, and with nothing changed, which is the cost of
+//comparing each line against the render cache.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mach/mach_time.h>
+#include <vector>
+#include <string>
+
+//The VGA line handlers are private to vga_draw.cpp, so compile it as part of this file
+//to get at them. The rest of the emulator is stubbed out below.
+#include "../DOSBox/src/hardware/vga_draw.cpp"
+
+
+#pragma mark -
+#pragma mark Stubs for the rest of the emulator
+
+VGA_Type vga;
+SVGA_Driver svga;
+SVGACards svgaCard=SVGA_None;
+MachineType machine=MCH_VGA;
+
+Bit32u CGA_2_Table[16];
+Bit32u CGA_4_Table[256];
+Bit32u CGA_4_HiRes_Table[256];
+Bit32u TXT_Font_Table[16];
+Bit32u TXT_FG_Table[16];
+Bit32u TXT_BG_Table[16];
+
+Render_t render;
+ScalerLineHandler_t RENDER_DrawLine;
+
+Bitu PIC_Ticks=0;
+Bit32s CPU_Cycles=0;
+Bit32s CPU_CycleLeft=0;
+Bit32s CPU_CycleMax=0;
+
+bool perf_enabled=false;
+Bit8u perf_current=PERF_OTHER;
+Bit64u perf_last=0;
+Bit64u perf_ticks[PERF_COUNTER_COUNT];
+
+void PIC_ActivateIRQ(Bitu irq) {}
+void PIC_DeActivateIRQ(Bitu irq) {}
+void PIC_AddEvent(PIC_EventHandler handler,float delay,Bitu val) {}
+void PIC_RemoveEvents(PIC_EventHandler handler) {}
+
+void RENDER_SetSize(Bitu width,Bitu height,Bitu bpp,float fps,double ratio,bool dblw,bool dblh) {}
+bool RENDER_StartUpdate(void) { return false; }
+void RENDER_EndUpdate(bool abort) {}
+
+void boxer_die(char const *functionName, char const *fileName, int lineNumber, char const* format,...) {
+	fprintf(stderr,"Fatal error in %s (%s:%d)\n",functionName,fileName,lineNumber);
+	exit(EXIT_FAILURE);
+}
+
+
+#pragma mark -
+#pragma mark Timing and reporting
+
+static Bitu bench_frames=200;
+static const char * bench_only=0;
+
+static double BENCH_Seconds(Bit64u ticks) {
+	static double seconds_per_tick=0;
+	if (!seconds_per_tick) {
+		mach_timebase_info_data_t timebase;
+		mach_timebase_info(&timebase);
+		seconds_per_tick=((double)timebase.numer/(double)timebase.denom)/1000000000.0;
+	}
+	return (double)ticks*seconds_per_tick;
+}
+
+static bool BENCH_Wanted(const std::string & name) {
+	return !bench_only || name.find(bench_only)!=std::string::npos;
+}
+
+static void BENCH_Report(const std::string & name,Bitu pixels,Bitu bytes,Bit64u ticks) {
+	double seconds=BENCH_Seconds(ticks);
+	double ns_per_pixel=seconds*1000000000.0/((double)pixels*bench_frames);
+	double mb_per_second=seconds>0 ? ((double)bytes*bench_frames)/(seconds*1024*1024) : 0;
+	printf("%-44s %8.3f ns/px %10lu bytes/frame %10.1f MB/s\n",
+		name.c_str(),ns_per_pixel,(unsigned long)bytes,mb_per_second);
+}
+
+
+#pragma mark -
+#pragma mark Frames
+
+struct BenchFrame {
+	std::string name;
+	Bitu width,height,bpp;
+	std::vector<Bit8u> pixels[2];	// the frame, and a copy with every pixel changed
+
+	Bitu PixelSize(void) const { return (bpp+7)/8; }
+	Bitu Pitch(void) const { return width*PixelSize(); }
+	const Bit8u * Line(Bitu which,Bitu y) const { return &pixels[which][y*Pitch()]; }
+};
+
+// Flips the lowest bit of every channel, so that each pixel of the copy differs from
+// the original while keeping the same overall structure.
+static void BENCH_MakeChangedCopy(BenchFrame & frame) {
+	frame.pixels[1]=frame.pixels[0];
+	Bitu size=frame.pixels[1].size();
+	Bit8u * p=&frame.pixels[1][0];
+	switch (frame.bpp) {
+	case 8:
+		for (Bitu i=0;i<size;i++) p[i]^=0x01;
+		break;
+	case 15:
+	case 16:
+		for (Bitu i=0;i<size;i+=2) *(Bit16u *)(p+i)^=0x0001;
+		break;
+	case 32:
+		for (Bitu i=0;i<size;i+=4) *(Bit32u *)(p+i)^=0x00010101;
+		break;
+	}
+}
+
+// A mix of flat areas, gradients and noise, so that the scalers which look at
+// neighbouring pixels take all of their paths.
+static BenchFrame BENCH_SyntheticFrame(Bitu width,Bitu height,Bitu bpp) {
+	BenchFrame frame;
+	char name[32];
+	sprintf(name,"%lux%lu",(unsigned long)width,(unsigned long)height);
+	frame.name=name;
+	frame.width=width;
+	frame.height=height;
+	frame.bpp=bpp;
+	frame.pixels[0].resize(frame.Pitch()*height+sizeof(Bitu));
+	Bit32u seed=12345;
+	for (Bitu y=0;y<height;y++) {
+		for (Bitu x=0;x<width;x++) {
+			seed=seed*1103515245+12345;
+			Bit32u value;
+			if (y<height/3) value=0x20;							// flat
+			else if (y<2*height/3) value=(Bit32u)(x+y);			// gradient
+			else value=seed>>16;								// noise
+			Bit8u * p=&frame.pixels[0][y*frame.Pitch()+x*frame.PixelSize()];
+			switch (bpp) {
+			case 8: *p=(Bit8u)value; break;
+			case 15: *(Bit16u *)p=(Bit16u)(((value&0x1f)<<10)|(((value>>2)&0x1f)<<5)|((value>>4)&0x1f)); break;
+			case 16: *(Bit16u *)p=(Bit16u)(((value&0x1f)<<11)|(((value>>2)&0x3f)<<5)|((value>>4)&0x1f)); break;
+			case 32: *(Bit32u *)p=((value&0xff)<<16)|(((value*3)&0xff)<<8)|((value*7)&0xff); break;
+			}
+		}
+	}
+	BENCH_MakeChangedCopy(frame);
+	return frame;
+}
+
+static bool BENCH_LoadCapture(const char * path,Bitu width,Bitu height,Bitu bpp,BenchFrame & frame) {
+	if (bpp!=8 && bpp!=15 && bpp!=16 && bpp!=32) return false;
+	if (!width || !height || width>SCALER_MAXWIDTH || height>SCALER_MAXHEIGHT) return false;
+	frame.name=path;
+	frame.width=width;
+	frame.height=height;
+	frame.bpp=bpp;
+	frame.pixels[0].resize(frame.Pitch()*height+sizeof(Bitu));
+	FILE * file=fopen(path,"rb");
+	if (!file) return false;
+	bool read=fread(&frame.pixels[0][0],frame.Pitch(),height,file)==height;
+	fclose(file);
+	if (read) BENCH_MakeChangedCopy(frame);
+	return read;
+}
+
+
+#pragma mark -
+#pragma mark Scalers
+
+struct BenchScaler {
+	const char * name;
+	ScalerSimpleBlock_t * simple;
+	ScalerComplexBlock_t * complex;
+};
+
+static const BenchScaler bench_scalers[]={
+	{"Normal1x",&ScaleNormal1x,0},
+	{"NormalDw",&ScaleNormalDw,0},
+	{"NormalDh",&ScaleNormalDh,0},
+	{"Normal2x",&ScaleNormal2x,0},
+	{"Normal3x",&ScaleNormal3x,0},
+	{"TV2x",&ScaleTV2x,0},
+	{"TV3x",&ScaleTV3x,0},
+	{"RGB2x",&ScaleRGB2x,0},
+	{"RGB3x",&ScaleRGB3x,0},
+	{"Scan2x",&ScaleScan2x,0},
+	{"Scan3x",&ScaleScan3x,0},
+	{"AdvMame2x",0,&ScaleAdvMame2x},
+	{"AdvMame3x",0,&ScaleAdvMame3x},
+	{"AdvInterp2x",0,&ScaleAdvInterp2x},
+	{"AdvInterp3x",0,&ScaleAdvInterp3x},
+	{"HQ2x",0,&ScaleHQ2x},
+	{"HQ3x",0,&ScaleHQ3x},
+	{"2xSaI",0,&Scale2xSaI},
+	{"Super2xSaI",0,&ScaleSuper2xSaI},
+	{"SuperEagle",0,&ScaleSuperEagle},
+};
+
+static const Bitu bench_out_bpp[]={8,15,16,32};
+
+// Sets up the renderer the way RENDER_Reset would for this scaler and these depths.
+// Returns false if the scaler has no handler for the combination.
+static bool BENCH_SetupScaler(const BenchScaler & scaler,ScalerLineHandler_t direct,const BenchFrame & frame,
+							  Bitu in_index,Bitu out_mode,Bitu & xscale,Bitu & yscale) {
+	ScalerLineBlock_t * line_block;
+	if (scaler.complex) {
+		if (frame.width>=SCALER_COMPLEXWIDTH-16 || frame.height>=SCALER_COMPLEXHEIGHT-16) return false;
+		render.scale.complexHandler=scaler.complex->Random[out_mode];
+		if (!render.scale.complexHandler) return false;
+		line_block=&ScalerCache;
+		xscale=scaler.complex->xscale;
+		yscale=scaler.complex->yscale;
+	} else {
+		render.scale.complexHandler=0;
+		line_block=&scaler.simple->Random;
+		xscale=scaler.simple->xscale;
+		yscale=scaler.simple->yscale;
+	}
+	render.scale.lineHandler=direct ? direct : (*line_block)[in_index][out_mode];
+	if (!render.scale.lineHandler) return false;
+
+	render.src.width=frame.width;
+	render.src.height=frame.height;
+	render.src.bpp=frame.bpp;
+	render.src.start=frame.Pitch()/sizeof(Bitu);
+	render.scale.cachePitch=frame.Pitch();
+	render.scale.inMode=(scalerMode_t)(in_index==4 ? scalerMode8 : in_index);
+	render.scale.outMode=(scalerMode_t)out_mode;
+	render.scale.blocks=frame.width/SCALER_BLOCKSIZE;
+	render.scale.lastBlock=frame.width%SCALER_BLOCKSIZE;
+	render.scale.inHeight=frame.height;
+
+	// as MakeAspectTable does without aspect correction: complex scalers lag a line behind
+	Bitu skip=scaler.complex ? 1 : 0;
+	for (Bitu i=0;i<skip;i++) Scaler_Aspect[i]=0;
+	for (Bitu i=skip;i<frame.height+skip;i++) Scaler_Aspect[i]=(Bit8u)yscale;
+	return true;
+}
+
+static void BENCH_DrawFrame(const BenchFrame & frame,Bitu which,Bit8u * output,Bitu output_pitch) {
+	render.scale.inLine=0;
+	render.scale.outLine=0;
+	render.scale.cacheRead=(Bit8u *)&scalerSourceCache;
+	render.scale.outWrite=output;
+	render.scale.outPitch=output_pitch;
+	Scaler_ChangedLines[0]=0;
+	Scaler_ChangedLineIndex=0;
+	for (Bitu y=0;y<frame.height;y++)
+		render.scale.lineHandler(frame.Line(which,y));
+}
+
+static void BENCH_RunScaler(const std::string & name,const BenchScaler & scaler,ScalerLineHandler_t direct,
+							const BenchFrame & frame,Bitu in_index,Bitu out_bpp) {
+	Bitu out_mode=(out_bpp==8) ? scalerMode8 : (out_bpp==15) ? scalerMode15 : (out_bpp==16) ? scalerMode16 : scalerMode32;
+	Bitu xscale,yscale;
+	if (!BENCH_SetupScaler(scaler,direct,frame,in_index,out_mode,xscale,yscale)) return;
+	if (!BENCH_Wanted(name)) return;
+
+	Bitu out_pixel=(out_bpp+7)/8;
+	Bitu output_pitch=frame.width*xscale*out_pixel;
+	std::vector<Bit8u> output(output_pitch*(frame.height+2)*yscale);
+
+	Bitu pixels=frame.width*frame.height;
+	Bitu in_bytes=frame.Pitch()*frame.height;
+	Bitu out_bytes=output_pitch*frame.height*yscale;
+
+	// Every line changed: read the source and the cache, write the cache and the output
+	memset(&scalerSourceCache,0,sizeof(scalerSourceCache));
+	BENCH_DrawFrame(frame,1,&output[0],output_pitch);
+	Bit64u start=mach_absolute_time();
+	for (Bitu i=0;i<bench_frames;i++)
+		BENCH_DrawFrame(frame,i&1,&output[0],output_pitch);
+	BENCH_Report(name+" changed",pixels,in_bytes*3+out_bytes,mach_absolute_time()-start);
+
+	// Nothing changed: read the source and the cache
+	BENCH_DrawFrame(frame,0,&output[0],output_pitch);
+	start=mach_absolute_time();
+	for (Bitu i=0;i<bench_frames;i++)
+		BENCH_DrawFrame(frame,0,&output[0],output_pitch);
+	BENCH_Report(name+" unchanged",pixels,in_bytes*2,mach_absolute_time()-start);
+}
+
+static void BENCH_Scalers(const BenchFrame & frame) {
+	// 8bpp is run twice: once as usual, and once through the handlers used after a palette change
+	static const Bitu in_indexes[]={0,4,1,2,3};
+	for (Bitu s=0;s<sizeof(bench_scalers)/sizeof(bench_scalers[0]);s++) {
+		const BenchScaler & scaler=bench_scalers[s];
+		for (Bitu i=0;i<sizeof(in_indexes)/sizeof(in_indexes[0]);i++) {
+			Bitu in_index=in_indexes[i];
+			Bitu in_bpp=(in_index==0 || in_index==4) ? 8 : (in_index==1) ? 15 : (in_index==2) ? 16 : 32;
+			if (in_bpp!=frame.bpp) continue;
+			for (Bitu o=0;o<sizeof(bench_out_bpp)/sizeof(bench_out_bpp[0]);o++) {
+				char name[128];
+				sprintf(name,"%s %lu%s->%lu %s",scaler.name,(unsigned long)in_bpp,in_index==4 ? "pal" : "",
+					(unsigned long)bench_out_bpp[o],frame.name.c_str());
+				BENCH_RunScaler(name,scaler,0,frame,in_index,bench_out_bpp[o]);
+			}
+		}
+	}
+
+	// The direct handlers RENDER_Reset uses in place of Normal1x for unscaled 32bpp output
+	ScalerLineHandler_t direct=(frame.bpp==8) ? RENDER_DirectLine8_32 : (frame.bpp==32) ? RENDER_DirectLine32_32 : 0;
+	if (direct) {
+		char name[128];
+		sprintf(name,"Direct %lu->32 %s",(unsigned long)frame.bpp,frame.name.c_str());
+		BENCH_RunScaler(name,bench_scalers[0],direct,frame,frame.bpp==8 ? 0 : 3,32);
+	}
+}
+
+
+#pragma mark -
+#pragma mark VGA line handlers
+
+struct BenchLineHandler {
+	const char * name;
+	VGA_Line_Handler handler;
+	Bitu width;			// pixels per line
+	Bitu blocks;		// vga.draw.blocks
+	Bitu line_bytes;	// video memory read per line
+	Bitu out_bytes;		// bytes written to TempLine per line, if any
+	bool tandy;			// reads through vga.tandy.draw_base rather than vga.draw.linear_base
+};
+
+static const Bitu bench_vga_memory=512*1024;
+
+static void BENCH_SetupVGA(std::vector<Bit8u> & memory) {
+	memory.resize(bench_vga_memory*2);
+	Bit32u seed=54321;
+	for (Bitu i=0;i<memory.size();i++) {
+		seed=seed*1103515245+12345;
+		memory[i]=(Bit8u)(seed>>16);
+	}
+	for (Bitu i=0;i<16;i++) {
+		CGA_2_Table[i]=i*0x01010101;
+		TXT_Font_Table[i]=(i&1 ? 0xff000000 : 0)|(i&2 ? 0xff0000 : 0)|(i&4 ? 0xff00 : 0)|(i&8 ? 0xff : 0);
+		TXT_FG_Table[i]=i*0x01010101;
+		TXT_BG_Table[i]=(15-i)*0x01010101;
+	}
+	for (Bitu i=0;i<256;i++) {
+		CGA_4_Table[i]=i*0x01010101;
+		CGA_4_HiRes_Table[i]=i*0x01010101;
+		vga.dac.xlat16[i]=(Bit16u)(i*0x0101);
+	}
+	vga.draw.linear_base=&memory[0];
+	vga.draw.linear_mask=bench_vga_memory-1;
+	vga.tandy.draw_base=&memory[0];
+	vga.tandy.line_mask=3;
+	vga.tandy.line_shift=13;
+	vga.tandy.addr_mask=8*1024-1;
+	vga.draw.font_tables[0]=&memory[0];
+	vga.draw.font_tables[1]=&memory[64*1024];
+	vga.draw.cursor.enabled=0;
+}
+
+static void BENCH_RunLineHandler(const BenchLineHandler & line) {
+	std::string name=std::string("VGA ")+line.name;
+	if (!BENCH_Wanted(name)) return;
+
+	vga.draw.blocks=line.blocks;
+	vga.draw.line_length=line.line_bytes;
+	vga.draw.width=line.width;
+
+	const Bitu lines=200;
+	Bitu sink=0;
+	Bit64u start=mach_absolute_time();
+	for (Bitu i=0;i<bench_frames;i++) {
+		Bitu vidstart=0;
+		for (Bitu y=0;y<lines;y++) {
+			Bit8u * drawn=line.handler(vidstart,y&15);
+			if (drawn) sink+=drawn[0];
+			vidstart+=line.tandy ? line.line_bytes/2 : line.line_bytes;
+		}
+	}
+	Bit64u ticks=mach_absolute_time()-start;
+	BENCH_Report(name,line.width*lines,(line.line_bytes+line.out_bytes)*lines,ticks+(sink&0));
+}
+
+static void BENCH_LineHandlers(void) {
+	std::vector<Bit8u> memory;
+	BENCH_SetupVGA(memory);
+
+	// The linear handlers only return a pointer into video memory, which the scaler then reads
+	const BenchLineHandler handlers[]={
+		{"Linear 320x200",			VGA_Draw_Linear_Line,		320,	80,		320,	0,		false},
+		{"Linear 640x480",			VGA_Draw_Linear_Line,		640,	160,	640,	0,		false},
+		{"Linear 800x600 16bpp",	VGA_Draw_Linear_Line,		800,	200,	1600,	0,		false},
+		{"Xlat16 320x200",			VGA_Draw_Xlat16_Linear_Line,320,	80,		320,	640,	false},
+		{"4BPP 320x200",			VGA_Draw_4BPP_Line,			320,	80,		160,	320,	true},
+		{"4BPP double 160x200",		VGA_Draw_4BPP_Line_Double,	320,	80,		80,		320,	true},
+		{"2BPP 320x200",			VGA_Draw_2BPP_Line,			320,	80,		80,		320,	true},
+		{"2BPP hires 640x200",		VGA_Draw_2BPPHiRes_Line,	640,	80,		160,	640,	true},
+		{"1BPP 640x200",			VGA_Draw_1BPP_Line,			640,	80,		80,		640,	true},
+		{"CGA16 640x200",			VGA_Draw_CGA16_Line,		640,	80,		80,		640,	true},
+		{"Text 80x25",				VGA_TEXT_Draw_Line,			640,	80,		160,	640,	false},
+		{"Text xlat16 80x25",		VGA_TEXT_Xlat16_Draw_Line,	640,	80,		160,	1280,	false},
+	};
+	for (Bitu i=0;i<sizeof(handlers)/sizeof(handlers[0]);i++)
+		BENCH_RunLineHandler(handlers[i]);
+
+#ifdef VGA_KEEP_CHANGES
+	// The changed-memory check on its own, with nothing changed so that every line is skipped
+	std::vector<Bit8u> map(((bench_vga_memory*2)>>VGA_CHANGE_SHIFT)+32,0);
+	vga.changes.map=&map[0];
+	vga.changes.checkMask=1;
+	vga.changes.span=320;
+	VGA_Changes_Draw_Line=VGA_Draw_Linear_Line;
+	const BenchLineHandler changes={"Changes 320x200 unchanged",VGA_Draw_Changes_Line,320,80,320,0,false};
+	BENCH_RunLineHandler(changes);
+	vga.changes.map=0;
+#endif
+}
+
+
+#pragma mark -
+#pragma mark Main
+
+int main(int argc,char * argv[]) {
+	std::vector<BenchFrame> frames;
+	for (int i=1;i<argc;i++) {
+		if (!strcmp(argv[i],"-n") && i+1<argc) {
+			bench_frames=strtoul(argv[++i],0,10);
+			if (!bench_frames) bench_frames=1;
+		} else if (!strcmp(argv[i],"-only") && i+1<argc) {
+			bench_only=argv[++i];
+		} else if (!strcmp(argv[i],"-capture") && i+4<argc) {
+			BenchFrame frame;
+			const char * path=argv[i+1];
+			if (!BENCH_LoadCapture(path,strtoul(argv[i+2],0,10),strtoul(argv[i+3],0,10),strtoul(argv[i+4],0,10),frame)) {
+				fprintf(stderr,"Could not load capture %s\n",path);
+				return EXIT_FAILURE;
+			}
+			frames.push_back(frame);
+			i+=4;
+		} else {
+			fprintf(stderr,"Usage: %s [-n frames] [-only name] [-capture path width height bpp]...\n",argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	static const Bitu synthetic_bpp[]={8,15,16,32};
+	for (Bitu i=0;i<sizeof(synthetic_bpp)/sizeof(synthetic_bpp[0]);i++) {
+		frames.push_back(BENCH_SyntheticFrame(320,200,synthetic_bpp[i]));
+		frames.push_back(BENCH_SyntheticFrame(640,480,synthetic_bpp[i]));
+	}
+
+	// a plain greyscale palette, so that 8bpp output is meaningful
+	for (Bitu i=0;i<256;i++) {
+		render.pal.rgb[i].red=render.pal.rgb[i].green=render.pal.rgb[i].blue=(Bit8u)i;
+		render.pal.lut.b32[i]=(Bit32u)(i<<16|i<<8|i);
+	}
+
+	printf("%lu frames per case\n",(unsigned long)bench_frames);
+	for (Bitu i=0;i<frames.size();i++)
+		BENCH_Scalers(frames[i]);
+	BENCH_LineHandlers();
+	return EXIT_SUCCESS;
+}
+//--End of modifications
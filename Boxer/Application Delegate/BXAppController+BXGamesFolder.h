@@ -12,6 +12,7 @@
 //with the app delegate or its lifecycle.
 
 #import "BXAppController.h"
+#import "BXGamesFolderIndex.h"
 
 #pragma mark -
 #pragma mark Constants
@@ -45,6 +46,10 @@ enum {
 //IMPLEMENTATION NOTE: this will detect and import an older games folder from Boxer 0.8x automatically.
 @property (copy, nonatomic) NSURL *gamesFolderURL;
 
+//A persistent index of the gameboxes in the games folder, which is kept up to date
+//as the folder's contents change. Will be nil if no games folder has been chosen.
+@property (readonly, nonatomic) BXGamesFolderIndex *gamesFolderIndex;
+
 //The icon of the games folder path. This is used for UIs that need to display the games folder.
 @property (readonly, nonatomic) NSImage *gamesFolderIcon;
 
@@ -53,6 +53,13 @@ NSString * const BXGamesFolderBookmarkUserDefaultsKey = @"gamesFolderURLBookmark
 //This is dependent on the Finder version and the current graphics chipset.
 - (NSSize) _shelfArtworkSize;
 
+//The location at which shelf artwork for the current screen will be stored,
+//regardless of whether it has been generated yet.
+- (NSURL *) _shelfArtworkLocation;
+
+//Replaces the games folder index with one for the current games folder.
+- (void) _rebuildGamesFolderIndex;
+
 //Callback for the 'we-couldnt-find-your-games-folder' sheet.
 - (void) _gamesFolderPromptDidEnd: (NSAlert *)alert
 					   returnCode: (NSInteger)returnCode
@@ -189,7 +196,7 @@ NSString * const BXGamesFolderBookmarkUserDefaultsKey = @"gamesFolderURLBookmark
 }
 
 
-- (NSURL *) shelfArtworkURL
+- (NSURL *) _shelfArtworkLocation
 {
     BOOL useRetinaAssets = NO;
     //10.7 and up
@@ -203,8 +210,16 @@ NSString * const BXGamesFolderBookmarkUserDefaultsKey = @"gamesFolderURLBookmark
 	NSURL *artworkFolderURL = [supportURL URLByAppendingPathComponent: @"Shelf artwork"];
     
 	NSString *artworkName = useRetinaAssets ? @"Shelves@2x.jpg" : @"Shelves.jpg";
-	NSURL *artworkURL = [artworkFolderURL URLByAppendingPathComponent: artworkName];
-	
+	return [artworkFolderURL URLByAppendingPathComponent: artworkName];
+}
+
+- (NSURL *) shelfArtworkURL
+{
+    NSURL *artworkURL = self._shelfArtworkLocation;
+    if (!artworkURL) return nil;
+    
+    NSURL *artworkFolderURL = artworkURL.URLByDeletingLastPathComponent;
+    
 	//If there's no suitable artwork yet, then generate a new image
 	if (![artworkURL checkResourceIsReachableAndReturnError: NULL])
 	{
@@ -283,6 +298,7 @@ NSString * const BXGamesFolderBookmarkUserDefaultsKey = @"gamesFolderURLBookmark
             if (folderURL)
             {
                 _gamesFolderURL = [folderURL.fileReferenceURL copy];
+                [self _rebuildGamesFolderIndex];
                 
                 //Re-save the bookmark data if it was stale (e.g. if the folder has moved or been renamed.)
                 if (dataIsStale)
@@ -377,6 +393,7 @@ NSString * const BXGamesFolderBookmarkUserDefaultsKey = @"gamesFolderURLBookmark
 	{
 		[_gamesFolderURL release];
 		_gamesFolderURL = [newURL.fileReferenceURL retain];
+        [self _rebuildGamesFolderIndex];
 		
         //Store the new location in user defaults as a bookmark, so that users can safely move the folder around.
 		if (newURL != nil)
@@ -395,6 +412,29 @@ NSString * const BXGamesFolderBookmarkUserDefaultsKey = @"gamesFolderURLBookmark
 	}
 }
 
+- (BXGamesFolderIndex *) gamesFolderIndex
+{
+    //Make sure the games folder has been resolved, which will create the index for it.
+    [self gamesFolderURL];
+    return [[_gamesFolderIndex retain] autorelease];
+}
+
+- (void) _rebuildGamesFolderIndex
+{
+    [_gamesFolderIndex stopIndexing];
+    [_gamesFolderIndex release];
+    _gamesFolderIndex = nil;
+    
+    NSURL *supportURL = [self supportURLCreatingIfMissing: NO error: NULL];
+    if (_gamesFolderURL && supportURL)
+    {
+        NSURL *indexURL = [supportURL URLByAppendingPathComponent: @"Games Folder Index.plist"];
+        _gamesFolderIndex = [[BXGamesFolderIndex alloc] initWithGamesFolderURL: _gamesFolderURL.filePathURL
+                                                                      indexURL: indexURL];
+        [_gamesFolderIndex startIndexing];
+    }
+}
+
 + (BOOL) _isReservedURL: (NSURL *)URL
 {
 	//Reject reserved paths
@@ -622,8 +662,8 @@ NSString * const BXGamesFolderBookmarkUserDefaultsKey = @"gamesFolderURLBookmark
                      andSubFolders: (BOOL)applyToSubFolders
                  switchToShelfMode: (BOOL)switchMode
 {
-	//NOTE: if no shelf artwork could be found or generated, then bail out early
-	NSURL *backgroundImageURL = self.shelfArtworkURL;
+	//NOTE: if there's nowhere to put the shelf artwork, then bail out early
+	NSURL *backgroundImageURL = self._shelfArtworkLocation;
     if (!backgroundImageURL)
         return;
 	
@@ -635,6 +675,24 @@ NSString * const BXGamesFolderBookmarkUserDefaultsKey = @"gamesFolderURLBookmark
 	
     applicator.appliesToSubFolders = applyToSubFolders;
     applicator.switchToIconView = switchMode;
+    
+    //If we're styling the games folder, we can skip the walk through its subfolders
+    //and use the folders that our index knows contain gameboxes.
+    BXGamesFolderIndex *index = _gamesFolderIndex;
+    if (applyToSubFolders && index.isLoaded && [URL.filePathURL isEqual: index.gamesFolderURL.filePathURL])
+        applicator.subFolderURLs = index.foldersContainingGameboxes;
+    
+    //Rendering the shelf artwork is slow, so if it hasn't been generated yet then do so
+    //on our operation queue rather than holding up the UI. (If generation fails, the
+    //applicator will find no background image and will bail out.)
+    if (![backgroundImageURL checkResourceIsReachableAndReturnError: NULL])
+    {
+        NSBlockOperation *artworkGenerator = [NSBlockOperation blockOperationWithBlock: ^{
+            [self shelfArtworkURL];
+        }];
+        [applicator addDependency: artworkGenerator];
+        [self.generalQueue addOperation: artworkGenerator];
+    }
 	
 	for (id operation in self.generalQueue.operations)
 	{
@@ -667,6 +725,10 @@ NSString * const BXGamesFolderBookmarkUserDefaultsKey = @"gamesFolderURLBookmark
 																		  appearanceFromURL: parentURL];
 	
 	[remover setAppliesToSubFolders: applyToSubFolders];
+    
+    BXGamesFolderIndex *index = _gamesFolderIndex;
+    if (applyToSubFolders && index.isLoaded && [URL.filePathURL isEqual: index.gamesFolderURL.filePathURL])
+        remover.subFolderURLs = index.foldersContainingGameboxes;
 	
 	for (id operation in self.generalQueue.operations)
 	{
@@ -19,9 +19,11 @@ enum {
 };
 
 @class BXInspectorController;
+@class BXGamesFolderIndex;
 @interface BXAppController : BXBaseAppController
 {
 	NSURL *_gamesFolderURL;
+    BXGamesFolderIndex *_gamesFolderIndex;
 }
 
 //Returns YES if there are other Boxer processes currently running, no otherwise.
@@ -17,6 +17,7 @@
 
 #import "BXSession+BXFileManagement.h"
 #import "BXGamebox.h"
+#import "BXGameProfile.h"
 #import "BXImportSession.h"
 #import "BXEmulator.h"
 #import "BXMIDIDeviceMonitor.h"
@@ -39,7 +40,10 @@ NSString * const BXActivateOnLaunchParam = @"--activateOnLaunch";
 
 
 //Because we can only run one emulation session at a time, we need to launch a second
-//Boxer process for opening additional/subsequent documents
+//Boxer process for opening additional/subsequent documents. DOSBox keeps its machine in
+//global state, so one emulator per process is a hard limit: running each session in its own
+//process is also what lets several games run in parallel on separate cores, and keeps a crash
+//in one game from taking the others down with it.
 - (void) _launchProcessWithDocumentAtURL: (NSURL *)URL extraArguments: (NSArray *)extraArgs;
 - (void) _launchProcessWithImportSessionAtURL: (NSURL *)URL extraArguments: (NSArray *)extraArgs;
 - (void) _launchProcessWithUntitledDocumentAndExtraArguments: (NSArray *)extraArgs;
@@ -134,6 +138,12 @@ NSString * const BXActivateOnLaunchParam = @"--activateOnLaunch";
 			[self openImportSessionWithContentsOfURL: [NSURL fileURLWithPath: importPath] display: YES error: nil];
 		}
 	}
+
+    //Build the game profile lookup tables in the background, so that the first
+    //game launch or import doesn't have to wait for them.
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0), ^{
+        [BXGameProfile prepareProfileCatalogue];
+    });
 }
 
 //If no other window was opened during startup, show our startup window.
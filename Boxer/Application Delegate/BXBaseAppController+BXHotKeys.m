@@ -19,9 +19,8 @@
 //http://joshua.nozzi.name/2010/10/catching-media-key-events/
 
 
-/// The event subtype for media key events, used to distinguish them from other kinds
-/// of private system events.
-#define BXMediaKeyEventSubtype 8
+/// The KVO context for the session state that decides which hotkeys our tap captures.
+static void *BXHotkeyCaptureConditionsContext = &BXHotkeyCaptureConditionsContext;
 
 @implementation BXBaseAppController (BXHotKeys)
 
@@ -71,78 +70,6 @@
     }
 }
 
-- (BOOL) eventTap: (BXKeyboardEventTap *)tap shouldCaptureKeyEvent: (NSEvent *)event
-{
-    //Don't capture any keys when we're not the active application
-    if (![NSApp isActive]) return NO;
-    
-    //Tweak: let Cmd-modified keys fall through, so that key-repeat events
-    //for key equivalents are handled properly.
-    if ((event.modifierFlags & NSCommandKeyMask) == NSCommandKeyMask)
-        return NO;
-    
-    //Only capture if the current session is key and is running a program.
-    if (!self.currentSession.programIsActive) return NO;
-    if ([self documentForWindow: [NSApp keyWindow]] != self.currentSession) return NO;
-    
-    switch (event.keyCode)
-    {
-        case kVK_UpArrow:
-        case kVK_DownArrow:
-        case kVK_LeftArrow:
-        case kVK_RightArrow:
-        case kVK_F1:
-        case kVK_F2:
-        case kVK_F3:
-        case kVK_F4:
-        case kVK_F5:
-        case kVK_F6:
-        case kVK_F7:
-        case kVK_F8:
-        case kVK_F9:
-        case kVK_F10:
-        case kVK_F11:
-        case kVK_F12:
-            return YES;
-            break;
-        default:
-            return NO;
-    }
-}
-
-- (BOOL) eventTap: (BXKeyboardEventTap *)tap shouldCaptureSystemDefinedEvent: (NSEvent *)event
-{
-    //Ignore all events other than media keys.
-    if (event.subtype != BXMediaKeyEventSubtype) return NO;
-    
-    //Don't capture any keys when we're not the active application.
-    if (![NSApp isActive]) return NO;
-    
-    //Only capture media keys if the current session is running.
-    if (!self.currentSession) return NO;
-    @synchronized(self.currentSession)
-    {
-        if (!self.currentSession.isEmulating) return NO;
-    }
-    
-    //Only listen for certain media keys.
-    NSUInteger keyCode = [self.class _mediaKeyCode: event];
-    
-    switch (keyCode)
-    {
-        case NX_KEYTYPE_PLAY:
-        case NX_KEYTYPE_FAST:
-            return YES;
-            break;
-            
-        case NX_KEYTYPE_REWIND:
-        default:
-            return NO;
-            break;
-    }
-}
-
-
 #pragma mark - Hotkey capture lifecycle
 
 - (void) prepareHotkeyTap
@@ -165,6 +92,98 @@
                            toObject: defaults
                         withKeyPath: @"suppressSystemHotkeys"
                             options: nil];
+    
+    //Tell the tap up front which keys we want, so that it can decide about each keystroke
+    //on its own thread without calling back to us.
+    NSMutableIndexSet *keyCodes = [NSMutableIndexSet indexSet];
+    [keyCodes addIndex: kVK_UpArrow];
+    [keyCodes addIndex: kVK_DownArrow];
+    [keyCodes addIndex: kVK_LeftArrow];
+    [keyCodes addIndex: kVK_RightArrow];
+    CGKeyCode functionKeys[12] = { kVK_F1, kVK_F2, kVK_F3, kVK_F4, kVK_F5, kVK_F6, kVK_F7, kVK_F8, kVK_F9, kVK_F10, kVK_F11, kVK_F12 };
+    for (NSUInteger i=0; i<12; i++)
+        [keyCodes addIndex: functionKeys[i]];
+    
+    [self.hotkeySuppressionTap setCapturedKeyCodes: keyCodes];
+    
+    //Only listen for certain media keys.
+    NSMutableIndexSet *mediaKeyCodes = [NSMutableIndexSet indexSet];
+    [mediaKeyCodes addIndex: NX_KEYTYPE_PLAY];
+    [mediaKeyCodes addIndex: NX_KEYTYPE_FAST];
+    [self.hotkeySuppressionTap setCapturedMediaKeyCodes: mediaKeyCodes];
+    
+    //Tweak: let Cmd-modified keys fall through, so that key-repeat events
+    //for key equivalents are handled properly.
+    self.hotkeySuppressionTap.passthroughModifiers = NSCommandKeyMask;
+    
+    //Keep the tap up to date with whether we want those keys right now.
+    NSNotificationCenter *center = [NSNotificationCenter defaultCenter];
+    NSArray *notificationNames = @[NSApplicationDidBecomeActiveNotification,
+                                   NSApplicationDidResignActiveNotification,
+                                   NSWindowDidBecomeKeyNotification,
+                                   NSWindowDidResignKeyNotification];
+    for (NSString *name in notificationNames)
+    {
+        [center addObserver: self
+                   selector: @selector(_hotkeyCaptureConditionsDidChange:)
+                       name: name
+                     object: nil];
+    }
+    
+    [self addObserver: self
+           forKeyPath: @"currentSession.programIsActive"
+              options: 0
+              context: BXHotkeyCaptureConditionsContext];
+    
+    [self addObserver: self
+           forKeyPath: @"currentSession.emulating"
+              options: 0
+              context: BXHotkeyCaptureConditionsContext];
+    
+    [self _syncHotkeyCaptureConditions];
+}
+
+- (void) observeValueForKeyPath: (NSString *)keyPath
+                       ofObject: (id)object
+                         change: (NSDictionary *)change
+                        context: (void *)context
+{
+    if (context == BXHotkeyCaptureConditionsContext)
+    {
+        //Session state may change on the emulation thread.
+        if ([NSThread isMainThread])
+        {
+            [self _syncHotkeyCaptureConditions];
+        }
+        else
+        {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                [self _syncHotkeyCaptureConditions];
+            });
+        }
+    }
+    else
+    {
+        [super observeValueForKeyPath: keyPath ofObject: object change: change context: context];
+    }
+}
+
+- (void) _hotkeyCaptureConditionsDidChange: (NSNotification *)notification
+{
+    [self _syncHotkeyCaptureConditions];
+}
+
+- (void) _syncHotkeyCaptureConditions
+{
+    BXSession *session = self.currentSession;
+    BOOL isActive = [NSApp isActive];
+    
+    //Only capture keys if the current session is key and is running a program,
+    //and only capture media keys if the current session is running at all.
+    BOOL sessionIsKey = (session != nil) && ([self documentForWindow: [NSApp keyWindow]] == session);
+    
+    self.hotkeySuppressionTap.capturesKeyEvents = isActive && sessionIsKey && session.programIsActive;
+    self.hotkeySuppressionTap.capturesMediaKeyEvents = isActive && session.isEmulating;
 }
 
 - (void) checkHotkeyCaptureAvailability
@@ -26,6 +26,8 @@
 #import "NSError+ADBErrorHelpers.h"
 #import "NSURL+ADBFilesystemHelpers.h"
 #import "NSObject+ADBPerformExtensions.h"
+#import "ADBDigest.h"
+#import "BXCoverArt.h"
 
 #import "ADBUserNotificationDispatcher.h"
 
@@ -176,6 +178,17 @@
     //Start scanning for MIDI devices now
     self.MIDIDeviceMonitor = [[[BXMIDIDeviceMonitor alloc] init] autorelease];
     [self.MIDIDeviceMonitor start];
+    
+    //Persist file digests and rendered cover art in our support folder, so that unchanged
+    //gameboxes don't need to be rehashed or rerendered whenever they are identified.
+    //Likewise for data that the emulator works out at startup, like unpacked codepage fonts.
+    NSURL *supportURL = [self supportURLCreatingIfMissing: YES error: NULL];
+    if (supportURL)
+    {
+        [ADBDigest setCacheURL: [supportURL URLByAppendingPathComponent: @"Digests.plist"]];
+        [BXCoverArt setCacheURL: [supportURL URLByAppendingPathComponent: @"Cover art" isDirectory: YES]];
+        [BXEmulator setCacheURL: [supportURL URLByAppendingPathComponent: @"Emulator cache" isDirectory: YES]];
+    }
 }
 
 - (void) closeAllDocumentsWithDelegate: (id)delegate
@@ -210,6 +223,8 @@
 	//Disable our hotkey suppression
     [self.hotkeySuppressionTap unbind: @"enabled"];
     self.hotkeySuppressionTap.enabled = NO;
+    [self removeObserver: self forKeyPath: @"currentSession.programIsActive"];
+    [self removeObserver: self forKeyPath: @"currentSession.emulating"];
     
     //Tell the MIDI device scanner to stop
     [self.MIDIDeviceMonitor cancel];
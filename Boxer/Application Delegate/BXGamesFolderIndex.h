@@ -0,0 +1,80 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+
+//BXGamesFolderIndex maintains a persistent index of the gameboxes within a games folder,
+//recording each gamebox's identifier, launchers, icon and modification date, so that
+//code which needs to know what's in the games folder doesn't have to walk it each time.
+
+//The index is saved between launches along with the last FSEvents event ID it processed.
+//When indexing starts it catches up on the changes made since then, and from then on it
+//rescans only the folders that FSEvents reports as having changed.
+
+#import <Foundation/Foundation.h>
+#import <CoreServices/CoreServices.h>
+
+
+#pragma mark - Constants
+
+//Keys for the gamebox records in gameboxRecords.
+extern NSString * const BXGamesFolderIndexURLKey;               //An NSURL of the gamebox's location.
+extern NSString * const BXGamesFolderIndexIdentifierKey;        //An NSString of the gamebox's game identifier, if it has one.
+extern NSString * const BXGamesFolderIndexLaunchersKey;         //An NSArray of the gamebox's launcher dictionaries, if it has any.
+extern NSString * const BXGamesFolderIndexIconDigestKey;        //An NSString hex digest of the gamebox's custom icon, if it has one.
+extern NSString * const BXGamesFolderIndexModificationDateKey;  //An NSDate of when the gamebox was last modified.
+
+
+#pragma mark - Interface declaration
+
+@interface BXGamesFolderIndex : NSObject
+{
+    NSURL *_gamesFolderURL;
+    NSURL *_indexURL;
+    NSString *_rootPath;
+
+    NSMutableDictionary *_records;
+    NSMutableSet *_knownFolders;
+    NSArray *_gameboxRecords;
+    BOOL _loaded;
+
+    dispatch_queue_t _queue;
+    FSEventStreamRef _stream;
+    FSEventStreamEventId _lastEventID;
+}
+
+//The games folder being indexed.
+@property (readonly, copy, nonatomic) NSURL *gamesFolderURL;
+
+//The location of the file in which the index is persisted between launches.
+@property (readonly, copy, nonatomic) NSURL *indexURL;
+
+//An array of records for all gameboxes in the games folder, using the keys listed above.
+//This is updated on the main thread whenever the index changes, and is KVO-observable.
+@property (readonly, copy) NSArray *gameboxRecords;
+
+//The URLs of every folder in the games folder that directly contains gameboxes.
+@property (readonly, nonatomic) NSArray *foldersContainingGameboxes;
+
+//Whether the index has been brought up to date since indexing began.
+//This is KVO-observable, and will change on the main thread.
+@property (readonly, getter=isLoaded) BOOL loaded;
+
+
+#pragma mark - Methods
+
+//Returns a new index for the specified games folder, persisted at the specified location.
+//This will not begin indexing until startIndexing is called.
+- (id) initWithGamesFolderURL: (NSURL *)gamesFolderURL indexURL: (NSURL *)indexURL;
+
+//Loads the persisted index, catches up on any changes made to the games folder since
+//it was saved, and then watches the folder for further changes.
+- (void) startIndexing;
+
+//Stops watching the games folder for changes and saves the index.
+- (void) stopIndexing;
+
+@end
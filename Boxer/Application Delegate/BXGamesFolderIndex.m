@@ -0,0 +1,562 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+#import "BXGamesFolderIndex.h"
+#import "BXGamebox.h"
+#import "BXFileTypes.h"
+#import "ADBDigest.h"
+#import "NSData+HexStrings.h"
+#import "NSURL+ADBFilesystemHelpers.h"
+#include <sys/stat.h>
+
+
+#pragma mark - Constants
+
+NSString * const BXGamesFolderIndexURLKey               = @"BXGamesFolderIndexURL";
+NSString * const BXGamesFolderIndexIdentifierKey        = @"BXGamesFolderIndexIdentifier";
+NSString * const BXGamesFolderIndexLaunchersKey         = @"BXGamesFolderIndexLaunchers";
+NSString * const BXGamesFolderIndexIconDigestKey        = @"BXGamesFolderIndexIconDigest";
+NSString * const BXGamesFolderIndexModificationDateKey  = @"BXGamesFolderIndexModificationDate";
+
+//Keys for the persisted index file.
+NSString * const BXGamesFolderIndexRootPathKey      = @"RootPath";
+NSString * const BXGamesFolderIndexDeviceUUIDKey    = @"DeviceUUID";
+NSString * const BXGamesFolderIndexLastEventIDKey   = @"LastEventID";
+NSString * const BXGamesFolderIndexRecordsKey       = @"Records";
+NSString * const BXGamesFolderIndexFoldersKey       = @"Folders";
+
+//Used to tell whether we're already running on the index's private queue.
+static void * const BXGamesFolderIndexQueueKey = (void *)&BXGamesFolderIndexQueueKey;
+
+//How long FSEvents should wait to coalesce changes before telling us about them.
+#define BXGamesFolderIndexEventLatency 2.0
+
+
+#pragma mark - Private method declarations
+
+@interface BXGamesFolderIndex ()
+
+@property (readwrite, copy) NSArray *gameboxRecords;
+@property (readwrite, getter=isLoaded) BOOL loaded;
+
+//The following must only be called on our private queue.
+
+//Loads the persisted index from indexURL. Returns NO if there was no usable index there,
+//in which case the games folder will need to be scanned from scratch.
+- (BOOL) _loadIndex;
+- (void) _saveIndex;
+
+//Returns the location of the specified path relative to the games folder,
+//or nil if the path is not inside the games folder.
+- (NSString *) _relativePathForPath: (NSString *)path;
+- (NSURL *) _URLForRelativePath: (NSString *)relativePath;
+
+//Returns the relative path of the gamebox containing the specified relative path (or the path itself,
+//if it is a gamebox) or nil if it is not inside a gamebox.
+- (NSString *) _gameboxContainingRelativePath: (NSString *)relativePath;
+
+//Updates the index in response to a change at the specified path reported by FSEvents.
+//If recursive is YES, the folder at that path will be rescanned in its entirety.
+- (void) _processChangeAtPath: (NSString *)path recursive: (BOOL)recursive;
+
+//Synchronises the index with the folder at the specified relative path. Subfolders we haven't
+//seen before will be scanned in full; known subfolders will only be scanned if recursive is YES.
+- (void) _scanFolderAtRelativePath: (NSString *)relativePath recursive: (BOOL)recursive;
+
+//Updates the index record for the gamebox at the specified relative path, if it has changed.
+- (void) _indexGameboxAtRelativePath: (NSString *)relativePath;
+
+//Removes the specified relative path and everything under it from the index.
+- (void) _forgetRelativePath: (NSString *)relativePath;
+
+//Sends the current state of the index to the main thread as our gameboxRecords.
+- (void) _publishRecords;
+
+//Called by our FSEvents stream callback with each batch of changes.
+- (void) _handleEventsAtPaths: (char **)paths
+                        flags: (const FSEventStreamEventFlags *)flags
+                          IDs: (const FSEventStreamEventId *)IDs
+                        count: (size_t)numEvents;
+
+@end
+
+
+static void _BXGamesFolderIndexEventCallback(ConstFSEventStreamRef stream,
+                                             void *info,
+                                             size_t numEvents,
+                                             void *eventPaths,
+                                             const FSEventStreamEventFlags eventFlags[],
+                                             const FSEventStreamEventId eventIDs[])
+{
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    [(BXGamesFolderIndex *)info _handleEventsAtPaths: (char **)eventPaths
+                                               flags: eventFlags
+                                                 IDs: eventIDs
+                                               count: numEvents];
+    [pool drain];
+}
+
+
+#pragma mark - Implementation
+
+@implementation BXGamesFolderIndex
+@synthesize gamesFolderURL = _gamesFolderURL;
+@synthesize indexURL = _indexURL;
+@synthesize gameboxRecords = _gameboxRecords;
+@synthesize loaded = _loaded;
+
+- (id) initWithGamesFolderURL: (NSURL *)gamesFolderURL indexURL: (NSURL *)indexURL
+{
+    self = [super init];
+    if (self)
+    {
+        _gamesFolderURL = [gamesFolderURL copy];
+        _indexURL = [indexURL copy];
+
+        //FSEvents reports fully-resolved paths, so resolve the games folder's own path to match.
+        char resolvedPath[PATH_MAX];
+        if (realpath(gamesFolderURL.path.fileSystemRepresentation, resolvedPath))
+            _rootPath = [[[NSFileManager defaultManager] stringWithFileSystemRepresentation: resolvedPath
+                                                                                    length: strlen(resolvedPath)] copy];
+        else
+            _rootPath = [gamesFolderURL.path copy];
+
+        _records = [[NSMutableDictionary alloc] init];
+        _knownFolders = [[NSMutableSet alloc] init];
+        _queue = dispatch_queue_create("com.boxer.BXGamesFolderIndex", DISPATCH_QUEUE_SERIAL);
+        dispatch_queue_set_specific(_queue, BXGamesFolderIndexQueueKey, self, NULL);
+    }
+    return self;
+}
+
+- (void) dealloc
+{
+    [self stopIndexing];
+
+    dispatch_release(_queue), _queue = NULL;
+
+    [_gamesFolderURL release], _gamesFolderURL = nil;
+    [_indexURL release], _indexURL = nil;
+    [_rootPath release], _rootPath = nil;
+    [_records release], _records = nil;
+    [_knownFolders release], _knownFolders = nil;
+    self.gameboxRecords = nil;
+
+    [super dealloc];
+}
+
+- (NSArray *) foldersContainingGameboxes
+{
+    NSMutableSet *folderURLs = [NSMutableSet set];
+    for (NSDictionary *record in self.gameboxRecords)
+    {
+        NSURL *gameboxURL = [record objectForKey: BXGamesFolderIndexURLKey];
+        [folderURLs addObject: gameboxURL.URLByDeletingLastPathComponent];
+    }
+    return folderURLs.allObjects;
+}
+
+
+#pragma mark - Starting and stopping
+
+- (void) startIndexing
+{
+    dispatch_async(_queue, ^{
+        if (_stream) return;
+
+        FSEventStreamEventId sinceWhen;
+        BOOL caughtUp;
+        if ([self _loadIndex])
+        {
+            //Replay everything that happened since we last saved: we'll consider ourselves
+            //loaded once FSEvents tells us that its history is done.
+            sinceWhen = _lastEventID;
+            caughtUp = NO;
+        }
+        else
+        {
+            sinceWhen = FSEventsGetCurrentEventId();
+            _lastEventID = sinceWhen;
+            [self _scanFolderAtRelativePath: @"" recursive: YES];
+            caughtUp = YES;
+        }
+
+        FSEventStreamContext context = { 0, self, NULL, NULL, NULL };
+        _stream = FSEventStreamCreate(kCFAllocatorDefault,
+                                      _BXGamesFolderIndexEventCallback,
+                                      &context,
+                                      (CFArrayRef)@[_rootPath],
+                                      sinceWhen,
+                                      BXGamesFolderIndexEventLatency,
+                                      kFSEventStreamCreateFlagWatchRoot);
+
+        if (_stream)
+        {
+            FSEventStreamSetDispatchQueue(_stream, _queue);
+            if (!FSEventStreamStart(_stream))
+            {
+                FSEventStreamInvalidate(_stream);
+                FSEventStreamRelease(_stream);
+                _stream = NULL;
+            }
+        }
+
+        //If we're not going to hear about the history, then don't wait for it.
+        if (!_stream && !caughtUp)
+        {
+            [self _scanFolderAtRelativePath: @"" recursive: YES];
+            caughtUp = YES;
+        }
+
+        if (caughtUp)
+        {
+            [self _saveIndex];
+            [self _publishRecords];
+        }
+    });
+}
+
+- (void) stopIndexing
+{
+    void (^stop)(void) = ^{
+        if (_stream)
+        {
+            FSEventStreamStop(_stream);
+            FSEventStreamInvalidate(_stream);
+            FSEventStreamRelease(_stream);
+            _stream = NULL;
+
+            [self _saveIndex];
+        }
+    };
+
+    //We may be deallocated on our own queue by the last block that retained us,
+    //in which case dispatching synchronously onto it would deadlock.
+    if (dispatch_get_specific(BXGamesFolderIndexQueueKey) == self)
+        stop();
+    else
+        dispatch_sync(_queue, stop);
+}
+
+
+#pragma mark - Persistence
+
+- (NSString *) _deviceUUID
+{
+    struct stat info;
+    if (stat(_rootPath.fileSystemRepresentation, &info) != 0)
+        return nil;
+
+    CFUUIDRef UUID = FSEventsCopyUUIDForDevice(info.st_dev);
+    if (!UUID)
+        return nil;
+
+    NSString *UUIDString = [(NSString *)CFUUIDCreateString(kCFAllocatorDefault, UUID) autorelease];
+    CFRelease(UUID);
+
+    return UUIDString;
+}
+
+- (BOOL) _loadIndex
+{
+    NSDictionary *savedIndex = [NSDictionary dictionaryWithContentsOfURL: self.indexURL];
+    if (!savedIndex)
+        return NO;
+
+    //Event IDs are only meaningful for the same folder on the same device.
+    //If the games folder or its volume has changed, we'll have to start over.
+    if (![[savedIndex objectForKey: BXGamesFolderIndexRootPathKey] isEqualToString: _rootPath])
+        return NO;
+
+    NSString *deviceUUID = self._deviceUUID;
+    if (!deviceUUID || ![[savedIndex objectForKey: BXGamesFolderIndexDeviceUUIDKey] isEqualToString: deviceUUID])
+        return NO;
+
+    NSNumber *lastEventID = [savedIndex objectForKey: BXGamesFolderIndexLastEventIDKey];
+    NSDictionary *records = [savedIndex objectForKey: BXGamesFolderIndexRecordsKey];
+    NSArray *folders = [savedIndex objectForKey: BXGamesFolderIndexFoldersKey];
+    if (!lastEventID || !records || !folders)
+        return NO;
+
+    _lastEventID = lastEventID.unsignedLongLongValue;
+
+    [_records removeAllObjects];
+    for (NSString *relativePath in records)
+    {
+        NSMutableDictionary *record = [[records objectForKey: relativePath] mutableCopy];
+        [_records setObject: record forKey: relativePath];
+        [record release];
+    }
+
+    [_knownFolders removeAllObjects];
+    [_knownFolders addObjectsFromArray: folders];
+
+    return YES;
+}
+
+- (void) _saveIndex
+{
+    NSString *deviceUUID = self._deviceUUID;
+    if (!self.indexURL || !deviceUUID)
+        return;
+
+    NSDictionary *index = @{
+        BXGamesFolderIndexRootPathKey: _rootPath,
+        BXGamesFolderIndexDeviceUUIDKey: deviceUUID,
+        BXGamesFolderIndexLastEventIDKey: @(_lastEventID),
+        BXGamesFolderIndexRecordsKey: _records,
+        BXGamesFolderIndexFoldersKey: _knownFolders.allObjects,
+    };
+
+    [[NSFileManager defaultManager] createDirectoryAtURL: self.indexURL.URLByDeletingLastPathComponent
+                             withIntermediateDirectories: YES
+                                              attributes: nil
+                                                   error: NULL];
+    [index writeToURL: self.indexURL atomically: YES];
+}
+
+- (void) _publishRecords
+{
+    NSMutableArray *records = [NSMutableArray arrayWithCapacity: _records.count];
+    for (NSString *relativePath in _records)
+    {
+        NSMutableDictionary *record = [[_records objectForKey: relativePath] mutableCopy];
+        [record setObject: [self _URLForRelativePath: relativePath] forKey: BXGamesFolderIndexURLKey];
+        [records addObject: record];
+        [record release];
+    }
+
+    dispatch_async(dispatch_get_main_queue(), ^{
+        self.gameboxRecords = records;
+        if (!self.isLoaded)
+            self.loaded = YES;
+    });
+}
+
+
+#pragma mark - Handling changes
+
+- (void) _handleEventsAtPaths: (char **)paths
+                        flags: (const FSEventStreamEventFlags *)flags
+                          IDs: (const FSEventStreamEventId *)IDs
+                        count: (size_t)numEvents
+{
+    NSFileManager *manager = [NSFileManager defaultManager];
+    BOOL historyDone = NO;
+
+    for (size_t i=0; i<numEvents; i++)
+    {
+        if (flags[i] & kFSEventStreamEventFlagHistoryDone)
+        {
+            historyDone = YES;
+            continue;
+        }
+
+        //If events were dropped, or the games folder itself was moved or deleted,
+        //then we can't trust our incremental state and must rescan from the top.
+        BOOL mustRescan = (flags[i] & (kFSEventStreamEventFlagMustScanSubDirs |
+                                       kFSEventStreamEventFlagUserDropped |
+                                       kFSEventStreamEventFlagKernelDropped)) != 0;
+
+        NSString *path;
+        if (flags[i] & kFSEventStreamEventFlagRootChanged)
+            path = _rootPath;
+        else
+            path = [manager stringWithFileSystemRepresentation: paths[i] length: strlen(paths[i])];
+
+        [self _processChangeAtPath: path recursive: mustRescan];
+
+        if (IDs[i] > _lastEventID)
+            _lastEventID = IDs[i];
+    }
+
+    //Don't publish anything while we're still replaying history,
+    //since we'd be announcing a half-updated index.
+    if (!self.isLoaded && !historyDone)
+        return;
+
+    [self _saveIndex];
+    [self _publishRecords];
+}
+
+- (void) _processChangeAtPath: (NSString *)path recursive: (BOOL)recursive
+{
+    NSString *relativePath = [self _relativePathForPath: path];
+    if (!relativePath)
+        return;
+
+    NSString *gameboxPath = [self _gameboxContainingRelativePath: relativePath];
+    if (gameboxPath)
+    {
+        [self _indexGameboxAtRelativePath: gameboxPath];
+    }
+    else if ([[self _URLForRelativePath: relativePath] checkResourceIsReachableAndReturnError: NULL])
+    {
+        [self _scanFolderAtRelativePath: relativePath recursive: recursive];
+    }
+    else
+    {
+        [self _forgetRelativePath: relativePath];
+    }
+}
+
+- (void) _scanFolderAtRelativePath: (NSString *)relativePath recursive: (BOOL)recursive
+{
+    NSURL *folderURL = [self _URLForRelativePath: relativePath];
+    NSArray *contents = [[NSFileManager defaultManager] contentsOfDirectoryAtURL: folderURL
+                                                      includingPropertiesForKeys: @[NSURLIsDirectoryKey, NSURLIsPackageKey]
+                                                                         options: NSDirectoryEnumerationSkipsHiddenFiles
+                                                                           error: NULL];
+
+    if (!contents)
+    {
+        [self _forgetRelativePath: relativePath];
+        return;
+    }
+
+    [_knownFolders addObject: relativePath];
+
+    NSMutableSet *childPaths = [NSMutableSet setWithCapacity: contents.count];
+    for (NSURL *URL in contents)
+    {
+        NSString *childPath = [relativePath stringByAppendingPathComponent: URL.lastPathComponent];
+
+        if ([URL conformsToFileType: BXGameboxType])
+        {
+            [childPaths addObject: childPath];
+            [self _indexGameboxAtRelativePath: childPath];
+        }
+        else
+        {
+            NSNumber *isDirFlag = nil, *isPackageFlag = nil;
+            [URL getResourceValue: &isDirFlag forKey: NSURLIsDirectoryKey error: NULL];
+            [URL getResourceValue: &isPackageFlag forKey: NSURLIsPackageKey error: NULL];
+
+            if (isDirFlag.boolValue && !isPackageFlag.boolValue)
+            {
+                [childPaths addObject: childPath];
+                if (recursive || ![_knownFolders containsObject: childPath])
+                    [self _scanFolderAtRelativePath: childPath recursive: YES];
+            }
+        }
+    }
+
+    //Forget about any gameboxes or folders that used to be here but aren't anymore.
+    NSMutableArray *knownChildPaths = [NSMutableArray arrayWithArray: _records.allKeys];
+    [knownChildPaths addObjectsFromArray: _knownFolders.allObjects];
+    for (NSString *knownPath in knownChildPaths)
+    {
+        if (knownPath.length && [knownPath.stringByDeletingLastPathComponent isEqualToString: relativePath] && ![childPaths containsObject: knownPath])
+            [self _forgetRelativePath: knownPath];
+    }
+}
+
+- (void) _indexGameboxAtRelativePath: (NSString *)relativePath
+{
+    NSURL *gameboxURL = [self _URLForRelativePath: relativePath];
+    NSURL *infoURL = [[gameboxURL URLByAppendingPathComponent: BXGameInfoFileName] URLByAppendingPathExtension: BXGameInfoFileExtension];
+
+    //Custom folder icons are stored in the resource fork of an Icon\r file inside the folder.
+    NSURL *iconURL = [[gameboxURL URLByAppendingPathComponent: @"Icon\r"] URLByAppendingPathComponent: @"..namedfork/rsrc"];
+
+    struct stat info;
+    if (stat(gameboxURL.path.fileSystemRepresentation, &info) != 0)
+    {
+        [self _forgetRelativePath: relativePath];
+        return;
+    }
+
+    //Consider the gamebox changed if the bundle, its game info or its icon has changed.
+    NSTimeInterval modificationTime = info.st_mtimespec.tv_sec + (info.st_mtimespec.tv_nsec / 1e9);
+    for (NSURL *URL in @[infoURL, iconURL])
+    {
+        if (stat(URL.path.fileSystemRepresentation, &info) == 0)
+            modificationTime = MAX(modificationTime, info.st_mtimespec.tv_sec + (info.st_mtimespec.tv_nsec / 1e9));
+    }
+    NSDate *modificationDate = [NSDate dateWithTimeIntervalSince1970: modificationTime];
+
+    NSMutableDictionary *record = [_records objectForKey: relativePath];
+    if ([[record objectForKey: BXGamesFolderIndexModificationDateKey] isEqualToDate: modificationDate])
+        return;
+
+    record = [NSMutableDictionary dictionaryWithObject: modificationDate forKey: BXGamesFolderIndexModificationDateKey];
+
+    NSDictionary *gameInfo = [NSDictionary dictionaryWithContentsOfURL: infoURL];
+    NSString *identifier = [gameInfo objectForKey: BXGameIdentifierGameInfoKey];
+    NSArray *launchers = [gameInfo objectForKey: BXLaunchersGameInfoKey];
+    if (identifier)
+        [record setObject: identifier forKey: BXGamesFolderIndexIdentifierKey];
+    if (launchers)
+        [record setObject: launchers forKey: BXGamesFolderIndexLaunchersKey];
+
+    NSData *iconDigest = [ADBDigest SHA1DigestForURLs: @[iconURL] error: NULL];
+    if (iconDigest)
+        [record setObject: iconDigest.stringWithHexBytes forKey: BXGamesFolderIndexIconDigestKey];
+
+    [_records setObject: record forKey: relativePath];
+}
+
+- (void) _forgetRelativePath: (NSString *)relativePath
+{
+    //If the games folder itself has gone, forget everything.
+    if (!relativePath.length)
+    {
+        [_records removeAllObjects];
+        [_knownFolders removeAllObjects];
+        return;
+    }
+
+    NSString *prefix = [relativePath stringByAppendingString: @"/"];
+    for (NSString *path in _records.allKeys)
+    {
+        if ([path isEqualToString: relativePath] || [path hasPrefix: prefix])
+            [_records removeObjectForKey: path];
+    }
+    for (NSString *path in _knownFolders.allObjects)
+    {
+        if ([path isEqualToString: relativePath] || [path hasPrefix: prefix])
+            [_knownFolders removeObject: path];
+    }
+}
+
+
+#pragma mark - Path helpers
+
+- (NSString *) _relativePathForPath: (NSString *)path
+{
+    //FSEvents reports folder paths with a trailing slash.
+    while (path.length > 1 && [path hasSuffix: @"/"])
+        path = [path substringToIndex: path.length - 1];
+
+    if ([path isEqualToString: _rootPath])
+        return @"";
+
+    NSString *prefix = [_rootPath stringByAppendingString: @"/"];
+    if ([path hasPrefix: prefix])
+        return [path substringFromIndex: prefix.length];
+
+    return nil;
+}
+
+- (NSURL *) _URLForRelativePath: (NSString *)relativePath
+{
+    return [NSURL fileURLWithPath: [_rootPath stringByAppendingPathComponent: relativePath]];
+}
+
+- (NSString *) _gameboxContainingRelativePath: (NSString *)relativePath
+{
+    NSString *path = @"";
+    for (NSString *component in relativePath.pathComponents)
+    {
+        path = [path stringByAppendingPathComponent: component];
+        if ([_records objectForKey: path] || [[self _URLForRelativePath: path] conformsToFileType: BXGameboxType])
+            return path;
+    }
+    return nil;
+}
+
+@end
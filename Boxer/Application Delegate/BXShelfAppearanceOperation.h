@@ -20,12 +20,18 @@
 {
 	NSURL *_targetURL;
 	BOOL _appliesToSubFolders;
+    NSArray *_subFolderURLs;
 	
 	FinderApplication *_finder;
 }
 @property (copy) NSURL *targetURL;
 @property (assign) BOOL appliesToSubFolders;
 
+//The folders containing gameboxes within targetURL, if these are already known.
+//If set, appliesToSubFolders will apply to just these folders instead of walking
+//the entire folder tree looking for gameboxes.
+@property (copy) NSArray *subFolderURLs;
+
 @end
 
 
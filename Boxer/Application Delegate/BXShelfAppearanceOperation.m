@@ -30,6 +30,7 @@
 @synthesize finder = _finder;
 @synthesize targetURL = _targetURL;
 @synthesize appliesToSubFolders = _appliesToSubFolders;
+@synthesize subFolderURLs = _subFolderURLs;
 
 - (id) init
 {
@@ -45,6 +46,7 @@
 {
     self.finder = nil;
     self.targetURL = nil;
+    self.subFolderURLs = nil;
     
 	[super dealloc];
 }
@@ -83,7 +85,22 @@
 	//Scan subfolders for any gameboxes, and apply the appearance to their containing folders
     //Note that we ensure that all URLs we deal with are POSIX paths and not file references,
     //to avoid any potential problems with Finder's applescript API resolving file references.
-	if (self.appliesToSubFolders)
+	if (self.appliesToSubFolders && self.subFolderURLs)
+    {
+		NSMutableSet *appliedURLs = [NSMutableSet setWithObject: initialURL];
+        for (NSURL *URL in self.subFolderURLs)
+        {
+			if (self.isCancelled) return;
+            
+            NSURL *folderURL = URL.filePathURL;
+            if (![appliedURLs containsObject: folderURL])
+            {
+                [appliedURLs addObject: folderURL];
+                [self _applyAppearanceToFolderAtURL: folderURL];
+            }
+        }
+    }
+	else if (self.appliesToSubFolders)
 	{
         NSDirectoryEnumerator *enumerator = [[NSFileManager defaultManager] enumeratorAtURL: initialURL
                                                                  includingPropertiesForKeys: nil
@@ -146,6 +163,16 @@
 	[super dealloc];
 }
 
+- (void) main
+{
+    //The background image may be generated by an operation we depend on:
+    //if that failed, then there's no appearance for us to apply.
+    if (![self.backgroundImageURL checkResourceIsReachableAndReturnError: NULL])
+        return;
+    
+    [super main];
+}
+
 - (void) _applyAppearanceToFolderAtURL: (NSURL *)folderURL
 {
 	NSAssert(self.backgroundImageURL != nil, @"BXShelfAppearanceApplicator _applyAppearanceToFolder called without background image.");
@@ -273,7 +273,7 @@ BOOL _mountSynchronously(DASessionRef session, DADiskRef disk, CFURLRef path, DA
 	[cdrdao release];
 	
 	//Run the task to completion and monitor its progress
-	[super main];
+	[self runTask];
 	
 	//If the image creation went smoothly, do final cleanup
 	if (!self.error)
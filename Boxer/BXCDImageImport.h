@@ -5,7 +5,9 @@
  online at [http://www.gnu.org/licenses/gpl-2.0.txt].
  */
 
-//BXCDImageImport rips physical CDs to (CDR-format) ISO disc images using OS X's hdiutil.
+//BXCDImageImport rips physical data CDs to ISO disc images, by copying sectors directly
+//from the disc's raw device. Subclasses may instead rip discs using an external tool,
+//by assigning a task and calling runTask.
 
 #import "BXDriveImport.h"
 #import "ADBTaskOperation.h"
@@ -30,6 +32,7 @@ enum {
 	NSURL *_destinationFolderURL;
 	NSURL *_destinationURL;
     BOOL _hasWrittenFiles;
+    NSData *_imageDigest;
 }
 
 @property (assign, readwrite) unsigned long long numBytes;
@@ -37,6 +40,14 @@ enum {
 @property (assign, readwrite) ADBOperationProgress currentProgress;
 @property (assign, readwrite, getter=isIndeterminate) BOOL indeterminate;
 
+//The SHA-1 digest of the ripped image, calculated as it was copied.
+//Will be nil until the import finishes successfully.
+@property (readonly, retain) NSData *imageDigest;
+
+//Runs the operation's task to completion while monitoring its progress.
+//For subclasses that rip using an external tool rather than the native sector copy.
+- (void) runTask;
+
 
 @end
 
@@ -9,13 +9,34 @@
 #import "ADBFileTransfer.h"
 #import "NSWorkspace+ADBMountedVolumes.h"
 #import "BXDrive.h"
-#import "RegexKitLite.h"
 #import "NSFileManager+ADBUniqueFilenames.h"
+#import <CommonCrypto/CommonDigest.h>
+#include <sys/disk.h>
+#include <sys/ioctl.h>
+#include <fcntl.h>
+
+
+//Sectors will be read from the disc in chunks of this size (rounded down to a whole number of sectors.)
+#define BXCDImageImportChunkSize (1024 * 1024)
+
+//The number of chunks that may be in flight at once: one being read from the disc,
+//the other being written out to the image.
+#define BXCDImageImportNumBuffers 2
 
 
 NSString * const BXCDImageImportErrorDomain = @"BXCDImageImportErrorDomain";
 
 
+@interface BXCDImageImport ()
+
+@property (readwrite, retain) NSData *imageDigest;
+
+//Updates our progress and sends an in-progress notification for the specified number of bytes copied.
+- (void) _reportProgressWithBytesTransferred: (unsigned long long)bytesTransferred;
+
+@end
+
+
 #pragma mark -
 #pragma mark Implementations
 
@@ -23,6 +44,7 @@ NSString * const BXCDImageImportErrorDomain = @"BXCDImageImportErrorDomain";
 @synthesize drive = _drive;
 @synthesize destinationFolderURL	= _destinationFolderURL;
 @synthesize destinationURL          = _destinationURL;
+@synthesize imageDigest             = _imageDigest;
 
 @synthesize numBytes			= _numBytes;
 @synthesize bytesTransferred	= _bytesTransferred;
@@ -89,6 +111,7 @@ NSString * const BXCDImageImportErrorDomain = @"BXCDImageImportErrorDomain";
     self.drive = nil;
     self.destinationFolderURL = nil;
     self.destinationURL = nil;
+    self.imageDigest = nil;
     
 	[super dealloc];
 }
@@ -148,24 +171,6 @@ NSString * const BXCDImageImportErrorDomain = @"BXCDImageImportErrorDomain";
 	NSURL *sourceURL        = self.drive.sourceURL;
 	NSURL *destinationURL	= self.destinationURL;
 	
-    
-	//Measure the size of the volume to determine how much data we'll be importing
-    NSNumber *volumeSizeResource;
-	NSError *volumeSizeError;
-    BOOL gotVolumeSize = [sourceURL getResourceValue: &volumeSizeResource
-                                              forKey: NSURLVolumeTotalCapacityKey
-                                               error: &volumeSizeError];
-    
-    if (gotVolumeSize)
-    {
-        self.numBytes = volumeSizeResource.unsignedLongLongValue;
-    }
-    else
-    {
-        self.error = volumeSizeError;
-        return;
-    }
-	
 	//Determine the /dev/diskx device name of the volume
 	NSString *deviceName = [[NSWorkspace sharedWorkspace] BSDDeviceNameForVolumeAtURL: sourceURL];
 	if (!deviceName)
@@ -176,62 +181,161 @@ NSString * const BXCDImageImportErrorDomain = @"BXCDImageImportErrorDomain";
 		self.error = unknownDeviceError;
 		return;
 	}
+    
+    //Read from the raw device rather than the buffered block device: this bypasses the buffer cache,
+    //which we'd only be filling with sectors we'll never read again.
+    NSString *rawDeviceName = deviceName;
+    if ([deviceName hasPrefix: @"/dev/disk"])
+        rawDeviceName = [@"/dev/r" stringByAppendingString: [deviceName substringFromIndex: 5]];
+    
+    int sourceDescriptor = open(rawDeviceName.fileSystemRepresentation, O_RDONLY);
+    if (sourceDescriptor == -1)
+    {
+        if (errno == EBUSY)
+            self.error = [BXCDImageImportDiscInUseError errorWithDrive: self.drive];
+        else
+            self.error = [BXCDImageImportRipFailedError errorWithDrive: self.drive];
+        return;
+    }
+    
+	//Measure the size of the disc to determine how much data we'll be importing
+    uint32_t blockSize = 0;
+    uint64_t blockCount = 0;
+    if (ioctl(sourceDescriptor, DKIOCGETBLOCKSIZE, &blockSize) != 0 ||
+        ioctl(sourceDescriptor, DKIOCGETBLOCKCOUNT, &blockCount) != 0 ||
+        blockSize == 0)
+    {
+        self.error = [BXCDImageImportRipFailedError errorWithDrive: self.drive];
+        close(sourceDescriptor);
+        return;
+    }
+    self.numBytes = blockSize * blockCount;
 	
-	//If the destination filename doesn't end in .cdr, then hdiutil will add it itself:
-	//so we'll do so for it, to ensure we know exactly what the destination path will be.
-	NSURL *tempDestinationURL = destinationURL;
-	if (![destinationURL.pathExtension.lowercaseString isEqualToString: @"cdr"])
-	{
-		tempDestinationURL = [destinationURL URLByAppendingPathExtension: @"cdr"];
-	}
-	
-	//Prepare the hdiutil task
-	NSTask *hdiutil = [[NSTask alloc] init];
-	NSArray *arguments = [NSArray arrayWithObjects:
-						  @"create",
-						  @"-srcdevice", deviceName,
-						  @"-format", @"UDTO",
-						  @"-puppetstrings",
-						  tempDestinationURL.path,
-						  nil];
-	
-	hdiutil.launchPath = @"/usr/bin/hdiutil";
-	hdiutil.arguments = arguments;
-	hdiutil.standardOutput = [NSPipe pipe];
-	hdiutil.standardError = [NSPipe pipe];
-	
-	self.task = hdiutil;
-	[hdiutil release];
-	
-	//Run the task to completion and monitor its progress
-    _hasWrittenFiles = NO;
-	[super main];
+    int destinationDescriptor = open(destinationURL.path.fileSystemRepresentation, O_WRONLY | O_CREAT | O_EXCL, 0644);
+    if (destinationDescriptor == -1)
+    {
+        self.error = [NSError errorWithDomain: NSPOSIXErrorDomain
+                                         code: errno
+                                     userInfo: @{ NSURLErrorKey: destinationURL }];
+        close(sourceDescriptor);
+        return;
+    }
+    
+	//At this point we have started creating data; record this fact so that we will
+	//clean up our partial files in -undoTransfer if the import is aborted.
     _hasWrittenFiles = YES;
-	
-	if (!self.error)
-	{
-		//If image creation succeeded, then rename the new image to its final destination name
-		if ([tempDestinationURL checkResourceIsReachableAndReturnError: NULL])
-		{
-			if (![tempDestinationURL isEqual: destinationURL])
-			{
-                NSError *renameError = nil;
-				BOOL moved = [[NSFileManager defaultManager] moveItemAtURL: tempDestinationURL
-                                                                     toURL: destinationURL
-                                                                     error: &renameError];
+    
+    //The image is written once and won't be read back any time soon, so keep it out of the cache too.
+    fcntl(destinationDescriptor, F_NOCACHE, 1);
+    
+    //Read whole numbers of sectors into sector-aligned buffers, as the raw device requires.
+    size_t chunkSize = MAX(BXCDImageImportChunkSize / blockSize, 1) * blockSize;
+    void *buffers[BXCDImageImportNumBuffers];
+    for (NSUInteger i=0; i<BXCDImageImportNumBuffers; i++)
+        buffers[i] = valloc(chunkSize);
+    
+    //Sectors are read on this thread, while a serial queue checksums and writes out
+    //the previously-read buffer, so that reading from the disc never waits on the destination.
+    dispatch_queue_t writeQueue = dispatch_queue_create("com.alunbestor.BXCDImageImport.writeQueue", DISPATCH_QUEUE_SERIAL);
+    dispatch_group_t writeGroup = dispatch_group_create();
+    dispatch_semaphore_t freeBuffers = dispatch_semaphore_create(BXCDImageImportNumBuffers);
+    
+    __block CC_SHA1_CTX digestContext;
+    CC_SHA1_Init(&digestContext);
+    
+    __block int writeErrno = 0;
+    __block unsigned long long bytesWritten = 0;
+    int readErrno = 0;
+    
+    self.indeterminate = NO;
+    CFAbsoluteTime lastProgressTime = 0;
+    NSUInteger bufferIndex = 0;
+    
+    while (!self.isCancelled && !writeErrno)
+    {
+        dispatch_semaphore_wait(freeBuffers, DISPATCH_TIME_FOREVER);
+        
+        void *buffer = buffers[bufferIndex];
+        ssize_t bytesRead = read(sourceDescriptor, buffer, chunkSize);
+        if (bytesRead < 0 && errno == EINTR)
+        {
+            dispatch_semaphore_signal(freeBuffers);
+            continue;
+        }
+        
+        if (bytesRead <= 0)
+        {
+            if (bytesRead < 0) readErrno = errno;
+            dispatch_semaphore_signal(freeBuffers);
+            break;
+        }
+        
+        dispatch_group_async(writeGroup, writeQueue, ^{
+            if (!writeErrno)
+            {
+                CC_SHA1_Update(&digestContext, buffer, (CC_LONG)bytesRead);
                 
-                if (!moved)
+                ssize_t offset = 0;
+                while (offset < bytesRead)
                 {
-                    self.error = renameError;
+                    ssize_t result = write(destinationDescriptor, (char *)buffer + offset, bytesRead - offset);
+                    if (result < 0)
+                    {
+                        if (errno == EINTR) continue;
+                        writeErrno = errno;
+                        break;
+                    }
+                    offset += result;
                 }
-			}
-		}
-		else
-		{
-			self.error = [BXCDImageImportRipFailedError errorWithDrive: self.drive];
-		}
-	}
+                bytesWritten += offset;
+            }
+            dispatch_semaphore_signal(freeBuffers);
+        });
+        
+        bufferIndex = (bufferIndex + 1) % BXCDImageImportNumBuffers;
+        
+        CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+        if (now - lastProgressTime >= self.pollInterval)
+        {
+            lastProgressTime = now;
+            [self _reportProgressWithBytesTransferred: bytesWritten];
+        }
+    }
+    
+    dispatch_group_wait(writeGroup, DISPATCH_TIME_FOREVER);
     
+    dispatch_release(writeGroup);
+    dispatch_release(writeQueue);
+    dispatch_release(freeBuffers);
+    for (NSUInteger i=0; i<BXCDImageImportNumBuffers; i++)
+        free(buffers[i]);
+    
+    close(sourceDescriptor);
+    if (close(destinationDescriptor) != 0 && !writeErrno)
+        writeErrno = errno;
+    
+    //If we were cancelled, -cancel will already have set our error.
+    if (!self.isCancelled)
+    {
+        if (writeErrno)
+        {
+            self.error = [NSError errorWithDomain: NSPOSIXErrorDomain
+                                             code: writeErrno
+                                         userInfo: @{ NSURLErrorKey: destinationURL }];
+        }
+        else if (readErrno || bytesWritten < self.numBytes)
+        {
+            self.error = [BXCDImageImportRipFailedError errorWithDrive: self.drive];
+        }
+        else
+        {
+            [self _reportProgressWithBytesTransferred: bytesWritten];
+            
+            NSMutableData *digest = [NSMutableData dataWithLength: CC_SHA1_DIGEST_LENGTH];
+            CC_SHA1_Final(digest.mutableBytes, &digestContext);
+            self.imageDigest = digest;
+        }
+    }
     
     //If the import failed for any reason (including cancellation),
     //then clean up the partial files.
@@ -241,38 +345,21 @@ NSString * const BXCDImageImportErrorDomain = @"BXCDImageImportErrorDomain";
     }
 }
 
-- (void) checkTaskProgress: (NSTimer *)timer
+- (void) runTask
 {
-    NSTask *task = timer.userInfo;
-	NSFileHandle *outputHandle = [task.standardOutput fileHandleForReading];
-	
-	NSString *currentOutput = [[NSString alloc] initWithData: outputHandle.availableData
-                                                    encoding: NSUTF8StringEncoding];
-	NSArray *progressValues = [currentOutput componentsMatchedByRegex: @"PERCENT:(-?[0-9\\.]+)" capture: 1];
-	[currentOutput release];
-	
-	ADBOperationProgress latestProgress = [progressValues.lastObject floatValue];
-	
-	if (latestProgress > 0)
-	{
-		self.indeterminate = NO;
-		//hdiutil expresses progress as a float percentage from 0 to 100
-		self.currentProgress = latestProgress / 100.0f;
-		self.bytesTransferred = (self.numBytes * (double)self.currentProgress);
-		
-		NSDictionary *info = [NSDictionary dictionaryWithObjectsAndKeys:
-							  [NSNumber numberWithUnsignedLongLong:	self.bytesTransferred],	ADBFileTransferBytesTransferredKey,
-							  [NSNumber numberWithUnsignedLongLong:	self.numBytes],			ADBFileTransferBytesTotalKey,
-							  nil];
-		[self _sendInProgressNotificationWithInfo: info];
-	}
-	//hdiutil will print "-1" when its own progress is indeterminate
-	//q.v. man hdiutil and search for -puppetstrings
-	else if (latestProgress == -1)
-	{
-		self.indeterminate = YES;
-		[self _sendInProgressNotificationWithInfo: nil];
-	}
+    [super main];
+}
+
+- (void) _reportProgressWithBytesTransferred: (unsigned long long)bytesTransferred
+{
+    self.bytesTransferred = MIN(bytesTransferred, self.numBytes);
+    self.currentProgress = (self.numBytes > 0) ? (float)self.bytesTransferred / (float)self.numBytes : 0;
+    
+    NSDictionary *info = @{
+                           ADBFileTransferBytesTransferredKey: @(self.bytesTransferred),
+                           ADBFileTransferBytesTotalKey: @(self.numBytes),
+                           };
+    [self _sendInProgressNotificationWithInfo: info];
 }
 
 
@@ -69,14 +69,14 @@ enum {
     
     //Center the throttle axis after connection,
     //since clearInput will not do this normally
-	JOYSTICK_Move_Y(BXGameportStick2, BXGameportAxisCentered);
+	[self setPosition: BXGameportAxisCentered forGameportAxis: BXCHFlightstickProThrottleAxis];
 }
 
 - (void) clearInput
 {
-	JOYSTICK_Move_X(BXGameportStick1, BXGameportAxisCentered);
-	JOYSTICK_Move_Y(BXGameportStick1, BXGameportAxisCentered);
-	JOYSTICK_Move_X(BXGameportStick2, BXGameportAxisCentered);
+	[self setPosition: BXGameportAxisCentered forGameportAxis: BXGameportXAxis];
+	[self setPosition: BXGameportAxisCentered forGameportAxis: BXGameportYAxis];
+	[self setPosition: BXGameportAxisCentered forGameportAxis: BXCHFlightstickProRudderAxis];
 	//Preserve the value of the throttle axis, because it does not snap back to center
 	
 	[self setPressedButtons: BXNoGameportButtonsMask];
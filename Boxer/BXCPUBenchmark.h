@@ -0,0 +1,77 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+
+//BXCPUBenchmark is a headless session that runs a fixed set of small guest programs under each
+//of DOSBox's CPU cores, and reports how many millions of guest instructions per host second each
+//core managed on each program. Boxer runs one when launched with --cpu-benchmark [report path].
+
+//The programs live on drive Z and need no drives of their own: integer arithmetic, string
+//operations, floating point, self-modifying code, paging faults in protected mode, and shifts
+//and bit scans. Their sources are in Benchmarks/cpu_workloads.
+
+//Where the dynamic core can use the host CPU's instruction set extensions, it is run a second
+//time without them, so that the report shows whether they are worth having.
+
+#import "BXHeadlessSession.h"
+
+
+#pragma mark -
+#pragma mark Constants
+
+/// Keys for the dictionary returned by @c results.
+/// An NSDictionary mapping core names to dictionaries using the per-core keys below.
+/// Cores this build doesn't have are left out.
+extern NSString * const BXCPUBenchmarkCoresKey;
+/// An NSNumber wrapping the fixed CPU speed in cycles the programs were run at.
+extern NSString * const BXCPUBenchmarkCyclesKey;
+/// An NSArray of the names of the host CPU's instruction set extensions the dynamic core used.
+/// Only present if there were any, in which case the core's run without them is listed under
+/// its usual name with "_baseline" on the end.
+extern NSString * const BXCPUBenchmarkHostFeaturesKey;
+/// An NSNumber wrapping how many times faster the dynamic core ran across all the programs with
+/// the host's extensions than without them. Only present alongside @c BXCPUBenchmarkHostFeaturesKey.
+extern NSString * const BXCPUBenchmarkHostFeaturesSpeedupKey;
+
+/// Keys for each core's dictionary.
+/// An NSNumber wrapping the guest instructions executed per host second across all the programs
+/// that ran successfully, in millions.
+extern NSString * const BXCPUBenchmarkMIPSKey;
+/// An NSDictionary mapping program names to dictionaries using the per-program keys below.
+extern NSString * const BXCPUBenchmarkWorkloadsKey;
+/// For the dynamic core only: an NSDictionary of its translation cache's counters once every program
+/// had run, using the keys listed under @c BXEmulatorDynamicCacheSizeKey in BXEmulator.h.
+extern NSString * const BXCPUBenchmarkDynamicCacheKey;
+
+/// Keys for each program's dictionary. @c BXCPUBenchmarkMIPSKey is also used here.
+/// NSNumbers wrapping the guest instructions the program executes and the host seconds it took.
+extern NSString * const BXCPUBenchmarkInstructionsKey;
+extern NSString * const BXCPUBenchmarkSecondsKey;
+/// An NSNumber wrapping the program's exit code. Only present if the program failed, in which case
+/// its timings are left out of the core's totals.
+extern NSString * const BXCPUBenchmarkExitCodeKey;
+
+
+@interface BXCPUBenchmark : BXHeadlessSession
+{
+    NSArray *_runs;
+    NSUInteger _nextRunIndex;
+    CFAbsoluteTime _runStartTime;
+    NSMutableDictionary *_coreResults;
+    NSDictionary *_dynamicCacheStatistics;
+    NSArray *_hostFeatures;
+    NSDictionary *_results;
+}
+
+/// The results of the benchmark, using the keys listed above; or @c nil if it did not finish.
+@property (readonly, retain) NSDictionary *results;
+
+/// Runs the emulator on the calling thread until every program has been run under every core,
+/// then returns @c results. Like BXHeadlessSession, this can only be done once per process.
+- (NSDictionary *) run;
+
+@end
@@ -0,0 +1,344 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+
+#import "BXCPUBenchmark.h"
+#import "BXEmulator+BXShell.h"
+#import "BXEmulator+BXPerformanceCounters.h"
+#import "BXEmulatorDelegate.h"
+
+#import "dos_inc.h"
+#import "dos_system.h"
+
+#import "../Benchmarks/cpu_workloads/cpu_workloads.h"
+
+
+#pragma mark -
+#pragma mark Constants
+
+NSString * const BXCPUBenchmarkCoresKey         = @"cores";
+NSString * const BXCPUBenchmarkCyclesKey        = @"cycles";
+NSString * const BXCPUBenchmarkMIPSKey          = @"MIPS";
+NSString * const BXCPUBenchmarkWorkloadsKey     = @"workloads";
+NSString * const BXCPUBenchmarkInstructionsKey  = @"instructions";
+NSString * const BXCPUBenchmarkSecondsKey       = @"seconds";
+NSString * const BXCPUBenchmarkExitCodeKey      = @"exitCode";
+NSString * const BXCPUBenchmarkDynamicCacheKey  = @"dynamicCache";
+NSString * const BXCPUBenchmarkHostFeaturesKey  = @"hostFeatures";
+NSString * const BXCPUBenchmarkHostFeaturesSpeedupKey = @"hostFeaturesSpeedup";
+
+//The fixed speed to run at. With turbo on this doesn't limit how fast the programs run,
+//but it sets how many instructions are executed between each round of event processing.
+#define BXCPUBenchmarkCycles 100000
+
+typedef struct {
+    const char *fileName;
+    unsigned char *data;
+    Bit32u size;
+    //The number of guest instructions in the program's main loop, as listed in its source.
+    double instructions;
+} BXCPUBenchmarkWorkload;
+
+static const BXCPUBenchmarkWorkload BXCPUBenchmarkWorkloads[] = {
+    { "BXINT.COM",      BXINT_COM,      sizeof(BXINT_COM),      8.0 * 8000000 },
+    { "BXSTRING.COM",   BXSTRING_COM,   sizeof(BXSTRING_COM),   (36864.0 + 14) * 2000 },
+    { "BXFPU.COM",      BXFPU_COM,      sizeof(BXFPU_COM),      9.0 * 5000000 },
+    { "BXSMC.COM",      BXSMC_COM,      sizeof(BXSMC_COM),      6.0 * 1000000 },
+    { "BXPAGING.COM",   BXPAGING_COM,   sizeof(BXPAGING_COM),   (10.0 + 12) * 200000 },
+    { "BXBITS.COM",     BXBITS_COM,     sizeof(BXBITS_COM),     12.0 * 4000000 },
+};
+#define BXCPUBenchmarkWorkloadCount (sizeof(BXCPUBenchmarkWorkloads) / sizeof(BXCPUBenchmarkWorkload))
+
+typedef struct {
+    BXCoreMode mode;
+    NSString *name;
+    //Whether this is the dynamic core run without the host CPU's instruction set extensions.
+    BOOL baseline;
+} BXCPUBenchmarkCore;
+
+static const BXCPUBenchmarkCore BXCPUBenchmarkCores[] = {
+    { BXCoreNormal,     @"normal",          NO },
+    { BXCoreSimple,     @"simple",          NO },
+    { BXCoreFull,       @"full",            NO },
+    { BXCorePrefetch,   @"prefetch",        NO },
+    { BXCoreThreaded,   @"threaded",        NO },
+#if (C_DYNAMIC_X86)
+    { BXCoreDynamic,    @"dyn_x86",         NO },
+#elif (C_DYNREC)
+    { BXCoreDynamic,    @"dynrec",          NO },
+    { BXCoreDynamic,    @"dynrec_baseline", YES },
+#endif
+};
+#define BXCPUBenchmarkCoreCount (sizeof(BXCPUBenchmarkCores) / sizeof(BXCPUBenchmarkCore))
+
+
+#pragma mark -
+#pragma mark Private interface declarations
+
+@interface BXCPUBenchmark ()
+
+@property (readwrite, retain) NSDictionary *results;
+
+//The core and workload of the run at the specified index.
+- (const BXCPUBenchmarkCore *) _coreForRunAtIndex: (NSUInteger)index;
+- (const BXCPUBenchmarkWorkload *) _workloadForRunAtIndex: (NSUInteger)index;
+
+//Whether the specified process is the program for the next run.
+- (BOOL) _processIsNextRun: (NSDictionary *)processInfo;
+
+//Records the timings of the run that just finished.
+- (void) _recordRunWithSeconds: (CFAbsoluteTime)seconds exitCode: (NSUInteger)exitCode;
+
+//Compiles the results once every run has finished.
+- (void) _finishBenchmark;
+
+//The name under which the dynamic core's results are listed.
+- (NSString *) _dynamicCoreName;
+
+@end
+
+
+@implementation BXCPUBenchmark
+@synthesize results = _results;
+
+- (id) init
+{
+    self = [super init];
+    if (self)
+    {
+        _coreResults = [[NSMutableDictionary alloc] initWithCapacity: BXCPUBenchmarkCoreCount];
+    }
+    return self;
+}
+
+- (void) dealloc
+{
+    self.results = nil;
+
+    [_runs release], _runs = nil;
+    [_coreResults release], _coreResults = nil;
+    [_dynamicCacheStatistics release], _dynamicCacheStatistics = nil;
+    [_hostFeatures release], _hostFeatures = nil;
+
+    [super dealloc];
+}
+
+
+#pragma mark -
+#pragma mark Running
+
+- (NSDictionary *) run
+{
+    //Run the emulator on this thread rather than in the background, so that program notifications
+    //reach us straight away and we can switch cores before each program starts.
+    [self.emulator start];
+    return self.results;
+}
+
+- (const BXCPUBenchmarkCore *) _coreForRunAtIndex: (NSUInteger)index
+{
+    return &BXCPUBenchmarkCores[[[[_runs objectAtIndex: index] objectAtIndex: 0] unsignedIntegerValue]];
+}
+
+- (const BXCPUBenchmarkWorkload *) _workloadForRunAtIndex: (NSUInteger)index
+{
+    return &BXCPUBenchmarkWorkloads[[[[_runs objectAtIndex: index] objectAtIndex: 1] unsignedIntegerValue]];
+}
+
+- (BOOL) _processIsNextRun: (NSDictionary *)processInfo
+{
+    if (_nextRunIndex >= _runs.count || [self.emulator processIsShell: processInfo])
+        return NO;
+
+    NSString *dosPath = [processInfo objectForKey: BXEmulatorDOSPathKey];
+    NSString *fileName = [NSString stringWithCString: [self _workloadForRunAtIndex: _nextRunIndex]->fileName
+                                            encoding: NSASCIIStringEncoding];
+    return [dosPath.uppercaseString hasSuffix: fileName];
+}
+
+- (void) _recordRunWithSeconds: (CFAbsoluteTime)seconds exitCode: (NSUInteger)exitCode
+{
+    const BXCPUBenchmarkCore *core = [self _coreForRunAtIndex: _nextRunIndex];
+    const BXCPUBenchmarkWorkload *workload = [self _workloadForRunAtIndex: _nextRunIndex];
+
+    NSMutableDictionary *workloads = [_coreResults objectForKey: core->name];
+    if (!workloads)
+    {
+        workloads = [NSMutableDictionary dictionaryWithCapacity: BXCPUBenchmarkWorkloadCount];
+        [_coreResults setObject: workloads forKey: core->name];
+    }
+
+    NSString *name = [[NSString stringWithCString: workload->fileName encoding: NSASCIIStringEncoding] stringByDeletingPathExtension];
+    NSMutableDictionary *result = [NSMutableDictionary dictionaryWithDictionary: @{
+        BXCPUBenchmarkInstructionsKey:  @(workload->instructions),
+        BXCPUBenchmarkSecondsKey:       @(seconds),
+    }];
+
+    if (exitCode != 0)
+        [result setObject: @(exitCode) forKey: BXCPUBenchmarkExitCodeKey];
+    else if (seconds > 0)
+        [result setObject: @(workload->instructions / seconds / 1000000.0) forKey: BXCPUBenchmarkMIPSKey];
+
+    [workloads setObject: result forKey: name];
+}
+
+- (NSString *) _dynamicCoreName
+{
+    for (NSUInteger i=0; i<BXCPUBenchmarkCoreCount; i++)
+    {
+        if (BXCPUBenchmarkCores[i].mode == BXCoreDynamic)
+            return BXCPUBenchmarkCores[i].name;
+    }
+    return nil;
+}
+
+- (void) _finishBenchmark
+{
+    NSMutableDictionary *cores = [NSMutableDictionary dictionaryWithCapacity: _coreResults.count];
+    for (NSString *coreName in _coreResults)
+    {
+        NSDictionary *workloads = [_coreResults objectForKey: coreName];
+
+        double instructions = 0, seconds = 0;
+        for (NSDictionary *result in workloads.objectEnumerator)
+        {
+            if ([result objectForKey: BXCPUBenchmarkExitCodeKey])
+                continue;
+
+            instructions += [[result objectForKey: BXCPUBenchmarkInstructionsKey] doubleValue];
+            seconds += [[result objectForKey: BXCPUBenchmarkSecondsKey] doubleValue];
+        }
+
+        NSMutableDictionary *coreResult = [NSMutableDictionary dictionaryWithDictionary: @{
+            BXCPUBenchmarkMIPSKey:      @(seconds > 0 ? instructions / seconds / 1000000.0 : 0),
+            BXCPUBenchmarkWorkloadsKey: [[workloads copy] autorelease],
+        }];
+
+        if (_dynamicCacheStatistics && [coreName isEqualToString: [self _dynamicCoreName]])
+            [coreResult setObject: _dynamicCacheStatistics forKey: BXCPUBenchmarkDynamicCacheKey];
+
+        [cores setObject: coreResult forKey: coreName];
+    }
+
+    NSMutableDictionary *results = [NSMutableDictionary dictionaryWithDictionary: @{
+        BXCPUBenchmarkCoresKey:     cores,
+        BXCPUBenchmarkCyclesKey:    @(BXCPUBenchmarkCycles),
+    }];
+
+    if (_hostFeatures.count)
+    {
+        NSString *coreName = [self _dynamicCoreName];
+        NSString *baselineName = [coreName stringByAppendingString: @"_baseline"];
+        double MIPS = [[[cores objectForKey: coreName] objectForKey: BXCPUBenchmarkMIPSKey] doubleValue];
+        double baselineMIPS = [[[cores objectForKey: baselineName] objectForKey: BXCPUBenchmarkMIPSKey] doubleValue];
+
+        [results setObject: _hostFeatures forKey: BXCPUBenchmarkHostFeaturesKey];
+        if (baselineMIPS > 0)
+            [results setObject: @(MIPS / baselineMIPS) forKey: BXCPUBenchmarkHostFeaturesSpeedupKey];
+    }
+
+    self.results = results;
+
+    self.emulator.countingPerformance = NO;
+    [self cancel];
+}
+
+
+#pragma mark -
+#pragma mark Emulator delegate methods
+
+//Put the programs on drive Z, so that the benchmark needs no drives of its own.
+- (void) runPreflightCommandsForEmulator: (BXEmulator *)emulator
+{
+    for (NSUInteger i=0; i<BXCPUBenchmarkWorkloadCount; i++)
+    {
+        const BXCPUBenchmarkWorkload *workload = &BXCPUBenchmarkWorkloads[i];
+        VFILE_Register(workload->fileName, workload->data, workload->size);
+    }
+}
+
+- (void) runLaunchCommandsForEmulator: (BXEmulator *)emulator
+{
+    self.drawsFrames = NO;
+    emulator.fixedSpeed = BXCPUBenchmarkCycles;
+    emulator.turboSpeed = YES;
+
+    //Find out which of the host's extensions the dynamic core can use: if there are none,
+    //there's no point running it a second time without them.
+    emulator.dynamicCoreUsesHostFeatures = YES;
+    [_hostFeatures release];
+    _hostFeatures = [emulator.dynamicCoreHostFeatures copy];
+
+    //Leave out any cores this build doesn't have, which will refuse to be switched to.
+    NSMutableArray *runs = [NSMutableArray arrayWithCapacity: BXCPUBenchmarkCoreCount * BXCPUBenchmarkWorkloadCount];
+    for (NSUInteger i=0; i<BXCPUBenchmarkCoreCount; i++)
+    {
+        const BXCPUBenchmarkCore *core = &BXCPUBenchmarkCores[i];
+        if (core->baseline && !_hostFeatures.count)
+            continue;
+
+        emulator.coreMode = core->mode;
+        if (emulator.coreMode != core->mode)
+            continue;
+
+        for (NSUInteger j=0; j<BXCPUBenchmarkWorkloadCount; j++)
+            [runs addObject: @[@(i), @(j)]];
+    }
+    emulator.coreMode = BXCoreNormal;
+
+    [_runs release];
+    _runs = [runs copy];
+    _nextRunIndex = 0;
+
+    for (NSUInteger i=0; i<_runs.count; i++)
+    {
+        NSString *command = [NSString stringWithFormat: @"Z:\\%s", [self _workloadForRunAtIndex: i]->fileName];
+        [emulator executeCommand: command encoding: BXDirectStringEncoding];
+    }
+}
+
+//Switch to the run's core as its program starts rather than when its command is issued,
+//since commands may be queued until the shell is ready for them.
+- (void) emulatorWillStartProgram: (NSNotification *)notification
+{
+    if (![self _processIsNextRun: notification.userInfo])
+        return;
+
+    const BXCPUBenchmarkCore *core = [self _coreForRunAtIndex: _nextRunIndex];
+    BXCoreMode mode = core->mode;
+    if (mode == BXCoreDynamic)
+        self.emulator.dynamicCoreUsesHostFeatures = !core->baseline;
+    self.emulator.coreMode = mode;
+
+    //The dynamic core only times its translation separately while performance is being counted.
+    //Leave the counters off for the other cores so that they don't pay for timing their IO.
+    self.emulator.countingPerformance = (mode == BXCoreDynamic);
+
+    _runStartTime = CFAbsoluteTimeGetCurrent();
+}
+
+- (void) emulatorDidFinishProgram: (NSNotification *)notification
+{
+    if (![self _processIsNextRun: notification.userInfo])
+        return;
+
+    CFAbsoluteTime seconds = CFAbsoluteTimeGetCurrent() - _runStartTime;
+    [self _recordRunWithSeconds: seconds exitCode: dos.return_code];
+
+    //The translation cache's counters only ever grow, so the last dynamic run's covers them all.
+    if ([self _coreForRunAtIndex: _nextRunIndex]->mode == BXCoreDynamic)
+    {
+        [_dynamicCacheStatistics release];
+        _dynamicCacheStatistics = [self.emulator.dynamicCacheStatistics copy];
+    }
+
+    _nextRunIndex++;
+    if (_nextRunIndex >= _runs.count)
+        [self _finishBenchmark];
+}
+
+@end
@@ -0,0 +1,88 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+
+//BXCacheRegistry keeps track of the caches that Boxer holds onto in case it needs them again,
+//so that they can be trimmed together when the system runs short of memory. Caches register
+//themselves with a priority: when the system reports memory pressure, the least important
+//caches are trimmed first, and trimming stops once the caches fit within a shared budget.
+//If memory becomes critically short, every cache is trimmed as far as it can go.
+
+//Memory pressure notifications are only available from OS X 10.9: on earlier versions,
+//caches are only trimmed when asked to explicitly.
+
+#import <Foundation/Foundation.h>
+
+
+#pragma mark - Constants
+
+typedef NS_ENUM(NSInteger, BXCachePriority) {
+    BXCachePriorityLow      = -1,   //Cheap to rebuild: trimmed first.
+    BXCachePriorityNormal   = 0,
+    BXCachePriorityHigh     = 1,    //Slow to rebuild, or valuable to the user: trimmed last.
+};
+
+typedef NS_ENUM(NSUInteger, BXCacheTrimLevel) {
+    //Release whatever is being kept around but is not currently in use.
+    BXCacheTrimSpare,
+
+    //Release everything that can be rebuilt later, even if that will cause a hitch.
+    BXCacheTrimAll,
+};
+
+
+#pragma mark - Protocols
+
+@protocol BXTrimmableCache <NSObject>
+
+//The approximate number of bytes the cache is holding, counting only what
+//could be released by trimCacheToLevel:. Called from any thread.
+- (NSUInteger) cacheSize;
+
+//Releases cached resources as far as the specified level allows.
+//Called from any thread: caches must do their trimming on whichever thread owns them.
+- (void) trimCacheToLevel: (BXCacheTrimLevel)level;
+
+@end
+
+
+#pragma mark - Interface
+
+@interface BXCacheRegistry : NSObject
+{
+    NSMutableArray *_entries;
+    NSUInteger _budget;
+    dispatch_queue_t _queue;
+    dispatch_source_t _memoryPressureSource;
+}
+
+//How many bytes registered caches may hold between them once the system starts running short
+//of memory. Defaults to 1/32nd of physical memory.
+@property (assign) NSUInteger budget;
+
+//The total size of all registered caches.
+@property (readonly) NSUInteger totalCacheSize;
+
+//Returns the registry shared by the whole application, which starts listening for
+//memory pressure the first time it is requested.
++ (BXCacheRegistry *) sharedRegistry;
+
+//Adds the specified cache to the registry. The registry does not retain the cache:
+//the cache must unregister itself before it is deallocated.
+- (void) registerCache: (id <BXTrimmableCache>)cache withPriority: (BXCachePriority)priority;
+- (void) unregisterCache: (id <BXTrimmableCache>)cache;
+
+//Trims registered caches, least important first, until they fit within the budget.
+//Spare resources are released from every cache before any cache is trimmed entirely.
+//Called automatically when the system warns of memory pressure.
+- (void) trimCachesToBudget;
+
+//Trims every registered cache as far as it will go.
+//Called automatically when memory pressure becomes critical.
+- (void) trimAllCaches;
+
+@end
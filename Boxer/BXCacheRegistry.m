@@ -0,0 +1,203 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+#import "BXCacheRegistry.h"
+
+
+//Keys for the entries in our list of registered caches.
+static NSString * const BXCacheRegistryCacheKey     = @"cache";
+static NSString * const BXCacheRegistryPriorityKey  = @"priority";
+
+
+@interface BXCacheRegistry ()
+
+//Called on our queue whenever the system reports a change in memory pressure.
+- (void) _memoryPressureDidChange;
+
+//Returns the registered caches in the order they should be trimmed.
+- (NSArray *) _cachesInTrimOrder;
+
+@end
+
+
+@implementation BXCacheRegistry
+@synthesize budget = _budget;
+
++ (BXCacheRegistry *) sharedRegistry
+{
+    static BXCacheRegistry *registry = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        registry = [[self alloc] init];
+    });
+    return registry;
+}
+
+- (id) init
+{
+    self = [super init];
+    if (self)
+    {
+        _entries = [[NSMutableArray alloc] init];
+        _budget = (NSUInteger)([NSProcessInfo processInfo].physicalMemory / 32);
+        _queue = dispatch_queue_create("com.boxer.cacheRegistry", DISPATCH_QUEUE_SERIAL);
+
+        //DISPATCH_SOURCE_TYPE_MEMORYPRESSURE is weakly linked, and will be NULL before 10.9.
+#ifdef DISPATCH_SOURCE_TYPE_MEMORYPRESSURE
+        if (DISPATCH_SOURCE_TYPE_MEMORYPRESSURE != NULL)
+        {
+            _memoryPressureSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_MEMORYPRESSURE, 0,
+                                                           DISPATCH_MEMORYPRESSURE_WARN | DISPATCH_MEMORYPRESSURE_CRITICAL,
+                                                           _queue);
+
+            BXCacheRegistry *registry = self;
+            dispatch_source_set_event_handler(_memoryPressureSource, ^{
+                [registry _memoryPressureDidChange];
+            });
+            dispatch_resume(_memoryPressureSource);
+        }
+#endif
+    }
+    return self;
+}
+
+- (void) dealloc
+{
+    if (_memoryPressureSource)
+    {
+        dispatch_source_cancel(_memoryPressureSource);
+        dispatch_release(_memoryPressureSource), _memoryPressureSource = NULL;
+    }
+    if (_queue)
+    {
+        dispatch_release(_queue), _queue = NULL;
+    }
+    [_entries release], _entries = nil;
+    [super dealloc];
+}
+
+
+#pragma mark - Registering caches
+
+- (void) registerCache: (id <BXTrimmableCache>)cache withPriority: (BXCachePriority)priority
+{
+    NSDictionary *entry = @{
+                            BXCacheRegistryCacheKey: [NSValue valueWithNonretainedObject: cache],
+                            BXCacheRegistryPriorityKey: @(priority),
+                            };
+
+    @synchronized(self)
+    {
+        [self unregisterCache: cache];
+
+        //Keep the list ordered from least to most important, with later registrations
+        //of the same priority after earlier ones.
+        NSUInteger index = 0;
+        for (NSDictionary *existingEntry in _entries)
+        {
+            if ([[existingEntry objectForKey: BXCacheRegistryPriorityKey] integerValue] > priority)
+                break;
+            index++;
+        }
+        [_entries insertObject: entry atIndex: index];
+    }
+}
+
+- (void) unregisterCache: (id <BXTrimmableCache>)cache
+{
+    @synchronized(self)
+    {
+        for (NSUInteger i=0; i<_entries.count; i++)
+        {
+            NSValue *value = [[_entries objectAtIndex: i] objectForKey: BXCacheRegistryCacheKey];
+            if (value.nonretainedObjectValue == cache)
+            {
+                [_entries removeObjectAtIndex: i];
+                break;
+            }
+        }
+    }
+}
+
+- (NSArray *) _cachesInTrimOrder
+{
+    NSMutableArray *caches = [NSMutableArray arrayWithCapacity: _entries.count];
+    for (NSDictionary *entry in _entries)
+    {
+        NSValue *value = [entry objectForKey: BXCacheRegistryCacheKey];
+        [caches addObject: value.nonretainedObjectValue];
+    }
+    return caches;
+}
+
+- (NSUInteger) totalCacheSize
+{
+    NSUInteger totalSize = 0;
+    @synchronized(self)
+    {
+        for (id <BXTrimmableCache> cache in [self _cachesInTrimOrder])
+            totalSize += cache.cacheSize;
+    }
+    return totalSize;
+}
+
+
+#pragma mark - Trimming caches
+
+//IMPLEMENTATION NOTE: caches are trimmed while we hold the lock, so that a cache cannot
+//unregister itself and be deallocated partway through being trimmed.
+
+- (void) trimCachesToBudget
+{
+    @synchronized(self)
+    {
+        NSArray *caches = [self _cachesInTrimOrder];
+        NSUInteger totalSize = self.totalCacheSize;
+
+        BXCacheTrimLevel levels[2] = { BXCacheTrimSpare, BXCacheTrimAll };
+        for (NSUInteger i=0; i<2; i++)
+        {
+            for (id <BXTrimmableCache> cache in caches)
+            {
+                if (totalSize <= self.budget)
+                    return;
+
+                NSUInteger sizeBeforeTrimming = cache.cacheSize;
+                [cache trimCacheToLevel: levels[i]];
+                NSUInteger sizeAfterTrimming = MIN(sizeBeforeTrimming, cache.cacheSize);
+
+                totalSize -= MIN(totalSize, sizeBeforeTrimming - sizeAfterTrimming);
+            }
+        }
+    }
+}
+
+- (void) trimAllCaches
+{
+    @synchronized(self)
+    {
+        for (id <BXTrimmableCache> cache in [self _cachesInTrimOrder])
+            [cache trimCacheToLevel: BXCacheTrimAll];
+    }
+}
+
+- (void) _memoryPressureDidChange
+{
+#ifdef DISPATCH_SOURCE_TYPE_MEMORYPRESSURE
+    unsigned long pressure = dispatch_source_get_data(_memoryPressureSource);
+    if (pressure & DISPATCH_MEMORYPRESSURE_CRITICAL)
+    {
+        [self trimAllCaches];
+    }
+    else if (pressure & DISPATCH_MEMORYPRESSURE_WARN)
+    {
+        [self trimCachesToBudget];
+    }
+#endif
+}
+
+@end
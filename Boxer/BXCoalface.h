@@ -42,6 +42,7 @@ extern "C" {
 	
 #pragma mark - Rendering
 	Bitu boxer_prepareForFrameSize(Bitu width, Bitu height, Bitu gfx_flags, double scalex, double scaley, GFX_CallBack_t callback);
+	bool boxer_frameNeeded();
 	bool boxer_startFrame(Bit8u **frameBuffer, Bitu *pitch);
 	void boxer_finishFrame(const uint16_t *dirtyBlocks);
 	Bitu boxer_idealOutputMode(Bitu flags);
@@ -56,6 +57,11 @@ extern "C" {
     
     double boxer_CGACompositeHueOffset();
     void boxer_setCGACompositeHueOffset(double hue);
+    void boxer_CGACompositeSignal(double *hue, Bit8u *red, Bit8u *green, Bit8u *blue);
+    
+    //Whether Boxer draws the SVGA hardware cursor over frames itself, instead of DOSBox
+    //drawing it into each line.
+    bool boxer_drawsHardwareCursor();
     
     
 #pragma mark - Shell
@@ -125,6 +131,7 @@ extern "C" {
     bool boxer_createLocalDir(const char *path, DOS_Drive *drive);
     bool boxer_removeLocalDir(const char *path, DOS_Drive *drive);
     bool boxer_getLocalPathStats(const char *path, DOS_Drive *drive, struct stat *outStatus);
+    bool boxer_getLocalDirectoryStamp(const char *path, DOS_Drive *drive, Bit64u *outStamp);
     bool boxer_localDirectoryExists(const char *path, DOS_Drive *drive);
     bool boxer_localFileExists(const char *path, DOS_Drive *drive);
     
@@ -139,16 +146,29 @@ extern "C" {
 	
 	//Called from dosbox.cpp to allow control over the emulation loop.
 	void boxer_runLoopWillStartWithContextInfo(void **contextInfo);
-	void boxer_runLoopDidFinishWithContextInfo(void *contextInfo);
+	void boxer_runLoopDidFinishWithContextInfo(void **contextInfo, bool exiting);
 	bool boxer_runLoopShouldContinue();
 	void boxer_processEvents();
 	
+	//Called from perfcounters.cpp on the emulation thread each time new timings are published.
+	void boxer_performanceCountersDidUpdate();
+	
+	//Called from cpu.cpp when core=adaptive moves to the dynamic core or back to the normal core.
+	//reason is one of "protected", "realmode" or "smc".
+	void boxer_CPUCoreDidSwitch(bool dynamic, const char *reason);
+	
     
 #pragma mark - Input
     
     void boxer_setJoystickActive(bool joystickActive);
 	void boxer_setMouseActive(bool mouseActive);
 	void boxer_mouseMovedToPoint(float x, float y);
+    bool boxer_takeMouseMotion(float *xrel, float *yrel);
+    
+    //Called from keyboard.cpp and mouse.cpp for input latency measurements:
+    //see BXInputLatencyRecorder. These do nothing unless a measurement is running.
+    void boxer_inputDidReachEmulation();
+    void boxer_programDidReadInput();
     
     //Defined in keyboard.cpp to let Boxer see if there's any room left in the keyboard buffer.
     Bitu boxer_keyboardBufferRemaining();
@@ -178,6 +198,10 @@ extern "C" {
     //If consumeKey is true, the key will be removed from the buffer as it is read.
     bool boxer_getNextKeyCodeInPasteBuffer(Bit16u *outKeyCode, bool consumeKey);
     
+    //Fills outKeyCodes with up to maxKeyCodes keycodes from Boxer's internal key buffer,
+    //removing them from the buffer. Returns the number of keycodes retrieved.
+    Bitu boxer_takeKeyCodesFromPasteBuffer(Bit16u *outKeyCodes, Bitu maxKeyCodes);
+    
     
 #pragma mark - Printer support
     
@@ -197,6 +221,10 @@ extern "C" {
 	const char * boxer_localizedStringForKey(char const * key);
     
     void boxer_log(char const* format,...);
+    
+    //Called from dos_keyboard_layout.cpp: returns the path at which to keep the specified file
+    //between sessions, or NULL if nothing should be kept.
+    const char * boxer_cachePathForFile(char const * fileName);
     void boxer_die(char const *functionName, char const *fileName, int lineNumber, char const* format,...);
     
 #if __cplusplus
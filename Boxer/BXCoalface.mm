@@ -7,12 +7,21 @@
 
 
 #import "BXCoalface.h"
+#import "BXCoalfaceDrives.h"
 #import "BXEmulatorPrivate.h"
 #import "setup.h"
 #import "mapper.h"
 #import "cross.h"
 #import "shell.h"
 #import "ADBFilesystem.h"
+#import "BXInputLatencyRecorder.h"
+#import "signposts.h"
+#import <dirent.h>
+#import <errno.h>
+#import <fcntl.h>
+#import <sys/attr.h>
+#import <sys/vnode.h>
+#import <sys/stat.h>
 
 #pragma mark - Runloop state functions
 
@@ -29,9 +38,9 @@ void boxer_runLoopWillStartWithContextInfo(void **contextInfo)
 	[[BXEmulator currentEmulator] _runLoopWillStartWithContextInfo: contextInfo];
 }
 
-void boxer_runLoopDidFinishWithContextInfo(void *contextInfo)
+void boxer_runLoopDidFinishWithContextInfo(void **contextInfo, bool exiting)
 {
-	[[BXEmulator currentEmulator] _runLoopDidFinishWithContextInfo: contextInfo];
+	[[BXEmulator currentEmulator] _runLoopDidFinishWithContextInfo: contextInfo exiting: exiting];
 }
 
 //This is called at the start of DOSBox_NormalLoop, and
@@ -41,6 +50,22 @@ bool boxer_runLoopShouldContinue()
 	return [[BXEmulator currentEmulator] _runLoopShouldContinue];
 }
 
+//Notifies Boxer that a new set of performance counters is available.
+void boxer_performanceCountersDidUpdate()
+{
+    BXEmulator *emulator = [BXEmulator currentEmulator];
+    [emulator willChangeValueForKey: @"performanceCounters"];
+    [emulator didChangeValueForKey: @"performanceCounters"];
+}
+
+//Notifies Boxer that the adaptive core has moved between the normal and dynamic cores.
+void boxer_CPUCoreDidSwitch(bool dynamic, const char *reason)
+{
+    BXEmulator *emulator = [BXEmulator currentEmulator];
+    [emulator _didSwitchAdaptiveCoreToDynamic: dynamic
+                                       reason: [NSString stringWithUTF8String: reason]];
+}
+
 //Notifies Boxer of changes to title and speed settings
 void boxer_handleDOSBoxTitleChange(Bit32s newCycles, Bits newFrameskip, bool newPaused)
 {
@@ -63,17 +88,38 @@ Bitu boxer_prepareForFrameSize(Bitu width, Bitu height, Bitu gfx_flags, double s
 	
 	NSSize outputSize	= NSMakeSize((CGFloat)width, (CGFloat)height);
 	NSSize scale		= NSMakeSize((CGFloat)scalex, (CGFloat)scaley);
-	[[emulator videoHandler] prepareForOutputSize: outputSize atScale: scale withCallback: callback];
 	
-	return GFX_CAN_32 | GFX_SCALING;
+	//8-bit output is passed on as palette indexes, which the renderer looks up on the GPU.
+	Bitu mode = boxer_idealOutputMode(gfx_flags);
+	NSUInteger depth = (mode & GFX_CAN_8) ? 1 : 4;
+	[[emulator videoHandler] prepareForOutputSize: outputSize atScale: scale depth: depth withCallback: callback];
+	
+	return mode;
 }
 
 Bitu boxer_idealOutputMode(Bitu flags)
 {
 	//Originally this tested various bit depths to find the most appropriate mode for the chosen scaler.
-	//Because OS X always uses a 32bpp context and Boxer always uses RGBA-capable scalers, we ignore the
-	//original function's behaviour altogether and just return something that will keep DOSBox happy.
-	return GFX_CAN_32 | GFX_SCALING;
+	//Boxer draws 32-bit frames for everything except 8-bit video modes drawn with scalers that can
+	//output 8-bit lines: those are left as palette indexes, for a quarter of the frame size and
+	//so that palette changes don't need the whole frame redrawn.
+	if (flags & GFX_CAN_8)
+		return GFX_CAN_8 | GFX_SCALING;
+	else
+		return GFX_CAN_32 | GFX_SCALING;
+}
+
+bool boxer_drawsHardwareCursor()
+{
+	//Our renderers draw the hardware cursor over each frame as a separate quad,
+	//so that it can move over a static screen without any lines being redrawn.
+	return YES;
+}
+
+bool boxer_frameNeeded()
+{
+	BXEmulator *emulator = [BXEmulator currentEmulator];
+	return [[emulator videoHandler] isFrameNeeded];
 }
 
 bool boxer_startFrame(Bit8u **frameBuffer, Bitu *pitch)
@@ -84,6 +130,7 @@ bool boxer_startFrame(Bit8u **frameBuffer, Bitu *pitch)
 
 void boxer_finishFrame(const uint16_t *dirtyBlocks)
 {
+    SignpostScope signpost(SIGNPOST_FRAME_HANDOFF);
 	BXEmulator *emulator = [BXEmulator currentEmulator];
 	[[emulator videoHandler] finishFrameWithChanges: dirtyBlocks];	
 }
@@ -96,11 +143,8 @@ Bitu boxer_getRGBPaletteEntry(Bit8u red, Bit8u green, Bit8u blue)
 
 void boxer_setPalette(Bitu start,Bitu count,GFX_PalEntry * entries)
 {
-	//This replacement DOSBox function does nothing, as the original was intended only for SDL
-	//surface palettes which are irrelevant to OpenGL.
-	//Furthermore it should never be called: if it does, that means DOSBox thinks it's using
-	//surface output and this is a bug.
-	NSCAssert(NO, @"boxer_setPalette called. This is a bug and should never happen.");
+	BXEmulator *emulator = [BXEmulator currentEmulator];
+	[[emulator videoHandler] setPaletteEntries: entries start: start count: count];
 }
 
 
@@ -255,89 +299,341 @@ bool boxer_shouldShowFileWithName(const char *name)
 bool boxer_shouldAllowWriteAccessToPath(const char *path, DOS_Drive *dosboxDrive)
 {
 	BXEmulator *emulator = [BXEmulator currentEmulator];
+    
+    BXLocalPathInfo *info = boxer_cachedLocalPathInfo(path, dosboxDrive);
+    if (info)
+    {
+        if (info->writable == -1)
+            info->writable = [emulator _shouldAllowWriteAccessToLocalPath: path onDOSBoxDrive: dosboxDrive];
+        return info->writable;
+    }
+    
 	return [emulator _shouldAllowWriteAccessToLocalPath: path onDOSBoxDrive: dosboxDrive];
 }
 
 //Tells Boxer to resync its cached drives - called by DOSBox functions that add/remove drives
 void boxer_driveDidMount(Bit8u driveIndex)
 {
+    boxer_invalidateLocalPathCache();
 	BXEmulator *emulator = [BXEmulator currentEmulator];
 	[emulator _syncDriveCache];
 }
 
 void boxer_driveDidUnmount(Bit8u driveIndex)
 {
+    boxer_invalidateLocalPathCache();
 	BXEmulator *emulator = [BXEmulator currentEmulator];
 	[emulator _syncDriveCache];
 }
 
 void boxer_didCreateLocalFile(const char *path, DOS_Drive *dosboxDrive)
 {
+    boxer_forgetLocalPaths(dosboxDrive);
 	BXEmulator *emulator = [BXEmulator currentEmulator];
 	[emulator _didCreateFileAtLocalPath: path onDOSBoxDrive: dosboxDrive];
 }
 
 void boxer_didRemoveLocalFile(const char *path, DOS_Drive *dosboxDrive)
 {
+    boxer_forgetLocalPaths(dosboxDrive);
 	BXEmulator *emulator = [BXEmulator currentEmulator];
 	[emulator _didRemoveFileAtLocalPath: path onDOSBoxDrive: dosboxDrive];
 }
 
 
 
+//Paths that have been looked up before are answered from the cache in BXCoalfaceDrives
+//where possible. Anything that may change what's on the drive goes through Boxer's filesystem
+//as usual, and makes the drive forget what it had cached.
+//Each operation is marked out as a signpost interval, so that slow drive access shows up in Instruments.
+
 FILE * boxer_openLocalFile(const char *path, DOS_Drive *drive, const char *mode)
 {
+    SignpostScope signpost(SIGNPOST_DRIVE_IO, "open", path);
+    //Files opened only for reading come straight from wherever their path resolved to:
+    //shadowed filesystems only move files around when they're opened for writing.
+    bool readOnly = (strpbrk(mode, "wa+") == NULL);
+    BXLocalPathInfo *info = NULL;
+    if (readOnly)
+    {
+        info = boxer_cachedLocalPathInfo(path, drive);
+        if (info && info->type == BXLocalPathMissing)
+        {
+            errno = ENOENT;
+            return NULL;
+        }
+    }
+    else
+    {
+        boxer_forgetLocalPaths(drive);
+    }
+    
     BXEmulator *emulator = [BXEmulator currentEmulator];
-    return [emulator _openFileAtLocalPath: path onDOSBoxDrive: drive inMode: mode];
+    FILE *file;
+    if (info)
+        file = fopen(info->resolvedPath.c_str(), mode);
+    else
+        file = [emulator _openFileAtLocalPath: path onDOSBoxDrive: drive inMode: mode];
+    
+    if (file)
+        [emulator _didOpenLocalFile: file inMode: mode];
+    
+    return file;
 }
 
 bool boxer_removeLocalFile(const char *path, DOS_Drive *drive)
 {
+    SignpostScope signpost(SIGNPOST_DRIVE_IO, "remove", path);
+    boxer_forgetLocalPaths(drive);
     BXEmulator *emulator = [BXEmulator currentEmulator];
     return [emulator _removeFileAtLocalPath: path onDOSBoxDrive: drive];
 }
 
 bool boxer_moveLocalFile(const char *fromPath, const char *toPath, DOS_Drive *drive)
 {
+    SignpostScope signpost(SIGNPOST_DRIVE_IO, "move", fromPath);
+    boxer_forgetLocalPaths(drive);
     BXEmulator *emulator = [BXEmulator currentEmulator];
     return [emulator _moveLocalPath: fromPath toLocalPath: toPath onDOSBoxDrive: drive];
 }
 
 bool boxer_createLocalDir(const char *path, DOS_Drive *drive)
 {
+    SignpostScope signpost(SIGNPOST_DRIVE_IO, "mkdir", path);
+    boxer_forgetLocalPaths(drive);
     BXEmulator *emulator = [BXEmulator currentEmulator];
     return [emulator _createDirectoryAtLocalPath: path onDOSBoxDrive: drive];
 }
 
 bool boxer_removeLocalDir(const char *path, DOS_Drive *drive)
 {
+    SignpostScope signpost(SIGNPOST_DRIVE_IO, "rmdir", path);
+    boxer_forgetLocalPaths(drive);
     BXEmulator *emulator = [BXEmulator currentEmulator];
     return [emulator _removeDirectoryAtLocalPath: path onDOSBoxDrive: drive];
 }
 
 bool boxer_getLocalPathStats(const char *path, DOS_Drive *drive, struct stat *outStatus)
 {
+    SignpostScope signpost(SIGNPOST_DRIVE_IO, "stat", path);
+    BXLocalPathInfo *info = boxer_cachedLocalPathInfo(path, drive);
+    if (info)
+    {
+        if (info->type == BXLocalPathMissing)
+            return false;
+        
+        //The stats themselves aren't cached, since the file's size and dates change as it's written to.
+        //If the file has vanished since we cached it, forget it and look again the long way.
+        if (stat(info->resolvedPath.c_str(), outStatus) == 0)
+            return true;
+        
+        boxer_forgetLocalPaths(drive);
+    }
+    
     BXEmulator *emulator = [BXEmulator currentEmulator];
     return [emulator _getStats: outStatus forLocalPath: path onDOSBoxDrive: drive];
 }
 
+bool boxer_getLocalDirectoryStamp(const char *path, DOS_Drive *drive, Bit64u *outStamp)
+{
+    SignpostScope signpost(SIGNPOST_DRIVE_IO, "directory stamp", path);
+    BXEmulator *emulator = [BXEmulator currentEmulator];
+    uint64_t stamp = 0;
+    BOOL stamped = [emulator _getModificationStamp: &stamp forLocalDirectory: path onDOSBoxDrive: drive];
+    if (stamped) *outStamp = stamp;
+    return stamped;
+}
+
 bool boxer_localDirectoryExists(const char *path, DOS_Drive *drive)
 {
+    SignpostScope signpost(SIGNPOST_DRIVE_IO, "directory exists", path);
+    BXLocalPathInfo *info = boxer_cachedLocalPathInfo(path, drive);
+    if (info)
+        return info->type == BXLocalPathDirectory;
+    
     BXEmulator *emulator = [BXEmulator currentEmulator];
     return [emulator _localDirectoryExists: path onDOSBoxDrive: drive];
 }
 
 bool boxer_localFileExists(const char *path, DOS_Drive *drive)
 {
+    SignpostScope signpost(SIGNPOST_DRIVE_IO, "file exists", path);
+    BXLocalPathInfo *info = boxer_cachedLocalPathInfo(path, drive);
+    if (info)
+        return info->type == BXLocalPathFile;
+    
     BXEmulator *emulator = [BXEmulator currentEmulator];
     return [emulator _localFileExists: path onDOSBoxDrive: drive];
 }
 
 #pragma mark Directory enumeration
 
+//Handles for open directories come in two kinds: directories on plain local folders are read in
+//one go into a buffer of names, while everything else is enumerated through the drive's filesystem.
+typedef struct {
+    NSDictionary *enumeratorInfo;
+    
+    //Each entry is a flag byte (nonzero for directories) followed by the NUL-terminated name.
+    char *entries;
+    size_t entriesLength;
+    size_t nextEntry;
+} BXLocalDirectoryHandle;
+
+//How much to grow the entry buffer by when reading a directory.
+#define BXLocalDirectoryBufferChunk 16384
+
+static bool _BXAppendDirectoryEntry(BXLocalDirectoryHandle *handle, size_t *capacity, const char *name, bool isDirectory)
+{
+    //Names that aren't plain ASCII are passed through NSString like the enumerator would do,
+    //so that they come out in the same normalization form either way.
+    for (const char *c = name; *c; c++)
+    {
+        if (*c & 0x80)
+        {
+            NSString *fileName = [[NSString alloc] initWithUTF8String: name];
+            if (fileName)
+            {
+                name = fileName.fileSystemRepresentation;
+                [fileName autorelease];
+            }
+            break;
+        }
+    }
+    
+    size_t nameLength = strlen(name);
+    if (nameLength >= CROSS_LEN) nameLength = CROSS_LEN - 1;
+    
+    size_t entryLength = nameLength + 2;
+    if (handle->entriesLength + entryLength > *capacity)
+    {
+        size_t newCapacity = *capacity + MAX(entryLength, BXLocalDirectoryBufferChunk);
+        char *newEntries = (char *)realloc(handle->entries, newCapacity);
+        if (!newEntries) return false;
+        handle->entries = newEntries;
+        *capacity = newCapacity;
+    }
+    
+    char *entry = handle->entries + handle->entriesLength;
+    entry[0] = isDirectory;
+    memcpy(entry + 1, name, nameLength);
+    entry[nameLength + 1] = 0;
+    handle->entriesLength += entryLength;
+    return true;
+}
+
+//Reads the entire contents of the specified directory into the handle's buffer,
+//returning false if the directory could not be read.
+static bool _BXReadLocalDirectory(const char *path, BXLocalDirectoryHandle *handle)
+{
+    size_t capacity = 0;
+    
+    //DOSBox expects directory entries for . and .., which we always list first.
+    if (!_BXAppendDirectoryEntry(handle, &capacity, ".", true) ||
+        !_BXAppendDirectoryEntry(handle, &capacity, "..", true))
+        return false;
+    
+    bool succeeded = true;
+    
+#if defined(MAC_OS_X_VERSION_10_10) && MAC_OS_X_VERSION_MAX_ALLOWED >= MAC_OS_X_VERSION_10_10
+    //getattrlistbulk gives us the names and types of many entries per call, where available.
+    if (getattrlistbulk != NULL)
+    {
+        int fd = open(path, O_RDONLY | O_DIRECTORY);
+        if (fd < 0) return false;
+        
+        struct attrlist attributes;
+        memset(&attributes, 0, sizeof(attributes));
+        attributes.bitmapcount = ATTR_BIT_MAP_COUNT;
+        attributes.commonattr = ATTR_CMN_RETURNED_ATTRS | ATTR_CMN_NAME | ATTR_CMN_OBJTYPE;
+        
+        char buffer[65536];
+        int count;
+        while (succeeded && (count = getattrlistbulk(fd, &attributes, buffer, sizeof(buffer), 0)) > 0)
+        {
+            char *entry = buffer;
+            for (int i=0; i < count && succeeded; i++)
+            {
+                //Attributes come back in bitmap order, after the entry length and the set of
+                //attributes that were actually returned.
+                char *field = entry;
+                uint32_t entryLength = *(uint32_t *)field;
+                field += sizeof(uint32_t);
+                
+                attribute_set_t returned = *(attribute_set_t *)field;
+                field += sizeof(attribute_set_t);
+                
+                const char *name = NULL;
+                if (returned.commonattr & ATTR_CMN_NAME)
+                {
+                    attrreference_t nameRef = *(attrreference_t *)field;
+                    name = field + nameRef.attr_dataoffset;
+                    field += sizeof(attrreference_t);
+                }
+                
+                fsobj_type_t type = VNON;
+                if (returned.commonattr & ATTR_CMN_OBJTYPE)
+                {
+                    type = *(fsobj_type_t *)field;
+                    field += sizeof(fsobj_type_t);
+                }
+                
+                if (name) succeeded = _BXAppendDirectoryEntry(handle, &capacity, name, type == VDIR);
+                entry += entryLength;
+            }
+        }
+        if (count < 0) succeeded = false;
+        
+        close(fd);
+        return succeeded;
+    }
+#endif
+    
+    DIR *dir = opendir(path);
+    if (!dir) return false;
+    
+    struct dirent *dirEntry;
+    while (succeeded && (dirEntry = readdir(dir)) != NULL)
+    {
+        const char *name = dirEntry->d_name;
+        if (!strcmp(name, ".") || !strcmp(name, "..")) continue;
+        
+        bool isDirectory;
+        if (dirEntry->d_type == DT_UNKNOWN)
+        {
+            //Not all filesystems fill in the type, in which case we have to look for ourselves.
+            char entryPath[PATH_MAX];
+            struct stat status;
+            snprintf(entryPath, sizeof(entryPath), "%s/%s", path, name);
+            isDirectory = (lstat(entryPath, &status) == 0 && S_ISDIR(status.st_mode));
+        }
+        else isDirectory = (dirEntry->d_type == DT_DIR);
+        
+        succeeded = _BXAppendDirectoryEntry(handle, &capacity, name, isDirectory);
+    }
+    closedir(dir);
+    
+    return succeeded;
+}
+
 void *boxer_openLocalDirectory(const char *path, DOS_Drive *drive)
 {
+    SignpostScope signpost(SIGNPOST_DRIVE_IO, "opendir", path);
     BXEmulator *emulator = [BXEmulator currentEmulator];
+    BXLocalDirectoryHandle *handle = (BXLocalDirectoryHandle *)calloc(1, sizeof(BXLocalDirectoryHandle));
+    
+    //If the drive is a plain local folder, read the directory directly in one go
+    //rather than creating and stepping through an enumerator for it.
+    if ([emulator _canReadLocalPathDirectly: path onDOSBoxDrive: drive])
+    {
+        if (_BXReadLocalDirectory(path, handle))
+            return handle;
+        
+        //If that failed, fall back on the filesystem to deal with it.
+        free(handle->entries);
+        handle->entries = NULL;
+        handle->entriesLength = 0;
+    }
+    
     id <ADBFilesystemFileURLEnumeration> enumerator = [emulator _directoryEnumeratorForLocalPath: path
                                                                                         onDOSBoxDrive: drive];
     
@@ -347,21 +643,40 @@ void *boxer_openLocalDirectory(const char *path, DOS_Drive *drive)
     //which are expected by DOSBox. So, we insert them ourselves during iteration.
     NSMutableArray *fakeEntries = [NSMutableArray arrayWithObjects: @".", @"..", nil];
     
-    //The dictionary will be released when the calling context calls boxer_closeLocalDirectory() with the pointer to the dictionary.
+    //The dictionary will be released when the calling context calls boxer_closeLocalDirectory() with the handle.
     NSDictionary *enumeratorInfo = @{ @"enumerator": enumerator, @"fakeEntries": fakeEntries };
+    handle->enumeratorInfo = [enumeratorInfo retain];
     
-    return (__bridge void *)[enumeratorInfo retain];
+    return handle;
 }
 
 void boxer_closeLocalDirectory(void *handle)
 {
-    NSDictionary *enumeratorInfo = (__bridge NSDictionary *)handle;
-    [enumeratorInfo release];
+    BXLocalDirectoryHandle *directoryHandle = (BXLocalDirectoryHandle *)handle;
+    [directoryHandle->enumeratorInfo release];
+    free(directoryHandle->entries);
+    free(directoryHandle);
 }
 
 bool boxer_getNextDirectoryEntry(void *handle, char *outName, bool &isDirectory)
 {
-    NSDictionary *enumeratorInfo = (__bridge NSDictionary *)handle;
+    BXLocalDirectoryHandle *directoryHandle = (BXLocalDirectoryHandle *)handle;
+    
+    if (directoryHandle->entries)
+    {
+        if (directoryHandle->nextEntry >= directoryHandle->entriesLength)
+            return false;
+        
+        const char *entry = directoryHandle->entries + directoryHandle->nextEntry;
+        size_t nameLength = strlen(entry + 1);
+        
+        isDirectory = (entry[0] != 0);
+        memcpy(outName, entry + 1, nameLength + 1);
+        directoryHandle->nextEntry += nameLength + 2;
+        return true;
+    }
+    
+    NSDictionary *enumeratorInfo = directoryHandle->enumeratorInfo;
     NSMutableArray *fakeEntries = [enumeratorInfo objectForKey: @"fakeEntries"];
     
     if (fakeEntries.count)
@@ -440,6 +755,15 @@ bool boxer_getNextKeyCodeInPasteBuffer(Bit16u *outKeyCode, bool consumeKey)
     else return false;
 }
 
+Bitu boxer_takeKeyCodesFromPasteBuffer(Bit16u *outKeyCodes, Bitu maxKeyCodes)
+{
+	BXEmulator *emulator = [BXEmulator currentEmulator];
+    
+    [emulator _polledBIOSKeyBuffer];
+    
+    return [emulator.keyBuffer takeKeys: outKeyCodes maxCount: maxKeyCodes];
+}
+
 void boxer_setMouseActive(bool mouseActive)
 {
 	BXEmulator *emulator = [BXEmulator currentEmulator];
@@ -459,6 +783,28 @@ void boxer_mouseMovedToPoint(float x, float y)
 	emulator.mouse.position = point;
 }
 
+bool boxer_takeMouseMotion(float *xrel, float *yrel)
+{
+    NSPoint delta;
+	BXEmulator *emulator = [BXEmulator currentEmulator];
+    if (![emulator.mouse takePendingMotion: &delta])
+        return false;
+    
+    *xrel = (float)delta.x;
+    *yrel = (float)delta.y;
+    return true;
+}
+
+void boxer_inputDidReachEmulation()
+{
+    BXInputLatencyMark(BXInputLatencyDelivered);
+}
+
+void boxer_programDidReadInput()
+{
+    BXInputLatencyMark(BXInputLatencyRead);
+}
+
 void boxer_setCapsLockActive(bool active)
 {
 	BXEmulator *emulator = [BXEmulator currentEmulator];
@@ -489,6 +835,7 @@ Bitu boxer_PRINTER_readdata(Bitu port,Bitu iolen)
 void boxer_PRINTER_writedata(Bitu port,Bitu val,Bitu iolen)
 {
 	BXEmulator *emulator = [BXEmulator currentEmulator];
+    BXStallCallScope stallCall("printer data");
     emulator.printer.dataRegister = val;
 }
 
@@ -501,6 +848,7 @@ Bitu boxer_PRINTER_readstatus(Bitu port,Bitu iolen)
 void boxer_PRINTER_writecontrol(Bitu port,Bitu val, Bitu iolen)
 {
 	BXEmulator *emulator = [BXEmulator currentEmulator];
+    BXStallCallScope stallCall("printer control");
     emulator.printer.controlRegister = val;
 }
 
@@ -514,6 +862,7 @@ bool boxer_PRINTER_isInited(Bitu port)
 {
 	BXEmulator *emulator = [BXEmulator currentEmulator];
     //Tell the emulator we actually want a printer
+    BXStallCallScope stallCall("-emulator:didRequestPrinterOnLPTPort:");
     [emulator _didRequestPrinterOnLPTPort: port];
     return emulator.printer != nil;
 }
@@ -533,6 +882,23 @@ const char * boxer_localizedStringForKey(char const *keyStr)
 	return [localizedString cStringUsingEncoding: BXDisplayStringEncoding];
 }
 
+const char * boxer_cachePathForFile(char const * fileName)
+{
+    NSURL *cacheURL = [BXEmulator cacheURL];
+    if (!cacheURL)
+        return NULL;
+    
+    BOOL created = [[NSFileManager defaultManager] createDirectoryAtURL: cacheURL
+                                            withIntermediateDirectories: YES
+                                                             attributes: nil
+                                                                  error: NULL];
+    if (!created)
+        return NULL;
+    
+    NSString *name = [NSString stringWithCString: fileName encoding: BXDirectStringEncoding];
+    return [cacheURL URLByAppendingPathComponent: name].path.fileSystemRepresentation;
+}
+
 void boxer_log(char const* format,...)
 {
 #ifdef BOXER_DEBUG
@@ -20,9 +20,35 @@ bool boxer_MIDIAvailable();
 
 //Dispatch MIDI messages sent from DOSBox's MPU-401 emulation.
 void boxer_sendMIDIMessage(Bit8u *msg);
+//Dispatch a MIDI message that fell due at the specified emulated time, in milliseconds
+//since emulation began. Sent by the MPU-401's intelligent mode.
+void boxer_sendMIDIMessageAtTime(Bit8u *msg, double timestamp);
 void boxer_sendMIDISysex(Bit8u *msg, Bitu len);
 
 float boxer_masterVolume(BXAudioChannel channel);
 
 //Defined in mixer.cpp. Update the volumes of all active channels.
-void boxer_updateVolumes();
\ No newline at end of file
+void boxer_updateVolumes();
+
+//Called from mixer.cpp with each batch of mixed output while a movie is being recorded.
+void boxer_recordMixerOutput(Bit32u sampleRate, Bitu numFrames, Bit16s *samples);
+
+#pragma mark - CoreAudio output
+
+//Called by the mixer on CoreAudio's render thread to fill stream with len bytes of 16-bit stereo audio.
+typedef void (*BXAudioOutputCallback)(void *userdata, Bit8u *stream, int len);
+
+//Called from mixer.cpp to play the mixer's output through a CoreAudio output unit instead of SDL.
+//sampleRate should be the preferred mixer rate: this will be replaced with the output device's own
+//rate so that CoreAudio has no need to resample. bufferFrames should be the preferred size of the
+//device's IO buffer: this will be replaced with the nearest size the device supports.
+//Returns false if the output could not be opened, in which case the mixer should fall back on SDL.
+//The output starts out paused.
+bool boxer_openAudioOutput(Bit32u *sampleRate, Bit32u *bufferFrames, BXAudioOutputCallback callback);
+void boxer_closeAudioOutput();
+void boxer_pauseAudioOutput(bool pause);
+
+//How many frames at the mixer's rate it takes for audio handed to CoreAudio to reach the speakers:
+//the output device's own latency and safety offset plus its IO buffer. This is kept up to date
+//when the device is switched or its sample rate is changed.
+Bitu boxer_audioOutputLatency();
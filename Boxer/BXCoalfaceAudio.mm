@@ -119,6 +119,18 @@ void boxer_sendMIDIMessage(Bit8u *msg)
 #endif
 }
 
+void boxer_sendMIDIMessageAtTime(Bit8u *msg, double timestamp)
+{
+    Bit8u status = msg[0];
+    NSUInteger len = (NSUInteger)BXMIDIMessageLength[status];
+    
+    if (len)
+    {
+        [[BXEmulator currentEmulator] sendMIDIMessage: [NSData dataWithBytesNoCopy: msg length: len freeWhenDone: NO]
+                                       atEmulatedTime: timestamp];
+    }
+}
+
 void boxer_sendMIDISysex(Bit8u *msg, Bitu len)
 {
     [[BXEmulator currentEmulator] sendMIDISysex: [NSData dataWithBytesNoCopy: msg length: len freeWhenDone: NO]];
@@ -129,3 +141,273 @@ float boxer_masterVolume(BXAudioChannel channel)
     //We don't use separate left and right volumes.
     return [BXEmulator currentEmulator].masterVolume;
 }
+
+void boxer_recordMixerOutput(Bit32u sampleRate, Bitu numFrames, Bit16s *samples)
+{
+    [[BXEmulator currentEmulator] _recordAudioSamples: (const int16_t *)samples
+                                               frames: numFrames
+                                           sampleRate: sampleRate];
+}
+
+
+#pragma mark - CoreAudio output
+
+#import <AudioUnit/AudioUnit.h>
+#import <CoreAudio/CoreAudio.h>
+
+static struct {
+    AudioUnit unit;
+    AudioDeviceID device;
+    BXAudioOutputCallback callback;
+    Float64 sampleRate;     //The rate the mixer is producing audio at.
+    UInt32 bufferFrames;    //The IO buffer size the mixer asked for.
+    volatile Bitu latency;  //In frames at the mixer's rate.
+    bool running;
+    //Device notifications arrive on threads of CoreAudio's choosing: they are handled
+    //on this queue, which opening and closing the output also go through.
+    dispatch_queue_t queue;
+} _audioOutput;
+
+static OSStatus _audioOutputDeviceChanged(AudioObjectID objectID, UInt32 numAddresses,
+                                          const AudioObjectPropertyAddress addresses[], void *context);
+
+static const AudioObjectPropertyAddress _defaultOutputDeviceAddress = {
+    kAudioHardwarePropertyDefaultOutputDevice,
+    kAudioObjectPropertyScopeGlobal,
+    kAudioObjectPropertyElementMaster
+};
+
+static const AudioObjectPropertyAddress _deviceSampleRateAddress = {
+    kAudioDevicePropertyNominalSampleRate,
+    kAudioObjectPropertyScopeGlobal,
+    kAudioObjectPropertyElementMaster
+};
+
+static OSStatus _renderAudioOutput(void *inRefCon,
+                                   AudioUnitRenderActionFlags *ioActionFlags,
+                                   const AudioTimeStamp *inTimeStamp,
+                                   UInt32 inBusNumber,
+                                   UInt32 inNumberFrames,
+                                   AudioBufferList *ioData)
+{
+    AudioBuffer *buffer = &ioData->mBuffers[0];
+    _audioOutput.callback(NULL, (Bit8u *)buffer->mData, (int)buffer->mDataByteSize);
+    return noErr;
+}
+
+static UInt32 _audioDeviceFrames(AudioDeviceID device, AudioObjectPropertySelector selector, AudioObjectPropertyScope scope)
+{
+    AudioObjectPropertyAddress address = { selector, scope, kAudioObjectPropertyElementMaster };
+    UInt32 value = 0, size = sizeof(value);
+    if (AudioObjectGetPropertyData(device, &address, 0, NULL, &size, &value) != noErr)
+        return 0;
+    return value;
+}
+
+static Float64 _audioDeviceSampleRate(AudioDeviceID device)
+{
+    Float64 rate = 0;
+    UInt32 size = sizeof(rate);
+    if (AudioObjectGetPropertyData(device, &_deviceSampleRateAddress, 0, NULL, &size, &rate) != noErr)
+        return 0;
+    return rate;
+}
+
+//Applies our preferred IO buffer size to the unit's current output device, and works out
+//how much latency the device adds. Called on the output queue.
+static void _syncAudioOutputDevice()
+{
+    AudioDeviceID device = kAudioObjectUnknown;
+    UInt32 size = sizeof(device);
+    if (AudioUnitGetProperty(_audioOutput.unit, kAudioOutputUnitProperty_CurrentDevice,
+                             kAudioUnitScope_Global, 0, &device, &size) != noErr)
+        return;
+    
+    //Follow sample rate changes on whichever device we're now playing through.
+    if (device != _audioOutput.device)
+    {
+        if (_audioOutput.device != kAudioObjectUnknown)
+            AudioObjectRemovePropertyListener(_audioOutput.device, &_deviceSampleRateAddress, _audioOutputDeviceChanged, NULL);
+        AudioObjectAddPropertyListener(device, &_deviceSampleRateAddress, _audioOutputDeviceChanged, NULL);
+        _audioOutput.device = device;
+    }
+    
+    //Ask for the IO buffer size we want, within the range the device supports.
+    UInt32 bufferFrames = _audioOutput.bufferFrames;
+    AudioValueRange range;
+    AudioObjectPropertyAddress address = {
+        kAudioDevicePropertyBufferFrameSizeRange,
+        kAudioObjectPropertyScopeGlobal,
+        kAudioObjectPropertyElementMaster
+    };
+    size = sizeof(range);
+    if (AudioObjectGetPropertyData(device, &address, 0, NULL, &size, &range) == noErr)
+    {
+        if (bufferFrames < range.mMinimum) bufferFrames = (UInt32)range.mMinimum;
+        if (bufferFrames > range.mMaximum) bufferFrames = (UInt32)range.mMaximum;
+    }
+    address.mSelector = kAudioDevicePropertyBufferFrameSize;
+    AudioObjectSetPropertyData(device, &address, 0, NULL, sizeof(bufferFrames), &bufferFrames);
+    
+    //Add up everything that stands between our render callback and the speakers.
+    UInt32 deviceFrames = _audioDeviceFrames(device, kAudioDevicePropertyBufferFrameSize, kAudioObjectPropertyScopeGlobal);
+    deviceFrames += _audioDeviceFrames(device, kAudioDevicePropertyLatency, kAudioDevicePropertyScopeOutput);
+    deviceFrames += _audioDeviceFrames(device, kAudioDevicePropertySafetyOffset, kAudioDevicePropertyScopeOutput);
+    
+    AudioStreamID stream;
+    size = sizeof(stream);
+    address.mSelector = kAudioDevicePropertyStreams;
+    address.mScope = kAudioDevicePropertyScopeOutput;
+    if (AudioObjectGetPropertyData(device, &address, 0, NULL, &size, &stream) == noErr && size >= sizeof(stream))
+        deviceFrames += _audioDeviceFrames(stream, kAudioStreamPropertyLatency, kAudioObjectPropertyScopeGlobal);
+    
+    //The mixer can't change its rate once it's running, so if the device's rate has changed
+    //the output unit will be resampling for us: report the latency at the mixer's rate.
+    Float64 deviceRate = _audioDeviceSampleRate(device);
+    if (deviceRate <= 0) deviceRate = _audioOutput.sampleRate;
+    _audioOutput.latency = (Bitu)(deviceFrames * _audioOutput.sampleRate / deviceRate);
+}
+
+static OSStatus _audioOutputDeviceChanged(AudioObjectID objectID, UInt32 numAddresses,
+                                          const AudioObjectPropertyAddress addresses[], void *context)
+{
+    dispatch_async(_audioOutput.queue, ^{
+        if (_audioOutput.unit) _syncAudioOutputDevice();
+    });
+    return noErr;
+}
+
+static void _disposeAudioOutput()
+{
+    if (_audioOutput.unit)
+    {
+        AudioOutputUnitStop(_audioOutput.unit);
+        AudioUnitUninitialize(_audioOutput.unit);
+        AudioComponentInstanceDispose(_audioOutput.unit);
+        _audioOutput.unit = NULL;
+    }
+    AudioObjectRemovePropertyListener(kAudioObjectSystemObject, &_defaultOutputDeviceAddress, _audioOutputDeviceChanged, NULL);
+    if (_audioOutput.device != kAudioObjectUnknown)
+    {
+        AudioObjectRemovePropertyListener(_audioOutput.device, &_deviceSampleRateAddress, _audioOutputDeviceChanged, NULL);
+        _audioOutput.device = kAudioObjectUnknown;
+    }
+    _audioOutput.running = false;
+    _audioOutput.latency = 0;
+}
+
+bool boxer_openAudioOutput(Bit32u *sampleRate, Bit32u *bufferFrames, BXAudioOutputCallback callback)
+{
+    if (!_audioOutput.queue)
+        _audioOutput.queue = dispatch_queue_create("com.boxer.audiooutput", NULL);
+    
+    __block OSStatus errCode = noErr;
+    BXStallCallScope stallCall("opening audio output");
+    dispatch_sync(_audioOutput.queue, ^{
+        _disposeAudioOutput();
+        
+        AudioComponentDescription outputDesc;
+        outputDesc.componentType = kAudioUnitType_Output;
+        outputDesc.componentSubType = kAudioUnitSubType_DefaultOutput;
+        outputDesc.componentManufacturer = kAudioUnitManufacturer_Apple;
+        outputDesc.componentFlags = 0;
+        outputDesc.componentFlagsMask = 0;
+        
+#define REQUIRE(result) if ((errCode = result) != noErr) break
+        
+        do {
+            AudioComponent component = AudioComponentFindNext(NULL, &outputDesc);
+            if (!component)
+            {
+                errCode = kAudioUnitErr_InvalidElement;
+                break;
+            }
+            REQUIRE(AudioComponentInstanceNew(component, &_audioOutput.unit));
+            
+            //Run the mixer at the device's own rate, so that the unit doesn't have to resample.
+            AudioDeviceID device = kAudioObjectUnknown;
+            UInt32 size = sizeof(device);
+            REQUIRE(AudioUnitGetProperty(_audioOutput.unit, kAudioOutputUnitProperty_CurrentDevice,
+                                         kAudioUnitScope_Global, 0, &device, &size));
+            Float64 deviceRate = _audioDeviceSampleRate(device);
+            _audioOutput.sampleRate = (deviceRate > 0) ? deviceRate : *sampleRate;
+            _audioOutput.bufferFrames = *bufferFrames;
+            _audioOutput.callback = callback;
+            
+            //Feed the unit with the mixer's interleaved native-endian 16-bit stereo.
+            AudioStreamBasicDescription format;
+            format.mSampleRate = _audioOutput.sampleRate;
+            format.mFormatID = kAudioFormatLinearPCM;
+            format.mFormatFlags = kAudioFormatFlagsNativeEndian | kAudioFormatFlagIsSignedInteger | kAudioFormatFlagIsPacked;
+            format.mChannelsPerFrame = 2;
+            format.mBitsPerChannel = 16;
+            format.mBytesPerFrame = 4;
+            format.mFramesPerPacket = 1;
+            format.mBytesPerPacket = 4;
+            format.mReserved = 0;
+            REQUIRE(AudioUnitSetProperty(_audioOutput.unit, kAudioUnitProperty_StreamFormat,
+                                         kAudioUnitScope_Input, 0, &format, sizeof(format)));
+            
+            AURenderCallbackStruct renderCallback;
+            renderCallback.inputProc = _renderAudioOutput;
+            renderCallback.inputProcRefCon = NULL;
+            REQUIRE(AudioUnitSetProperty(_audioOutput.unit, kAudioUnitProperty_SetRenderCallback,
+                                         kAudioUnitScope_Input, 0, &renderCallback, sizeof(renderCallback)));
+            
+            //Keep the unit's own slice size in line with the device buffer we're asking for.
+            UInt32 maxFrames = (*bufferFrames > 4096) ? *bufferFrames : 4096;
+            AudioUnitSetProperty(_audioOutput.unit, kAudioUnitProperty_MaximumFramesPerSlice,
+                                 kAudioUnitScope_Global, 0, &maxFrames, sizeof(maxFrames));
+            
+            REQUIRE(AudioUnitInitialize(_audioOutput.unit));
+            
+            _syncAudioOutputDevice();
+            AudioObjectAddPropertyListener(kAudioObjectSystemObject, &_defaultOutputDeviceAddress, _audioOutputDeviceChanged, NULL);
+        }
+        while (NO);
+        
+#undef REQUIRE
+        
+        if (errCode != noErr)
+            _disposeAudioOutput();
+    });
+    
+    if (errCode != noErr)
+    {
+#ifdef BOXER_DEBUG
+        NSLog(@"Could not open CoreAudio output: error %d", (int)errCode);
+#endif
+        return false;
+    }
+    
+    *sampleRate = (Bit32u)_audioOutput.sampleRate;
+    *bufferFrames = _audioDeviceFrames(_audioOutput.device, kAudioDevicePropertyBufferFrameSize, kAudioObjectPropertyScopeGlobal);
+    if (!*bufferFrames) *bufferFrames = _audioOutput.bufferFrames;
+    return true;
+}
+
+void boxer_closeAudioOutput()
+{
+    if (!_audioOutput.queue) return;
+    BXStallCallScope stallCall("closing audio output");
+    dispatch_sync(_audioOutput.queue, ^{
+        _disposeAudioOutput();
+    });
+}
+
+void boxer_pauseAudioOutput(bool pause)
+{
+    if (!_audioOutput.queue) return;
+    BXStallCallScope stallCall("pausing audio output");
+    dispatch_sync(_audioOutput.queue, ^{
+        if (!_audioOutput.unit || _audioOutput.running == !pause) return;
+        if (pause) AudioOutputUnitStop(_audioOutput.unit);
+        else AudioOutputUnitStart(_audioOutput.unit);
+        _audioOutput.running = !pause;
+    });
+}
+
+Bitu boxer_audioOutputLatency()
+{
+    return _audioOutput.latency;
+}
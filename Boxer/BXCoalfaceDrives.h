@@ -10,6 +10,7 @@
 
 #import "BXCoalface.h"
 #import "drives.h"
+#import <string>
 
 
 //Byte-swapping to fix endianness issues on PowerPC
@@ -22,3 +23,39 @@ direntry boxer_FATDirEntryHostToLittle(direntry entry);
 
 partTable boxer_FATPartitionTableLittleToHost(partTable table);
 partTable boxer_FATPartitionTableHostToLittle(partTable table);
+
+
+//Called from drive_local.cpp: watches the host folder backing a local drive for changes made
+//outside of DOSBox, and tells the drive which of its directories have changed.
+//Returns a handle to pass to boxer_unwatchLocalDrive, or NULL if the folder can't be watched.
+void *boxer_watchLocalDrive(const char *path, localDrive *drive);
+void boxer_unwatchLocalDrive(void *watcher);
+
+
+//Called from the local file hooks in BXCoalface.mm: remembers what Boxer's filesystem classes
+//make of each host path on a local drive, so that games that check the same files over and over
+//don't have to go back through the drive's filesystem every time. Only drives that are watching
+//their host folder are cached, since only they hear about changes made outside of DOSBox.
+enum BXLocalPathType {
+    BXLocalPathMissing,
+    BXLocalPathFile,
+    BXLocalPathDirectory
+};
+
+struct BXLocalPathInfo {
+    BXLocalPathType type;
+    std::string resolvedPath;   //Where the path really lives on disk, e.g. in the drive's shadow.
+    signed char writable;       //Whether DOSBox may write to the path, or -1 if we haven't asked yet.
+};
+
+//Returns what the path on the specified drive resolves to, or NULL if the drive's paths aren't cached.
+//Must be called on the emulation thread, and the result is only valid until the next call.
+BXLocalPathInfo *boxer_cachedLocalPathInfo(const char *path, DOS_Drive *drive);
+
+//Discards the cached paths for the specified drive. Must be called on the emulation thread.
+void boxer_forgetLocalPaths(DOS_Drive *drive);
+
+//Discards the cached paths for all drives the next time they're looked up.
+//Safe to call from any thread, for use when drives are mounted or unmounted
+//or Boxer rearranges a drive's files behind DOSBox's back.
+void boxer_invalidateLocalPathCache();
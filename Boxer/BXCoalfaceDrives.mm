@@ -7,7 +7,11 @@
 
 #import <Foundation/Foundation.h>
 #import <CoreFoundation/CFByteOrder.h>
+#import <CoreServices/CoreServices.h>
+#import <sys/stat.h>
+#import <map>
 #import "BXCoalfaceDrives.h"
+#import "BXEmulatorPrivate.h"
 
 
 //Fix endianness issues in FAT read/write operations
@@ -91,4 +95,284 @@ partTable boxer_FATPartitionTableHostToLittle(partTable table)
         table.pentry[i].partSize = CFSwapInt32HostToLittle(table.pentry[i].partSize);
     }
     return table;    
-}
\ No newline at end of file
+}
+
+
+#pragma mark - Watching local drives for changes
+
+//How long FSEvents should wait to coalesce changes before telling us about them.
+#define BXLocalDriveWatcherLatency 0.25
+
+//Watches the host folder backing a local drive with FSEvents, and passes on the directories
+//that have changed to the drive on the emulation thread, where it's safe to touch the drive cache.
+@interface BXLocalDriveWatcher : NSObject
+{
+    FSEventStreamRef _stream;
+    dispatch_queue_t _queue;
+    NSThread *_emulationThread;
+    localDrive *_drive;
+    char _watchedPath[PATH_MAX];
+    char _drivePath[CROSS_LEN];
+}
+
+- (id) initWithPath: (const char *)path drive: (localDrive *)drive;
+- (void) stopWatching;
+
+@end
+
+static void _BXLocalDriveWatcherCallback(ConstFSEventStreamRef stream,
+                                         void *info,
+                                         size_t numEvents,
+                                         void *eventPaths,
+                                         const FSEventStreamEventFlags eventFlags[],
+                                         const FSEventStreamEventId eventIds[]);
+
+@implementation BXLocalDriveWatcher
+
+- (id) initWithPath: (const char *)path drive: (localDrive *)drive
+{
+    self = [self init];
+    if (self)
+    {
+        //FSEvents reports paths with any symlinks resolved, so we need to match against
+        //the resolved location of the folder and then report them in terms of the original.
+        char resolvedPath[PATH_MAX];
+        struct stat status;
+        if (!realpath(path, resolvedPath) || stat(resolvedPath, &status) != 0 || !S_ISDIR(status.st_mode))
+        {
+            [self release];
+            return nil;
+        }
+        snprintf(_watchedPath, sizeof(_watchedPath), "%s/", resolvedPath);
+        
+        size_t pathLength = strlen(path);
+        bool hasTrailingSlash = (pathLength && path[pathLength - 1] == '/');
+        snprintf(_drivePath, sizeof(_drivePath), hasTrailingSlash ? "%s" : "%s/", path);
+        
+        _drive = drive;
+        
+        //Drives may be mounted from outside the emulation thread, so ask the emulator where it's running.
+        NSThread *emulationThread = [BXEmulator currentEmulator].emulationThread;
+        if (!emulationThread) emulationThread = [NSThread currentThread];
+        _emulationThread = [emulationThread retain];
+        
+        CFStringRef watchedPath = CFStringCreateWithFileSystemRepresentation(kCFAllocatorDefault, resolvedPath);
+        CFArrayRef pathsToWatch = CFArrayCreate(kCFAllocatorDefault, (const void **)&watchedPath, 1, &kCFTypeArrayCallBacks);
+        
+        FSEventStreamContext context = {0, self, NULL, NULL, NULL};
+        _stream = FSEventStreamCreate(kCFAllocatorDefault,
+                                      &_BXLocalDriveWatcherCallback,
+                                      &context,
+                                      pathsToWatch,
+                                      kFSEventStreamEventIdSinceNow,
+                                      BXLocalDriveWatcherLatency,
+                                      kFSEventStreamCreateFlagWatchRoot | kFSEventStreamCreateFlagNoDefer);
+        
+        CFRelease(pathsToWatch);
+        CFRelease(watchedPath);
+        
+        if (!_stream)
+        {
+            [self release];
+            return nil;
+        }
+        
+        _queue = dispatch_queue_create("com.boxer.localDriveWatcher", NULL);
+        FSEventStreamSetDispatchQueue(_stream, _queue);
+        if (!FSEventStreamStart(_stream))
+        {
+            [self stopWatching];
+            [self release];
+            return nil;
+        }
+    }
+    return self;
+}
+
+- (void) stopWatching
+{
+    _drive = NULL;
+    if (_stream)
+    {
+        FSEventStreamStop(_stream);
+        FSEventStreamInvalidate(_stream);
+        FSEventStreamRelease(_stream);
+        _stream = NULL;
+        
+        //Wait for any callback that's already in progress to finish.
+        dispatch_sync(_queue, ^{});
+    }
+}
+
+- (void) dealloc
+{
+    [self stopWatching];
+    if (_queue)
+    {
+        dispatch_release(_queue);
+        _queue = NULL;
+    }
+    [_emulationThread release], _emulationThread = nil;
+    [super dealloc];
+}
+
+//Called on our watcher queue: translates the changed paths into the drive's terms
+//and hands them on to the emulation thread.
+- (void) _queueChangesAtPaths: (const char **)paths
+                        flags: (const FSEventStreamEventFlags *)flags
+                        count: (size_t)numEvents
+{
+    NSMutableArray *changes = [NSMutableArray arrayWithCapacity: numEvents];
+    size_t watchedPathLength = strlen(_watchedPath);
+    
+    for (size_t i=0; i < numEvents; i++)
+    {
+        const char *relativePath;
+        BOOL recursive = (flags[i] & kFSEventStreamEventFlagMustScanSubDirs) != 0;
+        
+        //If the watched folder itself was moved or replaced, or if FSEvents dropped events,
+        //we can't tell what has changed and must refresh the whole drive.
+        if (flags[i] & (kFSEventStreamEventFlagRootChanged | kFSEventStreamEventFlagKernelDropped | kFSEventStreamEventFlagUserDropped))
+        {
+            relativePath = "";
+            recursive = YES;
+        }
+        //The folder we're watching is reported without its trailing slash.
+        else if (strlen(paths[i]) == watchedPathLength - 1 && strncasecmp(paths[i], _watchedPath, watchedPathLength - 1) == 0)
+        {
+            relativePath = "";
+        }
+        else if (strncasecmp(paths[i], _watchedPath, watchedPathLength) == 0)
+        {
+            relativePath = paths[i] + watchedPathLength;
+        }
+        else continue;
+        
+        char drivePath[CROSS_LEN];
+        snprintf(drivePath, sizeof(drivePath), "%s%s", _drivePath, relativePath);
+        
+        //Pass the path on as raw bytes, to be sure it reaches the drive cache
+        //exactly as we built it.
+        NSData *pathData = [NSData dataWithBytes: drivePath length: strlen(drivePath) + 1];
+        [changes addObject: @[pathData, @(recursive)]];
+    }
+    
+    if (changes.count)
+    {
+        [self performSelector: @selector(_applyChanges:)
+                     onThread: _emulationThread
+                   withObject: changes
+                waitUntilDone: NO];
+    }
+}
+
+//Called on the emulation thread.
+- (void) _applyChanges: (NSArray *)changes
+{
+    for (NSArray *change in changes)
+    {
+        //The drive may have been unmounted since these changes were queued.
+        if (!_drive) return;
+        
+        NSData *pathData = [change objectAtIndex: 0];
+        BOOL recursive = [[change objectAtIndex: 1] boolValue];
+        _drive->hostDirectoryDidChange((const char *)pathData.bytes, recursive);
+        
+        //We don't know which of the drive's paths are affected, so forget them all.
+        boxer_forgetLocalPaths(_drive);
+    }
+}
+
+@end
+
+static void _BXLocalDriveWatcherCallback(ConstFSEventStreamRef stream,
+                                         void *info,
+                                         size_t numEvents,
+                                         void *eventPaths,
+                                         const FSEventStreamEventFlags eventFlags[],
+                                         const FSEventStreamEventId eventIds[])
+{
+    BXLocalDriveWatcher *watcher = (BXLocalDriveWatcher *)info;
+    [watcher _queueChangesAtPaths: (const char **)eventPaths
+                            flags: eventFlags
+                            count: numEvents];
+}
+
+void *boxer_watchLocalDrive(const char *path, localDrive *drive)
+{
+    return [[BXLocalDriveWatcher alloc] initWithPath: path drive: drive];
+}
+
+void boxer_unwatchLocalDrive(void *watcher)
+{
+    BXLocalDriveWatcher *localDriveWatcher = (BXLocalDriveWatcher *)watcher;
+    [localDriveWatcher stopWatching];
+    [localDriveWatcher release];
+}
+
+
+#pragma mark - Caching local path lookups
+
+//Once a drive has this many paths cached, its cache is emptied and starts over.
+#define BXLocalPathCacheLimit 4096
+
+typedef std::map<std::string, BXLocalPathInfo> BXLocalPathCache;
+typedef std::map<DOS_Drive *, BXLocalPathCache> BXLocalPathCacheTable;
+
+//Only touched on the emulation thread.
+static BXLocalPathCacheTable _localPathCaches;
+static int32_t _localPathCacheGeneration = 0;
+
+//Bumped from any thread by boxer_invalidateLocalPathCache: when this no longer matches
+//the generation above, all cached paths are discarded on the next lookup.
+static volatile int32_t _localPathCacheInvalidations = 0;
+
+BXLocalPathInfo *boxer_cachedLocalPathInfo(const char *path, DOS_Drive *dosboxDrive)
+{
+    localDrive *drive = dynamic_cast<localDrive *>(dosboxDrive);
+    if (!drive || !drive->isWatchingHostDirectory())
+        return NULL;
+    
+    int32_t invalidations = _localPathCacheInvalidations;
+    if (invalidations != _localPathCacheGeneration)
+    {
+        _localPathCaches.clear();
+        _localPathCacheGeneration = invalidations;
+    }
+    
+    BXLocalPathCache &cache = _localPathCaches[dosboxDrive];
+    BXLocalPathCache::iterator match = cache.find(path);
+    if (match != cache.end())
+        return &match->second;
+    
+    if (cache.size() >= BXLocalPathCacheLimit)
+        cache.clear();
+    
+    BOOL exists = NO, isDirectory = NO;
+    NSURL *resolvedURL = [[BXEmulator currentEmulator] _resolvedURLForLocalPath: path
+                                                                   onDOSBoxDrive: dosboxDrive
+                                                                          exists: &exists
+                                                                     isDirectory: &isDirectory];
+    
+    BXLocalPathInfo &info = cache[path];
+    info.type = BXLocalPathMissing;
+    info.writable = -1;
+    
+    const char *resolvedPath = resolvedURL.fileSystemRepresentation;
+    if (exists && resolvedPath)
+    {
+        info.type = isDirectory ? BXLocalPathDirectory : BXLocalPathFile;
+        info.resolvedPath = resolvedPath;
+    }
+    return &info;
+}
+
+void boxer_forgetLocalPaths(DOS_Drive *drive)
+{
+    _localPathCaches.erase(drive);
+}
+
+void boxer_invalidateLocalPathCache()
+{
+    __sync_add_and_fetch(&_localPathCacheInvalidations, 1);
+}
@@ -9,17 +9,30 @@
 //BXCoverArt renders a boxed cover-art appearance from an original source image. It can return
 //an NSImage resource suitable for use as a file thumbnail, or draw the art directly into the
 //current graphics context.
+//Rendered representations are cached in memory and (if a cache URL has been set) on disk,
+//keyed by a digest of the source image and the rendered size. Rendering does not depend
+//on the main thread, so cover art can safely be generated on a background queue.
 
 #import <Cocoa/Cocoa.h>
 
 @interface BXCoverArt : NSObject
 {
 	NSImage *sourceImage;
+    NSString *_sourceImageDigest;
 }
 //The original image we will render into cover art
 @property (retain) NSImage *sourceImage;
 
 
+#pragma mark -
+#pragma mark Caching
+
+//The folder in which rendered cover art will be cached between launches.
+//If nil (the default), rendered art will only be cached in memory.
++ (NSURL *) cacheURL;
++ (void) setCacheURL: (NSURL *)URL;
+
+
 #pragma mark -
 #pragma mark Art assets
 
@@ -57,6 +70,11 @@
 //Note that this returns an NSImage directly, not a BXCoverArt instance.
 + (NSImage *) coverArtWithImage: (NSImage *)image;
 
+//Renders cover art from the specified image on a background queue, then calls the completion
+//handler on the main thread with the resulting image (which will be nil if rendering failed.)
++ (void) renderCoverArtWithImage: (NSImage *)image
+               completionHandler: (void (^)(NSImage *coverArt))completionHandler;
+
 //Returns whether the specified image appears to contain actual transparent/translucent pixels.
 //This is distinct from whether it has an alpha channel, as the alpha channel may go unused
 //(e.g. in an opaque image saved as 32-bit PNG.)
@@ -10,10 +10,60 @@
 #import "ADBGeometry.h"
 #import "NSShadow+ADBShadowExtensions.h"
 #import "ADBAppKitVersionHelpers.h"
+#import "NSData+HexStrings.h"
+#import <CommonCrypto/CommonDigest.h>
+
+
+@interface BXCoverArt ()
+
+//A hex digest of the source image's contents, used as the key for cached renderings.
+@property (readonly, nonatomic) NSString *sourceImageDigest;
+
+//The in-memory cache of rendered representations, keyed by source image digest and size.
++ (NSCache *) _renderedRepresentations;
+
+//Renders the source image as cover art into a new bitmap of the specified size.
+- (NSBitmapImageRep *) _renderedRepresentationForSize: (NSSize)iconSize;
+
+@end
+
 
 @implementation BXCoverArt
 @synthesize sourceImage;
 
+static NSURL *_cacheURL = nil;
+
++ (NSURL *) cacheURL
+{
+    @synchronized(self)
+    {
+        return [[_cacheURL retain] autorelease];
+    }
+}
+
++ (void) setCacheURL: (NSURL *)URL
+{
+    @synchronized(self)
+    {
+        if (![URL isEqual: _cacheURL])
+        {
+            [_cacheURL release];
+            _cacheURL = [URL copy];
+        }
+    }
+}
+
++ (NSCache *) _renderedRepresentations
+{
+    static NSCache *cache;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        cache = [[NSCache alloc] init];
+        cache.name = @"BXCoverArt rendered representations";
+    });
+    return cache;
+}
+
 
 //We give gameboxes a fairly strong shadow to lift them out from light backgrounds
 + (NSShadow *) dropShadowForSize: (NSSize)iconSize
@@ -55,6 +105,44 @@
 	return self;
 }
 
+- (void) dealloc
+{
+    [self setSourceImage: nil];
+	[super dealloc];
+}
+
+- (NSImage *) sourceImage
+{
+    return [[sourceImage retain] autorelease];
+}
+
+- (void) setSourceImage: (NSImage *)image
+{
+    if (image != sourceImage)
+    {
+        [sourceImage release];
+        sourceImage = [image retain];
+        
+        [_sourceImageDigest release];
+        _sourceImageDigest = nil;
+    }
+}
+
+- (NSString *) sourceImageDigest
+{
+    if (!_sourceImageDigest)
+    {
+        NSData *imageData = [[self sourceImage] TIFFRepresentation];
+        if (!imageData) return nil;
+        
+        NSMutableData *digest = [NSMutableData dataWithLength: CC_SHA1_DIGEST_LENGTH];
+        CC_SHA1(imageData.bytes, (CC_LONG)imageData.length, digest.mutableBytes);
+        
+        _sourceImageDigest = [digest.stringWithHexBytes copy];
+    }
+    return _sourceImageDigest;
+}
+
 - (void) drawInRect: (NSRect)frame
 {
 	//Switch to high-quality interpolation before we begin, and restore it once we're done
@@ -126,17 +214,77 @@
 }
 
 - (NSImageRep *) representationForSize: (NSSize)iconSize
-{	
-	NSRect frame = NSMakeRect(0, 0, iconSize.width, iconSize.height);
+{
+    NSString *digest = [self sourceImageDigest];
+    
+    //If we couldn't get at the source image's data, we can't cache it either.
+    if (!digest) return [self _renderedRepresentationForSize: iconSize];
+    
+    NSString *cacheKey = [NSString stringWithFormat: @"%@-%.0fx%.0f", digest, iconSize.width, iconSize.height];
+    NSCache *cache = [[self class] _renderedRepresentations];
+    
+    NSImageRep *rep = [cache objectForKey: cacheKey];
+    if (rep) return rep;
+    
+    NSURL *cacheFolderURL = [[self class] cacheURL];
+    NSURL *cachedFileURL = [cacheFolderURL URLByAppendingPathComponent: [cacheKey stringByAppendingPathExtension: @"png"]];
+    
+    if (cachedFileURL)
+    {
+        rep = [NSBitmapImageRep imageRepWithContentsOfURL: cachedFileURL];
+        [rep setSize: iconSize];
+    }
+    
+    if (!rep)
+    {
+        NSBitmapImageRep *renderedRep = [self _renderedRepresentationForSize: iconSize];
+        if (renderedRep && cachedFileURL)
+        {
+            NSData *PNGData = [renderedRep representationUsingType: NSPNGFileType properties: nil];
+            [[NSFileManager defaultManager] createDirectoryAtURL: cacheFolderURL
+                                     withIntermediateDirectories: YES
+                                                      attributes: nil
+                                                           error: NULL];
+            [PNGData writeToURL: cachedFileURL atomically: YES];
+        }
+        rep = renderedRep;
+    }
+    
+    if (rep)
+        [cache setObject: rep forKey: cacheKey];
+    
+    return rep;
+}
 
-	//Create a new empty canvas to draw into
-	NSImage *canvas = [[NSImage alloc] initWithSize: iconSize];
-	
-	[canvas lockFocus];
+- (NSBitmapImageRep *) _renderedRepresentationForSize: (NSSize)iconSize
+{
+	NSRect frame = NSMakeRect(0, 0, iconSize.width, iconSize.height);
+    
+	//Create a new empty bitmap to draw into. Unlike locking focus on an NSImage,
+    //drawing into our own bitmap context is safe to do off the main thread.
+    NSBitmapImageRep *rep = [[NSBitmapImageRep alloc] initWithBitmapDataPlanes: NULL
+                                                                    pixelsWide: (NSInteger)iconSize.width
+                                                                    pixelsHigh: (NSInteger)iconSize.height
+                                                                 bitsPerSample: 8
+                                                               samplesPerPixel: 4
+                                                                      hasAlpha: YES
+                                                                      isPlanar: NO
+                                                                colorSpaceName: NSCalibratedRGBColorSpace
+                                                                   bytesPerRow: 0
+                                                                  bitsPerPixel: 0];
+    
+    NSGraphicsContext *context = [NSGraphicsContext graphicsContextWithBitmapImageRep: rep];
+    if (!context)
+    {
+        [rep release];
+        return nil;
+    }
+    
+    [NSGraphicsContext saveGraphicsState];
+        [NSGraphicsContext setCurrentContext: context];
 		[self drawInRect: frame];
-		NSBitmapImageRep *rep = [[NSBitmapImageRep alloc] initWithFocusedViewRect: frame];
-	[canvas unlockFocus];
-	[canvas release];
+        [context flushGraphics];
+    [NSGraphicsContext restoreGraphicsState];
 	
 	return [rep autorelease];
 }
@@ -167,6 +315,21 @@
 	return [generator coverArt];
 }
 
++ (void) renderCoverArtWithImage: (NSImage *)image
+               completionHandler: (void (^)(NSImage *coverArt))completionHandler
+{
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+        NSImage *coverArt = [[self coverArtWithImage: image] retain];
+        [pool drain];
+        
+        dispatch_async(dispatch_get_main_queue(), ^{
+            completionHandler(coverArt);
+            [coverArt release];
+        });
+    });
+}
+
 + (BOOL) imageHasTransparency: (NSImage *)image
 {
 	BOOL hasTranslucentPixels = NO;
@@ -174,30 +337,34 @@
 	//Only bother testing transparency if the image has an alpha channel
 	if ([[[image representations] lastObject] hasAlpha])
 	{
-		NSSize imageSize = [image size];
+        //Read the pixels from a bitmap of the image rather than locking focus on it,
+        //so that this is safe to call off the main thread.
+        CGImageRef imageRef = [image CGImageForProposedRect: NULL context: nil hints: nil];
+        NSBitmapImageRep *bitmap = (imageRef) ? [[NSBitmapImageRep alloc] initWithCGImage: imageRef] : nil;
+        
+		NSInteger width = [bitmap pixelsWide], height = [bitmap pixelsHigh];
 		
 		//Test 5 pixels in an X pattern: each corner and right in the center of the image.
-		NSPoint testPoints[5] = {
-			NSMakePoint(0,						0),
-			NSMakePoint(imageSize.width - 1.0f,	0),
-			NSMakePoint(0,						imageSize.height - 1.0f),
-			NSMakePoint(imageSize.width - 1.0f,	imageSize.height - 1.0f),
-			NSMakePoint(imageSize.width * 0.5f,	imageSize.height * 0.5f)
+		NSInteger testPoints[5][2] = {
+			{0,             0},
+			{width - 1,     0},
+			{0,             height - 1},
+			{width - 1,     height - 1},
+			{width / 2,     height / 2}
 		};
 		NSInteger i;
-						
-		[image lockFocus];
-		for (i=0; i<5; i++)
+        
+		for (i=0; bitmap && i<5; i++)
 		{
 			//If any of the pixels appears to be translucent, then stop looking further.
-			NSColor *pixel = NSReadPixel(testPoints[i]);
+			NSColor *pixel = [bitmap colorAtX: testPoints[i][0] y: testPoints[i][1]];
 			if (pixel && [pixel alphaComponent] < 0.9)
 			{
 				hasTranslucentPixels = YES;
 				break;
 			}
 		}
-		[image unlockFocus];
+        [bitmap release];
 	}
 
 	return hasTranslucentPixels;
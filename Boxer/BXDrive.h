@@ -35,6 +35,7 @@ typedef NS_ENUM(NSInteger, BXDriveType) {
 {
     NSURL *_sourceURL;
     NSURL *_shadowURL;
+    NSURL *_directoryIndexURL;
     NSURL *_mountPointURL;
     NSMutableSet *_equivalentURLs;
     
@@ -82,6 +83,11 @@ typedef NS_ENUM(NSInteger, BXDriveType) {
 //location instead of creating/modifying files in the original location.
 @property (copy, nonatomic) NSURL *shadowURL;
 
+//The location at which the emulator keeps an index of this drive's directories and their
+//DOS filenames between sessions, so that the drive can be listed without being read again
+//and files keep the same 8.3 names from one session to the next. If nil, no index is kept.
+@property (copy, nonatomic) NSURL *directoryIndexURL;
+
 
 //The DOS drive letter under which this drive will be mounted.
 //If nil, BXEmulator will choose an appropriate drive letter at mount time
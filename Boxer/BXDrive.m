@@ -21,6 +21,7 @@
 @implementation BXDrive
 @synthesize sourceURL = _sourceURL;
 @synthesize shadowURL = _shadowURL;
+@synthesize directoryIndexURL = _directoryIndexURL;
 @synthesize mountPointURL = _mountPointURL;
 @synthesize letter = _letter;
 @synthesize title = _title;
@@ -238,6 +239,7 @@
     //Avoid using our setter methods as they have a lot of magic in them.
     [_sourceURL release], _sourceURL = nil;
     [_shadowURL release], _shadowURL = nil;
+    [_directoryIndexURL release], _directoryIndexURL = nil;
     [_mountPointURL release], _mountPointURL = nil;
     [_equivalentURLs release], _equivalentURLs = nil;
     [_filesystem release], _filesystem = nil;
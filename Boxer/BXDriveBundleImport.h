@@ -6,7 +6,9 @@
  */
 
 //BXDriveBundleImport wraps BIN/CUE images and any associated audio tracks into a .cdmedia bundle,
-//rewriting cue paths as necessary.
+//rewriting cue paths as necessary. When copying, the track files are brought across one after
+//another in the order the cue lists them, each cloned if the filesystem allows or else streamed
+//through a large buffer, so that the source image is read once from start to finish.
 
 #import "ADBFileTransferSet.h"
 #import "BXDriveImport.h"
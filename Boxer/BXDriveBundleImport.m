@@ -8,6 +8,7 @@
 
 #import "BXDriveBundleImport.h"
 #import "BXSimpleDriveImport.h"
+#import "ADBSingleFileTransfer.h"
 #import "ADBBinCueImage.h"
 #import "BXDrive.h"
 #import "RegexKitLite.h"
@@ -16,6 +17,10 @@
 
 NSString * const BXDriveBundleErrorDomain = @"BXDriveBundleErrorDomain";
 
+//The size of the chunks in which track files are read when they can't be cloned.
+//Large enough that reading a track costs little more than the disk's own read time.
+#define BXDriveBundleImportStreamingBufferSize (4 * 1024 * 1024)
+
 
 
 @implementation BXDriveBundleImport
@@ -134,6 +139,8 @@ NSString * const BXDriveBundleErrorDomain = @"BXDriveBundleErrorDomain";
     //Work out what to do with the related file paths we've parsed from the cue file
     NSURL *baseURL = sourceURL.URLByDeletingLastPathComponent;
     NSMutableDictionary *revisedPaths = [NSMutableDictionary dictionaryWithCapacity: numRelatedPaths];
+    NSMutableSet *transferredNames = [NSMutableSet setWithCapacity: numRelatedPaths];
+    ADBSingleFileTransfer *previousTransfer = nil;
     
     for (NSString *fromPath in relatedPaths)
     {
@@ -144,7 +151,23 @@ NSString * const BXDriveBundleErrorDomain = @"BXDriveBundleErrorDomain";
         NSString *fromName	= fromURL.lastPathComponent;
         NSURL *toURL        = [destinationURL URLByAppendingPathComponent: fromName];
         
-        [self addTransferFromPath: fromURL.path toPath: toURL.path];
+        //Only bring each file across once, even if the cue refers to it more than once.
+        if (![transferredNames containsObject: fromName])
+        {
+            [transferredNames addObject: fromName];
+            [self addTransferFromPath: fromURL.path toPath: toURL.path];
+            
+            //Copy the tracks one at a time in the order the cue lists them, so that the source
+            //is read in a single pass rather than by several copies contending for the same disk.
+            ADBSingleFileTransfer *transfer = self.operations.lastObject;
+            if (self.copyFiles)
+            {
+                transfer.streamingBufferSize = BXDriveBundleImportStreamingBufferSize;
+                if (previousTransfer)
+                    [transfer addDependency: previousTransfer];
+            }
+            previousTransfer = transfer;
+        }
         
         //Make a note of the path if it needs to be changed when we rewrite the CUE file
         //(e.g. if it's in a subdirectory that will no longer exist when the files are imported)
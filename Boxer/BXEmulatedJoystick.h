@@ -175,6 +175,12 @@ enum {
 #pragma mark Joystick classes
 
 @interface BXBaseEmulatedJoystick: NSObject
+{
+    //Our own record of the gameport's axis positions and pressed buttons. DOSBox's gameport
+    //is brought into line with these on the emulation thread.
+    float gameportAxes[4];
+    NSUInteger gameportButtons;
+}
 
 - (void) clearInput;
 - (void) didConnect;
@@ -6,6 +6,7 @@
  */
 
 #import "BXEmulatedJoystickPrivate.h"
+#import "BXEmulatorPrivate.h"
 
 
 #pragma mark -
@@ -33,6 +34,12 @@ NSString * const BXEmulatedJoystickClassKey = @"BXEmulatedJoystickClassKey";
 #pragma mark -
 #pragma mark Implementations
 
+//Passes a change to the gameport on to DOSBox on the emulation thread, whichever thread the change arrived on.
+static void BXJoystickPerform(dispatch_block_t block)
+{
+    [[BXEmulator currentEmulator] _performInputOnEmulationThread: block];
+}
+
 @implementation BXBaseEmulatedJoystick
 
 + (BXEmulatedPOVDirection) closest4WayDirectionForPOV: (BXEmulatedPOVDirection)direction
@@ -62,10 +69,10 @@ NSString * const BXEmulatedJoystickClassKey = @"BXEmulatedJoystickClassKey";
 
 - (void) clearInput
 {
-	JOYSTICK_Move_X(BXGameportStick1, BXGameportAxisCentered);
-	JOYSTICK_Move_Y(BXGameportStick1, BXGameportAxisCentered);
-	JOYSTICK_Move_X(BXGameportStick2, BXGameportAxisCentered);
-	JOYSTICK_Move_Y(BXGameportStick2, BXGameportAxisCentered);
+	[self setPosition: BXGameportAxisCentered forGameportAxis: BXGameportXAxis];
+	[self setPosition: BXGameportAxisCentered forGameportAxis: BXGameportYAxis];
+	[self setPosition: BXGameportAxisCentered forGameportAxis: BXGameportX2Axis];
+	[self setPosition: BXGameportAxisCentered forGameportAxis: BXGameportY2Axis];
 	
 	[self setPressedButtons: BXNoGameportButtonsMask];
 }
@@ -73,16 +80,20 @@ NSString * const BXEmulatedJoystickClassKey = @"BXEmulatedJoystickClassKey";
 - (void) didConnect
 {
 	BOOL enableSecondJoystick = [[self class] requiresFullJoystickSupport];
-	JOYSTICK_Enable(BXGameportStick1, YES);
-	JOYSTICK_Enable(BXGameportStick2, enableSecondJoystick);
+    BXJoystickPerform(^{
+        JOYSTICK_Enable(BXGameportStick1, YES);
+        JOYSTICK_Enable(BXGameportStick2, enableSecondJoystick);
+    });
 	//Reset all inputs to default position
 	[self clearInput];
 }
 
 - (void) willDisconnect
 {
-	JOYSTICK_Enable(BXGameportStick1, NO);
-	JOYSTICK_Enable(BXGameportStick2, NO);
+    BXJoystickPerform(^{
+        JOYSTICK_Enable(BXGameportStick1, NO);
+        JOYSTICK_Enable(BXGameportStick2, NO);
+    });
 }
 
 
@@ -101,19 +112,19 @@ NSString * const BXEmulatedJoystickClassKey = @"BXEmulatedJoystickClassKey";
 	switch (button)
 	{
 		case BXEmulatedJoystickButton1:
-			return JOYSTICK_GetButton(BXGameportStick1, BXGameportButton1);
+			return (gameportButtons & BXGameportButton1Mask) != 0;
 			break;
 			
 		case BXEmulatedJoystickButton2:
-			return JOYSTICK_GetButton(BXGameportStick1, BXGameportButton2);
+			return (gameportButtons & BXGameportButton2Mask) != 0;
 			break;
 			
 		case BXEmulatedJoystickButton3:
-			return JOYSTICK_GetButton(BXGameportStick2, BXGameportButton1);
+			return (gameportButtons & BXGameportButton3Mask) != 0;
 			break;
 			
 		case BXEmulatedJoystickButton4:
-			return JOYSTICK_GetButton(BXGameportStick2, BXGameportButton2);
+			return (gameportButtons & BXGameportButton4Mask) != 0;
 			break;
 			
 		default:
@@ -156,21 +167,26 @@ NSString * const BXEmulatedJoystickClassKey = @"BXEmulatedJoystickClassKey";
 	switch (axis)
 	{
 		case BXGameportXAxis:
-			JOYSTICK_Move_X(BXGameportStick1, position);
+			BXJoystickPerform(^{ JOYSTICK_Move_X(BXGameportStick1, position); });
 			break;
 		
 		case BXGameportYAxis:
-			JOYSTICK_Move_Y(BXGameportStick1, position);
+			BXJoystickPerform(^{ JOYSTICK_Move_Y(BXGameportStick1, position); });
 			break;
 			
 		case BXGameportX2Axis:
-			JOYSTICK_Move_X(BXGameportStick2, position);
+			BXJoystickPerform(^{ JOYSTICK_Move_X(BXGameportStick2, position); });
 			break;
 			
 		case BXGameportY2Axis:
-			JOYSTICK_Move_Y(BXGameportStick2, position);
+			BXJoystickPerform(^{ JOYSTICK_Move_Y(BXGameportStick2, position); });
 			break;
+            
+        default:
+            return;
 	}
+    
+    gameportAxes[axis] = position;
 }
 
 - (float) positionForGameportAxis: (BXGameportAxis)axis
@@ -178,19 +194,10 @@ NSString * const BXEmulatedJoystickClassKey = @"BXEmulatedJoystickClassKey";
 	switch (axis)
 	{
 		case BXGameportXAxis:
-			return JOYSTICK_GetMove_X(BXGameportStick1);
-			break;
-		
 		case BXGameportYAxis:
-			return JOYSTICK_GetMove_Y(BXGameportStick1);
-			break;
-			
 		case BXGameportX2Axis:
-			return JOYSTICK_GetMove_X(BXGameportStick2);
-			break;
-			
 		case BXGameportY2Axis:
-			return JOYSTICK_GetMove_Y(BXGameportStick2);
+			return gameportAxes[axis];
 			break;
 		
 		default:
@@ -213,22 +220,18 @@ NSString * const BXEmulatedJoystickClassKey = @"BXEmulatedJoystickClassKey";
 
 - (void) setPressedButtons: (BXGameportButtonMask)buttonMask
 {
-	JOYSTICK_Button(BXGameportStick1, BXGameportButton1, (buttonMask & BXGameportButton1Mask));
-	JOYSTICK_Button(BXGameportStick1, BXGameportButton2, (buttonMask & BXGameportButton2Mask));
-	JOYSTICK_Button(BXGameportStick2, BXGameportButton1, (buttonMask & BXGameportButton3Mask));
-	JOYSTICK_Button(BXGameportStick2, BXGameportButton2, (buttonMask & BXGameportButton4Mask));	
+    gameportButtons = buttonMask;
+    BXJoystickPerform(^{
+        JOYSTICK_Button(BXGameportStick1, BXGameportButton1, (buttonMask & BXGameportButton1Mask));
+        JOYSTICK_Button(BXGameportStick1, BXGameportButton2, (buttonMask & BXGameportButton2Mask));
+        JOYSTICK_Button(BXGameportStick2, BXGameportButton1, (buttonMask & BXGameportButton3Mask));
+        JOYSTICK_Button(BXGameportStick2, BXGameportButton2, (buttonMask & BXGameportButton4Mask));
+    });
 }
 
 - (BXGameportButtonMask) pressedButtons
 {
-	BXGameportButtonMask buttonMask = BXNoGameportButtonsMask;
-	
-	if (JOYSTICK_GetButton(BXGameportStick1, BXGameportButton1)) buttonMask |= BXGameportButton1Mask;
-	if (JOYSTICK_GetButton(BXGameportStick1, BXGameportButton2)) buttonMask |= BXGameportButton2Mask;
-	if (JOYSTICK_GetButton(BXGameportStick2, BXGameportButton1)) buttonMask |= BXGameportButton3Mask;
-	if (JOYSTICK_GetButton(BXGameportStick2, BXGameportButton2)) buttonMask |= BXGameportButton4Mask;
-	
-	return buttonMask;
+	return gameportButtons;
 }
 
 #pragma mark -
@@ -236,24 +239,35 @@ NSString * const BXEmulatedJoystickClassKey = @"BXEmulatedJoystickClassKey";
 
 - (void) setButton: (BXEmulatedJoystickButton)button toState: (BOOL)pressed
 {
+    BXGameportButtonMask buttonMask;
 	switch (button)
 	{
 		case BXEmulatedJoystickButton1:
-			JOYSTICK_Button(BXGameportStick1, BXGameportButton1, pressed);
+            buttonMask = BXGameportButton1Mask;
+			BXJoystickPerform(^{ JOYSTICK_Button(BXGameportStick1, BXGameportButton1, pressed); });
 			break;
 			
 		case BXEmulatedJoystickButton2:
-			JOYSTICK_Button(BXGameportStick1, BXGameportButton2, pressed);
+            buttonMask = BXGameportButton2Mask;
+			BXJoystickPerform(^{ JOYSTICK_Button(BXGameportStick1, BXGameportButton2, pressed); });
 			break;
 			
 		case BXEmulatedJoystickButton3:
-			JOYSTICK_Button(BXGameportStick2, BXGameportButton1, pressed);
+            buttonMask = BXGameportButton3Mask;
+			BXJoystickPerform(^{ JOYSTICK_Button(BXGameportStick2, BXGameportButton1, pressed); });
 			break;
 			
 		case BXEmulatedJoystickButton4:
-			JOYSTICK_Button(BXGameportStick2, BXGameportButton2, pressed);
+            buttonMask = BXGameportButton4Mask;
+			BXJoystickPerform(^{ JOYSTICK_Button(BXGameportStick2, BXGameportButton2, pressed); });
 			break;
+            
+        default:
+            return;
 	}
+    
+    if (pressed)    gameportButtons |= buttonMask;
+    else            gameportButtons &= ~buttonMask;
 }
 
 - (void) releaseButton: (NSNumber *)button
@@ -7,7 +7,7 @@
 
 
 #import "BXEmulatedKeyboard.h"
-#import "BXEmulator.h"
+#import "BXEmulatorPrivate.h"
 #import "BXCoalface.h"
 #import "NSObject+ADBPerformExtensions.h"
 
@@ -22,6 +22,12 @@ Bitu DOS_SwitchKeyboardLayout(const char* new_layout, Bit32s& tried_cp);
 Bitu DOS_LoadKeyboardLayout(const char * layoutname, Bit32s codepage, const char * codepagefile);
 const char* DOS_GetLoadedLayout(void);
 
+//Passes a key event on to DOSBox on the emulation thread, whichever thread the event arrived on.
+static void BXKeyboardAddKey(BXDOSKeyCode key, BOOL pressed)
+{
+    [[BXEmulator currentEmulator] _performInputOnEmulationThread: ^{ KEYBOARD_AddKey(key, pressed); }];
+}
+
 @interface BXEmulatedKeyboard ()
 
 //Assign rather than retain, because NSTimers retain their targets
@@ -80,7 +86,7 @@ const char* DOS_GetLoadedLayout(void);
         //If this key is not already pressed, tell the emulator the key has been pressed.
         if (!_pressedKeys[key])
         {
-            KEYBOARD_AddKey(key, YES);
+            BXKeyboardAddKey(key, YES);
         }
         _pressedKeys[key]++;
     }
@@ -107,7 +113,7 @@ const char* DOS_GetLoadedLayout(void);
         //If this was the last press of this key,
         //tell the emulator to finally release the key.
         if (!_pressedKeys[key])
-            KEYBOARD_AddKey(key, NO);
+            BXKeyboardAddKey(key, NO);
 	}
 }
 
@@ -141,7 +147,7 @@ const char* DOS_GetLoadedLayout(void);
 - (void) clearInput
 {
     //Clear any pending keyboard events.
-    KEYBOARD_ClrBuffer();
+    [[BXEmulator currentEmulator] _performInputOnEmulationThread: ^{ KEYBOARD_ClrBuffer(); }];
     
     //Release any previously-pressed keys.
 	NSUInteger key;
@@ -33,6 +33,9 @@
     private:
         BXEmulatedMT32 *_delegate;
     };
+
+    //Renders the synth's output on an audio worker thread when one is worthwhile.
+    class BXEmulatedMT32Worker;
 #endif
 
 
@@ -88,6 +91,7 @@ typedef NS_OPTIONS(NSUInteger, BXMT32ROMType) {
     NSURL *_controlROMURL;
     NSError *_synthError;
     unsigned int _sampleRate;
+    NSTimeInterval _renderAhead;
     
 #ifdef __cplusplus
     MT32Emu::Synth *_synth;
@@ -96,6 +100,7 @@ typedef NS_OPTIONS(NSUInteger, BXMT32ROMType) {
     MT32Emu::FileStream *_controlROMHandle;
     const MT32Emu::ROMImage *_PCMROMImage;
     const MT32Emu::ROMImage *_controlROMImage;
+    BXEmulatedMT32Worker *_worker;
 #endif
 }
 
@@ -104,6 +109,15 @@ typedef NS_OPTIONS(NSUInteger, BXMT32ROMType) {
 @property (assign, nonatomic) id <BXEmulatedMT32Delegate> delegate;
 @property (assign, nonatomic) unsigned int sampleRate;
 
+//How far ahead of the mixer the synth may render when it has a render thread, in seconds.
+//Higher values make it less likely that the emulation has to wait on the synth, at the cost
+//of music lagging further behind the game. Changing this restarts the render thread.
+@property (assign, nonatomic) NSTimeInterval renderAhead;
+
+//How many times the mixer has had to wait for the render thread to catch up.
+//If this keeps climbing, renderAhead is too low for this machine.
+@property (readonly, nonatomic) NSUInteger renderStallCount;
+
 - (id <BXMIDIDevice>) initWithPCMROM: (NSURL *)PCMROMURL
                           controlROM: (NSURL *)controlROMURL
                             delegate: (id <BXEmulatedMT32Delegate>)delegate
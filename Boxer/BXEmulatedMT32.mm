@@ -12,6 +12,7 @@
 #import "BXEmulatedMT32Delegate.h"
 #import "NSError+ADBErrorHelpers.h"
 #import "NSURL+ADBFilesystemHelpers.h"
+#import "audio_worker.h"
 
 
 #pragma mark -
@@ -23,6 +24,57 @@ NSString * const BXMT32PCMROMTypeKey = @"BXMT32PCMROMType";
 
 #define BXMT32DefaultSampleRate 32000
 
+//How much output the audio worker may render ahead by default, in seconds.
+#define BXMT32DefaultRenderAhead 0.005
+
+//The types of event we queue up for the audio worker.
+enum {
+    BXMT32WorkerMessage,
+    BXMT32WorkerSysex,
+};
+
+
+#pragma mark -
+#pragma mark Audio worker
+
+//Applies MIDI messages and renders output on an audio worker thread, so that the synth's
+//considerable rendering cost is kept off the emulation thread. See audio_worker.h.
+class BXEmulatedMT32Worker : public AudioWorker
+{
+public:
+    BXEmulatedMT32Worker(MT32Emu::Synth *synth, unsigned int sampleRate, NSTimeInterval renderAhead) :
+        AudioWorker("com.boxer.mt32", 2 * sizeof(SInt16), (Bitu)(sampleRate * renderAhead)),
+        _synth(synth) {};
+    
+    ~BXEmulatedMT32Worker() { Drain(); };
+    
+protected:
+    void ApplyEvent(const Bit8u *data, Bitu length)
+    {
+        //The synth may report LCD messages back to us while handling events.
+        NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+        if (data[0] == BXMT32WorkerMessage)
+        {
+            UInt32 packedMsg;
+            memcpy(&packedMsg, data + 1, sizeof(packedMsg));
+            _synth->playMsg(packedMsg);
+        }
+        else
+        {
+            _synth->playSysex((UInt8 *)(data + 1), (UInt32)(length - 1));
+        }
+        [pool drain];
+    };
+    
+    void Render(void *buffer, Bitu frames)
+    {
+        _synth->render((SInt16 *)buffer, (UInt32)frames);
+    };
+    
+private:
+    MT32Emu::Synth *_synth;
+};
+
 
 
 #pragma mark -
@@ -33,6 +85,9 @@ NSString * const BXMT32PCMROMTypeKey = @"BXMT32PCMROMType";
 
 - (BOOL) _prepareMT32EmulatorWithError: (NSError **)outError;
 
+//Creates a render thread for the synth if one would be worthwhile, replacing any existing one.
+- (void) _prepareWorker;
+
 @end
 
 
@@ -45,6 +100,7 @@ NSString * const BXMT32PCMROMTypeKey = @"BXMT32PCMROMType";
 @synthesize controlROMURL = _controlROMURL;
 @synthesize synthError = _synthError;
 @synthesize sampleRate = _sampleRate;
+@synthesize renderAhead = _renderAhead;
 
 
 #pragma mark - ROM validation methods
@@ -196,6 +252,7 @@ NSString * const BXMT32PCMROMTypeKey = @"BXMT32PCMROMType";
         self.PCMROMURL = PCMROMURL;
         self.controlROMURL = controlROMURL;
         self.sampleRate = BXMT32DefaultSampleRate;
+        self.renderAhead = BXMT32DefaultRenderAhead;
         self.delegate = delegate;
         
         if (![self _prepareMT32EmulatorWithError: outError])
@@ -209,6 +266,13 @@ NSString * const BXMT32PCMROMTypeKey = @"BXMT32PCMROMType";
 
 - (void) close
 {
+    //Let the worker finish with the synth before we tear it down.
+    if (_worker)
+    {
+        delete _worker;
+        _worker = NULL;
+    }
+    
     if (_synth)
     {
         _synth->close();
@@ -257,10 +321,28 @@ NSString * const BXMT32PCMROMTypeKey = @"BXMT32PCMROMType";
 - (BOOL) supportsMT32Music          { return YES; }
 - (BOOL) supportsGeneralMIDIMusic   { return NO; }
 
-//Since we're processing on the same thread, the emulator is always ready to go
+//Messages are applied in order on the same thread as rendering (or on a render thread
+//that keeps pace with it), so unlike a real MT-32 there's never any need to wait for a
+//sysex to be digested before sending more.
 - (BOOL) isProcessing       { return NO; }
 - (NSDate *) dateWhenReady  { return [NSDate distantPast]; }
 
+- (void) setRenderAhead: (NSTimeInterval)renderAhead
+{
+    renderAhead = MAX(renderAhead, 0);
+    if (renderAhead != _renderAhead)
+    {
+        _renderAhead = renderAhead;
+        if (_worker)
+            [self _prepareWorker];
+    }
+}
+
+- (NSUInteger) renderStallCount
+{
+    return (_worker) ? _worker->Stalls() : 0;
+}
+
 
 - (void) handleMessage: (NSData *)message
 {
@@ -280,7 +362,16 @@ NSString * const BXMT32PCMROMTypeKey = @"BXMT32PCMROMType";
     
     UInt32 packedMsg = status + (data1 << 8) + (data2 << 16);
     
-    _synth->playMsg(packedMsg);
+    if (_worker)
+    {
+        UInt8 event[1 + sizeof(packedMsg)] = { BXMT32WorkerMessage };
+        memcpy(event + 1, &packedMsg, sizeof(packedMsg));
+        _worker->QueueEvent(event, sizeof(event));
+    }
+    else
+    {
+        _synth->playMsg(packedMsg);
+    }
 }
 
 - (void) handleSysex: (NSData *)message
@@ -288,7 +379,18 @@ NSString * const BXMT32PCMROMTypeKey = @"BXMT32PCMROMType";
     NSAssert(_synth, @"handleSysEx: called before successful initialization.");
     NSAssert(message.length > 0, @"0-length message received by handleSysex:");
     
-    _synth->playSysex((UInt8 *)message.bytes, (UInt32)message.length);
+    if (_worker)
+    {
+        NSMutableData *event = [NSMutableData dataWithCapacity: message.length + 1];
+        UInt8 type = BXMT32WorkerSysex;
+        [event appendBytes: &type length: 1];
+        [event appendData: message];
+        _worker->QueueEvent(event.bytes, event.length);
+    }
+    else
+    {
+        _synth->playSysex((UInt8 *)message.bytes, (UInt32)message.length);
+    }
 }
 
 - (void) resume
@@ -318,7 +420,10 @@ NSString * const BXMT32PCMROMTypeKey = @"BXMT32PCMROMType";
                    sampleRate: (NSUInteger *)sampleRate
                        format: (BXAudioFormat *)format
 {
-    _synth->render((SInt16 *)buffer, (UInt32)numFrames);
+    if (_worker)
+        _worker->Read(buffer, numFrames);
+    else
+        _synth->render((SInt16 *)buffer, (UInt32)numFrames);
 
     *sampleRate = self.sampleRate;
     *format = BXAudioFormat16Bit | BXAudioFormatSigned | BXAudioFormatStereo;
@@ -368,9 +473,24 @@ NSString * const BXMT32PCMROMTypeKey = @"BXMT32PCMROMType";
         return NO;
     }
     
+    [self _prepareWorker];
+    
     return YES;
 }
 
+- (void) _prepareWorker
+{
+    //Deleting the old worker applies any messages it still had waiting.
+    if (_worker)
+    {
+        delete _worker;
+        _worker = NULL;
+    }
+    
+    if (AudioWorker::Worthwhile())
+        _worker = new BXEmulatedMT32Worker(_synth, self.sampleRate, self.renderAhead);
+}
+
 @end
 
 
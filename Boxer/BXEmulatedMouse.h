@@ -29,6 +29,11 @@
 	
 	BXMouseButtonMask _pressedButtons;
     NSTimeInterval _lastButtonDown[BXMouseButtonMax];
+    
+    //Relative motion accumulated while the mouse is locked, waiting for DOSBox's mouse driver
+    //to collect it. In fixed-point units of BXMouseMotionScale, updated atomically.
+    volatile int64_t _pendingMotionX;
+    volatile int64_t _pendingMotionY;
 }
 
 
@@ -61,9 +66,16 @@
 
 //Move the mouse to a relative point on the specified canvas, by the relative delta.
 //TODO: simplify this API to always use a 0.0-1.0 canvas.
+//While locked, the delta is accumulated and applied when DOSBox's mouse driver next collects it
+//with takePendingMotion:, rather than being applied straight away.
 - (void) movedTo: (NSPoint)point
 			  by: (NSPoint)delta
 		onCanvas: (NSRect)canvas
 	 whileLocked: (BOOL)locked;
 
+//Collects the relative motion accumulated since this was last called, in DOSBox's pixel units,
+//and empties the accumulator. Returns NO and leaves outDelta untouched if there was no motion.
+//Called on the emulation thread by DOSBox's mouse driver at the emulated mouse's sample rate.
+- (BOOL) takePendingMotion: (NSPoint *)outDelta;
+
 @end
@@ -7,12 +7,37 @@
 
 
 #import "BXEmulatedMouse.h"
+#import "BXEmulatorPrivate.h"
+#import <libkern/OSAtomic.h>
 
 #import "config.h"
 #import "video.h"
 #import "mouse.h"
 
 
+#pragma mark -
+#pragma mark Constants
+
+//The resolution of accumulated relative motion: 1/65536th of a DOSBox pixel.
+#define BXMouseMotionScale 65536.0
+
+//Adds to an accumulator of relative motion. Safe to call from any thread.
+static void BXMouseAddMotion(CGFloat delta, volatile int64_t *accumulator)
+{
+    int64_t amount = (int64_t)llround(delta * BXMouseMotionScale);
+    if (amount) OSAtomicAdd64Barrier(amount, accumulator);
+}
+
+//Empties an accumulator of relative motion and returns what it held. Safe to call from any thread.
+static int64_t BXMouseTakeMotion(volatile int64_t *accumulator)
+{
+    int64_t amount;
+    do { amount = *accumulator; }
+    while (amount && !OSAtomicCompareAndSwap64Barrier(amount, 0, accumulator));
+    return amount;
+}
+
+
 #pragma mark -
 #pragma mark Private method declarations
 
@@ -22,6 +47,10 @@
 - (void) setButton: (BXMouseButton)button toState: (BOOL)pressed;
 - (void) releaseButton: (NSNumber *)button;
 
+//Applies any accumulated relative motion straight away, so that it isn't applied after
+//a button press or release that happened after it. Called on the emulation thread.
+- (void) _applyPendingMotion;
+
 @end
 
 
@@ -83,11 +112,23 @@
 		NSPoint canvasDelta = NSMakePoint(delta.x * canvas.size.width,
 										  delta.y * canvas.size.height);
 		
-		Mouse_CursorMoved(canvasDelta.x,
-						  canvasDelta.y,
-						  point.x,
-						  point.y,
-						  locked);
+        //While locked, DOSBox only cares about relative motion: accumulate it for the mouse driver
+        //to collect at the emulated mouse's own rate, so that motion isn't bunched up according to
+        //when the host's mouse events happen to arrive.
+        if (locked)
+        {
+            BXMouseAddMotion(canvasDelta.x, &_pendingMotionX);
+            BXMouseAddMotion(canvasDelta.y, &_pendingMotionY);
+            return;
+        }
+        
+		[[BXEmulator currentEmulator] _performInputOnEmulationThread: ^{
+            Mouse_CursorMoved(canvasDelta.x,
+                              canvasDelta.y,
+                              point.x,
+                              point.y,
+                              locked);
+        }];
 	}
 }
 
@@ -113,7 +154,10 @@
 	{
 		if (pressed)
 		{
-			Mouse_ButtonPressed(button);
+			[[BXEmulator currentEmulator] _performInputOnEmulationThread: ^{
+                [self _applyPendingMotion];
+                Mouse_ButtonPressed(button);
+            }];
             self.pressedButtons |= buttonMask;
             
             _lastButtonDown[button] = [NSDate timeIntervalSinceReferenceDate];
@@ -140,7 +184,10 @@
             }
             else
             {
-                Mouse_ButtonReleased(button);
+                [[BXEmulator currentEmulator] _performInputOnEmulationThread: ^{
+                    [self _applyPendingMotion];
+                    Mouse_ButtonReleased(button);
+                }];
                 self.pressedButtons &= ~buttonMask;
                 
                 _lastButtonDown[button] = 0;
@@ -149,6 +196,24 @@
 	}
 }
 
+- (BOOL) takePendingMotion: (NSPoint *)outDelta
+{
+    int64_t x = BXMouseTakeMotion(&_pendingMotionX);
+    int64_t y = BXMouseTakeMotion(&_pendingMotionY);
+    if (!x && !y)
+        return NO;
+    
+    *outDelta = NSMakePoint(x / BXMouseMotionScale, y / BXMouseMotionScale);
+    return YES;
+}
+
+- (void) _applyPendingMotion
+{
+    NSPoint delta;
+    if ([self takePendingMotion: &delta])
+        Mouse_CursorMoved(delta.x, delta.y, 0, 0, true);
+}
+
 - (void) buttonDown: (BXMouseButton)button
 {
 	[self setButton: button toState: YES];
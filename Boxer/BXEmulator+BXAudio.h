@@ -61,6 +61,35 @@ extern NSString * const BXMIDIExternalDeviceIndexKey;
 extern NSString * const BXMIDIExternalDeviceNeedsMT32SysexDelaysKey;
 
 
+#pragma mark - Audio buffer statistics constants
+
+/// Keys for the dictionary returned by @c -audioBufferStatistics.
+/// The number of times the sound output ran out of audio to play, as an NSNumber.
+extern NSString * const BXEmulatorAudioUnderrunsKey;
+
+/// The number of frames of audio that were thrown away because the output buffer was too full, as an NSNumber.
+extern NSString * const BXEmulatorAudioDroppedFramesKey;
+
+/// The number of frames of audio waiting to be played, and the number the mixer is aiming to keep waiting,
+/// as NSNumbers.
+extern NSString * const BXEmulatorAudioBufferFillKey;
+extern NSString * const BXEmulatorAudioBufferTargetKey;
+
+/// The number of times the sound output has asked for audio; how many of those times it came up
+/// slightly short and what there was had to be stretched to fit; and how many times there was so much
+/// waiting that the oldest audio was skipped to keep the delay down. As NSNumbers.
+extern NSString * const BXEmulatorAudioCallbacksKey;
+extern NSString * const BXEmulatorAudioStretchedCallbacksKey;
+extern NSString * const BXEmulatorAudioOverrunsKey;
+
+/// How long, in seconds, the audio most recently played took to reach the output device after it was
+/// mixed, and the total of every such delay measured so far along with how many were measured.
+/// The first two are NSNumbers of NSTimeInterval, the last an NSNumber.
+extern NSString * const BXEmulatorAudioOutputDelayKey;
+extern NSString * const BXEmulatorAudioTotalOutputDelayKey;
+extern NSString * const BXEmulatorAudioOutputDelayCountKey;
+
+
 #pragma mark - BXEmulator (BXAudio)
 
 @protocol BXMIDIDevice;
@@ -82,4 +111,16 @@ extern NSString * const BXMIDIExternalDeviceNeedsMT32SysexDelaysKey;
 - (void) sendMIDIMessage: (NSData *)message;
 - (void) sendMIDISysex: (NSData *)message;
 
+//Dispatch the specified MIDI message onward to the active MIDI device, along with the emulated time
+//in milliseconds at which it fell due. Devices that cannot schedule messages ahead are sent it as-is.
+- (void) sendMIDIMessage: (NSData *)message atEmulatedTime: (double)timestamp;
+
+
+#pragma mark - Audio output
+
+/// How well the sound output is keeping up, using the keys listed under @c BXEmulatorAudioUnderrunsKey.
+/// The counts run for the lifetime of the emulator. Returns @c nil if the emulator is not running.
+/// This is KVO-compliant, and changes about once a second while the emulator is running.
+@property (readonly) NSDictionary *audioBufferStatistics;
+
 @end
@@ -27,6 +27,17 @@ NSString * const BXMIDIExternalDeviceIndexKey       = @"External Device Index";
 NSString * const BXMIDIExternalDeviceUniqueIDKey    = @"External Device Unique ID";
 NSString * const BXMIDIExternalDeviceNeedsMT32SysexDelaysKey = @"Needs MT-32 Sysex Delays";
 
+NSString * const BXEmulatorAudioUnderrunsKey        = @"underruns";
+NSString * const BXEmulatorAudioDroppedFramesKey    = @"dropped";
+NSString * const BXEmulatorAudioBufferFillKey       = @"fill";
+NSString * const BXEmulatorAudioBufferTargetKey     = @"target";
+NSString * const BXEmulatorAudioCallbacksKey        = @"callbacks";
+NSString * const BXEmulatorAudioStretchedCallbacksKey   = @"stretchedCallbacks";
+NSString * const BXEmulatorAudioOverrunsKey         = @"overruns";
+NSString * const BXEmulatorAudioOutputDelayKey      = @"outputDelay";
+NSString * const BXEmulatorAudioTotalOutputDelayKey = @"totalOutputDelay";
+NSString * const BXEmulatorAudioOutputDelayCountKey = @"outputDelayCount";
+
 
 @implementation BXEmulator (BXAudio)
 
@@ -80,8 +91,12 @@ NSString * const BXMIDIExternalDeviceNeedsMT32SysexDelaysKey = @"Needs MT-32 Sys
 
 - (id <BXMIDIDevice>) attachMIDIDeviceForDescription: (NSDictionary *)description
 {
-    id <BXMIDIDevice> device = [self.delegate MIDIDeviceForEmulator: self
-                                                 meetingDescription: description];
+    id <BXMIDIDevice> device;
+    {
+        BXStallCallScope stallCall("-MIDIDeviceForEmulator:meetingDescription:");
+        device = [self.delegate MIDIDeviceForEmulator: self
+                                   meetingDescription: description];
+    }
     
     if (device && device != self.activeMIDIDevice)
     {
@@ -104,6 +119,21 @@ NSString * const BXMIDIExternalDeviceNeedsMT32SysexDelaysKey = @"Needs MT-32 Sys
     }
 }
 
+- (void) sendMIDIMessage: (NSData *)message atEmulatedTime: (double)timestamp
+{
+    [self _attachRequestedMIDIDeviceIfNeeded];
+    
+    id <BXMIDIDevice> device = self.activeMIDIDevice;
+    if (device)
+    {
+        [self _waitUntilActiveMIDIDeviceIsReady];
+        if ([device respondsToSelector: @selector(handleMessage:atEmulatedTime:)])
+            [device handleMessage: message atEmulatedTime: timestamp];
+        else
+            [device handleMessage: message];
+    }
+}
+
 - (void) sendMIDISysex: (NSData *)message
 {
     //Connect to our requested MIDI device the first time we need one.
@@ -168,6 +198,31 @@ NSString * const BXMIDIExternalDeviceNeedsMT32SysexDelaysKey = @"Needs MT-32 Sys
 }
 
 
+#pragma mark -
+#pragma mark Audio output
+
+- (NSDictionary *) audioBufferStatistics
+{
+    if (!self.isExecuting) return nil;
+    
+    MIXER_BufferState state;
+    MIXER_GetBufferState(&state);
+    
+    return @{
+             BXEmulatorAudioUnderrunsKey:       @(state.underruns),
+             BXEmulatorAudioDroppedFramesKey:   @(state.dropped),
+             BXEmulatorAudioBufferFillKey:      @(state.fill),
+             BXEmulatorAudioBufferTargetKey:    @(state.target),
+             BXEmulatorAudioCallbacksKey:       @(state.callbacks),
+             BXEmulatorAudioStretchedCallbacksKey:  @(state.stretched),
+             BXEmulatorAudioOverrunsKey:        @(state.overruns),
+             BXEmulatorAudioOutputDelayKey:     @(state.delay / 1000000.0),
+             BXEmulatorAudioTotalOutputDelayKey:    @(state.delay_total / 1000000.0),
+             BXEmulatorAudioOutputDelayCountKey:    @(state.delay_count),
+             };
+}
+
+
 
 
 #pragma mark -
@@ -175,7 +230,7 @@ NSString * const BXMIDIExternalDeviceNeedsMT32SysexDelaysKey = @"Needs MT-32 Sys
 
 - (void) _suspendAudio
 {
-    SDL_PauseAudio(YES);
+    MIXER_PauseOutput(true);
     
     _cdromWasPlaying = (SDL_CDStatus(NULL) == CD_PLAYING);
     if (_cdromWasPlaying)
@@ -184,9 +239,21 @@ NSString * const BXMIDIExternalDeviceNeedsMT32SysexDelaysKey = @"Needs MT-32 Sys
     [self.activeMIDIDevice pause];
 }
 
+- (void) _updateAudioBufferStatistics
+{
+    //The counters change with every audio callback, so only announce them periodically.
+    NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+    if (now - _lastAudioBufferStatisticsTime >= BXAudioBufferStatisticsInterval)
+    {
+        _lastAudioBufferStatisticsTime = now;
+        [self willChangeValueForKey: @"audioBufferStatistics"];
+        [self didChangeValueForKey: @"audioBufferStatistics"];
+    }
+}
+
 - (void) _resumeAudio
 {
-    SDL_PauseAudio(NO);
+    MIXER_PauseOutput(false);
     
     if (_cdromWasPlaying)
         SDL_CDResume(NULL);
@@ -367,6 +434,7 @@ void _renderMIDIOutput(Bitu numFrames)
 {
     id <BXMIDIDevice> device = self.activeMIDIDevice;
     BOOL askDelegate = [self.delegate respondsToSelector: @selector(emulator:shouldWaitForMIDIDevice:untilDate:)];
+    BXStallCallScope stallCall("waiting for MIDI device");
     
     while (device.isProcessing)
     {
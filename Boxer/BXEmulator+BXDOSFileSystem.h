@@ -85,6 +85,7 @@
 - (BOOL) releaseResourcesForDrive: (BXDrive *)drive error: (NSError **)outError;
 
 //Flush the DOS filesystem cache and rescan to synchronise it with the local filesystem state.
+//Local drives that are watching their host folder are skipped, since they keep themselves in sync.
 - (void) refreshMountedDrives;
 
 //Returns the preferred available drive letter to which the specified path should be mounted,
@@ -11,12 +11,17 @@
 #import "NSString+ADBPaths.h"
 #import "RegexKitLite.h"
 #import "ADBFilesystem.h"
+#import "ADBLocalFilesystem.h"
+#import "ADBShadowedFilesystem.h"
 #import "NSURL+ADBFilesystemHelpers.h"
+#import "BXFileTypes.h"
 
 #import "dos_inc.h"
 #import "dos_system.h"
 #import "drives.h"
+#import "BXCoalfaceDrives.h"
 #import "cdrom.h"
+#include <fcntl.h>
 
 
 #pragma mark - Private constants
@@ -223,7 +228,14 @@ void MSCDEX_SetCDInterface(int intNr, int forceCD);
         mountPath = [mountPath stringByAppendingString: @"/"];
 	
     NSError *mountError = nil;
-    if (isImage)
+    if (isImage && [mountURL conformsToFileType: BXZipArchiveType])
+    {
+        DOSBoxDrive = [self _driveFromArchiveAtPath: mountPath
+                                         shadowPath: drive.shadowURL.path
+                                            mediaID: (drive.type == BXDriveFloppyDisk) ? BXFloppyMediaID : BXHardDiskMediaID
+                                              error: &mountError];
+    }
+    else if (isImage)
     {
         switch (drive.type)
         {
@@ -238,6 +250,7 @@ void MSCDEX_SetCDInterface(int intNr, int forceCD);
                 break;
             case BXDriveFloppyDisk:
                 DOSBoxDrive = [self _floppyDriveFromImageAtPath: mountPath
+                                                     shadowPath: drive.shadowURL.path
                                                           error: &mountError];
                 break;
                 
@@ -287,6 +300,15 @@ void MSCDEX_SetCDInterface(int intNr, int forceCD);
 					DOSBoxDrive->SetLabel(cLabel, drive.isCDROM, false);
 			}
 			
+            //Pick up where DOSBox left off with the drive's directories last time, if we can.
+            //(Image-backed drives don't go through DOSBox's directory cache.)
+            if (!isImage && drive.directoryIndexURL)
+            {
+                const char *indexPath = drive.directoryIndexURL.fileSystemRepresentation;
+                if (indexPath)
+                    DOSBoxDrive->dirCache.SetIndexFile(indexPath);
+            }
+            
 			//Populate the drive with the settings we ended up using, and add the drive to our own drives cache
             drive.letter = driveLetter;
             drive.DOSVolumeLabel = [NSString stringWithCString: DOSBoxDrive->GetLabel()
@@ -424,6 +446,10 @@ void MSCDEX_SetCDInterface(int intNr, int forceCD);
         NSUInteger driveIndex = [self _indexOfDriveLetter: drive.letter];
         [self _closeFilesForDOSBoxDriveAtIndex: driveIndex];
         
+        //Whatever the caller does with the drive's files next, DOSBox's idea of where they are
+        //will no longer hold.
+        boxer_invalidateLocalPathCache();
+        
         //TODO: hook into ISO file handling to close file handles for image-backed drives.
     }
     return YES;
@@ -433,8 +459,15 @@ void MSCDEX_SetCDInterface(int intNr, int forceCD);
 {
 	if (self.isExecuting)
 	{
+        boxer_invalidateLocalPathCache();
+        
 		for (NSUInteger i=0; i < DOS_DRIVES; i++)
 		{
+            //Local drives that are watching their folder for changes already know
+            //what has changed, so there's no need to empty their caches.
+            localDrive *watchedDrive = dynamic_cast<localDrive *>(Drives[i]);
+            if (watchedDrive && watchedDrive->isWatchingHostDirectory()) continue;
+            
 			if (Drives[i]) Drives[i]->EmptyCache();
 		}
 	}
@@ -926,6 +959,7 @@ void MSCDEX_SetCDInterface(int intNr, int forceCD);
 	if (Drives[index]) return NO;
 	
 	Drives[index] = drive;
+    boxer_invalidateLocalPathCache();
 	mem_writeb(Real2Phys(dos.tables.mediaid)+((PhysPt)index)*2, drive->GetMediaByte());
 	
 	return YES;
@@ -945,6 +979,7 @@ void MSCDEX_SetCDInterface(int intNr, int forceCD);
         [self _closeFilesForDOSBoxDriveAtIndex: index];
         
 		Drives[index] = NULL;
+        boxer_invalidateLocalPathCache();
 		return YES;
 	}
 	else
@@ -1087,13 +1122,27 @@ void MSCDEX_SetCDInterface(int intNr, int forceCD);
 
 //Create a new DOS_Drive floppy from a path to a raw disk image.
 - (DOS_Drive *) _floppyDriveFromImageAtPath: (NSString *)path
+                                 shadowPath: (NSString *)shadowPath
                                       error: (NSError **)outError
 {	
 	const char *drivePath = [path cStringUsingEncoding: BXDirectStringEncoding];
 	//If the path couldn't be encoded, don't attempt to go further
 	if (!drivePath) return nil;
+    
+    //The overlay file itself is only created once something is written to the disk,
+    //but the folder it will go into needs to be there by then.
+    const char *overlayPath = NULL;
+    if (shadowPath)
+    {
+        [[NSFileManager defaultManager] createDirectoryAtPath: shadowPath.stringByDeletingLastPathComponent
+                                  withIntermediateDirectories: YES
+                                                   attributes: nil
+                                                        error: NULL];
+        
+        overlayPath = [shadowPath cStringUsingEncoding: BXDirectStringEncoding];
+    }
 	
-	fatDrive *drive = new fatDrive(drivePath, 0, 0, 0, 0, 0);
+	fatDrive *drive = new fatDrive(drivePath, 0, 0, 0, 0, 0, overlayPath);
 	if (!drive || !drive->created_successfully)
     {
         delete drive;
@@ -1108,6 +1157,51 @@ void MSCDEX_SetCDInterface(int intNr, int forceCD);
 	return (DOS_Drive *)drive;
 }
 
+//Create a new DOS_Drive from a path to a zip archive.
+- (DOS_Drive *) _driveFromArchiveAtPath: (NSString *)path
+                             shadowPath: (NSString *)shadowPath
+                                mediaID: (NSUInteger)mediaID
+                                  error: (NSError **)outError
+{
+	const char *drivePath = [path cStringUsingEncoding: BXDirectStringEncoding];
+	//If the path couldn't be encoded, don't attempt to go further
+	if (!drivePath) return nil;
+    
+    //The shadow folder itself is only created once something is written to the drive,
+    //but the folder it will go into needs to be there by then.
+    const char *drivePathForChanges = NULL;
+    if (shadowPath)
+    {
+        [[NSFileManager defaultManager] createDirectoryAtPath: shadowPath.stringByDeletingLastPathComponent
+                                  withIntermediateDirectories: YES
+                                                   attributes: nil
+                                                        error: NULL];
+        
+        drivePathForChanges = [shadowPath cStringUsingEncoding: BXDirectStringEncoding];
+    }
+    
+	int errorCode = BXDOSBoxMountUnknownError;
+	zipDrive *drive = new zipDrive(drivePath, drivePathForChanges, (Bit8u)mediaID, errorCode);
+    
+	if (errorCode == BXDOSBoxMountSuccess)
+	{
+        return drive;
+    }
+    else
+    {
+		delete drive;
+        
+        if (outError)
+        {
+            *outError = [NSError errorWithDomain: BXDOSBoxMountErrorDomain
+                                            code: errorCode
+                                        userInfo: nil];
+        }
+        
+        return nil;
+	}
+}
+
 //Create a new DOS_Drive floppy from a path to a raw disk image.
 //Currently unimplemented as this requires data about the
 //volume layout of the image.
@@ -1340,12 +1434,14 @@ void MSCDEX_SetCDInterface(int intNr, int forceCD);
 - (BOOL) _shouldMountLocalPath: (const char *)localPath
 {
     NSURL *fileURL = [NSURL URLFromFileSystemRepresentation: localPath];
+    BXStallCallScope stallCall("-emulator:shouldMountDriveFromURL:");
 	return [self.delegate emulator: self shouldMountDriveFromURL: fileURL];
 }
 
 //Todo: supplement this by getting entire OS X filepaths out of DOSBox, instead of just filenames
 - (BOOL) _shouldShowFileWithName: (NSString *)fileName
 {
+    BXStallCallScope stallCall("-emulator:shouldShowFileWithName:");
     return [self.delegate emulator: self shouldShowFileWithName: fileName];
 }
 
@@ -1354,6 +1450,7 @@ void MSCDEX_SetCDInterface(int intNr, int forceCD);
 	BXDrive *drive = [self _driveMatchingDOSBoxDrive: dosboxDrive];
     
     NSURL *fileURL = [NSURL URLFromFileSystemRepresentation: localPath];
+    BXStallCallScope stallCall("-emulator:shouldAllowWriteAccessToURL:onDrive:");
     return [self.delegate emulator: self shouldAllowWriteAccessToURL: fileURL onDrive: drive];
 }
 
@@ -1413,6 +1510,7 @@ void MSCDEX_SetCDInterface(int intNr, int forceCD);
     if ([ext hasPrefix: @"."])
         ext = [ext substringFromIndex: 1];
     
+    BXStallCallScope stallCall("-emulator:openCaptureFileOfType:extension:");
     return [self.delegate emulator: self openCaptureFileOfType: type extension: ext];
 }
 
@@ -1441,6 +1539,26 @@ void MSCDEX_SetCDInterface(int intNr, int forceCD);
     return file;
 }
 
+- (void) _didOpenLocalFile: (FILE *)file inMode: (const char *)mode
+{
+    //Files opened for writing from scratch have nothing in them worth knowing about.
+    if (strchr(mode, 'w'))
+        return;
+    
+    if (![self.delegate respondsToSelector: @selector(emulator:didOpenFileAtURL:)])
+        return;
+    
+    //Ask the file handle where it actually ended up, since shadowed drives
+    //may have opened a different file from the one the drive asked for.
+    char resolvedPath[MAXPATHLEN];
+    if (fcntl(fileno(file), F_GETPATH, resolvedPath) == -1)
+        return;
+    
+    NSURL *fileURL = [NSURL URLFromFileSystemRepresentation: resolvedPath];
+    BXStallCallScope stallCall("-emulator:didOpenFileAtURL:");
+    [self.delegate emulator: self didOpenFileAtURL: fileURL];
+}
+
 - (BOOL) _removeFileAtLocalPath: (const char *)path
                   onDOSBoxDrive: (DOS_Drive *)dosboxDrive
 {
@@ -1580,6 +1698,87 @@ void MSCDEX_SetCDInterface(int intNr, int forceCD);
     return NO;
 }
 
+- (BOOL) _getModificationStamp: (out uint64_t *)outStamp
+             forLocalDirectory: (const char *)path
+                 onDOSBoxDrive: (DOS_Drive *)dosboxDrive
+{
+    BXDrive *drive = [self _driveMatchingDOSBoxDrive: dosboxDrive];
+    ADBLocalFilesystem *filesystem = (ADBLocalFilesystem *)drive.filesystem;
+    
+    //Only folders on disk have modification dates we can go by.
+    if (![filesystem isKindOfClass: [ADBLocalFilesystem class]])
+        return NO;
+    
+    NSURL *localURL         = [NSURL URLFromFileSystemRepresentation: path];
+    NSString *logicalPath   = [filesystem pathForFileURL: localURL].stringByStandardizingPath;
+    if (!logicalPath)
+        return NO;
+    
+    //A shadowed directory's contents are made up of the directory in the source location and
+    //the one in the shadow location, so the stamp has to change whenever either of them does.
+    NSMutableArray *directoryURLs = [NSMutableArray arrayWithObject: [filesystem.baseURL URLByAppendingPathComponent: logicalPath]];
+    if ([filesystem isKindOfClass: [ADBShadowedFilesystem class]])
+    {
+        NSURL *shadowURL = [(ADBShadowedFilesystem *)filesystem shadowURL];
+        if (shadowURL)
+            [directoryURLs addObject: [shadowURL URLByAppendingPathComponent: logicalPath]];
+    }
+    
+    time_t now = time(NULL);
+    uint64_t stamp = 0;
+    BOOL foundDirectory = NO;
+    for (NSURL *directoryURL in directoryURLs)
+    {
+        //Mix each location in separately, so that the directory appearing or disappearing
+        //in one location changes the stamp even if the other location stays the same.
+        stamp *= 0x100000001B3ULL;
+        
+        struct stat status;
+        if (stat(directoryURL.fileSystemRepresentation, &status) != 0)
+            continue;
+        
+        if (!S_ISDIR(status.st_mode))
+            return NO;
+        
+        //Some filesystems only record modification dates to the second, so a directory that
+        //changed within the last second could change again without its date moving on.
+        //Don't vouch for it until it has settled.
+        if (status.st_mtimespec.tv_sec >= now - 1)
+            return NO;
+        
+        stamp ^= ((uint64_t)status.st_mtimespec.tv_sec * 1000000000ULL) + status.st_mtimespec.tv_nsec + 1;
+        foundDirectory = YES;
+    }
+    
+    if (foundDirectory && outStamp)
+        *outStamp = stamp;
+    
+    return foundDirectory;
+}
+
+- (NSURL *) _resolvedURLForLocalPath: (const char *)path
+                       onDOSBoxDrive: (DOS_Drive *)dosboxDrive
+                              exists: (out BOOL *)outExists
+                         isDirectory: (out BOOL *)outIsDirectory
+{
+    BXDrive *drive = [self _driveMatchingDOSBoxDrive: dosboxDrive];
+    id <ADBFilesystemPathAccess, ADBFilesystemFileURLAccess> filesystem = (id)drive.filesystem;
+    NSAssert2([filesystem conformsToProtocol: @protocol(ADBFilesystemFileURLAccess)],
+              @"Filesystem %@ for drive %@ does not support local URL file access.", filesystem, drive);
+    
+    //Round-trip the path in case the filesystem remaps it to a different file location
+    NSURL *localURL         = [NSURL URLFromFileSystemRepresentation: path];
+    NSString *logicalPath   = [filesystem pathForFileURL: localURL];
+    
+    BOOL isDirectory = NO;
+    BOOL exists = (logicalPath && [filesystem fileExistsAtPath: logicalPath isDirectory: &isDirectory]);
+    
+    if (outExists) *outExists = exists;
+    if (outIsDirectory) *outIsDirectory = (exists && isDirectory);
+    
+    return (exists) ? [filesystem fileURLForPath: logicalPath] : nil;
+}
+
 - (BOOL) _localDirectoryExists: (const char *)path
                  onDOSBoxDrive: (DOS_Drive *)dosboxDrive
 {
@@ -1632,4 +1831,19 @@ void MSCDEX_SetCDInterface(int intNr, int forceCD);
                               errorHandler: NULL];
 }
 
+- (BOOL) _canReadLocalPathDirectly: (const char *)path
+                     onDOSBoxDrive: (DOS_Drive *)dosboxDrive
+{
+    BXDrive *drive = [self _driveMatchingDOSBoxDrive: dosboxDrive];
+    id <ADBFilesystemPathAccess, ADBFilesystemFileURLAccess> filesystem = (id)drive.filesystem;
+    
+    //Shadowed and image-backed filesystems present contents that aren't where they appear
+    //to be on disk, so only a plain local filesystem will do.
+    if (![filesystem isMemberOfClass: [ADBLocalFilesystem class]])
+        return NO;
+    
+    NSURL *localURL = [NSURL URLFromFileSystemRepresentation: path];
+    return [filesystem exposesFileURL: localURL];
+}
+
 @end
\ No newline at end of file
@@ -0,0 +1,82 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+//The BXInputReplay category extends BXEmulator with the ability to record a stretch of play and
+//replay it later exactly as it happened, so that the same stretch of a game can be benchmarked
+//again and again.
+
+//A replay is a folder containing a snapshot of the machine at the moment recording started,
+//the keyboard, mouse and joystick input that reached the machine from then on stamped with the
+//emulated time at which it arrived, the configuration files and drives the session was using,
+//and an Info.plist describing the recording. Replays are run at a fixed CPU speed, so that
+//the machine receives its input at the same emulated instant on every run.
+
+#import "BXEmulator.h"
+
+
+#pragma mark -
+#pragma mark Constants
+
+/// The names of the files inside a replay folder.
+extern NSString * const BXInputReplaySnapshotFileName;
+extern NSString * const BXInputReplayInputFileName;
+extern NSString * const BXInputReplayDrivesFileName;
+extern NSString * const BXInputReplayInfoFileName;
+/// The folder within a replay containing copies of the session's configuration files,
+/// named so that they sort in the order they were applied.
+extern NSString * const BXInputReplayConfigurationsFolderName;
+
+/// Keys for a replay's Info.plist.
+/// An NSNumber wrapping the fixed CPU speed in cycles at which the replay must be run.
+extern NSString * const BXInputReplayCyclesKey;
+/// An NSNumber wrapping the @c BXCoreMode that was active when recording started.
+extern NSString * const BXInputReplayCoreModeKey;
+/// NSNumbers wrapping the emulated milliseconds, frames drawn and frame checksum of the recording.
+extern NSString * const BXInputReplayDurationKey;
+extern NSString * const BXInputReplayFrameCountKey;
+extern NSString * const BXInputReplayFrameChecksumKey;
+
+
+@interface BXEmulator (BXInputReplay)
+
+/// Whether input is currently being recorded.
+@property (readonly, nonatomic, getter=isRecordingInput) BOOL recordingInput;
+
+/// Whether a replay is currently being played back.
+@property (readonly, nonatomic, getter=isReplayingInput) BOOL replayingInput;
+
+/// Whether the replay being played back has reached the point at which recording stopped.
+@property (readonly, nonatomic, getter=isReplayFinished) BOOL replayFinished;
+
+/// The number of frames drawn, and a checksum of their contents, since recording or playback began.
+/// Two playbacks of the same replay that went the same way will have the same checksum.
+@property (readonly, nonatomic) NSUInteger replayFrameCount;
+@property (readonly, nonatomic) uint32_t replayFrameChecksum;
+
+/// The number of emulated milliseconds since recording or playback began.
+@property (readonly, nonatomic) NSUInteger replayElapsedTicks;
+
+/// Snapshots the machine and starts recording input into a new replay folder at the specified location.
+/// Like saving states, this can only be done while @c canSaveStates is @c YES. From here on the CPU
+/// is locked at its current speed until recording finishes. Returns @c NO and populates @c outError
+/// if recording could not be started.
+- (BOOL) startRecordingInputToURL: (NSURL *)URL error: (out NSError **)outError;
+
+/// Stops recording and finishes writing the replay folder. Returns @c NO and populates @c outError
+/// if the replay could not be written. Does nothing and returns @c YES if no input was being recorded.
+- (BOOL) finishRecordingInputWithError: (out NSError **)outError;
+
+/// Restores the machine to the start of the replay folder at the specified location and starts playing
+/// back its input, at the CPU speed it was recorded at. Live input is ignored until playback is stopped.
+/// The replay's drives must already be mounted, and this can only be done while @c canSaveStates is @c YES.
+/// Returns @c NO and populates @c outError if playback could not be started.
+- (BOOL) startReplayingInputFromURL: (NSURL *)URL error: (out NSError **)outError;
+
+/// Stops playing back input, returning control to live input.
+- (void) stopReplayingInput;
+
+@end
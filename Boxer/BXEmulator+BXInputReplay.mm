@@ -0,0 +1,248 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+#import "BXEmulator+BXInputReplay.h"
+#import "BXEmulatorPrivate.h"
+
+#import "inputreplay.h"
+
+
+#pragma mark -
+#pragma mark Constants
+
+NSString * const BXInputReplaySnapshotFileName          = @"Snapshot.bxstate";
+NSString * const BXInputReplayInputFileName             = @"Input.bxinput";
+NSString * const BXInputReplayDrivesFileName            = @"Drives.plist";
+NSString * const BXInputReplayInfoFileName              = @"Info.plist";
+NSString * const BXInputReplayConfigurationsFolderName  = @"Configurations";
+
+NSString * const BXInputReplayCyclesKey         = @"cycles";
+NSString * const BXInputReplayCoreModeKey       = @"coreMode";
+NSString * const BXInputReplayDurationKey       = @"duration";
+NSString * const BXInputReplayFrameCountKey     = @"frameCount";
+NSString * const BXInputReplayFrameChecksumKey  = @"frameChecksum";
+
+
+@implementation BXEmulator (BXInputReplay)
+
+#pragma mark -
+#pragma mark Status
+
+- (BOOL) isRecordingInput
+{
+    return REPLAY_IsRecording();
+}
+
+- (BOOL) isReplayingInput
+{
+    return REPLAY_IsPlaying();
+}
+
+- (BOOL) isReplayFinished
+{
+    return REPLAY_PlaybackFinished();
+}
+
+- (NSUInteger) replayFrameCount
+{
+    return REPLAY_FrameCount();
+}
+
+- (uint32_t) replayFrameChecksum
+{
+    return REPLAY_FrameChecksum();
+}
+
+- (NSUInteger) replayElapsedTicks
+{
+    return REPLAY_ElapsedTicks();
+}
+
+
+#pragma mark -
+#pragma mark Recording
+
+- (BOOL) startRecordingInputToURL: (NSURL *)URL error: (out NSError **)outError
+{
+    NSAssert(!self.isRecordingInput, @"startRecordingInputToURL:error: called while input was already being recorded.");
+
+    if (!self.canSaveStates)
+    {
+        if (outError) *outError = [self.class _replayErrorWithCode: BXEmulatorStateUnavailable];
+        return NO;
+    }
+
+    NSFileManager *manager = [NSFileManager defaultManager];
+    NSURL *configurationsURL = [URL URLByAppendingPathComponent: BXInputReplayConfigurationsFolderName];
+    if (![manager createDirectoryAtURL: configurationsURL withIntermediateDirectories: YES attributes: nil error: outError])
+        return NO;
+
+    //Copy the configurations in the order they were applied, numbering them so they sort that way too.
+    NSArray *configurationURLs = [self.delegate configurationURLsForEmulator: self];
+    NSUInteger index = 0;
+    for (NSURL *configurationURL in configurationURLs)
+    {
+        NSString *name = [NSString stringWithFormat: @"%02lu %@", (unsigned long)index++, configurationURL.lastPathComponent];
+        if (![manager copyItemAtURL: configurationURL toURL: [configurationsURL URLByAppendingPathComponent: name] error: outError])
+            return NO;
+    }
+
+    //Drives aren't part of snapshots, so record the ones that need mounting before the snapshot can be restored.
+    NSMutableArray *drives = [NSMutableArray arrayWithCapacity: self.mountedDrives.count];
+    for (BXDrive *drive in self.mountedDrives)
+    {
+        if (!drive.isVirtual)
+            [drives addObject: drive];
+    }
+    NSData *driveData = [NSKeyedArchiver archivedDataWithRootObject: drives];
+    if (![driveData writeToURL: [URL URLByAppendingPathComponent: BXInputReplayDrivesFileName] options: NSDataWritingAtomic error: outError])
+        return NO;
+
+    //Lock the speed for the duration, since the input is stamped in emulated time and a replay
+    //only goes the same way if each emulated millisecond runs the same number of instructions.
+    NSInteger cycles = self.fixedSpeed;
+    self.fixedSpeed = cycles;
+
+    NSDictionary *info = @{
+                           BXInputReplayCyclesKey: @(cycles),
+                           BXInputReplayCoreModeKey: @(self.coreMode),
+                           };
+    if (![info writeToURL: [URL URLByAppendingPathComponent: BXInputReplayInfoFileName] atomically: YES])
+    {
+        if (outError) *outError = [self.class _replayErrorWithCode: BXEmulatorReplayUnreadable];
+        return NO;
+    }
+
+    BOOL saved = [self saveStateToURL: [URL URLByAppendingPathComponent: BXInputReplaySnapshotFileName]
+                                error: outError
+                    completionHandler: ^(BOOL succeeded, NSError *error) {
+                        if (!succeeded)
+                            NSLog(@"Could not write the snapshot for input recording: %@", error);
+                    }];
+    if (!saved)
+        return NO;
+
+    //The machine's state was copied synchronously above, so recording starts from exactly the point of the snapshot.
+    [self willChangeValueForKey: @"recordingInput"];
+        REPLAY_StartRecording();
+        [_inputRecordingURL release];
+        _inputRecordingURL = [URL copy];
+    [self didChangeValueForKey: @"recordingInput"];
+
+    return YES;
+}
+
+- (BOOL) finishRecordingInputWithError: (out NSError **)outError
+{
+    if (!self.isRecordingInput)
+        return YES;
+
+    NSUInteger duration = REPLAY_ElapsedTicks();
+    NSUInteger frameCount = REPLAY_FrameCount();
+    uint32_t checksum = REPLAY_FrameChecksum();
+
+    NSURL *URL = [_inputRecordingURL autorelease];
+    _inputRecordingURL = nil;
+
+    [self willChangeValueForKey: @"recordingInput"];
+        BOOL written = REPLAY_StopRecording([URL URLByAppendingPathComponent: BXInputReplayInputFileName].path.fileSystemRepresentation);
+    [self didChangeValueForKey: @"recordingInput"];
+
+    if (written)
+    {
+        NSURL *infoURL = [URL URLByAppendingPathComponent: BXInputReplayInfoFileName];
+        NSMutableDictionary *info = [NSMutableDictionary dictionaryWithContentsOfURL: infoURL];
+        [info setObject: @(duration) forKey: BXInputReplayDurationKey];
+        [info setObject: @(frameCount) forKey: BXInputReplayFrameCountKey];
+        [info setObject: @(checksum) forKey: BXInputReplayFrameChecksumKey];
+        written = info && [info writeToURL: infoURL atomically: YES];
+    }
+
+    if (!written)
+    {
+        if (outError) *outError = [self.class _replayErrorWithCode: BXEmulatorReplayUnreadable];
+        return NO;
+    }
+    return YES;
+}
+
+
+#pragma mark -
+#pragma mark Playback
+
+- (BOOL) startReplayingInputFromURL: (NSURL *)URL error: (out NSError **)outError
+{
+    if (!self.canSaveStates)
+    {
+        if (outError) *outError = [self.class _replayErrorWithCode: BXEmulatorStateUnavailable];
+        return NO;
+    }
+
+    NSDictionary *info = [NSDictionary dictionaryWithContentsOfURL: [URL URLByAppendingPathComponent: BXInputReplayInfoFileName]];
+    NSNumber *cycles = [info objectForKey: BXInputReplayCyclesKey];
+    if (!cycles || ![info objectForKey: BXInputReplayDurationKey])
+    {
+        if (outError) *outError = [self.class _replayErrorWithCode: BXEmulatorReplayUnreadable];
+        return NO;
+    }
+
+    if (![self restoreStateFromURL: [URL URLByAppendingPathComponent: BXInputReplaySnapshotFileName] error: outError])
+        return NO;
+
+    self.fixedSpeed = cycles.integerValue;
+    NSNumber *coreMode = [info objectForKey: BXInputReplayCoreModeKey];
+    if (coreMode)
+        self.coreMode = (BXCoreMode)coreMode.integerValue;
+
+    [self willChangeValueForKey: @"replayingInput"];
+        BOOL started = REPLAY_StartPlayback([URL URLByAppendingPathComponent: BXInputReplayInputFileName].path.fileSystemRepresentation);
+    [self didChangeValueForKey: @"replayingInput"];
+
+    if (!started)
+    {
+        if (outError) *outError = [self.class _replayErrorWithCode: BXEmulatorReplayUnreadable];
+        return NO;
+    }
+    return YES;
+}
+
+- (void) stopReplayingInput
+{
+    if (!self.isReplayingInput)
+        return;
+
+    [self willChangeValueForKey: @"replayingInput"];
+        REPLAY_StopPlayback();
+    [self didChangeValueForKey: @"replayingInput"];
+}
+
+
+#pragma mark -
+#pragma mark Private methods
+
++ (NSError *) _replayErrorWithCode: (NSInteger)code
+{
+    NSString *description;
+    switch (code)
+    {
+        case BXEmulatorReplayUnreadable:
+            description = NSLocalizedString(@"The input recording could not be read or written.",
+                                            @"Error shown when an input recording for benchmarking was missing, damaged or could not be saved.");
+            break;
+
+        case BXEmulatorStateUnavailable:
+        default:
+            description = NSLocalizedString(@"Input cannot be recorded or replayed right now.",
+                                            @"Error shown when the user tries to record or replay input while the emulator is not running.");
+            break;
+    }
+    return [NSError errorWithDomain: BXEmulatorErrorDomain
+                               code: code
+                           userInfo: @{ NSLocalizedDescriptionKey: description }];
+}
+
+@end
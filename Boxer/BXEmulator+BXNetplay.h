@@ -0,0 +1,78 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+//The BXNetplay category extends BXEmulator with the ability to play a game with other people over
+//the network, by running the same machine on every player's Mac and exchanging only their input.
+
+//The host starts the game and the other players join it. Once everyone has joined, the host's
+//machine is copied to the other players and every machine is locked to the host's CPU speed and core.
+//From then on, each player's keyboard, mouse and joystick input is held back for a few frames and
+//applied to every machine at the same emulated instant, so the machines stay in step without any
+//of the game's own networking: this works for games that only ever supported one keyboard.
+//If a player leaves or stops responding, or the machines are found to have gone their separate
+//ways, netplay stops and each machine carries on alone.
+
+#import "BXEmulator.h"
+
+
+#pragma mark -
+#pragma mark Constants
+
+typedef NS_ENUM(NSInteger, BXNetplayState) {
+    BXNetplayInactive,
+    BXNetplayWaiting,   //Waiting for the other players to join, or for the host's machine to arrive.
+    BXNetplayRunning,   //Playing in lockstep.
+    BXNetplayFailed,    //Stopped because a player left or stopped responding: see netplayFailureReason.
+};
+
+/// The UDP port that games are hosted on unless another is specified.
+extern const NSUInteger BXNetplayDefaultPort;
+
+/// The most players that can take part in a game, including the host.
+extern const NSUInteger BXNetplayMaxPlayers;
+
+
+@interface BXEmulator (BXNetplay)
+
+/// The current state of netplay. Updated on the emulation thread, and observable.
+@property (readonly, nonatomic) BXNetplayState netplayState;
+
+/// This player's number, with the host being 0.
+@property (readonly, nonatomic) NSUInteger netplayPlayerIndex;
+
+/// How many players have joined so far, including the host.
+@property (readonly, nonatomic) NSUInteger netplayJoinedPlayers;
+
+/// Why netplay stopped, when @c netplayState is @c BXNetplayFailed.
+@property (readonly, nonatomic) NSString *netplayFailureReason;
+
+/// How long the machine has spent waiting on other players' input since lockstep play began.
+/// If this climbs steadily, the frame delay is too short for the connection.
+@property (readonly, nonatomic) NSTimeInterval netplayStallTime;
+
+/// Starts hosting a game for the specified number of players, including this one, on the specified port.
+/// Input is held back for @c frameDelay frames of @c frameLength seconds each: longer delays ride out
+/// slower connections, at the cost of a less responsive game. The CPU is locked at its current speed
+/// and core from here on. Returns @c NO and populates @c outError if the port could not be opened.
+- (BOOL) hostNetplayForPlayers: (NSUInteger)players
+                          port: (NSUInteger)port
+                    frameDelay: (NSUInteger)frameDelay
+                   frameLength: (NSTimeInterval)frameLength
+                         error: (out NSError **)outError;
+
+/// Starts joining the game hosted at the specified address and port. Once the host starts the game,
+/// this machine is replaced with the host's. Returns @c NO and populates @c outError if the host's address
+/// could not be resolved.
+- (BOOL) joinNetplayAtHost: (NSString *)host
+                      port: (NSUInteger)port
+                     error: (out NSError **)outError;
+
+/// Leaves the current game, letting the other players know. Can be called from any thread: this
+/// also stops the emulation thread waiting on other players.
+- (void) stopNetplay;
+
+@end
@@ -0,0 +1,189 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+#import "BXEmulator+BXNetplay.h"
+#import "BXEmulatorPrivate.h"
+
+#import "netplay.h"
+
+
+#pragma mark -
+#pragma mark Constants
+
+const NSUInteger BXNetplayDefaultPort = NETPLAY_DEFAULT_PORT;
+const NSUInteger BXNetplayMaxPlayers = NETPLAY_MAX_PLAYERS;
+
+//How many frames apart the machines compare their states.
+#define BXNetplayHashInterval 30
+
+
+#pragma mark -
+#pragma mark Private methods
+
+@interface BXEmulator (BXNetplayPrivate)
+
+//Records the current state of netplay and notifies observers if it has changed.
+- (void) _syncNetplayState;
+
+//Returns an error for the specified code.
++ (NSError *) _netplayErrorWithCode: (NSInteger)code;
+
+@end
+
+
+@implementation BXEmulator (BXNetplay)
+
+#pragma mark -
+#pragma mark Status
+
+- (BXNetplayState) netplayState
+{
+    return (BXNetplayState)_netplayState;
+}
+
+- (NSUInteger) netplayPlayerIndex
+{
+    return NETPLAY_PlayerIndex();
+}
+
+- (NSUInteger) netplayJoinedPlayers
+{
+    return NETPLAY_JoinedPlayers();
+}
+
+- (NSString *) netplayFailureReason
+{
+    if (_netplayState != BXNetplayFailed)
+        return nil;
+    return [NSString stringWithUTF8String: NETPLAY_FailureReason()];
+}
+
+- (NSTimeInterval) netplayStallTime
+{
+    return NETPLAY_StallTime() / 1000.0;
+}
+
+
+#pragma mark -
+#pragma mark Starting and stopping
+
+- (BOOL) hostNetplayForPlayers: (NSUInteger)players
+                          port: (NSUInteger)port
+                    frameDelay: (NSUInteger)frameDelay
+                   frameLength: (NSTimeInterval)frameLength
+                         error: (out NSError **)outError
+{
+    NSAssert(players >= 2 && players <= BXNetplayMaxPlayers, @"Invalid number of players: %lu", (unsigned long)players);
+
+    //Lock the speed for the duration, since input is applied at fixed emulated instants and the machines
+    //only stay in step if each emulated millisecond runs the same number of instructions on all of them.
+    //Likewise, the adaptive core must not be left to choose the core for itself.
+    NSInteger cycles = self.fixedSpeed;
+    self.fixedSpeed = cycles;
+    BXCoreMode coreMode = self.coreMode;
+    self.coreMode = coreMode;
+
+    NetplaySettings settings;
+    settings.players        = players;
+    settings.frame_ms       = MAX((NSUInteger)1, (NSUInteger)round(frameLength * 1000));
+    settings.delay          = MAX((NSUInteger)1, frameDelay);
+    settings.hash_interval  = BXNetplayHashInterval;
+    settings.cycles         = cycles;
+    settings.core           = coreMode;
+
+    BOOL started = NETPLAY_Host((Bit16u)port, settings, self.class._saveStateBuildIdentifier.UTF8String);
+    [self _syncNetplayState];
+
+    if (!started)
+    {
+        if (outError) *outError = [self.class _netplayErrorWithCode: BXEmulatorNetplayUnavailable];
+        return NO;
+    }
+    return YES;
+}
+
+- (BOOL) joinNetplayAtHost: (NSString *)host
+                      port: (NSUInteger)port
+                     error: (out NSError **)outError
+{
+    BOOL started = NETPLAY_Join(host.UTF8String, (Bit16u)port, self.class._saveStateBuildIdentifier.UTF8String);
+    [self _syncNetplayState];
+
+    if (!started)
+    {
+        if (outError) *outError = [self.class _netplayErrorWithCode: BXEmulatorNetplayUnavailable];
+        return NO;
+    }
+    return YES;
+}
+
+- (void) stopNetplay
+{
+    //Break the emulation thread out of waiting on the other players, in case that's where it is.
+    NETPLAY_Interrupt();
+    [self _performOnEmulationThread: ^{
+        NETPLAY_Stop();
+        [self _syncNetplayState];
+    }];
+}
+
+
+#pragma mark -
+#pragma mark Internal methods
+
+//IMPLEMENTATION NOTE: while playing in lockstep, netplay runs from a DOSBox tick handler rather than
+//from here, since input has to be exchanged at exact emulated instants.
+
+- (void) _updateNetplay
+{
+    if (_netplayState == BXNetplayWaiting && self.canSaveStates && NETPLAY_Poll())
+    {
+        //Every machine must now run exactly as the host's does.
+        const NetplaySettings &settings = NETPLAY_Settings();
+        self.fixedSpeed = settings.cycles;
+        self.coreMode = (BXCoreMode)settings.core;
+
+        //A player's machine has just been replaced by the host's, which its history can't follow.
+        if (NETPLAY_PlayerIndex() != 0)
+            [self _discardRewindHistory];
+    }
+    [self _syncNetplayState];
+}
+
+- (void) _stopNetplayForRestore
+{
+    if (NETPLAY_State() == NETPLAY_RUNNING)
+    {
+        NETPLAY_Stop();
+        [self _syncNetplayState];
+    }
+}
+
+- (void) _syncNetplayState
+{
+    BXNetplayState state = (BXNetplayState)NETPLAY_State();
+    if (state != _netplayState)
+    {
+        [self willChangeValueForKey: @"netplayState"];
+        _netplayState = state;
+        [self didChangeValueForKey: @"netplayState"];
+    }
+}
+
++ (NSError *) _netplayErrorWithCode: (NSInteger)code
+{
+    NSString *description = NSLocalizedString(@"Boxer could not connect to the game.",
+                                              @"Error shown when a network game could not be hosted or joined, because the port was in use or the host's address could not be found.");
+    NSString *suggestion = NSLocalizedString(@"Check the host's address, and that no other application is using the same port.",
+                                             @"Recovery suggestion shown when a network game could not be hosted or joined.");
+    return [NSError errorWithDomain: BXEmulatorErrorDomain
+                               code: code
+                           userInfo: @{ NSLocalizedDescriptionKey: description,
+                                        NSLocalizedRecoverySuggestionErrorKey: suggestion }];
+}
+
+@end
@@ -40,6 +40,15 @@
 
 - (BOOL) handlePastedString: (NSString *)pastedString asCommand: (BOOL)treatAsCommand
 {   
+    //Pasting depends on the state of the emulated machine, so it's done on the emulation thread.
+    if (self.emulationThread && [NSThread currentThread] != self.emulationThread)
+    {
+        [self _performOnEmulationThread: ^{
+            [self handlePastedString: pastedString asCommand: treatAsCommand];
+        }];
+        return YES;
+    }
+    
     //While we're at the DOS prompt, we can paste text directly as commands
     //and be more intelligent about formatting.
 	if (treatAsCommand && self._canPasteToShell)
@@ -66,7 +75,7 @@
                 
                 //TWEAK: no longer paste these into the command queue, because the architecture
                 //for that has changed significantly. Instead, paste the sanitised strings into
-                //the keybuffer.
+                //the keybuffer, which DOS's line input reads from directly.
                 //[self.commandQueue addObject: cleanedString];
                 [self.keyBuffer addKeysForCharacters: cleanedString];
 			}
@@ -75,6 +84,9 @@
     
     //If supported, paste characters via the BIOS key buffer. This is faster and more accurate,
     //but is not supported by programs that read directly from the keyboard.
+    //DOS line input (including COPY CON) takes keys straight from our buffer, while other programs
+    //have the BIOS key buffer topped up from ours each time they poll it: either way, the paste
+    //goes in as fast as the program can read it.
     else if (self._canPasteToBIOS)
     {
         [self.keyBuffer addKeysForCharacters: pastedString];
@@ -0,0 +1,77 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+//The BXPerformanceCounters category extends BXEmulator with timings of how the emulation thread
+//spends its time, broken down by subsystem. While enabled, a new set of timings is published
+//once a second and also emitted as signpost intervals that can be viewed in Instruments.
+//The emulation thread's heap allocations are counted as well: steady-state emulation should make
+//next to none, since each one risks waiting on other threads for the allocator's locks.
+
+#import "BXEmulator.h"
+#import "BXStallWatchdog.h"
+
+
+#pragma mark -
+#pragma mark Constants
+
+/// Keys for the dictionary returned by @c performanceCounters. Each subsystem's value is an NSNumber
+/// wrapping the fraction of the emulation thread's time that was spent in that subsystem, from 0.0 to 1.0.
+/// The subsystems' fractions add up to 1.0.
+
+/// Running guest code in the CPU core.
+extern NSString * const BXPerformanceCPUKey;
+/// Running emulator callbacks on the guest's behalf, such as BIOS and DOS services.
+extern NSString * const BXPerformanceCallbackKey;
+/// Running emulated IO port handlers.
+extern NSString * const BXPerformanceIOKey;
+/// Drawing emulated video lines.
+extern NSString * const BXPerformanceVGAKey;
+/// Scaling drawn lines into the output frame.
+extern NSString * const BXPerformanceRenderKey;
+/// Mixing and synthesizing audio.
+extern NSString * const BXPerformanceMixerKey;
+/// Processing Boxer's events and handing finished frames to Boxer.
+extern NSString * const BXPerformanceCoalfaceKey;
+/// Sleeping to keep emulated time in step with real time.
+extern NSString * const BXPerformanceIdleKey;
+/// Everything else, such as timer and interrupt controller events.
+extern NSString * const BXPerformanceOtherKey;
+
+/// An NSDictionary mapping the name of each mixer channel to an NSNumber wrapping the fraction
+/// of the emulation thread's time spent mixing that channel. This is part of the time given
+/// for @c BXPerformanceMixerKey, and may include time spent in other subsystems on its behalf.
+extern NSString * const BXPerformanceMixerChannelsKey;
+
+/// An NSNumber wrapping the number of seconds of host time the counters cover.
+extern NSString * const BXPerformanceIntervalKey;
+
+/// An NSNumber wrapping the number of heap allocations made on the emulation thread
+/// per second of emulated time. Absent if allocations could not be counted on this system.
+extern NSString * const BXPerformanceAllocationsPerSecondKey;
+
+
+@interface BXEmulator (BXPerformanceCounters)
+
+/// Whether the emulator is currently timing its subsystems. Changes take effect the next time
+/// the emulator processes events, and the first set of timings is available a second later.
+@property (assign, nonatomic, getter=isCountingPerformance) BOOL countingPerformance;
+
+/// The most recently published timings, as a dictionary using the keys listed above;
+/// or @c nil if no timings have been published since the counters were last enabled.
+/// This is KVO-compliant, and changes about once a second while the counters are enabled.
+@property (readonly, nonatomic) NSDictionary *performanceCounters;
+
+/// The most recent times the emulation thread went longer than a few frames without finishing a tick,
+/// oldest first, as dictionaries using the keys listed under @c BXStallDurationKey in BXStallWatchdog.h.
+/// Stalls are watched for whether or not @c countingPerformance is enabled. This is KVO-compliant,
+/// and changes on the main thread whenever a stall ends.
+@property (readonly, nonatomic) NSArray *recentStalls;
+
+/// The number of stalls there have been since the emulator started.
+@property (readonly, nonatomic) NSUInteger stallCount;
+
+@end
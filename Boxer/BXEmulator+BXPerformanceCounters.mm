@@ -0,0 +1,144 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+#import "BXEmulator+BXPerformanceCounters.h"
+#import "BXEmulatorPrivate.h"
+
+#import "perfcounters.h"
+
+
+#pragma mark -
+#pragma mark Constants
+
+NSString * const BXPerformanceCPUKey            = @"cpu";
+NSString * const BXPerformanceCallbackKey       = @"callback";
+NSString * const BXPerformanceIOKey             = @"io";
+NSString * const BXPerformanceVGAKey            = @"vga";
+NSString * const BXPerformanceRenderKey         = @"render";
+NSString * const BXPerformanceMixerKey          = @"mixer";
+NSString * const BXPerformanceCoalfaceKey       = @"coalface";
+NSString * const BXPerformanceIdleKey           = @"idle";
+NSString * const BXPerformanceOtherKey          = @"other";
+NSString * const BXPerformanceMixerChannelsKey  = @"mixerChannels";
+NSString * const BXPerformanceIntervalKey       = @"interval";
+NSString * const BXPerformanceAllocationsPerSecondKey = @"allocationsPerSecond";
+
+
+@implementation BXEmulator (BXPerformanceCounters)
+
+- (BOOL) isCountingPerformance
+{
+    return PERF_IsEnabled();
+}
+
+- (void) setCountingPerformance: (BOOL)counting
+{
+    if (counting == self.isCountingPerformance)
+        return;
+
+    [self willChangeValueForKey: @"performanceCounters"];
+    PERF_SetEnabled(counting);
+    [self didChangeValueForKey: @"performanceCounters"];
+}
+
+- (NSDictionary *) performanceCounters
+{
+    PerfSnapshot snapshot;
+    if (!PERF_GetSnapshot(&snapshot))
+        return nil;
+
+    //Report fractions of the total rather than of the interval, since the two can differ
+    //slightly depending on where in the emulation loop the snapshot was taken.
+    double total = 0;
+    for (NSUInteger i=0; i<PERF_COUNTER_COUNT; i++)
+        total += snapshot.seconds[i];
+
+    if (total <= 0)
+        return nil;
+
+    NSMutableDictionary *channels = [NSMutableDictionary dictionaryWithCapacity: snapshot.channel_count];
+    for (NSUInteger i=0; i<snapshot.channel_count; i++)
+    {
+        NSString *name = [NSString stringWithCString: snapshot.channels[i].name encoding: NSASCIIStringEncoding];
+        if (name)
+            [channels setObject: @(snapshot.channels[i].seconds / total) forKey: name];
+    }
+
+    NSMutableDictionary *counters = [NSMutableDictionary dictionaryWithDictionary: @{
+             BXPerformanceCPUKey:           @(snapshot.seconds[PERF_CPU] / total),
+             BXPerformanceCallbackKey:      @(snapshot.seconds[PERF_CALLBACK] / total),
+             BXPerformanceIOKey:            @(snapshot.seconds[PERF_IO] / total),
+             BXPerformanceVGAKey:           @(snapshot.seconds[PERF_VGA] / total),
+             BXPerformanceRenderKey:        @(snapshot.seconds[PERF_RENDER] / total),
+             BXPerformanceMixerKey:         @(snapshot.seconds[PERF_MIXER] / total),
+             BXPerformanceCoalfaceKey:      @(snapshot.seconds[PERF_COALFACE] / total),
+             BXPerformanceIdleKey:          @(snapshot.seconds[PERF_IDLE] / total),
+             BXPerformanceOtherKey:         @(snapshot.seconds[PERF_OTHER] / total),
+             BXPerformanceMixerChannelsKey: channels,
+             BXPerformanceIntervalKey:      @(snapshot.interval),
+             }];
+
+    if (snapshot.allocations >= 0 && snapshot.emulated_seconds > 0)
+    {
+        [counters setObject: @(snapshot.allocations / snapshot.emulated_seconds)
+                     forKey: BXPerformanceAllocationsPerSecondKey];
+    }
+
+    return counters;
+}
+
+
+#pragma mark - Stalls
+
+- (NSArray *) recentStalls
+{
+    return [[_recentStalls copy] autorelease];
+}
+
+- (NSUInteger) stallCount
+{
+    return _stallCount;
+}
+
+- (void) _startStallWatchdog
+{
+    if (!_stallWatchdog)
+        _stallWatchdog = [[BXStallWatchdog alloc] initWithThreshold: BXEmulatorStallThreshold];
+    
+    //The watchdog is stopped before we are released, so it's safe for it to call back to us unretained.
+    __block BXEmulator *emulator = self;
+    _stallWatchdog.stallHandler = ^(NSDictionary *stall) {
+        [emulator _recordStall: stall];
+    };
+    [_stallWatchdog startWatchingCurrentThread];
+}
+
+- (void) _stopStallWatchdog
+{
+    [_stallWatchdog stopWatching];
+    _stallWatchdog.armed = NO;
+    _stallWatchdog.stallHandler = nil;
+}
+
+- (void) _recordStall: (NSDictionary *)stall
+{
+    [self willChangeValueForKey: @"recentStalls"];
+    [self willChangeValueForKey: @"stallCount"];
+    
+    if (!_recentStalls)
+        _recentStalls = [[NSMutableArray alloc] initWithCapacity: BXEmulatorMaxRecentStalls];
+    
+    [_recentStalls addObject: stall];
+    if (_recentStalls.count > BXEmulatorMaxRecentStalls)
+        [_recentStalls removeObjectAtIndex: 0];
+    _stallCount++;
+    
+    [self didChangeValueForKey: @"stallCount"];
+    [self didChangeValueForKey: @"recentStalls"];
+}
+
+@end
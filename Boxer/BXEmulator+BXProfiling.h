@@ -0,0 +1,72 @@
+/* 
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+//The BXProfiling category extends BXEmulator with a sampling profiler, which records where
+//the guest program spends its time without needing a debugger build of DOSBox.
+
+#import "BXEmulator.h"
+
+
+#pragma mark -
+#pragma mark Constants
+
+/// Keys for the dictionaries returned by @c profilerSamples.
+
+/// An NSNumber wrapping the code segment of the sampled location.
+extern NSString * const BXEmulatorProfilerSegmentKey;
+
+/// An NSNumber wrapping the instruction offset of the sampled location.
+/// Under the dynamic cores this is the start of the running block, not the exact instruction.
+extern NSString * const BXEmulatorProfilerOffsetKey;
+
+/// An NSNumber wrapping the BXCoreMode that was active when the sample was taken,
+/// or -1 if the emulator was using some other core.
+extern NSString * const BXEmulatorProfilerCoreModeKey;
+
+/// One of the BXEmulatorProfilerContext constants listed below.
+extern NSString * const BXEmulatorProfilerContextKey;
+
+/// An NSNumber wrapping how many times this combination was sampled.
+extern NSString * const BXEmulatorProfilerCountKey;
+
+
+/// Values for @c BXEmulatorProfilerContextKey, describing what the emulator was doing
+/// on the guest's behalf when the sample was taken.
+extern NSString * const BXEmulatorProfilerContextGuest;
+extern NSString * const BXEmulatorProfilerContextCallback;
+extern NSString * const BXEmulatorProfilerContextIO;
+extern NSString * const BXEmulatorProfilerContextPageFault;
+
+
+@interface BXEmulator (BXProfiling)
+
+/// Whether the profiler is currently taking samples.
+@property (readonly, getter=isProfiling) BOOL profiling;
+
+/// The number of samples taken since the profile was last reset, including any that
+/// did not fit in the profile's histogram.
+@property (readonly) NSUInteger profilerSampleCount;
+
+/// The samples recorded so far, as an array of dictionaries using the keys listed above,
+/// ordered from most to least frequently sampled.
+@property (readonly) NSArray *profilerSamples;
+
+/// Starts sampling the guest every @c interval seconds, adding to any samples already recorded.
+/// Does nothing if the profiler is already running.
+- (void) startProfilingWithInterval: (NSTimeInterval)interval;
+
+/// Stops sampling. The samples recorded so far are kept until @c resetProfile is called.
+- (void) stopProfiling;
+
+/// Discards all samples recorded so far.
+- (void) resetProfile;
+
+/// Writes the samples recorded so far to the specified location as comma-separated values.
+/// Returns @c NO and populates @c outError if the file could not be written.
+- (BOOL) writeProfileToURL: (NSURL *)URL error: (out NSError **)outError;
+
+@end
@@ -0,0 +1,138 @@
+/* 
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+#import "BXEmulator+BXProfiling.h"
+#import "BXEmulatorPrivate.h"
+
+#import "profiler.h"
+
+
+#pragma mark -
+#pragma mark Constants
+
+//The largest number of distinct locations we will report.
+#define BXProfilerMaxSamples 4096
+
+//The interval to use if we're given a nonsensical one.
+#define BXProfilerDefaultInterval 0.001
+
+NSString * const BXEmulatorProfilerSegmentKey   = @"segment";
+NSString * const BXEmulatorProfilerOffsetKey    = @"offset";
+NSString * const BXEmulatorProfilerCoreModeKey  = @"coreMode";
+NSString * const BXEmulatorProfilerContextKey   = @"context";
+NSString * const BXEmulatorProfilerCountKey     = @"count";
+
+NSString * const BXEmulatorProfilerContextGuest     = @"guest";
+NSString * const BXEmulatorProfilerContextCallback  = @"callback";
+NSString * const BXEmulatorProfilerContextIO        = @"io";
+NSString * const BXEmulatorProfilerContextPageFault = @"pagefault";
+
+
+@implementation BXEmulator (BXProfiling)
+
+- (BOOL) isProfiling
+{
+    return PROFILER_IsRunning();
+}
+
+- (NSUInteger) profilerSampleCount
+{
+    return PROFILER_GetTotalSamples();
+}
+
+- (void) startProfilingWithInterval: (NSTimeInterval)interval
+{
+    if (interval <= 0)
+        interval = BXProfilerDefaultInterval;
+    
+    Bitu intervalInMicroseconds = MAX((Bitu)(interval * 1000000), (Bitu)1);
+    
+    [self willChangeValueForKey: @"profiling"];
+    PROFILER_Start(intervalInMicroseconds);
+    [self didChangeValueForKey: @"profiling"];
+}
+
+- (void) stopProfiling
+{
+    [self willChangeValueForKey: @"profiling"];
+    PROFILER_Stop();
+    [self didChangeValueForKey: @"profiling"];
+}
+
+- (void) resetProfile
+{
+    PROFILER_Reset();
+}
+
++ (NSString *) _profilerContextName: (Bit8u)context
+{
+    switch (context)
+    {
+        case PROFILER_CALLBACK:
+            return BXEmulatorProfilerContextCallback;
+        case PROFILER_IO:
+            return BXEmulatorProfilerContextIO;
+        case PROFILER_PAGEFAULT:
+            return BXEmulatorProfilerContextPageFault;
+        case PROFILER_GUEST:
+        default:
+            return BXEmulatorProfilerContextGuest;
+    }
+}
+
+- (NSArray *) profilerSamples
+{
+    ProfilerSample *samples = (ProfilerSample *)malloc(BXProfilerMaxSamples * sizeof(ProfilerSample));
+    if (!samples) return nil;
+    
+    Bitu numSamples = PROFILER_GetSamples(samples, BXProfilerMaxSamples);
+    NSMutableArray *results = [NSMutableArray arrayWithCapacity: numSamples];
+    
+    for (Bitu i=0; i<numSamples; i++)
+    {
+        ProfilerSample sample = samples[i];
+        
+        //PROFILER_CORE_* values match BXCoreMode for every core we know about.
+        NSInteger coreMode = (sample.core == PROFILER_CORE_OTHER) ? -1 : (NSInteger)sample.core;
+        
+        [results addObject: @{
+         BXEmulatorProfilerSegmentKey:  @(sample.cs),
+         BXEmulatorProfilerOffsetKey:   @(sample.eip),
+         BXEmulatorProfilerCoreModeKey: @(coreMode),
+         BXEmulatorProfilerContextKey:  [self.class _profilerContextName: sample.context],
+         BXEmulatorProfilerCountKey:    @(sample.count),
+         }];
+    }
+    
+    free(samples);
+    return results;
+}
+
+- (BOOL) writeProfileToURL: (NSURL *)URL error: (out NSError **)outError
+{
+    NSArray *samples = self.profilerSamples;
+    NSUInteger totalSamples = self.profilerSampleCount;
+    
+    NSMutableString *CSV = [NSMutableString stringWithString: @"address,core,context,count,percent\n"];
+    for (NSDictionary *sample in samples)
+    {
+        NSUInteger count = [[sample objectForKey: BXEmulatorProfilerCountKey] unsignedIntegerValue];
+        double percent = totalSamples ? (100.0 * count / totalSamples) : 0.0;
+        
+        [CSV appendFormat: @"%04X:%08X,%ld,%@,%lu,%.2f\n",
+         [[sample objectForKey: BXEmulatorProfilerSegmentKey] unsignedIntValue],
+         [[sample objectForKey: BXEmulatorProfilerOffsetKey] unsignedIntValue],
+         (long)[[sample objectForKey: BXEmulatorProfilerCoreModeKey] integerValue],
+         [sample objectForKey: BXEmulatorProfilerContextKey],
+         (unsigned long)count,
+         percent];
+    }
+    
+    return [CSV writeToURL: URL atomically: YES encoding: NSUTF8StringEncoding error: outError];
+}
+
+@end
@@ -0,0 +1,27 @@
+/* 
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+//The BXRecording category extends BXEmulator with functionality for recording
+//the emulator's video and audio output to a movie file.
+
+#import "BXEmulator.h"
+
+@interface BXEmulator (BXRecording)
+
+/// Whether a movie is currently being recorded. This property is KVO-compliant.
+@property (readonly, getter=isRecordingMovie) BOOL recordingMovie;
+
+/// Starts recording the emulator's video and audio output to an H.264 QuickTime movie at the specified location.
+/// Returns @c NO and populates @c outError if recording could not be started (e.g. because movie recording
+/// is not supported on this version of OS X.)
+- (BOOL) startRecordingMovieToURL: (NSURL *)URL error: (out NSError **)outError;
+
+/// Stops recording, calling @c completionHandler on the main thread once the movie file has been finalized.
+/// Does nothing (and does not call the completion handler) if no movie is being recorded.
+- (void) stopRecordingMovieWithCompletionHandler: (void (^)(BOOL succeeded, NSError *error))completionHandler;
+
+@end
@@ -0,0 +1,75 @@
+/* 
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+#import "BXEmulatorPrivate.h"
+#import "BXMovieRecorder.h"
+
+#import "hardware.h"
+
+
+@implementation BXEmulator (BXRecording)
+
+- (BOOL) isRecordingMovie
+{
+    return _movieRecorder != nil;
+}
+
+- (BOOL) startRecordingMovieToURL: (NSURL *)URL error: (out NSError **)outError
+{
+    NSAssert(!self.isRecordingMovie, @"startRecordingMovieToURL:error: called while a movie was already being recorded.");
+    
+    if (![BXMovieRecorder isSupported])
+    {
+        if (outError)
+        {
+            NSString *description = NSLocalizedString(@"Movie recording requires OS X 10.7 or higher.",
+                                                      @"Error shown when the user tries to record a movie on a version of OS X that does not support it.");
+            
+            *outError = [NSError errorWithDomain: BXEmulatorErrorDomain
+                                            code: BXEmulatorMovieRecordingUnsupported
+                                        userInfo: @{ NSLocalizedDescriptionKey: description }];
+        }
+        return NO;
+    }
+    
+    [self willChangeValueForKey: @"recordingMovie"];
+        _movieRecorder = [[BXMovieRecorder alloc] initWithURL: URL fileType: nil];
+    
+        //Tell DOSBox's mixer to start passing its output to us.
+        CaptureState |= CAPTURE_MOVIE;
+    [self didChangeValueForKey: @"recordingMovie"];
+    
+    return YES;
+}
+
+- (void) stopRecordingMovieWithCompletionHandler: (void (^)(BOOL succeeded, NSError *error))completionHandler
+{
+    if (!self.isRecordingMovie)
+        return;
+    
+    [self willChangeValueForKey: @"recordingMovie"];
+        CaptureState &= ~CAPTURE_MOVIE;
+    
+        //The recorder will keep itself alive until it has finished writing.
+        [_movieRecorder finishWithCompletionHandler: completionHandler];
+        [_movieRecorder release], _movieRecorder = nil;
+    [self didChangeValueForKey: @"recordingMovie"];
+}
+
+- (void) _recordFrame: (BXVideoFrame *)frame
+{
+    [_movieRecorder appendVideoFrame: frame];
+}
+
+- (void) _recordAudioSamples: (const int16_t *)samples
+                      frames: (NSUInteger)numFrames
+                  sampleRate: (NSUInteger)sampleRate
+{
+    [_movieRecorder appendAudioSamples: samples frames: numFrames sampleRate: sampleRate];
+}
+
+@end
@@ -0,0 +1,54 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+//The BXRewind category extends BXEmulator with a rolling history of recent machine states,
+//which lets the user wind the emulated machine back by up to a minute or so of play.
+
+//The history is kept in memory and is made up of a full copy of the machine every so often,
+//with only the changes since the previous frame recorded in between. Frames are taken between
+//emulated instructions at a fixed interval, and the oldest frames are dropped to stay within
+//the memory budget.
+
+#import "BXEmulator.h"
+
+/// The defaults for the rewind history's settings.
+#define BXDefaultRewindMemoryBudget 32 * 1024 * 1024
+#define BXDefaultRewindInterval 1.0
+#define BXDefaultRewindKeyframeInterval 15
+
+@interface BXEmulator (BXRewind)
+
+/// Whether the emulator keeps a history of recent machine states to rewind to. The history is
+/// started or stopped the next time the emulator processes events, and is discarded when stopped.
+@property (assign, nonatomic, getter=isRewindEnabled) BOOL rewindEnabled;
+
+/// The most memory in bytes that the history may take up. The newest full copy of the machine
+/// and the frames after it are always kept, however large they are.
+/// Changes take effect the next time the history is enabled.
+@property (assign, nonatomic) NSUInteger rewindMemoryBudget;
+
+/// How many seconds apart to take frames for the history.
+@property (assign, nonatomic) NSTimeInterval rewindInterval;
+
+/// How many frames apart to take full copies of the machine. Fewer full copies take up less memory,
+/// but make rewinding slower. Changes take effect the next time the history is enabled.
+@property (assign, nonatomic) NSUInteger rewindKeyframeInterval;
+
+/// The number of frames currently in the history.
+@property (readonly, nonatomic) NSUInteger rewindFrameCount;
+
+/// Roughly how many seconds back the history currently goes.
+@property (readonly, nonatomic) NSTimeInterval rewindableDuration;
+
+/// Winds the emulated machine back by the specified number of seconds, to the closest frame in the
+/// history that is at least that far back, or to the oldest frame if the history does not go back
+/// that far. Frames after that point are discarded.
+/// Returns @c NO and populates @c outError if the machine could not be rewound, which is subject to
+/// the same conditions as restoring a snapshot: see @c BXSaveStates.
+- (BOOL) rewindBy: (NSTimeInterval)duration error: (out NSError **)outError;
+
+@end
@@ -0,0 +1,208 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+#import "BXEmulator+BXRewind.h"
+#import "BXEmulatorPrivate.h"
+
+#import "rewind.h"
+
+
+#pragma mark -
+#pragma mark Private methods
+
+@interface BXEmulator (BXRewindPrivate)
+
+//Records the current size of the history and notifies observers if it has changed.
+- (void) _syncRewindFrameCount;
+
+//Returns an error for the specified code, with an optional explanation from DOSBox.
++ (NSError *) _rewindErrorWithCode: (NSInteger)code reason: (NSString *)reason;
+
+@end
+
+
+@implementation BXEmulator (BXRewind)
+
+#pragma mark -
+#pragma mark Settings
+
+- (BOOL) isRewindEnabled                        { return _rewindEnabled; }
+- (void) setRewindEnabled: (BOOL)enabled        { _rewindEnabled = enabled; }
+
+- (NSUInteger) rewindMemoryBudget               { return _rewindMemoryBudget; }
+- (void) setRewindMemoryBudget: (NSUInteger)budget { _rewindMemoryBudget = budget; }
+
+- (NSTimeInterval) rewindInterval               { return _rewindInterval; }
+- (void) setRewindInterval: (NSTimeInterval)interval
+{
+    //Don't let frames be taken so often that they slow down emulation.
+    _rewindInterval = MAX(interval, 0.1);
+}
+
+- (NSUInteger) rewindKeyframeInterval           { return _rewindKeyframeInterval; }
+- (void) setRewindKeyframeInterval: (NSUInteger)interval
+{
+    _rewindKeyframeInterval = MAX(interval, (NSUInteger)1);
+}
+
+
+#pragma mark -
+#pragma mark History
+
+- (NSUInteger) rewindFrameCount
+{
+    return _rewindFrameCount;
+}
+
+- (NSTimeInterval) rewindableDuration
+{
+    return _rewindFrameCount * _rewindInterval;
+}
+
++ (NSSet *) keyPathsForValuesAffectingRewindableDuration
+{
+    return [NSSet setWithObjects: @"rewindFrameCount", @"rewindInterval", nil];
+}
+
+- (BOOL) rewindBy: (NSTimeInterval)duration error: (out NSError **)outError
+{
+    if (!self.canSaveStates || !_rewindFrameCount)
+    {
+        if (outError) *outError = [self.class _rewindErrorWithCode: BXEmulatorStateUnavailable reason: nil];
+        return NO;
+    }
+
+    //The newest frame is up to one interval old already, so count back from there.
+    NSTimeInterval sinceLastFrame = [NSDate timeIntervalSinceReferenceDate] - _lastRewindCaptureTime;
+    NSInteger age = (NSInteger)ceil((duration - sinceLastFrame) / _rewindInterval);
+    age = MAX(0, MIN(age, (NSInteger)_rewindFrameCount - 1));
+
+    [self _stopNetplayForRestore];
+
+    std::string reason;
+    SaveStateResult restored = REWIND_Restore((Bitu)age, reason);
+
+    [self _syncRewindFrameCount];
+    _lastRewindCaptureTime = [NSDate timeIntervalSinceReferenceDate];
+
+    switch (restored)
+    {
+        case SAVESTATE_OK:
+            return YES;
+
+        case SAVESTATE_INCOMPATIBLE:
+            if (outError) *outError = [self.class _rewindErrorWithCode: BXEmulatorStateIncompatible
+                                                                reason: [NSString stringWithUTF8String: reason.c_str()]];
+            return NO;
+
+        case SAVESTATE_DAMAGED:
+        default:
+            //The machine is now half-restored: there's no going back from here.
+            if (outError) *outError = [self.class _rewindErrorWithCode: BXEmulatorStateDamaged
+                                                                reason: [NSString stringWithUTF8String: reason.c_str()]];
+            [self _discardRewindHistory];
+            [self cancel];
+            return NO;
+    }
+}
+
+
+#pragma mark -
+#pragma mark Internal methods
+
+- (void) _updateRewindHistory
+{
+    if (_rewindEnabled != REWIND_IsActive())
+    {
+        if (_rewindEnabled)
+        {
+            //This will keep failing until DOSBox has allocated the machine's memory.
+            if (REWIND_Start(_rewindMemoryBudget, _rewindKeyframeInterval))
+                _lastRewindCaptureTime = 0;
+        }
+        else
+        {
+            REWIND_Stop();
+            [self _syncRewindFrameCount];
+        }
+    }
+
+    if (REWIND_IsActive() && !self.isPaused && self.canSaveStates)
+    {
+        NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+        if (now - _lastRewindCaptureTime >= _rewindInterval)
+        {
+            REWIND_Capture();
+            _lastRewindCaptureTime = now;
+            [self _syncRewindFrameCount];
+        }
+    }
+}
+
+- (void) _discardRewindHistory
+{
+    REWIND_Clear();
+    [self _syncRewindFrameCount];
+}
+
+- (void) _shrinkRewindHistory
+{
+    REWIND_Shrink(0);
+    [self _syncRewindFrameCount];
+}
+
+- (void) _syncRewindFrameCount
+{
+    NSUInteger frameCount = REWIND_FrameCount();
+    if (frameCount != _rewindFrameCount)
+    {
+        [self willChangeValueForKey: @"rewindFrameCount"];
+        _rewindFrameCount = frameCount;
+        [self didChangeValueForKey: @"rewindFrameCount"];
+    }
+}
+
++ (NSError *) _rewindErrorWithCode: (NSInteger)code reason: (NSString *)reason
+{
+    NSString *description, *suggestion;
+    switch (code)
+    {
+        case BXEmulatorStateIncompatible:
+            description = NSLocalizedString(@"The game could not be rewound that far.",
+                                            @"Error shown when the rewind history could not be restored because the game has moved on too far since.");
+            suggestion  = NSLocalizedString(@"Try rewinding by a shorter amount.",
+                                            @"Recovery suggestion shown when the rewind history could not be restored because the game has moved on too far since.");
+            break;
+
+        case BXEmulatorStateDamaged:
+            description = NSLocalizedString(@"The game could not be rewound.",
+                                            @"Error shown when the rewind history was found to be damaged while it was being restored.");
+            suggestion  = NSLocalizedString(@"The game will need to be restarted.",
+                                            @"Recovery suggestion shown when the rewind history was found to be damaged while it was being restored.");
+            break;
+
+        case BXEmulatorStateUnavailable:
+        default:
+            description = NSLocalizedString(@"The game cannot be rewound right now.",
+                                            @"Error shown when the user tries to rewind while the emulator is not running or there is no rewind history yet.");
+            suggestion  = NSLocalizedString(@"Try again once the game has been running for a few seconds.",
+                                            @"Recovery suggestion shown when the user tries to rewind while the emulator is not running or there is no rewind history yet.");
+            break;
+    }
+
+    NSMutableDictionary *userInfo = [NSMutableDictionary dictionaryWithObjectsAndKeys:
+                                     description, NSLocalizedDescriptionKey,
+                                     suggestion, NSLocalizedRecoverySuggestionErrorKey,
+                                     nil];
+
+    if (reason.length)
+        [userInfo setObject: reason forKey: NSLocalizedFailureReasonErrorKey];
+
+    return [NSError errorWithDomain: BXEmulatorErrorDomain code: code userInfo: userInfo];
+}
+
+@end
@@ -0,0 +1,56 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+//The BXSaveStates category extends BXEmulator with the ability to snapshot the entire emulated
+//machine to a file, and to later restore the machine to exactly that point.
+
+//Snapshots are tied to the build of Boxer that made them and to the session's configuration:
+//a snapshot made by another build, or with a different machine type, memory size or set of
+//emulated devices, will be rejected without affecting the running machine.
+
+#import "BXEmulator.h"
+
+@interface BXEmulator (BXSaveStates)
+
+/// Whether the emulator is at a point where it can currently save or restore a snapshot.
+/// This is only the case while the emulator is processing events between emulated instructions,
+/// which is when UI actions are dispatched.
+@property (readonly, nonatomic) BOOL canSaveStates;
+
+/// Snapshots the emulated machine and writes it to the specified location.
+/// The emulator is paused only for as long as it takes to copy the machine's state: compressing
+/// and writing the snapshot happens on a background queue, after which @c completionHandler is
+/// called on the main thread. Returns @c NO and populates @c outError if the snapshot could not
+/// be taken, in which case the completion handler will not be called.
+- (BOOL) saveStateToURL: (NSURL *)URL
+                  error: (out NSError **)outError
+      completionHandler: (void (^)(BOOL succeeded, NSError *error))completionHandler;
+
+/// Restores the emulated machine from the snapshot at the specified location.
+/// Returns @c NO and populates @c outError if the snapshot could not be read or was incompatible,
+/// in which case the machine is left as it was. If the snapshot turns out to be damaged partway
+/// through restoring, the machine is no longer in a usable state and emulation will be cancelled.
+- (BOOL) restoreStateFromURL: (NSURL *)URL error: (out NSError **)outError;
+
+
+#pragma mark - Startup snapshots
+
+/// Snapshots the emulated machine as it stands once its startup commands have run, so that a later
+/// launch with the same configuration can resume from here with @c restoreStartupStateFromURL:error:.
+/// This must be called from the delegate's @c runLaunchCommandsForEmulator: and otherwise behaves
+/// the same as @c saveStateToURL:error:completionHandler:.
+- (BOOL) saveStartupStateToURL: (NSURL *)URL
+                         error: (out NSError **)outError
+             completionHandler: (void (^)(BOOL succeeded, NSError *error))completionHandler;
+
+/// Restores a snapshot made by @c saveStartupStateToURL:error:completionHandler: and skips ahead
+/// past whichever startup commands had been run when it was made, including the launch command.
+/// This must be called from the delegate's @c runPreflightCommandsForEmulator:, after mounting
+/// the same drives as were mounted when the snapshot was made. Drives are not part of snapshots.
+- (BOOL) restoreStartupStateFromURL: (NSURL *)URL error: (out NSError **)outError;
+
+@end
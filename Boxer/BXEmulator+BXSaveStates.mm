@@ -0,0 +1,422 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+#import "BXEmulator+BXSaveStates.h"
+#import "BXEmulatorPrivate.h"
+
+#import <mach-o/dyld.h>
+#import <mach-o/loader.h>
+#import <zlib.h>
+#import "savestate.h"
+#import "mem.h"
+#import "shell.h"
+#import "dos_inc.h"
+
+
+#pragma mark -
+#pragma mark Constants
+
+//Snapshot files are a small header followed by the DOSBox snapshot compressed with zlib.
+#define BXSaveStateFileMagic 0x42585353 //'BXSS'
+#define BXSaveStateFileVersion 2
+
+//Marks a snapshot as an ordinary one, rather than one made at the end of startup.
+#define BXSaveStateNoResumeLocation UINT32_MAX
+
+typedef struct BXSaveStateFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t uncompressedLength;
+    uint32_t resumeLocation;    //Where the startup commands had got to, for startup snapshots.
+    uint32_t reserved;
+} BXSaveStateFileHeader;
+
+//How much to allow for the machine state besides main memory when sizing the snapshot buffer.
+#define BXSaveStateBufferPadding 4 * 1024 * 1024
+
+
+#pragma mark -
+#pragma mark Stream buffers
+
+//Lets DOSBox write its snapshot straight into an NSMutableData.
+class BXMutableDataStreambuf : public std::streambuf {
+public:
+    BXMutableDataStreambuf(NSMutableData *data) : _data(data) {}
+protected:
+    std::streamsize xsputn(const char *bytes, std::streamsize length)
+    {
+        [_data appendBytes: bytes length: (NSUInteger)length];
+        return length;
+    }
+    int_type overflow(int_type c)
+    {
+        if (!traits_type::eq_int_type(c, traits_type::eof()))
+        {
+            char byte = traits_type::to_char_type(c);
+            [_data appendBytes: &byte length: 1];
+        }
+        return traits_type::not_eof(c);
+    }
+private:
+    NSMutableData *_data;
+};
+
+//Lets DOSBox read its snapshot straight out of an NSData, which must outlive the buffer.
+class BXDataStreambuf : public std::streambuf {
+public:
+    BXDataStreambuf(NSData *data)
+    {
+        char *bytes = (char *)data.bytes;
+        setg(bytes, bytes, bytes + data.length);
+    }
+};
+
+
+#pragma mark -
+#pragma mark Private methods
+
+@interface BXEmulator (BXSaveStatesInternals)
+
+//Snapshots the machine and writes it to the specified location, recording the specified
+//startup command location along with it.
+- (BOOL) _saveStateToURL: (NSURL *)URL
+          resumeLocation: (uint32_t)resumeLocation
+                   error: (out NSError **)outError
+       completionHandler: (void (^)(BOOL succeeded, NSError *error))completionHandler;
+
+//Restores the machine from the specified location, returning the startup command location
+//that was recorded with it in outResumeLocation.
+- (BOOL) _restoreStateFromURL: (NSURL *)URL
+               resumeLocation: (uint32_t *)outResumeLocation
+                        error: (out NSError **)outError;
+
+//The batch file currently running Boxer's startup commands, or NULL if there is none.
+- (BatchFile *) _startupBatchFile;
+
+//Returns an error for the specified code, with an optional explanation from DOSBox.
++ (NSError *) _saveStateErrorWithCode: (NSInteger)code reason: (NSString *)reason;
+
+@end
+
+
+@implementation BXEmulator (BXSaveStates)
+
+- (BOOL) canSaveStates
+{
+    return self.isExecuting && (_processingEvents || _processingStartupCommand) && [NSThread currentThread] == self.emulationThread;
+}
+
+- (BOOL) saveStateToURL: (NSURL *)URL
+                  error: (out NSError **)outError
+      completionHandler: (void (^)(BOOL succeeded, NSError *error))completionHandler
+{
+    return [self _saveStateToURL: URL
+                  resumeLocation: BXSaveStateNoResumeLocation
+                           error: outError
+               completionHandler: completionHandler];
+}
+
+- (BOOL) restoreStateFromURL: (NSURL *)URL error: (out NSError **)outError
+{
+    uint32_t resumeLocation;
+    return [self _restoreStateFromURL: URL resumeLocation: &resumeLocation error: outError];
+}
+
+- (BOOL) saveStartupStateToURL: (NSURL *)URL
+                         error: (out NSError **)outError
+             completionHandler: (void (^)(BOOL succeeded, NSError *error))completionHandler
+{
+    BatchFile *batchFile = self._startupBatchFile;
+    if (!_processingStartupCommand || !batchFile)
+    {
+        if (outError) *outError = [self.class _saveStateErrorWithCode: BXEmulatorStateUnavailable reason: nil];
+        return NO;
+    }
+
+    return [self _saveStateToURL: URL
+                  resumeLocation: batchFile->location
+                           error: outError
+               completionHandler: completionHandler];
+}
+
+- (BOOL) restoreStartupStateFromURL: (NSURL *)URL error: (out NSError **)outError
+{
+    BatchFile *batchFile = self._startupBatchFile;
+    if (!_processingStartupCommand || !batchFile)
+    {
+        if (outError) *outError = [self.class _saveStateErrorWithCode: BXEmulatorStateUnavailable reason: nil];
+        return NO;
+    }
+
+    //Don't pick up an ordinary snapshot by mistake: it won't say where to resume from.
+    uint32_t resumeLocation = BXSaveStateNoResumeLocation;
+    BOOL restored = [self _restoreStateFromURL: URL resumeLocation: &resumeLocation error: outError];
+    if (restored)
+    {
+        if (resumeLocation != BXSaveStateNoResumeLocation)
+        {
+            //Carry on from after the command at which the snapshot was made,
+            //skipping the startup commands it has already accounted for.
+            batchFile->location = resumeLocation;
+
+            //The snapshot's clock is as old as the snapshot itself.
+            DOS_SyncDateTimeWithHost();
+        }
+        else
+        {
+            //The machine state has already been replaced, so we can't just carry on.
+            if (outError) *outError = [self.class _saveStateErrorWithCode: BXEmulatorStateDamaged reason: nil];
+            [self cancel];
+            return NO;
+        }
+    }
+    return restored;
+}
+
+@end
+
+
+@implementation BXEmulator (BXSaveStatesInternals)
+
+- (BatchFile *) _startupBatchFile
+{
+    DOS_Shell *shell = self._currentShell;
+    return (shell) ? shell->bf : NULL;
+}
+
+- (BOOL) _saveStateToURL: (NSURL *)URL
+          resumeLocation: (uint32_t)resumeLocation
+                   error: (out NSError **)outError
+       completionHandler: (void (^)(BOOL succeeded, NSError *error))completionHandler
+{
+    if (!self.canSaveStates)
+    {
+        if (outError) *outError = [self.class _saveStateErrorWithCode: BXEmulatorStateUnavailable reason: nil];
+        return NO;
+    }
+
+    //Copy the machine's state while the emulator is paused: this is the only part the user waits for.
+    NSUInteger capacity = MEM_TotalPages() * MEM_PAGESIZE + BXSaveStateBufferPadding;
+    NSMutableData *state = [[NSMutableData alloc] initWithCapacity: capacity];
+    BOOL saved;
+    {
+        BXMutableDataStreambuf buffer(state);
+        std::ostream stream(&buffer);
+        saved = SAVESTATE_Save(stream, self.class._saveStateBuildIdentifier.UTF8String);
+    }
+
+    if (!saved)
+    {
+        [state release];
+        if (outError) *outError = [self.class _saveStateErrorWithCode: BXEmulatorStateUnavailable reason: nil];
+        return NO;
+    }
+
+    void (^handler)(BOOL, NSError *) = [completionHandler copy];
+    URL = [URL copy];
+
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        NSError *writeError = nil;
+        BOOL succeeded = NO;
+
+        BXSaveStateFileHeader header;
+        header.magic = CFSwapInt32HostToBig(BXSaveStateFileMagic);
+        header.version = CFSwapInt32HostToBig(BXSaveStateFileVersion);
+        header.uncompressedLength = CFSwapInt64HostToBig(state.length);
+        header.resumeLocation = CFSwapInt32HostToBig(resumeLocation);
+        header.reserved = 0;
+
+        //Favour speed over size: snapshots are mostly memory that compresses well regardless.
+        uLongf compressedLength = compressBound(state.length);
+        NSMutableData *file = [[NSMutableData alloc] initWithLength: sizeof(header) + compressedLength];
+        memcpy(file.mutableBytes, &header, sizeof(header));
+
+        int result = compress2((Bytef *)file.mutableBytes + sizeof(header), &compressedLength,
+                               (const Bytef *)state.bytes, state.length,
+                               Z_BEST_SPEED);
+
+        if (result == Z_OK)
+        {
+            file.length = sizeof(header) + compressedLength;
+            succeeded = [file writeToURL: URL options: NSDataWritingAtomic error: &writeError];
+        }
+        else
+        {
+            writeError = [NSError errorWithDomain: NSCocoaErrorDomain
+                                             code: NSFileWriteUnknownError
+                                         userInfo: @{ NSURLErrorKey: URL }];
+        }
+
+        [file release];
+        [state release];
+
+        //Retain the error past the end of the autorelease pool this block may be drained in.
+        [writeError retain];
+        dispatch_async(dispatch_get_main_queue(), ^{
+            if (handler) handler(succeeded, writeError);
+            [writeError release];
+            [handler release];
+            [URL release];
+        });
+    });
+
+    return YES;
+}
+
+- (BOOL) _restoreStateFromURL: (NSURL *)URL
+               resumeLocation: (uint32_t *)outResumeLocation
+                        error: (out NSError **)outError
+{
+    if (!self.canSaveStates)
+    {
+        if (outError) *outError = [self.class _saveStateErrorWithCode: BXEmulatorStateUnavailable reason: nil];
+        return NO;
+    }
+
+    [self _stopNetplayForRestore];
+
+    NSData *file = [NSData dataWithContentsOfURL: URL options: NSDataReadingMappedIfSafe error: outError];
+    if (!file)
+        return NO;
+
+    BXSaveStateFileHeader header;
+    BOOL validHeader = (file.length > sizeof(header));
+    if (validHeader)
+    {
+        memcpy(&header, file.bytes, sizeof(header));
+        validHeader = CFSwapInt32BigToHost(header.magic) == BXSaveStateFileMagic &&
+                        CFSwapInt32BigToHost(header.version) == BXSaveStateFileVersion;
+    }
+
+    //Don't trust the recorded length with more than the machine could plausibly need.
+    uLongf stateLength = validHeader ? (uLongf)CFSwapInt64BigToHost(header.uncompressedLength) : 0;
+    NSUInteger maxLength = MEM_TotalPages() * MEM_PAGESIZE * 2 + BXSaveStateBufferPadding;
+    if (!validHeader || stateLength > maxLength)
+    {
+        if (outError) *outError = [self.class _saveStateErrorWithCode: BXEmulatorStateIncompatible reason: nil];
+        return NO;
+    }
+
+    NSMutableData *state = [NSMutableData dataWithLength: stateLength];
+    int result = uncompress((Bytef *)state.mutableBytes, &stateLength,
+                            (const Bytef *)file.bytes + sizeof(header), file.length - sizeof(header));
+
+    if (result != Z_OK || stateLength != state.length)
+    {
+        if (outError) *outError = [self.class _saveStateErrorWithCode: BXEmulatorStateIncompatible reason: nil];
+        return NO;
+    }
+
+    std::string reason;
+    SaveStateResult loaded;
+    {
+        BXDataStreambuf buffer(state);
+        std::istream stream(&buffer);
+        loaded = SAVESTATE_Load(stream, self.class._saveStateBuildIdentifier.UTF8String, reason);
+    }
+
+    switch (loaded)
+    {
+        case SAVESTATE_OK:
+            //The rewind history leads up to the machine we just replaced, not the one we restored.
+            [self _discardRewindHistory];
+            *outResumeLocation = CFSwapInt32BigToHost(header.resumeLocation);
+            return YES;
+
+        case SAVESTATE_INCOMPATIBLE:
+            if (outError) *outError = [self.class _saveStateErrorWithCode: BXEmulatorStateIncompatible
+                                                                   reason: [NSString stringWithUTF8String: reason.c_str()]];
+            return NO;
+
+        case SAVESTATE_DAMAGED:
+        default:
+            //The machine is now half-restored: there's no going back from here.
+            if (outError) *outError = [self.class _saveStateErrorWithCode: BXEmulatorStateDamaged
+                                                                   reason: [NSString stringWithUTF8String: reason.c_str()]];
+            [self cancel];
+            return NO;
+    }
+}
+
++ (NSString *) _saveStateBuildIdentifier
+{
+    static NSString *identifier = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        //Use the UUID the linker stamps into the executable, which changes with every build.
+        const struct mach_header_64 *header = (const struct mach_header_64 *)_dyld_get_image_header(0);
+        if (header && header->magic == MH_MAGIC_64)
+        {
+            const uint8_t *command = (const uint8_t *)(header + 1);
+            for (uint32_t i=0; i < header->ncmds; i++)
+            {
+                const struct load_command *loadCommand = (const struct load_command *)command;
+                if (loadCommand->cmd == LC_UUID)
+                {
+                    const uint8_t *uuid = ((const struct uuid_command *)loadCommand)->uuid;
+                    NSMutableString *hex = [NSMutableString stringWithCapacity: 32];
+                    for (NSUInteger j=0; j < 16; j++)
+                        [hex appendFormat: @"%02x", uuid[j]];
+                    identifier = [hex copy];
+                    break;
+                }
+                command += loadCommand->cmdsize;
+            }
+        }
+
+        //Fall back on the version number if the executable has no UUID.
+        if (!identifier)
+        {
+            NSDictionary *info = [NSBundle mainBundle].infoDictionary;
+            identifier = [[NSString alloc] initWithFormat: @"%@ (%@)",
+                          [info objectForKey: @"CFBundleShortVersionString"],
+                          [info objectForKey: (NSString *)kCFBundleVersionKey]];
+        }
+    });
+    return identifier;
+}
+
++ (NSError *) _saveStateErrorWithCode: (NSInteger)code reason: (NSString *)reason
+{
+    NSString *description, *suggestion;
+    switch (code)
+    {
+        case BXEmulatorStateIncompatible:
+            description = NSLocalizedString(@"The saved state could not be restored.",
+                                            @"Error shown when a saved state was made by a different version of Boxer or with different settings.");
+            suggestion  = NSLocalizedString(@"Saved states can only be restored by the version of Boxer that made them, with the same game settings.",
+                                            @"Recovery suggestion shown when a saved state was made by a different version of Boxer or with different settings.");
+            break;
+
+        case BXEmulatorStateDamaged:
+            description = NSLocalizedString(@"The saved state is damaged and could not be restored.",
+                                            @"Error shown when a saved state was found to be damaged while it was being restored.");
+            suggestion  = NSLocalizedString(@"The game will need to be restarted.",
+                                            @"Recovery suggestion shown when a saved state was found to be damaged while it was being restored.");
+            break;
+
+        case BXEmulatorStateUnavailable:
+        default:
+            description = NSLocalizedString(@"The game’s state cannot be saved or restored right now.",
+                                            @"Error shown when the user tries to save or restore a state while the emulator is not running.");
+            suggestion  = NSLocalizedString(@"Try again once the game is running.",
+                                            @"Recovery suggestion shown when the user tries to save or restore a state while the emulator is not running.");
+            break;
+    }
+
+    NSMutableDictionary *userInfo = [NSMutableDictionary dictionaryWithObjectsAndKeys:
+                                     description, NSLocalizedDescriptionKey,
+                                     suggestion, NSLocalizedRecoverySuggestionErrorKey,
+                                     nil];
+
+    if (reason.length)
+        [userInfo setObject: reason forKey: NSLocalizedFailureReasonErrorKey];
+
+    return [NSError errorWithDomain: BXEmulatorErrorDomain code: code userInfo: userInfo];
+}
+
+@end
@@ -55,6 +55,65 @@ nil];
  */
 
 
+//The name given to the in-memory batch file that runs a series of queued commands.
+static const char * const BXCommandBatchName = "BOXER";
+
+//Returns the in-memory batch file that is running queued commands in the specified shell,
+//or NULL if there is none. This may not be the topmost batch file, if it has launched another.
+static BatchFile *_commandBatchForShell(DOS_Shell *shell)
+{
+    for (BatchFile *batch = shell->bf; batch != NULL; batch = batch->prev)
+    {
+        if (batch->in_memory)
+            return batch;
+    }
+    return NULL;
+}
+
+//Encodes the specified commands as batch file lines that the shell will run exactly as if they had
+//been entered at the commandline, without echoing them. Returns false if any of the commands cannot
+//be represented as a single batch file line, in which case they should be run one at a time instead.
+static bool _compileCommandsIntoBatchLines(NSArray *commands, std::string &lines)
+{
+    NSCharacterSet *whitespace = [NSCharacterSet whitespaceAndNewlineCharacterSet];
+    for (NSString *command in commands)
+    {
+        command = [command stringByTrimmingCharactersInSet: whitespace];
+        if (!command.length)
+            continue;
+        
+        const char *encodedCommand = [command cStringUsingEncoding: BXDirectStringEncoding];
+        if (!encodedCommand)
+            return false;
+        
+        std::string line;
+        if (encodedCommand[0] != '@')
+            line += '@';
+        
+        for (const char *c = encodedCommand; *c; c++)
+        {
+            //Line breaks would split the command in two, and the batch file reader
+            //would strip out most other control characters.
+            unsigned char chr = *c;
+            if (chr < 32 && chr != '\t' && chr != 0x1b && chr != 8)
+                return false;
+            
+            //Percent signs must be doubled to survive the reader's variable expansion.
+            if (chr == '%')
+                line += '%';
+            line += chr;
+        }
+        
+        if (line.length() >= CMD_MAXLINE)
+            return false;
+        
+        lines += line;
+        lines += "\r\n";
+    }
+    return true;
+}
+
+
 @implementation BXEmulator (BXShell)
 
 #pragma mark -
@@ -63,19 +122,22 @@ nil];
 - (void) executeCommand: (NSString *)command
 			   encoding: (NSStringEncoding)encoding
 {
-    if (self.isExecuting)
-    {
-		if (self._canExecuteCommandsDirectly)
-		{
-            [self _parseCommand: command encoding: encoding];
-		}
-        //Otherwise, add the line to the end of the queue and we'll process it 
-        //when we're next at the commandline.
-		else
-		{
-			[self.commandQueue addObject: [command stringByAppendingString: @"\n"]];
-		}
-    }
+    //Commands can only be run on the emulation thread.
+    [self _performOnEmulationThread: ^{
+        if (self.isExecuting)
+        {
+            if (self._canExecuteCommandsDirectly)
+            {
+                [self _parseCommand: command encoding: encoding];
+            }
+            //Otherwise, add the line to the end of the queue and we'll process it
+            //when we're next at the commandline.
+            else
+            {
+                [self.commandQueue addObject: [command stringByAppendingString: @"\n"]];
+            }
+        }
+    }];
 }
 
 - (void) executeCommand: (NSString *)command
@@ -267,12 +329,18 @@ nil];
 
 - (void) runPreflightCommands: (NSString *)argumentString
 {
+    _processingStartupCommand = YES;
+    BXStallCallScope stallCall("-runPreflightCommandsForEmulator:");
 	[self.delegate runPreflightCommandsForEmulator: self];
+    _processingStartupCommand = NO;
 }
 
 - (void) runLaunchCommands: (NSString *)argumentString
 {
+    _processingStartupCommand = YES;
+    BXStallCallScope stallCall("-runLaunchCommandsForEmulator:");
 	[self.delegate runLaunchCommandsForEmulator: self];
+    _processingStartupCommand = NO;
 }
 
 - (void) listDrives: (NSString *)argumentString
@@ -409,6 +477,35 @@ nil];
     NSMutableArray *queue = self.commandQueue;
     if (queue.count)
     {
+        DOS_Shell *shell = self._currentShell;
+        
+        //If several commands are waiting, compile them all into a batch file held in memory
+        //so that the shell runs them in a single pass, without redrawing the prompt between
+        //each one. Commands queued while that batch is still running are appended to it,
+        //so that they run in the order they were queued.
+        BatchFile *commandBatch = _commandBatchForShell(shell);
+        if (queue.count > 1 || commandBatch != NULL)
+        {
+            std::string lines;
+            if (_compileCommandsIntoBatchLines(queue, lines))
+            {
+                [queue removeAllObjects];
+                
+                if (commandBatch != NULL)
+                {
+                    commandBatch->AppendLines(lines);
+                }
+                else if (lines.length())
+                {
+                    if (self.clearsScreenBeforeCommandExecution)
+                        [self clearScreen];
+                    
+                    shell->bf = new BatchFile(shell, BXCommandBatchName, lines);
+                }
+                return YES;
+            }
+        }
+        
 		NSString *command = [[[queue objectAtIndex: 0] copy] autorelease];
 		[queue removeObjectAtIndex: 0];
         
@@ -416,8 +513,6 @@ nil];
         
         if (command.length)
         {
-            DOS_Shell *shell = self._currentShell;
-            
             BOOL printCommand = shell->echo;
             
             //The printing behaviour below matches DOSBox's handling of batch file lines:
@@ -630,7 +725,10 @@ nil];
 - (BOOL) _shouldDisplayStartupMessagesForShell: (DOS_Shell *)shell
 {
     if ([self.delegate respondsToSelector: @selector(emulatorShouldDisplayStartupMessages:)])
+    {
+        BXStallCallScope stallCall("-emulatorShouldDisplayStartupMessages:");
         return [self.delegate emulatorShouldDisplayStartupMessages: self];
+    }
     else
         return YES;
 }
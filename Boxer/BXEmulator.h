@@ -7,6 +7,7 @@
 
 
 #import <Foundation/Foundation.h>
+#import "BXCacheRegistry.h"
 
 
 #pragma mark - Emulator constants
@@ -36,7 +37,19 @@ typedef NS_ENUM(NSInteger, BXCoreMode) {
 	BXCoreSimple	= 2,
     
     /// The full CPU emulation core ("core=full" in DOSBox parlance.) Not used by Boxer.
-	BXCoreFull		= 3
+	BXCoreFull		= 3,
+    
+    /// The threaded-dispatch build of the normal core ("core=threaded" in DOSBox parlance.)
+	BXCoreThreaded	= 4,
+    
+    /// The normal core with prefetch queue emulation ("core=normal" with "cputype=386_prefetch"
+    /// or "486_prefetch" in DOSBox parlance.) Not used by Boxer except for benchmarking.
+	BXCorePrefetch	= 5,
+    
+    /// Starts on the normal core and moves to the dynamic core and back while running
+    /// ("core=adaptive" in DOSBox parlance.) Only ever passed to @c coreMode:
+    /// while it is in effect, @c coreMode reports whichever core is currently running.
+	BXCoreAdaptive	= 6
 };
 
 
@@ -82,12 +95,95 @@ extern NSStringEncoding BXDisplayStringEncoding;
 extern NSStringEncoding BXDirectStringEncoding;
 
 
+/// Keys for the dictionary returned by @c -dynamicCacheStatistics.
+/// The size in bytes of the dynamic core's translation cache, as an NSNumber.
+extern NSString * const BXEmulatorDynamicCacheSizeKey;
+
+/// The number of times an already-translated block was looked up and entered, as an NSNumber.
+extern NSString * const BXEmulatorDynamicCacheHitsKey;
+
+/// The number of blocks that have been translated, as an NSNumber.
+extern NSString * const BXEmulatorDynamicCacheTranslationsKey;
+
+/// The number of translated blocks that were discarded to make room for new ones, as an NSNumber.
+extern NSString * const BXEmulatorDynamicCacheEvictionsKey;
+
+/// The number of times the cache has filled up and begun reusing its oldest space, as an NSNumber.
+extern NSString * const BXEmulatorDynamicCacheWrapsKey;
+
+/// The number of guest instructions that have been translated, as an NSNumber.
+extern NSString * const BXEmulatorDynamicCacheInstructionsKey;
+
+/// The average number of guest instructions in each translated block, as an NSNumber.
+extern NSString * const BXEmulatorDynamicCacheAverageBlockLengthKey;
+
+/// The number of bytes of host code that have been generated, as an NSNumber.
+extern NSString * const BXEmulatorDynamicCacheBytesEmittedKey;
+
+/// The number of times the whole cache has been discarded, as an NSNumber.
+extern NSString * const BXEmulatorDynamicCacheFlushesKey;
+
+/// The number of translated blocks that were discarded because the game wrote over their code,
+/// as an NSNumber. A count that keeps pace with @c BXEmulatorDynamicCacheTranslationsKey means
+/// the game is rewriting its own code faster than the dynamic core can profit from translating it.
+extern NSString * const BXEmulatorDynamicCacheInvalidationsKey;
+
+/// The number of code pages that have had blocks discarded that way, as an NSNumber.
+extern NSString * const BXEmulatorDynamicCacheInvalidatedPagesKey;
+
+/// The physical page number of the page whose blocks have been discarded the most times,
+/// and how many times that was, as NSNumbers. Absent if no blocks have been discarded that way.
+extern NSString * const BXEmulatorDynamicCacheHottestPageKey;
+extern NSString * const BXEmulatorDynamicCacheHottestPageInvalidationsKey;
+
+/// The number of times a code page has been left to the normal core for a while because its code
+/// kept being rewritten, and the number of instructions the normal core ran in such pages instead
+/// of them being translated, as NSNumbers.
+extern NSString * const BXEmulatorDynamicCacheSMCInterpretedPagesKey;
+extern NSString * const BXEmulatorDynamicCacheSMCInterpretedInstructionsKey;
+
+/// The host seconds the dynamic core has spent translating blocks and running them, as NSNumbers.
+/// These only advance while @c countingPerformance is enabled.
+extern NSString * const BXEmulatorDynamicCacheTranslationSecondsKey;
+extern NSString * const BXEmulatorDynamicCacheExecutionSecondsKey;
+
+
+/// Keys for the dictionary returned by @c -autoSpeedStatistics.
+/// The cycle count the automatic speed controller is currently running at, as an NSNumber.
+extern NSString * const BXEmulatorAutoSpeedTargetKey;
+
+/// The number of cycles actually emulated per millisecond of real time, as an NSNumber.
+/// This falls below the target when the host cannot keep up.
+extern NSString * const BXEmulatorAutoSpeedAchievedKey;
+
+/// The fraction of real time the emulator spent idle, from 0.0 to 1.0, as an NSNumber.
+extern NSString * const BXEmulatorAutoSpeedHostSlackKey;
+
+/// How much of the targeted host usage is being achieved, as an NSNumber: 1.0 means
+/// the controller is on target, higher means there is room to run faster.
+extern NSString * const BXEmulatorAutoSpeedLoadKey;
+
+/// How many times the controller has changed the cycle count, how many of those changes were made
+/// while the mixer had less audio buffered than it was aiming for, and how many of those were
+/// raises, which leave the mixer even less time to catch up. As NSNumbers.
+extern NSString * const BXEmulatorAutoSpeedAdjustmentsKey;
+extern NSString * const BXEmulatorAutoSpeedStarvedAdjustmentsKey;
+extern NSString * const BXEmulatorAutoSpeedStarvedRaisesKey;
+
+
+/// The furthest that @c -emulationRate may stray from 1.0. At 1% the pitch of the sound
+/// shifts by less than a fifth of a semitone, which is too little to hear.
+#define BXEmulatorMaxRateDeviation 0.01
+
+
 @class BXVideoHandler;
 @class BXEmulatedKeyboard;
 @class BXEmulatedMouse;
 @class BXEmulatedPrinter;
 @class BXKeyBuffer;
 @class BXDrive;
+@class BXMovieRecorder;
+@class BXStallWatchdog;
 
 @protocol BXEmulatedJoystick;
 @protocol BXEmulatedPrinterDelegate;
@@ -105,7 +201,9 @@ extern NSStringEncoding BXDirectStringEncoding;
 /// @warning Only one instance of BXEmulator can be created by a single Boxer process, because DOSBox relies
 /// extensive global state that is not cleaned up after exiting. Further BXEmulator instances cannot be created
 /// without restarting the application process.
-@interface BXEmulator : NSObject
+/// While emulating, @c BXEmulator registers itself with @c BXCacheRegistry, so that its rewind
+/// history and spare video frames can be trimmed when memory runs short.
+@interface BXEmulator : NSObject <BXTrimmableCache>
 {
 	__unsafe_unretained id <BXEmulatorDelegate, BXEmulatorFileSystemDelegate, BXEmulatorAudioDelegate, BXEmulatedPrinterDelegate> _delegate;
 	BXVideoHandler *_videoHandler;
@@ -125,10 +223,13 @@ extern NSStringEncoding BXDirectStringEncoding;
     NSDictionary *_lastProcess;
 	
 	BOOL _cancelled;
+    BOOL _exitsProcessWhenCancelled;
+    BOOL _finishedForProcessExit;
 	BOOL _executing;
 	BOOL _initialized;
 	BOOL _paused;
     BOOL _wasAutoSpeed;
+    BOOL _adaptiveCoreAllowsDynamic;
     
     BOOL _waitingForCommandInput;
     BOOL _clearsScreenBeforeCommandExecution;
@@ -139,6 +240,57 @@ extern NSStringEncoding BXDirectStringEncoding;
     
     //The thread on which start was called.
     NSThread *_emulationThread;
+    
+    //Whether we are currently inside _processEvents, between emulated instructions.
+    //Used by BXSaveStates to tell when it is safe to snapshot the machine.
+    BOOL _processingEvents;
+    
+    //Whether we are currently running Boxer's preflight or launch command at the end of startup,
+    //which BXSaveStates also treats as a safe point.
+    BOOL _processingStartupCommand;
+    
+    //Key-value changes and notifications made off the main thread, waiting to be delivered
+    //together on the main thread. Guarded by synchronizing on _pendingChangedKeys.
+    NSMutableOrderedSet *_pendingChangedKeys;
+    NSMutableArray *_pendingNotifications;
+    BOOL _pendingEmulationStateChange;
+    BOOL _pendingChangesScheduled;
+    NSTimeInterval _lastPendingChangesDelivery;
+    
+    //Blocks posted from other threads for the emulation thread to perform, as a lock-free
+    //last-in-first-out list. Managed by _performOnEmulationThread: and _performPendingEvents.
+    void * volatile _pendingEvents;
+    
+    //Input posted for the emulation thread that is being held back to keep the spacing it arrived with,
+    //as a first-in-first-out list. Only touched on the emulation thread. See _performInputOnEmulationThread:.
+    void *_deferredInputEvents;
+    void *_lastDeferredInputEvent;
+    NSTimeInterval _lastInputTimestamp;
+    NSUInteger _lastInputTicks;
+    
+    //The run loop source that wakes the emulation thread while it's paused, when events are posted.
+    CFRunLoopSourceRef _pendingEventsSource;
+    CFRunLoopRef _emulationRunLoop;
+    volatile BOOL _waitingForEvents;
+    NSTimeInterval _lastRunLoopSweepTime;
+    NSTimeInterval _lastDynamicCacheStatisticsTime;
+    NSTimeInterval _lastAudioBufferStatisticsTime;
+    
+    //Managed by BXPerformanceCounters.
+    BXStallWatchdog *_stallWatchdog;
+    NSMutableArray *_recentStalls;
+    NSUInteger _stallCount;
+    
+    //Managed by BXRewind.
+    BOOL _rewindEnabled;
+    NSUInteger _rewindMemoryBudget;
+    NSTimeInterval _rewindInterval;
+    NSUInteger _rewindKeyframeInterval;
+    NSUInteger _rewindFrameCount;
+    NSTimeInterval _lastRewindCaptureTime;
+    
+    //Managed by BXNetplay.
+    NSInteger _netplayState;
 	
 	//The queue of commands we are waiting to execute at the DOS prompt.
     //Managed by BXShell.
@@ -155,6 +307,12 @@ extern NSStringEncoding BXDirectStringEncoding;
     
     //Used by BXDOSFilesystem to track drives while they're being mounted.
     BXDrive *_driveBeingMounted;
+    
+    //Managed by BXRecording.
+    BXMovieRecorder *_movieRecorder;
+    
+    //Managed by BXInputReplay.
+    NSURL *_inputRecordingURL;
 }
 
 
@@ -250,12 +408,50 @@ extern NSStringEncoding BXDirectStringEncoding;
 /// Whether we are running at automatic maximum speed.
 @property (assign, getter=isAutoSpeed) BOOL autoSpeed;
 
+/// The highest speed, in cycles, that automatic speed may reach: 0 if there is no limit.
+/// This is normally set by a "cycles=max limit" conf setting, and is reset when that setting changes.
+@property (assign) NSInteger autoSpeedLimit;
+
 /// Whether we are running in turbo mode (emulating as fast as possible.)
 @property (assign, getter=isTurboSpeed) BOOL turboSpeed;
 
+/// How fast emulated time runs compared to real time: normally 1.0. Rendering views nudge this
+/// within @c BXEmulatorMaxRateDeviation to lock the emulated display's refresh to the host display's.
+/// Sound is resampled to match, so it stays in step without gaps or dropped samples.
+@property (assign) double emulationRate;
+
 /// The current CPU core mode.
 @property (assign) BXCoreMode coreMode;
 
+/// Whether the adaptive core is choosing the core by itself. Setting @c coreMode to anything
+/// other than @c BXCoreAdaptive turns this off.
+@property (readonly, getter=isAdaptiveCoreActive) BOOL adaptiveCoreActive;
+
+/// Whether the adaptive core may move to the dynamic core. Set to @c NO for games that are
+/// already known to rewrite their own code too often for the dynamic core. Defaults to @c YES.
+@property (assign) BOOL adaptiveCoreAllowsDynamic;
+
+/// Counters describing how well the dynamic core's translation cache is coping, using the keys
+/// listed under @c BXEmulatorDynamicCacheSizeKey. The cache size is set by the "dynamic_cache"
+/// conf setting. Returns @c nil if the emulator is not running or the dynamic core is unavailable.
+/// This is KVO-compliant, and changes about once a second while the dynamic core is in use.
+@property (readonly) NSDictionary *dynamicCacheStatistics;
+
+/// Whether the dynamic core may use instruction set extensions of the host CPU, such as BMI2, in the
+/// code it generates. Changing this discards the code translated so far, so it should only be changed
+/// on the emulation thread. This is normally set by the "dynamic_hostfeatures" conf setting, and is
+/// there so that the code that runs on any host can be compared against.
+@property (assign) BOOL dynamicCoreUsesHostFeatures;
+
+/// The lowercase names of the host CPU's instruction set extensions that the dynamic core is using.
+/// Empty if the host has none that it can use, or if @c dynamicCoreUsesHostFeatures is turned off.
+@property (readonly) NSArray *dynamicCoreHostFeatures;
+
+/// The state of the controller that adjusts the CPU speed while @c autoSpeed is enabled,
+/// using the keys listed under @c BXEmulatorAutoSpeedTargetKey. The values are only updated
+/// while running at automatic speed. Returns @c nil if the emulator is not running.
+@property (readonly) NSDictionary *autoSpeedStatistics;
+
 /// The current gameport timing mode.
 @property (assign) BXGameportTimingMode gameportTimingMode;
 
@@ -305,6 +501,11 @@ extern NSStringEncoding BXDirectStringEncoding;
 /// (and the memory state is too polluted to reuse.)
 + (BOOL) canLaunchEmulator;
 
+/// A folder in which emulators may keep data they have worked out for use in later sessions,
+/// such as unpacked codepage fonts. Nothing is kept between sessions if this is @c nil.
++ (NSURL *) cacheURL;
++ (void) setCacheURL: (NSURL *)URL;
+
 /// Returns the correct DOSBox configuration string for the "cycles" setting given the specified values.
 + (NSString *) configStringForFixedSpeed: (NSInteger)speed isAuto: (BOOL)isAutoSpeed;
 
@@ -323,6 +524,15 @@ extern NSStringEncoding BXDirectStringEncoding;
 /// Stop emulation as soon as possible.
 - (void) cancel;
 
+/// Stop emulation as soon as possible, for when the process will exit once the emulator has finished.
+/// Instead of unwinding DOSBox and shutting down each of its modules, the emulator pushes any writes
+/// that DOS programs have made out to disk, finishes recording any input and then reports that it
+/// has finished, leaving the rest of the machine to be discarded along with the process.
+/// If the emulator has its own thread, that thread never returns from @c -start.
+/// @note This must only be used when nothing else will run in the process: in-process teardown
+/// that needs DOSBox's modules to have shut down cleanly should use @c -cancel instead.
+- (void) cancelForProcessExit;
+
 /// Pause the emulation. This will mute all sound and pause the DOSBox emulation loop.
 - (void) pause;
 
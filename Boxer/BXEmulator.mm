@@ -7,6 +7,10 @@
 
 #import "BXEmulatorPrivate.h"
 #import "NSObject+ADBPerformExtensions.h"
+#import "BXEmulator+BXInputReplay.h"
+#import <libkern/OSAtomic.h>
+#import <Block.h>
+#import <dlfcn.h>
 
 #import <SDL/SDL.h>
 #import "cpu.h"
@@ -14,6 +18,10 @@
 #import "shell.h"
 #import "mapper.h"
 #import "joystick.h"
+#import "pic.h"
+#import "rewind.h"
+#import "netplay.h"
+#import "dos_inc.h"
 
 
 #pragma mark - Constants
@@ -39,6 +47,13 @@ NSString * const BXEmulatorDidBeginGraphicalContextNotification		= @"BXEmulatorD
 NSString * const BXEmulatorDidFinishGraphicalContextNotification	= @"BXEmulatorDidFinishGraphicalContextNotification";
 
 NSString * const BXEmulatorDidChangeEmulationStateNotification		= @"BXEmulatorDidChangeEmulationStateNotification";
+NSString * const BXEmulatorDidSwitchAdaptiveCoreNotification		= @"BXEmulatorDidSwitchAdaptiveCoreNotification";
+
+NSString * const BXEmulatorAdaptiveCoreModeKey      = @"coreMode";
+NSString * const BXEmulatorAdaptiveCoreReasonKey    = @"reason";
+NSString * const BXEmulatorAdaptiveCoreReasonProtectedMode      = @"protected";
+NSString * const BXEmulatorAdaptiveCoreReasonRealMode           = @"realmode";
+NSString * const BXEmulatorAdaptiveCoreReasonSelfModifyingCode  = @"smc";
 
 
 NSString * const BXEmulatorDOSPathKey           = @"DOSPath";
@@ -53,6 +68,32 @@ NSString * const BXEmulatorExitDateKey          = @"exitDate";
 
 NSString * const BXDOSBoxErrorDomain = @"BXDOSBoxErrorDomain";
 
+NSString * const BXEmulatorDynamicCacheSizeKey          = @"size";
+NSString * const BXEmulatorDynamicCacheHitsKey          = @"hits";
+NSString * const BXEmulatorDynamicCacheTranslationsKey  = @"translations";
+NSString * const BXEmulatorDynamicCacheEvictionsKey     = @"evictions";
+NSString * const BXEmulatorDynamicCacheWrapsKey         = @"wraps";
+NSString * const BXEmulatorDynamicCacheInstructionsKey  = @"instructions";
+NSString * const BXEmulatorDynamicCacheAverageBlockLengthKey = @"averageBlockLength";
+NSString * const BXEmulatorDynamicCacheBytesEmittedKey  = @"bytesEmitted";
+NSString * const BXEmulatorDynamicCacheFlushesKey       = @"flushes";
+NSString * const BXEmulatorDynamicCacheInvalidationsKey = @"invalidations";
+NSString * const BXEmulatorDynamicCacheInvalidatedPagesKey = @"invalidatedPages";
+NSString * const BXEmulatorDynamicCacheHottestPageKey   = @"hottestPage";
+NSString * const BXEmulatorDynamicCacheHottestPageInvalidationsKey = @"hottestPageInvalidations";
+NSString * const BXEmulatorDynamicCacheSMCInterpretedPagesKey = @"smcInterpretedPages";
+NSString * const BXEmulatorDynamicCacheSMCInterpretedInstructionsKey = @"smcInterpretedInstructions";
+NSString * const BXEmulatorDynamicCacheTranslationSecondsKey = @"translationSeconds";
+NSString * const BXEmulatorDynamicCacheExecutionSecondsKey = @"executionSeconds";
+
+NSString * const BXEmulatorAutoSpeedTargetKey       = @"target";
+NSString * const BXEmulatorAutoSpeedAchievedKey     = @"achieved";
+NSString * const BXEmulatorAutoSpeedHostSlackKey    = @"hostSlack";
+NSString * const BXEmulatorAutoSpeedLoadKey         = @"load";
+NSString * const BXEmulatorAutoSpeedAdjustmentsKey  = @"adjustments";
+NSString * const BXEmulatorAutoSpeedStarvedAdjustmentsKey   = @"starvedAdjustments";
+NSString * const BXEmulatorAutoSpeedStarvedRaisesKey        = @"starvedRaises";
+
 
 NSStringEncoding BXDisplayStringEncoding	= CFStringConvertEncodingToNSStringEncoding(kCFStringEncodingDOSLatin1);
 NSStringEncoding BXDirectStringEncoding		= NSUTF8StringEncoding;
@@ -66,15 +107,21 @@ extern const char* RunningProgram;
 
 //defined in dosbox.cpp
 extern bool ticksLocked;
+extern double ticksRate;
 
 #if (C_DYNAMIC_X86)
 //defined in core_dyn_x86.cpp
 void CPU_Core_Dyn_X86_Cache_Init(bool enable_cache);
 void CPU_Core_Dyn_X86_SetFPUMode(bool dh_fpu);
+void CPU_Core_Dyn_X86_Cache_GetStats(CPU_DynamicCacheStats * stats);
 
 #elif (C_DYNREC)
 //defined in core_dynrec.cpp
 void CPU_Core_Dynrec_Cache_Init(bool enable_cache);
+void CPU_Core_Dynrec_Cache_GetStats(CPU_DynamicCacheStats * stats);
+void CPU_Core_Dynrec_SetHostFeatures(bool enable);
+bool CPU_Core_Dynrec_HostFeaturesEnabled(void);
+const char * CPU_Core_Dynrec_HostFeatureNames(void);
 #endif
 
 
@@ -108,12 +155,86 @@ void CPU_Core_Dynrec_Cache_Init(bool enable_cache);
 
 #pragma mark - Global tracking variables
 
+/// An entry in the emulator's queue of blocks posted for the emulation thread. See -_performOnEmulationThread:.
+typedef struct BXEmulatorEvent {
+    struct BXEmulatorEvent *next;
+    dispatch_block_t block;
+    NSTimeInterval timestamp;   //The host time at which input was posted, or 0 for blocks that aren't input.
+} BXEmulatorEvent;
+
+/// Events that have been performed or discarded, kept for reuse so that posting input doesn't have to go
+/// through the allocator every time: memory freed on the emulation thread after being allocated on the main
+/// thread is otherwise handed back across threads, and the two contend for the allocator's locks.
+static OSQueueHead BXEmulatorEventFreeList = OS_ATOMIC_QUEUE_INIT;
+
+/// Creates a new event for the specified block, which must later be freed by performing or discarding it.
+static BXEmulatorEvent *BXEmulatorEventCreate(dispatch_block_t block, NSTimeInterval timestamp)
+{
+    BXEmulatorEvent *event = (BXEmulatorEvent *)OSAtomicDequeue(&BXEmulatorEventFreeList, offsetof(BXEmulatorEvent, next));
+    if (!event)
+        event = (BXEmulatorEvent *)malloc(sizeof(BXEmulatorEvent));
+    
+    event->next = NULL;
+    event->block = Block_copy(block);
+    event->timestamp = timestamp;
+    return event;
+}
+
+/// Releases the event's block and returns the event to the free list.
+static void BXEmulatorEventFree(BXEmulatorEvent *event)
+{
+    Block_release(event->block);
+    event->block = nil;
+    OSAtomicEnqueue(&BXEmulatorEventFreeList, event, offsetof(BXEmulatorEvent, next));
+}
+
+/// Frees a list of events without performing them.
+static void BXEmulatorDiscardEvents(BXEmulatorEvent *event)
+{
+    while (event)
+    {
+        BXEmulatorEvent *next = event->next;
+        BXEmulatorEventFree(event);
+        event = next;
+    }
+}
+
+/// The context kept for each nested DOSBox run loop. See -_runLoopWillStartWithContextInfo:.
+typedef struct BXRunLoopContext {
+    NSAutoreleasePool *pool;
+    NSTimeInterval poolCreationTime;
+} BXRunLoopContext;
+
+/// The callback for the emulation thread's pending-events run loop source.
+static void BXEmulatorPerformPendingEvents(void *info)
+{
+    [(BXEmulator *)info _performPendingEvents];
+}
+
+/// The QoS class for user-interactive work, which 10.8 and 10.9 don't know about.
+#define BXUserInteractiveQOSClass 0x21
+
+/// Asks for the current thread to be scheduled as user-interactive work, so that it isn't pushed onto
+/// efficiency cores or starved by background work when the host is busy. QoS classes are only
+/// available from 10.10: on older systems, this raises the thread's priority instead.
+static void BXEmulatorRaiseCurrentThreadPriority()
+{
+    typedef int (*BXSetQOSClassFunction)(unsigned int qosClass, int relativePriority);
+    BXSetQOSClassFunction setQOSClass = (BXSetQOSClassFunction)dlsym(RTLD_DEFAULT, "pthread_set_qos_class_self_np");
+    
+    if (!setQOSClass || setQOSClass(BXUserInteractiveQOSClass, 0) != 0)
+        [NSThread setThreadPriority: 1.0];
+}
+
 /// The singleton emulator instance. Returned by [BXEmulator currentEmulator].
 static BXEmulator *_currentEmulator = nil;
 
 /// Whether an emulator instance has been started yet. No other emulators can be started after this.
 static BOOL _hasStartedEmulator = NO;
 
+/// Where emulators keep data between sessions. Returned by [BXEmulator cacheURL].
+static NSURL *_cacheURL = nil;
+
 
 #pragma mark - Class methods
 
@@ -129,6 +250,26 @@ static BOOL _hasStartedEmulator = NO;
 	return !_hasStartedEmulator;
 }
 
++ (NSURL *) cacheURL
+{
+    @synchronized(self)
+    {
+        return [[_cacheURL retain] autorelease];
+    }
+}
+
++ (void) setCacheURL: (NSURL *)URL
+{
+    @synchronized(self)
+    {
+        if (![URL isEqual: _cacheURL])
+        {
+            [_cacheURL release];
+            _cacheURL = [URL copy];
+        }
+    }
+}
+
 + (NSString *) configStringForFixedSpeed: (NSInteger)speed
 								  isAuto: (BOOL)isAutoSpeed
 {
@@ -148,6 +289,13 @@ static BOOL _hasStartedEmulator = NO;
 			return @"dynamic";
 		case BXCoreSimple:
 			return @"simple";
+		case BXCoreThreaded:
+			return @"threaded";
+        //Prefetch emulation is a cputype setting rather than a core of its own.
+		case BXCorePrefetch:
+			return @"normal";
+		case BXCoreAdaptive:
+			return @"adaptive";
 		default:
 			return @"auto";
 	}
@@ -181,8 +329,15 @@ static BOOL _hasStartedEmulator = NO;
 		_commandQueue           = [[NSMutableArray alloc] initWithCapacity: 4];
 		_driveCache             = [[NSMutableDictionary alloc] initWithCapacity: DOS_DRIVES];
 		_pendingSysexMessages   = [[NSMutableArray alloc] initWithCapacity: 4];
+        _pendingChangedKeys     = [[NSMutableOrderedSet alloc] initWithCapacity: 8];
+        _pendingNotifications   = [[NSMutableArray alloc] initWithCapacity: 4];
         
         self.masterVolume = 1.0f;
+        _adaptiveCoreAllowsDynamic = YES;
+        
+        _rewindMemoryBudget     = BXDefaultRewindMemoryBudget;
+        _rewindInterval         = BXDefaultRewindInterval;
+        _rewindKeyframeInterval = BXDefaultRewindKeyframeInterval;
 		
         self.keyboard = [[[BXEmulatedKeyboard alloc] init] autorelease];
         self.mouse = [[[BXEmulatedMouse alloc] init] autorelease];
@@ -215,11 +370,36 @@ static BOOL _hasStartedEmulator = NO;
 	[_driveCache release], _driveCache = nil;
 	[_commandQueue release], _commandQueue = nil;
     [_pendingSysexMessages release], _pendingSysexMessages = nil;
+    [_pendingChangedKeys release], _pendingChangedKeys = nil;
+    [_pendingNotifications release], _pendingNotifications = nil;
+    [_movieRecorder release], _movieRecorder = nil;
+    [_inputRecordingURL release], _inputRecordingURL = nil;
+    [_stallWatchdog release], _stallWatchdog = nil;
+    [_recentStalls release], _recentStalls = nil;
 	
 	[super dealloc];
 }
 
 
+#pragma mark - Trimming caches
+
+- (NSUInteger) cacheSize
+{
+    //The video handler's spare frames aren't counted, since there are only ever a few of them.
+    return REWIND_MemoryUsed();
+}
+
+- (void) trimCacheToLevel: (BXCacheTrimLevel)level
+{
+    [self _performOnEmulationThread: ^{
+        [self.videoHandler.framePool drain];
+        
+        if (level == BXCacheTrimAll)
+            [self _shrinkRewindHistory];
+    }];
+}
+
+
 #pragma mark - Controlling emulation state
 
 - (void) start
@@ -229,11 +409,14 @@ static BOOL _hasStartedEmulator = NO;
     
 	if (self.isCancelled) return;
     
-    self.emulationThread = [NSThread currentThread];
-	
 	//Record ourselves as the current emulator instance for DOSBox to talk to
     _currentEmulator = [self retain];
 	_hasStartedEmulator = YES;
+    
+    self.emulationThread = [NSThread currentThread];
+    
+    //Our rewind history is the most valuable of Boxer's caches, so it should be trimmed last.
+    [[BXCacheRegistry sharedRegistry] registerCache: self withPriority: BXCachePriorityHigh];
 	
 	[self _postNotificationName: BXEmulatorWillStartNotification
 			   delegateSelector: @selector(emulatorWillStart:)
@@ -241,10 +424,39 @@ static BOOL _hasStartedEmulator = NO;
 	
 	self.executing = YES;
 	
+    //If we have our own thread, make sure it gets scheduled ahead of background work, and give it a way
+    //to be woken up when events are posted to it while it's paused.
+    if (self.isConcurrent)
+    {
+        BXEmulatorRaiseCurrentThreadPriority();
+        
+        CFRunLoopSourceContext context = {0};
+        context.info = self;
+        context.perform = BXEmulatorPerformPendingEvents;
+        
+        _pendingEventsSource = CFRunLoopSourceCreate(kCFAllocatorDefault, 0, &context);
+        _emulationRunLoop = (CFRunLoopRef)CFRetain(CFRunLoopGetCurrent());
+        CFRunLoopAddSource(_emulationRunLoop, _pendingEventsSource, kCFRunLoopCommonModes);
+    }
+    
+    //Watch for the emulation thread getting held up, once it's up and running.
+    [self _startStallWatchdog];
+    
 	//Start DOSBox's main loop
 	[self _startDOSBox];
+    
+    [self _stopStallWatchdog];
 	
+    //If we already reported that we'd finished, in the expectation that the process would exit,
+    //don't report it again.
+    BOOL alreadyFinished = _finishedForProcessExit;
+    
 	self.executing = NO;
+    
+    [[BXCacheRegistry sharedRegistry] unregisterCache: self];
+    
+    //Let any other players know we've gone.
+    NETPLAY_Stop();
 	
 	if (_currentEmulator == self)
     {
@@ -252,19 +464,33 @@ static BOOL _hasStartedEmulator = NO;
         _currentEmulator = nil;
 	}
     
-	[self _postNotificationName: BXEmulatorDidFinishNotification
-			   delegateSelector: @selector(emulatorDidFinish:)
-					   userInfo: nil];
+    if (_pendingEventsSource)
+    {
+        CFRunLoopRemoveSource(_emulationRunLoop, _pendingEventsSource, kCFRunLoopCommonModes);
+        CFRelease(_pendingEventsSource), _pendingEventsSource = NULL;
+        CFRelease(_emulationRunLoop), _emulationRunLoop = NULL;
+    }
+    
+    //Discard any events that were posted too late to be performed.
+    BXEmulatorEvent *event;
+    do { event = (BXEmulatorEvent *)_pendingEvents; }
+    while (event && !OSAtomicCompareAndSwapPtrBarrier(event, NULL, &_pendingEvents));
+    BXEmulatorDiscardEvents(event);
+    
+    BXEmulatorDiscardEvents((BXEmulatorEvent *)_deferredInputEvents);
+    _deferredInputEvents = _lastDeferredInputEvent = NULL;
+    
+    if (!alreadyFinished)
+    {
+        [self _postNotificationName: BXEmulatorDidFinishNotification
+                   delegateSelector: @selector(emulatorDidFinish:)
+                           userInfo: nil];
+    }
 }
 
 - (void) cancel
 {
-    if (self.emulationThread && [NSThread currentThread] != self.emulationThread)
-    {
-        [self performSelector: _cmd onThread: self.emulationThread withObject: nil waitUntilDone: NO];
-    }
-    else
-    {
+    [self _performOnEmulationThread: ^{
         if (self.isExecuting && !self.isCancelled)
         {
             //Immediately kill audio output to avoid hanging notes
@@ -276,6 +502,45 @@ static BOOL _hasStartedEmulator = NO;
         }
 
         self.cancelled = YES;
+    }];
+}
+
+- (void) cancelForProcessExit
+{
+    [self _performOnEmulationThread: ^{
+        _exitsProcessWhenCancelled = YES;
+    }];
+    [self cancel];
+}
+
+- (void) _finishForProcessExit
+{
+    _finishedForProcessExit = YES;
+    
+    //Snapshot whatever would otherwise have been saved on the way out: anything DOS programs
+    //have written but not yet closed, each drive's directory index, and any input being recorded.
+    DOS_FlushAllFiles();
+    for (NSUInteger i=0; i<DOS_DRIVES; i++)
+    {
+        if (Drives[i]) Drives[i]->dirCache.SaveIndex();
+    }
+    [self finishRecordingInputWithError: NULL];
+    NETPLAY_Stop();
+    
+    [[BXCacheRegistry sharedRegistry] unregisterCache: self];
+    self.executing = NO;
+    
+	[self _postNotificationName: BXEmulatorDidFinishNotification
+			   delegateSelector: @selector(emulatorDidFinish:)
+					   userInfo: nil];
+    
+    //If we have our own thread, leave it here: nothing on it needs to happen before the process exits.
+    //(On the main thread we can only return, and if the process does not exit after all then DOSBox
+    //will unwind as normal.)
+    if (self.isConcurrent)
+    {
+        while (YES)
+            [NSThread sleepForTimeInterval: DBL_MAX];
     }
 }
 
@@ -457,6 +722,26 @@ static BOOL _hasStartedEmulator = NO;
 	}
 }
 
+- (NSInteger) autoSpeedLimit
+{
+    if (self.isExecuting && CPU_CycleLimit > 0)
+        return (NSInteger)CPU_CycleLimit;
+    else
+        return 0;
+}
+
+- (void) setAutoSpeedLimit: (NSInteger)limit
+{
+    if (self.isExecuting)
+    {
+        CPU_CycleLimit = (limit > 0) ? (Bit32s)limit : -1;
+        
+        //Bring the speed down straight away rather than waiting for the controller to do it
+        if (CPU_CycleLimit > 0 && CPU_CycleAutoAdjust == BXSpeedAuto && CPU_CycleMax > CPU_CycleLimit)
+            CPU_CycleMax = CPU_CycleLimit;
+    }
+}
+
 - (BOOL) isTurboSpeed
 {
     return ticksLocked;
@@ -496,6 +781,17 @@ static BOOL _hasStartedEmulator = NO;
 }
 
 
+- (double) emulationRate
+{
+    return ticksRate;
+}
+
+- (void) setEmulationRate: (double)rate
+{
+    ticksRate = MIN(MAX(rate, 1.0 - BXEmulatorMaxRateDeviation), 1.0 + BXEmulatorMaxRateDeviation);
+}
+
+
 - (BXCoreMode) coreMode
 {
 	if (self.isExecuting)
@@ -515,13 +811,124 @@ static BOOL _hasStartedEmulator = NO;
 		
 		if (cpudecoder == &CPU_Core_Simple_Run)			return BXCoreSimple;
 		if (cpudecoder == &CPU_Core_Full_Run)			return BXCoreFull;
+		if (cpudecoder == &CPU_Core_Threaded_Run ||
+			cpudecoder == &CPU_Core_Threaded_Trap_Run)	return BXCoreThreaded;
+		if (cpudecoder == &CPU_Core_Prefetch_Run ||
+			cpudecoder == &CPU_Core_Prefetch_Trap_Run)	return BXCorePrefetch;
 		
 		return BXCoreUnknown;
 	}
 	else return BXCoreUnknown;
 }
+
+- (BOOL) isAdaptiveCoreActive
+{
+    return self.isExecuting && CPU_AdaptiveCore_Enabled();
+}
+
+- (BOOL) adaptiveCoreAllowsDynamic
+{
+    return _adaptiveCoreAllowsDynamic;
+}
+
+- (void) setAdaptiveCoreAllowsDynamic: (BOOL)allowsDynamic
+{
+    _adaptiveCoreAllowsDynamic = allowsDynamic;
+    CPU_AdaptiveCore_SetPromotionAllowed(allowsDynamic);
+}
+
+- (NSDictionary *) dynamicCacheStatistics
+{
+    if (!self.isExecuting) return nil;
+    
+    CPU_DynamicCacheStats stats;
+#if (C_DYNAMIC_X86)
+    CPU_Core_Dyn_X86_Cache_GetStats(&stats);
+#elif (C_DYNREC)
+    CPU_Core_Dynrec_Cache_GetStats(&stats);
+#else
+    return nil;
+#endif
+    
+    NSMutableDictionary *statistics = [NSMutableDictionary dictionaryWithDictionary: @{
+             BXEmulatorDynamicCacheSizeKey:         @(stats.size),
+             BXEmulatorDynamicCacheHitsKey:         @(stats.hits),
+             BXEmulatorDynamicCacheTranslationsKey: @(stats.translations),
+             BXEmulatorDynamicCacheEvictionsKey:    @(stats.evictions),
+             BXEmulatorDynamicCacheWrapsKey:        @(stats.wraps),
+             BXEmulatorDynamicCacheInstructionsKey: @(stats.instructions),
+             BXEmulatorDynamicCacheAverageBlockLengthKey: @(stats.translations ? (double)stats.instructions / stats.translations : 0),
+             BXEmulatorDynamicCacheBytesEmittedKey: @(stats.bytes_emitted),
+             BXEmulatorDynamicCacheFlushesKey:      @(stats.flushes),
+             BXEmulatorDynamicCacheInvalidationsKey: @(stats.invalidations),
+             BXEmulatorDynamicCacheInvalidatedPagesKey: @(stats.invalidated_pages),
+             BXEmulatorDynamicCacheSMCInterpretedPagesKey: @(stats.smc_interpreted_pages),
+             BXEmulatorDynamicCacheSMCInterpretedInstructionsKey: @(stats.smc_interpreted_instructions),
+             BXEmulatorDynamicCacheTranslationSecondsKey: @(stats.translate_seconds),
+             //The run time includes the time spent translating.
+             BXEmulatorDynamicCacheExecutionSecondsKey: @(MAX(stats.run_seconds - stats.translate_seconds, 0.0)),
+             }];
+    
+    if (stats.hottest_page_invalidations)
+    {
+        [statistics setObject: @(stats.hottest_page) forKey: BXEmulatorDynamicCacheHottestPageKey];
+        [statistics setObject: @(stats.hottest_page_invalidations) forKey: BXEmulatorDynamicCacheHottestPageInvalidationsKey];
+    }
+    
+    return statistics;
+}
+
+- (BOOL) dynamicCoreUsesHostFeatures
+{
+#if (C_DYNREC)
+    return CPU_Core_Dynrec_HostFeaturesEnabled();
+#else
+    return NO;
+#endif
+}
+
+- (void) setDynamicCoreUsesHostFeatures: (BOOL)usesHostFeatures
+{
+#if (C_DYNREC)
+    CPU_Core_Dynrec_SetHostFeatures(usesHostFeatures);
+#endif
+}
+
+- (NSArray *) dynamicCoreHostFeatures
+{
+#if (C_DYNREC)
+    NSString *names = [NSString stringWithUTF8String: CPU_Core_Dynrec_HostFeatureNames()];
+    if (names.length)
+        return [names componentsSeparatedByString: @" "];
+#endif
+    return @[];
+}
+
+- (NSDictionary *) autoSpeedStatistics
+{
+    if (!self.isExecuting) return nil;
+    
+    DOSBOX_CycleControllerState state;
+    DOSBOX_GetCycleControllerState(&state);
+    
+    return @{
+             BXEmulatorAutoSpeedTargetKey:      @(state.target),
+             BXEmulatorAutoSpeedAchievedKey:    @(state.achieved),
+             BXEmulatorAutoSpeedHostSlackKey:   @(state.slack),
+             BXEmulatorAutoSpeedLoadKey:        @(state.load),
+             BXEmulatorAutoSpeedAdjustmentsKey: @(state.adjustments),
+             BXEmulatorAutoSpeedStarvedAdjustmentsKey:  @(state.starved_adjustments),
+             BXEmulatorAutoSpeedStarvedRaisesKey:       @(state.starved_raises),
+             };
+}
+
 - (void) setCoreMode: (BXCoreMode)coreMode
 {
+    //An explicit choice of core takes over from the adaptive core, even if it matches the core
+    //the adaptive core happens to be running right now.
+    if (self.isExecuting && coreMode != BXCoreAdaptive)
+        CPU_AdaptiveCore_Disable();
+    
 	if (self.isExecuting && self.coreMode != coreMode)
 	{
 		switch(coreMode)
@@ -530,6 +937,13 @@ static BOOL _hasStartedEmulator = NO;
 				cpudecoder = &CPU_Core_Normal_Run;
 				break;
 				
+			case BXCoreAdaptive:
+				//The adaptive core will move to the dynamic core by itself once it's worthwhile
+				if (self.isAdaptiveCoreActive) return;
+				cpudecoder = &CPU_Core_Normal_Run;
+				CPU_AdaptiveCore_Enable();
+				break;
+				
 			case BXCoreDynamic:
 #if (C_DYNAMIC_X86)
 				CPU_Core_Dyn_X86_Cache_Init(true);
@@ -548,6 +962,14 @@ static BOOL _hasStartedEmulator = NO;
 			case BXCoreFull:
 				cpudecoder = &CPU_Core_Full_Run;
 				break;
+			case BXCoreThreaded:
+				cpudecoder = &CPU_Core_Threaded_Run;
+				break;
+			case BXCorePrefetch:
+				//Use a 386's queue size unless the configured CPU type chose one already
+				if (!CPU_PrefetchQueueSize) CPU_PrefetchQueueSize = 16;
+				cpudecoder = &CPU_Core_Prefetch_Run;
+				break;
 		}
 		
 		//Prevent DOSBox from resetting the core mode after a program exits
@@ -567,18 +989,16 @@ static BOOL _hasStartedEmulator = NO;
 {
 	if (!self.isPaused)
 	{
-        if (self.emulationThread && [NSThread currentThread] != self.emulationThread)
-        {
-            [self performSelector: _cmd onThread: self.emulationThread withObject: nil waitUntilDone: NO];
-        }
-        else
-        {
+        [self _performOnEmulationThread: ^{
             @synchronized(self)
             {
-                self.paused = YES;
-                [self _suspendAudio];
+                if (!self.isPaused)
+                {
+                    self.paused = YES;
+                    [self _suspendAudio];
+                }
             }
-        }
+        }];
 	}
 }
 
@@ -586,18 +1006,16 @@ static BOOL _hasStartedEmulator = NO;
 {	
 	if (self.isPaused)
     {
-        if (self.emulationThread && [NSThread currentThread] != self.emulationThread)
-        {
-            [self performSelector: _cmd onThread: self.emulationThread withObject: nil waitUntilDone: NO];
-        }
-        else
-        {
+        [self _performOnEmulationThread: ^{
             @synchronized(self)
             {
-                self.paused = NO;
-                [self _resumeAudio];
+                if (self.isPaused)
+                {
+                    self.paused = NO;
+                    [self _resumeAudio];
+                }
             }
-        }
+        }];
 	}
 }
 
@@ -767,43 +1185,72 @@ static BOOL _hasStartedEmulator = NO;
 			  delegateSelector: (SEL)selector
 					  userInfo: (NSDictionary *)userInfo
 {
+    NSNotification *notification = [NSNotification notificationWithName: name
+                                                                  object: self
+                                                                userInfo: userInfo];
+    
     //Always post notifications on the main thread.
     if (![NSThread isMainThread])
     {
-        [self performSelectorOnMainThread: _cmd waitUntilDone: NO withValues: &name, &selector, &userInfo];
+        @synchronized(_pendingChangedKeys)
+        {
+            [_pendingNotifications addObject: @[notification, NSStringFromSelector(selector)]];
+            [self _schedulePendingChanges];
+        }
     }
     else
     {
-        NSNotificationCenter *center = [NSNotificationCenter defaultCenter];
-        NSNotification *notification = [NSNotification notificationWithName: name
-                                                                     object: self
-                                                                   userInfo: userInfo];
-        
-        if ([self.delegate respondsToSelector: selector])
-            [self.delegate performSelector: selector withObject: notification];
-        
-        [center postNotification: notification];
+        [self _deliverNotification: notification delegateSelector: selector];
     }
 }
 
+- (void) _deliverNotification: (NSNotification *)notification delegateSelector: (SEL)selector
+{
+    if ([self.delegate respondsToSelector: selector])
+        [self.delegate performSelector: selector withObject: notification];
+    
+    [[NSNotificationCenter defaultCenter] postNotification: notification];
+}
+
 
 #pragma mark - Synchronizing emulation state
 
-//Dispatch KVC notifications on the main thread
+//KVO notifications are dispatched on the main thread. Changes made on the emulation thread are
+//collected and delivered together at most once per display frame, so that a key that changes
+//many times in between gets a single will/did pair.
 - (void) willChangeValueForKey: (NSString *)key
 {
-    if (![NSThread isMainThread])
-        [self performSelectorOnMainThread: _cmd withObject: key waitUntilDone: NO];
-    else
+    //Off the main thread, the will-change is sent along with the did-change when they're delivered.
+    if ([NSThread isMainThread])
         [super willChangeValueForKey: key];
 }
 
 - (void) didChangeValueForKey: (NSString *)key
 {
     if (![NSThread isMainThread])
-        [self performSelectorOnMainThread: _cmd withObject: key waitUntilDone: NO];
+    {
+        @synchronized(_pendingChangedKeys)
+        {
+            [_pendingChangedKeys addObject: key];
+            [self _schedulePendingChanges];
+        }
+    }
     else
+    {
         [super didChangeValueForKey: key];
+    }
+}
+
+- (void) _didSwitchAdaptiveCoreToDynamic: (BOOL)dynamic reason: (NSString *)reason
+{
+    NSDictionary *userInfo = @{
+                               BXEmulatorAdaptiveCoreModeKey: @(dynamic ? BXCoreDynamic : BXCoreNormal),
+                               BXEmulatorAdaptiveCoreReasonKey: reason,
+                               };
+    
+    [self _postNotificationName: BXEmulatorDidSwitchAdaptiveCoreNotification
+               delegateSelector: @selector(emulatorDidSwitchAdaptiveCore:)
+                       userInfo: userInfo];
 }
 
 //Called by coalface functions to notify Boxer that the emulation state may have changed behind its back
@@ -811,36 +1258,97 @@ static BOOL _hasStartedEmulator = NO;
 {
     if (![NSThread isMainThread])
     {
-        [self performSelectorOnMainThread: _cmd withObject: nil waitUntilDone: NO];
+        @synchronized(_pendingChangedKeys)
+        {
+            _pendingEmulationStateChange = YES;
+            [self _schedulePendingChanges];
+        }
     }
     else
     {
-        [self willChangeValueForKey: @"fixedSpeed"];
-        [self willChangeValueForKey: @"autoSpeed"];
-        [self willChangeValueForKey: @"frameskip"];
-        [self willChangeValueForKey: @"coreMode"];
-        
-        [self didChangeValueForKey: @"fixedSpeed"];
-        [self didChangeValueForKey: @"autoSpeed"];
-        [self didChangeValueForKey: @"frameskip"];
-        [self didChangeValueForKey: @"coreMode"];
-        
-        NSString *newProcessName = [NSString stringWithCString: RunningProgram
-                                                      encoding: BXDirectStringEncoding];
-        
-        if ([newProcessName isEqualToString: shellProcessName]) newProcessName = nil;
-        self.processName = newProcessName;
+        [self _syncEmulationState];
+    }
+}
+
+- (void) _syncEmulationState
+{
+    [self willChangeValueForKey: @"fixedSpeed"];
+    [self willChangeValueForKey: @"autoSpeed"];
+    [self willChangeValueForKey: @"frameskip"];
+    [self willChangeValueForKey: @"coreMode"];
+    
+    [self didChangeValueForKey: @"fixedSpeed"];
+    [self didChangeValueForKey: @"autoSpeed"];
+    [self didChangeValueForKey: @"frameskip"];
+    [self didChangeValueForKey: @"coreMode"];
+    
+    NSString *newProcessName = [NSString stringWithCString: RunningProgram
+                                                  encoding: BXDirectStringEncoding];
+    
+    if ([newProcessName isEqualToString: shellProcessName]) newProcessName = nil;
+    self.processName = newProcessName;
+    
+    //Let the delegate know that the emulation state has changed behind its back, so it can re-check CPU settings
+    [self _postNotificationName: BXEmulatorDidChangeEmulationStateNotification
+               delegateSelector: @selector(emulatorDidChangeEmulationState:)
+                       userInfo: nil];
+}
+
+//Must be called while synchronized on _pendingChangedKeys.
+- (void) _schedulePendingChanges
+{
+    if (_pendingChangesScheduled)
+        return;
+    
+    _pendingChangesScheduled = YES;
+    
+    NSTimeInterval sinceLastDelivery = [NSDate timeIntervalSinceReferenceDate] - _lastPendingChangesDelivery;
+    NSTimeInterval delay = MAX(0, BXPendingChangesDeliveryInterval - sinceLastDelivery);
+    
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
+        [self _deliverPendingChanges];
+    });
+}
+
+- (void) _deliverPendingChanges
+{
+    NSArray *changedKeys, *notifications;
+    BOOL emulationStateChanged;
+    
+    @synchronized(_pendingChangedKeys)
+    {
+        changedKeys = [[_pendingChangedKeys.array copy] autorelease];
+        notifications = [[_pendingNotifications copy] autorelease];
+        emulationStateChanged = _pendingEmulationStateChange;
         
-        //Let the delegate know that the emulation state has changed behind its back, so it can re-check CPU settings
-        [self _postNotificationName: BXEmulatorDidChangeEmulationStateNotification
-                   delegateSelector: @selector(emulatorDidChangeEmulationState:)
-                           userInfo: nil];
+        [_pendingChangedKeys removeAllObjects];
+        [_pendingNotifications removeAllObjects];
+        _pendingEmulationStateChange = NO;
+        _pendingChangesScheduled = NO;
+        _lastPendingChangesDelivery = [NSDate timeIntervalSinceReferenceDate];
+    }
+    
+    for (NSString *key in changedKeys)
+        [self willChangeValueForKey: key];
+    for (NSString *key in changedKeys)
+        [self didChangeValueForKey: key];
+    
+    if (emulationStateChanged)
+        [self _syncEmulationState];
+    
+    for (NSArray *pendingNotification in notifications)
+    {
+        [self _deliverNotification: [pendingNotification objectAtIndex: 0]
+                  delegateSelector: NSSelectorFromString([pendingNotification objectAtIndex: 1])];
     }
 }
 
 - (void) _didInitialize
 {
 	self.initialized = YES;
+    
+    //Initialization takes as long as it takes: stalls only count from here on.
+    _stallWatchdog.armed = YES;
 	
 	//These flags will only change during initialization
 	[self willChangeValueForKey: @"gameportTimingMode"];
@@ -857,30 +1365,79 @@ static BOOL _hasStartedEmulator = NO;
 
 - (void) _didFinishFrame: (BXVideoFrame *)frame
 {
+    if (self.isRecordingMovie)
+        [self _recordFrame: frame];
+    
+    BXStallCallScope stallCall("-emulator:didFinishFrame:");
     [self.delegate emulator: self didFinishFrame: frame];
 }
 
+- (void) _updateDynamicCacheStatistics
+{
+    //The counters change constantly while the dynamic core is running, so only announce them periodically.
+    if (self.coreMode != BXCoreDynamic)
+        return;
+    
+    NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+    if (now - _lastDynamicCacheStatisticsTime >= BXDynamicCacheStatisticsInterval)
+    {
+        _lastDynamicCacheStatisticsTime = now;
+        [self willChangeValueForKey: @"dynamicCacheStatistics"];
+        [self didChangeValueForKey: @"dynamicCacheStatistics"];
+    }
+}
+
 
 #pragma mark -
 #pragma mark Runloop handling
 
 - (void) _processEvents
 {
+    _processingEvents = YES;
+    
+    [self _updateRewindHistory];
+    [self _updateDynamicCacheStatistics];
+    [self _updateAudioBufferStatistics];
+    [self _updateNetplay];
+    
+    //Perform whatever other threads have posted for us: this costs nothing if nothing is waiting.
+    [self _performPendingEvents];
+    
     //Let our delegate process events for us if we don't have our own thread
     if (!self.isConcurrent)
     {
+        BXStallCallScope stallCall("-processEventsForEmulator:");
         [self.delegate processEventsForEmulator: self];
     }
-    else
+    //While paused, sleep in the run loop until we're resumed: posting an event will wake us up.
+    else if (self.isPaused)
     {
-        NSDate *untilDate = self.isPaused ? [NSDate distantFuture] : [NSDate distantPast];
+        //Sleeping while paused is no stall.
+        _stallWatchdog.armed = NO;
         
-        while ([[NSRunLoop currentRunLoop] runMode: NSDefaultRunLoopMode beforeDate: untilDate])
+        //Catch anything that was posted before the poster could see that we were going to sleep.
+        _waitingForEvents = YES;
+        OSMemoryBarrier();
+        [self _performPendingEvents];
+        
+        while (self.isPaused && !self.isCancelled)
         {
-            if (self.isCancelled) break;
-            if (!self.isPaused) break;
+            if (![[NSRunLoop currentRunLoop] runMode: NSDefaultRunLoopMode beforeDate: [NSDate distantFuture]])
+                break;
         }
+        
+        _waitingForEvents = NO;
+        _lastRunLoopSweepTime = [NSDate timeIntervalSinceReferenceDate];
+        _stallWatchdog.armed = self.isInitialized;
     }
+    //Otherwise, only give the run loop a turn every so often to fire any timers and other sources.
+    else if (_lastRunLoopTime - _lastRunLoopSweepTime >= BXRunLoopSweepInterval)
+    {
+        [[NSRunLoop currentRunLoop] runMode: NSDefaultRunLoopMode beforeDate: [NSDate distantPast]];
+        _lastRunLoopSweepTime = _lastRunLoopTime;
+    }
+    
+    _processingEvents = NO;
 }
 
 - (BOOL) _runLoopShouldContinue
@@ -892,6 +1449,10 @@ static BOOL _hasStartedEmulator = NO;
 	//and may crash if they fail to complete.
 	if (self.isCancelled && self.isInitialized)
     {
+        //If the process is about to exit, save what needs saving here rather than unwinding first.
+        if (_exitsProcessWhenCancelled && !_finishedForProcessExit)
+            [self _finishForProcessExit];
+        
         return NO;
 	}
 	return YES;
@@ -899,24 +1460,189 @@ static BOOL _hasStartedEmulator = NO;
 
 - (void) _runLoopWillStartWithContextInfo: (void **)contextInfo
 {
-    //Create an autorelease pool for this iteration of the runloop:
-    //we'll drain it down in _runLoopDidFinishWithAutoreleasePool:
-    if (contextInfo)
+    //Create an autorelease pool for this run loop the first time round: it's drained every so often
+    //in _runLoopDidFinishWithContextInfo:exiting:, rather than being recreated every iteration.
+    if (contextInfo && !*contextInfo)
     {
-        *contextInfo = [[NSAutoreleasePool alloc] init];
+        BXRunLoopContext *context = (BXRunLoopContext *)malloc(sizeof(BXRunLoopContext));
+        context->pool = [[NSAutoreleasePool alloc] init];
+        context->poolCreationTime = [NSDate timeIntervalSinceReferenceDate];
+        *contextInfo = context;
     }
+    BXStallCallScope stallCall("-emulatorWillStartRunLoop:");
 	[self.delegate emulatorWillStartRunLoop: self];
 }
 
-- (void) _runLoopDidFinishWithContextInfo: (void *)contextInfo
+- (void) _runLoopDidFinishWithContextInfo: (void **)contextInfo exiting: (BOOL)exiting
 {
-	[self.delegate emulatorDidFinishRunLoop: self];
+    {
+        BXStallCallScope stallCall("-emulatorDidFinishRunLoop:");
+        [self.delegate emulatorDidFinishRunLoop: self];
+    }
     
     _lastRunLoopTime = [NSDate timeIntervalSinceReferenceDate];
     
-    if (contextInfo)
+    BXRunLoopContext *context = contextInfo ? (BXRunLoopContext *)*contextInfo : NULL;
+    if (context)
     {
-        [(NSAutoreleasePool *)contextInfo drain];
+        //Nested run loops have already exited and drained their own pools by now,
+        //so this loop's pool is at the top of the stack and safe to drain.
+        if (exiting)
+        {
+            [context->pool drain];
+            free(context);
+            *contextInfo = NULL;
+        }
+        else if (_lastRunLoopTime - context->poolCreationTime >= BXRunLoopPoolDrainInterval)
+        {
+            [context->pool drain];
+            context->pool = [[NSAutoreleasePool alloc] init];
+            context->poolCreationTime = _lastRunLoopTime;
+        }
+    }
+}
+
+- (void) _performOnEmulationThread: (dispatch_block_t)block
+{
+    NSThread *thread = self.emulationThread;
+    if (!thread || [NSThread currentThread] == thread)
+    {
+        block();
+        return;
+    }
+    
+    //Emulation has finished, and there's nobody left to perform the block.
+    if (_currentEmulator != self)
+        return;
+    
+    [self _postEvent: BXEmulatorEventCreate(block, 0)];
+}
+
+- (void) _performInputOnEmulationThread: (dispatch_block_t)block
+{
+    NSThread *thread = self.emulationThread;
+    if (!thread)
+    {
+        block();
+        return;
+    }
+    
+    if (_currentEmulator != self)
+        return;
+    
+    BXEmulatorEvent *event = BXEmulatorEventCreate(block, [NSDate timeIntervalSinceReferenceDate]);
+    
+    //Input posted on the emulation thread itself still has to wait its turn behind earlier input.
+    if ([NSThread currentThread] == thread)
+    {
+        [self _deferInputEvent: event];
+        [self _performDueInputEvents];
+    }
+    else
+    {
+        [self _postEvent: event];
+    }
+}
+
+- (void) _postEvent: (void *)eventPtr
+{
+    BXEmulatorEvent *event = (BXEmulatorEvent *)eventPtr;
+    void *head;
+    do
+    {
+        head = _pendingEvents;
+        event->next = (BXEmulatorEvent *)head;
+    }
+    while (!OSAtomicCompareAndSwapPtrBarrier(head, event, &_pendingEvents));
+    
+    //If the emulation thread is asleep in its run loop, wake it up to deal with the event.
+    if (_waitingForEvents && _pendingEventsSource)
+    {
+        CFRunLoopSourceSignal(_pendingEventsSource);
+        CFRunLoopWakeUp(_emulationRunLoop);
+    }
+}
+
+- (void) _performPendingEvents
+{
+    if (!_pendingEvents && !_deferredInputEvents)
+        return;
+    
+    //Take the whole list at once, leaving it empty for posters to carry on adding to.
+    BXEmulatorEvent *events;
+    do { events = (BXEmulatorEvent *)_pendingEvents; }
+    while (events && !OSAtomicCompareAndSwapPtrBarrier(events, NULL, &_pendingEvents));
+    
+    //The list is newest-first: reverse it to perform events in the order they were posted.
+    BXEmulatorEvent *orderedEvents = NULL;
+    while (events)
+    {
+        BXEmulatorEvent *next = events->next;
+        events->next = orderedEvents;
+        orderedEvents = events;
+        events = next;
+    }
+    
+    while (orderedEvents)
+    {
+        BXEmulatorEvent *next = orderedEvents->next;
+        if (orderedEvents->timestamp)
+        {
+            [self _deferInputEvent: orderedEvents];
+        }
+        else
+        {
+            BXStallCallScope stallCall("performing an event posted to the emulation thread");
+            orderedEvents->block();
+            BXEmulatorEventFree(orderedEvents);
+        }
+        orderedEvents = next;
+    }
+    
+    [self _performDueInputEvents];
+}
+
+- (void) _deferInputEvent: (void *)eventPtr
+{
+    BXEmulatorEvent *event = (BXEmulatorEvent *)eventPtr;
+    event->next = NULL;
+    
+    if (_lastDeferredInputEvent)
+        ((BXEmulatorEvent *)_lastDeferredInputEvent)->next = event;
+    else
+        _deferredInputEvents = event;
+    
+    _lastDeferredInputEvent = event;
+}
+
+- (void) _performDueInputEvents
+{
+    if (!_deferredInputEvents)
+        return;
+    
+    NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+    NSUInteger ticks = PIC_Ticks;
+    
+    while (_deferredInputEvents)
+    {
+        BXEmulatorEvent *event = (BXEmulatorEvent *)_deferredInputEvents;
+        
+        //Hold the input back until as much emulated time has passed since the previous input
+        //as the host time between them, unless it has been waiting too long already.
+        NSTimeInterval spacing = MIN(event->timestamp - _lastInputTimestamp, BXInputEventMaxSpacing);
+        BOOL isDue = (spacing <= 0) || (ticks - _lastInputTicks) >= (spacing * 1000) || (now - event->timestamp) >= BXInputEventMaxLatency;
+        if (!isDue)
+            break;
+        
+        _deferredInputEvents = event->next;
+        if (!_deferredInputEvents)
+            _lastDeferredInputEvent = NULL;
+        
+        _lastInputTimestamp = event->timestamp;
+        _lastInputTicks = ticks;
+        
+        event->block();
+        BXEmulatorEventFree(event);
     }
 }
 
@@ -990,6 +1716,9 @@ static BOOL _hasStartedEmulator = NO;
 	//Clean up after DOSBox finishes.
 	SDL_Quit();
 	[self.videoHandler shutdown];
+    
+    //Finalize any movie that was still being recorded.
+    [self stopRecordingMovieWithCompletionHandler: nil];
     control = NULL;
 }
 
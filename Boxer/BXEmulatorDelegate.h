@@ -38,6 +38,11 @@ extern NSString * const BXEmulatorDidReturnToShellNotification;
 /// Sent when the emulator changes state in some way that is not covered by an existing notification.
 extern NSString * const BXEmulatorDidChangeEmulationStateNotification;
 
+/// Sent when the adaptive core has moved to the dynamic core or back to the normal core.
+/// The @c userInfo of the notification contains the new core under @c BXEmulatorAdaptiveCoreModeKey,
+/// and why it moved under @c BXEmulatorAdaptiveCoreReasonKey.
+extern NSString * const BXEmulatorDidSwitchAdaptiveCoreNotification;
+
 /// Sent when the emulator has just switched into a graphical (non-text) video mode.
 extern NSString * const BXEmulatorDidBeginGraphicalContextNotification;
 
@@ -84,6 +89,25 @@ extern NSString * const BXEmulatorLaunchDateKey;
 extern NSString * const BXEmulatorExitDateKey;
 
 
+#pragma mark Adaptive core notification keys
+//Keys used in the userInfo dictionary of BXEmulatorDidSwitchAdaptiveCoreNotification.
+
+/// An NSNumber @c BXCoreMode recording which core the adaptive core moved to: either @c BXCoreNormal or @c BXCoreDynamic.
+extern NSString * const BXEmulatorAdaptiveCoreModeKey;
+
+/// One of the reasons below, recording why the adaptive core moved.
+extern NSString * const BXEmulatorAdaptiveCoreReasonKey;
+
+/// The program had been running in protected mode for long enough to be worth translating.
+extern NSString * const BXEmulatorAdaptiveCoreReasonProtectedMode;
+
+/// The program had gone back to running in real mode.
+extern NSString * const BXEmulatorAdaptiveCoreReasonRealMode;
+
+/// The program kept rewriting its own code, throwing away the dynamic core's translations.
+extern NSString * const BXEmulatorAdaptiveCoreReasonSelfModifyingCode;
+
+
 #pragma mark - BXEmulatorDelegate
 
 @class BXVideoFrame;
@@ -136,6 +160,10 @@ extern NSString * const BXEmulatorExitDateKey;
 /// Called at shell startup to decide whether to display the standard DOSBox startup preamble. Defaults to @c YES if not implemented.
 - (BOOL) emulatorShouldDisplayStartupMessages: (BXEmulator *)emulator;
 
+/// Requests how long, in seconds, the delegate took to render the most recent frame it was given.
+/// This is used for automatic frameskipping. Will be treated as 0 if not implemented.
+- (CFTimeInterval) renderingTimeForEmulator: (BXEmulator *)emulator;
+
 
 #pragma mark Lifecycle notifications
 
@@ -183,6 +211,10 @@ extern NSString * const BXEmulatorExitDateKey;
 /// @note Currently no information is provided about what, if anything, has changed.
 - (void) emulatorDidChangeEmulationState: (NSNotification *)notification;
 
+/// Called when the adaptive core has moved to the dynamic core or back to the normal core.
+/// Corresponds to BXEmulatorDidSwitchAdaptiveCoreNotification.
+- (void) emulatorDidSwitchAdaptiveCore: (NSNotification *)notification;
+
 @end
 
 
@@ -240,6 +272,11 @@ extern NSString * const BXEmulatorDidRemoveFileNotification;
 /// Corresponds to @c BXEmulatorDidRemoveFileNotification.
 - (void) emulatorDidRemoveFile: (NSNotification *)notification;
 
+/// Called on the emulation thread whenever the emulator opens an existing file in the OS X filesystem.
+/// @param fileURL  The location of the file that was actually opened, which for shadowed drives
+///                 may not be the location that the drive asked for.
+- (void) emulator: (BXEmulator *)emulator didOpenFileAtURL: (NSURL *)fileURL;
+
 @end
 
 
@@ -30,6 +30,12 @@ extern NSString * const BXDOSFilesystemErrorDriveKey;
 enum {
     BXEmulatorUnknownError,
     BXEmulatorUnrecoverableError,   //Error code used when DOSBox encounters any kind of unrecoverable error and must quit.
+    BXEmulatorMovieRecordingUnsupported,    //Movie recording is not available on this version of OS X.
+    BXEmulatorStateUnavailable,     //The emulator was not at a point where its state could be saved or restored.
+    BXEmulatorStateIncompatible,    //A saved state was unreadable or made by a different build or configuration.
+    BXEmulatorStateDamaged,         //A saved state was found to be damaged partway through restoring it.
+    BXEmulatorReplayUnreadable,     //An input recording was missing, unreadable or could not be written.
+    BXEmulatorNetplayUnavailable,   //A network game could not be hosted or joined.
 };
 
 //Error constants for BXDOSFilesystemErrorDomain
@@ -16,6 +16,10 @@
 #import "BXEmulator+BXDOSFileSystem.h"
 #import "BXEmulator+BXAudio.h"
 #import "BXEmulator+BXPaste.h"
+#import "BXEmulator+BXRecording.h"
+#import "BXEmulator+BXSaveStates.h"
+#import "BXEmulator+BXRewind.h"
+#import "BXEmulator+BXNetplay.h"
 #import "BXMIDIDevice.h"
 #import "BXVideoHandler.h"
 #import "BXEmulatedKeyboard.h"
@@ -26,6 +30,7 @@
 #import "BXAudioSource.h"
 #import "BXCoalfaceAudio.h"
 #import "BXDrive.h"
+#import "BXStallWatchdog.h"
 #include <stdexcept>
 #include <execinfo.h>
 
@@ -67,6 +72,38 @@ typedef struct BXDriveGeometry {
 /// at all, or it only checks the BIOS keyboard buffer in response to a hardware keyboard event.
 #define BXBIOSKeyBufferPollIntervalCutoff 0.5
 
+/// The shortest time in seconds between deliveries of KVO and notifications posted from the emulation thread.
+/// Changes made in between are coalesced. This is roughly one display frame.
+#define BXPendingChangesDeliveryInterval 1.0 / 60.0
+
+/// The shortest time in seconds between announcing changes to @c dynamicCacheStatistics while the dynamic core is in use.
+#define BXDynamicCacheStatisticsInterval 1.0
+
+/// The shortest time in seconds between announcing changes to @c audioBufferStatistics.
+#define BXAudioBufferStatisticsInterval 1.0
+
+/// How long in seconds the emulation thread may go without finishing a tick before it counts as stalled.
+/// This is several display frames: long enough to be a visible hitch, but short of any deliberate wait.
+#define BXEmulatorStallThreshold 0.1
+
+/// How many of the most recent stalls @c recentStalls keeps hold of.
+#define BXEmulatorMaxRecentStalls 20
+
+/// The shortest time in seconds between draining the autorelease pool for an iteration of DOSBox's run loop.
+#define BXRunLoopPoolDrainInterval 0.1
+
+/// The shortest time in seconds between giving the emulation thread's NSRunLoop a turn while emulating,
+/// for timers and other run loop sources. Posting events to the emulator does not depend on the run loop.
+#define BXRunLoopSweepInterval 1.0 / 60.0
+
+/// The most time in seconds that the emulator will space consecutive input events apart by when
+/// applying them, when they arrived further apart than that. See -_performInputOnEmulationThread:.
+#define BXInputEventMaxSpacing 0.05
+
+/// The longest time in seconds that input will be held back to keep its spacing, before it is
+/// applied regardless: this stops input backing up when emulation is running slower than realtime.
+#define BXInputEventMaxLatency 0.1
+
 /// The process name of the DOSBox COMMAND.COM instance.
 extern NSString * const shellProcessName;
 
@@ -177,15 +214,52 @@ enum {
 /// Called during DOSBox's run loop. Returns NO to short-circuit the loop.
 - (BOOL) _runLoopShouldContinue;
 
-/// Called at the start of each iteration of DOSBox's run loop.
-/// @param contextInfo[out]  Populated with a retained reference to the @c NSAutoreleasePool
-/// for the current iteration of the run loop.
-- (void) _runLoopWillStartWithContextInfo: (out void **)contextInfo;
+/// Called by @c -_runLoopShouldContinue once the emulator has been cancelled by @c -cancelForProcessExit:
+/// saves what needs saving and reports that the emulator has finished, without unwinding DOSBox.
+- (void) _finishForProcessExit;
 
-/// Called at the end of each iteration of DOSBox's run loop.
-/// @param contextInfo  The contextInfo that was provided by @c _runLoopWillStartWithContextInfo:
-///                     (in practice, the @c NSAutoreleasePool for the current iteration of the run loop.)
-- (void) _runLoopDidFinishWithContextInfo: (void *)contextInfo;
+/// Called at the start of each iteration of DOSBox's run loop.
+/// @param contextInfo[in,out]  The context for the current run loop, which is kept across its iterations.
+/// @c NULL on the first iteration, in which case it is populated with a new context holding an
+/// @c NSAutoreleasePool for the run loop.
+- (void) _runLoopWillStartWithContextInfo: (inout void **)contextInfo;
+
+/// Called at the end of each iteration of DOSBox's run loop. The context's autorelease pool is drained
+/// every @c BXRunLoopPoolDrainInterval seconds rather than every iteration, and always when the loop exits.
+/// @param contextInfo[in,out]  The context provided by @c _runLoopWillStartWithContextInfo:.
+/// Reset to @c NULL once the context has been disposed of.
+/// @param exiting      Whether the run loop is about to exit.
+- (void) _runLoopDidFinishWithContextInfo: (inout void **)contextInfo exiting: (BOOL)exiting;
+
+/// Performs the specified block on the emulation thread. If called on the emulation thread, or if the
+/// emulator has not started, the block is performed immediately. Otherwise the block is added to a lock-free
+/// queue that the emulation thread empties each time it processes events: if the emulator is paused
+/// and waiting in its run loop, it will be woken up to perform the block.
+/// Blocks are performed in the order they were posted. Blocks posted after emulation has finished are discarded.
+- (void) _performOnEmulationThread: (dispatch_block_t)block;
+
+/// Performs the specified block on the emulation thread to apply user input to the emulated machine.
+/// The block is stamped with the current host time and posted like @c -_performOnEmulationThread:, except
+/// that input is applied with the same spacing in emulated time that it arrived with in host time (up to
+/// @c BXInputEventMaxSpacing). This means that e.g. a quick click or keypress that arrives while emulation
+/// is busy will still be seen by the game as a separate press and release, rather than landing in the same
+/// emulated millisecond. Input blocks are performed in the order they were posted relative to each other,
+/// but may be performed after other blocks that were posted later.
+- (void) _performInputOnEmulationThread: (dispatch_block_t)block;
+
+/// Performs all the blocks posted by @c -_performOnEmulationThread: so far, along with any input from
+/// @c -_performInputOnEmulationThread: that is now due. Called on the emulation thread.
+- (void) _performPendingEvents;
+
+/// Adds an event to the lock-free list of events waiting for the emulation thread,
+/// and wakes the emulation thread if it is asleep. Takes ownership of the event.
+- (void) _postEvent: (void *)event;
+
+/// Adds an input event to the end of the list of input waiting for its turn. Called on the emulation thread.
+- (void) _deferInputEvent: (void *)event;
+
+/// Performs as much waiting input as is due. Called on the emulation thread.
+- (void) _performDueInputEvents;
 
 /// Convenience method for sending a notification to both the default notification center and to a selector
 /// on the emulator's delegate. The object of the notification will be the @c BXEmulator instance.
@@ -197,9 +271,31 @@ enum {
 /// This resyncs the emulator's cached notions of the DOSBox state and posts notifications properties that have changed.
 - (void) _didChangeEmulationState;
 
+/// Resyncs the emulator's cached notions of the DOSBox state on the main thread on behalf of @c -_didChangeEmulationState.
+- (void) _syncEmulationState;
+
+/// Called by DOSBox when the adaptive core has moved to the dynamic core or back to the normal core.
+/// Posts a @c BXEmulatorDidSwitchAdaptiveCoreNotification.
+- (void) _didSwitchAdaptiveCoreToDynamic: (BOOL)dynamic reason: (NSString *)reason;
+
+/// Delivers a notification to the delegate and the default notification center. Must be called on the main thread.
+- (void) _deliverNotification: (NSNotification *)notification delegateSelector: (SEL)selector;
+
+/// Arranges for KVO and notifications posted off the main thread to be delivered on the main thread.
+/// Does nothing if a delivery is already pending, so that changes made in the meantime are coalesced into it.
+/// Must be called while synchronized on @c _pendingChangedKeys.
+- (void) _schedulePendingChanges;
+
+/// Delivers all pending KVO and notifications on the main thread. Each key that has changed gets a single
+/// will/did pair, however many times it changed since the last delivery.
+- (void) _deliverPendingChanges;
+
 /// Called by videoHandler when each new frame is ready. Passes the frame on to the emulator's delegate.
 - (void) _didFinishFrame: (BXVideoFrame *)frame;
 
+/// Called from @c -_processEvents to announce a change to @c dynamicCacheStatistics whenever one is due.
+- (void) _updateDynamicCacheStatistics;
+
 @end
 
 
@@ -262,11 +358,27 @@ enum {
 
 /// Creates a new DOSBox floppy drive instance from a disk image. This must then be mounted by @c -_addDOSBoxDrive:atIndex:.
 /// @param imagePath        The local filesystem path to the image to mount for the drive.
+/// @param shadowPath       An optional local filesystem path to an overlay file, which will record any changes
+///                         made to the disk in place of modifying the image itself. Pass nil to modify the image directly.
 /// @param outError[out]    If drive creation fails, this will be populated with an error giving the reason for failure.
 /// @return A new DOSBox drive instance, or NULL if drive creation failed.
 - (DOS_Drive *) _floppyDriveFromImageAtPath: (NSString *)imagePath
+                                 shadowPath: (NSString *)shadowPath
                                       error: (NSError **)outError;
 
+/// Creates a new DOSBox drive instance from a zip archive. This must then be mounted by @c -_addDOSBoxDrive:atIndex:.
+/// The archive is never modified: the drive is read-only unless given a shadow folder to record changes in.
+/// @param archivePath      The local filesystem path to the archive to mount for the drive.
+/// @param shadowPath       An optional local filesystem path to a folder which will record any changes made to the drive,
+///                         using the same layout as ADBShadowedFilesystem. Pass nil to make the drive read-only.
+/// @param mediaID          The DOS media descriptor the drive should report, which determines the drive's type.
+/// @param outError[out]    If drive creation fails, this will be populated with an error giving the reason for failure.
+/// @return A new DOSBox drive instance, or NULL if drive creation failed.
+- (DOS_Drive *) _driveFromArchiveAtPath: (NSString *)archivePath
+                             shadowPath: (NSString *)shadowPath
+                                mediaID: (NSUInteger)mediaID
+                                  error: (NSError **)outError;
+
 /// Creates a new DOSBox hard drive instance from a disk image. This must then be mounted by @c -_addDOSBoxDrive:atIndex:.
 /// @param imagePath        The local filesystem path to the image to mount for the drive.
 /// @param outError[out]    If drive creation fails, this will be populated with an error giving the reason for failure.
@@ -414,6 +526,11 @@ enum {
                   onDOSBoxDrive: (DOS_Drive *)dosboxDrive
                          inMode: (const char *)mode;
 
+/// Called by local filesystem drives once a file has been opened, to let the delegate know which file was read.
+/// @param file         The file handle that was opened.
+/// @param mode         The mode in which the file was opened. Files that are created or truncated by opening are ignored.
+- (void) _didOpenLocalFile: (FILE *)file inMode: (const char *)mode;
+
 /// Attempts to delete a file on the local filesystem.
 /// @param localPath    The POSIX path to the file on the local filesystem which should be removed.
 /// @param dosboxDrive  The DOSBox drive from which the file is being deleted.
@@ -471,6 +588,29 @@ enum {
       forLocalPath: (const char *)localPath
      onDOSBoxDrive: (DOS_Drive *)dosboxDrive;
 
+/// Gets a value for the specified directory that changes whenever anything is added to, removed from
+/// or renamed within the directory, so that DOSBox can tell whether its record of the directory is still good.
+/// @param outStamp[out]    If the method returns @c YES, this will be populated with the directory's stamp.
+/// @param localPath        The POSIX path to the directory on the local filesystem.
+/// @param dosboxDrive      The DOSBox drive instance that is asking.
+/// @return @c YES if the directory could be stamped, or @c NO if the drive's filesystem can't vouch for it:
+/// e.g. because it is backed by an image, or because it was modified too recently to be sure of.
+- (BOOL) _getModificationStamp: (out uint64_t *)outStamp
+             forLocalDirectory: (const char *)localPath
+                 onDOSBoxDrive: (DOS_Drive *)dosboxDrive;
+
+/// Resolves a location on the local filesystem to where the drive's filesystem really keeps it,
+/// e.g. in the drive's shadow, and checks whether anything exists there.
+/// @param localPath            The POSIX path on the local filesystem to resolve.
+/// @param dosboxDrive          The DOSBox drive instance that is resolving the path.
+/// @param outExists[out]       Will be set to YES if a file or directory exists at the location, or NO otherwise.
+/// @param outIsDirectory[out]  Will be set to YES if the location exists and is a directory, or NO otherwise.
+/// @return The URL at which the resource can be found, or @c nil if no resource exists at the location.
+- (NSURL *) _resolvedURLForLocalPath: (const char *)localPath
+                       onDOSBoxDrive: (DOS_Drive *)dosboxDrive
+                              exists: (out BOOL *)outExists
+                         isDirectory: (out BOOL *)outIsDirectory;
+
 /// Checks whether a directory exists at a specified location on the local filesystem.
 /// @param localPath        The POSIX path on the local filesystem to check.
 /// @param dosboxDrive      The DOSBox drive instance that is checking for the directory's existence.
@@ -495,6 +635,15 @@ enum {
 - (id <ADBFilesystemFileURLEnumeration>) _directoryEnumeratorForLocalPath: (const char *)path
                                                             onDOSBoxDrive: (DOS_Drive *)dosboxDrive;
 
+/// Checks whether a location on the local filesystem can be read directly with POSIX calls,
+/// rather than going through the drive's filesystem. This is only the case for drives
+/// that are plain folders, whose filesystem doesn't remap any of their contents.
+/// @param localPath    The POSIX path on the local filesystem for the directory to read.
+/// @param dosboxDrive  The DOSBox drive which is reading the location.
+/// @return YES if the location can be read directly, or NO if it must be read through the drive's filesystem.
+- (BOOL) _canReadLocalPathDirectly: (const char *)localPath
+                     onDOSBoxDrive: (DOS_Drive *)dosboxDrive;
+
 @end
 
 
@@ -527,6 +676,7 @@ enum {
               executeCommand: (BOOL *)execute;
 
 /// Called by DOSBox at opportune moments in the shell command process to give Boxer an opportunity to run its own commands.
+/// If more than one command is pending, they are all run together as an in-memory batch file.
 - (BOOL) _executeNextPendingCommand;
 
 /// Whether to display the startup preamble for the specified shell.
@@ -569,6 +719,9 @@ enum {
 /// Resume audio emulation and playback. Called when the emulator is resumed.
 - (void) _resumeAudio;
 
+/// Called from @c -_processEvents to announce a change to @c audioBufferStatistics whenever one is due.
+- (void) _updateAudioBufferStatistics;
+
 /// Used during MIDI input format detection to queue up copies of sysex messages that we received before deciding on a MIDI device.
 /// If a more appropriate MIDI device is later detected, these queued messages will be delivered to the new device.
 /// @note This is primarily for the benefit of MT-32 autodetection: a game may send a sequence of ambiguous MIDI sysex messages
@@ -630,6 +783,23 @@ enum {
 @end
 
 
+#pragma mark - Recording-related internal methods
+
+@interface BXEmulator (BXRecordingInternals)
+
+/// Passes the specified frame on to the movie recorder, if a movie is being recorded.
+/// Called from @c -_didFinishFrame: each time a frame is completed.
+- (void) _recordFrame: (BXVideoFrame *)frame;
+
+/// Passes the specified 16-bit stereo mixer output on to the movie recorder.
+/// Called by DOSBox's mixer each time it mixes new samples while a movie is being recorded.
+- (void) _recordAudioSamples: (const int16_t *)samples
+                      frames: (NSUInteger)numFrames
+                  sampleRate: (NSUInteger)sampleRate;
+
+@end
+
+
 #pragma mark - Paste-related internal methods
 
 @interface BXEmulator (BXPasteInternals)
@@ -649,6 +819,63 @@ enum {
 @end
 
 
+#pragma mark - Rewind-related internal methods
+
+@interface BXEmulator (BXRewindInternals)
+
+/// Called from @c -_processEvents to start or stop the rewind history when its setting has changed,
+/// and to add a frame to it whenever one is due.
+- (void) _updateRewindHistory;
+
+/// Empties the rewind history, for when the machine has been changed in a way that it could not follow.
+- (void) _discardRewindHistory;
+
+/// Drops all but the newest full copy of the machine and the frames after it, for when memory is short.
+- (void) _shrinkRewindHistory;
+
+@end
+
+
+#pragma mark - Save state-related internal methods
+
+@interface BXEmulator (BXSaveStatesSharedInternals)
+
+/// The identifier of this build of Boxer, used to reject snapshots made by other builds.
++ (NSString *) _saveStateBuildIdentifier;
+
+@end
+
+
+#pragma mark - Netplay-related internal methods
+
+@interface BXEmulator (BXNetplayInternals)
+
+/// Called from @c -_processEvents to notice when netplay has stopped, and while waiting for a network game
+/// to start, to exchange whatever is due with the other players and to send or restore the host's machine.
+- (void) _updateNetplay;
+
+/// Leaves any network game in progress, for when this machine is about to be changed
+/// in a way that the other players' machines could not follow.
+- (void) _stopNetplayForRestore;
+
+@end
+
+
+#pragma mark - Performance-related internal methods
+
+@interface BXEmulator (BXPerformanceCountersInternals)
+
+/// Called on the emulation thread when the emulator starts and finishes, to start and stop
+/// watching it for stalls. The watchdog is armed once DOSBox has initialized.
+- (void) _startStallWatchdog;
+- (void) _stopStallWatchdog;
+
+/// Called on the main thread with each stall the watchdog reports, to add it to @c recentStalls.
+- (void) _recordStall: (NSDictionary *)stall;
+
+@end
+
+
 #pragma mark - IO-related methods
 
 @interface BXEmulator (BXParallelInternals)
@@ -6,6 +6,10 @@
  */
 
 //BXExternalMIDIDevice represents a connection to an external MIDI device (such as a real MT-32.)
+//Messages are never sent straight to the device: instead each one is stamped with the time at which
+//the device will be ready for it, allowing for the time it needs to process any sysexes before it,
+//and handed to a serial queue that delivers it to CoreMIDI at that time. This means whoever sends
+//messages to the device never has to wait for the device to catch up.
 
 #import <Foundation/Foundation.h>
 #import <CoreMIDI/MIDIServices.h>
@@ -19,6 +23,15 @@
 //to avoid rapid volume changes flooding the device with messages.
 #define BXVolumeSyncDelay 0.05
 
+//How far ahead of the device we will schedule messages before reporting that the device
+//is still processing. Only a runaway program should upload enough sysex to reach this.
+#define BXExternalMIDIDeviceMaxScheduleAhead 30.0
+
+//How far ahead of the host time at which they arrive to schedule messages that carry an emulated
+//timestamp, so that messages the emulation produces in one burst can be spread back out to the
+//spacing they had in emulated time.
+#define BXExternalMIDIDeviceTimestampLead 0.01
+
 @interface BXExternalMIDIDevice : NSObject <BXMIDIDevice>
 {
 	MIDIPortRef _port;
@@ -27,7 +40,22 @@
     
     NSTimeInterval _secondsPerByte;
     
-    NSDate *_dateWhenReady;
+    //The host time at which the device will have finished processing every message
+    //scheduled so far. Protected by synchronizing on self.
+    MIDITimeStamp _hostTimeWhenReady;
+    //How far ahead of its timestamp the destination wants to be given each packet.
+    MIDITimeStamp _advanceScheduleTime;
+    
+    //The emulated time, in milliseconds, and the host time that correspond to each other
+    //when scheduling timestamped messages. Protected by synchronizing on self.
+    double _emulatedTimeAnchor;
+    MIDITimeStamp _hostTimeAnchor;
+    
+    //The queue on which scheduled messages wait until it's time to send them.
+    dispatch_queue_t _sendQueue;
+    //Signalled to cut short any wait in progress on the send queue when closing.
+    dispatch_semaphore_t _cancelSignal;
+    volatile BOOL _cancelled;
     
     float _volume;
     float _requestedVolume;
@@ -37,8 +65,8 @@
 //The destination this device is connecting to. Set at initialization time.
 @property (readonly, nonatomic) MIDIEndpointRef destination;
 
-//Declared as settable for the benefit of our subclasses
-@property (copy, nonatomic) NSDate *dateWhenReady;
+//The date by which the device will have processed all the messages scheduled so far.
+@property (readonly, nonatomic) NSDate *dateWhenReady;
 
 //The master volume assigned by the application, from 0.0 to 1.0.
 @property (assign, nonatomic) float volume;
@@ -67,6 +95,16 @@
 //directly by other classes unless you know what you're doing.
 - (void) dispatchSysex: (NSData *)sysex;
 
+//Schedules the specified message to be sent once the device has finished with everything
+//before it, and then allows the specified delay for the device to process the message itself.
+//Returns immediately. This is safe to call from any thread.
+- (void) scheduleMessage: (NSData *)message processingDelay: (NSTimeInterval)delay;
+
+//Same as above, but holds the message back until at least the specified host time.
+- (void) scheduleMessage: (NSData *)message
+              atHostTime: (MIDITimeStamp)hostTime
+         processingDelay: (NSTimeInterval)delay;
+
 
 #pragma mark -
 #pragma mark Initializers
@@ -7,6 +7,13 @@
 
 #import "BXExternalMIDIDevice.h"
 #import "BXExternalMIDIDevice+BXGeneralMIDISysexes.h"
+#import <CoreAudio/HostTime.h>
+#import "BXStallWatchdog.h"
+
+//The same length as DOSBox's MIDI message buffer, plus padding for extra data used by the packet list.
+//(Technically a sysex message could be much longer than 1024 bytes, but it would be truncated by DOSBox
+//before it ever reaches us.)
+#define MAX_SYSEX_PACKET_SIZE 1024 * 4
 
 #pragma mark -
 #pragma mark Private method declarations
@@ -26,6 +33,10 @@
 //Calls syncVolume and invalidates the timer.
 - (void) _performVolumeSync: (NSTimer *)timer;
 
+//Called on the send queue to wait until the specified host time, and then send the message
+//to the destination stamped with that time.
+- (void) _sendMessage: (NSData *)message atHostTime: (MIDITimeStamp)hostTime;
+
 @end
 
 
@@ -33,7 +44,6 @@
 #pragma mark Implementation
 
 @implementation BXExternalMIDIDevice
-@synthesize dateWhenReady = _dateWhenReady;
 @synthesize destination = _destination;
 @synthesize volume = _volume;
 @synthesize requestedVolume = _requestedVolume;
@@ -63,8 +73,11 @@
         //Don't use setVolume:, as it will try to send a message.
         _volume = 1.0f;
         _requestedVolume = 1.0f;
-        self.dateWhenReady = [NSDate distantPast];
         _secondsPerByte = BXExternalMIDIDeviceDefaultSysexRate;
+        _hostTimeWhenReady = 0;
+        
+        _sendQueue = dispatch_queue_create("com.boxer.externalmidi", NULL);
+        _cancelSignal = dispatch_semaphore_create(0);
     }
     return self;
 }
@@ -123,7 +136,10 @@
 {
     [self close];
     
-    self.dateWhenReady = nil;
+    dispatch_release(_sendQueue);
+    _sendQueue = NULL;
+    dispatch_release(_cancelSignal);
+    _cancelSignal = NULL;
     
     [super dealloc];
 }
@@ -132,8 +148,21 @@
 {
     if (_port)
     {
-        //Ensure the device stops playing notes when closing
+        //Throw away anything still waiting to be sent, sending only what's already due.
+        _cancelled = YES;
+        dispatch_semaphore_signal(_cancelSignal);
+        BXStallWatchdogBeginCall("closing MIDI device");
+        dispatch_sync(_sendQueue, ^{});
+        @synchronized(self)
+        {
+            _hostTimeWhenReady = 0;
+        }
+        
+        //Ensure the device stops playing notes when closing: these will be due straight away,
+        //so they'll still get sent. Then wait for them to go before we pull the port out from under them.
         [self pause];
+        dispatch_sync(_sendQueue, ^{});
+        BXStallWatchdogEndCall();
         
         MIDIPortDispose(_port);
         _port = (MIDIObjectRef)NULL;
@@ -186,6 +215,17 @@
         _secondsPerByte = 1.0f / (NSTimeInterval)maxSysexSpeed;
     }
     
+    //Determine how early the destination would like to receive scheduled packets:
+    //if it doesn't say, we'll deliver them right on time.
+    SInt32 advanceMicroseconds = 0;
+    errCode = MIDIObjectGetIntegerProperty(destination, kMIDIPropertyAdvanceScheduleTimeMuSec, &advanceMicroseconds);
+    if (errCode == noErr && advanceMicroseconds > 0)
+    {
+        _advanceScheduleTime = AudioConvertNanosToHostTime((UInt64)advanceMicroseconds * 1000);
+    }
+    
+    _cancelled = NO;
+    
     return YES;
 }
 
@@ -255,10 +295,26 @@
     return YES;
 }
 
+- (NSDate *) dateWhenReady
+{
+    MIDITimeStamp now = AudioGetCurrentHostTime();
+    MIDITimeStamp whenReady;
+    @synchronized(self)
+    {
+        whenReady = _hostTimeWhenReady;
+    }
+    
+    if (whenReady <= now) return [NSDate distantPast];
+    
+    NSTimeInterval secondsUntilReady = AudioConvertHostTimeToNanos(whenReady - now) / 1.0e9;
+    return [NSDate dateWithTimeIntervalSinceNow: secondsUntilReady];
+}
+
 - (BOOL) isProcessing
 {
-    //We're still processing if our readiness date is in the future
-    return self.dateWhenReady.timeIntervalSinceNow > 0;
+    //Messages get scheduled for when the device is ready for them, so there's no need
+    //to hold off sending them unless we've got absurdly far ahead of the device.
+    return self.dateWhenReady.timeIntervalSinceNow > BXExternalMIDIDeviceMaxScheduleAhead;
 }
 
 
@@ -267,13 +323,34 @@
     NSAssert(_port && _destination, @"handleMessage: called before successful initialization.");
     NSAssert(message.length > 0, @"0-length message received by handleMessage:");
     
-    UInt8 buffer[sizeof(MIDIPacketList)];
-    MIDIPacketList *packetList = (MIDIPacketList *)buffer;
-	MIDIPacket *currentPacket = MIDIPacketListInit(packetList);
+    [self scheduleMessage: message processingDelay: 0];
+}
+
+- (void) handleMessage: (NSData *)message atEmulatedTime: (double)timestamp
+{
+    NSAssert(_port && _destination, @"handleMessage:atEmulatedTime: called before successful initialization.");
+    NSAssert(message.length > 0, @"0-length message received by handleMessage:atEmulatedTime:");
     
-    MIDIPacketListAdd(packetList, sizeof(buffer), currentPacket, (MIDITimeStamp)0, message.length, (UInt8 *)message.bytes);
+    MIDITimeStamp hostTime;
+    @synchronized(self)
+    {
+        //Play the message as long after the anchor as it fell due after the anchor's emulated time.
+        //Start a new anchor a short way ahead of now whenever that would leave the message due in the past
+        //or too far in the future: i.e. whenever emulation has been paused, throttled or fast-forwarded.
+        MIDITimeStamp now = AudioGetCurrentHostTime();
+        MIDITimeStamp lead = AudioConvertNanosToHostTime((UInt64)(BXExternalMIDIDeviceTimestampLead * 1.0e9));
+        double offset = timestamp - _emulatedTimeAnchor;
+        
+        hostTime = _hostTimeAnchor + AudioConvertNanosToHostTime((UInt64)(MAX(offset, 0.0) * 1.0e6));
+        if (!_hostTimeAnchor || offset < 0 || hostTime < now || hostTime > now + (lead * 2))
+        {
+            _emulatedTimeAnchor = timestamp;
+            _hostTimeAnchor = now + lead;
+            hostTime = _hostTimeAnchor;
+        }
+    }
     
-    MIDISend(_port, _destination, packetList);
+    [self scheduleMessage: message atHostTime: hostTime processingDelay: 0];
 }
 
 - (void) handleSysex: (NSData *)message
@@ -308,26 +385,69 @@
 
 - (void) dispatchSysex: (NSData *)message
 {
-//The same length as DOSBox's MIDI message buffer, plus padding for extra data used by the packet list.
-//(Technically a sysex message could be much longer than 1024 bytes, but it would be truncated by DOSBox
-//before it ever reaches us.)
-#define MAX_SYSEX_PACKET_SIZE 1024 * 4
+    NSAssert(_port && _destination, @"dispatchSysex: called before successful initialization.");
+    NSAssert(message.length > 0, @"0-length message received by dispatchSysex:");
+    
+    //Allow for how long it should take the device to process all that
+    NSTimeInterval processingDelay = [self processingDelayForSysex: message];
+    [self scheduleMessage: message processingDelay: processingDelay];
+}
 
-    NSAssert(_port && _destination, @"handleMessage: called before successful initialization.");
-    NSAssert(message.length > 0, @"0-length message received by handleMessage:");
+- (void) scheduleMessage: (NSData *)message processingDelay: (NSTimeInterval)delay
+{
+    [self scheduleMessage: message atHostTime: 0 processingDelay: delay];
+}
 
+- (void) scheduleMessage: (NSData *)message
+              atHostTime: (MIDITimeStamp)requestedHostTime
+         processingDelay: (NSTimeInterval)delay
+{
+    //The message we've been given may be pointing into DOSBox's own buffer, so take a copy to send later.
+    NSData *messageToSend = [NSData dataWithBytes: message.bytes length: message.length];
+    
+    //Synchronize so that messages from different threads get timestamps in the order they're queued.
+    @synchronized(self)
+    {
+        MIDITimeStamp now = AudioGetCurrentHostTime();
+        MIDITimeStamp hostTime = MAX(MAX(now, requestedHostTime), _hostTimeWhenReady);
+        
+        if (delay > 0)
+            _hostTimeWhenReady = hostTime + AudioConvertNanosToHostTime((UInt64)(delay * 1.0e9));
+        else
+            _hostTimeWhenReady = hostTime;
+        
+        //Don't let the block retain us: close waits for the queue to empty before we go away,
+        //whereas if the block held the last reference we'd be deallocated on our own queue.
+        __block BXExternalMIDIDevice *device = self;
+        dispatch_async(_sendQueue, ^{
+            [device _sendMessage: messageToSend atHostTime: hostTime];
+        });
+    }
+}
+
+- (void) _sendMessage: (NSData *)message atHostTime: (MIDITimeStamp)hostTime
+{
+    //Hand the message over to CoreMIDI as early as the destination wants it.
+    MIDITimeStamp sendTime = (hostTime > _advanceScheduleTime) ? hostTime - _advanceScheduleTime : 0;
+    MIDITimeStamp now = AudioGetCurrentHostTime();
+    if (sendTime > now && !_cancelled)
+    {
+        dispatch_time_t deadline = dispatch_time(DISPATCH_TIME_NOW, (int64_t)AudioConvertHostTimeToNanos(sendTime - now));
+        //Pass the signal on, so that any other waits queued up behind us get cut short too.
+        if (dispatch_semaphore_wait(_cancelSignal, deadline) == 0)
+            dispatch_semaphore_signal(_cancelSignal);
+    }
+    
+    //If we're being closed, drop any messages that weren't due yet.
+    if (_cancelled && hostTime > AudioGetCurrentHostTime()) return;
+    
     UInt8 buffer[MAX_SYSEX_PACKET_SIZE];
     MIDIPacketList *packetList = (MIDIPacketList *)buffer;
 	MIDIPacket *currentPacket = MIDIPacketListInit(packetList);
     
-    MIDIPacketListAdd(packetList, sizeof(buffer), currentPacket, (MIDITimeStamp)0, message.length, (UInt8 *)message.bytes);
+    MIDIPacketListAdd(packetList, sizeof(buffer), currentPacket, hostTime, message.length, (UInt8 *)message.bytes);
     
     MIDISend(_port, _destination, packetList);
-    
-    //Now, calculate how long it should take the device to process all that
-    NSTimeInterval processingDelay = [self processingDelayForSysex: message];
-    if (processingDelay > 0)
-        self.dateWhenReady = [NSDate dateWithTimeIntervalSinceNow: processingDelay];
 }
 
 - (void) pause
@@ -399,13 +519,10 @@
     _volumeSyncTimer = nil;
     
     //Only try to sync the volume if we're still connected.
+    //(There's no need to wait for the device to be ready, since the sync will be scheduled for then.)
     if (_port && _destination)
     {   
-        //If we're still busy processing, then defer the sync until after another delay.
-        if (self.isProcessing)
-            [self scheduleVolumeSync];
-        else
-            [self syncVolume];
+        [self syncVolume];
     }
 }
 
@@ -20,9 +20,11 @@ extern NSString * const BXCDROMFolderType;      //.cdrom
 extern NSString * const BXCuesheetImageType;    //.cue / .inst
 extern NSString * const BXISOImageType;         //.iso / .gog
 extern NSString * const BXCDRImageType;         //.cdr
+extern NSString * const BXCHDImageType;         //.chd
 extern NSString * const BXVirtualPCImageType;   //.vfd
 extern NSString * const BXRawFloppyImageType;   //.ima
 extern NSString * const BXNDIFImageType;        //.img
+extern NSString * const BXZipArchiveType;       //.zip
 
 extern NSString * const BXDiskBundleType;       //Base UTI for .cdmedia
 extern NSString * const BXCDROMImageBundleType;      //.cdmedia
@@ -105,6 +107,26 @@ typedef NS_ENUM(NSInteger, BXExecutableType) {
                            filesystem: (id <ADBFilesystemPathAccess>)filesystem
                                 error: (out NSError **)outError;
 
+
+#pragma mark - Executable type cache
+
+//The types determined by the methods above are cached for the lifetime of the application,
+//keyed by the device, inode, size and modification date of the file: so a file that is
+//replaced or modified will be read again, while a file that has merely been renamed won't.
+//Files whose attributes don't include all of these, such as those inside disk images, are
+//read every time.
+
+//Determines the types of all the EXE files directly within the specified directory that aren't
+//already cached, reading their headers in parallel where the filesystem allows it, and caches them.
+//Returns the cache entries for every EXE in the directory whose type is known, in the format
+//taken by addCachedExecutableTypes:. This is used to warm the cache ahead of a scan.
++ (NSDictionary *) cacheTypesOfExecutablesInDirectory: (NSString *)path
+                                           filesystem: (id <ADBFilesystemPathAccess>)filesystem;
+
+//Adds previously-returned cache entries back into the cache, such as ones persisted in a gamebox.
+//Ignores any that are malformed.
++ (void) addCachedExecutableTypes: (NSDictionary *)entries;
+
 @end
 
 
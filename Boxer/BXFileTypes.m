@@ -25,9 +25,11 @@ NSString * const BXCDROMFolderType      = @"net.washboardabs.boxer-cdrom-folder"
 NSString * const BXCuesheetImageType    = @"com.goldenhawk.cdrwin-cuesheet";
 NSString * const BXISOImageType         = @"public.iso-image";
 NSString * const BXCDRImageType         = @"com.apple.disk-image-cdr";
+NSString * const BXCHDImageType         = @"net.mamedev.chd-image";
 NSString * const BXVirtualPCImageType   = @"com.microsoft.virtualpc-disk-image";
 NSString * const BXRawFloppyImageType   = @"com.winimage.raw-disk-image";
 NSString * const BXNDIFImageType        = @"com.apple.disk-image-ndif";
+NSString * const BXZipArchiveType       = @"public.zip-archive";
 
 NSString * const BXDiskBundleType       = @"net.washboardabs.boxer-disk-bundle";
 NSString * const BXCDROMImageBundleType = @"net.washboardabs.boxer-cdrom-bundle";
@@ -48,6 +50,7 @@ NSString * const BXDOCFileType      = @"com.microsoft.word.doc";
     dispatch_once(&onceToken, ^{
         types = [[NSSet alloc] initWithObjects:
                  BXHardDiskFolderType,
+                 BXZipArchiveType,
                  nil];
     });
 	return types;
@@ -64,6 +67,7 @@ NSString * const BXDOCFileType      = @"com.microsoft.word.doc";
                  BXCDROMImageBundleType,
                  BXISOImageType,
                  BXCDRImageType,
+                 BXCHDImageType,
                  nil];
     });
 	return types;
@@ -106,9 +110,11 @@ NSString * const BXDOCFileType      = @"com.microsoft.word.doc";
                  BXISOImageType,
                  BXCDRImageType,
                  BXCuesheetImageType,
+                 BXCHDImageType,
                  BXRawFloppyImageType,
                  BXVirtualPCImageType,
                  BXNDIFImageType,
+                 BXZipArchiveType,
                  nil];
     });
 	return types;
@@ -232,12 +238,30 @@ NSString * const BXDOCFileType      = @"com.microsoft.word.doc";
 
 NSString * const BXExecutableTypesErrorDomain = @"BXExecutableTypesErrorDomain";
 
+@interface BXFileTypes (BXExecutableTypeCachePrivate)
+
+//Returns the key under which to cache the type of a file with the specified attributes,
+//or nil if the attributes don't identify the file well enough to cache it.
++ (NSString *) _executableTypeCacheKeyForAttributes: (NSDictionary *)attributes;
+
+//Returns the cached type for the specified key, or BXExecutableTypeUnknown if none is cached.
++ (BXExecutableType) _cachedExecutableTypeForKey: (NSString *)key;
++ (void) _cacheExecutableType: (BXExecutableType)type forKey: (NSString *)key;
+
+@end
+
 @implementation BXFileTypes (BXExecutableTypes)
 
 + (BXExecutableType) typeOfExecutableAtURL: (NSURL *)URL error: (NSError **)outError
 {
 	NSAssert(URL != nil, @"No URL specified!");
     
+    NSDictionary *attributes = [[NSFileManager defaultManager] attributesOfItemAtPath: URL.path error: NULL];
+    NSString *cacheKey = [self _executableTypeCacheKeyForAttributes: attributes];
+    BXExecutableType cachedType = [self _cachedExecutableTypeForKey: cacheKey];
+    if (cachedType != BXExecutableTypeUnknown)
+        return cachedType;
+    
     NSError *openError;
     ADBFileHandle *handle = [ADBFileHandle handleForURL: URL options: ADBOpenForReading error: &openError];
     if (handle)
@@ -245,6 +269,8 @@ NSString * const BXExecutableTypesErrorDomain = @"BXExecutableTypesErrorDomain";
         BXExecutableType type = [BXFileTypes typeOfExecutableInStream: handle error: outError];
         if ([handle conformsToProtocol: @protocol(ADBFileHandleAccess)])
             [(id <ADBFileHandleAccess>)handle close];
+        
+        [self _cacheExecutableType: type forKey: cacheKey];
         return type;
     }
     else
@@ -268,6 +294,11 @@ NSString * const BXExecutableTypesErrorDomain = @"BXExecutableTypesErrorDomain";
 	NSAssert(path != nil, @"No URL specified!");
 	NSAssert(filesystem != nil, @"No filesystem specified!");
     
+    NSString *cacheKey = [self _executableTypeCacheKeyForAttributes: [filesystem attributesOfFileAtPath: path error: NULL]];
+    BXExecutableType cachedType = [self _cachedExecutableTypeForKey: cacheKey];
+    if (cachedType != BXExecutableTypeUnknown)
+        return cachedType;
+    
     NSError *openError = nil;
     id <ADBReadable, ADBSeekable> handle = [filesystem fileHandleAtPath: path options: ADBOpenForReading error: &openError];
     if (handle)
@@ -275,6 +306,8 @@ NSString * const BXExecutableTypesErrorDomain = @"BXExecutableTypesErrorDomain";
         BXExecutableType type = [BXFileTypes typeOfExecutableInStream: handle error: outError];
         if ([handle conformsToProtocol: @protocol(ADBFileHandleAccess)])
             [(id <ADBFileHandleAccess>)handle close];
+        
+        [self _cacheExecutableType: type forKey: cacheKey];
         return type;
     }
     else
@@ -470,6 +503,141 @@ NSString * const BXExecutableTypesErrorDomain = @"BXExecutableTypesErrorDomain";
 	return NO;
 }
 
+
+#pragma mark - Executable type cache
+
++ (NSMutableDictionary *) _executableTypeCache
+{
+    static NSMutableDictionary *cache;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        cache = [[NSMutableDictionary alloc] init];
+    });
+    return cache;
+}
+
++ (NSString *) _executableTypeCacheKeyForAttributes: (NSDictionary *)attributes
+{
+    NSNumber *device        = [attributes objectForKey: NSFileSystemNumber];
+    NSNumber *inode         = [attributes objectForKey: NSFileSystemFileNumber];
+    NSNumber *size          = [attributes objectForKey: NSFileSize];
+    NSDate *modificationDate = [attributes objectForKey: NSFileModificationDate];
+    
+    if (!device || !inode || !size || !modificationDate)
+        return nil;
+    
+    return [NSString stringWithFormat: @"%llu:%llu:%llu:%.0f",
+            device.unsignedLongLongValue,
+            inode.unsignedLongLongValue,
+            size.unsignedLongLongValue,
+            modificationDate.timeIntervalSinceReferenceDate];
+}
+
++ (BXExecutableType) _cachedExecutableTypeForKey: (NSString *)key
+{
+    if (!key) return BXExecutableTypeUnknown;
+    
+    NSMutableDictionary *cache = [self _executableTypeCache];
+    @synchronized(cache)
+    {
+        return [[cache objectForKey: key] integerValue];
+    }
+}
+
+//Types that couldn't be determined aren't cached, since the file may just have been unreadable at the time.
++ (void) _cacheExecutableType: (BXExecutableType)type forKey: (NSString *)key
+{
+    if (!key || type == BXExecutableTypeUnknown) return;
+    
+    NSMutableDictionary *cache = [self _executableTypeCache];
+    @synchronized(cache)
+    {
+        [cache setObject: @(type) forKey: key];
+    }
+}
+
++ (void) addCachedExecutableTypes: (NSDictionary *)entries
+{
+    if (![entries isKindOfClass: [NSDictionary class]]) return;
+    
+    for (NSString *key in entries)
+    {
+        NSNumber *type = [entries objectForKey: key];
+        if ([key isKindOfClass: [NSString class]] && [type isKindOfClass: [NSNumber class]])
+            [self _cacheExecutableType: type.integerValue forKey: key];
+    }
+}
+
++ (NSDictionary *) cacheTypesOfExecutablesInDirectory: (NSString *)path
+                                           filesystem: (id <ADBFilesystemPathAccess>)filesystem
+{
+    NSMutableDictionary *entries = [NSMutableDictionary dictionary];
+    NSMutableArray *uncachedPaths = [NSMutableArray array];
+    NSMutableArray *uncachedKeys = [NSMutableArray array];
+    
+    id <ADBFilesystemPathEnumeration> enumerator = [filesystem enumeratorAtPath: path
+                                                                        options: NSDirectoryEnumerationSkipsSubdirectoryDescendants | NSDirectoryEnumerationSkipsHiddenFiles
+                                                                   errorHandler: NULL];
+    
+    NSString *filePath;
+    while ((filePath = enumerator.nextObject))
+    {
+        if (![filesystem fileAtPath: filePath conformsToType: BXEXEProgramType])
+            continue;
+        
+        //Files we can't key can't be cached, so there's no point reading them ahead of time.
+        NSString *key = [self _executableTypeCacheKeyForAttributes: enumerator.fileAttributes];
+        if (!key)
+            continue;
+        
+        BXExecutableType type = [self _cachedExecutableTypeForKey: key];
+        if (type != BXExecutableTypeUnknown)
+        {
+            [entries setObject: @(type) forKey: key];
+        }
+        else
+        {
+            [uncachedPaths addObject: filePath];
+            [uncachedKeys addObject: key];
+        }
+    }
+    
+    NSUInteger numUncached = uncachedPaths.count;
+    if (numUncached)
+    {
+        BXExecutableType *types = calloc(numUncached, sizeof(BXExecutableType));
+        
+        //Files on the local filesystem can be read concurrently; image-backed filesystems
+        //read through a single handle onto the image, so those are read one at a time.
+        void (^readType)(size_t) = ^(size_t i) {
+            NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+            NSString *uncachedPath = [uncachedPaths objectAtIndex: i];
+            types[i] = [self typeOfExecutableAtPath: uncachedPath filesystem: filesystem error: NULL];
+            [pool drain];
+        };
+        
+        if ([filesystem isKindOfClass: [ADBLocalFilesystem class]])
+        {
+            dispatch_apply(numUncached, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), readType);
+        }
+        else
+        {
+            for (size_t i = 0; i < numUncached; i++)
+                readType(i);
+        }
+        
+        for (NSUInteger i = 0; i < numUncached; i++)
+        {
+            if (types[i] != BXExecutableTypeUnknown)
+                [entries setObject: @(types[i]) forKey: [uncachedKeys objectAtIndex: i]];
+        }
+        
+        free(types);
+    }
+    
+    return entries;
+}
+
 @end
 
 
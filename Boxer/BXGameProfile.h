@@ -55,6 +55,8 @@ extern NSString * const BXGenericProfileIdentifier;
     BOOL _shouldImportMountCommands;
     BOOL _shouldImportLaunchCommands;
     BOOL _shouldImportSettings;
+    
+    NSDictionary *_recommendedSettings;
 }
 
 #pragma mark -
@@ -125,6 +127,11 @@ extern NSString * const BXGenericProfileIdentifier;
 @property (assign, nonatomic) BOOL shouldImportLaunchCommands;
 @property (assign, nonatomic) BOOL shouldImportSettings;
 
+//Performance settings recommended for this game, learned from how it has run in practice:
+//see BXPerformanceTelemetry for the keys. Used for gameboxes that have no record of their own yet.
+//Will be nil if the profile has no recommendations.
+@property (copy, nonatomic) NSDictionary *recommendedSettings;
+
 #pragma mark -
 #pragma mark Helper class methods
 
@@ -175,6 +182,16 @@ extern NSString * const BXGenericProfileIdentifier;
 + (id) profileMatchingPath: (NSString *)basePath
               inFilesystem: (id <ADBFilesystemPathAccess>)filesystem;
 
+//Returns the GameProfiles.plist-format dictionary of the profile whose telltales match the specified path,
+//or nil if no matching profile is found. If outTier is provided, it will be populated with the priority
+//tier of the match: 0 for game-specific profiles, and higher numbers for progressively more generic ones.
+//Unlike profileMatchingPath:inFilesystem: this creates no profile, so is suited to checking many paths in one pass.
++ (NSDictionary *) profileDataMatchingPath: (NSString *)path tier: (NSUInteger *)outTier;
+
+//Builds the lookup tables used for profile detection ahead of time, so that the first scan doesn't pay for it.
+//Called at application launch; safe to call from any thread.
++ (void) prepareProfileCatalogue;
+
 //Returns an enumerator of all game profiles detected by traversing the specified enumerator.
 //(As a convenience this returns an enumerator instead of an array, so that scanning can be
 //terminated prematurely without the cost of a full filesystem search.)
@@ -7,9 +7,11 @@
 
 
 #import "BXGameProfile.h"
+#import "BXGameProfileCatalogue.h"
 #import "BXDrive.h"
 #import "ADBScanOperation.h"
 #import "ADBFilesystem.h"
+#import "BXPerformanceTelemetry.h"
 
 NSString * const BXGenericProfileIdentifier = @"net.washboardabs.generic";
 
@@ -35,20 +37,10 @@ NSString * const BXInvalidGameDateThreshold = @"1981-01-01 00:00:00 +0000";
 @property (retain, nonatomic) NSDictionary *driveLabelMappings;
 
 //Loads, caches and returns the contents of GameProfiles.plist to avoid multiple hits to the filesystem.
+//Only used by genericProfiles and specificGameProfiles: everything else goes through BXGameProfileCatalogue,
+//which doesn't need the whole plist in memory.
 + (NSDictionary *) _gameProfileData;
 
-//Generates, caches and returns a dictionary of identifier -> profile lookups.
-//Used by profileWithIdentifier:
-+ (NSDictionary *) _identifierIndex;
-
-//Generates, caches and returns an array of lookup tables in order of priority.
-//Used by detectedProfileForPath: to perform detection in multiple passes of the file hierarchy.
-+ (NSArray *) _lookupTables;
-
-//Generates and returns a lookup table of filename->profile mappings for the specified set of profiles.
-//Used by _lookupTables.
-+ (NSDictionary *) _lookupTableForProfiles: (NSArray *)profiles;
-
 @end
 
 
@@ -73,6 +65,7 @@ NSString * const BXInvalidGameDateThreshold = @"1981-01-01 00:00:00 +0000";
 @synthesize shouldImportLaunchCommands = _shouldImportLaunchCommands;
 @synthesize shouldImportSettings = _shouldImportSettings;
 @synthesize preferredInstallationFolderPath = _preferredInstallationFolderPath;
+@synthesize recommendedSettings = _recommendedSettings;
 
 + (BXReleaseMedium) mediumOfGameAtURL: (NSURL *)baseURL
 {
@@ -126,7 +119,7 @@ NSString * const BXInvalidGameDateThreshold = @"1981-01-01 00:00:00 +0000";
 
 + (NSString *) catalogueVersion
 {
-    return [[self _gameProfileData] objectForKey: @"BXGameProfileCatalogueVersion"];
+    return [BXGameProfileCatalogue sharedCatalogue].catalogueVersion;
 }
 + (NSArray *) genericProfiles
 {
@@ -154,7 +147,7 @@ NSString * const BXInvalidGameDateThreshold = @"1981-01-01 00:00:00 +0000";
     }
     else
     {
-        NSDictionary *profileData = [[self _identifierIndex] objectForKey: identifier];
+        NSDictionary *profileData = [[BXGameProfileCatalogue sharedCatalogue] profileDataWithIdentifier: identifier];
         if (profileData) return [[[self alloc] initWithDictionary: profileData] autorelease];
         else return nil;
     }
@@ -164,68 +157,85 @@ NSString * const BXInvalidGameDateThreshold = @"1981-01-01 00:00:00 +0000";
              searchSubfolders: (BOOL)searchSubfolders
 {
 	NSFileManager *manager	= [NSFileManager defaultManager];
-	NSDictionary *matchingProfile;
-	
-	//lookupTables is divided into separate sets of profiles in order of priority: game-specific
-	//profiles followed by generic profiles.
+	NSDictionary *bestMatch = nil;
+    NSUInteger bestTier = NSNotFound;
 	
-	//We check the entire filesystem for one set of profiles first, before starting on the next:
-	//This allows game-specific profiles to override generic ones that would otherwise match sooner.
-	for (NSDictionary *lookups in [self _lookupTables])
-	{
-		NSDirectoryEnumerator *enumerator = [manager enumeratorAtPath: basePath];
-		for (NSString *path in enumerator)
-		{
-			//Don't descend into any subfolders if not asked to
-			if (!searchSubfolders) [enumerator skipDescendents];
-			
-			//First check for an exact filename match
-			NSString *fileName	= path.lastPathComponent.lowercaseString;
-			if ((matchingProfile = [lookups objectForKey: fileName]))
-				return [[[self alloc] initWithDictionary: matchingProfile] autorelease];
-			
-			//Next, check if the base filename (sans extension) matches anything
-			//TODO: eliminate this branch, and just use explicit filenames in the profile telltales.
-			NSString *baseName	= [fileName.stringByDeletingPathExtension stringByAppendingString: @".*"];
-			if ((matchingProfile = [lookups objectForKey: baseName]))
-				return [[[self alloc] initWithDictionary: matchingProfile] autorelease];
-		}
-	}
+	//Check the whole hierarchy in a single pass, keeping the earliest match from the most specific tier:
+	//this allows game-specific profiles to override generic ones that would otherwise match sooner.
+    NSDirectoryEnumerator *enumerator = [manager enumeratorAtPath: basePath];
+    for (NSString *path in enumerator)
+    {
+        //Don't descend into any subfolders if not asked to
+        if (!searchSubfolders) [enumerator skipDescendents];
+        
+        NSUInteger tier;
+        NSDictionary *matchingProfile = [self profileDataMatchingPath: path tier: &tier];
+        if (matchingProfile && tier < bestTier)
+        {
+            bestMatch = matchingProfile;
+            bestTier = tier;
+            
+            //Nothing can beat a game-specific match, so stop looking.
+            if (bestTier == 0) break;
+        }
+    }
 	
-	return nil;
+	if (bestMatch)
+        return [[[self alloc] initWithDictionary: bestMatch] autorelease];
+    else
+        return nil;
 }
 
-+ (BXGameProfile *) profileMatchingPath: (NSString *)path
-                           inFilesystem: (id<ADBFilesystemPathAccess>)filesystem
++ (NSDictionary *) profileDataMatchingPath: (NSString *)path tier: (NSUInteger *)outTier
 {
-    NSArray *lookupTables = [self _lookupTables];
-    NSUInteger numLookups = lookupTables.count;
+    BXGameProfileCatalogue *catalogue = [BXGameProfileCatalogue sharedCatalogue];
     
+    //First check for an exact filename match, then check if the base filename (sans extension) matches anything.
+    //TODO: eliminate the second check, and just use explicit filenames in the profile telltales.
     NSString *filename = path.lastPathComponent.lowercaseString;
+    NSUInteger tier = NSNotFound;
+    NSDictionary *match = [catalogue profileDataForTelltale: filename tier: &tier];
+    
     NSString *wildcardFilename = [filename.stringByDeletingPathExtension stringByAppendingString: @".*"];
+    NSUInteger wildcardTier = NSNotFound;
+    NSDictionary *wildcardMatch = [catalogue profileDataForTelltale: wildcardFilename tier: &wildcardTier];
     
-    for (NSUInteger i=0; i<numLookups; i++)
+    //A wildcard match only wins if it comes from a more specific tier than the exact match.
+    if (wildcardMatch && (!match || wildcardTier < tier))
     {
-        NSDictionary *lookups = [lookupTables objectAtIndex: i];
-        NSDictionary *matchingProfile = [lookups objectForKey: filename];
-        if (!matchingProfile)
-            matchingProfile = [lookups objectForKey: wildcardFilename];
+        match = wildcardMatch;
+        tier = wildcardTier;
+    }
+    
+    if (match && outTier)
+        *outTier = tier;
+    
+    return match;
+}
+
++ (BXGameProfile *) profileMatchingPath: (NSString *)path
+                           inFilesystem: (id<ADBFilesystemPathAccess>)filesystem
+{
+    NSUInteger tier;
+    NSDictionary *matchingProfile = [self profileDataMatchingPath: path tier: &tier];
+    if (matchingProfile)
+    {
+        //Give more specific tiers higher priority than more generic ones.
+        NSUInteger priorityMultiplier = [BXGameProfileCatalogue sharedCatalogue].numTiers - tier;
         
-        if (matchingProfile)
-        {
-            //Give earlier lookup tables higher priority than later ones:
-            //our lookup tables are ordered from most specific to most generic.
-            NSUInteger priorityMultiplier = numLookups - i;
-            
-            BXGameProfile *profile = [[self alloc] initWithDictionary: matchingProfile];
-            profile.priority *= priorityMultiplier;
-            
-            return [profile autorelease];
-        }
+        BXGameProfile *profile = [[self alloc] initWithDictionary: matchingProfile];
+        profile.priority *= priorityMultiplier;
+        
+        return [profile autorelease];
     }
     return nil;
 }
 
++ (void) prepareProfileCatalogue
+{
+    [BXGameProfileCatalogue sharedCatalogue];
+}
+
 + (NSEnumerator *) profilesDetectedInContentsOfEnumerator: (id <ADBFilesystemPathEnumeration>)enumerator
 {
     ADBScanCallback callback = ^id(NSString *path, BOOL *outStop) {
@@ -333,6 +343,9 @@ NSString * const BXInvalidGameDateThreshold = @"1981-01-01 00:00:00 +0000";
 		
 		//Used by volumeLabelForDrive:
 		self.driveLabelMappings	= [profileDict objectForKey: @"BXProfileDriveLabels"];
+        
+        //Used by BXSession to seed the performance settings of new gameboxes
+        self.recommendedSettings = [profileDict objectForKey: BXProfileRecommendedSettingsKey];
 	}
 	return self;
 }
@@ -348,6 +361,7 @@ NSString * const BXInvalidGameDateThreshold = @"1981-01-01 00:00:00 +0000";
     self.installerPatterns = nil;
     self.ignoredInstallerPatterns = nil;
     self.preferredInstallationFolderPath = nil;
+    self.recommendedSettings = nil;
 	
 	[super dealloc];
 }
@@ -417,60 +431,4 @@ NSString * const BXInvalidGameDateThreshold = @"1981-01-01 00:00:00 +0000";
 	return dict;
 }
 
-+ (NSDictionary *) _identifierIndex
-{
-    static NSMutableDictionary *lookups;
-    static dispatch_once_t onceToken;
-    dispatch_once(&onceToken, ^{
-        lookups = [[NSMutableDictionary alloc] initWithCapacity: 200];
-        for (NSDictionary *profile in [self specificGameProfiles])
-        {
-            NSString *identifier = [profile objectForKey: @"BXProfileIdentifier"];
-            if (identifier)
-            {
-                NSAssert1([lookups objectForKey: identifier] == nil, @"Duplicate profile identifier: %@", identifier);
-                [lookups setObject: profile forKey: identifier];
-            }
-        }
-        
-        for (NSDictionary *profile in [self genericProfiles])
-        {
-            NSString *identifier = [profile objectForKey: @"BXProfileIdentifier"];
-            if (identifier)
-            {
-                NSAssert1([lookups objectForKey: identifier] == nil, @"Duplicate profile identifier: %@", identifier);
-                [lookups setObject: profile forKey: identifier];
-            }
-        }
-    });
-    return lookups;
-}
-
-+ (NSArray *) _lookupTables
-{
-	static NSArray *lookupTables;
-    static dispatch_once_t onceToken;
-    dispatch_once(&onceToken, ^{
-		lookupTables = [[NSArray alloc] initWithObjects:
-						[self _lookupTableForProfiles: [self specificGameProfiles]],
-						[self _lookupTableForProfiles: [self genericProfiles]],
-						nil];
-	});
-	return lookupTables;
-}
-							   
-+ (NSDictionary *) _lookupTableForProfiles: (NSArray *)profiles
-{
-	NSMutableDictionary *lookups = [[NSMutableDictionary alloc] initWithCapacity: 200];
-	for (NSDictionary *profile in profiles)
-	{
-		for (NSString *telltale in [profile objectForKey: @"BXProfileTelltales"])
-        {
-            NSAssert1([lookups objectForKey: telltale] == nil, @"Duplicate profile telltale: %@", telltale);
-            [lookups setObject: profile forKey: telltale];
-        }
-	}
-	return [lookups autorelease];
-}
-
 @end
@@ -0,0 +1,59 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+
+//BXGameProfileCatalogue looks up the profiles in GameProfiles.plist without parsing the whole plist.
+//The first time a given version of the plist is used, it is compiled into a binary index in the
+//user's caches folder: sorted tables of telltales and of identifiers, pointing at each profile's
+//own small binary plist. After that the index is just mapped into memory, and a profile's
+//dictionary is only decoded once something actually asks for it.
+
+#import <Foundation/Foundation.h>
+
+@interface BXGameProfileCatalogue : NSObject
+{
+    NSData *_indexData;
+    NSString *_catalogueVersion;
+    NSMutableDictionary *_decodedProfiles;
+}
+
+#pragma mark - Properties
+
+//The BXGameProfileCatalogueVersion of the plist the catalogue was compiled from.
+@property (readonly, nonatomic) NSString *catalogueVersion;
+
+//The number of priority tiers the profiles are divided into: game-specific profiles are
+//tier 0, and generic profiles come after them.
+@property (readonly, nonatomic) NSUInteger numTiers;
+
+
+#pragma mark - Initialization
+
+//Returns the catalogue for the application's own GameProfiles.plist, loading or compiling it
+//on first use. Safe to call from any thread. Returns nil if the plist could not be read.
++ (BXGameProfileCatalogue *) sharedCatalogue;
+
+//Returns a catalogue for the profile plist at the specified URL. The compiled index is loaded
+//from indexURL if one there is up to date with the plist, and is otherwise compiled and saved
+//there. indexURL may be nil, in which case the index is just compiled into memory.
+//Returns nil if the plist could not be read.
+- (id) initWithContentsOfURL: (NSURL *)profilesURL indexURL: (NSURL *)indexURL;
+
+
+#pragma mark - Looking up profiles
+
+//Returns the GameProfiles.plist-format dictionary of the profile with the specified identifier,
+//or nil if there is no such profile.
+- (NSDictionary *) profileDataWithIdentifier: (NSString *)identifier;
+
+//Returns the GameProfiles.plist-format dictionary of the profile that claims the specified
+//lowercase telltale filename, or nil if no profile does. If a telltale is claimed in more than
+//one tier, the most specific tier wins. If outTier is provided, it will be populated with the
+//tier of the profile.
+- (NSDictionary *) profileDataForTelltale: (NSString *)telltale tier: (NSUInteger *)outTier;
+
+@end
@@ -0,0 +1,462 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+
+#import "BXGameProfileCatalogue.h"
+
+
+#pragma mark - Index format
+
+//The compiled index is laid out as a header, followed by the profile table, the identifier table,
+//the telltale table, each profile's binary plist and finally a pool of NUL-terminated UTF-8 strings.
+//Offsets are all in bytes from the start of the index. The index is only ever read on the machine
+//that wrote it, so values are stored in the host's byte order.
+
+#define BXProfileIndexMagic 0x43505842 //'BXPC'
+#define BXProfileIndexFormatVersion 1
+
+//The profile sets in GameProfiles.plist, in order of priority: each one is a tier.
+#define BXProfileIndexNumTiers 2
+static NSString * const BXProfileIndexTierKeys[BXProfileIndexNumTiers] = {
+    @"BXSpecificGameProfiles",
+    @"BXGenericProfiles",
+};
+
+typedef struct {
+    uint32_t magic;
+    uint32_t formatVersion;
+
+    //The size and modification time of the plist the index was compiled from, to tell when it's stale.
+    uint64_t sourceSize;
+    int64_t sourceModificationTime;
+
+    uint32_t catalogueVersionOffset;
+
+    uint32_t numProfiles;
+    uint32_t profilesOffset;
+
+    //The numbers of the profiles that have identifiers, sorted by identifier.
+    uint32_t numIdentifiers;
+    uint32_t identifiersOffset;
+
+    //Sorted by telltale.
+    uint32_t numTelltales;
+    uint32_t telltalesOffset;
+
+    uint32_t padding;
+} BXProfileIndexHeader;
+
+typedef struct {
+    uint32_t identifierOffset;
+    uint32_t dataOffset;
+    uint32_t dataLength;
+    uint32_t tier;
+} BXProfileIndexProfile;
+
+typedef struct {
+    uint32_t telltaleOffset;
+    uint32_t profileNumber;
+} BXProfileIndexTelltale;
+
+
+#pragma mark - Private interface declarations
+
+@interface BXGameProfileCatalogue ()
+
+//Returns whether the specified index data is well-formed and was compiled from a plist of the specified size and date.
++ (BOOL) _isValidIndex: (NSData *)indexData sourceSize: (uint64_t)size sourceModificationTime: (int64_t)modificationTime;
+
+//Compiles the specified GameProfiles.plist contents into an index. Returns nil if there was nothing to compile.
++ (NSData *) _indexForProfiles: (NSDictionary *)profiles sourceSize: (uint64_t)size sourceModificationTime: (int64_t)modificationTime;
+
+//Returns the string at the specified offset in the index, or NULL if the offset is out of bounds.
+- (const char *) _stringAtOffset: (uint32_t)offset;
+
+//Returns the decoded dictionary of the specified profile, decoding it if this is the first time it was asked for.
+- (NSDictionary *) _profileDataForProfileNumber: (uint32_t)profileNumber;
+
+@end
+
+
+#pragma mark - Implementation
+
+@implementation BXGameProfileCatalogue
+@synthesize catalogueVersion = _catalogueVersion;
+
++ (BXGameProfileCatalogue *) sharedCatalogue
+{
+    static BXGameProfileCatalogue *catalogue = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        NSURL *profilesURL = [[NSBundle mainBundle] URLForResource: @"GameProfiles" withExtension: @"plist"];
+
+        //Keep the index in a caches folder of our own, since it can always be compiled again.
+        NSURL *indexURL = nil;
+        NSURL *cachesURL = [[NSFileManager defaultManager] URLsForDirectory: NSCachesDirectory
+                                                                  inDomains: NSUserDomainMask].lastObject;
+        NSString *bundleIdentifier = [NSBundle mainBundle].bundleIdentifier;
+        if (cachesURL && bundleIdentifier)
+        {
+            indexURL = [[cachesURL URLByAppendingPathComponent: bundleIdentifier] URLByAppendingPathComponent: @"GameProfiles.index"];
+        }
+
+        if (profilesURL)
+            catalogue = [[self alloc] initWithContentsOfURL: profilesURL indexURL: indexURL];
+    });
+    return catalogue;
+}
+
+- (id) initWithContentsOfURL: (NSURL *)profilesURL indexURL: (NSURL *)indexURL
+{
+    self = [self init];
+    if (self)
+    {
+        NSDictionary *attrs = [profilesURL resourceValuesForKeys: @[NSURLFileSizeKey, NSURLContentModificationDateKey] error: NULL];
+        uint64_t size = [[attrs objectForKey: NSURLFileSizeKey] unsignedLongLongValue];
+        int64_t modificationTime = (int64_t)[[attrs objectForKey: NSURLContentModificationDateKey] timeIntervalSinceReferenceDate];
+
+        //Map the existing index if it's still up to date: this leaves the profiles themselves on disk until they're needed.
+        if (indexURL)
+        {
+            NSData *indexData = [NSData dataWithContentsOfURL: indexURL options: NSDataReadingMappedAlways error: NULL];
+            if (indexData && [self.class _isValidIndex: indexData sourceSize: size sourceModificationTime: modificationTime])
+                _indexData = [indexData retain];
+        }
+
+        //Otherwise, compile a new one from the plist and save it for next time.
+        if (!_indexData)
+        {
+            NSDictionary *profiles = [NSDictionary dictionaryWithContentsOfURL: profilesURL];
+            NSData *indexData = [self.class _indexForProfiles: profiles sourceSize: size sourceModificationTime: modificationTime];
+
+            if (!indexData)
+            {
+                [self release];
+                return nil;
+            }
+
+            if (indexURL)
+            {
+                [[NSFileManager defaultManager] createDirectoryAtURL: indexURL.URLByDeletingLastPathComponent
+                                         withIntermediateDirectories: YES
+                                                          attributes: nil
+                                                               error: NULL];
+                [indexData writeToURL: indexURL atomically: YES];
+            }
+            _indexData = [indexData retain];
+        }
+
+        const BXProfileIndexHeader *header = (const BXProfileIndexHeader *)_indexData.bytes;
+        const char *version = [self _stringAtOffset: header->catalogueVersionOffset];
+        if (version)
+            _catalogueVersion = [[NSString alloc] initWithUTF8String: version];
+
+        _decodedProfiles = [[NSMutableDictionary alloc] initWithCapacity: 16];
+    }
+    return self;
+}
+
+- (void) dealloc
+{
+    [_indexData release], _indexData = nil;
+    [_catalogueVersion release], _catalogueVersion = nil;
+    [_decodedProfiles release], _decodedProfiles = nil;
+
+    [super dealloc];
+}
+
+- (NSUInteger) numTiers
+{
+    return BXProfileIndexNumTiers;
+}
+
+
+#pragma mark - Looking up profiles
+
+- (NSDictionary *) profileDataWithIdentifier: (NSString *)identifier
+{
+    const char *key = identifier.UTF8String;
+    if (!key)
+        return nil;
+
+    const uint8_t *bytes = (const uint8_t *)_indexData.bytes;
+    const BXProfileIndexHeader *header = (const BXProfileIndexHeader *)bytes;
+    const BXProfileIndexProfile *profiles = (const BXProfileIndexProfile *)(bytes + header->profilesOffset);
+    const uint32_t *identifiers = (const uint32_t *)(bytes + header->identifiersOffset);
+
+    NSUInteger low = 0, high = header->numIdentifiers;
+    while (low < high)
+    {
+        NSUInteger middle = (low + high) / 2;
+        uint32_t profileNumber = identifiers[middle];
+        const char *candidate = [self _stringAtOffset: profiles[profileNumber].identifierOffset];
+        int comparison = candidate ? strcmp(key, candidate) : 1;
+
+        if (comparison == 0)
+            return [self _profileDataForProfileNumber: profileNumber];
+        else if (comparison < 0)
+            high = middle;
+        else
+            low = middle + 1;
+    }
+    return nil;
+}
+
+- (NSDictionary *) profileDataForTelltale: (NSString *)telltale tier: (NSUInteger *)outTier
+{
+    const char *key = telltale.UTF8String;
+    if (!key)
+        return nil;
+
+    const uint8_t *bytes = (const uint8_t *)_indexData.bytes;
+    const BXProfileIndexHeader *header = (const BXProfileIndexHeader *)bytes;
+    const BXProfileIndexProfile *profiles = (const BXProfileIndexProfile *)(bytes + header->profilesOffset);
+    const BXProfileIndexTelltale *telltales = (const BXProfileIndexTelltale *)(bytes + header->telltalesOffset);
+
+    NSUInteger low = 0, high = header->numTelltales;
+    while (low < high)
+    {
+        NSUInteger middle = (low + high) / 2;
+        const char *candidate = [self _stringAtOffset: telltales[middle].telltaleOffset];
+        int comparison = candidate ? strcmp(key, candidate) : 1;
+
+        if (comparison == 0)
+        {
+            uint32_t profileNumber = telltales[middle].profileNumber;
+            if (outTier) *outTier = profiles[profileNumber].tier;
+            return [self _profileDataForProfileNumber: profileNumber];
+        }
+        else if (comparison < 0)
+            high = middle;
+        else
+            low = middle + 1;
+    }
+    return nil;
+}
+
+- (const char *) _stringAtOffset: (uint32_t)offset
+{
+    //The index ends with a NUL, so any string that starts within it is terminated.
+    if (offset >= _indexData.length)
+        return NULL;
+    return (const char *)_indexData.bytes + offset;
+}
+
+- (NSDictionary *) _profileDataForProfileNumber: (uint32_t)profileNumber
+{
+    @synchronized(self)
+    {
+        NSNumber *key = @(profileNumber);
+        NSDictionary *profileData = [_decodedProfiles objectForKey: key];
+        if (!profileData)
+        {
+            const uint8_t *bytes = (const uint8_t *)_indexData.bytes;
+            const BXProfileIndexHeader *header = (const BXProfileIndexHeader *)bytes;
+            const BXProfileIndexProfile *profile = (const BXProfileIndexProfile *)(bytes + header->profilesOffset) + profileNumber;
+
+            //Decode straight out of the index without copying it: the index lives as long as we do.
+            NSData *data = [NSData dataWithBytesNoCopy: (void *)(bytes + profile->dataOffset)
+                                                length: profile->dataLength
+                                          freeWhenDone: NO];
+
+            profileData = [NSPropertyListSerialization propertyListWithData: data
+                                                                    options: NSPropertyListImmutable
+                                                                     format: NULL
+                                                                      error: NULL];
+
+            if (![profileData isKindOfClass: [NSDictionary class]])
+                return nil;
+
+            [_decodedProfiles setObject: profileData forKey: key];
+        }
+        return profileData;
+    }
+}
+
+
+#pragma mark - Compiling the index
+
++ (BOOL) _isValidIndex: (NSData *)indexData sourceSize: (uint64_t)size sourceModificationTime: (int64_t)modificationTime
+{
+    NSUInteger length = indexData.length;
+    if (length < sizeof(BXProfileIndexHeader) + 1)
+        return NO;
+
+    const uint8_t *bytes = (const uint8_t *)indexData.bytes;
+    const BXProfileIndexHeader *header = (const BXProfileIndexHeader *)bytes;
+
+    if (header->magic != BXProfileIndexMagic || header->formatVersion != BXProfileIndexFormatVersion)
+        return NO;
+
+    if (header->sourceSize != size || header->sourceModificationTime != modificationTime)
+        return NO;
+
+    if (bytes[length - 1] != '\0')
+        return NO;
+
+    //Make sure every table, and every profile's plist, lies within the index.
+    if ((uint64_t)header->profilesOffset + (uint64_t)header->numProfiles * sizeof(BXProfileIndexProfile) > length ||
+        (uint64_t)header->identifiersOffset + (uint64_t)header->numIdentifiers * sizeof(uint32_t) > length ||
+        (uint64_t)header->telltalesOffset + (uint64_t)header->numTelltales * sizeof(BXProfileIndexTelltale) > length)
+        return NO;
+
+    const BXProfileIndexProfile *profiles = (const BXProfileIndexProfile *)(bytes + header->profilesOffset);
+    for (uint32_t i=0; i<header->numProfiles; i++)
+    {
+        if ((uint64_t)profiles[i].dataOffset + profiles[i].dataLength > length || profiles[i].tier >= BXProfileIndexNumTiers)
+            return NO;
+    }
+
+    const uint32_t *identifiers = (const uint32_t *)(bytes + header->identifiersOffset);
+    for (uint32_t i=0; i<header->numIdentifiers; i++)
+    {
+        if (identifiers[i] >= header->numProfiles)
+            return NO;
+    }
+
+    const BXProfileIndexTelltale *telltales = (const BXProfileIndexTelltale *)(bytes + header->telltalesOffset);
+    for (uint32_t i=0; i<header->numTelltales; i++)
+    {
+        if (telltales[i].profileNumber >= header->numProfiles)
+            return NO;
+    }
+
+    return YES;
+}
+
++ (NSData *) _indexForProfiles: (NSDictionary *)profiles sourceSize: (uint64_t)size sourceModificationTime: (int64_t)modificationTime
+{
+    if (![profiles isKindOfClass: [NSDictionary class]])
+        return nil;
+
+    //Gather up the profiles in order of priority, along with who claims each identifier and telltale.
+    NSMutableArray *profileList = [NSMutableArray arrayWithCapacity: 200];
+    NSMutableArray *profileTiers = [NSMutableArray arrayWithCapacity: 200];
+    NSMutableDictionary *identifierOwners = [NSMutableDictionary dictionaryWithCapacity: 200];
+    NSMutableDictionary *telltaleOwners = [NSMutableDictionary dictionaryWithCapacity: 400];
+
+    for (NSUInteger tier=0; tier<BXProfileIndexNumTiers; tier++)
+    {
+        NSMutableSet *tierTelltales = [NSMutableSet setWithCapacity: 200];
+        for (NSDictionary *profile in [profiles objectForKey: BXProfileIndexTierKeys[tier]])
+        {
+            NSNumber *profileNumber = @(profileList.count);
+            [profileList addObject: profile];
+            [profileTiers addObject: @(tier)];
+
+            NSString *identifier = [profile objectForKey: @"BXProfileIdentifier"];
+            if (identifier)
+            {
+                NSAssert1([identifierOwners objectForKey: identifier] == nil, @"Duplicate profile identifier: %@", identifier);
+                [identifierOwners setObject: profileNumber forKey: identifier];
+            }
+
+            for (NSString *telltale in [profile objectForKey: @"BXProfileTelltales"])
+            {
+                NSAssert1(![tierTelltales containsObject: telltale], @"Duplicate profile telltale: %@", telltale);
+                [tierTelltales addObject: telltale];
+
+                //If a more specific tier already claimed this telltale, it keeps it.
+                if (![telltaleOwners objectForKey: telltale])
+                    [telltaleOwners setObject: profileNumber forKey: telltale];
+            }
+        }
+    }
+
+    //Lookups compare UTF-8 bytes, so the tables must be sorted the same way.
+    NSComparator byUTF8 = ^NSComparisonResult(NSString *string1, NSString *string2) {
+        int comparison = strcmp(string1.UTF8String, string2.UTF8String);
+        return (comparison < 0) ? NSOrderedAscending : (comparison > 0) ? NSOrderedDescending : NSOrderedSame;
+    };
+    NSArray *sortedIdentifiers = [identifierOwners.allKeys sortedArrayUsingComparator: byUTF8];
+    NSArray *sortedTelltales = [telltaleOwners.allKeys sortedArrayUsingComparator: byUTF8];
+
+    uint32_t numProfiles = (uint32_t)profileList.count;
+    uint32_t numIdentifiers = (uint32_t)sortedIdentifiers.count;
+    uint32_t numTelltales = (uint32_t)sortedTelltales.count;
+
+    uint32_t profilesOffset = sizeof(BXProfileIndexHeader);
+    uint32_t identifiersOffset = profilesOffset + numProfiles * sizeof(BXProfileIndexProfile);
+    uint32_t telltalesOffset = identifiersOffset + numIdentifiers * sizeof(uint32_t);
+    uint32_t dataOffset = telltalesOffset + numTelltales * sizeof(BXProfileIndexTelltale);
+
+    //Encode each profile as a binary plist of its own, so that it can be decoded on its own later.
+    NSMutableData *profileData = [NSMutableData data];
+    NSMutableData *profileTable = [NSMutableData dataWithLength: numProfiles * sizeof(BXProfileIndexProfile)];
+    BXProfileIndexProfile *profileEntries = (BXProfileIndexProfile *)profileTable.mutableBytes;
+    for (uint32_t i=0; i<numProfiles; i++)
+    {
+        NSData *data = [NSPropertyListSerialization dataWithPropertyList: [profileList objectAtIndex: i]
+                                                                  format: NSPropertyListBinaryFormat_v1_0
+                                                                 options: 0
+                                                                   error: NULL];
+        if (!data)
+            return nil;
+
+        profileEntries[i].dataOffset = dataOffset + (uint32_t)profileData.length;
+        profileEntries[i].dataLength = (uint32_t)data.length;
+        profileEntries[i].tier = [[profileTiers objectAtIndex: i] unsignedIntValue];
+        [profileData appendData: data];
+    }
+
+    //The strings come last, so that the index ends with a NUL.
+    uint32_t stringsOffset = dataOffset + (uint32_t)profileData.length;
+    NSMutableData *strings = [NSMutableData data];
+    uint32_t (^addString)(NSString *) = ^uint32_t(NSString *string) {
+        uint32_t offset = stringsOffset + (uint32_t)strings.length;
+        const char *UTF8String = string.UTF8String;
+        [strings appendBytes: UTF8String length: strlen(UTF8String) + 1];
+        return offset;
+    };
+
+    NSMutableData *identifierTable = [NSMutableData dataWithLength: numIdentifiers * sizeof(uint32_t)];
+    uint32_t *identifierEntries = (uint32_t *)identifierTable.mutableBytes;
+    for (uint32_t i=0; i<numIdentifiers; i++)
+    {
+        NSString *identifier = [sortedIdentifiers objectAtIndex: i];
+        uint32_t profileNumber = [[identifierOwners objectForKey: identifier] unsignedIntValue];
+        identifierEntries[i] = profileNumber;
+        profileEntries[profileNumber].identifierOffset = addString(identifier);
+    }
+
+    NSMutableData *telltaleTable = [NSMutableData dataWithLength: numTelltales * sizeof(BXProfileIndexTelltale)];
+    BXProfileIndexTelltale *telltaleEntries = (BXProfileIndexTelltale *)telltaleTable.mutableBytes;
+    for (uint32_t i=0; i<numTelltales; i++)
+    {
+        NSString *telltale = [sortedTelltales objectAtIndex: i];
+        telltaleEntries[i].telltaleOffset = addString(telltale);
+        telltaleEntries[i].profileNumber = [[telltaleOwners objectForKey: telltale] unsignedIntValue];
+    }
+
+    NSString *catalogueVersion = [profiles objectForKey: @"BXGameProfileCatalogueVersion"];
+
+    BXProfileIndexHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = BXProfileIndexMagic;
+    header.formatVersion = BXProfileIndexFormatVersion;
+    header.sourceSize = size;
+    header.sourceModificationTime = modificationTime;
+    header.catalogueVersionOffset = addString(catalogueVersion ? catalogueVersion : @"");
+    header.numProfiles = numProfiles;
+    header.profilesOffset = profilesOffset;
+    header.numIdentifiers = numIdentifiers;
+    header.identifiersOffset = identifiersOffset;
+    header.numTelltales = numTelltales;
+    header.telltalesOffset = telltalesOffset;
+
+    NSMutableData *index = [NSMutableData dataWithCapacity: stringsOffset + strings.length];
+    [index appendBytes: &header length: sizeof(header)];
+    [index appendData: profileTable];
+    [index appendData: identifierTable];
+    [index appendData: telltaleTable];
+    [index appendData: profileData];
+    [index appendData: strings];
+
+    return index;
+}
+
+@end
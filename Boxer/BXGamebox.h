@@ -51,6 +51,10 @@ extern NSString * const BXLaunchersGameInfoKey;
 //The gameInfo key under which we store the close-on-exit toggle flag as an NSNumber.
 extern NSString * const BXCloseOnExitGameInfoKey;
 
+//The gameInfo key under which we store the types of the gamebox's executables, as an NSDictionary
+//of executable type cache entries. See BXFileTypes addCachedExecutableTypes:.
+extern NSString * const BXExecutableTypesGameInfoKey;
+
 
 #pragma mark - Launcher dictionary constants.
 
@@ -92,6 +96,15 @@ extern NSString * const BXGameInfoFileExtension;
 //The filename of the documentation folder inside the gamebox.
 extern NSString * const BXDocumentationFolderName;
 
+//Keys for launch manifest dictionaries. See launchManifest below.
+extern NSString * const BXLaunchManifestProfileIdentifierKey;   //The identifier of the game profile detected for the gamebox.
+extern NSString * const BXLaunchManifestProfileVersionKey;      //The profile catalogue version under which the profile was detected.
+extern NSString * const BXLaunchManifestDrivesKey;              //An array of drive dictionaries, using the keys below.
+
+extern NSString * const BXLaunchManifestDrivePathKey;           //The location of the drive, relative to the gamebox's resource folder.
+extern NSString * const BXLaunchManifestDriveLetterKey;         //The drive letter of the drive.
+extern NSString * const BXLaunchManifestDriveTypeKey;           //An NSNumber of the drive's BXDriveType.
+
 
 //The different kinds of game identifiers we can have.
 typedef NS_ENUM(NSUInteger, BXGameIdentifierType) {
@@ -107,10 +120,17 @@ typedef NS_ENUM(NSUInteger, BXGameIdentifierType) {
 @interface BXGamebox : NSBundle <ADBUndoable>
 {
 	NSMutableDictionary *_gameInfo;
+    BOOL _gameInfoNeedsPersisting;
+    NSUInteger _gameInfoPersistRequests;
     NSMutableArray *_launchers;
     __unsafe_unretained id <ADBUndoDelegate> _undoDelegate;
     BOOL _lastWritableStatus;
     CFAbsoluteTime _nextWriteableCheckTime;
+    
+    NSArray *_cachedDocumentationURLs;
+    NSDictionary *_documentationDirectoryTimestamps;
+    
+    NSDictionary *_launchManifest;
 }
 
 #pragma mark - Properties
@@ -161,6 +181,11 @@ typedef NS_ENUM(NSUInteger, BXGameIdentifierType) {
 //The delegate from whom we will request an undo manager for undoable operations.
 @property (assign, nonatomic) id <ADBUndoDelegate> undoDelegate;
 
+//A precomputed description of the gamebox's bundled drives and game profile, using the keys listed above.
+//Standalone apps are exported with one of these, so that they can start up without scanning the gamebox.
+//If set, bundledDrives will be built from the manifest instead of from the gamebox's contents.
+@property (copy, nonatomic) NSDictionary *launchManifest;
+
 #pragma mark - Class methods
 
 //Re-casts the return value as a BXGamebox instead of an NSBundle
@@ -170,12 +195,23 @@ typedef NS_ENUM(NSUInteger, BXGameIdentifierType) {
 #pragma mark - Instance methods
 
 //Get/set metadata in the gameInfo dictionary.
+//Changes are saved back to the gamebox shortly afterwards on a background queue,
+//so that a burst of changes results in a single write.
 - (id) gameInfoForKey: (NSString *)key;
 - (void) setGameInfo: (id)info forKey: (NSString *)key;
 
+//Saves any pending changes to the gameInfo immediately, and waits until they have been written.
+//Called when a session closes and before the gamebox is moved.
+- (void) synchronizeGameInfo;
+
 //Clear resource caches for documentation, gameInfo and executables.
 - (void) refresh;
 
+//Returns a launch manifest describing the gamebox's current bundled drives,
+//along with the specified game profile details (which may be nil.)
+- (NSDictionary *) generatedLaunchManifestWithProfileIdentifier: (NSString *)profileIdentifier
+                                                 profileVersion: (NSString *)profileVersion;
+
 
 - (void) addLauncher: (NSDictionary *)launcher;
 - (void) insertLauncher: (NSDictionary *)launcher atIndex: (NSUInteger)index;
@@ -233,6 +269,7 @@ typedef NS_ENUM(NSInteger, BXGameboxDocumentationConflictBehaviour) {
 //Returns an array of documentation found in the gamebox. If the gamebox has a documentation
 //folder, the contents of this folder will be returned; otherwise, the rest of the gamebox
 //will be searched for documentation.
+//The results are cached until the folders that were searched are modified.
 @property (readonly, nonatomic) NSArray *documentationURLs;
 
 //Returns the eventual URL for the gamebox's documentation folder. This may not yet exist.
@@ -15,6 +15,7 @@
 #import "NSURL+ADBFilesystemHelpers.h"
 #import "NSError+ADBErrorHelpers.h"
 #import "BXBaseAppController.h"
+#include <sys/stat.h>
 
 
 #pragma mark - Constants
@@ -31,6 +32,7 @@ NSString * const BXGameIdentifierTypeGameInfoKey    = @"BXGameIdentifierType";
 NSString * const BXTargetProgramGameInfoKey         = @"BXDefaultProgramPath";
 NSString * const BXLaunchersGameInfoKey             = @"BXLaunchers";
 NSString * const BXCloseOnExitGameInfoKey           = @"BXCloseAfterDefaultProgram";
+NSString * const BXExecutableTypesGameInfoKey       = @"BXExecutableTypes";
 
 NSString * const BXTargetSymlinkName			= @"DOSBox Target";
 NSString * const BXConfigurationFileName		= @"DOSBox Preferences";
@@ -39,6 +41,13 @@ NSString * const BXGameInfoFileName				= @"Game Info";
 NSString * const BXGameInfoFileExtension		= @"plist";
 NSString * const BXDocumentationFolderName		= @"Documentation";
 
+NSString * const BXLaunchManifestProfileIdentifierKey   = @"BXGameProfileIdentifier";
+NSString * const BXLaunchManifestProfileVersionKey      = @"BXGameProfileVersion";
+NSString * const BXLaunchManifestDrivesKey              = @"BXDrives";
+NSString * const BXLaunchManifestDrivePathKey           = @"BXDrivePath";
+NSString * const BXLaunchManifestDriveLetterKey         = @"BXDriveLetter";
+NSString * const BXLaunchManifestDriveTypeKey           = @"BXDriveType";
+
 
 NSString * const BXLauncherTitleKey         = @"BXLauncherTitle";
 NSString * const BXLauncherRelativePathKey  = @"BXLauncherPath";
@@ -56,6 +65,9 @@ NSString * const BXGameboxErrorDomain = @"BXGameboxErrorDomain";
 //to prevent repeated hits to the filesystem.
 #define BXGameboxWritableCheckCacheDuration 3.0
 
+//How long to wait after the game info changes before saving it, in case more changes follow.
+#define BXGameInfoPersistDelay 1.0
+
 
 #pragma mark - Private method declarations
 
@@ -77,15 +89,43 @@ NSString * const BXGameboxErrorDomain = @"BXGameboxErrorDomain";
 //Rewrite the launchers array in the game info.
 - (void) _persistLaunchers;
 
-//Save the game info back to the gamebox.
+//Flag the game info as needing saving back to the gamebox, and schedule a save
+//once changes have settled down.
 - (void) _persistGameInfo;
 
+//The serial queue on which game info is written for all gameboxes.
++ (dispatch_queue_t) _gameInfoWriteQueue;
+
+//Returns the game info serialized for writing if it has unsaved changes, or nil if it has none,
+//and clears the flag for unsaved changes. The game info is serialized immediately so that
+//the write isn't affected by later changes.
+- (NSData *) _takeUnsavedGameInfo;
+
+//The path to the gamebox's game info plist file.
+- (NSString *) _gameInfoPath;
+
+//Returns the files in the specified location, filtered to just documentation files if documentationOnly is YES.
+//If timestamps is provided, the modification time of every directory walked will be recorded into it,
+//keyed by path, so that the results can later be checked for staleness.
++ (NSArray *) _URLsInLocation: (NSURL *)location
+         searchSubdirectories: (BOOL)searchSubdirs
+            documentationOnly: (BOOL)documentationOnly
+          directoryTimestamps: (NSMutableDictionary *)timestamps;
+
+//Returns the modification time of the file at the specified path,
+//or nil if the file does not exist.
++ (NSNumber *) _modificationTimeOfPath: (NSString *)path;
+
+//Discards our cached documentation URLs, forcing them to be rediscovered next time they're needed.
+- (void) _clearDocumentationCache;
+
 @end
 
 
 @implementation BXGamebox
 @synthesize gameInfo = _gameInfo;
 @synthesize undoDelegate = _undoDelegate;
+@synthesize launchManifest = _launchManifest;
 
 //We ignore files with these names when considering which programs are important enough to list
 //TODO: read this data from a configuration plist instead
@@ -112,9 +152,12 @@ NSString * const BXGameboxErrorDomain = @"BXGameboxErrorDomain";
 {
     [self.undoDelegate removeAllUndoActionsForClient: self];
     
+    [self synchronizeGameInfo];
     self.gameInfo = nil;
     
     [_launchers release], _launchers = nil;
+    [self _clearDocumentationCache];
+    self.launchManifest = nil;
     
 	[super dealloc];
 }
@@ -473,7 +516,10 @@ NSString * const BXGameboxErrorDomain = @"BXGameboxErrorDomain";
 
 - (void) refresh
 {
+    //Don't lose any changes we haven't saved yet.
+    [self synchronizeGameInfo];
     self.gameInfo = nil;
+    [self _clearDocumentationCache];
 }
 
 #pragma mark - Gamebox contents
@@ -512,6 +558,25 @@ NSString * const BXGameboxErrorDomain = @"BXGameboxErrorDomain";
 
 - (NSArray *) bundledDrives
 {
+    //If we have a launch manifest, then it already lists our drives:
+    //recreate them from that rather than scanning our contents again.
+    NSArray *manifestDrives = [self.launchManifest objectForKey: BXLaunchManifestDrivesKey];
+    if (manifestDrives)
+    {
+        NSMutableArray *drives = [NSMutableArray arrayWithCapacity: manifestDrives.count];
+        for (NSDictionary *driveInfo in manifestDrives)
+        {
+            NSString *path = [driveInfo objectForKey: BXLaunchManifestDrivePathKey];
+            NSURL *URL = (path.length) ? [self.resourceURL URLByAppendingPathComponent: path] : self.resourceURL;
+            
+            BXDrive *drive = [BXDrive driveWithContentsOfURL: URL
+                                                      letter: [driveInfo objectForKey: BXLaunchManifestDriveLetterKey]
+                                                        type: [[driveInfo objectForKey: BXLaunchManifestDriveTypeKey] integerValue]];
+            [drives addObject: drive];
+        }
+        return drives;
+    }
+    
     NSMutableArray *bundledVolumes = [NSMutableArray arrayWithCapacity: 10];
     [bundledVolumes addObjectsFromArray: self.floppyVolumeURLs];
     [bundledVolumes addObjectsFromArray: self.hddVolumeURLs];
@@ -548,6 +613,43 @@ NSString * const BXGameboxErrorDomain = @"BXGameboxErrorDomain";
     return drives;
 }
 
+- (NSDictionary *) generatedLaunchManifestWithProfileIdentifier: (NSString *)profileIdentifier
+                                                 profileVersion: (NSString *)profileVersion
+{
+    //Make sure we scan our actual contents rather than any existing manifest.
+    NSDictionary *oldManifest = [self.launchManifest retain];
+    self.launchManifest = nil;
+    
+    NSArray *drives = self.bundledDrives;
+    
+    self.launchManifest = oldManifest;
+    [oldManifest release];
+    
+    NSMutableArray *driveInfo = [NSMutableArray arrayWithCapacity: drives.count];
+    for (BXDrive *drive in drives)
+    {
+        NSString *path = [drive.sourceURL pathRelativeToURL: self.resourceURL];
+        NSMutableDictionary *info = [NSMutableDictionary dictionaryWithObjectsAndKeys:
+                                     path ?: @"", BXLaunchManifestDrivePathKey,
+                                     @(drive.type), BXLaunchManifestDriveTypeKey,
+                                     nil];
+        
+        //Drives with no explicit letter will be assigned one when they're mounted.
+        if (drive.letter)
+            [info setObject: drive.letter forKey: BXLaunchManifestDriveLetterKey];
+        
+        [driveInfo addObject: info];
+    }
+    
+    NSMutableDictionary *manifest = [NSMutableDictionary dictionaryWithObject: driveInfo forKey: BXLaunchManifestDrivesKey];
+    if (profileIdentifier && profileVersion)
+    {
+        [manifest setObject: profileIdentifier forKey: BXLaunchManifestProfileIdentifierKey];
+        [manifest setObject: profileVersion forKey: BXLaunchManifestProfileVersionKey];
+    }
+    return manifest;
+}
+
 - (NSURL *) configurationFileURL
 {
 	NSString *fileName = [BXConfigurationFileName stringByAppendingPathExtension: BXConfigurationFileExtension];
@@ -615,16 +717,85 @@ NSString * const BXGameboxErrorDomain = @"BXGameboxErrorDomain";
 
 #pragma mark - Private methods
 
-//Write the game info back to the plist file
++ (dispatch_queue_t) _gameInfoWriteQueue
+{
+    static dispatch_queue_t queue;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        queue = dispatch_queue_create("com.boxer.gameInfoWrites", DISPATCH_QUEUE_SERIAL);
+    });
+    return queue;
+}
+
 - (void) _persistGameInfo
 {
     //TWEAK: standalone games should not modify their plists.
-	if (_gameInfo && ![(BXBaseAppController *)[NSApp delegate] isStandaloneGameBundle])
-	{
-		NSString *infoName = [BXGameInfoFileName stringByAppendingPathExtension: BXGameInfoFileExtension];
-		NSString *infoPath = [self.resourcePath stringByAppendingPathComponent: infoName];
-		[_gameInfo writeToFile: infoPath atomically: YES];
-	}
+    if ([(BXBaseAppController *)[NSApp delegate] isStandaloneGameBundle])
+        return;
+    
+    NSUInteger request;
+    @synchronized(self)
+    {
+        _gameInfoNeedsPersisting = YES;
+        request = ++_gameInfoPersistRequests;
+    }
+    
+    //Only the latest request gets to save, so that a burst of changes is written once.
+    //IMPLEMENTATION NOTE: we use the main queue rather than performSelector:afterDelay:,
+    //since game info may be changed from import operations that have no run loop.
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(BXGameInfoPersistDelay * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
+        BOOL isLatestRequest;
+        @synchronized(self)
+        {
+            isLatestRequest = (request == _gameInfoPersistRequests);
+        }
+        
+        if (isLatestRequest)
+        {
+            NSData *infoData = [self _takeUnsavedGameInfo];
+            if (infoData)
+            {
+                NSString *infoPath = [self _gameInfoPath];
+                dispatch_async([self.class _gameInfoWriteQueue], ^{
+                    [infoData writeToFile: infoPath atomically: YES];
+                });
+            }
+        }
+    });
+}
+
+- (void) synchronizeGameInfo
+{
+    NSData *infoData = [self _takeUnsavedGameInfo];
+    NSString *infoPath = [self _gameInfoPath];
+    
+    //Wait for any earlier writes to finish too, so that they don't land on top of this one.
+    dispatch_sync([self.class _gameInfoWriteQueue], ^{
+        [infoData writeToFile: infoPath atomically: YES];
+    });
+}
+
+- (NSData *) _takeUnsavedGameInfo
+{
+    @synchronized(self)
+    {
+        NSData *infoData = nil;
+        if (_gameInfoNeedsPersisting && _gameInfo)
+        {
+            infoData = [NSPropertyListSerialization dataWithPropertyList: _gameInfo
+                                                                  format: NSPropertyListXMLFormat_v1_0
+                                                                 options: 0
+                                                                   error: NULL];
+        }
+        _gameInfoNeedsPersisting = NO;
+        return infoData;
+    }
+}
+
+- (NSString *) _gameInfoPath
+{
+    NSString *infoName = [BXGameInfoFileName stringByAppendingPathExtension: BXGameInfoFileExtension];
+    return [self.resourcePath stringByAppendingPathComponent: infoName];
 }
 
 + (NSArray *) URLsForMeaningfulExecutablesInLocation: (NSURL *)location searchSubdirectories: (BOOL)searchSubdirs
@@ -724,7 +895,7 @@ NSString * const BXGameboxErrorDomain = @"BXGameboxErrorDomain";
     [self willChangeValueForKey: @"hasDocumentationFolder"];
     [self willChangeValueForKey: @"documentationURLs"];
     
-    //This is where we'd clear any documentation cache, if we had one.
+    [self _clearDocumentationCache];
     
     [self didChangeValueForKey: @"documentationURLs"];
     [self didChangeValueForKey: @"hasDocumentationFolder"];
@@ -769,6 +940,7 @@ NSString * const BXGameboxErrorDomain = @"BXGameboxErrorDomain";
             }
         }
         
+        [self _clearDocumentationCache];
         [self didChangeValueForKey: @"documentationURLs"];
         [self didChangeValueForKey: @"hasDocumentationFolder"];
         
@@ -794,6 +966,7 @@ NSString * const BXGameboxErrorDomain = @"BXGameboxErrorDomain";
         }
     }
     
+    [self _clearDocumentationCache];
     [self didChangeValueForKey: @"documentationURLs"];
     [self didChangeValueForKey: @"hasDocumentationFolder"];
     
@@ -820,6 +993,7 @@ NSString * const BXGameboxErrorDomain = @"BXGameboxErrorDomain";
         }
     }
     
+    [self _clearDocumentationCache];
     [self didChangeValueForKey: @"documentationURLs"];
     [self didChangeValueForKey: @"hasDocumentationFolder"];
     
@@ -845,6 +1019,7 @@ NSString * const BXGameboxErrorDomain = @"BXGameboxErrorDomain";
         }
     }
     
+    [self _clearDocumentationCache];
     [self didChangeValueForKey: @"documentationURLs"];
     [self didChangeValueForKey: @"hasDocumentationFolder"];
     
@@ -1008,6 +1183,7 @@ NSString * const BXGameboxErrorDomain = @"BXGameboxErrorDomain";
         }
     }
     
+    [self _clearDocumentationCache];
     [self didChangeValueForKey: @"documentationURLs"];
     
     //Clean up our temporary folder on our way out, regardless of success or failure.
@@ -1087,6 +1263,7 @@ NSString * const BXGameboxErrorDomain = @"BXGameboxErrorDomain";
             BOOL removed = [[NSFileManager defaultManager] removeItemAtURL: documentationURL
                                                                      error: outError];
             
+            [self _clearDocumentationCache];
             [self didChangeValueForKey: @"documentationURLs"];
             
             if (removed)
@@ -1123,6 +1300,7 @@ NSString * const BXGameboxErrorDomain = @"BXGameboxErrorDomain";
                                                          resultingItemURL: &trashedURL
                                                                     error: outError];
             
+            [self _clearDocumentationCache];
             [self didChangeValueForKey: @"documentationURLs"];
             
             if (removed)
@@ -1175,29 +1353,88 @@ NSString * const BXGameboxErrorDomain = @"BXGameboxErrorDomain";
 
 - (NSArray *) documentationURLs
 {
+    //If none of the directories we searched last time have changed since, then our cached results are still good.
+    if (_cachedDocumentationURLs)
+    {
+        BOOL cacheIsCurrent = YES;
+        for (NSString *path in _documentationDirectoryTimestamps)
+        {
+            NSNumber *modificationTime = [self.class _modificationTimeOfPath: path];
+            if (![modificationTime isEqualToNumber: [_documentationDirectoryTimestamps objectForKey: path]])
+            {
+                cacheIsCurrent = NO;
+                break;
+            }
+        }
+        
+        if (cacheIsCurrent)
+            return [[_cachedDocumentationURLs retain] autorelease];
+        else
+            [self _clearDocumentationCache];
+    }
+    
     NSURL *docsURL = self.documentationFolderURL;
+    NSMutableDictionary *timestamps = [NSMutableDictionary dictionary];
+    NSArray *URLs;
     
     //If the documentation folder exists, return everything inside it.
     if ([docsURL checkResourceIsReachableAndReturnError: NULL])
     {
-        NSArray *properties = @[NSURLTypeIdentifierKey];
-        NSDirectoryEnumerator *enumerator = [[NSFileManager defaultManager] enumeratorAtURL: docsURL
-                                                                 includingPropertiesForKeys: properties
-                                                                                    options: NSDirectoryEnumerationSkipsHiddenFiles
-                                                                               errorHandler: NULL];
-        
-        return enumerator.allObjects;
+        URLs = [self.class _URLsInLocation: docsURL
+                      searchSubdirectories: YES
+                         documentationOnly: NO
+                       directoryTimestamps: timestamps];
     }
     //Otherwise, search the rest of the gamebox for documentation.
     else
     {
-        return [self.class URLsForDocumentationInLocation: self.bundleURL searchSubdirectories: YES];
+        URLs = [self.class _URLsInLocation: self.bundleURL
+                      searchSubdirectories: YES
+                         documentationOnly: YES
+                       directoryTimestamps: timestamps];
     }
+    
+    //Also watch the folder the documentation folder lives in, so that we notice if it's created or deleted.
+    NSString *docsParentPath = docsURL.URLByDeletingLastPathComponent.path;
+    NSNumber *docsParentTime = [self.class _modificationTimeOfPath: docsParentPath];
+    if (docsParentTime)
+        [timestamps setObject: docsParentTime forKey: docsParentPath];
+    
+    _cachedDocumentationURLs = [URLs copy];
+    _documentationDirectoryTimestamps = [timestamps copy];
+    
+    return URLs;
+}
+
+- (void) _clearDocumentationCache
+{
+    [_cachedDocumentationURLs release], _cachedDocumentationURLs = nil;
+    [_documentationDirectoryTimestamps release], _documentationDirectoryTimestamps = nil;
+}
+
++ (NSNumber *) _modificationTimeOfPath: (NSString *)path
+{
+    struct stat info;
+    if (lstat(path.fileSystemRepresentation, &info) != 0)
+        return nil;
+    
+    return @(info.st_mtimespec.tv_sec + (info.st_mtimespec.tv_nsec / 1e9));
 }
 
 + (NSArray *) URLsForDocumentationInLocation: (NSURL *)location searchSubdirectories: (BOOL)searchSubdirs
 {
-    NSArray *properties = @[NSURLTypeIdentifierKey];
+    return [self _URLsInLocation: location
+            searchSubdirectories: searchSubdirs
+               documentationOnly: YES
+             directoryTimestamps: nil];
+}
+
++ (NSArray *) _URLsInLocation: (NSURL *)location
+         searchSubdirectories: (BOOL)searchSubdirs
+            documentationOnly: (BOOL)documentationOnly
+          directoryTimestamps: (NSMutableDictionary *)timestamps
+{
+    NSArray *properties = @[NSURLTypeIdentifierKey, NSURLIsDirectoryKey];
     NSDirectoryEnumerationOptions options = NSDirectoryEnumerationSkipsHiddenFiles;
     if (!searchSubdirs)
         options |= NSDirectoryEnumerationSkipsSubdirectoryDescendants;
@@ -1207,14 +1444,31 @@ NSString * const BXGameboxErrorDomain = @"BXGameboxErrorDomain";
                                                                                 options: options
                                                                            errorHandler: NULL];
     
-    NSMutableArray *documentationURLs = [NSMutableArray array];
+    //A directory's modification time changes whenever files are added to, removed from or renamed within it.
+    NSNumber *locationTime = [self _modificationTimeOfPath: location.path];
+    if (locationTime)
+        [timestamps setObject: locationTime forKey: location.path];
+    
+    NSMutableArray *URLs = [NSMutableArray array];
     for (NSURL *URL in enumerator)
     {
-        if ([self isDocumentationFileAtURL: URL])
-            [documentationURLs addObject: URL];
+        if (timestamps && searchSubdirs)
+        {
+            NSNumber *isDirFlag = nil;
+            [URL getResourceValue: &isDirFlag forKey: NSURLIsDirectoryKey error: NULL];
+            if (isDirFlag.boolValue)
+            {
+                NSNumber *directoryTime = [self _modificationTimeOfPath: URL.path];
+                if (directoryTime)
+                    [timestamps setObject: directoryTime forKey: URL.path];
+            }
+        }
+        
+        if (!documentationOnly || [self isDocumentationFileAtURL: URL])
+            [URLs addObject: URL];
     }
     
-    return documentationURLs;
+    return URLs;
 }
 
 + (BOOL) isDocumentationFileAtURL: (NSURL *)URL
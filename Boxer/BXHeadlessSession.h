@@ -0,0 +1,81 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+
+//BXHeadlessSession runs a BXEmulator without any window, rendering view or OpenGL context,
+//for unattended use such as automated regression runs. It acts as the emulator's delegate,
+//and as a frame sink that holds onto the most recently finished frame and optionally saves
+//every Nth frame to disk as a PNG.
+
+//Like BXSession, only one headless session can be run per process, since DOSBox cannot be
+//restarted once it has finished.
+
+#import <Foundation/Foundation.h>
+#import "BXEmulatorDelegate.h"
+#import "BXEmulatedPrinter.h"
+
+
+@class BXEmulator;
+@class BXVideoFrame;
+
+@interface BXHeadlessSession : NSObject <BXEmulatorDelegate, BXEmulatorFileSystemDelegate, BXEmulatorAudioDelegate, BXEmulatedPrinterDelegate>
+{
+    BXEmulator *_emulator;
+    NSArray *_configurationURLs;
+    NSArray *_launchCommands;
+
+    BXVideoFrame *_latestFrame;
+    NSUInteger _frameCount;
+
+    NSURL *_frameDumpURL;
+    NSUInteger _frameDumpInterval;
+    dispatch_queue_t _frameDumpQueue;
+}
+
+#pragma mark -
+#pragma mark Properties
+
+//The emulator this session is running.
+@property (readonly, retain) BXEmulator *emulator;
+
+//DOSBox configuration files to load after Boxer's own baseline configuration, in the order
+//they should be applied. Must be set before the session is started.
+@property (copy) NSArray *configurationURLs;
+
+//DOS commands to execute once AUTOEXEC.BAT has finished, in order.
+@property (copy) NSArray *launchCommands;
+
+//The most recently finished frame. Renderers aren't involved, so the frame pool may recycle
+//this frame as soon as the next one starts: lock it with beginReading before reading from it.
+@property (readonly, retain) BXVideoFrame *latestFrame;
+
+//The number of frames the emulator has finished since the session started.
+@property (readonly) NSUInteger frameCount;
+
+//A folder into which to save frames as PNG images. Screenshots and other DOSBox captures will
+//also be saved here. If nil, frames are not saved and captures are refused.
+@property (copy) NSURL *frameDumpURL;
+
+//Save every Nth finished frame into frameDumpURL. 0 means no frames will be saved.
+@property (assign) NSUInteger frameDumpInterval;
+
+//Whether the emulator draws frames at all. Turn this off for runs that never look at the display,
+//so that emulation isn't slowed down by drawing: latestFrame and frameCount will stop updating.
+//Defaults to YES.
+@property (assign) BOOL drawsFrames;
+
+
+#pragma mark -
+#pragma mark Running
+
+//Starts emulation on a background thread. This returns immediately.
+- (void) start;
+
+//Tells the emulator to stop: it will finish on its own thread shortly afterward.
+- (void) cancel;
+
+@end
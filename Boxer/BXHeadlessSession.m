@@ -0,0 +1,253 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+
+#import "BXHeadlessSession.h"
+#import "BXEmulator+BXShell.h"
+#import "BXVideoFrame.h"
+#import "BXVideoHandler.h"
+#import <Cocoa/Cocoa.h>
+
+
+//The size we report as our viewport and maximum frame size. Since we never scale frames up,
+//this just needs to be larger than any DOS resolution.
+#define BXHeadlessMaxFrameSize NSMakeSize(4096, 4096)
+
+
+#pragma mark -
+#pragma mark Private interface declarations
+
+@interface BXHeadlessSession ()
+
+@property (readwrite, retain) BXEmulator *emulator;
+@property (readwrite, retain) BXVideoFrame *latestFrame;
+@property (readwrite) NSUInteger frameCount;
+
+//Copies the specified frame's pixels and writes them to a numbered PNG file
+//in frameDumpURL on our dump queue.
+- (void) _dumpFrame: (BXVideoFrame *)frame withNumber: (NSUInteger)frameNumber;
+
+@end
+
+
+@implementation BXHeadlessSession
+@synthesize emulator = _emulator;
+@synthesize configurationURLs = _configurationURLs;
+@synthesize launchCommands = _launchCommands;
+@synthesize latestFrame = _latestFrame;
+@synthesize frameCount = _frameCount;
+@synthesize frameDumpURL = _frameDumpURL;
+@synthesize frameDumpInterval = _frameDumpInterval;
+
+- (id) init
+{
+    self = [super init];
+    if (self)
+    {
+        self.emulator = [[[BXEmulator alloc] init] autorelease];
+        self.emulator.delegate = self;
+        _frameDumpQueue = dispatch_queue_create("com.boxer.headlessFrameDump", DISPATCH_QUEUE_SERIAL);
+    }
+    return self;
+}
+
+- (void) dealloc
+{
+    self.emulator.delegate = nil;
+    self.emulator = nil;
+    self.configurationURLs = nil;
+    self.launchCommands = nil;
+    self.latestFrame = nil;
+    self.frameDumpURL = nil;
+
+    if (_frameDumpQueue)
+    {
+        //Let any pending frames finish writing first.
+        dispatch_sync(_frameDumpQueue, ^{});
+        dispatch_release(_frameDumpQueue);
+        _frameDumpQueue = NULL;
+    }
+
+    [super dealloc];
+}
+
+
+#pragma mark -
+#pragma mark Running
+
+- (void) start
+{
+    [self.emulator performSelectorInBackground: @selector(start) withObject: nil];
+}
+
+- (void) cancel
+{
+    [self.emulator cancel];
+}
+
+
+#pragma mark -
+#pragma mark Frame handling
+
+- (void) emulator: (BXEmulator *)emulator didFinishFrame: (BXVideoFrame *)frame
+{
+    self.latestFrame = frame;
+    self.frameCount++;
+
+    if (frame && self.frameDumpURL && self.frameDumpInterval > 0 && (self.frameCount % self.frameDumpInterval) == 0)
+        [self _dumpFrame: frame withNumber: self.frameCount];
+}
+
+- (BOOL) drawsFrames
+{
+    return !self.emulator.videoHandler.drawingSuspended;
+}
+
+- (void) setDrawsFrames: (BOOL)drawsFrames
+{
+    self.emulator.videoHandler.drawingSuspended = !drawsFrames;
+}
+
+- (void) _dumpFrame: (BXVideoFrame *)frame withNumber: (NSUInteger)frameNumber
+{
+    //Copy the frame now, while we're still on the emulation thread and the frame isn't
+    //being drawn into: the rest can wait.
+    if (![frame beginReading])
+        return;
+
+    NSData *pixels = frame.BGRAData;
+    NSSize size = frame.size;
+    NSUInteger pitch = (NSUInteger)frame.size.width * 4;
+
+    [frame endReading];
+
+    NSString *fileName = [NSString stringWithFormat: @"Frame %06lu.png", (unsigned long)frameNumber];
+    NSURL *destinationURL = [self.frameDumpURL URLByAppendingPathComponent: fileName];
+
+    dispatch_async(_frameDumpQueue, ^{
+        NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+
+        //Frames are BGRA in host byte order, with an ignored alpha channel.
+        CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB();
+        CGDataProviderRef provider = CGDataProviderCreateWithCFData((CFDataRef)pixels);
+        CGImageRef image = CGImageCreate((size_t)size.width, (size_t)size.height,
+                                         8, 32, pitch,
+                                         colorSpace,
+                                         kCGBitmapByteOrder32Little | kCGImageAlphaNoneSkipFirst,
+                                         provider, NULL, false, kCGRenderingIntentDefault);
+
+        if (image)
+        {
+            NSBitmapImageRep *rep = [[NSBitmapImageRep alloc] initWithCGImage: image];
+            NSData *PNGData = [rep representationUsingType: NSPNGFileType properties: @{}];
+            [PNGData writeToURL: destinationURL atomically: NO];
+            [rep release];
+            CGImageRelease(image);
+        }
+
+        CGDataProviderRelease(provider);
+        CGColorSpaceRelease(colorSpace);
+
+        [pool drain];
+    });
+}
+
+
+#pragma mark -
+#pragma mark Emulator delegate methods
+
+//We never render frames ourselves, so let DOSBox produce them at their native size.
+- (NSSize) viewportSizeForEmulator: (BXEmulator *)emulator
+{
+    return NSZeroSize;
+}
+
+- (NSSize) maxFrameSizeForEmulator: (BXEmulator *)emulator
+{
+    return BXHeadlessMaxFrameSize;
+}
+
+- (NSArray *) configurationURLsForEmulator: (BXEmulator *)emulator
+{
+    NSMutableArray *configURLs = [NSMutableArray arrayWithCapacity: self.configurationURLs.count + 1];
+
+    //Load Boxer's baseline configuration first, as BXSession does.
+    NSURL *preflightConfURL = [[NSBundle mainBundle] URLForResource: @"Preflight"
+                                                      withExtension: @"conf"
+                                                       subdirectory: @"Configurations"];
+    NSAssert(preflightConfURL != nil, @"Missing preflight configuration.");
+    [configURLs addObject: preflightConfURL];
+
+    if (self.configurationURLs)
+        [configURLs addObjectsFromArray: self.configurationURLs];
+
+    return configURLs;
+}
+
+- (void) runPreflightCommandsForEmulator: (BXEmulator *)emulator {}
+
+- (void) runLaunchCommandsForEmulator: (BXEmulator *)emulator
+{
+    for (NSString *command in self.launchCommands)
+    {
+        [emulator executeCommand: command encoding: BXDirectStringEncoding];
+    }
+}
+
+//The emulator runs on its own thread, so there is no event queue for us to pump.
+- (void) processEventsForEmulator: (BXEmulator *)emulator {}
+- (void) emulatorWillStartRunLoop: (BXEmulator *)emulator {}
+- (void) emulatorDidFinishRunLoop: (BXEmulator *)emulator {}
+
+- (BOOL) emulatorShouldDisplayStartupMessages: (BXEmulator *)emulator
+{
+    return NO;
+}
+
+
+#pragma mark -
+#pragma mark Filesystem delegate methods
+
+- (BOOL) emulator: (BXEmulator *)emulator shouldShowFileWithName: (NSString *)fileName
+{
+    return YES;
+}
+
+- (BOOL) emulator: (BXEmulator *)emulator shouldMountDriveFromURL: (NSURL *)fileURL
+{
+    return YES;
+}
+
+- (BOOL) emulator: (BXEmulator *)emulator shouldAllowWriteAccessToURL: (NSURL *)fileURL onDrive: (BXDrive *)drive
+{
+    return YES;
+}
+
+- (FILE *) emulator: (BXEmulator *)emulator openCaptureFileOfType: (NSString *)captureType extension: (NSString *)extension
+{
+    if (!self.frameDumpURL)
+        return NULL;
+
+    NSString *fileName = [NSString stringWithFormat: @"%@ %lu.%@", captureType, (unsigned long)self.frameCount, extension];
+    fileName = [fileName stringByReplacingOccurrencesOfString: @"/" withString: @"-"];
+
+    NSURL *URL = [self.frameDumpURL URLByAppendingPathComponent: fileName];
+    return fopen(URL.fileSystemRepresentation, "w+b");
+}
+
+
+#pragma mark -
+#pragma mark Audio delegate methods
+
+//Headless sessions have no MIDI output: games will fall back on whatever else they support.
+- (id <BXMIDIDevice>) MIDIDeviceForEmulator: (BXEmulator *)emulator
+                         meetingDescription: (NSDictionary *)description
+{
+    return nil;
+}
+
+@end
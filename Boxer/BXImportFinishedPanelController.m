@@ -39,7 +39,11 @@
 	{
 		if (icon)
 		{
-            self.controller.document.representedIcon = [BXCoverArt coverArtWithImage: icon];
+            //Render the cover art in the background, so that large source images don't hold up the UI.
+            BXImportSession *session = self.controller.document;
+            [BXCoverArt renderCoverArtWithImage: icon completionHandler: ^(NSImage *coverArt) {
+                session.representedIcon = coverArt;
+            }];
 		}
 		else
 		{
@@ -22,6 +22,18 @@
 
 
 
+//Joins a set of regex patterns into a single alternation, so that a path can be tested
+//against the whole set with one match instead of one match per pattern.
+static NSString *_combinedPattern(id <NSFastEnumeration> patterns)
+{
+    NSMutableArray *groups = [NSMutableArray array];
+    for (NSString *pattern in patterns)
+        [groups addObject: [NSString stringWithFormat: @"(?:%@)", pattern]];
+    
+    return [[groups componentsJoinedByString: @"|"] retain];
+}
+
+
 @implementation BXImportSession (BXImportPolicies)
 
 #pragma mark -
@@ -52,13 +64,11 @@
 
 + (BOOL) isInstallerAtPath: (NSString *)path
 {	
-	NSString *fileName = path.lastPathComponent.lowercaseString;
+	static NSString *combinedPattern = nil;
+	if (!combinedPattern) combinedPattern = _combinedPattern([self installerPatterns]);
 	
-	for (NSString *pattern in [self installerPatterns])
-	{
-		if ([fileName isMatchedByRegex: pattern]) return YES;
-	}
-	return NO;
+	NSString *fileName = path.lastPathComponent.lowercaseString;
+	return [fileName isMatchedByRegex: combinedPattern];
 }
 
 + (NSSet *) ignoredFilePatterns
@@ -95,15 +105,13 @@
 
 + (BOOL) isIgnoredFileAtPath: (NSString *)path
 {
-	NSRange matchRange = NSMakeRange(0, path.length);
-	for (NSString *pattern in [self ignoredFilePatterns])
-	{
-		if ([path isMatchedByRegex: pattern
-						   options: RKLCaseless
-						   inRange: matchRange
-							 error: NULL]) return YES;
-	}
-	return NO;
+	static NSString *combinedPattern = nil;
+	if (!combinedPattern) combinedPattern = _combinedPattern([self ignoredFilePatterns]);
+	
+	return [path isMatchedByRegex: combinedPattern
+						  options: RKLCaseless
+						  inRange: NSMakeRange(0, path.length)
+							error: NULL];
 }
 
 + (BOOL) isInconclusiveDOSProgramAtPath: (NSString *)path
@@ -139,15 +147,13 @@
 
 + (BOOL) isJunkFileAtPath: (NSString *)path
 {
-	NSRange matchRange = NSMakeRange(0, path.length);
-	for (NSString *pattern in [self junkFilePatterns])
-	{
-		if ([path isMatchedByRegex: pattern
-						   options: RKLCaseless
-						   inRange: matchRange
-							 error: NULL]) return YES;
-	}
-	return NO;
+	static NSString *combinedPattern = nil;
+	if (!combinedPattern) combinedPattern = _combinedPattern([self junkFilePatterns]);
+	
+	return [path isMatchedByRegex: combinedPattern
+						  options: RKLCaseless
+						  inRange: NSMakeRange(0, path.length)
+							error: NULL];
 }
 
 
@@ -162,6 +168,7 @@
 								   @"iso",		//Likewise with mountable disc images
 								   @"cue",
 								   @"cdr",
+								   @"chd",
 								   @"inst",
 								   @"harddisk",	//Boxer drive folders indicate a former Boxer gamebox
 								   @"cdrom",
@@ -187,12 +194,10 @@
 	if ([[self playableGameTelltaleExtensions] containsObject: fileName.pathExtension]) return YES;
 	
 	//Next, test against our filename patterns
-	for (NSString *pattern in [self playableGameTelltalePatterns])
-	{
-		if ([fileName isMatchedByRegex: pattern]) return YES;
-	}
+	static NSString *combinedPattern = nil;
+	if (!combinedPattern) combinedPattern = _combinedPattern([self playableGameTelltalePatterns]);
 	
-	return NO;
+	return [fileName isMatchedByRegex: combinedPattern];
 }
 
 
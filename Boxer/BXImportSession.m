@@ -462,6 +462,9 @@
 		NSURL *newGameboxURL = [self _destinationURLForGameboxName: newName];
 		NSURL *currentGameboxURL = self.gamebox.bundleURL;
 		
+        //Make sure any pending game info changes land inside the gamebox before we move it.
+        [self.gamebox synchronizeGameInfo];
+        
 		NSFileManager *manager = [NSFileManager defaultManager];
 		
 		NSError *moveError;
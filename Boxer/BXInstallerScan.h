@@ -25,6 +25,12 @@
     BOOL _alreadyInstalled;
     
     BXGameProfile *_detectedProfile;
+    
+    BOOL _detectingProfile;
+    NSDictionary *_detectedProfileData;
+    NSUInteger _detectedProfileTier;
+    
+    NSMutableSet *_cachedExecutableDirectories;
 } 
 
 //The relative paths of all DOS and Windows executables and DOSBox configuration files
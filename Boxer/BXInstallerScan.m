@@ -14,6 +14,7 @@
 #import "NSString+ADBPaths.h"
 #import "BXFileTypes.h"
 #import "BXSessionError.h"
+#import "ADBLocalFilesystem.h"
 
 @interface BXInstallerScan ()
 
@@ -49,6 +50,7 @@
         self.DOSExecutables         = [NSMutableArray arrayWithCapacity: 10];
         self.macOSApps              = [NSMutableArray arrayWithCapacity: 10];
         self.DOSBoxConfigurations   = [NSMutableArray arrayWithCapacity: 2];
+        _cachedExecutableDirectories = [[NSMutableSet alloc] init];
     }
     return self;
 }
@@ -59,6 +61,8 @@
     self.DOSExecutables = nil;
     self.macOSApps = nil;
     self.detectedProfile = nil;
+    [_detectedProfileData release], _detectedProfileData = nil;
+    [_cachedExecutableDirectories release], _cachedExecutableDirectories = nil;
     
     [super dealloc];
 }
@@ -66,6 +70,20 @@
 //Overridden to gather additional data besides just matching installers.
 - (BOOL) matchAgainstPath: (NSString *)relativePath
 {
+    //Check every path for game profile telltales, keeping the best match found so far.
+    //This is done before isMatchingPath: since profile telltales may be hidden files.
+    if (_detectingProfile && _detectedProfileTier > 0)
+    {
+        NSUInteger tier;
+        NSDictionary *profileData = [BXGameProfile profileDataMatchingPath: relativePath tier: &tier];
+        if (profileData && tier < _detectedProfileTier)
+        {
+            [_detectedProfileData release];
+            _detectedProfileData = [profileData retain];
+            _detectedProfileTier = tier;
+        }
+    }
+    
     //Filter out files that don't match BXFileScan’s basic tests
     //(Basically this just filters out hidden files.)
     if ([self isMatchingPath: relativePath])
@@ -91,11 +109,23 @@
         
         if ([_workspace file: fullPath matchesTypes: executableTypes])
         {
+            //The first time we meet an executable in a directory, read the types of all the
+            //directory's EXEs at once, so that their headers are read in parallel and the
+            //compatibility check below hits the cache.
+            NSString *directory = fullPath.stringByDeletingLastPathComponent;
+            if (![_cachedExecutableDirectories containsObject: directory])
+            {
+                [_cachedExecutableDirectories addObject: directory];
+                ADBLocalFilesystem *filesystem = [ADBLocalFilesystem filesystemWithBaseURL: [NSURL fileURLWithPath: directory]];
+                [BXFileTypes cacheTypesOfExecutablesInDirectory: @"/" filesystem: filesystem];
+            }
+            
             if ([_workspace isCompatibleExecutableAtPath: fullPath error: NULL])
             {
                 [self addDOSExecutable: relativePath];
                 
-                //If this looks like an installer to us, finally add it into our list of matches
+                //If this looks like an installer to us, finally add it into our list of matches.
+                //(If we're still detecting the profile, installers it ignores are weeded out once the scan is done.)
                 if ([BXImportSession isInstallerAtPath: relativePath] && ![self.detectedProfile isIgnoredInstallerAtPath: relativePath])
                 {
                     [self addMatchingPath: relativePath];
@@ -159,28 +189,40 @@
 
 - (void) performScan
 {
-    //Detect the game profile before we start.
-    if (!self.detectedProfile)
-    {
-        //If we are scanning a mounted image, scan the mounted volume path for the game profile
-        //instead of the base image path. 
-        NSString *profileScanPath = (self.mountedVolumePath) ? self.mountedVolumePath : self.basePath;
-        
-        //IMPLEMENTATION NOTE: detectedProfileForPath:searchSubfolders: trawls the same
-        //directory structure as our own installer scan, so it would be more efficient
-        //to do profile detection in the same loop as installer detection.
-        //However, profile detection relies on iterating the same file structure multiple
-        //times in order to scan for different profile 'priorities' so this isn't an option.
-        //Also, it appears OS X's directory enumerator caches the result of a directory
-        //scan so that subsequent reiterations do not do disk I/O.
-        BXGameProfile *profile = [BXGameProfile detectedProfileForPath: profileScanPath
-                                                      searchSubfolders: YES];
-    
-        self.detectedProfile = profile;
-    }
+    //If no profile was specified, detect one during the same pass as installer detection
+    //(which already walks the mounted volume instead of the image, if we're scanning an image.)
+    //IMPLEMENTATION NOTE: this used to be a separate detectedProfileForPath:searchSubfolders: call
+    //before the scan, which trawled the whole directory structure once per profile priority.
+    //Matching against the telltales of all priorities at once lets us get away with a single pass.
+    _detectingProfile = (self.detectedProfile == nil);
+    _detectedProfileTier = NSNotFound;
+    [_detectedProfileData release], _detectedProfileData = nil;
     
     [super performScan];
     
+    if (_detectingProfile)
+    {
+        _detectingProfile = NO;
+        if (_detectedProfileData)
+        {
+            BXGameProfile *profile = [[BXGameProfile alloc] initWithDictionary: _detectedProfileData];
+            self.detectedProfile = profile;
+            [profile release];
+            
+            //Now that we know the profile, drop any installers that it tells us to ignore.
+            NSIndexSet *ignoredIndexes = [_matchingPaths indexesOfObjectsPassingTest: ^BOOL(NSString *path, NSUInteger idx, BOOL *stop) {
+                return [profile isIgnoredInstallerAtPath: path];
+            }];
+            
+            if (ignoredIndexes.count)
+            {
+                [self willChangeValueForKey: @"matchingPaths"];
+                [_matchingPaths removeObjectsAtIndexes: ignoredIndexes];
+                [self didChangeValueForKey: @"matchingPaths"];
+            }
+        }
+    }
+    
     if (!self.error)
     {
         //If we discovered windows executables (or Mac apps) as well as DOS programs,
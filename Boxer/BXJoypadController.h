@@ -8,18 +8,41 @@
 //BXJoyPadController listens for and receives input from iOS devices running JoyPad.
 //q.v. http://getjoypad.com/ and https://github.com/lzell/JoypadSDK#readme
 
+//Joypad devices are listened to on the same high-priority thread as HID controllers, and their
+//input is mapped onto the emulated joystick straight from that thread rather than waiting its turn
+//on the main thread. Stick and accelerometer samples that arrive together are coalesced, so that
+//only the newest position is applied instead of working through a backlog of stale ones.
+
 #import <Foundation/Foundation.h>
 #import "JoypadSDK.h"
 
-@interface BXJoypadController : NSObject <JoypadManagerDelegate>
+@class BXInputController;
+
+@interface BXJoypadController : NSObject <JoypadManagerDelegate, JoypadDeviceDelegate>
 {
     JoypadManager *joypadManager;
     JoypadControllerLayout *currentLayout;
     BOOL hasJoypadDevices;
+    
+    NSThread *_HIDThread;
+    NSArray *_joypadDevices;
+    
+    //The input controller that Joypad input is passed on to. Set on the main thread
+    //and read on the HID thread: guarded by synchronizing on self.
+    BXInputController *_targetInputController;
+    
+    //The newest stick and accelerometer samples, waiting to be applied at the end of
+    //the HID thread's current run loop pass. Only accessed on the HID thread.
+    JoypadAcceleration _pendingAcceleration;
+    JoypadStickPosition _pendingStickPositions[2];
+    BOOL _hasPendingAcceleration;
+    BOOL _hasPendingStickPositions[2];
+    BOOL _pendingMotionScheduled;
 }
 @property (readonly, nonatomic) JoypadManager *joypadManager;
 
 //An array of all currently-connected joypad devices being used by Boxer.
+//Updated on the main thread whenever a device connects or disconnects.
 @property (readonly, nonatomic) NSArray *joypadDevices;
 
 //The current joystick controller layout in use.
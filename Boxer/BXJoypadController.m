@@ -7,8 +7,8 @@
 
 #import "BXJoypadController.h"
 #import "JoypadSDK.h"
-#import "BXJoypadController.h"
 #import "BXBaseAppController.h"
+#import "BXJoystickController.h"
 #import "BXSession.h"
 #import "BXDOSWindowController.h"
 #import "BXInputController+BXJoypadInput.h"
@@ -22,6 +22,23 @@
 @property (readwrite, nonatomic) BOOL hasJoypadDevices;
 @property (readonly, nonatomic) BXInputController *activeWindowController;
 
+//Returns the input controller that Joypad input should be passed on to, retained and autoreleased
+//so that it survives being replaced partway through handling an event. Called on the HID thread.
+- (BXInputController *) _targetInputController;
+
+//Creates the Joypad manager and starts looking for devices. Called on the HID thread,
+//so that the manager does its networking on that thread's run loop.
+- (void) _startJoypadManager;
+- (void) _stopJoypadManager;
+
+//Records the connected devices and notifies observers. Called on the main thread.
+- (void) _syncJoypadDevices: (NSArray *)devices;
+
+//Arranges for the newest stick and accelerometer samples to be applied at the end of the
+//current run loop pass, and applies them. Called on the HID thread.
+- (void) _schedulePendingMotion;
+- (void) _applyPendingMotion;
+
 @end
 
 
@@ -39,24 +56,32 @@
         [currentLayout release];
         currentLayout = [layout retain];
         
-        if (layout)
+        if (layout && joypadManager)
         {
-            [joypadManager setControllerLayout: layout];
+            [joypadManager performSelector: @selector(setControllerLayout:)
+                                  onThread: _HIDThread
+                                withObject: layout
+                             waitUntilDone: NO];
         }
     }
 }
 
 - (void) awakeFromNib
 {
-    joypadManager = [[JoypadManager alloc] init];
-    [joypadManager setDelegate: self];
-    [joypadManager setMaxPlayerCount: 1];
+    BXBaseAppController *appController = (BXBaseAppController *)[NSApp delegate];
+    
+    _HIDThread = [appController.joystickController.HIDThread retain];
+    if (!_HIDThread)
+        _HIDThread = [[NSThread mainThread] retain];
+    
+    [self performSelector: @selector(_startJoypadManager)
+                 onThread: _HIDThread
+               withObject: nil
+            waitUntilDone: YES];
     
     //Default to a 4-button layout (this may be overridden by any game the user starts)
     [self setCurrentLayout: [BX4ButtonJoystickLayout layout]];
-    [joypadManager startFindingDevices];
     
-    BXBaseAppController *appController = (BXBaseAppController *)[NSApp delegate];
     [appController addObserver: self
                     forKeyPath: @"currentSession.DOSWindowController.inputController.currentJoypadLayout"
                        options: NSKeyValueObservingOptionInitial
@@ -74,19 +99,49 @@
     [appController removeObserver: self forKeyPath: @"currentSession.DOSWindowController.inputController.currentJoypadLayout"];
     [appController removeObserver: self forKeyPath: @"currentSession.DOSWindowController.inputController"];
     
-    [joypadManager stopFindingDevices];
-    [joypadManager release], joypadManager = nil;
+    [self performSelector: @selector(_stopJoypadManager)
+                 onThread: _HIDThread
+               withObject: nil
+            waitUntilDone: YES];
+    
     [self setCurrentLayout: nil], [currentLayout release];
+    [_joypadDevices release], _joypadDevices = nil;
+    [_targetInputController release], _targetInputController = nil;
+    [_HIDThread release], _HIDThread = nil;
     [super dealloc];
 }
 
+- (void) _startJoypadManager
+{
+    joypadManager = [[JoypadManager alloc] init];
+    [joypadManager setDelegate: self];
+    [joypadManager setMaxPlayerCount: 1];
+    [joypadManager startFindingDevices];
+}
+
+- (void) _stopJoypadManager
+{
+    [joypadManager stopFindingDevices];
+    [joypadManager release], joypadManager = nil;
+}
+
 
 #pragma mark -
 #pragma mark Joypad device monitoring
 
 - (NSArray *) joypadDevices
 {
-    return [joypadManager connectedDevices];
+    return _joypadDevices;
+}
+
+- (void) _syncJoypadDevices: (NSArray *)devices
+{
+    [self willChangeValueForKey: @"joypadDevices"];
+    [_joypadDevices release];
+    _joypadDevices = [devices copy];
+    [self didChangeValueForKey: @"joypadDevices"];
+    
+    [self setHasJoypadDevices: devices.count > 0];
 }
 
 - (BXInputController *) activeWindowController
@@ -94,6 +149,14 @@
     return [[[(BXBaseAppController *)[NSApp delegate] currentSession] DOSWindowController] inputController];
 }
 
+- (BXInputController *) _targetInputController
+{
+    @synchronized(self)
+    {
+        return [[_targetInputController retain] autorelease];
+    }
+}
+
 - (void) observeValueForKeyPath: (NSString *)keyPath
                        ofObject: (id)object
                          change: (NSDictionary *)change
@@ -106,13 +169,13 @@
         if (layout) [self setCurrentLayout: layout];
     }
     //Whenever the active window or its input controller changes,
-    //tell all Joypad devices to send their signal to the new one
+    //send all Joypad input to the new one
     else if ([keyPath isEqualToString: @"currentSession.DOSWindowController.inputController"])
     {
-        //Rebind all connected devices to send their messages to the currently active session
-        for (JoypadDevice *device in [self joypadDevices])
+        @synchronized(self)
         {
-            [device setDelegate: [self activeWindowController]];
+            [_targetInputController release];
+            _targetInputController = [[self activeWindowController] retain];
         }
     }
 }
@@ -122,7 +185,9 @@
 //will be enabled as early as possible.
 - (BOOL) joypadManager: (JoypadManager *)manager deviceShouldConnect: (JoypadDevice *)device
 {
-    [self setHasJoypadDevices: YES];
+    dispatch_async(dispatch_get_main_queue(), ^{
+        [self setHasJoypadDevices: YES];
+    });
     return YES;
 }
 
@@ -130,35 +195,116 @@
       deviceDidConnect: (JoypadDevice *)device
                 player: (unsigned int)player
 {
-    BXInputController *delegate = [self activeWindowController];
-    [device setDelegate: delegate];
+    //Decode the device's input ourselves on the HID thread, rather than waiting on the main thread.
+    [device setDelegate: self];
     
-    [self setHasJoypadDevices: YES];
-        
-    [self willChangeValueForKey: @"joypadDevices"];
-    [self didChangeValueForKey: @"joypadDevices"];
+    NSArray *devices = [[manager connectedDevices] copy];
+    dispatch_async(dispatch_get_main_queue(), ^{
+        [self _syncJoypadDevices: devices];
+    });
+    [devices release];
     
-    //Let the delegate know that the device has been connected
-    [delegate joypadManager: manager
-           deviceDidConnect: device
-                     player: player];
+    //Let the input controller know that the device has been connected
+    [[self _targetInputController] joypadManager: manager
+                                deviceDidConnect: device
+                                          player: player];
 }
 
 - (void) joypadManager: (JoypadManager *)manager
    deviceDidDisconnect: (JoypadDevice *)device
                 player: (unsigned int)player
-{   
-    BOOL devicesRemaining = [manager connectedDeviceCount] > 0;
-    [self setHasJoypadDevices: devicesRemaining];
-        
-    [self willChangeValueForKey: @"joypadDevices"];
-    [self didChangeValueForKey: @"joypadDevices"];
-    
-    BXInputController *delegate = (BXInputController *)[device delegate];
+{
+    NSArray *devices = [[manager connectedDevices] copy];
+    dispatch_async(dispatch_get_main_queue(), ^{
+        [self _syncJoypadDevices: devices];
+    });
+    [devices release];
     
-    //Let the device's delegate know that the device has been disconnected
-    [delegate joypadManager: manager deviceDidDisconnect: device player: player];
+    //Let the input controller know that the device has been disconnected
+    [[self _targetInputController] joypadManager: manager deviceDidDisconnect: device player: player];
     
     [device setDelegate: nil];
 }
+
+
+#pragma mark -
+#pragma mark JoypadDeviceDelegate methods
+
+//All of these are called on the HID thread. Buttons are passed on straight away, after any
+//motion that arrived before them; motion is held until the end of the current run loop pass,
+//so that when several samples arrive at once only the newest is applied.
+
+- (void) _schedulePendingMotion
+{
+    if (!_pendingMotionScheduled)
+    {
+        _pendingMotionScheduled = YES;
+        CFRunLoopPerformBlock(CFRunLoopGetCurrent(), kCFRunLoopCommonModes, ^{
+            [self _applyPendingMotion];
+        });
+    }
+}
+
+- (void) _applyPendingMotion
+{
+    _pendingMotionScheduled = NO;
+    if (!_hasPendingAcceleration && !_hasPendingStickPositions[0] && !_hasPendingStickPositions[1])
+        return;
+    
+    BXInputController *target = [self _targetInputController];
+    if (_hasPendingAcceleration)
+    {
+        _hasPendingAcceleration = NO;
+        [target joypadDevice: nil didAccelerate: _pendingAcceleration];
+    }
+    for (NSUInteger i=0; i<2; i++)
+    {
+        if (_hasPendingStickPositions[i])
+        {
+            _hasPendingStickPositions[i] = NO;
+            JoyInputIdentifier stick = (i == 0) ? kJoyInputAnalogStick1 : kJoyInputAnalogStick2;
+            [target joypadDevice: nil analogStick: stick didMove: _pendingStickPositions[i]];
+        }
+    }
+}
+
+- (void) joypadDevice: (JoypadDevice *)device didAccelerate: (JoypadAcceleration)accel
+{
+    _pendingAcceleration = accel;
+    _hasPendingAcceleration = YES;
+    [self _schedulePendingMotion];
+}
+
+- (void) joypadDevice: (JoypadDevice *)device analogStick: (JoyInputIdentifier)stick didMove: (JoypadStickPosition)newPosition
+{
+    NSUInteger index = (stick == kJoyInputAnalogStick2) ? 1 : 0;
+    _pendingStickPositions[index] = newPosition;
+    _hasPendingStickPositions[index] = YES;
+    [self _schedulePendingMotion];
+}
+
+- (void) joypadDevice: (JoypadDevice *)device dPad: (JoyInputIdentifier)dpad buttonUp: (JoyDpadButton)dpadButton
+{
+    [self _applyPendingMotion];
+    [[self _targetInputController] joypadDevice: device dPad: dpad buttonUp: dpadButton];
+}
+
+- (void) joypadDevice: (JoypadDevice *)device dPad: (JoyInputIdentifier)dpad buttonDown: (JoyDpadButton)dpadButton
+{
+    [self _applyPendingMotion];
+    [[self _targetInputController] joypadDevice: device dPad: dpad buttonDown: dpadButton];
+}
+
+- (void) joypadDevice: (JoypadDevice *)device buttonUp: (JoyInputIdentifier)button
+{
+    [self _applyPendingMotion];
+    [[self _targetInputController] joypadDevice: device buttonUp: button];
+}
+
+- (void) joypadDevice: (JoypadDevice *)device buttonDown: (JoyInputIdentifier)button
+{
+    [self _applyPendingMotion];
+    [[self _targetInputController] joypadDevice: device buttonDown: button];
+}
+
 @end
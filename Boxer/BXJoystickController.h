@@ -9,6 +9,11 @@
 //These messages are then translated into a more Boxer-friendly format and sent onwards to the
 //active DOS session's input controller.
 
+//Controllers are listened to on a dedicated high-priority thread, so that their input is read
+//promptly even while the main thread is busy. Events are handed over to the main thread in batches
+//that are delivered in all run loop modes (so that window drags and modal panels don't hold them up),
+//and axis changes that have been superseded by the time the batch is delivered are dropped.
+
 #import <Foundation/Foundation.h>
 #import "ADBHIDMonitor.h"
 
@@ -16,9 +21,20 @@
 {
 	ADBHIDMonitor *_HIDMonitor;
     NSArray *_recentHIDRemappers;
+    
+    NSThread *_HIDThread;
+    
+    //HID events received on the HID thread, waiting to be delivered on the main thread.
+    //Guarded by synchronizing on the array.
+    NSMutableArray *_pendingHIDEvents;
+    BOOL _pendingHIDEventsScheduled;
 }
 @property (readonly, retain, nonatomic) ADBHIDMonitor *HIDMonitor;
 
+//The high-priority thread on which controllers are listened to. Other sources of controller
+//input, such as Joypad devices, can be listened to on the same thread.
+@property (readonly, nonatomic) NSThread *HIDThread;
+
 //An array of DDHIDJoystick instances for each joystick currently connected.
 //Corresponds to hidMonitor matchedDevices.
 @property (readonly, nonatomic) NSArray *joystickDevices;
@@ -14,22 +14,44 @@
 #import "BXDOSWindowController.h"
 #import "BXInputController.h"
 
+//The QoS class for user-interactive work, which 10.8 and 10.9 don't know about.
+#define BXHIDThreadQualityOfService 0x21
+
 @interface BXJoystickController ()
 
 @property (retain, nonatomic) ADBHIDMonitor *HIDMonitor;
 @property (retain, nonatomic) NSArray *recentHIDRemappers;
 
+//The thread on which we listen to controllers. Runs for the lifetime of the application.
+- (void) _runHIDThread;
+
+//Delivers the HID events received on the HID thread so far. Called on the main thread.
+- (void) _deliverPendingHIDEvents;
+
+//Sends a HID event on to the current window's input controller. Called on the main thread.
+- (void) _dispatchHIDEventToActiveSession: (ADBHIDEvent *)event;
+
 @end
 
 @implementation BXJoystickController
 @synthesize HIDMonitor = _HIDMonitor;
 @synthesize recentHIDRemappers = _recentHIDRemappers;
+@synthesize HIDThread = _HIDThread;
 
 - (id) init
 {
     self = [super init];
     if (self)
     {
+        _pendingHIDEvents = [[NSMutableArray alloc] initWithCapacity: 10];
+        
+        _HIDThread = [[NSThread alloc] initWithTarget: self selector: @selector(_runHIDThread) object: nil];
+        _HIDThread.name = @"com.boxer.HIDInput";
+        _HIDThread.threadPriority = 1.0;
+        if ([_HIDThread respondsToSelector: @selector(setQualityOfService:)])
+            [_HIDThread setValue: @(BXHIDThreadQualityOfService) forKey: @"qualityOfService"];
+        [_HIDThread start];
+        
         self.HIDMonitor = [[[ADBHIDMonitor alloc] init] autorelease];
         
         self.HIDMonitor.delegate = self;
@@ -52,6 +74,9 @@
     
     self.recentHIDRemappers = nil;
     self.HIDMonitor = nil;
+    
+    [_HIDThread release], _HIDThread = nil;
+    [_pendingHIDEvents release], _pendingHIDEvents = nil;
 	
 	[super dealloc];
 }
@@ -123,7 +148,12 @@
 - (void) monitor: (ADBHIDMonitor *)monitor didAddHIDDevice: (DDHidJoystick *)device
 {
     device.delegate = self;
-	[device startListening];
+    
+    //DDHidLib delivers the device's input on the run loop it starts listening on.
+	[device performSelector: @selector(startListening)
+                   onThread: _HIDThread
+                 withObject: nil
+              waitUntilDone: NO];
 }
 
 - (void) monitor: (ADBHIDMonitor *)monitor didRemoveHIDDevice: (DDHidJoystick *)device
@@ -132,10 +162,100 @@
 }
 
 
+#pragma mark -
+#pragma mark HID thread
+
+- (void) _runHIDThread
+{
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    
+    //Keep the run loop running even while there are no controllers to listen to.
+    NSRunLoop *runLoop = [NSRunLoop currentRunLoop];
+    [runLoop addPort: [NSMachPort port] forMode: NSDefaultRunLoopMode];
+    
+    [pool drain];
+    
+    while (YES)
+    {
+        pool = [[NSAutoreleasePool alloc] init];
+        [runLoop runMode: NSDefaultRunLoopMode beforeDate: [NSDate distantFuture]];
+        [pool drain];
+    }
+}
+
+
 #pragma mark -
 #pragma mark ADBHIDDeviceDelegate methods
 
+//Called on the HID thread.
 - (void) dispatchHIDEvent: (ADBHIDEvent *)event
+{
+    if ([NSThread isMainThread])
+    {
+        [self _dispatchHIDEventToActiveSession: event];
+        return;
+    }
+    
+    BOOL needsDelivery = NO;
+    @synchronized(_pendingHIDEvents)
+    {
+        //If this axis has already moved since the last delivery, and nothing else has happened since,
+        //then only the newest position matters.
+        if (event.type == ADBHIDJoystickAxisChanged)
+        {
+            for (NSInteger i = _pendingHIDEvents.count - 1; i >= 0; i--)
+            {
+                ADBHIDEvent *pendingEvent = [_pendingHIDEvents objectAtIndex: i];
+                if (pendingEvent.type != ADBHIDJoystickAxisChanged)
+                    break;
+                
+                if (pendingEvent.device == event.device && pendingEvent.element == event.element)
+                {
+                    [_pendingHIDEvents removeObjectAtIndex: i];
+                    break;
+                }
+            }
+        }
+        
+        [_pendingHIDEvents addObject: event];
+        
+        if (!_pendingHIDEventsScheduled)
+        {
+            _pendingHIDEventsScheduled = YES;
+            needsDelivery = YES;
+        }
+    }
+    
+    //Deliver in all run loop modes, so that input isn't held up while the user is dragging a window
+    //or a modal panel is open.
+    if (needsDelivery)
+    {
+        CFRunLoopRef mainRunLoop = CFRunLoopGetMain();
+        CFRunLoopPerformBlock(mainRunLoop, kCFRunLoopCommonModes, ^{
+            [self _deliverPendingHIDEvents];
+        });
+        CFRunLoopWakeUp(mainRunLoop);
+    }
+}
+
+- (void) _deliverPendingHIDEvents
+{
+    NSArray *events;
+    @synchronized(_pendingHIDEvents)
+    {
+        events = [_pendingHIDEvents copy];
+        [_pendingHIDEvents removeAllObjects];
+        _pendingHIDEventsScheduled = NO;
+    }
+    
+    for (ADBHIDEvent *event in events)
+    {
+        [self _dispatchHIDEventToActiveSession: event];
+    }
+    [events release];
+}
+
+- (void) _dispatchHIDEventToActiveSession: (ADBHIDEvent *)event
 {
 	//Forward all HID events to the current window's input controller
     //FIXME: this is gross, instead we should do some kind of subscribe system.
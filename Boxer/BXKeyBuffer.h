@@ -40,6 +40,10 @@
 //Returns BXNoKey if the buffer is empty.
 - (UInt16) nextKey;
 
+//Copies up to maxKeys of the next available keys into keys and consumes them.
+//Returns the number of keys copied, which will be 0 if the buffer is empty.
+- (NSUInteger) takeKeys: (UInt16 *)keys maxCount: (NSUInteger)maxKeys;
+
 //Empties the key buffer.
 - (void) empty;
 
@@ -356,6 +356,17 @@
     return key;
 }
 
+- (NSUInteger) takeKeys: (UInt16 *)keys maxCount: (NSUInteger)maxKeys
+{
+    NSUInteger numTaken = 0;
+    while (numTaken < maxKeys && _readIndex != _addIndex)
+    {
+        keys[numTaken++] = _keyCodes[_readIndex];
+        _readIndex = (_readIndex + 1) % BXKeyBufferSize;
+    }
+    return numTaken;
+}
+
 - (void) empty
 {
     _readIndex = _addIndex;
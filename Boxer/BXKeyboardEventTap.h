@@ -8,6 +8,10 @@
 
 #import <Foundation/Foundation.h>
 
+/// The event subtype for media key events, used to distinguish them from other kinds
+/// of private system events.
+#define BXMediaKeyEventSubtype 8
+
 /// The current status of the event tap.
 typedef NS_ENUM(NSInteger, BXKeyboardEventTapStatus) {
     /// The event tap is not installed.
@@ -28,6 +32,11 @@ typedef NS_ENUM(NSInteger, BXKeyboardEventTapStatus) {
 
 /// Manages a low-level event tap that captures keyboard events, giving Boxer the ability to respond to them
 /// (and potentially swallow them) before they reach the system and trigger system-wide hotkey functions.
+///
+/// Every keystroke in the system waits on the tap, so the tap decides which events to capture by itself
+/// without calling out to anything: its owner publishes the set of keys to capture and whether capturing
+/// is currently appropriate, and the tap only has to look these up. Captured events are posted straight
+/// to the front of the application's event queue.
 @interface BXKeyboardEventTap : NSObject
 {
     ADBContinuousThread *_tapThread;
@@ -38,6 +47,13 @@ typedef NS_ENUM(NSInteger, BXKeyboardEventTapStatus) {
     BOOL _restartNeeded;
     BXKeyboardEventTapStatus _status;
     
+    //Published on the main thread and read without locking on the tap's thread.
+    volatile BOOL _capturesKeyEvents;
+    volatile BOOL _capturesMediaKeyEvents;
+    volatile NSUInteger _passthroughModifiers;
+    volatile uint32_t _capturedKeyCodes[4];
+    volatile uint32_t _capturedMediaKeyCodes;
+    
     __unsafe_unretained id <BXKeyboardEventTapDelegate> _delegate;
 }
 
@@ -48,9 +64,27 @@ typedef NS_ENUM(NSInteger, BXKeyboardEventTapStatus) {
 /// and not all keyboard events.
 + (BOOL) canCaptureKeyEvents;
 
-/// The delegate whom we will ask for event-capture decisions.
+/// The delegate whom we will notify about the tap's status.
 @property (assign) id <BXKeyboardEventTapDelegate> delegate;
 
+/// Whether key events for the captured key codes should currently be captured.
+/// The tap's owner should update this whenever the conditions for capturing change.
+@property (assign) BOOL capturesKeyEvents;
+
+/// Whether media key events for the captured media key codes should currently be captured.
+@property (assign) BOOL capturesMediaKeyEvents;
+
+/// Key events with any of these NSEvent modifier flags held down are never captured.
+@property (assign) NSUInteger passthroughModifiers;
+
+/// Sets the virtual key codes whose keyup and keydown events should be captured.
+/// Only codes below 128 are recognised.
+- (void) setCapturedKeyCodes: (NSIndexSet *)keyCodes;
+
+/// Sets the NX_KEYTYPE codes of the media keys that should be captured.
+/// Only codes below 32 are recognised.
+- (void) setCapturedMediaKeyCodes: (NSIndexSet *)keyCodes;
+
 /// Whether the event tap should capture system hotkeys and media keys.
 /// Toggling this will attach/detach the event tap.
 @property (assign, nonatomic, getter=isEnabled) BOOL enabled;
@@ -58,7 +92,7 @@ typedef NS_ENUM(NSInteger, BXKeyboardEventTapStatus) {
 /// The current status of the event tap. See @c BXKeyboardEventTapStatus constants.
 @property (readonly) BXKeyboardEventTapStatus status;
 
-/// Whether the event tap should run on a separate thread or the main thread.
+/// Whether the event tap should run on a separate high-priority thread or the main thread.
 /// A separate thread prevents input lag in other apps when the main thread is busy.
 /// Changing this while a tap is in progress will stop and restart the tap.
 @property (assign, nonatomic) BOOL usesDedicatedThread;
@@ -77,25 +111,6 @@ typedef NS_ENUM(NSInteger, BXKeyboardEventTapStatus) {
 /// prepared to receive delegate messages on a thread other than the main thread.
 @protocol BXKeyboardEventTapDelegate <NSObject>
 
-/// Called when a BXKeyboardEventTap instance receives a keyup or keydown event,
-/// before the event reaches the default OS X handler for dispatch.
-/// @param tap      The BXKeyboardEventTap instance that received the key event.
-/// @param event    The NSKeyUp/NSKeyDown event received by the tap.
-/// @return YES if the event tap should swallow the without passing it on to the system.
-/// @return NO if the event tap should let the event reach the system unmolested.
-/// @note This may be called on a thread other than the main thread.
-- (BOOL) eventTap: (BXKeyboardEventTap *)tap shouldCaptureKeyEvent: (NSEvent *)event;
-
-/// Called when a BXKeyboardEventTap instance receives a system-defined event,
-/// before the event reaches the default OS X handler for dispatch.
-/// @param tap      The BXKeyboardEventTap instance that received the system-defined event.
-/// @param event    The event received by the tap. The event will be of type NX_SYSDEFINED,
-///                 and it is the responsibility of the delegate to parse the event's data.
-/// @return YES if the event tap should swallow the without passing it on to the system.
-/// @return NO if the event tap should let the event reach the system unmolested.
-/// @note This may be called on a thread other than the main thread.
-- (BOOL) eventTap: (BXKeyboardEventTap *)tap shouldCaptureSystemDefinedEvent: (NSEvent *)event;
-
 /// Called whenever the event tap has finished trying (and possibly succeeding) to attach itself.
 /// @param tap      The BXKeyboardEventTap instance that attempted to attach itself.
 ///                 If the event tap failed to attach, its @c status will be @c BXKeyboardEventTapNotTapping.
@@ -11,6 +11,11 @@
 
 #import "BXKeyboardEventTap.h"
 #import "ADBContinuousThread.h"
+#import <libkern/OSAtomic.h>
+
+
+//The QoS class for user-interactive work, which 10.8 and 10.9 don't know about.
+#define BXEventTapThreadQualityOfService 0x21
 
 
 @interface BXKeyboardEventTap ()
@@ -25,12 +30,16 @@
 ///Our CGEventTap callback. Receives the BXKeyboardEventTap instance as the userInfo parameter, and passes handling directly on to it.
 static CGEventRef _handleEventFromTap(CGEventTapProxy proxy, CGEventType type, CGEventRef event, void *userInfo);
 
-/// Receives keyboard and system events and asks our delegate whether to let them go through
+/// Receives keyboard and system events and decides whether to let them go through
 /// or swallow them whole.
 - (CGEventRef) _handleEvent: (CGEventRef)event
                      ofType: (CGEventType)type
                   fromProxy: (CGEventTapProxy)proxy;
 
+/// Posts the specified event to the front of the application's event queue.
+/// Returns NO if it could not be converted into a Cocoa event.
+- (BOOL) _postCapturedEvent: (CGEventRef)event;
+
 /// Creates an event tap, and starts up a dedicated thread to monitor it (if @c usesDedicatedThread is YES)
 /// or adds it to the main thread (if @c usesDedicatedThread is NO).
 - (void) _startTapping;
@@ -54,6 +63,9 @@ static CGEventRef _handleEventFromTap(CGEventTapProxy proxy, CGEventType type, C
 @synthesize delegate = _delegate;
 @synthesize status = _status;
 @synthesize restartNeeded = _restartNeeded;
+@synthesize capturesKeyEvents = _capturesKeyEvents;
+@synthesize capturesMediaKeyEvents = _capturesMediaKeyEvents;
+@synthesize passthroughModifiers = _passthroughModifiers;
 
 - (id) init
 {
@@ -107,6 +119,33 @@ static CGEventRef _handleEventFromTap(CGEventTapProxy proxy, CGEventType type, C
     }
 }
 
+- (void) setCapturedKeyCodes: (NSIndexSet *)keyCodes
+{
+    for (NSUInteger i=0; i<4; i++)
+    {
+        uint32_t bits = 0;
+        for (NSUInteger j=0; j<32; j++)
+        {
+            if ([keyCodes containsIndex: (i * 32) + j])
+                bits |= (1u << j);
+        }
+        _capturedKeyCodes[i] = bits;
+    }
+    OSMemoryBarrier();
+}
+
+- (void) setCapturedMediaKeyCodes: (NSIndexSet *)keyCodes
+{
+    uint32_t bits = 0;
+    for (NSUInteger j=0; j<32; j++)
+    {
+        if ([keyCodes containsIndex: j])
+            bits |= (1u << j);
+    }
+    _capturedMediaKeyCodes = bits;
+    OSMemoryBarrier();
+}
+
 + (BOOL) canCaptureKeyEvents
 {
     return AXAPIEnabled() || AXIsProcessTrusted();
@@ -254,6 +293,12 @@ static CGEventRef _handleEventFromTap(CGEventTapProxy proxy, CGEventType type, C
                                                                  selector: @selector(_runTapInDedicatedThread)
                                                                    object: nil] autorelease];
             
+            //Every keystroke in the system waits on this thread, so don't let it wait on anything else.
+            self.tapThread.name = @"com.boxer.keyboardEventTap";
+            self.tapThread.threadPriority = 1.0;
+            if ([self.tapThread respondsToSelector: @selector(setQualityOfService:)])
+                [self.tapThread setValue: @(BXEventTapThreadQualityOfService) forKey: @"qualityOfService"];
+            
             [self.tapThread start];
         }
         else
@@ -307,88 +352,67 @@ static CGEventRef _handleEventFromTap(CGEventTapProxy proxy, CGEventType type, C
                      ofType: (CGEventType)type
                   fromProxy: (CGEventTapProxy)proxy
 {
-    //If we're not enabled or we have no way of validating the events, give up early
-    if (!self.enabled || !self.delegate)
-    {
-        return event;
-    }
-    
+    //IMPLEMENTATION NOTE: this is called for every keystroke in the system, so events we don't
+    //want are let through having only looked at their raw fields.
     switch (type)
     {
         case kCGEventKeyDown:
         case kCGEventKeyUp:
+        {
+            if (!_enabled || !_capturesKeyEvents)
+                break;
+            
+            if (CGEventGetFlags(event) & _passthroughModifiers)
+                break;
+            
+            int64_t keyCode = CGEventGetIntegerValueField(event, kCGKeyboardEventKeycode);
+            if (keyCode < 0 || keyCode >= 128 || !(_capturedKeyCodes[keyCode >> 5] & (1u << (keyCode & 31))))
+                break;
+            
+            //Returning NULL cancels the original event
+            if ([self _postCapturedEvent: event])
+                return NULL;
+            
+            break;
+        }
+            
         case NX_SYSDEFINED:
         {
-            BOOL shouldCapture = NO;
+            //System-defined events are rare, and the media key code can only be reached through NSEvent.
+            if (!_enabled || !_capturesMediaKeyEvents)
+                break;
             
-            //First try and make this into a cocoa event
+            BOOL shouldCapture = NO;
+            NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
             NSEvent *cocoaEvent = nil;
             @try
             {
                 cocoaEvent = [NSEvent eventWithCGEvent: event];
             }
-            @catch (NSException *exception) 
-            {
-#ifdef BOXER_DEBUG
-                //If the event could not be converted into a cocoa event, give up
-                CFStringRef eventDesc = CFCopyDescription(event);
-                NSLog(@"Could not convert CGEvent: %@", (__bridge NSString *)eventDesc);
-                CFRelease(eventDesc);
-#endif
-            }
+            @catch (NSException *exception) { }
             
-            if (cocoaEvent)
+            if (cocoaEvent.subtype == BXMediaKeyEventSubtype)
             {
-                if (type == NX_SYSDEFINED)
-                {
-                    shouldCapture = [self.delegate eventTap: self shouldCaptureSystemDefinedEvent: cocoaEvent];
-                }
-                else
-                {
-                    shouldCapture = [self.delegate eventTap: self shouldCaptureKeyEvent: cocoaEvent];
-                }
+                NSUInteger mediaKeyCode = ((NSUInteger)cocoaEvent.data1 & 0xFFFF0000) >> 16;
+                shouldCapture = (mediaKeyCode < 32) && (_capturedMediaKeyCodes & (1u << mediaKeyCode));
+                if (shouldCapture)
+                    [NSApp postEvent: cocoaEvent atStart: YES];
             }
+            [pool drain];
             
             if (shouldCapture)
-            {
-                [NSApp postEvent: cocoaEvent atStart: YES];
-                
-                //This approach ought to be closer to the normal behaviour
-                //of the event dispatch mechanism, but seems to result
-                //in key events occasionally getting lost, causing stuck keys.
-                //So we go with a more explicit NSEvent-based dispatch instead.
-                /*
-                 ProcessSerialNumber PSN;
-                 OSErr error = GetCurrentProcess(&PSN);
-                 if (error == noErr)
-                 {
-                 CGEventPostToPSN(&PSN, event);
-                 
-                 //Returning NULL cancels the original event
-                 return NULL;
-                 }
-                 */
-                
-                //Returning NULL cancels the original event
                 return NULL;
-            }
             
             break;
         }
         
         case kCGEventTapDisabledByTimeout:
-        {
-            //Re-enable the event tap if it has been disabled after a timeout.
-            //(This may occur if our thread has been blocked for some reason.)
-            CGEventTapEnable(_tap, YES);
-            break;
-        }
-            
         case kCGEventTapDisabledByUserInput:
         {
-            //Re-enable the event tap if it has been disabled after a timeout.
-            //(This may occur if our thread has been blocked for some reason.)
-            CGEventTapEnable(_tap, YES);
+            //Re-enable the event tap straight away if it has been disabled, so that we don't miss any keys.
+            //(A timeout may occur if our thread has been blocked for some reason.)
+            if (_tap)
+                CGEventTapEnable(_tap, YES);
             break;
         }
     }
@@ -396,19 +420,47 @@ static CGEventRef _handleEventFromTap(CGEventTapProxy proxy, CGEventType type, C
     return event;
 }
 
-static CGEventRef _handleEventFromTap(CGEventTapProxy proxy, CGEventType type, CGEventRef event, void *userInfo)
+- (BOOL) _postCapturedEvent: (CGEventRef)event
 {
-    CGEventRef returnedEvent = event;
-    
+    BOOL posted = NO;
     NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    
+    NSEvent *cocoaEvent = nil;
+    @try
+    {
+        cocoaEvent = [NSEvent eventWithCGEvent: event];
+    }
+    @catch (NSException *exception) 
+    {
+#ifdef BOXER_DEBUG
+        //If the event could not be converted into a cocoa event, give up
+        CFStringRef eventDesc = CFCopyDescription(event);
+        NSLog(@"Could not convert CGEvent: %@", (__bridge NSString *)eventDesc);
+        CFRelease(eventDesc);
+#endif
+    }
+    
+    if (cocoaEvent)
+    {
+        //Posting the original CGEvent to our own process ought to be closer to the normal behaviour
+        //of the event dispatch mechanism, but seems to result in key events occasionally getting lost,
+        //causing stuck keys. So we go with a more explicit NSEvent-based dispatch instead.
+        [NSApp postEvent: cocoaEvent atStart: YES];
+        posted = YES;
+    }
+    
+    [pool drain];
+    return posted;
+}
+
+static CGEventRef _handleEventFromTap(CGEventTapProxy proxy, CGEventType type, CGEventRef event, void *userInfo)
+{
     BXKeyboardEventTap *tap = (__bridge BXKeyboardEventTap *)userInfo;
     if (tap)
     {
-        returnedEvent = [tap _handleEvent: event ofType: type fromProxy: proxy];
+        return [tap _handleEvent: event ofType: type fromProxy: proxy];
     }
-    [pool drain];
-    
-    return returnedEvent;
+    return event;
 }
 
 @end
@@ -61,4 +61,12 @@
 //in an unusable state.
 - (void) close;
 
+@optional
+
+//Handle a standard MIDI message that fell due at the specified emulated time, in milliseconds
+//since emulation began. Devices that implement this can schedule the message ahead to play
+//as far apart from its neighbours as it was in emulated time, rather than playing it as soon
+//as it arrives. Devices that don't will be sent handleMessage: instead.
+- (void) handleMessage: (NSData *)message atEmulatedTime: (double)timestamp;
+
 @end
@@ -0,0 +1,32 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+//BXMixerMIDISynth plays General MIDI through the same built-in synth as BXMIDISynth, but rather
+//than sending it to its own CoreAudio output, renders the synth's output offline into a DOSBox
+//mixer channel. Music then shares the emulator's volume, muting, recording and timing: each
+//message is placed at the sample within the mixer block where the emulated program sent it,
+//rather than whenever CoreAudio's output thread next gets around to it.
+
+#import "BXMIDISynth.h"
+#import "BXAudioSource.h"
+
+#ifdef __cplusplus
+    //Holds the synth's pending messages and renders its output. See BXMixerMIDISynth.mm.
+    class BXMixerMIDISynthRenderer;
+    //Renders the synth's output on an audio worker thread when one is worthwhile.
+    class BXMixerMIDISynthWorker;
+#endif
+
+@interface BXMixerMIDISynth : BXMIDISynth <BXAudioSource>
+{
+#ifdef __cplusplus
+    BXMixerMIDISynthRenderer *_renderer;
+    BXMixerMIDISynthWorker *_worker;
+#endif
+}
+
+@end
@@ -0,0 +1,409 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+#import "BXMixerMIDISynth.h"
+#import "dosbox.h"
+#import "pic.h"
+#import "audio_worker.h"
+#import <deque>
+#import <vector>
+
+
+#pragma mark -
+#pragma mark Constants
+
+#define BXMixerMIDISynthSampleRate 44100
+
+//How much output the audio worker may render ahead, in seconds.
+#define BXMixerMIDISynthRenderAhead 0.005
+
+//The most frames we ask the synth to render at once. The mixer rarely asks for more than
+//a few milliseconds at a time, so this is only reached when catching up.
+#define BXMixerMIDISynthMaxSlice 4096
+
+//The types of event we queue up for the renderer.
+enum {
+    BXMixerMIDISynthMessage,
+    BXMixerMIDISynthSysex,
+};
+
+//Each event is its type, then the frame within the next mixer block at which it was sent,
+//then the MIDI data itself.
+#define BXMixerMIDISynthEventHeaderLength (1 + sizeof(UInt32))
+
+
+#pragma mark -
+#pragma mark Renderer
+
+//Keeps the messages waiting for the synth and renders its output a mixer block at a time.
+//Each block's messages arrive before it is rendered, each with the frame within the block at
+//which it was sent: regular messages are passed to the synth with that frame as their offset
+//into the render, while a sysex, which can't be offset, is sent between two partial renders.
+//Any messages that can't be placed within the block they arrived for are sent at the start
+//of the next one.
+class BXMixerMIDISynthRenderer
+{
+public:
+    BXMixerMIDISynthRenderer(AudioUnit synthUnit) :
+        _synthUnit(synthUnit), _sampleTime(0), _blockFrame(0), _rendering(false) {};
+
+    void addEvent(const UInt8 *data, NSUInteger length)
+    {
+        //The first event after a render belongs to the next block.
+        if (_rendering)
+        {
+            for (std::deque<Event>::iterator event = _events.begin(); event != _events.end(); ++event)
+                event->frame = 0;
+
+            _blockFrame = 0;
+            _rendering = false;
+        }
+
+        Event event;
+        event.type = data[0];
+        memcpy(&event.frame, data + 1, sizeof(event.frame));
+        event.bytes.assign(data + BXMixerMIDISynthEventHeaderLength, data + length);
+        _events.push_back(event);
+    };
+
+    void render(SInt16 *output, UInt32 frames)
+    {
+        _rendering = true;
+        while (frames > 0)
+        {
+            UInt32 slice = MIN(frames, (UInt32)BXMixerMIDISynthMaxSlice);
+
+            //Send everything that's due before the end of this slice.
+            while (!_events.empty())
+            {
+                Event &event = _events.front();
+                UInt32 offset = (event.frame > _blockFrame) ? event.frame - _blockFrame : 0;
+                if (offset >= slice) break;
+
+                if (event.type == BXMixerMIDISynthSysex)
+                {
+                    //Render up to the sysex, and send it once that's done.
+                    if (offset > 0)
+                    {
+                        slice = offset;
+                        break;
+                    }
+                    MusicDeviceSysEx(_synthUnit, &event.bytes[0], (UInt32)event.bytes.size());
+                }
+                else
+                {
+                    UInt8 data1 = (event.bytes.size() > 1) ? event.bytes[1] : 0;
+                    UInt8 data2 = (event.bytes.size() > 2) ? event.bytes[2] : 0;
+                    MusicDeviceMIDIEvent(_synthUnit, event.bytes[0], data1, data2, offset);
+                }
+                _events.pop_front();
+            }
+
+            _renderSlice(output, slice);
+
+            output += slice * 2;
+            frames -= slice;
+            _blockFrame += slice;
+        }
+    };
+
+private:
+    struct Event {
+        UInt8 type;
+        UInt32 frame;
+        std::vector<UInt8> bytes;
+    };
+
+    void _renderSlice(SInt16 *output, UInt32 frames)
+    {
+        //The synth renders non-interleaved floats, which we interleave into 16-bit stereo for the mixer.
+        struct {
+            AudioBufferList list;
+            AudioBuffer right;
+        } buffers;
+        buffers.list.mNumberBuffers = 2;
+        buffers.list.mBuffers[0].mNumberChannels = 1;
+        buffers.list.mBuffers[0].mDataByteSize = frames * sizeof(float);
+        buffers.list.mBuffers[0].mData = _left;
+        buffers.right.mNumberChannels = 1;
+        buffers.right.mDataByteSize = frames * sizeof(float);
+        buffers.right.mData = _right;
+
+        AudioTimeStamp timeStamp;
+        memset(&timeStamp, 0, sizeof(timeStamp));
+        timeStamp.mSampleTime = _sampleTime;
+        timeStamp.mFlags = kAudioTimeStampSampleTimeValid;
+        _sampleTime += frames;
+
+        AudioUnitRenderActionFlags flags = 0;
+        if (AudioUnitRender(_synthUnit, &flags, &timeStamp, 0, frames, &buffers.list) != noErr)
+        {
+            memset(output, 0, frames * 2 * sizeof(SInt16));
+            return;
+        }
+
+        for (UInt32 i = 0; i < frames; i++)
+        {
+            output[i * 2]       = _sampleFromFloat(_left[i]);
+            output[i * 2 + 1]   = _sampleFromFloat(_right[i]);
+        }
+    };
+
+    static inline SInt16 _sampleFromFloat(float sample)
+    {
+        if (sample >= 1.0f) return 32767;
+        if (sample <= -1.0f) return -32768;
+        return (SInt16)(sample * 32767.0f);
+    };
+
+    AudioUnit _synthUnit;
+    Float64 _sampleTime;
+    std::deque<Event> _events;
+    UInt32 _blockFrame;
+    bool _rendering;
+    float _left[BXMixerMIDISynthMaxSlice];
+    float _right[BXMixerMIDISynthMaxSlice];
+};
+
+
+#pragma mark -
+#pragma mark Audio worker
+
+//Hands messages to the renderer and renders output on an audio worker thread, so that the
+//synth's rendering cost is kept off the emulation thread. See audio_worker.h.
+class BXMixerMIDISynthWorker : public AudioWorker
+{
+public:
+    BXMixerMIDISynthWorker(BXMixerMIDISynthRenderer *renderer, unsigned int sampleRate) :
+        AudioWorker("com.boxer.midisynth", 2 * sizeof(SInt16), (Bitu)(sampleRate * BXMixerMIDISynthRenderAhead)),
+        _renderer(renderer) {};
+
+    ~BXMixerMIDISynthWorker() { Drain(); };
+
+protected:
+    void ApplyEvent(const Bit8u *data, Bitu length)
+    {
+        _renderer->addEvent(data, length);
+    };
+
+    void Render(void *buffer, Bitu frames)
+    {
+        _renderer->render((SInt16 *)buffer, (UInt32)frames);
+    };
+
+private:
+    BXMixerMIDISynthRenderer *_renderer;
+};
+
+
+#pragma mark -
+#pragma mark Private method declarations
+
+@interface BXMixerMIDISynth ()
+
+//Queues a MIDI message or sysex for the renderer, marked with where in the current mixer block it was sent:
+//tickIndex is how far through the current emulated millisecond it was sent, from 0.0 to 1.0.
+- (void) _queueEventOfType: (UInt8)type withData: (NSData *)message atTickIndex: (double)tickIndex;
+
+@end
+
+
+#pragma mark -
+#pragma mark Implementation
+
+@implementation BXMixerMIDISynth
+
+#pragma mark -
+#pragma mark Initialization and cleanup
+
+- (void) close
+{
+    //Deleting the worker sends any messages it still had waiting.
+    if (_worker)
+    {
+        delete _worker;
+        _worker = NULL;
+    }
+
+    if (_renderer)
+    {
+        delete _renderer;
+        _renderer = NULL;
+    }
+
+    if (_synthUnit)
+    {
+        AudioUnitUninitialize(_synthUnit);
+        AudioComponentInstanceDispose(_synthUnit);
+        _synthUnit = NULL;
+    }
+
+    [super close];
+}
+
+//Overridden to open the synth on its own without an output unit, since we render it ourselves.
+- (BOOL) _prepareAudioGraphWithError: (NSError **)outError
+{
+    AudioComponentDescription synthDesc;
+
+    //OS X's built-in MIDI synth
+    synthDesc.componentType = kAudioUnitType_MusicDevice;
+    synthDesc.componentSubType = kAudioUnitSubType_DLSSynth;
+    synthDesc.componentManufacturer = kAudioUnitManufacturer_Apple;
+    synthDesc.componentFlags = 0;
+    synthDesc.componentFlagsMask = 0;
+
+    //Ask for stereo floats at our own sample rate, which the mixer will resample as needed.
+    AudioStreamBasicDescription format;
+    memset(&format, 0, sizeof(format));
+    format.mSampleRate = BXMixerMIDISynthSampleRate;
+    format.mFormatID = kAudioFormatLinearPCM;
+    format.mFormatFlags = kAudioFormatFlagsNativeFloatPacked | kAudioFormatFlagIsNonInterleaved;
+    format.mBytesPerPacket = sizeof(float);
+    format.mFramesPerPacket = 1;
+    format.mBytesPerFrame = sizeof(float);
+    format.mChannelsPerFrame = 2;
+    format.mBitsPerChannel = 32;
+
+    UInt32 maxFrames = BXMixerMIDISynthMaxSlice;
+
+    OSStatus errCode = noErr;
+
+#define REQUIRE(result) if ((errCode = result) != noErr) break
+
+    do {
+        AudioComponent synthComponent = AudioComponentFindNext(NULL, &synthDesc);
+        if (!synthComponent)
+        {
+            errCode = kAudioUnitErr_InvalidElement;
+            break;
+        }
+
+        REQUIRE(AudioComponentInstanceNew(synthComponent, &_synthUnit));
+        REQUIRE(AudioUnitSetProperty(_synthUnit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Output, 0, &format, sizeof(format)));
+        REQUIRE(AudioUnitSetProperty(_synthUnit, kAudioUnitProperty_MaximumFramesPerSlice, kAudioUnitScope_Global, 0, &maxFrames, sizeof(maxFrames)));
+        REQUIRE(AudioUnitInitialize(_synthUnit));
+    }
+    while (NO);
+
+    if (errCode != noErr)
+    {
+        //Clean up after ourselves if there was an error
+        if (_synthUnit)
+        {
+            AudioComponentInstanceDispose(_synthUnit);
+            _synthUnit = NULL;
+        }
+
+        if (outError)
+        {
+            *outError = [NSError errorWithDomain: NSOSStatusErrorDomain
+                                            code: errCode
+                                        userInfo: nil];
+        }
+        return NO;
+    }
+
+    _renderer = new BXMixerMIDISynthRenderer(_synthUnit);
+    if (AudioWorker::Worthwhile())
+        _worker = new BXMixerMIDISynthWorker(_renderer, BXMixerMIDISynthSampleRate);
+
+    return YES;
+}
+
+
+#pragma mark -
+#pragma mark MIDI processing and status
+
+- (void) handleMessage: (NSData *)message
+{
+    NSAssert(_renderer != NULL, @"handleMessage: called before successful initialization.");
+    NSAssert(message.length > 0, @"0-length message received by handleMessage:");
+
+    [self _queueEventOfType: BXMixerMIDISynthMessage withData: message atTickIndex: PIC_TickIndex()];
+}
+
+- (void) handleMessage: (NSData *)message atEmulatedTime: (double)timestamp
+{
+    NSAssert(_renderer != NULL, @"handleMessage:atEmulatedTime: called before successful initialization.");
+    NSAssert(message.length > 0, @"0-length message received by handleMessage:atEmulatedTime:");
+
+    //Place the message by when it fell due rather than when it reached us, as long as that
+    //falls within the current millisecond.
+    double tickIndex = MIN(MAX(timestamp - PIC_Ticks, 0.0), 1.0);
+    [self _queueEventOfType: BXMixerMIDISynthMessage withData: message atTickIndex: tickIndex];
+}
+
+- (void) handleSysex: (NSData *)message
+{
+    NSAssert(_renderer != NULL, @"handleSysEx: called before successful initialization.");
+    NSAssert(message.length > 0, @"0-length message received by handleSysex:");
+
+    [self _queueEventOfType: BXMixerMIDISynthSysex withData: message atTickIndex: PIC_TickIndex()];
+}
+
+- (void) _queueEventOfType: (UInt8)type withData: (NSData *)message atTickIndex: (double)tickIndex
+{
+    //The mixer renders each emulated millisecond's output at the start of the next one,
+    //so how far the emulation is through the current millisecond tells us how far into
+    //the next block of output this message belongs.
+    UInt32 frame = (UInt32)(tickIndex * (BXMixerMIDISynthSampleRate / 1000.0));
+
+    NSMutableData *event = [NSMutableData dataWithCapacity: BXMixerMIDISynthEventHeaderLength + message.length];
+    [event appendBytes: &type length: 1];
+    [event appendBytes: &frame length: sizeof(frame)];
+    [event appendData: message];
+
+    if (_worker)
+        _worker->QueueEvent(event.bytes, event.length);
+    else
+        _renderer->addEvent((const UInt8 *)event.bytes, event.length);
+}
+
+- (void) resume
+{
+    //Because BXMixerMIDISynth is mixer-driven, this has no effect
+}
+
+- (void) pause
+{
+    //Because BXMixerMIDISynth is mixer-driven, this has no effect
+}
+
+//Because BXMixerMIDISynth is mixer-driven, this has no effect:
+//it is up to the renderer to control volume.
+- (void) setVolume: (float)volume
+{
+
+}
+
+- (float) volume
+{
+    return 1.0f;
+}
+
+- (NSUInteger) sampleRate
+{
+    return BXMixerMIDISynthSampleRate;
+}
+
+- (BOOL) renderOutputToBuffer: (void *)buffer
+                       frames: (NSUInteger)numFrames
+                   sampleRate: (NSUInteger *)sampleRate
+                       format: (BXAudioFormat *)format
+{
+    if (_worker)
+        _worker->Read(buffer, numFrames);
+    else
+        _renderer->render((SInt16 *)buffer, (UInt32)numFrames);
+
+    *sampleRate = self.sampleRate;
+    *format = BXAudioFormat16Bit | BXAudioFormatSigned | BXAudioFormatStereo;
+    return YES;
+}
+
+@end
@@ -0,0 +1,123 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+
+//BXPerformanceTelemetry keeps a running record of how a game has actually performed on this Mac,
+//across all the sessions it has been played in: the CPU speed it asked for against what the host
+//managed, which way the adaptive core switched and why, how often the sound ran dry, how much
+//frameskipping was needed, how often the game rewrote its own code and how often MT-32 emulation
+//held up the mixer. From this it derives recommended settings for later sessions.
+
+//The record is stored with the rest of the gamebox's settings. Recommendations can also be exported
+//in GameProfiles.plist form, to be folded into the game's profile so that new users start from them.
+
+#import <Foundation/Foundation.h>
+
+
+#pragma mark - Constants
+
+//Keys for the dictionary returned by -recommendedSettings, which are also used for the
+//BXProfileRecommendedSettings dictionary of GameProfiles.plist entries.
+
+/// The CPU core the game should be run with, as an NSNumber of BXCoreMode.
+/// @c BXCoreNormal means the game rewrites its own code too often for the dynamic core.
+extern NSString * const BXRecommendedCoreModeKey;
+
+/// The highest speed, in cycles, that automatic speed should be allowed to reach, as an NSNumber.
+/// Absent if the host keeps up with the game at whatever speed it settles on.
+extern NSString * const BXRecommendedAutoSpeedLimitKey;
+
+/// Whether automatic frameskipping should be turned on, as an NSNumber boolean.
+extern NSString * const BXRecommendedAutomaticFrameskipKey;
+
+/// How far ahead of the mixer MT-32 emulation should render, in seconds, as an NSNumber.
+extern NSString * const BXRecommendedMT32RenderAheadKey;
+
+
+//The GameProfiles.plist key under which a profile's recommended settings are stored.
+extern NSString * const BXProfileRecommendedSettingsKey;
+
+
+@class BXEmulator;
+
+#pragma mark - Interface
+
+@interface BXPerformanceTelemetry : NSObject
+{
+    NSUInteger _sessionCount;
+    NSTimeInterval _sampledTime;
+    
+    NSTimeInterval _autoSpeedTime;
+    NSTimeInterval _shortfallTime;
+    double _requestedCycleSeconds;
+    double _achievedCycleSeconds;
+    NSInteger _steadyPeakCycles;
+    
+    NSUInteger _dynamicSwitches;
+    NSUInteger _normalSwitches;
+    NSUInteger _selfModifyingCodeSwitches;
+    
+    NSUInteger _audioUnderruns;
+    double _frameskipSeconds;
+    NSUInteger _codeTranslations;
+    NSUInteger _codeInvalidations;
+    
+    NSTimeInterval _MT32Time;
+    NSUInteger _MT32RenderStalls;
+    NSTimeInterval _MT32RenderAhead;
+    
+    //The emulator's running counters as of the previous sample, so that each sample can record
+    //how far they have moved since. Reset whenever a sample is skipped.
+    BOOL _hasBaseline;
+    NSUInteger _lastUnderruns;
+    NSUInteger _lastTranslations;
+    NSUInteger _lastInvalidations;
+    NSUInteger _lastMT32Stalls;
+}
+
+/// How long this game has been sampled for in total, across all sessions.
+@property (readonly, nonatomic) NSTimeInterval sampledTime;
+
+/// The number of sessions that have been sampled.
+@property (readonly, nonatomic) NSUInteger sessionCount;
+
+/// The share of translated code blocks that the game later wrote over, from 0.0 upwards.
+@property (readonly, nonatomic) double selfModifyingCodeRate;
+
+/// Audio underruns per minute of sampled time.
+@property (readonly, nonatomic) double underrunsPerMinute;
+
+/// A plist-compatible representation of the record, suitable for storing in the gamebox settings.
+@property (readonly, nonatomic) NSDictionary *dictionaryRepresentation;
+
+/// Settings derived from the record, using the keys listed under @c BXRecommendedCoreModeKey.
+/// Only settings that differ from Boxer's own defaults are included. Returns @c nil until
+/// the game has been sampled for long enough to draw any conclusions.
+@property (readonly, nonatomic) NSDictionary *recommendedSettings;
+
+/// Returns a record that continues from one previously returned by -dictionaryRepresentation.
+/// The dictionary may be nil, in which case the record starts out empty.
+- (id) initWithDictionaryRepresentation: (NSDictionary *)representation;
+
+/// Called at the start of each new session to be sampled.
+- (void) beginSession;
+
+/// Records the state of the emulator over the specified interval since the previous sample.
+/// Samples taken while the emulator is paused or fast-forwarding are skipped, since they say
+/// nothing about how the game runs.
+- (void) sampleEmulator: (BXEmulator *)emulator interval: (NSTimeInterval)interval;
+
+/// Records a decision by the adaptive core to move to or from the dynamic core,
+/// with one of the BXEmulatorAdaptiveCoreReason constants.
+- (void) recordAdaptiveCoreSwitchToDynamic: (BOOL)dynamic reason: (NSString *)reason;
+
+/// Returns a GameProfiles.plist-format dictionary carrying the recommended settings for
+/// the profile with the specified identifier, along with the evidence they were derived from.
+/// Returns nil if there are no recommendations yet.
+- (NSDictionary *) profileEntryWithIdentifier: (NSString *)identifier gameName: (NSString *)gameName;
+
+@end
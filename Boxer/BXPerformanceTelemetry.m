@@ -0,0 +1,309 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+#import "BXPerformanceTelemetry.h"
+#import "BXEmulator+BXAudio.h"
+#import "BXEmulatorDelegate.h"
+#import "BXVideoHandler.h"
+#import "BXEmulatedMT32.h"
+
+
+#pragma mark - Constants
+
+NSString * const BXRecommendedCoreModeKey           = @"coreMode";
+NSString * const BXRecommendedAutoSpeedLimitKey     = @"autoSpeedLimit";
+NSString * const BXRecommendedAutomaticFrameskipKey = @"automaticFrameskip";
+NSString * const BXRecommendedMT32RenderAheadKey    = @"MT32RenderAhead";
+
+NSString * const BXProfileRecommendedSettingsKey    = @"BXProfileRecommendedSettings";
+
+
+//How long a game must have been sampled for before we recommend anything for it.
+#define BXTelemetryMinimumSampledTime 300.0
+
+//How long a game must have been sampled at automatic speed or with MT-32 music
+//before we recommend anything about either.
+#define BXTelemetryMinimumFeatureTime 60.0
+
+//A sample whose achieved speed falls this far short of the requested speed counts as the host falling behind.
+#define BXTelemetryShortfallRatio 0.9
+
+//How much of the time the host must fall behind, and how often the sound must run dry,
+//before we recommend limiting automatic speed.
+#define BXTelemetryShortfallShare 0.25
+#define BXTelemetryUnderrunsPerMinute 1.0
+
+//The average frameskip above which we recommend automatic frameskipping.
+#define BXTelemetryFrameskipThreshold 0.5
+
+//The share of translated blocks that must be written over, and the minimum number of translations
+//for that to be meaningful, before we recommend the normal core.
+#define BXTelemetrySelfModifyingCodeRate 0.5
+#define BXTelemetryMinimumTranslations 1000
+
+//How many times per minute the MT-32 may hold up the mixer before we recommend rendering further ahead,
+//and the furthest ahead we'll recommend.
+#define BXTelemetryMT32StallsPerMinute 1.0
+#define BXTelemetryMaxMT32RenderAhead 0.05
+
+
+//Keys for the dictionary representation.
+static NSString * const BXTelemetrySessionCountKey          = @"sessions";
+static NSString * const BXTelemetrySampledTimeKey           = @"sampledTime";
+static NSString * const BXTelemetryAutoSpeedTimeKey         = @"autoSpeedTime";
+static NSString * const BXTelemetryShortfallTimeKey         = @"shortfallTime";
+static NSString * const BXTelemetryRequestedCycleSecondsKey = @"requestedCycleSeconds";
+static NSString * const BXTelemetryAchievedCycleSecondsKey  = @"achievedCycleSeconds";
+static NSString * const BXTelemetrySteadyPeakCyclesKey      = @"steadyPeakCycles";
+static NSString * const BXTelemetryDynamicSwitchesKey       = @"dynamicSwitches";
+static NSString * const BXTelemetryNormalSwitchesKey        = @"normalSwitches";
+static NSString * const BXTelemetrySMCSwitchesKey           = @"selfModifyingCodeSwitches";
+static NSString * const BXTelemetryAudioUnderrunsKey        = @"audioUnderruns";
+static NSString * const BXTelemetryFrameskipSecondsKey      = @"frameskipSeconds";
+static NSString * const BXTelemetryCodeTranslationsKey      = @"codeTranslations";
+static NSString * const BXTelemetryCodeInvalidationsKey     = @"codeInvalidations";
+static NSString * const BXTelemetryMT32TimeKey              = @"MT32Time";
+static NSString * const BXTelemetryMT32RenderStallsKey      = @"MT32RenderStalls";
+static NSString * const BXTelemetryMT32RenderAheadKey       = @"MT32RenderAhead";
+
+//The key under which profile entries carry the record their recommendations were derived from.
+static NSString * const BXProfileTelemetryKey               = @"BXProfileTelemetry";
+
+
+@implementation BXPerformanceTelemetry
+@synthesize sampledTime = _sampledTime;
+@synthesize sessionCount = _sessionCount;
+
+//Returns how far a running counter has moved since it was last read. Counters that have gone
+//backwards have been reset (e.g. because the device they belong to was replaced), and so have
+//moved by their whole current value.
+static inline NSUInteger _counterDelta(NSUInteger current, NSUInteger previous)
+{
+    return (current >= previous) ? current - previous : current;
+}
+
+- (id) initWithDictionaryRepresentation: (NSDictionary *)representation
+{
+    self = [self init];
+    if (self)
+    {
+        _sessionCount           = [[representation objectForKey: BXTelemetrySessionCountKey] unsignedIntegerValue];
+        _sampledTime            = [[representation objectForKey: BXTelemetrySampledTimeKey] doubleValue];
+        _autoSpeedTime          = [[representation objectForKey: BXTelemetryAutoSpeedTimeKey] doubleValue];
+        _shortfallTime          = [[representation objectForKey: BXTelemetryShortfallTimeKey] doubleValue];
+        _requestedCycleSeconds  = [[representation objectForKey: BXTelemetryRequestedCycleSecondsKey] doubleValue];
+        _achievedCycleSeconds   = [[representation objectForKey: BXTelemetryAchievedCycleSecondsKey] doubleValue];
+        _steadyPeakCycles       = [[representation objectForKey: BXTelemetrySteadyPeakCyclesKey] integerValue];
+        _dynamicSwitches        = [[representation objectForKey: BXTelemetryDynamicSwitchesKey] unsignedIntegerValue];
+        _normalSwitches         = [[representation objectForKey: BXTelemetryNormalSwitchesKey] unsignedIntegerValue];
+        _selfModifyingCodeSwitches = [[representation objectForKey: BXTelemetrySMCSwitchesKey] unsignedIntegerValue];
+        _audioUnderruns         = [[representation objectForKey: BXTelemetryAudioUnderrunsKey] unsignedIntegerValue];
+        _frameskipSeconds       = [[representation objectForKey: BXTelemetryFrameskipSecondsKey] doubleValue];
+        _codeTranslations       = [[representation objectForKey: BXTelemetryCodeTranslationsKey] unsignedIntegerValue];
+        _codeInvalidations      = [[representation objectForKey: BXTelemetryCodeInvalidationsKey] unsignedIntegerValue];
+        _MT32Time               = [[representation objectForKey: BXTelemetryMT32TimeKey] doubleValue];
+        _MT32RenderStalls       = [[representation objectForKey: BXTelemetryMT32RenderStallsKey] unsignedIntegerValue];
+        _MT32RenderAhead        = [[representation objectForKey: BXTelemetryMT32RenderAheadKey] doubleValue];
+    }
+    return self;
+}
+
+- (NSDictionary *) dictionaryRepresentation
+{
+    return @{
+             BXTelemetrySessionCountKey:            @(_sessionCount),
+             BXTelemetrySampledTimeKey:             @(_sampledTime),
+             BXTelemetryAutoSpeedTimeKey:           @(_autoSpeedTime),
+             BXTelemetryShortfallTimeKey:           @(_shortfallTime),
+             BXTelemetryRequestedCycleSecondsKey:   @(_requestedCycleSeconds),
+             BXTelemetryAchievedCycleSecondsKey:    @(_achievedCycleSeconds),
+             BXTelemetrySteadyPeakCyclesKey:        @(_steadyPeakCycles),
+             BXTelemetryDynamicSwitchesKey:         @(_dynamicSwitches),
+             BXTelemetryNormalSwitchesKey:          @(_normalSwitches),
+             BXTelemetrySMCSwitchesKey:             @(_selfModifyingCodeSwitches),
+             BXTelemetryAudioUnderrunsKey:          @(_audioUnderruns),
+             BXTelemetryFrameskipSecondsKey:        @(_frameskipSeconds),
+             BXTelemetryCodeTranslationsKey:        @(_codeTranslations),
+             BXTelemetryCodeInvalidationsKey:       @(_codeInvalidations),
+             BXTelemetryMT32TimeKey:                @(_MT32Time),
+             BXTelemetryMT32RenderStallsKey:        @(_MT32RenderStalls),
+             BXTelemetryMT32RenderAheadKey:         @(_MT32RenderAhead),
+             };
+}
+
+
+#pragma mark - Sampling
+
+- (void) beginSession
+{
+    _sessionCount++;
+    _hasBaseline = NO;
+}
+
+- (void) sampleEmulator: (BXEmulator *)emulator interval: (NSTimeInterval)interval
+{
+    //Time spent paused or fast-forwarding tells us nothing about how the game runs,
+    //and the counters will have moved in ways that don't reflect normal play.
+    if (!emulator.isExecuting || emulator.isPaused || emulator.isTurboSpeed)
+    {
+        _hasBaseline = NO;
+        return;
+    }
+    
+    NSUInteger underruns = [[emulator.audioBufferStatistics objectForKey: BXEmulatorAudioUnderrunsKey] unsignedIntegerValue];
+    
+    NSDictionary *cacheStatistics = emulator.dynamicCacheStatistics;
+    NSUInteger translations     = [[cacheStatistics objectForKey: BXEmulatorDynamicCacheTranslationsKey] unsignedIntegerValue];
+    NSUInteger invalidations    = [[cacheStatistics objectForKey: BXEmulatorDynamicCacheInvalidationsKey] unsignedIntegerValue];
+    
+    BXEmulatedMT32 *MT32 = nil;
+    if ([(id)emulator.activeMIDIDevice isKindOfClass: [BXEmulatedMT32 class]])
+        MT32 = (BXEmulatedMT32 *)emulator.activeMIDIDevice;
+    NSUInteger MT32Stalls = MT32.renderStallCount;
+    
+    //The first sample after a gap only establishes where the counters start from.
+    if (_hasBaseline)
+    {
+        NSUInteger newUnderruns = _counterDelta(underruns, _lastUnderruns);
+    
+        _sampledTime += interval;
+        _audioUnderruns += newUnderruns;
+        _frameskipSeconds += emulator.videoHandler.frameskip * interval;
+        _codeTranslations += _counterDelta(translations, _lastTranslations);
+        _codeInvalidations += _counterDelta(invalidations, _lastInvalidations);
+    
+        if (emulator.isAutoSpeed)
+        {
+            NSDictionary *speedStatistics = emulator.autoSpeedStatistics;
+            NSInteger requested = [[speedStatistics objectForKey: BXEmulatorAutoSpeedTargetKey] integerValue];
+            NSInteger achieved  = [[speedStatistics objectForKey: BXEmulatorAutoSpeedAchievedKey] integerValue];
+    
+            if (requested > 0 && achieved > 0)
+            {
+                _autoSpeedTime += interval;
+                _requestedCycleSeconds += requested * interval;
+                _achievedCycleSeconds += achieved * interval;
+    
+                BOOL fellBehind = (achieved < requested * BXTelemetryShortfallRatio);
+                if (fellBehind)
+                    _shortfallTime += interval;
+    
+                //Remember the fastest speed the host has sustained without the sound breaking up:
+                //this is what we'll cap automatic speed at if it turns out to overreach.
+                if (!fellBehind && !newUnderruns)
+                    _steadyPeakCycles = MAX(_steadyPeakCycles, achieved);
+            }
+        }
+    
+        if (MT32)
+        {
+            _MT32Time += interval;
+            _MT32RenderStalls += _counterDelta(MT32Stalls, _lastMT32Stalls);
+            _MT32RenderAhead = MT32.renderAhead;
+        }
+    }
+    
+    _lastUnderruns = underruns;
+    _lastTranslations = translations;
+    _lastInvalidations = invalidations;
+    _lastMT32Stalls = MT32Stalls;
+    _hasBaseline = YES;
+}
+
+- (void) recordAdaptiveCoreSwitchToDynamic: (BOOL)dynamic reason: (NSString *)reason
+{
+    if (dynamic)
+        _dynamicSwitches++;
+    else
+        _normalSwitches++;
+    
+    if ([reason isEqualToString: BXEmulatorAdaptiveCoreReasonSelfModifyingCode])
+        _selfModifyingCodeSwitches++;
+}
+
+
+#pragma mark - Recommendations
+
+- (double) selfModifyingCodeRate
+{
+    if (_codeTranslations)
+        return _codeInvalidations / (double)_codeTranslations;
+    else
+        return 0;
+}
+
+- (double) underrunsPerMinute
+{
+    if (_sampledTime > 0)
+        return _audioUnderruns / (_sampledTime / 60.0);
+    else
+        return 0;
+}
+
+- (NSDictionary *) recommendedSettings
+{
+    if (_sampledTime < BXTelemetryMinimumSampledTime)
+        return nil;
+    
+    NSMutableDictionary *settings = [NSMutableDictionary dictionaryWithCapacity: 4];
+    
+    //Games that the adaptive core had to pull off the dynamic core, or that write over most of what
+    //the dynamic core translates, are better off on the normal core from the start.
+    BOOL rewritesCode = (_codeTranslations >= BXTelemetryMinimumTranslations && self.selfModifyingCodeRate >= BXTelemetrySelfModifyingCodeRate);
+    if (_selfModifyingCodeSwitches > 0 || rewritesCode)
+        [settings setObject: @(BXCoreNormal) forKey: BXRecommendedCoreModeKey];
+    
+    //If automatic speed keeps overreaching what the host can manage, and the sound suffers for it,
+    //hold it to the fastest speed the host has managed cleanly.
+    if (_autoSpeedTime >= BXTelemetryMinimumFeatureTime && _steadyPeakCycles > 0)
+    {
+        double shortfallShare = _shortfallTime / _autoSpeedTime;
+        if (shortfallShare >= BXTelemetryShortfallShare && self.underrunsPerMinute >= BXTelemetryUnderrunsPerMinute)
+        {
+            NSInteger limit = MAX(1000, (_steadyPeakCycles / 1000) * 1000);
+            [settings setObject: @(limit) forKey: BXRecommendedAutoSpeedLimitKey];
+        }
+    }
+    
+    //If the game has needed frameskipping for much of the time, let Boxer manage it.
+    if (_frameskipSeconds / _sampledTime >= BXTelemetryFrameskipThreshold)
+        [settings setObject: @YES forKey: BXRecommendedAutomaticFrameskipKey];
+    
+    //If the MT-32 keeps holding up the mixer, render further ahead than was being rendered.
+    //Each session that still stalls will double it again, up to a point.
+    if (_MT32Time >= BXTelemetryMinimumFeatureTime && _MT32RenderAhead > 0)
+    {
+        double stallsPerMinute = _MT32RenderStalls / (_MT32Time / 60.0);
+        if (stallsPerMinute >= BXTelemetryMT32StallsPerMinute)
+        {
+            NSTimeInterval renderAhead = MIN(_MT32RenderAhead * 2, BXTelemetryMaxMT32RenderAhead);
+            [settings setObject: @(renderAhead) forKey: BXRecommendedMT32RenderAheadKey];
+        }
+    }
+    
+    return settings;
+}
+
+- (NSDictionary *) profileEntryWithIdentifier: (NSString *)identifier gameName: (NSString *)gameName
+{
+    NSDictionary *recommendations = self.recommendedSettings;
+    if (!recommendations.count)
+        return nil;
+    
+    NSMutableDictionary *entry = [NSMutableDictionary dictionaryWithCapacity: 4];
+    if (identifier)
+        [entry setObject: identifier forKey: @"BXProfileIdentifier"];
+    if (gameName)
+        [entry setObject: gameName forKey: @"BXProfileGameName"];
+    
+    [entry setObject: recommendations forKey: BXProfileRecommendedSettingsKey];
+    [entry setObject: self.dictionaryRepresentation forKey: BXProfileTelemetryKey];
+    
+    return entry;
+}
+
+@end
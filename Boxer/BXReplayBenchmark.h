@@ -0,0 +1,122 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+
+//BXReplayBenchmark is a headless session that plays back a replay recorded with BXInputReplay
+//as fast as the host can run it, and reports how fast that was and where the time went.
+//Boxer runs one when launched with --replay-benchmark <replay folder> [report path].
+
+//With measuresAudio turned on, the replay is instead played back in real time with the sound
+//output running as it would for a player, while other threads keep the host as busy as hostLoad
+//asks; and the results report how often the sound ran dry and how far it lagged behind.
+//Boxer runs one of these when launched with
+//--audio-benchmark <replay folder> <host load percentage> <maximum underruns> [report path],
+//and fails if the sound ran dry more often than allowed.
+
+//Drives are mounted read-only for the benchmark, so that a run can't change what the next run sees.
+
+#import "BXHeadlessSession.h"
+
+
+#pragma mark -
+#pragma mark Constants
+
+/// Keys for the dictionary returned by @c results.
+/// NSNumbers wrapping the emulated frames drawn, the emulated and host seconds the replay took,
+/// the emulated frames drawn per host second, and the CPU time the whole process used.
+extern NSString * const BXReplayBenchmarkFrameCountKey;
+extern NSString * const BXReplayBenchmarkEmulatedSecondsKey;
+extern NSString * const BXReplayBenchmarkHostSecondsKey;
+extern NSString * const BXReplayBenchmarkFramesPerSecondKey;
+extern NSString * const BXReplayBenchmarkProcessCPUSecondsKey;
+
+/// An NSDictionary mapping the subsystem keys from BXEmulator+BXPerformanceCounters to NSNumbers
+/// wrapping the seconds of host time the emulation thread spent in each during the replay.
+extern NSString * const BXReplayBenchmarkSubsystemSecondsKey;
+/// An NSDictionary mapping the names of mixer channels to NSNumbers wrapping the seconds spent mixing each.
+extern NSString * const BXReplayBenchmarkMixerChannelSecondsKey;
+
+/// NSNumbers wrapping the checksum of the frames drawn during this run and during the recording,
+/// and whether the two matched. If they didn't, the replay went differently from the recording
+/// and its timings shouldn't be compared with other runs.
+extern NSString * const BXReplayBenchmarkFrameChecksumKey;
+extern NSString * const BXReplayBenchmarkRecordedFrameChecksumKey;
+extern NSString * const BXReplayBenchmarkChecksumMatchesKey;
+
+/// Only present when @c measuresAudio is enabled. NSNumbers wrapping the share of each host CPU that
+/// was kept busy during the replay; how many times the sound output asked for audio and how many of
+/// those times it ran dry, came up slightly short or had so much waiting that it skipped some; and
+/// how many frames of audio were thrown away.
+extern NSString * const BXReplayBenchmarkHostLoadKey;
+extern NSString * const BXReplayBenchmarkAudioCallbacksKey;
+extern NSString * const BXReplayBenchmarkAudioUnderrunsKey;
+extern NSString * const BXReplayBenchmarkAudioStretchedCallbacksKey;
+extern NSString * const BXReplayBenchmarkAudioOverrunsKey;
+extern NSString * const BXReplayBenchmarkAudioDroppedFramesKey;
+
+/// Only present when @c measuresAudio is enabled. NSNumbers wrapping the average and the longest
+/// time in seconds that audio took to reach the output device after it was mixed.
+extern NSString * const BXReplayBenchmarkAudioAverageDelayKey;
+extern NSString * const BXReplayBenchmarkAudioPeakDelayKey;
+
+/// Only present when @c measuresAudio is enabled. NSNumbers wrapping how many times automatic speed
+/// changed the cycle count during the replay, how many of those changes were made while the sound was
+/// running short, and how many of those were raises.
+extern NSString * const BXReplayBenchmarkAutoSpeedAdjustmentsKey;
+extern NSString * const BXReplayBenchmarkAutoSpeedStarvedAdjustmentsKey;
+extern NSString * const BXReplayBenchmarkAutoSpeedStarvedRaisesKey;
+
+
+@interface BXReplayBenchmark : BXHeadlessSession
+{
+    NSURL *_replayURL;
+    NSDictionary *_replayInfo;
+    NSDictionary *_results;
+    NSError *_error;
+
+    BOOL _startupFinished;
+    BOOL _replayStarted;
+    CFAbsoluteTime _startTime;
+    double _startCPUSeconds;
+
+    NSUInteger _lastPerformanceSequence;
+    NSMutableDictionary *_subsystemSeconds;
+    NSMutableDictionary *_mixerChannelSeconds;
+
+    BOOL _measuresAudio;
+    double _hostLoad;
+    volatile BOOL _generatingLoad;
+    NSDictionary *_startAudioStatistics;
+    NSDictionary *_startAutoSpeedStatistics;
+    NSTimeInterval _peakAudioDelay;
+}
+
+/// The replay folder to play back.
+@property (readonly, copy) NSURL *replayURL;
+
+/// The results of the benchmark, using the keys listed above; or @c nil if the replay did not finish.
+@property (readonly, retain) NSDictionary *results;
+
+/// The error that stopped the replay from finishing, if any.
+@property (readonly, retain) NSError *error;
+
+/// Whether to play the replay back in real time and report on the sound output, rather than
+/// running it as fast as possible. Must be set before the benchmark is run. Defaults to @c NO.
+@property (assign) BOOL measuresAudio;
+
+/// The share of each host CPU, from 0.0 to 1.0, to keep busy while the replay is measuring audio,
+/// to see how the sound holds up when the emulator is competing for the host. Defaults to 0.
+@property (assign) double hostLoad;
+
+/// Returns a benchmark that will play back the replay folder at the specified location.
+- (id) initWithReplayURL: (NSURL *)replayURL;
+
+/// Runs the emulator on the calling thread until the replay has finished or failed,
+/// then returns @c results. Like BXHeadlessSession, this can only be done once per process.
+- (NSDictionary *) run;
+
+@end
@@ -0,0 +1,399 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+
+#import "BXReplayBenchmark.h"
+#import "BXEmulator+BXInputReplay.h"
+#import "BXEmulator+BXPerformanceCounters.h"
+#import "BXEmulator+BXAudio.h"
+#import "BXEmulator+BXSaveStates.h"
+#import "BXEmulator+BXDOSFileSystem.h"
+#import "BXVideoHandler.h"
+#import "BXDrive.h"
+#import <sys/resource.h>
+
+#import "perfcounters.h"
+
+
+#pragma mark -
+#pragma mark Constants
+
+NSString * const BXReplayBenchmarkFrameCountKey             = @"frameCount";
+NSString * const BXReplayBenchmarkEmulatedSecondsKey        = @"emulatedSeconds";
+NSString * const BXReplayBenchmarkHostSecondsKey            = @"hostSeconds";
+NSString * const BXReplayBenchmarkFramesPerSecondKey        = @"framesPerSecond";
+NSString * const BXReplayBenchmarkProcessCPUSecondsKey      = @"processCPUSeconds";
+NSString * const BXReplayBenchmarkSubsystemSecondsKey       = @"subsystemSeconds";
+NSString * const BXReplayBenchmarkMixerChannelSecondsKey    = @"mixerChannelSeconds";
+NSString * const BXReplayBenchmarkFrameChecksumKey          = @"frameChecksum";
+NSString * const BXReplayBenchmarkRecordedFrameChecksumKey  = @"recordedFrameChecksum";
+NSString * const BXReplayBenchmarkChecksumMatchesKey        = @"checksumMatches";
+NSString * const BXReplayBenchmarkHostLoadKey               = @"hostLoad";
+NSString * const BXReplayBenchmarkAudioCallbacksKey         = @"audioCallbacks";
+NSString * const BXReplayBenchmarkAudioUnderrunsKey         = @"audioUnderruns";
+NSString * const BXReplayBenchmarkAudioStretchedCallbacksKey    = @"audioStretchedCallbacks";
+NSString * const BXReplayBenchmarkAudioOverrunsKey          = @"audioOverruns";
+NSString * const BXReplayBenchmarkAudioDroppedFramesKey     = @"audioDroppedFrames";
+NSString * const BXReplayBenchmarkAudioAverageDelayKey      = @"audioAverageDelay";
+NSString * const BXReplayBenchmarkAudioPeakDelayKey         = @"audioPeakDelay";
+NSString * const BXReplayBenchmarkAutoSpeedAdjustmentsKey   = @"autoSpeedAdjustments";
+NSString * const BXReplayBenchmarkAutoSpeedStarvedAdjustmentsKey    = @"autoSpeedStarvedAdjustments";
+NSString * const BXReplayBenchmarkAutoSpeedStarvedRaisesKey = @"autoSpeedStarvedRaises";
+
+//How often, in seconds, each load thread alternates between spinning and sleeping.
+//This is short enough that the emulator sees a steady load rather than bursts.
+#define BXReplayBenchmarkLoadPeriod 0.01
+
+
+#pragma mark -
+#pragma mark Private interface declarations
+
+@interface BXReplayBenchmark ()
+
+@property (readwrite, copy) NSURL *replayURL;
+@property (readwrite, retain) NSDictionary *results;
+@property (readwrite, retain) NSError *error;
+
+//Restores the replay's snapshot and starts playing it back at full speed.
+- (void) _startReplay;
+
+//Adds the most recently published performance counters to our running totals, if we haven't already.
+- (void) _collectPerformanceCounters;
+
+//Compiles the results once the replay has finished.
+- (void) _finishReplay;
+
+//Adds the sound output's results to the specified results.
+- (void) _addAudioResultsTo: (NSMutableDictionary *)results;
+
+//Starts and stops the threads that keep the host busy while measuring audio.
+- (void) _startGeneratingLoad;
+- (void) _stopGeneratingLoad;
+- (void) _generateLoad;
+
+//The user and system CPU time used so far by the whole process.
++ (double) _processCPUSeconds;
+
+@end
+
+
+@implementation BXReplayBenchmark
+@synthesize replayURL = _replayURL;
+@synthesize results = _results;
+@synthesize error = _error;
+@synthesize measuresAudio = _measuresAudio;
+@synthesize hostLoad = _hostLoad;
+
+- (id) initWithReplayURL: (NSURL *)replayURL
+{
+    self = [self init];
+    if (self)
+    {
+        self.replayURL = replayURL;
+        _replayInfo = [[NSDictionary alloc] initWithContentsOfURL: [replayURL URLByAppendingPathComponent: BXInputReplayInfoFileName]];
+        _subsystemSeconds = [[NSMutableDictionary alloc] initWithCapacity: PERF_COUNTER_COUNT];
+        _mixerChannelSeconds = [[NSMutableDictionary alloc] initWithCapacity: PERF_MAX_CHANNELS];
+    }
+    return self;
+}
+
+- (void) dealloc
+{
+    self.replayURL = nil;
+    self.results = nil;
+    self.error = nil;
+
+    [_replayInfo release], _replayInfo = nil;
+    [_subsystemSeconds release], _subsystemSeconds = nil;
+    [_mixerChannelSeconds release], _mixerChannelSeconds = nil;
+    [_startAudioStatistics release], _startAudioStatistics = nil;
+    [_startAutoSpeedStatistics release], _startAutoSpeedStatistics = nil;
+
+    [super dealloc];
+}
+
+
+#pragma mark -
+#pragma mark Running
+
+- (NSDictionary *) run
+{
+    //Run the emulator on this thread rather than in the background, so that we're
+    //asked to process events between emulated instructions and can restore the replay's snapshot.
+    [self.emulator start];
+    [self _stopGeneratingLoad];
+    return self.results;
+}
+
+- (void) _startReplay
+{
+    _replayStarted = YES;
+
+    NSError *replayError = nil;
+    if (![self.emulator startReplayingInputFromURL: self.replayURL error: &replayError])
+    {
+        self.error = replayError;
+        [self cancel];
+        return;
+    }
+
+    //Draw every frame and otherwise run as fast as we can: the fixed speed the replay
+    //set keeps the emulated machine doing the same work regardless.
+    self.emulator.videoHandler.automaticFrameskip = NO;
+    self.emulator.videoHandler.frameskip = 0;
+    self.emulator.turboSpeed = !self.measuresAudio;
+    self.emulator.countingPerformance = YES;
+
+    //When measuring audio, play in real time so that the sound output runs just as it would
+    //for a player, and note where its counters started from.
+    if (self.measuresAudio)
+    {
+        _startAudioStatistics = [self.emulator.audioBufferStatistics retain];
+        _startAutoSpeedStatistics = [self.emulator.autoSpeedStatistics retain];
+        _peakAudioDelay = 0;
+        [self _startGeneratingLoad];
+    }
+
+    _startTime = CFAbsoluteTimeGetCurrent();
+    _startCPUSeconds = [self.class _processCPUSeconds];
+}
+
+- (void) _collectPerformanceCounters
+{
+    PerfSnapshot snapshot;
+    if (!PERF_GetSnapshot(&snapshot) || snapshot.sequence == _lastPerformanceSequence)
+        return;
+
+    _lastPerformanceSequence = snapshot.sequence;
+
+    NSString * const subsystemKeys[PERF_COUNTER_COUNT] = {
+        BXPerformanceOtherKey,
+        BXPerformanceCPUKey,
+        BXPerformanceCallbackKey,
+        BXPerformanceIOKey,
+        BXPerformanceVGAKey,
+        BXPerformanceRenderKey,
+        BXPerformanceMixerKey,
+        BXPerformanceCoalfaceKey,
+        BXPerformanceIdleKey,
+    };
+
+    for (NSUInteger i=0; i<PERF_COUNTER_COUNT; i++)
+    {
+        double total = [[_subsystemSeconds objectForKey: subsystemKeys[i]] doubleValue] + snapshot.seconds[i];
+        [_subsystemSeconds setObject: @(total) forKey: subsystemKeys[i]];
+    }
+
+    for (NSUInteger i=0; i<snapshot.channel_count; i++)
+    {
+        NSString *name = [NSString stringWithCString: snapshot.channels[i].name encoding: NSASCIIStringEncoding];
+        if (!name)
+            continue;
+
+        double total = [[_mixerChannelSeconds objectForKey: name] doubleValue] + snapshot.channels[i].seconds;
+        [_mixerChannelSeconds setObject: @(total) forKey: name];
+    }
+}
+
+- (void) _finishReplay
+{
+    CFAbsoluteTime hostSeconds = CFAbsoluteTimeGetCurrent() - _startTime;
+    double CPUSeconds = [self.class _processCPUSeconds] - _startCPUSeconds;
+
+    NSUInteger frameCount = self.emulator.replayFrameCount;
+    uint32_t checksum = self.emulator.replayFrameChecksum;
+    NSNumber *recordedChecksum = [_replayInfo objectForKey: BXInputReplayFrameChecksumKey];
+
+    NSMutableDictionary *results = [NSMutableDictionary dictionaryWithDictionary: @{
+        BXReplayBenchmarkFrameCountKey:             @(frameCount),
+        BXReplayBenchmarkEmulatedSecondsKey:        @(self.emulator.replayElapsedTicks / 1000.0),
+        BXReplayBenchmarkHostSecondsKey:            @(hostSeconds),
+        BXReplayBenchmarkFramesPerSecondKey:        @(hostSeconds > 0 ? frameCount / hostSeconds : 0),
+        BXReplayBenchmarkProcessCPUSecondsKey:      @(CPUSeconds),
+        BXReplayBenchmarkSubsystemSecondsKey:       [[_subsystemSeconds copy] autorelease],
+        BXReplayBenchmarkMixerChannelSecondsKey:    [[_mixerChannelSeconds copy] autorelease],
+        BXReplayBenchmarkFrameChecksumKey:          @(checksum),
+    }];
+
+    if (self.measuresAudio)
+    {
+        [self _stopGeneratingLoad];
+        [self _addAudioResultsTo: results];
+    }
+
+    if (recordedChecksum)
+    {
+        [results setObject: recordedChecksum forKey: BXReplayBenchmarkRecordedFrameChecksumKey];
+        [results setObject: @(recordedChecksum.unsignedIntValue == checksum) forKey: BXReplayBenchmarkChecksumMatchesKey];
+    }
+
+    self.results = results;
+
+    self.emulator.countingPerformance = NO;
+    [self.emulator stopReplayingInput];
+    [self cancel];
+}
+
+//Returns how far the specified counter has moved between the two sets of statistics.
+static NSUInteger _countSince(NSDictionary *statistics, NSDictionary *startStatistics, NSString *key)
+{
+    NSUInteger count = [[statistics objectForKey: key] unsignedIntegerValue];
+    NSUInteger startCount = [[startStatistics objectForKey: key] unsignedIntegerValue];
+    return (count >= startCount) ? count - startCount : 0;
+}
+
+- (void) _addAudioResultsTo: (NSMutableDictionary *)results
+{
+    NSDictionary *audio = self.emulator.audioBufferStatistics;
+    NSDictionary *autoSpeed = self.emulator.autoSpeedStatistics;
+
+    NSUInteger delayCount = _countSince(audio, _startAudioStatistics, BXEmulatorAudioOutputDelayCountKey);
+    NSTimeInterval totalDelay = [[audio objectForKey: BXEmulatorAudioTotalOutputDelayKey] doubleValue] -
+                                [[_startAudioStatistics objectForKey: BXEmulatorAudioTotalOutputDelayKey] doubleValue];
+
+    [results addEntriesFromDictionary: @{
+        BXReplayBenchmarkHostLoadKey:                   @(self.hostLoad),
+        BXReplayBenchmarkAudioCallbacksKey:             @(_countSince(audio, _startAudioStatistics, BXEmulatorAudioCallbacksKey)),
+        BXReplayBenchmarkAudioUnderrunsKey:             @(_countSince(audio, _startAudioStatistics, BXEmulatorAudioUnderrunsKey)),
+        BXReplayBenchmarkAudioStretchedCallbacksKey:    @(_countSince(audio, _startAudioStatistics, BXEmulatorAudioStretchedCallbacksKey)),
+        BXReplayBenchmarkAudioOverrunsKey:              @(_countSince(audio, _startAudioStatistics, BXEmulatorAudioOverrunsKey)),
+        BXReplayBenchmarkAudioDroppedFramesKey:         @(_countSince(audio, _startAudioStatistics, BXEmulatorAudioDroppedFramesKey)),
+        BXReplayBenchmarkAudioAverageDelayKey:          @(delayCount ? totalDelay / delayCount : 0),
+        BXReplayBenchmarkAudioPeakDelayKey:             @(_peakAudioDelay),
+        BXReplayBenchmarkAutoSpeedAdjustmentsKey:       @(_countSince(autoSpeed, _startAutoSpeedStatistics, BXEmulatorAutoSpeedAdjustmentsKey)),
+        BXReplayBenchmarkAutoSpeedStarvedAdjustmentsKey:    @(_countSince(autoSpeed, _startAutoSpeedStatistics, BXEmulatorAutoSpeedStarvedAdjustmentsKey)),
+        BXReplayBenchmarkAutoSpeedStarvedRaisesKey:     @(_countSince(autoSpeed, _startAutoSpeedStatistics, BXEmulatorAutoSpeedStarvedRaisesKey)),
+    }];
+}
+
+- (void) _startGeneratingLoad
+{
+    if (self.hostLoad <= 0 || _generatingLoad)
+        return;
+
+    _generatingLoad = YES;
+
+    //Load every CPU evenly, so that the emulation and audio threads can't just
+    //be scheduled onto whichever CPUs happen to be left idle.
+    NSUInteger numThreads = [NSProcessInfo processInfo].activeProcessorCount;
+    for (NSUInteger i=0; i<numThreads; i++)
+        [NSThread detachNewThreadSelector: @selector(_generateLoad) toTarget: self withObject: nil];
+}
+
+- (void) _stopGeneratingLoad
+{
+    _generatingLoad = NO;
+}
+
+- (void) _generateLoad
+{
+    @autoreleasepool
+    {
+        NSTimeInterval busyTime = BXReplayBenchmarkLoadPeriod * MIN(self.hostLoad, 1.0);
+        NSTimeInterval idleTime = BXReplayBenchmarkLoadPeriod - busyTime;
+
+        while (_generatingLoad)
+        {
+            CFAbsoluteTime startTime = CFAbsoluteTimeGetCurrent();
+            while (CFAbsoluteTimeGetCurrent() - startTime < busyTime)
+                ;
+
+            if (idleTime > 0)
+                [NSThread sleepForTimeInterval: idleTime];
+        }
+    }
+}
+
++ (double) _processCPUSeconds
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1000000.0 +
+           usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1000000.0;
+}
+
+
+#pragma mark -
+#pragma mark Emulator delegate methods
+
+//Use the configuration files exactly as they were when the replay was recorded.
+- (NSArray *) configurationURLsForEmulator: (BXEmulator *)emulator
+{
+    NSURL *configurationsURL = [self.replayURL URLByAppendingPathComponent: BXInputReplayConfigurationsFolderName];
+    NSArray *URLs = [[NSFileManager defaultManager] contentsOfDirectoryAtURL: configurationsURL
+                                                  includingPropertiesForKeys: nil
+                                                                     options: NSDirectoryEnumerationSkipsHiddenFiles
+                                                                       error: NULL];
+
+    return [URLs sortedArrayUsingComparator: ^NSComparisonResult(NSURL *URL1, NSURL *URL2) {
+        return [URL1.lastPathComponent compare: URL2.lastPathComponent];
+    }];
+}
+
+//Mount the drives the replay's snapshot expects, now that DOS is up and running.
+- (void) runPreflightCommandsForEmulator: (BXEmulator *)emulator
+{
+    NSData *driveData = [NSData dataWithContentsOfURL: [self.replayURL URLByAppendingPathComponent: BXInputReplayDrivesFileName]];
+    NSArray *drives = driveData ? [NSKeyedUnarchiver unarchiveObjectWithData: driveData] : nil;
+
+    for (BXDrive *drive in drives)
+    {
+        drive.readOnly = YES;
+
+        NSError *mountError = nil;
+        if (![emulator mountDrive: drive error: &mountError])
+        {
+            self.error = mountError;
+            [self cancel];
+            return;
+        }
+    }
+}
+
+//The replay is started from the next round of event processing instead, which is a point
+//at which snapshots can be restored without confusing the shell.
+- (void) runLaunchCommandsForEmulator: (BXEmulator *)emulator
+{
+    _startupFinished = YES;
+}
+
+- (void) processEventsForEmulator: (BXEmulator *)emulator
+{
+    if (!_replayStarted)
+    {
+        if (_startupFinished && emulator.canSaveStates && !emulator.isCancelled)
+            [self _startReplay];
+        return;
+    }
+
+    if (emulator.isReplayingInput)
+    {
+        [self _collectPerformanceCounters];
+
+        if (self.measuresAudio)
+        {
+            NSTimeInterval delay = [[emulator.audioBufferStatistics objectForKey: BXEmulatorAudioOutputDelayKey] doubleValue];
+            _peakAudioDelay = MAX(_peakAudioDelay, delay);
+        }
+
+        if (emulator.isReplayFinished)
+            [self _finishReplay];
+    }
+}
+
+
+#pragma mark -
+#pragma mark Filesystem delegate methods
+
+- (BOOL) emulator: (BXEmulator *)emulator shouldAllowWriteAccessToURL: (NSURL *)fileURL onDrive: (BXDrive *)drive
+{
+    return NO;
+}
+
+@end
@@ -14,9 +14,11 @@
 
 #import "BXEmulatedMT32.h"
 #import "BXMIDISynth.h"
+#import "BXMixerMIDISynth.h"
 #import "BXExternalMIDIDevice.h"
 #import "BXExternalMT32.h"
 #import "BXDummyMIDIDevice.h"
+#import "BXPerformanceTelemetry.h"
 
 
 @implementation BXSession (BXAudioControls)
@@ -128,7 +130,17 @@
                                                                          error: &emulatedMT32Error] autorelease];
         
         if (emulatedMT32)
+        {
+            NSTimeInterval renderAhead = [[NSUserDefaults standardUserDefaults] doubleForKey: @"emulatedMT32RenderAhead"];
+            
+            //Render further ahead than usual if the MT-32 has been found to hold this game up.
+            NSNumber *recommendedRenderAhead = [[self _recommendedPerformanceSettings] objectForKey: BXRecommendedMT32RenderAheadKey];
+            renderAhead = MAX(renderAhead, recommendedRenderAhead.doubleValue);
+            
+            if (renderAhead > 0)
+                emulatedMT32.renderAhead = renderAhead;
             return emulatedMT32;
+        }
         
         else if (emulatedMT32Error)
         {
@@ -159,7 +171,16 @@
     }
     else
     {
-        fallbackSynth = [[[BXMIDISynth alloc] initWithError: NULL] autorelease];
+        //Unless the user has turned it off, render the synth through DOSBox's mixer so that its
+        //timing, volume and recording match the rest of the emulated sound; and if that fails,
+        //give the synth its own output as before.
+        if ([[NSUserDefaults standardUserDefaults] boolForKey: @"mixMIDISynthOutput"])
+            fallbackSynth = [[[BXMixerMIDISynth alloc] initWithError: NULL] autorelease];
+        else
+            fallbackSynth = nil;
+        
+        if (!fallbackSynth)
+            fallbackSynth = [[[BXMIDISynth alloc] initWithError: NULL] autorelease];
     }
     
     //If a custom soundfont has been specified for the MIDI synth, load that now also.
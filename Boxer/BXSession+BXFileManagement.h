@@ -203,6 +203,11 @@ typedef NS_OPTIONS(NSUInteger, BXDriveMountOptions) {
 //Returns the path to the bundle where we will store state data for the current gamebox.
 - (NSURL *) currentGameStateURL;
 
+//Returns the location at which to keep the quick-saved snapshot of the emulated machine for
+//the current gamebox, or nil if there is no gamebox. This lives within the current game state,
+//so that it is discarded along with the file changes it depends on.
+- (NSURL *) quickSaveStateURL;
+
 //Sets/retrieves the Info.plist metadata for the game state at the specified URL. 
 - (NSDictionary *) infoForGameStateAtURL: (NSURL *)stateURL;
 - (BOOL) setInfo: (NSDictionary *)info forGameStateAtURL: (NSURL *)stateURL;
@@ -212,6 +217,11 @@ typedef NS_OPTIONS(NSUInteger, BXDriveMountOptions) {
 //This location may not exist yet, but will be created once it is needed.
 - (NSURL *) shadowURLForDrive: (BXDrive *)drive;
 
+//Returns the location at which to keep the index of the specified drive's directories between
+//sessions, or nil if the drive is not part of the gamebox. This lives alongside the game states
+//rather than within the current one, since it stays valid when the current state is reverted.
+- (NSURL *) directoryIndexURLForDrive: (BXDrive *)drive;
+
 //Revert the contents of the specified drive/all drives to their original values by deleting
 //the shadowed data. Reverting will fail if one or more of the drives are currently in use by DOS.
 //Returns YES on success, or NO and populates outError on failure.
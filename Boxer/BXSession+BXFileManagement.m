@@ -36,12 +36,32 @@
 #import "BXBezelController.h"
 #import "ADBUserNotificationDispatcher.h"
 #import "BXInspectorController.h"
+#include <fcntl.h>
+#include <sys/stat.h>
 
 
 //Boxer will delay its handling of volume mount notifications by this many seconds,
 //to allow multipart volumes to finish mounting properly
 #define BXVolumeMountDelay 1.0
 
+//When mounting a gamebox's drives at startup, Boxer will wait this many seconds for secondary
+//drives to finish preparing before starting without them. They will be mounted once they're ready.
+#define BXBundledDrivePreparationGracePeriod 1.0
+
+//How much of each drive image Boxer will read ahead while preparing bundled drives:
+//enough to cover the image's headers and its directory tables.
+#define BXBundledDrivePrefetchLength 256 * 1024
+
+//How many seconds after startup Boxer will keep recording which files the game reads,
+//and how many of those files it will remember between sessions.
+#define BXLaunchAccessProfileDuration 30.0
+#define BXLaunchAccessProfileMaxFiles 128
+
+//How much of each remembered file, and of all remembered files together,
+//Boxer will ask the system to read ahead when the gamebox is launched.
+#define BXLaunchAccessPrefetchLengthPerFile 8 * 1024 * 1024
+#define BXLaunchAccessPrefetchTotalLength 128 * 1024 * 1024
+
 
 NSString * const BXGameStateGameNameKey = @"BXGameName";
 NSString * const BXGameStateGameIdentifierKey = @"BXGameIdentifier";
@@ -59,6 +79,18 @@ NSString * const BXGameStateEmulatorVersionKey = @"BXEmulatorVersion";
 
 - (void) _applicationDidBecomeActive: (NSNotification *)theNotification;
 
+//Reads ahead the files backing the specified drive. Called on a background queue.
+- (void) _prefetchBundledDrive: (BXDrive *)drive;
+//Called on a background queue once the specified drive has been prefetched.
+- (void) _bundledDriveWasPrepared: (BXDrive *)drive;
+//Returns whether the specified drive has finished preparing.
+- (BOOL) _bundledDriveIsPrepared: (BXDrive *)drive;
+//Mounts the specified bundled drive with the standard bundled drive options.
+- (void) _mountBundledDrive: (BXDrive *)drive;
+
+//Merges the specified files into the gamebox's launch access profile. Must be called on the main thread.
+- (void) _storeLaunchAccessProfile: (NSArray *)recordedPaths;
+
 @end
 
 
@@ -244,6 +276,11 @@ NSString * const BXGameStateEmulatorVersionKey = @"BXEmulatorVersion";
     }
 }
 
+- (NSURL *) quickSaveStateURL
+{
+    return [self.currentGameStateURL URLByAppendingPathComponent: @"QuickSave.boxersnapshot"];
+}
+
 - (NSURL *) shadowURLForDrive: (BXDrive *)drive
 {
     if ([self _shouldShadowDrive: drive])
@@ -251,15 +288,7 @@ NSString * const BXGameStateEmulatorVersionKey = @"BXEmulatorVersion";
         NSURL *stateURL = self.currentGameStateURL;
         if (stateURL)
         {
-            NSString *driveName;
-            //If the drive is identical to the gamebox itself (old-style gameboxes)
-            //then map it to a different name.
-            if ([drive.sourceURL isEqual: self.gamebox.resourceURL])
-                driveName = @"C.harddisk";
-            //Otherwise, use the original filename of the gamebox.
-            else
-                driveName = drive.sourceURL.lastPathComponent;
-            
+            NSString *driveName = [self _gameStateNameForDrive: drive];
             NSURL *driveShadowURL = [stateURL URLByAppendingPathComponent: driveName];
             
             return driveShadowURL;
@@ -268,6 +297,30 @@ NSString * const BXGameStateEmulatorVersionKey = @"BXEmulatorVersion";
     return nil;
 }
 
+- (NSString *) _gameStateNameForDrive: (BXDrive *)drive
+{
+    //If the drive is identical to the gamebox itself (old-style gameboxes)
+    //then map it to a different name.
+    if ([drive.sourceURL isEqual: self.gamebox.resourceURL])
+        return @"C.harddisk";
+    //Otherwise, use the original filename of the gamebox.
+    else
+        return drive.sourceURL.lastPathComponent;
+}
+
+- (NSURL *) directoryIndexURLForDrive: (BXDrive *)drive
+{
+    if (!self.hasGamebox || drive.isVirtual || ![self driveIsBundled: drive])
+        return nil;
+    
+    NSURL *statesURL = [(BXBaseAppController *)[NSApp delegate] gameStatesURLForGamebox: self.gamebox
+                                                                       creatingIfMissing: YES
+                                                                                   error: NULL];
+    
+    NSString *indexName = [[self _gameStateNameForDrive: drive] stringByAppendingPathExtension: @"dirindex"];
+    return [statesURL URLByAppendingPathComponent: indexName];
+}
+
 - (BOOL) hasShadowedChanges
 {
     for (BXDrive *drive in self.allDrives)
@@ -1244,6 +1297,8 @@ NSString * const BXGameStateEmulatorVersionKey = @"BXEmulatorVersion";
         drive.shadowURL = [self shadowURLForDrive: drive];
     }
     
+    drive.directoryIndexURL = [self directoryIndexURLForDrive: drive];
+    
     //Check if this is a CD-ROM drive and enabled for CD audio.
     //If it is, check that any CD audio volume is actually available.
     //TODO: cache this information so we're not polling the filesystem.
@@ -1491,6 +1546,304 @@ NSString * const BXGameStateEmulatorVersionKey = @"BXEmulatorVersion";
 }
 
 
+#pragma mark -
+#pragma mark Preparing bundled drives
+
+- (void) _prepareBundledDrives
+{
+    //Drives are prepared once per emulator session.
+    if (_preparedBundledDrives || !self.gamebox)
+        return;
+    
+    NSArray *drives = self.gamebox.bundledDrives;
+    
+    @synchronized(self)
+    {
+        _preparedBundledDrives = [drives copy];
+        
+        [_drivesAwaitingPreparation release];
+        _drivesAwaitingPreparation = [[NSMutableSet alloc] initWithArray: drives];
+        
+        [_drivesDeferredUntilPrepared release];
+        _drivesDeferredUntilPrepared = [[NSMutableSet alloc] init];
+        
+        if (!_drivePreparedSignal)
+            _drivePreparedSignal = dispatch_semaphore_create(0);
+    }
+    
+    //Drive images may be spread across several disks or network volumes, so read them all at once
+    //rather than one after the other. Drive C goes first, as the emulator can't start without it.
+    for (BXDrive *drive in drives)
+    {
+        BOOL isDriveC = [drive.letter isEqualToString: @"C"];
+        long priority = (isDriveC) ? DISPATCH_QUEUE_PRIORITY_HIGH : DISPATCH_QUEUE_PRIORITY_DEFAULT;
+        
+        //The drive and session are retained by the block until the drive has been prepared.
+        dispatch_async(dispatch_get_global_queue(priority, 0), ^{
+            NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+            [self _prefetchBundledDrive: drive];
+            [self _bundledDriveWasPrepared: drive];
+            [pool drain];
+        });
+    }
+}
+
+- (void) _prefetchBundledDrive: (BXDrive *)drive
+{
+    NSURL *mountPointURL = drive.mountPointURL;
+    
+    //Folder drives are read on demand by DOSBox, so there's nothing worth reading ahead.
+    if (!mountPointURL || [mountPointURL checkResourceIsReachableAndReturnError: NULL] == NO || mountPointURL.isDirectory)
+        return;
+    
+    //Cue sheets name the tracks that make up the rest of the image: read the headers of those too,
+    //since DOSBox will open each of them to work out the disc's track layout.
+    NSMutableArray *URLsToRead = [NSMutableArray arrayWithObject: mountPointURL];
+    if ([ADBBinCueImage isCueAtURL: mountPointURL error: NULL])
+    {
+        NSArray *trackURLs = [ADBBinCueImage resourceURLsInCueAtURL: mountPointURL error: NULL];
+        if (trackURLs)
+            [URLsToRead addObjectsFromArray: trackURLs];
+    }
+    
+    char *buffer = malloc(BXBundledDrivePrefetchLength);
+    if (!buffer)
+        return;
+    
+    for (NSURL *URL in URLsToRead)
+    {
+        int fd = open(URL.fileSystemRepresentation, O_RDONLY);
+        if (fd == -1)
+            continue;
+        
+        //Reading the data pulls it into the filesystem cache, where it'll still be waiting
+        //when the emulator opens the image for real.
+        pread(fd, buffer, BXBundledDrivePrefetchLength, 0);
+        close(fd);
+    }
+    
+    free(buffer);
+}
+
+- (void) _bundledDriveWasPrepared: (BXDrive *)drive
+{
+    BOOL wasDeferred;
+    @synchronized(self)
+    {
+        [_drivesAwaitingPreparation removeObject: drive];
+        wasDeferred = [_drivesDeferredUntilPrepared containsObject: drive];
+        [_drivesDeferredUntilPrepared removeObject: drive];
+    }
+    
+    dispatch_semaphore_signal(_drivePreparedSignal);
+    
+    //If we've already started without this drive, mount it now it's ready. This is done
+    //on the main thread, in the same way as for volumes that get mounted mid-session.
+    if (wasDeferred)
+    {
+        dispatch_async(dispatch_get_main_queue(), ^{
+            if (!_isClosing && self.isEmulating)
+                [self _mountBundledDrive: drive];
+        });
+    }
+}
+
+- (BOOL) _bundledDriveIsPrepared: (BXDrive *)drive
+{
+    @synchronized(self)
+    {
+        return ![_drivesAwaitingPreparation containsObject: drive];
+    }
+}
+
+- (void) _mountBundledDrive: (BXDrive *)drive
+{
+    if ([drive.letter isEqualToString: @"C"])
+        drive.title = NSLocalizedString(@"Game Drive", @"The display title for the gamebox’s C drive.");
+    
+    NSError *mountError = nil;
+    [self mountDrive: drive
+            ifExists: BXDriveQueue
+             options: BXBundledDriveMountOptions
+               error: &mountError];
+    
+    //TODO: deal with any mounting errors that occur. Since all this happens automatically
+    //during startup, we can't really give errors straight to the user as they will seem cryptic.
+}
+
+- (void) _mountPreparedBundledDrives
+{
+    [self _prepareBundledDrives];
+    
+    NSArray *drives = [[_preparedBundledDrives retain] autorelease];
+    
+    //If our target was the gamebox itself, rewrite it to point to drive C
+    //so that we'll start up at drive C.
+    for (BXDrive *drive in drives)
+    {
+        if ([drive.letter isEqualToString: @"C"] && [self.targetURL isEqual: self.gamebox.bundleURL])
+            self.targetURL = drive.sourceURL;
+    }
+    
+    dispatch_time_t deadline = dispatch_time(DISPATCH_TIME_NOW, (int64_t)(BXBundledDrivePreparationGracePeriod * NSEC_PER_SEC));
+    BOOL requiresCDROM = self.gameProfile.requiresCDROM;
+    
+    for (BXDrive *drive in drives)
+    {
+        //Drive C, the drive containing our target and any CD the game insists on
+        //must be mounted before we start: wait on those for as long as they take.
+        BOOL isEssential = [drive.letter isEqualToString: @"C"] ||
+                           (self.targetURL && [drive exposesLogicalURL: self.targetURL]) ||
+                           (requiresCDROM && drive.isCDROM);
+        
+        dispatch_time_t timeout = (isEssential) ? DISPATCH_TIME_FOREVER : deadline;
+        
+        BOOL isPrepared;
+        while (!(isPrepared = [self _bundledDriveIsPrepared: drive]))
+        {
+            //The semaphore is signalled whenever any drive finishes, so check again each time.
+            if (dispatch_semaphore_wait(_drivePreparedSignal, timeout) != 0)
+                break;
+        }
+        
+        if (isPrepared)
+        {
+            [self _mountBundledDrive: drive];
+        }
+        else
+        {
+            //Carry on without this drive for now, but show it in the drive list
+            //and mount it once it's ready.
+            if (!drive.letter)
+                drive.letter = [self preferredLetterForDrive: drive options: BXBundledDriveMountOptions];
+            
+            //If it has finished in the meantime, mount it now; otherwise leave it to _bundledDriveWasPrepared:.
+            BOOL stillPreparing;
+            @synchronized(self)
+            {
+                stillPreparing = [_drivesAwaitingPreparation containsObject: drive];
+                if (stillPreparing)
+                    [_drivesDeferredUntilPrepared addObject: drive];
+            }
+            
+            if (stillPreparing)
+            {
+                if (drive.letter)
+                    [self enqueueDrive: drive];
+            }
+            else
+            {
+                [self _mountBundledDrive: drive];
+            }
+        }
+    }
+    
+    //Let the drives be prepared afresh if the emulator is restarted, in case they've changed.
+    @synchronized(self)
+    {
+        [_preparedBundledDrives release], _preparedBundledDrives = nil;
+    }
+}
+
+
+#pragma mark -
+#pragma mark Launch access profiles
+
+- (void) _beginLaunchAccessProfile
+{
+    if (!self.gamebox)
+        return;
+    
+    //Paths returned by the filesystem have their symlinks resolved, so resolve ours to match.
+    NSURL *baseURL = self.gamebox.bundleURL.URLByResolvingSymlinksInPath;
+    NSArray *previousPaths = [self.gameSettings objectForKey: BXGameboxSettingsLaunchAccessProfileKey];
+    
+    //Ask the system to start reading in whatever the game read last time. F_RDADVISE returns
+    //as soon as the reads are queued, so this is quick even on slow disks and network volumes.
+    if (previousPaths.count)
+    {
+        dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), ^{
+            NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+            off_t remainingLength = BXLaunchAccessPrefetchTotalLength;
+            
+            for (NSString *path in previousPaths)
+            {
+                if (![path isKindOfClass: [NSString class]])
+                    continue;
+                
+                NSURL *URL = [baseURL URLByAppendingPathComponent: path];
+                int fd = open(URL.fileSystemRepresentation, O_RDONLY);
+                if (fd == -1)
+                    continue;
+                
+                struct stat status;
+                if (fstat(fd, &status) == 0 && S_ISREG(status.st_mode))
+                {
+                    off_t length = MIN(status.st_size, MIN(remainingLength, (off_t)BXLaunchAccessPrefetchLengthPerFile));
+                    if (length > 0)
+                    {
+                        struct radvisory advice;
+                        advice.ra_offset = 0;
+                        advice.ra_count = (int)length;
+                        fcntl(fd, F_RDADVISE, &advice);
+                        
+                        remainingLength -= length;
+                    }
+                }
+                close(fd);
+                
+                if (remainingLength <= 0)
+                    break;
+            }
+            [pool drain];
+        });
+    }
+    
+    @synchronized(self)
+    {
+        [_launchAccessProfileBaseURL release];
+        _launchAccessProfileBaseURL = [baseURL copy];
+        
+        [_launchAccessProfile release];
+        _launchAccessProfile = [[NSMutableArray alloc] init];
+        
+        _launchAccessProfileDeadline = CFAbsoluteTimeGetCurrent() + BXLaunchAccessProfileDuration;
+    }
+}
+
+- (void) _finishLaunchAccessProfile
+{
+    NSArray *recordedPaths;
+    @synchronized(self)
+    {
+        recordedPaths = [_launchAccessProfile autorelease];
+        _launchAccessProfile = nil;
+    }
+    
+    if (recordedPaths)
+        [self _storeLaunchAccessProfile: recordedPaths];
+}
+
+- (void) _storeLaunchAccessProfile: (NSArray *)recordedPaths
+{
+    //Files read this time come first, followed by those read in previous sessions: so files
+    //that are only needed now and then are still remembered, until pushed out by newer ones.
+    NSMutableArray *paths = [NSMutableArray arrayWithArray: recordedPaths];
+    NSArray *previousPaths = [self.gameSettings objectForKey: BXGameboxSettingsLaunchAccessProfileKey];
+    for (NSString *path in previousPaths)
+    {
+        if ([path isKindOfClass: [NSString class]] && ![paths containsObject: path])
+            [paths addObject: path];
+    }
+    
+    if (paths.count > BXLaunchAccessProfileMaxFiles)
+        [paths removeObjectsInRange: NSMakeRange(BXLaunchAccessProfileMaxFiles, paths.count - BXLaunchAccessProfileMaxFiles)];
+    
+    if (paths.count)
+        [self.gameSettings setObject: paths forKey: BXGameboxSettingsLaunchAccessProfileKey];
+}
+
+
 #pragma mark -
 #pragma mark Managing executables
 
@@ -1757,6 +2110,37 @@ NSString * const BXGameStateEmulatorVersionKey = @"BXEmulatorVersion";
 }
 
 //Pick up on the deletion of executables
+- (void) emulator: (BXEmulator *)emulator didOpenFileAtURL: (NSURL *)fileURL
+{
+    NSArray *finishedPaths;
+    @synchronized(self)
+    {
+        if (!_launchAccessProfile)
+            return;
+        
+        if (CFAbsoluteTimeGetCurrent() < _launchAccessProfileDeadline)
+        {
+            //Only files within the gamebox are worth remembering: anything else may not be there next time.
+            if ([fileURL isBasedInURL: _launchAccessProfileBaseURL] && _launchAccessProfile.count < BXLaunchAccessProfileMaxFiles)
+            {
+                NSString *path = [fileURL pathRelativeToURL: _launchAccessProfileBaseURL];
+                if (path.length && ![_launchAccessProfile containsObject: path])
+                    [_launchAccessProfile addObject: path];
+            }
+            return;
+        }
+        
+        //Once the recording period is over, stop recording and store what we've got.
+        finishedPaths = [_launchAccessProfile autorelease];
+        _launchAccessProfile = nil;
+    }
+    
+    //This is called on the emulation thread, but game settings belong to the main thread.
+    dispatch_async(dispatch_get_main_queue(), ^{
+        [self _storeLaunchAccessProfile: finishedPaths];
+    });
+}
+
 - (void) emulatorDidRemoveFile: (NSNotification *)notification
 {
 	BXDrive *drive = [notification.userInfo objectForKey: BXEmulatorDriveKey];
@@ -1844,6 +2228,10 @@ NSString * const BXGameStateEmulatorVersionKey = @"BXEmulatorVersion";
                                                                         options: NSDirectoryEnumerationSkipsHiddenFiles
                                                                    errorHandler: NULL];
     
+    //The directories whose executables we have already read ahead, and the cache entries for them.
+    NSMutableSet *cachedDirectories = [NSMutableSet set];
+    NSMutableDictionary *scannedTypes = self.scannedExecutableTypes;
+    
     ADBOperation *scan = [ADBScanOperation scanWithEnumerator: enumerator
                                                    usingBlock: ^id(NSString *path, BOOL *stop)
     {
@@ -1853,7 +2241,25 @@ NSString * const BXGameStateEmulatorVersionKey = @"BXEmulatorVersion";
             [enumerator skipDescendants];
             return nil;
         }
-        else if ([BXFileTypes isCompatibleExecutableAtPath: path filesystem: enumerator.filesystem error: NULL])
+        
+        //The first time we meet an EXE in a directory, read the types of all the directory's EXEs
+        //at once: this lets their headers be read in parallel, so that the checks below hit the cache.
+        if ([enumerator.filesystem fileAtPath: path conformsToType: BXEXEProgramType])
+        {
+            NSString *directory = path.stringByDeletingLastPathComponent;
+            if (![cachedDirectories containsObject: directory])
+            {
+                [cachedDirectories addObject: directory];
+                NSDictionary *entries = [BXFileTypes cacheTypesOfExecutablesInDirectory: directory
+                                                                             filesystem: enumerator.filesystem];
+                @synchronized(scannedTypes)
+                {
+                    [scannedTypes addEntriesFromDictionary: entries];
+                }
+            }
+        }
+        
+        if ([BXFileTypes isCompatibleExecutableAtPath: path filesystem: enumerator.filesystem error: NULL])
         {
             return path;
         }
@@ -1962,6 +2368,25 @@ NSString * const BXGameStateEmulatorVersionKey = @"BXEmulatorVersion";
                             forKey: drive.letter];
         if (notify) [self didChangeValueForKey: @"executableURLs"];
 	}
+    
+    //Record the types of the executables we came across in the gamebox, alongside what it already
+    //knew about, so that scans in later sessions can skip reading them.
+    if (scan.succeeded && self.hasGamebox)
+    {
+        NSMutableDictionary *executableTypes = [NSMutableDictionary dictionary];
+        NSDictionary *persistedTypes = [self.gamebox gameInfoForKey: BXExecutableTypesGameInfoKey];
+        if ([persistedTypes isKindOfClass: [NSDictionary class]])
+            [executableTypes addEntriesFromDictionary: persistedTypes];
+        
+        @synchronized(self.scannedExecutableTypes)
+        {
+            [executableTypes addEntriesFromDictionary: self.scannedExecutableTypes];
+        }
+        
+        if (executableTypes.count)
+            [self.gamebox setGameInfo: executableTypes forKey: BXExecutableTypesGameInfoKey];
+    }
+    
     [self didChangeValueForKey: @"isScanningForExecutables"];
 }
 
@@ -2224,6 +2649,10 @@ NSString * const BXGameStateEmulatorVersionKey = @"BXEmulatorVersion";
         descriptiveSuffix = @" LPT output";
         extension = @"txt";
     }
+    else if ([typeDescription isEqualToString: @"Input Latency"]) //Input latency measurements
+    {
+        descriptiveSuffix = @" input latency";
+    }
     
     //Work out an appropriate filename, based on the title of the session and the current date and time.
     NSValueTransformer *transformer = [NSValueTransformer valueTransformerForName: @"BXCaptureDateTransformer"];
@@ -2258,7 +2687,8 @@ NSString * const BXGameStateEmulatorVersionKey = @"BXEmulatorVersion";
     if (URL != nil)
     {
         const char *fsRepresentation = URL.fileSystemRepresentation;
-        FILE *handle = fopen(fsRepresentation, "wb");
+        //Opened for reading too, as encoded captures may need to read back what they've written
+        FILE *handle = fopen(fsRepresentation, "w+b");
         //TODO: should we hide the file extension for common file types like txt and png?
         return handle;
     }
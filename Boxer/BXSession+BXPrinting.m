@@ -62,6 +62,7 @@
     [self.emulator.printer cancelPrintSession];
 }
 
+//IMPLEMENTATION NOTE: this and printer:willBeginSession: are called on the printer's own queue.
 - (void) printerDidInitialize: (BXEmulatedPrinter *)printer
 {
     //Apply OS X's preferred page size as the default emulated printer setup.
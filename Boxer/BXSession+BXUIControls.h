@@ -39,6 +39,12 @@ enum
 //The maximum frameskip level we can set
 #define BXMaxFrameskip 9
 
+//How many blocks the dynamic core must have translated before dynamicCoreRewritesCode
+//passes judgement, and the fraction of them that must have been discarded because the game
+//wrote over their code for it to decide the game is better off without the dynamic core.
+#define BXDynamicCoreMinimumTranslations 1000
+#define BXDynamicCoreRewrittenCodeThreshold 0.5
+
 typedef NS_ENUM(NSInteger, BXPlaybackMode) {
     BXPaused,
     BXPlaying,
@@ -55,6 +61,10 @@ typedef NS_ENUM(NSInteger, BXPlaybackMode) {
 //The number of frames to be skipped for each frame that is played
 @property (assign, nonatomic) NSUInteger frameskip;
 
+//Whether the frameskip is adjusted automatically according to how well the Mac is keeping up.
+//The manual frameskip setting is restored when this is turned off.
+@property (assign, nonatomic) BOOL automaticFrameskip;
+
 //The CPU speed, as a fixed cycles number or BXAutoSpeed (if autoSpeed is YES).
 @property (assign, nonatomic) NSInteger CPUSpeed;
 
@@ -81,9 +91,34 @@ typedef NS_ENUM(NSInteger, BXPlaybackMode) {
 @property (readonly, nonatomic) NSString *speedDescription;
 @property (readonly, nonatomic) NSString *frameskipDescription;
 
+//Whether the game is rewriting its own code so often that the dynamic core spends most of its effort
+//retranslating it. Games like this usually run faster on the normal core, and their game profiles
+//can pin them to it with a "core=normal" configuration.
+@property (readonly, nonatomic) BOOL dynamicCoreRewritesCode;
+
+//Localised human-readable description of how the dynamic core's translation is going,
+//or an empty string if it is not in use. Shown beneath the dynamic core toggle in the CPU panel.
+@property (readonly, nonatomic) NSString *dynamicCoreDescription;
+
+//Localised human-readable description of how far the sound lags behind the game and how often
+//it has dropped out, or an empty string if there is no sound output. Shown in the CPU panel,
+//since the CPU speed and frameskip settings are what most often cure stuttering sound.
+@property (readonly, nonatomic) NSString *audioOutputDescription;
+
+//Localised human-readable description of the last time the emulation thread was held up,
+//and what it was waiting on, or an empty string if it never has been. Shown in the CPU panel
+//alongside the audio output, since a held-up emulator is heard as much as seen.
+@property (readonly, nonatomic) NSString *stallDescription;
+
 //The current playback mode: paused, playing, fast-forwarding. Used for UI bindings.
 @property (assign, nonatomic) BXPlaybackMode playbackMode;
 
+//Whether the session keeps a history of recent play that can be rewound. Used for UI bindings.
+@property (assign, nonatomic, getter=isRewindEnabled) BOOL rewindEnabled;
+
+//How many seconds back the game can currently be rewound. Used by the rewind slider in the Inspector.
+@property (readonly, nonatomic) NSTimeInterval rewindableDuration;
+
 //The title to use for the "Player Data" submenu in the File menu when this session is active.
 @property (readonly, nonatomic) NSString *playerDataMenuLabel;
 
@@ -152,6 +187,33 @@ typedef NS_ENUM(NSInteger, BXPlaybackMode) {
 //Save a screenshot to the desktop.
 - (IBAction) saveScreenshot: (id)sender;
 
+//Start or stop recording a movie of the DOS session to the recordings folder.
+- (IBAction) toggleRecordingMovie: (id)sender;
+
+//Start or stop recording the DOS session's input to a replay in the recordings folder,
+//which can be played back with --replay-benchmark to benchmark that stretch of the game.
+- (IBAction) toggleRecordingInput: (id)sender;
+
+//Snapshot the emulated machine to the gamebox's quick-save slot, replacing any previous snapshot.
+- (IBAction) quickSaveState: (id)sender;
+
+//Restore the emulated machine from the gamebox's quick-save slot.
+- (IBAction) quickRestoreState: (id)sender;
+
+//Wind the game back by one step in its rewind history.
+- (IBAction) rewind: (id)sender;
+
+//Wind the game back by the number of seconds given by the sender's doubleValue.
+//Used by the rewind slider in the Inspector, which is bound to rewindableDuration.
+- (IBAction) rewindToPosition: (id)sender;
+
+//Start hosting a network game for the number of players in the user defaults, or leave the
+//network game in progress. Other players join the game with joinNetplay:.
+- (IBAction) toggleHostingNetplay: (id)sender;
+
+//Ask for the address of a host and join the network game there.
+- (IBAction) joinNetplay: (id)sender;
+
 
 //Cycle forward/backward through all drive queues.
 - (IBAction) mountNextDrivesInQueues: (id)sender;
@@ -9,6 +9,12 @@
 #import "BXEmulator+BXShell.h"
 #import "BXEmulator+BXPaste.h"
 #import "BXEmulator+BXAudio.h"
+#import "BXEmulator+BXRecording.h"
+#import "BXEmulator+BXInputReplay.h"
+#import "BXEmulator+BXSaveStates.h"
+#import "BXEmulator+BXRewind.h"
+#import "BXEmulator+BXNetplay.h"
+#import "BXEmulator+BXPerformanceCounters.h"
 #import "BXValueTransformers.h"
 #import "BXBaseAppController+BXSupportFiles.h"
 #import "BXVideoHandler.h"
@@ -178,6 +184,25 @@
 	[self.gameSettings setObject: @(frameskip) forKey: @"frameskip"];
 }
 
+- (BOOL) automaticFrameskip
+{
+	return self.emulator.videoHandler.automaticFrameskip;
+}
+
+- (void) setAutomaticFrameskip: (BOOL)automatic
+{
+	self.emulator.videoHandler.automaticFrameskip = automatic;
+	
+	//Go back to the user's own frameskip setting when automatic frameskipping is turned off.
+	if (!automatic)
+	{
+		NSNumber *frameskip = [self.gameSettings objectForKey: @"frameskip"];
+		self.emulator.videoHandler.frameskip = frameskip.unsignedIntegerValue;
+	}
+	
+	[self.gameSettings setObject: @(automatic) forKey: @"automaticFrameskip"];
+}
+
 - (BOOL) validateFrameskip: (NSNumber **)ioValue error: (NSError **)outError
 {
 	NSUInteger theValue = [*ioValue unsignedIntegerValue];
@@ -443,8 +468,8 @@
 	if (theAction == @selector(incrementSpeed:))		return isShowingDOSView && !self.speedAtMaximum;
 	if (theAction == @selector(decrementSpeed:))		return isShowingDOSView && !self.speedAtMinimum;
 
-	if (theAction == @selector(incrementFrameSkip:))	return isShowingDOSView && !self.frameskipAtMaximum;
-	if (theAction == @selector(decrementFrameSkip:))	return isShowingDOSView && !self.frameskipAtMinimum;
+	if (theAction == @selector(incrementFrameSkip:))	return isShowingDOSView && !self.automaticFrameskip && !self.frameskipAtMaximum;
+	if (theAction == @selector(decrementFrameSkip:))	return isShowingDOSView && !self.automaticFrameskip && !self.frameskipAtMinimum;
     
 	if (theAction == @selector(saveScreenshot:))        return isShowingDOSView;
     
@@ -538,6 +563,64 @@
     {
         return isShowingDOSView;
     }
+    
+    else if (theAction == @selector(toggleRecordingMovie:))
+    {
+        if (!self.emulator.isRecordingMovie)
+            title = NSLocalizedString(@"Start Recording Movie", @"Video menu option for starting a movie recording.");
+        else
+            title = NSLocalizedString(@"Stop Recording Movie", @"Video menu option for stopping a movie recording.");
+        
+        theItem.title = title;
+        
+        return self.isEmulating && (isShowingDOSView || self.emulator.isRecordingMovie);
+    }
+    else if (theAction == @selector(toggleRecordingInput:))
+    {
+        if (!self.emulator.isRecordingInput)
+            title = NSLocalizedString(@"Start Recording Replay", @"Menu option for starting an input recording for benchmarking.");
+        else
+            title = NSLocalizedString(@"Stop Recording Replay", @"Menu option for stopping an input recording for benchmarking.");
+        
+        theItem.title = title;
+        
+        return self.isEmulating && (isShowingDOSView || self.emulator.isRecordingInput);
+    }
+    else if (theAction == @selector(quickSaveState:))
+    {
+        return self.isEmulating && isShowingDOSView && self.quickSaveStateURL != nil;
+    }
+    
+    else if (theAction == @selector(quickRestoreState:))
+    {
+        return self.isEmulating && isShowingDOSView && [self.quickSaveStateURL checkResourceIsReachableAndReturnError: NULL];
+    }
+    
+    else if (theAction == @selector(toggleHostingNetplay:))
+    {
+        BXNetplayState state = self.emulator.netplayState;
+        BOOL inGame = (state == BXNetplayWaiting || state == BXNetplayRunning);
+        if (!inGame)
+            title = NSLocalizedString(@"Host Network Game", @"Menu option for starting a network game that other players can join.");
+        else
+            title = NSLocalizedString(@"Leave Network Game", @"Menu option for leaving a network game that has been hosted or joined.");
+        
+        theItem.title = title;
+        
+        return self.isEmulating && (isShowingDOSView || inGame);
+    }
+    
+    else if (theAction == @selector(joinNetplay:))
+    {
+        BXNetplayState state = self.emulator.netplayState;
+        BOOL inGame = (state == BXNetplayWaiting || state == BXNetplayRunning);
+        return self.isEmulating && isShowingDOSView && !inGame;
+    }
+    
+    else if (theAction == @selector(rewind:) || theAction == @selector(rewindToPosition:))
+    {
+        return self.isEmulating && isShowingDOSView && self.rewindableDuration > 0;
+    }
     //Menu item to switch to next disc in queue
     else if (theAction == @selector(mountNextDrivesInQueues:))
     {
@@ -730,6 +813,9 @@
 {
 	if (!self.isEmulating) return @"";
 	
+	if (self.automaticFrameskip)
+		return NSLocalizedString(@"Skipping frames as needed", @"Descriptive text for automatic frameskipping");
+	
 	NSString *format;
 	if (self.frameskip == 0)
 			format = NSLocalizedString(@"Playing every frame",		@"Descriptive text for 0 frameskipping");
@@ -738,19 +824,109 @@
 	return [NSString stringWithFormat: format, self.frameskip + 1];
 }
 
+- (BOOL) dynamicCoreRewritesCode
+{
+    NSDictionary *statistics = self.emulator.dynamicCacheStatistics;
+    double translations = [[statistics objectForKey: BXEmulatorDynamicCacheTranslationsKey] doubleValue];
+    double invalidations = [[statistics objectForKey: BXEmulatorDynamicCacheInvalidationsKey] doubleValue];
+    
+    return (translations >= BXDynamicCoreMinimumTranslations &&
+            invalidations >= translations * BXDynamicCoreRewrittenCodeThreshold);
+}
+
+- (NSString *) dynamicCoreDescription
+{
+    if (!self.isEmulating || !self.isDynamic) return @"";
+    
+    NSDictionary *statistics = self.emulator.dynamicCacheStatistics;
+    if (!statistics) return @"";
+    
+    if (self.dynamicCoreRewritesCode)
+        return NSLocalizedString(@"This game rewrites its own code constantly, and may run faster with this option turned off.",
+                                 @"Descriptive text for when the dynamic core is spending most of its time retranslating self-modifying code.");
+    
+    NSUInteger translations = [[statistics objectForKey: BXEmulatorDynamicCacheTranslationsKey] unsignedIntegerValue];
+    NSUInteger invalidations = [[statistics objectForKey: BXEmulatorDynamicCacheInvalidationsKey] unsignedIntegerValue];
+    double blockLength = [[statistics objectForKey: BXEmulatorDynamicCacheAverageBlockLengthKey] doubleValue];
+    
+    NSString *format = NSLocalizedString(@"Translated %1$lu blocks of %2$.1f instructions; %3$lu rewritten by the game",
+                                         @"Descriptive text for the dynamic core's translation statistics. %1$lu is the number of blocks translated, %2$.1f is the average number of instructions in each block, and %3$lu is the number of blocks discarded because the game wrote over their code.");
+    
+    return [NSString stringWithFormat: format, (unsigned long)translations, blockLength, (unsigned long)invalidations];
+}
+
+- (NSString *) audioOutputDescription
+{
+    if (!self.isEmulating) return @"";
+    
+    NSDictionary *statistics = self.emulator.audioBufferStatistics;
+    if (![[statistics objectForKey: BXEmulatorAudioCallbacksKey] unsignedIntegerValue]) return @"";
+    
+    NSTimeInterval delay = [[statistics objectForKey: BXEmulatorAudioOutputDelayKey] doubleValue];
+    NSUInteger underruns = [[statistics objectForKey: BXEmulatorAudioUnderrunsKey] unsignedIntegerValue];
+    
+    if (underruns == 0)
+    {
+        NSString *format = NSLocalizedString(@"Sound is playing %.0fms behind the game, with no dropouts.",
+                                             @"Descriptive text for the audio output when it has never run dry. %.0f is how many milliseconds the sound lags behind the emulation.");
+        return [NSString stringWithFormat: format, delay * 1000];
+    }
+    else
+    {
+        NSString *format = NSLocalizedString(@"Sound is playing %1$.0fms behind the game, and has dropped out %2$lu times.",
+                                             @"Descriptive text for the audio output when it has run dry. %1$.0f is how many milliseconds the sound lags behind the emulation, %2$lu is the number of times the sound has dropped out.");
+        return [NSString stringWithFormat: format, delay * 1000, (unsigned long)underruns];
+    }
+}
+
+- (NSString *) stallDescription
+{
+    if (!self.isEmulating) return @"";
+    
+    NSDictionary *stall = self.emulator.recentStalls.lastObject;
+    if (!stall) return @"";
+    
+    NSTimeInterval duration = [[stall objectForKey: BXStallDurationKey] doubleValue];
+    NSString *call = [[stall objectForKey: BXStallCallsKey] lastObject];
+    NSUInteger count = self.emulator.stallCount;
+    
+    if (call)
+    {
+        NSString *format = NSLocalizedString(@"Last held up for %1$.0fms in %2$@; %3$lu times in all.",
+                                             @"Descriptive text for the emulator having been held up. %1$.0f is how many milliseconds the last hold-up lasted, %2$@ is the call the emulator was waiting on, %3$lu is how many hold-ups there have been.");
+        return [NSString stringWithFormat: format, duration * 1000, call, (unsigned long)count];
+    }
+    else
+    {
+        NSString *format = NSLocalizedString(@"Last held up for %1$.0fms; %2$lu times in all.",
+                                             @"Descriptive text for the emulator having been held up outside any known call. %1$.0f is how many milliseconds the last hold-up lasted, %2$lu is how many hold-ups there have been.");
+        return [NSString stringWithFormat: format, duration * 1000, (unsigned long)count];
+    }
+}
+
 + (NSSet *) keyPathsForValuesAffectingSpeedDescription		{ return [NSSet setWithObject: @"sliderSpeed"]; }
-+ (NSSet *) keyPathsForValuesAffectingFrameskipDescription	{ return [NSSet setWithObjects: @"emulating", @"frameskip", nil]; }
++ (NSSet *) keyPathsForValuesAffectingFrameskipDescription	{ return [NSSet setWithObjects: @"emulating", @"frameskip", @"automaticFrameskip", nil]; }
++ (NSSet *) keyPathsForValuesAffectingDynamicCoreRewritesCode	{ return [NSSet setWithObject: @"emulator.dynamicCacheStatistics"]; }
++ (NSSet *) keyPathsForValuesAffectingDynamicCoreDescription	{ return [NSSet setWithObjects: @"emulating", @"dynamic", @"emulator.dynamicCacheStatistics", nil]; }
++ (NSSet *) keyPathsForValuesAffectingAudioOutputDescription	{ return [NSSet setWithObjects: @"emulating", @"emulator.audioBufferStatistics", nil]; }
++ (NSSet *) keyPathsForValuesAffectingStallDescription		{ return [NSSet setWithObjects: @"emulating", @"emulator.recentStalls", @"emulator.stallCount", nil]; }
 
 
 #pragma mark -
 #pragma mark Recording
 
 - (IBAction) saveScreenshot: (id)sender
-{   
-    NSImage *screenshot = [self.DOSWindowController screenshotOfCurrentFrame];
-    if (screenshot)
-    {
-        NSURL *destinationURL = [self URLForCaptureOfType: @"Screenshot" fileExtension: @"png"];
+{
+    //Decide on the filename now, rather than when the capture completes,
+    //so that it reflects the time at which the user asked for the screenshot.
+    NSURL *destinationURL = [self URLForCaptureOfType: @"Screenshot" fileExtension: @"png"];
+    
+    //The image data is read back, encoded and written out on a background queue,
+    //so that taking screenshots doesn't stall rendering or emulation.
+    [self.DOSWindowController captureScreenshotOfCurrentFrameWithCompletionHandler: ^(NSImage *screenshot) {
+        if (!screenshot)
+            return;
+        
         BOOL saved = [screenshot saveToURL: destinationURL
                                   withType: NSPNGFileType
                                 properties: nil
@@ -760,9 +936,270 @@
         {
             [destinationURL setResourceValue: @(YES) forKey: NSURLHasHiddenExtensionKey error: NULL];
             
+            dispatch_async(dispatch_get_main_queue(), ^{
+                [(BXBaseAppController *)[NSApp delegate] playUISoundWithName: @"Snapshot" atVolume: 1.0f];
+                [[BXBezelController controller] showScreenshotBezel];
+            });
+        }
+    }];
+}
+
+
+- (IBAction) toggleRecordingMovie: (id)sender
+{
+    if (self.emulator.isRecordingMovie)
+    {
+        [self.emulator stopRecordingMovieWithCompletionHandler: ^(BOOL succeeded, NSError *error) {
+            if (!succeeded && error)
+            {
+                [self presentError: error
+                    modalForWindow: self.windowForSheet
+                          delegate: nil
+                didPresentSelector: NULL
+                       contextInfo: NULL];
+            }
+        }];
+    }
+    else
+    {
+        NSURL *destinationURL = [self URLForCaptureOfType: @"Movie" fileExtension: @"mov"];
+        NSError *recordingError = nil;
+        BOOL started = [self.emulator startRecordingMovieToURL: destinationURL error: &recordingError];
+        
+        if (!started && recordingError)
+        {
+            [self presentError: recordingError
+                modalForWindow: self.windowForSheet
+                      delegate: nil
+            didPresentSelector: NULL
+                   contextInfo: NULL];
+        }
+    }
+}
+
+- (IBAction) toggleRecordingInput: (id)sender
+{
+    NSError *recordingError = nil;
+    BOOL succeeded;
+    if (self.emulator.isRecordingInput)
+    {
+        succeeded = [self.emulator finishRecordingInputWithError: &recordingError];
+    }
+    else
+    {
+        NSURL *destinationURL = [self URLForCaptureOfType: @"Replay" fileExtension: @"bxreplay"];
+        succeeded = [self.emulator startRecordingInputToURL: destinationURL error: &recordingError];
+    }
+    
+    if (!succeeded && recordingError)
+    {
+        [self presentError: recordingError
+            modalForWindow: self.windowForSheet
+                  delegate: nil
+        didPresentSelector: NULL
+               contextInfo: NULL];
+    }
+}
+
+
+#pragma mark -
+#pragma mark Save states
+
+- (IBAction) quickSaveState: (id)sender
+{
+    NSURL *stateURL = self.quickSaveStateURL;
+    NSError *saveError = nil;
+    
+    BOOL createdFolder = [[NSFileManager defaultManager] createDirectoryAtURL: stateURL.URLByDeletingLastPathComponent
+                                                  withIntermediateDirectories: YES
+                                                                   attributes: nil
+                                                                        error: &saveError];
+    
+    //The emulator only pauses to copy the machine's state: the snapshot is compressed and written
+    //in the background, and we report back once it's on disk.
+    BOOL started = createdFolder && [self.emulator saveStateToURL: stateURL
+                                                            error: &saveError
+                                                completionHandler: ^(BOOL succeeded, NSError *error) {
+        if (succeeded)
+        {
             [(BXBaseAppController *)[NSApp delegate] playUISoundWithName: @"Snapshot" atVolume: 1.0f];
-            [[BXBezelController controller] showScreenshotBezel];
         }
+        else if (error)
+        {
+            [self presentError: error
+                modalForWindow: self.windowForSheet
+                      delegate: nil
+            didPresentSelector: NULL
+                   contextInfo: NULL];
+        }
+    }];
+    
+    if (!started && saveError)
+    {
+        [self presentError: saveError
+            modalForWindow: self.windowForSheet
+                  delegate: nil
+        didPresentSelector: NULL
+               contextInfo: NULL];
+    }
+}
+
+- (IBAction) quickRestoreState: (id)sender
+{
+    NSError *restoreError = nil;
+    BOOL restored = [self.emulator restoreStateFromURL: self.quickSaveStateURL error: &restoreError];
+    
+    if (!restored && restoreError)
+    {
+        [self presentError: restoreError
+            modalForWindow: self.windowForSheet
+                  delegate: nil
+        didPresentSelector: NULL
+               contextInfo: NULL];
+    }
+}
+
+- (IBAction) rewind: (id)sender
+{
+    [self _rewindBy: self.emulator.rewindInterval];
+}
+
+- (IBAction) rewindToPosition: (id)sender
+{
+    [self _rewindBy: [sender doubleValue]];
+}
+
+- (void) _rewindBy: (NSTimeInterval)duration
+{
+    NSError *rewindError = nil;
+    BOOL rewound = [self.emulator rewindBy: duration error: &rewindError];
+    
+    if (!rewound && rewindError)
+    {
+        [self presentError: rewindError
+            modalForWindow: self.windowForSheet
+                  delegate: nil
+        didPresentSelector: NULL
+               contextInfo: NULL];
+    }
+}
+
+- (BOOL) isRewindEnabled
+{
+    return self.emulator.isRewindEnabled;
+}
+
+- (void) setRewindEnabled: (BOOL)enabled
+{
+    self.emulator.rewindEnabled = enabled;
+    
+    [self.gameSettings setObject: @(enabled) forKey: @"rewindEnabled"];
+}
+
+- (NSTimeInterval) rewindableDuration
+{
+    return self.emulator.rewindableDuration;
+}
+
++ (NSSet *) keyPathsForValuesAffectingRewindableDuration
+{
+    return [NSSet setWithObjects: @"emulating", @"emulator.rewindableDuration", nil];
+}
+
+
+#pragma mark -
+#pragma mark Network games
+
+- (IBAction) toggleHostingNetplay: (id)sender
+{
+    BXNetplayState state = self.emulator.netplayState;
+    if (state == BXNetplayWaiting || state == BXNetplayRunning)
+    {
+        [self.emulator stopNetplay];
+        return;
+    }
+    
+    NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
+    NSUInteger players = MAX((NSInteger)2, MIN([defaults integerForKey: @"netplayPlayers"], (NSInteger)BXNetplayMaxPlayers));
+    
+    NSError *hostingError = nil;
+    BOOL started = [self.emulator hostNetplayForPlayers: players
+                                                   port: [defaults integerForKey: @"netplayPort"]
+                                             frameDelay: [defaults integerForKey: @"netplayFrameDelay"]
+                                            frameLength: [defaults doubleForKey: @"netplayFrameLength"]
+                                                  error: &hostingError];
+    
+    if (!started && hostingError)
+    {
+        [self presentError: hostingError
+            modalForWindow: self.windowForSheet
+                  delegate: nil
+        didPresentSelector: NULL
+               contextInfo: NULL];
+    }
+}
+
+- (IBAction) joinNetplay: (id)sender
+{
+    NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
+    
+    NSTextField *addressField = [[NSTextField alloc] initWithFrame: NSMakeRect(0, 0, 240, 22)];
+    NSString *lastHost = [defaults stringForKey: @"netplayLastHost"];
+    if (lastHost)
+        addressField.stringValue = lastHost;
+    
+    NSAlert *prompt = [[NSAlert alloc] init];
+    prompt.messageText = NSLocalizedString(@"Join a network game",
+                                           @"Bold text of the prompt asking for the address of a network game to join.");
+    prompt.informativeText = NSLocalizedString(@"Enter the address of the Mac hosting the game. Once everyone has joined, this game will be replaced with the host’s.",
+                                               @"Explanatory text of the prompt asking for the address of a network game to join.");
+    [prompt addButtonWithTitle: NSLocalizedString(@"Join", @"Button for joining a network game.")];
+    [prompt addButtonWithTitle: NSLocalizedString(@"Cancel", @"Cancel the current action and return to what the user was doing")];
+    prompt.accessoryView = addressField;
+    [addressField release];
+    
+    [prompt beginSheetModalForWindow: self.windowForSheet
+                       modalDelegate: self
+                      didEndSelector: @selector(_joinNetplayPromptDidEnd:returnCode:contextInfo:)
+                         contextInfo: NULL];
+}
+
+- (void) _joinNetplayPromptDidEnd: (NSAlert *)alert
+                       returnCode: (NSInteger)returnCode
+                      contextInfo: (void *)contextInfo
+{
+    NSString *address = [(NSTextField *)alert.accessoryView stringValue];
+    address = [address stringByTrimmingCharactersInSet: [NSCharacterSet whitespaceCharacterSet]];
+    
+    //Retained back when we created the prompt in joinNetplay:
+    [alert release];
+    
+    if (returnCode != NSAlertFirstButtonReturn || !address.length)
+        return;
+    
+    NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
+    [defaults setObject: address forKey: @"netplayLastHost"];
+    
+    //Allow the port to be given as host:port.
+    NSString *host = address;
+    NSUInteger port = [defaults integerForKey: @"netplayPort"];
+    NSRange separator = [address rangeOfString: @":" options: NSBackwardsSearch];
+    if (separator.location != NSNotFound)
+    {
+        host = [address substringToIndex: separator.location];
+        port = [[address substringFromIndex: NSMaxRange(separator)] integerValue];
+    }
+    
+    NSError *joiningError = nil;
+    BOOL started = [self.emulator joinNetplayAtHost: host port: port error: &joiningError];
+    
+    if (!started && joiningError)
+    {
+        [self presentError: joiningError
+            modalForWindow: self.windowForSheet
+                  delegate: nil
+        didPresentSelector: NULL
+               contextInfo: NULL];
     }
 }
 
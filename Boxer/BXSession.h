@@ -57,6 +57,10 @@ extern NSString * const BXGameboxSettingsLastProgramLaunchArgumentsKey;
 
 extern NSString * const BXGameboxSettingsDrivesKey;
 
+//The gamebox files that were read in the first moments of previous sessions,
+//as paths relative to the gamebox. These are read ahead when the gamebox is next launched.
+extern NSString * const BXGameboxSettingsLaunchAccessProfileKey;
+
 //Whether to skip the default/previous program when next launching this gamebox.
 //This flag will be cleared on the next startup.
 extern NSString * const BXGameboxSettingsShowLaunchPanelKey;
@@ -81,6 +85,8 @@ typedef NS_ENUM(NSInteger, BXSessionProgramCompletionBehavior) {
 @class BXDOSWindowController;
 @class BXPrintStatusPanelController;
 @class BXDocumentationPanelController;
+@class BXInputLatencyRecorder;
+@class BXPerformanceTelemetry;
 
 @interface BXSession : NSDocument <BXEmulatorDelegate, ADBUndoDelegate>
 {	
@@ -92,6 +98,18 @@ typedef NS_ENUM(NSInteger, BXSessionProgramCompletionBehavior) {
 	
 	NSMutableDictionary *_drives;
 	NSMutableDictionary *_executableURLs;
+    NSMutableDictionary *_scannedExecutableTypes;
+    
+    //Used by BXFileManagement to prepare the gamebox's drives while the emulator starts up.
+    dispatch_semaphore_t _drivePreparedSignal;
+    NSArray *_preparedBundledDrives;
+    NSMutableSet *_drivesAwaitingPreparation;
+    NSMutableSet *_drivesDeferredUntilPrepared;
+    
+    //Used by BXFileManagement to record which files are read in the first moments of the session.
+    NSMutableArray *_launchAccessProfile;
+    NSURL *_launchAccessProfileBaseURL;
+    CFAbsoluteTime _launchAccessProfileDeadline;
     
     NSImage *_cachedIcon;
 	
@@ -110,16 +128,20 @@ typedef NS_ENUM(NSInteger, BXSessionProgramCompletionBehavior) {
 	BOOL _hasLaunched;
     BOOL _hasFinishedStartupProcess;
 	BOOL _isClosing;
+    BOOL _exitsProcessOnEmulatorExit;
 	BOOL _emulating;
 	
 	BOOL _paused;
 	BOOL _autoPaused;
 	BOOL _interrupted;
 	BOOL _suspended;
+	BOOL _occluded;
     
     BOOL _canOpenURLs;
 	
 	BOOL _userSkippedDefaultProgram;
+    BOOL _resumedFromStartupState;
+    NSString *_startupStateDescriptor;
     BOOL _waitingForFastForwardRelease;
     
     BXSessionProgramCompletionBehavior _programCompletionBehavior;
@@ -135,6 +157,12 @@ typedef NS_ENUM(NSInteger, BXSessionProgramCompletionBehavior) {
     BXPrintStatusPanelController *_printStatusController;
     
     BXDocumentationPanelController *_documentationPanelController;
+    
+    BXInputLatencyRecorder *_inputLatencyRecorder;
+    
+    BXPerformanceTelemetry *_performanceTelemetry;
+    NSTimer *_performanceTelemetryTimer;
+    CFAbsoluteTime _lastPerformanceSampleTime;
 }
 
 
@@ -226,6 +254,10 @@ typedef NS_ENUM(NSInteger, BXSessionProgramCompletionBehavior) {
 @property (readonly, nonatomic, getter=isInterrupted)	BOOL interrupted;
 //Whether the emulator is currently suspended because Boxer is in the background.
 @property (readonly, nonatomic, getter=isAutoPaused)	BOOL autoPaused;
+//Whether the DOS window is entirely hidden behind other windows or offscreen. While occluded,
+//the session stops drawing frames but keeps emulating, so that games keep time and keep playing
+//audio. If the pauseWhileOccluded user default is set, the session is auto-paused instead.
+@property (readonly, nonatomic, getter=isOccluded)      BOOL occluded;
 
 
 #pragma mark - Helper class methods
@@ -24,6 +24,15 @@
 
 #import "BXEmulator+BXDOSFileSystem.h"
 #import "BXEmulator+BXShell.h"
+#import "BXEmulator+BXSaveStates.h"
+#import "BXEmulator+BXRewind.h"
+#import "BXEmulator+BXRecording.h"
+#import "BXVideoHandler.h"
+#import "BXInputLatencyRecorder.h"
+#import "BXPerformanceTelemetry.h"
+#import "BXBaseAppController+BXSupportFiles.h"
+#import "ADBDigest.h"
+#import "NSData+HexStrings.h"
 #import "BXEmulatorErrors.h"
 #import "NSWorkspace+ADBFileTypes.h"
 #import "NSString+ADBPaths.h"
@@ -71,6 +80,11 @@
 //How many recently-launched programs the session should track before it discards older ones.
 #define BXRecentProgramsLimit 10
 
+//Window occlusion was introduced in 10.9, so we define our own equivalents of
+//NSWindowDidChangeOcclusionStateNotification and NSWindowOcclusionStateVisible.
+#define BXWindowDidChangeOcclusionStateNotification @"NSWindowDidChangeOcclusionStateNotification"
+#define BXWindowOcclusionStateVisible (1UL << 1)
+
 #pragma mark -
 #pragma mark Gamebox settings keys
 
@@ -89,6 +103,7 @@ NSString * const BXGameboxSettingsShowLaunchPanelKey = @"showLaunchPanel";
 NSString * const BXGameboxSettingsAlwaysShowLaunchPanelKey = @"alwaysShowLaunchPanel";
 
 NSString * const BXGameboxSettingsDrivesKey     = @"BXQueudDrives";
+NSString * const BXGameboxSettingsLaunchAccessProfileKey = @"BXLaunchAccessProfile";
 
 NSString * const BXGameboxSettingsLastProgramPathKey = @"BXLastProgramPath";
 NSString * const BXGameboxSettingsLastProgramLaunchArgumentsKey = @"BXLastProgramLaunchArguments";
@@ -139,11 +154,13 @@ NSString * const BXGameImportedNotificationType     = @"BXGameImported";
 @synthesize gameSettings = _gameSettings;
 @synthesize drives = _drives;
 @synthesize executableURLs = _executableURLs;
+@synthesize scannedExecutableTypes = _scannedExecutableTypes;
 @synthesize emulating = _emulating;
 @synthesize paused = _paused;
 @synthesize autoPaused = _autoPaused;
 @synthesize interrupted = _interrupted;
 @synthesize suspended = _suspended;
+@synthesize occluded = _occluded;
 @synthesize cachedIcon = _cachedIcon;
 @synthesize canOpenURLs = _canOpenURLs;
 
@@ -151,6 +168,8 @@ NSString * const BXGameImportedNotificationType     = @"BXGameImported";
 @synthesize scanQueue = _scanQueue;
 @synthesize temporaryFolderURL = _temporaryFolderURL;
 @synthesize MT32MessagesReceived = _MT32MessagesReceived;
+@synthesize inputLatencyRecorder = _inputLatencyRecorder;
+@synthesize performanceTelemetry = _performanceTelemetry;
 
 @synthesize mutableRecentPrograms = _mutableRecentPrograms;
 
@@ -215,6 +234,7 @@ NSString * const BXGameImportedNotificationType     = @"BXGameImported";
 		
 		self.drives = [NSMutableDictionary dictionaryWithCapacity: 10];
 		self.executableURLs = [NSMutableDictionary dictionaryWithCapacity: 10];
+		self.scannedExecutableTypes = [NSMutableDictionary dictionary];
 		
 		self.emulator = [[[BXEmulator alloc] init] autorelease];
 		self.gameSettings = defaults;
@@ -275,6 +295,7 @@ NSString * const BXGameImportedNotificationType     = @"BXGameImported";
     
     self.drives = nil;
     self.executableURLs = nil;
+    self.scannedExecutableTypes = nil;
     
     self.cachedIcon = nil;
     
@@ -284,6 +305,21 @@ NSString * const BXGameImportedNotificationType     = @"BXGameImported";
     self.temporaryFolderURL = nil;
     self.MT32MessagesReceived = nil;
     
+    [self.inputLatencyRecorder stop];
+    self.inputLatencyRecorder = nil;
+    
+    self.performanceTelemetry = nil;
+    
+    [_startupStateDescriptor release], _startupStateDescriptor = nil;
+    
+    if (_drivePreparedSignal)
+        dispatch_release(_drivePreparedSignal), _drivePreparedSignal = NULL;
+    [_preparedBundledDrives release], _preparedBundledDrives = nil;
+    [_drivesAwaitingPreparation release], _drivesAwaitingPreparation = nil;
+    [_drivesDeferredUntilPrepared release], _drivesDeferredUntilPrepared = nil;
+    [_launchAccessProfile release], _launchAccessProfile = nil;
+    [_launchAccessProfileBaseURL release], _launchAccessProfileBaseURL = nil;
+    
 	[super dealloc];
 }
 
@@ -404,6 +440,10 @@ NSString * const BXGameImportedNotificationType     = @"BXGameImported";
             self.gamebox.undoDelegate = self;
             //Load up the settings and game profile for this gamebox while we're at it.
 			[self _loadGameSettingsForGamebox: self.gamebox];
+            
+            //Seed the executable type cache with what previous sessions learned about the gamebox's
+            //programs, so that scanning its drives needn't read them all again.
+            [BXFileTypes addCachedExecutableTypes: [self.gamebox gameInfoForKey: BXExecutableTypesGameInfoKey]];
 		}
 	}
 }
@@ -559,6 +599,7 @@ NSString * const BXGameImportedNotificationType     = @"BXGameImported";
 			
 			[self _registerForFilesystemNotifications];
 			[self _registerForPauseNotifications];
+            [self _syncOccludedState];
 		}
 	}
 }
@@ -665,9 +706,24 @@ NSString * const BXGameImportedNotificationType     = @"BXGameImported";
 	if (!_isClosing)
 	{
 		_isClosing = YES;
-		[self cancel];
-		
+        
+        //If the process will quit once we've closed, don't wait for DOSBox to unwind:
+        //just save what needs saving and quit once the emulator is done.
+        _exitsProcessOnEmulatorExit = [self _processWillExitAfterClosing];
+        if (_exitsProcessOnEmulatorExit)
+        {
+            [self.emulator cancelForProcessExit];
+            self.emulating = NO;
+        }
+        else
+        {
+            [self cancel];
+		}
+        
+        [self _finishLaunchAccessProfile];
 		[self synchronizeSettings];
+        [self.gamebox synchronizeGameInfo];
+        [[NSUserDefaults standardUserDefaults] synchronize];
 		[self _cleanup];
 		
 		[super close];
@@ -827,6 +883,13 @@ NSString * const BXGameImportedNotificationType     = @"BXGameImported";
 		//Persist these gamebox-specific configuration into the gamebox's configuration file.
 		[self _saveGameboxConfiguration: runtimeConf];
         
+        //Keep what we've learned about how the game performs for next time.
+        if (self.performanceTelemetry)
+        {
+            [self.gameSettings setObject: self.performanceTelemetry.dictionaryRepresentation
+                                  forKey: @"performanceTelemetry"];
+        }
+        
         
 		
         //Now that we've saved those settings to the gamebox conf,
@@ -1186,6 +1249,13 @@ NSString * const BXGameImportedNotificationType     = @"BXGameImported";
     
     //Start preventing the display from going to sleep
     [self _syncSuppressesDisplaySleep];
+    
+    //If the adaptive core found last time that this game rewrites its own code too often
+    //for the dynamic core, don't let it try again.
+    if ([[self.gameSettings objectForKey: @"adaptiveCoreAvoidsDynamic"] boolValue])
+        self.emulator.adaptiveCoreAllowsDynamic = NO;
+    
+    [self _startPerformanceTelemetry];
 }
 
 - (void) emulatorDidFinish: (NSNotification *)notification
@@ -1199,6 +1269,14 @@ NSString * const BXGameImportedNotificationType     = @"BXGameImported";
 	//Flag that we're no longer emulating
 	self.emulating = NO;
     
+    [self _stopPerformanceTelemetry];
+    
+    if (self.inputLatencyRecorder.isRecording)
+    {
+        [self.inputLatencyRecorder stop];
+        NSLog(@"%@", self.inputLatencyRecorder.summary);
+    }
+    
     //Turn off display-sleep suppression
     [self _syncSuppressesDisplaySleep];
 
@@ -1208,6 +1286,29 @@ NSString * const BXGameImportedNotificationType     = @"BXGameImported";
 	//Close the document once we're done, if desired
 	if ([self _shouldCloseOnEmulatorExit])
         [self close];
+    
+    //If we skipped unwinding the emulator because the process was going to quit anyway, quit now.
+    if (_exitsProcessOnEmulatorExit)
+        [NSApp terminate: self];
+}
+
+- (BOOL) _processWillExitAfterClosing
+{
+    //Import sessions carry on after their emulator has finished.
+    if (self.isGameImport)
+        return NO;
+    
+    //Finalizing a movie relies on the emulator shutting down normally.
+    if (!self.emulator.isExecuting || self.emulator.isRecordingMovie)
+        return NO;
+    
+    //Only if nothing else will be left open in the process once we're gone.
+    if ([[NSDocumentController sharedDocumentController] documents].count > 1)
+        return NO;
+    
+    id appDelegate = [NSApp delegate];
+    return [appDelegate respondsToSelector: @selector(applicationShouldTerminateAfterLastWindowClosed:)] &&
+        [appDelegate applicationShouldTerminateAfterLastWindowClosed: NSApp];
 }
 
 - (NSArray *) configurationURLsForEmulator: (BXEmulator *)emulator
@@ -1224,6 +1325,20 @@ NSString * const BXGameImportedNotificationType     = @"BXGameImported";
 
 	//If we don't have a previously-determined game profile already, detect the game profile
     //from our gamebox (or target URL, in the case of regular sessions).
+	if (!self.gameProfile)
+	{
+        //Standalone apps record the profile that was detected for their gamebox when they were exported,
+        //so use that if it's still current rather than scanning the gamebox all over again.
+        NSDictionary *launchManifest = self.gamebox.launchManifest;
+        NSString *manifestProfileIdentifier = [launchManifest objectForKey: BXLaunchManifestProfileIdentifierKey];
+        NSString *manifestProfileVersion = [launchManifest objectForKey: BXLaunchManifestProfileVersionKey];
+        if (manifestProfileIdentifier && manifestProfileVersion &&
+            [manifestProfileVersion compare: [BXGameProfile catalogueVersion] options: NSNumericSearch] != NSOrderedAscending)
+        {
+            self.gameProfile = [BXGameProfile profileWithIdentifier: manifestProfileIdentifier];
+        }
+	}
+    
 	if (!self.gameProfile)
 	{
         NSURL *detectionURL = (self.hasGamebox) ? self.gamebox.bundleURL : self.targetURL;
@@ -1320,12 +1435,24 @@ NSString * const BXGameImportedNotificationType     = @"BXGameImported";
 		//Flag that we have completed our initial game configuration.
 		_hasConfigured = YES;
         
+        //If this gamebox has started up before with the same configuration and drives, skip the rest
+        //of the startup commands by resuming from where they finished last time, and launch from there.
+        if ([self _resumeFromStartupState])
+        {
+            _resumedFromStartupState = YES;
+            [self runLaunchCommandsForEmulator: theEmulator];
+        }
+        
         [pool drain];
 	}
 }
 
 - (void) runLaunchCommandsForEmulator: (BXEmulator *)theEmulator
 {
+    //Snapshot the machine the first time startup finishes, so that later launches can skip to here.
+    if (!_hasLaunched && !_resumedFromStartupState)
+        [self _recordStartupState];
+    
 	_hasLaunched = YES;
     
     //Do any just-in-time configuration, which should override all previous startup stuff.
@@ -1333,6 +1460,12 @@ NSString * const BXGameImportedNotificationType     = @"BXGameImported";
 	if (frameskip && [self validateValue: &frameskip forKey: @"frameskip" error: nil])
 		[self setValue: frameskip forKey: @"frameskip"];
 	
+	NSNumber *automaticFrameskip = [self.gameSettings objectForKey: @"automaticFrameskip"];
+	if (automaticFrameskip)
+		[self setValue: automaticFrameskip forKey: @"automaticFrameskip"];
+    
+    [self _applyRecommendedPerformanceSettings];
+	
 	
 	//After all preflight configuration has finished, go ahead and open whatever
     //file or folder we're pointing at.
@@ -1393,6 +1526,115 @@ NSString * const BXGameImportedNotificationType     = @"BXGameImported";
     _userSkippedDefaultProgram = NO;
 }
 
+
+#pragma mark - Startup snapshots
+
+- (NSURL *) _startupStateURL
+{
+    if (!self.hasGamebox)
+        return nil;
+    
+    NSURL *statesURL = [(BXBaseAppController *)[NSApp delegate] gameStatesURLForGamebox: self.gamebox
+                                                                      creatingIfMissing: NO
+                                                                                  error: NULL];
+    return [statesURL URLByAppendingPathComponent: @"Startup.boxersnapshot"];
+}
+
+- (NSURL *) _startupStateInfoURL
+{
+    return [self._startupStateURL.URLByDeletingPathExtension URLByAppendingPathExtension: @"plist"];
+}
+
+- (NSString *) _currentStartupStateDescriptor
+{
+    NSArray *configURLs = [self configurationURLsForEmulator: self.emulator];
+    NSData *configDigest = [ADBDigest SHA1DigestForURLs: configURLs error: NULL];
+    if (!configDigest)
+        return nil;
+    
+    NSMutableString *descriptor = [NSMutableString stringWithString: configDigest.stringWithHexBytes];
+    
+    NSArray *drives = [self.mountedDrives sortedArrayUsingSelector: @selector(letterCompare:)];
+    for (BXDrive *drive in drives)
+    {
+        [descriptor appendFormat: @"\n%@:%ld:%@", drive.letter, (long)drive.type, drive.sourceURL.path];
+        
+        //A disk image is the drive's whole filesystem, so a changed image counts as a changed drive.
+        //Folders are left alone, since games routinely write to them.
+        NSNumber *isDirectory = nil;
+        NSDate *modificationDate = nil;
+        [drive.sourceURL getResourceValue: &isDirectory forKey: NSURLIsDirectoryKey error: NULL];
+        [drive.sourceURL getResourceValue: &modificationDate forKey: NSURLContentModificationDateKey error: NULL];
+        if (modificationDate && !isDirectory.boolValue)
+            [descriptor appendFormat: @":%.0f", modificationDate.timeIntervalSinceReferenceDate];
+    }
+    
+    return descriptor;
+}
+
+- (BOOL) _resumeFromStartupState
+{
+    NSURL *stateURL = self._startupStateURL;
+    if (!stateURL)
+        return NO;
+    
+    [_startupStateDescriptor release];
+    _startupStateDescriptor = [self._currentStartupStateDescriptor copy];
+    
+    NSDictionary *info = [NSDictionary dictionaryWithContentsOfURL: self._startupStateInfoURL];
+    NSString *recordedDescriptor = [info objectForKey: @"descriptor"];
+    if (!_startupStateDescriptor || ![recordedDescriptor isEqualToString: _startupStateDescriptor])
+        return NO;
+    
+    NSError *restoreError = nil;
+    BOOL restored = [self.emulator restoreStartupStateFromURL: stateURL error: &restoreError];
+    if (!restored)
+    {
+        //Most likely the snapshot was made by an earlier version of Boxer: discard it, and a fresh
+        //one will be recorded when startup finishes. If it was damaged instead, the emulator will
+        //already have been stopped and there's nothing more we can do.
+        NSLog(@"Could not resume from startup snapshot: %@", restoreError);
+        [self _discardStartupState];
+    }
+    return restored;
+}
+
+- (void) _recordStartupState
+{
+    NSURL *stateURL = self._startupStateURL;
+    if (!stateURL || !_startupStateDescriptor)
+        return;
+    
+    //Remove the previous snapshot first, so that a failed save can't leave a stale one looking valid.
+    [self _discardStartupState];
+    
+    //If the startup commands mounted drives of their own, a snapshot would resume without them.
+    if (![self._currentStartupStateDescriptor isEqualToString: _startupStateDescriptor])
+        return;
+    
+    BOOL createdFolder = [(BXBaseAppController *)[NSApp delegate] gameStatesURLForGamebox: self.gamebox
+                                                                        creatingIfMissing: YES
+                                                                                    error: NULL] != nil;
+    if (!createdFolder)
+        return;
+    
+    NSDictionary *info = @{ @"descriptor": _startupStateDescriptor };
+    NSURL *infoURL = self._startupStateInfoURL;
+    [self.emulator saveStartupStateToURL: stateURL
+                                   error: NULL
+                       completionHandler: ^(BOOL succeeded, NSError *error) {
+                           if (succeeded)
+                               [info writeToURL: infoURL atomically: YES];
+                       }];
+}
+
+- (void) _discardStartupState
+{
+    NSFileManager *manager = [NSFileManager defaultManager];
+    [manager removeItemAtURL: self._startupStateInfoURL error: NULL];
+    [manager removeItemAtURL: self._startupStateURL error: NULL];
+}
+
 - (void) emulator: (BXEmulator *)theEmulator didFinishFrame: (BXVideoFrame *)frame
 {
 	[self.DOSWindowController updateWithFrame: frame];
@@ -1408,6 +1650,11 @@ NSString * const BXGameImportedNotificationType     = @"BXGameImported";
 	return self.DOSWindowController.viewportSize;
 }
 
+- (CFTimeInterval) renderingTimeForEmulator: (BXEmulator *)theEmulator
+{
+	return self.DOSWindowController.renderingTime;
+}
+
 - (void) processEventsForEmulator: (BXEmulator *)theEmulator
 {
     //Only pump the event queue ourselves if the emulator has taken over the main thread.
@@ -1602,6 +1849,20 @@ NSString * const BXGameImportedNotificationType     = @"BXGameImported";
 	[self didChangeValueForKey: @"dynamic"];	
 }
 
+- (void) emulatorDidSwitchAdaptiveCore: (NSNotification *)notification
+{
+    //Remember games that the adaptive core had to take off the dynamic core for rewriting
+    //their own code, so that the next session can leave them on the normal core from the start.
+    NSString *reason = [notification.userInfo objectForKey: BXEmulatorAdaptiveCoreReasonKey];
+    if ([reason isEqualToString: BXEmulatorAdaptiveCoreReasonSelfModifyingCode])
+    {
+        [self.gameSettings setObject: @YES forKey: @"adaptiveCoreAvoidsDynamic"];
+    }
+    
+    BOOL dynamic = ([[notification.userInfo objectForKey: BXEmulatorAdaptiveCoreModeKey] integerValue] == BXCoreDynamic);
+    [self.performanceTelemetry recordAdaptiveCoreSwitchToDynamic: dynamic reason: reason];
+}
+
 
 #pragma mark -
 #pragma mark Private methods
@@ -1798,6 +2059,11 @@ NSString * const BXGameImportedNotificationType     = @"BXGameImported";
 
 - (void) _startEmulator
 {	
+    //Get the gamebox's drives and the files it's likely to need ready in the background
+    //while the emulator boots up.
+    [self _prepareBundledDrives];
+    [self _beginLaunchAccessProfile];
+    
 	//Set the emulator's current working directory relative to whatever we're opening
 	if (self.fileURL)
 	{
@@ -1812,8 +2078,23 @@ NSString * const BXGameImportedNotificationType     = @"BXGameImported";
 		}
 	}
 	
+    //Configure the rewind history: the emulator will start it once the machine is up and running.
+    NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
+    self.emulator.rewindMemoryBudget = [defaults integerForKey: @"rewindMemoryBudget"] * 1024 * 1024;
+    self.emulator.rewindInterval = [defaults doubleForKey: @"rewindInterval"];
+    self.emulator.rewindKeyframeInterval = [defaults integerForKey: @"rewindKeyframeInterval"];
+    self.emulator.rewindEnabled = [[self.gameSettings objectForKey: @"rewindEnabled"] boolValue];
+    
+    //Measure input latency for the session if desired, logging each measurement alongside our other captures.
+    if ([defaults boolForKey: @"recordInputLatency"])
+    {
+        NSURL *logURL = [self URLForCaptureOfType: @"Input Latency" fileExtension: @"csv"];
+        self.inputLatencyRecorder = [[[BXInputLatencyRecorder alloc] initWithLogURL: logURL] autorelease];
+        [self.inputLatencyRecorder start];
+    }
+    
 	//Start up the emulator itself.
-    if ([[NSUserDefaults standardUserDefaults] boolForKey: @"useMultithreadedEmulation"])
+    if ([defaults boolForKey: @"useMultithreadedEmulation"])
     {
         [self.emulator performSelectorInBackground: @selector(start) withObject: nil];
     }
@@ -1923,29 +2204,9 @@ NSString * const BXGameImportedNotificationType     = @"BXGameImported";
     //If we're running a gamebox, first mount all the drives that are bundled inside it.
     if (self.gamebox)
 	{
-        NSArray *bundledDrives = self.gamebox.bundledDrives;
-        
-        for (BXDrive *drive in bundledDrives)
-        {
-            if ([drive.letter isEqualToString: @"C"])
-            {
-                drive.title = NSLocalizedString(@"Game Drive", @"The display title for the gamebox’s C drive.");
-                
-                //If our target was the gamebox itself, rewrite it to point to this C drive
-                //so that we'll start up at drive C.
-                if ([self.targetURL isEqual: self.gamebox.bundleURL])
-                    self.targetURL = drive.sourceURL;
-            }
-            
-            NSError *mountError = nil;
-            [self mountDrive: drive
-                    ifExists: BXDriveQueue
-                     options: BXBundledDriveMountOptions
-                       error: &mountError];
-            
-            //TODO: deal with any mounting errors that occur. Since all this happens automatically
-            //during startup, we can't really give errors straight to the user as they will seem cryptic.
-        }
+        //The drives will normally have been prepared while the emulator was starting up:
+        //this mounts drive C as soon as it's ready, and the rest as they become ready.
+        [self _mountPreparedBundledDrives];
     }
 	
 	//Automount all currently mounted floppy and CD-ROM volumes if appropriate.
@@ -2106,6 +2367,9 @@ NSString * const BXGameImportedNotificationType     = @"BXGameImported";
 	[self.importQueue waitUntilAllOperationsAreFinished];
 	[self.scanQueue waitUntilAllOperationsAreFinished];
     
+    //Stop sampling the game's performance (the timer would otherwise keep us alive.)
+    [self _stopPerformanceTelemetry];
+    
     //Remove any notifications that were posted by this session
     [[ADBUserNotificationDispatcher dispatcher] removeAllNotificationsOfType: nil fromSender: self];
     
@@ -2185,6 +2449,8 @@ NSString * const BXGameImportedNotificationType     = @"BXGameImported";
             [self.emulator resume];
         }
         
+        [self _syncRenderingSuspended];
+        
         if (!self.emulator.isConcurrent)
         { 
             //The suspended state is only checked inside the event loop
@@ -2216,6 +2482,48 @@ NSString * const BXGameImportedNotificationType     = @"BXGameImported";
     self.autoPaused = [self _shouldAutoPause];
 }
 
+- (void) setOccluded: (BOOL)flag
+{
+    if (_occluded != flag)
+    {
+        _occluded = flag;
+        [self _syncRenderingSuspended];
+        [self _syncAutoPausedState];
+        
+        //Let go of our video buffers while nobody can see them: they will be rebuilt
+        //once the window is visible again. This includes when the window is minimized.
+        if (flag)
+        {
+            [self.DOSWindowController releaseRenderingResources];
+            [self.emulator trimCacheToLevel: BXCacheTrimSpare];
+        }
+    }
+}
+
+- (void) _syncOccludedState
+{
+    //Window occlusion is only reported on 10.9 and above: on earlier versions
+    //the window will always be treated as visible.
+    NSWindow *window = self.DOSWindowController.window;
+    BOOL occluded = NO;
+    if ([window respondsToSelector: @selector(occlusionState)])
+    {
+        NSUInteger state = [[window valueForKey: @"occlusionState"] unsignedIntegerValue];
+        occluded = !(state & BXWindowOcclusionStateVisible);
+    }
+    self.occluded = occluded;
+}
+
+- (void) _syncRenderingSuspended
+{
+    //Stop the rendering view from redrawing while there's nothing new for it to draw.
+    self.DOSWindowController.renderingSuspended = (self.suspended || self.occluded);
+    
+    //While the window can't be seen, let DOSBox skip drawing altogether, unless something
+    //other than the window needs the frames.
+    self.emulator.videoHandler.drawingSuspended = (self.occluded && !self.emulator.isRecordingMovie);
+}
+
 - (BOOL) _shouldAutoPause
 {
 	//Don't auto-pause if the emulator hasn't finished starting up yet.
@@ -2240,6 +2548,11 @@ NSString * const BXGameImportedNotificationType     = @"BXGameImported";
         if (self.DOSWindowController.window.isMiniaturized)
             return YES;
     }
+    
+    //Auto-pause if the DOS window is hidden behind other windows, if the user would rather
+    //save the battery than hear the game.
+    if (self.occluded && [[NSUserDefaults standardUserDefaults] boolForKey: @"pauseWhileOccluded"])
+        return YES;
 	
     return NO;
 }
@@ -2279,6 +2592,11 @@ NSString * const BXGameImportedNotificationType     = @"BXGameImported";
 				   name: NSApplicationDidBecomeActiveNotification
 				 object: NSApp];
 	
+	[center addObserver: self
+			   selector: @selector(_syncOccludedState)
+				   name: BXWindowDidChangeOcclusionStateNotification
+				 object: self.DOSWindowController.window];
+	
 	[center addObserver: self
 			   selector: @selector(_interruptionWillBegin:)
 				   name: NSMenuDidBeginTrackingNotification
@@ -2317,6 +2635,7 @@ NSString * const BXGameImportedNotificationType     = @"BXGameImported";
 	
 	[center removeObserver: self name: NSWindowWillMiniaturizeNotification object: nil];
 	[center removeObserver: self name: NSWindowDidDeminiaturizeNotification object: nil];
+	[center removeObserver: self name: BXWindowDidChangeOcclusionStateNotification object: nil];
     
 	[center removeObserver: self name: NSMenuDidEndTrackingNotification object: nil];
 	[center removeObserver: self name: NSMenuDidBeginTrackingNotification object: nil];
@@ -2376,6 +2695,99 @@ NSString * const BXGameImportedNotificationType     = @"BXGameImported";
 }
 
 
+#pragma mark - Performance telemetry
+
+//How often to sample the emulator's performance while the game is running.
+#define BXPerformanceTelemetrySampleInterval 10.0
+
+- (void) _startPerformanceTelemetry
+{
+    if (!self.hasGamebox || _performanceTelemetryTimer) return;
+    
+    if (!self.performanceTelemetry)
+    {
+        NSDictionary *record = [self.gameSettings objectForKey: @"performanceTelemetry"];
+        self.performanceTelemetry = [[[BXPerformanceTelemetry alloc] initWithDictionaryRepresentation: record] autorelease];
+    }
+    
+    [self.performanceTelemetry beginSession];
+    
+    _lastPerformanceSampleTime = CFAbsoluteTimeGetCurrent();
+    _performanceTelemetryTimer = [[NSTimer scheduledTimerWithTimeInterval: BXPerformanceTelemetrySampleInterval
+                                                                    target: self
+                                                                  selector: @selector(_samplePerformanceTelemetry:)
+                                                                  userInfo: nil
+                                                                   repeats: YES] retain];
+}
+
+- (void) _stopPerformanceTelemetry
+{
+    if (!_performanceTelemetryTimer) return;
+    
+    [_performanceTelemetryTimer invalidate];
+    [_performanceTelemetryTimer release], _performanceTelemetryTimer = nil;
+    
+    //If desired, write out what we've learned in GameProfiles.plist form alongside our other captures,
+    //so that it can be folded into the game's profile.
+    if ([[NSUserDefaults standardUserDefaults] boolForKey: @"exportPerformanceTelemetry"])
+    {
+        NSDictionary *entry = [self.performanceTelemetry profileEntryWithIdentifier: self.gameProfile.identifier
+                                                                           gameName: self.gamebox.gameName];
+        if (entry)
+        {
+            NSURL *exportURL = [self URLForCaptureOfType: @"Performance Profile" fileExtension: @"plist"];
+            [entry writeToURL: exportURL atomically: YES];
+        }
+    }
+}
+
+- (void) _samplePerformanceTelemetry: (NSTimer *)timer
+{
+    CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+    [self.performanceTelemetry sampleEmulator: self.emulator
+                                     interval: now - _lastPerformanceSampleTime];
+    _lastPerformanceSampleTime = now;
+}
+
+- (NSDictionary *) _recommendedPerformanceSettings
+{
+    NSDictionary *settings = self.performanceTelemetry.recommendedSettings;
+    if (!settings)
+        settings = self.gameProfile.recommendedSettings;
+    
+    return settings;
+}
+
+- (void) _applyRecommendedPerformanceSettings
+{
+    NSDictionary *settings = [self _recommendedPerformanceSettings];
+    if (!settings.count) return;
+    
+    //Keep the adaptive core off the dynamic core if the game has turned out to rewrite its code too often for it.
+    //Explicit choices of core are left alone.
+    NSNumber *coreMode = [settings objectForKey: BXRecommendedCoreModeKey];
+    if (coreMode && coreMode.integerValue == BXCoreNormal)
+        self.emulator.adaptiveCoreAllowsDynamic = NO;
+    
+    //Only limit automatic speed if the game's configuration hasn't set a limit of its own.
+    NSNumber *speedLimit = [settings objectForKey: BXRecommendedAutoSpeedLimitKey];
+    if (speedLimit && !self.emulator.autoSpeedLimit)
+        self.emulator.autoSpeedLimit = speedLimit.integerValue;
+    
+    //Only turn on automatic frameskipping if the user hasn't chosen either way for this game.
+    //This is not recorded in the game settings, so that the user's own choices stay distinguishable.
+    NSNumber *automaticFrameskip = [settings objectForKey: BXRecommendedAutomaticFrameskipKey];
+    if (automaticFrameskip.boolValue && ![self.gameSettings objectForKey: @"automaticFrameskip"])
+    {
+        [self willChangeValueForKey: @"automaticFrameskip"];
+        self.emulator.videoHandler.automaticFrameskip = YES;
+        [self didChangeValueForKey: @"automaticFrameskip"];
+    }
+    
+    //The MT-32 render-ahead is applied when the MT-32 is created: see BXSession+BXAudioControls.
+}
+
+
 #pragma mark - Undo management
 
 - (NSUndoManager *) undoManagerForClient: (id <ADBUndoable>)undoClient operation: (SEL)operation
@@ -46,12 +46,24 @@ extern NSString * const BXGameImportedNotificationType;
 @property (readwrite, retain, nonatomic) NSDictionary *drives;
 @property (readwrite, retain, nonatomic) NSDictionary *executableURLs;
 
+//The executable type cache entries for every EXE our drive scans have come across, which are
+//persisted into the gamebox so that later sessions needn't read the executables again.
+//Added to from the scan queue, so access must be synchronized on the dictionary.
+@property (retain, nonatomic) NSMutableDictionary *scannedExecutableTypes;
+
 @property (retain, nonatomic) NSOperationQueue *importQueue;
 @property (retain, nonatomic) NSOperationQueue *scanQueue;
 
 @property (retain, nonatomic) NSMutableSet *MT32MessagesReceived;
 @property (copy, nonatomic) NSURL *temporaryFolderURL;
 
+//Measures input latency over the course of the session, when the recordInputLatency user default is set.
+@property (retain, nonatomic) BXInputLatencyRecorder *inputLatencyRecorder;
+
+//Records how the game performs over the course of the session, to learn better settings for it.
+//Only used for gameboxes.
+@property (retain, nonatomic) BXPerformanceTelemetry *performanceTelemetry;
+
 //A cached version of the represented icon for our gamebox. Used by @representedIcon.
 @property (retain, nonatomic) NSImage *cachedIcon;
 
@@ -61,6 +73,7 @@ extern NSString * const BXGameImportedNotificationType;
 @property (readwrite, nonatomic, assign, getter=isSuspended)	BOOL suspended;
 @property (readwrite, nonatomic, assign, getter=isAutoPaused)	BOOL autoPaused;
 @property (readwrite, nonatomic, assign, getter=isInterrupted)	BOOL interrupted;
+@property (readwrite, nonatomic, assign, getter=isOccluded)	BOOL occluded;
 
 
 #pragma mark -
@@ -80,6 +93,11 @@ extern NSString * const BXGameImportedNotificationType;
 //Normally YES, may be overridden by BXSession subclasses. 
 - (BOOL) _shouldCloseOnEmulatorExit;
 
+//Whether closing the session will leave the process with nothing else to do, so that it will quit.
+//In that case the session lets the emulator skip unwinding DOSBox on the way out: see BXEmulator
+//cancelForProcessExit.
+- (BOOL) _processWillExitAfterClosing;
+
 //Whether the session should store the state of its drive queue in the settings for that gamebox.
 //YES by default, but will be overridden to NO by import sessions.
 - (BOOL) _shouldPersistQueuedDrives;
@@ -100,6 +118,26 @@ extern NSString * const BXGameImportedNotificationType;
 //runPreflightCommands at the start of AUTOEXEC.BAT, before any other commands or settings are run.
 - (void) _mountDrivesForSession;
 
+//Where we keep the snapshot of the gamebox's emulated machine at the end of startup, and a record
+//of the configuration and drives it was made with. Returns nil if the session has no gamebox.
+- (NSURL *) _startupStateURL;
+- (NSURL *) _startupStateInfoURL;
+
+//Describes everything a startup snapshot depends on that isn't part of the snapshot itself:
+//the contents of the configuration files, and the drives that are currently mounted.
+- (NSString *) _currentStartupStateDescriptor;
+
+//Called from runPreflightCommandsForEmulator: once drives have been mounted. Restores the gamebox's
+//startup snapshot if it was made with the same configuration and drives, and returns whether it did.
+- (BOOL) _resumeFromStartupState;
+
+//Called from runLaunchCommandsForEmulator: the first time it runs. Records a startup snapshot for
+//future launches, unless the startup commands mounted drives that a snapshot couldn't account for.
+- (void) _recordStartupState;
+
+//Deletes any startup snapshot for the gamebox.
+- (void) _discardStartupState;
+
 //Populates the session's game settings from the specified dictionary.
 //This will also load any game profile previously recorded in the settings.
 - (void) _loadGameSettings: (NSDictionary *)gameSettings;
@@ -142,6 +180,8 @@ extern NSString * const BXGameImportedNotificationType;
 - (void) _syncSuspendedState;
 - (void) _syncAutoPausedState;
 - (BOOL) _shouldAutoPause;
+- (void) _syncOccludedState;
+- (void) _syncRenderingSuspended;
 - (void) _registerForPauseNotifications;
 - (void) _deregisterForPauseNotifications;
 - (void) _interruptionWillBegin: (NSNotification *)notification;
@@ -165,6 +205,36 @@ extern NSString * const BXGameImportedNotificationType;
 - (void) _deregisterForFilesystemNotifications;
 - (void) _hasActiveImports;
 
+//Starts reading in the gamebox's bundled drives in the background, so that their images
+//are ready by the time we come to mount them. Called when the emulator is started.
+- (void) _prepareBundledDrives;
+
+//Mounts the gamebox's bundled drives, waiting for drive C and any other drives the session
+//can't start without. Drives that are still being prepared after a short grace period are
+//queued up and mounted once they're ready. Called from _mountDrivesForSession.
+- (void) _mountPreparedBundledDrives;
+
+//Reads ahead the gamebox files that were read in the first moments of previous sessions,
+//and starts recording which files are read in this one. Called when the emulator is started.
+- (void) _beginLaunchAccessProfile;
+
+//Stops recording and stores the files recorded so far in the game settings for next time.
+//Called once the recording period has elapsed, or when the session closes.
+- (void) _finishLaunchAccessProfile;
+
+//Start and stop sampling the game's performance into performanceTelemetry.
+//Started once the emulator has initialized, and stopped when it finishes.
+- (void) _startPerformanceTelemetry;
+- (void) _stopPerformanceTelemetry;
+
+//The performance settings learned for this game: from its own telemetry if it has been played
+//for long enough, otherwise from its game profile. See BXPerformanceTelemetry for the keys.
+- (NSDictionary *) _recommendedPerformanceSettings;
+
+//Applies the settings above that the user hasn't chosen for themselves.
+//Called from runLaunchCommandsForEmulator: along with the other just-in-time configuration.
+- (void) _applyRecommendedPerformanceSettings;
+
 //Used by mountNextDrivesInQueues and mountPreviousDrivesInQueues
 //to centralise mounting logic.
 - (void) _mountQueuedSiblingsAtOffset: (NSInteger)offset;
@@ -173,6 +243,9 @@ extern NSString * const BXGameImportedNotificationType;
 //Will return NO if the drive is read-only or not part of the gamebox.
 - (BOOL) _shouldShadowDrive: (BXDrive *)drive;
 
+//The name under which the specified gamebox drive's data is stored within the game's states.
+- (NSString *) _gameStateNameForDrive: (BXDrive *)drive;
+
 //Used for importing and exporting game states while safely overwriting existing ones.
 - (BOOL) _copyGameStateFromURL: (NSURL *)sourceURL
                          toURL: (NSURL *)destinationURL
@@ -35,7 +35,9 @@
 //Returns a new NSImage containing the source image tiled to fill the logical unit size.
 - (NSImage *) tiledImageWithSize: (NSSize)size;
 
-//Returns a new NSImage containing the source image tiled to fill the specific device pixel size.
+//Returns an NSImage containing the source image tiled to fill the specific device pixel size.
+//Unlike tiledImageWithSize:, this is safe to call off the main thread. Results are cached
+//in memory by source image and size, so repeated calls for the same size are cheap.
 - (NSImage *) tiledImageWithPixelSize: (NSSize)pixelSize;
 
 @end
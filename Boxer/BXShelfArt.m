@@ -6,8 +6,32 @@
  */
 
 #import "BXShelfArt.h"
+#import "NSData+HexStrings.h"
+#import <CommonCrypto/CommonDigest.h>
+
+
+@interface BXShelfArt ()
+
+//The in-memory cache of tiled images, keyed by source image digest and pixel size.
++ (NSCache *) _tiledImages;
+
+@end
+
 
 @implementation BXShelfArt
+
++ (NSCache *) _tiledImages
+{
+    static NSCache *cache;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        cache = [[NSCache alloc] init];
+        cache.name = @"BXShelfArt tiled images";
+        //Shelf art is usually rendered at the maximum size Finder supports, so only keep a couple around.
+        cache.totalCostLimit = 128 * 1024 * 1024;
+    });
+    return cache;
+}
 @synthesize sourceImage;
 
 - (id) initWithSourceImage: (NSImage *)image
@@ -77,6 +101,75 @@
         logicalSize = [[NSScreen mainScreen] convertRectFromBacking: pixelFrame].size;
     }
     
-    return [self tiledImageWithSize: logicalSize];
+    NSAssert(self.sourceImage != nil, @"[BXShelfArt -tiledImageWithPixelSize:] called before source image was set.");
+    
+    NSSize tileSize = self.sourceImage.size;
+    if (tileSize.width < 1 || tileSize.height < 1) return nil;
+    
+    NSData *sourceData = self.sourceImage.TIFFRepresentation;
+    NSMutableData *digest = [NSMutableData dataWithLength: CC_SHA1_DIGEST_LENGTH];
+    CC_SHA1(sourceData.bytes, (CC_LONG)sourceData.length, digest.mutableBytes);
+    
+    NSString *cacheKey = [NSString stringWithFormat: @"%@-%.0fx%.0f-%.0fx%.0f", digest.stringWithHexBytes,
+                          pixelSize.width, pixelSize.height, logicalSize.width, logicalSize.height];
+    
+    NSImage *image = [[self.class _tiledImages] objectForKey: cacheKey];
+    if (image) return image;
+    
+    //Draw into our own bitmap context rather than locking focus on an NSImage,
+    //so that this can be done off the main thread.
+    NSBitmapImageRep *rep = [[NSBitmapImageRep alloc] initWithBitmapDataPlanes: NULL
+                                                                    pixelsWide: (NSInteger)pixelSize.width
+                                                                    pixelsHigh: (NSInteger)pixelSize.height
+                                                                 bitsPerSample: 8
+                                                               samplesPerPixel: 4
+                                                                      hasAlpha: YES
+                                                                      isPlanar: NO
+                                                                colorSpaceName: NSCalibratedRGBColorSpace
+                                                                   bytesPerRow: 0
+                                                                  bitsPerPixel: 0];
+    
+    NSGraphicsContext *context = [NSGraphicsContext graphicsContextWithBitmapImageRep: rep];
+    if (!context)
+    {
+        [rep release];
+        return nil;
+    }
+    
+    [NSGraphicsContext saveGraphicsState];
+        [NSGraphicsContext setCurrentContext: context];
+        
+        //Draw the tiles ourselves in logical units, scaled up to device pixels:
+        //pattern colors would ignore our scaling, since they're drawn relative to the context's base space.
+        NSAffineTransform *scale = [NSAffineTransform transform];
+        [scale scaleXBy: pixelSize.width / logicalSize.width
+                    yBy: pixelSize.height / logicalSize.height];
+        [scale concat];
+        
+        //Lay the tiles out from the top left corner of the frame, as drawInRect: does.
+        CGFloat topEdge = logicalSize.height;
+        for (CGFloat y = topEdge - tileSize.height; y + tileSize.height > 0; y -= tileSize.height)
+        {
+            for (CGFloat x = 0; x < logicalSize.width; x += tileSize.width)
+            {
+                [self.sourceImage drawInRect: NSMakeRect(x, y, tileSize.width, tileSize.height)
+                                    fromRect: NSZeroRect
+                                   operation: NSCompositeCopy
+                                    fraction: 1.0f];
+            }
+        }
+        [context flushGraphics];
+    [NSGraphicsContext restoreGraphicsState];
+    
+    rep.size = logicalSize;
+    
+    image = [[NSImage alloc] initWithSize: logicalSize];
+    [image addRepresentation: rep];
+    [rep release];
+    
+    NSUInteger cost = (NSUInteger)(pixelSize.width * pixelSize.height * 4);
+    [[self.class _tiledImages] setObject: image forKey: cacheKey cost: cost];
+    
+    return [image autorelease];
 }
 @end
@@ -0,0 +1,104 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+
+//BXStallWatchdog keeps an eye on the emulation thread from a background queue, and notices whenever
+//it goes longer than a threshold without finishing a DOSBox tick. When that happens it samples the
+//emulation thread's call stack, and notes which delegate call or hand-off to another thread the
+//emulation thread had marked itself as being in. Once the thread gets going again, the stall is
+//reported along with how long it lasted in the end.
+
+//The emulation thread marks the calls it may block in with BXStallCallScope, or with
+//BXStallWatchdogBeginCall and BXStallWatchdogEndCall from plain Objective-C. These cost a couple
+//of stores, and do nothing on any thread but the one being watched.
+
+#import <Foundation/Foundation.h>
+
+
+#pragma mark - Constants
+
+/// Keys for the dictionaries passed to @c stallHandler.
+/// How long the emulation thread went without finishing a tick, in seconds, as an NSNumber.
+/// This is only as accurate as the watchdog's polling, which is a quarter of the threshold.
+extern NSString * const BXStallDurationKey;
+
+/// When the stall began, as an NSDate.
+extern NSString * const BXStallDateKey;
+
+/// The marked calls the emulation thread was inside when it was sampled, outermost first,
+/// as an NSArray of NSStrings. Empty if the thread wasn't inside any marked call.
+extern NSString * const BXStallCallsKey;
+
+/// The emulation thread's call stack when it was sampled, innermost first, as an NSArray of
+/// NSStrings in the format of backtrace_symbols(). Empty if the stack could not be sampled.
+extern NSString * const BXStallBacktraceKey;
+
+
+#pragma mark - Marking calls
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Marks the start and end of a call the watched thread might block in. The call's name must
+/// be a string constant, since it is kept around for the watchdog to read later.
+void BXStallWatchdogBeginCall(const char *call);
+void BXStallWatchdogEndCall(void);
+
+#ifdef __cplusplus
+}
+
+/// Marks a call the watched thread might block in for as long as the scope lasts.
+class BXStallCallScope {
+public:
+    BXStallCallScope(const char *call) { BXStallWatchdogBeginCall(call); }
+    ~BXStallCallScope() { BXStallWatchdogEndCall(); }
+};
+#endif
+
+
+#pragma mark - Interface
+
+@interface BXStallWatchdog : NSObject
+{
+    NSTimeInterval _threshold;
+    void (^_stallHandler)(NSDictionary *stall);
+    volatile BOOL _armed;
+
+    dispatch_queue_t _queue;
+    dispatch_source_t _timer;
+
+    //Only touched on our queue.
+    NSUInteger _lastTicks;
+    CFAbsoluteTime _lastProgressTime;
+    BOOL _stalled;
+    NSArray *_stallCalls;
+    NSArray *_stallBacktrace;
+}
+
+/// How long the emulation thread may go without finishing a tick before it counts as a stall.
+@property (readonly, nonatomic) NSTimeInterval threshold;
+
+/// Called on the main thread with a dictionary describing each stall, using the keys listed
+/// under @c BXStallDurationKey, once the stall is over.
+@property (copy, nonatomic) void (^stallHandler)(NSDictionary *stall);
+
+/// Whether the watchdog is currently counting stalls. This should be turned off while the emulation
+/// thread is deliberately idle, such as while the emulator is paused. A stall that is still going on
+/// when the watchdog is disarmed is reported with the length it had reached. Defaults to @c NO.
+@property (assign, getter=isArmed) BOOL armed;
+
+/// Returns a watchdog with the specified threshold in seconds.
+- (id) initWithThreshold: (NSTimeInterval)threshold;
+
+/// Starts watching the calling thread. Only one thread can be watched at a time.
+- (void) startWatchingCurrentThread;
+
+/// Stops watching, reporting any stall that was under way.
+- (void) stopWatching;
+
+@end
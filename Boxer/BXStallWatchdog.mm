@@ -0,0 +1,319 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+#import "BXStallWatchdog.h"
+#import <mach/mach.h>
+#import <pthread.h>
+#import <execinfo.h>
+#import <libkern/OSAtomic.h>
+
+#if __has_feature(ptrauth_calls)
+#import <ptrauth.h>
+#endif
+
+#import "dosbox.h"
+
+
+#pragma mark - Constants
+
+NSString * const BXStallDurationKey     = @"duration";
+NSString * const BXStallDateKey         = @"date";
+NSString * const BXStallCallsKey        = @"calls";
+NSString * const BXStallBacktraceKey    = @"backtrace";
+
+//How deeply marked calls may be nested before we stop keeping track of the inner ones.
+#define BXStallMaxCallDepth 8
+
+//The most frames of the call stack to sample.
+#define BXStallMaxFrames 64
+
+
+#pragma mark - Marking calls
+
+//The thread being watched, and the calls it has marked itself as being inside. The calls are only
+//written by the watched thread itself, and read by the watchdog's queue while looking into a stall.
+static pthread_t _watchedThread = NULL;
+static thread_act_t _watchedMachThread = MACH_PORT_NULL;
+static const char * volatile _calls[BXStallMaxCallDepth];
+static volatile NSUInteger _callDepth = 0;
+
+void BXStallWatchdogBeginCall(const char *call)
+{
+    if (!_watchedThread || !pthread_equal(pthread_self(), _watchedThread))
+        return;
+
+    NSUInteger depth = _callDepth;
+    if (depth < BXStallMaxCallDepth)
+        _calls[depth] = call;
+
+    //Make sure the call is in place before the watchdog can see it.
+    OSMemoryBarrier();
+    _callDepth = depth + 1;
+}
+
+void BXStallWatchdogEndCall(void)
+{
+    if (!_watchedThread || !pthread_equal(pthread_self(), _watchedThread))
+        return;
+
+    if (_callDepth > 0)
+        _callDepth--;
+}
+
+
+#pragma mark - Sampling the call stack
+
+//Strips the pointer authentication code from return addresses on arm64e, so they can be symbolicated.
+#if __has_feature(ptrauth_calls)
+#define BXStallStripPointer(pointer) (uintptr_t)ptrauth_strip((void *)(pointer), ptrauth_key_return_address)
+#else
+#define BXStallStripPointer(pointer) (uintptr_t)(pointer)
+#endif
+
+//Suspends the specified thread just long enough to walk its frame pointers, and fills frames with
+//the return addresses found. Returns the number of frames found. Nothing here may allocate memory
+//or take a lock while the thread is suspended, since it might be holding the lock itself.
+static NSUInteger _sampleFramesOfThread(thread_act_t thread, uintptr_t *frames, NSUInteger maxFrames)
+{
+    if (thread == MACH_PORT_NULL || thread_suspend(thread) != KERN_SUCCESS)
+        return 0;
+
+    NSUInteger count = 0;
+    uintptr_t pc = 0, fp = 0;
+    BOOL gotState = NO;
+
+#if defined(__x86_64__)
+    x86_thread_state64_t state;
+    mach_msg_type_number_t stateCount = x86_THREAD_STATE64_COUNT;
+    if (thread_get_state(thread, x86_THREAD_STATE64, (thread_state_t)&state, &stateCount) == KERN_SUCCESS)
+    {
+        pc = state.__rip;
+        fp = state.__rbp;
+        gotState = YES;
+    }
+#elif defined(__arm64__)
+    arm_thread_state64_t state;
+    mach_msg_type_number_t stateCount = ARM_THREAD_STATE64_COUNT;
+    if (thread_get_state(thread, ARM_THREAD_STATE64, (thread_state_t)&state, &stateCount) == KERN_SUCCESS)
+    {
+        pc = (uintptr_t)arm_thread_state64_get_pc(state);
+        fp = (uintptr_t)arm_thread_state64_get_fp(state);
+        gotState = YES;
+    }
+#endif
+
+    if (gotState)
+    {
+        frames[count++] = BXStallStripPointer(pc);
+
+        //Each frame starts with the caller's frame pointer followed by the return address.
+        //Read them with vm_read_overwrite so that a bad frame pointer can't crash us.
+        while (fp && count < maxFrames)
+        {
+            uintptr_t frame[2];
+            vm_size_t bytesRead = 0;
+            kern_return_t result = vm_read_overwrite(mach_task_self(), (vm_address_t)fp, sizeof(frame),
+                                                     (vm_address_t)frame, &bytesRead);
+
+            if (result != KERN_SUCCESS || bytesRead != sizeof(frame) || !frame[1])
+                break;
+
+            frames[count++] = BXStallStripPointer(frame[1]);
+
+            //The stack grows downwards, so each caller's frame must be further up than the last.
+            if (frame[0] <= fp)
+                break;
+            fp = frame[0];
+        }
+    }
+
+    thread_resume(thread);
+    return count;
+}
+
+
+#pragma mark - Private interface declarations
+
+@interface BXStallWatchdog ()
+
+//Called on our queue every so often to see whether the emulation thread is still making progress.
+- (void) _check;
+
+//Reports the stall that is under way, as having lasted until the specified time.
+- (void) _endStallAtTime: (CFAbsoluteTime)endTime;
+
+//The calls that the watched thread is marked as being inside.
++ (NSArray *) _currentCalls;
+
+//The watched thread's call stack, symbolicated.
++ (NSArray *) _backtraceOfWatchedThread;
+
+@end
+
+
+@implementation BXStallWatchdog
+@synthesize threshold = _threshold;
+@synthesize stallHandler = _stallHandler;
+@synthesize armed = _armed;
+
+- (id) initWithThreshold: (NSTimeInterval)threshold
+{
+    self = [self init];
+    if (self)
+    {
+        _threshold = threshold;
+        _queue = dispatch_queue_create("com.boxer.stallWatchdog", DISPATCH_QUEUE_SERIAL);
+    }
+    return self;
+}
+
+- (void) dealloc
+{
+    [self stopWatching];
+
+    if (_queue)
+    {
+        dispatch_release(_queue), _queue = NULL;
+    }
+    self.stallHandler = nil;
+
+    [super dealloc];
+}
+
+
+#pragma mark - Watching
+
+- (void) startWatchingCurrentThread
+{
+    NSAssert(_watchedThread == NULL, @"Only one thread can be watched at a time.");
+
+    _callDepth = 0;
+    _watchedMachThread = mach_thread_self();
+    _watchedThread = pthread_self();
+
+    dispatch_sync(_queue, ^{
+        _lastTicks = DOSBOX_TicksCompleted;
+        _lastProgressTime = CFAbsoluteTimeGetCurrent();
+        _stalled = NO;
+    });
+
+    //Check four times per threshold, so that stalls are measured to within a quarter of it.
+    uint64_t interval = (uint64_t)(self.threshold * NSEC_PER_SEC / 4);
+    _timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, _queue);
+    dispatch_source_set_timer(_timer, dispatch_time(DISPATCH_TIME_NOW, interval), interval, interval / 10);
+
+    //Don't retain ourselves from the timer, since it's only cancelled when we stop watching.
+    __block BXStallWatchdog *watchdog = self;
+    dispatch_source_set_event_handler(_timer, ^{
+        [watchdog _check];
+    });
+    dispatch_resume(_timer);
+}
+
+- (void) stopWatching
+{
+    if (!_timer)
+        return;
+
+    dispatch_source_cancel(_timer);
+    dispatch_release(_timer), _timer = NULL;
+
+    dispatch_sync(_queue, ^{
+        if (_stalled)
+            [self _endStallAtTime: CFAbsoluteTimeGetCurrent()];
+    });
+
+    _watchedThread = NULL;
+    if (_watchedMachThread != MACH_PORT_NULL)
+    {
+        mach_port_deallocate(mach_task_self(), _watchedMachThread);
+        _watchedMachThread = MACH_PORT_NULL;
+    }
+}
+
+- (void) _check
+{
+    CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+    NSUInteger ticks = DOSBOX_TicksCompleted;
+
+    if (!self.isArmed || ticks != _lastTicks)
+    {
+        if (_stalled)
+            [self _endStallAtTime: now];
+
+        _lastTicks = ticks;
+        _lastProgressTime = now;
+        return;
+    }
+
+    //Sample the thread as soon as the stall passes the threshold, while it's still stuck
+    //wherever it got stuck.
+    if (!_stalled && (now - _lastProgressTime) >= self.threshold)
+    {
+        _stalled = YES;
+        _stallCalls = [[self.class _currentCalls] retain];
+        _stallBacktrace = [[self.class _backtraceOfWatchedThread] retain];
+    }
+}
+
+- (void) _endStallAtTime: (CFAbsoluteTime)endTime
+{
+    NSDictionary *stall = @{
+                            BXStallDurationKey:     @(endTime - _lastProgressTime),
+                            BXStallDateKey:         [NSDate dateWithTimeIntervalSinceReferenceDate: _lastProgressTime],
+                            BXStallCallsKey:        _stallCalls ? _stallCalls : @[],
+                            BXStallBacktraceKey:    _stallBacktrace ? _stallBacktrace : @[],
+                            };
+
+    [_stallCalls release], _stallCalls = nil;
+    [_stallBacktrace release], _stallBacktrace = nil;
+    _stalled = NO;
+
+    void (^handler)(NSDictionary *) = self.stallHandler;
+    if (handler)
+    {
+        dispatch_async(dispatch_get_main_queue(), ^{
+            handler(stall);
+        });
+    }
+}
+
++ (NSArray *) _currentCalls
+{
+    NSUInteger depth = MIN((NSUInteger)_callDepth, (NSUInteger)BXStallMaxCallDepth);
+    OSMemoryBarrier();
+
+    NSMutableArray *calls = [NSMutableArray arrayWithCapacity: depth];
+    for (NSUInteger i=0; i<depth; i++)
+    {
+        const char *call = _calls[i];
+        if (call)
+            [calls addObject: [NSString stringWithUTF8String: call]];
+    }
+    return calls;
+}
+
++ (NSArray *) _backtraceOfWatchedThread
+{
+    uintptr_t frames[BXStallMaxFrames];
+    NSUInteger count = _sampleFramesOfThread(_watchedMachThread, frames, BXStallMaxFrames);
+    if (!count)
+        return @[];
+
+    char **symbols = backtrace_symbols((void * const *)frames, (int)count);
+    if (!symbols)
+        return @[];
+
+    NSMutableArray *backtrace = [NSMutableArray arrayWithCapacity: count];
+    for (NSUInteger i=0; i<count; i++)
+        [backtrace addObject: [NSString stringWithUTF8String: symbols[i]]];
+
+    free(symbols);
+    return backtrace;
+}
+
+@end
@@ -66,11 +66,11 @@ enum
 
 - (void) clearInput
 {
-	JOYSTICK_Move_X(BXGameportStick1, BXGameportAxisCentered);
-	JOYSTICK_Move_Y(BXGameportStick1, BXGameportAxisCentered);
-	JOYSTICK_Move_X(BXGameportStick2, BXGameportAxisCentered);
+	[self setPosition: BXGameportAxisCentered forGameportAxis: BXGameportXAxis];
+	[self setPosition: BXGameportAxisCentered forGameportAxis: BXGameportYAxis];
+	[self setPosition: BXGameportAxisCentered forGameportAxis: BXGameportX2Axis];
 	//Set the hat axis to its proper center position
-	JOYSTICK_Move_Y(BXGameportStick2, BXThrustmasterFCSPOVCentered);
+	[self setPosition: BXThrustmasterFCSPOVCentered forGameportAxis: BXThrustmasterFCSHatAxis];
     
     povDirectionMask = BXEmulatedPOVCentered;
 }
@@ -64,6 +64,19 @@ typedef struct {
 } BXFilterDefinition;
 
 
+//The highest frameskip level that automatic frameskipping will go to.
+#define BXMaxAutomaticFrameskip 4
+
+//How long automatic frameskipping waits after each change before raising the frameskip again,
+//and how long there must be spare headroom before it lowers the frameskip again.
+#define BXAutomaticFrameskipIncreaseDelay 0.25
+#define BXAutomaticFrameskipDecreaseDelay 1.0
+
+//The shortest time between frames drawn in turbo mode. The emulated machine produces frames
+//far faster than the screen can show them then, so only as many are drawn as can be seen.
+#define BXTurboFrameInterval (1.0 / 60.0)
+
+
 typedef NS_ENUM(NSInteger, BXHerculesTintMode) {
     BXHerculesWhiteTint = 0,
     BXHerculesAmberTint = 1,
@@ -74,11 +87,13 @@ typedef NS_ENUM(NSInteger, BXHerculesTintMode) {
 
 @class BXEmulator;
 @class BXVideoFrame;
+@class BXVideoFramePool;
 
 @interface BXVideoHandler : NSObject
 {
 	__unsafe_unretained BXEmulator *_emulator;
 	BXVideoFrame *_currentFrame;
+    BXVideoFramePool *_framePool;
 	
 	NSInteger _currentVideoMode;
 	BXFilterType _filterType;
@@ -86,6 +101,23 @@ typedef NS_ENUM(NSInteger, BXHerculesTintMode) {
     
     BXHerculesTintMode _herculesTint;
     double _CGAHueAdjustment;
+    
+    BOOL _automaticFrameskip;
+    CFAbsoluteTime _lastFrameStartTime;
+    CFAbsoluteTime _lastFrameskipChangeTime;
+    CFAbsoluteTime _headroomStartTime;
+    double _emulationLoad;
+    
+    BOOL _drawingSuspended;
+    CFAbsoluteTime _lastNeededFrameTime;
+    
+    //The palette for 8-bit frames as BGRA colors, and a count of the changes made to it.
+    uint32_t _palette[256];
+    NSUInteger _paletteVersion;
+    
+    //The hardware cursor image last handed to frames, and a count of the changes made to it.
+    NSData *_hardwareCursorImage;
+    NSUInteger _hardwareCursorVersion;
 	
 #if __cplusplus
 	//This is a C++ function pointer and should never be seen by Obj-C classes
@@ -99,9 +131,14 @@ typedef NS_ENUM(NSInteger, BXHerculesTintMode) {
 //Our parent emulator.
 @property (assign, nonatomic) BXEmulator *emulator;
 
-//The framebuffer we render our frames into.
+//The framebuffer we are currently rendering into, or most recently rendered into.
 @property (retain, nonatomic) BXVideoFrame *currentFrame;
 
+//The pool of recycled framebuffers from which currentFrame is drawn.
+//Completed frames are passed on to the emulator's delegate, and will not be
+//drawn into again while any renderer is reading from them.
+@property (readonly, nonatomic) BXVideoFramePool *framePool;
+
 //The current rendering style as a DOSBox filter type constant.
 @property (assign, nonatomic) BXFilterType filterType;
 
@@ -111,6 +148,22 @@ typedef NS_ENUM(NSInteger, BXHerculesTintMode) {
 //The current DOSBox frameskip setting.
 @property (assign, nonatomic) NSUInteger frameskip;
 
+//Whether to adjust the frameskip on the fly according to how well the host is keeping up.
+//When enabled, frames will be skipped whenever emulation is falling behind realtime, mixed
+//audio is running short or the renderer is struggling, and played again once headroom returns.
+@property (assign, nonatomic) BOOL automaticFrameskip;
+
+//Whether DOSBox should skip drawing frames altogether, e.g. while the DOS window cannot be seen.
+//Emulation carries on at the same speed, but the VGA draws nothing and no frames are passed
+//on to the emulator's delegate.
+@property (assign) BOOL drawingSuspended;
+
+//Whether anyone will see the frame that DOSBox is about to draw. This is checked by DOSBox
+//at the start of each frame that frameskip would not skip: if NO, the VGA keeps its timing
+//and raster state but draws no lines for the frame. Frames are not needed while drawing is
+//suspended, or in turbo mode when a frame was drawn less than BXTurboFrameInterval ago.
+@property (readonly, getter=isFrameNeeded) BOOL frameNeeded;
+
 //Whether the chosen filter is actually being rendered. This will be NO if the current rendered
 //size is smaller than the minimum size supported by the chosen filter.
 @property (readonly) BOOL filterIsActive;
@@ -154,8 +207,17 @@ typedef NS_ENUM(NSInteger, BXHerculesTintMode) {
 							 green: (NSUInteger)green
 							  blue: (NSUInteger)blue;
 
+//Called by DOSBox to update entries in the palette of 8-bit frames. The palette is passed on
+//with each frame, and only the frames drawn after this call will use the new colors.
+- (void) setPaletteEntries: (const GFX_PalEntry *)entries
+                     start: (NSUInteger)start
+                     count: (NSUInteger)count;
+
+//Called by DOSBox to prepare frames of the specified size. A depth of 1 produces indexed frames,
+//whose colors come from the palette above; a depth of 4 produces 32-bit BGRA frames.
 - (void) prepareForOutputSize: (NSSize)outputSize
 					  atScale: (NSSize)scale
+                        depth: (NSUInteger)depth
 				 withCallback: (GFX_CallBack_t)newCallback;
 
 - (BOOL) startFrameWithBuffer: (void **)frameBuffer pitch: (NSUInteger *)pitch;
@@ -9,11 +9,15 @@
 #import "BXVideoHandler.h"
 #import "BXEmulatorPrivate.h"
 #import "BXVideoFrame.h"
+#import "BXVideoFramePool.h"
 #import "ADBGeometry.h"
 #import "BXFilterDefinitions.h"
+#import "BXInputLatencyRecorder.h"
 
 #import "render.h"
 #import "vga.h"
+#import "mixer.h"
+#import "inputreplay.h"
 
 
 #pragma mark -
@@ -38,15 +42,25 @@
 - (void) _syncHerculesTint;
 - (void) _syncCGAHueAdjustment;
 
+//Called at the start of every frame that is drawn while automaticFrameskip is enabled,
+//to raise or lower the frameskip level according to the current load.
+- (void) _adjustAutomaticFrameskip;
+
+//Passes the SVGA hardware cursor's current image and position on to the specified frame.
+- (void) _syncHardwareCursorToFrame: (BXVideoFrame *)frame;
+
 @end
 
 
 @implementation BXVideoHandler
 @synthesize currentFrame = _currentFrame;
+@synthesize framePool = _framePool;
 @synthesize emulator = _emulator;
 @synthesize filterType = _filterType;
 @synthesize herculesTint = _herculesTint;
 @synthesize CGAHueAdjustment = _CGAHueAdjustment;
+@synthesize automaticFrameskip = _automaticFrameskip;
+@synthesize drawingSuspended = _drawingSuspended;
 
 - (id) init
 {
@@ -56,6 +70,7 @@
 		_currentVideoMode = M_TEXT;
         _herculesTint = BXHerculesWhiteTint;
         _CGAHueAdjustment = 0.0;
+        _framePool = [[BXVideoFramePool alloc] initWithCapacity: BXVideoFramePoolDefaultCapacity];
 	}
 	return self;
 }
@@ -63,6 +78,8 @@
 - (void) dealloc
 {	
     self.currentFrame = nil;
+    [_framePool release], _framePool = nil;
+    [_hardwareCursorImage release], _hardwareCursorImage = nil;
 	[super dealloc];
 }
 
@@ -133,6 +150,95 @@
 	render.frameskip.max = (Bitu)frameskip;
 }
 
+- (BOOL) isFrameNeeded
+{
+    if (self.drawingSuspended)
+        return NO;
+    
+    //Replays must draw every frame, so that the frames they checksum don't depend on how fast the host ran.
+    if (self.emulator.isTurboSpeed && !REPLAY_IsPlaying())
+    {
+        CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+        if ((now - _lastNeededFrameTime) < BXTurboFrameInterval)
+            return NO;
+        _lastNeededFrameTime = now;
+    }
+    return YES;
+}
+
+- (void) setAutomaticFrameskip: (BOOL)automatic
+{
+    if (automatic != _automaticFrameskip)
+    {
+        _automaticFrameskip = automatic;
+        
+        //Start measuring afresh from the next frame.
+        _lastFrameStartTime = 0;
+        _headroomStartTime = 0;
+        _emulationLoad = 1.0;
+    }
+}
+
+- (void) _adjustAutomaticFrameskip
+{
+    CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+    CFAbsoluteTime lastFrameStartTime = _lastFrameStartTime;
+    _lastFrameStartTime = now;
+    
+    if (!lastFrameStartTime || render.src.fps <= 0)
+        return;
+    
+    //Compare how long it has taken us to get through the frames since the last one we drew,
+    //against how long they would have taken at the game's refresh rate. Much longer gaps mean
+    //we were paused or otherwise interrupted, so we disregard those.
+    NSUInteger frameskip = self.frameskip;
+    CFTimeInterval frameInterval = 1.0 / render.src.fps;
+    CFTimeInterval expectedInterval = frameInterval * (frameskip + 1);
+    CFTimeInterval elapsedInterval = now - lastFrameStartTime;
+    if (elapsedInterval > 0.5)
+        return;
+    
+    _emulationLoad = (_emulationLoad * 0.75) + ((elapsedInterval / expectedInterval) * 0.25);
+    
+    CFTimeInterval renderingTime = 0;
+    if ([self.emulator.delegate respondsToSelector: @selector(renderingTimeForEmulator:)])
+        renderingTime = [self.emulator.delegate renderingTimeForEmulator: self.emulator];
+    double renderingLoad = renderingTime / frameInterval;
+    
+    //A negative fill level means there is no audio output to worry about.
+    float audioLevel = MIXER_BufferFillLevel();
+    
+    BOOL isStruggling = (_emulationLoad > 1.1 || renderingLoad > 0.9 || (audioLevel >= 0 && audioLevel < 1.0f));
+    BOOL hasHeadroom = (_emulationLoad < 1.02 && renderingLoad < 0.5 && (audioLevel < 0 || audioLevel >= 1.5f));
+    
+    if (isStruggling)
+    {
+        _headroomStartTime = 0;
+        if (frameskip < BXMaxAutomaticFrameskip && (now - _lastFrameskipChangeTime) >= BXAutomaticFrameskipIncreaseDelay)
+        {
+            self.frameskip = frameskip + 1;
+            _lastFrameskipChangeTime = now;
+        }
+    }
+    else if (hasHeadroom && frameskip > 0)
+    {
+        if (!_headroomStartTime)
+        {
+            _headroomStartTime = now;
+        }
+        else if ((now - _headroomStartTime) >= BXAutomaticFrameskipDecreaseDelay)
+        {
+            self.frameskip = frameskip - 1;
+            _lastFrameskipChangeTime = now;
+            _headroomStartTime = 0;
+        }
+    }
+    else
+    {
+        _headroomStartTime = 0;
+    }
+}
+
 //Chooses the specified filter, and resets the renderer to apply the change immediately.
 - (void) setFilterType: (BXFilterType)type
 {
@@ -194,27 +300,21 @@
 {
 	if (self.emulator.isInitialized)
 	{
-        if (self.emulator.emulationThread != [NSThread currentThread])
-        {
-            [self performSelector: _cmd
-                         onThread: self.emulator.emulationThread
-                       withObject: nil
-                    waitUntilDone: NO];
-        }
-        else
-        {
+        [self.emulator _performOnEmulationThread: ^{
             if (_frameInProgress) [self finishFrameWithChanges: NULL];
             
             if (_callback) _callback(GFX_CallBackReset);
             //CPU_Reset_AutoAdjust();
-        }
+        }];
 	}
 }
 
 - (void) shutdown
 {
-	[self finishFrameWithChanges: 0];
+	if (_frameInProgress) [self finishFrameWithChanges: 0];
 	if (_callback) _callback(GFX_CallBackStop);
+    
+    [self.framePool drain];
 }
 
 
@@ -223,6 +323,7 @@
 
 - (void) prepareForOutputSize: (NSSize)outputSize
                       atScale: (NSSize)scale
+                        depth: (NSUInteger)depth
                  withCallback: (GFX_CallBack_t)newCallback
 {
 	//Synchronise our record of the current video mode with the new video mode
@@ -236,18 +337,17 @@
 	BOOL nowTextMode = self.isInTextMode;
 	
 	//If we were in the middle of a frame then cancel it
-	_frameInProgress = NO;
+	if (_frameInProgress)
+    {
+        [self.framePool cancelFrame: self.currentFrame];
+        _frameInProgress = NO;
+    }
 	
 	_callback = newCallback;
 	
-	//Check if we can reuse our existing framebuffer: if not, create a new one
-	if (!NSEqualSizes(outputSize, self.currentFrame.size))
-	{
-        self.currentFrame = [BXVideoFrame frameWithSize: outputSize depth: 4];
-	}
-	
-    self.currentFrame.baseResolution = self.resolution;
-    self.currentFrame.containsText = nowTextMode;
+	//Frames in the pool will be reshaped to the new size as they are recycled,
+    //reusing their existing buffers.
+    [self.framePool setFrameSize: outputSize depth: depth];
 	
 	//Send notifications if the display mode has changed
 	
@@ -270,16 +370,46 @@
 		return NO;
 	}
 	
-	if (!self.currentFrame)
+	if (NSEqualSizes(self.framePool.frameSize, NSZeroSize))
 	{
 		NSLog(@"Tried to start a frame before any framebuffer was created!");
 		return NO;
 	}
 	
+    if (self.automaticFrameskip)
+    {
+        //Turbo mode holds frames back deliberately, so the gaps between them
+        //say nothing about how well we're keeping up.
+        if (self.emulator.isTurboSpeed)
+            _lastFrameStartTime = 0;
+        else
+            [self _adjustAutomaticFrameskip];
+    }
+    
+    //Grab a frame that no renderer is currently reading from. This will already contain
+    //the contents of the previous frame, so DOSBox only needs to draw what has changed.
+    self.currentFrame = [self.framePool checkoutFrameForWriting];
+    self.currentFrame.baseResolution = self.resolution;
+    self.currentFrame.containsText = self.isInTextMode;
+    self.currentFrame.refreshRate = (CGFloat)render.src.fps;
+    [self.currentFrame setPalette: _palette version: _paletteVersion];
+    
+    //In the CGA's composite color mode, DOSBox hands us the raw pixel bits for our
+    //renderer to decode: pass on the signal's current hue and color to decode them with.
+    self.currentFrame.composite = (self.currentFrame.isIndexed && _currentVideoMode == M_CGA16);
+    if (self.currentFrame.isComposite)
+    {
+        double hue;
+        Bit8u red, green, blue;
+        boxer_CGACompositeSignal(&hue, &red, &green, &blue);
+        self.currentFrame.compositeHue = (CGFloat)(hue * M_PI / 180.0);
+        self.currentFrame.compositeColor = blue | (green << 8) | (red << 16) | (0xffU << 24);
+    }
+    
+    [self _syncHardwareCursorToFrame: self.currentFrame];
+    
 	*buffer	= self.currentFrame.mutableBytes;
     *pitch	= self.currentFrame.pitch;
-    
-    [self.currentFrame clearDirtyRegions];
 	
 	_frameInProgress = YES;
 	return YES;
@@ -287,8 +417,9 @@
 
 - (void) finishFrameWithChanges: (const uint16_t *)dirtyBlocks
 {
-	if (self.currentFrame)
+	if (_frameInProgress && self.currentFrame)
 	{
+        BOOL hasChanges = NO;
         if (dirtyBlocks)
         {
             //Convert DOSBox's array of dirty blocks into a set of ranges
@@ -301,23 +432,136 @@
                 //Even-numbered indices represent clean regions that should be skipped.
                 BOOL isDirtyBlock = (i % 2 != 0);
                 
-                if (isDirtyBlock)
+                if (isDirtyBlock && regionLength)
                 {
                     [self.currentFrame setNeedsDisplayInRegion: NSMakeRange(currentOffset, regionLength)];
+                    hasChanges = YES;
                 }
                 
                 currentOffset += regionLength;
                 i++;
             }
         }
+        //If DOSBox didn't tell us what changed (e.g. because the frame was aborted),
+        //then we have to assume that all of it did.
+        else
+        {
+            [self.currentFrame setNeedsDisplayInRegion: NSMakeRange(0, self.currentFrame.size.height)];
+            hasChanges = YES;
+        }
         
         self.currentFrame.timestamp = CFAbsoluteTimeGetCurrent();
+        
+        if (hasChanges)
+            BXInputLatencyMarkFrame(BXInputLatencyRendered, self.currentFrame.timestamp);
+        
+        //Once committed, the frame will not be drawn into again while renderers are reading from it.
+        [self.framePool commitFrame: self.currentFrame];
         [self.emulator _didFinishFrame: self.currentFrame];
 	}
     
 	_frameInProgress = NO;
 }
 
+- (void) _syncHardwareCursorToFrame: (BXVideoFrame *)frame
+{
+    BOOL cursorActive = boxer_drawsHardwareCursor() && svga.hardware_cursor_active && svga.hardware_cursor_active();
+    if (!cursorActive || !vga.draw.width || !vga.draw.height)
+    {
+        frame.hardwareCursorImage = nil;
+        return;
+    }
+    
+    //Work out the cursor's colors in the same format as the current video mode,
+    //as VGA_Draw_*_Line_HWMouse would.
+    const Bit8u *fore = vga.s3.hgc.forestack, *back = vga.s3.hgc.backstack;
+    uint32_t colors[2];
+    switch (vga.mode)
+    {
+        case M_LIN32:
+            colors[0] = (back[0] | (back[1] << 8) | (back[2] << 16)) | (0xffU << 24);
+            colors[1] = (fore[0] | (fore[1] << 8) | (fore[2] << 16)) | (0xffU << 24);
+            break;
+        case M_LIN15:
+        case M_LIN16:
+        {
+            NSUInteger i;
+            for (i=0; i<2; i++)
+            {
+                const Bit8u *stack = i ? fore : back;
+                NSUInteger color = stack[0] | (stack[1] << 8);
+                NSUInteger red, green, blue;
+                if (vga.mode == M_LIN15)
+                {
+                    red     = ((color >> 10) & 0x1f) * 255 / 31;
+                    green   = ((color >> 5) & 0x1f) * 255 / 31;
+                }
+                else
+                {
+                    red     = ((color >> 11) & 0x1f) * 255 / 31;
+                    green   = ((color >> 5) & 0x3f) * 255 / 63;
+                }
+                blue = (color & 0x1f) * 255 / 31;
+                colors[i] = (uint32_t)[self paletteEntryWithRed: red green: green blue: blue];
+            }
+            break;
+        }
+        default:
+            colors[0] = _palette[back[0]];
+            colors[1] = _palette[fore[0]];
+            break;
+    }
+    
+    //Decode the cursor pattern from video memory. It is arranged as 16 bits of plane A
+    //followed by 16 bits of plane B, each pair of A and B bits making up one cursor pixel.
+    //The pattern is shifted left by posx pixels and up by posy pixels, leaving the rest
+    //of the cursor space transparent.
+    uint32_t pixels[BXVideoFrameHardwareCursorSize * BXVideoFrameHardwareCursorSize];
+    memset(pixels, 0, sizeof(pixels));
+    
+    const Bit8u *pattern = &vga.mem.linear[((Bitu)vga.s3.hgc.startaddr) << 10];
+    NSUInteger x, y;
+    for (y=0; y + vga.s3.hgc.posy < BXVideoFrameHardwareCursorSize; y++)
+    {
+        for (x=0; x + vga.s3.hgc.posx < BXVideoFrameHardwareCursorSize; x++)
+        {
+            NSUInteger bitIndex = ((y + vga.s3.hgc.posy) * BXVideoFrameHardwareCursorSize) + x + vga.s3.hgc.posx;
+            NSUInteger byteOffset = ((bitIndex >> 4) << 2) + ((bitIndex >> 3) & 1);
+            Bit8u bit = 0x80 >> (bitIndex & 7);
+            BOOL bitA = (pattern[byteOffset] & bit) != 0;
+            BOOL bitB = (pattern[byteOffset + 2] & bit) != 0;
+            
+            uint32_t pixel;
+            if (bitA)   pixel = bitB ? 0x00ffffff : 0;  //Inverted or transparent
+            else        pixel = colors[bitB];           //Foreground or background color
+            
+            pixels[(y * BXVideoFrameHardwareCursorSize) + x] = pixel;
+        }
+    }
+    
+    //Only hand on a new image when the cursor's appearance has actually changed,
+    //so that renderers only upload it again then.
+    if (!_hardwareCursorImage || memcmp(_hardwareCursorImage.bytes, pixels, sizeof(pixels)))
+    {
+        [_hardwareCursorImage release];
+        _hardwareCursorImage = [[NSData alloc] initWithBytes: pixels length: sizeof(pixels)];
+        _hardwareCursorVersion++;
+    }
+    
+    //The cursor's position is measured in the video mode's pixels and lines,
+    //which may not match the base resolution of the frame.
+    NSSize resolution = self.resolution;
+    CGFloat scaleX = resolution.width / vga.draw.width;
+    CGFloat scaleY = resolution.height / vga.draw.height;
+    
+    frame.hardwareCursorImage = _hardwareCursorImage;
+    frame.hardwareCursorVersion = _hardwareCursorVersion;
+    frame.hardwareCursorRegion = NSMakeRect(vga.s3.hgc.originx * scaleX,
+                                            vga.s3.hgc.originy * scaleY,
+                                            BXVideoFrameHardwareCursorSize * scaleX,
+                                            BXVideoFrameHardwareCursorSize * scaleY);
+}
+
 - (NSUInteger) paletteEntryWithRed: (NSUInteger)red
 							 green: (NSUInteger)green
 							  blue: (NSUInteger)blue;
@@ -326,6 +570,20 @@
 	return ((blue << 0) | (green << 8) | (red << 16)) | (255U << 24);
 }
 
+- (void) setPaletteEntries: (const GFX_PalEntry *)entries
+                     start: (NSUInteger)start
+                     count: (NSUInteger)count
+{
+    NSUInteger i;
+    for (i=0; i<count && start+i < 256; i++)
+    {
+        _palette[start+i] = (uint32_t)[self paletteEntryWithRed: entries[i].r
+                                                          green: entries[i].g
+                                                           blue: entries[i].b];
+    }
+    _paletteVersion++;
+}
+
 
 #pragma mark -
 #pragma mark Rendering strategy
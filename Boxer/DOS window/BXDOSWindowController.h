@@ -135,6 +135,16 @@ extern NSString * const BXViewDidLiveResizeNotification;
 //The current size of the DOS rendering viewport.
 @property (readonly, nonatomic) NSSize viewportSize;
 
+//How long the rendering view took to draw the most recent frame, or 0 if it can't say.
+@property (readonly, nonatomic) CFTimeInterval renderingTime;
+
+//Whether the rendering view has stopped redrawing, e.g. while the session is suspended.
+//Always NO if the rendering view does not support suspending.
+@property (assign, nonatomic, getter=isRenderingSuspended) BOOL renderingSuspended;
+
+//Tells the rendering view to release whatever it can rebuild later, e.g. while the window cannot be seen.
+- (void) releaseRenderingResources;
+
 #pragma mark Rendering options
 
 //The maximum drawing area to use when in fullscreen.
@@ -163,6 +173,11 @@ extern NSString * const BXViewDidLiveResizeNotification;
 //Will return nil if no frame has been provided yet (via updateWithFrame:).
 - (NSImage *) screenshotOfCurrentFrame;
 
+//Captures a screenshot of what is currently being rendered in the rendering view, without holding up
+//rendering or emulation while the image data is retrieved. completionHandler is called on a background
+//queue with the screenshot, or with nil if no frame has been provided yet.
+- (void) captureScreenshotOfCurrentFrameWithCompletionHandler: (void (^)(NSImage *screenshot))completionHandler;
+
 
 #pragma mark -
 #pragma mark Interface actions
@@ -1236,6 +1236,14 @@ NSString * const BXDOSWindowFullscreenSizeFormat = @"Fullscreen size for %@";
 	//Update the renderer with the new frame.
 	[self.renderingView updateWithFrame: frame];
     
+    //If the view is locking the emulated display's refresh to the screen's,
+    //keep the emulator running at the rate it needs for that.
+    if ([self.renderingView respondsToSelector: @selector(emulationRate)])
+    {
+        BXSession *session = (BXSession *)self.document;
+        session.emulator.emulationRate = self.renderingView.emulationRate;
+    }
+    
     BOOL hasFrame = (frame != nil);
 	if (hasFrame)
 	{
@@ -1293,6 +1301,34 @@ NSString * const BXDOSWindowFullscreenSizeFormat = @"Fullscreen size for %@";
 	return [self.renderingView maxFrameSize];
 }
 
+- (CFTimeInterval) renderingTime
+{
+    if ([self.renderingView respondsToSelector: @selector(renderingTime)])
+        return [self.renderingView renderingTime];
+    else
+        return 0;
+}
+
+- (BOOL) isRenderingSuspended
+{
+    if ([self.renderingView respondsToSelector: @selector(isRenderingSuspended)])
+        return [self.renderingView isRenderingSuspended];
+    else
+        return NO;
+}
+
+- (void) setRenderingSuspended: (BOOL)suspended
+{
+    if ([self.renderingView respondsToSelector: @selector(setRenderingSuspended:)])
+        [self.renderingView setRenderingSuspended: suspended];
+}
+
+- (void) releaseRenderingResources
+{
+    if ([self.renderingView respondsToSelector: @selector(releaseCachedResources)])
+        [self.renderingView releaseCachedResources];
+}
+
 //Returns the current size that the render view would be if it were in windowed mode.
 //This will differ from the actual render view size when in fullscreen mode.
 - (NSSize) windowedRenderingViewSize
@@ -1315,6 +1351,30 @@ NSString * const BXDOSWindowFullscreenSizeFormat = @"Fullscreen size for %@";
     return screenshot;
 }
 
+- (void) captureScreenshotOfCurrentFrameWithCompletionHandler: (void (^)(NSImage *screenshot))completionHandler
+{
+    if (self.currentPanel == BXDOSWindowDOSView && self.renderingView.currentFrame &&
+        [self.renderingView respondsToSelector: @selector(captureContentsOfRect:completionHandler:)])
+    {
+        NSRect visibleRect = self.renderingView.viewportRect;
+        [self.renderingView captureContentsOfRect: visibleRect
+                                completionHandler: ^(NSBitmapImageRep *bitmap) {
+                                    NSImage *screenshot = [[NSImage alloc] init];
+                                    [screenshot addRepresentation: bitmap];
+                                    completionHandler(screenshot);
+                                    [screenshot release];
+                                }];
+    }
+    else
+    {
+        NSImage *screenshot = [self screenshotOfCurrentFrame];
+        dispatch_queue_t queue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+        dispatch_async(queue, ^{
+            completionHandler(screenshot);
+        });
+    }
+}
+
 
 #pragma mark -
 #pragma mark Window resizing and fullscreen
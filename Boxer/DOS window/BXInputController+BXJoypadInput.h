@@ -6,6 +6,8 @@
  */
 
 //The BXJoypadInput category handles JoyPad iOS app input passed on from BXJoypadController.
+//Input arrives on the HID thread and is mapped straight onto the emulated joystick, which passes
+//it on to the emulation thread itself: anything that touches the UI is sent to the main thread.
 
 #import "BXInputController.h"
 #import "JoypadSDK.h"
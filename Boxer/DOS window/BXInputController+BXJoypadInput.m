@@ -106,10 +106,12 @@
 {
     //If the game seems to be ignoring joystick input right now,
     //and the user is poking away in Joypad, show a notification
-    if ([self _activeProgramIsIgnoringJoystick])
-    {
-        [[BXBezelController controller] showJoystickIgnoredBezel];
-    }
+    dispatch_async(dispatch_get_main_queue(), ^{
+        if ([self _activeProgramIsIgnoringJoystick])
+        {
+            [[BXBezelController controller] showJoystickIgnoredBezel];
+        }
+    });
 }
 
 //Passed on by BXJoypadController whenever a device is connected/disconnected
@@ -345,7 +347,9 @@
             
         case kJoyInputSelectButton:
             //Pause button
-            [self.representedObject togglePaused: self];
+            dispatch_async(dispatch_get_main_queue(), ^{
+                [self.representedObject togglePaused: self];
+            });
             break;
             
         case kJoyInputStartButton:
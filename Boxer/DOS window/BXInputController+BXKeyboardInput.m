@@ -10,6 +10,7 @@
 #import "BXDOSWindow.h"
 #import "BXBezelController.h"
 #import "BXEmulator+BXPaste.h"
+#import "BXInputLatencyRecorder.h"
 
 //For keycodes and input source methods
 #import <Carbon/Carbon.h>
@@ -68,6 +69,8 @@
 
 - (void) keyDown: (NSEvent *)theEvent
 {
+    BXInputLatencyMark(BXInputLatencyReceived);
+    
 	//If the keypress was command-modified, don't pass it on to the emulator as it indicates
 	//a failed key equivalent.
 	//(This is consistent with how other OS X apps with textinput handle Cmd-keypresses.)
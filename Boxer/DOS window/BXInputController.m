@@ -28,6 +28,7 @@
 #import "BXEmulatedJoystick.h"
 
 #import "BXBezelController.h"
+#import "BXInputLatencyRecorder.h"
 
 //For text input services notification names
 #import <Carbon/Carbon.h>
@@ -596,6 +597,8 @@ void _inputSourceChanged(CFNotificationCenterRef center,
 
 - (void) mouseDown: (NSEvent *)theEvent
 {
+    BXInputLatencyMark(BXInputLatencyReceived);
+    
 	//Unpause whenever the view is clicked on
 	[self.representedObject resume: self];
 	
@@ -656,6 +659,8 @@ void _inputSourceChanged(CFNotificationCenterRef center,
 
 - (void) rightMouseDown: (NSEvent *)theEvent
 {
+    BXInputLatencyMark(BXInputLatencyReceived);
+    
 	//Unpause whenever the view is clicked on
 	[self.representedObject resume: self];
 	
@@ -686,6 +691,8 @@ void _inputSourceChanged(CFNotificationCenterRef center,
 
 - (void) otherMouseDown: (NSEvent *)theEvent
 {
+    BXInputLatencyMark(BXInputLatencyReceived);
+    
 	//Unpause whenever the view is clicked on
 	[self.representedObject resume: self];
 	
@@ -823,6 +830,8 @@ void _inputSourceChanged(CFNotificationCenterRef center,
 	//Only apply mouse movement if we're locked or we're accepting unlocked mouse input
 	if ([self _controlsCursorWhileMouseInside])
 	{
+        BXInputLatencyMark(BXInputLatencyReceived);
+        
 		NSRect canvas = self.view.bounds;
 		CGFloat width = canvas.size.width;
 		CGFloat height = canvas.size.height;
@@ -1053,6 +1062,10 @@ void _inputSourceChanged(CFNotificationCenterRef center,
         //the cursor can leave the window and inadvertently click on other applications.
         CGAssociateMouseAndMouseCursorPosition(NO);
         
+        //Receive every mouse movement the hardware reports rather than having AppKit bunch
+        //them together: our emulated mouse collects the motion at its own rate instead.
+        [NSEvent setMouseCoalescingEnabled: NO];
+        
 		//If the cursor is outside of the view when we lock the mouse,
 		//then warp it to the center of the DOS view.
 		//This prevents mouse clicks from going to other windows.
@@ -1082,6 +1095,7 @@ void _inputSourceChanged(CFNotificationCenterRef center,
         //Allow the OS X cursor to update its position in response to mouse
         //movement again.
         CGAssociateMouseAndMouseCursorPosition(YES);
+        [NSEvent setMouseCoalescingEnabled: YES];
         
 		//If we're unlocking the mouse, then sync the OS X mouse cursor
 		//to wherever DOSBox's cursor is located within the view.
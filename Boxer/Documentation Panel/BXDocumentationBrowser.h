@@ -18,6 +18,7 @@
 {
     NSArray *_documentationURLs;
     NSIndexSet *_documentationSelectionIndexes;
+    NSURL *_thumbnailCacheURL;
     
     __unsafe_unretained NSScrollView *_documentationScrollView;
     __unsafe_unretained BXDocumentationList *_documentationList;
@@ -72,6 +73,11 @@
 //the presence of a Documentation folder in the gamebox, and whether we are a standalone game app.
 @property (readonly, nonatomic) BOOL canModifyDocumentation;
 
+//The folder in the gamebox's support data in which QuickLook thumbnails of its documentation
+//are cached between launches. Thumbnails are keyed by the file's modification date, so editing
+//a documentation file will generate a fresh thumbnail for it.
+@property (readonly, copy, nonatomic) NSURL *thumbnailCacheURL;
+
 #pragma mark - Constructors
 
 //Returns a newly-created BXDocumentationListController instance
@@ -160,11 +166,13 @@
 @interface BXDocumentationItem : BXCollectionItem
 {
     NSImage *_icon;
+    NSOperation *_thumbnailOperation;
 }
 
 //The icon for the documentation file.
-//This will initially be the Finder file icon, but will be replaced with a Spotlight image preview
-//asynchronously.
+//This will initially be the Finder file icon, but will be replaced with a QuickLook thumbnail
+//asynchronously. Thumbnails are generated a couple at a time on a shared background queue,
+//and cached in memory and in the browser's thumbnailCacheURL.
 @property (retain, nonatomic) NSImage *icon;
 
 //The display name of the documentation file.
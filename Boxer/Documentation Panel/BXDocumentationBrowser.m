@@ -10,6 +10,7 @@
 #import "BXGamebox.h"
 #import "NSURL+ADBQuickLookHelpers.h"
 #import "BXBaseAppController.h"
+#import "BXBaseAppController+BXSupportFiles.h"
 #import "NSView+ADBDrawingHelpers.h"
 #import "BXBaseAppController.h"
 #import "NSError+ADBErrorHelpers.h"
@@ -20,11 +21,19 @@ enum {
     BXDocumentationItemLabel = 2,
 };
 
+//The name of the folder within the gamebox's support data where documentation thumbnails are cached.
+static NSString * const BXDocumentationThumbnailCacheFolderName = @"Documentation Thumbnails";
+
+//How many thumbnails to generate at once. QuickLook can be slow to render large PDFs, and generating
+//thumbnails for every manual at once would swamp the machine and delay the ones the user can see.
+#define BXDocumentationThumbnailMaxConcurrentOperations 2
+
 @interface BXDocumentationBrowser ()
 
 //A copy of the gamebox's reported documentation.
 //Repopulated whenever the gamebox announces that it has been updated.
 @property (readwrite, copy, nonatomic) NSArray *documentationURLs;
+@property (readwrite, copy, nonatomic) NSURL *thumbnailCacheURL;
 
 //Called to repopulate and re-sort our local copy of the documentation URLs.
 - (void) _syncDocumentationURLs;
@@ -39,6 +48,7 @@ enum {
 
 @synthesize documentationURLs = _documentationURLs;
 @synthesize documentationSelectionIndexes = _documentationSelectionIndexes;
+@synthesize thumbnailCacheURL = _thumbnailCacheURL;
 @synthesize delegate = _delegate;
 
 #pragma mark - Initialization and deallocation
@@ -67,6 +77,20 @@ enum {
         
         [super setRepresentedObject: representedObject];
         
+        BXGamebox *gamebox = [(BXSession *)self.representedObject gamebox];
+        if (gamebox)
+        {
+            NSURL *statesURL = [(BXBaseAppController *)[NSApp delegate] gameStatesURLForGamebox: gamebox
+                                                                               creatingIfMissing: NO
+                                                                                           error: NULL];
+            self.thumbnailCacheURL = [statesURL URLByAppendingPathComponent: BXDocumentationThumbnailCacheFolderName
+                                                                 isDirectory: YES];
+        }
+        else
+        {
+            self.thumbnailCacheURL = nil;
+        }
+        
         if (self.representedObject)
         {
             [self.representedObject addObserver: self
@@ -110,6 +134,7 @@ enum {
     
     self.documentationURLs = nil;
     self.documentationSelectionIndexes = nil;
+    self.thumbnailCacheURL = nil;
     
     [super dealloc];
 }
@@ -796,13 +821,125 @@ enum {
 
 @interface BXDocumentationItem ()
 
+//The background operation currently generating or loading a thumbnail for this item.
+@property (retain, nonatomic) NSOperation *thumbnailOperation;
+
 //Loads up the icon (or spotlight preview) for the documentation URL as it is displayed in Finder.
 - (void) _refreshIcon;
 
+//The queue on which all items generate their thumbnails.
++ (NSOperationQueue *) _thumbnailQueue;
+
+//The in-memory cache of thumbnails shared by all items, keyed by _thumbnailKeyForURL:size:.
++ (NSCache *) _thumbnails;
+
+//Returns a key identifying the thumbnail for the specified URL at the specified pixel size,
+//suitable for use as a filename. Returns nil if the file's modification date could not be read.
++ (NSString *) _thumbnailKeyForURL: (NSURL *)URL size: (NSSize)pixelSize;
+
+//Returns a thumbnail for the specified URL, loading it from the cache folder if present
+//or else generating it and saving it there. Called on the thumbnail queue.
++ (NSImage *) _thumbnailForURL: (NSURL *)URL
+                          size: (NSSize)pixelSize
+                           key: (NSString *)key
+                   cacheFolder: (NSURL *)cacheFolderURL;
+
 @end
 
 @implementation BXDocumentationItem
 @synthesize icon = _icon;
+@synthesize thumbnailOperation = _thumbnailOperation;
+
++ (NSOperationQueue *) _thumbnailQueue
+{
+    static NSOperationQueue *queue;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        queue = [[NSOperationQueue alloc] init];
+        queue.maxConcurrentOperationCount = BXDocumentationThumbnailMaxConcurrentOperations;
+    });
+    return queue;
+}
+
++ (NSCache *) _thumbnails
+{
+    static NSCache *cache;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        cache = [[NSCache alloc] init];
+        cache.name = @"BXDocumentationItem thumbnails";
+    });
+    return cache;
+}
+
++ (NSString *) _thumbnailKeyForURL: (NSURL *)URL size: (NSSize)pixelSize
+{
+    NSDate *modificationDate = nil;
+    BOOL loadedDate = [URL getResourceValue: &modificationDate
+                                     forKey: NSURLContentModificationDateKey
+                                      error: NULL];
+    
+    if (!loadedDate || !modificationDate)
+        return nil;
+    
+    //Include a hash of the full path, in case documentation in different folders shares the same name.
+    return [NSString stringWithFormat: @"%@-%08lx-%.0f-%.0fx%.0f",
+            URL.lastPathComponent,
+            (unsigned long)URL.path.hash,
+            modificationDate.timeIntervalSinceReferenceDate,
+            pixelSize.width, pixelSize.height];
+}
+
++ (NSImage *) _thumbnailForURL: (NSURL *)URL
+                          size: (NSSize)pixelSize
+                           key: (NSString *)key
+                   cacheFolder: (NSURL *)cacheFolderURL
+{
+    NSURL *cachedFileURL = [cacheFolderURL URLByAppendingPathComponent: [key stringByAppendingPathExtension: @"png"]];
+    
+    if (cachedFileURL)
+    {
+        NSImage *cachedThumbnail = [[NSImage alloc] initWithContentsOfURL: cachedFileURL];
+        if (cachedThumbnail)
+            return [cachedThumbnail autorelease];
+    }
+    
+    NSImage *thumbnail = [URL quickLookThumbnailWithMaxSize: pixelSize iconStyle: YES];
+    
+    if (thumbnail && cachedFileURL)
+    {
+        CGImageRef cgThumbnail = [thumbnail CGImageForProposedRect: NULL context: nil hints: nil];
+        if (cgThumbnail)
+        {
+            NSBitmapImageRep *rep = [[NSBitmapImageRep alloc] initWithCGImage: cgThumbnail];
+            NSData *PNGData = [rep representationUsingType: NSPNGFileType properties: nil];
+            [rep release];
+            
+            NSFileManager *manager = [[NSFileManager alloc] init];
+            [manager createDirectoryAtURL: cacheFolderURL
+              withIntermediateDirectories: YES
+                               attributes: nil
+                                    error: NULL];
+            
+            //Clear out thumbnails of older versions of the same file before saving the new one.
+            NSString *versionPrefix = [NSString stringWithFormat: @"%@-%08lx-", URL.lastPathComponent, (unsigned long)URL.path.hash];
+            NSArray *cachedFiles = [manager contentsOfDirectoryAtURL: cacheFolderURL
+                                          includingPropertiesForKeys: nil
+                                                             options: NSDirectoryEnumerationSkipsHiddenFiles
+                                                               error: NULL];
+            for (NSURL *cachedFile in cachedFiles)
+            {
+                if ([cachedFile.lastPathComponent hasPrefix: versionPrefix])
+                    [manager removeItemAtURL: cachedFile error: NULL];
+            }
+            
+            [PNGData writeToURL: cachedFileURL atomically: YES];
+            [manager release];
+        }
+    }
+    
+    return thumbnail;
+}
 
 - (void) viewDidLoad
 {
@@ -810,6 +947,15 @@ enum {
     [[self.view viewWithTag: BXDocumentationItemIcon] unregisterDraggedTypes];
 }
 
+- (void) dealloc
+{
+    [self.thumbnailOperation cancel];
+    self.thumbnailOperation = nil;
+    self.icon = nil;
+    
+    [super dealloc];
+}
+
 - (void) setRepresentedObject: representedObject
 {
     if (representedObject != self.representedObject)
@@ -821,6 +967,10 @@ enum {
 
 - (void) _refreshIcon
 {
+    //Abandon any thumbnail we were still waiting on for our previous URL.
+    [self.thumbnailOperation cancel];
+    self.thumbnailOperation = nil;
+    
     if (self.representedObject)
     {
         //Fully resolve the path of our represented URL to ensure that we grab the icon of a proper file,
@@ -838,41 +988,71 @@ enum {
             self.icon = customIcon;
             return;
         }
-        //If the file doesn't have a custom icon, then initially display the default icon for this file type
-        //while we try to load a Quick Look thumbnail for the file.
-        else
+        
+        //Take retina displays into account when calculating the appropriate preview size.
+        NSSize thumbnailSize = self.view.bounds.size;
+        if ([self.view respondsToSelector: @selector(convertSizeToBacking:)])
+            thumbnailSize = [self.view convertSizeToBacking: thumbnailSize];
+        
+        //If we've already made a thumbnail for this version of the file, use it straight away.
+        NSString *thumbnailKey = [self.class _thumbnailKeyForURL: sourceURL size: thumbnailSize];
+        NSImage *cachedThumbnail = (thumbnailKey) ? [[self.class _thumbnails] objectForKey: thumbnailKey] : nil;
+        if (cachedThumbnail)
         {
-            //First, load and display Finder's standard icon for the file.
-            NSImage *defaultIcon = nil;
-            BOOL loadedDefaultIcon = [sourceURL getResourceValue: &defaultIcon
-                                                          forKey: NSURLEffectiveIconKey
-                                                           error: NULL];
-            
-            if (loadedDefaultIcon && defaultIcon != nil)
+            self.icon = cachedThumbnail;
+            return;
+        }
+        
+        //Otherwise, initially display Finder's standard icon for the file as a placeholder
+        //while we load or generate a Quick Look thumbnail for it.
+        NSImage *defaultIcon = nil;
+        BOOL loadedDefaultIcon = [sourceURL getResourceValue: &defaultIcon
+                                                      forKey: NSURLEffectiveIconKey
+                                                       error: NULL];
+        
+        if (loadedDefaultIcon && defaultIcon != nil)
+        {
+            self.icon = defaultIcon;
+        }
+        
+        //We perform this in a background operation, because it can take a while to prepare the thumbnail.
+        //Only cache thumbnails on disk if we know what version of the file they were made from.
+        NSURL *cacheFolderURL = nil;
+        if (thumbnailKey && [self.collectionView.delegate isKindOfClass: [BXDocumentationBrowser class]])
+            cacheFolderURL = [(BXDocumentationBrowser *)self.collectionView.delegate thumbnailCacheURL];
+        
+        NSBlockOperation *operation = [[NSBlockOperation alloc] init];
+        __block NSBlockOperation *blockOperation = operation;
+        [operation addExecutionBlock: ^{
+            NSImage *thumbnail = nil;
+            if (!blockOperation.isCancelled)
             {
-                self.icon = defaultIcon;
+                thumbnail = [self.class _thumbnailForURL: sourceURL
+                                                    size: thumbnailSize
+                                                     key: thumbnailKey
+                                             cacheFolder: cacheFolderURL];
+                
+                if (thumbnail && thumbnailKey)
+                    [[self.class _thumbnails] setObject: thumbnail forKey: thumbnailKey];
             }
             
-            //Meanwhile, load in a quicklook preview for this file in the background.
-            //Take retina displays into account when calculating the appropriate preview size.
-            NSSize thumbnailSize = self.view.bounds.size;
-            if ([self.view respondsToSelector: @selector(convertSizeToBacking:)])
-                thumbnailSize = [self.view convertSizeToBacking: thumbnailSize];
-            
-            //We perform this in an asynchronous block, because it can take a while
-            //to prepare the thumbnail.
-            dispatch_queue_t queue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0);
-            dispatch_async(queue, ^{
-                NSImage *thumbnail = [sourceURL quickLookThumbnailWithMaxSize: thumbnailSize iconStyle: YES];
-                
-                //Before applying the new icon, double-check that our represented URL hasn't changed in the meantime.
-                if (thumbnail && [sourceURL isEqual: [self.representedObject URLByResolvingSymlinksInPath]])
+            //Ensure we change the icon on the main thread, where the UI is doing its thing.
+            [thumbnail retain];
+            dispatch_async(dispatch_get_main_queue(), ^{
+                //Before applying the new icon, double-check that we haven't moved on to another URL in the meantime.
+                if (self.thumbnailOperation == blockOperation)
                 {
-                    //Ensure we change the icon on the main thread, where the UI is doing its thing.
-                    [self performSelectorOnMainThread: @selector(setIcon:) withObject: thumbnail waitUntilDone: YES];
+                    if (thumbnail)
+                        self.icon = thumbnail;
+                    self.thumbnailOperation = nil;
                 }
+                [thumbnail release];
             });
-        }
+        }];
+        
+        self.thumbnailOperation = operation;
+        [[self.class _thumbnailQueue] addOperation: operation];
+        [operation release];
     }
 }
 
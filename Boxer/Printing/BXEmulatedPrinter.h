@@ -133,6 +133,13 @@ typedef enum {
 #define BXEmulatedPrinterMaxVerticalTabs 16
 #define BXEmulatedPrinterMaxHorizontalTabs 32
 
+//How many bytes of input from the parallel port can be waiting to be processed before the printer
+//reports that it's busy.
+#define BXEmulatedPrinterInputBufferSize 4096
+
+//How many printed glyphs can be held back to be drawn together before they must be drawn.
+#define BXEmulatedPrinterMaxPendingGlyphs 256
+
 
 #pragma mark -
 #pragma mark Interface declaration
@@ -153,6 +160,19 @@ typedef enum {
     BOOL _autoFeed;
     BOOL _hasReadData;
     
+    //Input is processed on a queue of its own, so that printing doesn't hold up emulation.
+    //Bytes are passed from the parallel port to the queue through a ring buffer, which only
+    //the emulation thread adds to and only the queue takes from.
+    dispatch_queue_t _printQueue;
+    uint16_t _inputBuffer[BXEmulatedPrinterInputBufferSize];
+    volatile NSUInteger _inputHead;
+    volatile NSUInteger _inputTail;
+    volatile int32_t _inputScheduled;
+    BOOL _autoFeedForInput;     //Whether auto linefeed was on when the byte being processed was sent.
+    
+    BOOL _previewUpdateScheduled;
+    BOOL _printedSincePreviewUpdate;
+    
     BOOL _expectingESCCommand;
     BOOL _expectingFSCommand;
     uint16_t _currentESCPCommand;
@@ -228,9 +248,29 @@ typedef enum {
     
     NSUInteger _densityK, _densityL, _densityY, _densityZ;
     
+    //Bitmaps printed along the current line, gathered into a 1-bit mask to be drawn in one go.
+    NSMutableData *_bandData;
+    NSSize _bandDPI;
+    NSUInteger _bandWidth, _bandHeight, _bandBytesPerRow;
+    NSUInteger _bandMinColumn, _bandMaxColumn;     //The range of columns that have been printed into.
+    double _bandY;
+    BXESCPColor _bandColor;
+    
     NSMutableDictionary *_textAttributes;
     BOOL _textAttributesNeedUpdate;
     
+    //Glyph lookups for each font used in the current session, keyed by font.
+    NSMutableDictionary *_glyphCache;
+    NSMutableData *_currentFontGlyphs;
+    BOOL _canBatchGlyphs;
+    
+    //Glyphs that have been printed in the current text style but not yet drawn,
+    //with their baseline positions in Quartz points.
+    CGGlyph _pendingGlyphs[BXEmulatedPrinterMaxPendingGlyphs];
+    CGPoint _pendingGlyphPositions[BXEmulatedPrinterMaxPendingGlyphs];
+    NSUInteger _numPendingGlyphs;
+    BOOL _pendingGlyphsDoubleStruck;
+    
     BXPrintSession *_currentSession;
 }
 
@@ -280,7 +320,8 @@ typedef enum {
 @property (assign, nonatomic) BXEmulatedPrinterPort port;
 
 //Whether the printer is currently busy and cannot respond to more data.
-//Used by the parallel connection.
+//Used by the parallel connection. This will also be YES while the printer has fallen
+//too far behind with the data it has already been sent.
 @property (assign, nonatomic, getter=isBusy) BOOL busy;
 
 //Whether the printer will automatically linefeed when inserting a CR character.
@@ -333,6 +374,9 @@ typedef enum {
 #pragma mark -
 #pragma mark Control methods
 
+//IMPLEMENTATION NOTE: the printer processes its input on a queue of its own. The methods below
+//may be called from any thread, and take effect on the queue once any input before them is done.
+
 //Resets the printer, restoring all settings to their defaults.
 - (void) reset;
 
@@ -350,6 +394,7 @@ typedef enum {
 - (void) cancelPrintSession;
 
 
+
 #pragma mark -
 #pragma mark Parallel port methods
 
@@ -358,7 +403,8 @@ typedef enum {
 //or NO subsequent times (or if no data has been sent since the printer was last reset.)
 - (BOOL) acknowledge;
 
-//Called by the parallel port subsystem to feed each byte of data to the printer.
+//Processes the specified byte of data from the parallel port. This is called on the printer's queue
+//for each byte that is strobed through the data and control registers.
 - (void) handleDataByte: (uint8_t)byte;
 
 //Called by the parallel port subsystem to set/retrieve the bits on the printer's parallel port.
@@ -376,6 +422,9 @@ typedef enum {
 
 @optional
 
+//These two are called on the printer's queue, so that the delegate can configure the printer
+//and session before printing carries on. The rest are sent on the main thread.
+
 //Called when the printer is first activated or is reset.
 //At this point all printer settings (font, page size etc.) will be reset to their defaults
 //and can be modified by the delegate if desired.
@@ -393,13 +442,14 @@ typedef enum {
 //Called when the printer begins a new page in the specified session.
 - (void) printer: (BXEmulatedPrinter *)printer didStartPageInSession: (BXPrintSession *)session;
 
-//Called every time the printer prints characters or graphics to the current page in the specified session.
+//Called periodically while the printer is printing characters or graphics to the current page in the specified session.
+//The session's page preview will have been updated beforehand.
 - (void) printer: (BXEmulatedPrinter *)printer didPrintToPageInSession: (BXPrintSession *)session;
 
 //Called when the printer finishes printing the current page in the specified session.
 - (void) printer: (BXEmulatedPrinter *)printer didFinishPageInSession: (BXPrintSession *)session;
 
-//Called when the printer moves the print head to the specified X and Y position on the current page.
+//Called periodically while the printer moves the print head, with its X and Y position on the current page.
 - (void) printer: (BXEmulatedPrinter *)printer didMoveHeadToX: (CGFloat)xOffset;
 - (void) printer: (BXEmulatedPrinter *)printer didMoveHeadToY: (CGFloat)yOffset;
 
@@ -10,6 +10,7 @@
 #import "printer_charmaps.h"
 #import "BXCoalface.h"
 #import "BXPrintSession.h"
+#import <libkern/OSAtomic.h>
 
 
 #pragma mark -
@@ -46,6 +47,15 @@ enum {
     BXEmulatedPrinterStatusMask         = 0x07,
 };
 
+//Flags stored alongside each byte in the printer's input buffer.
+enum {
+    BXEmulatedPrinterInputAutoFeed      = 1 << 8,   //Auto linefeed was on when the byte was sent.
+    BXEmulatedPrinterInputReset         = 1 << 9,   //Not a byte of data: the printer was reset at this point.
+};
+
+//How often to update the page preview and tell the delegate about printing progress, in seconds.
+#define BXEmulatedPrinterPreviewInterval 0.2
+
 //Helper macro that returns two adjacent 8-bit parameters from an array, merged into a single 16-bit parameter
 #define WIDEPARAM(p, i) (p[i] + (p[i+1] << 8))
 
@@ -59,6 +69,14 @@ enum {
 #define VERTICAL_TABS_UNDEFINED 255
 #define UNIT_SIZE_UNDEFINED -1
 
+//One entry per character in BXEmulatedPrinter's glyph cache.
+typedef struct {
+    BOOL cached;
+    unichar codepoint;  //The unicode character the glyph was looked up for.
+    CGGlyph glyph;      //The font's glyph for that character, or 0 if the font has none.
+    CGFloat advance;    //The glyph's width in points.
+} BXEmulatedPrinterGlyph;
+
 #pragma mark -
 #pragma mark Private interface declaration
 
@@ -108,6 +126,9 @@ enum {
 //Called when the DOS session first communicates the intent to print.
 - (void) _prepareForPrinting;
 
+//Does the work of resetting the printer on the print queue.
+- (void) _reset;
+
 //Called when the DOS session changes parameters for text printing.
 - (void) _updateTextAttributes;
 
@@ -128,6 +149,15 @@ enum {
 //Called when the DOS session prepares a bitmap drawing context.
 - (void) _prepareForBitmapWithDensity: (NSUInteger)density columns: (NSUInteger)numColumns;
 
+//Copies the current bitmap into the band of graphics at the current head position, drawing
+//and starting a new band first if the current band is on a different line or in a different
+//resolution or color.
+- (void) _addBitmapToBand;
+
+//Draws the band of graphics accumulated by _addBitmapToBand as a single image mask
+//into the preview and PDF contexts, and clears the band.
+- (void) _drawBitmapBand;
+
 //Draws the specified bitmap data (expected to be 8-bits-per-pixel black and white) as a bitmap image
 //into the preview and PDF contexts. This gives slightly fuzzier output than the vectorized technique
 //below, but better rendering speeds and smaller PDF filesizes.
@@ -175,6 +205,38 @@ enum {
 //Prints the specified character to the page.
 - (void) _printCharacter: (uint8_t)byte;
 
+//Returns the glyph in the current font for the specified character, looking it up if needed.
+- (const BXEmulatedPrinterGlyph *) _glyphForCharacter: (uint8_t)character;
+
+//Draws any text that has been printed but is still being held back to be drawn in one go.
+//This happens at the end of each line, whenever the text style changes and whenever the preview is updated.
+- (void) _drawPendingText;
+
+
+#pragma mark -
+#pragma mark Input queueing
+
+//Called on the emulation thread to add a byte or flag to the input buffer, and get the print queue
+//working on it if it isn't already. Waits if the buffer is full.
+- (void) _enqueueInput: (uint16_t)input;
+
+//Called on the print queue to process everything in the input buffer.
+- (void) _processInput;
+
+
+#pragma mark -
+#pragma mark Notifications
+
+//Sends the specified message to the delegate asynchronously on the main thread.
+- (void) _notifyDelegate: (void (^)(id <BXEmulatedPrinterDelegate> delegate))message;
+
+//Called whenever something is printed to the page or the print head moves.
+//Schedules a preview update if one isn't already scheduled.
+- (void) _setNeedsPreviewUpdate;
+
+//Brings the page preview up to date and tells the delegate about what's been printed since last time.
+- (void) _updatePreview;
+
 
 #pragma mark -
 #pragma mark Command handling
@@ -193,7 +255,7 @@ enum {
 #pragma mark Geometry
 
 //Move the print head to the specified X or Y offset in page coordinates.
-//This notifies the delegate that the print head has moved.
+//The delegate is told about the new position the next time the preview is updated.
 - (void) _moveHeadToX: (CGFloat)xOffset;
 - (void) _moveHeadToY: (CGFloat)yOffset;
 
@@ -268,6 +330,8 @@ enum {
         _controlRegister = BXEmulatedPrinterControlReset;
         _initialized = NO;
         
+        _printQueue = dispatch_queue_create("com.boxer.PrintQueue", DISPATCH_QUEUE_SERIAL);
+        
         //IMPLEMENTATION NOTE: we do most of our real initialization in _prepareForPrinting,
         //which is only called once printing support has actually been requested.
     }
@@ -280,6 +344,12 @@ enum {
     self.textAttributes = nil;
     self.bitmapData = nil;
     
+    [_glyphCache release], _glyphCache = nil;
+    [_currentFontGlyphs release], _currentFontGlyphs = nil;
+    [_bandData release], _bandData = nil;
+    
+    dispatch_release(_printQueue), _printQueue = NULL;
+    
     [super dealloc];
 }
 
@@ -356,9 +426,7 @@ enum {
     if (_headPosition.x != xOffset)
     {
         _headPosition.x = xOffset;
-        
-        if ([self.delegate respondsToSelector: @selector(printer:didMoveHeadToX:)])
-            [self.delegate printer: self didMoveHeadToX: xOffset];
+        [self _setNeedsPreviewUpdate];
     }
 }
 
@@ -367,10 +435,62 @@ enum {
     if (_headPosition.y != yOffset)
     {
         _headPosition.y = yOffset;
+        [self _setNeedsPreviewUpdate];
+    }
+}
+
+
+#pragma mark -
+#pragma mark Notifications
+
+- (void) _notifyDelegate: (void (^)(id <BXEmulatedPrinterDelegate> delegate))message
+{
+    dispatch_async(dispatch_get_main_queue(), ^{
+        id <BXEmulatedPrinterDelegate> delegate = self.delegate;
+        if (delegate)
+            message(delegate);
+    });
+}
+
+- (void) _setNeedsPreviewUpdate
+{
+    if (!_previewUpdateScheduled)
+    {
+        _previewUpdateScheduled = YES;
+        
+        dispatch_time_t updateTime = dispatch_time(DISPATCH_TIME_NOW, (int64_t)(BXEmulatedPrinterPreviewInterval * NSEC_PER_SEC));
+        dispatch_after(updateTime, _printQueue, ^{
+            [self _updatePreview];
+        });
+    }
+}
+
+- (void) _updatePreview
+{
+    _previewUpdateScheduled = NO;
     
-        if ([self.delegate respondsToSelector: @selector(printer:didMoveHeadToY:)])
-            [self.delegate printer: self didMoveHeadToY: yOffset];
+    BXPrintSession *session = self.currentSession;
+    BOOL printed = _printedSincePreviewUpdate && session.pageInProgress;
+    _printedSincePreviewUpdate = NO;
+    
+    if (printed)
+    {
+        [self _drawPendingText];
+        [self _drawBitmapBand];
+        [session updateCurrentPagePreview];
     }
+    
+    NSPoint headPosition = self.headPosition;
+    [self _notifyDelegate: ^(id <BXEmulatedPrinterDelegate> delegate) {
+        if ([delegate respondsToSelector: @selector(printer:didMoveHeadToX:)])
+            [delegate printer: self didMoveHeadToX: headPosition.x];
+        
+        if ([delegate respondsToSelector: @selector(printer:didMoveHeadToY:)])
+            [delegate printer: self didMoveHeadToY: headPosition.y];
+        
+        if (printed && [delegate respondsToSelector: @selector(printer:didPrintToPageInSession:)])
+            [delegate printer: self didPrintToPageInSession: session];
+    }];
 }
 
 
@@ -557,6 +677,9 @@ enum {
 
 - (void) _updateTextAttributes
 {
+    //Draw any text still waiting in the old style before we replace it.
+    [self _drawPendingText];
+    
     NSFontDescriptor *fontDescriptor = [self.class _fontDescriptorForEmulatedTypeface: self.fontTypeface
                                                                                  bold: self.bold
                                                                                italic: self.italic];
@@ -675,6 +798,21 @@ enum {
                                 forKey: NSSuperscriptAttributeName];
     }
     
+    //Text can be drawn in batches of glyphs as long as it has no styles that only AppKit knows how to draw.
+    _canBatchGlyphs = !(self.underlined || self.linethroughed || self.superscript || self.subscript);
+    
+    if (!_glyphCache)
+        _glyphCache = [[NSMutableDictionary alloc] init];
+    
+    NSMutableData *fontGlyphs = [_glyphCache objectForKey: font];
+    if (!fontGlyphs)
+    {
+        fontGlyphs = [NSMutableData dataWithLength: 256 * sizeof(BXEmulatedPrinterGlyph)];
+        [_glyphCache setObject: fontGlyphs forKey: font];
+    }
+    [_currentFontGlyphs release];
+    _currentFontGlyphs = [fontGlyphs retain];
+    
     _textAttributesNeedUpdate = NO;
 }
 
@@ -842,7 +980,7 @@ enum {
     self.defaultPageSize = NSMakeSize(8.5, 11); //US Letter paper in inches
     
     //Initialise the emulated printer settings and data structures.
-    [self resetHard];
+    [self _reset];
 }
 
 - (void) resetHard
@@ -852,6 +990,11 @@ enum {
 }
 
 - (void) reset
+{
+    [self _enqueueInput: BXEmulatedPrinterInputReset];
+}
+
+- (void) _reset
 {
     [self _endESCPCommand];
     
@@ -959,6 +1102,8 @@ enum {
 
 - (void) _startNewLine
 {
+    [self _drawPendingText];
+    
     [self _moveHeadToX: self.leftMargin];
     [self _moveHeadToY: self.headPosition.y + self.lineSpacing];
     
@@ -970,6 +1115,10 @@ enum {
 {
     self.currentSession = [[[BXPrintSession alloc] init] autorelease];
     
+    //Only keep glyph lookups for as long as a session, so that the fonts used over
+    //a long stretch of printing don't pile up.
+    [_glyphCache removeAllObjects];
+    
     if ([self.delegate respondsToSelector: @selector(printer:willBeginSession:)])
     {
         [self.delegate printer: self willBeginSession: self.currentSession];
@@ -978,33 +1127,39 @@ enum {
 
 - (void) finishPrintSession
 {
-    //Commit the current page as long as it's not entirely blank
-    [self _startNewPageWithCarriageReturn: YES discardBlankPages: YES];
-    
-    //Finalize the session
-    [self.currentSession finishSession];
-    
-    if ([self.delegate respondsToSelector: @selector(printer:didFinishSession:)])
-    {
-        [self.delegate printer: self didFinishSession: self.currentSession];
-    }
-    
-    //Clear the session altogether, so that subsequent attempts to print will create a new session.
-    self.currentSession = nil;
+    dispatch_async(_printQueue, ^{
+        //Commit the current page as long as it's not entirely blank
+        [self _startNewPageWithCarriageReturn: YES discardBlankPages: YES];
+        
+        //Finalize the session
+        BXPrintSession *session = self.currentSession;
+        [session finishSession];
+        
+        [self _notifyDelegate: ^(id <BXEmulatedPrinterDelegate> delegate) {
+            if ([delegate respondsToSelector: @selector(printer:didFinishSession:)])
+                [delegate printer: self didFinishSession: session];
+        }];
+        
+        //Clear the session altogether, so that subsequent attempts to print will create a new session.
+        self.currentSession = nil;
+    });
 }
 
 - (void) cancelPrintSession
 {
-    //Commit the current page as long as it's not entirely blank
-    [self _startNewPageWithCarriageReturn: YES discardBlankPages: YES];
-    
-    if ([self.delegate respondsToSelector: @selector(printer:didCancelSession:)])
-    {
-        [self.delegate printer: self didCancelSession: self.currentSession];
-    }
-    
-    //Discard the current session without doing anything further with it.
-    self.currentSession = nil;
+    dispatch_async(_printQueue, ^{
+        //Commit the current page as long as it's not entirely blank
+        [self _startNewPageWithCarriageReturn: YES discardBlankPages: YES];
+        
+        BXPrintSession *session = self.currentSession;
+        [self _notifyDelegate: ^(id <BXEmulatedPrinterDelegate> delegate) {
+            if ([delegate respondsToSelector: @selector(printer:didCancelSession:)])
+                [delegate printer: self didCancelSession: session];
+        }];
+        
+        //Discard the current session without doing anything further with it.
+        self.currentSession = nil;
+    });
 }
 
 - (void) _startNewPageWithCarriageReturn: (BOOL)insertCarriageReturn
@@ -1012,6 +1167,9 @@ enum {
 {
     BOOL addedPage = NO;
     
+    [self _drawPendingText];
+    [self _drawBitmapBand];
+    
     //If a page is in progress, finish it up.
     if (self.currentSession.pageInProgress)
     {
@@ -1032,8 +1190,14 @@ enum {
         addedPage = YES;
     }
     
-    if (addedPage && [self.delegate respondsToSelector: @selector(printer:didFinishPageInSession:)])
-        [self.delegate printer: self didFinishPageInSession: self.currentSession];
+    if (addedPage)
+    {
+        BXPrintSession *session = self.currentSession;
+        [self _notifyDelegate: ^(id <BXEmulatedPrinterDelegate> delegate) {
+            if ([delegate respondsToSelector: @selector(printer:didFinishPageInSession:)])
+                [delegate printer: self didFinishPageInSession: session];
+        }];
+    }
     
     //Reset the head position to the top of the next page, and optionally reset to the left margin.
     if (insertCarriageReturn)
@@ -1052,10 +1216,65 @@ enum {
     //Create a new page, if none is currently in progress.
     if (!self.currentSession.pageInProgress)
     {
-        [self.currentSession beginPageWithSize: self.pageSize];
+        BXPrintSession *session = self.currentSession;
+        [session beginPageWithSize: self.pageSize];
         
-        if ([self.delegate respondsToSelector: @selector(printer:didStartPageInSession:)])
-            [self.delegate printer: self didStartPageInSession: self.currentSession];
+        [self _notifyDelegate: ^(id <BXEmulatedPrinterDelegate> delegate) {
+            if ([delegate respondsToSelector: @selector(printer:didStartPageInSession:)])
+                [delegate printer: self didStartPageInSession: session];
+        }];
+    }
+}
+
+- (void) _enqueueInput: (uint16_t)input
+{
+    //If the print queue has fallen too far behind, wait for it to catch up.
+    //Programs that watch the busy signal will never get here, but BIOS printing ignores it.
+    while (_inputHead - _inputTail >= BXEmulatedPrinterInputBufferSize)
+        usleep(1000);
+    
+    _inputBuffer[_inputHead % BXEmulatedPrinterInputBufferSize] = input;
+    OSMemoryBarrier();
+    _inputHead++;
+    
+    if (OSAtomicCompareAndSwap32Barrier(0, 1, &_inputScheduled))
+    {
+        dispatch_async(_printQueue, ^{
+            [self _processInput];
+        });
+    }
+}
+
+- (void) _processInput
+{
+    while (YES)
+    {
+        while (_inputTail != _inputHead)
+        {
+            OSMemoryBarrier();
+            uint16_t input = _inputBuffer[_inputTail % BXEmulatedPrinterInputBufferSize];
+            OSMemoryBarrier();
+            _inputTail++;
+            
+            @autoreleasepool
+            {
+                if (input & BXEmulatedPrinterInputReset)
+                {
+                    [self _reset];
+                }
+                else
+                {
+                    _autoFeedForInput = (input & BXEmulatedPrinterInputAutoFeed) == BXEmulatedPrinterInputAutoFeed;
+                    [self handleDataByte: (uint8_t)input];
+                }
+            }
+        }
+        
+        //Let the emulation thread know it will have to get us going again for the next byte.
+        //If a byte arrived just before we did that, carry on with it ourselves instead.
+        OSAtomicCompareAndSwap32Barrier(1, 0, &_inputScheduled);
+        if (_inputTail == _inputHead || !OSAtomicCompareAndSwap32Barrier(0, 1, &_inputScheduled))
+            break;
     }
 }
 
@@ -1064,8 +1283,6 @@ enum {
     if (!_initialized)
         [self _prepareForPrinting];
     
-    _hasReadData = YES;
-    
     //For some unsupported ESC/P commands, we know ahead of time that we can ignore
     //all of the bytes making up that command.
     if (_numDataBytesToIgnore > 0)
@@ -1180,6 +1397,121 @@ enum {
     _bitmapCurrentRow = 0;
 }
 
+- (void) _addBitmapToBand
+{
+    //Bitmaps are placed on whole dots in the band, which is as precise as the printer's own head positioning.
+    NSUInteger startColumn = (NSUInteger)round(self.headPosition.x * _bitmapDPI.width);
+    
+    BOOL bandMatches = _bandData &&
+                        NSEqualSizes(_bandDPI, _bitmapDPI) &&
+                        _bandHeight == _bitmapHeight &&
+                        _bandY == self.headPosition.y &&
+                        _bandColor == self.color;
+    
+    if (!bandMatches)
+    {
+        [self _drawBitmapBand];
+        
+        _bandDPI = _bitmapDPI;
+        _bandHeight = _bitmapHeight;
+        _bandY = self.headPosition.y;
+        _bandColor = self.color;
+        _bandWidth = (NSUInteger)ceil(self.pageSize.width * _bandDPI.width);
+        _bandBytesPerRow = (_bandWidth + 7) / 8;
+        _bandMinColumn = NSUIntegerMax;
+        _bandMaxColumn = 0;
+        _bandData = [[NSMutableData alloc] initWithLength: _bandBytesPerRow * _bandHeight];
+    }
+    
+    //Anything that goes off the right edge of the page is lost.
+    NSUInteger endColumn = MIN(startColumn + _bitmapWidth, _bandWidth);
+    if (endColumn <= startColumn)
+        return;
+    
+    const uint8_t *pixels = (const uint8_t *)self.bitmapData.bytes;
+    uint8_t *bits = (uint8_t *)_bandData.mutableBytes;
+    
+    NSUInteger row, col;
+    for (row = 0; row < _bitmapHeight; row++)
+    {
+        const uint8_t *rowPixels = pixels + (row * _bitmapWidth) - startColumn;
+        uint8_t *rowBits = bits + (row * _bandBytesPerRow);
+        for (col = startColumn; col < endColumn; col++)
+        {
+            if (rowPixels[col])
+                rowBits[col / 8] |= (0x80 >> (col % 8));
+        }
+    }
+    
+    _bandMinColumn = MIN(_bandMinColumn, startColumn);
+    _bandMaxColumn = MAX(_bandMaxColumn, endColumn - 1);
+}
+
+static void _BXReleaseBandData(void *info, const void *data, size_t size)
+{
+    [(NSData *)info release];
+}
+
+- (void) _drawBitmapBand
+{
+    if (!_bandData)
+        return;
+    
+    if (_bandMinColumn <= _bandMaxColumn)
+    {
+        //Only draw the part of the band that has anything in it, rounded out to whole bytes.
+        NSUInteger firstByte = _bandMinColumn / 8;
+        NSUInteger lastByte = _bandMaxColumn / 8;
+        NSUInteger pixelWidth = (lastByte - firstByte + 1) * 8;
+        
+        //The data provider takes over our reference to the band data.
+        const uint8_t *bits = (const uint8_t *)_bandData.bytes + firstByte;
+        CGDataProviderRef provider = CGDataProviderCreateWithData(_bandData, bits, _bandData.length - firstByte, _BXReleaseBandData);
+        _bandData = nil;
+        
+        //Set bits are dots of ink: invert the mask so that those are the ones that get painted.
+        CGFloat decode[2] = { 1, 0 };
+        CGImageRef mask = CGImageMaskCreate(pixelWidth, _bandHeight, 1, 1, _bandBytesPerRow, provider, decode, NO);
+        CGDataProviderRelease(provider);
+        
+        NSPoint offset = [self convertPointFromPage: NSMakePoint(firstByte * 8 / _bandDPI.width, _bandY)];
+        CGSize maskSize = CGSizeMake(pixelWidth * 72.0 / _bandDPI.width,
+                                     _bandHeight * 72.0 / _bandDPI.height);
+        CGRect maskRect = CGRectMake(offset.x, offset.y - maskSize.height, maskSize.width, maskSize.height);
+        
+        NSColor *printColor = [self.class _colorForColorCode: _bandColor];
+        CGColorRef cgColor = CGColorCreateGenericCMYK(printColor.cyanComponent,
+                                                      printColor.magentaComponent,
+                                                      printColor.yellowComponent,
+                                                      printColor.blackComponent,
+                                                      printColor.alphaComponent);
+        
+        //Draw into the preview and PDF context in turn.
+        NSArray *contexts = [NSArray arrayWithObjects:
+                             self.currentSession.previewContext,
+                             self.currentSession.PDFContext,
+                             nil];
+        
+        for (NSGraphicsContext *context in contexts)
+        {
+            CGContextRef ctx = (CGContextRef)context.graphicsPort;
+            CGContextSaveGState(ctx);
+                CGContextSetInterpolationQuality(ctx, kCGInterpolationNone);
+                CGContextSetFillColorWithColor(ctx, cgColor);
+                CGContextDrawImage(ctx, maskRect, mask);
+            CGContextRestoreGState(ctx);
+        }
+        
+        CGColorRelease(cgColor);
+        CGImageRelease(mask);
+    }
+    else
+    {
+        [_bandData release];
+        _bandData = nil;
+    }
+}
+
 - (void) _drawImageWithBitmapData: (NSData *)bitmapData
                             width: (NSUInteger)pixelWidth
                            height: (NSUInteger)pixelHeight
@@ -1334,41 +1666,24 @@ enum {
         //Once we've got all the pixels for this image, render it into the page.
         if (_bitmapCurrentColumn >= _bitmapWidth)
         {
-            //Convert the current color into a CGColor for our draw methods to use.
-            NSColor *printColor = [self.class _colorForColorCode: self.color];
-            CGColorRef cgColor = CGColorCreateGenericCMYK(printColor.cyanComponent,
-                                                          printColor.magentaComponent,
-                                                          printColor.yellowComponent,
-                                                          printColor.blackComponent,
-                                                          printColor.alphaComponent);
-            
-            NSSize dotSize = NSMakeSize(72.0 / _bitmapDPI.width,
-                                        72.0 / _bitmapDPI.height);
-            
-            NSPoint offset = [self convertPointFromPage: self.headPosition];
-            NSSize bitmapSize = NSMakeSize(dotSize.width * _bitmapWidth,
-                                           dotSize.height * _bitmapHeight);
-            CGRect imageRect = CGRectMake(offset.x, offset.y - bitmapSize.height,
-                                          bitmapSize.width, bitmapSize.height);
-            
             [self _prepareCanvasForPrinting];
+            [self _drawPendingText];
             
-            //Draw the bitmap into our rendering contexts, either as a straight image or as a vectorised path.
-            [self _drawVectorizedBitmapData: self.bitmapData width: _bitmapWidth height: _bitmapHeight inRect: imageRect color: cgColor];
-            //[self _drawImageWithBitmapData: self.bitmapData width: _bitmapWidth height: _bitmapHeight inRect: imageRect color: cgColor];
+            //Add the bitmap to the band of graphics for the current line, which will be drawn in one go.
+            //(We used to draw each bitmap straight away with _drawVectorizedBitmapData:, but graphics-heavy
+            //pages are made up of hundreds of these and drawing each one separately got very slow.)
+            [self _addBitmapToBand];
             
             //Discard the bitmap once we're done with it
             self.bitmapData = nil;
             
-            CGColorRelease(cgColor);
-            
             //Advance the print head beyond the bitmap data
             CGFloat newX = self.headPosition.x + (_bitmapWidth * (1 / _bitmapDPI.width));
             [self _moveHeadToX: newX];
             
             //Let the context know we printed something
-            if ([self.delegate respondsToSelector: @selector(printer:didPrintToPageInSession:)])
-                [self.delegate printer: self didPrintToPageInSession: self.currentSession];
+            _printedSincePreviewUpdate = YES;
+            [self _setNeedsPreviewUpdate];
         }
         
         return YES;
@@ -1381,9 +1696,9 @@ enum {
 
 - (void) _printCharacter: (uint8_t)character
 {
-    //FIXME: this routine naively prints each glyph one by one, which prevents OSX from doing kerning or ligatures.
-    //Instead, when in proportional mode we could batch up characters into strings and print them once we hit the
-    //end of the line (or are interrupted by other commands.)
+    //FIXME: this routine positions each glyph one by one, which prevents OSX from doing kerning or ligatures.
+    //Glyphs are drawn in batches (see _drawPendingText), but in proportional mode we could go further and lay out
+    //each batch as a string.
     
     //I have no real idea why this is here, it was just in the original implementation with no explanation given.
     //Perhaps there's some DOS programs that send 1s instead of spaces??
@@ -1397,12 +1712,23 @@ enum {
     //Locate the unicode character to print
     unichar codepoint = _charMap[character];
     
-    //Construct a string for drawing the glyph and work out how big it will be rendered.
-    NSString *stringToPrint = [NSString stringWithCharacters: &codepoint length: 1];
-    NSSize stringSize = [stringToPrint sizeWithAttributes: self.textAttributes];
+    //Look up the glyph for the character in the current font and work out how big it will be rendered.
+    //If the font has no glyph for it, or the text has styles that we can't draw ourselves, we leave it
+    //to AppKit to draw as a string instead.
+    const BXEmulatedPrinterGlyph *glyph = [self _glyphForCharacter: character];
+    BOOL batchGlyph = _canBatchGlyphs && glyph->glyph != 0;
     
-    double stringWidth = stringSize.width / 72.0;
-    double descenderHeight = [[self.textAttributes objectForKey: NSFontAttributeName] descender] / 72.0;
+    NSString *stringToPrint = nil;
+    double stringWidth;
+    if (batchGlyph)
+    {
+        stringWidth = glyph->advance / 72.0;
+    }
+    else
+    {
+        stringToPrint = [NSString stringWithCharacters: &codepoint length: 1];
+        stringWidth = [stringToPrint sizeWithAttributes: self.textAttributes].width / 72.0;
+    }
     
     //If we're printing in fixed-width, work out how big a space the string should fill
     double advance = 0;
@@ -1423,39 +1749,59 @@ enum {
     //but ESC/P printers print text on a baseline that's 20/180 inch below this point
     //(regardless of the current font size.) This ensures that baselines always line
     //up regardless of font size.
-    //(Also note that we have to take the descender height into consideration because
-    //AppKit's drawAtPoint: function draws from the bottom of the descender, not the baseline.)
-    textOrigin.y += BXESCPBaselineOffset - descenderHeight;
+    textOrigin.y += BXESCPBaselineOffset;
     
     //Position the glyph in the middle of the expected character width.
     //This prevents characters in proportional-but-monospaced fonts bunching up together.
     textOrigin.x += (advance - stringWidth) * 0.5;
     
-    
-    NSPoint drawPos = [self convertPointFromPage: textOrigin];
-    
-    //Draw into the preview and PDF context in turn.
     [self _prepareCanvasForPrinting];
-    NSArray *contexts = [NSArray arrayWithObjects:
-                         self.currentSession.previewContext,
-                         self.currentSession.PDFContext,
-                         nil];
     
-    for (NSGraphicsContext *context in contexts)
+    if (batchGlyph)
     {
-        [NSGraphicsContext saveGraphicsState];
-            [NSGraphicsContext setCurrentContext: context];
+        //Hold the glyph back to be drawn along with the rest of the line.
+        if (_numPendingGlyphs >= BXEmulatedPrinterMaxPendingGlyphs || (_numPendingGlyphs && _pendingGlyphsDoubleStruck != self.doubleStrike))
+            [self _drawPendingText];
         
-            [stringToPrint drawAtPoint: drawPos
-                        withAttributes: self.textAttributes];
+        _pendingGlyphs[_numPendingGlyphs] = glyph->glyph;
+        _pendingGlyphPositions[_numPendingGlyphs] = NSPointToCGPoint([self convertPointFromPage: textOrigin]);
+        _pendingGlyphsDoubleStruck = self.doubleStrike;
+        _numPendingGlyphs++;
+    }
+    else
+    {
+        //Draw whatever came before this character first, so that overprinted text stacks up in the right order.
+        [self _drawPendingText];
         
-            //In doublestrike mode, reprint the same string shifted slightly down to 'thicken' it.
-            if (self.doubleStrike)
-            {
-                [stringToPrint drawAtPoint: NSMakePoint(drawPos.x, drawPos.y + 0.5)
+        //AppKit's drawAtPoint: function draws from the bottom of the descender, not the baseline,
+        //so we have to take the descender height into consideration.
+        double descenderHeight = [[self.textAttributes objectForKey: NSFontAttributeName] descender] / 72.0;
+        textOrigin.y -= descenderHeight;
+        
+        NSPoint drawPos = [self convertPointFromPage: textOrigin];
+        
+        //Draw into the preview and PDF context in turn.
+        NSArray *contexts = [NSArray arrayWithObjects:
+                             self.currentSession.previewContext,
+                             self.currentSession.PDFContext,
+                             nil];
+        
+        for (NSGraphicsContext *context in contexts)
+        {
+            [NSGraphicsContext saveGraphicsState];
+                [NSGraphicsContext setCurrentContext: context];
+            
+                [stringToPrint drawAtPoint: drawPos
                             withAttributes: self.textAttributes];
-            }
-        [NSGraphicsContext restoreGraphicsState];
+            
+                //In doublestrike mode, reprint the same string shifted slightly down to 'thicken' it.
+                if (self.doubleStrike)
+                {
+                    [stringToPrint drawAtPoint: NSMakePoint(drawPos.x, drawPos.y + 0.5)
+                                withAttributes: self.textAttributes];
+                }
+            [NSGraphicsContext restoreGraphicsState];
+        }
     }
     
     //Advance the head past the string.
@@ -1472,8 +1818,63 @@ enum {
         [self _moveHeadToX: newX];
     }
     
-    if ([self.delegate respondsToSelector: @selector(printer:didPrintToPageInSession:)])
-        [self.delegate printer: self didPrintToPageInSession: self.currentSession];
+    _printedSincePreviewUpdate = YES;
+    [self _setNeedsPreviewUpdate];
+}
+
+- (const BXEmulatedPrinterGlyph *) _glyphForCharacter: (uint8_t)character
+{
+    BXEmulatedPrinterGlyph *glyph = (BXEmulatedPrinterGlyph *)_currentFontGlyphs.mutableBytes + character;
+    unichar codepoint = _charMap[character];
+    
+    //The character map may have changed since we last looked this character up.
+    if (!glyph->cached || glyph->codepoint != codepoint)
+    {
+        NSFont *font = [self.textAttributes objectForKey: NSFontAttributeName];
+        CGGlyph fontGlyph = 0;
+        if (!CTFontGetGlyphsForCharacters((CTFontRef)font, &codepoint, &fontGlyph, 1))
+            fontGlyph = 0;
+        
+        glyph->cached = YES;
+        glyph->codepoint = codepoint;
+        glyph->glyph = fontGlyph;
+        glyph->advance = (fontGlyph) ? [font advancementForGlyph: fontGlyph].width : 0;
+    }
+    return glyph;
+}
+
+- (void) _drawPendingText
+{
+    if (!_numPendingGlyphs)
+        return;
+    
+    CTFontRef font = (CTFontRef)[self.textAttributes objectForKey: NSFontAttributeName];
+    CGColorRef color = [[self.textAttributes objectForKey: NSForegroundColorAttributeName] CGColor];
+    
+    //Draw into the preview and PDF context in turn.
+    NSArray *contexts = [NSArray arrayWithObjects:
+                         self.currentSession.previewContext,
+                         self.currentSession.PDFContext,
+                         nil];
+    
+    for (NSGraphicsContext *context in contexts)
+    {
+        CGContextRef ctx = (CGContextRef)context.graphicsPort;
+        CGContextSaveGState(ctx);
+            CGContextSetTextMatrix(ctx, CGAffineTransformIdentity);
+            CGContextSetFillColorWithColor(ctx, color);
+            CTFontDrawGlyphs(font, _pendingGlyphs, _pendingGlyphPositions, _numPendingGlyphs, ctx);
+        
+            //In doublestrike mode, reprint the same glyphs shifted slightly to 'thicken' them.
+            if (_pendingGlyphsDoubleStruck)
+            {
+                CGContextTranslateCTM(ctx, 0, 0.5);
+                CTFontDrawGlyphs(font, _pendingGlyphs, _pendingGlyphPositions, _numPendingGlyphs, ctx);
+            }
+        CGContextRestoreGState(ctx);
+    }
+    
+    _numPendingGlyphs = 0;
 }
 
 - (BOOL) _handleControlCharacter: (uint8_t)byte
@@ -1934,7 +2335,7 @@ enum {
             break;
             
         case '@': // Initialize printer (ESC @)
-            [self reset];
+            [self _reset];
             break;
             
         case 'A': // Set n/60-inch line spacing
@@ -2437,7 +2838,7 @@ enum {
             
         case '\r':		// Carriage Return (CR)
             [self _moveHeadToX: self.leftMargin];
-            if (!self.autoFeed)
+            if (!_autoFeedForInput)
                 return YES;
             //If autoFeed is enabled, we drop down into the next case to automatically add a line feed
             
@@ -2518,6 +2919,11 @@ enum {
     return status;
 }
 
+- (BOOL) isBusy
+{
+    return _busy || (_inputHead - _inputTail >= BXEmulatedPrinterInputBufferSize);
+}
+
 - (void) setControlRegister: (uint8_t)controlFlags
 {
     BOOL resetWasOn = (_controlRegister & BXEmulatedPrinterControlReset) == BXEmulatedPrinterControlReset;
@@ -2526,12 +2932,17 @@ enum {
         [self resetHard];
     
 	//When the strobe signal flicks on then off, read the next byte
-    //from the data register and print it.
+    //from the data register and queue it up to be printed.
     BOOL strobeWasOn = (_controlRegister & BXEmulatedPrinterControlStrobe);
     BOOL strobeIsOn = (controlFlags & BXEmulatedPrinterControlStrobe);
 	if (strobeWasOn && !strobeIsOn)
     {
-        [self handleDataByte: self.dataRegister];
+        uint16_t input = self.dataRegister;
+        if (self.autoFeed)
+            input |= BXEmulatedPrinterInputAutoFeed;
+        
+        _hasReadData = YES;
+        [self _enqueueInput: input];
 	}
     
     //CHECKME: shouldn't we toggle the auto-linefeed behaviour *before* processing the data?
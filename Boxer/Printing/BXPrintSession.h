@@ -10,6 +10,10 @@
 
 #import <Cocoa/Cocoa.h>
 
+//How many page previews a session keeps, counting the current page.
+//Older previews are discarded to keep memory use down over long print jobs.
+#define BXPrintSessionMaxPagePreviews 2
+
 @interface BXPrintSession : NSObject
 {
     BOOL _finished;
@@ -20,12 +24,12 @@
     CGContextRef _CGPDFContext;
     CGDataConsumerRef _PDFDataConsumer;
     NSGraphicsContext *_PDFContext;
-    NSMutableData *_PDFData;
+    NSURL *_PDFURL;
     
     NSMutableArray *_pagePreviews;
     NSGraphicsContext *_previewContext;
-    NSBitmapImageRep *_previewCanvas;
-    void *_previewCanvasBacking;
+    CGContextRef _previewCanvas;
+    NSSize _previewCanvasSize;
 }
 
 #pragma mark -
@@ -44,13 +48,19 @@
 //The number of pages in the session, including the current page.
 @property (readonly, nonatomic) NSUInteger numPages;
 
-//An array of NSImages containing previews of each page, including the current page.
+//An array of NSImages containing previews of the most recent pages, including the current page.
+//See BXPrintSessionMaxPagePreviews.
 @property (readonly, nonatomic) NSArray *pagePreviews;
 
-//A preview of the current page. Will be nil if no page is in progress.
+//A preview of the current page as of the last call to updateCurrentPagePreview.
+//Will be nil if no page is in progress.
 @property (readonly, nonatomic) NSImage *currentPagePreview;
 
-//An NSData object representing a PDF of the session.
+//The location of the session's PDF file. Each page is written out to the file as it is finished,
+//so that long sessions don't have to be held in memory. The file is deleted along with the session.
+@property (readonly, nonatomic) NSURL *PDFURL;
+
+//An NSData object representing a PDF of the session, mapped from PDFURL.
 //Not usable until finishSession is called.
 @property (readonly, nonatomic) NSData *PDFData;
 
@@ -66,6 +76,10 @@
 #pragma mark -
 #pragma mark Methods
 
+//A session is not thread-safe while it is being printed into: all of the methods below,
+//and drawing into the preview and PDF contexts, should be done from the same thread.
+//The preview and PDF properties above may be read from any thread.
+
 //Starts a new page with the specified page size in inches.
 //If size is equal to CGSizeZero, a default size will be used of 8.3" x 11" (i.e. Letter).
 - (void) beginPageWithSize: (NSSize)size;
@@ -76,6 +90,9 @@
 //Creates a blank page with the specified size.
 - (void) insertBlankPageWithSize: (NSSize)size;
 
+//Takes a new snapshot of the current page for currentPagePreview.
+- (void) updateCurrentPagePreview;
+
 //Finishes the current page and finalizes PDF data.
 //Must be called before PDF data can be used.
 //Once called, no further printing can be done.
@@ -15,21 +15,21 @@
 @property (assign, nonatomic) NSUInteger numPages;
 @property (retain, nonatomic) NSGraphicsContext *previewContext;
 @property (retain, nonatomic) NSGraphicsContext *PDFContext;
+@property (copy, nonatomic) NSURL *PDFURL;
 
-//Mutable internal versions of the readonly accessors we've exposed in the public API.
-@property (retain, nonatomic) NSMutableData *_mutablePDFData;
+//Mutable internal version of the readonly accessor we've exposed in the public API.
 @property (retain, nonatomic) NSMutableArray *_mutablePagePreviews;
 
-//The bitmap canvas into which to draw the current page preview.
-@property (retain, nonatomic) NSBitmapImageRep *_previewCanvas;
 
-
-//Called when the session is created to create a PDF context and data backing.
+//Called when the session is created to create a PDF context and its backing file.
 - (void) _preparePDFContext;
 
-//Called when the preview context is first accessed or the preview backing has changed,
-//to create a new bitmap context that will write to the backing.
-- (void) _preparePreviewContext;
+//Called when a page is begun, to create (or clear) a bitmap context of the specified size in pixels
+//into which to draw the page preview.
+- (void) _preparePreviewContextWithSize: (NSSize)canvasSize;
+
+//Replaces the preview of the current page with a snapshot of the preview canvas.
+- (void) _snapshotPreview;
 
 @end
 
@@ -37,8 +37,7 @@
 @implementation BXPrintSession
 @synthesize PDFContext = _PDFContext;
 @synthesize previewContext = _previewContext;
-@synthesize _previewCanvas = _previewCanvas;
-@synthesize _mutablePDFData = _PDFData;
+@synthesize PDFURL = _PDFURL;
 @synthesize _mutablePagePreviews = _pagePreviews;
 
 @synthesize pageInProgress = _pageInProgress;
@@ -65,7 +64,7 @@
         self.previewDPI = NSMakeSize(72.0, 72.0);
         
         //Create a catching array for our page previews.
-        self._mutablePagePreviews = [NSMutableArray arrayWithCapacity: 1];
+        self._mutablePagePreviews = [NSMutableArray arrayWithCapacity: BXPrintSessionMaxPagePreviews];
         
         //Create the PDF context for this session.
         [self _preparePDFContext];
@@ -76,10 +75,12 @@
 
 - (void) _preparePDFContext
 {
-    //Create a new PDF context and its associated data object,
-    //into which we shall pour PDF data from the context.
-    self._mutablePDFData = [NSMutableData data];
-    _PDFDataConsumer = CGDataConsumerCreateWithCFData((__bridge CFMutableDataRef)self._mutablePDFData);
+    //Create a new PDF context that writes into a temporary file, into which CoreGraphics
+    //will pour each page's PDF data as the page is finished.
+    NSString *fileName = [NSString stringWithFormat: @"Boxer Print Session %@.pdf", [[NSProcessInfo processInfo] globallyUniqueString]];
+    self.PDFURL = [NSURL fileURLWithPath: [NSTemporaryDirectory() stringByAppendingPathComponent: fileName]];
+    
+    _PDFDataConsumer = CGDataConsumerCreateWithURL((__bridge CFURLRef)self.PDFURL);
     _CGPDFContext = CGPDFContextCreate(_PDFDataConsumer, NULL, (__bridge CFDictionaryRef)[self.class _defaultPDFInfo]);
     
     self.PDFContext = [NSGraphicsContext graphicsContextWithGraphicsPort: _CGPDFContext
@@ -90,19 +91,45 @@
     CGContextSetBlendMode(_CGPDFContext, kCGBlendModeMultiply);
 }
 
-- (void) _preparePreviewContext
+- (void) _preparePreviewContextWithSize: (NSSize)canvasSize
 {
-    self.previewContext = [NSGraphicsContext graphicsContextWithBitmapImageRep: self._previewCanvas];
-    _previewCanvasBacking = self._previewCanvas.bitmapData;
+    //Reuse the previous page's canvas if it's the right size, rather than allocating a new one for every page.
+    if (_previewCanvas && NSEqualSizes(canvasSize, _previewCanvasSize))
+    {
+        CGContextClearRect(_previewCanvas, CGRectMake(0, 0,
+                                                      canvasSize.width * 72.0 / self.previewDPI.width,
+                                                      canvasSize.height * 72.0 / self.previewDPI.height));
+        return;
+    }
+    
+    self.previewContext = nil;
+    CGContextRelease(_previewCanvas);
+    
+    //IMPLEMENTATION NOTE: we draw into a bitmap context of our own rather than an NSBitmapImageRep,
+    //because NSBitmapImageRep may change its backing on the fly when it's displayed, and the preview
+    //is displayed on the main thread while printing carries on elsewhere.
+    CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB();
+    _previewCanvas = CGBitmapContextCreate(NULL,
+                                           (size_t)canvasSize.width,
+                                           (size_t)canvasSize.height,
+                                           8,
+                                           0,
+                                           colorSpace,
+                                           kCGImageAlphaPremultipliedLast);
+    CGColorSpaceRelease(colorSpace);
+    _previewCanvasSize = canvasSize;
+    
+    self.previewContext = [NSGraphicsContext graphicsContextWithGraphicsPort: _previewCanvas
+                                                                     flipped: NO];
     
     //While we're here, set some properties of the context.
     //Use multiply blending so that overlapping printed colors will darken each other
-    CGContextSetBlendMode((CGContextRef)(_previewContext.graphicsPort), kCGBlendModeMultiply);
+    CGContextSetBlendMode(_previewCanvas, kCGBlendModeMultiply);
     
     //If previewDPI does not match the default number of points per inch (72x72),
     //scale the context transform to compensate.
     CGPoint scale = CGPointMake(self.previewDPI.width / 72.0, self.previewDPI.height / 72.0);
-    CGContextScaleCTM((CGContextRef)(_previewContext.graphicsPort), scale.x, scale.y);
+    CGContextScaleCTM(_previewCanvas, scale.x, scale.y);
 }
 
 - (void) finishSession
@@ -113,8 +140,8 @@
     if (self.pageInProgress)
         [self finishPage];
     
-    //Tear down the PDF context. This will leave our PDF data intact,
-    //but ensures no more data can be written.
+    //Tear down the PDF context. This will write out the rest of the PDF file,
+    //and ensures no more data can be written.
     CGPDFContextClose(_CGPDFContext);
     CGContextRelease(_CGPDFContext);
     CGDataConsumerRelease(_PDFDataConsumer);
@@ -123,6 +150,11 @@
     _PDFDataConsumer = nil;
     self.PDFContext = nil;
     
+    //We're done drawing previews too.
+    self.previewContext = nil;
+    CGContextRelease(_previewCanvas);
+    _previewCanvas = NULL;
+    
     self.finished = YES;
 }
 
@@ -131,10 +163,12 @@
     if (!self.isFinished)
         [self finishSession];
     
-    self._mutablePDFData = nil;
+    //Any mapped PDFData handed out will stay readable after the file is deleted.
+    if (self.PDFURL)
+        [[NSFileManager defaultManager] removeItemAtURL: self.PDFURL error: NULL];
+    
+    self.PDFURL = nil;
     self._mutablePagePreviews = nil;
-    self._previewCanvas = nil;
-    self.previewContext = nil;
     
     [super dealloc];
 }
@@ -161,23 +195,16 @@
     NSSize canvasSize = NSMakeSize(ceil(size.width * self.previewDPI.width),
                                    ceil(size.height * self.previewDPI.height));
     
-    self._previewCanvas = [[[NSBitmapImageRep alloc] initWithBitmapDataPlanes: NULL
-                                                                   pixelsWide: canvasSize.width
-                                                                   pixelsHigh: canvasSize.height
-                                                                bitsPerSample: 8
-                                                              samplesPerPixel: 4
-                                                                     hasAlpha: YES
-                                                                     isPlanar: NO
-                                                               colorSpaceName: NSDeviceRGBColorSpace
-                                                                  bytesPerRow: 0
-                                                                 bitsPerPixel: 0] autorelease];
-    
-    //Wrap this in an NSImage so upstream contexts can display the preview easily.
-    NSImage *preview = [[[NSImage alloc] initWithSize: canvasSize] autorelease];
-    [preview addRepresentation: self._previewCanvas];
+    [self _preparePreviewContextWithSize: canvasSize];
     
-    //Add the new image into our array of page previews.
-    [self._mutablePagePreviews addObject: preview];
+    //Add a blank preview for the new page into our array of page previews,
+    //making room for it by discarding the oldest.
+    @synchronized(_pagePreviews)
+    {
+        if (_pagePreviews.count >= BXPrintSessionMaxPagePreviews)
+            [_pagePreviews removeObjectAtIndex: 0];
+        [_pagePreviews addObject: [[[NSImage alloc] initWithSize: canvasSize] autorelease]];
+    }
     
     self.pageInProgress = YES;
     self.numPages++;
@@ -187,13 +214,11 @@
 {
     NSAssert(self.pageInProgress, @"finishPage called while no page was in progress.");
     
-    //Close the page in the current PDF context.
+    //Close the page in the current PDF context: this writes the page out to the PDF file.
     CGPDFContextEndPage(_CGPDFContext);
     
-    //Tear down the current preview context.
-    self.previewContext = nil;
-    self._previewCanvas = nil;
-    _previewCanvasBacking = NULL;
+    //Keep a final preview of the page.
+    [self _snapshotPreview];
     
     self.pageInProgress = NO;
 }
@@ -204,6 +229,27 @@
     [self finishPage];
 }
 
+- (void) updateCurrentPagePreview
+{
+    if (self.pageInProgress)
+        [self _snapshotPreview];
+}
+
+- (void) _snapshotPreview
+{
+    //IMPLEMENTATION NOTE: the snapshot shares the canvas's memory until the next time
+    //we draw into the canvas, so this is cheap to do as often as previews are displayed.
+    CGImageRef snapshot = CGBitmapContextCreateImage(_previewCanvas);
+    NSImage *preview = [[NSImage alloc] initWithCGImage: snapshot size: _previewCanvasSize];
+    CGImageRelease(snapshot);
+    
+    @synchronized(_pagePreviews)
+    {
+        [_pagePreviews replaceObjectAtIndex: _pagePreviews.count - 1 withObject: preview];
+    }
+    [preview release];
+}
+
 
 #pragma mark -
 #pragma mark Property accessors
@@ -214,29 +260,23 @@
     if (!self.isFinished)
         return nil;
     
-    return self._mutablePDFData;
+    return [NSData dataWithContentsOfURL: self.PDFURL
+                                 options: NSDataReadingMappedIfSafe
+                                   error: NULL];
 }
 
 - (NSArray *) pagePreviews
 {
-    return self._mutablePagePreviews;
+    @synchronized(_pagePreviews)
+    {
+        return [[_pagePreviews copy] autorelease];
+    }
 }
 
-//Dynamically create a new preview context the first time we need one,
-//or if the backing canvas has changed location since we last checked.
 - (NSGraphicsContext *) previewContext
 {
     if (!self.pageInProgress)
-        return NULL;
-    
-    //Create a new graphics context with which we can draw into the canvas image.
-    //IMPLEMENTATION NOTE: in 10.8, NSBitmapImageRep may sometimes change its backing on the fly
-    //without telling the graphics context about it. So we also check if the backing appears to have
-    //changed since the last time and if it has, we recreate the context.
-    if (!_previewContext || _previewCanvasBacking != self._previewCanvas.bitmapData)
-    {
-        [self _preparePreviewContext];
-    }
+        return nil;
     
     return [[_previewContext retain] autorelease];
 }
@@ -244,7 +284,12 @@
 - (NSImage *) currentPagePreview
 {
     if (self.pageInProgress)
-        return self.pagePreviews.lastObject;
+    {
+        @synchronized(_pagePreviews)
+        {
+            return [[_pagePreviews.lastObject retain] autorelease];
+        }
+    }
     else
         return nil;
 }
@@ -31,6 +31,7 @@ extern NSString * const BXRendererErrorDomain;
 
 @class BXVideoFrame;
 @class ADBTexture2D;
+@class ADBShader;
 @protocol BXRendererDelegate;
 @interface BXBasicRenderer : NSObject
 {
@@ -45,6 +46,27 @@ extern NSString * const BXRendererErrorDomain;
     
 	BOOL _needsNewFrameTexture;
 	BOOL _needsFrameTextureUpdate;
+    
+    GLuint _frameUploadBuffer;
+    NSUInteger _frameTextureSequenceNumber;
+    GLenum _frameTextureMagFilter;
+    BXVideoFrame *_surfaceFrame;
+    BOOL _surfaceBindingFailed;
+    
+    //Indexed frames are uploaded into these and looked up into the frame texture
+    //by the palette shader, drawing through the palette framebuffer.
+    //Composite frames are decoded by the composite shader instead.
+    ADBTexture2D *_indexTexture;
+    ADBTexture2D *_paletteTexture;
+    ADBShader *_paletteShader;
+    ADBShader *_compositeShader;
+    GLuint _paletteFramebuffer;
+    NSUInteger _indexTextureSequenceNumber;
+    NSUInteger _paletteTextureVersion;
+    
+    //The SVGA hardware cursor is drawn over the rendered frame from this texture.
+    ADBTexture2D *_hardwareCursorTexture;
+    NSUInteger _hardwareCursorTextureVersion;
 	
 	CFAbsoluteTime _previousFrameTime;
     CFAbsoluteTime _latestFrameTimestamp;
@@ -122,6 +144,21 @@ extern NSString * const BXRendererErrorDomain;
 - (CGSize) maxFrameSize;
 
 
+#pragma mark -
+#pragma mark Releasing resources
+
+//The approximate number of bytes of texture memory that releaseCachedResources would free.
+@property (readonly) NSUInteger cachedResourceSize;
+
+//Deletes textures that are only being kept in case they are needed again.
+//Must be called with the context locked.
+- (void) releaseSpareResources;
+
+//Deletes every texture that can be rebuilt from the current frame, e.g. while nothing is being drawn.
+//They will be recreated the next time the renderer renders. Must be called with the context locked.
+- (void) releaseCachedResources;
+
+
 #pragma mark -
 #pragma mark Frame updates and rendering
 
@@ -7,6 +7,8 @@
 
 
 #import "BXBasicRendererPrivate.h"
+#import "ADBShader.h"
+#import "signposts.h"
 
 #pragma mark -
 #pragma mark Constants
@@ -28,6 +30,57 @@ GLfloat viewportVerticesFlipped[8] = {
     -1,	1
 };
 
+//Looks up each texel of an indexed frame texture in a 256x1 palette texture.
+static NSString * const BXPaletteVertexShader = @"\
+void main() {\n\
+    gl_TexCoord[0] = gl_MultiTexCoord0;\n\
+    gl_Position = ftransform();\n\
+}\n";
+
+static NSString * const BXPaletteFragmentShader = @"\
+#extension GL_ARB_texture_rectangle : enable\n\
+uniform sampler2DRect indexes;\n\
+uniform sampler2DRect palette;\n\
+void main() {\n\
+    float index = texture2DRect(indexes, gl_TexCoord[0].st).r;\n\
+    gl_FragColor = texture2DRect(palette, vec2(index * 255.0 + 0.5, 0.5));\n\
+}\n";
+
+//Decodes the raw pixel bits of a composite CGA frame as an NTSC signal, with four of the CGA's
+//pixels to each cycle of the color carrier. Luma is averaged, and chroma demodulated, over a window
+//of two carrier cycles centered on each pixel; the chroma is then rotated by the hue, and the result
+//converted from YIQ to RGB and scaled by the foreground color. This must match _BXDecodeCompositeLine
+//in BXVideoFrame, which decodes composite frames on the CPU.
+static NSString * const BXCompositeFragmentShader = @"\
+#extension GL_ARB_texture_rectangle : enable\n\
+uniform sampler2DRect indexes;\n\
+uniform float texelsPerSample;\n\
+uniform float hue;\n\
+uniform vec3 tint;\n\
+void main() {\n\
+    float n = floor(gl_TexCoord[0].s / texelsPerSample);\n\
+    float Y = 0.0, I = 0.0, Q = 0.0;\n\
+    for (float k = -4.0; k < 4.0; k += 1.0) {\n\
+        float m = n + k;\n\
+        float weight = 4.5 - abs(k + 0.5);\n\
+        float signal = step(0.5, texture2DRect(indexes, vec2((m + 0.5) * texelsPerSample, gl_TexCoord[0].t)).r * 255.0) * weight;\n\
+        float phase = mod(m, 4.0) * 1.5707963;\n\
+        Y += signal;\n\
+        I += signal * cos(phase);\n\
+        Q += signal * sin(phase);\n\
+    }\n\
+    Y /= 20.0;\n\
+    I /= 15.0;\n\
+    Q /= 15.0;\n\
+    float c = cos(hue), s = sin(hue);\n\
+    float i2 = I * c + Q * s;\n\
+    float q2 = Q * c - I * s;\n\
+    vec3 rgb = vec3(Y + 0.956 * i2 + 0.621 * q2,\n\
+                    Y - 0.272 * i2 - 0.647 * q2,\n\
+                    Y - 1.105 * i2 + 1.702 * q2);\n\
+    gl_FragColor = vec4(clamp(rgb, 0.0, 1.0) * tint, 1.0);\n\
+}\n";
+
 @implementation BXBasicRenderer
 @synthesize context = _context;
 @synthesize currentFrame = _currentFrame;
@@ -104,6 +157,56 @@ GLfloat viewportVerticesFlipped[8] = {
     glDisable(GL_FOG);
     glPixelZoom(1.0f, 1.0f);
     
+    //If available, create a pixel buffer object through which to stream
+    //changed regions of each frame into our frame texture.
+    if ([self.class context: _context supportsExtension: "GL_ARB_pixel_buffer_object"])
+    {
+        glGenBuffersARB(1, &_frameUploadBuffer);
+    }
+    
+    //If available, prepare to look up indexed frames into the frame texture on the GPU.
+    if ([self.class context: _context supportsExtension: "GL_EXT_framebuffer_object"] &&
+        [self.class context: _context supportsExtension: "GL_ARB_fragment_shader"] &&
+        [self.class context: _context supportsExtension: "GL_ARB_texture_rg"])
+    {
+        NSError *shaderError = nil;
+        _paletteShader = [[ADBShader alloc] initWithVertexShader: BXPaletteVertexShader
+                                                 fragmentShaders: @[BXPaletteFragmentShader]
+                                                       inContext: _context
+                                                           error: &shaderError];
+        if (_paletteShader)
+        {
+            glUseProgramObjectARB(_paletteShader.shaderProgram);
+            glUniform1iARB([_paletteShader locationOfUniform: "indexes"], 0);
+            glUniform1iARB([_paletteShader locationOfUniform: "palette"], 1);
+            glUseProgramObjectARB(NULL);
+            
+            glGenFramebuffersEXT(1, &_paletteFramebuffer);
+        }
+        else
+        {
+            NSLog(@"Could not compile palette shader, falling back on looking up indexed frames on the CPU: %@", shaderError);
+        }
+        
+        if (_paletteShader)
+        {
+            _compositeShader = [[ADBShader alloc] initWithVertexShader: BXPaletteVertexShader
+                                                       fragmentShaders: @[BXCompositeFragmentShader]
+                                                             inContext: _context
+                                                                 error: &shaderError];
+            if (_compositeShader)
+            {
+                glUseProgramObjectARB(_compositeShader.shaderProgram);
+                glUniform1iARB([_compositeShader locationOfUniform: "indexes"], 0);
+                glUseProgramObjectARB(NULL);
+            }
+            else
+            {
+                NSLog(@"Could not compile composite shader, falling back on decoding composite frames on the CPU: %@", shaderError);
+            }
+        }
+    }
+    
     _needsTeardown = YES;
 }
 
@@ -111,10 +214,60 @@ GLfloat viewportVerticesFlipped[8] = {
 {
     [self.frameTexture deleteTexture];
     self.frameTexture = nil;
+    [self _releaseSurfaceFrame];
+    
+    CGLContextObj cgl_ctx = _context;
+    if (_frameUploadBuffer)
+    {
+        glDeleteBuffersARB(1, &_frameUploadBuffer);
+        _frameUploadBuffer = 0;
+    }
+    
+    [_indexTexture deleteTexture];
+    [_indexTexture release], _indexTexture = nil;
+    [_paletteTexture deleteTexture];
+    [_paletteTexture release], _paletteTexture = nil;
+    [_paletteShader deleteShaderProgram];
+    [_paletteShader release], _paletteShader = nil;
+    [_compositeShader deleteShaderProgram];
+    [_compositeShader release], _compositeShader = nil;
+    [_hardwareCursorTexture deleteTexture];
+    [_hardwareCursorTexture release], _hardwareCursorTexture = nil;
+    if (_paletteFramebuffer)
+    {
+        glDeleteFramebuffersEXT(1, &_paletteFramebuffer);
+        _paletteFramebuffer = 0;
+    }
     
     _needsTeardown = NO;
 }
 
+- (NSUInteger) cachedResourceSize
+{
+    return BXTextureMemorySize(self.frameTexture) + BXTextureMemorySize(_indexTexture) + BXTextureMemorySize(_hardwareCursorTexture);
+}
+
+- (void) releaseSpareResources
+{
+    //We don't keep anything spare ourselves: this is for subclasses.
+}
+
+- (void) releaseCachedResources
+{
+    [self releaseSpareResources];
+    
+    //The frame texture will be recreated and refilled in full from the current frame next time we render.
+    [self.frameTexture deleteTexture];
+    self.frameTexture = nil;
+    [self _releaseSurfaceFrame];
+    _frameTextureSequenceNumber = 0;
+    
+    [_indexTexture deleteTexture];
+    [_indexTexture release], _indexTexture = nil;
+    [_hardwareCursorTexture deleteTexture];
+    [_hardwareCursorTexture release], _hardwareCursorTexture = nil;
+}
+
 - (void) dealloc
 {
     if (_needsTeardown)
@@ -139,14 +292,7 @@ GLfloat viewportVerticesFlipped[8] = {
 {
     BOOL needsUpdate = NO;
     if (frame != self.currentFrame)
-    {   
-        //If the current texture isn't large enough to fit the new frame,
-        //we'll need to create a new one.
-        if (![self.frameTexture canAccomodateVideoFrame: frame])
-        {
-            _needsNewFrameTexture = YES;
-        }
-        
+    {
         self.currentFrame = frame;
         needsUpdate = YES;
     }
@@ -157,15 +303,22 @@ GLfloat viewportVerticesFlipped[8] = {
     
     if (needsUpdate)
     {
+        //If the current texture isn't large enough to fit the new frame,
+        //we'll need to create a new one. (We check this even for the same frame,
+        //since pooled frames may be reshaped in place when they are recycled.)
+        //The frame texture is always BGRA, even for indexed frames.
+        if (![self.frameTexture canAccommodateContentSize: NSSizeToCGSize(frame.size)])
+        {
+            _needsNewFrameTexture = YES;
+        }
+        
         //Even if the frame hasn't changed, it may contain new data:
         //flag that we're dirty and need re-rendering.
+        //IMPLEMENTATION NOTE: we no longer upload the frame here, as this is called
+        //on the emulation thread. Frames come from BXVideoHandler's frame pool and
+        //will not be drawn into again while we're reading them, so we can safely
+        //defer the upload until it's time to render.
         _needsFrameTextureUpdate = YES;
-        
-        //TWEAK: update our frame texture immediately with the new frame, while we know
-        //we have a complete frame in the buffer. (If we defer the update until it's time
-        //to render to the screen, then we may do it while DOS is in the middle of writing
-        //to the framebuffer: resulting in a 'torn' frame.)
-        [self _prepareFrameTextureForFrame: frame];
     }
 }
 
@@ -207,11 +360,12 @@ GLfloat viewportVerticesFlipped[8] = {
 
 - (BOOL) canRender
 {
-	return self.frameTexture != nil;
+	return self.frameTexture != nil || self.currentFrame != nil;
 }
 
 - (void) render
 {
+    SignpostID signpost = SIGNPOST_Begin(SIGNPOST_RENDERER, NULL, NULL);
     CFAbsoluteTime startTime = CFAbsoluteTimeGetCurrent();
     
     BXVideoFrame *frame = self.currentFrame;
@@ -219,6 +373,7 @@ GLfloat viewportVerticesFlipped[8] = {
     [self _prepareForRenderingFrame: frame];
     [self _clearViewport];
     [self _renderFrame: frame];
+    [self _renderHardwareCursorForFrame: frame];
     
     CFAbsoluteTime endTime = CFAbsoluteTimeGetCurrent();
     
@@ -234,6 +389,8 @@ GLfloat viewportVerticesFlipped[8] = {
     }
     
     _previousFrameTime = endTime;
+    
+    SIGNPOST_End(SIGNPOST_RENDERER, signpost);
 }
 
 - (void) _prepareForRenderingFrame: (BXVideoFrame *)frame
@@ -246,6 +403,17 @@ GLfloat viewportVerticesFlipped[8] = {
     if (self.delegate)
         [self.delegate renderer: self willRenderTextureToDestinationContext: self.frameTexture];
     
+    //Aspect ratio correction is applied only here, by stretching the frame to the viewport:
+    //DOSBox never doubles up lines for it. Smooth the stretch when it's uneven.
+    GLenum magFilter = [self _shouldSmoothStretchedFrame: frame] ? GL_LINEAR : GL_NEAREST;
+    if (magFilter != _frameTextureMagFilter)
+    {
+        [self.frameTexture setMinFilter: GL_LINEAR
+                              magFilter: magFilter
+                               wrapping: GL_CLAMP_TO_EDGE];
+        _frameTextureMagFilter = magFilter;
+    }
+    
     [self _setGLViewportToRegion: self.viewport];
     [self.frameTexture drawOntoVertices: viewportVertices error: NULL];
     
@@ -253,6 +421,77 @@ GLfloat viewportVerticesFlipped[8] = {
         [self.delegate renderer: self didRenderTextureToDestinationContext: self.frameTexture];
 }
 
+- (void) _renderHardwareCursorForFrame: (BXVideoFrame *)frame
+{
+    NSData *image = frame.hardwareCursorImage;
+    NSSize resolution = frame.baseResolution;
+    if (!image || !resolution.width || !resolution.height)
+        return;
+    
+    //The cursor image only needs uploading when it has changed.
+    CGRect imageRegion = CGRectMake(0, 0, BXVideoFrameHardwareCursorSize, BXVideoFrameHardwareCursorSize);
+    if (!_hardwareCursorTexture)
+    {
+        _hardwareCursorTexture = [[ADBTexture2D alloc] initWithType: GL_TEXTURE_RECTANGLE_ARB
+                                                        contentSize: imageRegion.size
+                                                              bytes: image.bytes
+                                                        inGLContext: _context
+                                                              error: NULL];
+        
+        [_hardwareCursorTexture setMinFilter: GL_LINEAR
+                                   magFilter: GL_NEAREST
+                                    wrapping: GL_CLAMP_TO_EDGE];
+    }
+    else if (frame.hardwareCursorVersion != _hardwareCursorTextureVersion)
+    {
+        [_hardwareCursorTexture fillRegion: imageRegion withBytes: image.bytes error: NULL];
+    }
+    _hardwareCursorTextureVersion = frame.hardwareCursorVersion;
+    
+    //Map the cursor's region of the frame onto the viewport.
+    NSRect region = frame.hardwareCursorRegion;
+    GLfloat left    = (GLfloat)(-1 + (2 * NSMinX(region) / resolution.width));
+    GLfloat right   = (GLfloat)(-1 + (2 * NSMaxX(region) / resolution.width));
+    GLfloat top     = (GLfloat)(1 - (2 * NSMinY(region) / resolution.height));
+    GLfloat bottom  = (GLfloat)(1 - (2 * NSMaxY(region) / resolution.height));
+    GLfloat cursorVertices[8] = {
+        left,   top,
+        right,  top,
+        right,  bottom,
+        left,   bottom
+    };
+    
+    CGLContextObj cgl_ctx = _context;
+    
+    [self _setGLViewportToRegion: self.viewport];
+    glEnable(GL_ALPHA_TEST);
+    glEnable(GL_BLEND);
+    
+    //First invert the frame beneath the cursor's inverting pixels, which are white with no alpha.
+    //Transparent pixels are black with no alpha, so this leaves the frame beneath them alone.
+    glAlphaFunc(GL_LESS, 0.5f);
+    glBlendFunc(GL_ONE_MINUS_DST_COLOR, GL_ONE_MINUS_SRC_COLOR);
+    [_hardwareCursorTexture drawOntoVertices: cursorVertices error: NULL];
+    
+    //Then draw the cursor's opaque pixels over the top.
+    glAlphaFunc(GL_GREATER, 0.5f);
+    glBlendFunc(GL_ONE, GL_ZERO);
+    [_hardwareCursorTexture drawOntoVertices: cursorVertices error: NULL];
+    
+    glDisable(GL_BLEND);
+    glDisable(GL_ALPHA_TEST);
+}
+
+- (BOOL) _shouldSmoothStretchedFrame: (BXVideoFrame *)frame
+{
+    BOOL usesSquarePixels = (frame.intendedScale.width == 1 && frame.intendedScale.height == 1);
+    if (usesSquarePixels)
+        return NO;
+    
+    CGPoint scalingFactor = [self _scalingFactorFromFrame: frame toViewport: self.viewport];
+    return !CGPointEqualToPoint(scalingFactor, CGPointIntegral(scalingFactor));
+}
+
 - (void) _clearViewport
 {
     CGLContextObj cgl_ctx = _context;
@@ -292,37 +531,228 @@ GLfloat viewportVerticesFlipped[8] = {
     return GL_TEXTURE_RECTANGLE_ARB;
 }
 
+- (void) _releaseSurfaceFrame
+{
+    [_surfaceFrame endReading];
+    [_surfaceFrame release];
+    _surfaceFrame = nil;
+}
+
 - (void) _prepareFrameTextureForFrame: (BXVideoFrame *)frame
 {
+    if (!frame || !(!self.frameTexture || _needsNewFrameTexture || _needsFrameTextureUpdate))
+        return;
+    
+    //If the emulator has already recycled this frame to draw a new one, leave our texture
+    //as it is: the newer frame will be passed to us shortly.
+    if (![frame beginReading])
+        return;
+    
+    //If the frame is stored in an IOSurface, point our texture straight at that surface
+    //instead of uploading the frame. Only rectangle textures can do this.
+    BOOL bindsSurface = (frame.surface != NULL && self.frameTextureType == GL_TEXTURE_RECTANGLE_ARB && !_surfaceBindingFailed);
+    
+    //A texture that was bound to a surface would draw its uploads straight into that surface,
+    //so we need a fresh texture whenever we switch between the two.
+    BOOL textureIsBoundToSurface = (_surfaceFrame != nil);
+    if (bindsSurface != textureIsBoundToSurface)
+        _needsNewFrameTexture = YES;
+    
     if (!self.frameTexture || _needsNewFrameTexture)
     {
         //Clear our old frame texture straight away when replacing it,
         //so that the resources won't linger around.
         [self.frameTexture deleteTexture];
+        [self _releaseSurfaceFrame];
         
         NSError *textureError = nil;
-        self.frameTexture = [ADBTexture2D textureWithType: self.frameTextureType
-                                               videoFrame: frame
-                                              inGLContext: _context
-                                                    error: &textureError];
+        if (bindsSurface || frame.isIndexed)
+        {
+            self.frameTexture = [ADBTexture2D textureWithType: self.frameTextureType
+                                                  contentSize: NSSizeToCGSize(frame.size)
+                                                        bytes: NULL
+                                                  inGLContext: _context
+                                                        error: &textureError];
+        }
+        else
+        {
+            self.frameTexture = [ADBTexture2D textureWithType: self.frameTextureType
+                                                   videoFrame: frame
+                                                  inGLContext: _context
+                                                        error: &textureError];
+        }
         
         NSAssert1(self.frameTexture != nil, @"Texture creation failed: %@", textureError);
         
         [self.frameTexture setMinFilter: GL_LINEAR
                               magFilter: GL_NEAREST
                                wrapping: GL_CLAMP_TO_EDGE];
+        _frameTextureMagFilter = GL_NEAREST;
         
         _needsNewFrameTexture = NO;
+        //Indexed frames still need to be looked up into the new texture.
+        _needsFrameTextureUpdate = frame.isIndexed;
+    }
+    
+    if (bindsSurface)
+    {
+        if (frame != _surfaceFrame)
+        {
+            NSError *bindingError = nil;
+            if ([self.frameTexture bindToSurfaceOfVideoFrame: frame error: &bindingError])
+            {
+                //Carry on reading from the frame for as long as our texture is drawing from it,
+                //so that the emulator doesn't draw into it in the meantime: the frame pool
+                //will hand out other frames to the emulator instead.
+                [self _releaseSurfaceFrame];
+                _surfaceFrame = [frame retain];
+                [frame beginReading];
+            }
+            //If the surface couldn't be bound, go back to uploading frames for the rest
+            //of this renderer's life: starting with this one.
+            else
+            {
+                NSLog(@"Could not bind frame texture to video frame surface, falling back on uploading: %@", bindingError);
+                _surfaceBindingFailed = YES;
+                [self.frameTexture fillWithVideoFrame: frame error: NULL];
+            }
+        }
+        _needsFrameTextureUpdate = NO;
+    }
+    else if (frame.isIndexed)
+    {
+        if (_needsFrameTextureUpdate)
+            [self _fillFrameTextureWithIndexedFrame: frame];
         _needsFrameTextureUpdate = NO;
     }
     else if (_needsFrameTextureUpdate)
     {
-        [self.frameTexture fillWithVideoFrame: frame error: NULL];
+        //If our texture contains the frame immediately before this one, we only need to
+        //upload the parts of the frame that have changed. Otherwise (e.g. if we skipped
+        //rendering some frames) we have to upload the whole thing.
+        BOOL textureHasPreviousFrame = (frame.sequenceNumber > 0 && frame.sequenceNumber == _frameTextureSequenceNumber + 1);
+        if (textureHasPreviousFrame)
+        {
+            [self.frameTexture fillWithDirtyRegionsOfVideoFrame: frame
+                                               usingPixelBuffer: _frameUploadBuffer
+                                                          error: NULL];
+        }
+        else
+        {
+            [self.frameTexture fillWithVideoFrame: frame error: NULL];
+        }
         _needsFrameTextureUpdate = NO;
     }
     
-    //Record the timestamp of the frame that's currently in our texture
+    //Record the timestamp and sequence of the frame that's currently in our texture
     self.latestFrameTimestamp = frame.timestamp;
+    _frameTextureSequenceNumber = frame.sequenceNumber;
+    
+    [frame endReading];
+}
+
+- (void) _fillFrameTextureWithIndexedFrame: (BXVideoFrame *)frame
+{
+    CGRect frameRegion = CGRectMake(0, 0, frame.size.width, frame.size.height);
+    self.frameTexture.contentRegion = frameRegion;
+    
+    ADBShader *shader = frame.isComposite ? _compositeShader : _paletteShader;
+    if (!shader)
+    {
+        NSData *pixels = frame.BGRAData;
+        [self.frameTexture fillRegion: frameRegion withBytes: pixels.bytes error: NULL];
+        return;
+    }
+    
+    //Upload the indexes that have changed since the frame in our index texture,
+    //in the same way as we would for a 32-bit frame.
+    if (![_indexTexture canAccomodateVideoFrame: frame])
+    {
+        [_indexTexture deleteTexture];
+        [_indexTexture release];
+        _indexTexture = [[ADBTexture2D alloc] initWithType: GL_TEXTURE_RECTANGLE_ARB
+                                                videoFrame: frame
+                                               inGLContext: _context
+                                                     error: NULL];
+        
+        [_indexTexture setMinFilter: GL_NEAREST
+                          magFilter: GL_NEAREST
+                           wrapping: GL_CLAMP_TO_EDGE];
+    }
+    else if (frame.sequenceNumber > 0 && frame.sequenceNumber == _indexTextureSequenceNumber + 1)
+    {
+        [_indexTexture fillWithDirtyRegionsOfVideoFrame: frame
+                                       usingPixelBuffer: _frameUploadBuffer
+                                                  error: NULL];
+    }
+    else if (frame.sequenceNumber == 0 || frame.sequenceNumber != _indexTextureSequenceNumber)
+    {
+        [_indexTexture fillWithVideoFrame: frame error: NULL];
+    }
+    _indexTextureSequenceNumber = frame.sequenceNumber;
+    
+    //The palette only needs uploading when it has changed. Composite frames don't use it.
+    CGRect paletteRegion = CGRectMake(0, 0, BXVideoFramePaletteSize, 1);
+    if (frame.isComposite)
+    {
+        //Leave the palette texture as it is.
+    }
+    else if (!_paletteTexture)
+    {
+        _paletteTexture = [[ADBTexture2D alloc] initWithType: GL_TEXTURE_RECTANGLE_ARB
+                                                 contentSize: paletteRegion.size
+                                                       bytes: frame.palette
+                                                 inGLContext: _context
+                                                       error: NULL];
+        
+        [_paletteTexture setMinFilter: GL_NEAREST
+                            magFilter: GL_NEAREST
+                             wrapping: GL_CLAMP_TO_EDGE];
+    }
+    else if (frame.paletteVersion != _paletteTextureVersion)
+    {
+        [_paletteTexture fillRegion: paletteRegion withBytes: frame.palette error: NULL];
+    }
+    if (!frame.isComposite)
+        _paletteTextureVersion = frame.paletteVersion;
+    
+    //Now draw the indexes through the palette, or decode the composite signal, into the frame texture.
+    CGLContextObj cgl_ctx = _context;
+    
+    GLint originalBuffer = 0;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING_EXT, &originalBuffer);
+    
+    glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, _paletteFramebuffer);
+    [self.frameTexture bindToFrameBuffer: _paletteFramebuffer
+                              attachment: GL_COLOR_ATTACHMENT0_EXT
+                                   level: 0
+                                   error: NULL];
+    
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_RECTANGLE_ARB, _paletteTexture.texture);
+    glActiveTexture(GL_TEXTURE0);
+    
+    glUseProgramObjectARB(shader.shaderProgram);
+    if (frame.isComposite)
+    {
+        uint32_t color = frame.compositeColor;
+        CGFloat texelsPerSample = frame.size.width / MAX(frame.baseResolution.width, (CGFloat)1);
+        glUniform1fARB([shader locationOfUniform: "texelsPerSample"], (GLfloat)texelsPerSample);
+        glUniform1fARB([shader locationOfUniform: "hue"], (GLfloat)frame.compositeHue);
+        glUniform3fARB([shader locationOfUniform: "tint"],
+                       ((color >> 16) & 0xff) / 255.0f,
+                       ((color >> 8) & 0xff) / 255.0f,
+                       (color & 0xff) / 255.0f);
+    }
+    [self _setGLViewportToRegion: frameRegion];
+    [_indexTexture drawOntoVertices: viewportVerticesFlipped error: NULL];
+    glUseProgramObjectARB(NULL);
+    
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_RECTANGLE_ARB, 0);
+    glActiveTexture(GL_TEXTURE0);
+    
+    glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, originalBuffer);
 }
 
 @end
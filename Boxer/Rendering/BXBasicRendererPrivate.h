@@ -28,6 +28,12 @@
 extern GLfloat viewportVertices[8];
 extern GLfloat viewportVerticesFlipped[8];
 
+//Roughly how much video memory the specified texture takes up, assuming 4 bytes per pixel.
+static inline NSUInteger BXTextureMemorySize(ADBTexture2D *texture)
+{
+    return (NSUInteger)(texture.textureSize.width * texture.textureSize.height * 4);
+}
+
 
 @interface BXBasicRenderer ()
 
@@ -53,12 +59,30 @@ extern GLfloat viewportVerticesFlipped[8];
 - (void) _renderFrame: (BXVideoFrame *)frame;
 
 //Called by _prepareForFrame to create/recreate/populate the frame texture
-//with the specified frame as necessary.
-//This is also called earlier during updateWithFrame:, to update the texture
-//as soon as new frame data is available: this avoids frame-tearing during
-//multithreaded rendering.
+//with the specified frame as necessary. The frame is locked for reading while
+//it is uploaded, which prevents the emulator from drawing into it and tearing
+//the frame; if the emulator has already recycled the frame, the texture is
+//left untouched.
 - (void) _prepareFrameTextureForFrame: (BXVideoFrame *)frame;
 
+//Called after _renderFrame: to draw the frame's hardware cursor, if it has one, over the viewport.
+- (void) _renderHardwareCursorForFrame: (BXVideoFrame *)frame;
+
+//Called during _renderFrame: to check whether the frame texture should be drawn to the viewport
+//with linear filtering. The base implementation returns YES when the frame is being stretched
+//unevenly for aspect ratio correction, so that its rows blend evenly instead of every few rows
+//being doubled. Overridden by subclasses that take care of stretching themselves.
+- (BOOL) _shouldSmoothStretchedFrame: (BXVideoFrame *)frame;
+
+//Called by _prepareFrameTextureForFrame to fill the frame texture from an indexed frame:
+//by uploading the frame's indexes and palette and looking them up with the palette shader,
+//or by looking the frame up on the CPU and uploading the result if the context can't do that.
+- (void) _fillFrameTextureWithIndexedFrame: (BXVideoFrame *)frame;
+
+//Stops reading from the frame whose IOSurface the frame texture is bound to,
+//returning it to the emulator to draw into.
+- (void) _releaseSurfaceFrame;
+
 //Returns the horizontal and vertical scaling factors we need to apply
 //to scale the specified frame to the specified viewport.
 - (CGPoint) _scalingFactorFromFrame: (BXVideoFrame *)frame
@@ -87,6 +111,10 @@ extern GLfloat viewportVerticesFlipped[8];
 //or fall back on direct rendering.
 - (BOOL) _shouldRenderWithSupersampling;
 
+//Overridden to return NO: supersampling takes care of uneven stretching below
+//maxSupersamplingScale, and we assume stretching artifacts won't be visible above it.
+- (BOOL) _shouldSmoothStretchedFrame: (BXVideoFrame *)frame;
+
 //Prepares a framebuffer and buffer texture for the specified frame if
 //a suitable one is not already available.
 //(This also determines whether a supersampling buffer is even necessary
@@ -107,6 +135,17 @@ extern GLfloat viewportVerticesFlipped[8];
 
 - (void) _bindTextureToSupersamplingBuffer: (ADBTexture2D *)texture;
 
+//Returns a buffer texture that can accommodate the specified content size, with its content
+//region set to that size. If the specified texture is already large enough it will be returned;
+//otherwise it is returned to the pool of spare textures, and a suitable spare texture is reused
+//or a new one created.
+- (ADBTexture2D *) _bufferTextureForContentSize: (CGSize)contentSize
+                               replacingTexture: (ADBTexture2D *)texture;
+
+//Adds the specified buffer texture to the pool of spare textures, deleting the oldest spare
+//textures if this takes the pool over BXMaxSpareBufferTextureBytes.
+- (void) _recycleBufferTexture: (ADBTexture2D *)texture;
+
 @end
 
 
@@ -8,6 +8,7 @@
 //Convenience classes for Boxer's builtin shader-based renderers.
 
 #import "BXSteppedShaderRenderer.h"
+#import "BXFrameRenderingView.h"
 
 
 @interface BXBuiltinShaderRenderer : BXSteppedShaderRenderer
@@ -27,4 +28,38 @@
 //A preset renderer that applies the CRT scanlines appearance.
 @interface BXCRTRenderer : BXBuiltinShaderRenderer
 
-@end
\ No newline at end of file
+@end
+
+//A lighter-weight version of the smoothed appearance for low-spec GPUs, using an HQ2x-style shader
+//in place of DOSBox's CPU-based HQx scalers.
+@interface BXLowSpecSmoothedRenderer : BXBuiltinShaderRenderer
+
+@end
+
+//A lighter-weight version of the CRT appearance for low-spec GPUs, using a simple scanline shader
+//in place of DOSBox's CPU-based scanline scalers.
+@interface BXLowSpecCRTRenderer : BXBuiltinShaderRenderer
+
+@end
+
+
+//Renderer selection shared by BXGLRenderingView and BXRenderingLayer, so that the choice
+//of rendering backend for a given style and context is made in exactly one place.
+@interface BXBasicRenderer (BXRendererSelection)
+
+//Whether the specified context is capable enough to bother with shader-based renderers.
+//Low-end GPUs (indicated by a maximum texture size under 4096x4096) are not.
++ (BOOL) contextSupportsAdvancedRenderers: (CGLContextObj)context;
+
+//Returns the renderer classes to try for the specified rendering style in the specified context,
+//in order of preference. Later entries are increasingly simple fallbacks. Low-spec contexts
+//get lighter-weight shaders for each style, so that the emulator never has to scale frames itself.
++ (NSArray *) rendererClassesForStyle: (BXRenderingStyle)style
+                            inContext: (CGLContextObj)context;
+
+//Returns a new renderer for the specified style and context, falling back on simpler renderers
+//if the preferred one could not be created. The renderer's context will not yet be prepared.
++ (BXBasicRenderer *) rendererForStyle: (BXRenderingStyle)style
+                             inContext: (CGLContextObj)context;
+
+@end
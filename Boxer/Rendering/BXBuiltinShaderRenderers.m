@@ -6,6 +6,7 @@
  */
 
 #import "BXBuiltinShaderRenderers.h"
+#import <OpenGL/CGLMacro.h>
 
 @implementation BXBuiltinShaderRenderer
 
@@ -75,4 +76,126 @@
     return NO;
 }
 
-@end
\ No newline at end of file
+@end
+
+
+@implementation BXLowSpecSmoothedRenderer
+
+- (id) initWithContext: (CGLContextObj)glContext error: (NSError **)outError
+{
+    NSArray *shaderNames = [NSArray arrayWithObjects: @"hq2x", nil];
+    //Kicks in at the same scale as DOSBox's HQx scaler did.
+    CGFloat scales[] = { 1.1 };
+    
+    return [self initWithShaderNames: shaderNames atScales: scales inContext: glContext error: outError];
+}
+
+//Render the shader at an integer multiple of the base resolution, as DOSBox's scaler would have,
+//then scale that to the destination size.
+- (BOOL) usesShaderSupersampling
+{
+    return YES;
+}
+
+@end
+
+
+@implementation BXLowSpecCRTRenderer
+
+- (id) initWithContext: (CGLContextObj)glContext error: (NSError **)outError
+{
+    NSArray *shaderNames = [NSArray arrayWithObjects: @"scanlines", nil];
+    //Below 2x there's no room to draw distinct scanlines.
+    CGFloat scales[] = { 2.0 };
+    
+    return [self initWithShaderNames: shaderNames atScales: scales inContext: glContext error: outError];
+}
+
+//Scanlines need to land on whole pixels, so render at an integer multiple of the base resolution.
+- (BOOL) usesShaderSupersampling
+{
+    return YES;
+}
+
+@end
+
+
+@implementation BXBasicRenderer (BXRendererSelection)
+
++ (BOOL) contextSupportsAdvancedRenderers: (CGLContextObj)context
+{
+    //As a very simple test of the performance, check the GPU's maximum texture size.
+    //A low size such as 2048x2048 indicates a very low-performance GPU.
+    CGLContextObj cgl_ctx = context;
+    GLint maxTextureDims = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureDims);
+    return (maxTextureDims >= 4096);
+}
+
++ (NSArray *) rendererClassesForStyle: (BXRenderingStyle)style
+                            inContext: (CGLContextObj)context
+{
+    //On low-performance GPUs, don't bother trying the fancy shaders:
+    //use cheaper shaders that approximate the same styles instead.
+    BOOL isLowSpec = ![self contextSupportsAdvancedRenderers: context];
+    
+    Class preferredClass;
+    switch (style)
+    {
+        case BXRenderingStyleSmoothed:
+            preferredClass = (isLowSpec) ? [BXLowSpecSmoothedRenderer class] : [BXSmoothedRenderer class];
+            break;
+        case BXRenderingStyleCRT:
+            preferredClass = (isLowSpec) ? [BXLowSpecCRTRenderer class] : [BXCRTRenderer class];
+            break;
+        case BXRenderingStyleNormal:
+        default:
+            preferredClass = [BXSupersamplingRenderer class];
+            break;
+    }
+    
+    if (preferredClass == [BXSupersamplingRenderer class])
+    {
+        return @[
+                 [BXSupersamplingRenderer class],
+                 [BXBasicRenderer class],
+                 ];
+    }
+    else
+    {
+        return @[
+                 preferredClass,
+                 [BXSupersamplingRenderer class],
+                 [BXBasicRenderer class],
+                 ];
+    }
+}
+
++ (BXBasicRenderer *) rendererForStyle: (BXRenderingStyle)style
+                             inContext: (CGLContextObj)context
+{
+    //Try to load a renderer for the specified rendering style.
+    //If that fails, fall back on increasingly simple renderers until
+    //we find one that works (or run out of options.)
+    for (Class rendererClass in [self rendererClassesForStyle: style inContext: context])
+    {
+        NSError *loadError = nil;
+        BXBasicRenderer *renderer = [[[rendererClass alloc] initWithContext: context error: &loadError] autorelease];
+        
+        if (renderer)
+        {
+            renderer.tag = style;
+            return renderer;
+        }
+        else
+        {
+            NSLog(@"Error loading %@ renderer: %@", NSStringFromClass(rendererClass), loadError);
+        }
+    }
+    
+    NSAssert(NO, @"No valid renderer could be created, we're screwed!");
+    
+    return nil;
+}
+
+@end
@@ -7,14 +7,29 @@
 
 
 //BXFrameRateCounterLayer is a cheap and dirty subclass of CATextLayer to format a provided/bound
-//frame rate as a suitable string for display.
+//frame rate as a suitable string for display, along with optional frame pacing statistics.
 
 #import <QuartzCore/QuartzCore.h>
 
 @interface BXFrameRateCounterLayer : CATextLayer
 {
 	CGFloat frameRate;
+    CFTimeInterval latency;
+    CFTimeInterval frameTimeDeviation;
 }
 @property (assign, nonatomic) CGFloat frameRate;
 
+//The time between a frame being delivered and it reaching the screen.
+//Not displayed if 0.
+@property (assign, nonatomic) CFTimeInterval latency;
+
+//The standard deviation of the time between presented frames: a measure of judder.
+//Not displayed if 0.
+@property (assign, nonatomic) CFTimeInterval frameTimeDeviation;
+
+//Sets all of the above at once, updating the displayed string only once.
+- (void) setFrameRate: (CGFloat)newRate
+              latency: (CFTimeInterval)newLatency
+   frameTimeDeviation: (CFTimeInterval)newDeviation;
+
 @end
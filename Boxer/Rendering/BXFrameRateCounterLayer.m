@@ -8,13 +8,55 @@
 
 #import "BXFrameRateCounterLayer.h"
 
+@interface BXFrameRateCounterLayer ()
+
+//Regenerates the displayed string from the current statistics.
+- (void) _syncString;
+
+@end
+
 @implementation BXFrameRateCounterLayer
-@synthesize frameRate;
+@synthesize frameRate, latency, frameTimeDeviation;
 
 - (void) setFrameRate: (CGFloat)newRate
 {
 	frameRate = newRate;	
-	[self setString: [NSString stringWithFormat: @"%0.02f fps", newRate]];
+	[self _syncString];
+}
+
+- (void) setLatency: (CFTimeInterval)newLatency
+{
+    latency = newLatency;
+    [self _syncString];
+}
+
+- (void) setFrameTimeDeviation: (CFTimeInterval)newDeviation
+{
+    frameTimeDeviation = newDeviation;
+    [self _syncString];
+}
+
+- (void) setFrameRate: (CGFloat)newRate
+              latency: (CFTimeInterval)newLatency
+   frameTimeDeviation: (CFTimeInterval)newDeviation
+{
+    frameRate = newRate;
+    latency = newLatency;
+    frameTimeDeviation = newDeviation;
+    [self _syncString];
+}
+
+- (void) _syncString
+{
+    NSMutableString *string = [NSMutableString stringWithFormat: @"%0.02f fps", frameRate];
+    
+    if (latency > 0)
+        [string appendFormat: @"\n%0.01f ms latency", latency * 1000.0];
+    
+    if (frameTimeDeviation > 0)
+        [string appendFormat: @"\n%0.02f ms jitter", frameTimeDeviation * 1000.0];
+        
+	[self setString: string];
 }
 
 @end
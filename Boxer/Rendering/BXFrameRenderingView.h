@@ -70,4 +70,26 @@ typedef NS_ENUM(NSInteger, BXRenderingStyle) {
 //Called whenever the window changes color space or scaling factor.
 - (void) windowDidChangeBackingProperties: (NSNotification *)notification;
 
+//Returns how long the view took to render its most recent frame.
+- (CFTimeInterval) renderingTime;
+
+//The rate at which the emulator should run to keep its display's refresh locked to the screen's,
+//for BXEmulator's emulationRate. 1.0 if the view isn't locking to the screen refresh.
+- (double) emulationRate;
+
+//Get/set whether the view should stop redrawing altogether, e.g. while the emulator is paused.
+//Views that redraw on a timer should stop the timer while suspended, and should redraw
+//their current frame once resumed.
+- (void) setRenderingSuspended: (BOOL)suspended;
+- (BOOL) isRenderingSuspended;
+
+//Tells the view to release whatever it can rebuild later on, e.g. while its window cannot be seen.
+- (void) releaseCachedResources;
+
+//Captures the specified region of the view (in view coordinates) asynchronously, calling
+//completionHandler on a background queue with the resulting bitmap. Views that don't implement
+//this will be captured synchronously with cacheDisplayInRect:toBitmapImageRep: instead.
+- (void) captureContentsOfRect: (NSRect)rect
+             completionHandler: (void (^)(NSBitmapImageRep *bitmap))completionHandler;
+
 @end
@@ -9,4 +9,11 @@
 
 @interface BXGLRenderingView (BXImageCapture)
 
+//Captures the specified region of the view (in view coordinates) without blocking the calling thread
+//for longer than it takes to queue up the readback. The pixels are transferred out of the GPU and
+//converted into a bitmap on a background queue, then completionHandler is called on that queue
+//with the resulting bitmap. The bitmap will be black if the view has not been rendered yet.
+- (void) captureContentsOfRect: (NSRect)rect
+             completionHandler: (void (^)(NSBitmapImageRep *bitmap))completionHandler;
+
 @end
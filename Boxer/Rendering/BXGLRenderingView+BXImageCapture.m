@@ -6,6 +6,7 @@
  */
 
 #import "BXGLRenderingView+BXImageCapture.h"
+#import "BXBasicRenderer.h"
 #import <OpenGL/CGLMacro.h>
 
 @interface NSBitmapImageRep (BXFlipper)
@@ -15,6 +16,15 @@
 
 @end
 
+@interface BXGLRenderingView (BXImageCapturePrivate)
+
+//Reads the specified region of the front buffer (in backing coordinates) into the specified
+//destination, which is either a pointer into client memory or an offset into the currently-bound
+//pixel pack buffer. The caller must have locked the context.
+- (void) _readFrontBufferInRect: (NSRect)backingRect intoDestination: (GLvoid *)destination;
+
+@end
+
 @implementation BXGLRenderingView (BXImageCapture)
 
 //Replacement implementation for base method on NSView: initializes an NSBitmapImageRep
@@ -73,6 +83,100 @@
     CGLContextObj cgl_ctx = self.openGLContext.CGLContextObj;
     
     CGLLockContext(cgl_ctx);
+        [self _readFrontBufferInRect: theRect intoDestination: rep.bitmapData];
+    CGLUnlockContext(cgl_ctx);
+    
+	//Finally, flip the captured image since GL reads it in the reverse order from what we need
+	[rep flip];
+}
+
+- (void) captureContentsOfRect: (NSRect)rect
+             completionHandler: (void (^)(NSBitmapImageRep *bitmap))completionHandler
+{
+    NSBitmapImageRep *rep = [self bitmapImageRepForCachingDisplayInRect: rect];
+    
+    NSRect backingRect = rect;
+    if ([self respondsToSelector: @selector(convertRectToBacking:)])
+        backingRect = [self convertRectToBacking: backingRect];
+    backingRect = NSIntegralRect(backingRect);
+    
+    dispatch_queue_t queue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+    
+    //If we don't have a renderer yet, there's nothing to read back: see cacheDisplayInRect:toBitmapImageRep:.
+    if (!self.renderer)
+    {
+        bzero(rep.bitmapData, rep.bytesPerPlane * rep.numberOfPlanes);
+        dispatch_async(queue, ^{
+            completionHandler(rep);
+        });
+        return;
+    }
+    
+    CGLContextObj cgl_ctx = self.openGLContext.CGLContextObj;
+    
+    CGLLockContext(cgl_ctx);
+    
+    //If pixel buffers are available, have the GPU copy the front buffer into one: glReadPixels
+    //will then return immediately, instead of waiting for rendering to finish and the pixels
+    //to arrive. We wait for them on the background queue instead.
+    GLuint packBuffer = 0;
+    if ([BXBasicRenderer context: cgl_ctx supportsExtension: "GL_ARB_pixel_buffer_object"])
+    {
+        GLsizeiptrARB bufferSize = rep.bytesPerRow * rep.pixelsHigh;
+        
+        glGenBuffersARB(1, &packBuffer);
+        glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, packBuffer);
+        glBufferDataARB(GL_PIXEL_PACK_BUFFER_ARB, bufferSize, NULL, GL_STREAM_READ_ARB);
+        
+        [self _readFrontBufferInRect: backingRect intoDestination: NULL];
+        
+        glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, 0);
+        
+        //Make sure the commands are submitted before another thread waits on the results.
+        glFlush();
+    }
+    else
+    {
+        [self _readFrontBufferInRect: backingRect intoDestination: rep.bitmapData];
+    }
+    
+    //Keep the context around until we've finished with the pack buffer, even if the view
+    //discards the context in the meantime.
+    CGLRetainContext(cgl_ctx);
+    
+    CGLUnlockContext(cgl_ctx);
+    
+    dispatch_async(queue, ^{
+        if (packBuffer)
+        {
+            //Mapping the buffer will block until the GPU has finished copying into it.
+            CGLLockContext(cgl_ctx);
+                glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, packBuffer);
+                const GLvoid *pixels = glMapBufferARB(GL_PIXEL_PACK_BUFFER_ARB, GL_READ_ONLY_ARB);
+                if (pixels)
+                {
+                    memcpy(rep.bitmapData, pixels, rep.bytesPerRow * rep.pixelsHigh);
+                    glUnmapBufferARB(GL_PIXEL_PACK_BUFFER_ARB);
+                }
+                else
+                {
+                    bzero(rep.bitmapData, rep.bytesPerPlane * rep.numberOfPlanes);
+                }
+                glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, 0);
+                glDeleteBuffersARB(1, &packBuffer);
+            CGLUnlockContext(cgl_ctx);
+        }
+        CGLReleaseContext(cgl_ctx);
+        
+        [rep flip];
+        completionHandler(rep);
+    });
+}
+
+- (void) _readFrontBufferInRect: (NSRect)backingRect intoDestination: (GLvoid *)destination
+{
+    CGLContextObj cgl_ctx = self.openGLContext.CGLContextObj;
+    
     GLenum channelOrder, byteType;
     
     //Alternate implementation that renders to a renderbuffer instead of grabbing pixel
@@ -87,7 +191,7 @@
      glGenRenderbuffersEXT(1, &renderbuffer);
      glBindRenderbufferEXT(GL_RENDERBUFFER_EXT, renderbuffer);
      
-     glRenderbufferStorageEXT(GL_RENDERBUFFER_EXT, GL_RGBA8, theRect.size.width, theRect.size.height);
+     glRenderbufferStorageEXT(GL_RENDERBUFFER_EXT, GL_RGBA8, backingRect.size.width, backingRect.size.height);
      glFramebufferRenderbufferEXT(GL_FRAMEBUFFER_EXT,
      GL_COLOR_ATTACHMENT0_EXT,
      GL_RENDERBUFFER_EXT,
@@ -132,15 +236,15 @@
     channelOrder	= GL_RGBA;
     
     //Pour the data into the NSBitmapImageRep
-    glReadPixels(theRect.origin.x,
-                 theRect.origin.y,
+    glReadPixels(backingRect.origin.x,
+                 backingRect.origin.y,
                  
-                 theRect.size.width,
-                 theRect.size.height,
+                 backingRect.size.width,
+                 backingRect.size.height,
                  
                  channelOrder,
                  byteType,
-                 rep.bitmapData
+                 destination
                  );
     
     //Restore the old settings
@@ -151,10 +255,6 @@
      glDeleteRenderbuffersEXT(1, &renderbuffer);
      glDeleteFramebuffersEXT(1, &framebuffer);
      */
-    CGLUnlockContext(cgl_ctx);
-    
-	//Finally, flip the captured image since GL reads it in the reverse order from what we need
-	[rep flip];
 }
 @end
 
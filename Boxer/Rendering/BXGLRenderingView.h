@@ -13,15 +13,35 @@
 #import "BXFrameRenderingView.h"
 #import <QuartzCore/QuartzCore.h>
 #import "BXBasicRenderer.h"
+#import "BXCacheRegistry.h"
 
 @class BXBasicRenderer;
 @class ADBTexture2D;
-@interface BXGLRenderingView : NSOpenGLView <BXFrameRenderingView, BXRendererDelegate, NSAnimationDelegate>
+@class BXFrameRateCounterLayer;
+@class BXInputLatencyLayer;
+@interface BXGLRenderingView : NSOpenGLView <BXFrameRenderingView, BXRendererDelegate, NSAnimationDelegate, BXTrimmableCache>
 {
 	BXBasicRenderer *_renderer;
     BXVideoFrame *_currentFrame;
 	CVDisplayLinkRef _displayLink;
     BOOL _needsCVLinkDisplay;
+    BOOL _usesFramePacing;
+    BOOL _renderingSuspended;
+    
+    uint64_t _latestFrameHostTime;
+    uint64_t _lastPresentedFrameHostTime;
+    uint64_t _lastPresentationHostTime;
+    uint64_t _lastCounterUpdateHostTime;
+    CFTimeInterval _presentationLatency;
+    CFTimeInterval _meanFrameInterval;
+    CFTimeInterval _frameIntervalVariance;
+    BXFrameRateCounterLayer *_frameRateCounter;
+    
+    BOOL _locksEmulationToRefresh;
+    double _emulationRate;
+    double _refreshPhaseError;
+    BXInputLatencyLayer *_inputLatencyCounter;
+    
     BOOL _managesViewport;
     NSRect _viewportRect;
     NSRect _targetViewportRect;
@@ -33,8 +53,6 @@
     BOOL _inViewportAnimation;
     BOOL _inViewAnimation;
     BOOL _usesTransparentSurface;
-    
-    BOOL _isLowSpecGPU;
 }
 
 @property (retain, nonatomic) BXBasicRenderer *renderer;
@@ -44,6 +62,38 @@
 @property (assign, nonatomic) NSSize maxViewportSize;
 @property (readonly, nonatomic) NSRect viewportRect;
 
+//Whether frames are being presented directly from the display link in time with the screen
+//refresh. Controlled by the useFramePacing user default, and only available when the
+//display link is in use. In this mode only the most recent frame is presented at each
+//refresh: any frames that arrive in between are skipped rather than queued.
+@property (readonly, nonatomic) BOOL usesFramePacing;
+
+//Whether the view has stopped redrawing. While suspended, the display link is stopped
+//so that it does not wake up at every screen refresh.
+@property (assign, nonatomic, getter=isRenderingSuspended) BOOL renderingSuspended;
+
+//A running average of the time between a frame arriving from the emulator
+//and its presentation at the next screen refresh. Only measured when usesFramePacing is YES.
+@property (readonly) CFTimeInterval presentationLatency;
+
+//The standard deviation of the time between successive presented frames. Only measured
+//when usesFramePacing is YES. Large values indicate uneven presentation (judder.)
+@property (readonly) CFTimeInterval frameTimeDeviation;
+
+//The rate at which the emulator should run to lock the emulated display's refresh to the screen's,
+//for BXEmulator's emulationRate. Only calculated when usesFramePacing and the syncEmulationToDisplay
+//user default are both enabled, and when the emulated refresh rate is within BXEmulatorMaxRateDeviation
+//of a whole number of screen refreshes; otherwise this is 1.0.
+@property (readonly) double emulationRate;
+
+//If set, this layer will be periodically updated with the view's frame rate
+//and frame pacing statistics.
+@property (retain, nonatomic) BXFrameRateCounterLayer *frameRateCounter;
+
+//If set, this layer will be periodically updated with the input latency statistics
+//of the current input latency recorder, if one is running.
+@property (retain, nonatomic) BXInputLatencyLayer *inputLatencyCounter;
+
 
 //Returns the rectangular region of the view into which the specified frame will be drawn.
 //This will be equal to the view bounds if managesAspectRatio is NO; otherwise, it will
@@ -9,12 +9,30 @@
 #import "BXGLRenderingView.h"
 #import "BXBuiltinShaderRenderers.h"
 #import "ADBTexture2D.h"
+#import "ADBShader.h"
 #import "BXVideoFrame.h"
 #import "ADBGeometry.h"
 #import "ADBGLHelpers.h"
+#import "BXFrameRateCounterLayer.h"
+#import "BXInputLatencyLayer.h"
+#import "BXInputLatencyRecorder.h"
+#import "BXEmulator.h"
 
 #import <OpenGL/CGLMacro.h>
 
+
+//How heavily each new sample is weighted in the running frame pacing statistics.
+#define BXFramePacingStatisticsWeight 0.05
+
+//How often to refresh the frame rate counter, in seconds.
+#define BXFrameRateCounterUpdateInterval 0.5
+
+//How strongly the emulation rate is nudged to steer frames toward arriving midway between
+//screen refreshes, per refresh period of phase error. Small enough that the correction
+//never makes up more than a fraction of BXEmulatorMaxRateDeviation.
+#define BXRefreshLockPhaseGain 0.002
+
+
 #pragma mark -
 #pragma mark Private interface declarations
 
@@ -34,6 +52,146 @@
 
 
 //The display link callback that renders the next frame in sync with the screen refresh.
+- (void) _presentLatestFrameForOutputTime: (const CVTimeStamp *)outputTime
+{
+    if (!self.needsCVLinkDisplay || self.inViewAnimation)
+        return;
+    
+    CGLContextObj cgl_ctx = self.openGLContext.CGLContextObj;
+    
+    CGLLockContext(cgl_ctx);
+    
+        if (_needsRendererUpdate)
+        {
+            self.renderer = [self rendererForStyle: self.renderingStyle inContext: cgl_ctx];
+            _needsRendererUpdate = NO;
+        }
+    
+        if ([self.renderer canRender])
+        {
+            self.needsCVLinkDisplay = NO;
+            
+            //Rendering now, rather than marking the view as needing display, means the frame
+            //is ready for the refresh the display link is preparing us for; the flush will then
+            //block until that refresh if swaps are synced to it.
+            [self.renderer render];
+            CGLFlushDrawable(cgl_ctx);
+            BXInputLatencyMarkFrame(BXInputLatencyPresented, self.currentFrame.timestamp);
+            
+            //Redraws of a frame we've already presented (e.g. after a viewport change)
+            //don't count toward the statistics.
+            if (_latestFrameHostTime != _lastPresentedFrameHostTime)
+            {
+                [self _recordPresentationOfFrameAtHostTime: _latestFrameHostTime
+                                       presentedAtHostTime: outputTime->hostTime];
+                _lastPresentedFrameHostTime = _latestFrameHostTime;
+            }
+        }
+    
+    CGLUnlockContext(cgl_ctx);
+}
+
+- (void) _recordPresentationOfFrameAtHostTime: (uint64_t)frameTime
+                         presentedAtHostTime: (uint64_t)presentationTime
+{
+    double hostFrequency = CVGetHostClockFrequency();
+    double weight = BXFramePacingStatisticsWeight;
+    
+    if (presentationTime > frameTime)
+    {
+        CFTimeInterval latency = (presentationTime - frameTime) / hostFrequency;
+        if (_presentationLatency > 0)
+            _presentationLatency += weight * (latency - _presentationLatency);
+        else
+            _presentationLatency = latency;
+        
+        if (_locksEmulationToRefresh)
+            [self _lockEmulationToRefreshWithLatency: latency];
+    }
+    
+    //Track a running mean and variance of the interval between presented frames.
+    if (_lastPresentationHostTime && presentationTime > _lastPresentationHostTime)
+    {
+        CFTimeInterval interval = (presentationTime - _lastPresentationHostTime) / hostFrequency;
+        if (_meanFrameInterval > 0)
+        {
+            CFTimeInterval delta = interval - _meanFrameInterval;
+            _meanFrameInterval += weight * delta;
+            _frameIntervalVariance = (1 - weight) * (_frameIntervalVariance + (weight * delta * delta));
+        }
+        else
+        {
+            _meanFrameInterval = interval;
+        }
+    }
+    _lastPresentationHostTime = presentationTime;
+    
+    if (self.frameRateCounter || self.inputLatencyCounter)
+    {
+        uint64_t counterInterval = (uint64_t)(BXFrameRateCounterUpdateInterval * hostFrequency);
+        if (presentationTime > _lastCounterUpdateHostTime + counterInterval)
+        {
+            _lastCounterUpdateHostTime = presentationTime;
+            [self performSelectorOnMainThread: @selector(_updateFrameRateCounter)
+                                   withObject: nil
+                                waitUntilDone: NO];
+        }
+    }
+}
+
+- (double) emulationRate
+{
+    if (_locksEmulationToRefresh && _emulationRate > 0)
+        return _emulationRate;
+    else
+        return 1.0;
+}
+
+- (void) _lockEmulationToRefreshWithLatency: (CFTimeInterval)latency
+{
+    CFTimeInterval refreshPeriod = CVDisplayLinkGetActualOutputVideoRefreshPeriod(_displayLink);
+    CGFloat emulatedRefreshRate = self.currentFrame.refreshRate;
+    if (refreshPeriod <= 0 || emulatedRefreshRate <= 0)
+    {
+        _emulationRate = 1.0;
+        return;
+    }
+    
+    //Work out how many screen refreshes each emulated frame should last, and how much emulated
+    //time would have to be warped for it to last exactly that long. If that's too much warping
+    //to get away with, leave the emulated refresh to drift against the screen's as normal.
+    CFTimeInterval framePeriod = 1.0 / emulatedRefreshRate;
+    double refreshesPerFrame = MAX(1.0, round(framePeriod / refreshPeriod));
+    double lockedRate = framePeriod / (refreshesPerFrame * refreshPeriod);
+    if (fabs(lockedRate - 1.0) > BXEmulatorMaxRateDeviation)
+    {
+        _emulationRate = 1.0;
+        return;
+    }
+    
+    //Matching rates alone would leave frames arriving wherever they happened to start out:
+    //if that's right on a refresh, timing jitter would still make frames miss it or double up.
+    //So steer frames toward arriving midway between refreshes. A frame that waited more than half
+    //a refresh arrived early, so emulation slows slightly to make the next one later, and vice versa.
+    double phaseError = (fmod(latency, refreshPeriod) / refreshPeriod) - 0.5;
+    _refreshPhaseError += BXFramePacingStatisticsWeight * (phaseError - _refreshPhaseError);
+    _emulationRate = lockedRate * (1.0 - (BXRefreshLockPhaseGain * _refreshPhaseError));
+}
+
+- (CFTimeInterval) frameTimeDeviation
+{
+    return sqrt(_frameIntervalVariance);
+}
+
+- (void) _updateFrameRateCounter
+{
+    [self.frameRateCounter setFrameRate: self.renderer.frameRate
+                                latency: self.presentationLatency
+                     frameTimeDeviation: self.frameTimeDeviation];
+    
+    [self.inputLatencyCounter refresh];
+}
+
 CVReturn BXDisplayLinkCallback(CVDisplayLinkRef displayLink,
                                const CVTimeStamp* now,  
                                const CVTimeStamp* outputTime,
@@ -48,6 +206,24 @@ CVReturn BXDisplayLinkCallback(CVDisplayLinkRef displayLink,
 //Called when a live resize or other animation ends, to recaculate with the final state of the viewport. 
 - (void) _finalizeViewportChanges;
 
+//Called from the display link when frame pacing is enabled, to render and flush the current frame
+//in time for the refresh at the specified output time. Does nothing if no new frame has arrived
+//since the last refresh.
+- (void) _presentLatestFrameForOutputTime: (const CVTimeStamp *)outputTime;
+
+//Updates the frame pacing statistics after presenting a frame that arrived at frameTime
+//for the screen refresh at presentationTime. Both times are in host time units.
+- (void) _recordPresentationOfFrameAtHostTime: (uint64_t)frameTime
+                         presentedAtHostTime: (uint64_t)presentationTime;
+
+//Pushes the latest frame and input latency statistics to our counters, if we have them.
+//Must be called on the main thread.
+- (void) _updateFrameRateCounter;
+
+//Called after presenting each frame when locking emulation to the screen refresh,
+//to recalculate emulationRate from how long the frame waited to be presented.
+- (void) _lockEmulationToRefreshWithLatency: (CFTimeInterval)latency;
+
 @end
 
 
@@ -60,11 +236,20 @@ CVReturn BXDisplayLinkCallback(CVDisplayLinkRef displayLink,
 @synthesize maxViewportSize = _maxViewportSize;
 @synthesize renderingStyle = _renderingStyle;
 @synthesize inViewAnimation = _inViewAnimation;
+@synthesize usesFramePacing = _usesFramePacing;
+@synthesize renderingSuspended = _renderingSuspended;
+@synthesize presentationLatency = _presentationLatency;
+@synthesize frameRateCounter = _frameRateCounter;
+@synthesize inputLatencyCounter = _inputLatencyCounter;
 
 - (void) dealloc
 {
+    [[BXCacheRegistry sharedRegistry] unregisterCache: self];
+    
     self.currentFrame = nil;
     self.renderer = nil;
+    self.frameRateCounter = nil;
+    self.inputLatencyCounter = nil;
 	[super dealloc];
 }
 
@@ -78,64 +263,9 @@ CVReturn BXDisplayLinkCallback(CVDisplayLinkRef displayLink,
 #pragma mark -
 #pragma mark Rendering methods
 
-- (Class) rendererClassForStyle: (BXRenderingStyle)style
-{
-    Class rendererClass;
-    switch (style)
-    {
-        case BXRenderingStyleSmoothed:
-            rendererClass = [BXSmoothedRenderer class];
-            break;
-        case BXRenderingStyleCRT:
-            rendererClass = [BXCRTRenderer class];
-            break;
-        case BXRenderingStyleNormal:
-        default:
-            rendererClass = [BXSupersamplingRenderer class];
-            break;
-    }
-    return rendererClass;
-}
-
 - (BXBasicRenderer *) rendererForStyle: (BXRenderingStyle)style inContext: (CGLContextObj)context
 {
-    //Try to load a renderer for the specified rendering style.
-    //If that fails, fall back on increasingly simple renderers until
-    //we find one that works (or run out of options.)
-    NSArray *renderersToTry;
-    
-    //On low-performance GPUs, don't even bother trying a fancy renderer:
-    //just stick with our standard renderers.
-    if (_isLowSpecGPU)
-    {
-        renderersToTry = [NSArray arrayWithObjects:
-                          [BXSupersamplingRenderer class],
-                          [BXBasicRenderer class],
-                          nil];
-    }
-    else
-    {
-        renderersToTry = [NSArray arrayWithObjects:
-                          [self rendererClassForStyle: style],
-                          [BXSupersamplingRenderer class],
-                          [BXBasicRenderer class],
-                          nil];
-    }
-    
-    
-    for (Class rendererClass in renderersToTry)
-    {
-        NSError *loadError = nil;
-        BXBasicRenderer *renderer = [[[rendererClass alloc] initWithContext: context error: &loadError] autorelease];
-        if (renderer)
-            return renderer;
-        else
-            NSLog(@"Error loading %@ renderer: %@", NSStringFromClass(rendererClass), loadError);
-    }
-    
-    NSAssert(NO, @"No valid renderer could be created, we're screwed!");
-    
-    return nil;
+    return [BXBasicRenderer rendererForStyle: style inContext: context];
 }
 
 - (void) updateWithFrame: (BXVideoFrame *)frame
@@ -145,6 +275,7 @@ CVReturn BXDisplayLinkCallback(CVDisplayLinkRef displayLink,
     CGLContextObj cgl_ctx = self.openGLContext.CGLContextObj;
     CGLLockContext(cgl_ctx);
         [self.renderer updateWithFrame: frame];
+        _latestFrameHostTime = CVGetCurrentHostTime();
     CGLUnlockContext(cgl_ctx);
     
     //If the frame changes size or aspect ratio, and we're responsible for the viewport ourselves,
@@ -165,6 +296,76 @@ CVReturn BXDisplayLinkCallback(CVDisplayLinkRef displayLink,
 }
 
 
+- (void) setRenderingSuspended: (BOOL)suspended
+{
+    if (suspended != _renderingSuspended)
+    {
+        _renderingSuspended = suspended;
+        
+        if (_displayLink)
+        {
+            if (suspended)
+            {
+                CVDisplayLinkStop(_displayLink);
+            }
+            else
+            {
+                //Don't count the time we were suspended towards the frame pacing statistics.
+                _lastPresentationHostTime = 0;
+                self.needsCVLinkDisplay = YES;
+                CVDisplayLinkStart(_displayLink);
+            }
+        }
+        else if (!suspended)
+        {
+            self.needsDisplay = YES;
+        }
+    }
+}
+
+
+#pragma mark -
+#pragma mark Releasing resources
+
+- (void) releaseCachedResources
+{
+    CGLContextObj cgl_ctx = self.openGLContext.CGLContextObj;
+    CGLLockContext(cgl_ctx);
+        [self.renderer releaseCachedResources];
+    CGLUnlockContext(cgl_ctx);
+}
+
+- (NSUInteger) cacheSize
+{
+    CGLContextObj cgl_ctx = self.openGLContext.CGLContextObj;
+    CGLLockContext(cgl_ctx);
+        NSUInteger size = self.renderer.cachedResourceSize;
+    CGLUnlockContext(cgl_ctx);
+    return size;
+}
+
+- (void) trimCacheToLevel: (BXCacheTrimLevel)level
+{
+    CGLContextObj cgl_ctx = self.openGLContext.CGLContextObj;
+    CGLLockContext(cgl_ctx);
+        if (level == BXCacheTrimAll)
+            [self.renderer releaseCachedResources];
+        else
+            [self.renderer releaseSpareResources];
+    CGLUnlockContext(cgl_ctx);
+    
+    //Redraw straight away if we're on screen, rather than showing an empty frame until the next one arrives.
+    if (level == BXCacheTrimAll && !self.isRenderingSuspended)
+    {
+        if (_displayLink)
+            self.needsCVLinkDisplay = YES;
+        else
+            dispatch_async(dispatch_get_main_queue(), ^{
+                self.needsDisplay = YES;
+            });
+    }
+}
+
 + (id) defaultAnimationForKey: (NSString *)key
 {
     if ([key isEqualToString: @"viewportRect"])
@@ -313,6 +514,11 @@ CVReturn BXDisplayLinkCallback(CVDisplayLinkRef displayLink,
 	return NSSizeFromCGSize(self.renderer.maxFrameSize);
 }
 
+- (CFTimeInterval) renderingTime
+{
+    return self.renderer.renderingTime;
+}
+
 - (void) setRenderingStyle: (BXRenderingStyle)renderingStyle
 {
     NSAssert1(renderingStyle >= 0 && renderingStyle < BXNumRenderingStyles,
@@ -335,12 +541,11 @@ CVReturn BXDisplayLinkCallback(CVDisplayLinkRef displayLink,
     }
 }
 
+//Every style is rendered on the GPU: low-spec GPUs get lighter-weight shaders for each style
+//(see BXBasicRenderer rendererClassesForStyle:inContext:) instead of DOSBox's CPU scalers.
 - (BOOL) supportsRenderingStyle: (BXRenderingStyle)style
 {
-    if (style == BXRenderingStyleNormal)
-        return YES;
-    else
-        return !_isLowSpecGPU;
+    return YES;
 }
 
 
@@ -391,20 +596,15 @@ CVReturn BXDisplayLinkCallback(CVDisplayLinkRef displayLink,
     [self.openGLContext setValues: &useVSync
                      forParameter: NSOpenGLCPSwapInterval];
 	
-    //As a very simple test of the performance, check the GPU's maximum texture size.
-    //A low size such as 2048x2048 indicates a very low-performance GPU.
-    
-    GLint maxTextureDims = 0;
-    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureDims);
-    _isLowSpecGPU = (maxTextureDims < 4096);
-    
     //Create a new renderer for this context, and set it up appropriately
     self.renderer = [self rendererForStyle: self.renderingStyle
                                  inContext: cgl_ctx];
     
-    //Set up the CV display link if desired
+    //Set up the CV display link if desired. Frame pacing relies on the display link,
+    //so we'll need one if that's enabled too.
+    BOOL useFramePacing = [[NSUserDefaults standardUserDefaults] boolForKey: @"useFramePacing"];
     BOOL useCVDisplayLink = [[NSUserDefaults standardUserDefaults] boolForKey: @"useCVDisplayLink"];
-    if (useCVDisplayLink)
+    if (useCVDisplayLink || useFramePacing)
     {
         //Create a display link capable of being used with all active displays
         CVReturn status = CVDisplayLinkCreateWithActiveCGDisplays(&_displayLink);
@@ -418,24 +618,45 @@ CVReturn BXDisplayLinkCallback(CVDisplayLinkRef displayLink,
             CGLPixelFormatObj cglPixelFormat = self.pixelFormat.CGLPixelFormatObj;
             CVDisplayLinkSetCurrentCGDisplayFromOpenGLContext(_displayLink, cgl_ctx, cglPixelFormat);
             
-            //Activate the display link
-            CVDisplayLinkStart(_displayLink);
+            _usesFramePacing = useFramePacing;
+            _lastPresentationHostTime = 0;
+            
+            //Locking the emulated refresh to the screen's relies on frame pacing
+            //to present each frame at the refresh it was meant for.
+            _locksEmulationToRefresh = useFramePacing && [[NSUserDefaults standardUserDefaults] boolForKey: @"syncEmulationToDisplay"];
+            _refreshPhaseError = 0;
+            _emulationRate = 1.0;
+            
+            //Activate the display link, unless we're not meant to be drawing yet.
+            if (!self.isRenderingSuspended)
+                CVDisplayLinkStart(_displayLink);
         }
     }
     
     CGLUnlockContext(cgl_ctx);
+    
+    //Our renderer's textures are cheap to rebuild, so let them go first when memory runs short.
+    [[BXCacheRegistry sharedRegistry] registerCache: self withPriority: BXCachePriorityLow];
 }
 
 - (void) clearGLContext
 {
+    [[BXCacheRegistry sharedRegistry] unregisterCache: self];
+    
     //Get rid of our entire renderer when the context changes.
     self.renderer = nil;
     
+    //Any shader programs compiled in the old context go with it.
+    if (self.openGLContext)
+        [ADBShader purgeCachedProgramsInContext: self.openGLContext.CGLContextObj];
+    
 	if (_displayLink)
 	{
 		CVDisplayLinkRelease(_displayLink);
 		_displayLink = NULL;
 	}
+    _usesFramePacing = NO;
+    _locksEmulationToRefresh = NO;
     	
 	[super clearGLContext];
 }
@@ -525,6 +746,7 @@ CVReturn BXDisplayLinkCallback(CVDisplayLinkRef displayLink,
             
             [self.renderer render];
             CGLFlushDrawable(cgl_ctx);
+            BXInputLatencyMarkFrame(BXInputLatencyPresented, self.currentFrame.timestamp);
         
         CGLUnlockContext(cgl_ctx);
     }
@@ -552,7 +774,9 @@ CVReturn BXDisplayLinkCallback(CVDisplayLinkRef displayLink,
 	
 	BXGLRenderingView *view = (__bridge BXGLRenderingView *)displayLinkContext;
     
-    if (view.needsCVLinkDisplay && !view.inViewAnimation)
+    if (view.usesFramePacing)
+        [view _presentLatestFrameForOutputTime: outputTime];
+    else if (view.needsCVLinkDisplay && !view.inViewAnimation)
         [view display];
     
 	[pool drain];
@@ -0,0 +1,20 @@
+/* 
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+
+//BXInputLatencyLayer is a companion to BXFrameRateCounterLayer that displays the summary
+//of whichever input latency recorder is currently running.
+
+#import <QuartzCore/QuartzCore.h>
+
+@interface BXInputLatencyLayer : CATextLayer
+
+//Regenerates the displayed string from the active recorder's current statistics.
+//Displays nothing if no recorder is running.
+- (void) refresh;
+
+@end
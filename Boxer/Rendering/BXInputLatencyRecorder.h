@@ -0,0 +1,91 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+
+//BXInputLatencyRecorder measures how long it takes for user input to make it onto the screen.
+//It follows one input event at a time through each stage of its journey: when a new event arrives
+//while one is still being followed, the new one is ignored. Events that never make it all the way
+//(e.g. keypresses the program never reads) are abandoned after a while.
+
+//Stages are marked from whichever thread they happen on with BXInputLatencyMark(), which does
+//nothing unless a recorder is running and is cheap enough to call from DOSBox's IO handlers.
+
+#import <Foundation/Foundation.h>
+#import <CoreFoundation/CoreFoundation.h>
+
+typedef NS_ENUM(NSUInteger, BXInputLatencyStage) {
+    /// The event was received by BXInputController.
+    BXInputLatencyReceived,
+
+    /// The event was passed to DOSBox's keyboard or mouse emulation.
+    BXInputLatencyDelivered,
+
+    /// The DOS program read the keyboard or mouse for the first time since then.
+    BXInputLatencyRead,
+
+    /// The next frame with changes in it was finished.
+    BXInputLatencyRendered,
+
+    /// That frame (or a later one) was presented on screen.
+    BXInputLatencyPresented,
+
+    BXInputLatencyStageCount,
+};
+
+
+@interface BXInputLatencyRecorder : NSObject
+{
+    NSMutableData *_samples;
+    NSFileHandle *_logHandle;
+    dispatch_queue_t _logQueue;
+    BOOL _recording;
+}
+
+/// The recorder that is currently running, if any.
++ (BXInputLatencyRecorder *) activeRecorder;
+
+/// Whether this recorder is currently running.
+@property (readonly, getter=isRecording) BOOL recording;
+
+/// The number of events that have been followed all the way to the screen.
+@property (readonly) NSUInteger sampleCount;
+
+/// Returns a recorder that will write each sample as a line of CSV to the file at the specified URL,
+/// replacing any file that is already there. logURL may be nil, in which case no log is written.
+- (id) initWithLogURL: (NSURL *)logURL;
+
+/// Start and stop recording. Only one recorder can run at a time: starting one stops any other.
+- (void) start;
+- (void) stop;
+
+/// Returns the time it took recorded events to get from one stage to another, at the specified
+/// percentile (from 0 to 100). Returns 0 if no events have been recorded yet.
+- (CFTimeInterval) latencyFromStage: (BXInputLatencyStage)fromStage
+                            toStage: (BXInputLatencyStage)toStage
+                       atPercentile: (double)percentile;
+
+/// A human-readable summary of the recorded latencies, for displaying and logging.
+- (NSString *) summary;
+
+@end
+
+
+#if __cplusplus
+extern "C" {
+#endif
+
+    /// Marks that the event currently being followed has reached the specified stage.
+    /// Ignored if no recorder is running, or if the event has not reached the stage before.
+    void BXInputLatencyMark(BXInputLatencyStage stage);
+
+    /// Variants of the above for the frame stages, identifying the frame by its timestamp.
+    /// A presented frame only counts if it is the same as or newer than the rendered frame.
+    void BXInputLatencyMarkFrame(BXInputLatencyStage stage, CFAbsoluteTime frameTimestamp);
+
+#if __cplusplus
+}
+#endif
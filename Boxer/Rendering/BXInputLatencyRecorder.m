@@ -0,0 +1,297 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+
+#import "BXInputLatencyRecorder.h"
+#import <CoreVideo/CoreVideo.h>
+#import <libkern/OSAtomic.h>
+#import <pthread.h>
+
+
+//How long to follow an event before giving up on it, in seconds.
+#define BXInputLatencyProbeTimeout 1.0
+
+//The stage an idle probe is at.
+#define BXInputLatencyIdle -1
+
+
+#pragma mark -
+#pragma mark Probe state
+
+//The event currently being followed. This is shared between all the threads that mark stages:
+//each stage is only marked once the stage before it has been, so each field has only one writer
+//at a time, and the stage itself is advanced with compare-and-swap.
+typedef struct {
+    uint64_t times[BXInputLatencyStageCount];
+    CFAbsoluteTime frameTimestamp;
+} BXInputLatencySample;
+
+static struct {
+    volatile int32_t enabled;
+    volatile int32_t stage;
+    BXInputLatencySample sample;
+} _probe = { 0, BXInputLatencyIdle };
+
+//Guards the active recorder, which completed samples are handed to.
+static pthread_mutex_t _activeRecorderLock = PTHREAD_MUTEX_INITIALIZER;
+static BXInputLatencyRecorder *_activeRecorder = nil;
+
+
+#pragma mark -
+#pragma mark Private interface declarations
+
+@interface BXInputLatencyRecorder ()
+
+@property (readwrite, getter=isRecording) BOOL recording;
+
+//Adds a completed sample to the recorder and the log. Called with the active recorder lock held.
+- (void) _addSample: (const BXInputLatencySample *)sample;
+
+@end
+
+
+@implementation BXInputLatencyRecorder
+@synthesize recording = _recording;
+
++ (BXInputLatencyRecorder *) activeRecorder
+{
+    pthread_mutex_lock(&_activeRecorderLock);
+    BXInputLatencyRecorder *recorder = [[_activeRecorder retain] autorelease];
+    pthread_mutex_unlock(&_activeRecorderLock);
+    return recorder;
+}
+
+- (id) initWithLogURL: (NSURL *)logURL
+{
+    self = [super init];
+    if (self)
+    {
+        _samples = [[NSMutableData alloc] init];
+
+        if (logURL)
+        {
+            NSString *header = @"received to delivered,delivered to read,read to rendered,rendered to presented,total\n";
+            [header writeToURL: logURL atomically: NO encoding: NSUTF8StringEncoding error: NULL];
+            _logHandle = [[NSFileHandle fileHandleForWritingToURL: logURL error: NULL] retain];
+            [_logHandle seekToEndOfFile];
+            _logQueue = dispatch_queue_create("com.boxer.InputLatencyLogQueue", DISPATCH_QUEUE_SERIAL);
+        }
+    }
+    return self;
+}
+
+- (void) dealloc
+{
+    [self stop];
+
+    if (_logQueue)
+    {
+        //Let any pending writes finish before we close the log.
+        dispatch_sync(_logQueue, ^{});
+        dispatch_release(_logQueue), _logQueue = NULL;
+    }
+    [_logHandle closeFile];
+    [_logHandle release], _logHandle = nil;
+    [_samples release], _samples = nil;
+
+    [super dealloc];
+}
+
+- (void) start
+{
+    pthread_mutex_lock(&_activeRecorderLock);
+    if (_activeRecorder != self)
+    {
+        _activeRecorder.recording = NO;
+        [_activeRecorder release];
+        _activeRecorder = [self retain];
+        self.recording = YES;
+
+        _probe.stage = BXInputLatencyIdle;
+        OSAtomicCompareAndSwap32Barrier(0, 1, &_probe.enabled);
+    }
+    pthread_mutex_unlock(&_activeRecorderLock);
+}
+
+- (void) stop
+{
+    pthread_mutex_lock(&_activeRecorderLock);
+    if (_activeRecorder == self)
+    {
+        OSAtomicCompareAndSwap32Barrier(1, 0, &_probe.enabled);
+
+        //Balanced by the retain in -start.
+        _activeRecorder = nil;
+        self.recording = NO;
+        [self autorelease];
+    }
+    pthread_mutex_unlock(&_activeRecorderLock);
+}
+
+- (NSUInteger) sampleCount
+{
+    @synchronized(_samples)
+    {
+        return _samples.length / sizeof(BXInputLatencySample);
+    }
+}
+
+- (void) _addSample: (const BXInputLatencySample *)sample
+{
+    @synchronized(_samples)
+    {
+        [_samples appendBytes: sample length: sizeof(BXInputLatencySample)];
+    }
+
+    if (_logHandle)
+    {
+        double hostFrequency = CVGetHostClockFrequency();
+        NSMutableString *line = [NSMutableString string];
+        NSUInteger stage;
+        for (stage = BXInputLatencyDelivered; stage < BXInputLatencyStageCount; stage++)
+        {
+            uint64_t elapsed = sample->times[stage] - sample->times[stage - 1];
+            [line appendFormat: @"%0.3f,", elapsed * 1000.0 / hostFrequency];
+        }
+        uint64_t total = sample->times[BXInputLatencyPresented] - sample->times[BXInputLatencyReceived];
+        [line appendFormat: @"%0.3f\n", total * 1000.0 / hostFrequency];
+
+        //Samples are completed on the display link thread, which shouldn't wait for the disk.
+        NSData *lineData = [line dataUsingEncoding: NSUTF8StringEncoding];
+        NSFileHandle *handle = _logHandle;
+        dispatch_async(_logQueue, ^{
+            [handle writeData: lineData];
+        });
+    }
+}
+
+static int _BXCompareLatencies(const void *a, const void *b)
+{
+    uint64_t first = *(const uint64_t *)a, second = *(const uint64_t *)b;
+    if (first < second) return -1;
+    if (first > second) return 1;
+    return 0;
+}
+
+- (CFTimeInterval) latencyFromStage: (BXInputLatencyStage)fromStage
+                            toStage: (BXInputLatencyStage)toStage
+                       atPercentile: (double)percentile
+{
+    NSAssert(fromStage < toStage && toStage < BXInputLatencyStageCount, @"Invalid stages passed to latencyFromStage:toStage:atPercentile:.");
+
+    uint64_t *latencies = NULL;
+    NSUInteger i, numSamples;
+    @synchronized(_samples)
+    {
+        const BXInputLatencySample *samples = (const BXInputLatencySample *)_samples.bytes;
+        numSamples = _samples.length / sizeof(BXInputLatencySample);
+        if (!numSamples)
+            return 0;
+
+        latencies = (uint64_t *)malloc(numSamples * sizeof(uint64_t));
+        for (i=0; i<numSamples; i++)
+            latencies[i] = samples[i].times[toStage] - samples[i].times[fromStage];
+    }
+
+    qsort(latencies, numSamples, sizeof(uint64_t), _BXCompareLatencies);
+
+    double rank = MIN(MAX(percentile, 0.0), 100.0) / 100.0 * (numSamples - 1);
+    uint64_t latency = latencies[(NSUInteger)round(rank)];
+    free(latencies);
+
+    return latency / CVGetHostClockFrequency();
+}
+
+- (NSString *) summary
+{
+    NSUInteger numSamples = self.sampleCount;
+    if (!numSamples)
+        return @"No input latency samples";
+
+    NSString *stageNames[BXInputLatencyStageCount] = {
+        @"received", @"delivered", @"read", @"rendered", @"presented"
+    };
+
+    NSMutableString *summary = [NSMutableString stringWithFormat: @"Input latency over %lu samples: %0.1f/%0.1f/%0.1f ms (50th/95th/99th)",
+                                (unsigned long)numSamples,
+                                [self latencyFromStage: BXInputLatencyReceived toStage: BXInputLatencyPresented atPercentile: 50] * 1000.0,
+                                [self latencyFromStage: BXInputLatencyReceived toStage: BXInputLatencyPresented atPercentile: 95] * 1000.0,
+                                [self latencyFromStage: BXInputLatencyReceived toStage: BXInputLatencyPresented atPercentile: 99] * 1000.0];
+
+    NSUInteger stage;
+    for (stage = BXInputLatencyDelivered; stage < BXInputLatencyStageCount; stage++)
+    {
+        [summary appendFormat: @"\n%@ to %@: %0.1f/%0.1f ms",
+         stageNames[stage - 1], stageNames[stage],
+         [self latencyFromStage: stage - 1 toStage: stage atPercentile: 50] * 1000.0,
+         [self latencyFromStage: stage - 1 toStage: stage atPercentile: 95] * 1000.0];
+    }
+    return summary;
+}
+
+@end
+
+
+#pragma mark -
+#pragma mark Marking stages
+
+void BXInputLatencyMarkFrame(BXInputLatencyStage stage, CFAbsoluteTime frameTimestamp)
+{
+    if (!_probe.enabled)
+        return;
+
+    int32_t currentStage = _probe.stage;
+    uint64_t now = CVGetCurrentHostTime();
+
+    //Start following a new event whenever we're not already following one,
+    //or the one we were following has gone astray.
+    if (stage == BXInputLatencyReceived)
+    {
+        if (currentStage != BXInputLatencyIdle)
+        {
+            uint64_t timeout = (uint64_t)(BXInputLatencyProbeTimeout * CVGetHostClockFrequency());
+            if (now - _probe.sample.times[BXInputLatencyReceived] < timeout)
+                return;
+        }
+        _probe.sample.times[BXInputLatencyReceived] = now;
+        OSAtomicCompareAndSwap32Barrier(currentStage, BXInputLatencyReceived, &_probe.stage);
+        return;
+    }
+
+    if (currentStage != (int32_t)stage - 1)
+        return;
+
+    if (stage == BXInputLatencyRendered)
+    {
+        _probe.sample.frameTimestamp = frameTimestamp;
+    }
+    else if (stage == BXInputLatencyPresented)
+    {
+        if (frameTimestamp < _probe.sample.frameTimestamp)
+            return;
+
+        //Take a copy before we let go of the probe, since a new event may start being followed
+        //as soon as we do.
+        BXInputLatencySample sample = _probe.sample;
+        sample.times[BXInputLatencyPresented] = now;
+        if (OSAtomicCompareAndSwap32Barrier(currentStage, BXInputLatencyIdle, &_probe.stage))
+        {
+            pthread_mutex_lock(&_activeRecorderLock);
+            [_activeRecorder _addSample: &sample];
+            pthread_mutex_unlock(&_activeRecorderLock);
+        }
+        return;
+    }
+
+    _probe.sample.times[stage] = now;
+    OSAtomicCompareAndSwap32Barrier(currentStage, (int32_t)stage, &_probe.stage);
+}
+
+void BXInputLatencyMark(BXInputLatencyStage stage)
+{
+    BXInputLatencyMarkFrame(stage, 0);
+}
@@ -0,0 +1,115 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+
+//BXMovieRecorder records the emulator's video frames and mixer output to an H.264/AAC QuickTime movie,
+//using AVAssetWriter (and thereby the hardware video encoder, where one is available.)
+//Frames and audio are handed to the recorder on the emulation thread, which only copies the data
+//it needs: scaling, encoding and writing all take place on the recorder's own serial queue.
+
+//The movie's timeline is driven by the amount of audio the mixer has produced, so that audio and video
+//stay in sync even if emulation runs slower or faster than realtime. If no audio is being produced
+//when recording starts, the movie will have no audio track and frames are timestamped against the
+//host clock instead.
+
+#import <Foundation/Foundation.h>
+#import <CoreMedia/CoreMedia.h>
+
+
+#pragma mark -
+#pragma mark Constants
+
+//Movies will be recorded at the smallest integer multiple of the first frame's aspect-corrected size
+//that's at least this tall, so that pixel art survives H.264's chroma subsampling.
+#define BXMovieRecorderMinimumOutputHeight 720
+
+//The target bitrates for the video and audio tracks, in bits per second.
+#define BXMovieRecorderVideoBitRate (8 * 1024 * 1024)
+#define BXMovieRecorderAudioBitRate (192 * 1024)
+
+//How many frames of audio to accumulate before passing them on to the encoder.
+#define BXMovieRecorderAudioBatchFrames 4096
+
+
+@class BXVideoFrame;
+@class AVAssetWriter;
+@class AVAssetWriterInput;
+@class AVAssetWriterInputPixelBufferAdaptor;
+
+@interface BXMovieRecorder : NSObject
+{
+    NSURL *_URL;
+    NSString *_fileType;
+    NSError *_error;
+
+    dispatch_queue_t _queue;
+
+    AVAssetWriter *_writer;
+    AVAssetWriterInput *_videoInput;
+    AVAssetWriterInput *_audioInput;
+    AVAssetWriterInputPixelBufferAdaptor *_pixelBufferAdaptor;
+    CMAudioFormatDescriptionRef _audioFormat;
+    NSSize _outputSize;
+
+    CFAbsoluteTime _startTime;
+    CMTime _lastVideoTime;
+
+    NSUInteger _sampleRate;
+    int64_t _audioFramesReceived;
+    int64_t _pendingAudioStartFrame;
+    NSMutableData *_pendingAudio;
+
+    BOOL _finishing;
+}
+
+#pragma mark -
+#pragma mark Properties
+
+//The location to which the movie is being recorded.
+@property (readonly, copy) NSURL *URL;
+
+//The AVFoundation file type of the movie being recorded. Defaults to AVFileTypeQuickTimeMovie.
+@property (readonly, copy) NSString *fileType;
+
+//The first error that occurred during recording, if any. Once an error has occurred, further frames
+//and audio will be ignored.
+@property (readonly, retain) NSError *error;
+
+//The size at which video is being recorded. Will be NSZeroSize until the first frame has been received.
+@property (readonly) NSSize outputSize;
+
+
+#pragma mark -
+#pragma mark Initialization
+
+//Returns whether movie recording is available on this system. AVFoundation is only weakly linked,
+//since it is not present on all the OS X versions that Boxer supports.
++ (BOOL) isSupported;
+
+//Returns a recorder that will write to the specified location with the specified AVFoundation file type.
+//Nothing is written until the first frame is appended.
+- (id) initWithURL: (NSURL *)URL fileType: (NSString *)fileType;
+
+
+#pragma mark -
+#pragma mark Recording
+
+//Adds the specified frame to the movie at the current point in the timeline. The frame's contents are
+//copied before this returns, so the frame can be recycled immediately afterward. If the encoder is
+//falling behind, frames will be dropped rather than queued.
+- (void) appendVideoFrame: (BXVideoFrame *)frame;
+
+//Adds the specified 16-bit interleaved stereo samples to the movie's audio track.
+- (void) appendAudioSamples: (const int16_t *)samples
+                     frames: (NSUInteger)numFrames
+                 sampleRate: (NSUInteger)sampleRate;
+
+//Finishes writing the movie, calling completionHandler on the main thread once the file has been
+//finalized. No further frames or audio will be accepted after this is called.
+- (void) finishWithCompletionHandler: (void (^)(BOOL succeeded, NSError *error))completionHandler;
+
+@end
@@ -0,0 +1,383 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+
+#import "BXMovieRecorder.h"
+#import "BXVideoFrame.h"
+#import <AVFoundation/AVFoundation.h>
+#import <CoreVideo/CoreVideo.h>
+
+
+#pragma mark -
+#pragma mark Private interface declarations
+
+@interface BXMovieRecorder ()
+
+@property (readwrite, copy) NSURL *URL;
+@property (readwrite, copy) NSString *fileType;
+@property (readwrite, retain) NSError *error;
+@property (readwrite) NSSize outputSize;
+
+//Creates the asset writer and its inputs, sized to suit the specified frame,
+//and starts the movie's timeline at the current time. Returns NO and populates
+//the error property if writing could not be started.
+- (BOOL) _startWritingWithFrame: (BXVideoFrame *)frame;
+
+//The current point in the movie's timeline.
+- (CMTime) _currentTime;
+
+//Passes any accumulated audio on to the encoder.
+- (void) _flushPendingAudio;
+
+@end
+
+
+//Copies the source pixels into the destination buffer, scaling them to fit with nearest-neighbour
+//sampling. Both buffers are assumed to be 32 bits per pixel.
+static void _BXScalePixels(const uint8_t *source, NSSize sourceSize, NSUInteger sourcePitch,
+                           uint8_t *destination, NSSize destinationSize, NSUInteger destinationPitch)
+{
+    NSUInteger sourceWidth = (NSUInteger)sourceSize.width, sourceHeight = (NSUInteger)sourceSize.height;
+    NSUInteger destWidth = (NSUInteger)destinationSize.width, destHeight = (NSUInteger)destinationSize.height;
+
+    if (!sourceWidth || !sourceHeight || !destWidth || !destHeight)
+        return;
+
+    NSUInteger *columnMap = (NSUInteger *)malloc(destWidth * sizeof(NSUInteger));
+    NSUInteger x, y;
+    for (x=0; x<destWidth; x++)
+        columnMap[x] = (x * sourceWidth) / destWidth;
+
+    NSUInteger previousSourceRow = NSNotFound;
+    for (y=0; y<destHeight; y++)
+    {
+        NSUInteger sourceRow = (y * sourceHeight) / destHeight;
+        uint32_t *destPixels = (uint32_t *)(destination + (y * destinationPitch));
+
+        //Rows that repeat the previous source row can be copied wholesale.
+        if (sourceRow == previousSourceRow)
+        {
+            memcpy(destPixels, (uint8_t *)destPixels - destinationPitch, destWidth * 4);
+        }
+        else
+        {
+            const uint32_t *sourcePixels = (const uint32_t *)(source + (sourceRow * sourcePitch));
+            for (x=0; x<destWidth; x++)
+                destPixels[x] = sourcePixels[columnMap[x]];
+        }
+        previousSourceRow = sourceRow;
+    }
+
+    free(columnMap);
+}
+
+
+@implementation BXMovieRecorder
+@synthesize URL = _URL;
+@synthesize fileType = _fileType;
+@synthesize error = _error;
+@synthesize outputSize = _outputSize;
+
++ (BOOL) isSupported
+{
+    return NSClassFromString(@"AVAssetWriter") != nil;
+}
+
+- (id) initWithURL: (NSURL *)URL fileType: (NSString *)fileType
+{
+    self = [super init];
+    if (self)
+    {
+        self.URL = URL;
+        self.fileType = (fileType != nil) ? fileType : AVFileTypeQuickTimeMovie;
+
+        _queue = dispatch_queue_create("com.boxer.movieRecorder", DISPATCH_QUEUE_SERIAL);
+        _pendingAudio = [[NSMutableData alloc] initWithCapacity: BXMovieRecorderAudioBatchFrames * 4];
+        _lastVideoTime = kCMTimeInvalid;
+        _startTime = CFAbsoluteTimeGetCurrent();
+    }
+    return self;
+}
+
+- (void) dealloc
+{
+    self.URL = nil;
+    self.fileType = nil;
+    self.error = nil;
+
+    [_writer release], _writer = nil;
+    [_videoInput release], _videoInput = nil;
+    [_audioInput release], _audioInput = nil;
+    [_pixelBufferAdaptor release], _pixelBufferAdaptor = nil;
+    [_pendingAudio release], _pendingAudio = nil;
+
+    if (_audioFormat)
+    {
+        CFRelease(_audioFormat);
+        _audioFormat = NULL;
+    }
+
+    if (_queue)
+    {
+        dispatch_release(_queue);
+        _queue = NULL;
+    }
+
+    [super dealloc];
+}
+
+
+#pragma mark -
+#pragma mark Recording
+
+- (CMTime) _currentTime
+{
+    if (_audioInput)
+        return CMTimeMake(_audioFramesReceived, (int32_t)_sampleRate);
+    else
+        return CMTimeMakeWithSeconds(CFAbsoluteTimeGetCurrent() - _startTime, 600);
+}
+
+- (BOOL) _startWritingWithFrame: (BXVideoFrame *)frame
+{
+    NSError *writerError = nil;
+    _writer = [[AVAssetWriter alloc] initWithURL: self.URL fileType: self.fileType error: &writerError];
+    if (!_writer)
+    {
+        self.error = writerError;
+        return NO;
+    }
+
+    //Scale up small DOS resolutions to an integer multiple of their aspect-corrected size.
+    NSSize scaledSize = frame.scaledSize;
+    CGFloat scale = MAX(1.0, ceil(BXMovieRecorderMinimumOutputHeight / scaledSize.height));
+
+    //H.264 requires even dimensions.
+    NSSize outputSize = NSMakeSize(ceil(scaledSize.width * scale / 2) * 2,
+                                   ceil(scaledSize.height * scale / 2) * 2);
+    self.outputSize = outputSize;
+
+    NSDictionary *compressionSettings = @{
+        AVVideoAverageBitRateKey: @(BXMovieRecorderVideoBitRate),
+    };
+    NSDictionary *videoSettings = @{
+        AVVideoCodecKey: AVVideoCodecH264,
+        AVVideoWidthKey: @(outputSize.width),
+        AVVideoHeightKey: @(outputSize.height),
+        AVVideoCompressionPropertiesKey: compressionSettings,
+    };
+
+    _videoInput = [[AVAssetWriterInput alloc] initWithMediaType: AVMediaTypeVideo
+                                                 outputSettings: videoSettings];
+    _videoInput.expectsMediaDataInRealTime = YES;
+
+    NSDictionary *pixelBufferAttributes = @{
+        (NSString *)kCVPixelBufferPixelFormatTypeKey: @(kCVPixelFormatType_32BGRA),
+        (NSString *)kCVPixelBufferWidthKey: @(outputSize.width),
+        (NSString *)kCVPixelBufferHeightKey: @(outputSize.height),
+    };
+    _pixelBufferAdaptor = [[AVAssetWriterInputPixelBufferAdaptor alloc] initWithAssetWriterInput: _videoInput
+                                                                     sourcePixelBufferAttributes: pixelBufferAttributes];
+
+    [_writer addInput: _videoInput];
+
+    //Only record audio if the mixer has already started sending it to us:
+    //otherwise the movie will be silent.
+    if (_sampleRate)
+    {
+        AudioChannelLayout layout;
+        bzero(&layout, sizeof(layout));
+        layout.mChannelLayoutTag = kAudioChannelLayoutTag_Stereo;
+
+        NSDictionary *audioSettings = @{
+            AVFormatIDKey: @(kAudioFormatMPEG4AAC),
+            AVSampleRateKey: @(_sampleRate),
+            AVNumberOfChannelsKey: @(2),
+            AVChannelLayoutKey: [NSData dataWithBytes: &layout length: sizeof(layout)],
+            AVEncoderBitRateKey: @(BXMovieRecorderAudioBitRate),
+        };
+
+        AVAssetWriterInput *audioInput = [AVAssetWriterInput assetWriterInputWithMediaType: AVMediaTypeAudio
+                                                                            outputSettings: audioSettings];
+        audioInput.expectsMediaDataInRealTime = YES;
+
+        //The AAC encoder does not support every sample rate DOSBox can be configured to use.
+        if ([_writer canAddInput: audioInput])
+        {
+            AudioStreamBasicDescription format;
+            bzero(&format, sizeof(format));
+            format.mSampleRate = _sampleRate;
+            format.mFormatID = kAudioFormatLinearPCM;
+            format.mFormatFlags = kAudioFormatFlagIsSignedInteger | kAudioFormatFlagIsPacked;
+            format.mBytesPerPacket = 4;
+            format.mFramesPerPacket = 1;
+            format.mBytesPerFrame = 4;
+            format.mChannelsPerFrame = 2;
+            format.mBitsPerChannel = 16;
+
+            OSStatus status = CMAudioFormatDescriptionCreate(kCFAllocatorDefault, &format,
+                                                             sizeof(layout), &layout,
+                                                             0, NULL, NULL, &_audioFormat);
+            if (status == noErr)
+            {
+                _audioInput = [audioInput retain];
+                [_writer addInput: _audioInput];
+            }
+        }
+        else
+        {
+            NSLog(@"Sample rate of %lu Hz is not supported for movie audio, recording without sound.", (unsigned long)_sampleRate);
+        }
+    }
+
+    if (![_writer startWriting])
+    {
+        self.error = _writer.error;
+        return NO;
+    }
+
+    [_writer startSessionAtSourceTime: [self _currentTime]];
+    _pendingAudioStartFrame = _audioFramesReceived;
+
+    return YES;
+}
+
+- (void) appendVideoFrame: (BXVideoFrame *)frame
+{
+    if (_finishing || self.error)
+        return;
+
+    if (!_writer && ![self _startWritingWithFrame: frame])
+        return;
+
+    //Skip frames that land at the same point in the timeline as the previous one.
+    CMTime time = [self _currentTime];
+    if (CMTIME_IS_VALID(_lastVideoTime) && CMTimeCompare(time, _lastVideoTime) <= 0)
+        return;
+    _lastVideoTime = time;
+
+    NSData *pixels = frame.BGRAData;
+    NSSize frameSize = frame.size;
+    NSUInteger pitch = (NSUInteger)frame.size.width * 4;
+    NSSize outputSize = self.outputSize;
+
+    dispatch_async(_queue, ^{
+        //Drop the frame if the encoder can't keep up, rather than stalling emulation.
+        if (!_videoInput.isReadyForMoreMediaData || !_pixelBufferAdaptor.pixelBufferPool)
+            return;
+
+        CVPixelBufferRef buffer = NULL;
+        CVReturn status = CVPixelBufferPoolCreatePixelBuffer(kCFAllocatorDefault,
+                                                             _pixelBufferAdaptor.pixelBufferPool,
+                                                             &buffer);
+        if (status != kCVReturnSuccess)
+            return;
+
+        CVPixelBufferLockBaseAddress(buffer, 0);
+            _BXScalePixels(pixels.bytes, frameSize, pitch,
+                           CVPixelBufferGetBaseAddress(buffer), outputSize, CVPixelBufferGetBytesPerRow(buffer));
+        CVPixelBufferUnlockBaseAddress(buffer, 0);
+
+        [_pixelBufferAdaptor appendPixelBuffer: buffer withPresentationTime: time];
+        CVPixelBufferRelease(buffer);
+    });
+}
+
+- (void) appendAudioSamples: (const int16_t *)samples
+                     frames: (NSUInteger)numFrames
+                 sampleRate: (NSUInteger)sampleRate
+{
+    if (_finishing || self.error)
+        return;
+
+    //If we started writing without an audio track, any audio that arrives later is of no use.
+    if (_writer && !_audioInput)
+        return;
+
+    //Changes of sample rate partway through recording aren't supported.
+    if (!_sampleRate)
+        _sampleRate = sampleRate;
+    else if (sampleRate != _sampleRate)
+        return;
+
+    //Audio that arrives before the first frame only advances the clock.
+    if (_writer)
+    {
+        [_pendingAudio appendBytes: samples length: numFrames * 4];
+    }
+    _audioFramesReceived += numFrames;
+
+    if (_pendingAudio.length >= BXMovieRecorderAudioBatchFrames * 4)
+        [self _flushPendingAudio];
+}
+
+- (void) _flushPendingAudio
+{
+    NSUInteger numFrames = _pendingAudio.length / 4;
+    if (!_audioInput || !numFrames)
+        return;
+
+    NSData *audio = [NSData dataWithData: _pendingAudio];
+    CMTime time = CMTimeMake(_pendingAudioStartFrame, (int32_t)_sampleRate);
+
+    [_pendingAudio setLength: 0];
+    _pendingAudioStartFrame = _audioFramesReceived;
+
+    dispatch_async(_queue, ^{
+        if (!_audioInput.isReadyForMoreMediaData)
+            return;
+
+        CMBlockBufferRef block = NULL;
+        OSStatus status = CMBlockBufferCreateWithMemoryBlock(kCFAllocatorDefault, NULL, audio.length,
+                                                             kCFAllocatorDefault, NULL, 0, audio.length,
+                                                             kCMBlockBufferAssureMemoryNowFlag, &block);
+        if (status != noErr)
+            return;
+
+        CMBlockBufferReplaceDataBytes(audio.bytes, block, 0, audio.length);
+
+        CMSampleBufferRef sampleBuffer = NULL;
+        status = CMAudioSampleBufferCreateWithPacketDescriptions(kCFAllocatorDefault, block, true, NULL, NULL,
+                                                                 _audioFormat, numFrames, time, NULL,
+                                                                 &sampleBuffer);
+        CFRelease(block);
+
+        if (status == noErr)
+        {
+            [_audioInput appendSampleBuffer: sampleBuffer];
+            CFRelease(sampleBuffer);
+        }
+    });
+}
+
+- (void) finishWithCompletionHandler: (void (^)(BOOL succeeded, NSError *error))completionHandler
+{
+    [self _flushPendingAudio];
+    _finishing = YES;
+
+    dispatch_async(_queue, ^{
+        BOOL succeeded = NO;
+        if (_writer && _writer.status == AVAssetWriterStatusWriting)
+        {
+            [_videoInput markAsFinished];
+            [_audioInput markAsFinished];
+
+            //This is called on our own queue, so there's no harm in waiting for it to finish.
+            succeeded = [_writer finishWriting];
+        }
+
+        NSError *error = (_writer.error != nil) ? _writer.error : self.error;
+        if (completionHandler)
+        {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                completionHandler(succeeded, error);
+            });
+        }
+    });
+}
+
+@end
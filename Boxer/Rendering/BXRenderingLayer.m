@@ -11,6 +11,7 @@
 #import "BXSupersamplingRenderer.h"
 #import "BXBuiltinShaderRenderers.h"
 #import "BXVideoFrame.h"
+#import "ADBShader.h"
 
 #import <OpenGL/CGLMacro.h>
 
@@ -22,8 +23,6 @@
 @property (retain, nonatomic) NSMutableArray *renderers;
 @property (retain, nonatomic) BXVideoFrame *currentFrame;
 
-+ (BOOL) contextSupportsAdvancedShaders: (CGLContextObj)context;
-+ (Class) rendererClassForStyle: (BXRenderingStyle)style;
 + (BXBasicRenderer *) prepareRendererForStyle: (BXRenderingStyle)style
                                     inContext: (CGLContextObj)context;
 
@@ -63,79 +62,12 @@
 
 #pragma mark Renderer creation
 
-+ (Class) rendererClassForStyle: (BXRenderingStyle)style
-{
-    Class rendererClass;
-    switch (style)
-    {
-        case BXRenderingStyleSmoothed:
-            rendererClass = [BXSmoothedRenderer class];
-            break;
-        case BXRenderingStyleCRT:
-            rendererClass = [BXCRTRenderer class];
-            break;
-        case BXRenderingStyleNormal:
-        default:
-            rendererClass = [BXSupersamplingRenderer class];
-            break;
-    }
-    return rendererClass;
-}
-
-+ (BOOL) contextSupportsAdvancedShaders: (CGLContextObj)context
-{
-    CGLContextObj cgl_ctx = context;
-    GLint maxTextureDims = 0;
-    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureDims);
-    return (maxTextureDims >= 4096);
-}
-
 + (BXBasicRenderer *) prepareRendererForStyle: (BXRenderingStyle)style
                                     inContext: (CGLContextObj)context
 {
-    //Try to load a renderer for the specified rendering style.
-    //If that fails, fall back on increasingly simple renderers until
-    //we find one that works (or run out of options.)
-    NSArray *renderersToTry;
-    
-    //On low-performance GPUs, don't even bother trying a fancy renderer:
-    //just stick with our standard renderers.
-    if (![self contextSupportsAdvancedShaders: context])
-    {
-        renderersToTry = @[
-                           [BXSupersamplingRenderer class],
-                           [BXBasicRenderer class],
-                           ];
-    }
-    else
-    {
-        renderersToTry = @[
-                           [self rendererClassForStyle: style],
-                           [BXSupersamplingRenderer class],
-                           [BXBasicRenderer class],
-                           ];
-    }
-    
-    for (Class rendererClass in renderersToTry)
-    {
-        NSError *loadError = nil;
-        BXBasicRenderer *renderer = [[[rendererClass alloc] initWithContext: context error: &loadError] autorelease];
-        
-        if (renderer)
-        {
-            [renderer prepareContext];
-            renderer.tag = style;
-            return renderer;
-        }
-        else
-        {
-            NSLog(@"Error loading %@ renderer: %@", NSStringFromClass(rendererClass), loadError);
-        }
-    }
-    
-    NSAssert(NO, @"No valid renderer could be created, we're screwed!");
-    
-    return nil;
+    BXBasicRenderer *renderer = [BXBasicRenderer rendererForStyle: style inContext: context];
+    [renderer prepareContext];
+    return renderer;
 }
 
 //FIXME: the answer to this depends on the context we're currently talking to.
@@ -173,6 +105,9 @@
         }
     }
     
+    //Any shader programs compiled in the context go with it.
+    [ADBShader purgeCachedProgramsInContext: ctx];
+    
     [super releaseCGLContext: ctx];
 }
 
@@ -69,6 +69,19 @@
     self.shaders = nil;
 }
 
+- (NSUInteger) cachedResourceSize
+{
+    return [super cachedResourceSize] + BXTextureMemorySize(self.auxiliaryBufferTexture);
+}
+
+- (void) releaseCachedResources
+{
+    [super releaseCachedResources];
+    
+    [self.auxiliaryBufferTexture deleteTexture];
+    self.auxiliaryBufferTexture = nil;
+}
+
 
 #pragma mark -
 #pragma mark Rendering
@@ -363,52 +376,20 @@
             //to make them. We'll use up to two buffers of identical size and swap them
             //back and forth as we render our shaders into them.
             
-            //Recreate the main buffer texture, if we don't have one yet or if our old one
-            //cannot accomodate the output size.
+            //Replace the main buffer texture with a spare one if we don't have one yet or if
+            //our old one cannot accomodate the output size.
             if (numShadersNeedingBuffers > 0)
             {
-                if (![self.supersamplingBufferTexture canAccommodateContentSize: largestOutputSize])
-                {
-                    if (_currentBufferTexture == self.supersamplingBufferTexture.texture)
-                        _currentBufferTexture = 0;
-                    
-                    //Clear our old buffer texture straight away when replacing it
-                    [self.supersamplingBufferTexture deleteTexture];
-                    
-                    //(Re)create the buffer texture in the new dimensions
-                    NSError *bufferError = nil;
-                    self.supersamplingBufferTexture = [ADBTexture2D textureWithType: self.bufferTextureType
-                                                                       contentSize: largestOutputSize
-                                                                             bytes: NULL
-                                                                       inGLContext: _context
-                                                                             error: &bufferError];
-                    
-                    NSAssert1(self.supersamplingBufferTexture != nil, @"Buffer texture creation failed: %@", bufferError);
-                }
+                self.supersamplingBufferTexture = [self _bufferTextureForContentSize: largestOutputSize
+                                                                    replacingTexture: self.supersamplingBufferTexture];
             }
             
-            //(Re)create a second auxiliary buffer if we'll need to swap back and forth
+            //Likewise with a second auxiliary buffer, if we'll need to swap back and forth
             //to handle multiple shaders.
             if (numShadersNeedingBuffers > 1)
             {
-                if (![self.auxiliaryBufferTexture canAccommodateContentSize: largestOutputSize])
-                {   
-                    if (_currentBufferTexture == self.auxiliaryBufferTexture.texture)
-                        _currentBufferTexture = 0;
-                    
-                    //Clear our old buffer texture straight away when replacing it
-                    [self.auxiliaryBufferTexture deleteTexture];
-                    
-                    //(Re)create the buffer texture in the new dimensions
-                    NSError *bufferError = nil;
-                    self.auxiliaryBufferTexture = [ADBTexture2D textureWithType: self.bufferTextureType
-                                                                   contentSize: largestOutputSize
-                                                                         bytes: NULL
-                                                                   inGLContext: _context
-                                                                         error: &bufferError];
-                    
-                    NSAssert1(self.auxiliaryBufferTexture != nil, @"Buffer texture creation failed: %@", bufferError);
-                }
+                self.auxiliaryBufferTexture = [self _bufferTextureForContentSize: largestOutputSize
+                                                                replacingTexture: self.auxiliaryBufferTexture];
             }
         }
         else
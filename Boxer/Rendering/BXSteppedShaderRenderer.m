@@ -42,6 +42,10 @@
     return self;
 }
 
+//IMPLEMENTATION NOTE: shader sets are used exactly as loaded, with no attempt to fuse adjacent
+//passes into a single program. Every shader we bundle is a single pass that samples neighbouring
+//texels, so there is nothing that could be fused; and fusing externally-supplied passes would
+//mean rewriting their GLSL source, since bsnes shaders sample their input texture directly.
 - (id) initWithContentsOfURLs: (NSArray *)shaderURLs
                      atScales: (CGFloat *)steps
                     inContext: (CGLContextObj)glContext
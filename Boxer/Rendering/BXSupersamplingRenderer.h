@@ -14,13 +14,23 @@
 
 #define BXDefaultMaxSupersamplingScale 4.0f
 
+//Buffer textures are created in multiples of this many pixels, so that small changes
+//to the viewport size (e.g. during live window resizing) can reuse the same texture.
+#define BXBufferTextureSizeGranularity 256.0f
+
+//The maximum amount of texture memory, in bytes, that we will hold onto in buffer textures
+//that are no longer in use, in case we need them again.
+#define BXMaxSpareBufferTextureBytes (32 * 1024 * 1024)
+
 @interface BXSupersamplingRenderer : BXBasicRenderer
 {
     ADBTexture2D *_supersamplingBufferTexture;
+    NSMutableArray *_spareBufferTextures;
 	GLuint _supersamplingBuffer;
     GLuint _currentBufferTexture;
     
 	CGSize _maxBufferTextureSize;
+    NSSize _lastFrameSize;
     CGFloat _maxSupersamplingScale;
     
 	BOOL _shouldUseSupersampling;
@@ -47,10 +47,17 @@
     {
         self.maxSupersamplingScale = BXDefaultMaxSupersamplingScale;
         _shouldRecalculateBuffer = YES;
+        _spareBufferTextures = [[NSMutableArray alloc] init];
     }
     return self;
 }
 
+- (void) dealloc
+{
+    [_spareBufferTextures release], _spareBufferTextures = nil;
+    [super dealloc];
+}
+
 - (void) prepareContext
 {
     [super prepareContext];
@@ -75,10 +82,43 @@
 
     [self.supersamplingBufferTexture deleteTexture];
     self.supersamplingBufferTexture = nil;
+    
+    [_spareBufferTextures makeObjectsPerformSelector: @selector(deleteTexture)];
+    [_spareBufferTextures removeAllObjects];
 }
 
 
 
+- (NSUInteger) cachedResourceSize
+{
+    NSUInteger size = [super cachedResourceSize] + BXTextureMemorySize(self.supersamplingBufferTexture);
+    for (ADBTexture2D *spareTexture in _spareBufferTextures)
+        size += BXTextureMemorySize(spareTexture);
+    return size;
+}
+
+- (void) releaseSpareResources
+{
+    [super releaseSpareResources];
+    
+    [_spareBufferTextures makeObjectsPerformSelector: @selector(deleteTexture)];
+    [_spareBufferTextures removeAllObjects];
+    
+    //Clear our record of the bound texture, since GL may reuse the texture name.
+    _currentBufferTexture = 0;
+}
+
+- (void) releaseCachedResources
+{
+    [super releaseCachedResources];
+    
+    [self.supersamplingBufferTexture deleteTexture];
+    self.supersamplingBufferTexture = nil;
+    _currentBufferTexture = 0;
+    _shouldRecalculateBuffer = YES;
+}
+
+
 #pragma mark -
 #pragma mark Handling frame updates and canvas resizes
 
@@ -88,8 +128,11 @@
 {
     //If the frame has changed size, we may need to recalculate
     //the supersampling buffer
-    if (frame != self.currentFrame && !NSEqualSizes(frame.size, self.currentFrame.size))
+    //(We compare against the last size we saw rather than the current frame's size,
+    //since pooled frames may be reshaped in place when recycled.)
+    if (!NSEqualSizes(frame.size, _lastFrameSize))
     {
+        _lastFrameSize = frame.size;
         _shouldRecalculateBuffer = YES;
     }
     
@@ -129,6 +172,11 @@
     return _shouldUseSupersampling;
 }
 
+- (BOOL) _shouldSmoothStretchedFrame: (BXVideoFrame *)frame
+{
+    return NO;
+}
+
 - (void) _renderFrame: (BXVideoFrame *)frame
 {
     if ([self _shouldRenderWithSupersampling])
@@ -205,40 +253,102 @@
         
         if (_shouldUseSupersampling)
         {
-            //Reuse the existing buffer if it's already large enough, simply ensuring
-            //that it uses the new supersampling size.
-            if ([self.supersamplingBufferTexture canAccommodateContentSize: supersamplingSize])
+            //Reuse the existing buffer if it's already large enough, or a spare one from the pool
+            //if not, simply ensuring that it uses the new supersampling size.
+            self.supersamplingBufferTexture = [self _bufferTextureForContentSize: supersamplingSize
+                                                                replacingTexture: self.supersamplingBufferTexture];
+            
+            [self.supersamplingBufferTexture setMinFilter: GL_LINEAR
+                                                magFilter: GL_LINEAR
+                                                 wrapping: GL_CLAMP_TO_EDGE];
+        }
+        
+        _shouldRecalculateBuffer = NO;
+    }
+}
+
+- (ADBTexture2D *) _bufferTextureForContentSize: (CGSize)contentSize
+                               replacingTexture: (ADBTexture2D *)texture
+{
+    ADBTexture2D *bufferTexture = nil;
+    
+    if ([texture canAccommodateContentSize: contentSize])
+    {
+        bufferTexture = texture;
+    }
+    else
+    {
+        [self _recycleBufferTexture: texture];
+        
+        //Look for the smallest spare texture that will fit the new size.
+        for (ADBTexture2D *spareTexture in _spareBufferTextures)
+        {
+            if (![spareTexture canAccommodateContentSize: contentSize])
+                continue;
+            
+            if (bufferTexture)
             {
-                self.supersamplingBufferTexture.contentRegion = CGRectMake(0, 0,
-                                                                           supersamplingSize.width,
-                                                                           supersamplingSize.height);
-            }
-            //Otherwise, recreate the buffer texture if it can't accomodate the new size.
-            else
-            {   
-                //Clear our old buffer texture straight away when replacing it
-                if (_currentBufferTexture == self.supersamplingBufferTexture.texture)
-                    _currentBufferTexture = 0;
-                
-                [self.supersamplingBufferTexture deleteTexture];
-                
-                //(Re)create the buffer texture in the new dimensions
-                NSError *bufferError = nil;
-                self.supersamplingBufferTexture = [ADBTexture2D textureWithType: self.bufferTextureType
-                                                                    contentSize: supersamplingSize
-                                                                          bytes: NULL
-                                                                    inGLContext: _context
-                                                                          error: &bufferError];
-                
-                NSAssert1(self.supersamplingBufferTexture != nil, @"Buffer texture creation failed: %@", bufferError);
-                
-                [self.supersamplingBufferTexture setMinFilter: GL_LINEAR
-                                                    magFilter: GL_LINEAR
-                                                     wrapping: GL_CLAMP_TO_EDGE];
+                CGSize spareSize = spareTexture.textureSize;
+                CGSize bestSize = bufferTexture.textureSize;
+                if ((spareSize.width * spareSize.height) >= (bestSize.width * bestSize.height))
+                    continue;
             }
+            bufferTexture = spareTexture;
         }
         
-        _shouldRecalculateBuffer = NO;
+        if (bufferTexture)
+        {
+            [[bufferTexture retain] autorelease];
+            [_spareBufferTextures removeObject: bufferTexture];
+        }
+        //If there are none, create a new texture rounded up to the next size bucket,
+        //so that it can accommodate modest increases in size later on.
+        else
+        {
+            CGSize bucketSize = CGSizeMake(ceilf(contentSize.width / BXBufferTextureSizeGranularity) * BXBufferTextureSizeGranularity,
+                                           ceilf(contentSize.height / BXBufferTextureSizeGranularity) * BXBufferTextureSizeGranularity);
+            
+            bucketSize.width    = MAX(contentSize.width, MIN(bucketSize.width, _maxBufferTextureSize.width));
+            bucketSize.height   = MAX(contentSize.height, MIN(bucketSize.height, _maxBufferTextureSize.height));
+            
+            NSError *bufferError = nil;
+            bufferTexture = [ADBTexture2D textureWithType: self.bufferTextureType
+                                              contentSize: bucketSize
+                                                    bytes: NULL
+                                              inGLContext: _context
+                                                    error: &bufferError];
+            
+            NSAssert1(bufferTexture != nil, @"Buffer texture creation failed: %@", bufferError);
+        }
+    }
+    
+    bufferTexture.contentRegion = CGRectMake(0, 0, contentSize.width, contentSize.height);
+    return bufferTexture;
+}
+
+- (void) _recycleBufferTexture: (ADBTexture2D *)texture
+{
+    if (!texture)
+        return;
+    
+    [_spareBufferTextures addObject: texture];
+    
+    NSUInteger spareBytes = 0;
+    for (ADBTexture2D *spareTexture in _spareBufferTextures)
+        spareBytes += BXTextureMemorySize(spareTexture);
+    
+    //Delete the oldest spare textures until we're back under our memory cap.
+    while (spareBytes > BXMaxSpareBufferTextureBytes && _spareBufferTextures.count)
+    {
+        ADBTexture2D *oldestTexture = [_spareBufferTextures objectAtIndex: 0];
+        spareBytes -= BXTextureMemorySize(oldestTexture);
+        
+        //Clear our record of the bound texture, since GL may reuse the texture name.
+        if (_currentBufferTexture == oldestTexture.texture)
+            _currentBufferTexture = 0;
+        
+        [oldestTexture deleteTexture];
+        [_spareBufferTextures removeObjectAtIndex: 0];
     }
 }
 
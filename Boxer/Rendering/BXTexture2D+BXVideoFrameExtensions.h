@@ -9,11 +9,18 @@
 
 //Helper methods for creating and filling BXGLTextures straight from frame buffers. 
 
+//Dirty regions separated by this many lines or fewer will be uploaded in a single call.
+#define BXDirtyRegionMergeDistance 8
+
+//If more than this proportion of the frame is dirty, the whole frame is uploaded at once.
+#define BXDirtyRegionFullUploadThreshold 0.75f
+
 @class BXVideoFrame;
 
 @interface ADBTexture2D (BXVideoFrameExtensions)
 
 //Create a new texture with the contents of the specified frame buffer.
+//Textures for indexed frames store the frame's palette indexes in a single GL_R8 channel.
 + (id) textureWithType: (GLenum)type
             videoFrame: (BXVideoFrame *)frame
            inGLContext: (CGLContextObj)context
@@ -24,12 +31,33 @@
         inGLContext: (CGLContextObj)context
               error: (NSError **)outError;
 
-//Fill the frame with the specified frame buffer.
-//This takes into account 'dirty' regions of the frame buffer, and also updates the content region
-//of the texture to match the size of the frame buffer. 
+//Fill the texture with the entire contents of the specified frame buffer.
+//This also updates the content region of the texture to match the size
+//of the frame buffer, blanking the texture if the size has changed.
 - (BOOL) fillWithVideoFrame: (BXVideoFrame *)frame
                       error: (NSError **)outError;
 
+//Fill the texture with only the 'dirty' regions of the specified frame buffer,
+//coalescing nearby regions to keep the number of uploads down. This is only valid
+//if the texture already contains the frame immediately preceding this one: it is up
+//to the calling context to check this. Falls back on fillWithVideoFrame:error: if the
+//frame has changed shape or if most of the frame has changed.
+//If pixelBuffer is nonzero, it is used as a pixel buffer object to stage the changed
+//lines so that the transfer to the GPU can happen asynchronously.
+- (BOOL) fillWithDirtyRegionsOfVideoFrame: (BXVideoFrame *)frame
+                         usingPixelBuffer: (GLuint)pixelBuffer
+                                    error: (NSError **)outError;
+
+//Points the texture straight at the IOSurface backing the specified frame, so that the frame
+//is drawn from where the emulator drew it instead of being uploaded. The texture's previous
+//contents are discarded and its content region is set to the size of the frame.
+//Only rectangle textures can be bound to a surface: returns NO without populating outError
+//if this texture is another type, or if the frame has no surface.
+//The frame must not be drawn into again while the texture is being drawn from.
+- (BOOL) bindToSurfaceOfVideoFrame: (BXVideoFrame *)frame
+                             error: (NSError **)outError;
+
+//Whether the texture is large enough for the specified frame, and stores texels of the frame's depth.
 - (BOOL) canAccomodateVideoFrame: (BXVideoFrame *)frame;
 
 @end
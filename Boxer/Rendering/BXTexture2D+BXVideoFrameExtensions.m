@@ -8,7 +8,9 @@
 #import "BXTexture2D+BXVideoFrameExtensions.h"
 #import "BXVideoFrame.h"
 #import "ADBGeometry.h"
+#import "ADBGLHelpers.h"
 #import <OpenGL/CGLMacro.h>
+#import <OpenGL/CGLIOSurface.h>
 
 @implementation ADBTexture2D (BXVideoFrameExtensions)
 
@@ -28,77 +30,200 @@
         inGLContext: (CGLContextObj)context
               error: (NSError **)outError
 {
-    return [self initWithType: type
-                  contentSize: NSSizeToCGSize(frame.size)
-                        bytes: frame.bytes
-                  inGLContext: context
-                        error: outError];
+    //Video frame textures are refilled on every frame, so keep them in memory shared
+    //with the GPU rather than having them copied into video memory after every upload.
+    //Indexed frames are stored as they are, in a single channel, for the renderer to look up.
+    if (frame.isIndexed)
+    {
+        return [self initWithType: type
+                      contentSize: NSSizeToCGSize(frame.size)
+                            bytes: frame.bytes
+                   internalFormat: GL_R8
+                      pixelFormat: GL_RED
+                        pixelType: GL_UNSIGNED_BYTE
+                      storageHint: GL_STORAGE_SHARED_APPLE
+                      inGLContext: context
+                            error: outError];
+    }
+    else
+    {
+        return [self initWithType: type
+                      contentSize: NSSizeToCGSize(frame.size)
+                            bytes: frame.bytes
+                      storageHint: GL_STORAGE_SHARED_APPLE
+                      inGLContext: context
+                            error: outError];
+    }
 }
 
 - (BOOL) fillWithVideoFrame: (BXVideoFrame *)frame
                       error: (NSError **)outError
 {
-    //If the frame has changed shape: update the content region, wipe the texture clean,
-    //and copy the entire frame into the texture rather than bothering to check for changed lines.
+    //If the frame has changed shape: update the content region and wipe the texture clean
+    //before copying the frame in.
     CGRect newContentRegion = CGRectMake(0, 0, frame.size.width, frame.size.height);
-    if (YES || !CGRectEqualToRect(_contentRegion, newContentRegion))
+    if (!CGRectEqualToRect(_contentRegion, newContentRegion))
     {
         self.contentRegion = newContentRegion;
         CGRect textureRegion = CGRectMake(0, 0, _textureSize.width, _textureSize.height);
         [self fillRegion: textureRegion withRed: 0 green: 0 blue: 0 alpha: 0 error: NULL];
-        return [self fillRegion: newContentRegion withBytes: frame.bytes error: outError];
     }
-    //This branch is disabled for now because it was occasionally missing rows:
-    //this could be because of a logical error in the calculation of dirty ranges,
-    //or could be because of a change in OS X's GL server that has introduced some
-    //race condition with the multithreaded renderer.
-    //(My gut says that with modern drivers it's more efficient to upload all the texture
-    //data in a single call anyway, so the code below is a false optimisation.)
-    else
+    return [self fillRegion: newContentRegion withBytes: frame.bytes error: outError];
+}
+
+//IMPLEMENTATION NOTE: this used to be done for every frame, but was disabled because it was
+//occasionally missing rows. The culprit was the renderer skipping frames: each frame's dirty
+//regions only describe what changed since the frame immediately before it, so they cannot be
+//applied on top of any older frame. The renderer now checks frame sequence numbers before
+//calling this, and falls back on a full upload whenever it has missed a frame.
+- (BOOL) fillWithDirtyRegionsOfVideoFrame: (BXVideoFrame *)frame
+                         usingPixelBuffer: (GLuint)pixelBuffer
+                                    error: (NSError **)outError
+{
+    CGRect frameRegion = CGRectMake(0, 0, frame.size.width, frame.size.height);
+    if (!CGRectEqualToRect(_contentRegion, frameRegion))
+        return [self fillWithVideoFrame: frame error: outError];
+    
+    NSUInteger i, numRegions = frame.numDirtyRegions;
+    if (!numRegions)
+        return YES;
+    
+    //Coalesce the dirty regions into as few uploads as we can get away with.
+    //(DOSBox provides its dirty regions in order from top to bottom.)
+    NSRange mergedRegions[MAX_DIRTY_REGIONS];
+    NSUInteger numMergedRegions = 0, numDirtyLines = 0;
+    NSUInteger frameHeight = (NSUInteger)frame.size.height;
+    for (i=0; i < numRegions; i++)
     {
-        //Optimisation: only upload the changed regions to the texture.
-        //TODO: profile this and see if it's quicker under some circumstances
-        //to just upload the whole texture at once, e.g. if there's lots of small
-        //changed regions.
+        NSRange region = NSIntersectionRange([frame dirtyRegionAtIndex: i], NSMakeRange(0, frameHeight));
+        if (!region.length)
+            continue;
         
-        NSUInteger pitch = frame.pitch;
-        GLsizei frameWidth = (GLsizei)frame.size.width;
-        NSUInteger i, numRegions = frame.numDirtyRegions;
+        if (numMergedRegions > 0)
+        {
+            NSRange *previousRegion = &mergedRegions[numMergedRegions - 1];
+            if (region.location <= NSMaxRange(*previousRegion) + BXDirtyRegionMergeDistance)
+            {
+                numDirtyLines -= previousRegion->length;
+                *previousRegion = NSUnionRange(*previousRegion, region);
+                numDirtyLines += previousRegion->length;
+                continue;
+            }
+        }
         
-        CGLContextObj cgl_ctx = _context;
+        mergedRegions[numMergedRegions++] = region;
+        numDirtyLines += region.length;
+    }
+    
+    //If most of the frame has changed, it's cheaper to just upload the whole thing in one go.
+    if (numDirtyLines > frameHeight * BXDirtyRegionFullUploadThreshold)
+        return [self fillWithVideoFrame: frame error: outError];
+    
+    NSUInteger pitch = frame.pitch;
+    GLsizei frameWidth = (GLsizei)frame.size.width;
+    const GLubyte *frameBytes = (const GLubyte *)frame.bytes;
+    
+    CGLContextObj cgl_ctx = _context;
+    
+    //If we have a pixel buffer to work with, copy the dirty lines into it at the same offsets
+    //as in the frame. The texture uploads below will then read from the buffer rather than
+    //from client memory, which lets the driver perform them asynchronously.
+    if (pixelBuffer)
+    {
+        glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, pixelBuffer);
         
-        glBindTexture(_type, _texture);
+        //Orphan the buffer's previous contents, so that we don't have to wait for
+        //any uploads that are still using them.
+        glBufferDataARB(GL_PIXEL_UNPACK_BUFFER_ARB, frame.frameData.length, NULL, GL_STREAM_DRAW_ARB);
+        GLubyte *bufferBytes = (GLubyte *)glMapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, GL_WRITE_ONLY_ARB);
         
-        for (i=0; i < numRegions; i++)
+        if (bufferBytes)
         {
-            NSRange dirtyRegion = [frame dirtyRegionAtIndex: i];
-            NSUInteger regionOffset = dirtyRegion.location * pitch;
-            
-            NSAssert2(regionOffset < frame.frameData.length,
-                      @"Dirty region offset exceeded frame size: %lu (limit %lu)", (unsigned long)regionOffset, (unsigned long)frame.frameData.length);
-            
-            //Uggghhhh, pointer arithmetic
-            const void *regionBytes = frame.bytes + regionOffset;
-            
-            glTexSubImage2D(_type,
-                            0,                      //Mipmap level
-                            0,                      //X offset
-                            dirtyRegion.location,	//Y offset
-                            frameWidth,             //Width
-                            dirtyRegion.length,     //Height
-                            GL_BGRA,                //Byte ordering
-                            GL_UNSIGNED_INT_8_8_8_8_REV,    //Byte packing
-                            regionBytes);                   //Texture data
+            for (i=0; i < numMergedRegions; i++)
+            {
+                NSUInteger offset = mergedRegions[i].location * pitch;
+                memcpy(bufferBytes + offset, frameBytes + offset, mergedRegions[i].length * pitch);
+            }
+            glUnmapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB);
         }
+        //If we couldn't map the buffer, fall back on uploading straight from the frame.
+        else
+        {
+            glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+            pixelBuffer = 0;
+        }
+    }
+    
+    glBindTexture(_type, _texture);
+    
+    if (self.bytesPerTexel != 4)
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    
+    for (i=0; i < numMergedRegions; i++)
+    {
+        NSRange dirtyRegion = mergedRegions[i];
+        NSUInteger regionOffset = dirtyRegion.location * pitch;
+        
+        //While a pixel buffer is bound, texture data pointers are treated as offsets into the buffer.
+        const GLvoid *regionBytes;
+        if (pixelBuffer)
+            regionBytes = (const GLvoid *)regionOffset;
+        else
+            regionBytes = frameBytes + regionOffset;
         
-        BOOL succeeded = [self _checkForGLError: outError];
-            
-        return succeeded;
+        glTexSubImage2D(_type,
+                        0,                      //Mipmap level
+                        0,                      //X offset
+                        (GLint)dirtyRegion.location,    //Y offset
+                        frameWidth,             //Width
+                        (GLsizei)dirtyRegion.length,    //Height
+                        _pixelFormat,           //Byte ordering
+                        _pixelType,             //Byte packing
+                        regionBytes);                   //Texture data
+    }
+    
+    if (self.bytesPerTexel != 4)
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    
+    if (pixelBuffer)
+        glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+    
+    BOOL succeeded = [self _checkForGLError: outError];
+    
+    return succeeded;
+}
+
+- (BOOL) bindToSurfaceOfVideoFrame: (BXVideoFrame *)frame
+                             error: (NSError **)outError
+{
+    IOSurfaceRef surface = frame.surface;
+    if (!surface || _type != GL_TEXTURE_RECTANGLE_ARB)
+        return NO;
+    
+    GLsizei width = (GLsizei)frame.size.width, height = (GLsizei)frame.size.height;
+    
+    CGLContextObj cgl_ctx = _context;
+    glBindTexture(_type, _texture);
+    CGLError error = CGLTexImageIOSurface2D(cgl_ctx, _type, GL_RGBA8, width, height,
+                                            GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, surface, 0);
+    
+    if (error != kCGLNoError)
+    {
+        if (outError)
+        {
+            NSDictionary *userInfo = @{ NSLocalizedDescriptionKey: @(CGLErrorString(error)) };
+            *outError = [NSError errorWithDomain: ADBGLErrorDomain code: error userInfo: userInfo];
+        }
+        return NO;
     }
+    
+    _textureSize = CGSizeMake(width, height);
+    _contentRegion = CGRectMake(0, 0, width, height);
+    return YES;
 }
 
 - (BOOL) canAccomodateVideoFrame: (BXVideoFrame *)frame
 {
-    return [self canAccommodateContentSize: NSSizeToCGSize(frame.size)];
+    return [self canAccommodateContentSize: NSSizeToCGSize(frame.size)] && self.bytesPerTexel == frame.bytesPerPixel;
 }
 @end
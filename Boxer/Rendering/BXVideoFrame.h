@@ -10,7 +10,19 @@
 //to draw as an OpenGL texture. It keeps track of the frame's resolution, bit depth and intended
 //display scale.
 
+//Where possible, 32-bit frames are stored in an IOSurface, which DOSBox draws into directly and
+//which renderers can bind as a texture without copying the frame up to the GPU.
+
+//8-bit frames are indexed: each pixel is an index into the frame's 256-color palette, which
+//renderers look up on the GPU. This keeps a palette-cycling effect down to a 1KB palette upload.
+//Indexed frames from the CGA's composite color mode instead hold the raw pixel bits that the CGA
+//sent down the composite cable, which renderers decode into color as an NTSC signal.
+
+//The SVGA hardware cursor is not drawn into the frame: frames carry its image and position
+//for renderers to draw over the frame, so that moving the cursor changes no lines of the frame.
+
 #import <Foundation/Foundation.h>
+#import <IOSurface/IOSurface.h>
 
 //The standard 4:3 aspect ratio of old displays
 extern const CGFloat BX4by3AspectRatio; 
@@ -22,19 +34,42 @@ extern const CGFloat BX4by3AspectRatio;
 //This is set to the maximum vertical resolution expected from a DOS game.
 #define MAX_DIRTY_REGIONS 1024
 
+//The number of entries in the palette of an indexed frame.
+#define BXVideoFramePaletteSize 256
+
+//The width and height in pixels of the hardware cursor image.
+#define BXVideoFrameHardwareCursorSize 64
+
 @interface BXVideoFrame : NSObject
 {
 	NSMutableData *_frameData;
+    IOSurfaceRef _surface;
 	NSSize _size;
 	NSSize _baseResolution;
 	NSUInteger _bytesPerPixel;
 	NSSize _intendedScale;
     BOOL _containsText;
     
+    uint32_t _palette[BXVideoFramePaletteSize];
+    NSUInteger _paletteVersion;
+    
+    BOOL _composite;
+    CGFloat _compositeHue;
+    uint32_t _compositeColor;
+    
+    NSData *_hardwareCursorImage;
+    NSUInteger _hardwareCursorVersion;
+    NSRect _hardwareCursorRegion;
+    
     NSRange _dirtyRegions[MAX_DIRTY_REGIONS];
     NSUInteger _numDirtyRegions;
     
     NSTimeInterval _timestamp;
+    CGFloat _refreshRate;
+    
+    NSUInteger _sequenceNumber;
+    NSUInteger _readerCount;
+    BOOL _beingWritten;
 }
 
 #pragma mark -
@@ -47,6 +82,44 @@ extern const CGFloat BX4by3AspectRatio;
 //is bytesPerPixel * size.width * size.height.
 @property (readonly) NSUInteger bytesPerPixel;
 
+//Whether the frame is 8-bit, with its pixels being indexes into the palette below.
+//Otherwise, the frame's pixels are 32-bit BGRA.
+@property (readonly, getter=isIndexed) BOOL indexed;
+
+//The palette of an indexed frame: BXVideoFramePaletteSize BGRA colors in the same format
+//as the pixels of a 32-bit frame.
+@property (readonly) const uint32_t *palette;
+
+//Identifies the contents of the palette: frames with the same palette version have the same
+//palette. This is 0 for frames that have never been given a palette.
+@property (readonly) NSUInteger paletteVersion;
+
+//Whether the frame is an indexed frame of composite CGA output. Each pixel of such a frame is
+//1 or 0 for whether the CGA's signal was high or low at that point: four of the original
+//pixels make up one cycle of the NTSC color carrier. The frame's palette is not used.
+@property (assign, getter=isComposite) BOOL composite;
+
+//The hue in radians by which to rotate the colors decoded from a composite frame.
+@property (assign) CGFloat compositeHue;
+
+//The BGRA color by which to scale the colors decoded from a composite frame: this stands
+//in for the CGA's foreground color.
+@property (assign) uint32_t compositeColor;
+
+//The image of the SVGA hardware cursor to draw over the frame, or nil if the cursor is not shown.
+//This is BXVideoFrameHardwareCursorSize pixels square, in 32-bit BGRA: pixels with an alpha
+//of 255 are drawn in their color, white pixels with an alpha of 0 invert the frame beneath them,
+//and pixels of 0 are transparent.
+@property (retain) NSData *hardwareCursorImage;
+
+//Identifies the contents of the hardware cursor image: frames with the same version
+//have the same image.
+@property (assign) NSUInteger hardwareCursorVersion;
+
+//Where to draw the hardware cursor image, in pixels of the base resolution
+//measured from the top left of the frame.
+@property (assign) NSRect hardwareCursorRegion;
+
 //The width in bytes of one scanline in the buffer.
 //This is equal to size.width * bytesPerPixel.
 @property (readonly) NSUInteger pitch;
@@ -77,11 +150,29 @@ extern const CGFloat BX4by3AspectRatio;
 //The absolute time which this frame represents. Updated each time a frame update is completed by the emulator.
 @property (assign) CFAbsoluteTime timestamp;
 
-//Read-only/mutable pointers to the frame's data.
+//The refresh rate in Hz of the emulated display when the frame was drawn, in emulated time.
+@property (assign) CGFloat refreshRate;
+
+//Read-only/mutable pointers to the frame's data. If the frame is backed by an IOSurface,
+//frameData wraps the surface's memory and cannot be resized.
 @property (readonly) NSMutableData *frameData;
 @property (readonly) const void *bytes;
 @property (readonly) void *mutableBytes;
 
+//The position of this frame in the sequence of frames produced by the emulator.
+//Assigned by BXVideoFramePool each time the frame is completed, and 0 for frames
+//that have never been completed. Consumers can compare this against the sequence
+//number of the last frame they processed to tell whether they have missed any frames.
+@property (assign) NSUInteger sequenceNumber;
+
+//Whether the frame is currently checked out for writing by the emulator.
+@property (readonly, getter=isBeingWritten) BOOL beingWritten;
+
+//The IOSurface in which the frame's data is stored, or NULL if the frame is stored in ordinary
+//memory (e.g. because it is not 32-bit or because IOSurfaces are unavailable.) The surface
+//is in BGRA format with no padding between scanlines, and is replaced if the frame is resized.
+@property (readonly) IOSurfaceRef surface;
+
 //The number of ranges of dirty lines. Incremented by setNeedsDisplayInRegion:
 //and reset to 0 by clearDirtyRegions. See the dirty region functions below.
 @property (readonly, assign) NSUInteger numDirtyRegions;
@@ -111,6 +202,14 @@ extern const CGFloat BX4by3AspectRatio;
 //Resets the aspect ratio of the frame to use unscaled square pixels.
 - (void) useSquarePixels;
 
+//Replaces the frame's palette with the specified BXVideoFramePaletteSize colors, unless it
+//already has the specified version of the palette. This has no effect on 32-bit frames.
+- (void) setPalette: (const uint32_t *)palette version: (NSUInteger)version;
+
+//Returns a copy of the frame's pixels as 32-bit BGRA, looking indexed frames up through
+//their palette and decoding composite frames. The pitch of the returned data is size.width * 4.
+- (NSData *) BGRAData;
+
 
 #pragma mark -
 #pragma mark Flagging scanlines of the frame as dirty.
@@ -120,4 +219,25 @@ extern const CGFloat BX4by3AspectRatio;
 
 - (NSRange) dirtyRegionAtIndex: (NSUInteger)region;
 
+
+#pragma mark -
+#pragma mark Sharing frames between threads
+
+//Called by consumers before reading the frame's contents from another thread.
+//Returns NO if the frame is currently being written to, in which case the frame
+//must not be read: a more recent frame will already be on its way.
+//Each successful call to beginReading must be balanced with a call to endReading.
+- (BOOL) beginReading;
+- (void) endReading;
+
+//Called by BXVideoFramePool before and after the emulator draws into the frame.
+//beginWriting returns NO if the frame is currently being read by any consumer.
+- (BOOL) beginWriting;
+- (void) endWriting;
+
+//Resizes the frame to the specified size and depth, reusing the existing backing store
+//where possible. This should only be called while the frame is checked out for writing.
+//The contents of the frame will be undefined afterwards.
+- (void) resizeToSize: (NSSize)targetSize depth: (NSUInteger)depth;
+
 @end
@@ -11,8 +11,75 @@
 
 const CGFloat BX4by3AspectRatio = (CGFloat)320.0 / (CGFloat)240.0;
 
+
+//Decodes one line of a composite frame into BGRA. This must match the composite shader in
+//BXBasicRenderer: luma is averaged, and chroma demodulated, over a window of two carrier cycles
+//centered on each of the original pixels, then the chroma is rotated by the hue and the result
+//converted from YIQ to RGB and scaled by the foreground color.
+static void _BXDecodeCompositeLine(const uint8_t *signal, NSUInteger width, NSUInteger numSamples,
+                                   CGFloat hue, uint32_t color, uint32_t *output)
+{
+    double texelsPerSample = (double)width / (double)numSamples;
+    double cosHue = cos(hue), sinHue = sin(hue);
+    double red = ((color >> 16) & 0xff), green = ((color >> 8) & 0xff), blue = (color & 0xff);
+    
+    NSInteger n, k;
+    NSUInteger x = 0;
+    for (n=0; n < (NSInteger)numSamples; n++)
+    {
+        double Y = 0, I = 0, Q = 0;
+        for (k=-4; k<4; k++)
+        {
+            NSInteger m = n + k;
+            NSInteger texel = (NSInteger)((m + 0.5) * texelsPerSample);
+            texel = MIN(MAX(texel, 0), (NSInteger)width - 1);
+            if (!signal[texel])
+                continue;
+            
+            double weight = 4.5 - fabs(k + 0.5);
+            Y += weight;
+            switch (m & 3)
+            {
+                case 0: I += weight; break;
+                case 1: Q += weight; break;
+                case 2: I -= weight; break;
+                case 3: Q -= weight; break;
+            }
+        }
+        Y /= 20.0;
+        I /= 15.0;
+        Q /= 15.0;
+        
+        double rotatedI = I * cosHue + Q * sinHue;
+        double rotatedQ = Q * cosHue - I * sinHue;
+        double R = Y + 0.956 * rotatedI + 0.621 * rotatedQ;
+        double G = Y - 0.272 * rotatedI - 0.647 * rotatedQ;
+        double B = Y - 1.105 * rotatedI + 1.702 * rotatedQ;
+        
+        uint32_t r = (uint32_t)(MIN(MAX(R, 0.0), 1.0) * red);
+        uint32_t g = (uint32_t)(MIN(MAX(G, 0.0), 1.0) * green);
+        uint32_t b = (uint32_t)(MIN(MAX(B, 0.0), 1.0) * blue);
+        uint32_t pixel = b | (g << 8) | (r << 16) | (255U << 24);
+        
+        NSUInteger endX = (NSUInteger)((n + 1) * texelsPerSample);
+        for (; x < endX && x < width; x++)
+            output[x] = pixel;
+    }
+    for (; x < width; x++)
+        output[x] = output[x - 1];
+}
+
 @interface BXVideoFrame ()
 @property (readwrite, assign) NSUInteger numDirtyRegions;
+
+//Allocates storage for the frame's current size and depth, in an IOSurface if possible.
+- (void) _allocateStorage;
+- (void) _releaseStorage;
+
+//Creates a BGRA IOSurface of the specified size whose scanlines are exactly
+//width * 4 bytes apart. Returns NULL if no such surface could be created.
++ (IOSurfaceRef) _newSurfaceWithSize: (NSSize)size;
+
 @end
 
 @implementation BXVideoFrame
@@ -24,6 +91,17 @@ const CGFloat BX4by3AspectRatio = (CGFloat)320.0 / (CGFloat)240.0;
 @synthesize numDirtyRegions = _numDirtyRegions;
 @synthesize containsText = _containsText;
 @synthesize timestamp = _timestamp;
+@synthesize sequenceNumber = _sequenceNumber;
+@synthesize beingWritten = _beingWritten;
+@synthesize surface = _surface;
+@synthesize paletteVersion = _paletteVersion;
+@synthesize composite = _composite;
+@synthesize compositeHue = _compositeHue;
+@synthesize compositeColor = _compositeColor;
+@synthesize hardwareCursorImage = _hardwareCursorImage;
+@synthesize hardwareCursorVersion = _hardwareCursorVersion;
+@synthesize hardwareCursorRegion = _hardwareCursorRegion;
+@synthesize refreshRate = _refreshRate;
 
 
 + (NSSize) scalingFactorForSize: (NSSize)frameSize toAspectRatio: (CGFloat)aspectRatio
@@ -63,18 +141,73 @@ const CGFloat BX4by3AspectRatio = (CGFloat)320.0 / (CGFloat)240.0;
 		_bytesPerPixel	= depth;
 		_intendedScale	= NSMakeSize(1.0f, 1.0f);
 		
-		NSUInteger requiredLength = _size.width * _size.height * _bytesPerPixel;
-		_frameData = [[NSMutableData alloc] initWithLength: requiredLength];
+        [self _allocateStorage];
 	}
 	return self;
 }
 
 - (void) dealloc
 {
-	[_frameData release], _frameData = nil;
+    [self _releaseStorage];
+    self.hardwareCursorImage = nil;
 	[super dealloc];
 }
 
++ (IOSurfaceRef) _newSurfaceWithSize: (NSSize)size
+{
+    NSUInteger width = (NSUInteger)size.width, height = (NSUInteger)size.height;
+    if (!width || !height)
+        return NULL;
+    
+    //We ask for tightly-packed scanlines, since the rest of Boxer assumes the pitch of a frame
+    //is its width in bytes: but IOSurface may insist on padding them, in which case we'll do without.
+    NSUInteger pitch = width * 4;
+    NSDictionary *properties = @{
+        (id)kIOSurfaceWidth:            @(width),
+        (id)kIOSurfaceHeight:           @(height),
+        (id)kIOSurfaceBytesPerElement:  @(4),
+        (id)kIOSurfaceBytesPerRow:      @(pitch),
+        (id)kIOSurfacePixelFormat:      @((uint32_t)'BGRA'),
+    };
+    
+    IOSurfaceRef surface = IOSurfaceCreate((CFDictionaryRef)properties);
+    if (surface && IOSurfaceGetBytesPerRow(surface) != pitch)
+    {
+        CFRelease(surface);
+        surface = NULL;
+    }
+    return surface;
+}
+
+- (void) _allocateStorage
+{
+    NSUInteger requiredLength = _size.width * _size.height * _bytesPerPixel;
+    
+    if (_bytesPerPixel == 4)
+        _surface = [self.class _newSurfaceWithSize: _size];
+    
+    if (_surface)
+    {
+        _frameData = [[NSMutableData alloc] initWithBytesNoCopy: IOSurfaceGetBaseAddress(_surface)
+                                                         length: requiredLength
+                                                   freeWhenDone: NO];
+    }
+    else
+    {
+        _frameData = [[NSMutableData alloc] initWithLength: requiredLength];
+    }
+}
+
+- (void) _releaseStorage
+{
+    [_frameData release], _frameData = nil;
+    if (_surface)
+    {
+        CFRelease(_surface);
+        _surface = NULL;
+    }
+}
+
 - (NSUInteger) pitch
 {
 	return self.size.width * self.bytesPerPixel;
@@ -91,6 +224,53 @@ const CGFloat BX4by3AspectRatio = (CGFloat)320.0 / (CGFloat)240.0;
     self.intendedScale = NSMakeSize(1, 1);
 }
 
+- (BOOL) isIndexed
+{
+    return (self.bytesPerPixel == 1);
+}
+
+- (const uint32_t *) palette
+{
+    return _palette;
+}
+
+- (void) setPalette: (const uint32_t *)palette version: (NSUInteger)version
+{
+    if (self.isIndexed && version != _paletteVersion)
+    {
+        memcpy(_palette, palette, sizeof(_palette));
+        _paletteVersion = version;
+    }
+}
+
+- (NSData *) BGRAData
+{
+    if (!self.isIndexed)
+        return [NSData dataWithBytes: self.bytes length: _frameData.length];
+    
+    NSUInteger i, numPixels = _frameData.length;
+    NSMutableData *data = [NSMutableData dataWithLength: numPixels * 4];
+    const uint8_t *indexes = (const uint8_t *)self.bytes;
+    uint32_t *pixels = (uint32_t *)data.mutableBytes;
+    
+    if (self.isComposite)
+    {
+        NSUInteger width = (NSUInteger)self.size.width, height = (NSUInteger)self.size.height;
+        NSUInteger numSamples = MAX((NSUInteger)self.baseResolution.width, 1U);
+        for (i=0; i<height && width; i++)
+        {
+            _BXDecodeCompositeLine(indexes + (i * width), width, numSamples,
+                                   self.compositeHue, self.compositeColor, pixels + (i * width));
+        }
+        return data;
+    }
+    
+    for (i=0; i<numPixels; i++)
+        pixels[i] = _palette[indexes[i]];
+    
+    return data;
+}
+
 - (NSSize) scaledSize
 {
 	return NSMakeSize(roundf(self.size.width    * self.intendedScale.width),
@@ -152,4 +332,89 @@ const CGFloat BX4by3AspectRatio = (CGFloat)320.0 / (CGFloat)240.0;
     return _dirtyRegions[regionIndex];
 }
 
+
+#pragma mark Thread access
+
+- (BOOL) beginReading
+{
+    @synchronized(self)
+    {
+        if (_beingWritten)
+            return NO;
+        
+        _readerCount++;
+        return YES;
+    }
+}
+
+- (void) endReading
+{
+    @synchronized(self)
+    {
+        NSAssert(_readerCount > 0, @"endReading called without a matching beginReading.");
+        _readerCount--;
+    }
+}
+
+- (BOOL) beginWriting
+{
+    @synchronized(self)
+    {
+        if (_readerCount > 0 || _beingWritten)
+            return NO;
+        
+        _beingWritten = YES;
+    }
+    
+    //Locking the surface waits for the GPU to finish with any earlier rendering from it.
+    if (_surface)
+        IOSurfaceLock(_surface, 0, NULL);
+    
+    return YES;
+}
+
+- (void) endWriting
+{
+    if (_surface)
+        IOSurfaceUnlock(_surface, 0, NULL);
+    
+    @synchronized(self)
+    {
+        _beingWritten = NO;
+    }
+}
+
+- (void) resizeToSize: (NSSize)targetSize depth: (NSUInteger)depth
+{
+    NSAssert(self.isBeingWritten, @"resizeToSize:depth: called on a frame that was not checked out for writing.");
+    
+    _size           = targetSize;
+    _baseResolution = targetSize;
+    _bytesPerPixel  = depth;
+    _intendedScale  = NSMakeSize(1.0f, 1.0f);
+    
+    //IOSurfaces can't be resized, so surface-backed frames get a new surface altogether.
+    if (_surface || _bytesPerPixel == 4)
+    {
+        if (_surface)
+            IOSurfaceUnlock(_surface, 0, NULL);
+        
+        [self _releaseStorage];
+        [self _allocateStorage];
+        
+        if (_surface)
+            IOSurfaceLock(_surface, 0, NULL);
+    }
+    //NSMutableData will keep hold of its existing allocation when shrinking,
+    //and will try to grow in place when expanding.
+    else
+    {
+        NSUInteger requiredLength = _size.width * _size.height * _bytesPerPixel;
+        _frameData.length = requiredLength;
+    }
+    
+    [self clearDirtyRegions];
+    _sequenceNumber = 0;
+}
+
 @end
@@ -0,0 +1,81 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+
+//BXVideoFramePool manages a small set of recycled BXVideoFrames shared between the emulation
+//thread, which draws into them, and the renderers, which read them back later on whatever thread
+//they render on. While the emulator is drawing into one frame, renderers are free to read from
+//any completed frame without either side having to wait for the other.
+
+//Because DOSBox only redraws the lines that have changed since the previous frame, the pool
+//brings each recycled frame up to date with the most recently completed frame before handing
+//it out, copying only the lines that have changed in the meantime.
+
+#import <Foundation/Foundation.h>
+
+//The number of frames the pool will normally keep around: one being drawn by the emulator,
+//one waiting to be rendered and one being read by the renderer.
+#define BXVideoFramePoolDefaultCapacity 3
+
+@class BXVideoFrame;
+@interface BXVideoFramePool : NSObject
+{
+    NSMutableArray *_frames;
+    BXVideoFrame *_latestFrame;
+    NSUInteger _capacity;
+
+    NSSize _frameSize;
+    NSUInteger _frameDepth;
+    NSUInteger _lastSequenceNumber;
+}
+
+#pragma mark -
+#pragma mark Properties
+
+//The number of frames the pool will try to get by with. If every frame is in use
+//when a new one is needed, the pool will grow beyond this rather than wait.
+@property (readonly, nonatomic) NSUInteger capacity;
+
+//The size and bytes-per-pixel of the frames that the pool will hand out.
+//Change these with setFrameSize:depth:.
+@property (readonly, nonatomic) NSSize frameSize;
+@property (readonly, nonatomic) NSUInteger frameDepth;
+
+//The most recently completed frame. This frame will not be handed out for writing again
+//until a more recent frame has been completed.
+@property (readonly, retain) BXVideoFrame *latestFrame;
+
+
+#pragma mark -
+#pragma mark Initializers
+
+- (id) initWithCapacity: (NSUInteger)capacity;
+
+
+#pragma mark -
+#pragma mark Methods
+
+//Updates the size and depth of frames handed out by the pool. Existing frames will be
+//reshaped in place the next time they are checked out, rather than reallocated.
+- (void) setFrameSize: (NSSize)frameSize depth: (NSUInteger)depth;
+
+//Returns a frame that is not in use by any reader or by the emulator, with its contents
+//matching the latest completed frame and its dirty regions cleared. The frame must later
+//be returned to the pool with commitFrame: or cancelFrame:.
+- (BXVideoFrame *) checkoutFrameForWriting;
+
+//Marks a frame checked out by checkoutFrameForWriting as complete, making it the latest frame.
+- (void) commitFrame: (BXVideoFrame *)frame;
+
+//Returns a frame checked out by checkoutFrameForWriting to the pool without completing it.
+//Its contents will be resynced from the latest frame if it is handed out again.
+- (void) cancelFrame: (BXVideoFrame *)frame;
+
+//Releases all frames that are not currently in use.
+- (void) drain;
+
+@end
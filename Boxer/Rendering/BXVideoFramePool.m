@@ -0,0 +1,201 @@
+/*
+ Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+ This source file is released under the GNU General Public License 2.0. A full copy of this license
+ can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+ online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+ */
+
+
+#import "BXVideoFramePool.h"
+#import "BXVideoFrame.h"
+
+
+#pragma mark -
+#pragma mark Private interface declarations
+
+@interface BXVideoFramePool ()
+
+@property (readwrite, retain) BXVideoFrame *latestFrame;
+
+//Copies into the specified frame all the lines that have changed in the latest frame
+//since the specified frame was last completed. If this cannot be determined (because
+//intervening frames have since been recycled) then the whole frame is copied.
+- (void) _syncFrameWithLatestFrame: (BXVideoFrame *)frame;
+
+@end
+
+
+@implementation BXVideoFramePool
+@synthesize capacity = _capacity;
+@synthesize frameSize = _frameSize;
+@synthesize frameDepth = _frameDepth;
+@synthesize latestFrame = _latestFrame;
+
+- (id) init
+{
+    return [self initWithCapacity: BXVideoFramePoolDefaultCapacity];
+}
+
+- (id) initWithCapacity: (NSUInteger)capacity
+{
+    self = [super init];
+    if (self)
+    {
+        _capacity = capacity;
+        _frames = [[NSMutableArray alloc] initWithCapacity: capacity];
+    }
+    return self;
+}
+
+- (void) dealloc
+{
+    self.latestFrame = nil;
+    [_frames release], _frames = nil;
+    [super dealloc];
+}
+
+- (void) setFrameSize: (NSSize)frameSize depth: (NSUInteger)depth
+{
+    if (!NSEqualSizes(frameSize, _frameSize) || depth != _frameDepth)
+    {
+        _frameSize = frameSize;
+        _frameDepth = depth;
+
+        //The latest frame is no longer any use as a source for new frames.
+        self.latestFrame = nil;
+    }
+}
+
+- (BXVideoFrame *) checkoutFrameForWriting
+{
+    //Look for the most recently completed frame that isn't the latest one and isn't
+    //being read: this will be the cheapest one to bring up to date.
+    BXVideoFrame *chosenFrame = nil;
+    for (BXVideoFrame *frame in _frames)
+    {
+        if (frame == self.latestFrame)
+            continue;
+
+        if (chosenFrame && frame.sequenceNumber <= chosenFrame.sequenceNumber)
+            continue;
+
+        if ([frame beginWriting])
+        {
+            [chosenFrame endWriting];
+            chosenFrame = frame;
+        }
+    }
+
+    //If all our frames are in use, make a new one. We prefer to grow beyond our capacity
+    //rather than wait for a reader to finish with one of the existing frames.
+    if (!chosenFrame)
+    {
+        if (_frames.count >= self.capacity)
+        {
+            NSLog(@"All %lu frames in the video frame pool are in use, allocating another.", (unsigned long)_frames.count);
+        }
+
+        chosenFrame = [BXVideoFrame frameWithSize: self.frameSize depth: self.frameDepth];
+        [chosenFrame beginWriting];
+        [_frames addObject: chosenFrame];
+    }
+
+    if (!NSEqualSizes(chosenFrame.size, self.frameSize) || chosenFrame.bytesPerPixel != self.frameDepth)
+    {
+        [chosenFrame resizeToSize: self.frameSize depth: self.frameDepth];
+    }
+
+    [self _syncFrameWithLatestFrame: chosenFrame];
+    [chosenFrame clearDirtyRegions];
+
+    return chosenFrame;
+}
+
+- (void) commitFrame: (BXVideoFrame *)frame
+{
+    NSAssert(frame.isBeingWritten, @"commitFrame: called with a frame that was not checked out.");
+
+    _lastSequenceNumber++;
+    frame.sequenceNumber = _lastSequenceNumber;
+
+    self.latestFrame = frame;
+    [frame endWriting];
+}
+
+- (void) cancelFrame: (BXVideoFrame *)frame
+{
+    NSAssert(frame.isBeingWritten, @"cancelFrame: called with a frame that was not checked out.");
+
+    //The frame may have been partially drawn to, so we can no longer tell what it contains.
+    frame.sequenceNumber = 0;
+    [frame endWriting];
+}
+
+- (void) drain
+{
+    for (BXVideoFrame *frame in [NSArray arrayWithArray: _frames])
+    {
+        if (frame != self.latestFrame && [frame beginWriting])
+        {
+            [frame endWriting];
+            [_frames removeObject: frame];
+        }
+    }
+}
+
+- (void) _syncFrameWithLatestFrame: (BXVideoFrame *)frame
+{
+    BXVideoFrame *latestFrame = self.latestFrame;
+
+    if (!latestFrame || latestFrame == frame)
+        return;
+
+    //If the frame has changed shape since the latest frame was drawn, the emulator
+    //will be redrawing it from scratch anyway.
+    if (!NSEqualSizes(latestFrame.size, frame.size) || latestFrame.bytesPerPixel != frame.bytesPerPixel)
+        return;
+
+    NSUInteger pitch = frame.pitch;
+    const uint8_t *sourceBytes = (const uint8_t *)latestFrame.bytes;
+    uint8_t *destinationBytes = (uint8_t *)frame.mutableBytes;
+
+    //Check that every frame completed since this one was last completed is still
+    //in the pool with its dirty regions intact.
+    NSUInteger staleSequence = frame.sequenceNumber;
+    NSUInteger numMissedFrames = latestFrame.sequenceNumber - staleSequence;
+    NSMutableArray *intermediateFrames = [NSMutableArray arrayWithCapacity: _frames.count];
+
+    if (staleSequence > 0)
+    {
+        for (BXVideoFrame *otherFrame in _frames)
+        {
+            if (otherFrame.sequenceNumber > staleSequence && NSEqualSizes(otherFrame.size, frame.size))
+                [intermediateFrames addObject: otherFrame];
+        }
+    }
+
+    if (staleSequence == 0 || intermediateFrames.count != numMissedFrames)
+    {
+        memcpy(destinationBytes, sourceBytes, latestFrame.frameData.length);
+    }
+    else
+    {
+        NSUInteger maxLine = frame.size.height;
+        for (BXVideoFrame *otherFrame in intermediateFrames)
+        {
+            NSUInteger i, numRegions = otherFrame.numDirtyRegions;
+            for (i=0; i<numRegions; i++)
+            {
+                NSRange region = [otherFrame dirtyRegionAtIndex: i];
+                if (region.location >= maxLine)
+                    continue;
+
+                NSUInteger length = MIN(region.length, maxLine - region.location);
+                NSUInteger offset = region.location * pitch;
+                memcpy(destinationBytes + offset, sourceBytes + offset, length * pitch);
+            }
+        }
+    }
+}
+
+@end
@@ -7,7 +7,171 @@
 
 #import <Cocoa/Cocoa.h>
 
+//Imported only for its method declarations: the standalone app controller is looked up
+//at runtime, since it isn't compiled into the main Boxer app.
+#import "BXStandaloneAppController.h"
+#import "BXReplayBenchmark.h"
+#import "BXCPUBenchmark.h"
+
+
+//Writes the results of a benchmark as JSON to the file at the specified path, or to stdout if path is NULL.
+static BOOL _writeBenchmarkReport(NSDictionary *results, const char *path)
+{
+    NSError *writeError = nil;
+    NSData *report = [NSJSONSerialization dataWithJSONObject: results
+                                                     options: NSJSONWritingPrettyPrinted
+                                                       error: &writeError];
+    BOOL wrote;
+    if (path)
+    {
+        NSURL *reportURL = [NSURL fileURLWithPath: [[NSFileManager defaultManager] stringWithFileSystemRepresentation: path
+                                                                                                               length: strlen(path)]];
+        wrote = [report writeToURL: reportURL options: NSDataWritingAtomic error: &writeError];
+    }
+    else
+    {
+        wrote = (report != nil);
+        [[NSFileHandle fileHandleWithStandardOutput] writeData: report];
+    }
+    
+    if (!wrote)
+        NSLog(@"Could not write benchmark report: %@", writeError);
+    
+    return wrote;
+}
+
 int main(int argc, char *argv[])
 {
+    //Boxer Bundler runs exported standalone apps with --write-launch-manifest <path>,
+    //to have them precompute the launch manifest for their bundled gamebox without starting up.
+    if (argc == 3 && strcmp(argv[1], "--write-launch-manifest") == 0)
+    {
+        @autoreleasepool
+        {
+            Class standaloneClass = NSClassFromString(@"BXStandaloneAppController");
+            NSURL *gameboxURL = [standaloneClass bundledGameboxURL];
+            if (!gameboxURL)
+                return EXIT_FAILURE;
+            
+            NSURL *manifestURL = [NSURL fileURLWithPath: [[NSFileManager defaultManager] stringWithFileSystemRepresentation: argv[2]
+                                                                                                                    length: strlen(argv[2])]];
+            NSError *writeError = nil;
+            BOOL wrote = [standaloneClass writeLaunchManifestForGameboxAtURL: gameboxURL
+                                                                       toURL: manifestURL
+                                                                       error: &writeError];
+            if (!wrote)
+            {
+                NSLog(@"Could not write launch manifest: %@", writeError);
+                return EXIT_FAILURE;
+            }
+            return EXIT_SUCCESS;
+        }
+    }
+    
+    //--replay-benchmark <replay folder> [report path] plays back a replay recorded with Start Recording Replay
+    //as fast as possible without any UI, and writes a JSON report of the results to the report path or stdout.
+    if ((argc == 3 || argc == 4) && strcmp(argv[1], "--replay-benchmark") == 0)
+    {
+        @autoreleasepool
+        {
+            NSFileManager *manager = [NSFileManager defaultManager];
+            NSURL *replayURL = [NSURL fileURLWithPath: [manager stringWithFileSystemRepresentation: argv[2]
+                                                                                            length: strlen(argv[2])]];
+            
+            //The emulator still expects an application to exist, even though we never run it.
+            [NSApplication sharedApplication];
+            
+            BXReplayBenchmark *benchmark = [[[BXReplayBenchmark alloc] initWithReplayURL: replayURL] autorelease];
+            NSDictionary *results = [benchmark run];
+            if (!results)
+            {
+                NSLog(@"Could not finish replay: %@", benchmark.error);
+                return EXIT_FAILURE;
+            }
+            
+            if (!_writeBenchmarkReport(results, (argc == 4) ? argv[3] : NULL))
+                return EXIT_FAILURE;
+            
+            //A replay that went differently from its recording can't be compared with other runs.
+            BOOL matched = [[results objectForKey: BXReplayBenchmarkChecksumMatchesKey] boolValue];
+            return matched ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    
+    //--audio-benchmark <replay folder> <host load percentage> <maximum underruns> [report path] plays back
+    //a replay in real time without any UI, while keeping each host CPU busy for the specified share of the time.
+    //It writes a JSON report of the results like --replay-benchmark, and fails if the sound output ran dry
+    //more than the specified number of times.
+    if ((argc == 5 || argc == 6) && strcmp(argv[1], "--audio-benchmark") == 0)
+    {
+        @autoreleasepool
+        {
+            NSFileManager *manager = [NSFileManager defaultManager];
+            NSURL *replayURL = [NSURL fileURLWithPath: [manager stringWithFileSystemRepresentation: argv[2]
+                                                                                            length: strlen(argv[2])]];
+            double hostLoad = MAX(0.0, MIN(atof(argv[3]) / 100.0, 1.0));
+            NSUInteger maxUnderruns = (NSUInteger)strtoul(argv[4], NULL, 10);
+            
+            [NSApplication sharedApplication];
+            
+            BXReplayBenchmark *benchmark = [[[BXReplayBenchmark alloc] initWithReplayURL: replayURL] autorelease];
+            benchmark.measuresAudio = YES;
+            benchmark.hostLoad = hostLoad;
+            
+            NSDictionary *results = [benchmark run];
+            if (!results)
+            {
+                NSLog(@"Could not finish replay: %@", benchmark.error);
+                return EXIT_FAILURE;
+            }
+            
+            if (!_writeBenchmarkReport(results, (argc == 6) ? argv[5] : NULL))
+                return EXIT_FAILURE;
+            
+            BOOL matched = [[results objectForKey: BXReplayBenchmarkChecksumMatchesKey] boolValue];
+            if (!matched)
+                return EXIT_FAILURE;
+            
+            //A configuration with no sound output can't tell us anything about underruns.
+            NSUInteger callbacks = [[results objectForKey: BXReplayBenchmarkAudioCallbacksKey] unsignedIntegerValue];
+            NSUInteger underruns = [[results objectForKey: BXReplayBenchmarkAudioUnderrunsKey] unsignedIntegerValue];
+            if (!callbacks)
+            {
+                NSLog(@"The replay played no sound.");
+                return EXIT_FAILURE;
+            }
+            if (underruns > maxUnderruns)
+            {
+                NSLog(@"Sound ran dry %lu times at %.0f%% host load, more than the %lu allowed.",
+                      (unsigned long)underruns, hostLoad * 100, (unsigned long)maxUnderruns);
+                return EXIT_FAILURE;
+            }
+            return EXIT_SUCCESS;
+        }
+    }
+    
+    //--cpu-benchmark [report path] runs a set of guest programs under each of DOSBox's CPU cores
+    //without any UI, and writes a JSON report of the results to the report path or stdout.
+    if ((argc == 2 || argc == 3) && strcmp(argv[1], "--cpu-benchmark") == 0)
+    {
+        @autoreleasepool
+        {
+            [NSApplication sharedApplication];
+            
+            BXCPUBenchmark *benchmark = [[[BXCPUBenchmark alloc] init] autorelease];
+            NSDictionary *results = [benchmark run];
+            if (!results)
+            {
+                NSLog(@"Could not finish CPU benchmark.");
+                return EXIT_FAILURE;
+            }
+            
+            if (!_writeBenchmarkReport(results, (argc == 3) ? argv[2] : NULL))
+                return EXIT_FAILURE;
+            
+            return EXIT_SUCCESS;
+        }
+    }
+    
     return NSApplicationMain(argc,  (const char **) argv);
 }
@@ -16,6 +16,9 @@ extern NSString * const BBAppExportErrorDomain;
 typedef NS_ENUM(NSInteger, BBAppExportErrorCode) {
     /// The app could not be code-signed successfully.
     BBAppExportCodeSignFailed,
+    
+    /// The app could not generate a launch manifest for its gamebox.
+    BBAppExportLaunchManifestFailed,
 };
 
 /// The NSError userInfo key listing the code signing identity used for a failed code sign.
@@ -10,10 +10,86 @@
 #import "NSURL+ADBFilesystemHelpers.h"
 #import "NSImage+ADBSaveImages.h"
 #import "BBIconDropzone.h"
+#import <CommonCrypto/CommonDigest.h>
+#import <copyfile.h>
+#import <dlfcn.h>
+#import <sys/stat.h>
 
 NSString * const BBAppExportErrorDomain = @"BBAppExportErrorDomain";
 NSString * const BBAppExportCodeSigningIdentityKey = @"BBAppExportCodeSigningIdentityKey";
 
+//Keys for each file entry in an export manifest.
+NSString * const BBExportManifestSourcePathKey = @"SourcePath";
+NSString * const BBExportManifestSourceSizeKey = @"SourceSize";
+NSString * const BBExportManifestSourceTimeKey = @"SourceModificationTime";
+NSString * const BBExportManifestDestinationSizeKey = @"DestinationSize";
+NSString * const BBExportManifestDestinationTimeKey = @"DestinationModificationTime";
+
+
+#pragma mark - Cloning helpers
+
+//clonefile() only exists on 10.12 and above, so we look it up at runtime rather than linking to it.
+typedef int (*BBCloneFileFunction)(const char *src, const char *dst, uint32_t flags);
+#define BBCloneNoFollow 0x0001 //CLONE_NOFOLLOW
+
+static BBCloneFileFunction _BBCloneFile(void)
+{
+    static BBCloneFileFunction cloneFile = NULL;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        cloneFile = (BBCloneFileFunction)dlsym(RTLD_DEFAULT, "clonefile");
+    });
+    return cloneFile;
+}
+
+static NSTimeInterval _BBModificationTime(const struct stat *info)
+{
+    return info->st_mtimespec.tv_sec + (info->st_mtimespec.tv_nsec / 1e9);
+}
+
+
+#pragma mark - Private method declarations
+
+@interface BBAppDelegate (AppExportingPrivate)
+
+//Returns the location at which we record the manifest for an app exported to the specified URL.
++ (NSURL *) _manifestURLForAppAtURL: (NSURL *)appURL;
+
+//Returns which of our preferred code signing identities are available on this machine, in order of preference.
+//The ad-hoc identity is always included as a last resort.
++ (NSArray *) _availableSigningIdentities;
+
+//Copies the file or folder at sourceURL to destinationURL inside the app being constructed at appURL,
+//cloning files where the filesystem allows. If previousManifest records that a file in the previously-exported
+//app at previousAppURL is an untouched copy of the same, unchanged source file, that file is cloned instead
+//of the source. Each file copied is recorded in manifest, keyed by its path relative to appURL.
+- (BOOL) _copyItemAtURL: (NSURL *)sourceURL
+                  toURL: (NSURL *)destinationURL
+             inAppAtURL: (NSURL *)appURL
+         previousAppURL: (NSURL *)previousAppURL
+       previousManifest: (NSDictionary *)previousManifest
+               manifest: (NSMutableDictionary *)manifest
+                  error: (NSError **)outError;
+
+//Removes entries from the manifest whose files in the app at appURL have been modified since they were copied,
+//as they can no longer be reused by subsequent exports.
+- (void) _pruneManifest: (NSMutableDictionary *)manifest forAppAtURL: (NSURL *)appURL;
+
+//Runs the app at the specified URL to generate the launch manifest for its bundled gamebox.
+//Returns NO and populates outError if the manifest could not be generated.
+- (BOOL) _writeLaunchManifestForAppAtURL: (NSURL *)appURL error: (NSError **)outError;
+
+- (NSURL *) _importGameboxFromURL: (NSURL *)gameboxURL
+                     intoAppAtURL: (NSURL *)appURL
+                         withName: (NSString *)gameboxName
+                       identifier: (NSString *)gameIdentifier
+                   previousAppURL: (NSURL *)previousAppURL
+                 previousManifest: (NSDictionary *)previousManifest
+                         manifest: (NSMutableDictionary *)manifest
+                            error: (NSError **)outError;
+
+@end
+
 @implementation BBAppDelegate (AppExporting)
 
 - (void) createAppAtDestinationURL: (NSURL *)destinationURL completion: (void(^)(NSURL *appURL, NSError *error))completionHandler
@@ -53,7 +129,22 @@ NSString * const BBAppExportCodeSigningIdentityKey = @"BBAppExportCodeSigningIde
     
     NSURL *tempAppURL = [baseTempURL URLByAppendingPathComponent: destinationURL.lastPathComponent];
     
-    BOOL copied = [manager copyItemAtURL: sourceURL toURL: tempAppURL error: outError];
+    //If we've exported to this destination before, then reuse whatever files from that export
+    //are still up to date instead of copying them afresh.
+    NSURL *manifestURL = [self.class _manifestURLForAppAtURL: destinationURL];
+    NSDictionary *previousManifest = nil;
+    if ([destinationURL checkResourceIsReachableAndReturnError: NULL])
+        previousManifest = [NSDictionary dictionaryWithContentsOfURL: manifestURL];
+    
+    NSMutableDictionary *manifest = [NSMutableDictionary dictionary];
+    
+    BOOL copied = [self _copyItemAtURL: sourceURL
+                                 toURL: tempAppURL
+                            inAppAtURL: tempAppURL
+                        previousAppURL: destinationURL
+                      previousManifest: previousManifest
+                              manifest: manifest
+                                 error: outError];
     if (!copied)
     {
         [manager removeItemAtURL: baseTempURL error: NULL];
@@ -72,6 +163,9 @@ NSString * const BBAppExportCodeSigningIdentityKey = @"BBAppExportCodeSigningIde
                                                intoAppAtURL: tempAppURL
                                                    withName: self.sanitisedAppName
                                                  identifier: self.appBundleIdentifier
+                                             previousAppURL: destinationURL
+                                           previousManifest: previousManifest
+                                                   manifest: manifest
                                                       error: outError];
     
     if (importedGameboxURL == nil)
@@ -244,19 +338,23 @@ NSString * const BBAppExportCodeSigningIdentityKey = @"BBAppExportCodeSigningIde
     //Write all of our changes to the app's plist back into the app.
     [appInfo writeToURL: appInfoURL atomically: YES];
     
+    //Have the new app precompute the drives and game profile of its gamebox, so that it doesn't
+    //have to scan the gamebox every time it starts up. This is optional: without a manifest,
+    //the app will just fall back on scanning.
+    NSError *manifestError = nil;
+    BOOL wroteManifest = [self _writeLaunchManifestForAppAtURL: tempAppURL error: &manifestError];
+    if (!wroteManifest)
+        NSLog(@"Could not generate launch manifest: %@", manifestError);
+    
     //Attempt to sign the app using a Gatekeeper-ready Developer ID identity;
     //If that fails, fall back on the standard Mac Developer identity;
     //If that fails, fall back on an ad-hoc identity (which will at least ensure
     //that the code signing is internally consistent, and not whatever broken
     //leftovers are inherited from the Boxer Standalone bundle.)
     //TODO: allow the user to choose the identity from a list or opt-out of signing altogether.
-    NSArray *preferredIdentities = @[
-                                     @"Developer ID Application",
-                                     @"Mac Developer",
-                                     @"-",
-                                     ];
-    
-    for (NSString *signingIdentity in preferredIdentities)
+    //We skip identities that aren't installed on this machine, so that we normally only have to sign once:
+    //codesign hashes every file in the bundle each time, which is slow for large gameboxes.
+    for (NSString *signingIdentity in [self.class _availableSigningIdentities])
     {
         NSError *signingError = nil;
         NSLog(@"Attempting to sign application bundle using '%@' identity...", signingIdentity);
@@ -279,6 +377,10 @@ NSString * const BBAppExportCodeSigningIdentityKey = @"BBAppExportCodeSigningIde
         }
     }
     
+    //Signing and our own rewrites will have changed some of the files we copied:
+    //those can't be reused by later exports, so leave them out of the manifest.
+    [self _pruneManifest: manifest forAppAtURL: tempAppURL];
+    
     //Once the app is ready, move the finished and (hopefully) codesigned app
     //from the temporary location to the final destination.
     NSURL *finalDestinationURL = nil;
@@ -291,6 +393,13 @@ NSString * const BBAppExportCodeSigningIdentityKey = @"BBAppExportCodeSigningIde
     
     if (swapped)
     {
+        //Record what we copied, so that the next export to this location can reuse it.
+        [manager createDirectoryAtURL: manifestURL.URLByDeletingLastPathComponent
+          withIntermediateDirectories: YES
+                           attributes: nil
+                                error: NULL];
+        [manifest writeToURL: manifestURL atomically: YES];
+        
         //TODO: once it's in place, update the resulting file's modification date.
         NSError *touchError;
         BOOL touched = [destinationURL setResourceValue: [NSDate date]
@@ -354,14 +463,230 @@ NSString * const BBAppExportCodeSigningIdentityKey = @"BBAppExportCodeSigningIde
     else return YES;
 }
 
+- (BOOL) _writeLaunchManifestForAppAtURL: (NSURL *)appURL error: (NSError **)outError
+{
+    NSBundle *app = [NSBundle bundleWithURL: appURL];
+    NSURL *manifestURL = [app.resourceURL URLByAppendingPathComponent: @"Launch Manifest.plist"];
+    
+    //The app itself knows best how to detect its gamebox's contents, so we ask it to do the work.
+    NSTask *writeManifest = [[NSTask alloc] init];
+    writeManifest.launchPath = app.executablePath;
+    writeManifest.arguments = @[@"--write-launch-manifest", manifestURL.path];
+    
+    NSPipe *errorPipe = [NSPipe pipe];
+    writeManifest.standardError = errorPipe;
+    
+    [writeManifest launch];
+    NSData *errorData = errorPipe.fileHandleForReading.readDataToEndOfFile;
+    [writeManifest waitUntilExit];
+    
+    if (writeManifest.terminationStatus != 0)
+    {
+        [[NSFileManager defaultManager] removeItemAtURL: manifestURL error: NULL];
+        
+        if (outError != NULL)
+        {
+            NSString *errorString = [[NSString alloc] initWithData: errorData encoding: NSUTF8StringEncoding];
+            *outError = [NSError errorWithDomain: BBAppExportErrorDomain
+                                            code: BBAppExportLaunchManifestFailed
+                                        userInfo: @{ NSLocalizedFailureReasonErrorKey: errorString ?: @"" }];
+        }
+        return NO;
+    }
+    return YES;
+}
+
++ (NSArray *) _availableSigningIdentities
+{
+    static NSArray *availableIdentities = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        NSArray *preferredIdentities = @[
+                                         @"Developer ID Application",
+                                         @"Mac Developer",
+                                         ];
+        
+        //Ask the keychain which code signing identities are installed.
+        NSTask *findIdentities = [[NSTask alloc] init];
+        findIdentities.launchPath = @"/usr/bin/security";
+        findIdentities.arguments = @[@"find-identity", @"-v", @"-p", @"codesigning"];
+        
+        NSPipe *outputPipe = [NSPipe pipe];
+        findIdentities.standardOutput = outputPipe;
+        findIdentities.standardError = [NSFileHandle fileHandleWithNullDevice];
+        
+        NSString *output = nil;
+        @try
+        {
+            [findIdentities launch];
+            NSData *outputData = outputPipe.fileHandleForReading.readDataToEndOfFile;
+            [findIdentities waitUntilExit];
+            output = [[NSString alloc] initWithData: outputData encoding: NSUTF8StringEncoding];
+        }
+        @catch (NSException *exception)
+        {
+            output = nil;
+        }
+        
+        NSMutableArray *identities = [NSMutableArray arrayWithCapacity: preferredIdentities.count + 1];
+        for (NSString *identity in preferredIdentities)
+        {
+            //If we couldn't get a listing, then try every identity as we used to.
+            if (!output || [output rangeOfString: [NSString stringWithFormat: @"\"%@", identity]].location != NSNotFound)
+                [identities addObject: identity];
+        }
+        [identities addObject: @"-"];
+        
+        availableIdentities = [identities copy];
+    });
+    return availableIdentities;
+}
+
++ (NSURL *) _manifestURLForAppAtURL: (NSURL *)appURL
+{
+    NSURL *cachesURL = [[NSFileManager defaultManager] URLsForDirectory: NSCachesDirectory
+                                                              inDomains: NSUserDomainMask][0];
+    NSString *bundleIdentifier = [NSBundle mainBundle].bundleIdentifier;
+    NSURL *manifestsURL = [cachesURL URLByAppendingPathComponent: [NSString stringWithFormat: @"%@/Export Manifests", bundleIdentifier]];
+    
+    //Name each manifest after a digest of the app's location.
+    const char *path = appURL.URLByStandardizingPath.path.fileSystemRepresentation;
+    unsigned char digest[CC_SHA1_DIGEST_LENGTH];
+    CC_SHA1(path, (CC_LONG)strlen(path), digest);
+    
+    NSMutableString *name = [NSMutableString stringWithCapacity: CC_SHA1_DIGEST_LENGTH * 2];
+    for (NSUInteger i=0; i<CC_SHA1_DIGEST_LENGTH; i++)
+        [name appendFormat: @"%02x", digest[i]];
+    
+    return [[manifestsURL URLByAppendingPathComponent: name] URLByAppendingPathExtension: @"plist"];
+}
+
+- (BOOL) _copyItemAtURL: (NSURL *)sourceURL
+                  toURL: (NSURL *)destinationURL
+             inAppAtURL: (NSURL *)appURL
+         previousAppURL: (NSURL *)previousAppURL
+       previousManifest: (NSDictionary *)previousManifest
+               manifest: (NSMutableDictionary *)manifest
+                  error: (NSError **)outError
+{
+    NSFileManager *manager = [[NSFileManager alloc] init];
+    BBCloneFileFunction cloneFile = _BBCloneFile();
+    
+    NSString *sourceBasePath = sourceURL.path;
+    NSString *destinationBasePath = destinationURL.path;
+    NSString *appPath = appURL.path;
+    
+    //Walk the source ourselves, including the source itself as the first item.
+    NSMutableArray *relativePaths = [NSMutableArray arrayWithObject: @""];
+    NSDirectoryEnumerator *enumerator = [manager enumeratorAtPath: sourceBasePath];
+    for (NSString *relativePath in enumerator)
+        [relativePaths addObject: relativePath];
+    
+    for (NSString *relativePath in relativePaths)
+    {
+        NSString *sourcePath = [sourceBasePath stringByAppendingPathComponent: relativePath];
+        NSString *destinationPath = [destinationBasePath stringByAppendingPathComponent: relativePath];
+        
+        struct stat sourceInfo;
+        if (lstat(sourcePath.fileSystemRepresentation, &sourceInfo) != 0)
+        {
+            if (outError)
+                *outError = [NSError errorWithDomain: NSPOSIXErrorDomain
+                                                code: errno
+                                            userInfo: @{ NSURLErrorKey: [NSURL fileURLWithPath: sourcePath] }];
+            return NO;
+        }
+        
+        //Folders and symlinks are recreated with their attributes but without their contents,
+        //which we copy individually as we get to them.
+        if (!S_ISREG(sourceInfo.st_mode))
+        {
+            if (copyfile(sourcePath.fileSystemRepresentation, destinationPath.fileSystemRepresentation, NULL, COPYFILE_ALL | COPYFILE_NOFOLLOW) != 0)
+            {
+                if (outError)
+                    *outError = [NSError errorWithDomain: NSPOSIXErrorDomain
+                                                    code: errno
+                                                userInfo: @{ NSURLErrorKey: [NSURL fileURLWithPath: sourcePath] }];
+                return NO;
+            }
+            continue;
+        }
+        
+        NSString *pathInApp = [destinationPath substringFromIndex: appPath.length];
+        NSTimeInterval sourceTime = _BBModificationTime(&sourceInfo);
+        
+        //Check if the previous export has an untouched copy of this same file that we can reuse.
+        NSString *copyFromPath = sourcePath;
+        NSDictionary *previousEntry = previousManifest[pathInApp];
+        if ([previousEntry[BBExportManifestSourcePathKey] isEqualToString: sourcePath] &&
+            [previousEntry[BBExportManifestSourceSizeKey] longLongValue] == sourceInfo.st_size &&
+            [previousEntry[BBExportManifestSourceTimeKey] doubleValue] == sourceTime)
+        {
+            NSString *previousPath = [previousAppURL.path stringByAppendingString: pathInApp];
+            struct stat previousInfo;
+            if (lstat(previousPath.fileSystemRepresentation, &previousInfo) == 0 &&
+                S_ISREG(previousInfo.st_mode) &&
+                [previousEntry[BBExportManifestDestinationSizeKey] longLongValue] == previousInfo.st_size &&
+                [previousEntry[BBExportManifestDestinationTimeKey] doubleValue] == _BBModificationTime(&previousInfo))
+            {
+                copyFromPath = previousPath;
+            }
+        }
+        
+        //Clone the file if the filesystem allows it, and fall back on a regular copy otherwise.
+        BOOL cloned = cloneFile && cloneFile(copyFromPath.fileSystemRepresentation, destinationPath.fileSystemRepresentation, BBCloneNoFollow) == 0;
+        if (!cloned && copyfile(copyFromPath.fileSystemRepresentation, destinationPath.fileSystemRepresentation, NULL, COPYFILE_ALL | COPYFILE_NOFOLLOW) != 0)
+        {
+            if (outError)
+                *outError = [NSError errorWithDomain: NSPOSIXErrorDomain
+                                                code: errno
+                                            userInfo: @{ NSURLErrorKey: [NSURL fileURLWithPath: copyFromPath] }];
+            return NO;
+        }
+        
+        struct stat destinationInfo;
+        if (lstat(destinationPath.fileSystemRepresentation, &destinationInfo) == 0)
+        {
+            manifest[pathInApp] = @{
+                BBExportManifestSourcePathKey: sourcePath,
+                BBExportManifestSourceSizeKey: @(sourceInfo.st_size),
+                BBExportManifestSourceTimeKey: @(sourceTime),
+                BBExportManifestDestinationSizeKey: @(destinationInfo.st_size),
+                BBExportManifestDestinationTimeKey: @(_BBModificationTime(&destinationInfo)),
+            };
+        }
+    }
+    
+    return YES;
+}
+
+- (void) _pruneManifest: (NSMutableDictionary *)manifest forAppAtURL: (NSURL *)appURL
+{
+    NSString *appPath = appURL.path;
+    for (NSString *pathInApp in manifest.allKeys)
+    {
+        NSDictionary *entry = manifest[pathInApp];
+        NSString *path = [appPath stringByAppendingString: pathInApp];
+        
+        struct stat info;
+        if (lstat(path.fileSystemRepresentation, &info) != 0 ||
+            [entry[BBExportManifestDestinationSizeKey] longLongValue] != info.st_size ||
+            [entry[BBExportManifestDestinationTimeKey] doubleValue] != _BBModificationTime(&info))
+        {
+            [manifest removeObjectForKey: pathInApp];
+        }
+    }
+}
+
 - (NSURL *) _importGameboxFromURL: (NSURL *)gameboxURL
                      intoAppAtURL: (NSURL *)appURL
                          withName: (NSString *)gameboxName
                        identifier: (NSString *)gameIdentifier
+                   previousAppURL: (NSURL *)previousAppURL
+                 previousManifest: (NSDictionary *)previousManifest
+                         manifest: (NSMutableDictionary *)manifest
                             error: (NSError **)outError
 {
-    NSFileManager *manager = [[NSFileManager alloc] init];
-    
     NSURL *appResourceURL = [appURL URLByAppendingPathComponent: @"Contents/Resources/"];
     
     //Rename the gamebox when importing, if desired
@@ -373,7 +698,13 @@ NSString * const BBAppExportCodeSigningIdentityKey = @"BBAppExportCodeSigningIde
     
     NSURL *destinationURL = [appResourceURL URLByAppendingPathComponent: gameboxName];
     
-    BOOL copiedGamebox = [manager copyItemAtURL: self.gameboxURL toURL: destinationURL error: outError];
+    BOOL copiedGamebox = [self _copyItemAtURL: self.gameboxURL
+                                        toURL: destinationURL
+                                   inAppAtURL: appURL
+                               previousAppURL: previousAppURL
+                             previousManifest: previousManifest
+                                     manifest: manifest
+                                        error: outError];
     if (!copiedGamebox)
     {
         return nil;
@@ -60,7 +60,8 @@ This means that this file has had too many modifications to be safely replaceabl
 
 /* #undef C_DYNREC */
 //--Modified 2009-02-26 by Alun Bestor to enable automatically for X64
-#if defined(__x86_64__) && !defined(C_DYNAMIC_X86)
+//--Modified to enable automatically for AArch64 too
+#if (defined(__x86_64__) || defined(__aarch64__)) && !defined(C_DYNAMIC_X86)
 	#define  C_DYNREC 1
 #endif
 //--End of modifications
@@ -70,8 +71,10 @@ This means that this file has had too many modifications to be safely replaceabl
 
 /* Define to 1 to use a x86 assembly fpu core */
 //--Modified 2009-02-26 by Alun Bestor to force this on for Intel
+//--Modified to let Intel builds choose the host double-precision FPU core instead,
+//by defining C_FPU_HOST_DOUBLE: see fpu_instructions.h for the precision this gives up.
 
-#if defined(__i386__) || defined(__x86_64__)
+#if (defined(__i386__) || defined(__x86_64__)) && !defined(C_FPU_HOST_DOUBLE)
 	#define C_FPU_X86 1
 #endif
 
@@ -88,6 +91,13 @@ This means that this file has had too many modifications to be safely replaceabl
 /* Define to 1 if you have the mprotect function */
 #define C_HAVE_MPROTECT 1
 
+//--Added to allocate the recompiler's code cache with MAP_JIT, which is required
+//on Apple Silicon where executable memory must never be writable at the same time
+#if defined(__APPLE__) && defined(__aarch64__)
+	#define C_HAVE_MAP_JIT 1
+#endif
+//--End of modifications
+
 /* Define to 1 to enable heavy debugging, also have to enable C_DEBUG */
 /* #undef C_HEAVY_DEBUG */
 
@@ -121,6 +131,10 @@ This means that this file has had too many modifications to be safely replaceabl
 	#define C_TARGETCPU X86
 #elif defined(__ppc__) || defined(__ppc64__)
 	#define C_TARGETCPU POWERPC
+//--Added for the AArch64 dynrec backend
+#elif defined(__aarch64__)
+	#define C_TARGETCPU ARMV8LE
+//--End of modifications
 #endif
 //--End of modifications
 
@@ -137,7 +151,12 @@ This means that this file has had too many modifications to be safely replaceabl
 
 
 /* Define to 1 to use a unaligned memory access */
+//--Modified to use unaligned access on the little-endian hosts that handle it natively
 //#define C_UNALIGNED_MEMORY 1
+#if !defined(WORDS_BIGENDIAN) && (defined(__i386__) || defined(__x86_64__) || defined(__aarch64__))
+	#define C_UNALIGNED_MEMORY 1
+#endif
+//--End of modifications
 
 /* libm doesn't include powf */
 /* #undef DB_HAVE_NO_POWF */
@@ -0,0 +1,91 @@
+/*
+ *  Copyright (C) 2002-2010  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+//--Added to move the cost of synthesizing audio off the emulation thread.
+//An AudioWorker sits between a synthesizer and its mixer channel. The emulation thread queues
+//the events that would have gone to the synthesizer (register writes, MIDI messages), and each
+//time the mixer asks for samples those events are handed to a worker queue along with a request
+//to render that many frames. The worker renders into a FIFO, which starts out primed with a few
+//milliseconds of silence: the emulation thread takes its frames from there, so it only has to
+//wait if the worker falls more than that far behind.
+//Events are applied at the same mixer-block granularity as when they were applied directly,
+//so the output is identical apart from the added latency.
+
+#ifndef DOSBOX_AUDIO_WORKER_H
+#define DOSBOX_AUDIO_WORKER_H
+
+#ifndef DOSBOX_DOSBOX_H
+#include "dosbox.h"
+#endif
+
+#include <vector>
+#include <pthread.h>
+#include <dispatch/dispatch.h>
+
+class AudioWorker {
+public:
+	// frame_size is the size in bytes of one frame of output,
+	// latency_frames is how many frames of silence to prime the FIFO with
+	AudioWorker(const char * name,Bitu frame_size,Bitu latency_frames);
+	virtual ~AudioWorker();
+
+	// whether the host has enough cores to make a worker worthwhile
+	static bool Worthwhile(void);
+
+	// called on the emulation thread: queues an event to be applied before the next render
+	void QueueEvent(const void * data,Bitu length);
+	// called on the emulation thread: fills buffer with the next frames of output
+	void Read(void * buffer,Bitu frames);
+	// how many times Read has had to wait for the worker to catch up
+	Bitu Stalls(void) const { return stalls; }
+
+protected:
+	// called on the worker queue to apply a queued event to the synthesizer
+	virtual void ApplyEvent(const Bit8u * data,Bitu length)=0;
+	// called on the worker queue to render frames of output into buffer
+	virtual void Render(void * buffer,Bitu frames)=0;
+
+	// applies any events that haven't been handed over yet and waits for the worker
+	// to finish everything that has been queued so far.
+	// Subclasses must call this in their destructor before tearing down their synthesizer.
+	void Drain(void);
+
+private:
+	struct Job {
+		std::vector<Bit8u> events;
+		Bitu frames;
+	};
+	void Perform(Job * job);
+
+	dispatch_queue_t queue;
+	pthread_mutex_t lock;
+	pthread_cond_t rendered;
+
+	Bit8u * fifo;
+	Bitu frame_size;
+	Bitu capacity;		// in frames
+	Bitu read_pos;		// in frames, only touched by the emulation thread
+	Bitu write_pos;		// in frames, only touched by the worker
+	Bitu available;		// in frames, protected by lock
+	Bitu stalls;		// emulation thread only
+
+	Job * pending;
+};
+
+#endif
+//--End of modifications
@@ -20,6 +20,11 @@
 #define DOSBOX_BIOS_DISK_H
 
 #include <stdio.h>
+//--Added for imageDisk's sector cache and mappedImageDisk
+#include <map>
+#include <vector>
+#include <string>
+//--End of modifications
 #ifndef DOSBOX_MEM_H
 #include "mem.h"
 #endif
@@ -47,15 +52,38 @@ class imageDisk  {
 public:
 	Bit8u Read_Sector(Bit32u head,Bit32u cylinder,Bit32u sector,void * data);
 	Bit8u Write_Sector(Bit32u head,Bit32u cylinder,Bit32u sector,void * data);
-	Bit8u Read_AbsoluteSector(Bit32u sectnum, void * data);
-	Bit8u Write_AbsoluteSector(Bit32u sectnum, void * data);
+	//--Modified to be overridable by mappedImageDisk
+	//Bit8u Read_AbsoluteSector(Bit32u sectnum, void * data);
+	//Bit8u Write_AbsoluteSector(Bit32u sectnum, void * data);
+	virtual Bit8u Read_AbsoluteSector(Bit32u sectnum, void * data);
+	virtual Bit8u Write_AbsoluteSector(Bit32u sectnum, void * data);
+	//--End of modifications
+
+	//--Added for transferring several consecutive sectors at once
+	virtual Bit8u Read_AbsoluteSectors(Bit32u sectnum, Bit32u count, void * data);
+	virtual Bit8u Write_AbsoluteSectors(Bit32u sectnum, Bit32u count, void * data);
+	//--End of modifications
 
 	void Set_Geometry(Bit32u setHeads, Bit32u setCyl, Bit32u setSect, Bit32u setSectSize);
 	void Get_Geometry(Bit32u * getHeads, Bit32u *getCyl, Bit32u *getSect, Bit32u *getSectSize);
 	Bit8u GetBiosType(void);
 	Bit32u getSectSize(void);
 	imageDisk(FILE *imgFile, Bit8u *imgName, Bit32u imgSizeK, bool isHardDisk);
-	~imageDisk() { if(diskimg != NULL) { fclose(diskimg); }	};
+	//--Modified to write out any deferred sector writes before closing the image
+	//~imageDisk() { if(diskimg != NULL) { fclose(diskimg); }	};
+	virtual ~imageDisk();
+	//--End of modifications
+
+	//--Added to cache sectors in memory and defer writes to the image file.
+	//Sectors that have been read or written recently are kept in an LRU cache, so repeated
+	//reads of directories and the like don't go back to the file each time. Writes only go
+	//into the cache: Flush writes out all the dirty sectors in order, with each run of
+	//consecutive sectors written in one go. That happens when a dirty sector would be evicted,
+	//when the disk has been idle for a while after writing, and when the disk is closed.
+	virtual void Flush(void);
+	bool hasUnflushedWrites(void) { return dirtySectors > 0; }
+	Bitu lastWriteTicks;	// PIC_Ticks at the last write into the cache
+	//--End of modifications
 
 	bool hardDrive;
 	bool active;
@@ -65,7 +93,62 @@ public:
 
 	Bit32u sector_size;
 	Bit32u heads,cylinders,sectors;
+
+	//--Added for the sector cache
+protected:
+	struct CachedSector {
+		Bit32u sectnum;
+		Bitu lastUsed;
+		bool dirty;
+		Bit8u *data;
+	};
+	CachedSector *cacheLookup(Bit32u sectnum);
+	CachedSector *cacheAllocate(Bit32u sectnum);
+	void cacheClear(void);
+
+	std::vector<CachedSector> cacheSlots;
+	std::map<Bit32u, Bitu> cachedSectors;	// sector number -> index in cacheSlots
+	Bitu cacheClock;
+	Bitu dirtySectors;
+	//--End of modifications
+};
+
+//--Added to service sector reads and writes straight from a memory mapping of the image file.
+//Without an overlay the image is mapped shared, so writes go into the file's pages as they're
+//made and Flush only has to msync the range that has been written to since the last flush.
+//With an overlay the image is mapped privately, so writes stay in memory and the image itself
+//is never modified: Flush instead records the changed blocks in the overlay file, which is
+//played back over the mapping the next time the image is opened.
+//If the image can't be mapped, this falls back on imageDisk's own sector cache.
+class mappedImageDisk : public imageDisk {
+public:
+	mappedImageDisk(FILE *imgFile, Bit8u *imgName, Bit32u imgSizeK, bool isHardDisk, const char *overlayPath = NULL);
+	virtual ~mappedImageDisk();
+
+	virtual Bit8u Read_AbsoluteSector(Bit32u sectnum, void * data);
+	virtual Bit8u Write_AbsoluteSector(Bit32u sectnum, void * data);
+	virtual Bit8u Read_AbsoluteSectors(Bit32u sectnum, Bit32u count, void * data);
+	virtual Bit8u Write_AbsoluteSectors(Bit32u sectnum, Bit32u count, void * data);
+	virtual void Flush(void);
+
+	bool isMapped(void) { return mapping != NULL; }
+
+private:
+	void loadOverlay(void);
+	void flushOverlay(void);
+
+	Bit8u *mapping;
+	size_t mappingSize;
+	bool sharedMapping;
+	// the range of the mapping written to since the last flush, when there's no overlay
+	size_t dirtyStart, dirtyEnd;
+
+	std::string overlayPath;
+	FILE *overlay;
+	std::map<Bit32u, long> overlayBlocks;	// block number -> offset of its record in the overlay file
+	std::vector<bool> dirtyBlocks;			// blocks written to since the last flush
 };
+//--End of modifications
 
 void updateDPT(void);
 
@@ -28,6 +28,14 @@
 typedef Bitu (*CallBack_Handler)(void);
 extern CallBack_Handler CallBack_Handlers[];
 
+//--Added to let the dynamic core service a few frequently-polled calls without leaving
+//the block that made them. A fast handler returns true if it dealt with the call entirely:
+//it must only read and write registers and emulated memory. If it returns false, the core
+//leaves the block and runs the callback's regular handler as normal.
+typedef bool (*CallBack_FastHandler)(void);
+extern CallBack_FastHandler CallBack_FastHandlers[];
+//--End of modifications
+
 enum { CB_RETN,CB_RETF,CB_RETF8,CB_IRET,CB_IRETD,CB_IRET_STI,CB_IRET_EOI_PIC1,
 		CB_IRQ0,CB_IRQ1,CB_IRQ1_BREAK,CB_IRQ9,CB_IRQ12,CB_IRQ12_RET,CB_IRQ6_PCJR,CB_MOUSE,
 		CB_INT29,CB_INT16,CB_HOOKABLE,CB_TDE_IRET,CB_IPXESR,CB_IPXESR_RET,
@@ -105,5 +113,8 @@ public:
 		return CALLBACK_RealPointer(m_callback);
 	}
 	void Set_RealVec(Bit8u vec);
+	//--Added to install a fast handler alongside the regular one: see CallBack_FastHandler
+	void Set_FastHandler(CallBack_FastHandler handler);
+	//--End of modifications
 };
 #endif
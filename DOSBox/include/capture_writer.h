@@ -0,0 +1,87 @@
+/*
+ *  Copyright (C) 2002-2010  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+//--Added to take the writing of capture files off the emulation thread.
+//A CaptureWriter takes over a file opened with OpenCaptureFile. What's written to it is gathered
+//into large blocks, and each full block is handed to a serial queue that writes it out, so a busy
+//disk holds up the queue rather than the emulation. Only if the queue falls a long way behind
+//does the emulation thread wait for it.
+//Wave output can also be encoded losslessly on the same queue as it's written.
+
+#ifndef DOSBOX_CAPTURE_WRITER_H
+#define DOSBOX_CAPTURE_WRITER_H
+
+#ifndef DOSBOX_DOSBOX_H
+#include "dosbox.h"
+#endif
+
+#include <stdio.h>
+#include <dispatch/dispatch.h>
+
+enum CaptureAudioFormat {
+	CAPTURE_AUDIO_WAV=0,	// written as is: the caller writes the header
+	CAPTURE_AUDIO_ALAC,		// Apple Lossless in an M4A file
+	CAPTURE_AUDIO_FLAC
+};
+
+class CaptureAudioEncoder;
+
+class CaptureWriter {
+public:
+	// takes over the file, which must be open for writing; and for reading too, if encoding
+	CaptureWriter(FILE * handle);
+
+	// whether the host can encode audio in the given format
+	static bool CanEncodeAudio(CaptureAudioFormat format);
+	// the file extension, with its leading separator, for audio in the given format
+	static const char * AudioExtension(CaptureAudioFormat format);
+	// from now on, treats everything written as 16-bit stereo frames at the given rate,
+	// to be encoded in the given format; returns false if that can't be done
+	bool EncodeAudio(CaptureAudioFormat format,Bitu rate);
+
+	// queues data to be appended to the file
+	void Write(const void * data,Bitu size);
+	// queues data to be written at the given offset into the file once everything before it
+	// has been written, such as to fill in a header. Not for use while encoding.
+	void WriteAt(Bitu offset,const void * data,Bitu size);
+	// how many bytes have been passed to Write
+	Bitu Length(void) const { return length; }
+
+	// queues the file to be closed once everything has been written, and the writer to be deleted
+	void Close(void);
+	// waits until every closed writer has finished with its file: for use when shutting down
+	static void FinishAll(void);
+
+private:
+	~CaptureWriter();
+	void Flush(void);
+	void Queue(Bit8u * data,Bitu size,Bits offset);
+	// called on the queue
+	void Perform(const Bit8u * data,Bitu size,Bits offset);
+
+	FILE * handle;
+	dispatch_queue_t queue;
+	dispatch_semaphore_t room;	// how many more blocks may be queued
+	Bit8u * block;
+	Bitu used;
+	Bitu length;
+	CaptureAudioEncoder * encoder;
+};
+
+#endif
+//--End of modifications
@@ -79,11 +79,68 @@ Bits CPU_Core_Dynrec_Run(void);
 Bits CPU_Core_Dynrec_Trap_Run(void);
 Bits CPU_Core_Prefetch_Run(void);
 Bits CPU_Core_Prefetch_Trap_Run(void);
+//--Added so that a loaded save state doesn't execute stale prefetched bytes
+void CPU_Core_Prefetch_Invalidate(void);
+//--End of modifications
+//--Added for the threaded variant of the normal core
+Bits CPU_Core_Threaded_Run(void);
+Bits CPU_Core_Threaded_Trap_Run(void);
+//Makes the threaded core look up its code page again, if the TLB may have changed under it
+void CPU_Core_Threaded_FlushFetch(void);
+//--End of modifications
+
+//--Added to report how well the dynamic core's translation cache is coping
+struct CPU_DynamicCacheStats {
+	Bitu size;				//Size of the translation cache in bytes
+	Bit64u hits;			//Times an already-translated block was looked up and entered
+	Bit64u translations;	//Blocks translated
+	Bit64u evictions;		//Translated blocks discarded to make room for new ones
+	Bit64u wraps;			//Times the cache filled up and began reusing its oldest space
+	Bit64u instructions;	//Guest instructions translated, across all translated blocks
+	Bit64u bytes_emitted;	//Bytes of host code generated
+	Bit64u flushes;			//Times the whole cache was discarded
+	Bit64u invalidations;	//Blocks discarded because the guest wrote over their code
+	Bit64u invalidated_pages;	//Code pages that have had at least one block discarded that way
+	Bitu hottest_page;		//The physical page whose blocks have been discarded the most times since it was last set up
+	Bit64u hottest_page_invalidations;	//...and how many times that was
+	Bit64u smc_interpreted_pages;	//Times a code page was left to the normal core because its code kept being rewritten
+	Bit64u smc_interpreted_instructions;	//Instructions the normal core ran in those pages instead of them being translated
+	double translate_seconds;	//Host time spent translating blocks, while perf counters are enabled
+	double run_seconds;		//Host time spent in the core overall, including translation, while perf counters are enabled
+};
+//--End of modifications
+
+//--Added to discard any translated code, for when guest memory is replaced by a save state
+void CPU_FlushCodeCache(void);
+//--End of modifications
+
+//--Added for core=adaptive, which moves between the normal and dynamic cores by itself.
+//Any other choice of core should disable it, so that it doesn't undo that choice.
+void CPU_AdaptiveCore_Enable(void);
+void CPU_AdaptiveCore_Disable(void);
+bool CPU_AdaptiveCore_Enabled(void);
+//Whether the adaptive core may move to the dynamic core at all: e.g. for a game that is already
+//known to rewrite its code too often for it. Defaults to true.
+void CPU_AdaptiveCore_SetPromotionAllowed(bool allowed);
+//--End of modifications
 
 void CPU_Enable_SkipAutoAdjust(void);
 void CPU_Disable_SkipAutoAdjust(void);
 void CPU_Reset_AutoAdjust(void);
 
+//--Added to let emulated services put the host thread to sleep while the guest idles.
+//Both skip ahead to the next scheduled PIC event, as HLT does: the emulation loop then
+//sleeps until the next millisecond is due, and virtual time continues at the normal rate.
+//The skipped cycles are excluded from the auto cycle measurements.
+
+//Call when the guest is certainly waiting for an interrupt, e.g. blocking on a keypress.
+void CPU_Idle(void);
+//Call when the guest polls for something that hasn't happened yet. Only once the guest
+//has polled repeatedly within the same emulated millisecond is it considered idle,
+//so programs that poll once in a while as part of their main loop are unaffected.
+void CPU_IdlePoll(void);
+//--End of modifications
+
 
 //CPU Stuff
 
@@ -30,6 +30,15 @@ extern Bitu cycle_count;
 extern Bitu debugCallback;
 
 #ifdef C_HEAVY_DEBUG
-bool DEBUG_HeavyIsBreakpoint(void);
+//--Modified so that the cores only call into the heavy debugger while it has something to check:
+//debug_heavy_checks is only set while code breakpoints are active or instructions are being
+//logged or checked, so otherwise each instruction costs a single flag test.
+extern bool debug_heavy_checks;
+bool DEBUG_HeavyCheckBreakpoint(void);
+static INLINE bool DEBUG_HeavyIsBreakpoint(void) {
+	if (GCC_LIKELY(!debug_heavy_checks)) return false;
+	return DEBUG_HeavyCheckBreakpoint();
+}
+//--End of modifications
 void DEBUG_HeavyWriteLogInstruction(void);
 #endif
@@ -21,6 +21,12 @@
 #ifndef DOSBOX_DMA_H
 #define DOSBOX_DMA_H
 
+//--Added for save states
+#ifndef DOSBOX_SAVESTATE_H
+#include "savestate.h"
+#endif
+//--End of modifications
+
 enum DMAEvent {
 	DMA_REACHED_TC,
 	DMA_MASKED,
@@ -107,6 +113,11 @@ public:
 	}
 	void WriteControllerReg(Bitu reg,Bitu val,Bitu len);
 	Bitu ReadControllerReg(Bitu reg,Bitu len);
+	//--Added for save states. Channel callbacks are restored without being called,
+	//since the devices they belong to restore their own side of things.
+	void SaveState(std::ostream& stream);
+	void LoadState(std::istream& stream);
+	//--End of modifications
 };
 
 DmaChannel * GetDMAChannel(Bit8u chan);
@@ -99,6 +99,11 @@ extern DOS_Device * Devices[DOS_DEVICES];
 
 extern Bit8u dos_copybuf[0x10000];
 
+//--Added to let the shell cache batch files: incremented whenever a file is written to,
+//created, deleted or renamed, so anything cached from a file before then may be stale.
+extern Bitu dos_files_generation;
+//--End of modifications
+
 
 void DOS_SetError(Bit16u code);
 
@@ -111,9 +116,16 @@ enum { HAND_NONE=0,HAND_FILE,HAND_DEVICE};
 void DOS_SetupFiles (void);
 bool DOS_ReadFile(Bit16u handle,Bit8u * data,Bit16u * amount);
 bool DOS_WriteFile(Bit16u handle,Bit8u * data,Bit16u * amount);
+//--Added to tell INT 21h reads and writes which handles may skip dos_copybuf
+bool DOS_IsDeviceHandle(Bit16u handle);
+//--End of modifications
 bool DOS_SeekFile(Bit16u handle,Bit32u * pos,Bit32u type);
 bool DOS_CloseFile(Bit16u handle);
 bool DOS_FlushFile(Bit16u handle);
+//--Added to push every open file's writes out to the host, for when the emulator is about to be
+//torn down without closing its files: see BXEmulator cancelForProcessExit.
+void DOS_FlushAllFiles(void);
+//--End of modifications
 bool DOS_DuplicateEntry(Bit16u entry,Bit16u * newentry);
 bool DOS_ForceDuplicateEntry(Bit16u entry,Bit16u newentry);
 bool DOS_GetFileDate(Bit16u entry, Bit16u* otime, Bit16u* odate);
@@ -148,6 +160,9 @@ bool DOS_SetFileAttr(char const * const name,Bit16u attr);
 bool DOS_IOCTL(void);
 bool DOS_GetSTDINStatus();
 Bit8u DOS_FindDevice(char const * name);
+//--Added to let a restored snapshot pick up the current date and time
+void DOS_SyncDateTimeWithHost(void);
+//--End of modifications
 void DOS_SetupDevices(void);
 
 /* Execute and new process creation */
@@ -22,6 +22,10 @@
 #define DOSBOX_DOS_SYSTEM_H
 
 #include <vector>
+//--Added to keep an index of the drive cache between launches
+#include <map>
+#include <string>
+//--End of modifications
 #ifndef DOSBOX_DOSBOX_H
 #include "dosbox.h"
 #endif
@@ -83,6 +87,9 @@ public:
     //that their physical backing media will be removed.
     virtual void    willBecomeUnavailable()     { }
     //--End of modifications
+	//--Added to let Boxer push writes out to the host before tearing down the emulator without closing files
+	virtual void	Flush()						{ }
+	//--End of modifications
 	void SetDrive(Bit8u drv) { hdrive=drv;}
 	Bit8u GetDrive(void) { return hdrive;}
 	Bit32u flags;
@@ -158,6 +165,17 @@ public:
 	void		DeleteEntry			(const char* path, bool ignoreLastDir = false);
 
 	void		EmptyCache			(void);
+	//--Added to let drives bring a single cached directory back in step with the host folder
+	void		RefreshDir			(const char* path, bool recursive);
+	//--End of modifications
+	//--Added to keep an index of cached directories and their short names from one launch to the next.
+	//SetIndexFile reads the index previously saved at the specified host path, and saves the index back
+	//there whenever SaveIndex is called and when the cache is destroyed. Each saved directory is only
+	//trusted once the drive confirms the directory hasn't changed since: see DOS_Drive::get_directory_stamp.
+	//Directories that have changed are read again, but the files still in them keep their old short names.
+	bool		SetIndexFile		(const char* path);
+	bool		SaveIndex			(void);
+	//--End of modifications
 	void		SetLabel			(const char* name,bool cdrom,bool allowupdate);
 	char*		GetLabel			(void) { return label; };
 
@@ -167,6 +185,14 @@ public:
 			orgname[0] = shortname[0] = 0;
 			nextEntry = shortNr = 0;
 			isDir = false;
+			//--Added to index directory contents by name
+			nextByShortName = nextByLongName = 0;
+			indexedEntries = 0;
+			//--End of modifications
+			//--Added to keep an index of the drive cache between launches
+			stamp = 0;
+			hasStamp = false;
+			//--End of modifications
 		}
 		~CFileInfo(void) {
 			for (Bit32u i=0; i<fileList.size(); i++) delete fileList[i];
@@ -181,11 +207,62 @@ public:
 		// contents
 		std::vector<CFileInfo*>	fileList;
 		std::vector<CFileInfo*>	longNameList;
+
+		//--Added to index directory contents by name, so that lookups don't have to
+		//search fileList. Each table is a power-of-2 number of buckets, chained through
+		//the nextByShortName/nextByLongName links of the entries in this directory.
+		std::vector<CFileInfo*>	shortNameIndex;
+		std::vector<CFileInfo*>	longNameIndex;
+		Bitu		indexedEntries;
+		CFileInfo*	nextByShortName;
+		CFileInfo*	nextByLongName;
+		//--End of modifications
+
+		//--Added to keep an index of the drive cache between launches:
+		//the drive's stamp for this directory as of when its contents were read.
+		Bit64u		stamp;
+		bool		hasStamp;
+		//--End of modifications
 	};
 
 private:
 
 	bool		RemoveTrailingDot	(char* shortname);
+	//--Added to index directory contents by name
+	void		AddToIndex		(CFileInfo* dir, CFileInfo* info);
+	void		LinkIntoIndex		(CFileInfo* dir, CFileInfo* info);
+	void		RebuildIndex		(CFileInfo* dir);
+	void		ClearIndex		(CFileInfo* dir);
+	CFileInfo*	FindByShortName		(CFileInfo* dir, const char* shortname);
+	CFileInfo*	FindByLongName		(CFileInfo* dir, const char* longname);
+	//--End of modifications
+	//--Added to let drives bring a single cached directory back in step with the host folder
+	CFileInfo*	FindCachedHostDir	(const char* path);
+	void		ForgetContents		(CFileInfo* dir);
+	void		ForgetSearches		(CFileInfo* info);
+	//--End of modifications
+	//--Added to keep an index of the drive cache between launches
+	struct SavedEntry {
+		std::string	orgname;
+		char		shortname	[DOS_NAMELENGTH_ASCII];
+		Bitu		shortNr;
+		bool		isDir;
+	};
+	struct SavedDir {
+		Bit64u		stamp;
+		std::vector<SavedEntry>	entries;
+	};
+	typedef std::map<std::string,SavedDir> SavedDirs;
+
+	bool		IndexKey			(const char* hostPath, std::string& key);
+	bool		ReadDirContents		(CFileInfo* dir);
+	void		AddSavedEntry		(CFileInfo* dir, const SavedEntry& saved);
+	void		CollectSavedDirs	(CFileInfo* dir, const std::string& key, SavedDirs& into);
+	bool		IsStaleSavedDir		(const std::string& key);
+
+	SavedDirs	savedDirs;
+	std::string	indexFile;
+	//--End of modifications
 	Bits		GetLongName		(CFileInfo* info, char* shortname);
 	void		CreateShortName		(CFileInfo* dir, CFileInfo* info);
 	Bitu		CreateShortNameID	(CFileInfo* dir, const char* name);
@@ -250,6 +327,11 @@ public:
 	virtual void closedir(void *handle) {};
 	virtual bool read_directory_first(void *handle, char* entry_name, bool& is_directory) { return false; };
 	virtual bool read_directory_next(void *handle, char* entry_name, bool& is_directory) { return false; };
+	//--Added to let DOS_Drive_Cache tell whether a directory has changed since it was last read.
+	//Returns false if the drive can't vouch for the directory, otherwise fills stamp with a value
+	//that will be different once anything has been added to, removed from or renamed in it.
+	virtual bool get_directory_stamp(const char *dir, Bit64u& stamp) { return false; };
+	//--End of modifications
 
 	virtual const char * GetInfo(void);
 	char curdir[DOS_PATHLENGTH];
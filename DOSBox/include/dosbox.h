@@ -31,6 +31,7 @@
 //void E_Exit(const char * message,...) GCC_ATTRIBUTE( __format__(__printf__, 1, 2));
 
 void MSG_Add(const char*,const char*); //add messages to the internal langaugefile
+void MSG_AddCopy(const char*,const char*); //--Added: add messages whose strings may not last, copying them straight away
 const char* MSG_Get(char const *);     //get messages from the internal langaugafile
 
 class Section;
@@ -38,11 +39,34 @@ class Section;
 typedef Bitu (LoopHandler)(void);
 
 void DOSBOX_RunMachine();
+//--Added to report how many DOSBOX_RunMachine calls are currently nested, for save states
+Bitu DOSBOX_RunMachineDepth(void);
+//--End of modifications
 void DOSBOX_SetLoop(LoopHandler * handler);
 void DOSBOX_SetNormalLoop();
 
 void DOSBOX_Init(void);
 
+//--Added so that Boxer can tell whether the emulation thread is still making progress
+//Counts every tick the main loop has finished, only advanced on the emulation thread
+extern volatile Bitu DOSBOX_TicksCompleted;
+//--End of modifications
+
+//--Added to report the state of the automatic cycle controller
+struct DOSBOX_CycleControllerState {
+	Bit32s target;		//The cycle count the controller has settled on for now (CPU_CycleMax)
+	Bit32s achieved;	//Cycles emulated per millisecond of host time during the last measurement
+	double slack;		//Smoothed fraction of host time spent idle
+	double load;		//Smoothed share of the targeted host usage being achieved, where 1.0 is on target
+	Bitu adjustments;			//How many times the controller has changed the cycle count
+	Bitu starved_adjustments;	//How many of those changes were made while the mixer was short of audio
+	Bitu starved_raises;		//How many of those were raises, which make an underrun more likely
+};
+void DOSBOX_GetCycleControllerState(DOSBOX_CycleControllerState * state);
+//Discards the controller's measurement history, e.g. when the program or speed mode changes
+void DOSBOX_ResetCycleController(void);
+//--End of modifications
+
 class Config;
 extern Config * control;
 
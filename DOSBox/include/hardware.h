@@ -32,6 +32,8 @@ enum OPL_Mode {
 #define CAPTURE_MIDI	0x04
 #define CAPTURE_IMAGE	0x08
 #define CAPTURE_VIDEO	0x10
+//Boxer-specific: set while Boxer is recording a movie of the mixer output (see BXEmulator+BXRecording.)
+#define CAPTURE_MOVIE	0x20
 
 extern Bitu CaptureState;
 
@@ -31,8 +31,10 @@
 typedef Bitu IO_ReadHandler(Bitu port,Bitu iolen);
 typedef void IO_WriteHandler(Bitu port,Bitu val,Bitu iolen);
 
-extern IO_WriteHandler * io_writehandlers[3][IO_MAX];
-extern IO_ReadHandler * io_readhandlers[3][IO_MAX];
+//--Modified: the handler tables are now private to iohandler.cpp
+//extern IO_WriteHandler * io_writehandlers[3][IO_MAX];
+//extern IO_ReadHandler * io_readhandlers[3][IO_MAX];
+//--End of modifications
 
 void IO_RegisterReadHandler(Bitu port,IO_ReadHandler * handler,Bitu mask,Bitu range=1);
 void IO_RegisterWriteHandler(Bitu port,IO_WriteHandler * handler,Bitu mask,Bitu range=1);
@@ -68,6 +70,33 @@ public:
 	~IO_WriteHandleObject();
 };
 
+//--Added so that devices can put off their setup until a program first uses them.
+//The device installs its handlers as usual and then covers its ports with a trap. The first
+//read or write to any trapped port puts the device's handlers back, calls the activation
+//function and then passes the access on to the device. Until then, no handlers of the device
+//are called, so it need not have done anything it only needs once it is in use.
+typedef void IO_ActivationHandler(void);
+struct IO_TrappedPort;
+class IO_TrapHandleObject {
+public:
+	IO_TrapHandleObject():activate(0),active(false),trapped(0),count(0),next(0){};
+	void Install(Bitu port,IO_ActivationHandler * handler,Bitu range=1);
+	// activates the device straight away, e.g. to restore it from a save state
+	void Activate(void);
+	bool IsActive(void) const { return active; }
+	~IO_TrapHandleObject();
+
+	static IO_TrapHandleObject * Find(Bitu port);
+private:
+	void Uncover(bool restore);
+	IO_ActivationHandler * activate;
+	bool active;
+	IO_TrappedPort * trapped;
+	Bitu count;
+	IO_TrapHandleObject * next;
+};
+//--End of modifications
+
 static INLINE void IO_Write(Bitu port,Bit8u val) {
 	IO_WriteB(port,val);
 }
@@ -0,0 +1,89 @@
+/*
+ *  Copyright (C) 2002-2010  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+//--Added to record the input that reaches the emulated machine and play it back later,
+//so that the same stretch of a game can be rerun for benchmarking.
+//Each input is stamped with the number of emulated milliseconds since recording began, and
+//is played back at the start of that millisecond. Played back from the same machine state with
+//the same fixed cycle count, a recording therefore drives the machine the same way every time,
+//however fast the host runs it. While a recording is playing, live input is ignored.
+//A checksum of every frame drawn is kept alongside, to confirm that playback went the same way.
+
+#ifndef DOSBOX_INPUTREPLAY_H
+#define DOSBOX_INPUTREPLAY_H
+
+#ifndef DOSBOX_DOSBOX_H
+#include "dosbox.h"
+#endif
+
+enum ReplayInput {
+	REPLAY_KEY=0,				// code is the KBD_KEYS value, flag is whether it was pressed
+	REPLAY_MOUSE_MOVE,			// values are xrel, yrel, x and y, flag is whether to emulate
+	REPLAY_MOUSE_BUTTON,		// code is the button, flag is whether it was pressed
+	REPLAY_JOYSTICK_ENABLE,		// which is the joystick, flag is whether it was enabled
+	REPLAY_JOYSTICK_BUTTON,		// which is the joystick, code is the button, flag is whether it was pressed
+	REPLAY_JOYSTICK_MOVE_X,		// which is the joystick, the first value is the position
+	REPLAY_JOYSTICK_MOVE_Y
+};
+
+// true while recording, playing back or playing over the network
+extern bool replay_active;
+
+// stamps and records the specified input if recording. Returns false if the input should
+// be ignored because it is live input arriving while a recording is played back.
+bool REPLAY_HandleInput(Bit8u type,Bit8u which,Bit8u flag,Bit32u code,float v0,float v1,float v2,float v3);
+
+// called by the input handlers with the input they are about to apply
+static INLINE bool REPLAY_Input(Bit8u type,Bit8u which,Bit8u flag,Bit32u code,
+								float v0=0,float v1=0,float v2=0,float v3=0) {
+	if (GCC_LIKELY(!replay_active)) return true;
+	return REPLAY_HandleInput(type,which,flag,code,v0,v1,v2,v3);
+}
+
+// applies the specified input to the machine, letting it through the input handlers while netplay holds
+// live input back. The input handlers themselves must not call this.
+void REPLAY_ApplyInput(Bit8u type,Bit8u which,Bit8u flag,Bit32u code,float v0,float v1,float v2,float v3);
+// called by netplay when it starts and stops holding back live input: see netplay.h.
+// Starting netplay stops playback.
+void REPLAY_SetNetplayActive(bool active);
+
+// called by RENDER_EndUpdate with the source lines of each frame drawn
+void REPLAY_FrameDrawn(const Bit8u * lines,Bitu pitch,Bitu line_size,Bitu height);
+
+// starts recording from the current emulated time, discarding any previous recording
+void REPLAY_StartRecording(void);
+// stops recording and writes the recording to path. Returns false if it could not be written.
+bool REPLAY_StopRecording(const char * path);
+bool REPLAY_IsRecording(void);
+
+// starts playing back the recording at path from the current emulated time.
+// Returns false if the recording could not be read.
+bool REPLAY_StartPlayback(const char * path);
+void REPLAY_StopPlayback(void);
+bool REPLAY_IsPlaying(void);
+// whether playback has reached the emulated time at which recording stopped
+bool REPLAY_PlaybackFinished(void);
+
+// the number of frames drawn since recording or playback began, and a checksum of their contents
+Bitu REPLAY_FrameCount(void);
+Bit32u REPLAY_FrameChecksum(void);
+// the number of emulated milliseconds since recording or playback began
+Bitu REPLAY_ElapsedTicks(void);
+
+#endif
+//--End of modifications
@@ -118,6 +118,10 @@ public:
 
 	Bit8u* databuffer;	// received data is stored here until we get called
 	Bitu buflen;		// by Interrupt
+	//--Added to keep received data in the ECB itself rather than allocating a buffer for every packet:
+	//databuffer points here while there is data waiting, and is NULL otherwise.
+	Bit8u datastorage[IPXBUFFERSIZE];
+	//--End of modifications
 
 #ifdef IPX_DEBUGMSG 
 	Bitu SerialNumber;
@@ -146,6 +150,12 @@ public:
 	void getImmAddress(Bit8u* immAddr);
 
 	~ECBClass();
+
+	//--Added to recycle ECBs: games post one for every packet they send or listen for, so ECBs are
+	//handed out from a list of previously freed ones instead of going to the allocator every time.
+	static void * operator new(size_t size);
+	static void operator delete(void * ptr);
+	//--End of modifications
 };
 
 // The following routines may not be needed on all systems.  On my build of SDL the IPaddress structure is 8 octects 
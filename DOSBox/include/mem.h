@@ -22,6 +22,7 @@
 #ifndef DOSBOX_DOSBOX_H
 #include "dosbox.h"
 #endif
+#include <string.h>	//--Added for memcpy in the unaligned host accessors
 
 typedef Bit32u PhysPt;
 typedef Bit8u * HostPt;
@@ -84,24 +85,31 @@ static INLINE void host_writed(HostPt off,Bit32u val) {
 
 #else
 
+//--Modified to go through memcpy, which compilers turn into a single native unaligned load or
+//store (MOV on x86, LDR/STR on AArch64) without the pointer casts assuming natural alignment.
 static INLINE Bit8u host_readb(HostPt off) {
 	return *(Bit8u *)off;
 }
 static INLINE Bit16u host_readw(HostPt off) {
-	return *(Bit16u *)off;
+	Bit16u val;
+	memcpy(&val,off,sizeof(val));
+	return val;
 }
 static INLINE Bit32u host_readd(HostPt off) {
-	return *(Bit32u *)off;
+	Bit32u val;
+	memcpy(&val,off,sizeof(val));
+	return val;
 }
 static INLINE void host_writeb(HostPt off,Bit8u val) {
 	*(Bit8u *)(off)=val;
 }
 static INLINE void host_writew(HostPt off,Bit16u val) {
-	*(Bit16u *)(off)=val;
+	memcpy(off,&val,sizeof(val));
 }
 static INLINE void host_writed(HostPt off,Bit32u val) {
-	*(Bit32u *)(off)=val;
+	memcpy(off,&val,sizeof(val));
 }
+//--End of modifications
 
 #endif
 
@@ -153,6 +161,9 @@ static INLINE Bit32u phys_readd(PhysPt addr){
 void MEM_BlockWrite(PhysPt pt,void const * const data,Bitu size);
 void MEM_BlockRead(PhysPt pt,void * data,Bitu size);
 void MEM_BlockCopy(PhysPt dest,PhysPt src,Bitu size);
+//--Added to let block transfers go straight to host memory when the guest block is contiguous there
+HostPt MEM_GetBlockHostPt(PhysPt pt,Bitu size,bool write);
+//--End of modifications
 void MEM_StrCopy(PhysPt pt,char * data,Bitu size);
 
 void mem_memcpy(PhysPt dest,PhysPt src,Bitu size);
@@ -25,6 +25,14 @@
 #include "dosbox.h"
 #endif
 
+//--Added for the resampler's history
+#include <vector>
+struct MixerSincTable;
+//--End of modifications
+//--Added for the performance counters
+struct PerfChannelTiming;
+//--End of modifications
+
 typedef void (*MIXER_MixHandler)(Bit8u * sampdate,Bit32u len);
 typedef void (*MIXER_Handler)(Bitu len);
 
@@ -51,11 +59,19 @@ public:
 	void SetScale( float f );
 	void UpdateVolume(void);
 	void SetFreq(Bitu _freq);
+	//--Added for save states: the rate last passed to SetFreq, as near as the mixer can tell
+	Bitu GetFreq(void);
+	//--End of modifications
 	void Mix(Bitu _needed);
 	void AddSilence(void);			//Fill up until needed
 
 	template<class Type,bool stereo,bool signeddata,bool nativeorder>
 	void AddSamples(Bitu len, const Type* data);
+	//--Added to resample through a windowed-sinc filter
+	template<class Type,bool stereo,bool signeddata,bool nativeorder>
+	void AddSincSamples(Bitu len, const Type* data);
+	void ClearSincHistory(void);
+	//--End of modifications
 
 	void AddSamples_m8(Bitu len, const Bit8u * data);
 	void AddSamples_s8(Bitu len, const Bit8u * data);
@@ -80,13 +96,23 @@ public:
 	MIXER_Handler handler;
 	float volmain[2];
 	float scale;
-	Bit32s volmul[2];
+	//--Modified to hold the gains applied when mixing into the floating-point bus
+	float volmul[2];
+	//--End of modifications
 	Bitu freq_add,freq_index;
 	Bitu done,needed;
 	Bits last[2];
 	const char * name;
 	bool enabled;
 	MixerChannel * next;
+	//--Added for the windowed-sinc resampler: the filter for the current rate, if any,
+	//and the recent input for each side
+	MixerSincTable * sinc_table;
+	std::vector<float> sinc_input[2];
+	//--End of modifications
+	//--Added for the performance counters: host time spent mixing this channel
+	Bit64u perf_ticks;
+	//--End of modifications
 };
 
 MixerChannel * MIXER_AddChannel(MIXER_Handler handler,Bitu freq,const char * name);
@@ -94,6 +120,43 @@ MixerChannel * MIXER_FindChannel(const char * name);
 /* Find the device you want to delete with findchannel "delchan gets deleted" */
 void MIXER_DelChannel(MixerChannel* delchan); 
 
+//--Added for the performance counters
+/* Copies up to max channels' names and mixing times into timings and returns how many were
+   copied, then starts every channel's mixing time over. timings may be 0 if max is 0. */
+Bitu MIXER_TakeChannelTimings(PerfChannelTiming * timings,Bitu max);
+//--End of modifications
+
+//--Added to let Boxer adjust frameskip according to how much audio is buffered
+/* How much mixed audio is waiting to be played, as a multiple of the prebuffer size.
+ * Below 1.0, the output is in danger of underrunning. Returns -1 if there is no sound output. */
+float MIXER_BufferFillLevel(void);
+//--End of modifications
+
+//--Added to report on the ring that carries mixed audio to the audio callback
+struct MIXER_BufferState {
+	Bitu fill;			// frames waiting to be played
+	Bitu target;		// the prebuffer level the mixer is aiming for, in frames
+	Bitu capacity;		// the size of the ring, in frames
+	Bitu underruns;		// how many times the callback ran out of audio
+	Bitu dropped;		// frames thrown away because the ring was too full
+	Bitu latency;		// frames of delay the output device and its buffer add after the callback
+	//--Added for audio telemetry
+	Bitu callbacks;		// how many times the callback has asked for audio
+	Bitu stretched;		// callbacks that came up slightly short and stretched what there was to fit
+	Bitu overruns;		// callbacks that found the ring too full and skipped its oldest audio
+	Bitu skipped;		// frames skipped by those callbacks, which are also counted in dropped
+	Bitu delay;			// microseconds from the audio last played being mixed to it leaving the device
+	Bit64u delay_total;	// the sum of every delay measured so far, in microseconds
+	Bitu delay_count;	// how many delays have been measured
+	//--End of modifications
+};
+void MIXER_GetBufferState(MIXER_BufferState * state);
+//--End of modifications
+
+//--Added to let Boxer pause and resume the sound output, whichever way it is being played
+void MIXER_PauseOutput(bool pause);
+//--End of modifications
+
 /* Object to maintain a mixerchannel; As all objects it registers itself with create
  * and removes itself when destroyed. */
 class MixerObject{
@@ -0,0 +1,96 @@
+/*
+ *  Copyright (C) 2002-2010  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+//--Added to play over the network by running the same machine in lockstep on every player's host.
+//One player hosts and the others join. Once everyone has joined, the host snapshots its machine and
+//sends it to the others, and from then on only input is exchanged. Emulated time is divided into
+//frames of a fixed number of milliseconds: input that reaches the machine during one frame is held
+//back and applied on every host at the start of a frame a few frames later, once everyone's input
+//for that frame has arrived. Given the same starting state, the same fixed cycle count and the same
+//input at the same emulated instants, every host's machine runs the same way.
+
+//Input travels over UDP through the host, which relays it to the other players. Each packet repeats
+//every frame of input the recipient has not yet acknowledged, so lost packets cost nothing as long
+//as a later one gets through. Every so often each host adds a hash of its machine's state, so that
+//a machine that has gone its own way is noticed rather than played on regardless.
+
+//Netplay is started and the snapshot is taken and restored from NETPLAY_Poll, which must be called
+//between emulated instructions at a point where save states can be made: see savestate.h.
+
+#ifndef DOSBOX_NETPLAY_H
+#define DOSBOX_NETPLAY_H
+
+#ifndef DOSBOX_DOSBOX_H
+#include "dosbox.h"
+#endif
+
+#define NETPLAY_DEFAULT_PORT		21300
+#define NETPLAY_MAX_PLAYERS			4
+
+enum NetplayState {
+	NETPLAY_INACTIVE=0,
+	NETPLAY_WAITING,			// waiting for players to join, or for the host's snapshot
+	NETPLAY_RUNNING,			// playing in lockstep
+	NETPLAY_FAILED				// stopped because a player went quiet or a machine went its own way
+};
+
+struct NetplaySettings {
+	Bitu players;				// how many players, including the host
+	Bitu frame_ms;				// emulated milliseconds per frame of input
+	Bitu delay;					// how many frames input is held back for
+	Bitu hash_interval;			// how many frames apart to compare machine states
+	Bits cycles;				// the fixed cycle count every machine must run at
+	Bitu core;					// the CPU core every machine must run, as a BXCoreMode
+};
+
+// starts hosting a game for the specified settings, listening on port. build identifies this
+// build to joining players, who must be running the same one. Returns false if the port
+// could not be opened.
+bool NETPLAY_Host(Bit16u port,const NetplaySettings& settings,const char * build);
+// starts joining the game hosted at the specified address. Returns false if the host
+// could not be resolved or a socket could not be opened.
+bool NETPLAY_Join(const char * host,Bit16u port,const char * build);
+void NETPLAY_Stop(void);
+
+// sends and receives whatever is due while not playing in lockstep, and takes or restores the
+// snapshot once everyone has joined. Returns true if the machine was just replaced or snapshotted
+// and lockstep play has begun, so that the caller can apply the settings. Blocks while the
+// snapshot is being sent and restored.
+bool NETPLAY_Poll(void);
+
+// can be called from any thread to give up waiting on the other players, stopping netplay
+// the next time the emulation thread checks.
+void NETPLAY_Interrupt(void);
+
+NetplayState NETPLAY_State(void);
+// the settings of the game, as chosen by the host: valid once lockstep play has begun
+const NetplaySettings& NETPLAY_Settings(void);
+// this player's number, with the host being 0, and how many players have joined so far
+Bitu NETPLAY_PlayerIndex(void);
+Bitu NETPLAY_JoinedPlayers(void);
+// why netplay failed, for NETPLAY_FAILED
+const char * NETPLAY_FailureReason(void);
+// how long, in host milliseconds, the machine has spent waiting on other players' input
+Bitu NETPLAY_StallTime(void);
+
+// called by REPLAY_HandleInput with live input: holds the input back until its frame comes round
+// and returns whether to apply it now, which is only while applying a frame.
+bool NETPLAY_HandleInput(Bit8u type,Bit8u which,Bit8u flag,Bit32u code,float v0,float v1,float v2,float v3);
+
+#endif
+//--End of modifications
@@ -30,7 +30,13 @@
 
 // disable this to reduce the size of the TLB
 // NOTE: does not work with the dynamic core (dynrec is fine)
+//--Modified to use the full TLB only for the dynamic x86 core, whose generated code indexes
+//paging.tlb.read directly. Otherwise the compact TLB keeps each page's entry together and
+//only allocates the banks for pages above 256MB when they are first used.
+#if (C_DYNAMIC_X86)
 #define USE_FULL_TLB
+#endif
+//--End of modifications
 
 class PageDirectory;
 
@@ -90,6 +96,10 @@ void PAGING_ClearTLB(void);
 void PAGING_LinkPage(Bitu lin_page,Bitu phys_page);
 void PAGING_LinkPage_ReadOnly(Bitu lin_page,Bitu phys_page);
 void PAGING_UnlinkPages(Bitu lin_page,Bitu pages);
+//--Added to drop only the TLB entries that map to the specified physical pages: when paging is
+//enabled, any linear page could map to them and the whole TLB is cleared instead.
+void PAGING_UnlinkPhysPages(Bitu phys_page,Bitu pages);
+//--End of modifications
 /* This maps the page directly, only use when paging is disabled */
 void PAGING_MapPage(Bitu lin_page,Bitu phys_page);
 bool PAGING_MakePhysPage(Bitu & page);
@@ -195,6 +205,16 @@ bool mem_unalignedreadd_checked(PhysPt address,Bit32u * val);
 bool mem_unalignedwritew_checked(PhysPt address,Bit16u val);
 bool mem_unalignedwrited_checked(PhysPt address,Bit32u val);
 
+//--Added to let REP MOVS, STOS and LODS copy, fill and read plain RAM a page at a time.
+//Each does as many of count elements as it can, starting at base+index and stepping by add_index
+//(the element size, negated when the direction flag is set), and updates the indexes and returns
+//how many elements are left. They stop at the first element that lies in a page with a handler,
+//and leave that and the rest to the caller's element-by-element loop.
+Bitu MEM_MovsFast(PhysPt si_base,Bitu * si_index,PhysPt di_base,Bitu * di_index,Bitu add_mask,Bits add_index,Bitu count);
+Bitu MEM_StosFast(PhysPt di_base,Bitu * di_index,Bitu add_mask,Bits add_index,Bitu count,Bit32u val);
+Bitu MEM_LodsFast(PhysPt si_base,Bitu * si_index,Bitu add_mask,Bits add_index,Bitu count,Bit32u * val);
+//--End of modifications
+
 #if defined(USE_FULL_TLB)
 
 static INLINE HostPt get_tlb_read(PhysPt address) {
@@ -225,7 +245,9 @@ void PAGING_InitTLBBank(tlb_entry **bank);
 
 static INLINE tlb_entry *get_tlb_entry(PhysPt address) {
 	Bitu index=(address>>12);
-	if (TLB_BANKS && (index > TLB_SIZE)) {
+	//--Modified to send the first page above the flat TLB to the banks instead of past the end of tlbh
+	if (TLB_BANKS && (index >= TLB_SIZE)) {
+	//--End of modifications
 		Bitu bank=(address>>BANK_SHIFT) - 1;
 		if (!paging.tlbh_banks[bank])
 			PAGING_InitTLBBank(&paging.tlbh_banks[bank]);
@@ -267,21 +289,23 @@ static INLINE Bit8u mem_readb_inline(PhysPt address) {
 	else return (Bit8u)(get_tlb_readhandler(address))->readb(address);
 }
 
+//--Modified to look up the TLB before checking whether the access crosses a page, so that
+//the fast path tests both at once with a single branch: on AArch64 this becomes a CMP/CCMP
+//pair. The slow paths sort out which of the two it was.
 static INLINE Bit16u mem_readw_inline(PhysPt address) {
-	if ((address & 0xfff)<0xfff) {
-		HostPt tlb_addr=get_tlb_read(address);
-		if (tlb_addr) return host_readw(tlb_addr+address);
-		else return (Bit16u)(get_tlb_readhandler(address))->readw(address);
-	} else return mem_unalignedreadw(address);
+	HostPt tlb_addr=get_tlb_read(address);
+	if (GCC_LIKELY((tlb_addr!=0) & ((address & 0xfff)<0xfff))) return host_readw(tlb_addr+address);
+	if ((address & 0xfff)<0xfff) return (Bit16u)(get_tlb_readhandler(address))->readw(address);
+	return mem_unalignedreadw(address);
 }
 
 static INLINE Bit32u mem_readd_inline(PhysPt address) {
-	if ((address & 0xfff)<0xffd) {
-		HostPt tlb_addr=get_tlb_read(address);
-		if (tlb_addr) return host_readd(tlb_addr+address);
-		else return (get_tlb_readhandler(address))->readd(address);
-	} else return mem_unalignedreadd(address);
+	HostPt tlb_addr=get_tlb_read(address);
+	if (GCC_LIKELY((tlb_addr!=0) & ((address & 0xfff)<0xffd))) return host_readd(tlb_addr+address);
+	if ((address & 0xfff)<0xffd) return (get_tlb_readhandler(address))->readd(address);
+	return mem_unalignedreadd(address);
 }
+//--End of modifications
 
 static INLINE void mem_writeb_inline(PhysPt address,Bit8u val) {
 	HostPt tlb_addr=get_tlb_write(address);
@@ -289,21 +313,21 @@ static INLINE void mem_writeb_inline(PhysPt address,Bit8u val) {
 	else (get_tlb_writehandler(address))->writeb(address,val);
 }
 
+//--Modified to test the TLB and page crossing with a single branch, as for the reads above
 static INLINE void mem_writew_inline(PhysPt address,Bit16u val) {
-	if ((address & 0xfff)<0xfff) {
-		HostPt tlb_addr=get_tlb_write(address);
-		if (tlb_addr) host_writew(tlb_addr+address,val);
-		else (get_tlb_writehandler(address))->writew(address,val);
-	} else mem_unalignedwritew(address,val);
+	HostPt tlb_addr=get_tlb_write(address);
+	if (GCC_LIKELY((tlb_addr!=0) & ((address & 0xfff)<0xfff))) host_writew(tlb_addr+address,val);
+	else if ((address & 0xfff)<0xfff) (get_tlb_writehandler(address))->writew(address,val);
+	else mem_unalignedwritew(address,val);
 }
 
 static INLINE void mem_writed_inline(PhysPt address,Bit32u val) {
-	if ((address & 0xfff)<0xffd) {
-		HostPt tlb_addr=get_tlb_write(address);
-		if (tlb_addr) host_writed(tlb_addr+address,val);
-		else (get_tlb_writehandler(address))->writed(address,val);
-	} else mem_unalignedwrited(address,val);
+	HostPt tlb_addr=get_tlb_write(address);
+	if (GCC_LIKELY((tlb_addr!=0) & ((address & 0xfff)<0xffd))) host_writed(tlb_addr+address,val);
+	else if ((address & 0xfff)<0xffd) (get_tlb_writehandler(address))->writed(address,val);
+	else mem_unalignedwrited(address,val);
 }
+//--End of modifications
 
 
 static INLINE bool mem_readb_checked(PhysPt address, Bit8u * val) {
@@ -362,5 +386,46 @@ static INLINE bool mem_writed_checked(PhysPt address,Bit32u val) {
 	} else return mem_unalignedwrited_checked(address,val);
 }
 
+//--Added to deliver page faults by unwinding back to the core that made the access, instead of
+//running the guest's handler in a nested emulation loop. A core that can restart the current
+//instruction from scratch makes its reads through the mem_read*_restartable functions below, and
+//catches PagingFault around its decode loop. If one of those reads page-faults, PAGING_PageFault
+//throws rather than nesting, and the core raises the exception with EIP still at the start of
+//the instruction. Writes, and reads made anywhere else, still take the nested path.
+struct PagingFault {
+	Bitu faultcode;
+};
+
+// set only while a restartable read is in the TLB's slow path
+extern bool paging_restartable;
+
+static INLINE Bit8u mem_readb_restartable(PhysPt address) {
+	HostPt tlb_addr=get_tlb_read(address);
+	if (tlb_addr) return host_readb(tlb_addr+address);
+	paging_restartable=true;
+	Bit8u val=mem_readb_inline(address);
+	paging_restartable=false;
+	return val;
+}
+
+static INLINE Bit16u mem_readw_restartable(PhysPt address) {
+	HostPt tlb_addr=get_tlb_read(address);
+	if (GCC_LIKELY((tlb_addr!=0) & ((address & 0xfff)<0xfff))) return host_readw(tlb_addr+address);
+	paging_restartable=true;
+	Bit16u val=mem_readw_inline(address);
+	paging_restartable=false;
+	return val;
+}
+
+static INLINE Bit32u mem_readd_restartable(PhysPt address) {
+	HostPt tlb_addr=get_tlb_read(address);
+	if (GCC_LIKELY((tlb_addr!=0) & ((address & 0xfff)<0xffd))) return host_readd(tlb_addr+address);
+	paging_restartable=true;
+	Bit32u val=mem_readd_inline(address);
+	paging_restartable=false;
+	return val;
+}
+//--End of modifications
+
 
 #endif
@@ -0,0 +1,125 @@
+/*
+ *  Copyright (C) 2002-2010  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+//--Added to time how long the emulation thread spends in each part of the emulator.
+//Whenever the emulation thread moves into or out of a subsystem, the host time since the last
+//move is charged to the subsystem it was in, so each counter holds time spent in that subsystem
+//alone and the counters add up to the total. Mixer channels also keep their own running totals.
+//Once a second the totals are published as a snapshot that other threads can read, and emitted
+//as a signpost interval for Instruments.
+//While the counters are disabled, each instrumented point costs a single flag test.
+//While they are enabled, heap allocations made on the emulation thread are counted too, since
+//allocating in steady-state emulation means contending with other threads for the allocator.
+
+#ifndef DOSBOX_PERFCOUNTERS_H
+#define DOSBOX_PERFCOUNTERS_H
+
+#ifndef DOSBOX_DOSBOX_H
+#include "dosbox.h"
+#endif
+
+#include <mach/mach_time.h>
+
+enum PerfCounter {
+	PERF_OTHER=0,		// anything not covered below, such as timer and PIC events
+	PERF_CPU,			// running guest code in the CPU core
+	PERF_CALLBACK,		// running an emulator callback, such as a BIOS or DOS service
+	PERF_IO,			// running an emulated IO port handler
+	PERF_VGA,			// drawing emulated video lines
+	PERF_RENDER,		// scaling drawn lines into the output frame
+	PERF_MIXER,			// mixing and synthesizing audio
+	PERF_COALFACE,		// processing Boxer's events and handing frames to Boxer
+	PERF_IDLE,			// sleeping to keep emulated time in step with the host
+	PERF_COUNTER_COUNT
+};
+
+#define PERF_MAX_CHANNELS	16
+
+struct PerfChannelTiming {
+	char name[32];
+	double seconds;
+};
+
+struct PerfSnapshot {
+	Bitu sequence;							// increases with every snapshot published
+	double interval;						// host seconds covered by the snapshot
+	double seconds[PERF_COUNTER_COUNT];		// host seconds spent in each subsystem
+	Bitu channel_count;
+	PerfChannelTiming channels[PERF_MAX_CHANNELS];	// host seconds spent mixing each channel
+	double emulated_seconds;				// emulated seconds covered by the snapshot
+	Bits allocations;						// heap allocations made on the emulation thread, or -1 if
+											// they could not be counted
+};
+
+// only touched on the emulation thread
+extern bool perf_enabled;
+extern Bit8u perf_current;
+extern Bit64u perf_last;
+extern Bit64u perf_ticks[PERF_COUNTER_COUNT];
+
+// charges the time since the last switch to the current subsystem, makes counter the current
+// subsystem, and returns the time of the switch
+static INLINE Bit64u PERF_Switch(Bit8u counter) {
+	Bit64u now=mach_absolute_time();
+	perf_ticks[perf_current]+=now-perf_last;
+	perf_last=now;
+	perf_current=counter;
+	return now;
+}
+
+// charges the emulation thread's time to the specified subsystem for as long as the scope lasts,
+// adding the time spent inside the scope to total as well if one is given
+class PerfScope {
+public:
+	PerfScope(Bit8u counter,Bit64u * total=0) : active(perf_enabled) {
+		if (GCC_UNLIKELY(active)) {
+			old_counter=perf_current;
+			inclusive=total;
+			started=PERF_Switch(counter);
+		}
+	}
+	~PerfScope() {
+		if (GCC_UNLIKELY(active)) {
+			Bit64u now=PERF_Switch(old_counter);
+			if (inclusive) *inclusive+=now-started;
+		}
+	}
+private:
+	bool active;
+	Bit8u old_counter;
+	Bit64u started;
+	Bit64u * inclusive;
+};
+
+// called on the emulation thread about once every emulated millisecond: applies any change to
+// whether the counters are enabled, and publishes a snapshot once a second has gone by
+void PERF_Tick(void);
+
+// may be called from any thread, and takes effect at the next PERF_Tick
+void PERF_SetEnabled(bool enabled);
+bool PERF_IsEnabled(void);
+
+// copies the most recent snapshot, returning false if none has been published since
+// the counters were enabled
+bool PERF_GetSnapshot(PerfSnapshot * snapshot);
+
+// converts a difference between two switch times into seconds
+double PERF_Seconds(Bit64u ticks);
+
+#endif
+//--End of modifications
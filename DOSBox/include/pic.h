@@ -48,9 +48,37 @@ static INLINE Bits PIC_MakeCycles(double amount) {
 	return (Bits)(CPU_CycleMax*amount);
 }
 
+//--Added to keep emulated time as a 64-bit integer count of nanoseconds, so that timing in hot
+//IO paths needs no floating point and does not lose precision as a session goes on. The time within
+//the current millisecond is the cycles used so far scaled by a 32.32 fixed-point count of nanoseconds
+//per cycle, which is only worked out again when CPU_CycleMax has changed since it was last used.
+#define PIC_NS_PER_MS	1000000
+
+extern Bit64u PIC_NsPerCycle;
+extern Bit32s PIC_NsPerCycleMax;
+void PIC_UpdateNsPerCycle(void);
+
+static INLINE Bit64s PIC_TickIndexNs(void) {
+	if (GCC_UNLIKELY(PIC_NsPerCycleMax!=CPU_CycleMax)) PIC_UpdateNsPerCycle();
+	return ((Bit64s)PIC_TickIndexND()*(Bit64s)PIC_NsPerCycle)>>32;
+}
+
+static INLINE Bit64s PIC_FullIndexNs(void) {
+	return (Bit64s)PIC_Ticks*PIC_NS_PER_MS+PIC_TickIndexNs();
+}
+
+// converts a time in nanoseconds to whole ticks of a clock running at rate Hz. The divisions are
+// by a constant, so the compiler turns them into multiplications, and the split keeps the products
+// from overflowing however long the session has run.
+static INLINE Bit64u PIC_NsToClocks(Bit64u ns,Bit32u rate) {
+	return (ns/1000000000)*rate+((ns%1000000000)*rate)/1000000000;
+}
+
+// for the edges that still want milliseconds as a double
 static INLINE double PIC_FullIndex(void) {
-	return PIC_Ticks+(double)PIC_TickIndex();
+	return PIC_Ticks+PIC_TickIndexNs()/(double)PIC_NS_PER_MS;
 }
+//--End of modifications
 
 void PIC_ActivateIRQ(Bitu irq);
 void PIC_DeActivateIRQ(Bitu irq);
@@ -63,5 +91,9 @@ void PIC_AddEvent(PIC_EventHandler handler,float delay,Bitu val=0);
 void PIC_RemoveEvents(PIC_EventHandler handler);
 void PIC_RemoveSpecificEvents(PIC_EventHandler handler, Bitu val);
 
+//--Added to report the most events that have been pending at once since the PIC was set up
+Bitu PIC_GetPeakQueueDepth(void);
+//--End of modifications
+
 void PIC_SetIRQMask(Bitu irq, bool masked);
 #endif
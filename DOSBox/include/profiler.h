@@ -0,0 +1,87 @@
+/*
+ *  Copyright (C) 2002-2010  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+//--Added to provide a sampling profiler that works without building the debugger.
+//While running, a host timer periodically records where the guest is (CS:EIP), which CPU core
+//is active and what the emulator is doing on the guest's behalf (a callback, an IO handler or
+//a page fault), and counts each distinct combination in a histogram.
+//Note that the dynamic cores only update EIP at block boundaries, so under those cores samples
+//are attributed to the start of the running block rather than the exact instruction.
+
+#ifndef DOSBOX_PROFILER_H
+#define DOSBOX_PROFILER_H
+
+#ifndef DOSBOX_DOSBOX_H
+#include "dosbox.h"
+#endif
+
+enum ProfilerContext {
+	PROFILER_GUEST=0,		// running guest code
+	PROFILER_CALLBACK,		// running an emulator callback, such as a BIOS or DOS service
+	PROFILER_IO,			// running an emulated IO port handler
+	PROFILER_PAGEFAULT,		// handling a guest page fault
+	PROFILER_CONTEXT_COUNT
+};
+
+// these match the values of BXCoreMode
+enum ProfilerCore {
+	PROFILER_CORE_NORMAL=0,
+	PROFILER_CORE_DYNAMIC,
+	PROFILER_CORE_SIMPLE,
+	PROFILER_CORE_FULL,
+	PROFILER_CORE_THREADED,
+	PROFILER_CORE_OTHER
+};
+
+struct ProfilerSample {
+	Bit16u cs;
+	Bit32u eip;
+	Bit8u core;
+	Bit8u context;
+	Bitu count;
+};
+
+// what the emulator is currently doing, read by the sampling timer
+extern volatile Bit8u profiler_context;
+
+// marks the emulator as being in the specified context for as long as the scope lasts
+class ProfilerContextScope {
+public:
+	ProfilerContextScope(Bit8u context) : old_context(profiler_context) { profiler_context=context; }
+	~ProfilerContextScope() { profiler_context=old_context; }
+private:
+	Bit8u old_context;
+};
+
+// starts sampling every interval_usec microseconds, continuing any existing histogram
+void PROFILER_Start(Bitu interval_usec);
+void PROFILER_Stop(void);
+bool PROFILER_IsRunning(void);
+
+// discards all samples recorded so far
+void PROFILER_Reset(void);
+
+// copies up to max_samples histogram entries into samples, most frequent first,
+// and returns how many were copied
+Bitu PROFILER_GetSamples(ProfilerSample * samples,Bitu max_samples);
+
+// the number of samples taken, including those that did not fit in the histogram
+Bitu PROFILER_GetTotalSamples(void);
+
+#endif
+//--End of modifications
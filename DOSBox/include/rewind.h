@@ -0,0 +1,62 @@
+/*
+ *  Copyright (C) 2002-2010  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+//--Added to let the emulated machine be wound back to recent points in time.
+//The rewind history is a bounded series of frames built on top of save states. A keyframe holds
+//all of main memory along with the rest of the machine's state; the frames that follow it hold
+//only the pages of main memory that were written to since the frame before, and the parts of
+//the rest of the machine's state that changed. Written pages are found by write-protecting main
+//memory on the host and catching the first write to each page, so that play is only slowed by
+//one fault per page per frame.
+
+//Frames are captured and restored with the same restrictions as save states: see savestate.h.
+//The history is only available on hosts that support memory protection, and is discarded
+//along with main memory when the machine is reconfigured.
+
+#ifndef DOSBOX_REWIND_H
+#define DOSBOX_REWIND_H
+
+#ifndef DOSBOX_SAVESTATE_H
+#include "savestate.h"
+#endif
+
+// budget is the most memory in bytes that the history may use, though the newest keyframe
+// and the frames after it are always kept. Returns false if rewinding is unavailable.
+bool REWIND_Start(Bitu budget,Bitu keyframe_interval);
+void REWIND_Stop(void);
+bool REWIND_IsActive(void);
+
+// discards all frames, for when the machine has been changed behind the history's back
+void REWIND_Clear(void);
+
+// drops the oldest frames until the history fits within budget, for when the host is short
+// of memory. The newest keyframe and the frames after it are still kept, and later frames
+// are trimmed to the budget the history was started with.
+void REWIND_Shrink(Bitu budget);
+
+// adds a frame for the machine's current state
+bool REWIND_Capture(void);
+
+// age is counted back from the newest frame, which is 0. Frames newer than
+// the one restored are discarded, and the restored frame becomes the newest.
+SaveStateResult REWIND_Restore(Bitu age,std::string& reason);
+
+Bitu REWIND_FrameCount(void);
+Bitu REWIND_MemoryUsed(void);
+
+#endif
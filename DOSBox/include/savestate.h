@@ -0,0 +1,96 @@
+/*
+ *  Copyright (C) 2002-2010  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+//--Added to snapshot and restore the whole emulated machine.
+//Each subsystem that holds machine state implements SaveStateComponent and registers itself
+//under a fixed name when it is created. A snapshot is a header followed by each registered
+//component's state in registration order, which is also the order the components were
+//initialised in, so that a component can rely on the ones before it having been restored.
+
+//Snapshots are only portable between identical builds running identical configurations:
+//handler functions are stored as offsets into the executable, and the component list must
+//match exactly. Snapshots must also be saved and loaded at the same depth of nested
+//DOSBOX_RunMachine calls, since the host stack below that point is not part of the snapshot.
+//In practice this means snapshots should be taken and restored from GFX_Events, between
+//emulated instructions.
+
+#ifndef DOSBOX_SAVESTATE_H
+#define DOSBOX_SAVESTATE_H
+
+#ifndef DOSBOX_DOSBOX_H
+#include "dosbox.h"
+#endif
+
+#include <iostream>
+#include <string>
+
+class SaveStateComponent {
+public:
+	virtual ~SaveStateComponent() {}
+	virtual void SaveState(std::ostream& stream)=0;
+	virtual void LoadState(std::istream& stream)=0;
+};
+
+enum SaveStateResult {
+	SAVESTATE_OK=0,
+	SAVESTATE_INCOMPATIBLE,		// the snapshot was rejected before any state was changed
+	SAVESTATE_DAMAGED			// the snapshot was unreadable partway through: machine state is now undefined
+};
+
+// components are keyed by name, so the same name must not be registered twice
+void SAVESTATE_Register(const char * name,SaveStateComponent * component);
+void SAVESTATE_Unregister(SaveStateComponent * component);
+
+// the build identifier should change whenever the executable does
+bool SAVESTATE_Save(std::ostream& stream,const char * build);
+SaveStateResult SAVESTATE_Load(std::istream& stream,const char * build,std::string& reason);
+
+// while excluded, main memory is left out of snapshots and left alone when loading them,
+// for callers such as the rewind history that keep track of memory themselves
+void SAVESTATE_SetMainMemoryExcluded(bool excluded);
+bool SAVESTATE_MainMemoryExcluded(void);
+
+// helpers for components to write plain-old-data values and blocks
+template <typename T> static INLINE void SAVESTATE_Write(std::ostream& stream,const T& value) {
+	stream.write(reinterpret_cast<const char *>(&value),sizeof(T));
+}
+template <typename T> static INLINE void SAVESTATE_Read(std::istream& stream,T& value) {
+	stream.read(reinterpret_cast<char *>(&value),sizeof(T));
+}
+static INLINE void SAVESTATE_WriteBlock(std::ostream& stream,const void * data,Bitu size) {
+	stream.write(reinterpret_cast<const char *>(data),(std::streamsize)size);
+}
+static INLINE void SAVESTATE_ReadBlock(std::istream& stream,void * data,Bitu size) {
+	stream.read(reinterpret_cast<char *>(data),(std::streamsize)size);
+}
+void SAVESTATE_WriteString(std::ostream& stream,const std::string& value);
+void SAVESTATE_ReadString(std::istream& stream,std::string& value);
+
+// handler functions are stored relative to the executable, to survive address space randomisation
+typedef void (*SaveStateFunction)(void);
+void SAVESTATE_WriteFunction(std::ostream& stream,SaveStateFunction function);
+SaveStateFunction SAVESTATE_ReadFunction(std::istream& stream);
+
+template <typename T> static INLINE void SAVESTATE_WriteHandler(std::ostream& stream,T handler) {
+	SAVESTATE_WriteFunction(stream,reinterpret_cast<SaveStateFunction>(handler));
+}
+template <typename T> static INLINE void SAVESTATE_ReadHandler(std::istream& stream,T& handler) {
+	handler=reinterpret_cast<T>(SAVESTATE_ReadFunction(stream));
+}
+
+#endif
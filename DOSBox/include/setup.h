@@ -42,6 +42,12 @@
 #include <string>
 #endif
 
+//--Added for Module_base's save state hooks
+#ifndef DOSBOX_SAVESTATE_H
+#include "savestate.h"
+#endif
+//--End of modifications
+
 
 class Hex {
 private:
@@ -118,7 +124,7 @@ public:
 	struct Changeable { enum Value {Always, WhenIdle,OnlyAtStart};};
 	const std::string propname;
 
-	Property(std::string const& _propname, Changeable::Value when):propname(_propname),change(when) { }
+	Property(std::string const& _propname, Changeable::Value when):propname(_propname),change(when),help_registered(false) { }
 	void Set_values(const char * const * in);
 	void Set_help(std::string const& str);
 	char const* Get_help();
@@ -141,6 +147,10 @@ protected:
 	typedef std::vector<Value>::iterator iter;
 	Value default_value;
 	const Changeable::Value change;
+	//--Added to register the help text as a message only once it is asked for
+	std::string help;
+	bool help_registered;
+	//--End of modifications
 };
 
 class Prop_int:public Property {
@@ -317,7 +327,9 @@ public:
 	std::string data;
 };
 
-class Module_base {
+//--Modified to let modules take part in save states: see savestate.h.
+//Modules that hold machine state override these and register themselves with SAVESTATE_Register.
+class Module_base: public SaveStateComponent {
 	/* Base for all hardware and software "devices" */
 protected:
 	Section* m_configuration;
@@ -327,5 +339,8 @@ public:
 	virtual ~Module_base(){/*LOG_MSG("executed")*/;};//Destructors are required
 	/* Returns true if succesful.*/
 	virtual bool Change_Config(Section* /*newconfig*/) {return false;} ;
+	virtual void SaveState(std::ostream& /*stream*/) {}
+	virtual void LoadState(std::istream& /*stream*/) {}
 };
+//--End of modifications
 #endif
@@ -61,6 +61,22 @@ public:
 	BatchFile * prev;
 	CommandLine * cmd;
 	std::string filename;
+	//--Added to let Boxer run a series of its own commands as a batch file held only in memory.
+	//An in-memory batch file is never read from DOS, and does not report its lifecycle to Boxer;
+	//batch files launched from it act as though they were CALLed, so that the rest of its lines
+	//still run once they finish.
+	BatchFile(DOS_Shell * host,char const * const name,std::string const& lines);
+	void AppendLines(std::string const& lines);
+	bool in_memory;
+	//--End of modifications
+	//--Added to read batch files from memory rather than a byte at a time through DOS
+private:
+	bool LoadContents(void);
+	std::string contents;
+	bool contents_loaded;
+	Bitu contents_generation;
+	DOS_Drive * contents_drive;
+	//--End of modifications
 };
 
 class AutoexecEditor;
@@ -0,0 +1,79 @@
+/*
+ *  Copyright (C) 2002-2010  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+//--Added to mark out individual frames, audio blocks and file operations as signpost intervals,
+//so that Instruments can line up what each thread was doing when audio drops out or frames stall.
+//Unlike the perf counters these need no enabling: while nothing is recording signposts, beginning
+//an interval costs a single check and returns 0, and ending an interval with an ID of 0 does nothing.
+//Boxer's Objective-C side uses these too, so this header is plain C.
+//The Boxer.instrpkg package in Instruments lays the intervals out per thread.
+
+#ifndef DOSBOX_SIGNPOSTS_H
+#define DOSBOX_SIGNPOSTS_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum SignpostInterval {
+	SIGNPOST_FRAME=0,		// drawing an emulated frame, from RENDER_StartUpdate to RENDER_EndUpdate
+	SIGNPOST_MIXER,			// mixing a block of audio in MIXER_MixData
+	SIGNPOST_UNDERRUN,		// playing silence on the audio thread because no mixed audio was ready
+	SIGNPOST_FRAME_HANDOFF,	// handing a finished frame over to Boxer
+	SIGNPOST_RENDERER,		// drawing the latest frame to the screen
+	SIGNPOST_DRIVE_IO,		// a file or directory operation on a local drive
+	SIGNPOST_AUDIO_CALLBACK,	// handing mixed audio to the output device, labelled with how it went
+	SIGNPOST_CYCLE_ADJUST,	// the automatic cycle controller changing the cycle count
+	SIGNPOST_INTERVAL_COUNT
+};
+
+typedef uint64_t SignpostID;
+
+// begins an interval, labelled with an operation and detail if given (such as "open" and a file path),
+// and returns the ID to end it with; or returns 0 if signposts aren't being recorded
+SignpostID SIGNPOST_Begin(enum SignpostInterval interval,const char * operation,const char * detail);
+
+// ends an interval begun with SIGNPOST_Begin
+void SIGNPOST_End(enum SignpostInterval interval,SignpostID signpost);
+
+// whether intervals of this kind are being recorded, so that callers can skip formatting details
+// that nothing will see
+int SIGNPOST_Enabled(enum SignpostInterval interval);
+
+#ifdef __cplusplus
+}
+
+// marks out an interval for as long as the scope lasts
+class SignpostScope {
+public:
+	SignpostScope(SignpostInterval _interval,const char * operation=0,const char * detail=0) : interval(_interval) {
+		signpost=SIGNPOST_Begin(interval,operation,detail);
+	}
+	~SignpostScope() {
+		SIGNPOST_End(interval,signpost);
+	}
+private:
+	SignpostInterval interval;
+	SignpostID signpost;
+};
+#endif
+
+#endif
+//--End of modifications
@@ -26,8 +26,10 @@
 #endif
 
 //Don't enable keeping changes and mapping lfb probably...
-#define VGA_LFB_MAPPED
-//#define VGA_KEEP_CHANGES
+//--Modified to track changes in every VGA mode, which means the LFB can't be mapped directly
+//#define VGA_LFB_MAPPED
+#define VGA_KEEP_CHANGES
+//--End of modifications
 #define VGA_CHANGE_SHIFT	9
 
 class PageHandler;
@@ -70,6 +72,12 @@ typedef struct {
 	bool attrindex;
 } VGA_Internal;
 
+//--Added to let planar writes skip the parts of the write pipeline that aren't in use
+// Set in mh_mask when write mode 0 would write the CPU data unmodified:
+// no rotation, logical operation, set/reset or bit masking.
+#define MH_PLAINWRITE	0x1
+//--End of modifications
+
 typedef struct {
 /* Memory handlers */
 	Bitu mh_mask;
@@ -156,6 +164,9 @@ typedef struct {
 	bool doublewidth,doubleheight;
 	Bit8u font[64*1024];
 	Bit8u * font_tables[2];
+	//--Added to invalidate cached text lines when font data or colours change
+	Bitu text_generation;
+	//--End of modifications
 	Bitu blinking;
 	struct {
 		Bitu address;
@@ -363,12 +374,16 @@ typedef struct {
 
 typedef struct {
 	//Add a few more just to be safe
-	Bit8u*	map; /* allocated dynamically: [(VGA_MEMORY >> VGA_CHANGE_SHIFT) + 32] */
+	//--Modified to cover the planar modes, whose addresses reach into the second half of fastmem
+	Bit8u*	map; /* allocated dynamically: [((VGA_MEMORY*2) >> VGA_CHANGE_SHIFT) + 32] */
+	Bitu	mapSize;
+	//--End of modifications
 	Bit8u	checkMask, frame, writeMask;
 	bool	active;
 	Bit32u  clearMask;
-	Bit32u	start, last;
-	Bit32u	lastAddress;
+	//--Added: how much video memory one line is drawn from, in draw address units
+	Bitu	span;
+	//--End of modifications
 } VGA_Changes;
 
 typedef struct {
@@ -445,10 +460,35 @@ void VGA_SetBlinking(Bitu enabled);
 void VGA_SetCGA2Table(Bit8u val0,Bit8u val1);
 void VGA_SetCGA4Table(Bit8u val0,Bit8u val1,Bit8u val2,Bit8u val3);
 void VGA_ActivateHardwareCursor(void);
+//--Added for Boxer to draw the hardware cursor over the frame itself: see vga_draw.cpp
+bool VGA_HardwareCursorChanged(void);
+//--End of modifications
 void VGA_KillDrawing(void);
+//--Added to restart the display timing and redraw from scratch, for when a save state has been loaded
+void VGA_RestartDrawing(void);
+//--End of modifications
+//--Added for drawing SVGA frames on a worker thread: see vga_draw.cpp.
+//Enabled by the render section's pipelined setting, on hosts with enough cores to spare one.
+void VGA_SetPipelinedDrawing(bool enabled);
+//Waits until the worker has finished with the line handlers and the renderer.
+//Anything that changes either while a frame may be drawing must call this first.
+void VGA_WaitForPipelinedFrame(void);
+//--End of modifications
 
 extern VGA_Type vga;
 
+//--Moved here from vga_memory.cpp so that the XGA blitter can record its writes too
+#ifdef VGA_KEEP_CHANGES
+#define MEM_CHANGED( _MEM ) vga.changes.map[ (_MEM) >> VGA_CHANGE_SHIFT ] |= vga.changes.writeMask;
+//#define MEM_CHANGED( _MEM ) vga.changes.map[ (_MEM) >> VGA_CHANGE_SHIFT ] = 1;
+// Writes are never longer than a change block, so marking both ends covers them
+#define MEM_CHANGED_RANGE( _MEM, _LEN ) { MEM_CHANGED( _MEM ); MEM_CHANGED( (_MEM) + (_LEN) - 1 ); }
+#else
+#define MEM_CHANGED( _MEM ) 
+#define MEM_CHANGED_RANGE( _MEM, _LEN ) 
+#endif
+//--End of modifications
+
 /* Support for modular SVGA implementation */
 /* Video mode extra data to be passed to FinishSetMode_SVGA().
    This structure will be in flux until all drivers (including S3)
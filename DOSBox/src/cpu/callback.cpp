@@ -32,6 +32,9 @@
 */
 
 CallBack_Handler CallBack_Handlers[CB_MAX];
+//--Added for the dynamic core's in-block callbacks
+CallBack_FastHandler CallBack_FastHandlers[CB_MAX];
+//--End of modifications
 char* CallBack_Description[CB_MAX];
 
 static Bitu call_stop,call_idle,call_default,call_default2;
@@ -55,6 +58,9 @@ Bitu CALLBACK_Allocate(void) {
 
 void CALLBACK_DeAllocate(Bitu in) {
 	CallBack_Handlers[in]=&illegal_handler;
+	//--Added for the dynamic core's in-block callbacks
+	CallBack_FastHandlers[in]=0;
+	//--End of modifications
 }
 
 	
@@ -531,10 +537,20 @@ void CALLBACK_HandlerObject::Set_RealVec(Bit8u vec){
 	} else E_Exit ("double usage of vector handler");
 }
 
+//--Added for the dynamic core's in-block callbacks
+void CALLBACK_HandlerObject::Set_FastHandler(CallBack_FastHandler handler){
+	if(installed) CallBack_FastHandlers[m_callback]=handler;
+	else E_Exit("Fast handler set on a callback that was not installed");
+}
+//--End of modifications
+
 void CALLBACK_Init(Section* /*sec*/) {
 	Bitu i;
 	for (i=0;i<CB_MAX;i++) {
 		CallBack_Handlers[i]=&illegal_handler;
+		//--Added for the dynamic core's in-block callbacks
+		CallBack_FastHandlers[i]=0;
+		//--End of modifications
 	}
 
 	/* Setup the Stop Handler */
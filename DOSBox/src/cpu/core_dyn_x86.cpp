@@ -51,12 +51,18 @@
 #include "paging.h"
 #include "inout.h"
 #include "fpu.h"
+//--Added to time translation separately from execution
+#include "perfcounters.h"
+//--End of modifications
 
 #define CACHE_MAXSIZE	(4096*3)
 #define CACHE_TOTAL		(1024*1024*8)
 #define CACHE_PAGES		(512)
 #define CACHE_BLOCKS	(64*1024)
 #define CACHE_ALIGN		(16)
+//--Added to bound how many recently-entered blocks cache_openblock will skip over
+#define CACHE_SECOND_CHANCE	(16)
+//--End of modifications
 #define DYN_HASH_SHIFT	(4)
 #define DYN_PAGE_HASH	(4096>>DYN_HASH_SHIFT)
 #define DYN_LINKS		(16)
@@ -262,6 +268,7 @@ static void dyn_restoreregister(DynReg * src_reg, DynReg * dst_reg) {
 
 
 Bits CPU_Core_Dyn_X86_Run(void) {
+	PerfScope perf(PERF_CPU,&cache_run_ticks);	//--Added to time the core as a whole
 	/* Determine the linear address of CS:EIP */
 restart_core:
 	PhysPt ip_point=SegPhys(cs)+reg_eip;
@@ -281,7 +288,12 @@ restart_core:
 	CacheBlock * block=chandler->FindCacheBlock(ip_point&4095);
 	if (!block) {
 		if (!chandler->invalidation_map || (chandler->invalidation_map[ip_point&4095]<4)) {
-			block=CreateCacheBlock(chandler,ip_point,32);
+			//--Modified to time translation separately from execution
+			{
+				PerfScope translate_perf(PERF_CPU,&cache_translate_ticks);
+				block=CreateCacheBlock(chandler,ip_point,32);
+			}
+			//--End of modifications
 		} else {
 			Bitu old_cycles=CPU_Cycles;
 			CPU_Cycles=1;
@@ -472,6 +484,28 @@ void CPU_Core_Dyn_X86_Cache_Close(void) {
 	cache_close();
 }
 
+//--Added to size the translation cache from the dynamic_cache setting and to report on it.
+//The size only takes effect if the cache has not yet been allocated: the generated code
+//refers to itself by absolute address, so the cache cannot be moved or grown afterwards.
+void CPU_Core_Dyn_X86_Cache_SetSize(Bitu size) {
+	if (cache_code_start_ptr) return;
+	cache_total=size;
+	cache_block_count=(Bitu)(((Bit64u)CACHE_BLOCKS*size)/CACHE_TOTAL);
+}
+
+void CPU_Core_Dyn_X86_Cache_GetStats(CPU_DynamicCacheStats * stats) {
+	*stats=cache_stats;
+	stats->translate_seconds=PERF_Seconds(cache_translate_ticks);
+	stats->run_seconds=PERF_Seconds(cache_run_ticks);
+}
+//--End of modifications
+
+//--Added to discard all translated code when a save state is loaded
+void CPU_Core_Dyn_X86_Cache_Flush(void) {
+	cache_flush();
+}
+//--End of modifications
+
 void CPU_Core_Dyn_X86_SetFPUMode(bool dh_fpu) {
 	dyn_dh_fpu.dh_fpu_enabled=dh_fpu;
 }
@@ -38,6 +38,9 @@ public:
 		Bit8u * wmapmask;
 		Bit16u maskstart;
 		Bit16u masklen;
+		//--Added to give blocks that are still in use a second chance at eviction, see cache_openblock
+		bool recent;
+		//--End of modifications
 	} cache;
 	struct {
 		Bitu index;
@@ -64,6 +67,19 @@ static struct {
 	CodePageHandler * last_page;
 } cache;
 
+//--Added to size the translation cache at startup and to track how well it is coping.
+//These default to the compile-time sizes, and are overridden by CPU_Core_Dyn_X86_Cache_SetSize.
+static Bitu cache_total=CACHE_TOTAL;
+static Bitu cache_block_count=CACHE_BLOCKS;
+static CPU_DynamicCacheStats cache_stats;
+//--End of modifications
+
+//--Added to measure how the core's time divides between translating code and running it.
+//These only advance while perf counters are enabled.
+static Bit64u cache_translate_ticks=0;
+static Bit64u cache_run_ticks=0;
+//--End of modifications
+
 static CacheBlock link_blocks[2];
 
 class CodePageHandler : public PageHandler {
@@ -78,6 +94,7 @@ public:
 		flags&=~PFLAG_WRITEABLE;
 		active_blocks=0;
 		active_count=16;
+		invalidation_count=0;	//--Added to count this page's self-modifying code
 		memset(&hash_map,0,sizeof(hash_map));
 		memset(&write_map,0,sizeof(write_map));
 		if (invalidation_map!=NULL) {
@@ -100,6 +117,14 @@ public:
 				if (start<=block->page.end && end>=block->page.start) {
 					if (ip_point<=block->page.end && ip_point>=block->page.start) is_current_block=true;
 					block->Clear();
+					//--Added to spot pages whose code is being rewritten over and over
+					cache_stats.invalidations++;
+					if (!invalidation_count++) cache_stats.invalidated_pages++;
+					if (invalidation_count>cache_stats.hottest_page_invalidations) {
+						cache_stats.hottest_page=phys_page;
+						cache_stats.hottest_page_invalidations=invalidation_count;
+					}
+					//--End of modifications
 				}
 				block=nextblock;
 			}
@@ -313,7 +338,13 @@ public:
 	CacheBlock * FindCacheBlock(Bitu start) {
 		CacheBlock * block=hash_map[1+(start>>DYN_HASH_SHIFT)];
 		while (block) {
-			if (block->page.start==start) return block;
+			//--Modified to note which blocks are still being entered, see cache_openblock
+			if (block->page.start==start) {
+				block->cache.recent=true;
+				cache_stats.hits++;
+				return block;
+			}
+			//--End of modifications
 			block=block->hash.next;
 		}
 		return 0;
@@ -336,6 +367,7 @@ private:
 	Bitu active_count;
 	HostPt hostmem;	
 	Bitu phys_page;
+	Bit64u invalidation_count;	//--Added: blocks in this page discarded because their code was written to
 };
 
 
@@ -392,20 +424,48 @@ void CacheBlock::Clear(void) {
 }
 
 
+//--Added to move the active block pointer on from the specified block, going back to the
+//start of the cache once it fills up.
+static void cache_advanceblock(CacheBlock * block) {
+	if (!block->cache.next) {
+//		LOG_MSG("Cache full restarting");
+		cache.block.active=cache.block.first;
+		cache_stats.wraps++;
+	} else {
+		cache.block.active=block->cache.next;
+	}
+}
+//--End of modifications
+
 static CacheBlock * cache_openblock(void) {
 	CacheBlock * block=cache.block.active;
+	//--Added to give blocks that have been entered since the cache last came round to them
+	//a second chance: this keeps hot code resident when the cache fills, instead of evicting
+	//strictly oldest-first. CACHE_SECOND_CHANCE bounds the search when everything is hot.
+	for (Bitu tries=0;tries<CACHE_SECOND_CHANCE && block->page.handler && block->cache.recent;tries++) {
+		block->cache.recent=false;
+		cache_advanceblock(block);
+		block=cache.block.active;
+	}
+	block->cache.recent=false;
+	cache_stats.translations++;
+	//--End of modifications
 	/* check for enough space in this block */
 	Bitu size=block->cache.size;
 	CacheBlock * nextblock=block->cache.next;
-	if (block->page.handler) 
+	if (block->page.handler) {
 		block->Clear();
+		cache_stats.evictions++;	//--Added to count evicted blocks
+	}
 	while (size<CACHE_MAXSIZE) {
 		if (!nextblock) 
 			goto skipresize;
 		size+=nextblock->cache.size;
 		CacheBlock * tempblock=nextblock->cache.next;
-		if (nextblock->page.handler) 
+		if (nextblock->page.handler) {
 			nextblock->Clear();
+			cache_stats.evictions++;	//--Added to count evicted blocks
+		}
 		cache_addunsedblock(nextblock);
 		nextblock=tempblock;
 	}
@@ -426,6 +486,7 @@ static void cache_closeblock(void) {
 	block->link[1].next=0;
 	/* Close the block with correct alignments */
 	Bitu written=cache.pos-block->cache.start;
+	cache_stats.bytes_emitted+=written;	//--Added to count generated code
 	if (written>block->cache.size) {
 		if (!block->cache.next) {
 			if (written>block->cache.size+CACHE_MAXSIZE) E_Exit("CacheBlock overrun 1 %d",written-block->cache.size);	
@@ -445,12 +506,9 @@ static void cache_closeblock(void) {
 		}
 	}
 	/* Advance the active block pointer */
-	if (!block->cache.next) {
-//		LOG_MSG("Cache full restarting");
-		cache.block.active=cache.block.first;
-	} else {
-		cache.block.active=block->cache.next;
-	}
+	//--Modified to share this with cache_openblock
+	cache_advanceblock(block);
+	//--End of modifications
 }
 
 static INLINE void cache_addb(Bit8u val) {
@@ -489,12 +547,16 @@ static void cache_init(bool enable) {
 	if (enable) {
 		if (cache_initialized) return;
 		cache_initialized = true;
+		//--Modified to size the cache blocks and the code cache from cache_block_count
+		//and cache_total instead of the compile-time constants, in the allocations below.
+		cache_stats.size=cache_total;
+		//--End of modifications
 		if (cache_blocks == NULL) {
-			cache_blocks=(CacheBlock*)malloc(CACHE_BLOCKS*sizeof(CacheBlock));
+			cache_blocks=(CacheBlock*)malloc(cache_block_count*sizeof(CacheBlock));
 			if(!cache_blocks) E_Exit("Allocating cache_blocks has failed");
-			memset(cache_blocks,0,sizeof(CacheBlock)*CACHE_BLOCKS);
+			memset(cache_blocks,0,sizeof(CacheBlock)*cache_block_count);
 			cache.block.free=&cache_blocks[0];
-			for (i=0;i<CACHE_BLOCKS-1;i++) {
+			for (i=0;i<cache_block_count-1;i++) {
 				cache_blocks[i].link[0].to=(CacheBlock *)1;
 				cache_blocks[i].link[1].to=(CacheBlock *)1;
 				cache_blocks[i].cache.next=&cache_blocks[i+1];
@@ -502,12 +564,12 @@ static void cache_init(bool enable) {
 		}
 		if (cache_code_start_ptr==NULL) {
 #if defined (WIN32)
-			cache_code_start_ptr=(Bit8u*)VirtualAlloc(0,CACHE_TOTAL+CACHE_MAXSIZE+PAGESIZE_TEMP-1+PAGESIZE_TEMP,
+			cache_code_start_ptr=(Bit8u*)VirtualAlloc(0,cache_total+CACHE_MAXSIZE+PAGESIZE_TEMP-1+PAGESIZE_TEMP,
 				MEM_COMMIT,PAGE_EXECUTE_READWRITE);
 			if (!cache_code_start_ptr)
-				cache_code_start_ptr=(Bit8u*)malloc(CACHE_TOTAL+CACHE_MAXSIZE+PAGESIZE_TEMP-1+PAGESIZE_TEMP);
+				cache_code_start_ptr=(Bit8u*)malloc(cache_total+CACHE_MAXSIZE+PAGESIZE_TEMP-1+PAGESIZE_TEMP);
 #else
-			cache_code_start_ptr=(Bit8u*)malloc(CACHE_TOTAL+CACHE_MAXSIZE+PAGESIZE_TEMP-1+PAGESIZE_TEMP);
+			cache_code_start_ptr=(Bit8u*)malloc(cache_total+CACHE_MAXSIZE+PAGESIZE_TEMP-1+PAGESIZE_TEMP);
 #endif
 			if(!cache_code_start_ptr) E_Exit("Allocating dynamic core cache memory failed");
 
@@ -517,14 +579,14 @@ static void cache_init(bool enable) {
 			cache_code+=PAGESIZE_TEMP;
 
 #if (C_HAVE_MPROTECT)
-			if(mprotect(cache_code_link_blocks,CACHE_TOTAL+CACHE_MAXSIZE+PAGESIZE_TEMP,PROT_WRITE|PROT_READ|PROT_EXEC))
+			if(mprotect(cache_code_link_blocks,cache_total+CACHE_MAXSIZE+PAGESIZE_TEMP,PROT_WRITE|PROT_READ|PROT_EXEC))
 				LOG_MSG("Setting excute permission on the code cache has failed!");
 #endif
 			CacheBlock * block=cache_getblock();
 			cache.block.first=block;
 			cache.block.active=block;
 			block->cache.start=&cache_code[0];
-			block->cache.size=CACHE_TOTAL;
+			block->cache.size=cache_total;
 			block->cache.next=0;								//Last block in the list
 		}
 		/* Setup the default blocks for block linkage returns */
@@ -546,6 +608,13 @@ static void cache_init(bool enable) {
 	}
 }
 
+//--Added to discard all translated code, for when a save state replaces guest memory wholesale
+static void cache_flush(void) {
+	cache_stats.flushes++;
+	while (cache.used_pages) cache.used_pages->ClearRelease();
+}
+//--End of modifications
+
 static void cache_close(void) {
 /*	for (;;) {
 		if (cache.used_pages) {
@@ -2027,6 +2027,7 @@ static CacheBlock * CreateCacheBlock(CodePageHandler * codepage,PhysPt start,Bit
 		decode.segprefix=0;
 		decode.rep=REP_NONE;
 		decode.cycles++;
+		cache_stats.instructions++;	//--Added to count translated instructions
 		decode.op_start=decode.code;
 restart_prefix:
 		Bitu opcode;
@@ -43,6 +43,13 @@
 #endif
 #endif /* C_HAVE_MPROTECT */
 
+//--Added for W^X code cache support on Apple Silicon
+#if (C_HAVE_MAP_JIT)
+#include <sys/mman.h>
+#include <pthread.h>
+#endif
+//--End of modifications
+
 #include "callback.h"
 #include "regs.h"
 #include "mem.h"
@@ -52,15 +59,31 @@
 #include "inout.h"
 #include "lazyflags.h"
 #include "pic.h"
+//--Added to time translation separately from execution
+#include "perfcounters.h"
+//--End of modifications
 
 #define CACHE_MAXSIZE	(4096*2)
 #define CACHE_TOTAL		(1024*1024*8)
 #define CACHE_PAGES		(512)
 #define CACHE_BLOCKS	(128*1024)
 #define CACHE_ALIGN		(16)
+//--Added to bound how many recently-entered blocks cache_openblock will skip over
+#define CACHE_SECOND_CHANCE	(16)
+//--End of modifications
 #define DYN_HASH_SHIFT	(4)
 #define DYN_PAGE_HASH	(4096>>DYN_HASH_SHIFT)
 #define DYN_LINKS		(16)
+//--Added to bound how far ahead dyn_follow_jump will skip to continue a block
+#define DYN_FOLLOW_MAXSKIP	(128)
+//--End of modifications
+//--Added to leave pages whose code keeps being rewritten to the normal core for a while:
+//a page that has this many blocks discarded within DYN_SMC_WINDOW milliseconds is not
+//translated again until DYN_SMC_INTERPRET milliseconds have passed
+#define DYN_SMC_HEAVY		(32)
+#define DYN_SMC_WINDOW		(100)
+#define DYN_SMC_INTERPRET	(1000)
+//--End of modifications
 
 #if 0
 #define DYN_LOG	LOG_MSG
@@ -141,6 +164,9 @@ static struct {
 #define MIPSEL		0x03
 #define ARMV4LE		0x04
 #define POWERPC		0x04
+//--Added for the AArch64 backend
+#define ARMV8LE		0x05
+//--End of modifications
 
 #if C_TARGETCPU == X86_64
 #include "core_dynrec/risc_x64.h"
@@ -152,6 +178,10 @@ static struct {
 #include "core_dynrec/risc_armv4le.h"
 #elif C_TARGETCPU == POWERPC
 #include "core_dynrec/risc_ppc.h"
+//--Added for the AArch64 backend
+#elif C_TARGETCPU == ARMV8LE
+#include "core_dynrec/risc_arm64.h"
+//--End of modifications
 #endif
 
 #include "core_dynrec/decoder.h"
@@ -186,6 +216,7 @@ CacheBlockDynRec * LinkBlocks(BlockReturn ret) {
 */
 
 Bits CPU_Core_Dynrec_Run(void) {
+	PerfScope perf(PERF_CPU,&cache_run_ticks);	//--Added to time the core as a whole
 	for (;;) {
 		// Determine the linear address of CS:EIP
 		PhysPt ip_point=SegPhys(cs)+reg_eip;
@@ -209,9 +240,23 @@ Bits CPU_Core_Dynrec_Run(void) {
 		if (!block) {
 			// no block found, thus translate the instruction stream
 			// unless the instruction is known to be modified
-			if (!chandler->invalidation_map || (chandler->invalidation_map[ip_point&4095]<4)) {
+			//--Modified to also leave pages whose code keeps being rewritten to the normal core
+			bool interpret=false;
+			if (chandler->IsSMCHeavy()) {
+				cache_stats.smc_interpreted_instructions++;
+				interpret=true;
+			} else if (chandler->invalidation_map && (chandler->invalidation_map[ip_point&4095]>=4)) {
+				interpret=true;
+			}
+			if (!interpret) {
+			//--End of modifications
 				// translate up to 32 instructions
-				block=CreateCacheBlock(chandler,ip_point,32);
+				//--Modified to time translation separately from execution
+				{
+					PerfScope translate_perf(PERF_CPU,&cache_translate_ticks);
+					block=CreateCacheBlock(chandler,ip_point,32);
+				}
+				//--End of modifications
 			} else {
 				// let the normal core handle this instruction to avoid zero-sized blocks
 				Bitu old_cycles=CPU_Cycles;
@@ -323,6 +368,11 @@ void CPU_Core_Dynrec_Init(void) {
 }
 
 void CPU_Core_Dynrec_Cache_Init(bool enable_cache) {
+	//--Added to find out which of the host CPU's instruction set extensions generated code can use
+#ifdef DRC_USE_HOST_FEATURES
+	gen_detect_host_features();
+#endif
+	//--End of modifications
 	// Initialize code cache and dynamic blocks
 	cache_init(enable_cache);
 }
@@ -331,4 +381,55 @@ void CPU_Core_Dynrec_Cache_Close(void) {
 	cache_close();
 }
 
+//--Added to size the translation cache from the dynamic_cache setting and to report on it.
+//The size only takes effect if the cache has not yet been allocated: the generated code
+//refers to itself by absolute address, so the cache cannot be moved or grown afterwards.
+void CPU_Core_Dynrec_Cache_SetSize(Bitu size) {
+	if (cache_code_start_ptr) return;
+	cache_total=size;
+	cache_block_count=(Bitu)(((Bit64u)CACHE_BLOCKS*size)/CACHE_TOTAL);
+}
+
+void CPU_Core_Dynrec_Cache_GetStats(CPU_DynamicCacheStats * stats) {
+	*stats=cache_stats;
+	stats->translate_seconds=PERF_Seconds(cache_translate_ticks);
+	stats->run_seconds=PERF_Seconds(cache_run_ticks);
+}
+//--End of modifications
+
+//--Added to let the dynamic_hostfeatures setting turn off the host CPU's instruction set extensions.
+//Code already translated is discarded, so that the change takes effect straight away.
+static bool host_features_enabled=true;
+
+void CPU_Core_Dynrec_SetHostFeatures(bool enable) {
+	host_features_enabled=enable;
+#ifdef DRC_USE_HOST_FEATURES
+	gen_detect_host_features();
+	Bitu features=enable ? host_features_supported : 0;
+	if (features==host_features) return;
+	host_features=features;
+	if (cache_initialized) cache_flush();
+#endif
+}
+
+bool CPU_Core_Dynrec_HostFeaturesEnabled(void) {
+	return host_features_enabled;
+}
+
+// the names of the extensions generated code is using, separated by spaces
+const char * CPU_Core_Dynrec_HostFeatureNames(void) {
+#ifdef DRC_USE_HOST_FEATURES
+	return gen_describe_host_features(host_features);
+#else
+	return "";
+#endif
+}
+//--End of modifications
+
+//--Added to discard all translated code when a save state is loaded
+void CPU_Core_Dynrec_Cache_Flush(void) {
+	cache_flush();
+}
+//--End of modifications
+
 #endif
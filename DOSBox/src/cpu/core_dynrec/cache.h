@@ -44,6 +44,9 @@ public:
 		Bit8u * wmapmask;
 		Bit16u maskstart;
 		Bit16u masklen;
+		//--Added to give blocks that are still in use a second chance at eviction, see cache_openblock
+		bool recent;
+		//--End of modifications
 	} cache;
 	struct {
 		Bitu index;
@@ -70,6 +73,19 @@ static struct {
 	CodePageHandlerDynRec * last_page;		// the last used page
 } cache;
 
+//--Added to size the translation cache at startup and to track how well it is coping.
+//These default to the compile-time sizes, and are overridden by CPU_Core_Dynrec_Cache_SetSize.
+static Bitu cache_total=CACHE_TOTAL;
+static Bitu cache_block_count=CACHE_BLOCKS;
+static CPU_DynamicCacheStats cache_stats;
+//--End of modifications
+
+//--Added to measure how the core's time divides between translating code and running it.
+//These only advance while perf counters are enabled.
+static Bit64u cache_translate_ticks=0;
+static Bit64u cache_run_ticks=0;
+//--End of modifications
+
 
 // cache memory pointers, to be malloc'd later
 static Bit8u * cache_code_start_ptr=NULL;
@@ -101,6 +117,13 @@ public:
 
 		active_blocks=0;
 		active_count=16;
+		invalidation_count=0;	//--Added to count this page's self-modifying code
+		//--Added to spot pages whose code is rewritten too often to be worth translating
+		smc_window_start=PIC_Ticks;
+		smc_window_invalidations=0;
+		smc_interpret_until=0;
+		smc_interpreting=false;
+		//--End of modifications
 
 		// initialize the maps with zero (no cache blocks as well as code present)
 		memset(&hash_map,0,sizeof(hash_map));
@@ -131,6 +154,15 @@ public:
 				if (start<=block->page.end && end>=block->page.start) {
 					if (ip_point<=block->page.end && ip_point>=block->page.start) is_current_block=true;
 					block->Clear();		// clear the block, decrements the write_map accordingly
+					//--Added to spot pages whose code is being rewritten over and over
+					cache_stats.invalidations++;
+					if (!invalidation_count++) cache_stats.invalidated_pages++;
+					if (invalidation_count>cache_stats.hottest_page_invalidations) {
+						cache_stats.hottest_page=phys_page;
+						cache_stats.hottest_page_invalidations=invalidation_count;
+					}
+					NoteSMCInvalidation();
+					//--End of modifications
 				}
 				block=nextblock;
 			}
@@ -284,6 +316,29 @@ public:
 		return false;
 	}
 
+	//--Added to leave the page to the normal core for a while once blocks in it are being
+	//discarded faster than it is worth translating them again
+	void NoteSMCInvalidation(void) {
+		if ((PIC_Ticks-smc_window_start)>=DYN_SMC_WINDOW) {
+			smc_window_start=PIC_Ticks;
+			smc_window_invalidations=0;
+		}
+		if (++smc_window_invalidations>=DYN_SMC_HEAVY) {
+			if (!IsSMCHeavy()) cache_stats.smc_interpreted_pages++;
+			smc_interpret_until=PIC_Ticks+DYN_SMC_INTERPRET;
+			smc_interpreting=true;
+			smc_window_invalidations=0;
+		}
+	}
+	// whether new code in this page should be run by the normal core rather than translated
+	bool IsSMCHeavy(void) {
+		if (GCC_LIKELY(!smc_interpreting)) return false;
+		if ((Bits)(smc_interpret_until-PIC_Ticks)>0) return true;
+		smc_interpreting=false;
+		return false;
+	}
+	//--End of modifications
+
     // add a cache block to this page and note it in the hash map
 	void AddCacheBlock(CacheBlockDynRec * block) {
 		Bitu index=1+(block->page.start>>DYN_HASH_SHIFT);
@@ -366,7 +421,13 @@ public:
 		CacheBlockDynRec * block=hash_map[1+(start>>DYN_HASH_SHIFT)];
 		// see if there's a cache block present at the start address
 		while (block) {
-			if (block->page.start==start) return block;	// found
+			//--Modified to note which blocks are still being entered, see cache_openblock
+			if (block->page.start==start) {
+				block->cache.recent=true;
+				cache_stats.hits++;
+				return block;	// found
+			}
+			//--End of modifications
 			block=block->hash.next;
 		}
 		return 0;	// none found
@@ -394,6 +455,13 @@ private:
 	Bitu active_count;		// delaying parameter to not immediately release a page
 	HostPt hostmem;	
 	Bitu phys_page;
+	Bit64u invalidation_count;	//--Added: blocks in this page discarded because their code was written to
+	//--Added for NoteSMCInvalidation
+	Bitu smc_window_start;			// the tick at which the current window of invalidations began
+	Bitu smc_window_invalidations;	// blocks discarded within that window
+	Bitu smc_interpret_until;		// the tick until which new code in this page is interpreted
+	bool smc_interpreting;
+	//--End of modifications
 };
 
 
@@ -459,13 +527,55 @@ void CacheBlockDynRec::Clear(void) {
 }
 
 
+//--Added to support code caches where the OS enforces W^X (MAP_JIT on Apple Silicon):
+//the cache can be either written to or executed by the current thread, never both at once.
+static INLINE void cache_begin_writing(void) {
+#if (C_HAVE_MAP_JIT)
+	pthread_jit_write_protect_np(0);
+#endif
+}
+
+static INLINE void cache_end_writing(void) {
+#if (C_HAVE_MAP_JIT)
+	pthread_jit_write_protect_np(1);
+#endif
+}
+//--End of modifications
+
+
+//--Added to move the active block pointer on from the specified block, going back to the
+//start of the cache once it fills up.
+static void cache_advanceblock(CacheBlockDynRec * block) {
+	if (!block->cache.next || (block->cache.next->cache.start>(cache_code_start_ptr + cache_total - CACHE_MAXSIZE))) {
+//		LOG_MSG("Cache full restarting");
+		cache.block.active=cache.block.first;
+		cache_stats.wraps++;
+	} else {
+		cache.block.active=block->cache.next;
+	}
+}
+//--End of modifications
+
 static CacheBlockDynRec * cache_openblock(void) {
 	CacheBlockDynRec * block=cache.block.active;
+	//--Added to give blocks that have been entered since the cache last came round to them
+	//a second chance: this keeps hot code resident when the cache fills, instead of evicting
+	//strictly oldest-first. CACHE_SECOND_CHANCE bounds the search when everything is hot.
+	for (Bitu tries=0;tries<CACHE_SECOND_CHANCE && block->page.handler && block->cache.recent;tries++) {
+		block->cache.recent=false;
+		cache_advanceblock(block);
+		block=cache.block.active;
+	}
+	block->cache.recent=false;
+	cache_stats.translations++;
+	//--End of modifications
 	// check for enough space in this block
 	Bitu size=block->cache.size;
 	CacheBlockDynRec * nextblock=block->cache.next;
-	if (block->page.handler) 
+	if (block->page.handler) {
 		block->Clear();
+		cache_stats.evictions++;	//--Added to count evicted blocks
+	}
 	// block size must be at least CACHE_MAXSIZE
 	while (size<CACHE_MAXSIZE) {
 		if (!nextblock)
@@ -473,8 +583,10 @@ static CacheBlockDynRec * cache_openblock(void) {
 		// merge blocks
 		size+=nextblock->cache.size;
 		CacheBlockDynRec * tempblock=nextblock->cache.next;
-		if (nextblock->page.handler) 
+		if (nextblock->page.handler) {
 			nextblock->Clear();
+			cache_stats.evictions++;	//--Added to count evicted blocks
+		}
 		// block is free now
 		cache_addunusedblock(nextblock);
 		nextblock=tempblock;
@@ -484,6 +596,10 @@ skipresize:
 	block->cache.size=size;
 	block->cache.next=nextblock;
 	cache.pos=block->cache.start;
+	//--Added to make the code cache writable while the block is generated:
+	//dyn_closeblock makes it executable again.
+	cache_begin_writing();
+	//--End of modifications
 	return block;
 }
 
@@ -498,6 +614,7 @@ static void cache_closeblock(void) {
 	block->link[1].next=0;
 	// close the block with correct alignment
 	Bitu written=(Bitu)(cache.pos-block->cache.start);
+	cache_stats.bytes_emitted+=written;	//--Added to count generated code
 	if (written>block->cache.size) {
 		if (!block->cache.next) {
 			if (written>block->cache.size+CACHE_MAXSIZE) E_Exit("CacheBlock overrun 1 %d",written-block->cache.size);	
@@ -518,12 +635,9 @@ static void cache_closeblock(void) {
 		}
 	}
 	// advance the active block pointer
-	if (!block->cache.next || (block->cache.next->cache.start>(cache_code_start_ptr + CACHE_TOTAL - CACHE_MAXSIZE))) {
-//		LOG_MSG("Cache full restarting");
-		cache.block.active=cache.block.first;
-	} else {
-		cache.block.active=block->cache.next;
-	}
+	//--Modified to share this with cache_openblock
+	cache_advanceblock(block);
+	//--End of modifications
 }
 
 
@@ -553,6 +667,7 @@ static INLINE void cache_addq(Bit64u val) {
 
 static void dyn_return(BlockReturn retcode,bool ret_exception);
 static void dyn_run_code(void);
+static void cache_block_closing(Bit8u* block_start,Bitu block_size);
 
 
 /* Define temporary pagesize so the MPROTECT case and the regular case share as much code as possible */
@@ -564,20 +679,34 @@ static void dyn_run_code(void);
 
 static bool cache_initialized = false;
 
+//--Added to explain why translated blocks are not persisted between sessions
+//The translation cache is deliberately process-local. Generated blocks embed absolute host
+//addresses (cpu_regs, the helper functions called from gen_call_function, the link blocks
+//above, and each block's own link/from chains), and all of those move from one launch to
+//the next under ASLR and malloc. Persisting blocks would need a relocation table emitted
+//alongside every block by each risc_*.h backend, which costs more than the translation it
+//would save. Within a session the cache already survives repeated cache_init calls (see the
+//early return below), and CodePageHandlerDynRec ignores writes that leave code bytes unchanged,
+//so reloading identical code into the same page does not force a retranslation.
+//--End of modifications
 static void cache_init(bool enable) {
 	Bits i;
 	if (enable) {
 		// see if cache is already initialized
 		if (cache_initialized) return;
 		cache_initialized = true;
+		//--Modified to size the cache blocks and the code cache from cache_block_count
+		//and cache_total instead of the compile-time constants, in the allocations below.
+		cache_stats.size=cache_total;
+		//--End of modifications
 		if (cache_blocks == NULL) {
 			// allocate the cache blocks memory
-			cache_blocks=(CacheBlockDynRec*)malloc(CACHE_BLOCKS*sizeof(CacheBlockDynRec));
+			cache_blocks=(CacheBlockDynRec*)malloc(cache_block_count*sizeof(CacheBlockDynRec));
 			if(!cache_blocks) E_Exit("Allocating cache_blocks has failed");
-			memset(cache_blocks,0,sizeof(CacheBlockDynRec)*CACHE_BLOCKS);
+			memset(cache_blocks,0,sizeof(CacheBlockDynRec)*cache_block_count);
 			cache.block.free=&cache_blocks[0];
 			// initialize the cache blocks
-			for (i=0;i<CACHE_BLOCKS-1;i++) {
+			for (i=0;i<cache_block_count-1;i++) {
 				cache_blocks[i].link[0].to=(CacheBlockDynRec *)1;
 				cache_blocks[i].link[1].to=(CacheBlockDynRec *)1;
 				cache_blocks[i].cache.next=&cache_blocks[i+1];
@@ -586,12 +715,18 @@ static void cache_init(bool enable) {
 		if (cache_code_start_ptr==NULL) {
 			// allocate the code cache memory
 #if defined (WIN32)
-			cache_code_start_ptr=(Bit8u*)VirtualAlloc(0,CACHE_TOTAL+CACHE_MAXSIZE+PAGESIZE_TEMP-1+PAGESIZE_TEMP,
+			cache_code_start_ptr=(Bit8u*)VirtualAlloc(0,cache_total+CACHE_MAXSIZE+PAGESIZE_TEMP-1+PAGESIZE_TEMP,
 				MEM_COMMIT,PAGE_EXECUTE_READWRITE);
 			if (!cache_code_start_ptr)
-				cache_code_start_ptr=(Bit8u*)malloc(CACHE_TOTAL+CACHE_MAXSIZE+PAGESIZE_TEMP-1+PAGESIZE_TEMP);
+				cache_code_start_ptr=(Bit8u*)malloc(cache_total+CACHE_MAXSIZE+PAGESIZE_TEMP-1+PAGESIZE_TEMP);
+//--Modified to allocate a MAP_JIT region where the OS enforces W^X for generated code
+#elif (C_HAVE_MAP_JIT)
+			cache_code_start_ptr=(Bit8u*)mmap(NULL,cache_total+CACHE_MAXSIZE+PAGESIZE_TEMP-1+PAGESIZE_TEMP,
+				PROT_READ|PROT_WRITE|PROT_EXEC,MAP_PRIVATE|MAP_ANON|MAP_JIT,-1,0);
+			if (cache_code_start_ptr==MAP_FAILED) cache_code_start_ptr=NULL;
+//--End of modifications
 #else
-			cache_code_start_ptr=(Bit8u*)malloc(CACHE_TOTAL+CACHE_MAXSIZE+PAGESIZE_TEMP-1+PAGESIZE_TEMP);
+			cache_code_start_ptr=(Bit8u*)malloc(cache_total+CACHE_MAXSIZE+PAGESIZE_TEMP-1+PAGESIZE_TEMP);
 #endif
 			if(!cache_code_start_ptr) E_Exit("Allocating dynamic cache failed");
 
@@ -601,17 +736,22 @@ static void cache_init(bool enable) {
 			cache_code_link_blocks=cache_code;
 			cache_code=cache_code+PAGESIZE_TEMP;
 
-#if (C_HAVE_MPROTECT)
-			if(mprotect(cache_code_link_blocks,CACHE_TOTAL+CACHE_MAXSIZE+PAGESIZE_TEMP,PROT_WRITE|PROT_READ|PROT_EXEC))
+//--Modified to leave MAP_JIT regions alone, since they are already executable
+#if (C_HAVE_MPROTECT) && !(C_HAVE_MAP_JIT)
+//--End of modifications
+			if(mprotect(cache_code_link_blocks,cache_total+CACHE_MAXSIZE+PAGESIZE_TEMP,PROT_WRITE|PROT_READ|PROT_EXEC))
 				LOG_MSG("Setting excute permission on the code cache has failed");
 #endif
 			CacheBlockDynRec * block=cache_getblock();
 			cache.block.first=block;
 			cache.block.active=block;
 			block->cache.start=&cache_code[0];
-			block->cache.size=CACHE_TOTAL;
+			block->cache.size=cache_total;
 			block->cache.next=0;						// last block in the list
 		}
+		//--Added to make the code cache writable while the link blocks are generated
+		cache_begin_writing();
+		//--End of modifications
 		// setup the default blocks for block linkage returns
 		cache.pos=&cache_code_link_blocks[0];
 		link_blocks[0].cache.start=cache.pos;
@@ -627,6 +767,11 @@ static void cache_init(bool enable) {
 //		link_blocks[1].cache.start=cache.pos;
 		dyn_run_code();
 
+		//--Added to make the code cache executable again once the link blocks are in place
+		cache_end_writing();
+		cache_block_closing(cache_code_link_blocks,PAGESIZE_TEMP);
+		//--End of modifications
+
 		cache.free_pages=0;
 		cache.last_page=0;
 		cache.used_pages=0;
@@ -639,6 +784,13 @@ static void cache_init(bool enable) {
 	}
 }
 
+//--Added to discard all translated code, for when a save state replaces guest memory wholesale
+static void cache_flush(void) {
+	cache_stats.flushes++;
+	while (cache.used_pages) cache.used_pages->ClearRelease();
+}
+//--End of modifications
+
 static void cache_close(void) {
 /*	for (;;) {
 		if (cache.used_pages) {
@@ -66,6 +66,7 @@ static CacheBlockDynRec * CreateCacheBlock(CodePageHandlerDynRec * codepage,Phys
 		decode.seg_prefix_used=false;
 		decode.rep=REP_NONE;
 		decode.cycles++;
+		cache_stats.instructions++;	//--Added to count translated instructions
 		decode.op_start=decode.code;
 restart_prefix:
 		Bitu opcode;
@@ -237,6 +238,11 @@ restart_prefix:
 				case 0xb6:dyn_movx_ev_gb(false);break;
 				case 0xb7:dyn_movx_ev_gw(false);break;
 
+				//--Added for the bit scan instructions
+				case 0xbc:dyn_bit_scan_gv_ev(true);break;
+				case 0xbd:dyn_bit_scan_gv_ev(false);break;
+				//--End of modifications
+
 				// sign-extending moves
 				case 0xbe:dyn_movx_ev_gb(true);break;
 				case 0xbf:dyn_movx_ev_gw(true);break;
@@ -271,6 +277,9 @@ restart_prefix:
 		case 0x61:
 			if (decode.big_op) gen_call_function_raw((void *)&dynrec_popa_dword);
 			else gen_call_function_raw((void *)&dynrec_popa_word);
+			//--Added for the register cache, since popa changes every register
+			dyn_reload_cached_regs();
+			//--End of modifications
 			break;
 
 //		case 0x62: BOUND missing
@@ -512,7 +521,13 @@ restart_prefix:
 			goto finish_block;
 		// 'jmp near imm16/32'
 		case 0xe9:
-			dyn_exit_link(decode.big_op ? (Bit32s)decode_fetchd() : (Bit16s)decode_fetchw());
+			//--Modified to carry on translating at the target of short forward jumps
+			{
+				Bits eip_change=decode.big_op ? (Bit32s)decode_fetchd() : (Bit16s)decode_fetchw();
+				if (dyn_follow_jump(eip_change)) break;
+				dyn_exit_link(eip_change);
+			}
+			//--End of modifications
 			goto finish_block;
 		// 'jmp far'
 		case 0xea:
@@ -520,7 +535,13 @@ restart_prefix:
 			goto finish_block;
 		// 'jmp short imm8'
 		case 0xeb:
-			dyn_exit_link((Bit8s)decode_fetchb());
+			//--Modified to carry on translating at the target of short forward jumps
+			{
+				Bits eip_change=(Bit8s)decode_fetchb();
+				if (dyn_follow_jump(eip_change)) break;
+				dyn_exit_link(eip_change);
+			}
+			//--End of modifications
 			goto finish_block;
 
 
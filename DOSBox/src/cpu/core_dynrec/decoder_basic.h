@@ -434,6 +434,111 @@ static void INLINE dyn_get_modrm(void) {
 #endif
 
 
+//--Added to keep often-used guest registers in host registers for the whole block.
+//Backends that define DRC_USE_REG_CACHE hold EAX, ECX, ESI and EDI in the callee-saved host
+//registers FC_CACHED_EAX/ECX/ESI/EDI, which gen_run_code loads before entering a block.
+//Reads of those registers become register moves. Writes still go to cpu_regs as well as to
+//the host register, so cpu_regs is always up to date: block exits, block links, exceptions
+//and helpers that read the guest registers need no spill code. Helpers that may change the
+//guest registers are followed by dyn_reload_cached_regs.
+#ifdef DRC_USE_REG_CACHE
+
+#define DRC_REG_UNCACHED 0xff
+
+// the host register that holds the guest register reg_index, or DRC_REG_UNCACHED
+static INLINE HostReg dyn_cached_reg(Bitu reg_index) {
+	switch (reg_index) {
+		case DRC_REG_EAX: return FC_CACHED_EAX;
+		case DRC_REG_ECX: return FC_CACHED_ECX;
+		case DRC_REG_ESI: return FC_CACHED_ESI;
+		case DRC_REG_EDI: return FC_CACHED_EDI;
+		default: return DRC_REG_UNCACHED;
+	}
+}
+
+// reload the cached registers after a helper that may have changed cpu_regs
+static INLINE void dyn_reload_cached_regs(void) {
+	gen_load_cached_regs();
+}
+
+static void dyn_mov_regval_to_reg(HostReg host_reg,Bitu reg_index) {
+	HostReg cached_reg=dyn_cached_reg(reg_index);
+	if (cached_reg!=DRC_REG_UNCACHED) gen_mov_from_cached_reg(host_reg,cached_reg);
+	else MOV_REG_VAL_TO_HOST_REG(host_reg,reg_index);
+}
+
+static void dyn_add_regval_to_reg(HostReg host_reg,Bitu reg_index) {
+	HostReg cached_reg=dyn_cached_reg(reg_index);
+	if (cached_reg!=DRC_REG_UNCACHED) gen_add_cached_reg(host_reg,cached_reg);
+	else ADD_REG_VAL_TO_HOST_REG(host_reg,reg_index);
+}
+
+// 16bit reads may destroy the upper 16bit of host_reg, so they can copy the whole register
+static void dyn_mov_regword_to_reg(HostReg host_reg,Bitu reg_index,bool dword) {
+	HostReg cached_reg=dyn_cached_reg(reg_index);
+	if (cached_reg!=DRC_REG_UNCACHED) gen_mov_from_cached_reg(host_reg,cached_reg);
+	else MOV_REG_WORD_TO_HOST_REG(host_reg,reg_index,dword);
+}
+
+static void dyn_mov_regword_from_reg(HostReg host_reg,Bitu reg_index,bool dword) {
+	MOV_REG_WORD_FROM_HOST_REG(host_reg,reg_index,dword);
+	HostReg cached_reg=dyn_cached_reg(reg_index);
+	if (cached_reg!=DRC_REG_UNCACHED) gen_mov_word_to_cached_reg(cached_reg,host_reg,dword);
+}
+
+static void dyn_mov_regbyte_to_reg_low(HostReg host_reg,Bitu reg_index,bool high_byte) {
+	HostReg cached_reg=dyn_cached_reg(reg_index);
+	if (cached_reg!=DRC_REG_UNCACHED) gen_mov_byte_from_cached_reg(host_reg,cached_reg,high_byte);
+	else MOV_REG_BYTE_TO_HOST_REG_LOW(host_reg,reg_index,high_byte);
+}
+
+static void dyn_mov_regbyte_to_reg_low_canuseword(HostReg host_reg,Bitu reg_index,bool high_byte) {
+	HostReg cached_reg=dyn_cached_reg(reg_index);
+	if (cached_reg!=DRC_REG_UNCACHED) gen_mov_byte_from_cached_reg(host_reg,cached_reg,high_byte);
+	else MOV_REG_BYTE_TO_HOST_REG_LOW_CANUSEWORD(host_reg,reg_index,high_byte);
+}
+
+static void dyn_mov_regbyte_from_reg_low(HostReg host_reg,Bitu reg_index,bool high_byte) {
+	MOV_REG_BYTE_FROM_HOST_REG_LOW(host_reg,reg_index,high_byte);
+	HostReg cached_reg=dyn_cached_reg(reg_index);
+	if (cached_reg!=DRC_REG_UNCACHED) gen_mov_byte_to_cached_reg(cached_reg,host_reg,high_byte);
+}
+
+#undef MOV_REG_VAL_TO_HOST_REG
+#undef ADD_REG_VAL_TO_HOST_REG
+#undef MOV_REG_WORD16_TO_HOST_REG
+#undef MOV_REG_WORD32_TO_HOST_REG
+#undef MOV_REG_WORD_TO_HOST_REG
+#undef MOV_REG_WORD16_FROM_HOST_REG
+#undef MOV_REG_WORD32_FROM_HOST_REG
+#undef MOV_REG_WORD_FROM_HOST_REG
+#undef MOV_REG_BYTE_TO_HOST_REG_LOW
+#undef MOV_REG_BYTE_TO_HOST_REG_LOW_CANUSEWORD
+#undef MOV_REG_BYTE_FROM_HOST_REG_LOW
+
+#define MOV_REG_VAL_TO_HOST_REG(host_reg, reg_index) dyn_mov_regval_to_reg(host_reg,reg_index)
+#define ADD_REG_VAL_TO_HOST_REG(host_reg, reg_index) dyn_add_regval_to_reg(host_reg,reg_index)
+
+#define MOV_REG_WORD16_TO_HOST_REG(host_reg, reg_index) dyn_mov_regword_to_reg(host_reg,reg_index,false)
+#define MOV_REG_WORD32_TO_HOST_REG(host_reg, reg_index) dyn_mov_regword_to_reg(host_reg,reg_index,true)
+#define MOV_REG_WORD_TO_HOST_REG(host_reg, reg_index, dword) dyn_mov_regword_to_reg(host_reg,reg_index,dword)
+
+#define MOV_REG_WORD16_FROM_HOST_REG(host_reg, reg_index) dyn_mov_regword_from_reg(host_reg,reg_index,false)
+#define MOV_REG_WORD32_FROM_HOST_REG(host_reg, reg_index) dyn_mov_regword_from_reg(host_reg,reg_index,true)
+#define MOV_REG_WORD_FROM_HOST_REG(host_reg, reg_index, dword) dyn_mov_regword_from_reg(host_reg,reg_index,dword)
+
+#define MOV_REG_BYTE_TO_HOST_REG_LOW(host_reg, reg_index, high_byte) dyn_mov_regbyte_to_reg_low(host_reg,reg_index,high_byte)
+#define MOV_REG_BYTE_TO_HOST_REG_LOW_CANUSEWORD(host_reg, reg_index, high_byte) dyn_mov_regbyte_to_reg_low_canuseword(host_reg,reg_index,high_byte)
+#define MOV_REG_BYTE_FROM_HOST_REG_LOW(host_reg, reg_index, high_byte) dyn_mov_regbyte_from_reg_low(host_reg,reg_index,high_byte)
+
+#else
+
+static INLINE void dyn_reload_cached_regs(void) { }
+
+#endif
+//--End of modifications
+
+
 #define DYN_LEA_MEM_MEM(ea_reg, op1, op2, scale, imm) dyn_lea_mem_mem(ea_reg,op1,op2,scale,imm)
 
 #if defined(DRC_USE_REGS_ADDR) && defined(DRC_USE_SEGS_ADDR)
@@ -442,7 +547,9 @@ static void INLINE dyn_get_modrm(void) {
 #define DYN_LEA_REG_VAL_REG_VAL(ea_reg, op1_index, op2_index, scale, imm) dyn_lea_regval_regval(ea_reg,op1_index,op2_index,scale,imm)
 #define DYN_LEA_MEM_REG_VAL(ea_reg, op1, op2_index, scale, imm) dyn_lea_mem_regval(ea_reg,op1,op2_index,scale,imm)
 
-#elif defined(DRC_USE_REGS_ADDR)
+//--Modified so that the register cache is used for address calculations too
+#elif defined(DRC_USE_REGS_ADDR) || defined(DRC_USE_REG_CACHE)
+//--End of modifications
 
 #define DYN_LEA_SEG_PHYS_REG_VAL(ea_reg, op1_index, op2_index, scale, imm) dyn_lea_mem_regval(ea_reg,DRCD_SEG_PHYS(op1_index),op2_index,scale,imm)
 #define DYN_LEA_REG_VAL_REG_VAL(ea_reg, op1_index, op2_index, scale, imm) dyn_lea_regval_regval(ea_reg,op1_index,op2_index,scale,imm)
@@ -503,69 +610,80 @@ static INLINE void dyn_set_eip_end(HostReg reg,Bit32u imm=0) {
 // is architecture dependent
 // R=host register; I=32bit immediate value; A=address value; m=memory
 
+//--Added for the register cache: the helpers called through the functions below may change
+//any guest register, so the cached registers are reloaded after them. Helpers that cannot,
+//such as the memory accessors and the flags operators, are called with gen_call_function_raw.
+static DRC_PTR_SIZE_IM INLINE dyn_call_function_setup(void * func,Bitu paramcount,bool fastcall=false) {
+	DRC_PTR_SIZE_IM proc_addr=gen_call_function_setup(func,paramcount,fastcall);
+	dyn_reload_cached_regs();
+	return proc_addr;
+}
+//--End of modifications
+
+//--Modified to call through dyn_call_function_setup
 static DRC_PTR_SIZE_IM INLINE gen_call_function_R(void * func,Bitu op) {
 	gen_load_param_reg(op,0);
-	return gen_call_function_setup(func, 1);
+	return dyn_call_function_setup(func, 1);
 }
 
 static DRC_PTR_SIZE_IM INLINE gen_call_function_R3(void * func,Bitu op) {
 	gen_load_param_reg(op,2);
-	return gen_call_function_setup(func, 3, true);
+	return dyn_call_function_setup(func, 3, true);
 }
 
 static DRC_PTR_SIZE_IM INLINE gen_call_function_RI(void * func,Bitu op1,Bitu op2) {
 	gen_load_param_imm(op2,1);
 	gen_load_param_reg(op1,0);
-	return gen_call_function_setup(func, 2);
+	return dyn_call_function_setup(func, 2);
 }
 
 static DRC_PTR_SIZE_IM INLINE gen_call_function_RA(void * func,Bitu op1,DRC_PTR_SIZE_IM op2) {
 	gen_load_param_addr(op2,1);
 	gen_load_param_reg(op1,0);
-	return gen_call_function_setup(func, 2);
+	return dyn_call_function_setup(func, 2);
 }
 
 static DRC_PTR_SIZE_IM INLINE gen_call_function_RR(void * func,Bitu op1,Bitu op2) {
 	gen_load_param_reg(op2,1);
 	gen_load_param_reg(op1,0);
-	return gen_call_function_setup(func, 2);
+	return dyn_call_function_setup(func, 2);
 }
 
 static DRC_PTR_SIZE_IM INLINE gen_call_function_IR(void * func,Bitu op1,Bitu op2) {
 	gen_load_param_reg(op2,1);
 	gen_load_param_imm(op1,0);
-	return gen_call_function_setup(func, 2);
+	return dyn_call_function_setup(func, 2);
 }
 
 static DRC_PTR_SIZE_IM INLINE gen_call_function_I(void * func,Bitu op) {
 	gen_load_param_imm(op,0);
-	return gen_call_function_setup(func, 1);
+	return dyn_call_function_setup(func, 1);
 }
 
 static DRC_PTR_SIZE_IM INLINE gen_call_function_II(void * func,Bitu op1,Bitu op2) {
 	gen_load_param_imm(op2,1);
 	gen_load_param_imm(op1,0);
-	return gen_call_function_setup(func, 2);
+	return dyn_call_function_setup(func, 2);
 }
 
 static DRC_PTR_SIZE_IM INLINE gen_call_function_III(void * func,Bitu op1,Bitu op2,Bitu op3) {
 	gen_load_param_imm(op3,2);
 	gen_load_param_imm(op2,1);
 	gen_load_param_imm(op1,0);
-	return gen_call_function_setup(func, 3);
+	return dyn_call_function_setup(func, 3);
 }
 
 static DRC_PTR_SIZE_IM INLINE gen_call_function_IA(void * func,Bitu op1,DRC_PTR_SIZE_IM op2) {
 	gen_load_param_addr(op2,1);
 	gen_load_param_imm(op1,0);
-	return gen_call_function_setup(func, 2);
+	return dyn_call_function_setup(func, 2);
 }
 
 static DRC_PTR_SIZE_IM INLINE gen_call_function_IIR(void * func,Bitu op1,Bitu op2,Bitu op3) {
 	gen_load_param_reg(op3,2);
 	gen_load_param_imm(op2,1);
 	gen_load_param_imm(op1,0);
-	return gen_call_function_setup(func, 3);
+	return dyn_call_function_setup(func, 3);
 }
 
 static DRC_PTR_SIZE_IM INLINE gen_call_function_IIIR(void * func,Bitu op1,Bitu op2,Bitu op3,Bitu op4) {
@@ -573,7 +691,7 @@ static DRC_PTR_SIZE_IM INLINE gen_call_function_IIIR(void * func,Bitu op1,Bitu o
 	gen_load_param_imm(op3,2);
 	gen_load_param_imm(op2,1);
 	gen_load_param_imm(op1,0);
-	return gen_call_function_setup(func, 4);
+	return dyn_call_function_setup(func, 4);
 }
 
 static DRC_PTR_SIZE_IM INLINE gen_call_function_IRRR(void * func,Bitu op1,Bitu op2,Bitu op3,Bitu op4) {
@@ -581,23 +699,28 @@ static DRC_PTR_SIZE_IM INLINE gen_call_function_IRRR(void * func,Bitu op1,Bitu o
 	gen_load_param_reg(op3,2);
 	gen_load_param_reg(op2,1);
 	gen_load_param_imm(op1,0);
-	return gen_call_function_setup(func, 4);
+	return dyn_call_function_setup(func, 4);
 }
 
 static DRC_PTR_SIZE_IM INLINE gen_call_function_m(void * func,Bitu op) {
 	gen_load_param_mem(op,2);
-	return gen_call_function_setup(func, 3, true);
+	return dyn_call_function_setup(func, 3, true);
 }
 
 static DRC_PTR_SIZE_IM INLINE gen_call_function_mm(void * func,Bitu op1,Bitu op2) {
 	gen_load_param_mem(op2,3);
 	gen_load_param_mem(op1,2);
-	return gen_call_function_setup(func, 4, true);
+	return dyn_call_function_setup(func, 4, true);
 }
+//--End of modifications
 
 
 
-enum save_info_type {db_exception, cycle_check, string_break};
+enum save_info_type {db_exception, cycle_check, string_break,
+	//--Added for callbacks that were not handled in-block, see dyn_fast_callback
+	callback_exit
+	//--End of modifications
+};
 
 
 // function that is called on exceptions
@@ -609,6 +732,20 @@ static BlockReturn DynRunException(Bit32u eip_add,Bit32u cycle_sub) {
 	return BR_Normal;
 }
 
+//--Added to run a callback's fast handler from within the block that calls it.
+//Returns true if the block must still exit to run the callback's regular handler.
+static bool DynRunFastCallback(Bitu callback) {
+	CallBack_FastHandler handler=CallBack_FastHandlers[callback];
+	if (handler) {
+		// the handlers read and write the flags directly
+		FillFlags();
+		if (handler()) return false;
+	}
+	core_dynrec.callback=callback;
+	return true;
+}
+//--End of modifications
+
 
 // array with information about code that is generated at the
 // end of a cache block because it is rarely reached (like exceptions)
@@ -657,6 +794,14 @@ static void dyn_fill_blocks(void) {
 				gen_add_direct_word(&reg_eip,save_info_dynrec[sct].eip_change,decode.big_op);
 				dyn_return(BR_Cycles);
 				break;
+			//--Added for callbacks that were not handled in-block
+			case callback_exit:
+				// leave the block after the callback instruction and run the regular handler
+				gen_add_direct_word(&reg_eip,save_info_dynrec[sct].eip_change,cpu.code.big);
+				gen_sub_direct_word(&CPU_Cycles,save_info_dynrec[sct].cycles,true);
+				dyn_return(BR_CallBack);
+				break;
+			//--End of modifications
 		}
 	}
 	used_save_info_dynrec=0;
@@ -668,6 +813,9 @@ static void dyn_closeblock(void) {
 	dyn_fill_blocks();
 	cache_block_before_close();
 	cache_closeblock();
+	//--Added to make the code cache executable again, see cache_openblock
+	cache_end_writing();
+	//--End of modifications
 	cache_block_closing(decode.block->cache.start,decode.block->cache.size);
 }
 
@@ -817,7 +965,9 @@ static void dyn_lea_mem_mem(HostReg ea_reg,void* op1,void* op2,Bitu scale,Bits i
 	}
 }
 
-#ifdef DRC_USE_REGS_ADDR
+//--Modified so that the register cache is used for address calculations too
+#if defined(DRC_USE_REGS_ADDR) || defined(DRC_USE_REG_CACHE)
+//--End of modifications
 // effective address calculation helper
 // loads op1 into ea_reg and adds the scaled op2 and the immediate to it
 // op1 is cpu_regs[op1_index], op2 is cpu_regs[op2_index] 
@@ -1240,6 +1390,9 @@ static void InvalidateFlags(void* current_simple_function,Bitu flags_type) {
 // this function can be replaced by a simpler one as well
 static void InvalidateFlagsPartially(void* current_simple_function,Bitu flags_type) {
 #ifdef DRC_FLAGS_INVALIDATION
+	//--Added to keep the full flags calculation if the queue is already full
+	if (mf_functions_num>=sizeof(mf_functions)/sizeof(mf_functions[0])) return;
+	//--End of modifications
 	mf_functions[mf_functions_num].pos=cache.pos;
 	mf_functions[mf_functions_num].fct_ptr=current_simple_function;
 	mf_functions[mf_functions_num].ftype=flags_type;
@@ -1252,6 +1405,9 @@ static void InvalidateFlagsPartially(void* current_simple_function,Bitu flags_ty
 // this function can be replaced by a simpler one as well
 static void InvalidateFlagsPartially(void* current_simple_function,DRC_PTR_SIZE_IM cpos,Bitu flags_type) {
 #ifdef DRC_FLAGS_INVALIDATION
+	//--Added to keep the full flags calculation if the queue is already full
+	if (mf_functions_num>=sizeof(mf_functions)/sizeof(mf_functions[0])) return;
+	//--End of modifications
 	mf_functions[mf_functions_num].pos=(Bit8u*)cpos;
 	mf_functions[mf_functions_num].fct_ptr=current_simple_function;
 	mf_functions[mf_functions_num].ftype=flags_type;
@@ -1265,3 +1421,20 @@ static void AcquireFlags(Bitu flags_mask) {
 	mf_functions_num=0;
 #endif
 }
+
+//--Added to let frequently-polled callbacks run without ending the block.
+//The fast handler is looked up when the callback runs rather than when the block
+//is translated, since callbacks can be reassigned without the code changing.
+static void dyn_fast_callback(Bitu callback) {
+	AcquireFlags(FMASK_TEST);
+	gen_call_function_I((void *)&DynRunFastCallback,callback);
+	save_info_dynrec[used_save_info_dynrec].branch_pos=gen_create_branch_long_nonzero(FC_RETOP,false);
+	if (!decode.cycles) decode.cycles++;
+	save_info_dynrec[used_save_info_dynrec].cycles=decode.cycles;
+	// the callback returns to the start of the next instruction
+	save_info_dynrec[used_save_info_dynrec].eip_change=decode.code-decode.code_start;
+	if (!cpu.code.big) save_info_dynrec[used_save_info_dynrec].eip_change&=0xffff;
+	save_info_dynrec[used_save_info_dynrec].type=callback_exit;
+	used_save_info_dynrec++;
+}
+//--End of modifications
@@ -530,12 +530,34 @@ static void dyn_imul_gvev(Bitu immsize) {
 			break;
 	}
 
-	if (decode.big_op) gen_call_function_raw((void*)dynrec_dimul_dword);
-	else gen_call_function_raw((void*)dynrec_dimul_word);
+	//--Modified to let the flags calculation be dropped if a later instruction overwrites the flags
+	if (decode.big_op) {
+		InvalidateFlagsPartially((void*)&dynrec_dimul_dword_simple,t_MUL);
+		gen_call_function_raw((void*)dynrec_dimul_dword);
+	} else {
+		InvalidateFlagsPartially((void*)&dynrec_dimul_word_simple,t_MUL);
+		gen_call_function_raw((void*)dynrec_dimul_word);
+	}
+	//--End of modifications
 
 	MOV_REG_WORD_FROM_HOST_REG(FC_RETOP,decode.modrm.reg,decode.big_op);
 }
 
+//--Added to translate the bit scan instructions rather than leave them to the normal core
+static void dyn_bit_scan_gv_ev(bool forward) {
+	dyn_get_modrm();
+	if (decode.modrm.mod<3) {
+		dyn_fill_ea(FC_ADDR);
+		dyn_read_word(FC_ADDR,FC_OP1,decode.big_op);
+	} else {
+		MOV_REG_WORD_TO_HOST_REG(FC_OP1,decode.modrm.rm,decode.big_op);
+	}
+	MOV_REG_WORD_TO_HOST_REG(FC_OP2,decode.modrm.reg,decode.big_op);
+	dyn_bit_scan_gencall(forward,decode.big_op);
+	MOV_REG_WORD_FROM_HOST_REG(FC_RETOP,decode.modrm.reg,decode.big_op);
+}
+//--End of modifications
+
 static void dyn_dshift_ev_gv(bool left,bool immediate) {
 	dyn_get_modrm();
 	if (decode.modrm.mod<3) {
@@ -712,18 +734,30 @@ static void dyn_grp3_eb(void) {
 	case 0x3:	// NEG Eb
 		dyn_sop_byte_gencall(SOP_NEG);
 		break;
+	//--Modified to let the flags calculation be dropped if a later instruction overwrites the flags
 	case 0x4:	// mul Eb
+		InvalidateFlagsPartially((void*)&dynrec_mul_byte_simple,t_MUL);
 		gen_call_function_raw((void*)&dynrec_mul_byte);
+		dyn_reload_cached_regs();
 		return;
 	case 0x5:	// imul Eb
+		InvalidateFlagsPartially((void*)&dynrec_imul_byte_simple,t_MUL);
 		gen_call_function_raw((void*)&dynrec_imul_byte);
+		dyn_reload_cached_regs();
 		return;
+	//--End of modifications
 	case 0x6:	// div Eb
 		gen_call_function_raw((void*)&dynrec_div_byte);
+		//--Added for the register cache, since the result goes straight to AX
+		dyn_reload_cached_regs();
+		//--End of modifications
 		dyn_check_exception(FC_RETOP);
 		return;
 	case 0x7:	// idiv Eb
 		gen_call_function_raw((void*)&dynrec_idiv_byte);
+		//--Added for the register cache, since the result goes straight to AX
+		dyn_reload_cached_regs();
+		//--End of modifications
 		dyn_check_exception(FC_RETOP);
 		return;
 	}
@@ -757,22 +791,42 @@ static void dyn_grp3_ev(void) {
 	case 0x3:	// NEG Eb
 		dyn_sop_word_gencall(SOP_NEG,decode.big_op);
 		break;
+	//--Modified to let the flags calculation be dropped if a later instruction overwrites the flags
 	case 0x4:	// mul Eb
-		if (decode.big_op) gen_call_function_raw((void*)&dynrec_mul_dword);
-		else gen_call_function_raw((void*)&dynrec_mul_word);
+		if (decode.big_op) {
+			InvalidateFlagsPartially((void*)&dynrec_mul_dword_simple,t_MUL);
+			gen_call_function_raw((void*)&dynrec_mul_dword);
+		} else {
+			InvalidateFlagsPartially((void*)&dynrec_mul_word_simple,t_MUL);
+			gen_call_function_raw((void*)&dynrec_mul_word);
+		}
+		dyn_reload_cached_regs();
 		return;
 	case 0x5:	// imul Eb
-		if (decode.big_op) gen_call_function_raw((void*)&dynrec_imul_dword);
-		else gen_call_function_raw((void*)&dynrec_imul_word);
+		if (decode.big_op) {
+			InvalidateFlagsPartially((void*)&dynrec_imul_dword_simple,t_MUL);
+			gen_call_function_raw((void*)&dynrec_imul_dword);
+		} else {
+			InvalidateFlagsPartially((void*)&dynrec_imul_word_simple,t_MUL);
+			gen_call_function_raw((void*)&dynrec_imul_word);
+		}
+		dyn_reload_cached_regs();
 		return;
+	//--End of modifications
 	case 0x6:	// div Eb
 		if (decode.big_op) gen_call_function_raw((void*)&dynrec_div_dword);
 		else gen_call_function_raw((void*)&dynrec_div_word);
+		//--Added for the register cache, since the result goes straight to eAX
+		dyn_reload_cached_regs();
+		//--End of modifications
 		dyn_check_exception(FC_RETOP);
 		return;
 	case 0x7:	// idiv Eb
 		if (decode.big_op) gen_call_function_raw((void*)&dynrec_idiv_dword);
 		else gen_call_function_raw((void*)&dynrec_idiv_word);
+		//--Added for the register cache, since the result goes straight to eAX
+		dyn_reload_cached_regs();
+		//--End of modifications
 		dyn_check_exception(FC_RETOP);
 		return;
 	}
@@ -805,7 +859,16 @@ static bool dyn_grp4_eb(void) {
 		}
 		break;
 	case 0x7:		//CALBACK Iw
-		gen_mov_direct_dword(&core_dynrec.callback,decode_fetchw());
+		//--Modified to run callbacks with a fast handler without ending the block
+		{
+			Bitu callback=decode_fetchw();
+			if (callback<CB_MAX && CallBack_FastHandlers[callback]) {
+				dyn_fast_callback(callback);
+				break;
+			}
+			gen_mov_direct_dword(&core_dynrec.callback,callback);
+		}
+		//--End of modifications
 		dyn_set_eip_end();
 		dyn_reduce_cycles();
 		dyn_return(BR_CallBack);
@@ -1086,6 +1149,27 @@ static void dyn_sahf(void) {
 }
 
 
+//--Added to build longer blocks across unconditional jumps. If the target of a jump lies
+//a short way further on in the same page, skip ahead to it and carry on translating there
+//instead of ending the block and going through the block linking in CPU_Core_Dynrec_Run.
+//The skipped bytes are added to the write map as though they had been decoded, so that the
+//block still covers one contiguous range of the page and is invalidated correctly.
+static bool dyn_follow_jump(Bits eip_change) {
+	if (eip_change<=0 || eip_change>DYN_FOLLOW_MAXSKIP) return false;
+	if (decode.page.index+eip_change>=4096) return false;
+
+	// eip arithmetic in the rest of the block assumes eip advances along with decode.code,
+	// so don't follow jumps whose target would wrap around at the operand size
+	Bitu eip_target=reg_eip+(Bitu)(decode.code-decode.code_start)+eip_change;
+	if (eip_target>(decode.big_op ? 0xffffffffu : 0xffffu)) return false;
+
+	for (Bits i=0;i<eip_change;i++) decode.page.wmap[decode.page.index+i]+=0x01;
+	decode.page.index+=eip_change;
+	decode.code+=eip_change;
+	return true;
+}
+//--End of modifications
+
 static void dyn_exit_link(Bits eip_change) {
 	gen_add_direct_word(&reg_eip,(decode.code-decode.code_start)+eip_change,decode.big_op);
 	dyn_reduce_cycles();
@@ -1217,6 +1217,74 @@ static void dyn_shift_word_gencall(ShiftOps op,bool dword) {
 	}
 }
 
+//--Added for the bit scan instructions. The destination's current value is passed in op2,
+//since it is left alone if the source is zero.
+static Bit16u DRC_CALL_CONV dynrec_bsf_word(Bit16u op1,Bit16u op2) DRC_FC;
+static Bit16u DRC_CALL_CONV dynrec_bsf_word(Bit16u op1,Bit16u op2) {
+	FillFlags();
+	if (!op1) {
+		SETFLAGBIT(ZF,true);
+		return op2;
+	}
+	SETFLAGBIT(ZF,false);
+	Bit16u result=0;
+	while ((op1 & 0x01)==0) { result++; op1>>=1; }
+	return result;
+}
+
+static Bit32u DRC_CALL_CONV dynrec_bsf_dword(Bit32u op1,Bit32u op2) DRC_FC;
+static Bit32u DRC_CALL_CONV dynrec_bsf_dword(Bit32u op1,Bit32u op2) {
+	FillFlags();
+	if (!op1) {
+		SETFLAGBIT(ZF,true);
+		return op2;
+	}
+	SETFLAGBIT(ZF,false);
+	Bit32u result=0;
+	while ((op1 & 0x01)==0) { result++; op1>>=1; }
+	return result;
+}
+
+static Bit16u DRC_CALL_CONV dynrec_bsr_word(Bit16u op1,Bit16u op2) DRC_FC;
+static Bit16u DRC_CALL_CONV dynrec_bsr_word(Bit16u op1,Bit16u op2) {
+	FillFlags();
+	if (!op1) {
+		SETFLAGBIT(ZF,true);
+		return op2;
+	}
+	SETFLAGBIT(ZF,false);
+	Bit16u result=15;
+	while ((op1 & 0x8000)==0) { result--; op1<<=1; }
+	return result;
+}
+
+static Bit32u DRC_CALL_CONV dynrec_bsr_dword(Bit32u op1,Bit32u op2) DRC_FC;
+static Bit32u DRC_CALL_CONV dynrec_bsr_dword(Bit32u op1,Bit32u op2) {
+	FillFlags();
+	if (!op1) {
+		SETFLAGBIT(ZF,true);
+		return op2;
+	}
+	SETFLAGBIT(ZF,false);
+	Bit32u result=31;
+	while ((op1 & 0x80000000)==0) { result--; op1<<=1; }
+	return result;
+}
+
+static void dyn_bit_scan_gencall(bool forward,bool dword) {
+	void * func;
+	if (forward) func=dword ? (void*)&dynrec_bsf_dword : (void*)&dynrec_bsf_word;
+	else func=dword ? (void*)&dynrec_bsr_dword : (void*)&dynrec_bsr_word;
+#ifdef DRC_USE_HOST_FEATURES
+	void * host_func=gen_bit_scan_function(forward,dword);
+	if (host_func) func=host_func;
+#endif
+	// only ZF is changed, so the other flags must have been worked out
+	AcquireFlags(FMASK_TEST);
+	gen_call_function_raw(func);
+}
+//--End of modifications
+
 static Bit16u DRC_CALL_CONV dynrec_dshl_word(Bit16u op1,Bit16u op2,Bit8u op3) DRC_FC;
 static Bit16u DRC_CALL_CONV dynrec_dshl_word(Bit16u op1,Bit16u op2,Bit8u op3) {
 	Bit8u val=op3 & 0x1f;
@@ -1469,6 +1537,47 @@ static void DRC_CALL_CONV dynrec_imul_dword(Bit32u op) {
 	}
 }
 
+//--Added to let multiplications take part in the flags optimization: these variants
+//are patched in by InvalidateFlags when a later instruction overwrites all the flags.
+static void DRC_CALL_CONV dynrec_mul_byte_simple(Bit8u op) DRC_FC;
+static void DRC_CALL_CONV dynrec_mul_byte_simple(Bit8u op) {
+	reg_ax=reg_al*op;
+}
+
+static void DRC_CALL_CONV dynrec_imul_byte_simple(Bit8u op) DRC_FC;
+static void DRC_CALL_CONV dynrec_imul_byte_simple(Bit8u op) {
+	reg_ax=((Bit8s)reg_al) * ((Bit8s)op);
+}
+
+static void DRC_CALL_CONV dynrec_mul_word_simple(Bit16u op) DRC_FC;
+static void DRC_CALL_CONV dynrec_mul_word_simple(Bit16u op) {
+	Bitu tempu=(Bitu)reg_ax*(Bitu)op;
+	reg_ax=(Bit16u)(tempu);
+	reg_dx=(Bit16u)(tempu >> 16);
+}
+
+static void DRC_CALL_CONV dynrec_imul_word_simple(Bit16u op) DRC_FC;
+static void DRC_CALL_CONV dynrec_imul_word_simple(Bit16u op) {
+	Bits temps=((Bit16s)reg_ax)*((Bit16s)op);
+	reg_ax=(Bit16s)(temps);
+	reg_dx=(Bit16s)(temps >> 16);
+}
+
+static void DRC_CALL_CONV dynrec_mul_dword_simple(Bit32u op) DRC_FC;
+static void DRC_CALL_CONV dynrec_mul_dword_simple(Bit32u op) {
+	Bit64u tempu=(Bit64u)reg_eax*(Bit64u)op;
+	reg_eax=(Bit32u)(tempu);
+	reg_edx=(Bit32u)(tempu >> 32);
+}
+
+static void DRC_CALL_CONV dynrec_imul_dword_simple(Bit32u op) DRC_FC;
+static void DRC_CALL_CONV dynrec_imul_dword_simple(Bit32u op) {
+	Bit64s temps=((Bit64s)((Bit32s)reg_eax))*((Bit64s)((Bit32s)op));
+	reg_eax=(Bit32u)(temps);
+	reg_edx=(Bit32u)(temps >> 32);
+}
+//--End of modifications
+
 
 static bool DRC_CALL_CONV dynrec_div_byte(Bit8u op) DRC_FC;
 static bool DRC_CALL_CONV dynrec_div_byte(Bit8u op) {
@@ -1581,6 +1690,18 @@ static Bit32u DRC_CALL_CONV dynrec_dimul_dword(Bit32u op1,Bit32u op2) {
 	return (Bit32s)res;
 }
 
+//--Added to let multiplications take part in the flags optimization, see dynrec_mul_byte_simple
+static Bit16u DRC_CALL_CONV dynrec_dimul_word_simple(Bit16u op1,Bit16u op2) DRC_FC;
+static Bit16u DRC_CALL_CONV dynrec_dimul_word_simple(Bit16u op1,Bit16u op2) {
+	return (Bit16u)((((Bit16s)op1) * ((Bit16s)op2)) & 0xffff);
+}
+
+static Bit32u DRC_CALL_CONV dynrec_dimul_dword_simple(Bit32u op1,Bit32u op2) DRC_FC;
+static Bit32u DRC_CALL_CONV dynrec_dimul_dword_simple(Bit32u op1,Bit32u op2) {
+	return (Bit32s)(((Bit64s)((Bit32s)op1))*((Bit64s)((Bit32s)op2)));
+}
+//--End of modifications
+
 
 
 static Bit16u DRC_CALL_CONV dynrec_cbw(Bit8u op) DRC_FC;
@@ -1651,6 +1772,14 @@ static Bit16u DRC_CALL_CONV dynrec_movsb_word(Bit16u count,Bit16s add_index,Phys
 		count=(Bit16u)CPU_Cycles;
 		CPU_Cycles=0;
 	}
+	//--Added to copy runs of plain RAM a page at a time
+	if (count>1) {
+		Bitu si_index=reg_si,di_index=reg_di;
+		count=(Bit16u)MEM_MovsFast(si_base,&si_index,di_base,&di_index,0xffff,add_index,count);
+		reg_si=(Bit16u)si_index;
+		reg_di=(Bit16u)di_index;
+	}
+	//--End of modifications
 	for (;count>0;count--) {
 		mem_writeb(di_base+reg_di,mem_readb(si_base+reg_si));
 		reg_si+=add_index;
@@ -1669,6 +1798,14 @@ static Bit32u DRC_CALL_CONV dynrec_movsb_dword(Bit32u count,Bit32s add_index,Phy
 		count=CPU_Cycles;
 		CPU_Cycles=0;
 	}
+	//--Added to copy runs of plain RAM a page at a time
+	if (count>1) {
+		Bitu si_index=reg_esi,di_index=reg_edi;
+		count=(Bit32u)MEM_MovsFast(si_base,&si_index,di_base,&di_index,0xffffffff,add_index,count);
+		reg_esi=(Bit32u)si_index;
+		reg_edi=(Bit32u)di_index;
+	}
+	//--End of modifications
 	for (;count>0;count--) {
 		mem_writeb(di_base+reg_edi,mem_readb(si_base+reg_esi));
 		reg_esi+=add_index;
@@ -1688,6 +1825,14 @@ static Bit16u DRC_CALL_CONV dynrec_movsw_word(Bit16u count,Bit16s add_index,Phys
 		CPU_Cycles=0;
 	}
 	add_index<<=1;
+	//--Added to copy runs of plain RAM a page at a time
+	if (count>1) {
+		Bitu si_index=reg_si,di_index=reg_di;
+		count=(Bit16u)MEM_MovsFast(si_base,&si_index,di_base,&di_index,0xffff,add_index,count);
+		reg_si=(Bit16u)si_index;
+		reg_di=(Bit16u)di_index;
+	}
+	//--End of modifications
 	for (;count>0;count--) {
 		mem_writew(di_base+reg_di,mem_readw(si_base+reg_si));
 		reg_si+=add_index;
@@ -1707,6 +1852,14 @@ static Bit32u DRC_CALL_CONV dynrec_movsw_dword(Bit32u count,Bit32s add_index,Phy
 		CPU_Cycles=0;
 	}
 	add_index<<=1;
+	//--Added to copy runs of plain RAM a page at a time
+	if (count>1) {
+		Bitu si_index=reg_esi,di_index=reg_edi;
+		count=(Bit32u)MEM_MovsFast(si_base,&si_index,di_base,&di_index,0xffffffff,add_index,count);
+		reg_esi=(Bit32u)si_index;
+		reg_edi=(Bit32u)di_index;
+	}
+	//--End of modifications
 	for (;count>0;count--) {
 		mem_writew(di_base+reg_edi,mem_readw(si_base+reg_esi));
 		reg_esi+=add_index;
@@ -1726,6 +1879,14 @@ static Bit16u DRC_CALL_CONV dynrec_movsd_word(Bit16u count,Bit16s add_index,Phys
 		CPU_Cycles=0;
 	}
 	add_index<<=2;
+	//--Added to copy runs of plain RAM a page at a time
+	if (count>1) {
+		Bitu si_index=reg_si,di_index=reg_di;
+		count=(Bit16u)MEM_MovsFast(si_base,&si_index,di_base,&di_index,0xffff,add_index,count);
+		reg_si=(Bit16u)si_index;
+		reg_di=(Bit16u)di_index;
+	}
+	//--End of modifications
 	for (;count>0;count--) {
 		mem_writed(di_base+reg_di,mem_readd(si_base+reg_si));
 		reg_si+=add_index;
@@ -1745,6 +1906,14 @@ static Bit32u DRC_CALL_CONV dynrec_movsd_dword(Bit32u count,Bit32s add_index,Phy
 		CPU_Cycles=0;
 	}
 	add_index<<=2;
+	//--Added to copy runs of plain RAM a page at a time
+	if (count>1) {
+		Bitu si_index=reg_esi,di_index=reg_edi;
+		count=(Bit32u)MEM_MovsFast(si_base,&si_index,di_base,&di_index,0xffffffff,add_index,count);
+		reg_esi=(Bit32u)si_index;
+		reg_edi=(Bit32u)di_index;
+	}
+	//--End of modifications
 	for (;count>0;count--) {
 		mem_writed(di_base+reg_edi,mem_readd(si_base+reg_esi));
 		reg_esi+=add_index;
@@ -1764,6 +1933,15 @@ static Bit16u DRC_CALL_CONV dynrec_lodsb_word(Bit16u count,Bit16s add_index,Phys
 		count=(Bit16u)CPU_Cycles;
 		CPU_Cycles=0;
 	}
+	//--Added to skip through runs of plain RAM a page at a time
+	if (count>1) {
+		Bitu si_index=reg_si;
+		Bit32u val=reg_al;
+		count=(Bit16u)MEM_LodsFast(si_base,&si_index,0xffff,add_index,count,&val);
+		reg_si=(Bit16u)si_index;
+		reg_al=(Bit8u)val;
+	}
+	//--End of modifications
 	for (;count>0;count--) {
 		reg_al=mem_readb(si_base+reg_si);
 		reg_si+=add_index;
@@ -1781,6 +1959,15 @@ static Bit32u DRC_CALL_CONV dynrec_lodsb_dword(Bit32u count,Bit32s add_index,Phy
 		count=CPU_Cycles;
 		CPU_Cycles=0;
 	}
+	//--Added to skip through runs of plain RAM a page at a time
+	if (count>1) {
+		Bitu si_index=reg_esi;
+		Bit32u val=reg_al;
+		count=(Bit32u)MEM_LodsFast(si_base,&si_index,0xffffffff,add_index,count,&val);
+		reg_esi=(Bit32u)si_index;
+		reg_al=(Bit8u)val;
+	}
+	//--End of modifications
 	for (;count>0;count--) {
 		reg_al=mem_readb(si_base+reg_esi);
 		reg_esi+=add_index;
@@ -1799,6 +1986,15 @@ static Bit16u DRC_CALL_CONV dynrec_lodsw_word(Bit16u count,Bit16s add_index,Phys
 		CPU_Cycles=0;
 	}
 	add_index<<=1;
+	//--Added to skip through runs of plain RAM a page at a time
+	if (count>1) {
+		Bitu si_index=reg_si;
+		Bit32u val=reg_ax;
+		count=(Bit16u)MEM_LodsFast(si_base,&si_index,0xffff,add_index,count,&val);
+		reg_si=(Bit16u)si_index;
+		reg_ax=(Bit16u)val;
+	}
+	//--End of modifications
 	for (;count>0;count--) {
 		reg_ax=mem_readw(si_base+reg_si);
 		reg_si+=add_index;
@@ -1817,6 +2013,15 @@ static Bit32u DRC_CALL_CONV dynrec_lodsw_dword(Bit32u count,Bit32s add_index,Phy
 		CPU_Cycles=0;
 	}
 	add_index<<=1;
+	//--Added to skip through runs of plain RAM a page at a time
+	if (count>1) {
+		Bitu si_index=reg_esi;
+		Bit32u val=reg_ax;
+		count=(Bit32u)MEM_LodsFast(si_base,&si_index,0xffffffff,add_index,count,&val);
+		reg_esi=(Bit32u)si_index;
+		reg_ax=(Bit16u)val;
+	}
+	//--End of modifications
 	for (;count>0;count--) {
 		reg_ax=mem_readw(si_base+reg_esi);
 		reg_esi+=add_index;
@@ -1835,6 +2040,15 @@ static Bit16u DRC_CALL_CONV dynrec_lodsd_word(Bit16u count,Bit16s add_index,Phys
 		CPU_Cycles=0;
 	}
 	add_index<<=2;
+	//--Added to skip through runs of plain RAM a page at a time
+	if (count>1) {
+		Bitu si_index=reg_si;
+		Bit32u val=reg_eax;
+		count=(Bit16u)MEM_LodsFast(si_base,&si_index,0xffff,add_index,count,&val);
+		reg_si=(Bit16u)si_index;
+		reg_eax=(Bit32u)val;
+	}
+	//--End of modifications
 	for (;count>0;count--) {
 		reg_eax=mem_readd(si_base+reg_si);
 		reg_si+=add_index;
@@ -1853,6 +2067,15 @@ static Bit32u DRC_CALL_CONV dynrec_lodsd_dword(Bit32u count,Bit32s add_index,Phy
 		CPU_Cycles=0;
 	}
 	add_index<<=2;
+	//--Added to skip through runs of plain RAM a page at a time
+	if (count>1) {
+		Bitu si_index=reg_esi;
+		Bit32u val=reg_eax;
+		count=(Bit32u)MEM_LodsFast(si_base,&si_index,0xffffffff,add_index,count,&val);
+		reg_esi=(Bit32u)si_index;
+		reg_eax=(Bit32u)val;
+	}
+	//--End of modifications
 	for (;count>0;count--) {
 		reg_eax=mem_readd(si_base+reg_esi);
 		reg_esi+=add_index;
@@ -1871,6 +2094,13 @@ static Bit16u DRC_CALL_CONV dynrec_stosb_word(Bit16u count,Bit16s add_index,Phys
 		count=(Bit16u)CPU_Cycles;
 		CPU_Cycles=0;
 	}
+	//--Added to fill runs of plain RAM a page at a time
+	if (count>1) {
+		Bitu di_index=reg_di;
+		count=(Bit16u)MEM_StosFast(di_base,&di_index,0xffff,add_index,count,reg_al);
+		reg_di=(Bit16u)di_index;
+	}
+	//--End of modifications
 	for (;count>0;count--) {
 		mem_writeb(di_base+reg_di,reg_al);
 		reg_di+=add_index;
@@ -1888,6 +2118,13 @@ static Bit32u DRC_CALL_CONV dynrec_stosb_dword(Bit32u count,Bit32s add_index,Phy
 		count=CPU_Cycles;
 		CPU_Cycles=0;
 	}
+	//--Added to fill runs of plain RAM a page at a time
+	if (count>1) {
+		Bitu di_index=reg_edi;
+		count=(Bit32u)MEM_StosFast(di_base,&di_index,0xffffffff,add_index,count,reg_al);
+		reg_edi=(Bit32u)di_index;
+	}
+	//--End of modifications
 	for (;count>0;count--) {
 		mem_writeb(di_base+reg_edi,reg_al);
 		reg_edi+=add_index;
@@ -1906,6 +2143,13 @@ static Bit16u DRC_CALL_CONV dynrec_stosw_word(Bit16u count,Bit16s add_index,Phys
 		CPU_Cycles=0;
 	}
 	add_index<<=1;
+	//--Added to fill runs of plain RAM a page at a time
+	if (count>1) {
+		Bitu di_index=reg_di;
+		count=(Bit16u)MEM_StosFast(di_base,&di_index,0xffff,add_index,count,reg_ax);
+		reg_di=(Bit16u)di_index;
+	}
+	//--End of modifications
 	for (;count>0;count--) {
 		mem_writew(di_base+reg_di,reg_ax);
 		reg_di+=add_index;
@@ -1924,6 +2168,13 @@ static Bit32u DRC_CALL_CONV dynrec_stosw_dword(Bit32u count,Bit32s add_index,Phy
 		CPU_Cycles=0;
 	}
 	add_index<<=1;
+	//--Added to fill runs of plain RAM a page at a time
+	if (count>1) {
+		Bitu di_index=reg_edi;
+		count=(Bit32u)MEM_StosFast(di_base,&di_index,0xffffffff,add_index,count,reg_ax);
+		reg_edi=(Bit32u)di_index;
+	}
+	//--End of modifications
 	for (;count>0;count--) {
 		mem_writew(di_base+reg_edi,reg_ax);
 		reg_edi+=add_index;
@@ -1942,6 +2193,13 @@ static Bit16u DRC_CALL_CONV dynrec_stosd_word(Bit16u count,Bit16s add_index,Phys
 		CPU_Cycles=0;
 	}
 	add_index<<=2;
+	//--Added to fill runs of plain RAM a page at a time
+	if (count>1) {
+		Bitu di_index=reg_di;
+		count=(Bit16u)MEM_StosFast(di_base,&di_index,0xffff,add_index,count,reg_eax);
+		reg_di=(Bit16u)di_index;
+	}
+	//--End of modifications
 	for (;count>0;count--) {
 		mem_writed(di_base+reg_di,reg_eax);
 		reg_di+=add_index;
@@ -1960,6 +2218,13 @@ static Bit32u DRC_CALL_CONV dynrec_stosd_dword(Bit32u count,Bit32s add_index,Phy
 		CPU_Cycles=0;
 	}
 	add_index<<=2;
+	//--Added to fill runs of plain RAM a page at a time
+	if (count>1) {
+		Bitu di_index=reg_edi;
+		count=(Bit32u)MEM_StosFast(di_base,&di_index,0xffffffff,add_index,count,reg_eax);
+		reg_edi=(Bit32u)di_index;
+	}
+	//--End of modifications
 	for (;count>0;count--) {
 		mem_writed(di_base+reg_edi,reg_eax);
 		reg_edi+=add_index;
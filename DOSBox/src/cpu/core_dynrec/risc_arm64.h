@@ -0,0 +1,858 @@
+/*
+ *  Copyright (C) 2002-2010  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+
+/* ARMv8 AArch64 (little endian) backend */
+
+
+// some configuring defines that specify the capabilities of this architecture
+// or aspects of the recompiling
+
+// protect FC_ADDR over function calls if necessaray
+// #define DRC_PROTECT_ADDR_REG
+
+// try to use non-flags generating functions if possible
+#define DRC_FLAGS_INVALIDATION
+// try to replace _simple functions by code
+#define DRC_FLAGS_INVALIDATION_DCODE
+
+// type with the same size as a pointer
+#define DRC_PTR_SIZE_IM Bit64u
+
+// calling convention modifier
+#define DRC_CALL_CONV	/* nothing */
+#define DRC_FC			/* nothing */
+
+// use FC_REGS_ADDR to hold the address of "cpu_regs" and to access it using FC_REGS_ADDR
+#define DRC_USE_REGS_ADDR
+// use FC_SEGS_ADDR to hold the address of "Segs" and to access it using FC_SEGS_ADDR
+#define DRC_USE_SEGS_ADDR
+// keep EAX, ECX, ESI and EDI in callee-saved registers for the whole block, see decoder_basic.h
+#define DRC_USE_REG_CACHE
+
+// register mapping
+typedef Bit8u HostReg;
+
+// registers x0-x18 are caller-saved (x18 is reserved by the platform on Darwin),
+// x19-x28 are callee-saved, x29 is the frame pointer and x30 the link register
+#define HOST_x0 0
+#define HOST_x1 1
+#define HOST_x2 2
+#define HOST_x3 3
+#define HOST_x9 9
+#define HOST_x15 15
+#define HOST_x16 16
+#define HOST_x17 17
+#define HOST_x19 19
+#define HOST_x20 20
+#define HOST_x21 21
+#define HOST_x22 22
+#define HOST_x23 23
+#define HOST_x24 24
+#define HOST_x25 25
+#define HOST_x29 29
+#define HOST_x30 30
+// register 31 is the zero register or the stack pointer, depending on the instruction
+#define HOST_xzr 31
+#define HOST_sp 31
+
+// temporary registers
+#define temp1 HOST_x16
+#define temp2 HOST_x17
+#define temp3 HOST_x15
+
+// register that holds function return values
+#define FC_RETOP HOST_x0
+
+// register used for address calculations, if the ABI does not
+// state that this register is preserved across function calls
+// then define DRC_PROTECT_ADDR_REG above
+#define FC_ADDR HOST_x19
+
+// register that holds the first parameter
+#define FC_OP1 HOST_x0
+
+// register that holds the second parameter
+#define FC_OP2 HOST_x1
+
+// special register that holds the third parameter for _R3 calls (byte accessible)
+#define FC_OP3 HOST_x2
+
+// register that holds byte-accessible temporary values
+#define FC_TMP_BA1 HOST_x0
+
+// register that holds byte-accessible temporary values
+#define FC_TMP_BA2 HOST_x1
+
+// temporary register for LEA
+#define TEMP_REG_DRC HOST_x9
+
+#ifdef DRC_USE_REGS_ADDR
+// used to hold the address of "cpu_regs" - preferably filled in function gen_run_code
+#define FC_REGS_ADDR HOST_x20
+#endif
+
+#ifdef DRC_USE_SEGS_ADDR
+// used to hold the address of "Segs" - preferably filled in function gen_run_code
+#define FC_SEGS_ADDR HOST_x21
+#endif
+
+#ifdef DRC_USE_REG_CACHE
+// used to hold the guest registers EAX, ECX, ESI and EDI - filled in function gen_run_code
+#define FC_CACHED_EAX HOST_x22
+#define FC_CACHED_ECX HOST_x23
+#define FC_CACHED_ESI HOST_x24
+#define FC_CACHED_EDI HOST_x25
+#endif
+
+
+// instruction encodings
+// w-forms operate on the low 32 bits and zero the upper 32 bits of the destination
+
+// mov (wide immediate)
+#define MOVZ64(dst, imm, shift) (0xd2800000 + ((shift) << 17) + ((imm) << 5) + (dst))			// shift is 0, 16, 32 or 48
+#define MOVK64(dst, imm, shift) (0xf2800000 + ((shift) << 17) + ((imm) << 5) + (dst))
+#define MOVZ(dst, imm, shift) (0x52800000 + ((shift) << 17) + ((imm) << 5) + (dst))			// shift is 0 or 16
+#define MOVK(dst, imm, shift) (0x72800000 + ((shift) << 17) + ((imm) << 5) + (dst))
+#define MOVN(dst, imm, shift) (0x12800000 + ((shift) << 17) + ((imm) << 5) + (dst))
+// mov dst, src (orr dst, wzr, src)
+#define MOV_REG(dst, src) (0x2a0003e0 + ((src) << 16) + (dst))
+// mov dst, src (add dst, src, #0), accepts sp
+#define MOV_REG64_FROM_SP(dst) (0x910003e0 + (dst))
+
+// arithmetic/logical with a register
+#define ADD_REG_LSL(dst, src1, src2, shift) (0x0b000000 + ((src2) << 16) + ((shift) << 10) + ((src1) << 5) + (dst))
+#define ADD64_REG(dst, src1, src2) (0x8b000000 + ((src2) << 16) + ((src1) << 5) + (dst))
+#define SUB_REG(dst, src1, src2) (0x4b000000 + ((src2) << 16) + ((src1) << 5) + (dst))
+#define AND_REG(dst, src1, src2) (0x0a000000 + ((src2) << 16) + ((src1) << 5) + (dst))
+#define ORR_REG(dst, src1, src2) (0x2a000000 + ((src2) << 16) + ((src1) << 5) + (dst))
+#define EOR_REG(dst, src1, src2) (0x4a000000 + ((src2) << 16) + ((src1) << 5) + (dst))
+#define LSLV(dst, src, amount) (0x1ac02000 + ((amount) << 16) + ((src) << 5) + (dst))
+#define LSRV(dst, src, amount) (0x1ac02400 + ((amount) << 16) + ((src) << 5) + (dst))
+#define ASRV(dst, src, amount) (0x1ac02800 + ((amount) << 16) + ((src) << 5) + (dst))
+#define RORV(dst, src, amount) (0x1ac02c00 + ((amount) << 16) + ((src) << 5) + (dst))
+
+// arithmetic with a 12bit immediate, optionally shifted left by 12 bits
+#define ADD_IMM(dst, src, imm, shift12) (0x11000000 + ((shift12) << 22) + ((imm) << 10) + ((src) << 5) + (dst))
+#define SUB_IMM(dst, src, imm, shift12) (0x51000000 + ((shift12) << 22) + ((imm) << 10) + ((src) << 5) + (dst))
+#define ADD64_IMM(dst, src, imm) (0x91000000 + ((imm) << 10) + ((src) << 5) + (dst))
+// cmp src, #imm
+#define CMP_IMM(src, imm) (0x7100001f + ((imm) << 10) + ((src) << 5))
+// tst src, #0xff / tst src, #0xffff
+#define TST_0xFF(src) (0x72001c1f + ((src) << 5))
+#define TST_0xFFFF(src) (0x72003c1f + ((src) << 5))
+
+// bitfield moves
+#define UXTB(dst, src) (0x53001c00 + ((src) << 5) + (dst))
+#define UXTH(dst, src) (0x53003c00 + ((src) << 5) + (dst))
+#define SXTB(dst, src) (0x13001c00 + ((src) << 5) + (dst))
+#define SXTH(dst, src) (0x13003c00 + ((src) << 5) + (dst))
+#define LSL_IMM(dst, src, amount) (0x53000000 + (((32 - (amount)) & 31) << 16) + ((31 - (amount)) << 10) + ((src) << 5) + (dst))
+// extract width bits from lsb upwards, or insert the lowest width bits at lsb leaving the other bits alone
+#define UBFX(dst, src, lsb, width) (0x53000000 + ((lsb) << 16) + (((lsb) + (width) - 1) << 10) + ((src) << 5) + (dst))
+#define BFI(dst, src, lsb, width) (0x33000000 + (((32 - (lsb)) & 31) << 16) + (((width) - 1) << 10) + ((src) << 5) + (dst))
+
+// loads and stores with an unsigned immediate offset, scaled by the access size
+#define LDRB_IMM(reg, addr, off) (0x39400000 + ((off) << 10) + ((addr) << 5) + (reg))
+#define LDRH_IMM(reg, addr, off) (0x79400000 + (((off) >> 1) << 10) + ((addr) << 5) + (reg))
+#define LDR_IMM(reg, addr, off) (0xb9400000 + (((off) >> 2) << 10) + ((addr) << 5) + (reg))
+#define LDR64_IMM(reg, addr, off) (0xf9400000 + (((off) >> 3) << 10) + ((addr) << 5) + (reg))
+#define STRB_IMM(reg, addr, off) (0x39000000 + ((off) << 10) + ((addr) << 5) + (reg))
+#define STRH_IMM(reg, addr, off) (0x79000000 + (((off) >> 1) << 10) + ((addr) << 5) + (reg))
+#define STR_IMM(reg, addr, off) (0xb9000000 + (((off) >> 2) << 10) + ((addr) << 5) + (reg))
+#define STR64_IMM(reg, addr, off) (0xf9000000 + (((off) >> 3) << 10) + ((addr) << 5) + (reg))
+// ldr reg, [pc, #off]
+#define LDR64_LITERAL(reg, off) (0x58000000 + ((((off) >> 2) & 0x7ffff) << 5) + (reg))
+
+// register pairs (offsets in bytes, multiples of 8)
+#define STP64_PRE(reg1, reg2, addr, off) (0xa9800000 + ((((off) >> 3) & 0x7f) << 15) + ((reg2) << 10) + ((addr) << 5) + (reg1))
+#define STP64_IMM(reg1, reg2, addr, off) (0xa9000000 + ((((off) >> 3) & 0x7f) << 15) + ((reg2) << 10) + ((addr) << 5) + (reg1))
+#define LDP64_POST(reg1, reg2, addr, off) (0xa8c00000 + ((((off) >> 3) & 0x7f) << 15) + ((reg2) << 10) + ((addr) << 5) + (reg1))
+#define LDP64_IMM(reg1, reg2, addr, off) (0xa9400000 + ((((off) >> 3) & 0x7f) << 15) + ((reg2) << 10) + ((addr) << 5) + (reg1))
+
+// pc-relative addressing, pages are 4KB regardless of the host's page size
+#define ADRP(dst, pages) (0x90000000 + (((pages) & 3) << 29) + ((((pages) >> 2) & 0x7ffff) << 5) + (dst))
+
+// branches (offsets in bytes, relative to the branch instruction)
+#define B_OFF(off) (0x14000000 + (((off) >> 2) & 0x3ffffff))
+#define BR(reg) (0xd61f0000 + ((reg) << 5))
+#define BLR(reg) (0xd63f0000 + ((reg) << 5))
+#define RET (0xd65f03c0)
+#define CBZ(reg) (0x34000000 + (reg))
+#define CBNZ(reg) (0x35000000 + (reg))
+#define B_COND(cond) (0x54000000 + (cond))
+#define COND_EQ 0x0
+#define COND_NE 0x1
+#define COND_LE 0xd
+
+// size of the code generated by gen_call_function_raw
+#define CALL_SEQUENCE_SIZE 20
+
+
+// move a full register from reg_src to reg_dst
+static void gen_mov_regs(HostReg reg_dst,HostReg reg_src) {
+	if(reg_src == reg_dst) return;
+	cache_addd( MOV_REG(reg_dst, reg_src) );			// mov reg_dst, reg_src
+}
+
+// move a 64bit constant value into a full register
+static void gen_mov_qword_to_reg_imm(HostReg dest_reg,Bit64u imm) {
+	bool first = true;
+	for (Bitu shift=0; shift<64; shift+=16) {
+		Bit32u part = (Bit32u)((imm >> shift) & 0xffff);
+		if (!part) continue;
+		if (first) {
+			cache_addd( MOVZ64(dest_reg, part, shift) );	// movz dest_reg, #part, lsl #shift
+			first = false;
+		} else {
+			cache_addd( MOVK64(dest_reg, part, shift) );	// movk dest_reg, #part, lsl #shift
+		}
+	}
+	if (first) cache_addd( MOVZ64(dest_reg, 0, 0) );		// movz dest_reg, #0
+}
+
+// move a 32bit constant value into dest_reg
+static void gen_mov_dword_to_reg_imm(HostReg dest_reg,Bit32u imm) {
+	if ((imm & 0xffff0000) == 0) {
+		cache_addd( MOVZ(dest_reg, imm, 0) );						// movz dest_reg, #imm
+	} else if ((imm & 0x0000ffff) == 0) {
+		cache_addd( MOVZ(dest_reg, imm >> 16, 16) );				// movz dest_reg, #(imm >> 16), lsl #16
+	} else if ((imm & 0xffff0000) == 0xffff0000) {
+		cache_addd( MOVN(dest_reg, (~imm) & 0xffff, 0) );			// movn dest_reg, #(~imm & 0xffff)
+	} else {
+		cache_addd( MOVZ(dest_reg, imm & 0xffff, 0) );				// movz dest_reg, #(imm & 0xffff)
+		cache_addd( MOVK(dest_reg, imm >> 16, 16) );				// movk dest_reg, #(imm >> 16), lsl #16
+	}
+}
+
+// find a base register for accessing size bytes at data, and the offset to use with it
+// the offset is a multiple of size and fits the scaled immediate of a load/store
+// cpu_regs and Segs are reached through their fixed registers, anything else
+// through temp1 (pc-relative if possible)
+static HostReg gen_addr_base(void* data,Bitu size,Bit32u &offset) {
+	Bit64s regs_diff = (Bit64s)data - (Bit64s)&cpu_regs;
+	if (regs_diff >= 0 && regs_diff + (Bit64s)size <= (Bit64s)sizeof(cpu_regs) && !(regs_diff & (size - 1))) {
+		offset = (Bit32u)regs_diff;
+		return FC_REGS_ADDR;
+	}
+	Bit64s segs_diff = (Bit64s)data - (Bit64s)&Segs;
+	if (segs_diff >= 0 && segs_diff + (Bit64s)size <= (Bit64s)sizeof(Segs) && !(segs_diff & (size - 1))) {
+		offset = (Bit32u)segs_diff;
+		return FC_SEGS_ADDR;
+	}
+
+	Bit64s pages = ((Bit64s)data >> 12) - ((Bit64s)cache.pos >> 12);
+	Bit32u low12 = (Bit32u)((Bit64u)data & 0xfff);
+	if (pages >= -0x100000 && pages < 0x100000) {
+		cache_addd( ADRP(temp1, (Bit32u)pages) );					// adrp temp1, data
+	} else {
+		gen_mov_qword_to_reg_imm(temp1, (Bit64u)data & ~(Bit64u)0xfff);	// mov temp1, data & ~0xfff
+	}
+	if (low12 & (size - 1)) {
+		cache_addd( ADD64_IMM(temp1, temp1, low12) );				// add temp1, temp1, #low12
+		offset = 0;
+	} else {
+		offset = low12;
+	}
+	return temp1;
+}
+
+// move a 32bit (dword==true) or 16bit (dword==false) value from memory into dest_reg
+// 16bit moves may destroy the upper 16bit of the destination register
+static void gen_mov_word_to_reg(HostReg dest_reg,void* data,bool dword) {
+	Bit32u offset;
+	HostReg base = gen_addr_base(data, dword ? 4 : 2, offset);
+	if (dword) {
+		cache_addd( LDR_IMM(dest_reg, base, offset) );		// ldr dest_reg, [base, #offset]
+	} else {
+		cache_addd( LDRH_IMM(dest_reg, base, offset) );		// ldrh dest_reg, [base, #offset]
+	}
+}
+
+// move a 16bit constant value into dest_reg
+// the upper 16bit of the destination register may be destroyed
+static void gen_mov_word_to_reg_imm(HostReg dest_reg,Bit16u imm) {
+	cache_addd( MOVZ(dest_reg, imm, 0) );					// movz dest_reg, #imm
+}
+
+// move 32bit (dword==true) or 16bit (dword==false) of a register into memory
+static void gen_mov_word_from_reg(HostReg src_reg,void* dest,bool dword) {
+	Bit32u offset;
+	HostReg base = gen_addr_base(dest, dword ? 4 : 2, offset);
+	if (dword) {
+		cache_addd( STR_IMM(src_reg, base, offset) );		// str src_reg, [base, #offset]
+	} else {
+		cache_addd( STRH_IMM(src_reg, base, offset) );		// strh src_reg, [base, #offset]
+	}
+}
+
+// move an 8bit value from memory into dest_reg
+// the upper 24bit of the destination register can be destroyed
+// this function does not use FC_OP1/FC_OP2 as dest_reg as these
+// registers might not be directly byte-accessible on some architectures
+static void gen_mov_byte_to_reg_low(HostReg dest_reg,void* data) {
+	Bit32u offset;
+	HostReg base = gen_addr_base(data, 1, offset);
+	cache_addd( LDRB_IMM(dest_reg, base, offset) );			// ldrb dest_reg, [base, #offset]
+}
+
+// move an 8bit value from memory into dest_reg
+// the upper 24bit of the destination register can be destroyed
+// this function can use FC_OP1/FC_OP2 as dest_reg which are
+// not directly byte-accessible on some architectures
+static void INLINE gen_mov_byte_to_reg_low_canuseword(HostReg dest_reg,void* data) {
+	gen_mov_byte_to_reg_low(dest_reg, data);
+}
+
+// move an 8bit constant value into dest_reg
+// the upper 24bit of the destination register can be destroyed
+// this function does not use FC_OP1/FC_OP2 as dest_reg as these
+// registers might not be directly byte-accessible on some architectures
+static void INLINE gen_mov_byte_to_reg_low_imm(HostReg dest_reg,Bit8u imm) {
+	cache_addd( MOVZ(dest_reg, imm, 0) );					// movz dest_reg, #imm
+}
+
+// move an 8bit constant value into dest_reg
+// the upper 24bit of the destination register can be destroyed
+// this function can use FC_OP1/FC_OP2 as dest_reg which are
+// not directly byte-accessible on some architectures
+static void INLINE gen_mov_byte_to_reg_low_imm_canuseword(HostReg dest_reg,Bit8u imm) {
+	gen_mov_byte_to_reg_low_imm(dest_reg, imm);
+}
+
+// move the lowest 8bit of a register into memory
+static void gen_mov_byte_from_reg_low(HostReg src_reg,void* dest) {
+	Bit32u offset;
+	HostReg base = gen_addr_base(dest, 1, offset);
+	cache_addd( STRB_IMM(src_reg, base, offset) );			// strb src_reg, [base, #offset]
+}
+
+
+
+// convert an 8bit word to a 32bit dword
+// the register is zero-extended (sign==false) or sign-extended (sign==true)
+static void gen_extend_byte(bool sign,HostReg reg) {
+	if (sign) {
+		cache_addd( SXTB(reg, reg) );		// sxtb reg, reg
+	} else {
+		cache_addd( UXTB(reg, reg) );		// uxtb reg, reg
+	}
+}
+
+// convert a 16bit word to a 32bit dword
+// the register is zero-extended (sign==false) or sign-extended (sign==true)
+static void gen_extend_word(bool sign,HostReg reg) {
+	if (sign) {
+		cache_addd( SXTH(reg, reg) );		// sxth reg, reg
+	} else {
+		cache_addd( UXTH(reg, reg) );		// uxth reg, reg
+	}
+}
+
+// add a 32bit value from memory to a full register
+static void gen_add(HostReg reg,void* op) {
+	gen_mov_word_to_reg(temp2, op, 1);
+	cache_addd( ADD_REG_LSL(reg, reg, temp2, 0) );		// add reg, reg, temp2
+}
+
+// add a 32bit constant value to a full register
+static void gen_add_imm(HostReg reg,Bit32u imm) {
+	if(!imm) return;
+	Bit32u negimm = (Bit32u)(-(Bit32s)imm);
+	if (imm < 4096) {
+		cache_addd( ADD_IMM(reg, reg, imm, 0) );				// add reg, reg, #imm
+	} else if (negimm < 4096) {
+		cache_addd( SUB_IMM(reg, reg, negimm, 0) );			// sub reg, reg, #(-imm)
+	} else if ((imm & 0xff000fff) == 0) {
+		cache_addd( ADD_IMM(reg, reg, imm >> 12, 1) );		// add reg, reg, #(imm >> 12), lsl #12
+	} else if ((negimm & 0xff000fff) == 0) {
+		cache_addd( SUB_IMM(reg, reg, negimm >> 12, 1) );		// sub reg, reg, #(-imm >> 12), lsl #12
+	} else {
+		gen_mov_dword_to_reg_imm(temp3, imm);
+		cache_addd( ADD_REG_LSL(reg, reg, temp3, 0) );		// add reg, reg, temp3
+	}
+}
+
+// and a 32bit constant value with a full register
+static void gen_and_imm(HostReg reg,Bit32u imm) {
+	if (imm == 0xffffffff) return;
+	if (imm == 0xff) {
+		cache_addd( UXTB(reg, reg) );							// uxtb reg, reg
+	} else if (imm == 0xffff) {
+		cache_addd( UXTH(reg, reg) );							// uxth reg, reg
+	} else {
+		gen_mov_dword_to_reg_imm(temp3, imm);
+		cache_addd( AND_REG(reg, reg, temp3) );				// and reg, reg, temp3
+	}
+}
+
+
+// move a 32bit constant value into memory
+static void gen_mov_direct_dword(void* dest,Bit32u imm) {
+	gen_mov_dword_to_reg_imm(temp2, imm);
+	gen_mov_word_from_reg(temp2, dest, 1);
+}
+
+// move an address into memory
+static void INLINE gen_mov_direct_ptr(void* dest,DRC_PTR_SIZE_IM imm) {
+	gen_mov_qword_to_reg_imm(temp2, imm);
+	Bit32u offset;
+	HostReg base = gen_addr_base(dest, 8, offset);
+	cache_addd( STR64_IMM(temp2, base, offset) );			// str temp2, [base, #offset]
+}
+
+// add a 32bit (dword==true) or 16bit (dword==false) constant value to a memory value
+static void gen_add_direct_word(void* dest,Bit32u imm,bool dword) {
+	if (!dword) imm &= 0xffff;
+	if(!imm) return;
+	Bit32u offset;
+	HostReg base = gen_addr_base(dest, dword ? 4 : 2, offset);
+	if (dword) {
+		cache_addd( LDR_IMM(temp2, base, offset) );		// ldr temp2, [base, #offset]
+		gen_add_imm(temp2, imm);
+		cache_addd( STR_IMM(temp2, base, offset) );		// str temp2, [base, #offset]
+	} else {
+		cache_addd( LDRH_IMM(temp2, base, offset) );	// ldrh temp2, [base, #offset]
+		gen_add_imm(temp2, imm);
+		cache_addd( STRH_IMM(temp2, base, offset) );	// strh temp2, [base, #offset]
+	}
+}
+
+// add an 8bit constant value to a dword memory value
+static void INLINE gen_add_direct_byte(void* dest,Bit8s imm) {
+	gen_add_direct_word(dest, (Bit32s)imm, 1);
+}
+
+// subtract an 8bit constant value from a dword memory value
+static void INLINE gen_sub_direct_byte(void* dest,Bit8s imm) {
+	gen_add_direct_word(dest, -((Bit32s)imm), 1);
+}
+
+// subtract a 32bit (dword==true) or 16bit (dword==false) constant value from a memory value
+static void INLINE gen_sub_direct_word(void* dest,Bit32u imm,bool dword) {
+	gen_add_direct_word(dest, -(Bit32s)imm, dword);
+}
+
+
+// effective address calculation, destination is dest_reg
+// scale_reg is scaled by scale (scale_reg*(2^scale)) and
+// added to dest_reg, then the immediate value is added
+static INLINE void gen_lea(HostReg dest_reg,HostReg scale_reg,Bitu scale,Bits imm) {
+	cache_addd( ADD_REG_LSL(dest_reg, dest_reg, scale_reg, scale) );		// add dest_reg, dest_reg, scale_reg, lsl #scale
+	gen_add_imm(dest_reg, (Bit32u)imm);
+}
+
+// effective address calculation, destination is dest_reg
+// dest_reg is scaled by scale (dest_reg*(2^scale)),
+// then the immediate value is added
+static INLINE void gen_lea(HostReg dest_reg,Bitu scale,Bits imm) {
+	if (scale) {
+		cache_addd( LSL_IMM(dest_reg, dest_reg, scale) );		// lsl dest_reg, dest_reg, #scale
+	}
+	gen_add_imm(dest_reg, (Bit32u)imm);
+}
+
+
+// generate a call to a parameterless function
+// the sequence always has the same length (CALL_SEQUENCE_SIZE) so that
+// gen_fill_function_ptr can later replace the target or the whole call
+static void INLINE gen_call_function_raw(void * func) {
+	cache_addd( LDR64_LITERAL(temp1, 12) );		// ldr temp1, [pc, #12]
+	cache_addd( BLR(temp1) );					// blr temp1
+	cache_addd( B_OFF(12) );					// b +12 (skip the literal)
+	cache_addq((Bit64u)func);					// .quad func
+}
+
+// generate a call to a function with paramcount parameters
+// note: the parameters are loaded in the architecture specific way
+// using the gen_load_param_ functions below
+static Bit64u INLINE gen_call_function_setup(void * func,Bitu paramcount,bool fastcall=false) {
+	Bit64u proc_addr = (Bit64u)cache.pos;
+	gen_call_function_raw(func);
+	return proc_addr;
+}
+
+// load an immediate value as param'th function parameter
+static void INLINE gen_load_param_imm(Bitu imm,Bitu param) {
+	gen_mov_dword_to_reg_imm(param, (Bit32u)imm);
+}
+
+// load an address as param'th function parameter
+static void INLINE gen_load_param_addr(Bitu addr,Bitu param) {
+	gen_mov_qword_to_reg_imm(param, addr);
+}
+
+// load a host-register as param'th function parameter
+static void INLINE gen_load_param_reg(Bitu reg,Bitu param) {
+	gen_mov_regs(param, reg);
+}
+
+// load a value from memory as param'th function parameter
+static void INLINE gen_load_param_mem(Bitu mem,Bitu param) {
+	gen_mov_word_to_reg(param, (void *)mem, 1);
+}
+
+// jump to an address pointed at by ptr, offset is in imm
+static void gen_jmp_ptr(void * ptr,Bits imm=0) {
+	Bit32u offset;
+	HostReg base = gen_addr_base(ptr, 8, offset);
+	cache_addd( LDR64_IMM(temp2, base, offset) );		// ldr temp2, [base, #offset]
+
+	if ((imm >= 0) && (imm < 32768) && !(imm & 7)) {
+		cache_addd( LDR64_IMM(temp2, temp2, imm) );		// ldr temp2, [temp2, #imm]
+	} else {
+		gen_mov_qword_to_reg_imm(temp1, (Bit64u)imm);
+		cache_addd( ADD64_REG(temp2, temp2, temp1) );		// add temp2, temp2, temp1
+		cache_addd( LDR64_IMM(temp2, temp2, 0) );		// ldr temp2, [temp2]
+	}
+	cache_addd( BR(temp2) );							// br temp2
+}
+
+// short conditional jump (+-127 bytes) if register is zero
+// the destination is set by gen_fill_branch() later
+static Bit64u gen_create_branch_on_zero(HostReg reg,bool dword) {
+	if (dword) {
+		cache_addd( CBZ(reg) );					// cbz reg, 0
+	} else {
+		cache_addd( TST_0xFFFF(reg) );			// tst reg, #0xffff
+		cache_addd( B_COND(COND_EQ) );			// b.eq 0
+	}
+	return ((Bit64u)cache.pos-4);
+}
+
+// short conditional jump (+-127 bytes) if register is nonzero
+// the destination is set by gen_fill_branch() later
+static Bit64u gen_create_branch_on_nonzero(HostReg reg,bool dword) {
+	if (dword) {
+		cache_addd( CBNZ(reg) );				// cbnz reg, 0
+	} else {
+		cache_addd( TST_0xFFFF(reg) );			// tst reg, #0xffff
+		cache_addd( B_COND(COND_NE) );			// b.ne 0
+	}
+	return ((Bit64u)cache.pos-4);
+}
+
+// calculate relative offset and fill it into the location pointed to by data
+// cbz, cbnz and b.cond all keep their 19bit word offset in bits 5-23
+static void gen_fill_branch(DRC_PTR_SIZE_IM data) {
+#if C_DEBUG
+	Bit64s len=(Bit64u)cache.pos-data;
+	if (len<0) len=-len;
+	if (len>=0x100000) LOG_MSG("Big jump %d",len);
+#endif
+	Bit32u offset = (Bit32u)(((Bit64u)cache.pos - data) >> 2);
+	*(Bit32u*)data = (*(Bit32u*)data & 0xff00001f) | ((offset & 0x7ffff) << 5);
+}
+
+// conditional jump if register is nonzero
+// for isdword==true the 32bit of the register are tested
+// for isdword==false the lowest 8bit of the register are tested
+static Bit64u gen_create_branch_long_nonzero(HostReg reg,bool isdword) {
+	if (isdword) {
+		cache_addd( CBNZ(reg) );				// cbnz reg, 0
+	} else {
+		cache_addd( TST_0xFF(reg) );			// tst reg, #0xff
+		cache_addd( B_COND(COND_NE) );			// b.ne 0
+	}
+	return ((Bit64u)cache.pos-4);
+}
+
+// compare 32bit-register against zero and jump if value less/equal than zero
+static Bit64u gen_create_branch_long_leqzero(HostReg reg) {
+	cache_addd( CMP_IMM(reg, 0) );				// cmp reg, #0
+	cache_addd( B_COND(COND_LE) );				// b.le 0
+	return ((Bit64u)cache.pos-4);
+}
+
+// calculate long relative offset and fill it into the location pointed to by data
+// (code blocks are far smaller than the +-1MB that the branches can reach)
+static void gen_fill_branch_long(Bit64u data) {
+	gen_fill_branch(data);
+}
+
+#ifdef DRC_USE_REG_CACHE
+
+// load all cached registers from cpu_regs
+static void gen_load_cached_regs(void) {
+	gen_mov_word_to_reg(FC_CACHED_EAX, DRCD_REG_VAL(DRC_REG_EAX), 1);
+	gen_mov_word_to_reg(FC_CACHED_ECX, DRCD_REG_VAL(DRC_REG_ECX), 1);
+	gen_mov_word_to_reg(FC_CACHED_ESI, DRCD_REG_VAL(DRC_REG_ESI), 1);
+	gen_mov_word_to_reg(FC_CACHED_EDI, DRCD_REG_VAL(DRC_REG_EDI), 1);
+}
+
+// move the 32bit value of a cached register into dest_reg
+static void gen_mov_from_cached_reg(HostReg dest_reg,HostReg cached_reg) {
+	gen_mov_regs(dest_reg, cached_reg);
+}
+
+// add the 32bit value of a cached register to reg
+static void gen_add_cached_reg(HostReg reg,HostReg cached_reg) {
+	cache_addd( ADD_REG_LSL(reg, reg, cached_reg, 0) );		// add reg, reg, cached_reg
+}
+
+// move the low (high_byte==false) or high (high_byte==true) byte of a cached register
+// into the lowest 8bit of dest_reg, the upper 24bit of dest_reg can be destroyed
+static void gen_mov_byte_from_cached_reg(HostReg dest_reg,HostReg cached_reg,bool high_byte) {
+	if (high_byte) {
+		cache_addd( UBFX(dest_reg, cached_reg, 8, 8) );		// ubfx dest_reg, cached_reg, #8, #8
+	} else {
+		gen_mov_regs(dest_reg, cached_reg);
+	}
+}
+
+// move 32bit (dword==true) or 16bit (dword==false) of src_reg into a cached register
+static void gen_mov_word_to_cached_reg(HostReg cached_reg,HostReg src_reg,bool dword) {
+	if (dword) {
+		gen_mov_regs(cached_reg, src_reg);
+	} else {
+		cache_addd( BFI(cached_reg, src_reg, 0, 16) );		// bfi cached_reg, src_reg, #0, #16
+	}
+}
+
+// move the lowest 8bit of src_reg into the low (high_byte==false)
+// or high (high_byte==true) byte of a cached register
+static void gen_mov_byte_to_cached_reg(HostReg cached_reg,HostReg src_reg,bool high_byte) {
+	cache_addd( BFI(cached_reg, src_reg, high_byte ? 8 : 0, 8) );		// bfi cached_reg, src_reg, #lsb, #8
+}
+
+#endif
+
+static void gen_run_code(void) {
+	cache_addd( STP64_PRE(HOST_x29, HOST_x30, HOST_sp, -80) );		// stp x29, x30, [sp, #-80]!
+	cache_addd( STP64_IMM(HOST_x19, HOST_x20, HOST_sp, 16) );		// stp x19, x20, [sp, #16]
+	cache_addd( STP64_IMM(HOST_x21, HOST_x22, HOST_sp, 32) );		// stp x21, x22, [sp, #32]
+	cache_addd( STP64_IMM(HOST_x23, HOST_x24, HOST_sp, 48) );		// stp x23, x24, [sp, #48]
+	cache_addd( STR64_IMM(HOST_x25, HOST_sp, 64) );				// str x25, [sp, #64]
+	cache_addd( MOV_REG64_FROM_SP(HOST_x29) );						// mov x29, sp
+
+	gen_mov_qword_to_reg_imm(FC_REGS_ADDR, (Bit64u)&cpu_regs);		// mov FC_REGS_ADDR, &cpu_regs
+	gen_mov_qword_to_reg_imm(FC_SEGS_ADDR, (Bit64u)&Segs);			// mov FC_SEGS_ADDR, &Segs
+#ifdef DRC_USE_REG_CACHE
+	gen_load_cached_regs();
+#endif
+
+	cache_addd( BR(HOST_x0) );										// br x0
+}
+
+// return from a function
+// (this must fit the 32 bytes that are set aside for each link block together with the return code)
+static void gen_return_function(void) {
+	cache_addd( LDR64_IMM(HOST_x25, HOST_sp, 64) );				// ldr x25, [sp, #64]
+	cache_addd( LDP64_IMM(HOST_x23, HOST_x24, HOST_sp, 48) );		// ldp x23, x24, [sp, #48]
+	cache_addd( LDP64_IMM(HOST_x21, HOST_x22, HOST_sp, 32) );		// ldp x21, x22, [sp, #32]
+	cache_addd( LDP64_IMM(HOST_x19, HOST_x20, HOST_sp, 16) );		// ldp x19, x20, [sp, #16]
+	cache_addd( LDP64_POST(HOST_x29, HOST_x30, HOST_sp, 80) );		// ldp x29, x30, [sp], #80
+	cache_addd( RET );												// ret
+}
+
+#ifdef DRC_FLAGS_INVALIDATION
+// called when a call to a function can be replaced by a
+// call to a simpler function
+// pos points at a call sequence generated by gen_call_function_raw
+static void gen_fill_function_ptr(Bit8u * pos,void* fct_ptr,Bitu flags_type) {
+#ifdef DRC_FLAGS_INVALIDATION_DCODE
+	// try to avoid function calls but rather directly fill in code
+	switch (flags_type) {
+		case t_ADDb:
+		case t_ADDw:
+		case t_ADDd:
+			*(Bit32u*)(pos+0)=ADD_REG_LSL(FC_RETOP, HOST_x0, HOST_x1, 0);	// add w0, w0, w1
+			*(Bit32u*)(pos+4)=B_OFF(CALL_SEQUENCE_SIZE-4);					// skip
+			break;
+		case t_ORb:
+		case t_ORw:
+		case t_ORd:
+			*(Bit32u*)(pos+0)=ORR_REG(FC_RETOP, HOST_x0, HOST_x1);			// orr w0, w0, w1
+			*(Bit32u*)(pos+4)=B_OFF(CALL_SEQUENCE_SIZE-4);					// skip
+			break;
+		case t_ANDb:
+		case t_ANDw:
+		case t_ANDd:
+			*(Bit32u*)(pos+0)=AND_REG(FC_RETOP, HOST_x0, HOST_x1);			// and w0, w0, w1
+			*(Bit32u*)(pos+4)=B_OFF(CALL_SEQUENCE_SIZE-4);					// skip
+			break;
+		case t_SUBb:
+		case t_SUBw:
+		case t_SUBd:
+			*(Bit32u*)(pos+0)=SUB_REG(FC_RETOP, HOST_x0, HOST_x1);			// sub w0, w0, w1
+			*(Bit32u*)(pos+4)=B_OFF(CALL_SEQUENCE_SIZE-4);					// skip
+			break;
+		case t_XORb:
+		case t_XORw:
+		case t_XORd:
+			*(Bit32u*)(pos+0)=EOR_REG(FC_RETOP, HOST_x0, HOST_x1);			// eor w0, w0, w1
+			*(Bit32u*)(pos+4)=B_OFF(CALL_SEQUENCE_SIZE-4);					// skip
+			break;
+		case t_CMPb:
+		case t_CMPw:
+		case t_CMPd:
+		case t_TESTb:
+		case t_TESTw:
+		case t_TESTd:
+			*(Bit32u*)(pos+0)=B_OFF(CALL_SEQUENCE_SIZE);						// skip
+			break;
+		case t_INCb:
+		case t_INCw:
+		case t_INCd:
+			*(Bit32u*)(pos+0)=ADD_IMM(FC_RETOP, HOST_x0, 1, 0);				// add w0, w0, #1
+			*(Bit32u*)(pos+4)=B_OFF(CALL_SEQUENCE_SIZE-4);					// skip
+			break;
+		case t_DECb:
+		case t_DECw:
+		case t_DECd:
+			*(Bit32u*)(pos+0)=SUB_IMM(FC_RETOP, HOST_x0, 1, 0);				// sub w0, w0, #1
+			*(Bit32u*)(pos+4)=B_OFF(CALL_SEQUENCE_SIZE-4);					// skip
+			break;
+		case t_SHLb:
+		case t_SHLw:
+		case t_SHLd:
+			*(Bit32u*)(pos+0)=LSLV(FC_RETOP, HOST_x0, HOST_x1);				// lsl w0, w0, w1
+			*(Bit32u*)(pos+4)=B_OFF(CALL_SEQUENCE_SIZE-4);					// skip
+			break;
+		case t_SHRb:
+		case t_SHRw:
+		case t_SHRd:
+			*(Bit32u*)(pos+0)=LSRV(FC_RETOP, HOST_x0, HOST_x1);				// lsr w0, w0, w1
+			*(Bit32u*)(pos+4)=B_OFF(CALL_SEQUENCE_SIZE-4);					// skip
+			break;
+		case t_SARd:
+			*(Bit32u*)(pos+0)=ASRV(FC_RETOP, HOST_x0, HOST_x1);				// asr w0, w0, w1
+			*(Bit32u*)(pos+4)=B_OFF(CALL_SEQUENCE_SIZE-4);					// skip
+			break;
+		case t_RORd:
+			*(Bit32u*)(pos+0)=RORV(FC_RETOP, HOST_x0, HOST_x1);				// ror w0, w0, w1
+			*(Bit32u*)(pos+4)=B_OFF(CALL_SEQUENCE_SIZE-4);					// skip
+			break;
+		case t_NEGb:
+		case t_NEGw:
+		case t_NEGd:
+			*(Bit32u*)(pos+0)=SUB_REG(FC_RETOP, HOST_xzr, HOST_x0);			// neg w0, w0
+			*(Bit32u*)(pos+4)=B_OFF(CALL_SEQUENCE_SIZE-4);					// skip
+			break;
+		default:
+			*(Bit64u*)(pos+12)=(Bit64u)fct_ptr;		// simple_func
+			break;
+	}
+#else
+	*(Bit64u*)(pos+12)=(Bit64u)fct_ptr;		// simple_func
+#endif
+}
+#endif
+
+// the instruction cache is not coherent with the data cache on ARM,
+// so it has to be invalidated for every block of freshly written code
+static void cache_block_closing(Bit8u* block_start,Bitu block_size) {
+	__builtin___clear_cache((char *)block_start, (char *)(block_start + block_size));
+}
+
+static void cache_block_before_close(void) { }
+
+
+#ifdef DRC_USE_SEGS_ADDR
+
+// mov 16bit value from Segs[index] into dest_reg using FC_SEGS_ADDR (index modulo 2 must be zero)
+// 16bit moves may destroy the upper 16bit of the destination register
+static void gen_mov_seg16_to_reg(HostReg dest_reg,Bitu index) {
+	cache_addd( LDRH_IMM(dest_reg, FC_SEGS_ADDR, index) );		// ldrh dest_reg, [FC_SEGS_ADDR, #index]
+}
+
+// mov 32bit value from Segs[index] into dest_reg using FC_SEGS_ADDR (index modulo 4 must be zero)
+static void gen_mov_seg32_to_reg(HostReg dest_reg,Bitu index) {
+	cache_addd( LDR_IMM(dest_reg, FC_SEGS_ADDR, index) );		// ldr dest_reg, [FC_SEGS_ADDR, #index]
+}
+
+// add a 32bit value from Segs[index] to a full register using FC_SEGS_ADDR (index modulo 4 must be zero)
+static void gen_add_seg32_to_reg(HostReg reg,Bitu index) {
+	cache_addd( LDR_IMM(temp1, FC_SEGS_ADDR, index) );			// ldr temp1, [FC_SEGS_ADDR, #index]
+	cache_addd( ADD_REG_LSL(reg, reg, temp1, 0) );				// add reg, reg, temp1
+}
+
+#endif
+
+#ifdef DRC_USE_REGS_ADDR
+
+// mov 16bit value from cpu_regs[index] into dest_reg using FC_REGS_ADDR (index modulo 2 must be zero)
+// 16bit moves may destroy the upper 16bit of the destination register
+static void gen_mov_regval16_to_reg(HostReg dest_reg,Bitu index) {
+	cache_addd( LDRH_IMM(dest_reg, FC_REGS_ADDR, index) );		// ldrh dest_reg, [FC_REGS_ADDR, #index]
+}
+
+// mov 32bit value from cpu_regs[index] into dest_reg using FC_REGS_ADDR (index modulo 4 must be zero)
+static void gen_mov_regval32_to_reg(HostReg dest_reg,Bitu index) {
+	cache_addd( LDR_IMM(dest_reg, FC_REGS_ADDR, index) );		// ldr dest_reg, [FC_REGS_ADDR, #index]
+}
+
+// move a 32bit (dword==true) or 16bit (dword==false) value from cpu_regs[index] into dest_reg using FC_REGS_ADDR (if dword==true index modulo 4 must be zero) (if dword==false index modulo 2 must be zero)
+// 16bit moves may destroy the upper 16bit of the destination register
+static void gen_mov_regword_to_reg(HostReg dest_reg,Bitu index,bool dword) {
+	if (dword) {
+		gen_mov_regval32_to_reg(dest_reg, index);
+	} else {
+		gen_mov_regval16_to_reg(dest_reg, index);
+	}
+}
+
+// move an 8bit value from cpu_regs[index]  into dest_reg using FC_REGS_ADDR
+// the upper 24bit of the destination register can be destroyed
+// this function does not use FC_OP1/FC_OP2 as dest_reg as these
+// registers might not be directly byte-accessible on some architectures
+static void gen_mov_regbyte_to_reg_low(HostReg dest_reg,Bitu index) {
+	cache_addd( LDRB_IMM(dest_reg, FC_REGS_ADDR, index) );		// ldrb dest_reg, [FC_REGS_ADDR, #index]
+}
+
+// move an 8bit value from cpu_regs[index]  into dest_reg using FC_REGS_ADDR
+// the upper 24bit of the destination register can be destroyed
+// this function can use FC_OP1/FC_OP2 as dest_reg which are
+// not directly byte-accessible on some architectures
+static void INLINE gen_mov_regbyte_to_reg_low_canuseword(HostReg dest_reg,Bitu index) {
+	gen_mov_regbyte_to_reg_low(dest_reg, index);
+}
+
+
+// add a 32bit value from cpu_regs[index] to a full register using FC_REGS_ADDR (index modulo 4 must be zero)
+static void gen_add_regval32_to_reg(HostReg reg,Bitu index) {
+	cache_addd( LDR_IMM(temp2, FC_REGS_ADDR, index) );			// ldr temp2, [FC_REGS_ADDR, #index]
+	cache_addd( ADD_REG_LSL(reg, reg, temp2, 0) );				// add reg, reg, temp2
+}
+
+
+// move 16bit of register into cpu_regs[index] using FC_REGS_ADDR (index modulo 2 must be zero)
+static void gen_mov_regval16_from_reg(HostReg src_reg,Bitu index) {
+	cache_addd( STRH_IMM(src_reg, FC_REGS_ADDR, index) );		// strh src_reg, [FC_REGS_ADDR, #index]
+}
+
+// move 32bit of register into cpu_regs[index] using FC_REGS_ADDR (index modulo 4 must be zero)
+static void gen_mov_regval32_from_reg(HostReg src_reg,Bitu index) {
+	cache_addd( STR_IMM(src_reg, FC_REGS_ADDR, index) );		// str src_reg, [FC_REGS_ADDR, #index]
+}
+
+// move 32bit (dword==true) or 16bit (dword==false) of a register into cpu_regs[index] using FC_REGS_ADDR (if dword==true index modulo 4 must be zero) (if dword==false index modulo 2 must be zero)
+static void gen_mov_regword_from_reg(HostReg src_reg,Bitu index,bool dword) {
+	if (dword) {
+		gen_mov_regval32_from_reg(src_reg, index);
+	} else {
+		gen_mov_regval16_from_reg(src_reg, index);
+	}
+}
+
+// move the lowest 8bit of a register into cpu_regs[index] using FC_REGS_ADDR
+static void gen_mov_regbyte_from_reg_low(HostReg src_reg,Bitu index) {
+	cache_addd( STRB_IMM(src_reg, FC_REGS_ADDR, index) );		// strb src_reg, [FC_REGS_ADDR, #index]
+}
+
+#endif
@@ -33,6 +33,14 @@
 // type with the same size as a pointer
 #define DRC_PTR_SIZE_IM Bit64u
 
+//--Added to keep EAX, ECX, ESI and EDI in r12-r15 for the whole block, see decoder_basic.h
+#define DRC_USE_REG_CACHE
+//--End of modifications
+
+//--Added to use the host CPU's instruction set extensions where they help, see gen_detect_host_features
+#define DRC_USE_HOST_FEATURES
+//--End of modifications
+
 // calling convention modifier
 #define DRC_CALL_CONV	/* nothing */
 #define DRC_FC			/* nothing */
@@ -76,6 +84,16 @@ typedef Bit8u HostReg;
 // temporary register for LEA
 #define TEMP_REG_DRC HOST_ESI
 
+//--Added for the register cache: callee-saved registers that are only reachable with a REX prefix,
+//so they are only ever used by the gen_*cached* functions below and never handed to the others
+#ifdef DRC_USE_REG_CACHE
+#define FC_CACHED_EAX 12
+#define FC_CACHED_ECX 13
+#define FC_CACHED_ESI 14
+#define FC_CACHED_EDI 15
+#endif
+//--End of modifications
+
 
 // move a full register from reg_src to reg_dst
 static void gen_mov_regs(HostReg reg_dst,HostReg reg_src) {
@@ -582,22 +600,271 @@ static void gen_fill_branch_long(Bit64u data) {
 }
 
 
+//--Added for the register cache
+#ifdef DRC_USE_REG_CACHE
+
+// load all cached registers from cpu_regs
+static void gen_load_cached_regs(void) {
+	static const Bit8u regs[4][2]={
+		{FC_CACHED_EAX,DRC_REG_EAX},{FC_CACHED_ECX,DRC_REG_ECX},
+		{FC_CACHED_ESI,DRC_REG_ESI},{FC_CACHED_EDI,DRC_REG_EDI}
+	};
+	for (Bitu i=0;i<4;i++) {
+		cache_addb(0x44);					// mov cached,[data]
+		cache_addb(0x8b);
+		gen_memaddr(regs[i][0]&7,DRCD_REG_VAL(regs[i][1]));
+	}
+}
+
+// move the 32bit value of a cached register into dest_reg
+static void gen_mov_from_cached_reg(HostReg dest_reg,HostReg cached_reg) {
+	cache_addb(0x41);					// mov dest_reg,cached_reg
+	cache_addb(0x8b);
+	cache_addb(0xc0+(dest_reg<<3)+(cached_reg&7));
+}
+
+// add the 32bit value of a cached register to reg
+static void gen_add_cached_reg(HostReg reg,HostReg cached_reg) {
+	cache_addb(0x41);					// add reg,cached_reg
+	cache_addb(0x03);
+	cache_addb(0xc0+(reg<<3)+(cached_reg&7));
+}
+
+// move the low (high_byte==false) or high (high_byte==true) byte of a cached register
+// into the lowest 8bit of dest_reg, the upper 24bit of dest_reg can be destroyed
+static void gen_mov_byte_from_cached_reg(HostReg dest_reg,HostReg cached_reg,bool high_byte) {
+	gen_mov_from_cached_reg(dest_reg,cached_reg);
+	if (high_byte) {
+		cache_addw(0xe8c1+(dest_reg<<8));	// shr dest_reg,8
+		cache_addb(0x08);
+	}
+}
+
+// move 32bit (dword==true) or 16bit (dword==false) of src_reg into a cached register
+static void gen_mov_word_to_cached_reg(HostReg cached_reg,HostReg src_reg,bool dword) {
+	if (!dword) cache_addb(0x66);
+	cache_addb(0x41);					// mov cached_reg,src_reg
+	cache_addb(0x89);
+	cache_addb(0xc0+(src_reg<<3)+(cached_reg&7));
+}
+
+// move the lowest 8bit of src_reg into the low (high_byte==false)
+// or high (high_byte==true) byte of a cached register
+static void gen_mov_byte_to_cached_reg(HostReg cached_reg,HostReg src_reg,bool high_byte) {
+	if (high_byte) {
+		cache_addw(0xc141);					// ror cached_reg,8
+		cache_addb(0xc8+(cached_reg&7));
+		cache_addb(0x08);
+	}
+	// with a REX prefix every register is byte-accessible
+	cache_addb(0x41);					// mov cached_reg(low),src_reg(low)
+	cache_addb(0x88);
+	cache_addb(0xc0+(src_reg<<3)+(cached_reg&7));
+	if (high_byte) {
+		cache_addw(0xc141);					// rol cached_reg,8
+		cache_addb(0xc0+(cached_reg&7));
+		cache_addb(0x08);
+	}
+}
+
+#endif
+//--End of modifications
+
+//--Modified to save the registers that hold cached guest registers, and load them for the block
 static void gen_run_code(void) {
 	cache_addb(0x53);					// push rbx
+#ifdef DRC_USE_REG_CACHE
+	// five pushes keep the stack aligned the same way as the single push of rbx did
+	cache_addw(0x5441);					// push r12
+	cache_addw(0x5541);					// push r13
+	cache_addw(0x5641);					// push r14
+	cache_addw(0x5741);					// push r15
+	gen_load_cached_regs();
+#endif
 	cache_addw(0xd0ff+(FC_OP1<<8));		// call rdi
+#ifdef DRC_USE_REG_CACHE
+	cache_addw(0x5f41);					// pop  r15
+	cache_addw(0x5e41);					// pop  r14
+	cache_addw(0x5d41);					// pop  r13
+	cache_addw(0x5c41);					// pop  r12
+#endif
 	cache_addb(0x5b);					// pop  rbx
 }
+//--End of modifications
 
 // return from a function
 static void gen_return_function(void) {
 	cache_addb(0xc3);		// ret
 }
 
+//--Added to use the host CPU's instruction set extensions where they help. Which ones the host
+//has is found out when the translation cache is set up; generated code only uses those in
+//host_features, which is left empty when the dynamic_hostfeatures setting is turned off.
+#if defined (_MSC_VER)
+#include <intrin.h>
+#define DRC_HOST_TARGET(extension)	/* nothing */
+#else
+#include <cpuid.h>
+#include <x86intrin.h>
+#define DRC_HOST_TARGET(extension)	__attribute__((target(extension)))
+#endif
+
+#define HOST_FEATURE_BMI1	0x01	// tzcnt
+#define HOST_FEATURE_BMI2	0x02	// shlx, shrx, sarx
+#define HOST_FEATURE_LZCNT	0x04	// lzcnt
+
+static Bitu host_features_supported=0;
+static Bitu host_features=0;
+
+static void gen_cpuid(Bit32u leaf,Bit32u regs[4]) {
+#if defined (_MSC_VER)
+	__cpuidex((int*)regs,(int)leaf,0);
+#else
+	__cpuid_count(leaf,0,regs[0],regs[1],regs[2],regs[3]);
+#endif
+}
+
+static void gen_detect_host_features(void) {
+	static bool detected=false;
+	if (detected) return;
+	detected=true;
+
+	Bit32u regs[4];
+	gen_cpuid(0,regs);
+	if (regs[0]>=7) {
+		gen_cpuid(7,regs);
+		if (regs[1] & (1<<3)) host_features_supported|=HOST_FEATURE_BMI1;
+		if (regs[1] & (1<<8)) host_features_supported|=HOST_FEATURE_BMI2;
+	}
+	gen_cpuid(0x80000000,regs);
+	if (regs[0]>=0x80000001) {
+		gen_cpuid(0x80000001,regs);
+		if (regs[2] & (1<<5)) host_features_supported|=HOST_FEATURE_LZCNT;
+	}
+	host_features=host_features_supported;
+}
+
+static const char * gen_describe_host_features(Bitu features) {
+	static char description[32];
+	description[0]=0;
+	if (features & HOST_FEATURE_BMI1) strcat(description," bmi1");
+	if (features & HOST_FEATURE_BMI2) strcat(description," bmi2");
+	if (features & HOST_FEATURE_LZCNT) strcat(description," lzcnt");
+	return description[0] ? description+1 : description;
+}
+
+// bit scans using tzcnt and lzcnt. Unlike bsf and bsr these are defined for a zero source,
+// giving the operand size, which is how a zero source is told apart here
+static Bit16u DRC_CALL_CONV dynrec_bsf_word_tzcnt(Bit16u op1,Bit16u op2) DRC_HOST_TARGET("bmi");
+static Bit16u DRC_CALL_CONV dynrec_bsf_word_tzcnt(Bit16u op1,Bit16u op2) {
+	Bit32u result=_tzcnt_u32(op1);
+	FillFlags();
+	SETFLAGBIT(ZF,result==32);
+	return (result==32) ? op2 : (Bit16u)result;
+}
+
+static Bit32u DRC_CALL_CONV dynrec_bsf_dword_tzcnt(Bit32u op1,Bit32u op2) DRC_HOST_TARGET("bmi");
+static Bit32u DRC_CALL_CONV dynrec_bsf_dword_tzcnt(Bit32u op1,Bit32u op2) {
+	Bit32u result=_tzcnt_u32(op1);
+	FillFlags();
+	SETFLAGBIT(ZF,result==32);
+	return (result==32) ? op2 : result;
+}
+
+static Bit16u DRC_CALL_CONV dynrec_bsr_word_lzcnt(Bit16u op1,Bit16u op2) DRC_HOST_TARGET("lzcnt");
+static Bit16u DRC_CALL_CONV dynrec_bsr_word_lzcnt(Bit16u op1,Bit16u op2) {
+	Bit32u leading=_lzcnt_u32(op1);
+	FillFlags();
+	SETFLAGBIT(ZF,leading==32);
+	return (leading==32) ? op2 : (Bit16u)(31-leading);
+}
+
+static Bit32u DRC_CALL_CONV dynrec_bsr_dword_lzcnt(Bit32u op1,Bit32u op2) DRC_HOST_TARGET("lzcnt");
+static Bit32u DRC_CALL_CONV dynrec_bsr_dword_lzcnt(Bit32u op1,Bit32u op2) {
+	Bit32u leading=_lzcnt_u32(op1);
+	FillFlags();
+	SETFLAGBIT(ZF,leading==32);
+	return (leading==32) ? op2 : 31-leading;
+}
+
+// returns a bit scan function that uses the host's own instructions, or NULL if there is none
+static void * gen_bit_scan_function(bool forward,bool dword) {
+	if (forward) {
+		if (!(host_features & HOST_FEATURE_BMI1)) return NULL;
+		return dword ? (void*)&dynrec_bsf_dword_tzcnt : (void*)&dynrec_bsf_word_tzcnt;
+	} else {
+		if (!(host_features & HOST_FEATURE_LZCNT)) return NULL;
+		return dword ? (void*)&dynrec_bsr_dword_lzcnt : (void*)&dynrec_bsr_word_lzcnt;
+	}
+}
+
+#ifdef DRC_FLAGS_INVALIDATION_DCODE
+// fills in the call to a _simple shift function with shlx, shrx or sarx, which take the
+// count in any register. Byte and word operands are extended first for right shifts,
+// since the bits above them may hold anything. Returns false for anything else.
+static bool gen_fill_function_bmi2(Bit8u * pos,Bitu flags_type) {
+	static const Bit8u mov_eax_edi[]={0x89,0xf8};
+	static const Bit8u movzx_eax_di[]={0x0f,0xb7,0xc7};
+	static const Bit8u movsx_eax_di[]={0x0f,0xbf,0xc7};
+	static const Bit8u movzx_eax_dil[]={0x40,0x0f,0xb6,0xc7};
+	static const Bit8u movsx_eax_dil[]={0x40,0x0f,0xbe,0xc7};
+
+	const Bit8u * load;
+	Bitu load_size;
+	Bit8u pp;		// selects the instruction through the VEX prefix
+	switch (flags_type) {
+		case t_SHLb:
+		case t_SHLw:
+		case t_SHLd:
+			load=mov_eax_edi;load_size=sizeof(mov_eax_edi);pp=0x01;
+			break;
+		case t_SHRb:
+			load=movzx_eax_dil;load_size=sizeof(movzx_eax_dil);pp=0x03;
+			break;
+		case t_SHRw:
+			load=movzx_eax_di;load_size=sizeof(movzx_eax_di);pp=0x03;
+			break;
+		case t_SHRd:
+			load=mov_eax_edi;load_size=sizeof(mov_eax_edi);pp=0x03;
+			break;
+		case t_SARb:
+			load=movsx_eax_dil;load_size=sizeof(movsx_eax_dil);pp=0x02;
+			break;
+		case t_SARw:
+			load=movsx_eax_di;load_size=sizeof(movsx_eax_di);pp=0x02;
+			break;
+		case t_SARd:
+			load=mov_eax_edi;load_size=sizeof(mov_eax_edi);pp=0x02;
+			break;
+		default:
+			return false;
+	}
+
+	Bit8u * code=pos;
+	for (Bitu i=0;i<load_size;i++) *code++=load[i];
+	*code++=0xc4;		// shlx/shrx/sarx eax,eax,esi
+	*code++=0xe2;
+	*code++=0x48+pp;	// vvvv=esi
+	*code++=0xf7;
+	*code++=0xc0;
+	// skip the rest of the 12 bytes of the call
+	*code++=0xeb;
+	*code=(Bit8u)(pos+12-(code+1));
+	code++;
+	while (code<pos+12) *code++=0x90;
+	return true;
+}
+#endif
+//--End of modifications
+
 #ifdef DRC_FLAGS_INVALIDATION
 // called when a call to a function can be replaced by a
 // call to a simpler function
 static void gen_fill_function_ptr(Bit8u * pos,void* fct_ptr,Bitu flags_type) {
 #ifdef DRC_FLAGS_INVALIDATION_DCODE
+	//--Added to shift with BMI2 instructions when the host has them
+	if ((host_features & HOST_FEATURE_BMI2) && gen_fill_function_bmi2(pos,flags_type)) return;
+	//--End of modifications
 	// try to avoid function calls but rather directly fill in code
 	switch (flags_type) {
 		case t_ADDb:
@@ -666,6 +933,39 @@ static void gen_fill_function_ptr(Bit8u * pos,void* fct_ptr,Bitu flags_type) {
 			*(Bit32u*)(pos+4)=0x909006eb;	// skip
 			*(Bit32u*)(pos+8)=0x90909090;
 			break;
+		//--Added to rotate by cl, which masks the count the same way the guest does.
+		//ecx is not preserved over the call being replaced either.
+		case t_ROLb:
+			*(Bit32u*)(pos+0)=0xf189f889;	// mov eax,edi; mov ecx,esi
+			*(Bit32u*)(pos+4)=0x04ebc0d2;	// rol al,cl; skip
+			*(Bit32u*)(pos+8)=0x90909090;
+			break;
+		case t_RORb:
+			*(Bit32u*)(pos+0)=0xf189f889;	// mov eax,edi; mov ecx,esi
+			*(Bit32u*)(pos+4)=0x04ebc8d2;	// ror al,cl; skip
+			*(Bit32u*)(pos+8)=0x90909090;
+			break;
+		case t_ROLw:
+			*(Bit32u*)(pos+0)=0xf189f889;	// mov eax,edi; mov ecx,esi
+			*(Bit32u*)(pos+4)=0xebc0d366;	// rol ax,cl; skip
+			*(Bit32u*)(pos+8)=0x90909003;
+			break;
+		case t_RORw:
+			*(Bit32u*)(pos+0)=0xf189f889;	// mov eax,edi; mov ecx,esi
+			*(Bit32u*)(pos+4)=0xebc8d366;	// ror ax,cl; skip
+			*(Bit32u*)(pos+8)=0x90909003;
+			break;
+		case t_ROLd:
+			*(Bit32u*)(pos+0)=0xf189f889;	// mov eax,edi; mov ecx,esi
+			*(Bit32u*)(pos+4)=0x04ebc0d3;	// rol eax,cl; skip
+			*(Bit32u*)(pos+8)=0x90909090;
+			break;
+		case t_RORd:
+			*(Bit32u*)(pos+0)=0xf189f889;	// mov eax,edi; mov ecx,esi
+			*(Bit32u*)(pos+4)=0x04ebc8d3;	// ror eax,cl; skip
+			*(Bit32u*)(pos+8)=0x90909090;
+			break;
+		//--End of modifications
 		default:
 			*(Bit64u*)(pos+2)=(Bit64u)fct_ptr;		// fill function pointer
 			break;
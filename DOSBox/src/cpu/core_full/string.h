@@ -71,6 +71,9 @@
 		}
 		break;
 	case R_STOSB:
+		//--Added to fill runs of plain RAM a page at a time
+		if (count>1) count=MEM_StosFast(di_base,&di_index,add_mask,add_index,count,reg_al);
+		//--End of modifications
 		for (;count>0;count--) {
 			SaveMb(di_base+di_index,reg_al);
 			di_index=(di_index+add_index) & add_mask;
@@ -78,6 +81,9 @@
 		break;
 	case R_STOSW:
 		add_index<<=1;
+		//--Added to fill runs of plain RAM a page at a time
+		if (count>1) count=MEM_StosFast(di_base,&di_index,add_mask,add_index,count,reg_ax);
+		//--End of modifications
 		for (;count>0;count--) {
 			SaveMw(di_base+di_index,reg_ax);
 			di_index=(di_index+add_index) & add_mask;
@@ -85,12 +91,18 @@
 		break;
 	case R_STOSD:
 		add_index<<=2;
+		//--Added to fill runs of plain RAM a page at a time
+		if (count>1) count=MEM_StosFast(di_base,&di_index,add_mask,add_index,count,reg_eax);
+		//--End of modifications
 		for (;count>0;count--) {
 			SaveMd(di_base+di_index,reg_eax);
 			di_index=(di_index+add_index) & add_mask;
 		}
 		break;
 	case R_MOVSB:
+		//--Added to copy runs of plain RAM a page at a time
+		if (count>1) count=MEM_MovsFast(si_base,&si_index,di_base,&di_index,add_mask,add_index,count);
+		//--End of modifications
 		for (;count>0;count--) {
 			SaveMb(di_base+di_index,LoadMb(si_base+si_index));
 			di_index=(di_index+add_index) & add_mask;
@@ -99,6 +111,9 @@
 		break;
 	case R_MOVSW:
 		add_index<<=1;
+		//--Added to copy runs of plain RAM a page at a time
+		if (count>1) count=MEM_MovsFast(si_base,&si_index,di_base,&di_index,add_mask,add_index,count);
+		//--End of modifications
 		for (;count>0;count--) {
 			SaveMw(di_base+di_index,LoadMw(si_base+si_index));
 			di_index=(di_index+add_index) & add_mask;
@@ -107,6 +122,9 @@
 		break;
 	case R_MOVSD:
 		add_index<<=2;
+		//--Added to copy runs of plain RAM a page at a time
+		if (count>1) count=MEM_MovsFast(si_base,&si_index,di_base,&di_index,add_mask,add_index,count);
+		//--End of modifications
 		for (;count>0;count--) {
 			SaveMd(di_base+di_index,LoadMd(si_base+si_index));
 			di_index=(di_index+add_index) & add_mask;
@@ -114,6 +132,13 @@
 		}
 		break;
 	case R_LODSB:
+		//--Added to skip through runs of plain RAM a page at a time
+		if (count>1) {
+			Bit32u val=reg_al;
+			count=MEM_LodsFast(si_base,&si_index,add_mask,add_index,count,&val);
+			reg_al=(Bit8u)val;
+		}
+		//--End of modifications
 		for (;count>0;count--) {
 			reg_al=LoadMb(si_base+si_index);
 			si_index=(si_index+add_index) & add_mask;
@@ -121,6 +146,13 @@
 		break;
 	case R_LODSW:
 		add_index<<=1;
+		//--Added to skip through runs of plain RAM a page at a time
+		if (count>1) {
+			Bit32u val=reg_ax;
+			count=MEM_LodsFast(si_base,&si_index,add_mask,add_index,count,&val);
+			reg_ax=(Bit16u)val;
+		}
+		//--End of modifications
 		for (;count>0;count--) {
 			reg_ax=LoadMw(si_base+si_index);
 			si_index=(si_index+add_index) & add_mask;
@@ -128,6 +160,13 @@
 		break;
 	case R_LODSD:
 		add_index<<=2;
+		//--Added to skip through runs of plain RAM a page at a time
+		if (count>1) {
+			Bit32u val=reg_eax;
+			count=MEM_LodsFast(si_base,&si_index,add_mask,add_index,count,&val);
+			reg_eax=(Bit32u)val;
+		}
+		//--End of modifications
 		for (;count>0;count--) {
 			reg_eax=LoadMd(si_base+si_index);
 			si_index=(si_index+add_index) & add_mask;
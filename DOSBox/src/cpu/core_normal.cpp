@@ -41,9 +41,11 @@
 #define SaveMd(off,val)	mem_writed(off,val)
 #else 
 #include "paging.h"
-#define LoadMb(off) mem_readb_inline(off)
-#define LoadMw(off) mem_readw_inline(off)
-#define LoadMd(off) mem_readd_inline(off)
+//--Modified to take page faults on reads by unwinding back to CPU_Core_Normal_Run
+#define LoadMb(off) mem_readb_restartable(off)
+#define LoadMw(off) mem_readw_restartable(off)
+#define LoadMd(off) mem_readd_restartable(off)
+//--End of modifications
 #define SaveMb(off,val)	mem_writeb_inline(off,val)
 #define SaveMw(off,val)	mem_writew_inline(off,val)
 #define SaveMd(off,val)	mem_writed_inline(off,val)
@@ -76,7 +78,7 @@ extern Bitu cycle_count;
 
 #define DO_PREFIX_ADDR()								\
 	core.prefixes=(core.prefixes & ~PREFIX_ADDR) |		\
-	(cpu.code.big ^ PREFIX_ADDR);						\
+	(CODE_BIG ^ PREFIX_ADDR);							\
 	core.ea_table=&EATable[(core.prefixes&1) * 256];	\
 	goto restart_opcode;
 
@@ -124,6 +126,12 @@ static INLINE Bit32u Fetchd() {
 	return temp;
 }
 
+//--Added so that the shared opcode headers use the decode loop's fixed code size
+#define CODE_BIG			CORE_NORMAL_BIG
+//Returned by the decode loops when they must hand over to the other one
+#define CORE_NORMAL_SIZE_CHANGED	(-1)
+//--End of modifications
+
 #define Push_16 CPU_Push16
 #define Push_32 CPU_Push32
 #define Pop_16 CPU_Pop16
@@ -136,57 +144,36 @@ static INLINE Bit32u Fetchd() {
 
 #define EALookupTable (core.ea_table)
 
+//--Modified to run one of two copies of the decode loop, each compiled for a fixed default
+//operand and address size: see core_normal/run.h. Each copy hands over to the other when a
+//far jump, call, interrupt or return switches the size of the code segment.
+#define CORE_NORMAL_RUN		CPU_Core_Normal_Run16
+#define CORE_NORMAL_BIG		0
+#include "core_normal/run.h"
+#undef CORE_NORMAL_RUN
+#undef CORE_NORMAL_BIG
+
+#define CORE_NORMAL_RUN		CPU_Core_Normal_Run32
+#define CORE_NORMAL_BIG		1
+#include "core_normal/run.h"
+#undef CORE_NORMAL_RUN
+#undef CORE_NORMAL_BIG
+
 Bits CPU_Core_Normal_Run(void) {
-	while (CPU_Cycles-->0) {
-		LOADIP;
-		core.opcode_index=cpu.code.big*0x200;
-		core.prefixes=cpu.code.big;
-		core.ea_table=&EATable[cpu.code.big*256];
-		BaseDS=SegBase(ds);
-		BaseSS=SegBase(ss);
-		core.base_val_ds=ds;
-#if C_DEBUG
-#if C_HEAVY_DEBUG
-		if (DEBUG_HeavyIsBreakpoint()) {
-			FillFlags();
-			return debugCallback;
-		};
-#endif
-		cycle_count++;
-#endif
-restart_opcode:
-		switch (core.opcode_index+Fetchb()) {
-		#include "core_normal/prefix_none.h"
-		#include "core_normal/prefix_0f.h"
-		#include "core_normal/prefix_66.h"
-		#include "core_normal/prefix_66_0f.h"
-		default:
-		illegal_opcode:
-#if C_DEBUG	
-			{
-				Bitu len=(GETIP-reg_eip);
-				LOADIP;
-				if (len>16) len=16;
-				char tempcode[16*2+1];char * writecode=tempcode;
-				for (;len>0;len--) {
-					sprintf(writecode,"%02X",mem_readb(core.cseip++));
-					writecode+=2;
-				}
-				LOG(LOG_CPU,LOG_NORMAL)("Illegal/Unhandled opcode %s",tempcode);
-			}
-#endif
-			CPU_Exception(6,0);
+	for (;;) {
+		Bits ret;
+		try {
+			ret=cpu.code.big ? CPU_Core_Normal_Run32() : CPU_Core_Normal_Run16();
+		} catch (PagingFault & fault) {
+			// a read page-faulted, and reg_eip still points at the start of the
+			// instruction to restart: see PagingFault in paging.h
+			CPU_Exception(EXCEPTION_PF,fault.faultcode);
 			continue;
 		}
-		SAVEIP;
+		if (ret!=CORE_NORMAL_SIZE_CHANGED) return ret;
 	}
-	FillFlags();
-	return CBRET_NONE;
-decode_end:
-	SAVEIP;
-	FillFlags();
-	return CBRET_NONE;
 }
+//--End of modifications
 
 Bits CPU_Core_Normal_Trap_Run(void) {
 	Bits oldCycles = CPU_Cycles;
@@ -228,7 +228,9 @@
 	CASE_0F_B(0x31)												/* RDTSC */
 		{
 			if (CPU_ArchitectureType<CPU_ARCHTYPE_PENTIUMSLOW) goto illegal_opcode;
-			Bit64s tsc=(Bit64s)(PIC_FullIndex()*(double)CPU_CycleMax);
+			//--Modified to count the cycles in integers rather than via double milliseconds
+			Bit64s tsc=(Bit64s)PIC_Ticks*CPU_CycleMax+PIC_TickIndexND();
+			//--End of modifications
 			reg_edx=(Bit32u)(tsc>>32);
 			reg_eax=(Bit32u)(tsc&0xffffffff);
 		}
@@ -418,8 +420,11 @@
 			GetRMrw;
 			if (rm >= 0xc0) goto illegal_opcode;
 			GetEAa;
+			//--Modified to read the offset before loading the segment, see PagingFault in paging.h
+			Bit16u off=LoadMw(eaa);
 			if (CPU_SetSegGeneral(ss,LoadMw(eaa+2))) RUNEXCEPTION();
-			*rmrw=LoadMw(eaa);
+			*rmrw=off;
+			//--End of modifications
 			break;
 		}
 	CASE_0F_W(0xb3)												/* BTR Ew,Gw */
@@ -443,8 +448,11 @@
 			GetRMrw;
 			if (rm >= 0xc0) goto illegal_opcode;
 			GetEAa;
+			//--Modified to read the offset before loading the segment, see PagingFault in paging.h
+			Bit16u off=LoadMw(eaa);
 			if (CPU_SetSegGeneral(fs,LoadMw(eaa+2))) RUNEXCEPTION();
-			*rmrw=LoadMw(eaa);
+			*rmrw=off;
+			//--End of modifications
 			break;
 		}
 	CASE_0F_W(0xb5)												/* LGS Ew */
@@ -452,8 +460,11 @@
 			GetRMrw;
 			if (rm >= 0xc0) goto illegal_opcode;
 			GetEAa;
+			//--Modified to read the offset before loading the segment, see PagingFault in paging.h
+			Bit16u off=LoadMw(eaa);
 			if (CPU_SetSegGeneral(gs,LoadMw(eaa+2))) RUNEXCEPTION();
-			*rmrw=LoadMw(eaa);
+			*rmrw=off;
+			//--End of modifications
 			break;
 		}
 	CASE_0F_W(0xb6)												/* MOVZX Gw,Eb */
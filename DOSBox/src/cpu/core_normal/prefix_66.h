@@ -351,10 +351,19 @@
 		}
 	CASE_D(0x8f)												/* POP Ed */
 		{
+			//--Modified to put ESP back if fetching the rest of the instruction page-faults,
+			//since the address is worked out after the pop: see PagingFault in paging.h
+			Bit32u old_esp=reg_esp;
 			Bit32u val=Pop_32();
-			GetRM;
-			if (rm >= 0xc0 ) {GetEArd;*eard=val;}
-			else {GetEAa;SaveMd(eaa,val);}
+			try {
+				GetRM;
+				if (rm >= 0xc0 ) {GetEArd;*eard=val;}
+				else {GetEAa;SaveMd(eaa,val);}
+			} catch (PagingFault &) {
+				reg_esp=old_esp;
+				throw;
+			}
+			//--End of modifications
 			break;
 		}
 	CASE_D(0x91)												/* XCHG ECX,EAX */
@@ -465,8 +474,11 @@
 			GetRMrd;
 			if (rm >= 0xc0) goto illegal_opcode;
 			GetEAa;
+			//--Modified to read the offset before loading the segment, see PagingFault in paging.h
+			Bit32u off=LoadMd(eaa);
 			if (CPU_SetSegGeneral(es,LoadMw(eaa+4))) RUNEXCEPTION();
-			*rmrd=LoadMd(eaa);
+			*rmrd=off;
+			//--End of modifications
 			break;
 		}
 	CASE_D(0xc5)												/* LDS */
@@ -474,8 +486,11 @@
 			GetRMrd;
 			if (rm >= 0xc0) goto illegal_opcode;
 			GetEAa;
+			//--Modified to read the offset before loading the segment, see PagingFault in paging.h
+			Bit32u off=LoadMd(eaa);
 			if (CPU_SetSegGeneral(ds,LoadMw(eaa+4))) RUNEXCEPTION();
-			*rmrd=LoadMd(eaa);
+			*rmrd=off;
+			//--End of modifications
 			break;
 		}
 	CASE_D(0xc7)												/* MOV Ed,Id */
@@ -268,8 +268,11 @@
 			GetRMrd;
 			if (rm >= 0xc0) goto illegal_opcode;
 			GetEAa;
+			//--Modified to read the offset before loading the segment, see PagingFault in paging.h
+			Bit32u off=LoadMd(eaa);
 			if (CPU_SetSegGeneral(ss,LoadMw(eaa+4))) RUNEXCEPTION();
-			*rmrd=LoadMd(eaa);
+			*rmrd=off;
+			//--End of modifications
 			break;
 		}
 	CASE_0F_D(0xb3)												/* BTR Ed,Gd */
@@ -293,8 +296,11 @@
 			GetRMrd;
 			if (rm >= 0xc0) goto illegal_opcode;
 			GetEAa;
+			//--Modified to read the offset before loading the segment, see PagingFault in paging.h
+			Bit32u off=LoadMd(eaa);
 			if (CPU_SetSegGeneral(fs,LoadMw(eaa+4))) RUNEXCEPTION();
-			*rmrd=LoadMd(eaa);
+			*rmrd=off;
+			//--End of modifications
 			break;
 		}
 	CASE_0F_D(0xb5)												/* LGS Ed */
@@ -302,8 +308,11 @@
 			GetRMrd;
 			if (rm >= 0xc0) goto illegal_opcode;
 			GetEAa;
+			//--Modified to read the offset before loading the segment, see PagingFault in paging.h
+			Bit32u off=LoadMd(eaa);
 			if (CPU_SetSegGeneral(gs,LoadMw(eaa+4))) RUNEXCEPTION();
-			*rmrd=LoadMd(eaa);
+			*rmrd=off;
+			//--End of modifications
 			break;
 		}
 	CASE_0F_D(0xb6)												/* MOVZX Gd,Eb */
@@ -256,7 +256,7 @@
 	CASE_B(0x65)												/* SEG GS: */
 		DO_PREFIX_SEG(gs);break;
 	CASE_B(0x66)												/* Operand Size Prefix */
-		core.opcode_index=(cpu.code.big^0x1)*0x200;
+		core.opcode_index=(CODE_BIG^0x1)*0x200;
 		goto restart_opcode;
 	CASE_B(0x67)												/* Address Size Prefix */
 		DO_PREFIX_ADDR();
@@ -432,7 +432,7 @@
 			if (rm >= 0xc0 ) {GetEArb;*earb=*rmrb;}
 			else {
 				if (cpu.pmode) {
-					if (GCC_UNLIKELY((rm==0x05) && (!cpu.code.big))) {
+					if (GCC_UNLIKELY((rm==0x05) && (!CODE_BIG))) {
 						Descriptor desc;
 						cpu.gdt.GetDescriptor(SegValue(core.base_val_ds),desc);
 						if ((desc.Type()==DESC_CODE_R_NC_A) || (desc.Type()==DESC_CODE_R_NC_NA)) {
@@ -523,10 +523,19 @@
 		}							
 	CASE_W(0x8f)												/* POP Ew */
 		{
+			//--Modified to put ESP back if fetching the rest of the instruction page-faults,
+			//since the address is worked out after the pop: see PagingFault in paging.h
+			Bit32u old_esp=reg_esp;
 			Bit16u val=Pop_16();
-			GetRM;
-			if (rm >= 0xc0 ) {GetEArw;*earw=val;}
-			else {GetEAa;SaveMw(eaa,val);}
+			try {
+				GetRM;
+				if (rm >= 0xc0 ) {GetEArw;*earw=val;}
+				else {GetEAa;SaveMw(eaa,val);}
+			} catch (PagingFault &) {
+				reg_esp=old_esp;
+				throw;
+			}
+			//--End of modifications
 			break;
 		}
 	CASE_B(0x90)												/* NOP */
@@ -690,8 +699,11 @@
 			GetRMrw;
 			if (rm >= 0xc0) goto illegal_opcode;
 			GetEAa;
+			//--Modified to read the offset before loading the segment, see PagingFault in paging.h
+			Bit16u off=LoadMw(eaa);
 			if (CPU_SetSegGeneral(es,LoadMw(eaa+2))) RUNEXCEPTION();
-			*rmrw=LoadMw(eaa);
+			*rmrw=off;
+			//--End of modifications
 			break;
 		}
 	CASE_W(0xc5)												/* LDS */
@@ -699,8 +711,11 @@
 			GetRMrw;
 			if (rm >= 0xc0) goto illegal_opcode;
 			GetEAa;
+			//--Modified to read the offset before loading the segment, see PagingFault in paging.h
+			Bit16u off=LoadMw(eaa);
 			if (CPU_SetSegGeneral(ds,LoadMw(eaa+2))) RUNEXCEPTION();
-			*rmrw=LoadMw(eaa);
+			*rmrw=off;
+			//--End of modifications
 			break;
 		}
 	CASE_B(0xc6)												/* MOV Eb,Ib */
@@ -0,0 +1,79 @@
+/*
+ *  Copyright (C) 2002-2010  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+//--Added for core_normal.cpp, which includes this once for each default code size.
+//CORE_NORMAL_RUN names the decode loop and CORE_NORMAL_BIG is the code size it is compiled for.
+//The loop returns CORE_NORMAL_SIZE_CHANGED, without executing anything further, as soon as
+//the code segment's size no longer matches: CPU_Core_Normal_Run then runs the other loop.
+
+static Bits CORE_NORMAL_RUN(void) {
+	while (CPU_Cycles-->0) {
+		if (GCC_UNLIKELY(cpu.code.big!=CORE_NORMAL_BIG)) {
+			CPU_Cycles++;
+			return CORE_NORMAL_SIZE_CHANGED;
+		}
+		LOADIP;
+		core.opcode_index=CORE_NORMAL_BIG*0x200;
+		core.prefixes=CORE_NORMAL_BIG;
+		core.ea_table=&EATable[CORE_NORMAL_BIG*256];
+		BaseDS=SegBase(ds);
+		BaseSS=SegBase(ss);
+		core.base_val_ds=ds;
+#if C_DEBUG
+#if C_HEAVY_DEBUG
+		if (DEBUG_HeavyIsBreakpoint()) {
+			FillFlags();
+			return debugCallback;
+		};
+#endif
+		cycle_count++;
+#endif
+restart_opcode:
+		switch (core.opcode_index+Fetchb()) {
+		#include "prefix_none.h"
+		#include "prefix_0f.h"
+		#include "prefix_66.h"
+		#include "prefix_66_0f.h"
+		default:
+		illegal_opcode:
+#if C_DEBUG	
+			{
+				Bitu len=(GETIP-reg_eip);
+				LOADIP;
+				if (len>16) len=16;
+				char tempcode[16*2+1];char * writecode=tempcode;
+				for (;len>0;len--) {
+					sprintf(writecode,"%02X",mem_readb(core.cseip++));
+					writecode+=2;
+				}
+				LOG(LOG_CPU,LOG_NORMAL)("Illegal/Unhandled opcode %s",tempcode);
+			}
+#endif
+			CPU_Exception(6,0);
+			continue;
+		}
+		SAVEIP;
+	}
+	FillFlags();
+	return CBRET_NONE;
+decode_end:
+	SAVEIP;
+	FillFlags();
+	return CBRET_NONE;
+}
+//--End of modifications
@@ -41,6 +41,10 @@ static void DoString(STRING_OP type) {
 		}
 	}
 	add_index=cpu.direction;
+	//--Added so that a page fault partway through leaves the registers at the element that
+	//faulted, for the instruction to carry on from there: see PagingFault in paging.h
+	try {
+	//--End of modifications
 	if (count) switch (type) {
 	case R_OUTSB:
 		for (;count>0;count--) {
@@ -76,6 +80,9 @@ static void DoString(STRING_OP type) {
 		}
 		break;
 	case R_STOSB:
+		//--Added to fill runs of plain RAM a page at a time
+		if (count>1) count=MEM_StosFast(di_base,&di_index,add_mask,add_index,count,reg_al);
+		//--End of modifications
 		for (;count>0;count--) {
 			SaveMb(di_base+di_index,reg_al);
 			di_index=(di_index+add_index) & add_mask;
@@ -83,6 +90,9 @@ static void DoString(STRING_OP type) {
 		break;
 	case R_STOSW:
 		add_index<<=1;
+		//--Added to fill runs of plain RAM a page at a time
+		if (count>1) count=MEM_StosFast(di_base,&di_index,add_mask,add_index,count,reg_ax);
+		//--End of modifications
 		for (;count>0;count--) {
 			SaveMw(di_base+di_index,reg_ax);
 			di_index=(di_index+add_index) & add_mask;
@@ -90,12 +100,18 @@ static void DoString(STRING_OP type) {
 		break;
 	case R_STOSD:
 		add_index<<=2;
+		//--Added to fill runs of plain RAM a page at a time
+		if (count>1) count=MEM_StosFast(di_base,&di_index,add_mask,add_index,count,reg_eax);
+		//--End of modifications
 		for (;count>0;count--) {
 			SaveMd(di_base+di_index,reg_eax);
 			di_index=(di_index+add_index) & add_mask;
 		}
 		break;
 	case R_MOVSB:
+		//--Added to copy runs of plain RAM a page at a time
+		if (count>1) count=MEM_MovsFast(si_base,&si_index,di_base,&di_index,add_mask,add_index,count);
+		//--End of modifications
 		for (;count>0;count--) {
 			SaveMb(di_base+di_index,LoadMb(si_base+si_index));
 			di_index=(di_index+add_index) & add_mask;
@@ -104,6 +120,9 @@ static void DoString(STRING_OP type) {
 		break;
 	case R_MOVSW:
 		add_index<<=1;
+		//--Added to copy runs of plain RAM a page at a time
+		if (count>1) count=MEM_MovsFast(si_base,&si_index,di_base,&di_index,add_mask,add_index,count);
+		//--End of modifications
 		for (;count>0;count--) {
 			SaveMw(di_base+di_index,LoadMw(si_base+si_index));
 			di_index=(di_index+add_index) & add_mask;
@@ -112,6 +131,9 @@ static void DoString(STRING_OP type) {
 		break;
 	case R_MOVSD:
 		add_index<<=2;
+		//--Added to copy runs of plain RAM a page at a time
+		if (count>1) count=MEM_MovsFast(si_base,&si_index,di_base,&di_index,add_mask,add_index,count);
+		//--End of modifications
 		for (;count>0;count--) {
 			SaveMd(di_base+di_index,LoadMd(si_base+si_index));
 			di_index=(di_index+add_index) & add_mask;
@@ -119,6 +141,13 @@ static void DoString(STRING_OP type) {
 		}
 		break;
 	case R_LODSB:
+		//--Added to skip through runs of plain RAM a page at a time
+		if (count>1) {
+			Bit32u val=reg_al;
+			count=MEM_LodsFast(si_base,&si_index,add_mask,add_index,count,&val);
+			reg_al=(Bit8u)val;
+		}
+		//--End of modifications
 		for (;count>0;count--) {
 			reg_al=LoadMb(si_base+si_index);
 			si_index=(si_index+add_index) & add_mask;
@@ -126,6 +155,13 @@ static void DoString(STRING_OP type) {
 		break;
 	case R_LODSW:
 		add_index<<=1;
+		//--Added to skip through runs of plain RAM a page at a time
+		if (count>1) {
+			Bit32u val=reg_ax;
+			count=MEM_LodsFast(si_base,&si_index,add_mask,add_index,count,&val);
+			reg_ax=(Bit16u)val;
+		}
+		//--End of modifications
 		for (;count>0;count--) {
 			reg_ax=LoadMw(si_base+si_index);
 			si_index=(si_index+add_index) & add_mask;
@@ -133,6 +169,13 @@ static void DoString(STRING_OP type) {
 		break;
 	case R_LODSD:
 		add_index<<=2;
+		//--Added to skip through runs of plain RAM a page at a time
+		if (count>1) {
+			Bit32u val=reg_eax;
+			count=MEM_LodsFast(si_base,&si_index,add_mask,add_index,count,&val);
+			reg_eax=(Bit32u)val;
+		}
+		//--End of modifications
 		for (;count>0;count--) {
 			reg_eax=LoadMd(si_base+si_index);
 			si_index=(si_index+add_index) & add_mask;
@@ -219,6 +262,22 @@ static void DoString(STRING_OP type) {
 	default:
 		LOG(LOG_CPU,LOG_ERROR)("Unhandled string op %d",type);
 	}
+	//--Added
+	} catch (PagingFault &) {
+		/* SCAS and CMPS count off each element before reading it */
+		if (type>=R_SCASB) count++;
+		reg_esi&=(~add_mask);
+		reg_esi|=(si_index & add_mask);
+		reg_edi&=(~add_mask);
+		reg_edi|=(di_index & add_mask);
+		if (TEST_PREFIX_REP) {
+			count+=count_left;
+			reg_ecx&=(~add_mask);
+			reg_ecx|=(count & add_mask);
+		}
+		throw;
+	}
+	//--End of modifications
 	/* Clean up after certain amount of instructions */
 	reg_esi&=(~add_mask);
 	reg_esi|=(si_index & add_mask);
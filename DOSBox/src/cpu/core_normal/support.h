@@ -16,6 +16,11 @@
  *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
  */
 
+//--Added for cores that compile their decode loop for a fixed code size: see core_normal.cpp
+#ifndef CODE_BIG
+#define CODE_BIG cpu.code.big
+#endif
+//--End of modifications
 
 #define LoadMbs(off) (Bit8s)(LoadMb(off))
 #define LoadMws(off) (Bit16s)(LoadMw(off))
@@ -53,33 +58,36 @@ static INLINE Bit32s Fetchds() {
 	}
 
 //TODO Could probably make all byte operands fast?
+//--Modified to fetch the displacement before anything else, so that a page fault while
+//fetching it leaves EIP, and the count register of LOOP, as they were: see paging.h
 #define JumpCond16_b(COND) {						\
+	Bit8s disp=Fetchbs();							\
 	SAVEIP;											\
-	if (COND) reg_ip+=Fetchbs();					\
-	reg_ip+=1;										\
+	if (COND) reg_ip+=disp;							\
 	continue;										\
 }
 
 #define JumpCond16_w(COND) {						\
+	Bit16s disp=Fetchws();							\
 	SAVEIP;											\
-	if (COND) reg_ip+=Fetchws();					\
-	reg_ip+=2;										\
+	if (COND) reg_ip+=disp;							\
 	continue;										\
 }
 
 #define JumpCond32_b(COND) {						\
+	Bit8s disp=Fetchbs();							\
 	SAVEIP;											\
-	if (COND) reg_eip+=Fetchbs();					\
-	reg_eip+=1;										\
+	if (COND) reg_eip+=disp;						\
 	continue;										\
 }
 
 #define JumpCond32_d(COND) {						\
+	Bit32s disp=Fetchds();							\
 	SAVEIP;											\
-	if (COND) reg_eip+=Fetchds();					\
-	reg_eip+=4;										\
+	if (COND) reg_eip+=disp;						\
 	continue;										\
 }
+//--End of modifications
 
 
 #define SETcc(cc)											\
@@ -207,6 +207,12 @@ static Bit32u Fetchd() {
 
 #define EALookupTable (core.ea_table)
 
+//--Added so that a loaded save state doesn't execute stale prefetched bytes
+void CPU_Core_Prefetch_Invalidate(void) {
+	pq_valid=false;
+}
+//--End of modifications
+
 Bits CPU_Core_Prefetch_Run(void) {
 	bool invalidate_pq=false;
 	while (CPU_Cycles-->0) {
@@ -0,0 +1,302 @@
+/*
+ *  Copyright (C) 2002-2010  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+//--Added to provide a variant of the normal core that dispatches through a table of label
+//addresses (GCC and Clang's labels-as-values extension) instead of a switch statement.
+//It shares core_normal's opcode headers, redefining their CASE_* macros to also emit a label
+//for each opcode: see core_threaded/dispatch.h for the table of those labels.
+//Jumping straight to the label skips the switch's bounds check and table lookup, and because
+//the dispatch that follows each instruction is a small block ending in an indirect jump, the
+//compiler can duplicate it into every opcode handler so that each one branches directly to
+//the next. This gives the host's branch predictor one prediction site per opcode instead of a
+//single shared one, which is most of the benefit on hosts without a dynamic core.
+//Instruction bytes are also fetched through a window onto the current code page: its host
+//address is looked up once per instruction, instead of going through the TLB for every byte.
+//The window reads guest memory directly, so it stays coherent with self-modifying code.
+
+#include <stdio.h>
+
+#include "dosbox.h"
+#include "mem.h"
+#include "cpu.h"
+#include "lazyflags.h"
+#include "inout.h"
+#include "callback.h"
+#include "pic.h"
+#include "fpu.h"
+#include "paging.h"
+
+#if C_DEBUG
+#include "debug.h"
+#endif
+
+#if defined(__GNUC__)
+
+#if (!C_CORE_INLINE)
+#define LoadMb(off) mem_readb(off)
+#define LoadMw(off) mem_readw(off)
+#define LoadMd(off) mem_readd(off)
+#define SaveMb(off,val)	mem_writeb(off,val)
+#define SaveMw(off,val)	mem_writew(off,val)
+#define SaveMd(off,val)	mem_writed(off,val)
+#else 
+/* Reads that page-fault unwind back to CPU_Core_Threaded_Run: see PagingFault in paging.h */
+#define LoadMb(off) mem_readb_restartable(off)
+#define LoadMw(off) mem_readw_restartable(off)
+#define LoadMd(off) mem_readd_restartable(off)
+#define SaveMb(off,val)	mem_writeb_inline(off,val)
+#define SaveMw(off,val)	mem_writew_inline(off,val)
+#define SaveMd(off,val)	mem_writed_inline(off,val)
+#endif
+
+extern Bitu cycle_count;
+
+#if C_FPU
+#define CPU_FPU	1						//Enable FPU escape instructions
+#endif
+
+#define CPU_PIC_CHECK 1
+#define CPU_TRAP_CHECK 1
+
+#define OPCODE_NONE			0x000
+#define OPCODE_0F			0x100
+#define OPCODE_SIZE			0x200
+
+#define PREFIX_ADDR			0x1
+#define PREFIX_REP			0x2
+
+#define TEST_PREFIX_ADDR	(core.prefixes & PREFIX_ADDR)
+#define TEST_PREFIX_REP		(core.prefixes & PREFIX_REP)
+
+#define DO_PREFIX_SEG(_SEG)					\
+	BaseDS=SegBase(_SEG);					\
+	BaseSS=SegBase(_SEG);					\
+	core.base_val_ds=_SEG;					\
+	goto restart_opcode;
+
+#define DO_PREFIX_ADDR()								\
+	core.prefixes=(core.prefixes & ~PREFIX_ADDR) |		\
+	(cpu.code.big ^ PREFIX_ADDR);						\
+	core.ea_table=&EATable[(core.prefixes&1) * 256];	\
+	goto restart_opcode;
+
+#define DO_PREFIX_REP(_ZERO)				\
+	core.prefixes|=PREFIX_REP;				\
+	core.rep_zero=_ZERO;					\
+	goto restart_opcode;
+
+typedef PhysPt (*GetEAHandler)(void);
+
+static const Bit32u AddrMaskTable[2]={0x0000ffff,0xffffffff};
+
+static struct {
+	Bitu opcode_index;
+	PhysPt cseip;
+	PhysPt base_ds,base_ss;
+	SegNames base_val_ds;
+	bool rep_zero;
+	Bitu prefixes;
+	GetEAHandler * ea_table;
+	PhysPt fetch_page;		/* the code page the fetch window covers */
+	HostPt fetch_host;		/* its host address as looked up in the TLB, or 0 if it isn't plain memory */
+} core;
+
+#define GETIP		(core.cseip-SegBase(cs))
+#define SAVEIP		reg_eip=GETIP;
+#define LOADIP		core.cseip=(SegBase(cs)+reg_eip);
+
+#define SegBase(c)	SegPhys(c)
+#define BaseDS		core.base_ds
+#define BaseSS		core.base_ss
+
+static INLINE void LoadFetchWindow() {
+	core.fetch_page=core.cseip&~0xfff;
+	core.fetch_host=get_tlb_read(core.cseip);
+}
+
+/* Whether the next len bytes can be read through the fetch window */
+#define IN_FETCH_WINDOW(len) (core.fetch_host && (core.cseip-core.fetch_page)<=(0x1000-len))
+
+static INLINE Bit8u Fetchb() {
+	Bit8u temp;
+	if (GCC_LIKELY(IN_FETCH_WINDOW(1))) temp=host_readb(core.fetch_host+core.cseip);
+	else temp=LoadMb(core.cseip);
+	core.cseip+=1;
+	return temp;
+}
+
+static INLINE Bit16u Fetchw() {
+	Bit16u temp;
+	if (GCC_LIKELY(IN_FETCH_WINDOW(2))) temp=host_readw(core.fetch_host+core.cseip);
+	else temp=LoadMw(core.cseip);
+	core.cseip+=2;
+	return temp;
+}
+static INLINE Bit32u Fetchd() {
+	Bit32u temp;
+	if (GCC_LIKELY(IN_FETCH_WINDOW(4))) temp=host_readd(core.fetch_host+core.cseip);
+	else temp=LoadMd(core.cseip);
+	core.cseip+=4;
+	return temp;
+}
+
+#define Push_16 CPU_Push16
+#define Push_32 CPU_Push32
+#define Pop_16 CPU_Pop16
+#define Pop_32 CPU_Pop32
+
+#include "instructions.h"
+#include "core_normal/support.h"
+#include "core_normal/string.h"
+
+/* Give every opcode a label as well as a case, for the dispatch table to point at */
+#undef CASE_W
+#undef CASE_D
+#undef CASE_0F_W
+#undef CASE_0F_D
+
+#define CASE_W(_WHICH)							\
+	case (OPCODE_NONE+_WHICH): op_w_ ## _WHICH:
+
+#define CASE_D(_WHICH)							\
+	case (OPCODE_SIZE+_WHICH): op_d_ ## _WHICH:
+
+#define CASE_0F_W(_WHICH)						\
+	case ((OPCODE_0F|OPCODE_NONE)+_WHICH): op_0f_w_ ## _WHICH:
+
+#define CASE_0F_D(_WHICH)						\
+	case ((OPCODE_0F|OPCODE_SIZE)+_WHICH): op_0f_d_ ## _WHICH:
+
+/* Stay in this core when the opcode headers single-step for the trap flag */
+#define CPU_Core_Normal_Trap_Run CPU_Core_Threaded_Trap_Run
+
+#define EALookupTable (core.ea_table)
+
+static Bits CPU_Core_Threaded_Decode(void) {
+	#include "core_threaded/dispatch.h"
+
+	while (CPU_Cycles-->0) {
+		LOADIP;
+		LoadFetchWindow();
+		core.opcode_index=cpu.code.big*0x200;
+		core.prefixes=cpu.code.big;
+		core.ea_table=&EATable[cpu.code.big*256];
+		BaseDS=SegBase(ds);
+		BaseSS=SegBase(ss);
+		core.base_val_ds=ds;
+#if C_DEBUG
+#if C_HEAVY_DEBUG
+		if (DEBUG_HeavyIsBreakpoint()) {
+			FillFlags();
+			return debugCallback;
+		};
+#endif
+		cycle_count++;
+#endif
+restart_opcode:
+		goto *opcode_table[core.opcode_index+Fetchb()];
+		/* Only ever entered through the labels above: the switch is kept so that
+		   the opcode headers can still break out of their cases */
+		switch (core.opcode_index) {
+		#include "core_normal/prefix_none.h"
+		#include "core_normal/prefix_0f.h"
+		#include "core_normal/prefix_66.h"
+		#include "core_normal/prefix_66_0f.h"
+		default:
+		illegal_opcode:
+#if C_DEBUG	
+			{
+				Bitu len=(GETIP-reg_eip);
+				LOADIP;
+				if (len>16) len=16;
+				char tempcode[16*2+1];char * writecode=tempcode;
+				for (;len>0;len--) {
+					sprintf(writecode,"%02X",mem_readb(core.cseip++));
+					writecode+=2;
+				}
+				LOG(LOG_CPU,LOG_NORMAL)("Illegal/Unhandled opcode %s",tempcode);
+			}
+#endif
+			CPU_Exception(6,0);
+			continue;
+		}
+		SAVEIP;
+	}
+	FillFlags();
+	return CBRET_NONE;
+decode_end:
+	SAVEIP;
+	FillFlags();
+	return CBRET_NONE;
+}
+
+#undef CPU_Core_Normal_Trap_Run
+
+/* The decode loop is kept apart from the try block, so that its computed gotos
+   never have to jump into or out of one */
+Bits CPU_Core_Threaded_Run(void) {
+	for (;;) {
+		try {
+			return CPU_Core_Threaded_Decode();
+		} catch (PagingFault & fault) {
+			// a read page-faulted, and reg_eip still points at the start of the
+			// instruction to restart
+			CPU_Exception(EXCEPTION_PF,fault.faultcode);
+		}
+	}
+}
+
+Bits CPU_Core_Threaded_Trap_Run(void) {
+	Bits oldCycles = CPU_Cycles;
+	CPU_Cycles = 1;
+	cpu.trap_skip = false;
+
+	Bits ret=CPU_Core_Threaded_Run();
+	if (!cpu.trap_skip) CPU_HW_Interrupt(1);
+	CPU_Cycles = oldCycles-1;
+	cpudecoder = &CPU_Core_Threaded_Run;
+
+	return ret;
+}
+
+#else
+
+/* Without labels-as-values, fall back on the normal core */
+Bits CPU_Core_Threaded_Run(void) {
+	return CPU_Core_Normal_Run();
+}
+
+Bits CPU_Core_Threaded_Trap_Run(void) {
+	return CPU_Core_Normal_Trap_Run();
+}
+
+#endif
+
+#if defined(__GNUC__)
+void CPU_Core_Threaded_FlushFetch(void) {
+	core.fetch_host=0;
+}
+#else
+void CPU_Core_Threaded_FlushFetch(void) {
+}
+#endif
+
+void CPU_Core_Threaded_Init(void) {
+
+}
+//--End of modifications
@@ -0,0 +1,286 @@
+/*
+ *  Copyright (C) 2002-2010  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+//--Added for the threaded core: see core_threaded.cpp.
+//One entry for each value of core.opcode_index+opcode, pointing at the label that the CASE_*
+//macros in core_threaded.cpp generate for that opcode, or at illegal_opcode for opcodes the
+//shared core_normal opcode headers don't implement. This must list exactly the opcodes those
+//headers implement, so it needs updating whenever a CASE_* is added to or removed from them.
+
+static const void * const opcode_table[0x400]={
+	/* 16-bit */
+	&&op_w_0x00,&&op_w_0x01,&&op_w_0x02,&&op_w_0x03,
+	&&op_w_0x04,&&op_w_0x05,&&op_w_0x06,&&op_w_0x07,
+	&&op_w_0x08,&&op_w_0x09,&&op_w_0x0a,&&op_w_0x0b,
+	&&op_w_0x0c,&&op_w_0x0d,&&op_w_0x0e,&&op_w_0x0f,
+	&&op_w_0x10,&&op_w_0x11,&&op_w_0x12,&&op_w_0x13,
+	&&op_w_0x14,&&op_w_0x15,&&op_w_0x16,&&op_w_0x17,
+	&&op_w_0x18,&&op_w_0x19,&&op_w_0x1a,&&op_w_0x1b,
+	&&op_w_0x1c,&&op_w_0x1d,&&op_w_0x1e,&&op_w_0x1f,
+	&&op_w_0x20,&&op_w_0x21,&&op_w_0x22,&&op_w_0x23,
+	&&op_w_0x24,&&op_w_0x25,&&op_w_0x26,&&op_w_0x27,
+	&&op_w_0x28,&&op_w_0x29,&&op_w_0x2a,&&op_w_0x2b,
+	&&op_w_0x2c,&&op_w_0x2d,&&op_w_0x2e,&&op_w_0x2f,
+	&&op_w_0x30,&&op_w_0x31,&&op_w_0x32,&&op_w_0x33,
+	&&op_w_0x34,&&op_w_0x35,&&op_w_0x36,&&op_w_0x37,
+	&&op_w_0x38,&&op_w_0x39,&&op_w_0x3a,&&op_w_0x3b,
+	&&op_w_0x3c,&&op_w_0x3d,&&op_w_0x3e,&&op_w_0x3f,
+	&&op_w_0x40,&&op_w_0x41,&&op_w_0x42,&&op_w_0x43,
+	&&op_w_0x44,&&op_w_0x45,&&op_w_0x46,&&op_w_0x47,
+	&&op_w_0x48,&&op_w_0x49,&&op_w_0x4a,&&op_w_0x4b,
+	&&op_w_0x4c,&&op_w_0x4d,&&op_w_0x4e,&&op_w_0x4f,
+	&&op_w_0x50,&&op_w_0x51,&&op_w_0x52,&&op_w_0x53,
+	&&op_w_0x54,&&op_w_0x55,&&op_w_0x56,&&op_w_0x57,
+	&&op_w_0x58,&&op_w_0x59,&&op_w_0x5a,&&op_w_0x5b,
+	&&op_w_0x5c,&&op_w_0x5d,&&op_w_0x5e,&&op_w_0x5f,
+	&&op_w_0x60,&&op_w_0x61,&&op_w_0x62,&&op_w_0x63,
+	&&op_w_0x64,&&op_w_0x65,&&op_w_0x66,&&op_w_0x67,
+	&&op_w_0x68,&&op_w_0x69,&&op_w_0x6a,&&op_w_0x6b,
+	&&op_w_0x6c,&&op_w_0x6d,&&op_w_0x6e,&&op_w_0x6f,
+	&&op_w_0x70,&&op_w_0x71,&&op_w_0x72,&&op_w_0x73,
+	&&op_w_0x74,&&op_w_0x75,&&op_w_0x76,&&op_w_0x77,
+	&&op_w_0x78,&&op_w_0x79,&&op_w_0x7a,&&op_w_0x7b,
+	&&op_w_0x7c,&&op_w_0x7d,&&op_w_0x7e,&&op_w_0x7f,
+	&&op_w_0x80,&&op_w_0x81,&&op_w_0x82,&&op_w_0x83,
+	&&op_w_0x84,&&op_w_0x85,&&op_w_0x86,&&op_w_0x87,
+	&&op_w_0x88,&&op_w_0x89,&&op_w_0x8a,&&op_w_0x8b,
+	&&op_w_0x8c,&&op_w_0x8d,&&op_w_0x8e,&&op_w_0x8f,
+	&&op_w_0x90,&&op_w_0x91,&&op_w_0x92,&&op_w_0x93,
+	&&op_w_0x94,&&op_w_0x95,&&op_w_0x96,&&op_w_0x97,
+	&&op_w_0x98,&&op_w_0x99,&&op_w_0x9a,&&op_w_0x9b,
+	&&op_w_0x9c,&&op_w_0x9d,&&op_w_0x9e,&&op_w_0x9f,
+	&&op_w_0xa0,&&op_w_0xa1,&&op_w_0xa2,&&op_w_0xa3,
+	&&op_w_0xa4,&&op_w_0xa5,&&op_w_0xa6,&&op_w_0xa7,
+	&&op_w_0xa8,&&op_w_0xa9,&&op_w_0xaa,&&op_w_0xab,
+	&&op_w_0xac,&&op_w_0xad,&&op_w_0xae,&&op_w_0xaf,
+	&&op_w_0xb0,&&op_w_0xb1,&&op_w_0xb2,&&op_w_0xb3,
+	&&op_w_0xb4,&&op_w_0xb5,&&op_w_0xb6,&&op_w_0xb7,
+	&&op_w_0xb8,&&op_w_0xb9,&&op_w_0xba,&&op_w_0xbb,
+	&&op_w_0xbc,&&op_w_0xbd,&&op_w_0xbe,&&op_w_0xbf,
+	&&op_w_0xc0,&&op_w_0xc1,&&op_w_0xc2,&&op_w_0xc3,
+	&&op_w_0xc4,&&op_w_0xc5,&&op_w_0xc6,&&op_w_0xc7,
+	&&op_w_0xc8,&&op_w_0xc9,&&op_w_0xca,&&op_w_0xcb,
+	&&op_w_0xcc,&&op_w_0xcd,&&op_w_0xce,&&op_w_0xcf,
+	&&op_w_0xd0,&&op_w_0xd1,&&op_w_0xd2,&&op_w_0xd3,
+	&&op_w_0xd4,&&op_w_0xd5,&&op_w_0xd6,&&op_w_0xd7,
+	&&op_w_0xd8,&&op_w_0xd9,&&op_w_0xda,&&op_w_0xdb,
+	&&op_w_0xdc,&&op_w_0xdd,&&op_w_0xde,&&op_w_0xdf,
+	&&op_w_0xe0,&&op_w_0xe1,&&op_w_0xe2,&&op_w_0xe3,
+	&&op_w_0xe4,&&op_w_0xe5,&&op_w_0xe6,&&op_w_0xe7,
+	&&op_w_0xe8,&&op_w_0xe9,&&op_w_0xea,&&op_w_0xeb,
+	&&op_w_0xec,&&op_w_0xed,&&op_w_0xee,&&op_w_0xef,
+	&&op_w_0xf0,&&op_w_0xf1,&&op_w_0xf2,&&op_w_0xf3,
+	&&op_w_0xf4,&&op_w_0xf5,&&op_w_0xf6,&&op_w_0xf7,
+	&&op_w_0xf8,&&op_w_0xf9,&&op_w_0xfa,&&op_w_0xfb,
+	&&op_w_0xfc,&&op_w_0xfd,&&op_w_0xfe,&&op_w_0xff,
+	/* 16-bit 0x0f */
+	&&op_0f_w_0x00,&&op_0f_w_0x01,&&op_0f_w_0x02,&&op_0f_w_0x03,
+	&&illegal_opcode,&&illegal_opcode,&&op_0f_w_0x06,&&illegal_opcode,
+	&&op_0f_w_0x08,&&op_0f_w_0x09,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&op_0f_w_0x20,&&op_0f_w_0x21,&&op_0f_w_0x22,&&op_0f_w_0x23,
+	&&op_0f_w_0x24,&&illegal_opcode,&&op_0f_w_0x26,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&op_0f_w_0x31,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&op_0f_w_0x80,&&op_0f_w_0x81,&&op_0f_w_0x82,&&op_0f_w_0x83,
+	&&op_0f_w_0x84,&&op_0f_w_0x85,&&op_0f_w_0x86,&&op_0f_w_0x87,
+	&&op_0f_w_0x88,&&op_0f_w_0x89,&&op_0f_w_0x8a,&&op_0f_w_0x8b,
+	&&op_0f_w_0x8c,&&op_0f_w_0x8d,&&op_0f_w_0x8e,&&op_0f_w_0x8f,
+	&&op_0f_w_0x90,&&op_0f_w_0x91,&&op_0f_w_0x92,&&op_0f_w_0x93,
+	&&op_0f_w_0x94,&&op_0f_w_0x95,&&op_0f_w_0x96,&&op_0f_w_0x97,
+	&&op_0f_w_0x98,&&op_0f_w_0x99,&&op_0f_w_0x9a,&&op_0f_w_0x9b,
+	&&op_0f_w_0x9c,&&op_0f_w_0x9d,&&op_0f_w_0x9e,&&op_0f_w_0x9f,
+	&&op_0f_w_0xa0,&&op_0f_w_0xa1,&&op_0f_w_0xa2,&&op_0f_w_0xa3,
+	&&op_0f_w_0xa4,&&op_0f_w_0xa5,&&illegal_opcode,&&illegal_opcode,
+	&&op_0f_w_0xa8,&&op_0f_w_0xa9,&&illegal_opcode,&&op_0f_w_0xab,
+	&&op_0f_w_0xac,&&op_0f_w_0xad,&&illegal_opcode,&&op_0f_w_0xaf,
+	&&op_0f_w_0xb0,&&op_0f_w_0xb1,&&op_0f_w_0xb2,&&op_0f_w_0xb3,
+	&&op_0f_w_0xb4,&&op_0f_w_0xb5,&&op_0f_w_0xb6,&&op_0f_w_0xb7,
+	&&illegal_opcode,&&illegal_opcode,&&op_0f_w_0xba,&&op_0f_w_0xbb,
+	&&op_0f_w_0xbc,&&op_0f_w_0xbd,&&op_0f_w_0xbe,&&op_0f_w_0xbf,
+	&&op_0f_w_0xc0,&&op_0f_w_0xc1,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&op_0f_w_0xc8,&&op_0f_w_0xc9,&&op_0f_w_0xca,&&op_0f_w_0xcb,
+	&&op_0f_w_0xcc,&&op_0f_w_0xcd,&&op_0f_w_0xce,&&op_0f_w_0xcf,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	/* 32-bit */
+	&&op_d_0x00,&&op_d_0x01,&&op_d_0x02,&&op_d_0x03,
+	&&op_d_0x04,&&op_d_0x05,&&op_d_0x06,&&op_d_0x07,
+	&&op_d_0x08,&&op_d_0x09,&&op_d_0x0a,&&op_d_0x0b,
+	&&op_d_0x0c,&&op_d_0x0d,&&op_d_0x0e,&&op_d_0x0f,
+	&&op_d_0x10,&&op_d_0x11,&&op_d_0x12,&&op_d_0x13,
+	&&op_d_0x14,&&op_d_0x15,&&op_d_0x16,&&op_d_0x17,
+	&&op_d_0x18,&&op_d_0x19,&&op_d_0x1a,&&op_d_0x1b,
+	&&op_d_0x1c,&&op_d_0x1d,&&op_d_0x1e,&&op_d_0x1f,
+	&&op_d_0x20,&&op_d_0x21,&&op_d_0x22,&&op_d_0x23,
+	&&op_d_0x24,&&op_d_0x25,&&op_d_0x26,&&op_d_0x27,
+	&&op_d_0x28,&&op_d_0x29,&&op_d_0x2a,&&op_d_0x2b,
+	&&op_d_0x2c,&&op_d_0x2d,&&op_d_0x2e,&&op_d_0x2f,
+	&&op_d_0x30,&&op_d_0x31,&&op_d_0x32,&&op_d_0x33,
+	&&op_d_0x34,&&op_d_0x35,&&op_d_0x36,&&op_d_0x37,
+	&&op_d_0x38,&&op_d_0x39,&&op_d_0x3a,&&op_d_0x3b,
+	&&op_d_0x3c,&&op_d_0x3d,&&op_d_0x3e,&&op_d_0x3f,
+	&&op_d_0x40,&&op_d_0x41,&&op_d_0x42,&&op_d_0x43,
+	&&op_d_0x44,&&op_d_0x45,&&op_d_0x46,&&op_d_0x47,
+	&&op_d_0x48,&&op_d_0x49,&&op_d_0x4a,&&op_d_0x4b,
+	&&op_d_0x4c,&&op_d_0x4d,&&op_d_0x4e,&&op_d_0x4f,
+	&&op_d_0x50,&&op_d_0x51,&&op_d_0x52,&&op_d_0x53,
+	&&op_d_0x54,&&op_d_0x55,&&op_d_0x56,&&op_d_0x57,
+	&&op_d_0x58,&&op_d_0x59,&&op_d_0x5a,&&op_d_0x5b,
+	&&op_d_0x5c,&&op_d_0x5d,&&op_d_0x5e,&&op_d_0x5f,
+	&&op_d_0x60,&&op_d_0x61,&&op_d_0x62,&&op_d_0x63,
+	&&op_d_0x64,&&op_d_0x65,&&op_d_0x66,&&op_d_0x67,
+	&&op_d_0x68,&&op_d_0x69,&&op_d_0x6a,&&op_d_0x6b,
+	&&op_d_0x6c,&&op_d_0x6d,&&op_d_0x6e,&&op_d_0x6f,
+	&&op_d_0x70,&&op_d_0x71,&&op_d_0x72,&&op_d_0x73,
+	&&op_d_0x74,&&op_d_0x75,&&op_d_0x76,&&op_d_0x77,
+	&&op_d_0x78,&&op_d_0x79,&&op_d_0x7a,&&op_d_0x7b,
+	&&op_d_0x7c,&&op_d_0x7d,&&op_d_0x7e,&&op_d_0x7f,
+	&&op_d_0x80,&&op_d_0x81,&&op_d_0x82,&&op_d_0x83,
+	&&op_d_0x84,&&op_d_0x85,&&op_d_0x86,&&op_d_0x87,
+	&&op_d_0x88,&&op_d_0x89,&&op_d_0x8a,&&op_d_0x8b,
+	&&op_d_0x8c,&&op_d_0x8d,&&op_d_0x8e,&&op_d_0x8f,
+	&&op_d_0x90,&&op_d_0x91,&&op_d_0x92,&&op_d_0x93,
+	&&op_d_0x94,&&op_d_0x95,&&op_d_0x96,&&op_d_0x97,
+	&&op_d_0x98,&&op_d_0x99,&&op_d_0x9a,&&op_d_0x9b,
+	&&op_d_0x9c,&&op_d_0x9d,&&op_d_0x9e,&&op_d_0x9f,
+	&&op_d_0xa0,&&op_d_0xa1,&&op_d_0xa2,&&op_d_0xa3,
+	&&op_d_0xa4,&&op_d_0xa5,&&op_d_0xa6,&&op_d_0xa7,
+	&&op_d_0xa8,&&op_d_0xa9,&&op_d_0xaa,&&op_d_0xab,
+	&&op_d_0xac,&&op_d_0xad,&&op_d_0xae,&&op_d_0xaf,
+	&&op_d_0xb0,&&op_d_0xb1,&&op_d_0xb2,&&op_d_0xb3,
+	&&op_d_0xb4,&&op_d_0xb5,&&op_d_0xb6,&&op_d_0xb7,
+	&&op_d_0xb8,&&op_d_0xb9,&&op_d_0xba,&&op_d_0xbb,
+	&&op_d_0xbc,&&op_d_0xbd,&&op_d_0xbe,&&op_d_0xbf,
+	&&op_d_0xc0,&&op_d_0xc1,&&op_d_0xc2,&&op_d_0xc3,
+	&&op_d_0xc4,&&op_d_0xc5,&&op_d_0xc6,&&op_d_0xc7,
+	&&op_d_0xc8,&&op_d_0xc9,&&op_d_0xca,&&op_d_0xcb,
+	&&op_d_0xcc,&&op_d_0xcd,&&op_d_0xce,&&op_d_0xcf,
+	&&op_d_0xd0,&&op_d_0xd1,&&op_d_0xd2,&&op_d_0xd3,
+	&&op_d_0xd4,&&op_d_0xd5,&&op_d_0xd6,&&op_d_0xd7,
+	&&op_d_0xd8,&&op_d_0xd9,&&op_d_0xda,&&op_d_0xdb,
+	&&op_d_0xdc,&&op_d_0xdd,&&op_d_0xde,&&op_d_0xdf,
+	&&op_d_0xe0,&&op_d_0xe1,&&op_d_0xe2,&&op_d_0xe3,
+	&&op_d_0xe4,&&op_d_0xe5,&&op_d_0xe6,&&op_d_0xe7,
+	&&op_d_0xe8,&&op_d_0xe9,&&op_d_0xea,&&op_d_0xeb,
+	&&op_d_0xec,&&op_d_0xed,&&op_d_0xee,&&op_d_0xef,
+	&&op_d_0xf0,&&op_d_0xf1,&&op_d_0xf2,&&op_d_0xf3,
+	&&op_d_0xf4,&&op_d_0xf5,&&op_d_0xf6,&&op_d_0xf7,
+	&&op_d_0xf8,&&op_d_0xf9,&&op_d_0xfa,&&op_d_0xfb,
+	&&op_d_0xfc,&&op_d_0xfd,&&op_d_0xfe,&&op_d_0xff,
+	/* 32-bit 0x0f */
+	&&op_0f_d_0x00,&&op_0f_d_0x01,&&op_0f_d_0x02,&&op_0f_d_0x03,
+	&&illegal_opcode,&&illegal_opcode,&&op_0f_d_0x06,&&illegal_opcode,
+	&&op_0f_d_0x08,&&op_0f_d_0x09,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&op_0f_d_0x20,&&op_0f_d_0x21,&&op_0f_d_0x22,&&op_0f_d_0x23,
+	&&op_0f_d_0x24,&&illegal_opcode,&&op_0f_d_0x26,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&op_0f_d_0x31,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&op_0f_d_0x80,&&op_0f_d_0x81,&&op_0f_d_0x82,&&op_0f_d_0x83,
+	&&op_0f_d_0x84,&&op_0f_d_0x85,&&op_0f_d_0x86,&&op_0f_d_0x87,
+	&&op_0f_d_0x88,&&op_0f_d_0x89,&&op_0f_d_0x8a,&&op_0f_d_0x8b,
+	&&op_0f_d_0x8c,&&op_0f_d_0x8d,&&op_0f_d_0x8e,&&op_0f_d_0x8f,
+	&&op_0f_d_0x90,&&op_0f_d_0x91,&&op_0f_d_0x92,&&op_0f_d_0x93,
+	&&op_0f_d_0x94,&&op_0f_d_0x95,&&op_0f_d_0x96,&&op_0f_d_0x97,
+	&&op_0f_d_0x98,&&op_0f_d_0x99,&&op_0f_d_0x9a,&&op_0f_d_0x9b,
+	&&op_0f_d_0x9c,&&op_0f_d_0x9d,&&op_0f_d_0x9e,&&op_0f_d_0x9f,
+	&&op_0f_d_0xa0,&&op_0f_d_0xa1,&&op_0f_d_0xa2,&&op_0f_d_0xa3,
+	&&op_0f_d_0xa4,&&op_0f_d_0xa5,&&illegal_opcode,&&illegal_opcode,
+	&&op_0f_d_0xa8,&&op_0f_d_0xa9,&&illegal_opcode,&&op_0f_d_0xab,
+	&&op_0f_d_0xac,&&op_0f_d_0xad,&&illegal_opcode,&&op_0f_d_0xaf,
+	&&op_0f_d_0xb0,&&op_0f_d_0xb1,&&op_0f_d_0xb2,&&op_0f_d_0xb3,
+	&&op_0f_d_0xb4,&&op_0f_d_0xb5,&&op_0f_d_0xb6,&&op_0f_d_0xb7,
+	&&illegal_opcode,&&illegal_opcode,&&op_0f_d_0xba,&&op_0f_d_0xbb,
+	&&op_0f_d_0xbc,&&op_0f_d_0xbd,&&op_0f_d_0xbe,&&op_0f_d_0xbf,
+	&&op_0f_d_0xc0,&&op_0f_d_0xc1,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&op_0f_d_0xc8,&&op_0f_d_0xc9,&&op_0f_d_0xca,&&op_0f_d_0xcb,
+	&&op_0f_d_0xcc,&&op_0f_d_0xcd,&&op_0f_d_0xce,&&op_0f_d_0xcf,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,
+	&&illegal_opcode,&&illegal_opcode,&&illegal_opcode,&&illegal_opcode
+};
+//--End of modifications
@@ -29,7 +29,14 @@
 #include "programs.h"
 #include "paging.h"
 #include "lazyflags.h"
+#include "fpu.h"	//--Added for save states
 #include "support.h"
+//--Added for guest idle detection
+#include "pic.h"
+//--End of modifications
+//--Added for the adaptive core
+#include "timer.h"
+//--End of modifications
 
 Bitu DEBUG_EnableDebugger(void);
 extern void GFX_SetTitle(Bit32s cycles ,Bits frameskip,bool paused);
@@ -60,6 +67,14 @@ Bit64s CPU_IODelayRemoved = 0;
 CPU_Decoder * cpudecoder;
 bool CPU_CycleAutoAdjust = false;
 bool CPU_SkipCycleAutoAdjust = false;
+
+//--Added for guest idle detection: see CPU_Idle()
+/* How many polls in one emulated millisecond mark the guest as idling */
+#define CPU_IDLE_POLLS		(8)
+static bool CPU_IdleEnabled = true;
+static Bitu CPU_IdlePollTick = 0;
+static Bitu CPU_IdlePollCount = 0;
+//--End of modifications
 Bitu CPU_AutoDetermineMode = 0;
 
 Bitu CPU_ArchitectureType = CPU_ARCHTYPE_MIXED;
@@ -71,15 +86,33 @@ Bitu CPU_PrefetchQueueSize=0;
 void CPU_Core_Full_Init(void);
 void CPU_Core_Normal_Init(void);
 void CPU_Core_Simple_Init(void);
+//--Added for the threaded variant of the normal core
+void CPU_Core_Threaded_Init(void);
+//--End of modifications
 #if (C_DYNAMIC_X86)
 void CPU_Core_Dyn_X86_Init(void);
 void CPU_Core_Dyn_X86_Cache_Init(bool enable_cache);
 void CPU_Core_Dyn_X86_Cache_Close(void);
 void CPU_Core_Dyn_X86_SetFPUMode(bool dh_fpu);
+//--Added to size the translation cache from the dynamic_cache setting
+void CPU_Core_Dyn_X86_Cache_SetSize(Bitu size);
+//--End of modifications
+//--Added for save states
+void CPU_Core_Dyn_X86_Cache_Flush(void);
+//--End of modifications
 #elif (C_DYNREC)
 void CPU_Core_Dynrec_Init(void);
 void CPU_Core_Dynrec_Cache_Init(bool enable_cache);
 void CPU_Core_Dynrec_Cache_Close(void);
+//--Added to size the translation cache from the dynamic_cache setting
+void CPU_Core_Dynrec_Cache_SetSize(Bitu size);
+//--End of modifications
+//--Added to let the dynamic_hostfeatures setting turn off the host's instruction set extensions
+void CPU_Core_Dynrec_SetHostFeatures(bool enable);
+//--End of modifications
+//--Added for save states
+void CPU_Core_Dynrec_Cache_Flush(void);
+//--End of modifications
 #endif
 
 /* In debug mode exceptions are tested and dosbox exits when 
@@ -119,6 +152,18 @@ void CPU_Core_Dynrec_Cache_Close(void);
 
 
 void Descriptor::Load(PhysPt address) {
+	//--Added to read descriptors straight from the TLB when their page is already mapped,
+	//rather than making two full memory reads. Extenders rewrite descriptors with ordinary
+	//memory writes, so their contents are always read afresh rather than cached.
+	if ((address & 0xfff)<=0xff8) {
+		HostPt tlb_addr=get_tlb_read(address);
+		if (tlb_addr) {
+			saved.fill[0]=host_readd(tlb_addr+address);
+			saved.fill[1]=host_readd(tlb_addr+address+4);
+			return;
+		}
+	}
+	//--End of modifications
 	cpu.mpl=0;
 	Bit32u* data = (Bit32u*)&saved;
 	*data	  = mem_readd(address);
@@ -2046,19 +2091,44 @@ bool CPU_CPUID(void) {
 	return true;
 }
 
+//--Added for guest idle detection
+static inline void CPU_SkipIdleCycles(void) {
+	/* Don't let the skipped cycles count as work done when adjusting the cycles */
+	if (CPU_Cycles>0) CPU_IODelayRemoved+=CPU_Cycles;
+	CPU_Cycles=0;
+}
+
+void CPU_Idle(void) {
+	if (CPU_IdleEnabled) CPU_SkipIdleCycles();
+}
+
+void CPU_IdlePoll(void) {
+	if (!CPU_IdleEnabled) return;
+	if (CPU_IdlePollTick!=PIC_Ticks) {
+		CPU_IdlePollTick=PIC_Ticks;
+		CPU_IdlePollCount=0;
+	}
+	if (++CPU_IdlePollCount>=CPU_IDLE_POLLS) CPU_SkipIdleCycles();
+}
+//--End of modifications
+
 static Bits HLT_Decode(void) {
 	/* Once an interrupt occurs, it should change cpu core */
 	if (reg_eip!=cpu.hlt.eip || SegValue(cs) != cpu.hlt.cs) {
 		cpudecoder=cpu.hlt.old_decoder;
 	} else {
-		CPU_Cycles=0;
+		//--Modified to keep halted time out of the auto cycle measurements
+		CPU_SkipIdleCycles();
+		//--End of modifications
 	}
 	return 0;
 }
 
 void CPU_HLT(Bitu oldeip) {
 	reg_eip=oldeip;
-	CPU_Cycles=0;
+	//--Modified to keep halted time out of the auto cycle measurements
+	CPU_SkipIdleCycles();
+	//--End of modifications
 	cpu.hlt.cs=SegValue(cs);
 	cpu.hlt.eip=reg_eip;
 	cpu.hlt.old_decoder=cpudecoder;
@@ -2098,6 +2168,151 @@ void CPU_ENTER(bool use32,Bitu bytes,Bitu level) {
 	reg_esp=(reg_esp&cpu.stack.notmask)|((sp_index)&cpu.stack.mask);
 }
 
+//--Added for the adaptive core setting, which starts out on the normal core, moves to the
+//dynamic core once a program settles into protected mode, and moves back again if the program
+//keeps rewriting its own code or drops back into real mode. Decisions are made from a tick
+//handler: these run between calls to cpudecoder, so it is a safe point to swap it.
+#if (C_DYNAMIC_X86) || (C_DYNREC)
+#define CPU_ADAPTIVE_PROMOTE_TICKS	500		//Unbroken protected-mode time before moving to the dynamic core
+#define CPU_ADAPTIVE_REALMODE_TICKS	1000	//Unbroken real-mode time before moving back to the normal core
+#define CPU_ADAPTIVE_SAMPLE_TICKS	250		//How often the dynamic core's invalidation rate is checked
+#define CPU_ADAPTIVE_SMC_MIN		256		//Invalidations per sample that count as heavy, if they are
+											//also at least half as many as the blocks translated
+#define CPU_ADAPTIVE_HOLDOFF_TICKS	2000	//How long to stay on the normal core after moving back for
+											//self-modifying code: doubled each time it happens again
+#define CPU_ADAPTIVE_HOLDOFF_MAX	64000
+
+static bool adaptive_enabled=false;
+static bool adaptive_promotion_allowed=true;
+static Bitu adaptive_pmode_ticks=0;
+static Bitu adaptive_realmode_ticks=0;
+static Bitu adaptive_sample_ticks=0;
+static Bitu adaptive_holdoff=0;
+static Bitu adaptive_holdoff_length=CPU_ADAPTIVE_HOLDOFF_TICKS;
+static Bit64u adaptive_last_invalidations=0;
+static Bit64u adaptive_last_translations=0;
+
+#if (C_DYNAMIC_X86)
+void CPU_Core_Dyn_X86_Cache_GetStats(CPU_DynamicCacheStats * stats);
+#define CPU_ADAPTIVE_DYNAMIC_RUN CPU_Core_Dyn_X86_Run
+#define CPU_ADAPTIVE_GETSTATS CPU_Core_Dyn_X86_Cache_GetStats
+#else
+void CPU_Core_Dynrec_Cache_GetStats(CPU_DynamicCacheStats * stats);
+#define CPU_ADAPTIVE_DYNAMIC_RUN CPU_Core_Dynrec_Run
+#define CPU_ADAPTIVE_GETSTATS CPU_Core_Dynrec_Cache_GetStats
+#endif
+
+/* The reason is a short keyword passed on to Boxer, which remembers it for the game */
+static void CPU_AdaptiveSwitch(CPU_Decoder * * decoder,bool dynamic,const char * reason,const char * description) {
+	if (dynamic) {
+#if (C_DYNAMIC_X86)
+		CPU_Core_Dyn_X86_Cache_Init(true);
+#else
+		CPU_Core_Dynrec_Cache_Init(true);
+#endif
+		*decoder=&CPU_ADAPTIVE_DYNAMIC_RUN;
+		CPU_DynamicCacheStats stats;
+		CPU_ADAPTIVE_GETSTATS(&stats);
+		adaptive_last_invalidations=stats.invalidations;
+		adaptive_last_translations=stats.translations;
+	} else {
+		*decoder=&CPU_Core_Normal_Run;
+	}
+	adaptive_pmode_ticks=0;
+	adaptive_realmode_ticks=0;
+	adaptive_sample_ticks=0;
+	LOG_MSG("CPU: adaptive core moved to the %s core: %s",dynamic ? "dynamic" : "normal",description);
+	boxer_CPUCoreDidSwitch(dynamic,reason);
+	GFX_SetTitle(-1,-1,false);
+}
+
+static void CPU_AdaptiveTick(void) {
+	/* While halted, the core to resume with is the one to change */
+	CPU_Decoder * * decoder=(cpudecoder==&HLT_Decode) ? &cpu.hlt.old_decoder : &cpudecoder;
+	bool on_dynamic=(*decoder==&CPU_ADAPTIVE_DYNAMIC_RUN);
+
+	if (!cpu.pmode) {
+		adaptive_realmode_ticks++;
+		adaptive_pmode_ticks=0;
+	} else if (!GETFLAG(VM)) {
+		adaptive_pmode_ticks++;
+		adaptive_realmode_ticks=0;
+	} else {
+		/* V86 mode says nothing either way about the program */
+		adaptive_pmode_ticks=0;
+		adaptive_realmode_ticks=0;
+	}
+	if (adaptive_holdoff) adaptive_holdoff--;
+
+	/* Leave alone anything else running, e.g. the trap core while single-stepping */
+	if (!on_dynamic && *decoder!=&CPU_Core_Normal_Run) return;
+
+	if (!on_dynamic) {
+		if (adaptive_promotion_allowed && !adaptive_holdoff &&
+			adaptive_pmode_ticks>=CPU_ADAPTIVE_PROMOTE_TICKS)
+			CPU_AdaptiveSwitch(decoder,true,"protected","program runs in protected mode");
+		return;
+	}
+
+	if (adaptive_realmode_ticks>=CPU_ADAPTIVE_REALMODE_TICKS) {
+		CPU_AdaptiveSwitch(decoder,false,"realmode","program runs in real mode");
+		return;
+	}
+
+	if (++adaptive_sample_ticks<CPU_ADAPTIVE_SAMPLE_TICKS) return;
+	adaptive_sample_ticks=0;
+
+	CPU_DynamicCacheStats stats;
+	CPU_ADAPTIVE_GETSTATS(&stats);
+	Bit64u invalidations=stats.invalidations-adaptive_last_invalidations;
+	Bit64u translations=stats.translations-adaptive_last_translations;
+	adaptive_last_invalidations=stats.invalidations;
+	adaptive_last_translations=stats.translations;
+
+	if (invalidations>=CPU_ADAPTIVE_SMC_MIN && invalidations*2>=translations) {
+		adaptive_holdoff=adaptive_holdoff_length;
+		if (adaptive_holdoff_length<CPU_ADAPTIVE_HOLDOFF_MAX) adaptive_holdoff_length*=2;
+		CPU_AdaptiveSwitch(decoder,false,"smc","program keeps rewriting its own code");
+	}
+}
+#endif
+
+void CPU_AdaptiveCore_Enable(void) {
+#if (C_DYNAMIC_X86) || (C_DYNREC)
+	if (adaptive_enabled) return;
+	adaptive_enabled=true;
+	adaptive_pmode_ticks=0;
+	adaptive_realmode_ticks=0;
+	adaptive_sample_ticks=0;
+	adaptive_holdoff=0;
+	adaptive_holdoff_length=CPU_ADAPTIVE_HOLDOFF_TICKS;
+	TIMER_AddTickHandler(&CPU_AdaptiveTick);
+#endif
+}
+
+void CPU_AdaptiveCore_Disable(void) {
+#if (C_DYNAMIC_X86) || (C_DYNREC)
+	if (!adaptive_enabled) return;
+	adaptive_enabled=false;
+	TIMER_DelTickHandler(&CPU_AdaptiveTick);
+#endif
+}
+
+bool CPU_AdaptiveCore_Enabled(void) {
+#if (C_DYNAMIC_X86) || (C_DYNREC)
+	return adaptive_enabled;
+#else
+	return false;
+#endif
+}
+
+void CPU_AdaptiveCore_SetPromotionAllowed(bool allowed) {
+#if (C_DYNAMIC_X86) || (C_DYNREC)
+	adaptive_promotion_allowed=allowed;
+#endif
+}
+//--End of modifications
+
 static void CPU_CycleIncrease(bool pressed) {
 	if (!pressed) return;
 	if (CPU_CycleAutoAdjust) {
@@ -2167,6 +2382,9 @@ void CPU_Reset_AutoAdjust(void) {
 	CPU_IODelayRemoved = 0;
 	ticksDone = 0;
 	ticksScheduled = 0;
+	//--Added to restart the cycle controller along with the auto cycle measurements
+	DOSBOX_ResetCycleController();
+	//--End of modifications
 }
 
 class CPU: public Module_base {
@@ -2174,6 +2392,7 @@ private:
 	static bool inited;
 public:
 	CPU(Section* configuration):Module_base(configuration) {
+		SAVESTATE_Register("cpu",this);	//--Added for save states
 		if(inited) {
 			Change_Config(configuration);
 			return;
@@ -2222,6 +2441,9 @@ public:
 		CPU_Core_Normal_Init();
 		CPU_Core_Simple_Init();
 		CPU_Core_Full_Init();
+		//--Added for the threaded variant of the normal core
+		CPU_Core_Threaded_Init();
+		//--End of modifications
 #if (C_DYNAMIC_X86)
 		CPU_Core_Dyn_X86_Init();
 #elif (C_DYNREC)
@@ -2239,6 +2461,10 @@ public:
 		CPU_Cycles=0;
 		CPU_SkipCycleAutoAdjust=false;
 
+		//--Added for guest idle detection
+		CPU_IdleEnabled=section->Get_bool("idle");
+		//--End of modifications
+
 		Prop_multival* p = section->Get_multival("cycles");
 		std::string type = p->GetSection()->Get_string("type");
 		std::string str ;
@@ -2319,10 +2545,22 @@ public:
 		CPU_CycleDown=section->Get_int("cycledown");
 		std::string core(section->Get_string("core"));
 		cpudecoder=&CPU_Core_Normal_Run;
+		//--Added for the adaptive core
+		CPU_AdaptiveCore_Disable();
+		//--End of modifications
 		if (core == "normal") {
 			cpudecoder=&CPU_Core_Normal_Run;
+		//--Added for the adaptive core, which starts out on the normal core
+		} else if (core == "adaptive") {
+			cpudecoder=&CPU_Core_Normal_Run;
+			CPU_AdaptiveCore_Enable();
+		//--End of modifications
 		} else if (core =="simple") {
 			cpudecoder=&CPU_Core_Simple_Run;
+		//--Added for the threaded variant of the normal core
+		} else if (core =="threaded") {
+			cpudecoder=&CPU_Core_Threaded_Run;
+		//--End of modifications
 		} else if (core == "full") {
 			cpudecoder=&CPU_Core_Full_Run;
 		} else if (core == "auto") {
@@ -2347,8 +2585,17 @@ public:
 		}
 
 #if (C_DYNAMIC_X86)
+		//--Added to size the translation cache before it is first allocated
+		CPU_Core_Dyn_X86_Cache_SetSize((Bitu)section->Get_int("dynamic_cache")*1024*1024);
+		//--End of modifications
 		CPU_Core_Dyn_X86_Cache_Init((core == "dynamic") || (core == "dynamic_nodhfpu"));
 #elif (C_DYNREC)
+		//--Added to size the translation cache before it is first allocated
+		CPU_Core_Dynrec_Cache_SetSize((Bitu)section->Get_int("dynamic_cache")*1024*1024);
+		//--End of modifications
+		//--Added to let the host's instruction set extensions be turned off
+		CPU_Core_Dynrec_SetHostFeatures(section->Get_bool("dynamic_hostfeatures"));
+		//--End of modifications
 		CPU_Core_Dynrec_Cache_Init( core == "dynamic" );
 #endif
 
@@ -2367,6 +2614,12 @@ public:
 				cpudecoder=&CPU_Core_Prefetch_Run;
 				CPU_PrefetchQueueSize = 16;
 				CPU_AutoDetermineMode&=(~CPU_AUTODETERMINE_CORE);
+			//--Added for the adaptive core, which cannot leave the prefetch core either
+			} else if (core == "adaptive") {
+				cpudecoder=&CPU_Core_Prefetch_Run;
+				CPU_PrefetchQueueSize = 16;
+				CPU_AdaptiveCore_Disable();
+			//--End of modifications
 			} else {
 				E_Exit("prefetch queue emulation requires the normal core setting.");
 			}
@@ -2401,11 +2654,56 @@ public:
 		else GFX_SetTitle(CPU_CycleMax,-1,false);
 		return true;
 	}
-	~CPU(){ /* empty */};
+	//--Added for save states. This includes the FPU, which has no module of its own.
+	//The cycle settings are deliberately left alone, since those belong to the user.
+	void SaveState(std::ostream& stream) {
+		SAVESTATE_Write(stream,cpu_regs);
+		SAVESTATE_Write(stream,Segs);
+		SAVESTATE_Write(stream,lflags);
+		CPUBlock block=cpu;
+		block.hlt.old_decoder=0;
+		SAVESTATE_Write(stream,block);
+		SAVESTATE_WriteHandler(stream,cpu.hlt.old_decoder);
+		SAVESTATE_Write(stream,cpu_tss);
+		SAVESTATE_WriteHandler(stream,cpudecoder);
+		SAVESTATE_Write(stream,CPU_Cycles);
+		SAVESTATE_Write(stream,CPU_CycleLeft);
+#if C_FPU
+		SAVESTATE_Write(stream,fpu);
+#endif
+	}
+	void LoadState(std::istream& stream) {
+		SAVESTATE_Read(stream,cpu_regs);
+		SAVESTATE_Read(stream,Segs);
+		SAVESTATE_Read(stream,lflags);
+		SAVESTATE_Read(stream,cpu);
+		SAVESTATE_ReadHandler(stream,cpu.hlt.old_decoder);
+		SAVESTATE_Read(stream,cpu_tss);
+		SAVESTATE_ReadHandler(stream,cpudecoder);
+		SAVESTATE_Read(stream,CPU_Cycles);
+		SAVESTATE_Read(stream,CPU_CycleLeft);
+#if C_FPU
+		SAVESTATE_Read(stream,fpu);
+#endif
+		CPU_Core_Threaded_FlushFetch();
+		CPU_Core_Prefetch_Invalidate();
+	}
+	//--End of modifications
+	~CPU(){ SAVESTATE_Unregister(this); };
 };
 	
 static CPU * test;
 
+//--Added to discard translated code when guest memory is replaced by a save state
+void CPU_FlushCodeCache(void) {
+#if (C_DYNAMIC_X86)
+	CPU_Core_Dyn_X86_Cache_Flush();
+#elif (C_DYNREC)
+	CPU_Core_Dynrec_Cache_Flush();
+#endif
+}
+//--End of modifications
+
 void CPU_ShutDown(Section* sec) {
 #if (C_DYNAMIC_X86)
 	CPU_Core_Dyn_X86_Cache_Close();
@@ -30,6 +30,9 @@
 #include "cpu.h"
 #include "debug.h"
 #include "setup.h"
+//--Added to let the profiler attribute time to page faults
+#include "profiler.h"
+//--End of modifications
 
 #define LINK_TOTAL		(64*1024)
 
@@ -37,6 +40,7 @@
 
 
 PagingBlock paging;
+bool paging_restartable=false;		//--Added for restartable reads, see paging.h
 
 
 Bitu PageHandler::readb(PhysPt addr) {
@@ -138,6 +142,16 @@ Bitu DEBUG_EnableDebugger(void);
 bool first=false;
 
 void PAGING_PageFault(PhysPt lin_addr,Bitu page_addr,Bitu faultcode) {
+	//--Added to unwind back to the core instead, when it can restart the faulting instruction
+	if (paging_restartable) {
+		paging_restartable=false;
+		paging.cr2=lin_addr;
+		LOG(LOG_PAGING,LOG_NORMAL)("PageFault at %X type [%x] unwinding",lin_addr,faultcode);
+		PagingFault fault;
+		fault.faultcode=faultcode;
+		throw fault;
+	}
+	//--End of modifications
 	/* Save the state of the cpu cores */
 	LazyFlags old_lflags;
 	memcpy(&old_lflags,&lflags,sizeof(LazyFlags));
@@ -159,7 +173,16 @@ void PAGING_PageFault(PhysPt lin_addr,Bitu page_addr,Bitu faultcode) {
 #if C_DEBUG
 //	DEBUG_EnableDebugger();
 #endif
-	DOSBOX_RunMachine();
+	//--Modified to let the profiler attribute time to page faults
+	{
+		ProfilerContextScope profiling(PROFILER_PAGEFAULT);
+		DOSBOX_RunMachine();
+	}
+	//--End of modifications
+	//--Added so the threaded core doesn't keep fetching through a code page the guest
+	//may have remapped while handling the fault
+	CPU_Core_Threaded_FlushFetch();
+	//--End of modifications
 	pf_queue.used--;
 	LOG(LOG_PAGING,LOG_NORMAL)("Left PageFault for %x queue %d",lin_addr,pf_queue.used);
 	memcpy(&lflags,&old_lflags,sizeof(LazyFlags));
@@ -838,6 +861,27 @@ void PAGING_LinkPage_ReadOnly(Bitu lin_page,Bitu phys_page) {
 #endif
 
 
+//--Added so that devices which remap a few physical pages, like the VGA on every bank switch,
+//don't make every page of RAM go through the init handler again while paging is disabled.
+//Linear pages then map to the same physical page, apart from those in the first megabyte
+//that EMS and the A20 gate have remapped through firstmb.
+void PAGING_UnlinkPhysPages(Bitu phys_page,Bitu pages) {
+	if (paging.enabled) {
+		PAGING_ClearTLB();
+		return;
+	}
+	Bitu end_page=phys_page+pages;
+	for (Bitu lin_page=0;lin_page<LINK_START;lin_page++) {
+		Bitu mapped_page=paging.firstmb[lin_page];
+		if ((mapped_page>=phys_page) && (mapped_page<end_page)) PAGING_UnlinkPages(lin_page,1);
+	}
+	if (end_page>LINK_START) {
+		Bitu start_page=(phys_page>LINK_START) ? phys_page : LINK_START;
+		PAGING_UnlinkPages(start_page,end_page-start_page);
+	}
+}
+//--End of modifications
+
 void PAGING_SetDirBase(Bitu cr3) {
 	paging.cr3=cr3;
 	
@@ -881,8 +925,32 @@ public:
 			paging.firstmb[i]=i;
 		}
 		pf_queue.used=0;
+		SAVESTATE_Register("paging",this);	//--Added for save states
+	}
+	//--Added for save states. The TLB is rebuilt from the page tables as pages are touched.
+	void SaveState(std::ostream& stream) {
+		SAVESTATE_Write(stream,paging.cr3);
+		SAVESTATE_Write(stream,paging.cr2);
+		SAVESTATE_Write(stream,paging.enabled);
+		SAVESTATE_Write(stream,paging.firstmb);
+		SAVESTATE_WriteBlock(stream,&pf_queue,sizeof(pf_queue));
+	}
+	void LoadState(std::istream& stream) {
+		Bitu cr3;
+		bool enabled;
+		SAVESTATE_Read(stream,cr3);
+		SAVESTATE_Read(stream,paging.cr2);
+		SAVESTATE_Read(stream,enabled);
+		SAVESTATE_Read(stream,paging.firstmb);
+		SAVESTATE_ReadBlock(stream,&pf_queue,sizeof(pf_queue));
+		PAGING_ClearTLB();
+		PAGING_InitTLB();
+		paging.enabled=false;
+		PAGING_SetDirBase(cr3);
+		PAGING_Enable(enabled);
 	}
-	~PAGING(){}
+	~PAGING(){ SAVESTATE_Unregister(this); }
+	//--End of modifications
 };
 
 static PAGING* test;
@@ -268,6 +268,25 @@ enum EBreakpoint { BKPNT_UNKNOWN, BKPNT_PHYSICAL, BKPNT_INTERRUPT, BKPNT_MEMORY,
 
 #define BPINT_ALL 0x100
 
+//--Added to find code breakpoints and memory breakpoints without searching for them on every instruction
+class WatchPageHandler;
+
+// one bit per 4kb page that holds an active code breakpoint
+#define BP_CODE_PAGES_SIZE ((1024*1024)/8)
+static Bit8u *	bpCodePages = 0;
+static Bitu		bpCodeCount = 0;
+
+#if C_HEAVY_DEBUG
+bool debug_heavy_checks = false;
+
+static void DEBUG_UpdateHeavyChecks(void) {
+	debug_heavy_checks = cpuLog || logHeavy || zeroProtect || skipFirstInstruction || (bpCodeCount>0);
+}
+#else
+static void DEBUG_UpdateHeavyChecks(void) { }
+#endif
+//--End of modifications
+
 class CBreakpoint
 {
 public:
@@ -279,6 +298,7 @@ public:
 	void					SetOnce			(bool _once)				{ once = _once; };
 	void					SetType			(EBreakpoint _type)			{ type = _type; };
 	void					SetValue		(Bit8u value)				{ ahValue = value; };
+	void					SetCondition	(const char * _condition)	{ condition = _condition; };	//--Added
 
 	bool					IsActive		(void)						{ return active; };
 	void					Activate		(bool _active);
@@ -290,6 +310,11 @@ public:
 	Bit32u					GetOffset		(void)						{ return offset; };
 	Bit8u					GetIntNr		(void)						{ if (GetType()==BKPNT_INTERRUPT)	return intNr;		else return 0; };
 	Bit16u					GetValue		(void)						{ if (GetType()!=BKPNT_PHYSICAL)	return ahValue;		else return 0; };
+	//--Added for conditional breakpoints and memory breakpoints
+	bool					HasCondition	(void)						{ return !condition.empty(); };
+	const char *			GetCondition	(void)						{ return condition.c_str(); };
+	bool					IsMemory		(void)						{ return (type==BKPNT_MEMORY) || (type==BKPNT_MEMORY_PROT) || (type==BKPNT_MEMORY_LINEAR); };
+	//--End of modifications
 
 	// statics
 	static CBreakpoint*		AddBreakpoint		(Bit16u seg, Bit32u off, bool once);
@@ -305,9 +330,22 @@ public:
 	static bool				DeleteByIndex		(Bit16u index);
 	static void				DeleteAll			(void);
 	static void				ShowList			(void);
+	//--Added for conditional breakpoints and memory breakpoints
+	static bool				ConditionMet		(const char * condition, bool & met);
+	static void				UpdateCodePages		(void);
+	static bool				IsCodePage			(PhysPt adr)	{ Bitu page = adr>>12; return bpCodePages && (bpCodePages[page>>3] & (1<<(page&7))); };
+	static void				CheckWatchedPage	(WatchPageHandler * handler);
+	static bool				CheckMemoryHit		(void);
+	static void				StepPastCondition	(void);
+	//--End of modifications
 
 
 private:
+	//--Added to start and stop watching a memory breakpoint's byte
+	void		Watch			(void);
+	void		Unwatch			(void);
+	//--End of modifications
+
 	EBreakpoint	type;
 	// Physical
 	PhysPt		location;
@@ -317,21 +355,142 @@ private:
 	// Int
 	Bit8u		intNr;
 	Bit16u		ahValue;
+	// Memory
+	WatchPageHandler *	watch;		//--Added
+	Bitu		watchOffset;		//--Added
 	// Shared
 	bool		active;
 	bool		once;
+	std::string	condition;			//--Added
 
 	static std::list<CBreakpoint*>	BPoints;
 public:
 	static CBreakpoint*				ignoreOnce;
+	//--Added for memory breakpoints that have been hit, and conditional breakpoints whose condition was false
+	static CBreakpoint*				memoryHit;
+	static Bit8u					memoryHitOldValue;
+	static CBreakpoint*				conditionSkip;
+	//--End of modifications
 };
 
 CBreakpoint::CBreakpoint(void):
 location(0),
 active(false),once(false),
 segment(0),offset(0),intNr(0),ahValue(0),
+watch(0),watchOffset(0),	//--Added
 type(BKPNT_UNKNOWN) { };
 
+//--Added to catch writes to memory breakpoints' bytes instead of polling them on every instruction.
+//While a memory breakpoint is active, the physical page holding its byte is given this handler,
+//which passes everything on to the page's own handler. The page is no longer directly writeable,
+//so every write to it comes through here and the watched bytes can be checked afterwards;
+//reads still go straight to memory. Code on the page runs under the normal core meanwhile.
+class WatchPageHandler : public PageHandler {
+public:
+	WatchPageHandler(Bitu _phys_page) : phys_page(_phys_page), refs(0) {
+		handler = MEM_GetPageHandler(phys_page);
+		flags = (handler->flags & ~(PFLAG_WRITEABLE|PFLAG_HASCODE)) | PFLAG_NOCODE;
+	}
+	Bitu readb(PhysPt addr) {
+		if (handler->flags & PFLAG_READABLE) return host_readb(handler->GetHostReadPt(phys_page)+(addr&4095));
+		return handler->readb(addr);
+	}
+	Bitu readw(PhysPt addr) {
+		if (handler->flags & PFLAG_READABLE) return host_readw(handler->GetHostReadPt(phys_page)+(addr&4095));
+		return handler->readw(addr);
+	}
+	Bitu readd(PhysPt addr) {
+		if (handler->flags & PFLAG_READABLE) return host_readd(handler->GetHostReadPt(phys_page)+(addr&4095));
+		return handler->readd(addr);
+	}
+	void writeb(PhysPt addr,Bitu val) {
+		if (handler->flags & PFLAG_WRITEABLE) host_writeb(handler->GetHostWritePt(phys_page)+(addr&4095),val);
+		else handler->writeb(addr,val);
+		CBreakpoint::CheckWatchedPage(this);
+	}
+	void writew(PhysPt addr,Bitu val) {
+		if (handler->flags & PFLAG_WRITEABLE) host_writew(handler->GetHostWritePt(phys_page)+(addr&4095),val);
+		else handler->writew(addr,val);
+		CBreakpoint::CheckWatchedPage(this);
+	}
+	void writed(PhysPt addr,Bitu val) {
+		if (handler->flags & PFLAG_WRITEABLE) host_writed(handler->GetHostWritePt(phys_page)+(addr&4095),val);
+		else handler->writed(addr,val);
+		CBreakpoint::CheckWatchedPage(this);
+	}
+	HostPt GetHostReadPt(Bitu phys_page) {
+		return handler->GetHostReadPt(phys_page);
+	}
+	HostPt GetHostWritePt(Bitu phys_page) {
+		return handler->GetHostWritePt(phys_page);
+	}
+	Bit8u ReadWatched(Bitu offset) {
+		return (Bit8u)readb((phys_page<<12)+offset);
+	}
+
+	Bitu phys_page;
+	PageHandler * handler;	// the page's own handler
+	Bitu refs;				// how many memory breakpoints are watching this page
+	static std::list<WatchPageHandler*> handlers;
+};
+
+std::list<WatchPageHandler*> WatchPageHandler::handlers;
+
+void CBreakpoint::Watch(void)
+{
+	if (watch) return;
+	// Watch protected mode memory only in pmode
+	if (GetType()==BKPNT_MEMORY_PROT) {
+		if (!cpu.pmode) return;
+		Descriptor desc;
+		if (!cpu.gdt.GetDescriptor(GetSegment(),desc)) return;
+		if (desc.GetLimit()==0) return;
+	}
+	PhysPt address;
+	if (GetType()==BKPNT_MEMORY_LINEAR) address = GetOffset();
+	else address = GetAddress(GetSegment(),GetOffset());
+
+	// Reading the byte maps its page in, if it can be, so we can find the physical page behind it
+	Bit8u value = 0;
+	if (mem_readb_checked(address,&value)) return;
+	Bitu phys_page = PAGING_GetPhysicalPage(address)>>12;
+	if (phys_page>=MEM_TotalPages()) return;
+
+	std::list<WatchPageHandler*>::iterator i;
+	for(i=WatchPageHandler::handlers.begin(); i != WatchPageHandler::handlers.end(); i++) {
+		if ((*i)->phys_page==phys_page) {
+			watch = (*i);
+			break;
+		}
+	}
+	if (!watch) {
+		watch = new WatchPageHandler(phys_page);
+		WatchPageHandler::handlers.push_back(watch);
+		MEM_SetPageHandler(phys_page,1,watch);
+		PAGING_ClearTLB();
+	}
+	watch->refs++;
+	watchOffset = address & 4095;
+	SetValue(value);
+}
+
+void CBreakpoint::Unwatch(void)
+{
+	if (!watch) return;
+	if (--watch->refs==0) {
+		// Leave the page alone if something else has taken it over since
+		if (MEM_GetPageHandler(watch->phys_page)==watch) {
+			MEM_SetPageHandler(watch->phys_page,1,watch->handler);
+			PAGING_ClearTLB();
+		}
+		WatchPageHandler::handlers.remove(watch);
+		delete watch;
+	}
+	watch = 0;
+	if (memoryHit==this) memoryHit = 0;
+}
+//--End of modifications
+
 void CBreakpoint::Activate(bool _active)
 {
 #if !C_HEAVY_DEBUG
@@ -351,12 +510,21 @@ void CBreakpoint::Activate(bool _active)
 		}
 	}
 #endif
+	//--Added to watch memory breakpoints' pages while they are active
+	if (IsMemory()) {
+		if (_active) Watch();
+		else Unwatch();
+	}
+	//--End of modifications
 	active = _active;
 };
 
 // Statics
 std::list<CBreakpoint*> CBreakpoint::BPoints;
 CBreakpoint*			CBreakpoint::ignoreOnce = 0;
+CBreakpoint*			CBreakpoint::memoryHit = 0;				//--Added
+Bit8u					CBreakpoint::memoryHitOldValue = 0;		//--Added
+CBreakpoint*			CBreakpoint::conditionSkip = 0;			//--Added
 Bitu					ignoreAddressOnce = 0;
 
 CBreakpoint* CBreakpoint::AddBreakpoint(Bit16u seg, Bit32u off, bool once)
@@ -401,8 +569,106 @@ void CBreakpoint::ActivateBreakpoints(PhysPt adr, bool activate)
 		}
 		bp->Activate(activate);	
 	};
+	UpdateCodePages();	//--Added
 };
 
+//--Added to find code breakpoints by page, and to stop at memory breakpoints and step past
+//conditional breakpoints without the cores having to look for them on every instruction.
+void CBreakpoint::UpdateCodePages(void)
+{
+	bpCodeCount = 0;
+	if (bpCodePages) memset(bpCodePages,0,BP_CODE_PAGES_SIZE);
+	std::list<CBreakpoint*>::iterator i;
+	for(i=BPoints.begin(); i != BPoints.end(); i++) {
+		CBreakpoint* bp = (*i);
+		if ((bp->GetType()!=BKPNT_PHYSICAL) || !bp->IsActive()) continue;
+		if (!bpCodePages) {
+			bpCodePages = new Bit8u[BP_CODE_PAGES_SIZE];
+			memset(bpCodePages,0,BP_CODE_PAGES_SIZE);
+		}
+		// The segment's base may have changed since the breakpoint was set
+		Bitu page = GetAddress(bp->GetSegment(),bp->GetOffset())>>12;
+		bpCodePages[page>>3] |= 1<<(page&7);
+		bpCodeCount++;
+	}
+	DEBUG_UpdateHeavyChecks();
+}
+
+bool CBreakpoint::ConditionMet(const char * condition, bool & met)
+// Evaluates a condition of the form [value] [op] [value], where op is one of == != < > <= >=
+// and values are as for any other command. Returns false if the condition can't be understood.
+{
+	char buffer[256];
+	safe_strncpy(buffer,condition,sizeof(buffer));
+	char* found = buffer;
+	Bit32u left = GetHexValue(found,found);
+	while (*found==' ') found++;
+	char op[3] = { 0,0,0 };
+	if (*found=='=' || *found=='!' || *found=='<' || *found=='>') op[0] = *found++;
+	if (*found=='=') op[1] = *found++;
+	if (!*found) return false;
+	Bit32u right = GetHexValue(found,found);
+	while (*found==' ') found++;
+	if (*found) return false;
+
+	if (!strcmp(op,"=="))		met = (left==right);
+	else if (!strcmp(op,"!="))	met = (left!=right);
+	else if (!strcmp(op,"<"))	met = (left<right);
+	else if (!strcmp(op,">"))	met = (left>right);
+	else if (!strcmp(op,"<="))	met = (left<=right);
+	else if (!strcmp(op,">="))	met = (left>=right);
+	else return false;
+	return true;
+}
+
+void CBreakpoint::CheckWatchedPage(WatchPageHandler * handler)
+// Called after each write to a watched page
+{
+	std::list<CBreakpoint*>::iterator i;
+	for(i=BPoints.begin(); i != BPoints.end(); i++) {
+		CBreakpoint* bp = (*i);
+		if (bp->watch!=handler) continue;
+		Bit8u value = handler->ReadWatched(bp->watchOffset);
+		if (bp->GetValue()==value) continue;
+		if (!memoryHit) {
+			memoryHit = bp;
+			memoryHitOldValue = (Bit8u)bp->GetValue();
+			// Stop the core once the current instruction is done
+			CPU_CycleLeft += CPU_Cycles;
+			CPU_Cycles = 0;
+		}
+		bp->SetValue(value);
+	}
+}
+
+bool CBreakpoint::CheckMemoryHit(void)
+// Checks if a memory breakpoint was hit during the last run of the core, and if it should stop execution
+{
+	CBreakpoint* bp = memoryHit;
+	if (!bp) return false;
+	memoryHit = 0;
+	if (bp->HasCondition()) {
+		bool met;
+		if (ConditionMet(bp->GetCondition(),met) && !met) return false;
+	}
+	DEBUG_ShowMsg("DEBUG: Memory breakpoint %s: %04X:%04X - %02X -> %02X\n",(bp->GetType()==BKPNT_MEMORY_PROT)?"(Prot)":"",bp->GetSegment(),bp->GetOffset(),memoryHitOldValue,bp->GetValue());
+	return true;
+}
+
+void CBreakpoint::StepPastCondition(void)
+// Runs the instruction under an INT3 breakpoint whose condition was false, then puts the breakpoint back
+{
+	CBreakpoint* bp = conditionSkip;
+	conditionSkip = 0;
+	CPU_CycleLeft += CPU_Cycles;
+	CPU_Cycles = 1;
+	Bits ret = (*cpudecoder)();
+	CPU_Cycles = 0;
+	bp->Activate(true);
+	if (ret>0) (*CallBack_Handlers[ret])();
+}
+//--End of modifications
+
 bool CBreakpoint::CheckBreakpoint(Bitu seg, Bitu off)
 // Checks if breakpoint is valid an should stop execution
 {
@@ -412,6 +678,10 @@ bool CBreakpoint::CheckBreakpoint(Bitu seg, Bitu off)
 	} else
 		ignoreAddressOnce = 0;
 
+	//--Added to only search the list on pages that have a code breakpoint
+	if (!IsCodePage(GetAddress(seg,off))) return false;
+	//--End of modifications
+
 	// Search matching breakpoint
 	std::list<CBreakpoint*>::iterator i;
 	CBreakpoint* bp;
@@ -424,45 +694,33 @@ bool CBreakpoint::CheckBreakpoint(Bitu seg, Bitu off)
 				bp->Activate(true);
 				return false;
 			};
+			//--Added to evaluate the breakpoint's condition only once it has been reached
+			if (bp->HasCondition()) {
+				bool met;
+				if (ConditionMet(bp->GetCondition(),met) && !met) {
+#if C_HEAVY_DEBUG
+					return false;
+#else
+					// Take out the INT3 so the instruction underneath can be run, then put it back
+					bp->Activate(false);
+					conditionSkip = bp;
+					return true;
+#endif
+				}
+			}
+			//--End of modifications
 			// Found, 
 			if (bp->GetOnce()) {
 				// delete it, if it should only be used once
 				(BPoints.erase)(i);
 				bp->Activate(false);
 				delete bp;
+				UpdateCodePages();	//--Added
 			} else {
 				ignoreOnce = bp;
 			};
 			return true;
 		} 
-#if C_HEAVY_DEBUG
-		// Memory breakpoint support
-		else if (bp->IsActive()) {
-			if ((bp->GetType()==BKPNT_MEMORY) || (bp->GetType()==BKPNT_MEMORY_PROT) || (bp->GetType()==BKPNT_MEMORY_LINEAR)) {
-				// Watch Protected Mode Memoryonly in pmode
-				if (bp->GetType()==BKPNT_MEMORY_PROT) {
-					// Check if pmode is active
-					if (!cpu.pmode) return false;
-					// Check if descriptor is valid
-					Descriptor desc;
-					if (!cpu.gdt.GetDescriptor(bp->GetSegment(),desc)) return false;
-					if (desc.GetLimit()==0) return false;
-				}
-
-				Bitu address; 
-				if (bp->GetType()==BKPNT_MEMORY_LINEAR) address = bp->GetOffset();
-				else address = GetAddress(bp->GetSegment(),bp->GetOffset());
-				Bit8u value=0;
-				if (mem_readb_checked(address,&value)) return false;
-				if (bp->GetValue() != value) {
-					// Yup, memory value changed
-					DEBUG_ShowMsg("DEBUG: Memory breakpoint %s: %04X:%04X - %02X -> %02X\n",(bp->GetType()==BKPNT_MEMORY_PROT)?"(Prot)":"",bp->GetSegment(),bp->GetOffset(),bp->GetValue(),value);
-					bp->SetValue(value);
-					return true;
-				};		
-			} 		
-		};
-#endif
 	};
 	return false;
 };
@@ -515,6 +773,7 @@ void CBreakpoint::DeleteAll()
 		delete bp;
 	};
 	(BPoints.clear)();
+	UpdateCodePages();	//--Added
 };
 
 
@@ -530,6 +789,7 @@ bool CBreakpoint::DeleteByIndex(Bit16u index)
 			(BPoints.erase)(i);
 			bp->Activate(false);
 			delete bp;
+			UpdateCodePages();	//--Added
 			return true;
 		}
 		nr++;
@@ -548,6 +808,7 @@ bool CBreakpoint::DeleteBreakpoint(PhysPt where)
 			(BPoints.erase)(i);
 			bp->Activate(false);
 			delete bp;
+			UpdateCodePages();	//--Added
 			return true;
 		}
 	};
@@ -595,17 +856,22 @@ void CBreakpoint::ShowList(void)
 	std::list<CBreakpoint*>::iterator i;
 	for(i=BPoints.begin(); i != BPoints.end(); i++) {
 		CBreakpoint* bp = (*i);
+		//--Added to list breakpoints' conditions
+		std::string condition;
+		if (bp->HasCondition()) condition = std::string(" IF ") + bp->GetCondition();
+		const char * cond = condition.c_str();
+		//--End of modifications
 		if (bp->GetType()==BKPNT_PHYSICAL) {
-			DEBUG_ShowMsg("%02X. BP %04X:%04X\n",nr,bp->GetSegment(),bp->GetOffset());
+			DEBUG_ShowMsg("%02X. BP %04X:%04X%s\n",nr,bp->GetSegment(),bp->GetOffset(),cond);
 		} else if (bp->GetType()==BKPNT_INTERRUPT) {
 			if (bp->GetValue()==BPINT_ALL)	DEBUG_ShowMsg("%02X. BPINT %02X\n",nr,bp->GetIntNr());					
 			else							DEBUG_ShowMsg("%02X. BPINT %02X AH=%02X\n",nr,bp->GetIntNr(),bp->GetValue());
 		} else if (bp->GetType()==BKPNT_MEMORY) {
-			DEBUG_ShowMsg("%02X. BPMEM %04X:%04X (%02X)\n",nr,bp->GetSegment(),bp->GetOffset(),bp->GetValue());
+			DEBUG_ShowMsg("%02X. BPMEM %04X:%04X (%02X)%s\n",nr,bp->GetSegment(),bp->GetOffset(),bp->GetValue(),cond);
 		} else if (bp->GetType()==BKPNT_MEMORY_PROT) {
-			DEBUG_ShowMsg("%02X. BPPM %04X:%08X (%02X)\n",nr,bp->GetSegment(),bp->GetOffset(),bp->GetValue());
+			DEBUG_ShowMsg("%02X. BPPM %04X:%08X (%02X)%s\n",nr,bp->GetSegment(),bp->GetOffset(),bp->GetValue(),cond);
 		} else if (bp->GetType()==BKPNT_MEMORY_LINEAR ) {
-			DEBUG_ShowMsg("%02X. BPLM %08X (%02X)\n",nr,bp->GetOffset(),bp->GetValue());
+			DEBUG_ShowMsg("%02X. BPLM %08X (%02X)%s\n",nr,bp->GetOffset(),bp->GetValue(),cond);
 		};
 		nr++;
 	}
@@ -615,6 +881,9 @@ bool DEBUG_Breakpoint(void)
 {
 	/* First get the phyiscal address and check for a set Breakpoint */
 	if (!CBreakpoint::CheckBreakpoint(SegValue(cs),reg_eip)) return false;
+	//--Added to leave the other breakpoints be when stepping past one whose condition was false
+	if (CBreakpoint::conditionSkip) return true;
+	//--End of modifications
 	// Found. Breakpoint is valid
 	PhysPt where=GetAddress(SegValue(cs),reg_eip);
 	CBreakpoint::ActivateBreakpoints(where,false);	// Deactivate all breakpoints
@@ -655,6 +924,16 @@ bool DEBUG_ExitLoop(void)
 	DrawVariables();
 #endif
 
+	//--Added to stop at memory breakpoints once the instruction that changed them has finished,
+	//and to step past conditional breakpoints that were reached without going through the debug callback
+	if (GCC_UNLIKELY(CBreakpoint::conditionSkip)) CBreakpoint::StepPastCondition();
+	if (GCC_UNLIKELY(CBreakpoint::memoryHit) && CBreakpoint::CheckMemoryHit()) {
+		CBreakpoint::ActivateBreakpoints(SegPhys(cs)+reg_eip,false);
+		DEBUG_Enable(true);
+		return true;
+	}
+	//--End of modifications
+
 	if (exitLoop) {
 		exitLoop = false;
 		return true;
@@ -910,6 +1189,19 @@ Bit32u GetHexValue(char* str, char*& hex)
 	return regval + value;
 };
 
+//--Added to check a breakpoint's optional condition before setting the breakpoint:
+//skips to the condition, if there is one, and reports it if it can't be understood.
+static bool CheckCondition(char*& condition)
+{
+	while (*condition==' ') condition++;
+	if (!*condition) return true;
+	bool met;
+	if (CBreakpoint::ConditionMet(condition,met)) return true;
+	DEBUG_ShowMsg("DEBUG: Can't understand breakpoint condition %s\n",condition);
+	return false;
+}
+//--End of modifications
+
 bool ChangeRegister(char* str)
 {
 	char* hex = str;
@@ -1043,20 +1335,24 @@ bool ParseCommand(char* str) {
 		return true;
 	};
 
+	//--Modified to take an optional condition after the address, and to allow memory breakpoints
+	//in all debugger builds now that they no longer need checking on every instruction
 	if (command == "BP") { // Add new breakpoint
 		Bit16u seg = (Bit16u)GetHexValue(found,found);found++; // skip ":"
 		Bit32u ofs = GetHexValue(found,found);
-		CBreakpoint::AddBreakpoint(seg,ofs,false);
+		if (!CheckCondition(found)) return false;
+		CBreakpoint* bp = CBreakpoint::AddBreakpoint(seg,ofs,false);
+		bp->SetCondition(found);
 		DEBUG_ShowMsg("DEBUG: Set breakpoint at %04X:%04X\n",seg,ofs);
 		return true;
 	};
 
-#if C_HEAVY_DEBUG
-
 	if (command == "BPM") { // Add new breakpoint
 		Bit16u seg = (Bit16u)GetHexValue(found,found);found++; // skip ":"
 		Bit32u ofs = GetHexValue(found,found);
-		CBreakpoint::AddMemBreakpoint(seg,ofs);
+		if (!CheckCondition(found)) return false;
+		CBreakpoint* bp = CBreakpoint::AddMemBreakpoint(seg,ofs);
+		bp->SetCondition(found);
 		DEBUG_ShowMsg("DEBUG: Set memory breakpoint at %04X:%04X\n",seg,ofs);
 		return true;
 	};
@@ -1064,9 +1360,11 @@ bool ParseCommand(char* str) {
 	if (command == "BPPM") { // Add new breakpoint
 		Bit16u seg = (Bit16u)GetHexValue(found,found);found++; // skip ":"
 		Bit32u ofs = GetHexValue(found,found);
+		if (!CheckCondition(found)) return false;
 		CBreakpoint* bp = CBreakpoint::AddMemBreakpoint(seg,ofs);
 		if (bp)	{
 			bp->SetType(BKPNT_MEMORY_PROT);
+			bp->SetCondition(found);
 			DEBUG_ShowMsg("DEBUG: Set prot-mode memory breakpoint at %04X:%08X\n",seg,ofs);
 		}
 		return true;
@@ -1074,13 +1372,16 @@ bool ParseCommand(char* str) {
 
 	if (command == "BPLM") { // Add new breakpoint
 		Bit32u ofs = GetHexValue(found,found);
+		if (!CheckCondition(found)) return false;
 		CBreakpoint* bp = CBreakpoint::AddMemBreakpoint(0,ofs);
-		if (bp) bp->SetType(BKPNT_MEMORY_LINEAR);
+		if (bp) {
+			bp->SetType(BKPNT_MEMORY_LINEAR);
+			bp->SetCondition(found);
+		}
 		DEBUG_ShowMsg("DEBUG: Set linear memory breakpoint at %08X\n",ofs);
 		return true;
 	};
-
-#endif
+	//--End of modifications
 
 	if (command == "BPINT") { // Add Interrupt Breakpoint
 		Bit8u intNr	= (Bit8u)GetHexValue(found,found);
@@ -1159,6 +1460,7 @@ bool ParseCommand(char* str) {
 		cpuLogFile << hex << noshowbase << setfill('0') << uppercase;
 		cpuLog = true;
 		cpuLogCounter = GetHexValue(found,found);
+		DEBUG_UpdateHeavyChecks();	//--Added
 
 		debugging = false;
 		CBreakpoint::ActivateBreakpoints(SegPhys(cs)+reg_eip,true);						
@@ -1245,12 +1547,14 @@ bool ParseCommand(char* str) {
 #if C_HEAVY_DEBUG
 	if (command == "HEAVYLOG") { // Create Cpu log file
 		logHeavy = !logHeavy;
+		DEBUG_UpdateHeavyChecks();	//--Added
 		DEBUG_ShowMsg("DEBUG: Heavy cpu logging %s.\n",logHeavy?"on":"off");
 		return true;
 	};
 
 	if (command == "ZEROPROTECT") { //toggle zero protection
 		zeroProtect = !zeroProtect;
+		DEBUG_UpdateHeavyChecks();	//--Added
 		DEBUG_ShowMsg("DEBUG: Zero code execution protection %s.\n",zeroProtect?"on":"off");
 		return true;
 	};
@@ -1271,11 +1575,10 @@ bool ParseCommand(char* str) {
 		DEBUG_ShowMsg("BP     [segment]:[offset] - Set breakpoint.\n");
 		DEBUG_ShowMsg("BPINT  [intNr] *          - Set interrupt breakpoint.\n");
 		DEBUG_ShowMsg("BPINT  [intNr] [ah]       - Set interrupt breakpoint with ah.\n");
-#if C_HEAVY_DEBUG
 		DEBUG_ShowMsg("BPM    [segment]:[offset] - Set memory breakpoint (memory change).\n");
 		DEBUG_ShowMsg("BPPM   [selector]:[offset]- Set pmode-memory breakpoint (memory change).\n");
 		DEBUG_ShowMsg("BPLM   [linear address]   - Set linear memory breakpoint (memory change).\n");
-#endif
+		DEBUG_ShowMsg("  ... [value][op][value]  - Add condition to BP/BPM/BPPM/BPLM, op: == != < > <= >=\n");
 		DEBUG_ShowMsg("BPLIST                    - List breakpoints.\n");		
 		DEBUG_ShowMsg("BPDEL  [bpNr] / *         - Delete breakpoint nr / all.\n");
 		DEBUG_ShowMsg("C / D  [segment]:[offset] - Set code / data view address.\n");
@@ -1606,6 +1909,7 @@ Bit32u DEBUG_CheckKeys(void) {
 				else {
 					exitLoop = false;
 					skipFirstInstruction = true; // for heavy debugger
+					DEBUG_UpdateHeavyChecks();	//--Added
 					CPU_Cycles = 1;
 					ret=(*cpudecoder)();
 					SetCodeWinStart();
@@ -1615,6 +1919,7 @@ Bit32u DEBUG_CheckKeys(void) {
 		case KEY_F(11):	// trace into
 				exitLoop = false;
 				skipFirstInstruction = true; // for heavy debugger
+				DEBUG_UpdateHeavyChecks();	//--Added
 				CPU_Cycles = 1;
 				ret = (*cpudecoder)();
 				SetCodeWinStart();
@@ -2005,6 +2310,12 @@ void DEBUG_CheckExecuteBreakpoint(Bit16u seg, Bit32u off)
 
 Bitu DEBUG_EnableDebugger(void)
 {
+	//--Added to carry on past a conditional breakpoint whose condition was false
+	if (CBreakpoint::conditionSkip) {
+		CBreakpoint::StepPastCondition();
+		return 0;
+	}
+	//--End of modifications
 	exitLoop = true;
 	DEBUG_Enable(true);
 	CPU_Cycles=CPU_CycleLeft=0;
@@ -2332,6 +2643,7 @@ void DEBUG_HeavyLogInstruction(void) {
 void DEBUG_HeavyWriteLogInstruction(void) {
 	if (!logHeavy) return;
 	logHeavy = false;
+	DEBUG_UpdateHeavyChecks();	//--Added
 	
 	DEBUG_ShowMsg("DEBUG: Creating cpu log LOGCPU_INT_CD.TXT\n");
 
@@ -2368,7 +2680,9 @@ void DEBUG_HeavyWriteLogInstruction(void) {
 	DEBUG_ShowMsg("DEBUG: Done.\n");	
 };
 
-bool DEBUG_HeavyIsBreakpoint(void) {
+//--Modified to be called only while debug_heavy_checks is set: see DEBUG_HeavyIsBreakpoint in debug.h.
+//Turns the checks back off once there is nothing left to check.
+bool DEBUG_HeavyCheckBreakpoint(void) {
 	static Bitu zero_count = 0;
 	if (cpuLog) {
 		if (cpuLogCounter>0) {
@@ -2379,6 +2693,7 @@ bool DEBUG_HeavyIsBreakpoint(void) {
 			cpuLogFile.close();
 			DEBUG_ShowMsg("DEBUG: cpu log LOGCPU.TXT created\n");
 			cpuLog = false;
+			DEBUG_UpdateHeavyChecks();
 			DEBUG_EnableDebugger();
 			return true;
 		}
@@ -2396,6 +2711,7 @@ bool DEBUG_HeavyIsBreakpoint(void) {
 
 	if (skipFirstInstruction) {
 		skipFirstInstruction = false;
+		DEBUG_UpdateHeavyChecks();
 		return false;
 	}
 	if (CBreakpoint::CheckBreakpoint(SegValue(cs),reg_eip)) {
@@ -2403,6 +2719,7 @@ bool DEBUG_HeavyIsBreakpoint(void) {
 	}
 	return false;
 }
+//--End of modifications
 
 #endif // HEAVY DEBUG
 
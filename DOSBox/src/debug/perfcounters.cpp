@@ -0,0 +1,199 @@
+/*
+ *  Copyright (C) 2002-2010  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+//--Added to time the emulator's subsystems: see perfcounters.h.
+//The counters themselves belong to the emulation thread and are read without locking;
+//only the published snapshot is shared with other threads.
+
+#include <string.h>
+#include <pthread.h>
+#include <dlfcn.h>
+#include "dosbox.h"
+#include "perfcounters.h"
+#include "mixer.h"
+
+#if defined(__has_include)
+#if __has_include(<os/signpost.h>)
+#include <os/signpost.h>
+#define PERF_SIGNPOSTS 1
+#endif
+#endif
+
+bool perf_enabled=false;
+Bit8u perf_current=PERF_OTHER;
+Bit64u perf_last=0;
+Bit64u perf_ticks[PERF_COUNTER_COUNT];
+
+// The hook that malloc stack logging uses: while it's set, the allocator calls it for every allocation
+// and deallocation in every zone. It isn't in the public headers, so it's looked up when first needed.
+typedef void (PerfMallocLogger)(Bit32u type,uintptr_t arg1,uintptr_t arg2,uintptr_t arg3,uintptr_t result,Bit32u skip);
+#define PERF_MALLOC_LOG_ALLOCATE 2
+
+static struct {
+	volatile bool requested;
+	Bit64u period_start;
+	Bit64u period_length;
+	Bit64u emulated_ms;
+	double seconds_per_tick;
+	Bitu sequence;
+	pthread_mutex_t lock;
+	PerfSnapshot published;
+	pthread_t thread;
+	PerfMallocLogger ** malloc_logger;
+	PerfMallocLogger * previous_logger;
+	Bitu allocations;
+#if PERF_SIGNPOSTS
+	os_log_t log;
+#endif
+} perf={false,0,0,0,0,0,PTHREAD_MUTEX_INITIALIZER};
+
+double PERF_Seconds(Bit64u ticks) {
+	if (!perf.seconds_per_tick) {
+		mach_timebase_info_data_t timebase;
+		mach_timebase_info(&timebase);
+		perf.seconds_per_tick=((double)timebase.numer/(double)timebase.denom)/1000000000.0;
+	}
+	return (double)ticks*perf.seconds_per_tick;
+}
+
+#if PERF_SIGNPOSTS
+static void PERF_BeginSignpost(void) {
+	if (__builtin_available(macOS 10.14, *)) {
+		if (!perf.log) perf.log=os_log_create("net.washboardabs.boxer","Emulation");
+		os_signpost_interval_begin(perf.log,OS_SIGNPOST_ID_EXCLUSIVE,"Emulation");
+	}
+}
+
+static void PERF_EndSignpost(const PerfSnapshot * snapshot) {
+	if (__builtin_available(macOS 10.14, *)) {
+		if (!perf.log) return;
+		if (!snapshot) {
+			os_signpost_interval_end(perf.log,OS_SIGNPOST_ID_EXCLUSIVE,"Emulation");
+			return;
+		}
+		const double * s=snapshot->seconds;
+		os_signpost_interval_end(perf.log,OS_SIGNPOST_ID_EXCLUSIVE,"Emulation",
+			"cpu %.3f callback %.3f io %.3f vga %.3f render %.3f mixer %.3f coalface %.3f idle %.3f other %.3f allocations %ld",
+			s[PERF_CPU],s[PERF_CALLBACK],s[PERF_IO],s[PERF_VGA],s[PERF_RENDER],
+			s[PERF_MIXER],s[PERF_COALFACE],s[PERF_IDLE],s[PERF_OTHER],(long)snapshot->allocations);
+	}
+}
+#endif
+
+// Called on every thread for every allocation while the counters are enabled, so it leaves as soon as it can:
+// only the emulation thread's allocations are counted, and only the emulation thread touches the count.
+static void PERF_LogAllocation(Bit32u type,uintptr_t arg1,uintptr_t arg2,uintptr_t arg3,uintptr_t result,Bit32u skip) {
+	if ((type & PERF_MALLOC_LOG_ALLOCATE) && pthread_equal(pthread_self(),perf.thread)) perf.allocations++;
+	if (perf.previous_logger) perf.previous_logger(type,arg1,arg2,arg3,result,skip+1);
+}
+
+static bool PERF_CountAllocations(bool count) {
+	if (!perf.malloc_logger) {
+		perf.malloc_logger=(PerfMallocLogger **)dlsym(RTLD_DEFAULT,"malloc_logger");
+		if (!perf.malloc_logger) return false;
+	}
+	if (count) {
+		perf.thread=pthread_self();
+		perf.previous_logger=*perf.malloc_logger;
+		*perf.malloc_logger=&PERF_LogAllocation;
+	} else if (*perf.malloc_logger==&PERF_LogAllocation) {
+		*perf.malloc_logger=perf.previous_logger;
+	}
+	return true;
+}
+
+static void PERF_Restart(Bit64u now) {
+	memset(perf_ticks,0,sizeof(perf_ticks));
+	MIXER_TakeChannelTimings(0,0);
+	perf.emulated_ms=0;
+	perf.allocations=0;
+	perf_current=PERF_OTHER;
+	perf_last=now;
+	perf.period_start=now;
+}
+
+static void PERF_Publish(Bit64u now) {
+	PerfSnapshot snapshot;
+	snapshot.sequence=++perf.sequence;
+	snapshot.interval=PERF_Seconds(now-perf.period_start);
+	for (Bitu i=0;i<PERF_COUNTER_COUNT;i++) {
+		snapshot.seconds[i]=PERF_Seconds(perf_ticks[i]);
+		perf_ticks[i]=0;
+	}
+	snapshot.channel_count=MIXER_TakeChannelTimings(snapshot.channels,PERF_MAX_CHANNELS);
+	snapshot.emulated_seconds=perf.emulated_ms/1000.0;
+	snapshot.allocations=perf.malloc_logger ? (Bits)perf.allocations : -1;
+	perf.period_start=now;
+	perf.emulated_ms=0;
+	perf.allocations=0;
+
+	pthread_mutex_lock(&perf.lock);
+	perf.published=snapshot;
+	pthread_mutex_unlock(&perf.lock);
+
+#if PERF_SIGNPOSTS
+	PERF_EndSignpost(&snapshot);
+	PERF_BeginSignpost();
+#endif
+	boxer_performanceCountersDidUpdate();
+}
+
+void PERF_Tick(void) {
+	if (GCC_UNLIKELY(perf.requested!=perf_enabled)) {
+		perf_enabled=perf.requested;
+		if (perf_enabled) {
+			if (!perf.period_length) perf.period_length=(Bit64u)(1.0/PERF_Seconds(1));
+			PERF_CountAllocations(true);
+			PERF_Restart(mach_absolute_time());
+#if PERF_SIGNPOSTS
+			PERF_BeginSignpost();
+#endif
+		} else {
+			PERF_CountAllocations(false);
+#if PERF_SIGNPOSTS
+			PERF_EndSignpost(0);
+#endif
+			pthread_mutex_lock(&perf.lock);
+			perf.published.sequence=0;
+			pthread_mutex_unlock(&perf.lock);
+		}
+	}
+	if (GCC_LIKELY(!perf_enabled)) return;
+	perf.emulated_ms++;
+	Bit64u now=mach_absolute_time();
+	if (now-perf.period_start<perf.period_length) return;
+	// charge the time so far to whatever we're in the middle of
+	PERF_Switch(perf_current);
+	PERF_Publish(perf_last);
+}
+
+void PERF_SetEnabled(bool enabled) {
+	perf.requested=enabled;
+}
+
+bool PERF_IsEnabled(void) {
+	return perf.requested;
+}
+
+bool PERF_GetSnapshot(PerfSnapshot * snapshot) {
+	pthread_mutex_lock(&perf.lock);
+	*snapshot=perf.published;
+	pthread_mutex_unlock(&perf.lock);
+	return snapshot->sequence!=0;
+}
+//--End of modifications
@@ -0,0 +1,171 @@
+/*
+ *  Copyright (C) 2002-2010  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+//--Added to provide a sampling profiler that works without the debugger: see profiler.h.
+//The sampling timer runs on its own serial queue and reads the emulator's state without
+//locking. A sample may therefore occasionally pair a CS with an EIP from a moment later,
+//which is harmless in a statistical profile and keeps the cost to the emulation thread at
+//a couple of byte stores per callback or IO access.
+
+#include <string.h>
+#include <stdlib.h>
+#include <dispatch/dispatch.h>
+#include "dosbox.h"
+#include "profiler.h"
+#include "cpu.h"
+#include "regs.h"
+
+volatile Bit8u profiler_context=PROFILER_GUEST;
+
+// must be a power of 2
+#define PROFILER_TABLE_SIZE		(16384)
+// stop adding new entries once the table is this full, to keep probing short
+#define PROFILER_TABLE_LIMIT	(PROFILER_TABLE_SIZE*3/4)
+
+static struct {
+	dispatch_queue_t queue;
+	dispatch_source_t timer;
+	ProfilerSample * table;
+	Bitu used;
+	Bitu total;
+} profiler;
+
+static Bit8u PROFILER_CurrentCore(void) {
+	CPU_Decoder * decoder=cpudecoder;
+	if (decoder==&CPU_Core_Normal_Run || decoder==&CPU_Core_Normal_Trap_Run) return PROFILER_CORE_NORMAL;
+#if (C_DYNAMIC_X86)
+	if (decoder==&CPU_Core_Dyn_X86_Run || decoder==&CPU_Core_Dyn_X86_Trap_Run) return PROFILER_CORE_DYNAMIC;
+#endif
+#if (C_DYNREC)
+	if (decoder==&CPU_Core_Dynrec_Run || decoder==&CPU_Core_Dynrec_Trap_Run) return PROFILER_CORE_DYNAMIC;
+#endif
+	if (decoder==&CPU_Core_Simple_Run) return PROFILER_CORE_SIMPLE;
+	if (decoder==&CPU_Core_Full_Run) return PROFILER_CORE_FULL;
+	if (decoder==&CPU_Core_Threaded_Run || decoder==&CPU_Core_Threaded_Trap_Run) return PROFILER_CORE_THREADED;
+	return PROFILER_CORE_OTHER;
+}
+
+// called on the profiler queue
+static void PROFILER_TakeSample(void) {
+	Bit16u cs=(Bit16u)SegValue(cs);
+	Bit32u eip=(Bit32u)reg_eip;
+	Bit8u core=PROFILER_CurrentCore();
+	Bit8u context=profiler_context;
+
+	profiler.total++;
+
+	Bitu hash=((Bitu)cs*31+eip)*31+core*PROFILER_CONTEXT_COUNT+context;
+	hash^=(hash>>13);
+	for (Bitu probe=0;probe<PROFILER_TABLE_SIZE;probe++) {
+		ProfilerSample * entry=&profiler.table[(hash+probe)&(PROFILER_TABLE_SIZE-1)];
+		if (!entry->count) {
+			// a new location: drop it if the table is getting too full
+			if (profiler.used>=PROFILER_TABLE_LIMIT) return;
+			entry->cs=cs;
+			entry->eip=eip;
+			entry->core=core;
+			entry->context=context;
+			entry->count=1;
+			profiler.used++;
+			return;
+		}
+		if (entry->cs==cs && entry->eip==eip && entry->core==core && entry->context==context) {
+			entry->count++;
+			return;
+		}
+	}
+}
+
+static int PROFILER_CompareSamples(const void * a,const void * b) {
+	Bitu count_a=((const ProfilerSample *)a)->count;
+	Bitu count_b=((const ProfilerSample *)b)->count;
+	if (count_a>count_b) return -1;
+	if (count_a<count_b) return 1;
+	return 0;
+}
+
+void PROFILER_Start(Bitu interval_usec) {
+	if (!profiler.queue) {
+		profiler.queue=dispatch_queue_create("com.dosbox.profiler",NULL);
+		profiler.table=(ProfilerSample *)calloc(PROFILER_TABLE_SIZE,sizeof(ProfilerSample));
+		if (!profiler.table) E_Exit("Allocating the profiler histogram has failed");
+	}
+	if (profiler.timer) return;
+	if (!interval_usec) interval_usec=1000;
+
+	dispatch_source_t timer=dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER,0,0,profiler.queue);
+	uint64_t interval=(uint64_t)interval_usec*NSEC_PER_USEC;
+	// allow some leeway so the system can coalesce our wakeups
+	dispatch_source_set_timer(timer,dispatch_time(DISPATCH_TIME_NOW,interval),interval,interval/10);
+	dispatch_source_set_event_handler(timer,^{
+		PROFILER_TakeSample();
+	});
+	profiler.timer=timer;
+	dispatch_resume(timer);
+}
+
+void PROFILER_Stop(void) {
+	if (!profiler.timer) return;
+	dispatch_source_cancel(profiler.timer);
+	dispatch_release(profiler.timer);
+	profiler.timer=NULL;
+	// wait for any sample in progress to finish
+	dispatch_sync(profiler.queue,^{});
+}
+
+bool PROFILER_IsRunning(void) {
+	return profiler.timer!=NULL;
+}
+
+void PROFILER_Reset(void) {
+	if (!profiler.queue) return;
+	dispatch_sync(profiler.queue,^{
+		memset(profiler.table,0,PROFILER_TABLE_SIZE*sizeof(ProfilerSample));
+		profiler.used=0;
+		profiler.total=0;
+	});
+}
+
+Bitu PROFILER_GetSamples(ProfilerSample * samples,Bitu max_samples) {
+	if (!profiler.queue) return 0;
+
+	__block Bitu found=0;
+	ProfilerSample * sorted=(ProfilerSample *)malloc(PROFILER_TABLE_SIZE*sizeof(ProfilerSample));
+	if (!sorted) return 0;
+	dispatch_sync(profiler.queue,^{
+		for (Bitu i=0;i<PROFILER_TABLE_SIZE;i++) {
+			if (profiler.table[i].count) sorted[found++]=profiler.table[i];
+		}
+	});
+	qsort(sorted,found,sizeof(ProfilerSample),&PROFILER_CompareSamples);
+
+	if (found>max_samples) found=max_samples;
+	memcpy(samples,sorted,found*sizeof(ProfilerSample));
+	free(sorted);
+	return found;
+}
+
+Bitu PROFILER_GetTotalSamples(void) {
+	if (!profiler.queue) return 0;
+	__block Bitu total=0;
+	dispatch_sync(profiler.queue,^{
+		total=profiler.total;
+	});
+	return total;
+}
+//--End of modifications
@@ -0,0 +1,127 @@
+/*
+ *  Copyright (C) 2002-2010  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+//--Added to mark out intervals for Instruments: see signposts.h.
+//These are called from several threads, so the logs are created once up front.
+
+#include <pthread.h>
+#include "signposts.h"
+
+#if defined(__has_include)
+#if __has_include(<os/signpost.h>)
+#include <os/signpost.h>
+#define SIGNPOSTS_AVAILABLE 1
+#endif
+#endif
+
+#if SIGNPOSTS_AVAILABLE
+
+// the Instruments package matches intervals by these subsystem, category and interval names
+static const char * const signpost_subsystem="net.washboardabs.boxer";
+static const char * const signpost_categories[SIGNPOST_INTERVAL_COUNT]={
+	"Emulation",	// SIGNPOST_FRAME
+	"Audio",		// SIGNPOST_MIXER
+	"Audio",		// SIGNPOST_UNDERRUN
+	"Emulation",	// SIGNPOST_FRAME_HANDOFF
+	"Rendering",	// SIGNPOST_RENDERER
+	"Drives",		// SIGNPOST_DRIVE_IO
+	"Audio",		// SIGNPOST_AUDIO_CALLBACK
+	"Emulation",	// SIGNPOST_CYCLE_ADJUST
+};
+
+static os_log_t signpost_logs[SIGNPOST_INTERVAL_COUNT];
+static pthread_once_t signpost_logs_once=PTHREAD_ONCE_INIT;
+
+static void SIGNPOST_CreateLogs(void) {
+	if (__builtin_available(macOS 10.14, *)) {
+		for (int i=0;i<SIGNPOST_INTERVAL_COUNT;i++)
+			signpost_logs[i]=os_log_create(signpost_subsystem,signpost_categories[i]);
+	}
+}
+
+// os_signpost needs the interval's name as a string literal
+#define SIGNPOST_INTERVAL_CASE(interval,name,action) \
+	case interval: action(log,signpost,name,"%{public}s %{public}s",operation,detail); break;
+
+SignpostID SIGNPOST_Begin(enum SignpostInterval interval,const char * operation,const char * detail) {
+	if (__builtin_available(macOS 10.14, *)) {
+		pthread_once(&signpost_logs_once,SIGNPOST_CreateLogs);
+		os_log_t log=signpost_logs[interval];
+		if (!os_signpost_enabled(log)) return 0;
+		os_signpost_id_t signpost=os_signpost_id_generate(log);
+		if (!operation) operation="";
+		if (!detail) detail="";
+		switch (interval) {
+			SIGNPOST_INTERVAL_CASE(SIGNPOST_FRAME,"Frame",os_signpost_interval_begin)
+			SIGNPOST_INTERVAL_CASE(SIGNPOST_MIXER,"Mix",os_signpost_interval_begin)
+			SIGNPOST_INTERVAL_CASE(SIGNPOST_UNDERRUN,"Underrun",os_signpost_interval_begin)
+			SIGNPOST_INTERVAL_CASE(SIGNPOST_FRAME_HANDOFF,"Frame Handoff",os_signpost_interval_begin)
+			SIGNPOST_INTERVAL_CASE(SIGNPOST_RENDERER,"Render",os_signpost_interval_begin)
+			SIGNPOST_INTERVAL_CASE(SIGNPOST_DRIVE_IO,"Drive IO",os_signpost_interval_begin)
+			SIGNPOST_INTERVAL_CASE(SIGNPOST_AUDIO_CALLBACK,"Audio Callback",os_signpost_interval_begin)
+			SIGNPOST_INTERVAL_CASE(SIGNPOST_CYCLE_ADJUST,"Cycle Adjust",os_signpost_interval_begin)
+			default: return 0;
+		}
+		return signpost;
+	}
+	return 0;
+}
+
+void SIGNPOST_End(enum SignpostInterval interval,SignpostID signpost) {
+	if (!signpost) return;
+	if (__builtin_available(macOS 10.14, *)) {
+		os_log_t log=signpost_logs[interval];
+		const char * operation="";
+		const char * detail="";
+		switch (interval) {
+			SIGNPOST_INTERVAL_CASE(SIGNPOST_FRAME,"Frame",os_signpost_interval_end)
+			SIGNPOST_INTERVAL_CASE(SIGNPOST_MIXER,"Mix",os_signpost_interval_end)
+			SIGNPOST_INTERVAL_CASE(SIGNPOST_UNDERRUN,"Underrun",os_signpost_interval_end)
+			SIGNPOST_INTERVAL_CASE(SIGNPOST_FRAME_HANDOFF,"Frame Handoff",os_signpost_interval_end)
+			SIGNPOST_INTERVAL_CASE(SIGNPOST_RENDERER,"Render",os_signpost_interval_end)
+			SIGNPOST_INTERVAL_CASE(SIGNPOST_DRIVE_IO,"Drive IO",os_signpost_interval_end)
+			SIGNPOST_INTERVAL_CASE(SIGNPOST_AUDIO_CALLBACK,"Audio Callback",os_signpost_interval_end)
+			SIGNPOST_INTERVAL_CASE(SIGNPOST_CYCLE_ADJUST,"Cycle Adjust",os_signpost_interval_end)
+			default: break;
+		}
+	}
+}
+
+int SIGNPOST_Enabled(enum SignpostInterval interval) {
+	if (__builtin_available(macOS 10.14, *)) {
+		pthread_once(&signpost_logs_once,SIGNPOST_CreateLogs);
+		return os_signpost_enabled(signpost_logs[interval]) ? 1 : 0;
+	}
+	return 0;
+}
+
+#else
+
+SignpostID SIGNPOST_Begin(enum SignpostInterval interval,const char * operation,const char * detail) {
+	return 0;
+}
+
+void SIGNPOST_End(enum SignpostInterval interval,SignpostID signpost) {
+}
+
+int SIGNPOST_Enabled(enum SignpostInterval interval) {
+	return 0;
+}
+
+#endif
+//--End of modifications
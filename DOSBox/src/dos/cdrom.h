@@ -147,9 +147,23 @@ private:
 		~BinaryFile();
 		bool read(Bit8u *buffer, int seek, int count);
 		int getLength();
+		//--Added to let isoDrive map the file into memory
+		const char *getPath() const { return path.c_str(); }
+		//--End of modifications
 	private:
 		BinaryFile();
 		std::ifstream *file;
+		//--Added to let isoDrive map the file into memory
+		std::string path;
+		//--End of modifications
+		//--Added to read from a memory mapping of the file where possible, asking the system
+		//to read ahead of us whenever reads run sequentially through the file.
+		void prefetch(int seek, int count);
+		Bit8u *mapping;
+		size_t mappingLength;
+		int lastSeek;		// where the previous read started, or -1
+		size_t prefetchedTo;	// how far through the file we've already asked the system to read
+		//--End of modifications
 	};
 	
 #if defined(C_SDL_SOUND)
@@ -162,11 +176,53 @@ private:
 	private:
 		AudioFile();
 		Sound_Sample *sample;
-		int lastCount;
-		int lastSeek;
+		//--Modified to decode ahead of the player on a thread of its own.
+		//The decoder fills a ring of PCM data starting from wherever the last read left off,
+		//so sequential reads are just copies out of the ring and only a jump elsewhere in the
+		//track has to wait for the decoder to seek. All the ring state is protected by lock.
+		//int lastCount;
+		//int lastSeek;
+		void startDecoding();
+		void stopDecoding();
+		static int decodeThread(void *data);
+		void decode();
+
+		SDL_Thread *decoder;
+		SDL_mutex *lock;
+		SDL_cond *wanted;		// signalled when the decoder has room or a seek to do
+		SDL_cond *decoded;		// signalled when the decoder has added data or seeked
+		Bit8u *ring;
+		int ringStart;			// the byte position in the track of the oldest data in the ring
+		int ringEnd;			// the byte position in the track the decoder has reached
+		int seekTo;				// a byte position for the decoder to jump to, or -1
+		bool ended;
+		bool failed;
+		bool stopping;
+		//--End of modifications
 	};
 #endif
 	
+	//--Added to read tracks out of MAME CHD (compressed hunks of data) images: see cdrom_chd.cpp.
+	//All the tracks of an image share one CHDImage, which owns the file, the hunk map and a small
+	//LRU of decompressed hunks. Each track gets a CHDFile that presents only that track's sectors,
+	//at the track's sector size and without the subcode that CHD stores alongside every frame.
+	class CHDImage;
+	class CHDFile : public TrackFile {
+	public:
+		CHDFile(CHDImage *image, int firstFrame, int frames, int sectorSize, bool audio);
+		~CHDFile();
+		bool read(Bit8u *buffer, int seek, int count);
+		int getLength();
+	private:
+		CHDFile();
+		CHDImage *image;
+		int firstFrame;		// the track's first sector, as a frame number within the image
+		int frames;
+		int sectorSize;
+		bool audio;			// CHD stores audio big-endian, so it has to be swapped on the way out
+	};
+	//--End of modifications
+	
 	struct Track {
 		int number;
 		int attr;
@@ -197,6 +253,12 @@ public:
 	bool	LoadUnloadMedia		(bool unload);
 	bool	ReadSector		(Bit8u *buffer, bool raw, unsigned long sector);
 	bool	HasDataTrack		(void);
+	//--Added to let isoDrive read the first data track straight from a memory mapping of its file.
+	//Returns false if the first track isn't a data track in a binary file. Otherwise sets path to the file,
+	//and offset to where the user data of the track's first sector begins in the file: the user data
+	//of each following sector lies sectorSize bytes further on, for as many sectors as the track has.
+	bool	GetDataTrackLayout	(std::string& path, Bit64u& offset, Bit32u& sectorSize, Bit32u& firstSector, Bit32u& sectors);
+	//--End of modifications
 	
     static	CDROM_Interface_Image* images[26];
     
@@ -221,6 +283,9 @@ private:
 	
 	void 	ClearTracks();
 	bool	LoadIsoFile(char *filename);
+	//--Added to mount CHD images
+	bool	LoadChdFile(char *filename);
+	//--End of modifications
 	bool	CanReadPVD(TrackFile *file, int sectorSize, bool mode2);
 	// cue sheet processing
 	bool	LoadCueSheet(char *cuefile);
@@ -0,0 +1,740 @@
+/*
+ *  Copyright (C) 2002-2011  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+//--Added to mount MAME CHD (compressed hunks of data) CD images.
+//A CHD file is a header, a map with one entry per hunk (a fixed-size run of CD frames),
+//the compressed hunks themselves and a chain of metadata entries describing the tracks.
+//The map is decoded once when the image is opened, so reading a sector costs at most one
+//read of one compressed hunk from the file: decompressed hunks are kept in a small LRU,
+//so the other sectors of that hunk (and sectors that are read repeatedly) come from memory.
+//Only version 5 images without a parent are supported, with hunks that are stored
+//uncompressed or compressed with the zlib or CD zlib codecs.
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
+#include "cdrom.h"
+
+using namespace std;
+
+// the size of every frame in a CD image: a raw sector followed by its subcode
+#define CHD_FRAME_SIZE			(RAW_SECTOR_SIZE + 96)
+#define CHD_SUBCODE_SIZE		96
+// tracks are padded out to a multiple of this many frames
+#define CHD_TRACK_PADDING		4
+// how many decompressed hunks to keep: CD hunks are usually 8 frames, so this is about 2 seconds
+#define CHD_HUNK_CACHE_SIZE		16
+
+#define CHD_V5_HEADER_SIZE		124
+#define CHD_MAP_HEADER_SIZE		16
+
+#define CHD_FOURCC(a,b,c,d)		(((Bit32u)(a) << 24) | ((Bit32u)(b) << 16) | ((Bit32u)(c) << 8) | (Bit32u)(d))
+#define CHD_CODEC_NONE			0
+#define CHD_CODEC_ZLIB			CHD_FOURCC('z','l','i','b')
+#define CHD_CODEC_CD_ZLIB		CHD_FOURCC('c','d','z','l')
+#define CHD_TRACK_METADATA		CHD_FOURCC('C','H','T','R')
+#define CHD_TRACK_METADATA2		CHD_FOURCC('C','H','T','2')
+
+// the kinds of entry in a v5 map
+enum {
+	CHD_COMPRESSION_TYPE_0 = 0,		// compressed with one of the four codecs in the header
+	CHD_COMPRESSION_TYPE_1,
+	CHD_COMPRESSION_TYPE_2,
+	CHD_COMPRESSION_TYPE_3,
+	CHD_COMPRESSION_NONE,			// stored as-is
+	CHD_COMPRESSION_SELF,			// a copy of an earlier hunk
+	CHD_COMPRESSION_PARENT,			// a hunk of the parent image
+	// only used while decoding the compressed map
+	CHD_COMPRESSION_RLE_SMALL,
+	CHD_COMPRESSION_RLE_LARGE,
+	CHD_COMPRESSION_SELF_0,
+	CHD_COMPRESSION_SELF_1,
+	CHD_COMPRESSION_PARENT_SELF,
+	CHD_COMPRESSION_PARENT_0,
+	CHD_COMPRESSION_PARENT_1
+};
+
+static inline Bit32u chd_read16(const Bit8u *p) { return ((Bit32u)p[0] << 8) | p[1]; }
+static inline Bit32u chd_read24(const Bit8u *p) { return ((Bit32u)p[0] << 16) | ((Bit32u)p[1] << 8) | p[2]; }
+static inline Bit32u chd_read32(const Bit8u *p) { return ((Bit32u)p[0] << 24) | chd_read24(p + 1); }
+static inline Bit64u chd_read48(const Bit8u *p) { return ((Bit64u)chd_read16(p) << 32) | chd_read32(p + 2); }
+static inline Bit64u chd_read64(const Bit8u *p) { return ((Bit64u)chd_read32(p) << 32) | chd_read32(p + 4); }
+
+static bool chd_pread(int fd, Bit8u *buffer, size_t length, Bit64u offset)
+{
+	while (length) {
+		ssize_t bytes = pread(fd, buffer, length, (off_t)offset);
+		if (bytes <= 0) return false;
+		buffer += bytes;
+		offset += bytes;
+		length -= bytes;
+	}
+	return true;
+}
+
+// CRC-16/CCITT, which the map is checked with
+static Bit16u chd_crc16(const Bit8u *data, size_t length)
+{
+	Bit16u crc = 0xffff;
+	while (length--) {
+		crc ^= (Bit16u)(*data++) << 8;
+		for (int bit = 0; bit < 8; bit++)
+			crc = (crc & 0x8000) ? (Bit16u)((crc << 1) ^ 0x1021) : (Bit16u)(crc << 1);
+	}
+	return crc;
+}
+
+// Reads MSB-first bits out of the compressed map, reading zeroes past its end.
+class CHDBitReader {
+public:
+	CHDBitReader(const Bit8u *_data, size_t _length) : data(_data), length(_length), position(0) {}
+	Bit32u peek(int bits) const {
+		Bit32u value = 0;
+		for (int i = 0; i < bits; i++) {
+			size_t bit = position + i;
+			Bit8u byte = (bit / 8 < length) ? data[bit / 8] : 0;
+			value = (value << 1) | ((byte >> (7 - bit % 8)) & 1);
+		}
+		return value;
+	}
+	void skip(int bits) { position += bits; }
+	Bit32u read(int bits) { Bit32u value = peek(bits); skip(bits); return value; }
+	bool overflowed() const { return position > length * 8; }
+private:
+	const Bit8u *data;
+	size_t length;
+	size_t position;
+};
+
+// The canonical Huffman decoder that the compression types of the map are coded with:
+// 16 codes of at most 8 bits, with the code lengths themselves run-length coded up front.
+class CHDHuffmanDecoder {
+public:
+	enum { CODES = 16, MAXBITS = 8 };
+
+	bool importTree(CHDBitReader &bits) {
+		int lengthBits = 4;		// enough for MAXBITS up to 15
+		for (int code = 0; code < CODES; ) {
+			Bit32u length = bits.read(lengthBits);
+			if (length != 1) {
+				lengths[code++] = length;
+				continue;
+			}
+			length = bits.read(lengthBits);
+			if (length == 1) {
+				lengths[code++] = length;
+				continue;
+			}
+			int repeat = bits.read(lengthBits) + 3;
+			if (code + repeat > CODES) return false;
+			while (repeat--) lengths[code++] = length;
+		}
+		return buildLookup();
+	}
+
+	Bit32u decode(CHDBitReader &bits) const {
+		Bit16u entry = lookup[bits.peek(MAXBITS)];
+		bits.skip(entry & 0x1f);
+		return entry >> 5;
+	}
+
+private:
+	bool buildLookup() {
+		// assign codes in the order MAME does: longest codes get the lowest values
+		Bit32u histogram[33] = {0};
+		for (int code = 0; code < CODES; code++) {
+			if (lengths[code] > MAXBITS) return false;
+			histogram[lengths[code]]++;
+		}
+		Bit32u start = 0;
+		for (int length = 32; length > 0; length--) {
+			Bit32u next = (start + histogram[length]) >> 1;
+			if (length != 1 && next * 2 != start + histogram[length]) return false;
+			histogram[length] = start;
+			start = next;
+		}
+
+		memset(lookup, 0, sizeof(lookup));
+		for (int code = 0; code < CODES; code++) {
+			Bit32u length = lengths[code];
+			if (!length) continue;
+			Bit32u bits = histogram[length]++;
+			int shift = MAXBITS - length;
+			Bit16u entry = (Bit16u)((code << 5) | length);
+			for (Bit32u i = bits << shift; i < ((bits + 1) << shift); i++) lookup[i] = entry;
+		}
+		return true;
+	}
+
+	Bit32u lengths[CODES];
+	Bit16u lookup[1 << MAXBITS];
+};
+
+// The CD codecs strip the sync header and ECC from mode 1 sectors whose ECC was intact,
+// so those have to be regenerated when the hunk is decompressed.
+static const Bit8u chd_sync_header[12] = { 0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x00 };
+static Bit8u chd_ecc_low[256];
+static Bit8u chd_ecc_high[256];
+
+static void chd_ecc_init()
+{
+	static bool initialized = false;
+	if (initialized) return;
+	for (int i = 0; i < 256; i++) {
+		Bit8u low = (Bit8u)((i << 1) ^ ((i & 0x80) ? 0x11d : 0));
+		chd_ecc_low[i] = low;
+		chd_ecc_high[i ^ low] = (Bit8u)i;
+	}
+	initialized = true;
+}
+
+// Computes one pair of P or Q parity bytes over the header and data of the sector (which start at byte 12),
+// from the elements at the given word offsets in the vector.
+static void chd_ecc_compute(Bit8u *sector, int first, int step, int count, int modulo, Bit8u &parity1, Bit8u &parity2)
+{
+	Bit8u val1 = 0, val2 = 0;
+	int word = first >> 1;
+	for (int i = 0; i < count; i++) {
+		int offset = ((word + i * step) % modulo) * 2 + (first & 1);
+		// mode 2 sectors leave their header out of the ECC
+		Bit8u byte = (sector[15] == 2 && offset < 4) ? 0 : sector[12 + offset];
+		val1 ^= byte;
+		val2 ^= byte;
+		val1 = chd_ecc_low[val1];
+	}
+	val1 = chd_ecc_high[chd_ecc_low[val1] ^ val2];
+	val2 ^= val1;
+	parity1 = val1;
+	parity2 = val2;
+}
+
+static void chd_ecc_generate(Bit8u *sector)
+{
+	// P parity: 86 columns of 24 bytes, each 43 words apart
+	for (int byte = 0; byte < 86; byte++)
+		chd_ecc_compute(sector, byte, 43, 24, 1118, sector[2076 + byte], sector[2076 + 86 + byte]);
+	// Q parity: 52 diagonals of 43 bytes, each 44 words apart, wrapping around the P parity too
+	for (int byte = 0; byte < 52; byte++)
+		chd_ecc_compute(sector, (byte >> 1) * 86 + (byte & 1), 44, 43, 1118, sector[2248 + byte], sector[2248 + 52 + byte]);
+}
+
+class CDROM_Interface_Image::CHDImage {
+public:
+	struct TrackInfo {
+		int number;
+		char type[32];
+		int frames;
+		int pregap;
+		bool pregapInData;
+		int postgap;
+	};
+
+	CHDImage() : fd(-1), hunkBytes(0), framesPerHunk(0), useCount(0), lock(NULL) {
+		memset(&inflater, 0, sizeof(inflater));
+		inflaterReady = false;
+	}
+
+	~CHDImage() {
+		for (size_t i = 0; i < cache.size(); i++) delete[] cache[i].data;
+		if (inflaterReady) inflateEnd(&inflater);
+		if (lock) SDL_DestroyMutex(lock);
+		if (fd >= 0) close(fd);
+	}
+
+	bool open(const char *filename);
+	bool readFrame(int frame, int offset, Bit8u *buffer, int count, bool swap);
+
+	void retain() { useCount++; }
+	void release() { if (--useCount == 0) delete this; }
+
+	vector<TrackInfo> tracks;
+
+private:
+	struct MapEntry {
+		Bit8u type;
+		Bit32u length;
+		Bit64u offset;
+	};
+	struct CachedHunk {
+		Bit32u hunk;
+		Bit32u lastUsed;
+		Bit8u *data;
+	};
+
+	bool readMap(Bit64u mapOffset, Bit32u unitBytes);
+	bool readMetadata(Bit64u metaOffset);
+	Bit8u *hunkData(Bit32u hunk);
+	bool readHunk(Bit32u hunk, Bit8u *dest, int depth);
+	bool inflate(const Bit8u *source, Bit32u sourceLength, Bit8u *dest, Bit32u destLength);
+	bool decompressCD(const Bit8u *source, Bit32u sourceLength, Bit8u *dest);
+
+	int fd;
+	Bit32u compressors[4];
+	Bit32u hunkBytes;
+	Bit32u hunkCount;
+	Bit32u framesPerHunk;
+	vector<MapEntry> map;
+	vector<CachedHunk> cache;
+	Bit32u useClock;
+	vector<Bit8u> compressed;	// scratch space for one compressed hunk
+	vector<Bit8u> sectors;		// scratch space for the sector data of a CD hunk
+	z_stream inflater;
+	bool inflaterReady;
+	int useCount;
+	// the emulation thread and the CD audio player can both be reading from the image
+	SDL_mutex *lock;
+};
+
+bool CDROM_Interface_Image::CHDImage::open(const char *filename)
+{
+	fd = ::open(filename, O_RDONLY);
+	if (fd < 0) return false;
+
+	Bit8u header[CHD_V5_HEADER_SIZE];
+	if (!chd_pread(fd, header, sizeof(header), 0)) return false;
+	if (memcmp(header, "MComprHD", 8) != 0) return false;
+	if (chd_read32(header + 12) != 5 || chd_read32(header + 8) < CHD_V5_HEADER_SIZE) {
+		LOG_MSG("CHD image %s is not a version 5 image: only version 5 is supported", filename);
+		return false;
+	}
+
+	for (int i = 0; i < 4; i++) {
+		compressors[i] = chd_read32(header + 16 + i * 4);
+		if (compressors[i] != CHD_CODEC_NONE && compressors[i] != CHD_CODEC_ZLIB && compressors[i] != CHD_CODEC_CD_ZLIB) {
+			LOG_MSG("CHD image %s uses an unsupported codec: only zlib and cdzl are supported", filename);
+			return false;
+		}
+	}
+	Bit64u logicalBytes = chd_read64(header + 32);
+	Bit64u mapOffset = chd_read64(header + 40);
+	Bit64u metaOffset = chd_read64(header + 48);
+	hunkBytes = chd_read32(header + 56);
+	Bit32u unitBytes = chd_read32(header + 60);
+
+	// a parent SHA1 means the image only holds the differences from another image
+	for (int i = 0; i < 20; i++) {
+		if (header[104 + i]) {
+			LOG_MSG("CHD image %s depends on a parent image, which is not supported", filename);
+			return false;
+		}
+	}
+
+	if (unitBytes != CHD_FRAME_SIZE || !hunkBytes || hunkBytes % CHD_FRAME_SIZE) return false;
+	framesPerHunk = hunkBytes / CHD_FRAME_SIZE;
+	Bit64u hunks = (logicalBytes + hunkBytes - 1) / hunkBytes;
+	if (!hunks || hunks > 0x7fffffff / framesPerHunk) return false;
+	hunkCount = (Bit32u)hunks;
+
+	if (!readMap(mapOffset, unitBytes)) return false;
+	if (!readMetadata(metaOffset)) return false;
+
+	if (inflateInit2(&inflater, -MAX_WBITS) != Z_OK) return false;
+	inflaterReady = true;
+
+	cache.resize(CHD_HUNK_CACHE_SIZE);
+	for (size_t i = 0; i < cache.size(); i++) {
+		cache[i].hunk = 0xffffffff;
+		cache[i].lastUsed = 0;
+		cache[i].data = new Bit8u[hunkBytes];
+	}
+	useClock = 0;
+	compressed.resize(hunkBytes);
+	sectors.resize(framesPerHunk * RAW_SECTOR_SIZE);
+
+	chd_ecc_init();
+	lock = SDL_CreateMutex();
+	return true;
+}
+
+bool CDROM_Interface_Image::CHDImage::readMap(Bit64u mapOffset, Bit32u unitBytes)
+{
+	map.resize(hunkCount);
+
+	// uncompressed images have a plain table of hunk positions, in units of whole hunks
+	if (compressors[0] == CHD_CODEC_NONE) {
+		vector<Bit8u> raw(hunkCount * 4);
+		if (!chd_pread(fd, &raw[0], raw.size(), mapOffset)) return false;
+		for (Bit32u hunk = 0; hunk < hunkCount; hunk++) {
+			Bit64u offset = (Bit64u)chd_read32(&raw[hunk * 4]) * hunkBytes;
+			map[hunk].type = CHD_COMPRESSION_NONE;
+			map[hunk].length = offset ? hunkBytes : 0;
+			map[hunk].offset = offset;
+		}
+		return true;
+	}
+
+	Bit8u mapHeader[CHD_MAP_HEADER_SIZE];
+	if (!chd_pread(fd, mapHeader, sizeof(mapHeader), mapOffset)) return false;
+	Bit32u mapBytes = chd_read32(mapHeader);
+	Bit64u firstOffset = chd_read48(mapHeader + 4);
+	Bit16u mapCRC = (Bit16u)chd_read16(mapHeader + 10);
+	int lengthBits = mapHeader[12];
+	int selfBits = mapHeader[13];
+	int parentBits = mapHeader[14];
+	if (lengthBits > 32 || selfBits > 32 || parentBits > 32) return false;
+
+	vector<Bit8u> packed(mapBytes + 4);
+	if (!chd_pread(fd, &packed[0], mapBytes, mapOffset + CHD_MAP_HEADER_SIZE)) return false;
+	CHDBitReader bits(&packed[0], mapBytes);
+
+	// first pass: the Huffman-coded compression type of each hunk, with runs of repeats
+	CHDHuffmanDecoder decoder;
+	if (!decoder.importTree(bits)) return false;
+	Bit8u lastType = 0;
+	int repeat = 0;
+	for (Bit32u hunk = 0; hunk < hunkCount; hunk++) {
+		if (repeat > 0) {
+			map[hunk].type = lastType;
+			repeat--;
+			continue;
+		}
+		Bit32u value = decoder.decode(bits);
+		if (value == CHD_COMPRESSION_RLE_SMALL) {
+			map[hunk].type = lastType;
+			repeat = 2 + decoder.decode(bits);
+		} else if (value == CHD_COMPRESSION_RLE_LARGE) {
+			map[hunk].type = lastType;
+			repeat = 2 + 16 + (decoder.decode(bits) << 4);
+			repeat += decoder.decode(bits);
+		} else map[hunk].type = lastType = (Bit8u)value;
+	}
+
+	// second pass: the lengths and positions that go with each type, rebuilding the
+	// raw 12-byte map entries as we go so that we can check them against the CRC
+	vector<Bit8u> raw(hunkCount * 12);
+	Bit64u position = firstOffset;
+	Bit64u lastSelf = 0, lastParent = 0;
+	for (Bit32u hunk = 0; hunk < hunkCount; hunk++) {
+		MapEntry &entry = map[hunk];
+		Bit64u offset = position;
+		Bit32u length = 0;
+		Bit16u crc = 0;
+		switch (entry.type) {
+			case CHD_COMPRESSION_TYPE_0:
+			case CHD_COMPRESSION_TYPE_1:
+			case CHD_COMPRESSION_TYPE_2:
+			case CHD_COMPRESSION_TYPE_3:
+				length = bits.read(lengthBits);
+				position += length;
+				crc = (Bit16u)bits.read(16);
+				break;
+			case CHD_COMPRESSION_NONE:
+				length = hunkBytes;
+				position += length;
+				crc = (Bit16u)bits.read(16);
+				break;
+			case CHD_COMPRESSION_SELF:
+				lastSelf = offset = bits.read(selfBits);
+				break;
+			case CHD_COMPRESSION_PARENT:
+				offset = bits.read(parentBits);
+				lastParent = offset;
+				break;
+			case CHD_COMPRESSION_SELF_1:
+				lastSelf++;
+			case CHD_COMPRESSION_SELF_0:
+				entry.type = CHD_COMPRESSION_SELF;
+				offset = lastSelf;
+				break;
+			case CHD_COMPRESSION_PARENT_SELF:
+				entry.type = CHD_COMPRESSION_PARENT;
+				lastParent = offset = ((Bit64u)hunk * hunkBytes) / unitBytes;
+				break;
+			case CHD_COMPRESSION_PARENT_1:
+				lastParent += hunkBytes / unitBytes;
+			case CHD_COMPRESSION_PARENT_0:
+				entry.type = CHD_COMPRESSION_PARENT;
+				offset = lastParent;
+				break;
+			default:
+				return false;
+		}
+		entry.length = length;
+		entry.offset = offset;
+
+		Bit8u *rawEntry = &raw[hunk * 12];
+		rawEntry[0] = entry.type;
+		for (int i = 0; i < 3; i++) rawEntry[1 + i] = (Bit8u)(length >> (16 - i * 8));
+		for (int i = 0; i < 6; i++) rawEntry[4 + i] = (Bit8u)(offset >> (40 - i * 8));
+		rawEntry[10] = (Bit8u)(crc >> 8);
+		rawEntry[11] = (Bit8u)crc;
+	}
+	if (bits.overflowed()) return false;
+	return chd_crc16(&raw[0], raw.size()) == mapCRC;
+}
+
+bool CDROM_Interface_Image::CHDImage::readMetadata(Bit64u metaOffset)
+{
+	// guard against loops in a damaged chain
+	for (int entries = 0; metaOffset && entries < 1024; entries++) {
+		Bit8u header[16];
+		if (!chd_pread(fd, header, sizeof(header), metaOffset)) return false;
+		Bit32u tag = chd_read32(header);
+		Bit32u length = chd_read24(header + 5);
+		Bit64u next = chd_read64(header + 8);
+
+		if ((tag == CHD_TRACK_METADATA || tag == CHD_TRACK_METADATA2) && length < 256) {
+			char text[256];
+			if (!chd_pread(fd, (Bit8u *)text, length, metaOffset + 16)) return false;
+			text[length] = 0;
+
+			TrackInfo track;
+			char subtype[32], pregapType[32], pregapSubtype[32];
+			track.pregap = track.postgap = 0;
+			pregapType[0] = 0;
+			if (tag == CHD_TRACK_METADATA2) {
+				if (sscanf(text, "TRACK:%d TYPE:%31s SUBTYPE:%31s FRAMES:%d PREGAP:%d PGTYPE:%31s PGSUB:%31s POSTGAP:%d",
+						   &track.number, track.type, subtype, &track.frames, &track.pregap,
+						   pregapType, pregapSubtype, &track.postgap) != 8) return false;
+			} else {
+				if (sscanf(text, "TRACK:%d TYPE:%31s SUBTYPE:%31s FRAMES:%d",
+						   &track.number, track.type, subtype, &track.frames) != 4) return false;
+			}
+			// a pregap type starting with V means the pregap's frames are stored in the image
+			track.pregapInData = (pregapType[0] == 'V');
+			if (track.frames < 0 || track.pregap < 0 || track.postgap < 0) return false;
+			if (track.pregapInData && track.pregap > track.frames) return false;
+			tracks.push_back(track);
+		}
+		metaOffset = next;
+	}
+
+	// tracks should be listed in order, starting from 1
+	for (size_t i = 0; i < tracks.size(); i++)
+		if (tracks[i].number != (int)i + 1) return false;
+	return !tracks.empty();
+}
+
+bool CDROM_Interface_Image::CHDImage::inflate(const Bit8u *source, Bit32u sourceLength, Bit8u *dest, Bit32u destLength)
+{
+	if (inflateReset(&inflater) != Z_OK) return false;
+	inflater.next_in = (Bytef *)source;
+	inflater.avail_in = sourceLength;
+	inflater.next_out = dest;
+	inflater.avail_out = destLength;
+	int result = ::inflate(&inflater, Z_FINISH);
+	return (result == Z_STREAM_END || result == Z_OK) && inflater.total_out == destLength;
+}
+
+// The CD zlib codec compresses the sector data of all the hunk's frames as one stream
+// and their subcode as another, after a bitmap of the frames whose sync header and ECC were
+// stripped. We have no use for subcode, so that part is left undecompressed and zeroed.
+bool CDROM_Interface_Image::CHDImage::decompressCD(const Bit8u *source, Bit32u sourceLength, Bit8u *dest)
+{
+	Bit32u eccBytes = (framesPerHunk + 7) / 8;
+	Bit32u lengthBytes = (hunkBytes < 65536) ? 2 : 3;
+	Bit32u headerBytes = eccBytes + lengthBytes;
+	if (sourceLength < headerBytes) return false;
+	Bit32u baseLength = (lengthBytes == 2) ? chd_read16(source + eccBytes) : chd_read24(source + eccBytes);
+	if (baseLength > sourceLength - headerBytes) return false;
+	if (!inflate(source + headerBytes, baseLength, &sectors[0], (Bit32u)sectors.size())) return false;
+
+	for (Bit32u frame = 0; frame < framesPerHunk; frame++) {
+		Bit8u *output = dest + frame * CHD_FRAME_SIZE;
+		memcpy(output, &sectors[frame * RAW_SECTOR_SIZE], RAW_SECTOR_SIZE);
+		memset(output + RAW_SECTOR_SIZE, 0, CHD_SUBCODE_SIZE);
+		if (source[frame / 8] & (1 << (frame % 8))) {
+			memcpy(output, chd_sync_header, sizeof(chd_sync_header));
+			chd_ecc_generate(output);
+		}
+	}
+	return true;
+}
+
+bool CDROM_Interface_Image::CHDImage::readHunk(Bit32u hunk, Bit8u *dest, int depth)
+{
+	const MapEntry &entry = map[hunk];
+	switch (entry.type) {
+		case CHD_COMPRESSION_TYPE_0:
+		case CHD_COMPRESSION_TYPE_1:
+		case CHD_COMPRESSION_TYPE_2:
+		case CHD_COMPRESSION_TYPE_3: {
+			if (entry.length > compressed.size()) return false;
+			if (!chd_pread(fd, &compressed[0], entry.length, entry.offset)) return false;
+			Bit32u codec = compressors[entry.type];
+			if (codec == CHD_CODEC_ZLIB) return inflate(&compressed[0], entry.length, dest, hunkBytes);
+			if (codec == CHD_CODEC_CD_ZLIB) return decompressCD(&compressed[0], entry.length, dest);
+			return false;
+		}
+		case CHD_COMPRESSION_NONE:
+			if (!entry.length) {
+				memset(dest, 0, hunkBytes);
+				return true;
+			}
+			return chd_pread(fd, dest, hunkBytes, entry.offset);
+		case CHD_COMPRESSION_SELF:
+			// a copy refers back to the first occurrence of the hunk, but don't trust that blindly
+			if (entry.offset >= hunkCount || depth > 4) return false;
+			return readHunk((Bit32u)entry.offset, dest, depth + 1);
+		default:
+			return false;
+	}
+}
+
+// Returns the decompressed hunk from the cache, decompressing it over the least recently used one
+// if it isn't there already. Must be called with the lock held.
+Bit8u *CDROM_Interface_Image::CHDImage::hunkData(Bit32u hunk)
+{
+	useClock++;
+	CachedHunk *oldest = &cache[0];
+	for (size_t i = 0; i < cache.size(); i++) {
+		if (cache[i].hunk == hunk) {
+			cache[i].lastUsed = useClock;
+			return cache[i].data;
+		}
+		if (cache[i].lastUsed < oldest->lastUsed) oldest = &cache[i];
+	}
+
+	oldest->hunk = 0xffffffff;
+	if (!readHunk(hunk, oldest->data, 0)) return NULL;
+	oldest->hunk = hunk;
+	oldest->lastUsed = useClock;
+	return oldest->data;
+}
+
+bool CDROM_Interface_Image::CHDImage::readFrame(int frame, int offset, Bit8u *buffer, int count, bool swap)
+{
+	Bit32u hunk = (Bit32u)frame / framesPerHunk;
+	if (frame < 0 || hunk >= hunkCount) return false;
+
+	SDL_mutexP(lock);
+	Bit8u *data = hunkData(hunk);
+	if (data) {
+		const Bit8u *source = data + (frame % framesPerHunk) * CHD_FRAME_SIZE;
+		if (swap) {
+			for (int i = 0; i < count; i++) buffer[i] = source[(offset + i) ^ 1];
+		} else memcpy(buffer, source + offset, count);
+	}
+	SDL_mutexV(lock);
+	return data != NULL;
+}
+
+CDROM_Interface_Image::CHDFile::CHDFile(CHDImage *_image, int _firstFrame, int _frames, int _sectorSize, bool _audio)
+{
+	image = _image;
+	image->retain();
+	firstFrame = _firstFrame;
+	frames = _frames;
+	sectorSize = _sectorSize;
+	audio = _audio;
+}
+
+CDROM_Interface_Image::CHDFile::~CHDFile()
+{
+	image->release();
+}
+
+bool CDROM_Interface_Image::CHDFile::read(Bit8u *buffer, int seek, int count)
+{
+	if (seek < 0 || count < 0) return false;
+	while (count > 0) {
+		int frame = seek / sectorSize;
+		int offset = seek % sectorSize;
+		int todo = sectorSize - offset;
+		if (todo > count) todo = count;
+		// the gap before the next track isn't stored, and reads as silence
+		if (frame >= frames) memset(buffer, 0, todo);
+		else if (!image->readFrame(firstFrame + frame, offset, buffer, todo, audio)) return false;
+		buffer += todo;
+		seek += todo;
+		count -= todo;
+	}
+	return true;
+}
+
+int CDROM_Interface_Image::CHDFile::getLength()
+{
+	return frames * sectorSize;
+}
+
+bool CDROM_Interface_Image::LoadChdFile(char *filename)
+{
+	CHDImage *image = new CHDImage();
+	image->retain();
+	if (!image->open(filename)) {
+		image->release();
+		return false;
+	}
+
+	tracks.clear();
+	Track track = {0, 0, 0, 0, 0, 0, false, NULL};
+	int start = 0;		// where the next track begins on the disc, counting from the first track
+	int frame = 0;		// where the next track's frames begin in the image
+	bool success = true;
+	for (size_t i = 0; i < image->tracks.size(); i++) {
+		const CHDImage::TrackInfo &info = image->tracks[i];
+		string type(info.type);
+		bool audio = false;
+		if (type == "AUDIO") {
+			track.sectorSize = RAW_SECTOR_SIZE;
+			track.attr = 0;
+			track.mode2 = false;
+			audio = true;
+		} else if (type == "MODE1" || type == "MODE2_FORM1") {
+			track.sectorSize = COOKED_SECTOR_SIZE;
+			track.attr = 0x40;
+			track.mode2 = false;
+		} else if (type == "MODE1_RAW") {
+			track.sectorSize = RAW_SECTOR_SIZE;
+			track.attr = 0x40;
+			track.mode2 = false;
+		} else if (type == "MODE2" || type == "MODE2_FORM_MIX") {
+			track.sectorSize = 2336;
+			track.attr = 0x40;
+			track.mode2 = true;
+		} else if (type == "MODE2_RAW") {
+			track.sectorSize = RAW_SECTOR_SIZE;
+			track.attr = 0x40;
+			track.mode2 = true;
+		} else {
+			LOG_MSG("CHD image %s has a track of unsupported type %s", filename, info.type);
+			success = false;
+			break;
+		}
+
+		int storedPregap = info.pregapInData ? info.pregap : 0;
+		track.number = info.number;
+		track.start = start + info.pregap;
+		track.length = info.frames - storedPregap;
+		track.skip = 0;
+		track.file = new CHDFile(image, frame + storedPregap, track.length, track.sectorSize, audio);
+		tracks.push_back(track);
+
+		start = track.start + track.length + info.postgap;
+		frame += info.frames + (CHD_TRACK_PADDING - info.frames % CHD_TRACK_PADDING) % CHD_TRACK_PADDING;
+	}
+	image->release();
+	if (!success) {
+		ClearTracks();
+		return false;
+	}
+
+	// leadout track
+	track.number++;
+	track.attr = 0;
+	track.start = start;
+	track.length = 0;
+	track.skip = 0;
+	track.file = NULL;
+	tracks.push_back(track);
+	return true;
+}
+//--End of modifications
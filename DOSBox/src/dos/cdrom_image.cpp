@@ -27,6 +27,11 @@
 #include <sstream>
 #include <vector>
 #include <sys/stat.h>
+//--Added for mapping binary track files into memory
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+//--End of modifications
 #include "cdrom.h"
 #include "drives.h"
 #include "support.h"
@@ -43,19 +48,89 @@ using namespace std;
 #define MAX_LINE_LENGTH 512
 #define MAX_FILENAME_LENGTH 256
 
+//--Added for mapping binary track files into memory
+// how far ahead of sequential reads to ask the system to read: about 3 seconds at single speed
+#define BINARY_READAHEAD_SIZE	(RAW_SECTOR_SIZE*75*3)
+//--End of modifications
+
 CDROM_Interface_Image::BinaryFile::BinaryFile(const char *filename, bool &error)
 {
 	file = new ifstream(filename, ios::in | ios::binary);
 	error = (file == NULL) || (file->fail());
+	//--Added to let isoDrive map the file into memory
+	path = filename;
+	//--End of modifications
+	
+	//--Added to read from a memory mapping of the file where possible: if the file
+	//can't be mapped, we carry on reading it through the stream as before.
+	mapping = NULL;
+	mappingLength = 0;
+	lastSeek = -1;
+	prefetchedTo = 0;
+	if (!error) {
+		int fd = open(filename, O_RDONLY);
+		if (fd >= 0) {
+			struct stat status;
+			if (fstat(fd, &status) == 0 && S_ISREG(status.st_mode) && status.st_size > 0
+				&& (off_t)(size_t)status.st_size == status.st_size) {
+				void *image = mmap(NULL, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+				if (image != MAP_FAILED) {
+					mapping = (Bit8u *)image;
+					mappingLength = (size_t)status.st_size;
+				}
+			}
+			close(fd);
+		}
+	}
+	//--End of modifications
 }
 
 CDROM_Interface_Image::BinaryFile::~BinaryFile()
 {
+	//--Added to release the file's memory mapping
+	if (mapping) munmap(mapping, mappingLength);
+	//--End of modifications
 	delete file;
 }
 
+//--Added to ask the system to read ahead of sequential reads. Sectors are usually read one at
+//a time and possibly with gaps between them (when reading only the user data of raw sectors),
+//so any read starting no more than a raw sector after the previous one counts as sequential.
+//The system fills in the pages it's asked for in the background, so by the time the reads get
+//there they're just copies out of memory rather than a trip to the disk for every sector.
+void CDROM_Interface_Image::BinaryFile::prefetch(int seek, int count)
+{
+	bool sequential = (lastSeek >= 0 && seek > lastSeek && seek - lastSeek <= RAW_SECTOR_SIZE);
+	lastSeek = seek;
+	if (!sequential) {
+		prefetchedTo = 0;
+		return;
+	}
+	
+	// top up the read-ahead once we're halfway through what we last asked for
+	size_t end = (size_t)seek + count;
+	if (end + BINARY_READAHEAD_SIZE / 2 <= prefetchedTo) return;
+	
+	size_t pageSize = (size_t)getpagesize();
+	size_t start = (prefetchedTo > end) ? prefetchedTo : end;
+	start -= start % pageSize;
+	size_t until = end + BINARY_READAHEAD_SIZE;
+	if (until > mappingLength) until = mappingLength;
+	if (until > start) madvise(mapping + start, until - start, MADV_WILLNEED);
+	prefetchedTo = until;
+}
+//--End of modifications
+
 bool CDROM_Interface_Image::BinaryFile::read(Bit8u *buffer, int seek, int count)
 {
+	//--Added to read straight from the file's memory mapping
+	if (mapping) {
+		if (seek < 0 || count < 0 || (size_t)seek + count > mappingLength) return false;
+		prefetch(seek, count);
+		memcpy(buffer, mapping + seek, count);
+		return true;
+	}
+	//--End of modifications
 	file->seekg(seek, ios::beg);
 	file->read((char*)buffer, count);
 	return !(file->fail());
@@ -70,22 +145,132 @@ int CDROM_Interface_Image::BinaryFile::getLength()
 }
 
 #if defined(C_SDL_SOUND)
+//--Added for decoding audio tracks ahead of the player
+// how much decoded audio to keep ready: 2 seconds of CD audio
+#define AUDIO_RING_SIZE		(RAW_SECTOR_SIZE*75*2)
+// how much the decoder decodes at once
+#define AUDIO_DECODE_SIZE	(RAW_SECTOR_SIZE*16)
+//--End of modifications
+
 CDROM_Interface_Image::AudioFile::AudioFile(const char *filename, bool &error)
 {
 	Sound_AudioInfo desired = {AUDIO_S16, 2, 44100};
 	sample = Sound_NewSampleFromFile(filename, &desired, RAW_SECTOR_SIZE);
-	lastCount = RAW_SECTOR_SIZE;
-	lastSeek = 0;
+	//--Modified to set up the decode-ahead state, leaving the decoder itself until the track is first read
+	//lastCount = RAW_SECTOR_SIZE;
+	//lastSeek = 0;
+	decoder = NULL;
+	lock = NULL;
+	wanted = NULL;
+	decoded = NULL;
+	ring = NULL;
+	ringStart = 0;
+	ringEnd = 0;
+	seekTo = -1;
+	ended = false;
+	failed = false;
+	stopping = false;
+	//--End of modifications
 	error = (sample == NULL);
 }
 
 CDROM_Interface_Image::AudioFile::~AudioFile()
 {
+	//--Added to shut down the decoder before the sample goes away
+	stopDecoding();
+	if (decoded) SDL_DestroyCond(decoded);
+	if (wanted) SDL_DestroyCond(wanted);
+	if (lock) SDL_DestroyMutex(lock);
+	delete[] ring;
+	//--End of modifications
 	Sound_FreeSample(sample);
 }
 
+//--Added to run the decode-ahead thread
+void CDROM_Interface_Image::AudioFile::startDecoding()
+{
+	if (!ring) {
+		ring = new Bit8u[AUDIO_RING_SIZE];
+		lock = SDL_CreateMutex();
+		wanted = SDL_CreateCond();
+		decoded = SDL_CreateCond();
+	}
+	Sound_SetBufferSize(sample, AUDIO_DECODE_SIZE);
+	stopping = false;
+	decoder = SDL_CreateThread(&decodeThread, this);
+}
+
+void CDROM_Interface_Image::AudioFile::stopDecoding()
+{
+	if (!decoder) return;
+	SDL_mutexP(lock);
+	stopping = true;
+	SDL_CondSignal(wanted);
+	SDL_mutexV(lock);
+	SDL_WaitThread(decoder, NULL);
+	decoder = NULL;
+}
+
+int CDROM_Interface_Image::AudioFile::decodeThread(void *data)
+{
+	((AudioFile *)data)->decode();
+	return 0;
+}
+
+// The sample is only touched outside the lock, and only by this thread while it is running.
+void CDROM_Interface_Image::AudioFile::decode()
+{
+	SDL_mutexP(lock);
+	while (!stopping) {
+		if (seekTo >= 0) {
+			int target = seekTo;
+			seekTo = -1;
+			SDL_mutexV(lock);
+			int success = Sound_Seek(sample, (int)((double)(target) / 176.4f));
+			SDL_mutexP(lock);
+			// a newer seek came in while we were busy
+			if (seekTo >= 0) continue;
+			ringStart = ringEnd = target;
+			ended = failed = !success;
+			SDL_CondSignal(decoded);
+			continue;
+		}
+		if (ended || failed || (ringEnd - ringStart) > (AUDIO_RING_SIZE - AUDIO_DECODE_SIZE)) {
+			SDL_CondWait(wanted, lock);
+			continue;
+		}
+
+		SDL_mutexV(lock);
+		int bytes = Sound_Decode(sample);
+		Uint32 flags = sample->flags;
+		SDL_mutexP(lock);
+		// throw away what we decoded if the player has jumped elsewhere meanwhile
+		if (seekTo >= 0) continue;
+
+		const Bit8u *input = (const Bit8u *)sample->buffer;
+		int left = bytes;
+		while (left > 0) {
+			int pos = ringEnd % AUDIO_RING_SIZE;
+			int todo = AUDIO_RING_SIZE - pos;
+			if (todo > left) todo = left;
+			memcpy(&ring[pos], input, todo);
+			input += todo;
+			ringEnd += todo;
+			left -= todo;
+		}
+		if (!bytes || (flags & (SOUND_SAMPLEFLAG_EOF | SOUND_SAMPLEFLAG_ERROR))) ended = true;
+		if (flags & SOUND_SAMPLEFLAG_ERROR) failed = true;
+		SDL_CondSignal(decoded);
+	}
+	SDL_mutexV(lock);
+}
+//--End of modifications
+
 bool CDROM_Interface_Image::AudioFile::read(Bit8u *buffer, int seek, int count)
 {
+	//--Modified to read from the decode-ahead ring, only seeking when the player jumps
+	//elsewhere in the track: count must be well under AUDIO_RING_SIZE.
+	/*
 	if (lastCount != count) {
 		int success = Sound_SetBufferSize(sample, count);
 		if (!success) return false;
@@ -104,6 +289,41 @@ bool CDROM_Interface_Image::AudioFile::read(Bit8u *buffer, int seek, int count)
 	}
 	
 	return !(sample->flags & SOUND_SAMPLEFLAG_ERROR);
+	*/
+	if (!decoder) startDecoding();
+
+	SDL_mutexP(lock);
+	if (seek < ringStart || seek > ringEnd) {
+		seekTo = seek;
+		ringEnd = seek;
+		ended = failed = false;
+	}
+	// everything before this read can go, leaving room for the decoder
+	ringStart = seek;
+	SDL_CondSignal(wanted);
+	while (!failed && (seekTo >= 0 || (!ended && ringEnd < seek + count)))
+		SDL_CondWait(decoded, lock);
+
+	int bytes = ringEnd - seek;
+	if (bytes > count) bytes = count;
+	if (bytes < 0) bytes = 0;
+	Bit8u *output = buffer;
+	int pos = seek;
+	int left = bytes;
+	while (left > 0) {
+		int offset = pos % AUDIO_RING_SIZE;
+		int todo = AUDIO_RING_SIZE - offset;
+		if (todo > left) todo = left;
+		memcpy(output, &ring[offset], todo);
+		output += todo;
+		pos += todo;
+		left -= todo;
+	}
+	memset(buffer + bytes, 0, count - bytes);
+	bool success = !failed;
+	SDL_mutexV(lock);
+	return success;
+	//--End of modifications
 }
 
 int CDROM_Interface_Image::AudioFile::getLength()
@@ -112,6 +332,14 @@ int CDROM_Interface_Image::AudioFile::getLength()
 	int shift = 0;
 	if (!(sample->flags & SOUND_SAMPLEFLAG_CANSEEK)) return -1;
 	
+	//--Added to take the sample back from the decoder, since finding the length moves it around:
+	//make the next read start afresh with a seek
+	if (decoder) {
+		stopDecoding();
+		ringStart = ringEnd = -1;
+	}
+	//--End of modifications
+	
 	while (true) {
 		int success = Sound_Seek(sample, (unsigned int)(shift + time));
 		if (!success) {
@@ -164,6 +392,9 @@ void CDROM_Interface_Image::InitNewMedia()
 bool CDROM_Interface_Image::SetDevice(char* path, int forceCD)
 {
 	if (LoadCueSheet(path)) return true;
+	//--Added to mount CHD images
+	if (LoadChdFile(path)) return true;
+	//--End of modifications
 	if (LoadIsoFile(path)) return true;
 	
     //--Disabled 2012-11-07 by Alun Bestor: this is already covered by our own error messages.
@@ -267,20 +498,69 @@ void CDROM_Interface_Image::ChannelControl(TCtrl ctrl)
 	player.ctrlData = ctrl;
 }
 
+//--Added to read sectors into a buffer that's kept from one read to the next, rather than
+//allocating a new one for every read: it only grows when a read is larger than any before.
+static Bit8u* readSectorsBuffer = NULL;
+static Bitu readSectorsBufferSize = 0;
+
+static Bit8u* CDROM_ReadSectorsBuffer(Bitu size) {
+	if (size > readSectorsBufferSize) {
+		delete[] readSectorsBuffer;
+		readSectorsBuffer = new Bit8u[size];
+		readSectorsBufferSize = size;
+	}
+	return readSectorsBuffer;
+}
+//--End of modifications
+
 bool CDROM_Interface_Image::ReadSectors(PhysPt buffer, bool raw, unsigned long sector, unsigned long num)
 {
 	int sectorSize = raw ? RAW_SECTOR_SIZE : COOKED_SECTOR_SIZE;
 	Bitu buflen = num * sectorSize;
-	Bit8u* buf = new Bit8u[buflen];
+	//--Modified to reuse the same buffer from one read to the next
+	//Bit8u* buf = new Bit8u[buflen];
+	Bit8u* buf = CDROM_ReadSectorsBuffer(buflen);
+	//--End of modifications
 	
 	bool success = true; //Gobliiins reads 0 sectors
+	//--Modified to look up the track once for each run of sectors within it, and read the whole
+	//run from the track's file in one go when its sectors hold exactly what was asked for: so a
+	//large MSCDEX read turns into one host read rather than one per sector.
+	/*
 	for(unsigned long i = 0; i < num; i++) {
 		success = ReadSector(&buf[i * sectorSize], raw, sector + i);
 		if (!success) break;
 	}
+	*/
+	unsigned long done = 0;
+	while (done < num) {
+		int track = GetTrack(sector + done) - 1;
+		if (track < 0 || (tracks[track].sectorSize != RAW_SECTOR_SIZE && raw)) { success = false; break; }
+		
+		// GetTrack never returns the leadout track, so there is always a next track
+		unsigned long run = tracks[track + 1].start - (sector + done);
+		if (run > num - done) run = num - done;
+		
+		if (tracks[track].sectorSize == sectorSize) {
+			int seek = tracks[track].skip + (sector + done - tracks[track].start) * tracks[track].sectorSize;
+			success = tracks[track].file->read(&buf[done * sectorSize], seek, run * sectorSize);
+			if (!success) break;
+		} else {
+			// raw tracks read cooked: each sector's user data lies between its header and its ECC
+			for (unsigned long i = 0; i < run; i++) {
+				success = ReadSector(&buf[(done + i) * sectorSize], raw, sector + done + i);
+				if (!success) break;
+			}
+			if (!success) break;
+		}
+		done += run;
+	}
+	//--End of modifications
     
 	MEM_BlockWrite(buffer, buf, buflen);
-	delete[] buf;
+	//--Disabled now that the buffer is reused
+	//delete[] buf;
+	//--End of modifications
     
 	return success;
 }
@@ -304,6 +584,28 @@ int CDROM_Interface_Image::GetTrack(int sector)
 	return -1;
 }
 
+//--Added to let isoDrive map the data track into memory: this must agree with ReadSector below
+bool CDROM_Interface_Image::GetDataTrackLayout(std::string& path, Bit64u& offset, Bit32u& sectorSize, Bit32u& firstSector, Bit32u& sectors)
+{
+	// there is always a leadout track after the last real one
+	if (tracks.size() < 2 || tracks[0].attr != 0x40) return false;
+	BinaryFile *file = dynamic_cast<BinaryFile *>(tracks[0].file);
+	// only cover the sectors that ReadSector would look for in this track
+	int length = tracks[0].length;
+	if (tracks[1].start - tracks[0].start < length) length = tracks[1].start - tracks[0].start;
+	if (!file || length <= 0) return false;
+	
+	path = file->getPath();
+	offset = tracks[0].skip;
+	if (tracks[0].sectorSize == RAW_SECTOR_SIZE && !tracks[0].mode2) offset += 16;
+	if (tracks[0].mode2) offset += 24;
+	sectorSize = tracks[0].sectorSize;
+	firstSector = tracks[0].start;
+	sectors = length;
+	return true;
+}
+//--End of modifications
+
 bool CDROM_Interface_Image::ReadSector(Bit8u *buffer, bool raw, unsigned long sector)
 {
 	int track = GetTrack(sector) - 1;
@@ -62,8 +62,18 @@ bool device_CON::Read(Bit8u * data,Bit16u * size) {
 		readcache=0;
 	}
 	while (*size>count) {
-		reg_ah=(IS_EGAVGA_ARCH)?0x10:0x0;
-		CALLBACK_RunRealInt(0x16);
+		//--Modified to hand pasted keys straight to DOS line input (such as the shell prompt
+		//and COPY CON), rather than going through an INT 16h call for each one.
+		//Keys already waiting in the BIOS buffer are read first to keep everything in order.
+		Bit16u pastedKey;
+		if (mem_readw(BIOS_KEYBOARD_BUFFER_HEAD)==mem_readw(BIOS_KEYBOARD_BUFFER_TAIL) &&
+			boxer_getNextKeyCodeInPasteBuffer(&pastedKey, true)) {
+			reg_ax=pastedKey;
+		} else {
+			reg_ah=(IS_EGAVGA_ARCH)?0x10:0x0;
+			CALLBACK_RunRealInt(0x16);
+		}
+		//--End of modifications
         
         //--Added 2012-08-19 by Alun Bestor to let Boxer interrupt STDIN keyboard input listening
         if (!boxer_continueListeningForKeyEvents())
@@ -138,6 +148,17 @@ bool device_CON::Write(Bit8u * data,Bit16u * size) {
 				count++;
 				continue;
 			} else { 
+				//--Added to write runs of ordinary characters to the screen in one go:
+				//this stops at the first control character, which is left to the code below
+				Bitu run=0;
+				while ((count+run<*size) && (data[count+run]!='\033')) run++;
+				Bitu written=INT10_TeletypeOutputString(&data[count],run,ansi.attr,ansi.enabled);
+				if (written) {
+					count+=(Bit16u)written;
+					lastwrite=data[count-1];
+					continue;
+				}
+				//--End of modifications
 				/* Some sort of "hack" now that \n doesn't set col to 0 (int10_char.cpp old chessgame) */
 				if((data[count] == '\n') && (lastwrite != '\r')) INT10_TeletypeOutputAttr('\r',ansi.attr,ansi.enabled);
 				/* pass attribute only if ansi is enabled */
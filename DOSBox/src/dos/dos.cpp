@@ -586,8 +586,14 @@ static Bitu DOS_21Handler(void) {
 		{ 
 			Bit16u toread=reg_cx;
 			dos.echo=true;
-			if (DOS_ReadFile(reg_bx,dos_copybuf,&toread)) {
-				MEM_BlockWrite(SegPhys(ds)+reg_dx,dos_copybuf,toread);
+			//--Modified to read files straight into guest memory when it is contiguous host RAM:
+			//devices may run guest code while reading, so they still go through dos_copybuf.
+			HostPt direct=0;
+			if (toread && !DOS_IsDeviceHandle(reg_bx))
+				direct=MEM_GetBlockHostPt(SegPhys(ds)+reg_dx,toread,true);
+			if (DOS_ReadFile(reg_bx,direct ? direct : dos_copybuf,&toread)) {
+				if (!direct) MEM_BlockWrite(SegPhys(ds)+reg_dx,dos_copybuf,toread);
+			//--End of modifications
 				reg_ax=toread;
 				CALLBACK_SCF(false);
 			} else {
@@ -601,8 +607,13 @@ static Bitu DOS_21Handler(void) {
 	case 0x40:					/* WRITE Write to file or device */
 		{
 			Bit16u towrite=reg_cx;
-			MEM_BlockRead(SegPhys(ds)+reg_dx,dos_copybuf,towrite);
-			if (DOS_WriteFile(reg_bx,dos_copybuf,&towrite)) {
+			//--Modified to write files straight from guest memory when it is contiguous host RAM
+			HostPt direct=0;
+			if (towrite && !DOS_IsDeviceHandle(reg_bx))
+				direct=MEM_GetBlockHostPt(SegPhys(ds)+reg_dx,towrite,false);
+			if (!direct) MEM_BlockRead(SegPhys(ds)+reg_dx,dos_copybuf,towrite);
+			if (DOS_WriteFile(reg_bx,direct ? direct : dos_copybuf,&towrite)) {
+			//--End of modifications
 				reg_ax=towrite;
 	   			CALLBACK_SCF(false);
 			} else {
@@ -1095,6 +1106,13 @@ static Bitu DOS_20Handler(void) {
 	return CBRET_NONE;
 }
 
+//--Added to treat repeated DOS idle calls as the guest idling
+static Bitu DOS_28Handler(void) {
+	CPU_IdlePoll();
+	return CBRET_NONE;
+}
+//--End of modifications
+
 static Bitu DOS_27Handler(void) {
 	// Terminate & stay resident
 	Bit16u para = (reg_dx/16)+((reg_dx % 16)>0);
@@ -1129,6 +1147,20 @@ static Bitu DOS_26Handler(void) {
 }
 
 
+//--Added to let a restored snapshot pick up the current date and time:
+//factored out of the DOS module's constructor.
+void DOS_SyncDateTimeWithHost(void) {
+	time_t curtime;struct tm *loctime;
+	curtime = time (NULL);loctime = localtime (&curtime);
+
+	dos.date.day=(Bit8u)loctime->tm_mday;
+	dos.date.month=(Bit8u)loctime->tm_mon+1;
+	dos.date.year=(Bit16u)loctime->tm_year+1900;
+	Bit32u ticks=(Bit32u)((loctime->tm_hour*3600+loctime->tm_min*60+loctime->tm_sec)*(float)PIT_TICK_RATE/65536.0);
+	mem_writed(BIOS_TIMER,ticks);
+}
+//--End of modifications
+
 class DOS:public Module_base{
 private:
 	CALLBACK_HandlerObject callback[7];
@@ -1154,7 +1186,9 @@ public:
 		callback[4].Install(DOS_27Handler,CB_IRET,"DOS Int 27");
 		callback[4].Set_RealVec(0x27);
 
-		callback[5].Install(NULL,CB_IRET,"DOS Int 28");
+		//--Modified to treat repeated DOS idle calls as the guest idling
+		callback[5].Install(DOS_28Handler,CB_IRET,"DOS Int 28");
+		//--End of modifications
 		callback[5].Set_RealVec(0x28);
 
 		callback[6].Install(NULL,CB_INT29,"CON Output Int 29");
@@ -1180,16 +1214,121 @@ public:
 		dos.version.minor=0;
 	
 		/* Setup time and date */
-		time_t curtime;struct tm *loctime;
-		curtime = time (NULL);loctime = localtime (&curtime);
-	
-		dos.date.day=(Bit8u)loctime->tm_mday;
-		dos.date.month=(Bit8u)loctime->tm_mon+1;
-		dos.date.year=(Bit16u)loctime->tm_year+1900;
-		Bit32u ticks=(Bit32u)((loctime->tm_hour*3600+loctime->tm_min*60+loctime->tm_sec)*(float)PIT_TICK_RATE/65536.0);
-		mem_writed(BIOS_TIMER,ticks);
+		//--Modified to share this with save states
+		DOS_SyncDateTimeWithHost();
+		//--End of modifications
+
+		SAVESTATE_Register("dos",this);	//--Added for save states
+	}
+
+	//--Added for save states. Most of DOS's state lives in guest memory and is restored with it:
+	//what's kept here is the kernel block, each drive's current directory, and the open file table.
+	//Open files are reopened by name and seeked back to where they were; the files themselves are
+	//not part of the snapshot, so any changes written to them since are not undone.
+	//Drives are not mounted or unmounted: a file on a drive that has since gone away is left closed.
+	void SaveState(std::ostream& stream) {
+		DOS_Block saved=dos;
+		saved.tables.country=NULL;
+		SAVESTATE_Write(stream,saved);
+
+		for (Bitu i=0;i<DOS_DRIVES;i++) {
+			Bit8u present=(Drives[i]!=NULL);
+			SAVESTATE_Write(stream,present);
+			if (present) SAVESTATE_WriteString(stream,Drives[i]->curdir);
+		}
+
+		for (Bitu i=0;i<DOS_FILES;i++) {
+			DOS_File * file=Files[i];
+			Bit8u present=(file && file->GetName());
+			SAVESTATE_Write(stream,present);
+			if (!present) continue;
+			Bit32u pos=0;
+			if (file->IsOpen()) file->Seek(&pos,DOS_SEEK_CUR);
+			SAVESTATE_WriteString(stream,file->GetName());
+			SAVESTATE_Write(stream,file->GetDrive());
+			SAVESTATE_Write(stream,file->flags);
+			SAVESTATE_Write(stream,file->time);
+			SAVESTATE_Write(stream,file->date);
+			SAVESTATE_Write(stream,file->attr);
+			SAVESTATE_Write(stream,(Bit32s)file->refCtr);
+			SAVESTATE_Write(stream,file->open);
+			SAVESTATE_Write(stream,pos);
+		}
+	}
+	void LoadState(std::istream& stream) {
+		Bit8u * country=dos.tables.country;
+		SAVESTATE_Read(stream,dos);
+		dos.tables.country=country;
+
+		for (Bitu i=0;i<DOS_DRIVES;i++) {
+			Bit8u present=0;
+			SAVESTATE_Read(stream,present);
+			if (!present) continue;
+			std::string curdir;
+			SAVESTATE_ReadString(stream,curdir);
+			if (Drives[i] && curdir.size()<DOS_PATHLENGTH) Drives[i]->SetDir(curdir.c_str());
+		}
+
+		for (Bitu i=0;i<DOS_FILES;i++) {
+			if (Files[i]) {
+				Files[i]->refCtr=1;
+				if (Files[i]->IsOpen()) Files[i]->Close();
+				delete Files[i];
+				Files[i]=NULL;
+			}
+		}
+		for (Bitu i=0;i<DOS_FILES;i++) {
+			Bit8u present=0;
+			SAVESTATE_Read(stream,present);
+			if (!stream) return;
+			if (!present) continue;
+			std::string name;
+			Bit8u drive=0xff;
+			Bit32u flags=0,pos=0;
+			Bit16u time=0,date=0,attr=0;
+			Bit32s refCtr=0;
+			bool open=false;
+			SAVESTATE_ReadString(stream,name);
+			SAVESTATE_Read(stream,drive);
+			SAVESTATE_Read(stream,flags);
+			SAVESTATE_Read(stream,time);
+			SAVESTATE_Read(stream,date);
+			SAVESTATE_Read(stream,attr);
+			SAVESTATE_Read(stream,refCtr);
+			SAVESTATE_Read(stream,open);
+			SAVESTATE_Read(stream,pos);
+			if (!stream) return;
+
+			if (drive==0xff) {
+				Bit8u devnum=DOS_FindDevice(name.c_str());
+				if (devnum!=DOS_DEVICES) Files[i]=new DOS_Device(*Devices[devnum]);
+			} else if (drive<DOS_DRIVES && Drives[drive]) {
+				if (Drives[drive]->FileOpen(&Files[i],name.c_str(),flags)) Files[i]->SetDrive(drive);
+				else Files[i]=NULL;
+			}
+			if (!Files[i]) {
+				LOG_MSG("SAVESTATE:Could not reopen %s, leaving it closed",name.c_str());
+				continue;
+			}
+			Files[i]->flags=flags;
+			Files[i]->time=time;
+			Files[i]->date=date;
+			Files[i]->attr=attr;
+			Files[i]->refCtr=refCtr;
+			if (open) Files[i]->Seek(&pos,DOS_SEEK_SET);
+			else if (Files[i]->IsOpen()) {
+				//the handle had been closed but was still referenced: match that
+				Bits refs=Files[i]->refCtr;
+				Files[i]->refCtr=1;
+				Files[i]->Close();
+				Files[i]->refCtr=refs;
+			}
+		}
 	}
+	//--End of modifications
+
 	~DOS(){
+		SAVESTATE_Unregister(this);	//--Added for save states
 		//--Modified 2009-12-20 by Alun Bestor to properly clear the devices list on shutdown.
 		//We could also do this with Files, but DOS_SetupFiles() already does this.
 		Bit16u i;
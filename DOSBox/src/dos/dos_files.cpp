@@ -43,6 +43,7 @@
 
 DOS_File * Files[DOS_FILES];
 DOS_Drive * Drives[DOS_DRIVES];
+Bitu dos_files_generation = 0;	//--Added
 
 Bit8u DOS_GetDefaultDrive(void) {
 //	return DOS_SDA(DOS_SDA_SEG,DOS_SDA_OFS).GetDrive();
@@ -288,7 +289,10 @@ bool DOS_Rename(char const * const oldname,char const * const newname) {
 		return false;
 	}
 
-	if (Drives[drivenew]->Rename(fullold,fullnew)) return true;
+	if (Drives[drivenew]->Rename(fullold,fullnew)) {
+		dos_files_generation++;	//--Added
+		return true;
+	}
 	/* If it still fails. which error should we give ? PATH NOT FOUND or EACCESS */
 	LOG(LOG_FILES,LOG_NORMAL)("Rename fails for %s to %s, no proper errorcode returned.",oldname,newname);
 	DOS_SetError(DOSERR_FILE_NOT_FOUND);
@@ -392,9 +396,20 @@ bool DOS_WriteFile(Bit16u entry,Bit8u * data,Bit16u * amount) {
 	Bit16u towrite=*amount;
 	bool ret=Files[handle]->Write(data,&towrite);
 	*amount=towrite;
+	//--Added to mark cached files as stale; writes to the console and other devices don't count
+	if (!(Files[handle]->GetInformation() & 0x8000)) dos_files_generation++;
+	//--End of modifications
 	return ret;
 }
 
+//--Added to tell INT 21h reads and writes which handles may skip dos_copybuf
+bool DOS_IsDeviceHandle(Bit16u entry) {
+	Bit32u handle=RealHandle(entry);
+	if (handle>=DOS_FILES || !Files[handle] || !Files[handle]->IsOpen()) return true;
+	return (Files[handle]->GetInformation() & 0x8000)!=0;
+}
+//--End of modifications
+
 bool DOS_SeekFile(Bit16u entry,Bit32u * pos,Bit32u type) {
 	Bit32u handle=RealHandle(entry);
 	if (handle>=DOS_FILES) {
@@ -444,6 +459,15 @@ bool DOS_FlushFile(Bit16u entry) {
 	return true;
 }
 
+//--Added to push every open file's writes out to the host, for when the emulator is about to be
+//torn down without closing its files
+void DOS_FlushAllFiles(void) {
+	for (Bitu i=0;i<DOS_FILES;i++) {
+		if (Files[i] && Files[i]->IsOpen()) Files[i]->Flush();
+	}
+}
+//--End of modifications
+
 static bool PathExists(char const * const name) {
 	const char* leading = strrchr(name,'\\');
 	if(!leading) return true;
@@ -497,6 +521,7 @@ bool DOS_CreateFile(char const * name,Bit16u attributes,Bit16u * entry) {
 		Files[handle]->SetDrive(drive);
 		Files[handle]->AddRef();
 		psp.SetFileHandle(*entry,handle);
+		dos_files_generation++;	//--Added
 		return true;
 	} else {
 		if(!PathExists(name)) DOS_SetError(DOSERR_PATH_NOT_FOUND); 
@@ -622,6 +647,7 @@ bool DOS_UnlinkFile(char const * const name) {
 	char fullname[DOS_PATHLENGTH];Bit8u drive;
 	if (!DOS_MakeName(name,fullname,&drive)) return false;
 	if(Drives[drive]->FileUnlink(fullname)){
+		dos_files_generation++;	//--Added
 		return true;
 	} else {
 		DOS_SetError(DOSERR_FILE_NOT_FOUND);
@@ -215,7 +215,7 @@ static Bit32u read_kcl_file(const char* kcl_file_name, const char* layout_id, bo
 	return 0;
 }
 
-static Bit32u read_kcl_data(Bit8u * kcl_data, Bit32u kcl_data_size, const char* layout_id, bool first_id_only) {
+static Bit32u read_kcl_data(const Bit8u * kcl_data, Bit32u kcl_data_size, const char* layout_id, bool first_id_only) {
 	// check ID-bytes
 	if ((kcl_data[0]!=0x4b) || (kcl_data[1]!=0x43) || (kcl_data[2]!=0x46)) {
 		return 0;
@@ -698,6 +698,64 @@ Bit16u keyboard_layout::extract_codepage(const char* keyboard_file_name) {
 	return 437;
 }
 
+//--Added to unpack each of the built-in codepage files only once. Unpacking one means running its
+//UPX stub on the emulated CPU, so the unpacked files are kept for the rest of the session, and in
+//Boxer's cache between sessions under a name that includes a checksum of the packed file.
+struct BuiltinCodepageFile {
+	const char * name;
+	const Bit8u * data;
+	Bit32u size;
+	Bit8u * unpacked;
+};
+static BuiltinCodepageFile builtin_codepage_files[]={
+	{ "EGA.CPX",	font_ega_cpx,	sizeof(font_ega_cpx),	0 },
+	{ "EGA3.CPX",	font_ega3_cpx,	sizeof(font_ega3_cpx),	0 },
+	{ "EGA5.CPX",	font_ega5_cpx,	sizeof(font_ega5_cpx),	0 },
+};
+
+static const char * builtin_codepage_cache_path(BuiltinCodepageFile * file) {
+	// FNV-1a, to tell apart the files of different builds
+	Bit32u hash=2166136261u;
+	for (Bitu i=0; i<file->size; i++) hash=(hash^file->data[i])*16777619u;
+	char cache_name[64];
+	sprintf(cache_name, "%s-%08X.CPI", file->name, hash);
+	return boxer_cachePathForFile(cache_name);
+}
+
+static bool read_cached_codepage_file(BuiltinCodepageFile * file, Bit8u * cpi_buf) {
+	if (!file->unpacked) {
+		const char * cache_path=builtin_codepage_cache_path(file);
+		if (!cache_path) return false;
+		FILE * cache_file=fopen(cache_path, "rb");
+		if (!cache_file) return false;
+		Bit8u * unpacked=new Bit8u[65536];
+		size_t read=fread(unpacked, sizeof(Bit8u), 65536, cache_file);
+		fclose(cache_file);
+		if (read!=65536) {
+			delete[] unpacked;
+			return false;
+		}
+		file->unpacked=unpacked;
+	}
+	memcpy(cpi_buf, file->unpacked, 65536);
+	return true;
+}
+
+static void cache_codepage_file(BuiltinCodepageFile * file, const Bit8u * cpi_buf) {
+	if (!file->unpacked) file->unpacked=new Bit8u[65536];
+	memcpy(file->unpacked, cpi_buf, 65536);
+
+	const char * cache_path=builtin_codepage_cache_path(file);
+	if (!cache_path) return;
+	FILE * cache_file=fopen(cache_path, "wb");
+	if (!cache_file) return;
+	size_t written=fwrite(cpi_buf, sizeof(Bit8u), 65536, cache_file);
+	fclose(cache_file);
+	// don't leave a partial file behind to be read back next time
+	if (written!=65536) remove(cache_path);
+}
+//--End of modifications
+
 Bitu keyboard_layout::read_codepage_file(const char* codepage_file_name, Bit32s codepage_id) {
 	char cp_filename[512];
 	strcpy(cp_filename, codepage_file_name);
@@ -762,28 +820,35 @@ Bitu keyboard_layout::read_codepage_file(const char* codepage_file_name, Bit32s
 	Bit32u cpi_buf_size=0,size_of_cpxdata=0;;
 	bool upxfound=false;
 	Bit16u found_at_pos=5;
+	BuiltinCodepageFile * builtin_file=NULL;	//--Added
 	if (tempfile==NULL) {
 		// check if build-in codepage is available
+		//--Modified to use the unpacked file from an earlier load if there is one
 		switch (codepage_id) {
 			case 437:	case 850:	case 852:	case 853:	case 857:	case 858:	
-						for (Bitu bct=0; bct<6322; bct++) cpi_buf[bct]=font_ega_cpx[bct];
-						cpi_buf_size=6322;
+						builtin_file=&builtin_codepage_files[0];
 						break;
 			case 771:	case 772:	case 808:	case 855:	case 866:	case 872:
-						for (Bitu bct=0; bct<5455; bct++) cpi_buf[bct]=font_ega3_cpx[bct];
-						cpi_buf_size=5455;
+						builtin_file=&builtin_codepage_files[1];
 						break;
 			case 737:	case 851:	case 869:
-						for (Bitu bct=0; bct<5720; bct++) cpi_buf[bct]=font_ega5_cpx[bct];
-						cpi_buf_size=5720;
+						builtin_file=&builtin_codepage_files[2];
 						break;
 			default: 
 				return KEYB_INVALIDCPFILE;
 				break;
 		}
-		upxfound=true;
-		found_at_pos=0x29;
-		size_of_cpxdata=cpi_buf_size;
+		if (read_cached_codepage_file(builtin_file, cpi_buf)) {
+			cpi_buf_size=65536;
+			builtin_file=NULL;
+		} else {
+			memcpy(cpi_buf, builtin_file->data, builtin_file->size);
+			cpi_buf_size=builtin_file->size;
+			upxfound=true;
+			found_at_pos=0x29;
+			size_of_cpxdata=cpi_buf_size;
+		}
+		//--End of modifications
 	} else {
 		Bit32u dr=(Bit32u)fread(cpi_buf, sizeof(Bit8u), 5, tempfile);
 		// check if file is valid
@@ -874,6 +939,8 @@ Bitu keyboard_layout::read_codepage_file(const char* codepage_file_name, Bit32s
 		cpi_buf_size=65536;
 
 		DOS_FreeMemory(seg);
+
+		if (builtin_file) cache_codepage_file(builtin_file, cpi_buf);	//--Added
 	}
 
 
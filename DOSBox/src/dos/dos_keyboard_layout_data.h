@@ -25,7 +25,9 @@
    Copyright (C) 2004 by Aitor SANTAMARIA_MERINO */
 
 
-Bit8u layout_keyboardsys[33196] = {
+//--Modified to declare the layout libraries const, so that they stay in read-only pages that are only
+//read in from disk when a layout is looked up in them. The same goes for the fonts in dos_codepages.h.
+static const Bit8u layout_keyboardsys[33196] = {
 0x4b, 0x43, 0x46, 0x00, 0x01, 0x01, 0x2e, 0x48, 0x65, 0x6e, 0x72, 0x69, 0x71, 0x75, 0x65, 0x20, 
 0x50, 0x65, 0x72, 0x6f, 0x6e, 0xff, 0x44, 0x4f, 0x53, 0x20, 0x63, 0x6f, 0x64, 0x65, 0x70, 0x61, 
 0x67, 0x65, 0x73, 0x20, 0x2d, 0x20, 0x6c, 0x69, 0x62, 0x72, 0x61, 0x72, 0x79, 0x20, 0x23, 0x31, 
@@ -2102,7 +2104,7 @@ Bit8u layout_keyboardsys[33196] = {
 0x75, 0x81, 0x79, 0x98, 0x41, 0x8e, 0x45, 0xd3, 0x49, 0xd8, 0x4f, 0x99, 0x55, 0x9a, 0x20, 0xf9, 
 0xf7, 0x03, 0x63, 0x87, 0x43, 0x80, 0x20, 0xf7, 0x00, 0xad, 0x00, 0x00 };
 
-Bit8u layout_keybrd2sys[25431] = {
+static const Bit8u layout_keybrd2sys[25431] = {
 0x4b, 0x43, 0x46, 0x00, 0x01, 0x01, 0x2e, 0x48, 0x65, 0x6e, 0x72, 0x69, 0x71, 0x75, 0x65, 0x20, 
 0x50, 0x65, 0x72, 0x6f, 0x6e, 0xff, 0x44, 0x4f, 0x53, 0x20, 0x63, 0x6f, 0x64, 0x65, 0x70, 0x61, 
 0x67, 0x65, 0x73, 0x20, 0x2d, 0x20, 0x6c, 0x69, 0x62, 0x72, 0x61, 0x72, 0x79, 0x20, 0x23, 0x32, 
@@ -3694,7 +3696,7 @@ Bit8u layout_keybrd2sys[25431] = {
 0x8d, 0x32, 0x41, 0x00, 0xac, 0x8c, 0x00, 0x28, 0x10, 0x00, 0x00, 0x36, 0x04, 0x1f, 0x00, 0x00, 
 0x00, 0x00, 0x7f, 0x00, 0xaf, 0x00, 0x00 };
 
-Bit8u layout_keybrd3sys[27122] = {
+static const Bit8u layout_keybrd3sys[27122] = {
 0x4b, 0x43, 0x46, 0x00, 0x01, 0x01, 0x2e, 0x48, 0x65, 0x6e, 0x72, 0x69, 0x71, 0x75, 0x65, 0x20, 
 0x50, 0x65, 0x72, 0x6f, 0x6e, 0xff, 0x44, 0x4f, 0x53, 0x20, 0x63, 0x6f, 0x64, 0x65, 0x70, 0x61, 
 0x67, 0x65, 0x73, 0x20, 0x2d, 0x20, 0x6c, 0x69, 0x62, 0x72, 0x61, 0x72, 0x79, 0x20, 0x23, 0x33, 
@@ -23,6 +23,9 @@
 #include "mem.h"
 #include "regs.h"
 #include "dos_inc.h"
+//--Added for guest idle detection
+#include "cpu.h"
+//--End of modifications
 #include <list>
 
 
@@ -183,7 +186,11 @@ static bool DOS_MultiplexFunctions(void) {
 		else if (reg_bx == 0x18) return true;	// idle callout
 		else return false;
 	case 0x1680:	/*  RELEASE CURRENT VIRTUAL MACHINE TIME-SLICE */
-		//TODO Maybe do some idling but could screw up other systems :)
+		//--Modified to idle when programs give up their time slice:
+		//this goes through the polling check, so it can't screw up programs
+		//that only call it occasionally.
+		CPU_IdlePoll();
+		//--End of modifications
 		return true; //So no warning in the debugger anymore
 	case 0x1689:	/*  Kernel IDLE CALL */
 	case 0x168f:	/*  Close awareness crap */
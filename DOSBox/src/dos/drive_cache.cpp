@@ -31,6 +31,14 @@
 #include <vector>
 #include <iterator>
 #include <algorithm>
+//--Added to let drives bring a single cached directory back in step with the host folder
+#include <set>
+#include <string>
+//--End of modifications
+//--Added to keep an index of the drive cache between launches
+#include <map>
+#include <stdio.h>
+//--End of modifications
 
 #if defined (WIN32)   /* Win 32 */
 #define WIN32_LEAN_AND_MEAN        // Exclude rarely-used stuff from 
@@ -89,6 +97,7 @@ DOS_Drive_Cache::DOS_Drive_Cache(const char* path, DOS_Drive *drv) {
 }
 
 DOS_Drive_Cache::~DOS_Drive_Cache(void) {
+	if (!indexFile.empty()) SaveIndex();	//--Added
 	Clear();
 	for (Bit32u i=0; i<MAX_OPENDIRS; i++) { delete dirFindFirst[i]; dirFindFirst[i]=0; };
 }
@@ -100,6 +109,10 @@ void DOS_Drive_Cache::Clear(void) {
 }
 
 void DOS_Drive_Cache::EmptyCache(void) {
+	//--Added to hang onto what we know about the cached directories, so that the files in them
+	//keep their short names when they're read again
+	if (!indexFile.empty() && dirBase) CollectSavedDirs(dirBase,"",savedDirs);
+	//--End of modifications
 	// Empty Cache and reinit
 	Clear();
 	dirBase		= new CFileInfo;
@@ -272,6 +285,9 @@ void DOS_Drive_Cache::CacheOut(const char* path, bool ignoreLastDir) {
 	// clear lists
 	dir->fileList.clear();
 	dir->longNameList.clear();
+	//--Added to index directory contents by name
+	ClearIndex(dir);
+	//--End of modifications
 	save_dir = 0;
 }
 
@@ -279,6 +295,411 @@ bool DOS_Drive_Cache::IsCachedIn(CFileInfo* curDir) {
 	return (curDir->fileList.size()>0);
 }
 
+//--Added to index directory contents by name, so that names which aren't in a directory
+//can be ruled out, and long names looked up, without searching its file lists.
+static inline Bitu DOS_Drive_Cache_HashName(const char* name) {
+	Bitu hash = 5381;
+	while (*name) hash = hash*33 + (Bit8u)*name++;
+	return hash;
+}
+
+void DOS_Drive_Cache::LinkIntoIndex(CFileInfo* dir, CFileInfo* info) {
+	Bitu mask = dir->shortNameIndex.size()-1;
+	CFileInfo* &shortBucket = dir->shortNameIndex[DOS_Drive_Cache_HashName(info->shortname) & mask];
+	info->nextByShortName = shortBucket;
+	shortBucket = info;
+	CFileInfo* &longBucket = dir->longNameIndex[DOS_Drive_Cache_HashName(info->orgname) & mask];
+	info->nextByLongName = longBucket;
+	longBucket = info;
+}
+
+void DOS_Drive_Cache::AddToIndex(CFileInfo* dir, CFileInfo* info) {
+	dir->indexedEntries++;
+	// Grow the tables and rehash the whole directory, which by now includes the new entry
+	if (dir->indexedEntries > dir->shortNameIndex.size()) RebuildIndex(dir);
+	else LinkIntoIndex(dir,info);
+}
+
+void DOS_Drive_Cache::RebuildIndex(CFileInfo* dir) {
+	Bitu size = 16;
+	while (size < dir->fileList.size()) size *= 2;
+	dir->shortNameIndex.assign(size,(CFileInfo*)0);
+	dir->longNameIndex.assign(size,(CFileInfo*)0);
+	for (Bitu i=0; i<dir->fileList.size(); i++) LinkIntoIndex(dir,dir->fileList[i]);
+	dir->indexedEntries = dir->fileList.size();
+}
+
+void DOS_Drive_Cache::ClearIndex(CFileInfo* dir) {
+	dir->shortNameIndex.clear();
+	dir->longNameIndex.clear();
+	dir->indexedEntries = 0;
+}
+
+DOS_Drive_Cache::CFileInfo* DOS_Drive_Cache::FindByShortName(CFileInfo* dir, const char* shortname) {
+	if (dir->shortNameIndex.empty()) return 0;
+	CFileInfo* info = dir->shortNameIndex[DOS_Drive_Cache_HashName(shortname) & (dir->shortNameIndex.size()-1)];
+	while (info && strcmp(shortname,info->shortname)) info = info->nextByShortName;
+	return info;
+}
+
+DOS_Drive_Cache::CFileInfo* DOS_Drive_Cache::FindByLongName(CFileInfo* dir, const char* longname) {
+	if (dir->longNameIndex.empty()) return 0;
+	CFileInfo* info = dir->longNameIndex[DOS_Drive_Cache_HashName(longname) & (dir->longNameIndex.size()-1)];
+	while (info && strcmp(longname,info->orgname)) info = info->nextByLongName;
+	return info;
+}
+//--End of modifications
+
+//--Added to let drives bring a single cached directory back in step with the host folder,
+//when something other than DOSBox has changed it. path is a host path under the base
+//directory, using long names. Directories that haven't been cached in yet are left alone,
+//since they'll be read fresh when they are first needed.
+void DOS_Drive_Cache::RefreshDir(const char* path, bool recursive) {
+	CFileInfo* dir = FindCachedHostDir(path);
+	if (!dir) return;
+
+	// Just drop everything below this directory and let it be cached in again on demand
+	if (recursive) {
+		ForgetContents(dir);
+		return;
+	}
+
+	char dirpath[CROSS_LEN];
+	safe_strncpy(dirpath,path,CROSS_LEN-1);
+	char end[2]={CROSS_FILESPLIT,0};
+	if (dirpath[strlen(dirpath)-1]!=CROSS_FILESPLIT) strcat(dirpath,end);
+
+	void* dirp = drive ? drive->opendir(dirpath) : 0;
+	if (!dirp) {
+		// The directory has gone away: its parent will be refreshed in turn
+		ForgetContents(dir);
+		return;
+	}
+
+	// See which of the cached entries are still there, and which names are new
+	// (ignoring those that CreateEntry would have hidden). Entries that have changed
+	// between file and directory are replaced.
+	std::set<CFileInfo*> kept;
+	std::vector<std::pair<std::string,bool> > added;
+	char dir_name[CROSS_LEN];
+	bool is_directory;
+	bool more = drive->read_directory_first(dirp, dir_name, is_directory);
+	while (more) {
+		CFileInfo* info = FindByLongName(dir,dir_name);
+		if (info && info->isDir==is_directory) kept.insert(info);
+		else if (boxer_shouldShowFileWithName(dir_name)) added.push_back(std::make_pair(std::string(dir_name),is_directory));
+		more = drive->read_directory_next(dirp, dir_name, is_directory);
+	}
+	drive->closedir(dirp);
+
+	if (kept.size()==dir->fileList.size() && added.empty()) return;
+
+	// Remove the entries that have gone first, so that any that were renamed back
+	// can get their old short names again
+	if (kept.size()!=dir->fileList.size()) {
+		std::vector<CFileInfo*> files;
+		std::vector<CFileInfo*> longNames;
+		for (Bitu i=0; i<dir->fileList.size(); i++) {
+			CFileInfo* info = dir->fileList[i];
+			if (kept.count(info)) {
+				files.push_back(info);
+				if (info->shortNr) longNames.push_back(info);
+			} else {
+				ForgetSearches(info);
+				delete info;
+			}
+		}
+		dir->fileList.swap(files);
+		// longNameList is sorted the same way as fileList, so this keeps it in order
+		dir->longNameList.swap(longNames);
+		RebuildIndex(dir);
+	}
+
+	for (Bitu i=0; i<added.size(); i++) {
+		CreateEntry(dir,added[i].first.c_str(),added[i].second);
+	}
+	save_dir = 0;
+}
+
+DOS_Drive_Cache::CFileInfo* DOS_Drive_Cache::FindCachedHostDir(const char* path) {
+	size_t baseLen = strlen(basePath);
+	if (strncmp(path,basePath,baseLen)) return 0;
+
+	CFileInfo* dir = dirBase;
+	char name[CROSS_LEN];
+	const char* start = path+baseLen;
+	while (*start) {
+		const char* pos = strchr(start,CROSS_FILESPLIT);
+		size_t len = pos ? (size_t)(pos-start) : strlen(start);
+		if (len) {
+			if (len>=CROSS_LEN || !IsCachedIn(dir)) return 0;
+			safe_strncpy(name,start,len+1);
+			dir = FindByLongName(dir,name);
+			if (!dir || !dir->isDir) return 0;
+		}
+		start += len;
+		if (*start) start++;
+	}
+	return IsCachedIn(dir) ? dir : 0;
+}
+
+void DOS_Drive_Cache::ForgetContents(CFileInfo* dir) {
+	for (Bitu i=0; i<dir->fileList.size(); i++) {
+		ForgetSearches(dir->fileList[i]);
+		delete dir->fileList[i];
+	}
+	dir->fileList.clear();
+	dir->longNameList.clear();
+	ClearIndex(dir);
+	save_dir = 0;
+}
+
+// Makes sure no open directory search still refers to an entry that's about to be deleted
+void DOS_Drive_Cache::ForgetSearches(CFileInfo* info) {
+	for (Bitu i=0; i<MAX_OPENDIRS; i++) {
+		if (dirSearch[i]==info) dirSearch[i] = 0;
+	}
+	for (Bitu i=0; i<info->fileList.size(); i++) ForgetSearches(info->fileList[i]);
+}
+//--End of modifications
+
+//--Added to keep an index of cached directories and their short names from one launch to the next.
+//The index is only ever read back by the same build on the same host, so it's written as-is.
+static const char DOS_Drive_Cache_IndexMagic[8] = { 'D','I','R','C','A','C','H','E' };
+static const Bit32u DOS_Drive_Cache_IndexVersion = 1;
+
+static bool DOS_Drive_Cache_WriteString(FILE* f, const char* str) {
+	Bit16u len = (Bit16u)strlen(str);
+	return fwrite(&len,sizeof(len),1,f)==1 && fwrite(str,1,len,f)==len;
+}
+
+static bool DOS_Drive_Cache_ReadString(FILE* f, char* str, Bitu maxLen) {
+	Bit16u len;
+	if (fread(&len,sizeof(len),1,f)!=1 || len>=maxLen) return false;
+	if (fread(str,1,len,f)!=len) return false;
+	str[len] = 0;
+	return true;
+}
+
+bool DOS_Drive_Cache::SetIndexFile(const char* path) {
+	indexFile = path;
+	savedDirs.clear();
+
+	FILE* f = fopen(path,"rb");
+	if (!f) return false;
+
+	char magic[sizeof(DOS_Drive_Cache_IndexMagic)];
+	Bit32u version;
+	bool ok = fread(magic,sizeof(magic),1,f)==1 && !memcmp(magic,DOS_Drive_Cache_IndexMagic,sizeof(magic)) &&
+		fread(&version,sizeof(version),1,f)==1 && version==DOS_Drive_Cache_IndexVersion;
+
+	char key[CROSS_LEN];
+	char orgname[CROSS_LEN];
+	Bit8u more;
+	while (ok && (ok = fread(&more,sizeof(more),1,f)==1) && more) {
+		Bit64u stamp;
+		Bit32u count;
+		ok = DOS_Drive_Cache_ReadString(f,key,CROSS_LEN) &&
+			fread(&stamp,sizeof(stamp),1,f)==1 && fread(&count,sizeof(count),1,f)==1;
+		if (!ok) break;
+
+		SavedDir& saved = savedDirs[key];
+		saved.stamp = stamp;
+		saved.entries.resize(count);
+		for (Bit32u i=0; ok && i<count; i++) {
+			SavedEntry& entry = saved.entries[i];
+			Bit32u shortNr;
+			Bit8u isDir;
+			ok = DOS_Drive_Cache_ReadString(f,orgname,CROSS_LEN) &&
+				DOS_Drive_Cache_ReadString(f,entry.shortname,DOS_NAMELENGTH_ASCII) &&
+				fread(&shortNr,sizeof(shortNr),1,f)==1 && fread(&isDir,sizeof(isDir),1,f)==1;
+			entry.orgname = orgname;
+			entry.shortNr = shortNr;
+			entry.isDir = (isDir!=0);
+		}
+	}
+	fclose(f);
+
+	if (!ok) {
+		LOG(LOG_DOSMISC,LOG_ERROR)("DIRCACHE: Ignoring unreadable index %s",path);
+		savedDirs.clear();
+		return false;
+	}
+
+	// The base directory was read when the drive was created, before there was an index to take
+	// it from: forget it, so that it's taken from the index the next time it's needed.
+	if (dirBase && IsCachedIn(dirBase)) ForgetContents(dirBase);
+	return true;
+}
+
+bool DOS_Drive_Cache::SaveIndex(void) {
+	if (indexFile.empty() || !dirBase) return false;
+
+	// Keep the directories that haven't been needed this time, unless they're known to have gone
+	SavedDirs dirs;
+	for (SavedDirs::const_iterator it=savedDirs.begin(); it!=savedDirs.end(); ++it) {
+		if (!IsStaleSavedDir(it->first)) dirs.insert(*it);
+	}
+	CollectSavedDirs(dirBase,"",dirs);
+
+	// Write to one side and then swap it into place, so that an interrupted save can't leave a torn index
+	std::string tempFile = indexFile+".tmp";
+	FILE* f = fopen(tempFile.c_str(),"wb");
+	if (!f) return false;
+
+	bool ok = fwrite(DOS_Drive_Cache_IndexMagic,sizeof(DOS_Drive_Cache_IndexMagic),1,f)==1 &&
+		fwrite(&DOS_Drive_Cache_IndexVersion,sizeof(DOS_Drive_Cache_IndexVersion),1,f)==1;
+
+	for (SavedDirs::const_iterator it=dirs.begin(); ok && it!=dirs.end(); ++it) {
+		const SavedDir& saved = it->second;
+		Bit8u more = 1;
+		Bit32u count = (Bit32u)saved.entries.size();
+		ok = fwrite(&more,sizeof(more),1,f)==1 && DOS_Drive_Cache_WriteString(f,it->first.c_str()) &&
+			fwrite(&saved.stamp,sizeof(saved.stamp),1,f)==1 && fwrite(&count,sizeof(count),1,f)==1;
+		for (Bit32u i=0; ok && i<count; i++) {
+			const SavedEntry& entry = saved.entries[i];
+			Bit32u shortNr = (Bit32u)entry.shortNr;
+			Bit8u isDir = entry.isDir ? 1 : 0;
+			ok = DOS_Drive_Cache_WriteString(f,entry.orgname.c_str()) && DOS_Drive_Cache_WriteString(f,entry.shortname) &&
+				fwrite(&shortNr,sizeof(shortNr),1,f)==1 && fwrite(&isDir,sizeof(isDir),1,f)==1;
+		}
+	}
+	Bit8u end = 0;
+	ok = ok && fwrite(&end,sizeof(end),1,f)==1;
+	ok = (fclose(f)==0) && ok;
+
+	if (ok) ok = (rename(tempFile.c_str(),indexFile.c_str())==0);
+	if (!ok) remove(tempFile.c_str());
+	return ok;
+}
+
+// Returns the key under which the specified host directory is saved in the index
+bool DOS_Drive_Cache::IndexKey(const char* hostPath, std::string& key) {
+	size_t baseLen = strlen(basePath);
+	if (strncmp(hostPath,basePath,baseLen)) return false;
+	const char* rel = hostPath+baseLen;
+	while (*rel==CROSS_FILESPLIT) rel++;
+	key = rel;
+	if (!key.empty() && key[key.size()-1]!=CROSS_FILESPLIT) key += CROSS_FILESPLIT;
+	return true;
+}
+
+// Fills in the contents of the directory at dirPath, as ReadDir used to
+bool DOS_Drive_Cache::ReadDirContents(CFileInfo* dir) {
+	SavedDirs::iterator saved = savedDirs.end();
+	std::string key;
+	if (!indexFile.empty() && IndexKey(dirPath,key)) {
+		dir->hasStamp = drive->get_directory_stamp(dirPath,dir->stamp);
+		saved = savedDirs.find(key);
+	}
+
+	// The directory hasn't changed since it was saved, so there's no need to read it at all
+	if (saved!=savedDirs.end() && dir->hasStamp && saved->second.stamp==dir->stamp) {
+		const std::vector<SavedEntry>& entries = saved->second.entries;
+		for (Bitu i=0; i<entries.size(); i++) {
+			if (boxer_shouldShowFileWithName(entries[i].orgname.c_str())) AddSavedEntry(dir,entries[i]);
+		}
+		savedDirs.erase(saved);
+		return true;
+	}
+
+	void* dirp = drive->opendir(dirPath);
+	if (!dirp) return false;
+
+	char dir_name[CROSS_LEN];
+	bool is_directory;
+	if (saved==savedDirs.end()) {
+		if (drive->read_directory_first(dirp, dir_name, is_directory)) {
+			CreateEntry(dir, dir_name, is_directory);
+			while (drive->read_directory_next(dirp, dir_name, is_directory)) {
+				CreateEntry(dir, dir_name, is_directory);
+			}
+		}
+		drive->closedir(dirp);
+		return true;
+	}
+
+	// The directory has changed: give the files that are still there their old short names back
+	// before any new files are named, so that the new ones can't take them
+	std::map<std::string,const SavedEntry*> savedByName;
+	const std::vector<SavedEntry>& entries = saved->second.entries;
+	for (Bitu i=0; i<entries.size(); i++) savedByName[entries[i].orgname] = &entries[i];
+
+	std::vector<std::pair<std::string,bool> > added;
+	bool more = drive->read_directory_first(dirp, dir_name, is_directory);
+	while (more) {
+		std::map<std::string,const SavedEntry*>::const_iterator found = savedByName.find(dir_name);
+		if (found!=savedByName.end() && found->second->isDir==is_directory &&
+			!FindByShortName(dir,found->second->shortname) && boxer_shouldShowFileWithName(dir_name)) {
+			AddSavedEntry(dir,*found->second);
+		} else {
+			added.push_back(std::make_pair(std::string(dir_name),is_directory));
+		}
+		more = drive->read_directory_next(dirp, dir_name, is_directory);
+	}
+	drive->closedir(dirp);
+
+	for (Bitu i=0; i<added.size(); i++) {
+		CreateEntry(dir,added[i].first.c_str(),added[i].second);
+	}
+	savedDirs.erase(saved);
+	return true;
+}
+
+// Adds an entry with the name it was saved with, keeping the lists in order as CreateEntry does
+void DOS_Drive_Cache::AddSavedEntry(CFileInfo* dir, const SavedEntry& saved) {
+	CFileInfo* info = new CFileInfo;
+	safe_strncpy(info->orgname,saved.orgname.c_str(),CROSS_LEN);
+	strcpy(info->shortname,saved.shortname);
+	info->shortNr = saved.shortNr;
+	info->isDir = saved.isDir;
+
+	if (info->shortNr) {
+		std::vector<CFileInfo*>::iterator it = std::upper_bound(dir->longNameList.begin(),dir->longNameList.end(),info,SortByName);
+		dir->longNameList.insert(it,info);
+	}
+	std::vector<CFileInfo*>::iterator it = std::upper_bound(dir->fileList.begin(),dir->fileList.end(),info,SortByName);
+	dir->fileList.insert(it,info);
+	AddToIndex(dir,info);
+}
+
+void DOS_Drive_Cache::CollectSavedDirs(CFileInfo* dir, const std::string& key, SavedDirs& into) {
+	if (!IsCachedIn(dir)) return;
+	if (dir->hasStamp) {
+		SavedDir& saved = into[key];
+		saved.stamp = dir->stamp;
+		saved.entries.resize(dir->fileList.size());
+		for (Bitu i=0; i<dir->fileList.size(); i++) {
+			CFileInfo* info = dir->fileList[i];
+			SavedEntry& entry = saved.entries[i];
+			entry.orgname = info->orgname;
+			strcpy(entry.shortname,info->shortname);
+			entry.shortNr = info->shortNr;
+			entry.isDir = info->isDir;
+		}
+	}
+	for (Bitu i=0; i<dir->fileList.size(); i++) {
+		CFileInfo* info = dir->fileList[i];
+		if (info->isDir && strcmp(info->orgname,".") && strcmp(info->orgname,".."))
+			CollectSavedDirs(info,key+info->orgname+CROSS_FILESPLIT,into);
+	}
+}
+
+// Whether the saved directory is known to have gone, because a directory above it
+// has been read this time and no longer contains the next directory down
+bool DOS_Drive_Cache::IsStaleSavedDir(const std::string& key) {
+	CFileInfo* dir = dirBase;
+	size_t start = 0, end;
+	while ((end = key.find(CROSS_FILESPLIT,start)) != std::string::npos) {
+		if (!IsCachedIn(dir)) return false;
+		dir = FindByLongName(dir,key.substr(start,end-start).c_str());
+		if (!dir || !dir->isDir) return true;
+		start = end+1;
+	}
+	return false;
+}
+//--End of modifications
+
 //--Modified 2009-10-06 by Alun Bestor: this function is unused by DOSBox but provides a useful way for Boxer to look up short filenames.
 //However, in its original state it didn't work properly: it was comparing a filename to a full OS path, instead of a filename to a filename. This has now been modified to produce the intended result.
 bool DOS_Drive_Cache::GetShortName(const char* dirpath, const char*filename, char* shortname) {
@@ -288,6 +709,14 @@ bool DOS_Drive_Cache::GetShortName(const char* dirpath, const char*filename, cha
 	CFileInfo* theDir = FindDirInfo(dirpath,expand);
 	//printf("\nScanning folder: %s (expanded to: %s)\n\n", dirpath, expand);
 
+	//--Modified to look the name up in the directory's index instead of scanning longNameList.
+	//Only entries with a generated short name (i.e. those in longNameList) have a nonzero shortNr.
+	CFileInfo* info = FindByLongName(theDir,filename);
+	if (info && info->shortNr) {
+		strcpy(shortname,info->shortname);
+		return true;
+	}
+	/*
 	std::vector<CFileInfo*>::size_type filelist_size = theDir->longNameList.size();
 	if (GCC_UNLIKELY(filelist_size<=0)) return false;
 
@@ -304,6 +733,8 @@ bool DOS_Drive_Cache::GetShortName(const char* dirpath, const char*filename, cha
 			return true;
 		};
 	}
+	*/
+	//--End of modifications
 	
 	/*
 	//This binary-search code would have been much more efficient than the above,
@@ -403,6 +834,13 @@ Bits DOS_Drive_Cache::GetLongName(CFileInfo* curDir, char* shortName) {
 
 	// Remove dot, if no extension...
 	RemoveTrailingDot(shortName);
+
+	//--Added to rule out unknown names with the directory's index before searching the file list.
+	//The search itself is still needed for the entry's position, and for which entry is found
+	//when several have ended up with the same short name.
+	if (!FindByShortName(curDir,shortName)) return -1;
+	//--End of modifications
+
 	// Search long name and return array number of element
 	Bits low	= 0;
 	Bits high	= (Bits)(filelist_size-1);
@@ -465,7 +903,11 @@ void DOS_Drive_Cache::CreateShortName(CFileInfo* curDir, CFileInfo* info) {
 	if (!createShort) {
 		char buffer[CROSS_LEN];
 		strcpy(buffer,tmpName);
-		createShort = (GetLongName(curDir,buffer)>=0);
+		//--Modified to only check the index, since we don't need the entry's position
+		RemoveTrailingDot(buffer);
+		createShort = (FindByShortName(curDir,buffer)!=0);
+		//createShort = (GetLongName(curDir,buffer)>=0);
+		//--End of modifications
 	}
 
 	if (createShort) {
@@ -497,6 +939,10 @@ void DOS_Drive_Cache::CreateShortName(CFileInfo* curDir, CFileInfo* info) {
 				// append at end of list
 				curDir->longNameList.push_back(info);
 			} else {
+				//--Modified to binary-search for the insertion point
+				std::vector<CFileInfo*>::iterator it = std::upper_bound(curDir->longNameList.begin(),curDir->longNameList.end(),info,SortByName);
+				curDir->longNameList.insert(it,info);
+				/*
 				// look for position where to insert this element
 				bool found=false;
 				std::vector<CFileInfo*>::iterator it;
@@ -509,6 +955,8 @@ void DOS_Drive_Cache::CreateShortName(CFileInfo* curDir, CFileInfo* info) {
 				// Put it in longname list...
 				if (found) curDir->longNameList.insert(it,info);
 				else curDir->longNameList.push_back(info);
+				*/
+				//--End of modifications
 			}
 		} else {
 			// empty file list, append
@@ -646,7 +1094,7 @@ void DOS_Drive_Cache::CreateEntry(CFileInfo* dir, const char* name, bool is_dire
 	// Check for long filenames...
 	CreateShortName(dir, info);		
 
-	bool found = false;
+	//bool found = false;
 
 	// keep list sorted (so GetLongName works correctly, used by CreateShortName in this routine)
 	if (dir->fileList.size()>0) {
@@ -654,6 +1102,10 @@ void DOS_Drive_Cache::CreateEntry(CFileInfo* dir, const char* name, bool is_dire
 			// append at end of list
 			dir->fileList.push_back(info);
 		} else {
+			//--Modified to binary-search for the insertion point
+			std::vector<CFileInfo*>::iterator it = std::upper_bound(dir->fileList.begin(),dir->fileList.end(),info,SortByName);
+			dir->fileList.insert(it,info);
+			/*
 			// look for position where to insert this element
 			std::vector<CFileInfo*>::iterator it;
 			for (it=dir->fileList.begin(); it!=dir->fileList.end(); ++it) {
@@ -665,11 +1117,17 @@ void DOS_Drive_Cache::CreateEntry(CFileInfo* dir, const char* name, bool is_dire
 			// Put file in lists
 			if (found) dir->fileList.insert(it,info);
 			else dir->fileList.push_back(info);
+			*/
+			//--End of modifications
 		}
 	} else {
 		// empty file list, append
 		dir->fileList.push_back(info);
 	}
+
+	//--Added to index directory contents by name
+	AddToIndex(dir,info);
+	//--End of modifications
 }
 
 void DOS_Drive_Cache::CopyEntry(CFileInfo* dir, CFileInfo* from) {
@@ -688,6 +1146,12 @@ bool DOS_Drive_Cache::ReadDir(Bit16u id, char* &result) {
 	if (id>MAX_OPENDIRS) return false;
 
 	if (!IsCachedIn(dirSearch[id])) {
+		//--Modified to take the directory's contents from the saved index when it hasn't changed
+		if (!ReadDirContents(dirSearch[id])) {
+			free[id] = true;
+			return false;
+		}
+		/*
 		// Try to open directory
 		void* dirp = drive->opendir(dirPath);
 		if (!dirp) {
@@ -706,6 +1170,8 @@ bool DOS_Drive_Cache::ReadDir(Bit16u id, char* &result) {
 
 		// close dir
 		drive->closedir(dirp);
+		*/
+		//--End of modifications
 
 		// Info
 /*		if (!dirp) {
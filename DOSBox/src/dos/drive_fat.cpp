@@ -42,8 +42,10 @@
 #define FAT16		   1
 #define FAT32		   2
 
-Bit8u fatSectBuffer[1024];
-Bit32u curFatSect;
+//--Removed now that each fatDrive keeps its whole FAT in memory
+//Bit8u fatSectBuffer[1024];
+//Bit32u curFatSect;
+//--End of modifications
 
 class fatFile : public DOS_File {
 public:
@@ -308,16 +310,23 @@ Bit32u fatDrive::getClusterValue(Bit32u clustNum) {
 			fatoffset = clustNum * 4;
 			break;
 	}
+	//--Modified to read from the copy of the FAT we keep in memory
+	/*
 	fatsectnum = bootbuffer.reservedsectors + (fatoffset / bootbuffer.bytespersector) + partSectOff;
 	fatentoff = fatoffset % bootbuffer.bytespersector;
 
 	if(curFatSect != fatsectnum) {
-		/* Load two sectors at once for FAT12 */
+		// Load two sectors at once for FAT12
 		loadedDisk->Read_AbsoluteSector(fatsectnum, &fatSectBuffer[0]);
 		if (fattype==FAT12)
 			loadedDisk->Read_AbsoluteSector(fatsectnum+1, &fatSectBuffer[512]);
 		curFatSect = fatsectnum;
 	}
+	*/
+	if (fatoffset >= fatCacheSize) return 0;
+	Bit8u *fatSectBuffer = fatCache;
+	fatentoff = fatoffset;
+	//--End of modifications
 
 	switch(fattype) {
 		case FAT12:
@@ -355,16 +364,26 @@ void fatDrive::setClusterValue(Bit32u clustNum, Bit32u clustValue) {
 			fatoffset = clustNum * 4;
 			break;
 	}
+	//--Modified to update the copy of the FAT we keep in memory, then write the changed sectors
+	//of it to each copy of the FAT on disk (which only goes as far as the disk's sector cache)
+	/*
 	fatsectnum = bootbuffer.reservedsectors + (fatoffset / bootbuffer.bytespersector) + partSectOff;
 	fatentoff = fatoffset % bootbuffer.bytespersector;
 
 	if(curFatSect != fatsectnum) {
-		/* Load two sectors at once for FAT12 */
+		// Load two sectors at once for FAT12
 		loadedDisk->Read_AbsoluteSector(fatsectnum, &fatSectBuffer[0]);
 		if (fattype==FAT12)
 			loadedDisk->Read_AbsoluteSector(fatsectnum+1, &fatSectBuffer[512]);
 		curFatSect = fatsectnum;
 	}
+	*/
+	if (fatoffset >= fatCacheSize) return;
+	Bit32u fatsector = fatoffset / bootbuffer.bytespersector;
+	fatsectnum = bootbuffer.reservedsectors + fatsector + partSectOff;
+	fatentoff = fatoffset % bootbuffer.bytespersector;
+	Bit8u *fatSectBuffer = &fatCache[fatsector * bootbuffer.bytespersector];
+	//--End of modifications
 
 	switch(fattype) {
 		case FAT12: {
@@ -393,8 +412,12 @@ void fatDrive::setClusterValue(Bit32u clustNum, Bit32u clustValue) {
 	for(int fc=0;fc<bootbuffer.fatcopies;fc++) {
 		loadedDisk->Write_AbsoluteSector(fatsectnum + (fc * bootbuffer.sectorsperfat), &fatSectBuffer[0]);
 		if (fattype==FAT12) {
-			if (fatentoff>=511)
-				loadedDisk->Write_AbsoluteSector(fatsectnum+1+(fc * bootbuffer.sectorsperfat), &fatSectBuffer[512]);
+			//--Modified to go by the sector size, and not to write past the end of the FAT
+			//if (fatentoff>=511)
+			//	loadedDisk->Write_AbsoluteSector(fatsectnum+1+(fc * bootbuffer.sectorsperfat), &fatSectBuffer[512]);
+			if (fatentoff>=(Bit32u)bootbuffer.bytespersector-1 && fatsector+1<bootbuffer.sectorsperfat)
+				loadedDisk->Write_AbsoluteSector(fatsectnum+1+(fc * bootbuffer.sectorsperfat), &fatSectBuffer[bootbuffer.bytespersector]);
+			//--End of modifications
 		}
 	}
 }
@@ -632,12 +655,20 @@ bool fatDrive::allocateCluster(Bit32u useCluster, Bit32u prevCluster) {
 	return true;
 }
 
-fatDrive::fatDrive(const char *sysFilename, Bit32u bytesector, Bit32u cylsector, Bit32u headscyl, Bit32u cylinders, Bit32u startSector) {
+//--Modified to take an optional overlay path
+//fatDrive::fatDrive(const char *sysFilename, Bit32u bytesector, Bit32u cylsector, Bit32u headscyl, Bit32u cylinders, Bit32u startSector) {
+fatDrive::fatDrive(const char *sysFilename, Bit32u bytesector, Bit32u cylsector, Bit32u headscyl, Bit32u cylinders, Bit32u startSector, const char *overlayPath) {
+//--End of modifications
 	//--Added 2009-10-25 by Alun Bestor to allow Boxer to track the system path for DOSBox drives
 	strcpy(systempath, sysFilename);
 	//--End of modifications
 	
 	created_successfully = true;
+	//--Added for the in-memory FAT
+	loadedDisk = NULL;
+	fatCache = NULL;
+	fatCacheSize = 0;
+	//--End of modifications
 	FILE *diskfile;
 	Bit32u filesize;
 	struct partTable mbrData;
@@ -648,13 +679,19 @@ fatDrive::fatDrive(const char *sysFilename, Bit32u bytesector, Bit32u cylsector,
 		imgDTA    = new DOS_DTA(imgDTAPtr);
 	}
 
-	diskfile = fopen(sysFilename, "rb+");
+	//--Modified to open the image read-only when its changes are going into an overlay instead
+	//diskfile = fopen(sysFilename, "rb+");
+	diskfile = fopen(sysFilename, overlayPath ? "rb" : "rb+");
+	//--End of modifications
 	if(!diskfile) {created_successfully = false;return;}
 	fseek(diskfile, 0L, SEEK_END);
 	filesize = (Bit32u)ftell(diskfile) / 1024L;
 
 	/* Load disk image */
-	loadedDisk = new imageDisk(diskfile, (Bit8u *)sysFilename, filesize, (filesize > 2880));
+	//--Modified to map the image into memory
+	//loadedDisk = new imageDisk(diskfile, (Bit8u *)sysFilename, filesize, (filesize > 2880));
+	loadedDisk = new mappedImageDisk(diskfile, (Bit8u *)sysFilename, filesize, (filesize > 2880), overlayPath);
+	//--End of modifications
 	if(!loadedDisk) {
 		created_successfully = false;
 		return;
@@ -754,9 +791,25 @@ fatDrive::fatDrive(const char *sysFilename, Bit32u bytesector, Bit32u cylsector,
 	/* There is no cluster 0, this means we are in the root directory */
 	cwdDirCluster = 0;
 
-	memset(fatSectBuffer,0,1024);
-	curFatSect = 0xffffffff;
+	//--Modified to read the whole of the first FAT into memory, with a sector's worth of
+	//slack at the end for FAT12 entries that straddle it
+	//memset(fatSectBuffer,0,1024);
+	//curFatSect = 0xffffffff;
+	fatCacheSize = bootbuffer.sectorsperfat * bootbuffer.bytespersector;
+	fatCache = new Bit8u[fatCacheSize + bootbuffer.bytespersector];
+	memset(fatCache, 0, fatCacheSize + bootbuffer.bytespersector);
+	for (Bit32u i = 0; i < bootbuffer.sectorsperfat; i++) {
+		loadedDisk->Read_AbsoluteSector(bootbuffer.reservedsectors + i + partSectOff, &fatCache[i * bootbuffer.bytespersector]);
+	}
+	//--End of modifications
+}
+
+//--Added to write out any changes still waiting in the disk's sector cache
+fatDrive::~fatDrive() {
+	if (loadedDisk) loadedDisk->Flush();
+	delete[] fatCache;
 }
+//--End of modifications
 
 bool fatDrive::AllocationInfo(Bit16u *_bytes_sector, Bit8u *_sectors_cluster, Bit16u *_total_clusters, Bit16u *_free_clusters) {
 	Bit32u hs, cy, sect,sectsize;
@@ -20,6 +20,13 @@
 
 #include <cctype>
 #include <cstring>
+//--Added for mapping local images into memory
+#include <set>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+//--End of modifications
 #include "cdrom.h"
 #include "dosbox.h"
 #include "dos_system.h"
@@ -64,6 +71,13 @@ bool isoFile::Read(Bit8u *data, Bit16u *size) {
 	if (filePos + *size > fileEnd)
 		*size = (Bit16u)(fileEnd - filePos);
 	
+	//--Added to copy straight out of the image when the drive has it mapped into memory
+	if (drive->readMapped(data, filePos, *size)) {
+		filePos += *size;
+		return true;
+	}
+	//--End of modifications
+	
 	Bit16u nowSize = 0;
 	int sector = filePos / ISO_FRAMESIZE;
 	Bit16u sectorPos = (Bit16u)(filePos % ISO_FRAMESIZE);
@@ -142,12 +156,23 @@ isoDrive::isoDrive(char letter, const char *name, Bit8u _mediaid, int &error) {
 	memset(dirIterators, 0, sizeof(dirIterators));
 	memset(sectorHashEntries, 0, sizeof(sectorHashEntries));
 	memset(&rootEntry, 0, sizeof(isoDirEntry));
+	//--Added to read local images straight from a memory mapping
+	mappedImage = NULL;
+	mappedLength = 0;
+	dirIndexed = false;
+	//--End of modifications
 	
 	safe_strncpy(this->fileName, name, CROSS_LEN);
 	error = UpdateMscdex(letter, name, subUnit);
 
 	if (!error) {
+		//--Added to read local images straight from a memory mapping
+		MapImage();
+		//--End of modifications
 		if (loadImage()) {
+			//--Added to look up paths from an index of every directory rather than scanning each time
+			if (mappedImage) BuildDirIndex();
+			//--End of modifications
 			strcpy(info, "isoDrive ");
 			strcat(info, name);
 			this->driveLetter = letter;
@@ -172,7 +197,12 @@ isoDrive::isoDrive(char letter, const char *name, Bit8u _mediaid, int &error) {
 	//--End of modifications
 }
 
-isoDrive::~isoDrive() { }
+//--Modified to release the image's memory mapping
+//isoDrive::~isoDrive() { }
+isoDrive::~isoDrive() {
+	UnmapImage();
+}
+//--End of modifications
 
 int isoDrive::UpdateMscdex(char letter, const char* path, Bit8u& _subUnit) {
 	if (MSCDEX_HasDrive(letter)) {
@@ -447,6 +477,14 @@ void isoDrive::FreeDirIterator(const int dirIterator) {
 }
 
 bool isoDrive::ReadCachedSector(Bit8u** buffer, const Bit32u sector) {
+	//--Added to hand out sectors straight from the mapping, which needs no caching
+	Bit8u* mapped = MappedSector(sector);
+	if (mapped) {
+		*buffer = mapped;
+		return true;
+	}
+	//--End of modifications
+	
 	// get hash table entry
 	int pos = sector % ISO_MAX_HASH_TABLE_SIZE;
 	SectorHashEntry& he = sectorHashEntries[pos];
@@ -465,6 +503,13 @@ bool isoDrive::ReadCachedSector(Bit8u** buffer, const Bit32u sector) {
 }
 
 inline bool isoDrive :: readSector(Bit8u *buffer, Bit32u sector) {
+	//--Added to read straight from the mapping when the sector lies inside it
+	Bit8u* mapped = MappedSector(sector);
+	if (mapped) {
+		memcpy(buffer, mapped, ISO_FRAMESIZE);
+		return true;
+	}
+	//--End of modifications
 	return CDROM_Interface_Image::images[subUnit]->ReadSector(buffer, false, sector);
 }
 
@@ -529,6 +574,10 @@ bool isoDrive :: lookup(isoDirEntry *de, const char *path) {
 	safe_strncpy(isoPath, path, ISO_MAXPATHNAME);
 	strreplace(isoPath, '\\', '/');
 	
+	//--Added to look the path up in the directory index when we have one
+	if (dirIndexed) return lookupIndexed(de, isoPath);
+	//--End of modifications
+	
 	// iterate over all path elements (name), and search each of them in the current de
 	for(char* name = strtok(isoPath, "/"); NULL != name; name = strtok(NULL, "/")) {
 
@@ -555,3 +604,134 @@ bool isoDrive :: lookup(isoDirEntry *de, const char *path) {
 	}
 	return true;
 }
+
+//--Added to read local images straight from a memory mapping of the image file, and to look up
+//paths from an index of every directory built once at mount. Images that aren't laid out as plain
+//binary files, or that can't be mapped, carry on going through the CD interface as before.
+void isoDrive::MapImage(void) {
+	std::string path;
+	Bit64u offset;
+	Bit32u sectorSize, firstSector, sectors;
+	if (!CDROM_Interface_Image::images[subUnit]->GetDataTrackLayout(path, offset, sectorSize, firstSector, sectors)) return;
+	
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) return;
+	
+	struct stat status;
+	if (fstat(fd, &status) != 0 || (off_t)(size_t)status.st_size != status.st_size
+		|| (Bit64u)status.st_size < offset + ISO_FRAMESIZE) {
+		close(fd);
+		return;
+	}
+	
+	// only cover the sectors that the file holds in full
+	Bit64u available = ((Bit64u)status.st_size - offset - ISO_FRAMESIZE) / sectorSize + 1;
+	if (available < sectors) sectors = (Bit32u)available;
+	
+	void* image = mmap(NULL, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (image == MAP_FAILED) return;
+	
+	mappedImage = (Bit8u*)image;
+	mappedLength = (size_t)status.st_size;
+	mappedOffset = offset;
+	mappedSectorSize = sectorSize;
+	mappedFirstSector = firstSector;
+	mappedSectors = sectors;
+}
+
+void isoDrive::UnmapImage(void) {
+	if (mappedImage) munmap(mappedImage, mappedLength);
+	mappedImage = NULL;
+	mappedLength = 0;
+	dirIndex.clear();
+	dirIndexed = false;
+}
+
+Bit8u* isoDrive::MappedSector(Bit32u sector) const {
+	if (!mappedImage || sector < mappedFirstSector || sector - mappedFirstSector >= mappedSectors) return NULL;
+	return mappedImage + mappedOffset + (Bit64u)(sector - mappedFirstSector) * mappedSectorSize;
+}
+
+bool isoDrive::readMapped(Bit8u *buffer, Bit32u offset, Bitu length) {
+	if (!mappedImage) return false;
+	if (!length) return true;
+	
+	// make sure the whole range lies inside the mapping before copying any of it
+	Bit32u sector = offset / ISO_FRAMESIZE;
+	Bit32u lastSector = (Bit32u)(((Bit64u)offset + length - 1) / ISO_FRAMESIZE);
+	if (!MappedSector(sector) || !MappedSector(lastSector)) return false;
+	
+	Bitu sectorPos = offset % ISO_FRAMESIZE;
+	if (mappedSectorSize == ISO_FRAMESIZE) {
+		memcpy(buffer, MappedSector(sector) + sectorPos, length);
+		return true;
+	}
+	// raw images have headers and error correction data between each sector's user data
+	while (length) {
+		Bitu chunk = ISO_FRAMESIZE - sectorPos;
+		if (chunk > length) chunk = length;
+		memcpy(buffer, MappedSector(sector) + sectorPos, chunk);
+		buffer += chunk;
+		length -= chunk;
+		sector++;
+		sectorPos = 0;
+	}
+	return true;
+}
+
+void isoDrive::BuildDirIndex(void) {
+	// walk every directory reachable from the root (including through the . and .. entries,
+	// which is why each directory is only visited once) the same way lookup() would scan it
+	std::set<DirIndexDir> visited;
+	std::vector<isoDirEntry> pending;
+	pending.push_back(rootEntry);
+	
+	while (!pending.empty()) {
+		isoDirEntry dir = pending.back();
+		pending.pop_back();
+		DirIndexDir dirKey = ((Bit64u)EXTENT_LOCATION(dir) << 32) | DATA_LENGTH(dir);
+		if (!visited.insert(dirKey).second) continue;
+		
+		int dirIterator = GetDirIterator(&dir);
+		isoDirEntry de;
+		while (GetNextDirEntry(dirIterator, &de)) {
+			const DirIterator& iterator = dirIterators[dirIterator];
+			DirIndexLocation location = ((Bit64u)iterator.currentSector << 32) | (iterator.pos - de.length);
+			
+			std::string name((char*)de.ident);
+			upcase(name);
+			// insert leaves any earlier entry with the same name in place
+			dirIndex.insert(std::make_pair(std::make_pair(dirKey, name), location));
+			
+			if (IS_DIR(de.fileFlags)) pending.push_back(de);
+		}
+		FreeDirIterator(dirIterator);
+	}
+	dirIndexed = true;
+}
+
+bool isoDrive::lookupIndexed(isoDirEntry *de, char *isoPath) {
+	for(char* name = strtok(isoPath, "/"); NULL != name; name = strtok(NULL, "/")) {
+		// current entry must be a directory, abort otherwise
+		if (!IS_DIR(de->fileFlags)) return false;
+		
+		// remove the trailing dot if present
+		size_t nameLength = strlen(name);
+		if (nameLength > 0) {
+			if (name[nameLength - 1] == '.') name[nameLength - 1] = 0;
+		}
+		
+		std::string key(name);
+		upcase(key);
+		DirIndexDir dirKey = ((Bit64u)EXTENT_LOCATION(*de) << 32) | DATA_LENGTH(*de);
+		DirIndex::const_iterator entry = dirIndex.find(std::make_pair(dirKey, key));
+		if (entry == dirIndex.end()) return false;
+		
+		Bit8u* buffer = NULL;
+		if (!ReadCachedSector(&buffer, (Bit32u)(entry->second >> 32))) return false;
+		if (readDirEntry(de, &buffer[(Bit32u)entry->second]) < 0) return false;
+	}
+	return true;
+}
+//--End of modifications
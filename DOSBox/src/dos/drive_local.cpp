@@ -31,6 +31,12 @@
 #include "cross.h"
 #include "inout.h"
 
+//--Added to keep the directory cache in step with changes made to the host folder outside of DOSBox
+#import "BXCoalfaceDrives.h"
+//--End of modifications
+
+//--Moved to drives.h so that zipDrive can hand out local files from its shadow folder
+/*
 class localFile : public DOS_File {
 public:
 	localFile(const char* name, FILE * handle);
@@ -50,6 +56,8 @@ private:
 	bool read_only_medium;
 	enum { NONE,READ,WRITE } last_action;
 };
+*/
+//--End of modifications
 
 
 bool localDrive::FileCreate(DOS_File * * file,const char * name,Bit16u /*attributes*/) {
@@ -595,6 +603,12 @@ bool localDrive::read_directory_next(void *handle, char* entry_name, bool& is_di
 }
 //--End of modifications
 
+//--Added to let the drive cache tell whether a directory has changed since it was last read
+bool localDrive::get_directory_stamp(const char *dir, Bit64u& stamp) {
+	return boxer_getLocalDirectoryStamp(dir, this, &stamp);
+}
+//--End of modifications
+
 localDrive::localDrive(const char * startdir,Bit16u _bytes_sector,Bit8u _sectors_cluster,Bit16u _total_clusters,Bit16u _free_clusters,Bit8u _mediaid) {
 	strcpy(basedir,startdir);
 	sprintf(info,"local directory %s",startdir);
@@ -608,9 +622,25 @@ localDrive::localDrive(const char * startdir,Bit16u _bytes_sector,Bit8u _sectors
 	strcpy(systempath, startdir);
 	//--End of modifications
 	
+	//--Added to keep the directory cache in step with changes made to the host folder outside of DOSBox
+	watcher = NULL;
+	//--End of modifications
+	
 	dirCache.SetBaseDir(basedir,this);
+	
+	//--Added to keep the directory cache in step with changes made to the host folder outside of DOSBox
+	watcher = boxer_watchLocalDrive(basedir, this);
+	//--End of modifications
 }
 
+//--Added to stop watching the host folder when the drive goes away
+localDrive::~localDrive() {
+	if (watcher) boxer_unwatchLocalDrive(watcher);
+	//Another drive may be created at the same address, so don't let it inherit our cached paths.
+	boxer_invalidateLocalPathCache();
+}
+//--End of modifications
+
 
 //TODO Maybe use fflush, but that seemed to fuck up in visual c
 bool localFile::Read(Bit8u * data,Bit16u * size) {
@@ -778,6 +808,13 @@ void localFile::willBecomeUnavailable()
 }
 //--End of modification
 
+//--Added to let Boxer push writes out to the host before tearing down the emulator without closing files
+void localFile::Flush()
+{
+	if (fhandle && last_action==WRITE) fflush(fhandle);
+}
+//--End of modifications
+
 
 
 // ********************************************
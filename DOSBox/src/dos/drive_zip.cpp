@@ -0,0 +1,1103 @@
+/*
+ *  Copyright (C) 2002-2010  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+//--Added to mount zip archives directly as DOS drives, without unpacking them first.
+//The archive's central directory is read once at mount time and turned into an in-memory
+//index of 8.3 DOS paths, so that directory searches and lookups never touch the archive.
+//Stored files are read straight out of the archive; deflated files are inflated on demand
+//in fixed-size blocks, the most recent of which are kept per open file so that programs
+//seeking around within a file don't have to reinflate it from the start each time.
+//The archive itself is never modified: if the drive is given a shadow folder, changes are
+//written there instead, using the same layout as ADBShadowedFilesystem (modified files
+//copied into the shadow, deletions recorded as empty .deleted marker files), so that
+//Boxer's existing tools for reverting shadowed changes work for archives too.
+
+#include <cctype>
+#include <cstring>
+#include <cstdio>
+#include <ctime>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include "dosbox.h"
+#include "dos_inc.h"
+#include "drives.h"
+#include "support.h"
+#include "cross.h"
+
+using namespace std;
+
+#define ZIP_LOCAL_SIGNATURE		0x04034b50
+#define ZIP_CENTRAL_SIGNATURE	0x02014b50
+#define ZIP_END_SIGNATURE		0x06054b50
+#define ZIP_END_SIZE			22
+#define ZIP_CENTRAL_SIZE		46
+#define ZIP_LOCAL_SIZE			30
+
+#define ZIP_METHOD_STORED		0
+#define ZIP_METHOD_DEFLATED		8
+#define ZIP_FLAG_ENCRYPTED		0x0001
+
+#define ZIP_BLOCKSIZE			32768	// size of the blocks a deflated file is inflated in
+#define ZIP_CACHEDBLOCKS		8		// how many inflated blocks each open file keeps around
+
+#define ZIP_DELETEDSUFFIX		".deleted"
+
+static inline Bit16u zipWord(const Bit8u *p) {
+	return (Bit16u)(p[0] | (p[1] << 8));
+}
+
+static inline Bit32u zipLong(const Bit8u *p) {
+	return (Bit32u)p[0] | ((Bit32u)p[1] << 8) | ((Bit32u)p[2] << 16) | ((Bit32u)p[3] << 24);
+}
+
+static string zipUpcase(const string &str) {
+	string result(str);
+	for (size_t i = 0; i < result.size(); i++) result[i] = toupper(result[i]);
+	return result;
+}
+
+static bool zipIsDOSChar(char c) {
+	if (isalnum((unsigned char)c)) return true;
+	return (c && strchr("!#$%&'()-@^_`{}~", c) != NULL);
+}
+
+// whether the specified (upper-cased) name can be used as-is in DOS
+static bool zipIsDOSName(const string &name) {
+	size_t dot = name.find('.');
+	string base = name.substr(0, dot);
+	string ext = (dot == string::npos) ? "" : name.substr(dot + 1);
+	if (base.empty() || base.size() > 8 || ext.size() > 3) return false;
+	if (dot != string::npos && ext.empty()) return false;
+	for (size_t i = 0; i < base.size(); i++) if (!zipIsDOSChar(base[i])) return false;
+	for (size_t i = 0; i < ext.size(); i++) if (!zipIsDOSChar(ext[i])) return false;
+	return true;
+}
+
+static void zipPackHostTime(time_t when, Bit16u &date, Bit16u &time) {
+	struct tm *ltime = localtime(&when);
+	if (ltime) {
+		date = DOS_PackDate((Bit16u)(ltime->tm_year + 1900), (Bit16u)(ltime->tm_mon + 1), (Bit16u)ltime->tm_mday);
+		time = DOS_PackTime((Bit16u)ltime->tm_hour, (Bit16u)ltime->tm_min, (Bit16u)ltime->tm_sec);
+	} else {
+		date = DOS_PackDate(1980, 1, 1);
+		time = 0;
+	}
+}
+
+
+class zipFile : public DOS_File {
+public:
+	zipFile(zipDrive *drive, const char *name, Bit32u entry);
+	~zipFile();
+	bool Read(Bit8u *data, Bit16u *size);
+	bool Write(Bit8u *data, Bit16u *size);
+	bool Seek(Bit32u *pos, Bit32u type);
+	bool Close();
+	Bit16u GetInformation(void);
+private:
+	const Bit8u *blockAt(Bit32u index, Bit32u &length);
+	bool inflateBlock(Bit8u *buffer, Bit32u length);
+	bool rewindStream(void);
+
+	struct Block {
+		Bit32u index;
+		Bit32u lastUsed;
+		Bit8u *data;
+	};
+
+	zipDrive *drive;
+	Bit64u dataOffset;
+	Bit32u compressedSize;
+	Bit32u fileSize;
+	Bit32u filePos;
+	bool deflated;
+
+	z_stream stream;
+	bool streamOpen;
+	Bit32u streamBlock;		// the block the stream will inflate next
+	Bit32u streamInput;		// how much of the compressed data the stream has consumed
+	Bit8u input[4096];
+
+	Block blocks[ZIP_CACHEDBLOCKS];
+	Bit32u useCounter;
+};
+
+zipFile::zipFile(zipDrive *drv, const char *filename, Bit32u entry) {
+	const zipDrive::Entry &e = drv->entryAtIndex(entry);
+	drive = drv;
+	time = e.time;
+	date = e.date;
+	attr = e.attr;
+	dataOffset = drv->dataOffsetForEntry(entry);
+	compressedSize = e.compressedSize;
+	fileSize = dataOffset ? e.size : 0;
+	filePos = 0;
+	deflated = (e.method == ZIP_METHOD_DEFLATED);
+	streamOpen = false;
+	streamBlock = 0;
+	streamInput = 0;
+	memset(&stream, 0, sizeof(stream));
+	for (Bitu i = 0; i < ZIP_CACHEDBLOCKS; i++) {
+		blocks[i].data = NULL;
+		blocks[i].lastUsed = 0;
+	}
+	useCounter = 0;
+	open = true;
+	this->name = NULL;
+	SetName(filename);
+}
+
+zipFile::~zipFile() {
+	if (streamOpen) inflateEnd(&stream);
+	for (Bitu i = 0; i < ZIP_CACHEDBLOCKS; i++) delete[] blocks[i].data;
+}
+
+bool zipFile::rewindStream(void) {
+	if (streamOpen) inflateEnd(&stream);
+	memset(&stream, 0, sizeof(stream));
+	// negative window bits: zip entries are raw deflate streams without a zlib header
+	streamOpen = (inflateInit2(&stream, -MAX_WBITS) == Z_OK);
+	streamBlock = 0;
+	streamInput = 0;
+	return streamOpen;
+}
+
+// inflates the next length bytes of the file into buffer
+bool zipFile::inflateBlock(Bit8u *buffer, Bit32u length) {
+	stream.next_out = buffer;
+	stream.avail_out = length;
+	while (stream.avail_out > 0) {
+		if (stream.avail_in == 0) {
+			Bit32u chunk = compressedSize - streamInput;
+			if (chunk > sizeof(input)) chunk = sizeof(input);
+			if (chunk == 0 || !drive->readArchive(input, dataOffset + streamInput, chunk)) return false;
+			streamInput += chunk;
+			stream.next_in = input;
+			stream.avail_in = chunk;
+		}
+		int ret = inflate(&stream, Z_NO_FLUSH);
+		if (ret == Z_STREAM_END) break;
+		if (ret != Z_OK) return false;
+	}
+	return (stream.avail_out == 0);
+}
+
+// returns the inflated contents of the specified block, inflating it if it isn't already cached
+const Bit8u *zipFile::blockAt(Bit32u index, Bit32u &length) {
+	length = fileSize - index * ZIP_BLOCKSIZE;
+	if (length > ZIP_BLOCKSIZE) length = ZIP_BLOCKSIZE;
+
+	Block *victim = &blocks[0];
+	for (Bitu i = 0; i < ZIP_CACHEDBLOCKS; i++) {
+		if (blocks[i].data && blocks[i].index == index) {
+			blocks[i].lastUsed = ++useCounter;
+			return blocks[i].data;
+		}
+		if (blocks[i].lastUsed < victim->lastUsed) victim = &blocks[i];
+	}
+
+	// deflate streams can only be read forwards, so going back means starting over
+	if (!streamOpen || streamBlock > index) {
+		if (!rewindStream()) return NULL;
+	}
+
+	if (!victim->data) victim->data = new Bit8u[ZIP_BLOCKSIZE];
+	victim->lastUsed = 0;
+	while (streamBlock <= index) {
+		Bit32u blockLength = fileSize - streamBlock * ZIP_BLOCKSIZE;
+		if (blockLength > ZIP_BLOCKSIZE) blockLength = ZIP_BLOCKSIZE;
+		// blocks skipped on the way are inflated into the victim too, and simply overwritten
+		if (!inflateBlock(victim->data, blockLength)) {
+			inflateEnd(&stream);
+			streamOpen = false;
+			return NULL;
+		}
+		streamBlock++;
+	}
+	victim->index = index;
+	victim->lastUsed = ++useCounter;
+	return victim->data;
+}
+
+bool zipFile::Read(Bit8u *data, Bit16u *size) {
+	if (filePos >= fileSize) {
+		*size = 0;
+		return true;
+	}
+	if (fileSize - filePos < *size)
+		*size = (Bit16u)(fileSize - filePos);
+
+	if (!deflated) {
+		if (!drive->readArchive(data, dataOffset + filePos, *size)) {
+			DOS_SetError(DOSERR_ACCESS_DENIED);
+			return false;
+		}
+		filePos += *size;
+		return true;
+	}
+
+	Bit16u nowSize = 0;
+	while (nowSize < *size) {
+		Bit32u blockLength;
+		const Bit8u *block = blockAt(filePos / ZIP_BLOCKSIZE, blockLength);
+		if (!block) break;
+		Bit32u blockPos = filePos % ZIP_BLOCKSIZE;
+		Bit32u remSize = *size - nowSize;
+		Bit32u remBlock = blockLength - blockPos;
+		Bit32u count = (remBlock < remSize) ? remBlock : remSize;
+		memcpy(&data[nowSize], &block[blockPos], count);
+		nowSize += (Bit16u)count;
+		filePos += count;
+	}
+	*size = nowSize;
+	return true;
+}
+
+bool zipFile::Write(Bit8u* /*data*/, Bit16u* /*size*/) {
+	return false;
+}
+
+bool zipFile::Seek(Bit32u *pos, Bit32u type) {
+	switch (type) {
+		case DOS_SEEK_SET:
+			filePos = *pos;
+			break;
+		case DOS_SEEK_CUR:
+			filePos += *pos;
+			break;
+		case DOS_SEEK_END:
+			filePos = fileSize + *pos;
+			break;
+		default:
+			return false;
+	}
+	if (filePos > fileSize)
+		filePos = fileSize;
+
+	*pos = filePos;
+	return true;
+}
+
+bool zipFile::Close() {
+	if (refCtr == 1) open = false;
+	return true;
+}
+
+Bit16u zipFile::GetInformation(void) {
+	return 0x40;		// read-only drive
+}
+
+
+zipDrive::zipDrive(const char *path, const char *shadow, Bit8u _mediaid, int &error) {
+	archivePath = path;
+	shadowPath = shadow ? shadow : "";
+	while (shadowPath.size() > 1 && shadowPath[shadowPath.size() - 1] == '/')
+		shadowPath.erase(shadowPath.size() - 1);
+	mediaid = _mediaid;
+	totalSize = 0;
+	nextSearch = 0;
+	memset(searchPositions, 0, sizeof(searchPositions));
+	label[0] = 0;
+
+	archive = open(path, O_RDONLY);
+	if (archive < 0) {
+		error = 3; //Could not read archive
+		return;
+	}
+	if (!loadIndex()) {
+		close(archive);
+		archive = -1;
+		error = 6; //Corrupt or unsupported archive
+		return;
+	}
+
+	// label the drive after the archive, minus its extension
+	string stem = archivePath.substr(archivePath.find_last_of('/') + 1);
+	size_t dot = stem.find_last_of('.');
+	if (dot != string::npos && dot > 0) stem.erase(dot);
+	string labelName;
+	for (size_t i = 0; i < stem.size() && labelName.size() < 11; i++)
+		if (zipIsDOSChar(stem[i])) labelName += stem[i];
+	if (labelName.size() > 8) labelName.insert(8, ".");
+	Set_Label(labelName.c_str(), label, false);
+
+	strcpy(info, "zipDrive ");
+	strncat(info, path, sizeof(info) - strlen(info) - 1);
+	safe_strncpy(systempath, path, CROSS_LEN);
+
+	if (!shadowPath.empty()) scanShadow("");
+	error = 0;
+}
+
+zipDrive::~zipDrive() {
+	if (archive >= 0) close(archive);
+}
+
+bool zipDrive::readArchive(void *buffer, Bit64u offset, size_t length) {
+	Bit8u *dest = (Bit8u *)buffer;
+	while (length > 0) {
+		ssize_t count = pread(archive, dest, length, (off_t)offset);
+		if (count <= 0) return false;
+		dest += count;
+		offset += count;
+		length -= count;
+	}
+	return true;
+}
+
+Bit64u zipDrive::dataOffsetForEntry(Bit32u index) {
+	Entry &e = entries[index];
+	if (!e.dataOffset) {
+		Bit8u header[ZIP_LOCAL_SIZE];
+		if (!readArchive(header, e.headerOffset, sizeof(header)) || zipLong(header) != ZIP_LOCAL_SIGNATURE)
+			return 0;
+		// the local header's name and extra field can differ in length from the central directory's
+		e.dataOffset = e.headerOffset + ZIP_LOCAL_SIZE + zipWord(header + 26) + zipWord(header + 28);
+	}
+	return e.dataOffset;
+}
+
+bool zipDrive::loadIndex(void) {
+	struct stat status;
+	if (fstat(archive, &status) != 0) return false;
+	totalSize = status.st_size;
+	if (totalSize < ZIP_END_SIZE) return false;
+
+	// the end-of-central-directory record sits at the very end, unless followed by an archive comment
+	Bit32u tailSize = (totalSize < 0xFFFF + ZIP_END_SIZE) ? (Bit32u)totalSize : 0xFFFF + ZIP_END_SIZE;
+	vector<Bit8u> tail(tailSize);
+	if (!readArchive(&tail[0], totalSize - tailSize, tailSize)) return false;
+
+	Bits endPos;
+	for (endPos = tailSize - ZIP_END_SIZE; endPos >= 0; endPos--)
+		if (zipLong(&tail[endPos]) == ZIP_END_SIGNATURE) break;
+	if (endPos < 0) {
+		LOG_MSG("ZIP: %s is not a zip archive", archivePath.c_str());
+		return false;
+	}
+
+	const Bit8u *end = &tail[endPos];
+	Bit16u entryCount = zipWord(end + 10);
+	Bit32u centralSize = zipLong(end + 12);
+	Bit32u centralOffset = zipLong(end + 16);
+	if (entryCount == 0xFFFF || centralOffset == 0xFFFFFFFF) {
+		LOG_MSG("ZIP: %s is a zip64 archive, which is not supported", archivePath.c_str());
+		return false;
+	}
+	if ((Bit64u)centralOffset + centralSize > totalSize) return false;
+
+	vector<Bit8u> central(centralSize + 1);
+	if (centralSize && !readArchive(&central[0], centralOffset, centralSize)) return false;
+
+	Entry root;
+	root.isDirectory = true;
+	root.method = ZIP_METHOD_STORED;
+	root.flags = 0;
+	root.compressedSize = root.size = 0;
+	root.headerOffset = root.dataOffset = 0;
+	zipPackHostTime(status.st_mtime, root.date, root.time);
+	root.attr = DOS_ATTR_DIRECTORY;
+	entries.push_back(root);
+
+	map<string, Bit32u> hostIndex;
+	hostIndex[""] = 0;
+
+	Bit32u pos = 0;
+	for (Bitu i = 0; i < entryCount; i++) {
+		if (pos + ZIP_CENTRAL_SIZE > centralSize) break;
+		const Bit8u *record = &central[pos];
+		if (zipLong(record) != ZIP_CENTRAL_SIGNATURE) break;
+
+		Bit8u madeBy = record[5];
+		Bit16u flags = zipWord(record + 8);
+		Bit16u method = zipWord(record + 10);
+		Bit16u time = zipWord(record + 12);
+		Bit16u date = zipWord(record + 14);
+		Bit32u compressedSize = zipLong(record + 20);
+		Bit32u size = zipLong(record + 24);
+		Bit16u nameLength = zipWord(record + 28);
+		Bit16u extraLength = zipWord(record + 30);
+		Bit16u commentLength = zipWord(record + 32);
+		Bit32u externalAttr = zipLong(record + 38);
+		Bit32u headerOffset = zipLong(record + 42);
+
+		Bit32u recordSize = ZIP_CENTRAL_SIZE + nameLength + extraLength + commentLength;
+		if (pos + recordSize > centralSize) break;
+		string name((const char *)record + ZIP_CENTRAL_SIZE, nameLength);
+		pos += recordSize;
+
+		for (size_t c = 0; c < name.size(); c++) if (name[c] == '\\') name[c] = '/';
+		bool isDirectory = (!name.empty() && name[name.size() - 1] == '/');
+		while (!name.empty() && name[0] == '/') name.erase(0, 1);
+		while (!name.empty() && name[name.size() - 1] == '/') name.erase(name.size() - 1);
+		if (name.empty() || name.compare(0, 9, "__MACOSX/") == 0 || name == "__MACOSX") continue;
+		if (name == ".." || name.compare(0, 3, "../") == 0 || name.find("/../") != string::npos) continue;
+
+		if (!isDirectory) {
+			if (flags & ZIP_FLAG_ENCRYPTED) {
+				LOG_MSG("ZIP: Skipping encrypted file %s", name.c_str());
+				continue;
+			}
+			if (method != ZIP_METHOD_STORED && method != ZIP_METHOD_DEFLATED) {
+				LOG_MSG("ZIP: Skipping %s, which uses unsupported compression method %d", name.c_str(), method);
+				continue;
+			}
+			if (size == 0xFFFFFFFF || compressedSize == 0xFFFFFFFF || headerOffset == 0xFFFFFFFF) {
+				LOG_MSG("ZIP: Skipping %s, which needs zip64 support", name.c_str());
+				continue;
+			}
+		}
+
+		Bit32u index = addEntry(name, hostIndex);
+		Entry &e = entries[index];
+		e.isDirectory = isDirectory;
+		e.method = method;
+		e.flags = flags;
+		e.compressedSize = isDirectory ? 0 : compressedSize;
+		e.size = isDirectory ? 0 : size;
+		e.headerOffset = headerOffset;
+		e.dataOffset = 0;
+		e.date = date;
+		e.time = time;
+		// only archives made on DOS-like systems store meaningful DOS attributes
+		e.attr = (madeBy == 0 || madeBy == 11 || madeBy == 14) ? (externalAttr & (DOS_ATTR_READ_ONLY | DOS_ATTR_HIDDEN | DOS_ATTR_SYSTEM)) : 0;
+		e.attr |= isDirectory ? DOS_ATTR_DIRECTORY : DOS_ATTR_ARCHIVE;
+		if (shadowPath.empty()) e.attr |= DOS_ATTR_READ_ONLY;
+	}
+
+	assignDOSNames(0, "");
+	return true;
+}
+
+// returns the index of the entry at the specified path, adding it (and any missing parent directories) if needed
+Bit32u zipDrive::addEntry(const string &hostPath, map<string, Bit32u> &hostIndex) {
+	map<string, Bit32u>::iterator found = hostIndex.find(hostPath);
+	if (found != hostIndex.end()) return found->second;
+
+	size_t slash = hostPath.find_last_of('/');
+	Bit32u parent = (slash == string::npos) ? 0 : addEntry(hostPath.substr(0, slash), hostIndex);
+
+	Entry e;
+	e.hostName = (slash == string::npos) ? hostPath : hostPath.substr(slash + 1);
+	e.isDirectory = true;
+	e.method = ZIP_METHOD_STORED;
+	e.flags = 0;
+	e.compressedSize = e.size = 0;
+	e.headerOffset = e.dataOffset = 0;
+	e.date = entries[0].date;
+	e.time = entries[0].time;
+	e.attr = DOS_ATTR_DIRECTORY;
+
+	Bit32u index = (Bit32u)entries.size();
+	entries.push_back(e);
+	entries[parent].children.push_back(index);
+	hostIndex[hostPath] = index;
+	return index;
+}
+
+// gives each entry in the directory a unique 8.3 name: names that are already valid in DOS are
+// kept as they are, and the rest are shortened the same way Windows does, to BASENA~1.EXT
+void zipDrive::assignDOSNames(Bit32u dirIndex, const string &dosPath) {
+	vector<Bit32u> &children = entries[dirIndex].children;
+	set<string> taken;
+	vector<Bit32u> unnamed;
+
+	for (size_t i = 0; i < children.size(); i++) {
+		Entry &e = entries[children[i]];
+		string name = zipUpcase(e.hostName);
+		if (zipIsDOSName(name) && taken.find(name) == taken.end()) {
+			e.dosName = name;
+			taken.insert(name);
+		} else unnamed.push_back(children[i]);
+	}
+
+	for (size_t i = 0; i < unnamed.size(); i++) {
+		Entry &e = entries[unnamed[i]];
+		string name = zipUpcase(e.hostName);
+		size_t dot = name.find_last_of('.');
+		string base, ext;
+		for (size_t c = 0; c < name.size() && c != dot; c++)
+			if (zipIsDOSChar(name[c])) base += name[c];
+		if (dot != string::npos) {
+			for (size_t c = dot + 1; c < name.size() && ext.size() < 3; c++)
+				if (zipIsDOSChar(name[c])) ext += name[c];
+		}
+		if (base.empty()) base = "_";
+
+		for (Bitu n = 1; ; n++) {
+			char suffix[16];
+			sprintf(suffix, "~%lu", (unsigned long)n);
+			size_t baseLength = 8 - strlen(suffix);
+			string candidate = base.substr(0, baseLength) + suffix;
+			if (!ext.empty()) candidate += "." + ext;
+			if (taken.find(candidate) == taken.end()) {
+				e.dosName = candidate;
+				taken.insert(candidate);
+				break;
+			}
+		}
+	}
+
+	for (size_t i = 0; i < children.size(); i++) {
+		Bit32u child = children[i];
+		string childPath = dosPath + entries[child].dosName;
+		entryIndex[childPath] = child;
+		if (entries[child].isDirectory) assignDOSNames(child, childPath + "\\");
+	}
+}
+
+void zipDrive::scanShadow(const string &relativePath) {
+	DIR *dir = ::opendir(shadowPathFor(relativePath).c_str());
+	if (!dir) return;
+	struct dirent *item;
+	while ((item = readdir(dir)) != NULL) {
+		if (!strcmp(item->d_name, ".") || !strcmp(item->d_name, "..")) continue;
+		string childPath = relativePath.empty() ? string(item->d_name) : relativePath + "/" + item->d_name;
+		shadowIndex.insert(zipUpcase(childPath));
+		struct stat status;
+		if (stat(shadowPathFor(childPath).c_str(), &status) == 0 && S_ISDIR(status.st_mode))
+			scanShadow(childPath);
+	}
+	::closedir(dir);
+}
+
+void zipDrive::EmptyCache(void) {
+	shadowIndex.clear();
+	if (!shadowPath.empty()) scanShadow("");
+}
+
+bool zipDrive::findEntry(const char *dosPath, Bit32u &index) {
+	string path = zipUpcase(dosPath);
+	while (!path.empty() && path[0] == '\\') path.erase(0, 1);
+	while (!path.empty() && path[path.size() - 1] == '\\') path.erase(path.size() - 1);
+	if (path.empty()) {
+		index = 0;
+		return true;
+	}
+	map<string, Bit32u>::iterator found = entryIndex.find(path);
+	if (found == entryIndex.end()) return false;
+	index = found->second;
+	return true;
+}
+
+// maps a DOS path to a path relative to the root of the archive and the shadow folder,
+// using the archive's own names for anything that the archive contains
+string zipDrive::relativeHostPath(const char *dosPath) {
+	string result, dosPrefix;
+	const char *component = dosPath;
+	while (*component) {
+		const char *separator = strchr(component, '\\');
+		size_t length = separator ? (size_t)(separator - component) : strlen(component);
+		if (length) {
+			string name(component, length);
+			dosPrefix += (dosPrefix.empty() ? "" : "\\") + zipUpcase(name);
+			map<string, Bit32u>::iterator found = entryIndex.find(dosPrefix);
+			if (!result.empty()) result += "/";
+			result += (found != entryIndex.end()) ? entries[found->second].hostName : zipUpcase(name);
+		}
+		if (!separator) break;
+		component = separator + 1;
+	}
+	return result;
+}
+
+string zipDrive::shadowPathFor(const string &relativePath) {
+	if (relativePath.empty()) return shadowPath;
+	return shadowPath + "/" + relativePath;
+}
+
+bool zipDrive::isShadowed(const string &relativePath) {
+	return (shadowIndex.find(zipUpcase(relativePath)) != shadowIndex.end());
+}
+
+// whether the item, or any directory containing it, has been marked as deleted in the shadow
+bool zipDrive::isDeleted(const string &relativePath) {
+	string key = zipUpcase(relativePath);
+	while (!key.empty()) {
+		if (shadowIndex.find(key + zipUpcase(ZIP_DELETEDSUFFIX)) != shadowIndex.end()) return true;
+		size_t slash = key.find_last_of('/');
+		if (slash == string::npos) break;
+		key.erase(slash);
+	}
+	return false;
+}
+
+bool zipDrive::lookup(const char *dosPath, PathInfo &info) {
+	memset(&info, 0, sizeof(info));
+	string relativePath = relativeHostPath(dosPath);
+	if (relativePath.empty()) {
+		info.exists = info.isDirectory = true;
+		info.date = entries[0].date;
+		info.time = entries[0].time;
+		info.attr = DOS_ATTR_DIRECTORY;
+		return true;
+	}
+	if (isDeleted(relativePath)) return false;
+
+	if (isShadowed(relativePath)) {
+		struct stat status;
+		if (stat(shadowPathFor(relativePath).c_str(), &status) != 0) return false;
+		info.exists = true;
+		info.inShadow = true;
+		info.isDirectory = S_ISDIR(status.st_mode);
+		info.size = info.isDirectory ? 0 : (Bit32u)status.st_size;
+		zipPackHostTime(status.st_mtime, info.date, info.time);
+		info.attr = info.isDirectory ? DOS_ATTR_DIRECTORY : DOS_ATTR_ARCHIVE;
+		findEntry(dosPath, info.entry);
+		return true;
+	}
+
+	if (!findEntry(dosPath, info.entry)) return false;
+	const Entry &e = entries[info.entry];
+	info.exists = true;
+	info.isDirectory = e.isDirectory;
+	info.size = e.size;
+	info.date = e.date;
+	info.time = e.time;
+	info.attr = e.attr;
+	return true;
+}
+
+bool zipDrive::canWrite(const char *dosPath) {
+	if (shadowPath.empty()) return false;
+	return boxer_shouldAllowWriteAccessToPath(shadowPathFor(relativeHostPath(dosPath)).c_str(), this);
+}
+
+// creates the shadow folder and any directories within it that the specified item needs
+bool zipDrive::makeShadowParents(const string &relativePath) {
+	if (mkdir(shadowPath.c_str(), 0755) != 0 && errno != EEXIST) return false;
+	size_t slash = 0;
+	while ((slash = relativePath.find('/', slash)) != string::npos) {
+		string parent = relativePath.substr(0, slash);
+		if (mkdir(shadowPathFor(parent).c_str(), 0755) != 0 && errno != EEXIST) return false;
+		shadowIndex.insert(zipUpcase(parent));
+		slash++;
+	}
+	return true;
+}
+
+// copies an archived file into the shadow, so that it can be modified
+bool zipDrive::extractToShadow(Bit32u index, const string &relativePath) {
+	if (!makeShadowParents(relativePath)) return false;
+	string destination = shadowPathFor(relativePath);
+	FILE *output = fopen(destination.c_str(), "wb");
+	if (!output) return false;
+
+	zipFile source(this, entries[index].dosName.c_str(), index);
+	Bit8u buffer[0x8000];
+	bool success = true;
+	while (success) {
+		Bit16u count = sizeof(buffer);
+		if (!source.Read(buffer, &count)) success = false;
+		else if (count == 0) break;
+		else if (fwrite(buffer, 1, count, output) != count) success = false;
+	}
+	fclose(output);
+
+	if (!success) {
+		unlink(destination.c_str());
+		return false;
+	}
+	shadowIndex.insert(zipUpcase(relativePath));
+	unmarkDeleted(relativePath);
+	return true;
+}
+
+void zipDrive::markDeleted(const string &relativePath) {
+	if (!makeShadowParents(relativePath)) return;
+	string marker = relativePath + ZIP_DELETEDSUFFIX;
+	FILE *output = fopen(shadowPathFor(marker).c_str(), "wb");
+	if (output) {
+		fclose(output);
+		shadowIndex.insert(zipUpcase(marker));
+	}
+}
+
+void zipDrive::unmarkDeleted(const string &relativePath) {
+	string marker = relativePath + ZIP_DELETEDSUFFIX;
+	if (isShadowed(marker)) {
+		unlink(shadowPathFor(marker).c_str());
+		shadowIndex.erase(zipUpcase(marker));
+	}
+}
+
+// deletes the shadowed copy of the specified item, along with anything inside it
+void zipDrive::removeShadowItem(const string &relativePath) {
+	DIR *dir = ::opendir(shadowPathFor(relativePath).c_str());
+	if (dir) {
+		struct dirent *item;
+		vector<string> names;
+		while ((item = readdir(dir)) != NULL) {
+			if (strcmp(item->d_name, ".") && strcmp(item->d_name, "..")) names.push_back(item->d_name);
+		}
+		::closedir(dir);
+		for (size_t i = 0; i < names.size(); i++) removeShadowItem(relativePath + "/" + names[i]);
+		rmdir(shadowPathFor(relativePath).c_str());
+	} else unlink(shadowPathFor(relativePath).c_str());
+	shadowIndex.erase(zipUpcase(relativePath));
+}
+
+// gathers everything in the specified directory from both the archive and the shadow
+void zipDrive::listDirectory(const char *dosDir, vector<FindResult> &results) {
+	string dosPrefix = zipUpcase(dosDir);
+	while (!dosPrefix.empty() && dosPrefix[dosPrefix.size() - 1] == '\\') dosPrefix.erase(dosPrefix.size() - 1);
+	string relativePrefix = relativeHostPath(dosPrefix.c_str());
+	if (!dosPrefix.empty()) {
+		dosPrefix += "\\";
+		relativePrefix += "/";
+	}
+
+	PathInfo info;
+	if (!dosPrefix.empty() && lookup(dosDir, info)) {
+		FindResult dot;
+		dot.name = ".";
+		dot.size = 0;
+		dot.date = info.date;
+		dot.time = info.time;
+		dot.attr = DOS_ATTR_DIRECTORY;
+		results.push_back(dot);
+		dot.name = "..";
+		results.push_back(dot);
+	}
+
+	set<string> listed;
+	Bit32u dirIndex;
+	if (findEntry(dosPrefix.c_str(), dirIndex) && entries[dirIndex].isDirectory) {
+		const vector<Bit32u> &children = entries[dirIndex].children;
+		for (size_t i = 0; i < children.size(); i++) {
+			const Entry &e = entries[children[i]];
+			listed.insert(zipUpcase(e.hostName));
+			if (!lookup((dosPrefix + e.dosName).c_str(), info)) continue;
+			FindResult result;
+			result.name = e.dosName;
+			result.size = info.size;
+			result.date = info.date;
+			result.time = info.time;
+			result.attr = (Bit8u)info.attr;
+			results.push_back(result);
+		}
+	}
+
+	string shadowPrefix = zipUpcase(relativePrefix);
+	string deletedSuffix = zipUpcase(ZIP_DELETEDSUFFIX);
+	for (set<string>::iterator i = shadowIndex.lower_bound(shadowPrefix); i != shadowIndex.end() && i->compare(0, shadowPrefix.size(), shadowPrefix) == 0; i++) {
+		string name = i->substr(shadowPrefix.size());
+		if (name.empty() || name.find('/') != string::npos) continue;
+		if (name.size() > deletedSuffix.size() && name.compare(name.size() - deletedSuffix.size(), deletedSuffix.size(), deletedSuffix) == 0) continue;
+		if (listed.find(name) != listed.end() || !zipIsDOSName(name)) continue;
+		if (!lookup((dosPrefix + name).c_str(), info)) continue;
+		FindResult result;
+		result.name = name;
+		result.size = info.size;
+		result.date = info.date;
+		result.time = info.time;
+		result.attr = (Bit8u)info.attr;
+		results.push_back(result);
+	}
+}
+
+bool zipDrive::FileOpen(DOS_File **file, const char *name, Bit32u flags) {
+	switch (flags & 0xf) {
+	case OPEN_READ: case OPEN_WRITE: case OPEN_READWRITE: break;
+	default:
+		DOS_SetError(DOSERR_ACCESS_CODE_INVALID);
+		return false;
+	}
+
+	PathInfo info;
+	if (!lookup(name, info) || info.isDirectory) return false;
+
+	bool writing = ((flags & 0xf) != OPEN_READ);
+	if (writing && !canWrite(name)) {
+		//Copy-pasted from cdromDrive::FileOpen
+		if ((flags&3)==OPEN_READWRITE) {
+			flags &= ~OPEN_READWRITE;
+			writing = false;
+		} else {
+			DOS_SetError(DOSERR_ACCESS_DENIED);
+			return false;
+		}
+	}
+
+	string relativePath = relativeHostPath(name);
+	if (writing && !info.inShadow) {
+		if (!extractToShadow(info.entry, relativePath)) {
+			DOS_SetError(DOSERR_ACCESS_DENIED);
+			return false;
+		}
+		info.inShadow = true;
+	}
+
+	if (info.inShadow) {
+		FILE *handle = fopen(shadowPathFor(relativePath).c_str(), writing ? "rb+" : "rb");
+		if (!handle) return false;
+		*file = new localFile(name, handle);
+	} else {
+		*file = new zipFile(this, name, info.entry);
+	}
+	(*file)->flags = flags;
+	return true;
+}
+
+bool zipDrive::FileCreate(DOS_File **file, const char *name, Bit16u /*attributes*/) {
+	if (!canWrite(name)) {
+		DOS_SetError(DOSERR_ACCESS_DENIED);
+		return false;
+	}
+
+	string relativePath = relativeHostPath(name);
+	PathInfo info;
+	if (lookup(name, info) && info.isDirectory) {
+		DOS_SetError(DOSERR_ACCESS_DENIED);
+		return false;
+	}
+	if (!makeShadowParents(relativePath)) return false;
+
+	FILE *handle = fopen(shadowPathFor(relativePath).c_str(), "wb+");
+	if (!handle) {
+		LOG_MSG("Warning: file creation failed: %s", shadowPathFor(relativePath).c_str());
+		return false;
+	}
+	shadowIndex.insert(zipUpcase(relativePath));
+	unmarkDeleted(relativePath);
+
+	*file = new localFile(name, handle);
+	(*file)->flags = OPEN_READWRITE;
+	return true;
+}
+
+bool zipDrive::FileUnlink(const char *name) {
+	PathInfo info;
+	if (!lookup(name, info) || info.isDirectory) {
+		DOS_SetError(DOSERR_FILE_NOT_FOUND);
+		return false;
+	}
+	if (!canWrite(name)) {
+		DOS_SetError(DOSERR_ACCESS_DENIED);
+		return false;
+	}
+
+	string relativePath = relativeHostPath(name);
+	if (info.inShadow) removeShadowItem(relativePath);
+	Bit32u index;
+	if (findEntry(name, index)) markDeleted(relativePath);
+	return true;
+}
+
+bool zipDrive::RemoveDir(const char *dir) {
+	PathInfo info;
+	if (!lookup(dir, info) || !info.isDirectory || !*dir) {
+		DOS_SetError(DOSERR_PATH_NOT_FOUND);
+		return false;
+	}
+	vector<FindResult> contents;
+	listDirectory(dir, contents);
+	// anything besides . and .. means the directory isn't empty
+	if (contents.size() > 2 || !canWrite(dir)) {
+		DOS_SetError(DOSERR_ACCESS_DENIED);
+		return false;
+	}
+
+	string relativePath = relativeHostPath(dir);
+	if (info.inShadow) removeShadowItem(relativePath);
+	Bit32u index;
+	if (findEntry(dir, index)) markDeleted(relativePath);
+	return true;
+}
+
+bool zipDrive::MakeDir(const char *dir) {
+	PathInfo info;
+	if (lookup(dir, info) || !canWrite(dir)) {
+		DOS_SetError(DOSERR_ACCESS_DENIED);
+		return false;
+	}
+
+	string relativePath = relativeHostPath(dir);
+	if (!makeShadowParents(relativePath)) return false;
+	if (mkdir(shadowPathFor(relativePath).c_str(), 0755) != 0 && errno != EEXIST) return false;
+	shadowIndex.insert(zipUpcase(relativePath));
+
+	// if this replaces a deleted directory from the archive, its old contents stay deleted
+	if (isShadowed(relativePath + ZIP_DELETEDSUFFIX)) {
+		unmarkDeleted(relativePath);
+		Bit32u index;
+		if (findEntry(dir, index)) {
+			const vector<Bit32u> &children = entries[index].children;
+			for (size_t i = 0; i < children.size(); i++)
+				markDeleted(relativePath + "/" + entries[children[i]].hostName);
+		}
+	}
+	return true;
+}
+
+bool zipDrive::TestDir(const char *dir) {
+	PathInfo info;
+	return (lookup(dir, info) && info.isDirectory);
+}
+
+bool zipDrive::FindFirst(const char *_dir, DOS_DTA &dta, bool fcb_findfirst) {
+	PathInfo info;
+	if (!lookup(_dir, info) || !info.isDirectory) {
+		DOS_SetError(DOSERR_PATH_NOT_FOUND);
+		return false;
+	}
+
+	// searches are given out in rotation, the same way as isoDrive's directory iterators
+	Bitu search = nextSearch;
+	nextSearch = (nextSearch + 1) % MAX_OPENDIRS;
+	searches[search].clear();
+	searchPositions[search] = 0;
+	listDirectory(_dir, searches[search]);
+	dta.SetDirID((Bit16u)search);
+
+	bool isRoot = (*_dir == 0);
+	Bit8u attr;
+	char pattern[DOS_NAMELENGTH_ASCII];
+	dta.GetSearchParams(attr, pattern);
+
+	if (attr == DOS_ATTR_VOLUME) {
+		if (strlen(label) != 0) {
+			dta.SetResult(label, 0, 0, 0, DOS_ATTR_VOLUME);
+			return true;
+		} else {
+			DOS_SetError(DOSERR_NO_MORE_FILES);
+			return false;
+		}
+	} else if ((attr & DOS_ATTR_VOLUME) && isRoot && !fcb_findfirst) {
+		if (WildFileCmp(label, pattern)) {
+			dta.SetResult(label, 0, 0, 0, DOS_ATTR_VOLUME);
+			return true;
+		}
+	}
+
+	return FindNext(dta);
+}
+
+bool zipDrive::FindNext(DOS_DTA &dta) {
+	Bit8u attr;
+	char pattern[DOS_NAMELENGTH_ASCII];
+	dta.GetSearchParams(attr, pattern);
+
+	Bitu search = dta.GetDirID();
+	if (search >= MAX_OPENDIRS) {
+		DOS_SetError(DOSERR_NO_MORE_FILES);
+		return false;
+	}
+
+	vector<FindResult> &results = searches[search];
+	while (searchPositions[search] < results.size()) {
+		const FindResult &result = results[searchPositions[search]++];
+		if (WildFileCmp(result.name.c_str(), pattern)
+			&& !(~attr & result.attr & (DOS_ATTR_DIRECTORY | DOS_ATTR_HIDDEN | DOS_ATTR_SYSTEM))) {
+			dta.SetResult(result.name.c_str(), result.size, result.date, result.time, result.attr);
+			return true;
+		}
+	}
+	// after searching the directory, let go of its results
+	vector<FindResult>().swap(results);
+
+	DOS_SetError(DOSERR_NO_MORE_FILES);
+	return false;
+}
+
+bool zipDrive::GetFileAttr(const char *name, Bit16u *attr) {
+	*attr = 0;
+	PathInfo info;
+	if (!lookup(name, info)) return false;
+	*attr = info.attr;
+	return true;
+}
+
+bool zipDrive::Rename(const char *oldname, const char *newname) {
+	PathInfo info;
+	if (!lookup(oldname, info)) {
+		DOS_SetError(DOSERR_FILE_NOT_FOUND);
+		return false;
+	}
+	// renaming directories would mean moving everything the archive has inside them
+	PathInfo existing;
+	if (info.isDirectory || lookup(newname, existing) || !canWrite(oldname) || !canWrite(newname)) {
+		DOS_SetError(DOSERR_ACCESS_DENIED);
+		return false;
+	}
+
+	string oldPath = relativeHostPath(oldname);
+	string newPath = relativeHostPath(newname);
+	if (!info.inShadow && !extractToShadow(info.entry, oldPath)) {
+		DOS_SetError(DOSERR_ACCESS_DENIED);
+		return false;
+	}
+	if (!makeShadowParents(newPath) || rename(shadowPathFor(oldPath).c_str(), shadowPathFor(newPath).c_str()) != 0) {
+		DOS_SetError(DOSERR_ACCESS_DENIED);
+		return false;
+	}
+	shadowIndex.erase(zipUpcase(oldPath));
+	shadowIndex.insert(zipUpcase(newPath));
+	unmarkDeleted(newPath);
+
+	Bit32u index;
+	if (findEntry(oldname, index)) markDeleted(oldPath);
+	return true;
+}
+
+bool zipDrive::AllocationInfo(Bit16u *bytes_sector, Bit8u *sectors_cluster, Bit16u *total_clusters, Bit16u *free_clusters) {
+	*bytes_sector = 512;
+	*sectors_cluster = 32;
+	Bit64u clusters = totalSize / (512 * 32) + 1;
+	*total_clusters = (clusters > 65534) ? 65534 : (Bit16u)clusters;
+	// report some room to spare when changes can go to the shadow folder
+	*free_clusters = shadowPath.empty() ? 0 : 16000;
+	return true;
+}
+
+bool zipDrive::FileExists(const char *name) {
+	PathInfo info;
+	return (lookup(name, info) && !info.isDirectory);
+}
+
+bool zipDrive::FileStat(const char *name, FileStat_Block *const stat_block) {
+	PathInfo info;
+	if (!lookup(name, info)) return false;
+	stat_block->date = info.date;
+	stat_block->time = info.time;
+	stat_block->size = info.size;
+	stat_block->attr = info.attr;
+	return true;
+}
+
+Bit8u zipDrive::GetMediaByte(void) {
+	return mediaid;
+}
+
+bool zipDrive::isRemote(void) {
+	return false;
+}
+
+bool zipDrive::isRemovable(void) {
+	return false;
+}
+
+Bits zipDrive::UnMount(void) {
+	delete this;
+	return 0;
+}
+//--End of modifications
@@ -22,6 +22,13 @@
 #define _DRIVES_H__
 
 #include <vector>
+//--Added for isoDrive's directory index
+#include <map>
+#include <string>
+//--End of modifications
+//--Added for zipDrive's shadow index
+#include <set>
+//--End of modifications
 #include <sys/types.h>
 #include "dos_system.h"
 #include "shell.h" /* for DOS_Shell */
@@ -49,9 +56,37 @@ private:
 	static int currentDrive;
 };
 
+//--Moved here from drive_local.cpp so that zipDrive can hand out local files from its shadow folder
+class localFile : public DOS_File {
+public:
+	localFile(const char* name, FILE * handle);
+	bool Read(Bit8u * data,Bit16u * size);
+	bool Write(Bit8u * data,Bit16u * size);
+	bool Seek(Bit32u * pos,Bit32u type);
+	bool Close();
+	Bit16u GetInformation(void);
+	bool UpdateDateTimeFromHost(void);   
+	void FlagReadOnlyMedium(void);
+    //--Added 2011-11-03 by Alun Bestor to let Boxer inform open file handles
+    //that their physical backing media will be removed.
+    void willBecomeUnavailable(void);
+    //--End of modifications
+	//--Added to let Boxer push writes out to the host before tearing down the emulator without closing files
+	void Flush(void);
+	//--End of modifications
+private:
+	FILE * fhandle;
+	bool read_only_medium;
+	enum { NONE,READ,WRITE } last_action;
+};
+//--End of modifications
+
 class localDrive : public DOS_Drive {
 public:
 	localDrive(const char * startdir,Bit16u _bytes_sector,Bit8u _sectors_cluster,Bit16u _total_clusters,Bit16u _free_clusters,Bit8u _mediaid);
+	//--Added to stop watching the host folder when the drive goes away
+	virtual ~localDrive();
+	//--End of modifications
 	virtual bool FileOpen(DOS_File * * file,const char * name,Bit32u flags);
 	virtual FILE *GetSystemFilePtr(char const * const name, char const * const type); 
 	virtual bool GetSystemFilename(char* sysName, char const * const dosName); 
@@ -77,6 +112,7 @@ public:
 	virtual void closedir(void *handle);
 	virtual bool read_directory_first(void *handle, char* entry_name, bool& is_directory);
 	virtual bool read_directory_next(void *handle, char* entry_name, bool& is_directory);
+	virtual bool get_directory_stamp(const char *dir, Bit64u& stamp);	//--Added
 
 	virtual void EmptyCache(void) { dirCache.EmptyCache(); };
 
@@ -84,9 +120,20 @@ public:
 	virtual bool getShortName(const char* dirpath, const char*filename, char* shortname) { return dirCache.GetShortName(dirpath, filename, shortname); };
 	//End of modifications
 	
+	//--Added to keep the directory cache in step with changes made to the host folder outside of DOSBox.
+	//Called by the watcher with the host path of a directory whose contents have changed;
+	//if recursive is true, the directories below it may have changed too.
+	void hostDirectoryDidChange(const char* path, bool recursive) { dirCache.RefreshDir(path, recursive); };
+	//Whether the drive is being told about such changes, in which case it doesn't need emptying to catch them.
+	bool isWatchingHostDirectory(void) const { return watcher != NULL; };
+	//--End of modifications
+	
 protected:
 	DOS_Drive_Cache dirCache;
 	char basedir[CROSS_LEN];
+	//--Added to keep the directory cache in step with changes made to the host folder outside of DOSBox
+	void *watcher;
+	//--End of modifications
 	friend void DOS_Shell::CMD_SUBST(char* args); 	
 	struct {
 		char srch_dir[CROSS_LEN];
@@ -190,7 +237,13 @@ struct partTable {
 
 class fatDrive : public DOS_Drive {
 public:
-	fatDrive(const char * sysFilename, Bit32u bytesector, Bit32u cylsector, Bit32u headscyl, Bit32u cylinders, Bit32u startSector);
+	//--Modified to take an optional overlay file to record changes in, leaving the image itself untouched
+	//fatDrive(const char * sysFilename, Bit32u bytesector, Bit32u cylsector, Bit32u headscyl, Bit32u cylinders, Bit32u startSector);
+	fatDrive(const char * sysFilename, Bit32u bytesector, Bit32u cylsector, Bit32u headscyl, Bit32u cylinders, Bit32u startSector, const char *overlayPath = NULL);
+	//--End of modifications
+	//--Added to flush the disk image and release the in-memory FAT
+	virtual ~fatDrive();
+	//--End of modifications
 	virtual bool FileOpen(DOS_File * * file,const char * name,Bit32u flags);
 	virtual bool FileCreate(DOS_File * * file,const char * name,Bit16u attributes);
 	virtual bool FileUnlink(const char * name);
@@ -252,6 +305,12 @@ private:
 
 	Bit32u cwdDirCluster;
 	Bit32u dirPosition; /* Position in directory search */
+
+	//--Added to keep the whole of the FAT in memory: it's read in at mount, and updated and written
+	//through to the disk (whose sector cache defers the actual writes) when clusters change.
+	Bit8u *fatCache;
+	Bit32u fatCacheSize;
+	//--End of modifications
 };
 
 
@@ -296,6 +355,107 @@ private:
 	char driveLetter;
 };
 
+//--Added to mount zip archives as DOS drives: see drive_zip.cpp.
+class zipDrive : public DOS_Drive {
+public:
+	//shadowPath is an optional folder to which changes to the drive will be written, using the
+	//same layout as ADBShadowedFilesystem: without one, the drive is read-only.
+	zipDrive(const char *archivePath, const char *shadowPath, Bit8u mediaid, int &error);
+	virtual ~zipDrive();
+	virtual bool FileOpen(DOS_File **file, const char *name, Bit32u flags);
+	virtual bool FileCreate(DOS_File **file, const char *name, Bit16u attributes);
+	virtual bool FileUnlink(const char *name);
+	virtual bool RemoveDir(const char *dir);
+	virtual bool MakeDir(const char *dir);
+	virtual bool TestDir(const char *dir);
+	virtual bool FindFirst(const char *_dir, DOS_DTA &dta, bool fcb_findfirst=false);
+	virtual bool FindNext(DOS_DTA &dta);
+	virtual bool GetFileAttr(const char *name, Bit16u *attr);
+	virtual bool Rename(const char *oldname, const char *newname);
+	virtual bool AllocationInfo(Bit16u *bytes_sector, Bit8u *sectors_cluster, Bit16u *total_clusters, Bit16u *free_clusters);
+	virtual bool FileExists(const char *name);
+	virtual bool FileStat(const char *name, FileStat_Block *const stat_block);
+	virtual Bit8u GetMediaByte(void);
+	virtual bool isRemote(void);
+	virtual bool isRemovable(void);
+	virtual Bits UnMount(void);
+	virtual char const *GetLabel(void) { return label; };
+	//Rescans the shadow folder, in case something other than the drive has changed it.
+	virtual void EmptyCache(void);
+
+	//Reads length bytes of the archive starting at the specified offset.
+	bool readArchive(void *buffer, Bit64u offset, size_t length);
+
+	struct Entry {
+		std::string hostName;	// the entry's name within its directory, as stored in the archive
+		std::string dosName;	// the 8.3 name it goes by in DOS
+		bool isDirectory;
+		Bit16u method;
+		Bit16u flags;
+		Bit32u compressedSize;
+		Bit32u size;
+		Bit64u headerOffset;	// where the entry's local header starts
+		Bit64u dataOffset;		// where its data starts: worked out from the local header when first needed
+		Bit16u date, time, attr;
+		std::vector<Bit32u> children;
+	};
+	//Returns the offset of the specified entry's data in the archive, or 0 if its local header is unreadable.
+	Bit64u dataOffsetForEntry(Bit32u index);
+	const Entry &entryAtIndex(Bit32u index) const { return entries[index]; }
+
+private:
+	// what a DOS path refers to: something in the shadow folder, an entry in the archive, or nothing
+	struct PathInfo {
+		bool exists;
+		bool isDirectory;
+		bool inShadow;
+		Bit32u entry;
+		Bit32u size;
+		Bit16u date, time, attr;
+	};
+	struct FindResult {
+		std::string name;
+		Bit32u size;
+		Bit16u date, time;
+		Bit8u attr;
+	};
+
+	bool loadIndex(void);
+	Bit32u addEntry(const std::string &hostPath, std::map<std::string, Bit32u> &hostIndex);
+	void assignDOSNames(Bit32u dirIndex, const std::string &dosPath);
+	void scanShadow(const std::string &relativePath);
+
+	bool lookup(const char *dosPath, PathInfo &info);
+	bool findEntry(const char *dosPath, Bit32u &index);
+	std::string relativeHostPath(const char *dosPath);
+	std::string shadowPathFor(const std::string &relativePath);
+	bool isShadowed(const std::string &relativePath);
+	bool isDeleted(const std::string &relativePath);
+	bool canWrite(const char *dosPath);
+	bool makeShadowParents(const std::string &relativePath);
+	bool extractToShadow(Bit32u index, const std::string &relativePath);
+	void markDeleted(const std::string &relativePath);
+	void unmarkDeleted(const std::string &relativePath);
+	void removeShadowItem(const std::string &relativePath);
+	void listDirectory(const char *dosDir, std::vector<FindResult> &results);
+
+	int archive;
+	std::string archivePath;
+	std::string shadowPath;
+	Bit8u mediaid;
+	char label[32];
+	Bit64u totalSize;
+
+	std::vector<Entry> entries;					// entries[0] is the root directory
+	std::map<std::string, Bit32u> entryIndex;	// upper-cased DOS path -> index in entries
+	std::set<std::string> shadowIndex;			// upper-cased relative host paths of everything in the shadow folder
+
+	std::vector<FindResult> searches[MAX_OPENDIRS];
+	Bitu searchPositions[MAX_OPENDIRS];
+	Bitu nextSearch;
+};
+//--End of modifications
+
 #ifdef _MSC_VER
 #pragma pack (1)
 #endif
@@ -394,6 +554,11 @@ public:
 	virtual bool isRemovable(void);
 	virtual Bits UnMount(void);
 	bool readSector(Bit8u *buffer, Bit32u sector);
+	//--Added to read local images straight from a memory mapping of the image file.
+	//Copies length bytes starting at the specified byte offset into the data track,
+	//or returns false if the image isn't mapped or the data lies outside the mapping.
+	bool readMapped(Bit8u *buffer, Bit32u offset, Bitu length);
+	//--End of modifications
 	virtual char const* GetLabel(void) {return discLabel;};
 	virtual void Activate(void);
 private:
@@ -406,6 +571,30 @@ private:
 	bool GetNextDirEntry(const int dirIterator, isoDirEntry* de);
 	void FreeDirIterator(const int dirIterator);
 	bool ReadCachedSector(Bit8u** buffer, const Bit32u sector);
+	//--Added to read local images straight from a memory mapping, and to look up paths
+	//on them from an index of every directory built once at mount.
+	void MapImage(void);
+	void UnmapImage(void);
+	Bit8u* MappedSector(Bit32u sector) const;
+	void BuildDirIndex(void);
+	bool lookupIndexed(isoDirEntry *de, char *isoPath);
+	
+	Bit8u* mappedImage;
+	size_t mappedLength;
+	Bit64u mappedOffset;
+	Bit32u mappedSectorSize;
+	Bit32u mappedFirstSector;
+	Bit32u mappedSectors;
+	
+	// identifies a directory by its extent (high 32 bits) and data length (low 32 bits)
+	typedef Bit64u DirIndexDir;
+	// where an entry's record lies: its sector (high 32 bits) and offset within the sector (low 32 bits)
+	typedef Bit64u DirIndexLocation;
+	// a directory's entries by upper-cased name, keeping the first of any duplicates as lookup() would
+	typedef std::map<std::pair<DirIndexDir, std::string>, DirIndexLocation> DirIndex;
+	DirIndex dirIndex;
+	bool dirIndexed;
+	//--End of modifications
 	
 	struct DirIterator {
 		bool valid;
@@ -23,6 +23,14 @@
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
+//--Added for the cycle controller
+#include <math.h>
+//--End of modifications
+//--Added for the microsecond host timebase
+#if defined(__APPLE__)
+#include <mach/mach_time.h>
+#endif
+//--End of modifications
 #include "dosbox.h"
 #include "debug.h"
 #include "cpu.h"
@@ -45,6 +53,15 @@
 //--Added 2012-10-19 by Alun Bestor to allow parallel port emulation
 #include "parport.h"
 //--End of modifications
+//--Added to let the profiler attribute time to callbacks
+#include "profiler.h"
+//--End of modifications
+//--Added for the performance counters
+#include "perfcounters.h"
+//--End of modifications
+//--Added to mark cycle adjustments for Instruments
+#include "signposts.h"
+//--End of modifications
 
 Config * control;
 MachineType machine;
@@ -128,6 +145,164 @@ Bit32s ticksDone;
 Bit32u ticksScheduled;
 bool ticksLocked;
 
+//--Added for a microsecond host timebase. SDL's millisecond ticks quantized the scheduling,
+//the cycle controller's measurements and the sleeps between ticks (which could oversleep by
+//a whole millisecond), causing jitter at low cycle counts.
+#if defined(__APPLE__)
+static mach_timebase_info_data_t host_timebase;
+#endif
+
+static Bit64u DOSBOX_GetHostMicroseconds(void) {
+#if defined(__APPLE__)
+	if (!host_timebase.denom) mach_timebase_info(&host_timebase);
+	return mach_absolute_time()*host_timebase.numer/host_timebase.denom/1000;
+#else
+	return (Bit64u)GetTicks()*1000;
+#endif
+}
+
+// sleeps for the given number of microseconds of host time, without rounding up to the millisecond
+static void DOSBOX_SleepMicroseconds(Bit64u micros) {
+#if defined(__APPLE__)
+	if (!host_timebase.denom) mach_timebase_info(&host_timebase);
+	mach_wait_until(mach_absolute_time()+micros*1000*host_timebase.denom/host_timebase.numer);
+#else
+	SDL_Delay((Bit32u)((micros+999)/1000));
+#endif
+}
+//--End of modifications
+
+//--Added to let Boxer warp emulated time very slightly, so that the emulated display's refresh
+//can lock to the host display's. Emulated time advances by ticksRate milliseconds for every
+//millisecond of host time; the mixer makes the same number of samples per host second whatever
+//the rate, so the sound is resampled to match.
+double ticksRate=1.0;
+
+// the warped clock in fractional milliseconds, kept with the microsecond timebase's precision
+static double DOSBOX_GetWarpedMilliseconds(void) {
+	static Bit64u host_last=0;
+	static double warped_ms=0;
+	Bit64u host_now=DOSBOX_GetHostMicroseconds();
+	if (host_last) warped_ms+=(double)(host_now-host_last)/1000.0*ticksRate;
+	else warped_ms=(double)host_now/1000.0;
+	host_last=host_now;
+	return warped_ms;
+}
+
+static Bit32u DOSBOX_GetTicks(void) {
+	return (Bit32u)DOSBOX_GetWarpedMilliseconds();
+}
+
+// sleeps until the warped clock reaches the given tick
+static void DOSBOX_SleepUntilTick(Bit32u tick) {
+	double remaining=(double)tick-DOSBOX_GetWarpedMilliseconds();
+	if (remaining>0) DOSBOX_SleepMicroseconds((Bit64u)(remaining*1000.0/ticksRate)+1);
+}
+//--End of modifications
+
+//--Added to replace the auto cycle heuristic with a smoothed PI controller.
+//The controller works on the logarithm of the measured load (how much of the target host
+//usage we're getting through), so that it makes proportional changes to the cycle count
+//whatever the current speed. Measurements are smoothed before use and small errors are
+//ignored, which stops the cycles hunting on timer jitter or brief host load spikes.
+
+/* How many ticks of emulation to measure over before adjusting the cycles */
+#define CYCLECTL_INTERVAL		100
+/* Weight given to each new measurement in the smoothed load */
+#define CYCLECTL_SMOOTHING		0.5
+/* Proportional and integral gains */
+#define CYCLECTL_KP				0.35
+#define CYCLECTL_KI				0.45
+/* Load errors smaller than this (about 2%) are treated as being on target */
+#define CYCLECTL_DEADBAND		0.02
+/* Limits on each adjustment: at most double the cycles, or cut them to a fifth */
+#define CYCLECTL_MAXRAISE		0.693
+#define CYCLECTL_MAXLOWER		(-1.609)
+
+static struct {
+	bool primed;
+	double error;		/* smoothed log of the load */
+	double last_error;
+	double slack;		/* smoothed fraction of host time spent idle */
+	Bit32s achieved;	/* cycles per millisecond of host time emulated during the last measurement */
+	/* milliseconds of host time that have passed, and been spent sleeping, since the last
+	   measurement, timed with the microsecond timebase rather than counted in whole ticks */
+	double elapsed;
+	double idle;
+	double last_time;
+	/* how many times the cycles have been changed, and how many of those changes (and raises
+	   in particular) were made while the mixer had less audio buffered than it was aiming for */
+	Bitu adjustments;
+	Bitu starved_adjustments;
+	Bitu starved_raises;
+} cyclectl;
+
+void DOSBOX_ResetCycleController(void) {
+	cyclectl.primed=false;
+	cyclectl.error=0;
+	cyclectl.last_error=0;
+	cyclectl.elapsed=0;
+	cyclectl.idle=0;
+	cyclectl.last_time=DOSBOX_GetWarpedMilliseconds();
+}
+
+void DOSBOX_GetCycleControllerState(DOSBOX_CycleControllerState * state) {
+	state->target=CPU_CycleMax;
+	state->achieved=cyclectl.achieved;
+	state->slack=cyclectl.slack;
+	state->load=exp(cyclectl.error);
+	state->adjustments=cyclectl.adjustments;
+	state->starved_adjustments=cyclectl.starved_adjustments;
+	state->starved_raises=cyclectl.starved_raises;
+}
+
+/* Records a change of the cycles from old_cmax to the current CPU_CycleMax, noting whether the
+   sound was running short at the time: raising the cycles then makes an underrun more likely */
+static void DOSBOX_NoteCycleAdjustment(Bit32s old_cmax) {
+	if (CPU_CycleMax==old_cmax) return;
+	float fill=MIXER_BufferFillLevel();
+	bool starved=(fill>=0 && fill<1.0f);
+	cyclectl.adjustments++;
+	if (starved) {
+		cyclectl.starved_adjustments++;
+		if (CPU_CycleMax>old_cmax) cyclectl.starved_raises++;
+	}
+	if (SIGNPOST_Enabled(SIGNPOST_CYCLE_ADJUST)) {
+		char detail[64];
+		if (fill>=0) snprintf(detail,sizeof(detail),"%d to %d cycles, %.0f%% of audio target buffered",
+			(int)old_cmax,(int)CPU_CycleMax,fill*100.0f);
+		else snprintf(detail,sizeof(detail),"%d to %d cycles",(int)old_cmax,(int)CPU_CycleMax);
+		SignpostScope signpost(SIGNPOST_CYCLE_ADJUST,CPU_CycleMax>old_cmax ? "raise" : "lower",detail);
+	}
+}
+
+/* Feeds a measured load into the controller and returns the new cycle count.
+   A load of 1.0 means we're using exactly the targeted share of the host. */
+static Bit32s DOSBOX_UpdateCycleController(double load) {
+	double measured=log(load);
+	if (!cyclectl.primed) {
+		cyclectl.error=measured;
+		cyclectl.last_error=0;
+		cyclectl.primed=true;
+	} else {
+		cyclectl.error+=CYCLECTL_SMOOTHING*(measured-cyclectl.error);
+	}
+
+	double error=cyclectl.error;
+	if (fabs(error)<CYCLECTL_DEADBAND) error=0;
+
+	/* velocity form, so there's no integral term to wind up while we're clamped */
+	double step=CYCLECTL_KP*(error-cyclectl.last_error)+CYCLECTL_KI*error;
+	cyclectl.last_error=error;
+	if (step>CYCLECTL_MAXRAISE) step=CYCLECTL_MAXRAISE;
+	else if (step<CYCLECTL_MAXLOWER) step=CYCLECTL_MAXLOWER;
+
+	double new_cmax=(double)CPU_CycleMax*exp(step);
+	if (new_cmax>(double)0x7fffffff) new_cmax=(double)0x7fffffff;
+	return (Bit32s)new_cmax;
+}
+//--End of modifications
+
 static Bitu Normal_Loop(void) {
 	Bits ret;
 	while (1) {
@@ -136,23 +311,42 @@ static Bitu Normal_Loop(void) {
 		//--End of modifications
 		
 		if (PIC_RunQueue()) {
-			ret=(*cpudecoder)();
+			//--Modified to time the CPU core for the performance counters
+			{
+				PerfScope perf(PERF_CPU);
+				ret=(*cpudecoder)();
+			}
+			//--End of modifications
 			if (GCC_UNLIKELY(ret<0)) return 1;
 			if (ret>0) {
-				Bitu blah=(*CallBack_Handlers[ret])();
+				//--Modified to let the profiler and performance counters attribute time to callbacks
+				Bitu blah;
+				{
+					ProfilerContextScope profiling(PROFILER_CALLBACK);
+					PerfScope perf(PERF_CALLBACK);
+					blah=(*CallBack_Handlers[ret])();
+				}
+				//--End of modifications
 				if (GCC_UNLIKELY(blah)) return blah;
 			}
 #if C_DEBUG
 			if (DEBUG_ExitLoop()) return 0;
 #endif
 		} else {
-			GFX_Events();
+			//--Modified to time Boxer's event processing and publish the performance counters
+			{
+				PerfScope perf(PERF_COALFACE);
+				GFX_Events();
+			}
+			PERF_Tick();
+			//--End of modifications
             //--Check again at this point in case our own events have cancelled the emulation.
             if (!boxer_runLoopShouldContinue()) return 1;
             //--End of modifications
 			if (ticksRemain>0) {
 				TIMER_AddTick();
 				ticksRemain--;
+				DOSBOX_TicksCompleted++;	//--Added for Boxer's stall watchdog
 			} else goto increaseticks;
 		}
 	}
@@ -160,16 +354,27 @@ increaseticks:
 	if (GCC_UNLIKELY(ticksLocked)) {
 		ticksRemain=5;
 		/* Reset any auto cycle guessing for this frame */
-		ticksLast = GetTicks();
+		ticksLast = DOSBOX_GetTicks();	//--Modified to use the warped clock
 		ticksAdded = 0;
 		ticksDone = 0;
 		ticksScheduled = 0;
+		//--Added to restart the cycle controller once we're out of turbo
+		DOSBOX_ResetCycleController();
+		//--End of modifications
 	} else {
 		Bit32u ticksNew;
-		ticksNew=GetTicks();
+		//--Modified to use the warped clock, and to measure how much host time the cycle
+		//controller is getting through
+		double timeNew=DOSBOX_GetWarpedMilliseconds();
+		ticksNew=(Bit32u)timeNew;
+		//--End of modifications
 		ticksScheduled += ticksAdded;
 		if (ticksNew > ticksLast) {
 			ticksRemain = ticksNew-ticksLast;
+			//--Added to measure how much host time the cycle controller is getting through
+			cyclectl.elapsed += timeNew-cyclectl.last_time;
+			cyclectl.last_time = timeNew;
+			//--End of modifications
 			ticksLast = ticksNew;
 			ticksDone += ticksRemain;
 			if ( ticksRemain > 20 ) {
@@ -177,62 +382,83 @@ increaseticks:
 			}
 			ticksAdded = ticksRemain;
 			if (CPU_CycleAutoAdjust && !CPU_SkipCycleAutoAdjust) {
-				if (ticksScheduled >= 250 || ticksDone >= 250 || (ticksAdded > 15 && ticksScheduled >= 5) ) {
-					if(ticksDone < 1) ticksDone = 1; // Protect against div by zero
+				//--Modified to adjust the cycles using the PI controller above,
+				//measuring over a shorter interval now that measurements are smoothed,
+				//and timing the busy and idle host time with the microsecond timebase
+				if (ticksScheduled >= CYCLECTL_INTERVAL || ticksDone >= CYCLECTL_INTERVAL || (ticksAdded > 15 && ticksScheduled >= 5) ) {
+					double busy = cyclectl.elapsed - cyclectl.idle;
+					if (busy < 0.1) busy = 0.1; // Protect against div by zero
+					if (cyclectl.elapsed < busy) cyclectl.elapsed = busy;
 					/* ratio we are aiming for is around 90% usage*/
-					Bit32s ratio = (ticksScheduled * (CPU_CyclePercUsed*90*1024/100/100)) / ticksDone;
+					double ratio = ((double)ticksScheduled * (CPU_CyclePercUsed*0.9/100.0)) / busy;
 					Bit32s new_cmax = CPU_CycleMax;
 					Bit64s cproc = (Bit64s)CPU_CycleMax * (Bit64s)ticksScheduled;
+					bool measured = false;
 					if (cproc > 0) {
 						/* ignore the cycles added due to the io delay code in order
 						   to have smoother auto cycle adjustments */
 						double ratioremoved = (double) CPU_IODelayRemoved / (double) cproc;
 						if (ratioremoved < 1.0) {
-							ratio = (Bit32s)((double)ratio * (1 - ratioremoved));
+							ratio *= (1 - ratioremoved);
 							/* Don't allow very high ratio which can cause us to lock as we don't scale down
 							 * for very low ratios. High ratio might result because of timing resolution */
-							if (ticksScheduled >= 250 && ticksDone < 10 && ratio > 20480) 
-								ratio = 20480;
-							Bit64s cmax_scaled = (Bit64s)CPU_CycleMax * (Bit64s)ratio;
-							if (ratio <= 1024) 
-								new_cmax = (Bit32s)(cmax_scaled / (Bit64s)1024);
-							else 
-								new_cmax = (Bit32s)(1 + (CPU_CycleMax >> 1) + cmax_scaled / (Bit64s)2048);
+							if (ticksScheduled >= CYCLECTL_INTERVAL && busy < 10 && ratio > 20.0)
+								ratio = 20.0;
+							measured = true;
+
+							cyclectl.achieved = (Bit32s)((double)(cproc - CPU_IODelayRemoved) / cyclectl.elapsed);
 						}
 					}
-
-					if (new_cmax<CPU_CYCLES_LOWER_LIMIT)
-						new_cmax=CPU_CYCLES_LOWER_LIMIT;
+					double slack = 1.0 - busy / cyclectl.elapsed;
+					cyclectl.slack += CYCLECTL_SMOOTHING * (slack - cyclectl.slack);
 
 					/* ratios below 1% are considered to be dropouts due to
 					   temporary load imbalance, the cycles adjusting is skipped */
-					if (ratio>10) {
+					if (measured && ratio>0.01) {
 						/* ratios below 12% along with a large time since the last update
 						   has taken place are most likely caused by heavy load through a
 						   different application, the cycles adjusting is skipped as well */
-						if ((ratio>120) || (ticksDone<700)) {
+						if ((ratio>0.12) || (busy<700)) {
+							Bit32s old_cmax = CPU_CycleMax;
+							new_cmax = DOSBOX_UpdateCycleController(ratio);
+							if (new_cmax<CPU_CYCLES_LOWER_LIMIT)
+								new_cmax=CPU_CYCLES_LOWER_LIMIT;
 							CPU_CycleMax = new_cmax;
 							if (CPU_CycleLimit > 0) {
 								if (CPU_CycleMax>CPU_CycleLimit) CPU_CycleMax = CPU_CycleLimit;
 							}
+							DOSBOX_NoteCycleAdjustment(old_cmax);
 						}
 					}
 					CPU_IODelayRemoved = 0;
 					ticksDone = 0;
 					ticksScheduled = 0;
+					cyclectl.elapsed = 0;
+					cyclectl.idle = 0;
+				//--End of modifications
 				} else if (ticksAdded > 15) {
 					/* ticksAdded > 15 but ticksScheduled < 5, lower the cycles
 					   but do not reset the scheduled/done ticks to take them into
 					   account during the next auto cycle adjustment */
+					Bit32s old_cmax = CPU_CycleMax;	//--Added to record the adjustment
 					CPU_CycleMax /= 3;
 					if (CPU_CycleMax < CPU_CYCLES_LOWER_LIMIT)
 						CPU_CycleMax = CPU_CYCLES_LOWER_LIMIT;
+					DOSBOX_NoteCycleAdjustment(old_cmax);	//--Added to record the adjustment
 				}
 			}
 		} else {
 			ticksAdded = 0;
-			SDL_Delay(1);
-			ticksDone -= GetTicks() - ticksNew;
+			//--Modified to time sleeping for the performance counters, and to sleep only until
+			//the next tick is due rather than for at least a millisecond
+			{
+				PerfScope perf(PERF_IDLE);
+				double sleepStart=DOSBOX_GetWarpedMilliseconds();
+				DOSBOX_SleepUntilTick(ticksLast+1);
+				cyclectl.idle+=DOSBOX_GetWarpedMilliseconds()-sleepStart;
+			}
+			//--End of modifications
+			ticksDone -= DOSBOX_GetTicks() - ticksNew;	//--Modified to use the warped clock
 			if (ticksDone < 0)
 				ticksDone = 0;
 		}
@@ -248,18 +474,35 @@ void DOSBOX_SetNormalLoop() {
 	loop=Normal_Loop;
 }
 
+//--Added so that Boxer can tell whether the emulation thread is still making progress
+volatile Bitu DOSBOX_TicksCompleted=0;
+//--End of modifications
+
+//--Added to track how deeply DOSBOX_RunMachine is nested: callbacks that run guest code
+//re-enter it, and a save state can only be restored at the depth it was taken at.
+static Bitu runMachineDepth=0;
+
+Bitu DOSBOX_RunMachineDepth(void) {
+	return runMachineDepth;
+}
+//--End of modifications
+
 void DOSBOX_RunMachine(void){
 	Bitu ret;
+	runMachineDepth++;	//--Added to track nesting for save states
+    //--Modified 2011-09-25 by Alun Bestor to bracket iterations of the run loop
+    //with our own callbacks. We pass along the contextInfo parameter so that
+    //Boxer knows which run loop is running (in case of nested runloops).
+    //The context is kept across iterations, and Boxer is told when the loop is finishing
+    //so that it can clean up after it.
+    void *contextInfo=0;
 	do {
-        //--Modified 2011-09-25 by Alun Bestor to bracket iterations of the run loop
-        //with our own callbacks. We pass along the contextInfo parameter so that
-        //Boxer knows which iteration of the runloop is running (in case of nested runloops).
-        void *contextInfo;
         boxer_runLoopWillStartWithContextInfo(&contextInfo);
 		ret=(*loop)();
-        boxer_runLoopDidFinishWithContextInfo(contextInfo);
-        //--End of modifications.
+        boxer_runLoopDidFinishWithContextInfo(&contextInfo,ret!=0);
 	} while (!ret);
+    //--End of modifications.
+	runMachineDepth--;	//--Added to track nesting for save states
 }
 
 static void DOSBOX_UnlockSpeed( bool pressed ) {
@@ -288,7 +531,7 @@ static void DOSBOX_RealInit(Section * sec) {
 	/* Initialize some dosbox internals */
 
 	ticksRemain=0;
-	ticksLast=GetTicks();
+	ticksLast=DOSBOX_GetTicks();	//--Modified to use the warped clock
 	ticksLocked = false;
 	DOSBOX_SetLoop(&Normal_Loop);
 	MSG_Init(section);
@@ -362,6 +605,14 @@ void DOSBOX_Init(void) {
 	Pstring = secprop->Add_path("captures",Property::Changeable::Always,"capture");
 	Pstring->Set_help("Directory where things like wave, midi, screenshot get captured.");
 
+	//--Added to let wave output be encoded losslessly as it's captured
+	const char* capturewaves[] = { "wav", "alac", "flac", 0 };
+	Pstring = secprop->Add_string("capturewave",Property::Changeable::Always,"wav");
+	Pstring->Set_values(capturewaves);
+	Pstring->Set_help("The format to capture wave output in. alac (Apple Lossless) and flac are compressed\n"
+		"without loss; if the host can't encode them, wav is used.");
+	//--End of modifications
+
 #if C_DEBUG	
 	LOG_StartUp();
 #endif
@@ -388,6 +639,12 @@ void DOSBOX_Init(void) {
 	Pint->SetMinMax(0,10);
 	Pint->Set_help("How many frames DOSBox skips before drawing one.");
 
+	//--Added for drawing SVGA frames on a worker thread
+	Pbool = secprop->Add_bool("pipelined",Property::Changeable::Always,true);
+	Pbool->Set_help("Draw SVGA frames on a separate thread while emulation carries on, if the host has 4 or more cores.\n"
+		"Frames with a split screen are drawn as usual.");
+	//--End of modifications
+
 	Pbool = secprop->Add_bool("aspect",Property::Changeable::Always,false);
 	Pbool->Set_help("Do aspect correction, if your output method doesn't support scaling this can slow things down!.");
 
@@ -415,12 +672,18 @@ void DOSBOX_Init(void) {
 	secprop=control->AddSection_prop("cpu",&CPU_Init,true);//done
 	const char* cores[] = { "auto",
 #if (C_DYNAMIC_X86) || (C_DYNREC)
-		"dynamic",
+		//--Modified to offer the adaptive core
+		"dynamic", "adaptive",
+		//--End of modifications
 #endif
-		"normal", "simple",0 };
+		//--Modified to offer the threaded variant of the normal core
+		"normal", "simple", "threaded",0 };
 	Pstring = secprop->Add_string("core",Property::Changeable::WhenIdle,"auto");
 	Pstring->Set_values(cores);
-	Pstring->Set_help("CPU Core used in emulation. auto will switch to dynamic if available and appropriate.");
+	Pstring->Set_help("CPU Core used in emulation. auto will switch to dynamic if available and appropriate.\n"
+		"threaded is a faster build of the normal core, for when dynamic is unavailable or unsuitable.\n"
+		"adaptive moves between normal and dynamic while running, by how the program behaves.");
+		//--End of modifications
 
 	const char* cputype_values[] = { "auto", "386", "386_slow", "486_slow", "pentium_slow", "386_prefetch", 0};
 	Pstring = secprop->Add_string("cputype",Property::Changeable::Always,"auto");
@@ -453,6 +716,25 @@ void DOSBOX_Init(void) {
 	Pint = secprop->Add_int("cycledown",Property::Changeable::Always,20);
 	Pint->SetMinMax(1,1000000);
 	Pint->Set_help("Setting it lower than 100 will be a percentage.");
+
+	//--Added to let games with large amounts of protected-mode code use a larger translation cache
+	Pint = secprop->Add_int("dynamic_cache",Property::Changeable::OnlyAtStart,8);
+	Pint->SetMinMax(1,256);
+	Pint->Set_help("Size in megabytes of the dynamic core's translation cache. Large protected-mode games\n"
+		"and Windows 3.x may run more smoothly with a larger cache.");
+	//--End of modifications
+
+	//--Added to let the dynamic core's use of the host CPU's instruction set extensions be turned off
+	Pbool = secprop->Add_bool("dynamic_hostfeatures",Property::Changeable::Always,true);
+	Pbool->Set_help("Let the dynamic core use instruction set extensions of the host CPU, such as BMI2,\n"
+		"in the code it generates. Turn this off to compare against code that runs on any host.");
+	//--End of modifications
+
+	//--Added to let users turn off guest idle detection for programs that misbehave with it
+	Pbool = secprop->Add_bool("idle",Property::Changeable::Always,true);
+	Pbool->Set_help("Let the emulator rest while the DOS program is waiting for input or sitting\n"
+		"in an idle loop, to save power. Turn this off if a game runs too slowly.");
+	//--End of modifications
 		
 #if C_FPU
 	secprop->AddInitFunction(&FPU_Init);
@@ -479,6 +761,27 @@ void DOSBOX_Init(void) {
 	Pint->SetMinMax(0,100);
 	Pint->Set_help("How many milliseconds of data to keep on top of the blocksize.");
 
+	//--Added to choose how channels are converted to the mixer rate
+	const char *resamplers[] = { "sinc", "linear", 0};
+	Pstring = secprop->Add_string("resampler",Property::Changeable::OnlyAtStart,"sinc");
+	Pstring->Set_values(resamplers);
+	Pstring->Set_help("How to convert devices running at a different rate from the mixer:\n"
+		"sinc uses a windowed-sinc filter, which is cleaner, linear interpolates between samples as older versions did.");
+	//--End of modifications
+
+	//--Added to play the mixer's output through CoreAudio directly
+	const char *outputs[] = { "coreaudio", "sdl", 0};
+	Pstring = secprop->Add_string("output",Property::Changeable::OnlyAtStart,"coreaudio");
+	Pstring->Set_values(outputs);
+	Pstring->Set_help("How to play the mixed sound: coreaudio runs at the output device's own rate and uses\n"
+		"blocksize as the device's buffer size, sdl goes through SDL's audio output as older versions did.");
+
+	Pbool = secprop->Add_bool("lowlatency",Property::Changeable::OnlyAtStart,false);
+	Pbool->Set_help("Keep as little sound buffered as possible, for games that need tight audio timing.\n"
+		"This asks the coreaudio output for a 32-frame device buffer (or the smallest the device allows)\n"
+		"and caps prebuffer at 5ms, so slower computers may get crackling.");
+	//--End of modifications
+
 	secprop=control->AddSection_prop("midi",&MIDI_Init,true);//done
 	secprop->AddInitFunction(&MPU401_Init,true);//done
 	
@@ -590,6 +893,12 @@ void DOSBOX_Init(void) {
 	Pint->Set_values(oplrates);
 	Pint->Set_help("Sample rate of OPL music emulation. Use 49716 for highest quality (set the mixer rate accordingly).");
 
+	//--Added to let the OPL be synthesized on an audio worker
+	Pbool = secprop->Add_bool("oplthread",Property::Changeable::WhenIdle,true);
+	Pbool->Set_help("Synthesize OPL music on a separate thread, to take its cost off the emulation thread on\n"
+		"multi-core machines. Adds a few milliseconds of latency. Has no effect with oplemu=compat.");
+	//--End of modifications
+
 
 	secprop=control->AddSection_prop("gus",&GUS_Init,true); //done
 	Pbool = secprop->Add_bool("gus",Property::Changeable::WhenIdle,false); 	
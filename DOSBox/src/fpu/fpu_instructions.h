@@ -18,6 +18,18 @@
 
 /* $Id: fpu_instructions.h,v 1.33 2009-05-27 09:15:41 qbix79 Exp $ */
 
+//--Added to document the precision trade-off of this FPU core.
+//This core keeps each FPU register as a host double and does its arithmetic in host double
+//precision, which works the same on any host with IEEE doubles: it is used on AArch64, and can
+//be chosen on Intel by defining C_FPU_HOST_DOUBLE (see config.h). Compared with the x87 core
+//in fpu_instructions_x86.h it has a 53-bit rather than 64-bit significand and an 11-bit rather
+//than 15-bit exponent, so intermediate results lose precision and overflow sooner; the
+//precision control bits of the control word are ignored; FLD/FSTP of 80-bit values round-trip
+//through a double; and FPU exceptions are never raised. Games that only load and store 32- and
+//64-bit values are rarely affected, but code relying on extended precision or on 80-bit
+//constants may see small differences.
+//--End of modifications
+
 
 static void FPU_FINIT(void) {
 	FPU_SetCW(0x37F);
@@ -67,9 +79,10 @@ static void FPU_FPOP(void){
 static double FROUND(double in){
 	switch(fpu.round){
 	case ROUND_Nearest:	
-		if (in-floor(in)>0.5) return (floor(in)+1);
-		else if (in-floor(in)<0.5) return (floor(in));
-		else return (((static_cast<Bit64s>(floor(in)))&1)!=0)?(floor(in)+1):(floor(in));
+		//--Modified to let the host round to nearest-even in one step, since we never
+		//change the host's rounding mode from its default
+		return rint(in);
+		//--End of modifications
 		break;
 	case ROUND_Down:
 		return (floor(in));
@@ -458,7 +471,13 @@ static void FPU_FYL2XP1(void){
 }
 
 static void FPU_FSCALE(void){
-	fpu.regs[TOP].d *= pow(2.0,static_cast<Real64>(static_cast<Bit64s>(fpu.regs[STV(1)].d)));
+	//--Modified to scale the exponent directly instead of going through pow():
+	//anything beyond this clamp overflows or underflows a double anyway.
+	Bit64s scale = static_cast<Bit64s>(fpu.regs[STV(1)].d);
+	if (scale > 4096) scale = 4096;
+	else if (scale < -4096) scale = -4096;
+	fpu.regs[TOP].d = ldexp(fpu.regs[TOP].d,static_cast<int>(scale));
+	//--End of modifications
 	return; //2^x where x is chopped.
 }
 
@@ -521,7 +540,7 @@ static void FPU_FXTRACT(void) {
 	FPU_Reg test = fpu.regs[TOP];
 	Bit64s exp80 =  test.ll&LONGTYPE(0x7ff0000000000000);
 	Bit64s exp80final = (exp80>>52) - BIAS64;
-	Real64 mant = test.d / (pow(2.0,static_cast<Real64>(exp80final)));
+	Real64 mant = ldexp(test.d,static_cast<int>(-exp80final));	//--Modified to avoid pow()
 	fpu.regs[TOP].d = static_cast<Real64>(exp80final);
 	FPU_PUSH(mant);
 }
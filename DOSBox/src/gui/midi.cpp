@@ -211,6 +211,31 @@ void MIDI_RawOutByte(Bit8u data) {
 	}
 }
 
+//--Added to let the MPU-401's intelligent mode pass on each message whole, along with the emulated
+//time in milliseconds at which it fell due, so that Boxer's MIDI devices can schedule it ahead.
+//Anything other than a single complete channel message goes through byte by byte as usual.
+void MIDI_RawOutMessage(const Bit8u * msg,Bitu len,double timestamp) {
+	Bitu status=len ? msg[0] : 0;
+	if (status<0x80 || status>=0xf0 || midi.status==0xf0 || MIDI_evt_len[status]!=len) {
+		for (Bitu i=0;i<len;i++) MIDI_RawOutByte(msg[i]);
+		return;
+	}
+	if (midi.sysex.start) {
+		Bit32u passed_ticks = GetTicks() - midi.sysex.start;
+		if (passed_ticks < midi.sysex.delay) SDL_Delay(midi.sysex.delay - passed_ticks);
+	}
+
+	midi.status=status;
+	midi.cmd_len=len;
+	memcpy(midi.cmd_buf,msg,len);
+	if (CaptureState & CAPTURE_MIDI) {
+		CAPTURE_AddMidi(false, midi.cmd_len, midi.cmd_buf);
+	}
+	boxer_sendMIDIMessageAtTime(midi.cmd_buf, timestamp);
+	midi.cmd_pos=1;		//Use Running status
+}
+//--End of modifications
+
 //--Disabled 2011-09-25 by Alun Bestor to let Boxer field such questions itself
 //bool MIDI_Available(void)  {
 //	return midi.available;
@@ -33,12 +33,31 @@
 #include "support.h"
 
 #include "render_scalers.h"
+//--Added for the performance counters
+#include "perfcounters.h"
+//--End of modifications
+//--Added to checksum frames during input replays
+#include "inputreplay.h"
+//--End of modifications
+//--Added to mark out each frame for Instruments
+#include "signposts.h"
+
+static SignpostID render_frame_signpost=0;
+//--End of modifications
+//--Added to hand on frames when the hardware cursor moves, and for pipelined drawing
+#include "vga.h"
+//--End of modifications
 
 Render_t render;
 ScalerLineHandler_t RENDER_DrawLine;
 
 static void RENDER_CallBack( GFX_CallBackFunctions_t function );
 
+//--Added so that 8-bit output hands on a frame after a palette change even if no lines change:
+//the new palette travels with the frame rather than needing every line redrawn in the new colors.
+static bool render_pal_sent=false;
+//--End of modifications
+
 static void Check_Palette(void) {
 	/* Clean up any previous changed palette data */
 	if (render.pal.changed) {
@@ -51,6 +70,7 @@ static void Check_Palette(void) {
 	switch (render.scale.outMode) {
 	case scalerMode8:
 		GFX_SetPalette(render.pal.first,render.pal.last-render.pal.first+1,(GFX_PalEntry *)&render.pal.rgb[render.pal.first]);
+		render_pal_sent=true;	//--Added
 		break;
 	case scalerMode15:
 	case scalerMode16:
@@ -99,21 +119,22 @@ static void RENDER_EmptyLineHandler(const void * src) {
 
 static void RENDER_StartLineHandler(const void * s) {
 	if (s) {
-		const Bitu *src = (Bitu*)s;
-		Bitu *cache = (Bitu*)(render.scale.cacheRead);
-		for (Bits x=render.src.start;x>0;) {
-			if (GCC_UNLIKELY(src[0] != cache[0])) {
-				if (!GFX_StartUpdate(&render.scale.outWrite, &render.scale.outPitch )) {
-					RENDER_DrawLine = RENDER_EmptyLineHandler;
-					return;
-				}
-				render.scale.outWrite += render.scale.outPitch * Scaler_ChangedLines[0];
-				RENDER_DrawLine = render.scale.lineHandler;
-				RENDER_DrawLine( s );
+		//--Modified to use the vectorized line comparison in render_scalers.h
+		if (RENDER_LineChanged((const Bitu *)s, (const Bitu *)render.scale.cacheRead, render.src.start)) {
+			if (!GFX_StartUpdate(&render.scale.outWrite, &render.scale.outPitch )) {
+				RENDER_DrawLine = RENDER_EmptyLineHandler;
+				//--Added: the rest of this frame never reaches the cache or the screen, and the
+				//VGA won't pass those lines again unless they change, so redraw everything next time
+				render.scale.clearCache = true;
+				//--End of modifications
 				return;
 			}
-			x--; src++; cache++;
+			render.scale.outWrite += render.scale.outPitch * Scaler_ChangedLines[0];
+			RENDER_DrawLine = render.scale.lineHandler;
+			RENDER_DrawLine( s );
+			return;
 		}
+		//--End of modifications
 	}
 	render.scale.cacheRead += render.scale.cachePitch;
 	Scaler_ChangedLines[0] += Scaler_Aspect[ render.scale.inLine ];
@@ -155,6 +176,12 @@ bool RENDER_StartUpdate(void) {
 		return false;
 	}
 	render.frameskip.count=0;
+	//--Added to let Boxer skip frames that nobody will see, e.g. while fast-forwarding or while
+	//its window is hidden. Like frameskip, this leaves the VGA to keep its timing and raster state
+	//without drawing any lines, and leaves the line cache as it was for the next frame drawn.
+	if (GCC_UNLIKELY(!boxer_frameNeeded()))
+		return false;
+	//--End of modifications
 	if (render.scale.inMode == scalerMode8) {
 		Check_Palette();
 	}
@@ -174,6 +201,7 @@ bool RENDER_StartUpdate(void) {
 			return false;
 		render.fullFrame = true;
 		render.scale.clearCache = false;
+		render_pal_sent = false;	//--Added
 		RENDER_DrawLine = RENDER_ClearCacheHandler;
 	} else {
 		if (render.pal.changed) {
@@ -182,6 +210,16 @@ bool RENDER_StartUpdate(void) {
 				return false;
 			RENDER_DrawLine = render.scale.linePalHandler;
 			render.fullFrame = true;
+		//--Added to start the frame straight away after an 8-bit palette change, drawing only the
+		//lines that change as usual. Likewise when the hardware cursor has moved, so that Boxer
+		//gets a frame to draw it over even though the lines themselves don't change.
+		} else if (render_pal_sent || VGA_HardwareCursorChanged()) {
+			if (GCC_UNLIKELY(!GFX_StartUpdate(&render.scale.outWrite, &render.scale.outPitch )))
+				return false;
+			render_pal_sent = false;
+			RENDER_DrawLine = render.scale.lineHandler;
+			render.fullFrame = false;
+		//--End of modifications
 		} else {
 			RENDER_DrawLine = RENDER_StartLineHandler;
 			if (GCC_UNLIKELY(CaptureState & (CAPTURE_IMAGE|CAPTURE_VIDEO))) 
@@ -191,6 +229,7 @@ bool RENDER_StartUpdate(void) {
 		}
 	}
 	render.updating = true;
+	render_frame_signpost=SIGNPOST_Begin(SIGNPOST_FRAME,0,0);	//--Added to mark out the frame
 	return true;
 }
 
@@ -198,6 +237,10 @@ static void RENDER_Halt( void ) {
 	RENDER_DrawLine = RENDER_EmptyLineHandler;
 	GFX_EndUpdate( 0 );
 	render.updating=false;
+	//--Added to mark out the frame
+	SIGNPOST_End(SIGNPOST_FRAME,render_frame_signpost);
+	render_frame_signpost=0;
+	//--End of modifications
 	render.active=false;
 }
 
@@ -205,6 +248,16 @@ extern Bitu PIC_Ticks;
 void RENDER_EndUpdate( bool abort ) {
 	if (GCC_UNLIKELY(!render.updating))
 		return;
+	//--Added for the performance counters
+	PerfScope perf(PERF_RENDER);
+	//--End of modifications
+	//--Added to checksum the frame's source lines while recording or replaying input
+	if (GCC_UNLIKELY(replay_active) && !abort) {
+		Bitu pixel_size=(render.src.bpp+7)/8;
+		REPLAY_FrameDrawn((Bit8u *)&scalerSourceCache,render.scale.cachePitch,
+			render.src.width*pixel_size,render.src.height);
+	}
+	//--End of modifications
 	RENDER_DrawLine = RENDER_EmptyLineHandler;
 	if (GCC_UNLIKELY(CaptureState & (CAPTURE_IMAGE|CAPTURE_VIDEO))) {
 		Bitu pitch, flags;
@@ -221,7 +274,12 @@ void RENDER_EndUpdate( bool abort ) {
 			flags, fps, (Bit8u *)&scalerSourceCache, (Bit8u*)&render.pal.rgb );
 	}
 	if ( render.scale.outWrite ) {
-		GFX_EndUpdate( abort? NULL : Scaler_ChangedLines );
+		//--Modified to time handing the frame to Boxer for the performance counters
+		{
+			PerfScope coalface_perf(PERF_COALFACE);
+			GFX_EndUpdate( abort? NULL : Scaler_ChangedLines );
+		}
+		//--End of modifications
 		render.frameskip.hadSkip[render.frameskip.index] = 0;
 	} else {
 #if 0
@@ -234,6 +292,10 @@ void RENDER_EndUpdate( bool abort ) {
 	}
 	render.frameskip.index = (render.frameskip.index + 1) & (RENDER_SKIP_CACHE - 1);
 	render.updating=false;
+	//--Added to mark out the frame
+	SIGNPOST_End(SIGNPOST_FRAME,render_frame_signpost);
+	render_frame_signpost=0;
+	//--End of modifications
 }
 
 static Bitu MakeAspectTable(Bitu skip,Bitu height,double scaley,Bitu miny) {
@@ -491,6 +553,14 @@ forcenormal:
 	default:
 		E_Exit("RENDER:Wrong source bpp %d", render.src.bpp );
 	}
+	//--Added to bypass the scaler templates when the output is a straight 1:1 copy of the source
+	if (!complexBlock && simpleBlock == &ScaleNormal1x && height == render.src.height && render.scale.outMode == scalerMode32) {
+		if (render.src.bpp == 8)
+			render.scale.lineHandler = RENDER_DirectLine8_32;
+		else if (render.src.bpp == 32)
+			render.scale.lineHandler = RENDER_DirectLine32_32;
+	}
+	//--End of modifications
 	render.scale.blocks = render.src.width / SCALER_BLOCKSIZE;
 	render.scale.lastBlock = render.src.width % SCALER_BLOCKSIZE;
 	render.scale.inHeight = render.src.height;
@@ -508,6 +578,7 @@ forcenormal:
 }
 
 static void RENDER_CallBack( GFX_CallBackFunctions_t function ) {
+	VGA_WaitForPipelinedFrame();	//--Added for pipelined drawing
 	if (function == GFX_CallBackStop) {
 		RENDER_Halt( );	
 		return;
@@ -523,6 +594,7 @@ static void RENDER_CallBack( GFX_CallBackFunctions_t function ) {
 }
 
 void RENDER_SetSize(Bitu width,Bitu height,Bitu bpp,float fps,double ratio,bool dblw,bool dblh) {
+	VGA_WaitForPipelinedFrame();	//--Added for pipelined drawing
 	RENDER_Halt( );
 	if (!width || !height || width > SCALER_MAXWIDTH || height > SCALER_MAXHEIGHT) { 
 		return;	
@@ -584,9 +656,16 @@ void RENDER_Init(Section * sec) {
 
 	render.pal.first=256;
 	render.pal.last=0;
-	render.aspect=section->Get_bool("aspect");
+	//--Modified: Boxer stretches frames to the correct aspect ratio when drawing them, so DOSBox
+	//must never double up lines for it (which would only make more rows to copy and upload).
+	//render.aspect=section->Get_bool("aspect");
+	render.aspect=false;
+	//--End of modifications
 	render.frameskip.max=section->Get_int("frameskip");
 	render.frameskip.count=0;
+	//--Added for drawing SVGA frames on a worker thread
+	VGA_SetPipelinedDrawing(section->Get_bool("pipelined"));
+	//--End of modifications
 	std::string cline;
 	std::string scaler;
 	//Check for commandline paramters and parse them through the configclass so they get checked against allowed values
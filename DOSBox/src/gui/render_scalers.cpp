@@ -70,6 +70,36 @@ static INLINE void ScalerAddLines( Bitu changed, Bitu count ) {
 	render.scale.outWrite += render.scale.outPitch * count;
 }
 
+//--Added to copy unscaled lines straight into the output frame
+void RENDER_DirectLine8_32(const void *s) {
+	const Bit8u *src = (const Bit8u *)s;
+	Bit8u *cache = render.scale.cacheRead;
+	render.scale.cacheRead += render.scale.cachePitch;
+	Bitu changed = RENDER_LineChanged((const Bitu *)src, (const Bitu *)cache, render.src.start);
+	if (changed) {
+		const Bit32u *lut = render.pal.lut.b32;
+		Bit32u *out = (Bit32u *)render.scale.outWrite;
+		Bitu width = render.src.width;
+		memcpy(cache, src, width);
+		for (Bitu x=0;x<width;x++)
+			out[x] = lut[src[x]];
+	}
+	ScalerAddLines( changed, 1 );
+}
+
+void RENDER_DirectLine32_32(const void *s) {
+	Bit8u *cache = render.scale.cacheRead;
+	render.scale.cacheRead += render.scale.cachePitch;
+	Bitu changed = RENDER_LineChanged((const Bitu *)s, (const Bitu *)cache, render.src.start);
+	if (changed) {
+		Bitu size = render.src.width * 4;
+		memcpy(cache, s, size);
+		memcpy(render.scale.outWrite, s, size);
+	}
+	ScalerAddLines( changed, 1 );
+}
+//--End of modifications
+
 
 #define BituMove2(_DST,_SRC,_SIZE)			\
 {											\
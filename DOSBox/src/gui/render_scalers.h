@@ -21,6 +21,11 @@
 
 //#include "render.h"
 #include "video.h"
+//--Added to compare source lines against the render cache with SSE2
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+//--End of modifications
 #if RENDER_USE_ADVANCED_SCALERS>0
 #define SCALER_MAXWIDTH		1280 
 #define SCALER_MAXHEIGHT	1024
@@ -62,6 +67,41 @@ typedef enum scalerOperation {
 typedef void (*ScalerLineHandler_t)(const void *src);
 typedef void (*ScalerComplexHandler_t)(void);
 
+//--Added to compare source lines against the render cache with SSE2
+/* Returns whether any of the first count words of the source line differ from the cached line.
+   Unchanged lines have to be compared in full, so this works through 64 bytes at a time. */
+static INLINE bool RENDER_LineChanged(const Bitu * src, const Bitu * cache, Bits count) {
+#if defined(__SSE2__)
+	const Bits blockWords = 64 / sizeof(Bitu);
+	const __m128i zero = _mm_setzero_si128();
+	for (;count>=blockWords;count-=blockWords) {
+		const __m128i *s = (const __m128i *)src;
+		const __m128i *c = (const __m128i *)cache;
+		__m128i diff0 = _mm_or_si128(_mm_xor_si128(_mm_loadu_si128(s+0), _mm_loadu_si128(c+0)),
+									 _mm_xor_si128(_mm_loadu_si128(s+1), _mm_loadu_si128(c+1)));
+		__m128i diff1 = _mm_or_si128(_mm_xor_si128(_mm_loadu_si128(s+2), _mm_loadu_si128(c+2)),
+									 _mm_xor_si128(_mm_loadu_si128(s+3), _mm_loadu_si128(c+3)));
+		if (GCC_UNLIKELY(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_or_si128(diff0, diff1), zero)) != 0xffff))
+			return true;
+		src += blockWords; cache += blockWords;
+	}
+#endif
+	for (;count>0;count--) {
+		if (GCC_UNLIKELY(*src++ != *cache++))
+			return true;
+	}
+	return false;
+}
+//--End of modifications
+
+//--Added to copy unscaled lines straight into the output frame
+/* Line handlers used in place of Normal1x when there is no scaling and no aspect correction
+   and the output is 32bpp. Each changed line is copied or palette-translated into the output
+   in a single pass over the whole line, rather than going through the scaler templates. */
+void RENDER_DirectLine8_32(const void *s);
+void RENDER_DirectLine32_32(const void *s);
+//--End of modifications
+
 extern Bit8u Scaler_Aspect[];
 extern Bit8u diff_table[];
 extern Bitu Scaler_ChangedLineIndex;
@@ -28,6 +28,12 @@
 #include "mapper.h"
 #include "mem.h"
 #include "dbopl.h"
+//--Added to let the OPL be synthesized on an audio worker
+#include "audio_worker.h"
+//--End of modifications
+//--Added to write captures from a background queue
+#include "capture_writer.h"
+//--End of modifications
 
 namespace OPL2 {
 	#include "opl.cpp"
@@ -86,6 +92,108 @@ namespace OPL3 {
 	};
 }
 
+//--Added to let the OPL be synthesized on an audio worker: see audio_worker.h.
+//This wraps the DOSBox OPL emulator, whose only state the emulation thread needs to know
+//about (whether OPL3 mode is active, for address writes) is easy to shadow.
+namespace DBOPL {
+	struct ThreadedHandler : public Adlib::Handler {
+		struct Worker : public AudioWorker {
+			DBOPL::Handler synth;
+			DBOPL::Chip& chip;
+			//How many events have been applied, and how many had been when a render last
+			//left the chip silent (or ~0 if it didn't): only written on the worker
+			volatile Bitu applied;
+			volatile Bitu silentAfter;
+			Worker( Bitu rate ) : AudioWorker( "com.dosbox.opl", 2 * sizeof(Bit32s), rate / 200 ), chip( synth.chip ), applied( 0 ), silentAfter( ~(Bitu)0 ) {
+				synth.Init( rate );
+			}
+			~Worker() {
+				Drain();
+			}
+			virtual void ApplyEvent( const Bit8u* data, Bitu length ) {
+				Bit32u reg = data[0] | ( data[1] << 8 );
+				chip.WriteReg( reg, data[2] );
+				applied = applied + 1;
+			}
+			virtual void Render( void* buffer, Bitu frames ) {
+				Bit32s* output = (Bit32s*)buffer;
+				while ( frames > 0 ) {
+					Bitu todo = frames > 512 ? 512 : frames;
+					frames -= todo;
+					if ( !chip.opl3Active ) {
+						//Write the mono output into the second half and spread it out from the front
+						Bit32s* mono = output + todo;
+						chip.GenerateBlock2( todo, mono );
+						for ( Bitu i = 0; i < todo; i++ ) {
+							output[i*2+0] = mono[i];
+							output[i*2+1] = mono[i];
+						}
+					} else {
+						chip.GenerateBlock3( todo, output );
+					}
+					output += todo * 2;
+				}
+				silentAfter = chip.Silent() ? (Bitu)applied : ~(Bitu)0;
+			}
+		};
+		Worker* worker;
+		bool opl3Active;
+		//How many events have been queued, and how many frames of silence have been read
+		//since the worker last found the chip silent with all of them applied.
+		//The worker renders ahead, so the chip only counts as silent once that's
+		//long enough for what it rendered beforehand to have been read.
+		Bitu queued;
+		Bitu silentFrames;
+		Bitu latency;
+
+		ThreadedHandler() : worker( 0 ), opl3Active( false ), queued( 0 ), silentFrames( 0 ), latency( 0 ) {
+		}
+		virtual Bit32u WriteAddr( Bit32u port, Bit8u val ) {
+			//Matches Chip::WriteAddr
+			switch ( port & 3 ) {
+			case 0:
+				return val;
+			case 2:
+				if ( opl3Active || (val == 0x05) )
+					return 0x100 | val;
+				else 
+					return val;
+			}
+			return 0;
+		}
+		virtual void WriteReg( Bit32u addr, Bit8u val ) {
+			if ( addr == 0x105 )
+				opl3Active = ( val & 1 ) != 0;
+			Bit8u event[3] = { (Bit8u)( addr & 0xff ), (Bit8u)( addr >> 8 ), val };
+			worker->QueueEvent( event, sizeof(event) );
+			queued++;
+			silentFrames = 0;
+		}
+		virtual void Generate( MixerChannel* chan, Bitu samples ) {
+			Bit32s buffer[ 512 * 2 ];
+			if ( GCC_UNLIKELY(samples > 512) )
+				samples = 512;
+			worker->Read( buffer, samples );
+			chan->AddSamples_s32( samples, buffer );
+			bool quiet = ( worker->silentAfter == queued );
+			for ( Bitu i = 0; quiet && i < samples * 2; i++ )
+				quiet = ( buffer[i] == 0 );
+			silentFrames = quiet ? silentFrames + samples : 0;
+		}
+		virtual void Init( Bitu rate ) {
+			worker = new Worker( rate );
+			latency = rate / 200;
+		}
+		virtual bool Silent() {
+			return silentFrames > latency;
+		}
+		~ThreadedHandler() {
+			delete worker;
+		}
+	};
+}
+//--End of modifications
+
 #define RAW_SIZE 1024
 
 
@@ -141,7 +249,7 @@ class Capture {
 	Bit8u delayShift8;
 	RawHeader header;
 
-	FILE*	handle;				//File used for writing
+	CaptureWriter*	handle;		//File used for writing	//--Modified to write from a background queue
 	Bit32u	startTicks;			//Start used to check total raw length on end
 	Bit32u	lastTicks;			//Last ticks when last last cmd was added
 	Bit8u	buf[1024];	//16 added for delay commands and what not
@@ -191,7 +299,7 @@ class Capture {
 	}
 
 	void ClearBuf( void ) {
-		fwrite( buf, 1, bufUsed, handle );
+		handle->Write( buf, bufUsed );	//--Modified to write from a background queue
 		header.commands += bufUsed / 2;
 		bufUsed = 0;
 	}
@@ -258,9 +366,10 @@ class Capture {
 			var_write( &header.versionLow, header.versionLow );
 			var_write( &header.commands, header.commands );
 			var_write( &header.milliseconds, header.milliseconds );
-			fseek( handle, 0, SEEK_SET );
-			fwrite( &header, 1, sizeof( header ), handle );
-			fclose( handle );
+			//--Modified to write from a background queue
+			handle->WriteAt( 0, &header, sizeof( header ) );
+			handle->Close();
+			//--End of modifications
 			handle = 0;
 		}
 	}
@@ -317,14 +426,17 @@ skipWrite:
 		)) {
 			return true;
 		}
-	  	handle = OpenCaptureFile("Raw Opl",".dro");
-		if (!handle)
+		//--Modified to write from a background queue
+		FILE* file = OpenCaptureFile("Raw Opl",".dro");
+		if (!file)
 			return false;
+		handle = new CaptureWriter( file );
 		InitHeader();
 		//Prepare space at start of the file for the header
-		fwrite( &header, 1, sizeof(header), handle );
+		handle->Write( &header, sizeof(header) );
 		/* write the Raw To Reg table */
-		fwrite( &ToReg, 1, RawUsed, handle );
+		handle->Write( &ToReg, RawUsed );
+		//--End of modifications
 		/* Write the cache of last commands */
 		WriteCache( );
 		/* Write the command that triggered this */
@@ -342,6 +454,9 @@ skipWrite:
 	}
 	~Capture() {
 		CloseFile();
+		//--Added to finish writing the capture before shutting down
+		CaptureWriter::FinishAll();
+		//--End of modifications
 	}
 
 };
@@ -547,6 +662,13 @@ static Adlib::Module* module = 0;
 
 static void OPL_CallBack(Bitu len) {
 	module->handler->Generate( module->mixerChan, len );
+	//--Added to put the channel to sleep as soon as the chip falls silent,
+	//rather than waiting out the timeout below: the next port write wakes it
+	if ( module->handler->Silent() ) {
+		module->mixerChan->Enable(false);
+		return;
+	}
+	//--End of modifications
 	//Disable the sound generation after 30 seconds of silence
 	if ((PIC_Ticks - module->lastUsed) > 30000) {
 		Bitu i;
@@ -638,20 +760,25 @@ Module::Module( Section* configuration ) : Module_base(configuration) {
 	if ( rate < 8000 )
 		rate = 8000;
 	std::string oplemu( section->Get_string( "oplemu" ) );
+	//--Added to let the OPL be synthesized on an audio worker
+	bool threaded = section->Get_bool( "oplthread" ) && AudioWorker::Worthwhile();
+	//--End of modifications
 
 	mixerChan = mixerObject.Install(OPL_CallBack,rate,"FM");
 	mixerChan->SetScale( 2.0f );
-	if (oplemu == "fast") {
-		handler = new DBOPL::Handler();
-	} else if (oplemu == "compat") {
+	//--Modified to let the OPL be synthesized on an audio worker
+	if (oplemu == "compat") {
 		if ( oplmode == OPL_opl2 ) {
 			handler = new OPL2::Handler();
 		} else {
 			handler = new OPL3::Handler();
 		}
+	} else if ( threaded ) {
+		handler = new DBOPL::ThreadedHandler();
 	} else {
 		handler = new DBOPL::Handler();
 	}
+	//--End of modifications
 	handler->Init( rate );
 	bool single = false;
 	switch ( oplmode ) {
@@ -679,9 +806,50 @@ Module::Module( Section* configuration ) : Module_base(configuration) {
 	ReadHandler[2].Install(base+8,OPL_Read,IO_MB, 1);
 
 	MAPPER_AddHandler(OPL_SaveRawEvent,MK_f7,MMOD1|MMOD2,"caprawopl","Cap OPL");
+	SAVESTATE_Register("opl",this);	//--Added for save states
+}
+
+//--Added for save states. The synthesizer's internal state isn't saved: instead the register
+//cache is written back into it, which restores every setting though notes will restart.
+void Module::SaveState( std::ostream& stream ) {
+	SAVESTATE_Write( stream, mode );
+	SAVESTATE_Write( stream, reg );
+	SAVESTATE_Write( stream, cache );
+	SAVESTATE_Write( stream, chip );
+}
+
+void Module::LoadState( std::istream& stream ) {
+	Mode savedMode;
+	SAVESTATE_Read( stream, savedMode );
+	if ( savedMode != mode ) {
+		stream.setstate( std::ios::failbit );
+		return;
+	}
+	SAVESTATE_Read( stream, reg );
+	SAVESTATE_Read( stream, cache );
+	SAVESTATE_Read( stream, chip );
+	if ( !stream )
+		return;
+	//A single OPL2 only has the first bank. Otherwise the OPL3 mode registers change
+	//how the others are interpreted, so they go first
+	Bit32u count = 256;
+	if ( mode != MODE_OPL2 ) {
+		count = 512;
+		handler->WriteReg( 0x105, cache[ 0x105 ] );
+		handler->WriteReg( 0x104, cache[ 0x104 ] );
+	}
+	for ( Bit32u i = 0; i < count; i++ ) {
+		if ( i == 0x104 || i == 0x105 )
+			continue;
+		handler->WriteReg( i, cache[ i ] );
+	}
+	lastUsed = PIC_Ticks;
+	mixerChan->Enable( true );
 }
+//--End of modifications
 
 Module::~Module() {
+	SAVESTATE_Unregister( this );	//--Added for save states
 	if ( capture ) {
 		delete capture;
 	}
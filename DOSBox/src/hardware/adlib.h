@@ -104,6 +104,12 @@ public:
 	virtual void Generate( MixerChannel* chan, Bitu samples ) = 0;
 	//Initialize at a specific sample rate and mode
 	virtual void Init( Bitu rate ) = 0;
+	//--Added to let the mixer channel sleep through silence
+	//Whether the chip has gone quiet and will stay that way until it's next written to
+	virtual bool Silent() {
+		return false;
+	}
+	//--End of modifications
 	virtual ~Handler() {
 	}
 };
@@ -143,6 +149,11 @@ public:
 	Bitu PortRead( Bitu port, Bitu iolen );
 	void Init( Mode m );
 
+	//--Added for save states
+	void SaveState( std::ostream& stream );
+	void LoadState( std::istream& stream );
+	//--End of modifications
+
 	Module( Section* configuration); 
 	~Module();
 };
@@ -0,0 +1,143 @@
+/*
+ *  Copyright (C) 2002-2010  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+//--Added to move the cost of synthesizing audio off the emulation thread: see audio_worker.h.
+
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "audio_worker.h"
+
+// the most frames we'll ask the worker for in one go
+#define AUDIO_WORKER_MAXREQUEST	4096
+
+// the QoS class for user-interactive work, which hosts before 10.10 don't know about
+#define AUDIO_WORKER_QOS_CLASS	0x21
+
+AudioWorker::AudioWorker(const char * name,Bitu _frame_size,Bitu latency_frames) {
+	frame_size=_frame_size;
+	capacity=latency_frames+AUDIO_WORKER_MAXREQUEST;
+	fifo=(Bit8u *)calloc(capacity,frame_size);
+	if (!fifo) E_Exit("Allocating the audio worker buffer has failed");
+	read_pos=0;
+	write_pos=latency_frames;
+	available=latency_frames;
+	stalls=0;
+
+	pthread_mutex_init(&lock,NULL);
+	pthread_cond_init(&rendered,NULL);
+	queue=dispatch_queue_create(name,NULL);
+	// the emulation thread waits on the worker when it falls behind, so keep it off efficiency cores
+	// and ahead of background work: older hosts return no queue for a QoS class
+	dispatch_queue_t target=dispatch_get_global_queue(AUDIO_WORKER_QOS_CLASS,0);
+	if (!target) target=dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH,0);
+	dispatch_set_target_queue(queue,target);
+	pending=new Job;
+}
+
+AudioWorker::~AudioWorker() {
+	Drain();
+	dispatch_release(queue);
+	pthread_cond_destroy(&rendered);
+	pthread_mutex_destroy(&lock);
+	delete pending;
+	free(fifo);
+}
+
+bool AudioWorker::Worthwhile(void) {
+	return sysconf(_SC_NPROCESSORS_ONLN)>1;
+}
+
+void AudioWorker::Drain(void) {
+	// hand over any events still waiting for a render, so they aren't lost
+	if (!pending->events.empty()) {
+		Job * job=pending;
+		job->frames=0;
+		pending=new Job;
+		AudioWorker * worker=this;
+		dispatch_async(queue,^{
+			worker->Perform(job);
+		});
+	}
+	dispatch_sync(queue,^{});
+}
+
+void AudioWorker::QueueEvent(const void * data,Bitu length) {
+	Bit32u size=(Bit32u)length;
+	const Bit8u * header=(const Bit8u *)&size;
+	pending->events.insert(pending->events.end(),header,header+sizeof(size));
+	pending->events.insert(pending->events.end(),(const Bit8u *)data,(const Bit8u *)data+length);
+}
+
+void AudioWorker::Read(void * buffer,Bitu frames) {
+	Bit8u * output=(Bit8u *)buffer;
+	while (frames) {
+		Bitu todo=frames>AUDIO_WORKER_MAXREQUEST ? AUDIO_WORKER_MAXREQUEST : frames;
+		frames-=todo;
+
+		// hand over the events so far along with the request for these frames
+		Job * job=pending;
+		job->frames=todo;
+		pending=new Job;
+		AudioWorker * worker=this;
+		dispatch_async(queue,^{
+			worker->Perform(job);
+		});
+
+		// the FIFO is primed, so normally this is already satisfied by earlier requests
+		pthread_mutex_lock(&lock);
+		if (available<todo) stalls++;
+		while (available<todo) pthread_cond_wait(&rendered,&lock);
+		available-=todo;
+		pthread_mutex_unlock(&lock);
+
+		Bitu first=capacity-read_pos;
+		if (first>todo) first=todo;
+		memcpy(output,fifo+read_pos*frame_size,first*frame_size);
+		memcpy(output+first*frame_size,fifo,(todo-first)*frame_size);
+		read_pos=(read_pos+todo)%capacity;
+		output+=todo*frame_size;
+	}
+}
+
+// called on the worker queue
+void AudioWorker::Perform(Job * job) {
+	const Bit8u * event=job->events.empty() ? 0 : &job->events[0];
+	const Bit8u * end=event+job->events.size();
+	while (event<end) {
+		Bit32u size;
+		memcpy(&size,event,sizeof(size));
+		event+=sizeof(size);
+		ApplyEvent(event,size);
+		event+=size;
+	}
+
+	Bitu frames=job->frames;
+	Bitu first=capacity-write_pos;
+	if (first>frames) first=frames;
+	if (first) Render(fifo+write_pos*frame_size,first);
+	if (frames>first) Render(fifo,frames-first);
+	write_pos=(write_pos+frames)%capacity;
+	delete job;
+
+	pthread_mutex_lock(&lock);
+	available+=frames;
+	pthread_cond_signal(&rendered);
+	pthread_mutex_unlock(&lock);
+}
+//--End of modifications
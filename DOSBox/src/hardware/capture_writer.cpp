@@ -0,0 +1,249 @@
+/*
+ *  Copyright (C) 2002-2010  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+//--Added to take the writing of capture files off the emulation thread: see capture_writer.h.
+
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <AudioToolbox/AudioToolbox.h>
+#include "capture_writer.h"
+
+// the size of the blocks handed to the queue: a whole number of 16-bit stereo frames
+#define CAPTURE_WRITER_BLOCK		(256*1024)
+// how many blocks may be waiting on the queue before Write has to wait for it
+#define CAPTURE_WRITER_MAX_BLOCKS	64
+
+// older SDKs don't name FLAC, which hosts before 10.13 can't encode
+#define CAPTURE_FORMAT_FLAC			'flac'
+#define CAPTURE_FILE_TYPE_FLAC		'flac'
+// how many frames the encoders are given to a packet
+#define CAPTURE_ENCODER_FRAMES		4096
+
+// Encodes 16-bit stereo frames through AudioToolbox into the writer's file, which it reaches
+// through callbacks so that it needn't open the file again. Only used on the writer's queue.
+class CaptureAudioEncoder {
+public:
+	static CaptureAudioEncoder * Create(FILE * handle,CaptureAudioFormat format,Bitu rate) {
+		CaptureAudioEncoder * encoder=new CaptureAudioEncoder(handle);
+		if (!encoder->Open(format,rate)) {
+			delete encoder;
+			return 0;
+		}
+		return encoder;
+	}
+	void Encode(const Bit8u * data,Bitu size) {
+		AudioBufferList list;
+		list.mNumberBuffers=1;
+		list.mBuffers[0].mNumberChannels=2;
+		list.mBuffers[0].mDataByteSize=(UInt32)size;
+		list.mBuffers[0].mData=(void *)data;
+		ExtAudioFileWrite(ext,(UInt32)(size/4),&list);
+	}
+	// finishes the encoded file: the file itself is left for the writer to close
+	~CaptureAudioEncoder() {
+		if (ext) ExtAudioFileDispose(ext);
+		if (file) AudioFileClose(file);
+	}
+private:
+	FILE * handle;
+	AudioFileID file;
+	ExtAudioFileRef ext;
+
+	CaptureAudioEncoder(FILE * _handle) : handle(_handle), file(0), ext(0) {
+	}
+	bool Open(CaptureAudioFormat format,Bitu rate) {
+		AudioStreamBasicDescription output;
+		memset(&output,0,sizeof(output));
+		output.mSampleRate=rate;
+		output.mFormatID=(format==CAPTURE_AUDIO_FLAC) ? CAPTURE_FORMAT_FLAC : kAudioFormatAppleLossless;
+		output.mFormatFlags=kAppleLosslessFormatFlag_16BitSourceData;
+		output.mFramesPerPacket=CAPTURE_ENCODER_FRAMES;
+		output.mChannelsPerFrame=2;
+		AudioFileTypeID type=(format==CAPTURE_AUDIO_FLAC) ? CAPTURE_FILE_TYPE_FLAC : kAudioFileM4AType;
+		if (AudioFileInitializeWithCallbacks(this,ReadProc,WriteProc,GetSizeProc,SetSizeProc,type,&output,0,&file)!=noErr) {
+			file=0;
+			return false;
+		}
+		if (ExtAudioFileWrapAudioFileID(file,true,&ext)!=noErr) {
+			ext=0;
+			return false;
+		}
+		AudioStreamBasicDescription input;
+		memset(&input,0,sizeof(input));
+		input.mSampleRate=rate;
+		input.mFormatID=kAudioFormatLinearPCM;
+		input.mFormatFlags=kAudioFormatFlagIsSignedInteger|kAudioFormatFlagIsPacked;
+		input.mBytesPerPacket=4;
+		input.mFramesPerPacket=1;
+		input.mBytesPerFrame=4;
+		input.mChannelsPerFrame=2;
+		input.mBitsPerChannel=16;
+		return ExtAudioFileSetProperty(ext,kExtAudioFileProperty_ClientDataFormat,sizeof(input),&input)==noErr;
+	}
+
+	static OSStatus ReadProc(void * client,SInt64 position,UInt32 count,void * buffer,UInt32 * actual) {
+		FILE * handle=((CaptureAudioEncoder *)client)->handle;
+		if (fseeko(handle,position,SEEK_SET)) return kAudioFilePositionError;
+		*actual=(UInt32)fread(buffer,1,count,handle);
+		return noErr;
+	}
+	static OSStatus WriteProc(void * client,SInt64 position,UInt32 count,const void * buffer,UInt32 * actual) {
+		FILE * handle=((CaptureAudioEncoder *)client)->handle;
+		if (fseeko(handle,position,SEEK_SET)) return kAudioFilePositionError;
+		*actual=(UInt32)fwrite(buffer,1,count,handle);
+		return (*actual==count) ? noErr : kAudioFileUnspecifiedError;
+	}
+	static SInt64 GetSizeProc(void * client) {
+		FILE * handle=((CaptureAudioEncoder *)client)->handle;
+		if (fseeko(handle,0,SEEK_END)) return 0;
+		return ftello(handle);
+	}
+	static OSStatus SetSizeProc(void * client,SInt64 size) {
+		FILE * handle=((CaptureAudioEncoder *)client)->handle;
+		fflush(handle);
+		return ftruncate(fileno(handle),size) ? kAudioFileUnspecifiedError : noErr;
+	}
+};
+
+// every writer's work goes into this group, so that FinishAll can wait for it
+static dispatch_group_t CaptureWriter_Group(void) {
+	static dispatch_group_t group;
+	static dispatch_once_t once;
+	dispatch_once(&once,^{
+		group=dispatch_group_create();
+	});
+	return group;
+}
+
+CaptureWriter::CaptureWriter(FILE * _handle) {
+	handle=_handle;
+	queue=dispatch_queue_create("com.dosbox.capture",NULL);
+	dispatch_set_target_queue(queue,dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW,0));
+	room=dispatch_semaphore_create(CAPTURE_WRITER_MAX_BLOCKS);
+	block=(Bit8u *)malloc(CAPTURE_WRITER_BLOCK);
+	if (!block) E_Exit("Allocating the capture buffer has failed");
+	used=0;
+	length=0;
+	encoder=0;
+}
+
+CaptureWriter::~CaptureWriter() {
+	free(block);
+	dispatch_release(room);
+	dispatch_release(queue);
+}
+
+bool CaptureWriter::CanEncodeAudio(CaptureAudioFormat format) {
+	if (format==CAPTURE_AUDIO_WAV) return true;
+	UInt32 formatID=(format==CAPTURE_AUDIO_FLAC) ? CAPTURE_FORMAT_FLAC : kAudioFormatAppleLossless;
+	UInt32 size=0;
+	if (AudioFormatGetPropertyInfo(kAudioFormatProperty_Encoders,sizeof(formatID),&formatID,&size)!=noErr) return false;
+	return size>0;
+}
+
+const char * CaptureWriter::AudioExtension(CaptureAudioFormat format) {
+	switch (format) {
+	case CAPTURE_AUDIO_ALAC: return ".m4a";
+	case CAPTURE_AUDIO_FLAC: return ".flac";
+	default: return ".wav";
+	}
+}
+
+bool CaptureWriter::EncodeAudio(CaptureAudioFormat format,Bitu rate) {
+	if (format==CAPTURE_AUDIO_WAV) return true;
+	// the encoder writes a header as it opens, so let anything already queued go first
+	Flush();
+	__block CaptureAudioEncoder * created=0;
+	FILE * file=handle;
+	dispatch_sync(queue,^{
+		created=CaptureAudioEncoder::Create(file,format,rate);
+	});
+	encoder=created;
+	return encoder!=0;
+}
+
+void CaptureWriter::Write(const void * data,Bitu size) {
+	const Bit8u * input=(const Bit8u *)data;
+	length+=size;
+	while (size) {
+		Bitu todo=CAPTURE_WRITER_BLOCK-used;
+		if (todo>size) todo=size;
+		memcpy(block+used,input,todo);
+		used+=todo;
+		input+=todo;
+		size-=todo;
+		if (used==CAPTURE_WRITER_BLOCK) Flush();
+	}
+}
+
+void CaptureWriter::WriteAt(Bitu offset,const void * data,Bitu size) {
+	Flush();
+	Bit8u * copy=(Bit8u *)malloc(size);
+	if (!copy) E_Exit("Allocating the capture buffer has failed");
+	memcpy(copy,data,size);
+	Queue(copy,size,(Bits)offset);
+}
+
+void CaptureWriter::Flush(void) {
+	if (!used) return;
+	Queue(block,used,-1);
+	block=(Bit8u *)malloc(CAPTURE_WRITER_BLOCK);
+	if (!block) E_Exit("Allocating the capture buffer has failed");
+	used=0;
+}
+
+// hands the data over to the queue, which frees it once it's written
+void CaptureWriter::Queue(Bit8u * data,Bitu size,Bits offset) {
+	dispatch_semaphore_wait(room,DISPATCH_TIME_FOREVER);
+	CaptureWriter * writer=this;
+	dispatch_group_async(CaptureWriter_Group(),queue,^{
+		writer->Perform(data,size,offset);
+		free(data);
+		dispatch_semaphore_signal(writer->room);
+	});
+}
+
+// called on the queue
+void CaptureWriter::Perform(const Bit8u * data,Bitu size,Bits offset) {
+	if (encoder) {
+		encoder->Encode(data,size);
+	} else if (offset>=0) {
+		off_t resume=ftello(handle);
+		fseeko(handle,offset,SEEK_SET);
+		fwrite(data,1,size,handle);
+		fseeko(handle,resume,SEEK_SET);
+	} else {
+		fwrite(data,1,size,handle);
+	}
+}
+
+void CaptureWriter::Close(void) {
+	Flush();
+	CaptureWriter * writer=this;
+	dispatch_group_async(CaptureWriter_Group(),queue,^{
+		delete writer->encoder;
+		fclose(writer->handle);
+		delete writer;
+	});
+}
+
+void CaptureWriter::FinishAll(void) {
+	dispatch_group_wait(CaptureWriter_Group(),DISPATCH_TIME_FOREVER);
+}
+//--End of modifications
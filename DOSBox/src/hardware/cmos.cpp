@@ -316,7 +316,19 @@ public:
 		cmos.regs[0x18]=(Bit8u)(exsize >> 8);
 		cmos.regs[0x30]=(Bit8u)exsize;
 		cmos.regs[0x31]=(Bit8u)(exsize >> 8);
+		SAVESTATE_Register("cmos",this);	//--Added for save states
 	}
+	//--Added for save states. The clock itself follows the host's time, as it always has.
+	void SaveState(std::ostream& stream) {
+		SAVESTATE_WriteBlock(stream,&cmos,sizeof(cmos));
+	}
+	void LoadState(std::istream& stream) {
+		SAVESTATE_ReadBlock(stream,&cmos,sizeof(cmos));
+	}
+	~CMOS(){
+		SAVESTATE_Unregister(this);
+	}
+	//--End of modifications
 };
 
 static CMOS* test;
@@ -440,7 +440,22 @@ static const VolumeHandler VolumeHandlerTable[5] = {
 };
 
 INLINE Bitu Operator::ForwardVolume() {
-	return currentLevel + (this->*volHandler)();
+	//--Modified to pick the envelope handler with a switch rather than calling through volHandler.
+	//This gets called for every operator on every sample, and this way the handlers can be inlined.
+	//return currentLevel + (this->*volHandler)();
+	switch ( state ) {
+	case SUSTAIN:
+		return currentLevel + TemplateVolume< SUSTAIN >();
+	case DECAY:
+		return currentLevel + TemplateVolume< DECAY >();
+	case RELEASE:
+		return currentLevel + TemplateVolume< RELEASE >();
+	case ATTACK:
+		return currentLevel + TemplateVolume< ATTACK >();
+	default:
+		return currentLevel + ENV_MAX;
+	}
+	//--End of modifications
 }
 
 
@@ -899,6 +914,11 @@ Channel* Channel::BlockTemplate( Chip* chip, Bit32u samples, Bit32s* output ) {
 		Op( 4 )->Prepare( chip );
 		Op( 5 )->Prepare( chip );
 	}
+	//--Added to keep the feedback in locals for the duration of the block: otherwise they have to go
+	//through memory on every sample, since the compiler can't rule out the output aliasing them
+	Bit32s old0 = old[0], old1 = old[1];
+	const Bit8u fb = feedback;
+	//--End of modifications
 	for ( Bitu i = 0; i < samples; i++ ) {
 		//Early out for percussion handlers
 		if ( mode == sm2Percussion ) {
@@ -910,11 +930,13 @@ Channel* Channel::BlockTemplate( Chip* chip, Bit32u samples, Bit32s* output ) {
 		}
 
 		//Do unsigned shift so we can shift out all bits but still stay in 10 bit range otherwise
-		Bit32s mod = (Bit32u)((old[0] + old[1])) >> feedback;
-		old[0] = old[1];
-		old[1] = Op(0)->GetSample( mod );
+		//--Modified to use the local copies of the feedback
+		Bit32s mod = (Bit32u)((old0 + old1)) >> fb;
+		old0 = old1;
+		old1 = Op(0)->GetSample( mod );
 		Bit32s sample;
-		Bit32s out0 = old[0];
+		Bit32s out0 = old0;
+		//--End of modifications
 		if ( mode == sm2AM || mode == sm3AM ) {
 			sample = out0 + Op(1)->GetSample( 0 );
 		} else if ( mode == sm2FM || mode == sm3FM ) {
@@ -957,6 +979,12 @@ Channel* Channel::BlockTemplate( Chip* chip, Bit32u samples, Bit32s* output ) {
             break;
 		}
 	}
+	//--Added to store the feedback back again
+	if ( mode != sm2Percussion && mode != sm3Percussion ) {
+		old[0] = old0;
+		old[1] = old1;
+	}
+	//--End of modifications
 	switch( mode ) {
 	case sm2AM:
 	case sm2FM:
@@ -1208,6 +1236,17 @@ void Chip::GenerateBlock3( Bitu total, Bit32s* output  ) {
 	}
 }
 
+//--Added to let the mixer channel sleep through silence: the chip is silent once every
+//operator has been attenuated away and sits in an envelope state it won't move on from
+bool Chip::Silent() const {
+	for ( Bitu i = 0; i < 18; i++ ) {
+		if ( !chan[i].op[0].Silent() || !chan[i].op[1].Silent() )
+			return false;
+	}
+	return true;
+}
+//--End of modifications
+
 void Chip::Setup( Bit32u rate ) {
 	double original = OPLRATE;
 //	double original = rate;
@@ -1514,5 +1553,11 @@ void Handler::Init( Bitu rate ) {
 	chip.Setup( rate );
 }
 
+//--Added to let the mixer channel sleep through silence
+bool Handler::Silent() {
+	return chip.Silent();
+}
+//--End of modifications
+
 
 };		//Namespace DBOPL
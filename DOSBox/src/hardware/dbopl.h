@@ -242,6 +242,10 @@ struct Chip {
 	void Generate( Bit32u samples );
 	void Setup( Bit32u r );
 
+	//--Added to let the mixer channel sleep through silence
+	bool Silent() const;
+	//--End of modifications
+
 	Chip();
 };
 
@@ -251,6 +255,9 @@ struct Handler : public Adlib::Handler {
 	virtual void WriteReg( Bit32u addr, Bit8u val );
 	virtual void Generate( MixerChannel* chan, Bitu samples );
 	virtual void Init( Bitu rate );
+	//--Added to let the mixer channel sleep through silence
+	virtual bool Silent();
+	//--End of modifications
 };
 
 
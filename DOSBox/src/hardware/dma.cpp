@@ -42,6 +42,18 @@ static void UpdateEMSMapping(void) {
 	}
 }
 
+//--Modified to copy contiguous spans at a time instead of byte by byte.
+//The wrap mask always covers whole 4K pages, so a span only has to stop at the end of
+//the current page (where the address may also wrap) or at the end of the transfer.
+
+/* care for EMS pageframe etc. */
+static INLINE Bitu DMA_TranslatePage(Bitu page) {
+	if (page < EMM_PAGEFRAME4K) return paging.firstmb[page];
+	else if (page < EMM_PAGEFRAME4K+0x10) return ems_board_mapping[page];
+	else if (page < LINK_START) return paging.firstmb[page];
+	return page;
+}
+
 /* read a block from physical memory */
 static void DMA_BlockRead(PhysPt spage,PhysPt offset,void * data,Bitu size,Bit8u dma16) {
 	Bit8u * write=(Bit8u *) data;
@@ -49,17 +61,18 @@ static void DMA_BlockRead(PhysPt spage,PhysPt offset,void * data,Bitu size,Bit8u
 	size <<= dma16;
 	offset <<= dma16;
 	Bit32u dma_wrap = ((0xffff<<dma16)+dma16) | dma_wrapping;
-	for ( ; size ; size--, offset++) {
-        if (offset>(dma_wrapping<<dma16)) {
+	while (size) {
+		if (offset>(dma_wrapping<<dma16)) {
 			LOG_MSG("DMA segbound wrapping (read): %x:%x size %x [%x] wrap %x",spage,offset,size,dma16,dma_wrapping);
 		}
 		offset &= dma_wrap;
-		Bitu page = highpart_addr_page+(offset >> 12);
-		/* care for EMS pageframe etc. */
-		if (page < EMM_PAGEFRAME4K) page = paging.firstmb[page];
-		else if (page < EMM_PAGEFRAME4K+0x10) page = ems_board_mapping[page];
-		else if (page < LINK_START) page = paging.firstmb[page];
-		*write++=phys_readb(page*4096 + (offset & 4095));
+		Bitu span = 4096 - (offset & 4095);
+		if (span > size) span = size;
+		Bitu page = DMA_TranslatePage(highpart_addr_page+(offset >> 12));
+		memcpy(write,MemBase+page*4096+(offset & 4095),span);
+		write+=span;
+		offset+=span;
+		size-=span;
 	}
 }
 
@@ -70,19 +83,21 @@ static void DMA_BlockWrite(PhysPt spage,PhysPt offset,void * data,Bitu size,Bit8
 	size <<= dma16;
 	offset <<= dma16;
 	Bit32u dma_wrap = ((0xffff<<dma16)+dma16) | dma_wrapping;
-	for ( ; size ; size--, offset++) {
+	while (size) {
 		if (offset>(dma_wrapping<<dma16)) {
 			LOG_MSG("DMA segbound wrapping (write): %x:%x size %x [%x] wrap %x",spage,offset,size,dma16,dma_wrapping);
 		}
 		offset &= dma_wrap;
-		Bitu page = highpart_addr_page+(offset >> 12);
-		/* care for EMS pageframe etc. */
-		if (page < EMM_PAGEFRAME4K) page = paging.firstmb[page];
-		else if (page < EMM_PAGEFRAME4K+0x10) page = ems_board_mapping[page];
-		else if (page < LINK_START) page = paging.firstmb[page];
-		phys_writeb(page*4096 + (offset & 4095), *read++);
+		Bitu span = 4096 - (offset & 4095);
+		if (span > size) span = size;
+		Bitu page = DMA_TranslatePage(highpart_addr_page+(offset >> 12));
+		memcpy(MemBase+page*4096+(offset & 4095),read,span);
+		read+=span;
+		offset+=span;
+		size-=span;
 	}
 }
+//--End of modifications
 
 DmaChannel * GetDMAChannel(Bit8u chan) {
 	if (chan<4) {
@@ -290,7 +305,10 @@ again:
 		curraddr+=want;
 		currcnt-=want;
 	} else {
-		DMA_BlockRead(pagebase,curraddr,buffer,want,DMA16);
+		//--Modified to read only up to the end of the block, as Write does: reading the
+		//whole request here just copied data that was then overwritten or discarded.
+		DMA_BlockRead(pagebase,curraddr,buffer,left,DMA16);
+		//--End of modifications
 		buffer+=left << DMA16;
 		want-=left;
 		done+=left;
@@ -343,6 +361,48 @@ again:
 	return done;
 }
 
+//--Added for save states
+void DmaController::SaveState(std::ostream& stream) {
+	SAVESTATE_Write(stream,flipflop);
+	for (Bitu i=0;i<4;i++) {
+		DmaChannel * chan=DmaChannels[i];
+		SAVESTATE_Write(stream,chan->pagebase);
+		SAVESTATE_Write(stream,chan->baseaddr);
+		SAVESTATE_Write(stream,chan->curraddr);
+		SAVESTATE_Write(stream,chan->basecnt);
+		SAVESTATE_Write(stream,chan->currcnt);
+		SAVESTATE_Write(stream,chan->pagenum);
+		SAVESTATE_Write(stream,chan->increment);
+		SAVESTATE_Write(stream,chan->autoinit);
+		SAVESTATE_Write(stream,chan->trantype);
+		SAVESTATE_Write(stream,chan->masked);
+		SAVESTATE_Write(stream,chan->tcount);
+		SAVESTATE_Write(stream,chan->request);
+		SAVESTATE_WriteHandler(stream,chan->callback);
+	}
+}
+
+void DmaController::LoadState(std::istream& stream) {
+	SAVESTATE_Read(stream,flipflop);
+	for (Bitu i=0;i<4;i++) {
+		DmaChannel * chan=DmaChannels[i];
+		SAVESTATE_Read(stream,chan->pagebase);
+		SAVESTATE_Read(stream,chan->baseaddr);
+		SAVESTATE_Read(stream,chan->curraddr);
+		SAVESTATE_Read(stream,chan->basecnt);
+		SAVESTATE_Read(stream,chan->currcnt);
+		SAVESTATE_Read(stream,chan->pagenum);
+		SAVESTATE_Read(stream,chan->increment);
+		SAVESTATE_Read(stream,chan->autoinit);
+		SAVESTATE_Read(stream,chan->trantype);
+		SAVESTATE_Read(stream,chan->masked);
+		SAVESTATE_Read(stream,chan->tcount);
+		SAVESTATE_Read(stream,chan->request);
+		SAVESTATE_ReadHandler(stream,chan->callback);
+	}
+}
+//--End of modifications
+
 class DMA:public Module_base{
 public:
 	DMA(Section* configuration):Module_base(configuration){
@@ -372,8 +432,34 @@ public:
 			DmaControllers[1]->DMA_WriteHandler[0x10].Install(0x89,DMA_Write_Port,IO_MB,3);
 			DmaControllers[1]->DMA_ReadHandler[0x10].Install(0x89,DMA_Read_Port,IO_MB,3);
 		}
+		SAVESTATE_Register("dma",this);	//--Added for save states
+	}
+	//--Added for save states
+	void SaveState(std::ostream& stream) {
+		SAVESTATE_Write(stream,dma_wrapping);
+		SAVESTATE_Write(stream,ems_board_mapping);
+		for (Bitu i=0;i<2;i++) {
+			bool present=(DmaControllers[i]!=NULL);
+			SAVESTATE_Write(stream,present);
+			if (present) DmaControllers[i]->SaveState(stream);
+		}
+	}
+	void LoadState(std::istream& stream) {
+		SAVESTATE_Read(stream,dma_wrapping);
+		SAVESTATE_Read(stream,ems_board_mapping);
+		for (Bitu i=0;i<2;i++) {
+			bool present=false;
+			SAVESTATE_Read(stream,present);
+			if (present!=(DmaControllers[i]!=NULL)) {
+				stream.setstate(std::ios::failbit);
+				return;
+			}
+			if (present) DmaControllers[i]->LoadState(stream);
+		}
 	}
+	//--End of modifications
 	~DMA(){
+		SAVESTATE_Unregister(this);	//--Added for save states
 		if (DmaControllers[0]) {
 			delete DmaControllers[0];
 			DmaControllers[0]=NULL;
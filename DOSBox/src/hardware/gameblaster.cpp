@@ -187,6 +187,51 @@ static void saa1099_envelope(int chip, int ch)
 }
 
 
+//--Added to let the mixer channel sleep through silence: a chip is silent when each channel
+//is switched off or turned all the way down. (A zero envelope doesn't count: even when the
+//envelope generator is off, its next clock sets the envelope back to full.)
+static bool saa1099_silent(int chip)
+{
+	struct SAA1099 *saa = &saa1099[chip];
+	if (!saa->all_ch_enable) return true;
+	for (int ch = 0; ch < 6; ch++)
+	{
+		struct saa1099_channel *c = &saa->channels[ch];
+		if (!c->freq_enable && !c->noise_enable) continue;
+		if (!c->amplitude[LEFT] && !c->amplitude[RIGHT]) continue;
+		return false;
+	}
+	return true;
+}
+//--End of modifications
+
+//--Added to generate the output in spans: see saa1099_update.
+//Whether an edge of the channel's square wave can change the output: either the channel is
+//heard, or its edges clock an envelope generator (which sets the envelopes even when it's off)
+static INLINE bool saa1099_edges_matter(struct SAA1099 *saa, int ch)
+{
+	if (saa->channels[ch].freq_enable) return true;
+	if (ch == 1 && saa->env_clock[0] == 0) return true;
+	if (ch == 4 && saa->env_clock[1] == 0) return true;
+	return false;
+}
+
+// whether any of the noise generator's channels are using it
+static INLINE bool saa1099_noise_matters(struct SAA1099 *saa, int ch)
+{
+	return saa->channels[ch*3].noise_enable || saa->channels[ch*3+1].noise_enable || saa->channels[ch*3+2].noise_enable;
+}
+
+// steps the noise generator's shift register once
+static INLINE void saa1099_step_noise(struct saa1099_noise *noise)
+{
+	if( ((noise->level & 0x4000) == 0) == ((noise->level & 0x0040) == 0) )
+		noise->level = (noise->level << 1) | 1;
+	else
+		noise->level <<= 1;
+}
+//--End of modifications
+
 static void saa1099_update(int chip, INT16 **buffer, int length)
 {
 	struct SAA1099 *saa = &saa1099[chip];
@@ -212,11 +257,88 @@ static void saa1099_update(int chip, INT16 **buffer, int length)
 		}
 	}
 
+	//--Added to generate the output in spans between the edges that can change it.
+	//Within a span every level holds, so the output is worked out once and the counters are
+	//advanced in bulk; channels nobody can hear are just wrapped round, and noise generators
+	//nobody is using are stepped in a batch. The sample with the edge is done as before.
+	for (ch = 0; ch < 6; ch++)
+	{
+		if (saa->channels[ch].freq == 0.0)
+			saa->channels[ch].freq = (double)((2 * 15625) << saa->channels[ch].octave) /
+				(511.0 - (double)saa->channels[ch].frequency);
+	}
+	//--End of modifications
+
     /* fill all data needed */
 	for( j = 0; j < length; j++ )
 	{
 		int output_l = 0, output_r = 0;
 
+		//--Added to generate the output in spans: see above
+		int run = length - j;
+		for (ch = 0; ch < 6 && run > 0; ch++)
+		{
+			if (!saa1099_edges_matter(saa, ch)) continue;
+			double before = saa->channels[ch].counter / saa->channels[ch].freq;
+			if (before < run) run = (int)before;
+		}
+		for (ch = 0; ch < 2 && run > 0; ch++)
+		{
+			if (!saa1099_noise_matters(saa, ch) || saa->noise[ch].freq <= 0) continue;
+			double before = saa->noise[ch].counter / saa->noise[ch].freq;
+			if (before < run) run = (int)before;
+		}
+		if (run > 0)
+		{
+			for (ch = 0; ch < 6; ch++)
+			{
+				struct saa1099_channel *c = &saa->channels[ch];
+				if (c->noise_enable && (saa->noise[ch/3].level & 1))
+				{
+					output_l -= c->amplitude[ LEFT] * c->envelope[ LEFT] / 16 / 2;
+					output_r -= c->amplitude[RIGHT] * c->envelope[RIGHT] / 16 / 2;
+				}
+				if (c->freq_enable && (c->level & 1))
+				{
+					output_l += c->amplitude[ LEFT] * c->envelope[ LEFT] / 16;
+					output_r += c->amplitude[RIGHT] * c->envelope[RIGHT] / 16;
+				}
+				c->counter -= run * c->freq;
+				if (c->counter < 0)
+				{
+					if (saa1099_edges_matter(saa, ch))
+					{
+						/* only rounding can take it past the edge: leave the edge to the next sample */
+						c->counter = 0;
+					}
+					else
+					{
+						int wraps = (int)ceil(-c->counter / sample_rate);
+						c->counter += wraps * sample_rate;
+						c->level ^= wraps & 1;
+					}
+				}
+			}
+			for (ch = 0; ch < 2; ch++)
+			{
+				saa->noise[ch].counter -= run * saa->noise[ch].freq;
+				while (saa->noise[ch].counter < 0)
+				{
+					saa->noise[ch].counter += sample_rate;
+					saa1099_step_noise(&saa->noise[ch]);
+				}
+			}
+			INT16 left = output_l / 6, right = output_r / 6;
+			for (int n = 0; n < run; n++)
+			{
+				buffer[LEFT][j+n] = left;
+				buffer[RIGHT][j+n] = right;
+			}
+			j += run - 1;
+			continue;
+		}
+		//--End of modifications
+
 		/* for each channel */
 		for (ch = 0; ch < 6; ch++)
 		{
@@ -419,6 +541,12 @@ static void CMS_CallBack(Bitu len) {
 		stream++;
 	}
 	if(cms_chan) cms_chan->AddSamples_s16(len,(Bit16s *)MixTemp);
+	//--Added to put the channel to sleep as soon as both chips fall silent: the next write wakes it
+	if (saa1099_silent(0) && saa1099_silent(1)) {
+		if(cms_chan) cms_chan->Enable(false);
+		return;
+	}
+	//--End of modifications
 	if (last_command + 10000 < PIC_Ticks) if(cms_chan) cms_chan->Enable(false);
 }
 
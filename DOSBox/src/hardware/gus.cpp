@@ -302,6 +302,74 @@ public:
 		}
 		UpdateVolumes();
 	}
+	//--Added to generate samples in runs: see generateSamples below.
+	//Returns how many of the next samples the wave (or the ramp) can be stepped through
+	//without reaching its end, along with the step to take each sample.
+	INLINE Bit32u StepsBeforeEnd(Bit8u ctrl,Bit32u pos,Bit32u add,Bit32u start,Bit32u end,Bit32u most,Bit32s & step) {
+		if (ctrl & 0x3) {
+			step=0;
+			return most;
+		}
+		Bit32s room;
+		if (ctrl & 0x40) {
+			step=-(Bit32s)add;
+			room=pos-start;
+		} else {
+			step=add;
+			room=end-pos;
+		}
+		if (room<=0) return 0;
+		if (!add) return most;
+		Bit32u steps=(room-1)/add;
+		return (steps<most) ? steps : most;
+	}
+
+	//Generates a run of samples at a steady volume. The state is kept in locals, since
+	//the compiler would otherwise have to assume writes to the stream could change it.
+	template <bool eightbit,bool interpolate>
+	void SteadyRun(Bit32s * out,Bit32u run,Bit32s wavestep) {
+		Bit32u addr=WaveAddr;
+		Bit32s left=VolLeft;
+		Bit32s right=VolRight;
+		// GetSample only checks whether the delta is below a whole sample
+		Bit32u delta=interpolate ? 0 : (1 << WAVE_FRACT);
+		for (Bit32u n=0;n<run;n++) {
+			Bit32s tmpsamp=GetSample(delta,addr,eightbit);
+			out[n<<1]+=tmpsamp*left;
+			out[(n<<1)+1]+=tmpsamp*right;
+			addr+=wavestep;
+		}
+		WaveAddr=addr;
+	}
+
+	//Generates a run of samples while the volume ramps, looking up the volume for each sample.
+	template <bool eightbit,bool interpolate>
+	void RampingRun(Bit32s * out,Bit32u run,Bit32s wavestep,Bit32s rampstep) {
+		Bit32u addr=WaveAddr;
+		Bit32u vol=RampVol;
+		Bit32s left=VolLeft;
+		Bit32s right=VolRight;
+		Bit32u delta=interpolate ? 0 : (1 << WAVE_FRACT);
+		for (Bit32u n=0;n<run;n++) {
+			Bit32s tmpsamp=GetSample(delta,addr,eightbit);
+			out[n<<1]+=tmpsamp*left;
+			out[(n<<1)+1]+=tmpsamp*right;
+			addr+=wavestep;
+			vol+=rampstep;
+			Bit32s templeft=vol - PanLeft;
+			templeft&=~(templeft >> 31);
+			Bit32s tempright=vol - PanRight;
+			tempright&=~(tempright >> 31);
+			left=vol16bit[templeft >> RAMP_FRACT];
+			right=vol16bit[tempright >> RAMP_FRACT];
+		}
+		WaveAddr=addr;
+		RampVol=vol;
+		VolLeft=left;
+		VolRight=right;
+	}
+	//--End of modifications
+
 	void generateSamples(Bit32s * stream,Bit32u len) {
 		int i;
 		Bit32s tmpsamp;
@@ -309,7 +377,41 @@ public:
 		if (RampCtrl & WaveCtrl & 3) return;
 		eightbit = ((WaveCtrl & 0x4) == 0);
 
-		for(i=0;i<(int)len;i++) {
+		//--Modified to work through runs of samples in which neither the wave nor the volume ramp
+		//reaches its end, so need no checks for looping, stopping or IRQs. Within such a run the
+		//addresses just step along; and when the volume is steady and silent, the run is skipped
+		//altogether. Whenever an end comes up we fall back to a single sample done the old way,
+		//so the results are identical.
+		for(i=0;i<(int)len;) {
+			Bit32s wavestep,rampstep;
+			Bit32u run=StepsBeforeEnd(WaveCtrl,WaveAddr,WaveAdd,WaveStart,WaveEnd,len-i,wavestep);
+			if (run) run=StepsBeforeEnd(RampCtrl,RampVol,RampAdd,RampStart,RampEnd,run,rampstep);
+			if (run) {
+				Bit32s * out=stream+(i<<1);
+				bool interpolate=(WaveAdd < (1 << WAVE_FRACT));
+				if (rampstep) {
+					if (eightbit) {
+						if (interpolate) RampingRun<true,true>(out,run,wavestep,rampstep);
+						else RampingRun<true,false>(out,run,wavestep,rampstep);
+					} else {
+						if (interpolate) RampingRun<false,true>(out,run,wavestep,rampstep);
+						else RampingRun<false,false>(out,run,wavestep,rampstep);
+					}
+				} else if (VolLeft || VolRight) {
+					if (eightbit) {
+						if (interpolate) SteadyRun<true,true>(out,run,wavestep);
+						else SteadyRun<true,false>(out,run,wavestep);
+					} else {
+						if (interpolate) SteadyRun<false,true>(out,run,wavestep);
+						else SteadyRun<false,false>(out,run,wavestep);
+					}
+				} else {
+					WaveAddr+=wavestep*(Bit32s)run;
+				}
+				i+=run;
+				continue;
+			}
+
 			// Get sample
 			tmpsamp = GetSample(WaveAdd, WaveAddr, eightbit);
 			// Output stereo sample
@@ -317,7 +419,9 @@ public:
 			stream[(i<<1)+1]+= tmpsamp * VolRight;
 			WaveUpdate();
 			RampUpdate();
+			i++;
 		}
+		//--End of modifications
 	}
 };
 
@@ -635,6 +739,9 @@ static Bitu read_gus(Bitu port,Bitu iolen) {
 
 static void write_gus(Bitu port,Bitu val,Bitu iolen) {
 //	LOG_MSG("Write gus port %x val %x",port,val);
+	//--Added to wake the channel if it went to sleep while every voice was stopped
+	if (!gus_chan->enabled) gus_chan->Enable(true);
+	//--End of modifications
 	switch(port - GUS_BASE) {
 	case 0x200:
 		myGUS.mixControl = (Bit8u)val;
@@ -762,6 +869,12 @@ static void GUS_CallBack(Bitu len) {
 	}
 	gus_chan->AddSamples_s16(len,buf16);
 	CheckVoiceIrq();
+	//--Added to put the channel to sleep once every voice has stopped both its wave and its
+	//volume ramp: then nothing moves and no IRQs come up until a port write wakes it again
+	for(i=0;i<myGUS.ActiveChannels;i++)
+		if (!(guschan[i]->RampCtrl & guschan[i]->WaveCtrl & 3)) return;
+	gus_chan->Enable(false);
+	//--End of modifications
 }
 
 // Generate logarithmic to linear volume conversion tables
@@ -797,12 +910,17 @@ static void MakeTables(void) {
 	pantable[15] = 1UL << 30UL;
 }
 
+//--Added so that the card is only set up once a program first uses it
+static void GUS_Activate(void);
+//--End of modifications
+
 class GUS:public Module_base{
 private:
 	IO_ReadHandleObject ReadHandler[8];
 	IO_WriteHandleObject WriteHandler[9];
 	AutoexecObject autoexecline[2];
 	MixerObject MixerChan;
+	IO_TrapHandleObject ActivationTrap;	//--Added to set up the card on first use
 public:
 	GUS(Section* configuration):Module_base(configuration){
 		if(!IS_EGAVGA_ARCH) return;
@@ -810,7 +928,10 @@ public:
 		if(!section->Get_bool("gus")) return;
 	
 		memset(&myGUS,0,sizeof(myGUS));
-		memset(GUSRam,0,1024*1024);
+		//--Modified: GUS RAM is only cleared once it has been used, so that an
+		//untouched card doesn't cost a megabyte of memory. See Activate().
+		//memset(GUSRam,0,1024*1024);
+		//--End of modifications
 	
 		myGUS.rate=section->Get_int("gusrate");
 	
@@ -857,16 +978,31 @@ public:
 	
 	//	DmaChannels[myGUS.dma1]->Register_TC_Callback(GUS_DMA_TC_Callback);
 	
+		//--Modified: the voices and tables are set up by Activate() when a program first
+		//touches one of the card's ports. Most games never do, and until then the card
+		//only needs to be visible. The mixer channel is still added here (disabled) so
+		//that its volume can be set with the MIXER command before the card is used.
+		/*
 		MakeTables();
 	
 		for (Bit8u chan_ct=0; chan_ct<32; chan_ct++) {
 			guschan[chan_ct] = new GUSChannels(chan_ct);
 		}
+		*/
 		// Register the Mixer CallBack 
 		gus_chan=MixerChan.Install(GUS_CallBack,GUS_RATE,"GUS");
+		/*
 		myGUS.gRegData=0x1;
 		GUSReset();
 		myGUS.gRegData=0x0;
+		*/
+		adlib_commandreg=85;	// as the reset would have left it
+		ActivationTrap.Install(0x200 + GUS_BASE,&GUS_Activate);
+		ActivationTrap.Install(0x206 + GUS_BASE,&GUS_Activate);
+		ActivationTrap.Install(0x208 + GUS_BASE,&GUS_Activate,4);
+		ActivationTrap.Install(0x302 + GUS_BASE,&GUS_Activate,4);
+		ActivationTrap.Install(0x307 + GUS_BASE,&GUS_Activate);
+		//--End of modifications
 		int portat = 0x200+GUS_BASE;
 
 		// ULTRASND=Port,DMA1,DMA2,IRQ1,IRQ2
@@ -878,29 +1014,100 @@ public:
 		// Create autoexec.bat lines
 		autoexecline[0].Install(temp.str());
 		autoexecline[1].Install(std::string("SET ULTRADIR=") + section->Get_string("ultradir"));
+
+		SAVESTATE_Register("gus",this);	//--Added for save states
 	}
 
+	//--Added to set up the card when a program first touches one of its ports
+	void Activate(void) {
+		MakeTables();
+	
+		for (Bit8u chan_ct=0; chan_ct<32; chan_ct++) {
+			guschan[chan_ct] = new GUSChannels(chan_ct);
+		}
+		// the Sound Blaster may have latched an adlib command since startup: keep it
+		Bit8u commandreg=adlib_commandreg;
+		myGUS.gRegData=0x1;
+		GUSReset();
+		myGUS.gRegData=0x0;
+		adlib_commandreg=commandreg;
+	}
+	//--End of modifications
+
+	//--Added for save states. The DMA callback is restored along with the DMA controllers.
+	//A card that hadn't been used yet when the state was saved is stored as just that.
+	void SaveState(std::ostream& stream) {
+		bool active=ActivationTrap.IsActive();
+		SAVESTATE_Write(stream,active);
+		if (!active) return;
+		SAVESTATE_Write(stream,myGUS);
+		SAVESTATE_Write(stream,GUSRam);
+		SAVESTATE_Write(stream,AutoAmp);
+		for (Bitu i=0;i<32;i++) SAVESTATE_Write(stream,*guschan[i]);
+		Bit8u current=curchan ? curchan->channum : 0xff;
+		SAVESTATE_Write(stream,current);
+		SAVESTATE_Write(stream,gus_chan->enabled);
+	}
+	void LoadState(std::istream& stream) {
+		Bit8u current=0xff;
+		bool enabled=false;
+		bool active=false;
+		SAVESTATE_Read(stream,active);
+		if (!active) {
+			// the card was unused when the state was saved: put it back as it was at startup
+			if (ActivationTrap.IsActive()) {
+				myGUS.gRegData=0x1;
+				GUSReset();
+				myGUS.gRegData=0x0;
+				gus_chan->Enable(false);
+			}
+			return;
+		}
+		ActivationTrap.Activate();
+		SAVESTATE_Read(stream,myGUS);
+		SAVESTATE_Read(stream,GUSRam);
+		SAVESTATE_Read(stream,AutoAmp);
+		for (Bitu i=0;i<32;i++) SAVESTATE_Read(stream,*guschan[i]);
+		SAVESTATE_Read(stream,current);
+		SAVESTATE_Read(stream,enabled);
+		curchan=(current<32) ? guschan[current] : NULL;
+		gus_chan->Enable(enabled);
+	}
+	//--End of modifications
+
 
 	~GUS() {
+		SAVESTATE_Unregister(this);	//--Added for save states
 		if(!IS_EGAVGA_ARCH) return;
 		Section_prop * section=static_cast<Section_prop *>(m_configuration);
 		if(!section->Get_bool("gus")) return;
 	
-		myGUS.gRegData=0x1;
-		GUSReset();
-		myGUS.gRegData=0x0;
+		//--Modified: there's nothing to tear down if the card was never used
+		if (ActivationTrap.IsActive()) {
+			myGUS.gRegData=0x1;
+			GUSReset();
+			myGUS.gRegData=0x0;
 	
-		for(Bitu i=0;i<32;i++) {
-			delete guschan[i];
+			for(Bitu i=0;i<32;i++) {
+				delete guschan[i];
+				guschan[i]=0;
+			}
+			memset(GUSRam,0,1024*1024);
 		}
+		//--End of modifications
 
 		memset(&myGUS,0,sizeof(myGUS));
-		memset(GUSRam,0,1024*1024);
 		}
 };
 
 static GUS* test;
 
+//--Added so that the card is only set up once a program first uses it
+static void GUS_Activate(void) {
+	if (test) test->Activate();
+}
+//--End of modifications
+
 void GUS_ShutDown(Section* /*sec*/) {
 	delete test;	
 }
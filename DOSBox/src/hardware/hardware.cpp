@@ -30,9 +30,13 @@
 #include "pic.h"
 #include "render.h"
 #include "cross.h"
+//--Added to write captures from a background queue
+#include "capture_writer.h"
+//--End of modifications
 
 #if (C_SSHOT)
 #import <libpng/png.h>
+#include <dispatch/dispatch.h>
 
 #include "../libs/zmbv/zmbv.cpp"
 #endif
@@ -47,14 +51,20 @@ Bitu CaptureState;
 
 static struct {
 	struct {
-		FILE * handle;
+		//--Modified to write captures from a background queue, and to encode wave output losslessly
+		CaptureWriter * handle;
+		CaptureAudioFormat format;
+		bool encoded;
+		//--End of modifications
 		Bit16s buf[WAVE_BUF][2];
 		Bitu used;
 		Bit32u length;
 		Bit32u freq;
 	} wave; 
 	struct {
-		FILE * handle;
+		//--Modified to write captures from a background queue
+		CaptureWriter * handle;
+		//--End of modifications
 		Bit8u buffer[MIDI_BUF];
 		Bitu used,done;
 		Bit32u last;
@@ -71,6 +81,7 @@ static struct {
 		Bitu		audiorate;
 		Bitu		audiowritten;
 		VideoCodec	*codec;
+		dispatch_queue_t	queue;
 		Bitu		width, height, bpp;
 		Bitu		written;
 		float		fps;
@@ -303,6 +314,13 @@ static void CAPTURE_VideoEvent(bool pressed) {
 		CaptureState &= ~CAPTURE_VIDEO;
 		LOG_MSG("Stopped capturing video.");	
 
+		/* Wait for the last frame to finish compressing */
+		if (capture.video.queue) {
+			dispatch_sync(capture.video.queue, ^{});
+			dispatch_release(capture.video.queue);
+			capture.video.queue = 0;
+		}
+
 		/* Adds AVI header to the file */
 		CAPTURE_VideoHeader();
 
@@ -483,6 +501,7 @@ skip_shot:
 			capture.video.handle = OpenCaptureFile("Video",".avi");
 			if (!capture.video.handle)
 				goto skip_video;
+			capture.video.queue = dispatch_queue_create("com.dosbox.videoCapture", NULL);
 			capture.video.codec = new VideoCodec();
 			if (!capture.video.codec)
 				goto skip_video;
@@ -513,6 +532,8 @@ skip_shot:
 		if (capture.video.frames % 300 == 0)
 			codecFlags = 1;
 		else codecFlags = 0;
+		/* The codec can't take a new frame until it has finished compressing the previous one */
+		dispatch_sync(capture.video.queue, ^{});
 		if (!capture.video.codec->PrepareCompressFrame( codecFlags, format, (char *)pal, capture.video.buf, capture.video.bufSize))
 			goto skip_video;
 
@@ -553,20 +574,37 @@ skip_shot:
 			}
 			capture.video.codec->CompressLines( 1, &rowPointer );
 		}
-		int written = capture.video.codec->FinishCompressFrame();
-		if (written < 0)
-			goto skip_video;
-		CAPTURE_AddAviChunk( "00dc", written, capture.video.buf, codecFlags & 1 ? 0x10 : 0x0);
 		capture.video.frames++;
-//		LOG_MSG("Frame %d video %d audio %d",capture.video.frames, written, capture.video.audioused *4 );
-		if ( capture.video.audioused ) {
-			CAPTURE_AddAviChunk( "01wb", capture.video.audioused * 4, capture.video.audiobuf, 0);
-			capture.video.audiowritten = capture.video.audioused*4;
+
+		//--Modified to compress and write frames on a background queue
+		/* Take a copy of the audio mixed during this frame, as the mixer will carry on filling the buffer */
+		Bit32u audioSize = capture.video.audioused * 4;
+		void *audioData = 0;
+		if (audioSize) {
+			audioData = malloc(audioSize);
+			if (audioData)
+				memcpy(audioData, capture.video.audiobuf, audioSize);
 			capture.video.audioused = 0;
 		}
 
-		/* Adds AVI header to the file */
-		CAPTURE_VideoHeader();
+		/* Motion search, deflate and writing to disk happen on the capture queue, so that
+		   emulation can carry on with the next frame in the meantime */
+		Bit32u chunkFlags = codecFlags & 1 ? 0x10 : 0x0;
+		dispatch_async(capture.video.queue, ^{
+			int written = capture.video.codec->FinishCompressFrame();
+			if (written >= 0)
+				CAPTURE_AddAviChunk( "00dc", written, capture.video.buf, chunkFlags);
+//			LOG_MSG("Frame %d video %d audio %d",capture.video.frames, written, audioSize );
+			if (audioData) {
+				CAPTURE_AddAviChunk( "01wb", audioSize, audioData, 0);
+				capture.video.audiowritten = audioSize;
+				free(audioData);
+			}
+
+			/* Adds AVI header to the file */
+			CAPTURE_VideoHeader();
+		});
+		//--End of modifications
 
 		/* Everything went okay, set flag again for next frame */
 		CaptureState |= CAPTURE_VIDEO;
@@ -609,21 +647,35 @@ void CAPTURE_AddWave(Bit32u freq, Bit32u len, Bit16s * data) {
 #endif
 	if (CaptureState & CAPTURE_WAVE) {
 		if (!capture.wave.handle) {
-			capture.wave.handle=OpenCaptureFile("Wave Output",".wav");
-			if (!capture.wave.handle) {
+			//--Modified to write captures from a background queue, and to encode wave output
+			//losslessly if the host can
+			CaptureAudioFormat format = capture.wave.format;
+			if (!CaptureWriter::CanEncodeAudio(format)) format = CAPTURE_AUDIO_WAV;
+			FILE * file=OpenCaptureFile("Wave Output",CaptureWriter::AudioExtension(format));
+			if (!file) {
+				CaptureState &= ~CAPTURE_WAVE;
+				return;
+			}
+			capture.wave.handle = new CaptureWriter(file);
+			capture.wave.encoded = (format != CAPTURE_AUDIO_WAV);
+			if (capture.wave.encoded && !capture.wave.handle->EncodeAudio(format,freq)) {
+				LOG_MSG("Encoding the wave output has failed.");
+				capture.wave.handle->Close();
+				capture.wave.handle = 0;
 				CaptureState &= ~CAPTURE_WAVE;
 				return;
 			}
 			capture.wave.length = 0;
 			capture.wave.used = 0;
 			capture.wave.freq = freq;
-			fwrite(wavheader,1,sizeof(wavheader),capture.wave.handle);
+			if (!capture.wave.encoded) capture.wave.handle->Write(wavheader,sizeof(wavheader));
+			//--End of modifications
 		}
 		Bit16s * read = data;
 		while (len > 0 ) {
 			Bitu left = WAVE_BUF - capture.wave.used;
 			if (!left) {
-				fwrite(capture.wave.buf,1,4*WAVE_BUF,capture.wave.handle);
+				capture.wave.handle->Write(capture.wave.buf,4*WAVE_BUF);	//--Modified to write from a background queue
 				capture.wave.length += 4*WAVE_BUF;
 				capture.wave.used = 0;
 				left = WAVE_BUF;
@@ -643,19 +695,21 @@ static void CAPTURE_WaveEvent(bool pressed) {
 	/* Check for previously opened wave file */
 	if (capture.wave.handle) {
 		LOG_MSG("Stopped capturing wave output.");
+		//--Modified to write from a background queue: encoded output needs no header
 		/* Write last piece of audio in buffer */
-		fwrite(capture.wave.buf,1,capture.wave.used*4,capture.wave.handle);
+		capture.wave.handle->Write(capture.wave.buf,capture.wave.used*4);
 		capture.wave.length+=capture.wave.used*4;
-		/* Fill in the header with useful information */
-		host_writed(&wavheader[0x04],capture.wave.length+sizeof(wavheader)-8);
-		host_writed(&wavheader[0x18],capture.wave.freq);
-		host_writed(&wavheader[0x1C],capture.wave.freq*4);
-		host_writed(&wavheader[0x28],capture.wave.length);
-		
-		fseek(capture.wave.handle,0,0);
-		fwrite(wavheader,1,sizeof(wavheader),capture.wave.handle);
-		fclose(capture.wave.handle);
+		if (!capture.wave.encoded) {
+			/* Fill in the header with useful information */
+			host_writed(&wavheader[0x04],capture.wave.length+sizeof(wavheader)-8);
+			host_writed(&wavheader[0x18],capture.wave.freq);
+			host_writed(&wavheader[0x1C],capture.wave.freq*4);
+			host_writed(&wavheader[0x28],capture.wave.length);
+			capture.wave.handle->WriteAt(0,wavheader,sizeof(wavheader));
+		}
+		capture.wave.handle->Close();
 		capture.wave.handle=0;
+		//--End of modifications
 		CaptureState |= CAPTURE_WAVE;
 	} 
 	CaptureState ^= CAPTURE_WAVE;
@@ -679,7 +733,7 @@ static void RawMidiAdd(Bit8u data) {
 	capture.midi.buffer[capture.midi.used++]=data;
 	if (capture.midi.used >= MIDI_BUF ) {
 		capture.midi.done += capture.midi.used;
-		fwrite(capture.midi.buffer,1,MIDI_BUF,capture.midi.handle);
+		capture.midi.handle->Write(capture.midi.buffer,MIDI_BUF);	//--Modified to write from a background queue
 		capture.midi.used = 0;
 	}
 }
@@ -693,11 +747,14 @@ static void RawMidiAddNumber(Bit32u val) {
 
 void CAPTURE_AddMidi(bool sysex, Bitu len, Bit8u * data) {
 	if (!capture.midi.handle) {
-		capture.midi.handle=OpenCaptureFile("Raw Midi",".mid");
-		if (!capture.midi.handle) {
+		//--Modified to write from a background queue
+		FILE * file=OpenCaptureFile("Raw Midi",".mid");
+		if (!file) {
 			return;
 		}
-		fwrite(midi_header,1,sizeof(midi_header),capture.midi.handle);
+		capture.midi.handle=new CaptureWriter(file);
+		capture.midi.handle->Write(midi_header,sizeof(midi_header));
+		//--End of modifications
 		capture.midi.last=PIC_Ticks;
 	}
 	Bit32u delta=PIC_Ticks-capture.midi.last;
@@ -723,17 +780,18 @@ static void CAPTURE_MidiEvent(bool pressed) {
 		RawMidiAdd(0xff);
 		RawMidiAdd(0x2F);
 		RawMidiAdd(0x00);
+		//--Modified to write from a background queue
 		/* clear out the final data in the buffer if any */
-		fwrite(capture.midi.buffer,1,capture.midi.used,capture.midi.handle);
+		capture.midi.handle->Write(capture.midi.buffer,capture.midi.used);
 		capture.midi.done+=capture.midi.used;
-		fseek(capture.midi.handle,18, SEEK_SET);
 		Bit8u size[4];
 		size[0]=(Bit8u)(capture.midi.done >> 24);
 		size[1]=(Bit8u)(capture.midi.done >> 16);
 		size[2]=(Bit8u)(capture.midi.done >> 8);
 		size[3]=(Bit8u)(capture.midi.done >> 0);
-		fwrite(&size,1,4,capture.midi.handle);
-		fclose(capture.midi.handle);
+		capture.midi.handle->WriteAt(18,&size,4);
+		capture.midi.handle->Close();
+		//--End of modifications
 		capture.midi.handle=0;
 		CaptureState &= ~CAPTURE_MIDI;
 		return;
@@ -756,6 +814,12 @@ public:
 		Prop_path* proppath= section->Get_path("captures");
 		capturedir = proppath->realpath;
 		CaptureState = 0;
+		//--Added to encode wave output losslessly
+		std::string waveformat = section->Get_string("capturewave");
+		if (waveformat == "alac") capture.wave.format = CAPTURE_AUDIO_ALAC;
+		else if (waveformat == "flac") capture.wave.format = CAPTURE_AUDIO_FLAC;
+		else capture.wave.format = CAPTURE_AUDIO_WAV;
+		//--End of modifications
 		MAPPER_AddHandler(CAPTURE_WaveEvent,MK_f6,MMOD1,"recwave","Rec Wave");
 		MAPPER_AddHandler(CAPTURE_MidiEvent,MK_f8,MMOD1|MMOD2,"caprawmidi","Cap MIDI");
 #if (C_SSHOT)
@@ -766,6 +830,9 @@ public:
 	~HARDWARE(){
 		if (capture.wave.handle) CAPTURE_WaveEvent(true);
 		if (capture.midi.handle) CAPTURE_MidiEvent(true);
+		//--Added to finish writing the captures before shutting down
+		CaptureWriter::FinishAll();
+		//--End of modifications
 	}
 };
 
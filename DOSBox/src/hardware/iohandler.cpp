@@ -19,6 +19,7 @@
 /* $Id: iohandler.cpp,v 1.30 2009-05-27 09:15:41 qbix79 Exp $ */
 
 #include <string.h>
+#include <stdlib.h>
 #include "dosbox.h"
 #include "inout.h"
 #include "setup.h"
@@ -29,11 +30,51 @@
 //--End of modifications
 
 #include "callback.h"
+//--Added to let the profiler and performance counters attribute time to IO handlers
+#include "profiler.h"
+#include "perfcounters.h"
+//--End of modifications
 
 //#define ENABLE_PORTLOG
 
-IO_WriteHandler * io_writehandlers[3][IO_MAX];
-IO_ReadHandler * io_readhandlers[3][IO_MAX];
+//--Modified to keep the handlers in pages of 256 ports, with each port's handlers for all three
+//widths side by side. Pages with no handlers installed share a single page of defaults, so the
+//table takes a few dozen kilobytes instead of several megabytes and the ports in use stay in cache.
+//IO_WriteHandler * io_writehandlers[3][IO_MAX];
+//IO_ReadHandler * io_readhandlers[3][IO_MAX];
+#define IO_PAGE_SHIFT	8
+#define IO_PAGE_SIZE	(1 << IO_PAGE_SHIFT)
+#define IO_PAGE_MASK	(IO_PAGE_SIZE-1)
+#define IO_PAGES		((IO_MAX+IO_PAGE_MASK) >> IO_PAGE_SHIFT)
+
+struct IO_PortHandlers {
+	IO_ReadHandler * read[3];
+	IO_WriteHandler * write[3];
+};
+
+static IO_PortHandlers io_defaultpage[IO_PAGE_SIZE];
+static IO_PortHandlers * io_pages[IO_PAGES];
+
+static INLINE IO_PortHandlers * IO_Port(Bitu port) {
+	return &io_pages[port >> IO_PAGE_SHIFT][port & IO_PAGE_MASK];
+}
+
+/* Returns a port's handlers for changing, first giving its page its own copy of the defaults
+ * if it was still sharing them. */
+static IO_PortHandlers * IO_WritablePort(Bitu port) {
+	IO_PortHandlers * & page=io_pages[port >> IO_PAGE_SHIFT];
+	if (!page || page==io_defaultpage) {
+		page=(IO_PortHandlers *)malloc(sizeof(io_defaultpage));
+		if (!page) E_Exit("Can't allocate IO handlers for port %x",port);
+		memcpy(page,io_defaultpage,sizeof(io_defaultpage));
+	}
+	return &page[port & IO_PAGE_MASK];
+}
+
+static INLINE Bitu IO_WidthIndex(Bitu iolen) {
+	return (iolen==4) ? 2 : ((iolen==2) ? 1 : 0);
+}
+//--End of modifications
 
 static Bitu IO_ReadBlocked(Bitu /*port*/,Bitu /*iolen*/) {
 	return ~0;
@@ -46,16 +87,16 @@ static Bitu IO_ReadDefault(Bitu port,Bitu iolen) {
 	switch (iolen) {
 	case 1:
 		LOG(LOG_IO,LOG_WARN)("Read from port %04X",port);
-		io_readhandlers[0][port]=IO_ReadBlocked;
+		IO_WritablePort(port)->read[0]=IO_ReadBlocked;
 		return 0xff;
 	case 2:
 		return 
-			(io_readhandlers[0][port+0](port+0,1) << 0) |
-			(io_readhandlers[0][port+1](port+1,1) << 8);
+			(IO_Port(port+0)->read[0](port+0,1) << 0) |
+			(IO_Port(port+1)->read[0](port+1,1) << 8);
 	case 4:
 		return
-			(io_readhandlers[1][port+0](port+0,2) << 0) |
-			(io_readhandlers[1][port+2](port+2,2) << 16);
+			(IO_Port(port+0)->read[1](port+0,2) << 0) |
+			(IO_Port(port+2)->read[1](port+2,2) << 16);
 	}
 	return 0;
 }
@@ -64,51 +105,55 @@ void IO_WriteDefault(Bitu port,Bitu val,Bitu iolen) {
 	switch (iolen) {
 	case 1:
 		LOG(LOG_IO,LOG_WARN)("Writing %02X to port %04X",val,port);		
-		io_writehandlers[0][port]=IO_WriteBlocked;
+		IO_WritablePort(port)->write[0]=IO_WriteBlocked;
 		break;
 	case 2:
-		io_writehandlers[0][port+0](port+0,(val >> 0) & 0xff,1);
-		io_writehandlers[0][port+1](port+1,(val >> 8) & 0xff,1);
+		IO_Port(port+0)->write[0](port+0,(val >> 0) & 0xff,1);
+		IO_Port(port+1)->write[0](port+1,(val >> 8) & 0xff,1);
 		break;
 	case 4:
-		io_writehandlers[1][port+0](port+0,(val >> 0 ) & 0xffff,2);
-		io_writehandlers[1][port+2](port+2,(val >> 16) & 0xffff,2);
+		IO_Port(port+0)->write[1](port+0,(val >> 0 ) & 0xffff,2);
+		IO_Port(port+2)->write[1](port+2,(val >> 16) & 0xffff,2);
 		break;
 	}
 }
 
 void IO_RegisterReadHandler(Bitu port,IO_ReadHandler * handler,Bitu mask,Bitu range) {
 	while (range--) {
-		if (mask&IO_MB) io_readhandlers[0][port]=handler;
-		if (mask&IO_MW) io_readhandlers[1][port]=handler;
-		if (mask&IO_MD) io_readhandlers[2][port]=handler;
+		IO_PortHandlers * handlers=IO_WritablePort(port);
+		if (mask&IO_MB) handlers->read[0]=handler;
+		if (mask&IO_MW) handlers->read[1]=handler;
+		if (mask&IO_MD) handlers->read[2]=handler;
 		port++;
 	}
 }
 
 void IO_RegisterWriteHandler(Bitu port,IO_WriteHandler * handler,Bitu mask,Bitu range) {
 	while (range--) {
-		if (mask&IO_MB) io_writehandlers[0][port]=handler;
-		if (mask&IO_MW) io_writehandlers[1][port]=handler;
-		if (mask&IO_MD) io_writehandlers[2][port]=handler;
+		IO_PortHandlers * handlers=IO_WritablePort(port);
+		if (mask&IO_MB) handlers->write[0]=handler;
+		if (mask&IO_MW) handlers->write[1]=handler;
+		if (mask&IO_MD) handlers->write[2]=handler;
 		port++;
 	}
 }
 
 void IO_FreeReadHandler(Bitu port,Bitu mask,Bitu range) {
 	while (range--) {
-		if (mask&IO_MB) io_readhandlers[0][port]=IO_ReadDefault;
-		if (mask&IO_MW) io_readhandlers[1][port]=IO_ReadDefault;
-		if (mask&IO_MD) io_readhandlers[2][port]=IO_ReadDefault;
+		IO_PortHandlers * handlers=IO_WritablePort(port);
+		if (mask&IO_MB) handlers->read[0]=IO_ReadDefault;
+		if (mask&IO_MW) handlers->read[1]=IO_ReadDefault;
+		if (mask&IO_MD) handlers->read[2]=IO_ReadDefault;
 		port++;
 	}
 }
 
 void IO_FreeWriteHandler(Bitu port,Bitu mask,Bitu range) {
 	while (range--) {
-		if (mask&IO_MB) io_writehandlers[0][port]=IO_WriteDefault;
-		if (mask&IO_MW) io_writehandlers[1][port]=IO_WriteDefault;
-		if (mask&IO_MD) io_writehandlers[2][port]=IO_WriteDefault;
+		IO_PortHandlers * handlers=IO_WritablePort(port);
+		if (mask&IO_MB) handlers->write[0]=IO_WriteDefault;
+		if (mask&IO_MW) handlers->write[1]=IO_WriteDefault;
+		if (mask&IO_MD) handlers->write[2]=IO_WriteDefault;
 		port++;
 	}
 }
@@ -144,6 +189,102 @@ IO_WriteHandleObject::~IO_WriteHandleObject(){
 	//LOG_MSG("FreeWritehandler called with port %X",m_port);
 }
 
+//--Added so that devices can put off their setup until a program first uses them
+struct IO_TrappedPort {
+	Bitu port;
+	IO_ReadHandler * read[3];
+	IO_WriteHandler * write[3];
+};
+
+static IO_TrapHandleObject * io_traps=0;
+
+static Bitu IO_ReadTrapped(Bitu port,Bitu iolen) {
+	IO_TrapHandleObject * trap=IO_TrapHandleObject::Find(port);
+	if (trap) trap->Activate();
+	else IO_FreeReadHandler(port,IO_MA);
+	return IO_Port(port)->read[IO_WidthIndex(iolen)](port,iolen);
+}
+
+static void IO_WriteTrapped(Bitu port,Bitu val,Bitu iolen) {
+	IO_TrapHandleObject * trap=IO_TrapHandleObject::Find(port);
+	if (trap) trap->Activate();
+	else IO_FreeWriteHandler(port,IO_MA);
+	IO_Port(port)->write[IO_WidthIndex(iolen)](port,val,iolen);
+}
+
+IO_TrapHandleObject * IO_TrapHandleObject::Find(Bitu port) {
+	for (IO_TrapHandleObject * trap=io_traps;trap;trap=trap->next) {
+		for (Bitu i=0;i<trap->count;i++) {
+			if (trap->trapped[i].port==port) return trap;
+		}
+	}
+	return 0;
+}
+
+void IO_TrapHandleObject::Install(Bitu port,IO_ActivationHandler * handler,Bitu range) {
+	if (active) E_Exit("IO trap installed after activation at port %x",port);
+	if (!trapped) {
+		next=io_traps;
+		io_traps=this;
+	}
+	activate=handler;
+	trapped=(IO_TrappedPort *)realloc(trapped,(count+range)*sizeof(IO_TrappedPort));
+	if (!trapped) E_Exit("Can't allocate IO trap for port %x",port);
+	while (range--) {
+		IO_TrappedPort * entry=&trapped[count++];
+		IO_PortHandlers * handlers=IO_Port(port);
+		entry->port=port;
+		for (Bitu i=0;i<3;i++) {
+			entry->read[i]=handlers->read[i];
+			entry->write[i]=handlers->write[i];
+		}
+		IO_RegisterReadHandler(port,IO_ReadTrapped,IO_MA);
+		IO_RegisterWriteHandler(port,IO_WriteTrapped,IO_MA);
+		port++;
+	}
+}
+
+/* Take the trap off its ports, either putting the device's handlers back or leaving
+ * the ports free. Ports that were given other handlers since are left alone. */
+void IO_TrapHandleObject::Uncover(bool restore) {
+	if (!trapped) return;
+	for (Bitu i=0;i<count;i++) {
+		IO_TrappedPort * entry=&trapped[i];
+		IO_PortHandlers * handlers=IO_WritablePort(entry->port);
+		for (Bitu w=0;w<3;w++) {
+			if (handlers->read[w]==IO_ReadTrapped)
+				handlers->read[w]=restore ? entry->read[w] : IO_ReadDefault;
+			if (handlers->write[w]==IO_WriteTrapped)
+				handlers->write[w]=restore ? entry->write[w] : IO_WriteDefault;
+		}
+	}
+	free(trapped);
+	trapped=0;
+	count=0;
+
+	IO_TrapHandleObject * * where=&io_traps;
+	while (*where) {
+		if (*where==this) {
+			*where=next;
+			break;
+		}
+		where=&(*where)->next;
+	}
+	next=0;
+}
+
+void IO_TrapHandleObject::Activate(void) {
+	if (active) return;
+	Uncover(true);
+	active=true;
+	if (activate) activate();
+}
+
+IO_TrapHandleObject::~IO_TrapHandleObject() {
+	Uncover(false);
+}
+//--End of modifications
+
 struct IOF_Entry {
 	Bitu cs;
 	Bitu eip;
@@ -312,8 +453,12 @@ void IO_WriteB(Bitu port,Bitu val) {
 		cpudecoder=old_cpudecoder;
 	}
 	else {
+		//--Modified to let the profiler and performance counters attribute time to IO handlers
+		ProfilerContextScope profiling(PROFILER_IO);
+		PerfScope perf(PERF_IO);
+		//--End of modifications
 		IO_USEC_write_delay();
-		io_writehandlers[0][port](port,val,1);
+		IO_Port(port)->write[0](port,val,1);
 	}
 }
 
@@ -348,8 +493,12 @@ void IO_WriteW(Bitu port,Bitu val) {
 		cpudecoder=old_cpudecoder;
 	}
 	else {
+		//--Modified to let the profiler and performance counters attribute time to IO handlers
+		ProfilerContextScope profiling(PROFILER_IO);
+		PerfScope perf(PERF_IO);
+		//--End of modifications
 		IO_USEC_write_delay();
-		io_writehandlers[1][port](port,val,2);
+		IO_Port(port)->write[1](port,val,2);
 	}
 }
 
@@ -383,7 +532,13 @@ void IO_WriteD(Bitu port,Bitu val) {
 		memcpy(&lflags,&old_lflags,sizeof(LazyFlags));
 		cpudecoder=old_cpudecoder;
 	}
-	else io_writehandlers[2][port](port,val,4);
+	else {
+		//--Modified to let the profiler and performance counters attribute time to IO handlers
+		ProfilerContextScope profiling(PROFILER_IO);
+		PerfScope perf(PERF_IO);
+		//--End of modifications
+		IO_Port(port)->write[2](port,val,4);
+	}
 }
 
 Bitu IO_ReadB(Bitu port) {
@@ -416,8 +571,12 @@ Bitu IO_ReadB(Bitu port) {
 		return retval;
 	}
 	else {
+		//--Modified to let the profiler and performance counters attribute time to IO handlers
+		ProfilerContextScope profiling(PROFILER_IO);
+		PerfScope perf(PERF_IO);
+		//--End of modifications
 		IO_USEC_read_delay();
-		retval = io_readhandlers[0][port](port,1);
+		retval = IO_Port(port)->read[0](port,1);
 	}
 	log_io(0, false, port, retval);
 	return retval;
@@ -452,8 +611,12 @@ Bitu IO_ReadW(Bitu port) {
 		cpudecoder=old_cpudecoder;
 	}
 	else {
+		//--Modified to let the profiler and performance counters attribute time to IO handlers
+		ProfilerContextScope profiling(PROFILER_IO);
+		PerfScope perf(PERF_IO);
+		//--End of modifications
 		IO_USEC_read_delay();
-		retval = io_readhandlers[1][port](port,2);
+		retval = IO_Port(port)->read[1](port,2);
 	}
 	log_io(1, false, port, retval);
 	return retval;
@@ -487,7 +650,11 @@ Bitu IO_ReadD(Bitu port) {
 		memcpy(&lflags,&old_lflags,sizeof(LazyFlags));
 		cpudecoder=old_cpudecoder;
 	} else {
-		retval = io_readhandlers[2][port](port,4);
+		//--Modified to let the profiler and performance counters attribute time to IO handlers
+		ProfilerContextScope profiling(PROFILER_IO);
+		PerfScope perf(PERF_IO);
+		//--End of modifications
+		retval = IO_Port(port)->read[2](port,4);
 	}
 	log_io(2, false, port, retval);
 	return retval;
@@ -497,8 +664,20 @@ class IO :public Module_base {
 public:
 	IO(Section* configuration):Module_base(configuration){
 	iof_queue.used=0;
-	IO_FreeReadHandler(0,IO_MA,IO_MAX);
-	IO_FreeWriteHandler(0,IO_MA,IO_MAX);
+	//--Modified to start every page off sharing the defaults
+	//IO_FreeReadHandler(0,IO_MA,IO_MAX);
+	//IO_FreeWriteHandler(0,IO_MA,IO_MAX);
+	for (Bitu i=0;i<IO_PAGE_SIZE;i++) {
+		for (Bitu w=0;w<3;w++) {
+			io_defaultpage[i].read[w]=IO_ReadDefault;
+			io_defaultpage[i].write[w]=IO_WriteDefault;
+		}
+	}
+	for (Bitu i=0;i<IO_PAGES;i++) {
+		if (io_pages[i] && io_pages[i]!=io_defaultpage) free(io_pages[i]);
+		io_pages[i]=io_defaultpage;
+	}
+	//--End of modifications
 	}
 	~IO()
 	{
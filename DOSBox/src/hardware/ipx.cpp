@@ -42,6 +42,17 @@
 #include "programs.h"
 #include "pic.h"
 
+//--Added for the local transport between sessions on the same host
+#if !defined(WIN32)
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+//--End of modifications
+
 #define SOCKTABLESIZE	150 // DOS IPX driver was limited to 150 open sockets
 
 struct ipxnetaddr {
@@ -126,8 +137,14 @@ ECBClass::ECBClass(Bit16u segment, Bit16u offset) {
 	mysocket = getSocket();
 }
 void ECBClass::writeDataBuffer(Bit8u* buffer, Bit16u length) {
+	//--Modified to copy into the ECB's own storage rather than a newly-allocated buffer
+	/*
 	if(databuffer!=0) delete [] databuffer;
 	databuffer = new Bit8u[length];
+	*/
+	if(length > IPXBUFFERSIZE) length = IPXBUFFERSIZE;
+	databuffer = datastorage;
+	//--End of modifications
 	memcpy(databuffer,buffer,length);
 	buflen=length;
 
@@ -257,9 +274,30 @@ ECBClass::~ECBClass() {
 			if(nextECB != NULL) nextECB->prevECB = prevECB;
 		}
 	}
-	if(databuffer!=0) delete [] databuffer;
+	//--Disabled now that received data is kept in the ECB itself
+	//if(databuffer!=0) delete [] databuffer;
+	//--End of modifications
+}
+
+//--Added to recycle ECBs. Freed ECBs are chained together through their own memory.
+static void * ECBFreeList = NULL;
+
+void * ECBClass::operator new(size_t size) {
+	if (ECBFreeList && size == sizeof(ECBClass)) {
+		void * ecb = ECBFreeList;
+		ECBFreeList = *(void **)ecb;
+		return ecb;
+	}
+	return ::operator new(size);
 }
 
+void ECBClass::operator delete(void * ptr) {
+	if (!ptr) return;
+	*(void **)ptr = ECBFreeList;
+	ECBFreeList = ptr;
+}
+//--End of modifications
+
 
 
 static bool sockInUse(Bit16u sockNum) {
@@ -598,6 +636,191 @@ static void receivePacket(Bit8u *buffer, Bit16s bufSize) {
 	LOG_IPX("IPX: RX Packet loss!");
 }
 
+//--Added to pass packets between sessions on the same host through shared memory.
+//Sessions connected to the same server find each other through a shared memory segment
+//named after the server's address, in which each takes a slot for its IPX node address.
+//Packets for a node with a slot are written straight into a ring in that slot, one ring
+//per sender so that each has only one writer; broadcasts are written into every other
+//slot and still go to the server for the benefit of other hosts. Packets that the server
+//relays from a node with a slot have already arrived this way, so they are dropped.
+//Ping packets (socket 2) always go through the server, so IPXNET PING still sees everyone.
+#if !defined(WIN32)
+
+#define IPX_LOCAL_VERSION	1
+#define IPX_LOCAL_NODES		8
+#define IPX_LOCAL_RINGSIZE	32	// packets
+
+struct IPXLocalRing {
+	volatile Bit32u head;		// written by the sender
+	volatile Bit32u tail;		// written by the receiver
+	Bit16u sizes[IPX_LOCAL_RINGSIZE];
+	Bit8u packets[IPX_LOCAL_RINGSIZE][IPXBUFFERSIZE];
+};
+
+struct IPXLocalNode {
+	volatile Bit32u pid;		// of the session that has claimed the slot, or 0 if free
+	volatile Bit32u live;		// whether netnode can be relied on yet
+	Bit8u netnode[6];
+	IPXLocalRing from[IPX_LOCAL_NODES];	// packets for this node, by sender
+};
+
+struct IPXLocalSegment {
+	volatile Bit32u version;
+	IPXLocalNode nodes[IPX_LOCAL_NODES];
+};
+
+static IPXLocalSegment * localSegment = 0;
+static char localSegmentName[32];
+static Bits localSlot = -1;
+
+static bool IPX_LocalNodeIsLive(Bitu slot) {
+	IPXLocalNode * node = &localSegment->nodes[slot];
+	Bit32u pid = node->pid;
+	if(!pid || !node->live) return false;
+	// reclaim the slots of sessions that went away without letting go of them
+	if(kill((pid_t)pid, 0) != 0 && errno == ESRCH) {
+		node->live = 0;
+		__sync_bool_compare_and_swap(&node->pid, pid, 0);
+		return false;
+	}
+	return true;
+}
+
+static Bits IPX_LocalFindNode(const Bit8u * netnode) {
+	for(Bitu i = 0; i < IPX_LOCAL_NODES; i++) {
+		if((Bits)i == localSlot) continue;
+		if(IPX_LocalNodeIsLive(i) && !memcmp(localSegment->nodes[i].netnode, netnode, 6)) return i;
+	}
+	return -1;
+}
+
+static void IPX_LocalJoin(void) {
+	// the segment is shared by everyone connected to the same server
+	sprintf(localSegmentName, "/dosbox-ipx-%08x-%u", ipxServConnIp.host, SDLNet_Read16(&ipxServConnIp.port));
+	int fd = shm_open(localSegmentName, O_RDWR | O_CREAT, 0600);
+	if(fd < 0) return;
+
+	struct stat info;
+	if(fstat(fd, &info) != 0 ||
+		(info.st_size == 0 && ftruncate(fd, sizeof(IPXLocalSegment)) != 0) ||
+		(info.st_size != 0 && info.st_size != (off_t)sizeof(IPXLocalSegment))) {
+		close(fd);
+		return;
+	}
+	void * mapping = mmap(0, sizeof(IPXLocalSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if(mapping == MAP_FAILED) return;
+
+	IPXLocalSegment * segment = (IPXLocalSegment *)mapping;
+	__sync_bool_compare_and_swap(&segment->version, 0, IPX_LOCAL_VERSION);
+	if(segment->version != IPX_LOCAL_VERSION) {
+		munmap(mapping, sizeof(IPXLocalSegment));
+		return;
+	}
+	localSegment = segment;
+
+	Bit32u pid = (Bit32u)getpid();
+	for(Bitu i = 0; i < IPX_LOCAL_NODES; i++) {
+		IPXLocalNode * node = &localSegment->nodes[i];
+		if(node->pid) IPX_LocalNodeIsLive(i);
+		if(!__sync_bool_compare_and_swap(&node->pid, 0, pid)) continue;
+
+		// anything left over from the last session in this slot isn't for us
+		for(Bitu s = 0; s < IPX_LOCAL_NODES; s++) node->from[s].tail = node->from[s].head;
+		memcpy(node->netnode, localIpxAddr.netnode, sizeof(node->netnode));
+		__sync_synchronize();
+		node->live = 1;
+		localSlot = i;
+		LOG_MSG("IPX: Sessions on this computer will be reached directly");
+		return;
+	}
+	// every slot is taken: carry on through the server
+	munmap(localSegment, sizeof(IPXLocalSegment));
+	localSegment = 0;
+}
+
+static void IPX_LocalLeave(void) {
+	if(!localSegment) return;
+	IPXLocalNode * node = &localSegment->nodes[localSlot];
+	node->live = 0;
+	__sync_synchronize();
+	node->pid = 0;
+
+	bool inUse = false;
+	for(Bitu i = 0; i < IPX_LOCAL_NODES; i++) {
+		if(IPX_LocalNodeIsLive(i)) inUse = true;
+	}
+	// later sessions will make a new one: anyone still on this one falls back to the server
+	if(!inUse) shm_unlink(localSegmentName);
+
+	munmap(localSegment, sizeof(IPXLocalSegment));
+	localSegment = 0;
+	localSlot = -1;
+}
+
+static void IPX_LocalWrite(Bitu slot, const Bit8u * buffer, Bit16u bufSize) {
+	IPXLocalRing * ring = &localSegment->nodes[slot].from[localSlot];
+	Bit32u head = ring->head;
+	if(head - ring->tail >= IPX_LOCAL_RINGSIZE) {
+		// the other session isn't keeping up: lose the packet, as the network would
+		LOG_IPX("IPX: Local TX Packet loss!");
+		return;
+	}
+	Bitu index = head % IPX_LOCAL_RINGSIZE;
+	memcpy(ring->packets[index], buffer, bufSize);
+	ring->sizes[index] = bufSize;
+	__sync_synchronize();
+	ring->head = head + 1;
+}
+
+// Returns true if the packet has been delivered to everyone it was for, false if it still
+// needs to go to the server.
+static bool IPX_LocalSend(const Bit8u * buffer, Bit16u bufSize) {
+	if(!localSegment) return false;
+	const IPXHeader * header = (const IPXHeader *)buffer;
+	if(SDLNet_Read16((void *)header->dest.socket) == 0x2) return false;
+
+	if(header->dest.addr.byIP.host == 0xffffffff) {
+		for(Bitu i = 0; i < IPX_LOCAL_NODES; i++) {
+			if((Bits)i != localSlot && IPX_LocalNodeIsLive(i)) IPX_LocalWrite(i, buffer, bufSize);
+		}
+		return false;
+	}
+	Bits slot = IPX_LocalFindNode(header->dest.addr.byNode.node);
+	if(slot < 0) return false;
+	IPX_LocalWrite(slot, buffer, bufSize);
+	return true;
+}
+
+static void IPX_LocalReceive(void) {
+	if(!localSegment) return;
+	IPXLocalNode * node = &localSegment->nodes[localSlot];
+	for(Bitu s = 0; s < IPX_LOCAL_NODES; s++) {
+		IPXLocalRing * ring = &node->from[s];
+		while(ring->tail != ring->head) {
+			__sync_synchronize();
+			Bitu index = ring->tail % IPX_LOCAL_RINGSIZE;
+			Bit16u size = ring->sizes[index];
+			// copied out first, since receivePacket may well end up sending
+			memcpy(recvBuffer, ring->packets[index], size);
+			__sync_synchronize();
+			ring->tail++;
+			receivePacket(recvBuffer, size);
+		}
+	}
+}
+
+#else
+
+static void IPX_LocalJoin(void) {}
+static void IPX_LocalLeave(void) {}
+static bool IPX_LocalSend(const Bit8u * buffer, Bit16u bufSize) { return false; }
+static void IPX_LocalReceive(void) {}
+static Bits IPX_LocalFindNode(const Bit8u * netnode) { return -1; }
+
+#endif
+//--End of modifications
+
 static void IPX_ClientLoop(void) {
 	int numrecv;
 	UDPpacket inPacket;
@@ -605,9 +828,21 @@ static void IPX_ClientLoop(void) {
 	inPacket.maxlen = IPXBUFFERSIZE;
 	inPacket.channel = UDPChannel;
 
+	//--Added for the local transport
+	IPX_LocalReceive();
+	//--End of modifications
+
 	// Its amazing how much simpler UDP is than TCP
 	numrecv = SDLNet_UDP_Recv(ipxClientSocket, &inPacket);
-	if(numrecv) receivePacket(inPacket.data, inPacket.len);
+	//--Modified to drop what the local transport has already delivered
+	//if(numrecv) receivePacket(inPacket.data, inPacket.len);
+	if(numrecv) {
+		IPXHeader * tmpHeader = (IPXHeader *)inPacket.data;
+		if(SDLNet_Read16(tmpHeader->dest.socket) != 0x2 &&
+			IPX_LocalFindNode(tmpHeader->src.addr.byNode.node) >= 0) return;
+		receivePacket(inPacket.data, inPacket.len);
+	}
+	//--End of modifications
 }
 
 
@@ -617,6 +852,7 @@ void DisconnectFromServer(bool unexpected) {
 		incomingPacket.connected = false;
 		TIMER_DelTickHandler(&IPX_ClientLoop);
 		SDLNet_UDP_Close(ipxClientSocket);
+		IPX_LocalLeave();	//--Added for the local transport
 	}
 }
 
@@ -701,7 +937,10 @@ static void sendPacket(ECBClass* sendecb) {
 		if(immedAddr[m]!=0xff) islocalbroadcast=false;
 	}
 	LOG_IPX("SEND crc:%2x",packetCRC(&outbuffer[0], packetsize));
-	if(!isloopback) {
+	//--Modified to hand packets for sessions on this host straight to them
+	//if(!isloopback) {
+	if(!isloopback && !IPX_LocalSend(outbuffer, packetsize)) {
+	//--End of modifications
 		outPacket.channel = UDPChannel;
 		outPacket.data = (Uint8 *)&outbuffer[0];
 		outPacket.len = packetsize;
@@ -821,6 +1060,7 @@ bool ConnectToServer(char const *strAddr) {
 
 				incomingPacket.connected = true;
 				TIMER_AddTickHandler(&IPX_ClientLoop);
+				IPX_LocalJoin();	//--Added for the local transport
 				return true;
 			}
 		} else {
@@ -29,17 +29,69 @@
 #include <string.h>
 #include "ipx.h"
 
+//--Added to run the server on a thread of its own
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/event.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+//--End of modifications
+
 IPaddress ipxServerIp;  // IPAddress for server's listening port
-UDPsocket ipxServerSocket;  // Listening server socket
+//--Modified to serve from a socket of our own, rather than polling an SDL_net socket from a timer
+//UDPsocket ipxServerSocket;  // Listening server socket
+static int ipxServerSocket=-1;
+//--End of modifications
 
 packetBuffer connBuffer[SOCKETTABLESIZE];
 
-Bit8u inBuffer[IPXBUFFERSIZE];
+//--Modified to receive packets in batches
+//Bit8u inBuffer[IPXBUFFERSIZE];
+//--End of modifications
 IPaddress ipconn[SOCKETTABLESIZE];  // Active TCP/IP connection 
 UDPsocket tcpconn[SOCKETTABLESIZE];  // Active TCP/IP connections
 SDLNet_SocketSet serverSocketSet;
 TIMER_TickHandler* serverTimer;
 
+//--Added to run the server on a thread of its own.
+//The server used to be polled from the emulator's tick handler, one packet per tick: so every
+//packet between clients waited on the host's emulation thread, and piled up whenever that was busy.
+//Now a thread waits on the socket with kqueue and relays everything that has arrived as soon as it does.
+//Connections are only changed by the server thread: the emulation thread just reads them for IPXNET STATUS.
+
+// the most packets to read off the socket before relaying them
+#define IPX_SERVER_BATCHSIZE 32
+// identifies the event that tells the server thread to stop
+#define IPX_SERVER_STOPEVENT 1
+
+static int serverQueue=-1;
+static pthread_t serverThread;
+static struct sockaddr_in clientAddrs[SOCKETTABLESIZE];	// ipconn as socket addresses, ready to send to
+static Bit8u batchBuffers[IPX_SERVER_BATCHSIZE][IPXBUFFERSIZE];
+static Bit16u batchSizes[IPX_SERVER_BATCHSIZE];
+static IPaddress batchAddrs[IPX_SERVER_BATCHSIZE];
+
+static void setClientAddr(Bit16u i) {
+	memset(&clientAddrs[i],0,sizeof(clientAddrs[i]));
+	clientAddrs[i].sin_len=sizeof(clientAddrs[i]);
+	clientAddrs[i].sin_family=AF_INET;
+	// both are in network byte order already
+	clientAddrs[i].sin_addr.s_addr=ipconn[i].host;
+	clientAddrs[i].sin_port=ipconn[i].port;
+}
+
+static bool sendToClient(Bit16u i,const Bit8u * buffer,Bit16u bufSize) {
+	if (sendto(ipxServerSocket,buffer,bufSize,0,(struct sockaddr *)&clientAddrs[i],sizeof(clientAddrs[i]))<0) {
+		LOG_MSG("IPXSERVER: %s", strerror(errno));
+		return false;
+	}
+	return true;
+}
+//--End of modifications
+
 Bit8u packetCRC(Bit8u *buffer, Bit16u bufSize) {
 	Bit8u tmpCRC = 0;
 	Bit16u i;
@@ -68,12 +120,14 @@ static void sendIPXPacket(Bit8u *buffer, Bit16s bufSize) {
 	Bit16u srcport, destport;
 	Bit32u srchost, desthost;
 	Bit16u i;
-	Bits result;
-	UDPpacket outPacket;
-	outPacket.channel = -1;
-	outPacket.data = buffer;
-	outPacket.len = bufSize;
-	outPacket.maxlen = bufSize;
+	//--Removed along with the SDL_net socket
+	//Bits result;
+	//UDPpacket outPacket;
+	//outPacket.channel = -1;
+	//outPacket.data = buffer;
+	//outPacket.len = bufSize;
+	//outPacket.maxlen = bufSize;
+	//--End of modifications
 	IPXHeader *tmpHeader;
 	tmpHeader = (IPXHeader *)buffer;
 
@@ -88,12 +142,9 @@ static void sendIPXPacket(Bit8u *buffer, Bit16s bufSize) {
 		// Broadcast
 		for(i=0;i<SOCKETTABLESIZE;i++) {
 			if(connBuffer[i].connected && ((ipconn[i].host != srchost)||(ipconn[i].port!=srcport))) {
-				outPacket.address = ipconn[i];
-				result = SDLNet_UDP_Send(ipxServerSocket,-1,&outPacket);
-				if(result == 0) {
-					LOG_MSG("IPXSERVER: %s", SDLNet_GetError());
-					continue;
-				}
+				//--Modified to send from our own socket
+				if(!sendToClient(i,buffer,bufSize)) continue;
+				//--End of modifications
 				//LOG_MSG("IPXSERVER: Packet of %d bytes sent from %d.%d.%d.%d to %d.%d.%d.%d (BROADCAST) (%x CRC)", bufSize, CONVIP(srchost), CONVIP(ipconn[i].host), packetCRC(&buffer[30], bufSize-30));
 			}
 		}
@@ -101,12 +152,9 @@ static void sendIPXPacket(Bit8u *buffer, Bit16s bufSize) {
 		// Specific address
 		for(i=0;i<SOCKETTABLESIZE;i++) {
 			if((connBuffer[i].connected) && (ipconn[i].host == desthost) && (ipconn[i].port == destport)) {
-				outPacket.address = ipconn[i];
-				result = SDLNet_UDP_Send(ipxServerSocket,-1,&outPacket);
-				if(result == 0) {
-					LOG_MSG("IPXSERVER: %s", SDLNet_GetError());
-					continue;
-				}
+				//--Modified to send from our own socket
+				if(!sendToClient(i,buffer,bufSize)) continue;
+				//--End of modifications
 				//LOG_MSG("IPXSERVER: Packet sent from %d.%d.%d.%d to %d.%d.%d.%d", CONVIP(srchost), CONVIP(desthost));
 			}
 		}
@@ -123,16 +171,20 @@ bool IPX_isConnectedToServer(Bits tableNum, IPaddress ** ptrAddr) {
 	return connBuffer[tableNum].connected;
 }
 
-static void ackClient(IPaddress clientAddr) {
+//--Modified to send from our own socket
+static void ackClient(Bit16u clientIndex) {
+//--End of modifications
 	IPXHeader regHeader;
-	UDPpacket regPacket;
-	Bits result;
+	//--Removed along with the SDL_net socket
+	//UDPpacket regPacket;
+	//Bits result;
+	//--End of modifications
 
 	SDLNet_Write16(0xffff, regHeader.checkSum);
 	SDLNet_Write16(sizeof(regHeader), regHeader.length);
 	
 	SDLNet_Write32(0, regHeader.dest.network);
-	PackIP(clientAddr, &regHeader.dest.addr.byIP);
+	PackIP(ipconn[clientIndex], &regHeader.dest.addr.byIP);
 	SDLNet_Write16(0x2, regHeader.dest.socket);
 
 	SDLNet_Write32(1, regHeader.src.network);
@@ -140,32 +192,32 @@ static void ackClient(IPaddress clientAddr) {
 	SDLNet_Write16(0x2, regHeader.src.socket);
 	regHeader.transControl = 0;
 
-	regPacket.data = (Uint8 *)&regHeader;
-	regPacket.len = sizeof(regHeader);
-	regPacket.maxlen = sizeof(regHeader);
-	regPacket.address = clientAddr;
 	// Send registration string to client.  If client doesn't get this, client will not be registered
-	result = SDLNet_UDP_Send(ipxServerSocket,-1,&regPacket);
-
+	//--Modified to send from our own socket
+	sendToClient(clientIndex,(Bit8u *)&regHeader,sizeof(regHeader));
+	//--End of modifications
 }
 
-static void IPX_ServerLoop() {
-	UDPpacket inPacket;
+//--Modified to be handed each packet by the server thread, rather than polling for one itself
+static void IPX_ServerLoop(Bit8u * inBuffer,Bit16u inSize,IPaddress inAddress) {
+	//UDPpacket inPacket;
 	IPaddress tmpAddr;
 
 	//char regString[] = "IPX Register\0";
 
 	Bit16u i;
 	Bit32u host;
-	Bits result;
+	//Bits result;
 
-	inPacket.channel = -1;
-	inPacket.data = &inBuffer[0];
-	inPacket.maxlen = IPXBUFFERSIZE;
+	//inPacket.channel = -1;
+	//inPacket.data = &inBuffer[0];
+	//inPacket.maxlen = IPXBUFFERSIZE;
 
 
-	result = SDLNet_UDP_Recv(ipxServerSocket, &inPacket);
-	if (result != 0) {
+	//result = SDLNet_UDP_Recv(ipxServerSocket, &inPacket);
+	//if (result != 0) {
+	{
+//--End of modifications
 		// Check to see if incoming packet is a registration packet
 		// For this, I just spoofed the echo protocol packet designation 0x02
 		IPXHeader *tmpHeader;
@@ -180,20 +232,26 @@ static void IPX_ServerLoop() {
 					if(!connBuffer[i].connected) {
 						// Use prefered host IP rather than the reported source IP
 						// It may be better to use the reported source
-						ipconn[i] = inPacket.address;
+						ipconn[i] = inAddress;
+						//--Added to send from our own socket
+						setClientAddr(i);
+						//--End of modifications
 
 						connBuffer[i].connected = true;
 						host = ipconn[i].host;
 						LOG_MSG("IPXSERVER: Connect from %d.%d.%d.%d", CONVIP(host));
-						ackClient(inPacket.address);
+						ackClient(i);
 						return;
 					} else {
 						if((ipconn[i].host == tmpAddr.host) && (ipconn[i].port == tmpAddr.port)) {
 
 							LOG_MSG("IPXSERVER: Reconnect from %d.%d.%d.%d", CONVIP(tmpAddr.host));
 							// Update anonymous port number if changed
-							ipconn[i].port = inPacket.address.port;
-							ackClient(inPacket.address);
+							ipconn[i].port = inAddress.port;
+							//--Added to send from our own socket
+							setClientAddr(i);
+							//--End of modifications
+							ackClient(i);
 							return;
 						}
 					}
@@ -203,13 +261,61 @@ static void IPX_ServerLoop() {
 		}
 
 		// IPX packet is complete.  Now interpret IPX header and send to respective IP address
-		sendIPXPacket((Bit8u *)inPacket.data, inPacket.len);
+		sendIPXPacket(inBuffer, inSize);
 	}
 }
 
+//--Added to run the server on a thread of its own
+static void * IPX_ServerThread(void *) {
+	struct kevent events[2];
+	for (;;) {
+		int numEvents=kevent(serverQueue,NULL,0,events,2,NULL);
+		if (numEvents<0) {
+			if (errno==EINTR) continue;
+			LOG_MSG("IPXSERVER: %s", strerror(errno));
+			break;
+		}
+		for (int e=0;e<numEvents;e++) {
+			if (events[e].filter==EVFILT_USER) return NULL;
+		}
+
+		// Read off everything that has arrived, in batches, before relaying any of it:
+		// there is no recvmmsg on OS X, but this still keeps the socket clear while we send.
+		for (;;) {
+			Bitu numPackets=0;
+			while (numPackets<IPX_SERVER_BATCHSIZE) {
+				struct sockaddr_in from;
+				socklen_t fromLen=sizeof(from);
+				ssize_t len=recvfrom(ipxServerSocket,batchBuffers[numPackets],IPXBUFFERSIZE,0,(struct sockaddr *)&from,&fromLen);
+				if (len<0) break;	// EAGAIN: nothing more for now
+				if ((size_t)len<sizeof(IPXHeader)) continue;
+				batchSizes[numPackets]=(Bit16u)len;
+				batchAddrs[numPackets].host=from.sin_addr.s_addr;
+				batchAddrs[numPackets].port=from.sin_port;
+				numPackets++;
+			}
+			for (Bitu p=0;p<numPackets;p++) IPX_ServerLoop(batchBuffers[p],batchSizes[p],batchAddrs[p]);
+			if (numPackets<IPX_SERVER_BATCHSIZE) break;
+		}
+	}
+	return NULL;
+}
+//--End of modifications
+
 void IPX_StopServer() {
-	TIMER_DelTickHandler(&IPX_ServerLoop);
-	SDLNet_UDP_Close(ipxServerSocket);
+	//--Modified to stop the server thread
+	//TIMER_DelTickHandler(&IPX_ServerLoop);
+	//SDLNet_UDP_Close(ipxServerSocket);
+	if (serverQueue<0) return;
+	struct kevent stopEvent;
+	EV_SET(&stopEvent,IPX_SERVER_STOPEVENT,EVFILT_USER,0,NOTE_TRIGGER,0,NULL);
+	kevent(serverQueue,&stopEvent,1,NULL,0,NULL);
+	pthread_join(serverThread,NULL);
+	close(serverQueue);
+	serverQueue=-1;
+	close(ipxServerSocket);
+	ipxServerSocket=-1;
+	//--End of modifications
 }
 
 bool IPX_StartServer(Bit16u portnum) {
@@ -218,12 +324,41 @@ bool IPX_StartServer(Bit16u portnum) {
 	if(!SDLNet_ResolveHost(&ipxServerIp, NULL, portnum)) {
 	
 		//serverSocketSet = SDLNet_AllocSocketSet(SOCKETTABLESIZE);
-		ipxServerSocket = SDLNet_UDP_Open(portnum);
-		if(!ipxServerSocket) return false;
+		//--Modified to serve from a socket of our own on a thread of its own
+		//ipxServerSocket = SDLNet_UDP_Open(portnum);
+		//if(!ipxServerSocket) return false;
+		ipxServerSocket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+		if(ipxServerSocket < 0) return false;
+
+		struct sockaddr_in serverAddr;
+		memset(&serverAddr,0,sizeof(serverAddr));
+		serverAddr.sin_len=sizeof(serverAddr);
+		serverAddr.sin_family=AF_INET;
+		serverAddr.sin_addr.s_addr=htonl(INADDR_ANY);
+		serverAddr.sin_port=htons(portnum);
+		if (bind(ipxServerSocket,(struct sockaddr *)&serverAddr,sizeof(serverAddr))<0 ||
+			fcntl(ipxServerSocket,F_SETFL,fcntl(ipxServerSocket,F_GETFL)|O_NONBLOCK)<0) {
+			close(ipxServerSocket);
+			ipxServerSocket=-1;
+			return false;
+		}
 
 		for(i=0;i<SOCKETTABLESIZE;i++) connBuffer[i].connected = false;
 
-		TIMER_AddTickHandler(&IPX_ServerLoop);
+		//TIMER_AddTickHandler(&IPX_ServerLoop);
+		serverQueue=kqueue();
+		struct kevent events[2];
+		EV_SET(&events[0],ipxServerSocket,EVFILT_READ,EV_ADD,0,0,NULL);
+		EV_SET(&events[1],IPX_SERVER_STOPEVENT,EVFILT_USER,EV_ADD|EV_CLEAR,0,0,NULL);
+		if (serverQueue<0 || kevent(serverQueue,events,2,NULL,0,NULL)<0 ||
+			pthread_create(&serverThread,NULL,IPX_ServerThread,NULL)!=0) {
+			if (serverQueue>=0) close(serverQueue);
+			serverQueue=-1;
+			close(ipxServerSocket);
+			ipxServerSocket=-1;
+			return false;
+		}
+		//--End of modifications
 		return true;
 	}
 	return false;
@@ -25,6 +25,9 @@
 #include "joystick.h"
 #include "pic.h"
 #include "support.h"
+//--Added to record and play back input for benchmarks
+#include "inputreplay.h"
+//--End of modifications
 
 #define RANGE 64
 #define TIMEOUT 10
@@ -94,6 +97,49 @@ static Bitu read_p201(Bitu port,Bitu iolen) {
 	return ret;
 }
 
+//--Modified to make polling the timed gameport cheap.
+//Games poll port 0x201 in tight loops many thousands of times per frame, so the axis bits are
+//worked out only when the next axis is due to discharge and are otherwise returned as they were.
+//The button bits are kept up to date as buttons change, rather than rebuilt on every read.
+#define AXIS_NEVER 1e300
+
+static Bit8u timed_axis_bits = 0xff;
+static Bit8u button_bits = 0xff;
+static double next_discharge = -1;
+
+static void update_button_bits(void) {
+	Bit8u bits=0xff;
+	if (stick[0].enabled) {
+		if (stick[0].button[0]) bits&=~16;
+		if (stick[0].button[1]) bits&=~32;
+	}
+	if (stick[1].enabled) {
+		if (stick[1].button[0]) bits&=~64;
+		if (stick[1].button[1]) bits&=~128;
+	}
+	button_bits=bits;
+}
+
+// clears the bits of the axes that have discharged by currentTick,
+// and notes when the next of the remaining axes will
+static void update_timed_axis_bits(double currentTick) {
+	double deadlines[4]={ stick[0].xtick, stick[0].ytick, stick[1].xtick, stick[1].ytick };
+	Bit8u bits=0xff;
+	next_discharge=AXIS_NEVER;
+	for (Bitu i=0;i<4;i++) {
+		if (!stick[i/2].enabled) continue;
+		if (deadlines[i] < currentTick) bits&=~(1<<i);
+		else if (deadlines[i] < next_discharge) next_discharge=deadlines[i];
+	}
+	timed_axis_bits=bits;
+}
+
+static Bitu read_p201_timed(Bitu port,Bitu iolen) {
+	double currentTick = PIC_FullIndex();
+	if (currentTick > next_discharge) update_timed_axis_bits(currentTick);
+	return timed_axis_bits & button_bits;
+}
+/*
 static Bitu read_p201_timed(Bitu port,Bitu iolen) {
 	Bit8u ret=0xff;
 	double currentTick = PIC_FullIndex();
@@ -117,6 +163,8 @@ static Bitu read_p201_timed(Bitu port,Bitu iolen) {
 	}
 	return ret;
 }
+*/
+//--End of modifications
 
 
 static void write_p201(Bitu port,Bitu val,Bitu iolen) {
@@ -152,39 +200,67 @@ static void write_p201_timed(Bitu port,Bitu val,Bitu iolen) {
 		stick[1].ytick = currentTick + 1000.0*( JOY_S_CONSTANT + S_PER_OHM *
 		                 (double)((swap34? stick[1].xpos : stick[1].ypos)+1.0) * OHMS);
 	}
+	update_timed_axis_bits(currentTick); //--Added for cheap timed gameport polling
 }
 
 
 //--Modified 2011-05-08 by Alun Bestor to let Boxer toggle the gameport timing on the fly.
+//Boxer is told the gameport is in use at most once per tick, since a round trip to Boxer
+//costs far more than the polls themselves.
+static Bitu last_active_tick = (Bitu)-1;
+static inline void report_joystick_active(void) {
+	if (last_active_tick != PIC_Ticks) {
+		last_active_tick = PIC_Ticks;
+		boxer_setJoystickActive(true);
+	}
+}
+
 static Bitu read_p201_switchable(Bitu port,Bitu iolen) {
-    boxer_setJoystickActive(true);
+    report_joystick_active();
     if (gameport_timed && !write_active) return read_p201_timed(port, iolen);
 	else return read_p201(port, iolen);
 }
 
 static void write_p201_switchable(Bitu port,Bitu val,Bitu iolen) {
-    boxer_setJoystickActive(true);
+    report_joystick_active();
 	if (gameport_timed) write_p201_timed(port, val, iolen);
 	else write_p201(port, val, iolen);
 }
 //--End of modifications
 
 
+//--Modified to keep the timed gameport's cached bits up to date.
 void JOYSTICK_Enable(Bitu which,bool enabled) {
+	//--Added to record and play back input for benchmarks
+	if (!REPLAY_Input(REPLAY_JOYSTICK_ENABLE,(Bit8u)which,enabled,0)) return;
+	//--End of modifications
 	if (which<2) stick[which].enabled=enabled;
+	update_button_bits();
+	next_discharge=-1;
 }
 
 void JOYSTICK_Button(Bitu which,Bitu num,bool pressed) {
+	//--Added to record and play back input for benchmarks
+	if (!REPLAY_Input(REPLAY_JOYSTICK_BUTTON,(Bit8u)which,pressed,(Bit32u)num)) return;
+	//--End of modifications
 	if ((which<2) && (num<2)) stick[which].button[num]=pressed;
+	update_button_bits();
 }
+//--End of modifications
 
 void JOYSTICK_Move_X(Bitu which,float x) {
+	//--Added to record and play back input for benchmarks
+	if (!REPLAY_Input(REPLAY_JOYSTICK_MOVE_X,(Bit8u)which,0,0,x)) return;
+	//--End of modifications
 	if (which<2) {
 		stick[which].xpos=x;
 	}
 }
 
 void JOYSTICK_Move_Y(Bitu which,float y) {
+	//--Added to record and play back input for benchmarks
+	if (!REPLAY_Input(REPLAY_JOYSTICK_MOVE_Y,(Bit8u)which,0,0,y)) return;
+	//--End of modifications
 	if (which<2) {
 		stick[which].ypos=y;
 	}
@@ -256,6 +332,8 @@ public:
 		
 		stick[0].xtick = stick[0].ytick = stick[1].xtick =
 		                 stick[1].ytick = PIC_FullIndex();
+		update_button_bits(); //--Added for cheap timed gameport polling
+		next_discharge = -1; //--Added for cheap timed gameport polling
 	}
 };
 static JOYSTICK* test;
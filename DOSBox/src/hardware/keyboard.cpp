@@ -25,6 +25,9 @@
 #include "mem.h"
 #include "mixer.h"
 #include "timer.h"
+//--Added to record and play back input for benchmarks
+#include "inputreplay.h"
+//--End of modifications
 //--Added 2012-02-24 by Alun Bestor to give Boxer more hooks into keyboard behaviour
 #import "BXCoalface.h"
 //--End of modifications
@@ -107,6 +110,7 @@ static void KEYBOARD_AddBuffer(Bit8u data) {
 
 
 static Bitu read_p60(Bitu port,Bitu iolen) {
+	boxer_programDidReadInput(); //--Added for input latency measurement
 	keyb.p60changed=false;
 	if (!keyb.scheduled && keyb.used) {
 		keyb.scheduled=true;
@@ -229,6 +233,10 @@ static Bitu read_p64(Bitu port,Bitu iolen) {
 }
 
 void KEYBOARD_AddKey(KBD_KEYS keytype,bool pressed) {
+	//--Added to record and play back input for benchmarks
+	if (!REPLAY_Input(REPLAY_KEY,0,pressed,keytype)) return;
+	//--End of modifications
+	boxer_inputDidReachEmulation(); //--Added for input latency measurement
 	Bit8u ret=0;bool extend=false;
 	switch (keytype) {
 	case KBD_esc:ret=1;break;
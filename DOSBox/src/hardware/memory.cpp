@@ -24,8 +24,16 @@
 #include "setup.h"
 #include "paging.h"
 #include "regs.h"
+#include "rewind.h"		//--Added for rewinding
 
 #include <string.h>
+//--Added for rewinding
+#if !defined(WIN32)
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+//--End of modifications
 
 #define PAGES_IN_BLOCK	((1024*1024)/MEM_PAGE_SIZE)
 #define SAFE_MEMORY	32
@@ -174,23 +182,239 @@ void mem_strcpy(PhysPt dest,PhysPt src) {
 	mem_writeb_inline(dest,0);
 }
 
+//--Modified to copy whole runs of plain RAM at once. Where the TLB has host pointers for
+//both sides, everything up to the next page boundary is copied in one go; anything else,
+//such as video memory or pages that haven't been linked yet, still goes byte by byte
+//through the page handlers.
+static INLINE Bitu MEM_PageRemainder(PhysPt pt,Bitu size) {
+	Bitu todo=MEM_PAGE_SIZE-(pt & (MEM_PAGE_SIZE-1));
+	return (todo<size) ? todo : size;
+}
+
 void mem_memcpy(PhysPt dest,PhysPt src,Bitu size) {
-	while (size--) mem_writeb_inline(dest++,mem_readb_inline(src++));
+	while (size) {
+		HostPt src_tlb=get_tlb_read(src);
+		HostPt dest_tlb=get_tlb_write(dest);
+		if (!src_tlb || !dest_tlb) {
+			mem_writeb_inline(dest++,mem_readb_inline(src++));
+			size--;
+			continue;
+		}
+		Bitu todo=MEM_PageRemainder(src,MEM_PageRemainder(dest,size));
+		HostPt from=src_tlb+src;
+		HostPt to=dest_tlb+dest;
+		// Copying forwards byte by byte repeats the bytes between the two when the
+		// destination overlaps the end of the source, so copy no more than that at once
+		if (to>from && (Bitu)(to-from)<todo) todo=(Bitu)(to-from);
+		memcpy(to,from,todo);
+		dest+=todo;
+		src+=todo;
+		size-=todo;
+	}
 }
 
 void MEM_BlockRead(PhysPt pt,void * data,Bitu size) {
 	Bit8u * write=reinterpret_cast<Bit8u *>(data);
-	while (size--) {
-		*write++=mem_readb_inline(pt++);
+	while (size) {
+		HostPt tlb_addr=get_tlb_read(pt);
+		if (!tlb_addr) {
+			*write++=mem_readb_inline(pt++);
+			size--;
+			continue;
+		}
+		Bitu todo=MEM_PageRemainder(pt,size);
+		memcpy(write,tlb_addr+pt,todo);
+		write+=todo;
+		pt+=todo;
+		size-=todo;
 	}
 }
 
 void MEM_BlockWrite(PhysPt pt,void const * const data,Bitu size) {
 	Bit8u const * read = reinterpret_cast<Bit8u const * const>(data);
-	while (size--) {
-		mem_writeb_inline(pt++,*read++);
+	while (size) {
+		HostPt tlb_addr=get_tlb_write(pt);
+		if (!tlb_addr) {
+			mem_writeb_inline(pt++,*read++);
+			size--;
+			continue;
+		}
+		Bitu todo=MEM_PageRemainder(pt,size);
+		memcpy(tlb_addr+pt,read,todo);
+		read+=todo;
+		pt+=todo;
+		size-=todo;
+	}
+}
+
+HostPt MEM_GetBlockHostPt(PhysPt pt,Bitu size,bool write) {
+	if (!size) return 0;
+	HostPt tlb_addr=0;
+	for (PhysPt page=pt & ~(MEM_PAGE_SIZE-1);page<pt+size;page+=MEM_PAGE_SIZE) {
+		HostPt page_addr=write ? get_tlb_write(page) : get_tlb_read(page);
+		if (!page_addr && !paging.enabled && PAGING_ForcePageInit(page))
+			page_addr=write ? get_tlb_write(page) : get_tlb_read(page);
+		if (!page_addr) return 0;
+		if (tlb_addr && page_addr!=tlb_addr) return 0;
+		tlb_addr=page_addr;
+	}
+	if (write) {
+		// Fault in any write-protected host pages (e.g. while rewinding) before
+		// the caller hands the block to something like fread that can't take the fault
+		for (PhysPt page=pt & ~(MEM_PAGE_SIZE-1);page<pt+size;page+=MEM_PAGE_SIZE) {
+			volatile Bit8u * touch=tlb_addr+(page<pt ? pt : page);
+			*touch=*touch;
+		}
 	}
+	return tlb_addr+pt;
+}
+//--End of modifications
+
+//--Added for the REP MOVS, STOS and LODS fast paths in the CPU cores
+/* How many of count elements, starting with the one at address (which is base+index) and stepping
+   by add_index, lie in the same page as the first and come before index wraps round add_mask.
+   Returns 0 if the first element straddles the end of its page. */
+static INLINE Bitu MEM_StringRun(PhysPt address,Bitu index,Bitu add_mask,Bits add_index,Bitu count) {
+	Bitu size=(add_index<0) ? (Bitu)(-add_index) : (Bitu)add_index;
+	Bitu offset=address & (MEM_PAGE_SIZE-1);
+	if (offset+size>MEM_PAGE_SIZE) return 0;
+	Bitu run,wrap;
+	if (add_index>0) {
+		run=(MEM_PAGE_SIZE-offset)/size;
+		wrap=(add_mask-index)/size+1;
+	} else {
+		run=offset/size+1;
+		wrap=index/size+1;
+	}
+	if (wrap<run) run=wrap;
+	return (count<run) ? count : run;
+}
+
+/* Each of these alternates between doing a page's worth of elements straight in host memory and
+   doing a single element the ordinary way. The ordinary way takes care of elements that straddle
+   two pages and maps in pages that haven't been touched yet; if a page still has no host memory
+   after that, it has a handler and the caller is left to do the rest. */
+
+Bitu MEM_MovsFast(PhysPt si_base,Bitu * si_index,PhysPt di_base,Bitu * di_index,Bitu add_mask,Bits add_index,Bitu count) {
+	Bitu size=(add_index<0) ? (Bitu)(-add_index) : (Bitu)add_index;
+	bool retried=false;
+	while (count) {
+		PhysPt si_addr=si_base+*si_index;
+		PhysPt di_addr=di_base+*di_index;
+		Bitu run=MEM_StringRun(si_addr,*si_index,add_mask,add_index,count);
+		run=MEM_StringRun(di_addr,*di_index,add_mask,add_index,run);
+		HostPt src=run ? get_tlb_read(si_addr) : 0;
+		HostPt dst=run ? get_tlb_write(di_addr) : 0;
+		if (!src || !dst) {
+			if (run) {
+				if (retried) break;
+				retried=true;
+			}
+			switch (size) {
+			case 1:mem_writeb_inline(di_addr,mem_readb_inline(si_addr));break;
+			case 2:mem_writew_inline(di_addr,mem_readw_inline(si_addr));break;
+			default:mem_writed_inline(di_addr,mem_readd_inline(si_addr));break;
+			}
+			run=1;
+		} else {
+			Bitu len=run*size;
+			src+=si_addr;
+			dst+=di_addr;
+			/* memmove matches copying one element at a time, unless the destination starts
+			   partway into the source on the side being copied towards: then each element
+			   copied overwrites one still to be read, and the copy has to repeat itself */
+			HostPt src_low=(add_index<0) ? src-(len-size) : src;
+			HostPt dst_low=(add_index<0) ? dst-(len-size) : dst;
+			if ((add_index>0) ? (dst_low>src_low && dst_low<src_low+len) : (dst_low<src_low && dst_low+len>src_low)) {
+				for (Bitu i=run;i>0;i--,src+=add_index,dst+=add_index) switch (size) {
+				case 1:host_writeb(dst,host_readb(src));break;
+				case 2:host_writew(dst,host_readw(src));break;
+				default:host_writed(dst,host_readd(src));break;
+				}
+			} else {
+				memmove(dst_low,src_low,len);
+			}
+			retried=false;
+		}
+		*si_index=(*si_index+run*add_index) & add_mask;
+		*di_index=(*di_index+run*add_index) & add_mask;
+		count-=run;
+	}
+	return count;
+}
+
+Bitu MEM_StosFast(PhysPt di_base,Bitu * di_index,Bitu add_mask,Bits add_index,Bitu count,Bit32u val) {
+	Bitu size=(add_index<0) ? (Bitu)(-add_index) : (Bitu)add_index;
+	bool retried=false;
+	while (count) {
+		PhysPt di_addr=di_base+*di_index;
+		Bitu run=MEM_StringRun(di_addr,*di_index,add_mask,add_index,count);
+		HostPt dst=run ? get_tlb_write(di_addr) : 0;
+		if (!dst) {
+			if (run) {
+				if (retried) break;
+				retried=true;
+			}
+			switch (size) {
+			case 1:mem_writeb_inline(di_addr,(Bit8u)val);break;
+			case 2:mem_writew_inline(di_addr,(Bit16u)val);break;
+			default:mem_writed_inline(di_addr,val);break;
+			}
+			run=1;
+		} else {
+			/* Every element gets the same value, so fill from the lowest one up */
+			Bitu len=run*size;
+			dst+=di_addr;
+			if (add_index<0) dst-=len-size;
+			switch (size) {
+			case 1:
+				memset(dst,(Bit8u)val,len);
+				break;
+			case 2:
+				for (Bitu i=0;i<len;i+=2) host_writew(dst+i,(Bit16u)val);
+				break;
+			default:
+				for (Bitu i=0;i<len;i+=4) host_writed(dst+i,val);
+				break;
+			}
+			retried=false;
+		}
+		*di_index=(*di_index+run*add_index) & add_mask;
+		count-=run;
+	}
+	return count;
+}
+
+Bitu MEM_LodsFast(PhysPt si_base,Bitu * si_index,Bitu add_mask,Bits add_index,Bitu count,Bit32u * val) {
+	Bitu size=(add_index<0) ? (Bitu)(-add_index) : (Bitu)add_index;
+	bool retried=false;
+	while (count) {
+		PhysPt si_addr=si_base+*si_index;
+		Bitu run=MEM_StringRun(si_addr,*si_index,add_mask,add_index,count);
+		HostPt src=run ? get_tlb_read(si_addr) : 0;
+		if (!src) {
+			if (run) {
+				if (retried) break;
+				retried=true;
+			}
+			run=1;
+		} else {
+			/* Reading plain RAM has no side effects, so only the last element matters */
+			src+=si_addr;
+			src+=(Bits)(run-1)*add_index;
+			retried=false;
+		}
+		switch (size) {
+		case 1:*val=src ? host_readb(src) : mem_readb_inline(si_addr);break;
+		case 2:*val=src ? host_readw(src) : mem_readw_inline(si_addr);break;
+		default:*val=src ? host_readd(src) : mem_readd_inline(si_addr);break;
+		}
+		*si_index=(*si_index+run*add_index) & add_mask;
+		count-=run;
+	}
+	return count;
 }
+//--End of modifications
 
 void MEM_BlockCopy(PhysPt dest,PhysPt src,Bitu size) {
 	mem_memcpy(dest,src,size);
@@ -317,12 +541,41 @@ MemHandle MEM_GetNextFreePage(void) {
 	return (MemHandle)BestMatch(1);
 }
 
+//--Added to hand the host pages behind released guest memory back to the system.
+//The contents of freed guest memory are undefined, so the host may zero them lazily.
+//Skipped while rewinding, since the history only restores pages it saw written to.
+static void MEM_DiscardPages(Bitu start,Bitu count) {
+#if !defined(WIN32) && (defined(MADV_FREE) || defined(MADV_DONTNEED))
+	if (!count || REWIND_IsActive()) return;
+	Bitu host_page=(Bitu)getpagesize();
+	Bitu from=((Bitu)(MemBase+start*MEM_PAGESIZE)+host_page-1) & ~(host_page-1);
+	Bitu until=((Bitu)(MemBase+(start+count)*MEM_PAGESIZE)) & ~(host_page-1);
+	if (until<=from) return;
+#if defined(MADV_FREE)
+	madvise((void *)from,until-from,MADV_FREE);
+#else
+	madvise((void *)from,until-from,MADV_DONTNEED);
+#endif
+#endif
+}
+//--End of modifications
+
 void MEM_ReleasePages(MemHandle handle) {
+	//--Modified to discard the host pages behind each contiguous run of released pages
+	Bitu run_start=0,run_count=0;
 	while (handle>0) {
 		MemHandle next=memory.mhandles[handle];
 		memory.mhandles[handle]=0;
+		if (run_count && (Bitu)handle==run_start+run_count) run_count++;
+		else {
+			MEM_DiscardPages(run_start,run_count);
+			run_start=(Bitu)handle;
+			run_count=1;
+		}
 		handle=next;
 	}
+	MEM_DiscardPages(run_start,run_count);
+	//--End of modifications
 }
 
 bool MEM_ReAllocatePages(MemHandle & handle,Bitu pages,bool sequence) {
@@ -558,11 +811,26 @@ public:
 			LOG_MSG("Memory sizes above %d MB are NOT recommended.",SAFE_MEMORY - 1);
 			LOG_MSG("Stick with the default values unless you are absolutely certain.");
 		}
+		//--Modified for rewinding: main memory is page-aligned on the host, so that the
+		//rewind history can track which pages are written to by write-protecting them.
+		//It is mapped rather than allocated, so that its pages start out as shared zero
+		//pages and only take up memory once the guest touches them.
+#if !defined(WIN32)
+		void * mapping = mmap(NULL,memsize*1024*1024,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANON,-1,0);
+		MemBase = (mapping==MAP_FAILED) ? 0 : (HostPt)mapping;
+		if (!MemBase) E_Exit("Can't allocate main memory of %d MB",memsize);
+#if defined(MADV_HUGEPAGE)
+		//Rewinding write-protects individual pages, which the host splits back out as needed
+		madvise(mapping,memsize*1024*1024,MADV_HUGEPAGE);
+#endif
+#else
 		MemBase = new Bit8u[memsize*1024*1024];
 		if (!MemBase) E_Exit("Can't allocate main memory of %d MB",memsize);
 		/* Clear the memory, as new doesn't always give zeroed memory
 		 * (Visual C debug mode). We want zeroed memory though. */
 		memset((void*)MemBase,0,memsize*1024*1024);
+#endif
+		//--End of modifications
 		memory.pages = (memsize*1024*1024)/4096;
 		/* Allocate the data for the different page information blocks */
 		memory.phandlers=new  PageHandler * [memory.pages];
@@ -591,9 +859,40 @@ public:
 		WriteHandler.Install(0x92,write_p92,IO_MB);
 		ReadHandler.Install(0x92,read_p92,IO_MB);
 		MEM_A20_Enable(false);
+		SAVESTATE_Register("memory",this);	//--Added for save states
+	}
+	//--Added for save states. The page handlers are left alone, since they are set up by
+	//the devices that own them; the A20 gate's mapping is restored along with paging.
+	void SaveState(std::ostream& stream) {
+		SAVESTATE_Write(stream,memory.pages);
+		if (!SAVESTATE_MainMemoryExcluded()) SAVESTATE_WriteBlock(stream,MemBase,memory.pages*MEM_PAGESIZE);
+		SAVESTATE_WriteBlock(stream,memory.mhandles,memory.pages*sizeof(MemHandle));
+		SAVESTATE_Write(stream,memory.a20.enabled);
+		SAVESTATE_Write(stream,memory.a20.controlport);
+	}
+	void LoadState(std::istream& stream) {
+		Bitu pages=0;
+		SAVESTATE_Read(stream,pages);
+		if (pages!=memory.pages) {
+			stream.setstate(std::ios::failbit);
+			return;
+		}
+		if (!SAVESTATE_MainMemoryExcluded()) SAVESTATE_ReadBlock(stream,MemBase,memory.pages*MEM_PAGESIZE);
+		SAVESTATE_ReadBlock(stream,memory.mhandles,memory.pages*sizeof(MemHandle));
+		SAVESTATE_Read(stream,memory.a20.enabled);
+		SAVESTATE_Read(stream,memory.a20.controlport);
 	}
+	//--End of modifications
 	~MEMORY(){
+		SAVESTATE_Unregister(this);	//--Added for save states
+		//--Modified for rewinding: the history refers to main memory and must go with it
+		REWIND_Stop();
+#if !defined(WIN32)
+		munmap(MemBase,memory.pages*MEM_PAGESIZE);
+#else
 		delete [] MemBase;
+#endif
+		//--End of modifications
 		delete [] memory.phandlers;
 		delete [] memory.mhandles;
 	}
@@ -24,8 +24,14 @@
 */
 
 #include <string.h>
+//--Added to label the audio callback's signposts
+#include <stdio.h>
+//--End of modifications
 #include <sys/types.h>
 #include <math.h>
+//--Added for the resampler's coefficient tables
+#include <map>
+//--End of modifications
 
 #if defined (WIN32)
 //Midi listing
@@ -48,6 +54,12 @@
 #include "mapper.h"
 #include "hardware.h"
 #include "programs.h"
+//--Added for the performance counters
+#include "perfcounters.h"
+//--End of modifications
+//--Added to mark out mixed blocks and underruns for Instruments
+#include "signposts.h"
+//--End of modifications
 
 //--Added 2012-02-26 by Alun Bestor to give Boxer control over the mixer.
 #import "BXCoalfaceAudio.h"
@@ -56,18 +68,19 @@
 #define MIXER_SSIZE 4
 #define MIXER_SHIFT 14
 #define MIXER_REMAIN ((1<<MIXER_SHIFT)-1)
-#define MIXER_VOLSHIFT 13
 
-static INLINE Bit16s MIXER_CLIP(Bits SAMP) {
-	if (SAMP < MAX_AUDIO) {
-		if (SAMP > MIN_AUDIO)
-			return SAMP;
-		else return MIN_AUDIO;
-	} else return MAX_AUDIO;
+//--Modified to mix into a floating-point bus instead of fixed-point integers.
+//Channels add their samples at their own volume straight into the bus, which is only
+//clipped once, when it is converted to 16-bit output. The conversion works on
+//contiguous runs of the bus so that the compiler can vectorize it.
+static INLINE Bit16s MIXER_CLIP(float SAMP) {
+	SAMP = SAMP < MAX_AUDIO ? SAMP : MAX_AUDIO;
+	SAMP = SAMP > MIN_AUDIO ? SAMP : MIN_AUDIO;
+	return (Bit16s)SAMP;
 }
 
 static struct {
-	Bit32s work[MIXER_BUFSIZE][2];
+	float work[MIXER_BUFSIZE][2];
 	Bitu pos,done;
 	Bitu needed, min_needed, max_needed;
 	Bit32u tick_add,tick_remain;
@@ -76,13 +89,50 @@ static struct {
 	bool nosound;
 	Bit32u freq;
 	Bit32u blocksize;
+	//--Added to choose between linear and windowed-sinc resampling
+	bool sinc;
+	//--End of modifications
+	//--Added to play through CoreAudio rather than SDL
+	bool coreaudio;
+	//--End of modifications
 } mixer;
 
 Bit8u MixTemp[MIXER_BUFSIZE];
 
+/* Convert frames of the bus starting at pos to 16-bit stereo output */
+static void MIXER_ConvertBus(Bitu pos,Bit16s * output,Bitu frames) {
+	while (frames) {
+		Bitu todo=MIXER_BUFSIZE-pos;
+		if (todo>frames) todo=frames;
+		const float * input=&mixer.work[pos][0];
+		for (Bitu i=0;i<todo*2;i++) output[i]=MIXER_CLIP(input[i]);
+		output+=todo*2;
+		frames-=todo;
+		pos=(pos+todo)&MIXER_BUFMASK;
+	}
+}
+
+/* Silence frames of the bus starting at pos, ready for mixing into again */
+static void MIXER_ClearBus(Bitu pos,Bitu frames) {
+	while (frames) {
+		Bitu todo=MIXER_BUFSIZE-pos;
+		if (todo>frames) todo=frames;
+		memset(&mixer.work[pos][0],0,todo*sizeof(mixer.work[0]));
+		frames-=todo;
+		pos=(pos+todo)&MIXER_BUFMASK;
+	}
+}
+//--End of modifications
+
 MixerChannel * MIXER_AddChannel(MIXER_Handler handler,Bitu freq,const char * name) {
 	MixerChannel * chan=new MixerChannel();
 	chan->scale = 1.0f;
+	//--Added to start off without a resampling filter until SetFreq picks one
+	chan->sinc_table=0;
+	//--End of modifications
+	//--Added for the performance counters
+	chan->perf_ticks=0;
+	//--End of modifications
 	chan->handler=handler;
 	chan->name=name;
 	chan->SetFreq(freq);
@@ -93,6 +143,21 @@ MixerChannel * MIXER_AddChannel(MIXER_Handler handler,Bitu freq,const char * nam
 	return chan;
 }
 
+//--Added for the performance counters
+Bitu MIXER_TakeChannelTimings(PerfChannelTiming * timings,Bitu max) {
+	Bitu count=0;
+	for (MixerChannel * chan=mixer.channels;chan;chan=chan->next) {
+		if (count<max) {
+			safe_strncpy(timings[count].name,chan->name,sizeof(timings[count].name));
+			timings[count].seconds=PERF_Seconds(chan->perf_ticks);
+			count++;
+		}
+		chan->perf_ticks=0;
+	}
+	return count;
+}
+//--End of modifications
+
 MixerChannel * MIXER_FindChannel(const char * name) {
 	MixerChannel * chan=mixer.channels;
 	while (chan) {
@@ -116,12 +181,154 @@ void MIXER_DelChannel(MixerChannel* delchan) {
 	}
 }
 
+//--Added to hand mixed audio over to the audio callback without either side taking a lock.
+//The emulation thread is the only one to touch the mix bus and the channels: at the end of
+//each tick it converts what it has mixed into this ring, and the audio callback only ever
+//reads from the ring. Each side only advances its own position, so neither can block the other.
+#define MIXER_RINGSIZE MIXER_BUFSIZE
+#define MIXER_RINGMASK (MIXER_RINGSIZE-1)
+
+static struct {
+	Bit16s frames[MIXER_RINGSIZE][2];
+	volatile Bitu write_pos;	// frames written so far, only advanced by the emulation thread
+	volatile Bitu read_pos;		// frames read so far, only advanced by the audio callback
+	volatile Bitu underruns;	// only touched by the audio callback
+	volatile Bitu dropped;		// only touched by the emulation thread
+	volatile Bitu skipped;		// only touched by the audio callback
+	/* telemetry, only touched by the audio callback */
+	volatile Bitu callbacks;
+	volatile Bitu stretched;
+	volatile Bitu overruns;
+	volatile Bitu delay;
+	volatile Bit64u delay_total;
+	volatile Bitu delay_count;
+} mixer_ring;
+
+static INLINE Bitu MIXER_RingFill(void) {
+	return mixer_ring.write_pos-mixer_ring.read_pos;
+}
+
+/* To measure how long mixed audio waits before it is heard, each block written to the ring is
+   stamped with the host time it was mixed at, and the callback looks up the stamp of the first
+   frame it is about to play. The stamps are only written by the emulation thread, and published
+   along with the frames they describe. */
+#define MIXER_STAMPS 256
+#define MIXER_STAMPMASK (MIXER_STAMPS-1)
+
+static struct {
+	struct {
+		Bitu end_pos;		// the ring's write position once the block was written
+		Bit64u time;		// when it was written, in mach_absolute_time units
+	} blocks[MIXER_STAMPS];
+	volatile Bitu count;	// blocks stamped so far, only advanced by the emulation thread
+	Bitu next;				// the oldest stamp the callback may still need, only touched by the callback
+	mach_timebase_info_data_t timebase;
+} mixer_stamps;
+
+/* Record the time at which the ring was filled up to end_pos, called on the emulation thread
+   before the frames are published */
+static INLINE void MIXER_StampBlock(Bitu end_pos) {
+	Bitu index=mixer_stamps.count&MIXER_STAMPMASK;
+	mixer_stamps.blocks[index].end_pos=end_pos;
+	mixer_stamps.blocks[index].time=mach_absolute_time();
+}
+
+/* Measure how long the frame at read_pos has waited since it was mixed, adding the latency
+   of the output device that is still to come, called on the audio thread */
+static void MIXER_MeasureDelay(Bitu read_pos,Bitu device_latency) {
+	Bitu count=mixer_stamps.count;
+	__sync_synchronize();
+	Bitu next=mixer_stamps.next;
+	/* Leave a stamp's grace so that we never read one that is being overwritten */
+	if (count-next>=MIXER_STAMPS) next=count-MIXER_STAMPS+1;
+	while (next!=count && (Bits)(mixer_stamps.blocks[next&MIXER_STAMPMASK].end_pos-read_pos)<=0) next++;
+	mixer_stamps.next=next;
+	if (next==count) return;
+
+	if (!mixer_stamps.timebase.denom) mach_timebase_info(&mixer_stamps.timebase);
+	Bit64u waited=mach_absolute_time()-mixer_stamps.blocks[next&MIXER_STAMPMASK].time;
+	Bitu delay=(Bitu)(waited*mixer_stamps.timebase.numer/mixer_stamps.timebase.denom/1000);
+	if (mixer.freq) delay+=(Bitu)((Bit64u)device_latency*1000000/mixer.freq);
+	mixer_ring.delay=delay;
+	mixer_ring.delay_total+=delay;
+	mixer_ring.delay_count++;
+}
+
+/* Convert frames of the bus starting at pos into the ring, called on the emulation thread */
+static void MIXER_WriteRing(Bitu pos,Bitu frames) {
+	Bitu write_pos=mixer_ring.write_pos;
+	Bitu space=MIXER_RINGSIZE-(write_pos-mixer_ring.read_pos);
+	if (frames>space) {
+		mixer_ring.dropped+=frames-space;
+		frames=space;
+	}
+	while (frames) {
+		Bitu todo=MIXER_RINGSIZE-(write_pos&MIXER_RINGMASK);
+		if (todo>frames) todo=frames;
+		MIXER_ConvertBus(pos,&mixer_ring.frames[write_pos&MIXER_RINGMASK][0],todo);
+		pos=(pos+todo)&MIXER_BUFMASK;
+		write_pos+=todo;
+		frames-=todo;
+	}
+	if (write_pos==mixer_ring.write_pos) return;
+	MIXER_StampBlock(write_pos);
+	/* Make sure the frames and their stamp are in place before the callback can see them */
+	__sync_synchronize();
+	mixer_ring.write_pos=write_pos;
+	mixer_stamps.count++;
+}
+
+/* SDL doesn't tell us its device latency, so just count the block it plays out of */
+static Bitu MIXER_DeviceLatency(void) {
+	if (mixer.nosound) return 0;
+	else if (mixer.coreaudio) return boxer_audioOutputLatency();
+	else return mixer.blocksize;
+}
+
+void MIXER_GetBufferState(MIXER_BufferState * state) {
+	state->fill=mixer.nosound ? 0 : MIXER_RingFill();
+	state->target=mixer.min_needed;
+	state->capacity=MIXER_RINGSIZE;
+	state->underruns=mixer_ring.underruns;
+	state->dropped=mixer_ring.dropped+mixer_ring.skipped;
+	state->latency=MIXER_DeviceLatency();
+	state->callbacks=mixer_ring.callbacks;
+	state->stretched=mixer_ring.stretched;
+	state->overruns=mixer_ring.overruns;
+	state->skipped=mixer_ring.skipped;
+	state->delay=mixer_ring.delay;
+	state->delay_total=mixer_ring.delay_total;
+	state->delay_count=mixer_ring.delay_count;
+}
+//--End of modifications
+
+//--Added to pause and resume whichever output is in use
+void MIXER_PauseOutput(bool pause) {
+	if (mixer.nosound) return;
+	if (mixer.coreaudio) boxer_pauseAudioOutput(pause);
+	else SDL_PauseAudio(pause ? 1 : 0);
+}
+//--End of modifications
+
+//--Added to let Boxer adjust frameskip according to how much audio is buffered
+float MIXER_BufferFillLevel(void) {
+	if (mixer.nosound || !mixer.min_needed) return -1.0f;
+	//--Modified to measure what is waiting in the ring
+	//return (float)mixer.done / (float)mixer.min_needed;
+	return (float)MIXER_RingFill() / (float)mixer.min_needed;
+	//--End of modifications
+}
+//--End of modifications
+
 void MixerChannel::UpdateVolume(void) {
     //--Modified 2012-02-26 by Alun Bestor to give Boxer control over master volume
 	//volmul[0]=(Bits)((1 << MIXER_VOLSHIFT)*scale*volmain[0]*mixer.mastervol[0]);
 	//volmul[1]=(Bits)((1 << MIXER_VOLSHIFT)*scale*volmain[1]*mixer.mastervol[1]);
-	volmul[0]=(Bits)((1 << MIXER_VOLSHIFT)*scale*volmain[0]*boxer_masterVolume(BXLeftChannel));
-	volmul[1]=(Bits)((1 << MIXER_VOLSHIFT)*scale*volmain[1]*boxer_masterVolume(BXRightChannel));
+	//--Modified again to work with the floating-point mix bus
+	//volmul[0]=(Bits)((1 << MIXER_VOLSHIFT)*scale*volmain[0]*boxer_masterVolume(BXLeftChannel));
+	//volmul[1]=(Bits)((1 << MIXER_VOLSHIFT)*scale*volmain[1]*boxer_masterVolume(BXRightChannel));
+	volmul[0]=scale*volmain[0]*boxer_masterVolume(BXLeftChannel);
+	volmul[1]=scale*volmain[1]*boxer_masterVolume(BXRightChannel);
     //--End of modifications
 }
 
@@ -141,17 +348,156 @@ void MixerChannel::Enable(bool _yesno) {
 	enabled=_yesno;
 	if (enabled) {
 		freq_index=MIXER_REMAIN;
-		SDL_LockAudio();
+		//--Added to start the resampler afresh
+		if (sinc_table) ClearSincHistory();
+		//--End of modifications
+		//--Modified to drop the audio lock, as the callback no longer touches the channels
 		if (done<mixer.done) done=mixer.done;
-		SDL_UnlockAudio();
+		//--End of modifications
+	}
+}
+
+//--Added to resample channels whose rate differs from the mixer's through a windowed-sinc
+//filter, rather than by interpolating linearly between neighbouring samples, which aliases.
+//Each rate ratio gets a table of filter coefficients for every fractional position between
+//two input samples; the tables are built once and shared between channels.
+//The filter delays a channel by about half its length in input samples.
+#define MIXER_SINC_TAPS 16
+#define MIXER_SINC_PHASEBITS 8
+#define MIXER_SINC_PHASES (1<<MIXER_SINC_PHASEBITS)
+
+struct MixerSincTable {
+	float coeffs[MIXER_SINC_PHASES][MIXER_SINC_TAPS];
+};
+
+static std::map<Bitu,MixerSincTable *> mixer_sinc_tables;
+
+static MixerSincTable * MIXER_SincTable(Bitu freq_add) {
+	std::map<Bitu,MixerSincTable *>::iterator found=mixer_sinc_tables.find(freq_add);
+	if (found!=mixer_sinc_tables.end()) return found->second;
+
+	MixerSincTable * table=new MixerSincTable;
+	/* When the channel is faster than the mixer, cut off at the mixer's nyquist frequency instead of the channel's.
+	 * Either way leave a little room for the filter to roll off in. */
+	double cutoff=0.92;
+	if (freq_add>(1<<MIXER_SHIFT)) cutoff*=(double)(1<<MIXER_SHIFT)/freq_add;
+	const double half=MIXER_SINC_TAPS/2;
+	for (Bitu phase=0;phase<MIXER_SINC_PHASES;phase++) {
+		double frac=(phase+0.5)/MIXER_SINC_PHASES;
+		double sum=0;
+		for (Bitu tap=0;tap<MIXER_SINC_TAPS;tap++) {
+			/* The distance of this tap from the point we're sampling at */
+			double x=(double)tap+1-half-frac;
+			double sinc=x ? sin(M_PI*cutoff*x)/(M_PI*x) : cutoff;
+			/* Blackman window */
+			double window=0.42+0.5*cos(M_PI*x/half)+0.08*cos(2*M_PI*x/half);
+			table->coeffs[phase][tap]=(float)(sinc*window);
+			sum+=sinc*window;
+		}
+		/* Normalize each phase so the filter doesn't change the level */
+		for (Bitu tap=0;tap<MIXER_SINC_TAPS;tap++) table->coeffs[phase][tap]=(float)(table->coeffs[phase][tap]/sum);
+	}
+	mixer_sinc_tables[freq_add]=table;
+	return table;
+}
+
+template<class Type,bool signeddata,bool nativeorder>
+static INLINE Bits MIXER_ReadSample(const Type * data,Bitu index) {
+	if (sizeof(Type)==1) {
+		if (!signeddata) return ((Bit8s)(data[index] ^ 0x80)) << 8;
+		return data[index] << 8;
+	}
+	//16bit and 32bit both contain 16bit data internally
+	if (signeddata) {
+		if (nativeorder) return data[index];
+		if (sizeof(Type)==2) return (Bit16s)host_readw((HostPt)&data[index]);
+		return (Bit32s)host_readd((HostPt)&data[index]);
+	}
+	if (nativeorder) return (Bits)data[index]-32768;
+	if (sizeof(Type)==2) return (Bits)host_readw((HostPt)&data[index])-32768;
+	return (Bits)host_readd((HostPt)&data[index])-32768;
+}
+
+static INLINE float MIXER_SincSample(const float * coeffs,const float * input) {
+	float sample=0;
+	for (Bitu tap=0;tap<MIXER_SINC_TAPS;tap++) sample+=coeffs[tap]*input[tap];
+	return sample;
+}
+
+void MixerChannel::ClearSincHistory(void) {
+	sinc_input[0].assign(MIXER_SINC_TAPS,0.0f);
+	sinc_input[1].assign(MIXER_SINC_TAPS,0.0f);
+}
+
+/* Each input block is converted to floats after the tail of the previous block, and the
+ * filter then steps through it the same way the linear path does. */
+template<class Type,bool stereo,bool signeddata,bool nativeorder>
+inline void MixerChannel::AddSincSamples(Bitu len, const Type* data) {
+	float * input[2];
+	sinc_input[0].resize(MIXER_SINC_TAPS+len);
+	input[0]=&sinc_input[0][0];
+	if (stereo) {
+		sinc_input[1].resize(MIXER_SINC_TAPS+len);
+		input[1]=&sinc_input[1][0];
+		for (Bitu i=0;i<len;i++) {
+			input[0][MIXER_SINC_TAPS+i]=(float)MIXER_ReadSample<Type,signeddata,nativeorder>(data,i*2+0);
+			input[1][MIXER_SINC_TAPS+i]=(float)MIXER_ReadSample<Type,signeddata,nativeorder>(data,i*2+1);
+		}
+	} else {
+		input[1]=input[0];
+		for (Bitu i=0;i<len;i++) {
+			input[0][MIXER_SINC_TAPS+i]=(float)MIXER_ReadSample<Type,signeddata,nativeorder>(data,i);
+		}
+	}
+
+	Bitu mixpos=mixer.pos+done;
+	for (;;) {
+		Bitu pos=freq_index >> MIXER_SHIFT;
+		if (pos>=len) break;
+		const float * coeffs=sinc_table->coeffs[(freq_index & MIXER_REMAIN) >> (MIXER_SHIFT-MIXER_SINC_PHASEBITS)];
+		freq_index+=freq_add;
+		mixpos&=MIXER_BUFMASK;
+		float sample=MIXER_SincSample(coeffs,input[0]+pos+1);
+		mixer.work[mixpos][0]+=sample*volmul[0];
+		if (stereo) sample=MIXER_SincSample(coeffs,input[1]+pos+1);
+		mixer.work[mixpos][1]+=sample*volmul[1];
+		mixpos++;done++;
+	}
+	/* Carry on from the same point in the next block */
+	freq_index-=len << MIXER_SHIFT;
+
+	/* Keep the tail of this block, which the filter will need for the start of the next */
+	memmove(input[0],input[0]+len,MIXER_SINC_TAPS*sizeof(float));
+	sinc_input[0].resize(MIXER_SINC_TAPS);
+	if (stereo) {
+		memmove(input[1],input[1]+len,MIXER_SINC_TAPS*sizeof(float));
+		sinc_input[1].resize(MIXER_SINC_TAPS);
 	}
 }
+//--End of modifications
+
+//--Added for save states
+Bitu MixerChannel::GetFreq(void) {
+	return (Bitu)(((Bit64u)freq_add*mixer.freq+(1<<(MIXER_SHIFT-1))) >> MIXER_SHIFT);
+}
+//--End of modifications
 
 void MixerChannel::SetFreq(Bitu _freq) {
 	freq_add=(_freq<<MIXER_SHIFT)/mixer.freq;
+	//--Added to pick the resampling filter for this rate
+	MixerSincTable * table=(mixer.sinc && freq_add!=(1<<MIXER_SHIFT)) ? MIXER_SincTable(freq_add) : 0;
+	if (table && !sinc_table) {
+		ClearSincHistory();
+		freq_index&=MIXER_REMAIN;
+	}
+	sinc_table=table;
+	//--End of modifications
 }
 
 void MixerChannel::Mix(Bitu _needed) {
+	//--Added for the performance counters
+	PerfScope perf(PERF_MIXER,&perf_ticks);
+	//--End of modifications
 	needed=_needed;
 	while (enabled && needed>done) {
 		Bitu todo=needed-done;
@@ -166,11 +512,20 @@ void MixerChannel::AddSilence(void) {
 		done=needed;
 		last[0]=last[1]=0;
 		freq_index=MIXER_REMAIN;
+		//--Added to silence the resampler's history too
+		if (sinc_table) ClearSincHistory();
+		//--End of modifications
 	}
 }
 
 template<class Type,bool stereo,bool signeddata,bool nativeorder>
 inline void MixerChannel::AddSamples(Bitu len, const Type* data) {
+	//--Added to resample through the windowed-sinc filter where one has been chosen
+	if (sinc_table) {
+		AddSincSamples<Type,stereo,signeddata,nativeorder>(len,data);
+		return;
+	}
+	//--End of modifications
 	Bits diff[2];
 	Bitu mixpos=mixer.pos+done;
 	freq_index&=MIXER_REMAIN;
@@ -260,9 +615,9 @@ thestart:
 		freq_index+=freq_add;
 		mixpos&=MIXER_BUFMASK;
 		Bits sample=last[0]+((diff[0]*diff_mul) >> MIXER_SHIFT);
-		mixer.work[mixpos][0]+=sample*volmul[0];
+		mixer.work[mixpos][0]+=(float)sample*volmul[0];
 		if (stereo) sample=last[1]+((diff[1]*diff_mul) >> MIXER_SHIFT);
-		mixer.work[mixpos][1]+=sample*volmul[1];
+		mixer.work[mixpos][1]+=(float)sample*volmul[1];
 		mixpos++;done++;
 	}
 }
@@ -289,8 +644,8 @@ void MixerChannel::AddStretched(Bitu len,Bit16s * data) {
 		freq_index+=temp_add;
 		mixpos&=MIXER_BUFMASK;
 		Bits sample=last[0]+((diff*diff_mul) >> MIXER_SHIFT);
-		mixer.work[mixpos][0]+=sample*volmul[0];
-		mixer.work[mixpos][1]+=sample*volmul[1];
+		mixer.work[mixpos][0]+=(float)sample*volmul[0];
+		mixer.work[mixpos][1]+=(float)sample*volmul[1];
 		mixpos++;
 	}
 }
@@ -345,44 +700,45 @@ void MixerChannel::AddSamples_s32_nonnative(Bitu len,const Bit32s * data) {
 }
 
 void MixerChannel::FillUp(void) {
-	SDL_LockAudio();
+	//--Modified to drop the audio lock, as the callback no longer touches the channels
 	if (!enabled || done<mixer.done) {
-		SDL_UnlockAudio();
 		return;
 	}
 	float index=PIC_TickIndex();
 	Mix((Bitu)(index*mixer.needed));
-	SDL_UnlockAudio();
+	//--End of modifications
 }
 
 extern bool ticksLocked;
 static inline bool Mixer_irq_important(void) {
 	/* In some states correct timing of the irqs is more important then 
 	 * non stuttering audo */
-	return (ticksLocked || (CaptureState & (CAPTURE_WAVE|CAPTURE_VIDEO)));
+	return (ticksLocked || (CaptureState & (CAPTURE_WAVE|CAPTURE_VIDEO|CAPTURE_MOVIE)));
 }
 
 /* Mix a certain amount of new samples */
 static void MIXER_MixData(Bitu needed) {
+	SignpostScope signpost(SIGNPOST_MIXER);	//--Added to mark out the block for Instruments
 	MixerChannel * chan=mixer.channels;
 	while (chan) {
 		chan->Mix(needed);
 		chan=chan->next;
 	}
-	if (CaptureState & (CAPTURE_WAVE|CAPTURE_VIDEO)) {
+	if (CaptureState & (CAPTURE_WAVE|CAPTURE_VIDEO|CAPTURE_MOVIE)) {
 		Bit16s convert[1024][2];
 		Bitu added=needed-mixer.done;
 		if (added>1024) 
 			added=1024;
 		Bitu readpos=(mixer.pos+mixer.done)&MIXER_BUFMASK;
-		for (Bitu i=0;i<added;i++) {
-			Bits sample=mixer.work[readpos][0] >> MIXER_VOLSHIFT;
-			convert[i][0]=MIXER_CLIP(sample);
-			sample=mixer.work[readpos][1] >> MIXER_VOLSHIFT;
-			convert[i][1]=MIXER_CLIP(sample);
-			readpos=(readpos+1)&MIXER_BUFMASK;
-		}
-		CAPTURE_AddWave( mixer.freq, added, (Bit16s*)convert );
+		//--Modified to convert from the floating-point mix bus
+		MIXER_ConvertBus(readpos,&convert[0][0],added);
+		//--End of modifications
+		if (CaptureState & (CAPTURE_WAVE|CAPTURE_VIDEO))
+			CAPTURE_AddWave( mixer.freq, added, (Bit16s*)convert );
+		//--Added to let Boxer record movies with its own encoder
+		if (CaptureState & CAPTURE_MOVIE)
+			boxer_recordMixerOutput( mixer.freq, added, (Bit16s*)convert );
+		//--End of modifications
 	}
 	//Reset the the tick_add for constant speed
 	if( Mixer_irq_important() )
@@ -390,23 +746,14 @@ static void MIXER_MixData(Bitu needed) {
 	mixer.done = needed;
 }
 
-static void MIXER_Mix(void) {
-	SDL_LockAudio();
-	MIXER_MixData(mixer.needed);
-	mixer.tick_remain+=mixer.tick_add;
-	mixer.needed+=(mixer.tick_remain>>MIXER_SHIFT);
-	mixer.tick_remain&=MIXER_REMAIN;
-	SDL_UnlockAudio();
-}
+//--Modified so that every tick, the frames mixed so far are handed on and the bus is
+//cleared for the next tick, whether or not there is any sound output. The rate control
+//that used to happen in the audio callback now happens here, based on how full the ring is.
 
-static void MIXER_Mix_NoSound(void) {
-	MIXER_MixData(mixer.needed);
-	/* Clear piece we've just generated */
-	for (Bitu i=0;i<mixer.needed;i++) {
-		mixer.work[mixer.pos][0]=0;
-		mixer.work[mixer.pos][1]=0;
-		mixer.pos=(mixer.pos+1)&MIXER_BUFMASK;
-	}
+/* Clear the piece we've just generated and set up for the next tick */
+static void MIXER_NextTick(void) {
+	MIXER_ClearBus(mixer.pos,mixer.needed);
+	mixer.pos=(mixer.pos+mixer.needed)&MIXER_BUFMASK;
 	/* Reduce count in channels */
 	for (MixerChannel * chan=mixer.channels;chan;chan=chan->next) {
 		if (chan->done>mixer.needed) chan->done-=mixer.needed;
@@ -419,112 +766,126 @@ static void MIXER_Mix_NoSound(void) {
 	mixer.done=0;
 }
 
+//--Added so that when Boxer warps emulated time, each tick mixes the frames for the host time
+//it takes rather than the emulated time, resampling the sound to the warped rate.
+extern double ticksRate;
+static inline Bitu MIXER_TickFrequency(void) {
+	return (Bitu)((double)mixer.freq/ticksRate+0.5);
+}
+//--End of modifications
+
+/* Speed up or slow down how much we mix per tick to keep the ring near the prebuffer level */
+//--Modified to mix at MIXER_TickFrequency instead of mixer.freq
+static void MIXER_AdjustTickRate(void) {
+	if (Mixer_irq_important()) return;
+	Bitu fill=MIXER_RingFill();
+	Bitu freq=MIXER_TickFrequency();
+	if (fill < mixer.min_needed) {
+		Bitu diff=mixer.min_needed-fill;
+		mixer.tick_add=((freq+(diff*3)) << MIXER_SHIFT)/1000;
+	} else {
+		/* Mixer tick value being updated:
+		 * 3 cases:
+		 * 1) A lot too high. >division by 5. but maxed by 2* min to prevent too fast drops.
+		 * 2) A little too high > division by 8
+		 * 3) A little to nothing above the min_needed buffer > go to default value
+		 */
+		Bitu diff=fill-mixer.min_needed;
+		if(diff > (mixer.min_needed<<1)) diff = mixer.min_needed<<1;
+		if(diff > (mixer.min_needed>>1))
+			mixer.tick_add = ((freq-(diff/5)) << MIXER_SHIFT)/1000;
+		else if (diff > (mixer.min_needed>>4))
+			mixer.tick_add = ((freq-(diff>>3)) << MIXER_SHIFT)/1000;
+		else
+			mixer.tick_add = (freq<< MIXER_SHIFT)/1000;
+	}
+}
+//--End of modifications
+
+static void MIXER_Mix(void) {
+	MIXER_MixData(mixer.needed);
+	MIXER_WriteRing(mixer.pos,mixer.needed);
+	MIXER_AdjustTickRate();
+	MIXER_NextTick();
+}
+
+static void MIXER_Mix_NoSound(void) {
+	MIXER_MixData(mixer.needed);
+	MIXER_NextTick();
+}
+
+/* Called on the audio thread: this only ever reads from the ring */
 static void MIXER_CallBack(void * userdata, Uint8 *stream, int len) {
 	Bitu need=(Bitu)len/MIXER_SSIZE;
 	Bit16s * output=(Bit16s *)stream;
-	Bitu reduce;
-	Bitu pos, index, index_add;
-	Bits sample;
-	/* Enough room in the buffer ? */
-	if (mixer.done < need) {
-//		LOG_MSG("Full underrun need %d, have %d, min %d", need, mixer.done, mixer.min_needed);
-		if((need - mixer.done) > (need >>7) ) //Max 1 procent stretch.
-			return;
-		reduce = mixer.done;
-		index_add = (reduce << MIXER_SHIFT) / need;
-		mixer.tick_add = ((mixer.freq+mixer.min_needed) << MIXER_SHIFT)/1000;
-	} else if (mixer.done < mixer.max_needed) {
-		Bitu left = mixer.done - need;
-		if (left < mixer.min_needed) {
-			if( !Mixer_irq_important() ) {
-				Bitu needed = mixer.needed - need;
-				Bitu diff = (mixer.min_needed>needed?mixer.min_needed:needed) - left;
-				mixer.tick_add = ((mixer.freq+(diff*3)) << MIXER_SHIFT)/1000;
-				left = 0; //No stretching as we compensate with the tick_add value
-			} else {
-				left = (mixer.min_needed - left);
-				left = 1 + (2*left) / mixer.min_needed; //left=1,2,3
-			}
-//			LOG_MSG("needed underrun need %d, have %d, min %d, left %d", need, mixer.done, mixer.min_needed, left);
-			reduce = need - left;
-			index_add = (reduce << MIXER_SHIFT) / need;
-		} else {
-			reduce = need;
-			index_add = (1 << MIXER_SHIFT);
-//			LOG_MSG("regular run need %d, have %d, min %d, left %d", need, mixer.done, mixer.min_needed, left);
-
-			/* Mixer tick value being updated:
-			 * 3 cases:
-			 * 1) A lot too high. >division by 5. but maxed by 2* min to prevent too fast drops.
-			 * 2) A little too high > division by 8
-			 * 3) A little to nothing above the min_needed buffer > go to default value
-			 */
-			Bitu diff = left - mixer.min_needed;
-			if(diff > (mixer.min_needed<<1)) diff = mixer.min_needed<<1;
-			if(diff > (mixer.min_needed>>1))
-				mixer.tick_add = ((mixer.freq-(diff/5)) << MIXER_SHIFT)/1000;
-			else if (diff > (mixer.min_needed>>4))
-				mixer.tick_add = ((mixer.freq-(diff>>3)) << MIXER_SHIFT)/1000;
-			else
-				mixer.tick_add = (mixer.freq<< MIXER_SHIFT)/1000;
-		}
-	} else {
-		/* There is way too much data in the buffer */
-//		LOG_MSG("overflow run need %d, have %d, min %d", need, mixer.done, mixer.min_needed);
-		if (mixer.done > MIXER_BUFSIZE)
-			index_add = MIXER_BUFSIZE - 2*mixer.min_needed;
-		else 
-			index_add = mixer.done - 2*mixer.min_needed;
-		index_add = (index_add << MIXER_SHIFT) / need;
-		reduce = mixer.done - 2* mixer.min_needed;
-		mixer.tick_add = ((mixer.freq-(mixer.min_needed/5)) << MIXER_SHIFT)/1000;
-	}
-	/* Reduce done count in all channels */
-	for (MixerChannel * chan=mixer.channels;chan;chan=chan->next) {
-		if (chan->done>reduce) chan->done-=reduce;
-		else chan->done=0;
+	Bitu read_pos=mixer_ring.read_pos;
+	Bitu available=mixer_ring.write_pos-read_pos;
+	/* Make sure we see the frames that were written before write_pos was */
+	__sync_synchronize();
+	mixer_ring.callbacks++;
+	const char * outcome="play";
+
+	/* There is way too much data in the ring: skip the oldest so latency doesn't build up */
+	if (available > mixer.max_needed+need) {
+		Bitu skip=available-(2*mixer.min_needed+need);
+		mixer_ring.skipped+=skip;
+		read_pos+=skip;
+		available-=skip;
+		mixer_ring.overruns++;
+		outcome="skip";
 	}
-   
-	// Reset mixer.tick_add when irqs are important
-	if( Mixer_irq_important() )
-		mixer.tick_add=(mixer.freq<< MIXER_SHIFT)/1000;
-
-	mixer.done -= reduce;
-	mixer.needed -= reduce;
-	pos = mixer.pos;
-	mixer.pos = (mixer.pos + reduce) & MIXER_BUFMASK;
-	index = 0;
-	if(need != reduce) {
-		while (need--) {
-			Bitu i = (pos + (index >> MIXER_SHIFT )) & MIXER_BUFMASK;
-			index += index_add;
-			sample=mixer.work[i][0]>>MIXER_VOLSHIFT;
-			*output++=MIXER_CLIP(sample);
-			sample=mixer.work[i][1]>>MIXER_VOLSHIFT;
-			*output++=MIXER_CLIP(sample);
+
+	/* Measure how long the audio we're about to play has waited since it was mixed,
+	   and label the callback for Instruments with how it went */
+	if (available) MIXER_MeasureDelay(read_pos,MIXER_DeviceLatency());
+	if (available<need) outcome=(available && (need - available) <= (need >>7)) ? "stretch" : "underrun";
+	char detail[64]="";
+	if (SIGNPOST_Enabled(SIGNPOST_AUDIO_CALLBACK))
+		snprintf(detail,sizeof(detail),"%lu of %lu frames ready, %lu us delay",
+			(unsigned long)available,(unsigned long)need,(unsigned long)mixer_ring.delay);
+	SignpostScope callback_signpost(SIGNPOST_AUDIO_CALLBACK,outcome,detail);
+
+	if (available >= need) {
+		while (need) {
+			Bitu todo=MIXER_RINGSIZE-(read_pos&MIXER_RINGMASK);
+			if (todo>need) todo=need;
+			memcpy(output,&mixer_ring.frames[read_pos&MIXER_RINGMASK][0],todo*MIXER_SSIZE);
+			output+=todo*2;
+			read_pos+=todo;
+			need-=todo;
 		}
-		/* Clean the used buffer */
-		while (reduce--) {
-			pos &= MIXER_BUFMASK;
-			mixer.work[pos][0]=0;
-			mixer.work[pos][1]=0;
-			pos++;
+	} else if (available && (need - available) <= (need >>7)) {
+		/* Max 1 procent stretch */
+		mixer_ring.stretched++;
+		Bitu index=0;
+		Bitu index_add=(available << MIXER_SHIFT) / need;
+		while (need--) {
+			Bitu i=(read_pos+(index >> MIXER_SHIFT)) & MIXER_RINGMASK;
+			index+=index_add;
+			*output++=mixer_ring.frames[i][0];
+			*output++=mixer_ring.frames[i][1];
 		}
+		read_pos+=available;
 	} else {
-		while (reduce--) {
-			pos &= MIXER_BUFMASK;
-			sample=mixer.work[pos][0]>>MIXER_VOLSHIFT;
-			*output++=MIXER_CLIP(sample);
-			sample=mixer.work[pos][1]>>MIXER_VOLSHIFT;
-			*output++=MIXER_CLIP(sample);
-			mixer.work[pos][0]=0;
-			mixer.work[pos][1]=0;
-			pos++;
-		}
+		/* Full underrun: play silence and leave what there is to build up */
+		SignpostScope signpost(SIGNPOST_UNDERRUN);	//--Added to mark the dropout for Instruments
+		mixer_ring.underruns++;
+		memset(stream,0,len);
+		if (read_pos==mixer_ring.read_pos) return;
 	}
+	/* Make sure we're done with the frames before the emulation thread can reuse them */
+	__sync_synchronize();
+	mixer_ring.read_pos=read_pos;
 }
+//--End of modifications
 
 static void MIXER_Stop(Section* sec) {
+	//--Added to shut down the CoreAudio output, which SDL won't do for us
+	if (mixer.coreaudio) {
+		boxer_closeAudioOutput();
+		mixer.coreaudio=false;
+	}
+	//--End of modifications
 }
 
 class MIXER : public Program {
@@ -632,6 +993,13 @@ void MIXER_Init(Section* sec) {
 	mixer.freq=section->Get_int("rate");
 	mixer.nosound=section->Get_bool("nosound");
 	mixer.blocksize=section->Get_int("blocksize");
+	//--Added to choose how channels are resampled
+	mixer.sinc=!strcasecmp(section->Get_string("resampler"),"sinc");
+	//--End of modifications
+	//--Added to choose how the mixed sound is played
+	mixer.coreaudio=!strcasecmp(section->Get_string("output"),"coreaudio");
+	bool lowlatency=section->Get_bool("lowlatency");
+	//--End of modifications
 
 	/* Initialize the internal stuff */
 	mixer.channels=0;
@@ -654,10 +1022,32 @@ void MIXER_Init(Section* sec) {
 	spec.samples=(Uint16)mixer.blocksize;
 
 	mixer.tick_remain=0;
+	//--Added to try CoreAudio first, falling back on SDL if it can't be opened.
+	//In low-latency mode ask for a tiny device buffer, which CoreAudio will round up if the device needs.
+	if (mixer.coreaudio && !mixer.nosound) {
+		Bit32u freq=mixer.freq;
+		Bit32u blocksize=lowlatency ? 32 : mixer.blocksize;
+		if (boxer_openAudioOutput(&freq,&blocksize,MIXER_CallBack)) {
+			if (mixer.freq != freq)
+				LOG_MSG("MIXER:Running at the output device's rate of %d",freq);
+			mixer.freq=freq;
+			mixer.blocksize=blocksize;
+		} else {
+			LOG_MSG("MIXER:Can't open CoreAudio output, falling back on SDL.");
+			mixer.coreaudio=false;
+		}
+	}
+	//--End of modifications
 	if (mixer.nosound) {
 		LOG_MSG("MIXER:No Sound Mode Selected.");
+		mixer.coreaudio=false;
 		mixer.tick_add=((mixer.freq) << MIXER_SHIFT)/1000;
 		TIMER_AddTickHandler(MIXER_Mix_NoSound);
+	//--Modified to skip SDL when CoreAudio is already playing
+	} else if (mixer.coreaudio) {
+		mixer.tick_add=(mixer.freq << MIXER_SHIFT)/1000;
+		TIMER_AddTickHandler(MIXER_Mix);
+	//--End of modifications
 	} else if (SDL_OpenAudio(&spec, &obtained) <0 ) {
 		mixer.nosound = true;
 		LOG_MSG("MIXER:Can't open audio: %s , running in nosound mode.",SDL_GetError());
@@ -670,13 +1060,18 @@ void MIXER_Init(Section* sec) {
 		mixer.blocksize=obtained.samples;
 		mixer.tick_add=(mixer.freq << MIXER_SHIFT)/1000;
 		TIMER_AddTickHandler(MIXER_Mix);
-		SDL_PauseAudio(0);
 	}
 	mixer.min_needed=section->Get_int("prebuffer");
 	if (mixer.min_needed>100) mixer.min_needed=100;
+	//--Added to keep the ring short in low-latency mode
+	if (lowlatency && mixer.min_needed>5) mixer.min_needed=5;
+	//--End of modifications
 	mixer.min_needed=(mixer.freq*mixer.min_needed)/1000;
 	mixer.max_needed=mixer.blocksize * 2 + 2*mixer.min_needed;
 	mixer.needed=mixer.min_needed+1;
+	//--Modified to start the callback only once the buffer sizes it reads are known
+	if (!mixer.nosound) MIXER_PauseOutput(false);
+	//--End of modifications
 	PROGRAMS_MakeFile("MIXER.COM",MIXER_ProgramStart);
 }
 
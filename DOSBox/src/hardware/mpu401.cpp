@@ -27,6 +27,9 @@
 #include "support.h"
 
 void MIDI_RawOutByte(Bit8u data);
+//--Added to pass on whole messages along with the emulated time they were due
+void MIDI_RawOutMessage(const Bit8u * msg,Bitu len,double timestamp);
+//--End of modifications
 bool MIDI_Available(void);
 
 static void MPU401_Event(Bitu);
@@ -37,6 +40,10 @@ static void MPU401_EOIHandler(void);
 #define MPU401_REVISION	0x01
 #define MPU401_QUEUE 32
 #define MPU401_TIMECONSTANT (60000000/1000.0f)
+//--Added to schedule one event for whenever the next track, conductor or clock message falls due,
+//rather than one for every tick of the MPU's clock. This bounds how far ahead that event can be.
+#define MPU401_MAX_TICKS 0xf0
+//--End of modifications
 
 enum MpuMode { M_UART,M_INTELLIGENT };
 enum MpuDataType {T_OVERFLOW,T_MARK,T_MIDI_SYS,T_MIDI_NORM,T_COMMAND};
@@ -88,6 +95,14 @@ static struct {
 		Bit8u cth_rate,cth_counter;
 		bool clock_to_host,cth_active;
 	} clock;
+	//--Added to track the MPU's clock between events: tick_start is the emulated time of the
+	//last tick the counters have been brought up to, and due is how many ticks after that
+	//the pending event is for.
+	struct {
+		double tick_start;
+		Bits due;
+	} sched;
+	//--End of modifications
 } mpu;
 
 
@@ -139,8 +154,14 @@ static void MPU401_WriteCommand(Bitu port,Bitu val,Bitu iolen) {
 			case 0x8:	/* Play */
 				LOG(LOG_MISC,LOG_NORMAL)("MPU-401:Intelligent mode playback started");
 				mpu.state.playing=true;
+				//--Modified to start the clock from now and leave scheduling the first event
+				//to the port handler, once the command has been dealt with
+				/*
 				PIC_RemoveEvents(MPU401_Event);
 				PIC_AddEvent(MPU401_Event,MPU401_TIMECONSTANT/(mpu.clock.tempo*mpu.clock.timebase));
+				*/
+				mpu.sched.tick_start=PIC_FullIndex();
+				//--End of modifications
 				ClrQueue();
 				break;
 		}
@@ -480,8 +501,13 @@ static void MPU401_IntelligentOut(Bit8u chan) {
 			}
 			break;
 		case T_MIDI_NORM:
+			//--Modified to send the message in one piece, stamped with the emulated time it was due
+			/*
 			for (Bitu i=0;i<mpu.playbuf[chan].vlength;i++)
 				MIDI_RawOutByte(mpu.playbuf[chan].value[i]);
+			*/
+			MIDI_RawOutMessage(mpu.playbuf[chan].value,mpu.playbuf[chan].vlength,PIC_FullIndex());
+			//--End of modifications
 			break;
 		default:
 			break;
@@ -513,9 +539,106 @@ static void UpdateConductor(void) {
 	mpu.state.req_mask|=(1<<9);
 }
 
+//--Added to count the MPU's clock in whole spans of ticks instead of one tick at a time
+
+static double MPU401_TickLength(void) {
+	Bitu rate=mpu.clock.tempo*mpu.clock.timebase;
+	return rate ? MPU401_TIMECONSTANT/rate : 0;
+}
+
+// how many ticks until the next track, conductor or clock-to-host message falls due:
+// a counter falls due on the tick that takes it to 0 or below
+static Bits MPU401_TicksUntilDue(void) {
+	Bits due=MPU401_MAX_TICKS;
+	for (Bitu i=0;i<8;i++) {
+		if ((mpu.state.amask&(1<<i)) && mpu.playbuf[i].counter<due) due=mpu.playbuf[i].counter;
+	}
+	if (mpu.state.conductor && mpu.condbuf.counter<due) due=mpu.condbuf.counter;
+	if (mpu.clock.clock_to_host) {
+		Bits cth=(Bits)mpu.clock.cth_rate-(Bits)mpu.clock.cth_counter;
+		if (cth<due) due=cth;
+	}
+	return (due<1) ? 1 : due;
+}
+
+// counts down the specified number of ticks, none of which may bring anything due
+static void MPU401_SkipTicks(Bits ticks) {
+	if (ticks<=0) return;
+	for (Bitu i=0;i<8;i++) {
+		if (mpu.state.amask&(1<<i)) mpu.playbuf[i].counter-=ticks;
+	}
+	if (mpu.state.conductor) mpu.condbuf.counter-=ticks;
+	if (mpu.clock.clock_to_host) mpu.clock.cth_counter+=(Bit8u)ticks;
+}
+
+// brings the counters up to the last tick that has passed, for when the program is about to
+// see or change them between events. Counters stand still while an interrupt is pending,
+// but the clock keeps ticking.
+static void MPU401_SyncTicks(void) {
+	if (mpu.mode==M_UART || !mpu.state.playing) return;
+	double length=MPU401_TickLength();
+	if (length<=0) return;
+	Bits elapsed=(Bits)((PIC_FullIndex()-mpu.sched.tick_start)/length);
+	if (elapsed<=0) return;
+	if (!mpu.state.irq_pending && mpu.sched.due>0) {
+		// leave the tick that brings something due to the event itself
+		if (elapsed>=mpu.sched.due) elapsed=mpu.sched.due-1;
+		MPU401_SkipTicks(elapsed);
+		mpu.sched.due-=elapsed;
+	}
+	mpu.sched.tick_start+=elapsed*length;
+}
+
+// schedules a single event for the tick on which something next falls due. Nothing is
+// scheduled while an interrupt is pending, since the counters cannot move until it is
+// acknowledged, and acknowledging it goes through a port handler which schedules afresh.
+static void MPU401_ScheduleEvent(void) {
+	PIC_RemoveEvents(MPU401_Event);
+	mpu.sched.due=0;
+	if (mpu.mode==M_UART || !mpu.state.playing || mpu.state.irq_pending) return;
+	double length=MPU401_TickLength();
+	if (length<=0) return;
+	mpu.sched.due=MPU401_TicksUntilDue();
+	double delay=mpu.sched.tick_start+mpu.sched.due*length-PIC_FullIndex();
+	PIC_AddEvent(MPU401_Event,(delay>0) ? (float)delay : 0.0f);
+}
+
+// the port handlers the program actually talks to: these bring the counters up to date
+// before the program can see or change them, and schedule the next event afresh afterwards
+static Bitu MPU401_ReadDataPort(Bitu port,Bitu iolen) {
+	if (mpu.mode==M_UART) return MPU401_ReadData(port,iolen);
+	MPU401_SyncTicks();
+	Bitu ret=MPU401_ReadData(port,iolen);
+	MPU401_ScheduleEvent();
+	return ret;
+}
+
+static void MPU401_WriteDataPort(Bitu port,Bitu val,Bitu iolen) {
+	if (mpu.mode==M_UART) {MPU401_WriteData(port,val,iolen);return;}
+	MPU401_SyncTicks();
+	MPU401_WriteData(port,val,iolen);
+	MPU401_ScheduleEvent();
+}
+
+static void MPU401_WriteCommandPort(Bitu port,Bitu val,Bitu iolen) {
+	MPU401_SyncTicks();
+	MPU401_WriteCommand(port,val,iolen);
+	MPU401_ScheduleEvent();
+}
+//--End of modifications
+
 static void MPU401_Event(Bitu val) {
 	if (mpu.mode==M_UART) return;
+	//--Modified to count down all the ticks the event was scheduled across: every tick but the last
+	//is known to bring nothing due, so the last one is the only one that needs stepping through
+	/*
 	if (mpu.state.irq_pending) goto next_event;
+	*/
+	if (mpu.state.irq_pending || mpu.sched.due<=0) return;
+	MPU401_SkipTicks(mpu.sched.due-1);
+	mpu.sched.tick_start+=mpu.sched.due*MPU401_TickLength();
+	mpu.sched.due=0;
+	//--End of modifications
 	for (Bitu i=0;i<8;i++) { /* Decrease counters */
 		if (mpu.state.amask&(1<<i)) {
 			mpu.playbuf[i].counter--;
@@ -534,11 +657,16 @@ static void MPU401_Event(Bitu val) {
 		}
 	}
 	if (!mpu.state.irq_pending && mpu.state.req_mask) MPU401_EOIHandler();
+	//--Modified to schedule the next event for whenever something next falls due
+	/*
 next_event:
 	PIC_RemoveEvents(MPU401_Event);
 	Bitu new_time;
 	if ((new_time=mpu.clock.tempo*mpu.clock.timebase)==0) return;
 	PIC_AddEvent(MPU401_Event,MPU401_TIMECONSTANT/new_time);
+	*/
+	MPU401_ScheduleEvent();
+	//--End of modifications
 }
 
 static void MPU401_EOIHandler(void) {
@@ -583,6 +711,10 @@ static void MPU401_Reset(void) {
 	mpu.clock.clock_to_host=false;
 	mpu.clock.cth_rate=60;
 	mpu.clock.cth_counter=0;
+	//--Added to clear the MPU's clock along with everything else
+	mpu.sched.tick_start=0;
+	mpu.sched.due=0;
+	//--End of modifications
 	ClrQueue();
 	mpu.state.req_mask=0;
 	mpu.condbuf.counter=0;
@@ -607,9 +739,16 @@ public:
 		/*Enabled and there is a Midi */
 		installed = true;
 		
+		//--Modified to go through the handlers that keep the MPU's clock in step
+		/*
 		WriteHandler[0].Install(0x330,&MPU401_WriteData,IO_MB);
 		WriteHandler[1].Install(0x331,&MPU401_WriteCommand,IO_MB);
 		ReadHandler[0].Install(0x330,&MPU401_ReadData,IO_MB);
+		*/
+		WriteHandler[0].Install(0x330,&MPU401_WriteDataPort,IO_MB);
+		WriteHandler[1].Install(0x331,&MPU401_WriteCommandPort,IO_MB);
+		ReadHandler[0].Install(0x330,&MPU401_ReadDataPort,IO_MB);
+		//--End of modifications
 		ReadHandler[1].Install(0x331,&MPU401_ReadStatus,IO_MB);
 	
 		mpu.queue_used=0;
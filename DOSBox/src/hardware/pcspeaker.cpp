@@ -19,6 +19,9 @@
  /* $Id: pcspeaker.cpp,v 1.26 2009-05-27 09:15:41 qbix79 Exp $ */
 
 #include <math.h>
+//--Added for the band-limited steps
+#include <string.h>
+//--End of modifications
 #include "dosbox.h"
 #include "mixer.h"
 #include "timer.h"
@@ -33,7 +36,18 @@
 #define SPKR_ENTRIES 1024
 #define SPKR_VOLUME 5000
 //#define SPKR_SHIFT 8
-#define SPKR_SPEED (float)((SPKR_VOLUME*2)/0.070f)
+//--Removed along with the volume slide, which the band-limited steps below make unnecessary
+//#define SPKR_SPEED (float)((SPKR_VOLUME*2)/0.070f)
+//--End of modifications
+
+//--Added to synthesize the output from band-limited steps: see PCSPEAKER_CallBack.
+//Each step is spread over this many output samples, and is tabled at this many fractional positions.
+#define SPKR_BLEP_TAPS 16
+#define SPKR_BLEP_PHASES 64
+//The impulse's cutoff, as a fraction of the output's Nyquist frequency
+#define SPKR_BLEP_CUTOFF 0.9
+#define SPKR_MAX_BLOCK (MIXER_BUFSIZE/sizeof(Bit16s))
+//--End of modifications
 
 enum SPKR_MODES {
 	SPKR_OFF,SPKR_ON,SPKR_PIT_OFF,SPKR_PIT_ON
@@ -54,14 +68,51 @@ static struct {
 	float pit_new_max,pit_new_half;
 	float pit_max,pit_half;
 	float pit_index;
+	//--Modified: volwant is now the level after the last step, and volcur the output's level
+	//once the steps so far have been summed up
 	float volwant,volcur;
+	//--End of modifications
 	Bitu last_ticks;
 	float last_index;
 	Bitu min_tr;
 	DelayEntry entries[SPKR_ENTRIES];
 	Bitu used;
+	//--Added for the band-limited steps: the changes in level still to be summed into the output,
+	//starting from the next output sample, and whether any of them may be nonzero
+	float deltas[SPKR_MAX_BLOCK+SPKR_BLEP_TAPS+1];
+	bool deltas_pending;
+	//--End of modifications
 } spkr;
 
+//--Added for the band-limited steps: a windowed-sinc impulse for each fractional position,
+//normalized so that each sums to 1. Summed up, an impulse gives a step without the aliasing
+//a sharp step would have; its midpoint lies SPKR_BLEP_TAPS/2-1 samples after the step's position.
+static float spkr_blep[SPKR_BLEP_PHASES+1][SPKR_BLEP_TAPS];
+
+static void SPKR_MakeBlepTable(void) {
+	for (Bitu phase=0;phase<=SPKR_BLEP_PHASES;phase++) {
+		double offset=(double)phase/SPKR_BLEP_PHASES;
+		double sum=0;
+		for (Bitu tap=0;tap<SPKR_BLEP_TAPS;tap++) {
+			double x=(double)tap-(SPKR_BLEP_TAPS/2-1)-offset;
+			double sinc=(x==0) ? SPKR_BLEP_CUTOFF : sin(PI*x*SPKR_BLEP_CUTOFF)/(PI*x);
+			double window=0.42+0.5*cos(2*PI*x/SPKR_BLEP_TAPS)+0.08*cos(4*PI*x/SPKR_BLEP_TAPS);
+			spkr_blep[phase][tap]=(float)(sinc*window);
+			sum+=sinc*window;
+		}
+		for (Bitu tap=0;tap<SPKR_BLEP_TAPS;tap++) spkr_blep[phase][tap]/=(float)sum;
+	}
+}
+
+//Adds a change in level at the given position in output samples from the start of the block
+static INLINE void SPKR_AddStep(float pos,float delta) {
+	Bitu sample=(Bitu)pos;
+	const float * impulse=spkr_blep[(Bitu)((pos-sample)*SPKR_BLEP_PHASES+0.5f)];
+	float * out=spkr.deltas+sample;
+	for (Bitu tap=0;tap<SPKR_BLEP_TAPS;tap++) out[tap]+=delta*impulse[tap];
+}
+//--End of modifications
+
 static void AddDelayEntry(float index,float vol) {
 	if (spkr.used==SPKR_ENTRIES) {
 		return;
@@ -247,60 +298,39 @@ void PCSPEAKER_SetType(Bitu mode) {
 	};
 }
 
+//--Modified to synthesize the output from band-limited steps, rather than integrating the level
+//over each output sample with a volume slide to soften the edges. Each change in level becomes
+//a tabled impulse added into the deltas, so its cost doesn't depend on the output rate, and
+//the output is just the running sum of the deltas: while there are none it is a flat level.
 static void PCSPEAKER_CallBack(Bitu len) {
 	Bit16s * stream=(Bit16s*)MixTemp;
 	ForwardPIT(1);
 	spkr.last_index=0;
-	Bitu count=len;
-	Bitu pos=0;
-	float sample_base=0;
-	float sample_add=(1.0001f)/len;
-	while (count--) {
-		float index=sample_base;
-		sample_base+=sample_add;
-		float end=sample_base;
-		double value=0;
-		while(index<end) {
-			/* Check if there is an upcoming event */
-			if (spkr.used && spkr.entries[pos].index<=index) {
-				spkr.volwant=spkr.entries[pos].vol;
-				pos++;spkr.used--;
-				continue;
-			}
-			float vol_end;
-			if (spkr.used && spkr.entries[pos].index<end) {
-				vol_end=spkr.entries[pos].index;
-			} else vol_end=end;
-			float vol_len=vol_end-index;
-            /* Check if we have to slide the volume */
-			float vol_diff=spkr.volwant-spkr.volcur;
-			if (vol_diff == 0) {
-				value+=spkr.volcur*vol_len;
-				index+=vol_len;
-			} else {
-				/* Check how long it will take to goto new level */
-				float vol_time=(float)(fabs(vol_diff)/SPKR_SPEED);
-				if (vol_time<=vol_len) {
-					/* Volume reaches endpoint in this block, calc until that point */
-					value+=vol_time*spkr.volcur;
-					value+=vol_time*vol_diff/2;
-					index+=vol_time;
-					spkr.volcur=spkr.volwant;
-				} else {
-					/* Volume still not reached in this block */
-					value+=spkr.volcur*vol_len;
-					if (vol_diff<0) {
-						value-=(SPKR_SPEED*vol_len*vol_len)/2;
-						spkr.volcur-=SPKR_SPEED*vol_len;
-					} else {
-						value+=(SPKR_SPEED*vol_len*vol_len)/2;
-						spkr.volcur+=SPKR_SPEED*vol_len;
-					}
-					index+=vol_len;
-				}
-			}
+	if (len>SPKR_MAX_BLOCK) len=SPKR_MAX_BLOCK;
+	if (spkr.used || spkr.deltas_pending) {
+		for (Bitu pos=0;pos<spkr.used;pos++) {
+			float sample=spkr.entries[pos].index*len;
+			if (sample<0) sample=0;
+			else if (sample>len) sample=(float)len;
+			SPKR_AddStep(sample,spkr.entries[pos].vol-spkr.volwant);
+			spkr.volwant=spkr.entries[pos].vol;
+		}
+		/* The last steps' tails run on into the next block */
+		if (spkr.used) spkr.deltas_pending=true;
+		else if (len>=SPKR_BLEP_TAPS) spkr.deltas_pending=false;
+		spkr.used=0;
+		float level=spkr.volcur;
+		for (Bitu i=0;i<len;i++) {
+			level+=spkr.deltas[i];
+			stream[i]=(Bit16s)level;
 		}
-		*stream++=(Bit16s)(value/sample_add);
+		memmove(spkr.deltas,spkr.deltas+len,SPKR_BLEP_TAPS*sizeof(float));
+		memset(spkr.deltas+SPKR_BLEP_TAPS,0,len*sizeof(float));
+		/* Once the steps have all been summed, settle exactly on the level they lead to */
+		spkr.volcur=spkr.deltas_pending ? level : spkr.volwant;
+	} else {
+		Bit16s level=(Bit16s)spkr.volwant;
+		for (Bitu i=0;i<len;i++) stream[i]=level;
 	}
 	if(spkr.chan) spkr.chan->AddSamples_m16(len,(Bit16s*)MixTemp);
 
@@ -314,13 +344,15 @@ static void PCSPEAKER_CallBack(Bitu len) {
 		if(spkr.volwant == 0) { 
 			spkr.last_ticks = 0;
 			if(spkr.chan) spkr.chan->Enable(false);
-		} else {
+		} else if (!spkr.deltas_pending) {
+			/* Steps this small are inaudible, so they needn't be band-limited */
 			if(spkr.volwant > 0) spkr.volwant--; else spkr.volwant++;
-		
+			spkr.volcur = spkr.volwant;
 		}
 	} 
 
 }
+//--End of modifications
 class PCSPEAKER:public Module_base {
 private:
 	MixerObject MixerChan;
@@ -340,6 +372,12 @@ public:
 		spkr.pit_index=0;
 		spkr.min_tr=(PIT_TICK_RATE+spkr.rate/2-1)/(spkr.rate/2);
 		spkr.used=0;
+		//--Added for the band-limited steps
+		SPKR_MakeBlepTable();
+		memset(spkr.deltas,0,sizeof(spkr.deltas));
+		spkr.deltas_pending=false;
+		spkr.volwant=spkr.volcur=0;
+		//--End of modifications
 		/* Register the sound channel */
 		spkr.chan=MixerChan.Install(&PCSPEAKER_CallBack,spkr.rate,"SPKR");
 	}
@@ -19,6 +19,9 @@
 /* $Id: pic.cpp,v 1.44 2009-05-27 09:15:41 qbix79 Exp $ */
 
 #include <list>
+//--Added for the growable event heap
+#include <stdlib.h>
+//--End of modifications
 
 #include "dosbox.h"
 #include "inout.h"
@@ -28,7 +31,9 @@
 #include "timer.h"
 #include "setup.h"
 
+//--Modified to make this the initial size of the event heap, which now grows as needed
 #define PIC_QUEUESIZE 512
+//--End of modifications
 
 struct IRQ_Block {
 	bool masked;
@@ -51,6 +56,16 @@ struct PIC_Controller {
 };
 
 Bitu PIC_Ticks=0;
+//--Added for the integer emulated time in pic.h
+Bit64u PIC_NsPerCycle=0;
+Bit32s PIC_NsPerCycleMax=0;
+
+void PIC_UpdateNsPerCycle(void) {
+	PIC_NsPerCycleMax=CPU_CycleMax;
+	if (CPU_CycleMax>0) PIC_NsPerCycle=((Bit64u)PIC_NS_PER_MS<<32)/(Bit64u)CPU_CycleMax;
+	else PIC_NsPerCycle=0;
+}
+//--End of modifications
 Bitu PIC_IRQCheck;
 Bitu PIC_IRQOnSecondPicActive;
 Bitu PIC_IRQActive;
@@ -59,19 +74,79 @@ Bitu PIC_IRQActive;
 static IRQ_Block irqs[16];
 static PIC_Controller pics[2];
 static bool PIC_Special_Mode = false; //Saves one compare in the pic_run_irqloop
+//--Modified to keep scheduled events in a binary heap instead of a sorted linked list,
+//so that adding an event costs O(log n) rather than a walk through every pending event.
+//Events due at the same index still run in the order they were added, as they did before.
 struct PICEntry {
 	float index;
+	Bit32u order;
 	Bitu value;
 	PIC_EventHandler pic_event;
-	PICEntry * next;
 };
 
 static struct {
-	PICEntry entries[PIC_QUEUESIZE];
-	PICEntry * free_entry;
-	PICEntry * next_entry;
+	PICEntry * entries;	// the heap, soonest event first
+	Bitu used;
+	Bitu size;
+	Bitu peak;			// the most events that have been pending at once
+	Bit32u next_order;
 } pic_queue;
 
+static INLINE bool PIC_EntryBefore(const PICEntry & a,const PICEntry & b) {
+	if (a.index!=b.index) return a.index<b.index;
+	return (Bit32s)(a.order-b.order)<0;
+}
+
+static void PIC_SiftUp(Bitu pos) {
+	PICEntry entry=pic_queue.entries[pos];
+	while (pos) {
+		Bitu parent=(pos-1)/2;
+		if (!PIC_EntryBefore(entry,pic_queue.entries[parent])) break;
+		pic_queue.entries[pos]=pic_queue.entries[parent];
+		pos=parent;
+	}
+	pic_queue.entries[pos]=entry;
+}
+
+static void PIC_SiftDown(Bitu pos) {
+	PICEntry entry=pic_queue.entries[pos];
+	for (;;) {
+		Bitu child=pos*2+1;
+		if (child>=pic_queue.used) break;
+		if (child+1<pic_queue.used && PIC_EntryBefore(pic_queue.entries[child+1],pic_queue.entries[child])) child++;
+		if (!PIC_EntryBefore(pic_queue.entries[child],entry)) break;
+		pic_queue.entries[pos]=pic_queue.entries[child];
+		pos=child;
+	}
+	pic_queue.entries[pos]=entry;
+}
+
+static void PIC_RemoveFirstEntry(void) {
+	if (--pic_queue.used) {
+		pic_queue.entries[0]=pic_queue.entries[pic_queue.used];
+		PIC_SiftDown(0);
+	}
+}
+
+static void PIC_RemoveMatchingEntries(PIC_EventHandler handler,bool match_value,Bitu val) {
+	Bitu kept=0;
+	for (Bitu i=0;i<pic_queue.used;i++) {
+		PICEntry * entry=&pic_queue.entries[i];
+		if (GCC_UNLIKELY(entry->pic_event==handler) && (!match_value || entry->value==val)) continue;
+		if (kept!=i) pic_queue.entries[kept]=*entry;
+		kept++;
+	}
+	if (kept==pic_queue.used) return;
+	pic_queue.used=kept;
+	/* Rebuild the heap from what's left */
+	for (Bitu i=kept/2;i-->0;) PIC_SiftDown(i);
+}
+
+Bitu PIC_GetPeakQueueDepth(void) {
+	return pic_queue.peak;
+}
+//--End of modifications
+
 static void write_command(Bitu port,Bitu val,Bitu iolen) {
 	PIC_Controller * pic=&pics[port==0x20 ? 0 : 1];
 	Bitu irq_base=port==0x20 ? 0 : 8;
@@ -286,6 +361,9 @@ void PIC_runIRQs(void) {
 	if (!GETFLAG(IF)) return;
 	if (GCC_UNLIKELY(!PIC_IRQCheck)) return;
 	if (GCC_UNLIKELY(cpudecoder==CPU_Core_Normal_Trap_Run)) return;
+	//--Added for the threaded variant of the normal core
+	if (GCC_UNLIKELY(cpudecoder==CPU_Core_Threaded_Trap_Run)) return;
+	//--End of modifications
 
 	static Bitu IRQ_priority_order[16] = 
 		{ 0,1,2,8,9,10,11,12,13,14,15,3,4,5,6,7 };
@@ -353,104 +431,46 @@ void PIC_SetIRQMask(Bitu irq, bool masked) {
 	}
 }
 
-static void AddEntry(PICEntry * entry) {
-	PICEntry * find_entry=pic_queue.next_entry;
-	if (GCC_UNLIKELY(find_entry ==0)) {
-		entry->next=0;
-		pic_queue.next_entry=entry;
-	} else if (find_entry->index>entry->index) {
-		pic_queue.next_entry=entry;
-		entry->next=find_entry;
-	} else while (find_entry) {
-		if (find_entry->next) {
-			/* See if the next index comes later than this one */
-			if (find_entry->next->index > entry->index) {
-				entry->next=find_entry->next;
-				find_entry->next=entry;
-				break;
-			} else {
-				find_entry=find_entry->next;
-			}
-		} else {
-			entry->next=find_entry->next;
-			find_entry->next=entry;
-			break;
-		}
-	}
-	Bits cycles=PIC_MakeCycles(pic_queue.next_entry->index-PIC_TickIndex());
-	if (cycles<CPU_Cycles) {
-		CPU_CycleLeft+=CPU_Cycles;
-		CPU_Cycles=0;
-	}
-}
+//--Modified to add events to the heap
 static bool InEventService = false;
 static float srv_lag = 0;
 
 void PIC_AddEvent(PIC_EventHandler handler,float delay,Bitu val) {
-	if (GCC_UNLIKELY(!pic_queue.free_entry)) {
-		LOG(LOG_PIC,LOG_ERROR)("Event queue full");
-		return;
+	if (GCC_UNLIKELY(pic_queue.used==pic_queue.size)) {
+		Bitu size=pic_queue.size ? pic_queue.size*2 : PIC_QUEUESIZE;
+		PICEntry * entries=(PICEntry *)realloc(pic_queue.entries,size*sizeof(PICEntry));
+		if (!entries) {
+			LOG(LOG_PIC,LOG_ERROR)("Event queue full");
+			return;
+		}
+		pic_queue.entries=entries;
+		pic_queue.size=size;
 	}
-	PICEntry * entry=pic_queue.free_entry;
+	PICEntry * entry=&pic_queue.entries[pic_queue.used];
 	if(InEventService) entry->index = delay + srv_lag;
 	else entry->index = delay + PIC_TickIndex();
 
+	entry->order=pic_queue.next_order++;
 	entry->pic_event=handler;
 	entry->value=val;
-	pic_queue.free_entry=pic_queue.free_entry->next;
-	AddEntry(entry);
+	PIC_SiftUp(pic_queue.used++);
+	if (pic_queue.used>pic_queue.peak) pic_queue.peak=pic_queue.used;
+
+	Bits cycles=PIC_MakeCycles(pic_queue.entries[0].index-PIC_TickIndex());
+	if (cycles<CPU_Cycles) {
+		CPU_CycleLeft+=CPU_Cycles;
+		CPU_Cycles=0;
+	}
 }
 
 void PIC_RemoveSpecificEvents(PIC_EventHandler handler, Bitu val) {
-	PICEntry * entry=pic_queue.next_entry;
-	PICEntry * prev_entry;
-	prev_entry = 0;
-	while (entry) {
-		if (GCC_UNLIKELY((entry->pic_event == handler)) && (entry->value == val)) {
-			if (prev_entry) {
-				prev_entry->next=entry->next;
-				entry->next=pic_queue.free_entry;
-				pic_queue.free_entry=entry;
-				entry=prev_entry->next;
-				continue;
-			} else {
-				pic_queue.next_entry=entry->next;
-				entry->next=pic_queue.free_entry;
-				pic_queue.free_entry=entry;
-				entry=pic_queue.next_entry;
-				continue;
-			}
-		}
-		prev_entry=entry;
-		entry=entry->next;
-	}	
+	PIC_RemoveMatchingEntries(handler,true,val);
 }
 
 void PIC_RemoveEvents(PIC_EventHandler handler) {
-	PICEntry * entry=pic_queue.next_entry;
-	PICEntry * prev_entry;
-	prev_entry=0;
-	while (entry) {
-		if (GCC_UNLIKELY(entry->pic_event==handler)) {
-			if (prev_entry) {
-				prev_entry->next=entry->next;
-				entry->next=pic_queue.free_entry;
-				pic_queue.free_entry=entry;
-				entry=prev_entry->next;
-				continue;
-			} else {
-				pic_queue.next_entry=entry->next;
-				entry->next=pic_queue.free_entry;
-				pic_queue.free_entry=entry;
-				entry=pic_queue.next_entry;
-				continue;
-			}
-		}
-		prev_entry=entry;
-		entry=entry->next;
-	}	
+	PIC_RemoveMatchingEntries(handler,false,0);
 }
-
+//--End of modifications
 
 bool PIC_RunQueue(void) {
 	/* Check to see if a new milisecond needs to be started */
@@ -462,22 +482,21 @@ bool PIC_RunQueue(void) {
 	/* Check the queue for an entry */
 	Bits index_nd=PIC_TickIndexND();
 	InEventService = true;
-	while (pic_queue.next_entry && (pic_queue.next_entry->index*CPU_CycleMax<=index_nd)) {
-		PICEntry * entry=pic_queue.next_entry;
-		pic_queue.next_entry=entry->next;
-
-		srv_lag = entry->index;
-		(entry->pic_event)(entry->value); // call the event handler
-
-		/* Put the entry in the free list */
-		entry->next=pic_queue.free_entry;
-		pic_queue.free_entry=entry;
+	//--Modified to take events from the heap: the entry is copied out first,
+	//since the handler may well add or remove events
+	while (pic_queue.used && (pic_queue.entries[0].index*CPU_CycleMax<=index_nd)) {
+		PICEntry entry=pic_queue.entries[0];
+		PIC_RemoveFirstEntry();
+
+		srv_lag = entry.index;
+		(entry.pic_event)(entry.value); // call the event handler
 	}
 	InEventService = false;
 
 	/* Check when to set the new cycle end */
-	if (pic_queue.next_entry) {
-		Bits cycles=(Bits)(pic_queue.next_entry->index*CPU_CycleMax-index_nd);
+	if (pic_queue.used) {
+		Bits cycles=(Bits)(pic_queue.entries[0].index*CPU_CycleMax-index_nd);
+	//--End of modifications
 		if (GCC_UNLIKELY(!cycles)) cycles=1;
 		if (cycles<CPU_CycleLeft) {
 			CPU_Cycles=cycles;
@@ -526,11 +545,11 @@ void TIMER_AddTick(void) {
 	CPU_Cycles=0;
 	PIC_Ticks++;
 	/* Go through the list of scheduled events and lower their index with 1000 */
-	PICEntry * entry=pic_queue.next_entry;
-	while (entry) {
-		entry->index -= 1.0f;
-		entry=entry->next;
+	//--Modified to walk the heap: lowering every index by the same amount keeps it in order
+	for (Bitu i=0;i<pic_queue.used;i++) {
+		pic_queue.entries[i].index -= 1.0f;
 	}
+	//--End of modifications
 	/* Call our list of ticker handlers */
 	TickerBlock * ticker=firstticker;
 	while (ticker) {
@@ -589,14 +608,70 @@ public:
 		WriteHandler[2].Install(0xa0,write_command,IO_MB);
 		WriteHandler[3].Install(0xa1,write_data,IO_MB);
 		/* Initialize the pic queue */
-		for (i=0;i<PIC_QUEUESIZE-1;i++) {
-			pic_queue.entries[i].next=&pic_queue.entries[i+1];
+		//--Modified to set up the event heap
+		if (!pic_queue.entries) {
+			pic_queue.entries=(PICEntry *)malloc(PIC_QUEUESIZE*sizeof(PICEntry));
+			if (!pic_queue.entries) E_Exit("Allocating the PIC event queue has failed");
+			pic_queue.size=PIC_QUEUESIZE;
+		}
+		pic_queue.used=0;
+		pic_queue.peak=0;
+		pic_queue.next_order=0;
+		//--End of modifications
+		SAVESTATE_Register("pic",this);	//--Added for save states
+	}
+	//--Added for save states. Pending events are saved in heap order, so the heap
+	//needs no rebuilding; their handlers are saved relative to the executable.
+	void SaveState(std::ostream& stream) {
+		SAVESTATE_Write(stream,PIC_Ticks);
+		SAVESTATE_Write(stream,PIC_IRQCheck);
+		SAVESTATE_Write(stream,PIC_IRQOnSecondPicActive);
+		SAVESTATE_Write(stream,PIC_IRQActive);
+		SAVESTATE_Write(stream,irqs);
+		SAVESTATE_Write(stream,pics);
+		SAVESTATE_Write(stream,PIC_Special_Mode);
+		SAVESTATE_Write(stream,pic_queue.next_order);
+		SAVESTATE_Write(stream,pic_queue.used);
+		for (Bitu i=0;i<pic_queue.used;i++) {
+			PICEntry * entry=&pic_queue.entries[i];
+			SAVESTATE_Write(stream,entry->index);
+			SAVESTATE_Write(stream,entry->order);
+			SAVESTATE_Write(stream,entry->value);
+			SAVESTATE_WriteHandler(stream,entry->pic_event);
+		}
+	}
+	void LoadState(std::istream& stream) {
+		Bitu used=0;
+		SAVESTATE_Read(stream,PIC_Ticks);
+		SAVESTATE_Read(stream,PIC_IRQCheck);
+		SAVESTATE_Read(stream,PIC_IRQOnSecondPicActive);
+		SAVESTATE_Read(stream,PIC_IRQActive);
+		SAVESTATE_Read(stream,irqs);
+		SAVESTATE_Read(stream,pics);
+		SAVESTATE_Read(stream,PIC_Special_Mode);
+		SAVESTATE_Read(stream,pic_queue.next_order);
+		SAVESTATE_Read(stream,used);
+		if (used>0x10000) stream.setstate(std::ios::failbit);
+		if (!stream) return;
+		if (used>pic_queue.size) {
+			PICEntry * entries=(PICEntry *)realloc(pic_queue.entries,used*sizeof(PICEntry));
+			if (!entries) E_Exit("Allocating the PIC event queue has failed");
+			pic_queue.entries=entries;
+			pic_queue.size=used;
+		}
+		pic_queue.used=used;
+		for (Bitu i=0;i<used;i++) {
+			PICEntry * entry=&pic_queue.entries[i];
+			SAVESTATE_Read(stream,entry->index);
+			SAVESTATE_Read(stream,entry->order);
+			SAVESTATE_Read(stream,entry->value);
+			SAVESTATE_ReadHandler(stream,entry->pic_event);
 		}
-		pic_queue.entries[PIC_QUEUESIZE-1].next=0;
-		pic_queue.free_entry=&pic_queue.entries[0];
-		pic_queue.next_entry=0;
+		if (pic_queue.used>pic_queue.peak) pic_queue.peak=pic_queue.used;
 	}
+	//--End of modifications
 	~PIC(){
+		SAVESTATE_Unregister(this);	//--Added for save states
 	}
 };
 
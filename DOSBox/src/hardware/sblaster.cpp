@@ -1580,6 +1580,8 @@ public:
 		if (sb.type == SBT_16) sb.chan->Enable(true);
 		else sb.chan->Enable(false);
 
+		SAVESTATE_Register("sblaster",this);	//--Added for save states
+
 		// Create set blaster line
 		ostringstream temp;
 		temp << "SET BLASTER=A" << setw(3)<< hex << sb.hw.base
@@ -1594,7 +1596,40 @@ public:
 		else sb.midi = true;
 	}	
 	
+	//--Added for save states. Pending DMA and IRQ events are restored with the PIC's queue,
+	//and the DMA callbacks with the DMA controllers.
+	void SaveState(std::ostream& stream) {
+		SB_INFO saved=sb;
+		saved.dma.chan=NULL;
+		saved.chan=NULL;
+		SAVESTATE_Write(stream,saved);
+		Bit8u channum=sb.dma.chan ? sb.dma.chan->channum : 0xff;
+		SAVESTATE_Write(stream,channum);
+		SAVESTATE_Write(stream,sb.chan->enabled);
+		SAVESTATE_Write(stream,(Bit32u)sb.chan->GetFreq());
+		SAVESTATE_Write(stream,ASP_regs);
+		SAVESTATE_Write(stream,ASP_init_in_progress);
+	}
+	void LoadState(std::istream& stream) {
+		MixerChannel * chan=sb.chan;
+		Bit8u channum=0xff;
+		bool enabled=false;
+		Bit32u freq=22050;
+		SAVESTATE_Read(stream,sb);
+		SAVESTATE_Read(stream,channum);
+		SAVESTATE_Read(stream,enabled);
+		SAVESTATE_Read(stream,freq);
+		SAVESTATE_Read(stream,ASP_regs);
+		SAVESTATE_Read(stream,ASP_init_in_progress);
+		sb.chan=chan;
+		sb.dma.chan=(channum==0xff) ? NULL : GetDMAChannel(channum);
+		sb.chan->SetFreq(freq);
+		sb.chan->Enable(enabled);
+	}
+	//--End of modifications
+
 	~SBLASTER() {
+		SAVESTATE_Unregister(this);	//--Added for save states
 		switch (oplmode) {
 		case OPL_none:
 			break;
@@ -28,6 +28,25 @@
 
 #include "misc_util.h"
 
+//--Added for the transport thread
+#ifdef TCP_TRANSPORT
+#include <unistd.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <sys/event.h>
+#include <netinet/tcp.h>
+
+// identifies the event that wakes the thread, and the reasons passed with it
+#define TCP_TRANSPORT_WAKE	1
+#define TCP_TRANSPORT_DATA	0x1
+#define TCP_TRANSPORT_FLUSH	0x2
+#define TCP_TRANSPORT_STOP	0x4
+
+// send as soon as this much has been gathered
+#define TCP_TRANSPORT_SENDSIZE	1024
+#endif
+//--End of modifications
+
 struct _TCPsocketX {
 	int ready;
 #ifdef NATIVESOCKETS
@@ -48,6 +67,9 @@ Bit32u Netwrapper_GetCapabilities()
 #ifdef NATIVESOCKETS
 TCPClientSocket::TCPClientSocket(int platformsocket) {
 	sendbuffer=0;
+#ifdef TCP_TRANSPORT
+	transport=false;	//--Added for the transport thread
+#endif
 	nativetcpstruct = new Bit8u[sizeof(struct _TCPsocketX)];
 	
 	mysock = (TCPsocket)nativetcpstruct;
@@ -104,6 +126,9 @@ TCPClientSocket::TCPClientSocket(TCPsocket source) {
 	nativetcpstruct=0;
 #endif
 	sendbuffer=0;
+#ifdef TCP_TRANSPORT
+	transport=false;	//--Added for the transport thread
+#endif
 	isopen = false;
 	if(!SDLNetInited) {
         if(SDLNet_Init()==-1) {
@@ -129,6 +154,9 @@ TCPClientSocket::TCPClientSocket(const char* destination, Bit16u port) {
 	nativetcpstruct=0;
 #endif
 	sendbuffer=0;
+#ifdef TCP_TRANSPORT
+	transport=false;	//--Added for the transport thread
+#endif
 	isopen = false;
 	if(!SDLNetInited) {
         if(SDLNet_Init()==-1) {
@@ -153,6 +181,11 @@ TCPClientSocket::TCPClientSocket(const char* destination, Bit16u port) {
 }
 
 TCPClientSocket::~TCPClientSocket() {
+	//--Added to stop the transport thread before the socket goes away
+#ifdef TCP_TRANSPORT
+	if(transport) StopTransport();
+#endif
+	//--End of modifications
 	
 	if(sendbuffer) delete [] sendbuffer;
 #ifdef NATIVESOCKETS
@@ -180,6 +213,26 @@ bool TCPClientSocket::GetRemoteAddressString(Bit8u* buffer) {
 }
 
 bool TCPClientSocket::ReceiveArray(Bit8u* data, Bitu* size) {
+	//--Added to read from the transport thread's ring
+#ifdef TCP_TRANSPORT
+	if(transport) {
+		Bitu received=0;
+		Bitu tail=rxtail;
+		while(received<*size && tail!=rxhead) {
+			data[received++]=rxring[tail&(TCP_TRANSPORT_RINGSIZE-1)];
+			tail++;
+		}
+		__sync_synchronize();
+		rxtail=tail;
+		*size=received;
+		if(!received && transportclosed && rxtail==rxhead) {
+			isopen=false;
+			return false;
+		}
+		return true;
+	}
+#endif
+	//--End of modifications
 	if(SDLNet_CheckSockets(listensocketset,0))
 	{
 		Bits retval = SDLNet_TCP_Recv(mysock, data, *size);
@@ -204,6 +257,26 @@ Bits TCPClientSocket::GetcharNonBlock() {
 // -1: no data
 // -2: socket closed
 // 0..255: data
+	//--Added to read from the transport thread's ring
+#ifdef TCP_TRANSPORT
+	if(transport) {
+		Bitu tail=rxtail;
+		if(tail==rxhead) {
+			// the thread only closes once it has handed over everything it received
+			__sync_synchronize();
+			if(transportclosed && tail==rxhead) {
+				isopen=false;
+				return -2;
+			}
+			return -1;
+		}
+		Bits retval=rxring[tail&(TCP_TRANSPORT_RINGSIZE-1)];
+		__sync_synchronize();
+		rxtail=tail+1;
+		return retval;
+	}
+#endif
+	//--End of modifications
 	if(SDLNet_CheckSockets(listensocketset,0))
 	{
 		Bitu retval =0;
@@ -215,6 +288,15 @@ Bits TCPClientSocket::GetcharNonBlock() {
 	else return -1;
 }
 bool TCPClientSocket::Putchar(Bit8u data) {
+	//--Added to send through the transport thread
+#ifdef TCP_TRANSPORT
+	if(transport) {
+		if(!QueueSend(&data,1)) return false;
+		WakeTransport(TCP_TRANSPORT_FLUSH);
+		return true;
+	}
+#endif
+	//--End of modifications
 	if(SDLNet_TCP_Send(mysock, &data, 1)!=1) {
 		isopen=false;
 		return false;
@@ -223,6 +305,15 @@ bool TCPClientSocket::Putchar(Bit8u data) {
 }
 
 bool TCPClientSocket::SendArray(Bit8u* data, Bitu bufsize) {
+	//--Added to send through the transport thread
+#ifdef TCP_TRANSPORT
+	if(transport) {
+		if(!QueueSend(data,bufsize)) return false;
+		WakeTransport(TCP_TRANSPORT_FLUSH);
+		return true;
+	}
+#endif
+	//--End of modifications
 	if(SDLNet_TCP_Send(mysock, data, bufsize)!=(int)bufsize) {
 		isopen=false;
 		return false;
@@ -231,6 +322,11 @@ bool TCPClientSocket::SendArray(Bit8u* data, Bitu bufsize) {
 }
 
 bool TCPClientSocket::SendByteBuffered(Bit8u data) {
+	//--Added to let the transport thread gather the bytes instead
+#ifdef TCP_TRANSPORT
+	if(transport) return QueueSend(&data,1);
+#endif
+	//--End of modifications
 	
 	if(sendbufferindex==(sendbuffersize-1)) {
 		// buffer is full, get rid of it
@@ -267,6 +363,14 @@ bool TCPClientSocket::SendArrayBuffered(Bit8u* data, Bitu bufsize) {
 }
 */
 void TCPClientSocket::FlushBuffer() {
+	//--Added to let the transport thread do the sending
+#ifdef TCP_TRANSPORT
+	if(transport) {
+		WakeTransport(TCP_TRANSPORT_FLUSH);
+		return;
+	}
+#endif
+	//--End of modifications
 	if(sendbufferindex) {
 		if(SDLNet_TCP_Send(mysock, sendbuffer,
 			sendbufferindex)!=(int)sendbufferindex) {
@@ -285,6 +389,193 @@ void TCPClientSocket::SetSendBufferSize(Bitu bufsize) {
 }
 
 
+//--Added to move the socket's traffic onto a thread of its own.
+//Polling the socket from the serial port's events meant a select() per byte received,
+//and data sent went out in lumps timed by millisecond events, with Nagle's algorithm
+//adding its own delay on top. Now the thread is woken by kqueue as soon as data arrives
+//or is queued, and the emulation only ever touches the rings.
+#ifdef TCP_TRANSPORT
+
+static Bit64s TransportTime() {
+	struct timeval now;
+	gettimeofday(&now,0);
+	return (Bit64s)now.tv_sec*1000000+now.tv_usec;
+}
+
+bool TCPClientSocket::StartTransport(Bitu coalesce_usec) {
+	if(transport || !isopen || !mysock) return false;
+	int channel=((struct _TCPsocketX*)mysock)->channel;
+
+	int nodelay=1;
+	setsockopt(channel,IPPROTO_TCP,TCP_NODELAY,&nodelay,sizeof(nodelay));
+	// a dropped connection should show up as an error from send, not kill us
+	int nosigpipe=1;
+	setsockopt(channel,SOL_SOCKET,SO_NOSIGPIPE,&nosigpipe,sizeof(nosigpipe));
+
+	transportqueue=kqueue();
+	if(transportqueue<0) return false;
+	struct kevent events[2];
+	EV_SET(&events[0],channel,EVFILT_READ,EV_ADD,0,0,0);
+	EV_SET(&events[1],TCP_TRANSPORT_WAKE,EVFILT_USER,EV_ADD|EV_CLEAR,0,0,0);
+	if(kevent(transportqueue,events,2,0,0,0)<0) {
+		close(transportqueue);
+		return false;
+	}
+
+	coalesceusec=coalesce_usec;
+	transportclosed=false;
+	rxhead=rxtail=0;
+	txhead=txtail=0;
+	// anything already buffered the old way goes first
+	if(sendbuffer && sendbufferindex) {
+		memcpy(txring,sendbuffer,sendbufferindex);
+		txhead=sendbufferindex;
+		sendbufferindex=0;
+	}
+	if(pthread_create(&transportthread,0,TransportThread,this)!=0) {
+		close(transportqueue);
+		return false;
+	}
+	transport=true;
+	if(txhead!=txtail) WakeTransport(TCP_TRANSPORT_FLUSH);
+	return true;
+}
+
+void TCPClientSocket::StopTransport() {
+	WakeTransport(TCP_TRANSPORT_STOP);
+	pthread_join(transportthread,0);
+	close(transportqueue);
+	transport=false;
+}
+
+void TCPClientSocket::WakeTransport(Bit32u reason) {
+	struct kevent event;
+	EV_SET(&event,TCP_TRANSPORT_WAKE,EVFILT_USER,0,NOTE_TRIGGER|NOTE_FFOR|reason,0,0);
+	kevent(transportqueue,&event,1,0,0,0);
+}
+
+bool TCPClientSocket::QueueSend(const Bit8u* data, Bitu size) {
+	Bitu head=txhead;
+	Bitu start=head;
+	while(size) {
+		if(transportclosed) {
+			isopen=false;
+			return false;
+		}
+		if(head-txtail==TCP_TRANSPORT_RINGSIZE) {
+			// full: hand over what we have and wait for the thread to make room
+			__sync_synchronize();
+			txhead=head;
+			WakeTransport(TCP_TRANSPORT_FLUSH);
+			usleep(100);
+			continue;
+		}
+		txring[head&(TCP_TRANSPORT_RINGSIZE-1)]=*data++;
+		head++;
+		size--;
+	}
+	__sync_synchronize();
+	txhead=head;
+	__sync_synchronize();
+	// The thread rechecks the ring after every send, so it only needs waking
+	// if it had emptied the ring before these bytes went in.
+	if(txtail==start) WakeTransport(TCP_TRANSPORT_DATA);
+	return true;
+}
+
+void* TCPClientSocket::TransportThread(void* param) {
+	TCPClientSocket* self=(TCPClientSocket*)param;
+	int channel=((struct _TCPsocketX*)self->mysock)->channel;
+	Bit64s lastsend=0;
+	Bit64s deadline=-1;		// when the bytes waiting to be sent must go out, or -1 if none are
+	bool flush=false;
+
+	for(;;) {
+		struct kevent events[2];
+		struct timespec timeout;
+		struct timespec* wait=0;
+		if(deadline>=0) {
+			Bit64s remaining=deadline-TransportTime();
+			if(remaining<0) remaining=0;
+			timeout.tv_sec=(time_t)(remaining/1000000);
+			timeout.tv_nsec=(long)(remaining%1000000)*1000;
+			wait=&timeout;
+		}
+		int numevents=kevent(self->transportqueue,0,0,events,2,wait);
+		if(numevents<0 && errno!=EINTR) break;
+
+		for(int e=0;e<numevents;e++) {
+			if(events[e].filter==EVFILT_USER) {
+				if(events[e].fflags&TCP_TRANSPORT_STOP) return 0;
+				if(events[e].fflags&TCP_TRANSPORT_FLUSH) flush=true;
+			} else if(events[e].filter==EVFILT_READ) {
+				Bitu head=self->rxhead;
+				Bitu space=TCP_TRANSPORT_RINGSIZE-(head-self->rxtail);
+				if(!space) {
+					// the emulation has fallen behind: let it catch up
+					usleep(1000);
+					continue;
+				}
+				// read as far as the end of the ring; the rest comes next time round
+				Bitu offset=head&(TCP_TRANSPORT_RINGSIZE-1);
+				if(space>TCP_TRANSPORT_RINGSIZE-offset) space=TCP_TRANSPORT_RINGSIZE-offset;
+				ssize_t received=recv(channel,&self->rxring[offset],space,MSG_DONTWAIT);
+				if(received>0) {
+					__sync_synchronize();
+					self->rxhead=head+received;
+				} else if(received==0 || (errno!=EAGAIN && errno!=EINTR)) {
+					__sync_synchronize();
+					self->transportclosed=true;
+					return 0;
+				}
+			}
+		}
+
+		Bitu pending=self->txhead-self->txtail;
+		if(!pending) {
+			deadline=-1;
+			flush=false;
+			continue;
+		}
+		Bit64s now=TransportTime();
+		if(deadline<0) {
+			// Bytes after a quiet spell are most likely a keypress or a game's turn,
+			// so send them straight away; otherwise gather them like Nagle would.
+			if(now-lastsend>=(Bit64s)self->coalesceusec) flush=true;
+			deadline=now+self->coalesceusec;
+		}
+		if(!flush && now<deadline && pending<TCP_TRANSPORT_SENDSIZE) continue;
+
+		__sync_synchronize();
+		while(pending) {
+			Bitu tail=self->txtail;
+			Bitu offset=tail&(TCP_TRANSPORT_RINGSIZE-1);
+			Bitu length=pending;
+			if(length>TCP_TRANSPORT_RINGSIZE-offset) length=TCP_TRANSPORT_RINGSIZE-offset;
+			ssize_t sent=send(channel,&self->txring[offset],length,0);
+			if(sent<0) {
+				if(errno==EINTR) continue;
+				self->transportclosed=true;
+				return 0;
+			}
+			__sync_synchronize();
+			self->txtail=tail+sent;
+			pending-=sent;
+		}
+		lastsend=now;
+		deadline=-1;
+		flush=false;
+		// anything queued while we were sending gets picked up next time round
+		__sync_synchronize();
+		if(self->txhead!=self->txtail) deadline=TransportTime()+self->coalesceusec;
+	}
+	self->transportclosed=true;
+	return 0;
+}
+
+#endif
+//--End of modifications
+
 TCPServerSocket::TCPServerSocket(Bit16u port)
 {
 	isopen = false;
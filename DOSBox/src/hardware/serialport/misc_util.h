@@ -51,6 +51,13 @@
  #include <sys/socket.h>
  #include <netinet/in.h>
  //socklen_t should be handled by configure
+
+//--Added to give client sockets a thread of their own where kqueue is available
+ #if defined(MACOSX)
+  #define TCP_TRANSPORT
+  #include <pthread.h>
+ #endif
+//--End of modifications
 #endif
 
 #ifdef NATIVESOCKETS
@@ -97,6 +104,18 @@ class TCPClientSocket {
 	bool SendByteBuffered(Bit8u data);
 	bool SendArrayBuffered(Bit8u* data, Bitu bufsize);
 
+//--Added to move the socket's traffic onto a thread of its own
+#ifdef TCP_TRANSPORT
+	// Starts a thread that sends and receives for this socket, with Nagle's algorithm
+	// turned off. After a quiet spell the first byte sent goes out at once; after that,
+	// bytes are gathered for up to coalesce_usec microseconds before they are sent.
+	// Received bytes wait in a ring for GetcharNonBlock/ReceiveArray.
+	// If this returns false the socket carries on as it was.
+	bool StartTransport(Bitu coalesce_usec);
+	bool transport;
+#endif
+//--End of modifications
+
 	private:
 	TCPsocket mysock;
 	SDLNet_SocketSet listensocketset;
@@ -106,6 +125,30 @@ class TCPClientSocket {
 	Bitu sendbufferindex;
 	
 	Bit8u* sendbuffer;
+
+//--Added to move the socket's traffic onto a thread of its own
+#ifdef TCP_TRANSPORT
+// must be a power of two
+#define TCP_TRANSPORT_RINGSIZE 16384
+
+	static void* TransportThread(void* param);
+	void StopTransport();
+	bool QueueSend(const Bit8u* data, Bitu size);
+	void WakeTransport(Bit32u reason);
+
+	int transportqueue;
+	pthread_t transportthread;
+	Bitu coalesceusec;
+	volatile bool transportclosed;
+
+	// Each ring has one writer for its head and one for its tail, so neither needs a lock.
+	// The indexes run freely and are masked when the ring is accessed.
+	volatile Bitu rxhead, rxtail;	// head written by the thread, tail by the emulation
+	volatile Bitu txhead, txtail;	// head written by the emulation, tail by the thread
+	Bit8u rxring[TCP_TRANSPORT_RINGSIZE];
+	Bit8u txring[TCP_TRANSPORT_RINGSIZE];
+#endif
+//--End of modifications
 };
 
 class TCPServerSocket {
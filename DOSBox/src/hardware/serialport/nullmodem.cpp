@@ -40,6 +40,7 @@ CNullModem::CNullModem(Bitu id, CommandLine* cmd):CSerial (id, cmd) {
 	rx_state=N_RX_DISC;
 
 	tx_gather = 12;
+	tx_coalesce = 500;	//--Added for the transport thread
 	
 	dtrrespect=false;
 	tx_block=false;
@@ -85,6 +86,15 @@ CNullModem::CNullModem(Bitu id, CommandLine* cmd):CSerial (id, cmd) {
 			tx_gather=12;
 		}
 	}
+	//--Added to tune the transport thread
+	// coalesce: How many microseconds to gather data for before sending it,
+	// once data has started flowing. Replaces txdelay where sockets have a thread of their own.
+	if(getBituSubstring("coalesce:", &tx_coalesce, cmd)) {
+		if(!(tx_coalesce<=100000)) {
+			tx_coalesce=500;
+		}
+	}
+	//--End of modifications
 	// port is for both server and client
 	if(getBituSubstring("port:", &temptcpport, cmd)) {
 		if(!(temptcpport>0&&temptcpport<65536)) {
@@ -114,6 +124,9 @@ CNullModem::CNullModem(Bitu id, CommandLine* cmd):CSerial (id, cmd) {
 						return;
 					}
 					clientsocket->SetSendBufferSize(256);
+#ifdef TCP_TRANSPORT
+					clientsocket->StartTransport(tx_coalesce);	//--Added to give the connection a thread of its own
+#endif
 					clientsocket->GetRemoteAddressString(peernamebuf);
 					// transmit the line status
 					if(!transparent) setRTSDTR(getRTS(), getDTR());
@@ -194,6 +207,11 @@ CNullModem::~CNullModem () {
 void CNullModem::WriteChar(Bit8u data) {
 	
 	if(clientsocket)clientsocket->SendByteBuffered(data);
+	//--Added to leave the gathering to the transport thread when there is one
+#ifdef TCP_TRANSPORT
+	if(clientsocket && clientsocket->transport) return;
+#endif
+	//--End of modifications
 	if(!tx_block) {
 		//LOG_MSG("setevreduct");
 		setEvent(SERIAL_TX_REDUCTION, (float)tx_gather);
@@ -227,6 +245,9 @@ void CNullModem::ClientConnect(){
 		return;
 	}
 	clientsocket->SetSendBufferSize(256);
+#ifdef TCP_TRANSPORT
+	clientsocket->StartTransport(tx_coalesce);	//--Added to give the connection a thread of its own
+#endif
 	clientsocket->GetRemoteAddressString(peernamebuf);
 	// transmit the line status
 	if(!transparent) setRTSDTR(getRTS(), getDTR());
@@ -388,6 +409,9 @@ void CNullModem::handleUpperEvent(Bit16u type) {
 				log_ser(dbg_aux,"Nullmodem: A client (%s) has connected.", peeripbuf);
 #endif// new socket found...
 				clientsocket->SetSendBufferSize(256);
+#ifdef TCP_TRANSPORT
+				clientsocket->StartTransport(tx_coalesce);	//--Added to give the connection a thread of its own
+#endif
 				rx_state=N_RX_IDLE;
 				setEvent(SERIAL_POLLING_EVENT, 1);
 				
@@ -81,6 +81,11 @@ public:
 	Bitu tx_gather;		// how long to gather tx data before
 						// sending all of them [milliseconds]
 
+	//--Added for the transport thread
+	Bitu tx_coalesce;	// how long the transport thread gathers tx data
+						// before sending it [microseconds]
+	//--End of modifications
+
 	
 	bool dtrrespect;	// dtr behavior - only send data to the serial
 						// port when DTR is on
@@ -205,6 +205,31 @@ static void SN76496Update(Bitu length) {
 		unsigned int out;
 		int left;
 
+		//--Added to generate the output in spans: while no voice reaches an edge within a sample,
+		//each is high or low for the whole of it, so the output holds and the counters can be
+		//advanced in bulk. The sample with the edge is done as before, so the output is the same.
+		Bitu run=count;
+		for (i = 0;i < 4 && run;i++)
+		{
+			Bitu before=(R->Count[i] > STEP) ? (Bitu)((R->Count[i]-1)/STEP) : 0;
+			if (before < run) run=before;
+		}
+		if (run)
+		{
+			out = 0;
+			for (i = 0;i < 4;i++)
+			{
+				if (R->Output[i]) out += STEP * R->Volume[i];
+				R->Count[i] -= (int)run * STEP;
+			}
+			if (out > MAX_OUTPUT * STEP) out = MAX_OUTPUT * STEP;
+			Bit16s value=(Bit16s)(out / STEP);
+			for (Bitu n = 0;n < run;n++) *(buffer++) = value;
+			count-=run;
+			continue;
+		}
+		//--End of modifications
+
 
 		/* vol[] keeps track of how long each square wave stays */
 		/* in the 1 position during the sample period. */
@@ -271,6 +296,13 @@ static void SN76496Update(Bitu length) {
 		count--;
 	}
 	tandy.chan->AddSamples_m16(length,(Bit16s *)MixTemp);
+	//--Added to put the channel to sleep as soon as every voice is turned all the way down:
+	//the next write wakes it
+	if (!(R->Volume[0] | R->Volume[1] | R->Volume[2] | R->Volume[3])) {
+		tandy.enabled=false;
+		tandy.chan->Enable(false);
+	}
+	//--End of modifications
 }
 
 
@@ -39,8 +39,13 @@ static INLINE void BCD2BIN(Bit16u& val) {
 
 struct PIT_Block {
 	Bitu cntr;
+	//--Modified to time the counters in whole PIT clocks rather than double milliseconds:
+	//start is the clock the running period began on and period is its length in clocks,
+	//while delay is only kept for scheduling timer 0's events.
 	float delay;
-	double start;
+	Bit64u start;
+	Bitu period;
+	//--End of modifications
 
 	Bit16u read_latch;
 	Bit16u write_latch;
@@ -66,13 +71,28 @@ static Bit8u latched_timerstatus;
 // reprogrammed.
 static bool latched_timerstatus_locked;
 
+//--Added to read emulated time as a count of PIT clocks
+static INLINE Bit64u PIT_Clock(void) {
+	Bit64s ns=PIC_FullIndexNs();
+	return PIC_NsToClocks(ns>0 ? (Bit64u)ns : 0,PIT_TICK_RATE);
+}
+
+// how far into its current period a counter is, for an index that may be slightly negative
+// when timer 0's event ran a little early
+static INLINE Bit64s PIT_PeriodIndex(Bit64s index,Bitu period) {
+	index%=(Bit64s)period;
+	return (index<0) ? index+(Bit64s)period : index;
+}
+//--End of modifications
+
 static void PIT0_Event(Bitu /*val*/) {
 	PIC_ActivateIRQ(0);
 	if (pit[0].mode != 0) {
-		pit[0].start += pit[0].delay;
+		pit[0].start += pit[0].period;	//--Modified to count whole PIT clocks
 
 		if (GCC_UNLIKELY(pit[0].update_count)) {
 			pit[0].delay=(1000.0f/((float)PIT_TICK_RATE/(float)pit[0].cntr));
+			pit[0].period=pit[0].cntr;	//--Added
 			pit[0].update_count=false;
 		}
 		PIC_AddEvent(PIT0_Event,pit[0].delay);
@@ -81,21 +101,21 @@ static void PIT0_Event(Bitu /*val*/) {
 
 static bool counter_output(Bitu counter) {
 	PIT_Block * p=&pit[counter];
-	double index=PIC_FullIndex()-p->start;
+	//--Modified to work in whole PIT clocks
+	Bit64s index=(Bit64s)(PIT_Clock()-p->start);
 	switch (p->mode) {
 	case 0:
 		if (p->new_mode) return false;
-		if (index>p->delay) return true;
+		if (index>(Bit64s)p->period) return true;
 		else return false;
 		break;
 	case 2:
 		if (p->new_mode) return true;
-		index=fmod(index,(double)p->delay);
-		return index>0;
+		return PIT_PeriodIndex(index,p->period)>0;
 	case 3:
 		if (p->new_mode) return true;
-		index=fmod(index,(double)p->delay);
-		return index*2<p->delay;
+		return PIT_PeriodIndex(index,p->period)*2<(Bit64s)p->period;
+	//--End of modifications
 	case 4:
 		//Only low on terminal count
 		// if(fmod(index,(double)p->delay) == 0) return false; //Maybe take one rate tick in consideration
@@ -140,42 +160,42 @@ static void counter_latch(Bitu counter) {
 	//If gate2 is disabled don't update the read_latch
 	if(counter == 2 && !gate2 && p->mode !=1) return;
 
-	double index=PIC_FullIndex()-p->start;
+	//--Modified to work in whole PIT clocks
+	Bit64s index=(Bit64s)(PIT_Clock()-p->start);
 	switch (p->mode) {
 	case 4:		/* Software Triggered Strobe */
 	case 0:		/* Interrupt on Terminal Count */
 		/* Counter keeps on counting after passing terminal count */
-		if (index>p->delay) {
-			index-=p->delay;
+		if (index>(Bit64s)p->period) {
+			index-=p->period;
 			if(p->bcd) {
-				index = fmod(index,(1000.0/PIT_TICK_RATE)*10000.0);
-				p->read_latch = (Bit16u)(9999-index*(PIT_TICK_RATE/1000.0));
+				p->read_latch = (Bit16u)(9999-index%10000);
 			} else {
-				index = fmod(index,(1000.0/PIT_TICK_RATE)*(double)0x10000);
-				p->read_latch = (Bit16u)(0xffff-index*(PIT_TICK_RATE/1000.0));
+				p->read_latch = (Bit16u)(0xffff-index%0x10000);
 			}
 		} else {
-			p->read_latch=(Bit16u)(p->cntr-index*(PIT_TICK_RATE/1000.0));
+			p->read_latch=(Bit16u)(p->cntr-index);
 		}
 		break;
 	case 1: // countdown
 		if(p->counting) {
-			if (index>p->delay) { // has timed out
+			if (index>(Bit64s)p->period) { // has timed out
 				p->read_latch = 0xffff; //unconfirmed
 			} else {
-				p->read_latch=(Bit16u)(p->cntr-index*(PIT_TICK_RATE/1000.0));
+				p->read_latch=(Bit16u)(p->cntr-index);
 			}
 		}
 		break;
 	case 2:		/* Rate Generator */
-		index=fmod(index,(double)p->delay);
-		p->read_latch=(Bit16u)(p->cntr - (index/p->delay)*p->cntr);
+		index=PIT_PeriodIndex(index,p->period);
+		p->read_latch=(Bit16u)(p->cntr - (index*p->cntr)/p->period);
 		break;
 	case 3:		/* Square Wave Rate Generator */
-		index=fmod(index,(double)p->delay);
+		index=PIT_PeriodIndex(index,p->period);
 		index*=2;
-		if (index>p->delay) index-=p->delay;
-		p->read_latch=(Bit16u)(p->cntr - (index/p->delay)*p->cntr);
+		if (index>(Bit64s)p->period) index-=p->period;
+		p->read_latch=(Bit16u)(p->cntr - (index*p->cntr)/p->period);
+	//--End of modifications
 		// In mode 3 it never returns odd numbers LSB (if odd number is written 1 will be
 		// subtracted on first clock and then always 2)
 		// fixes "Corncob 3D"
@@ -225,7 +245,10 @@ static void write_latch(Bitu port,Bitu val,Bitu /*iolen*/) {
 			p->update_count=true;
 			return;
 		}
-		p->start=PIC_FullIndex();
+		//--Modified to time the counter in whole PIT clocks
+		p->start=PIT_Clock();
+		p->period=p->cntr;
+		//--End of modifications
 		p->delay=(1000.0f/((float)PIT_TICK_RATE/(float)p->cntr));
 
 		switch (counter) {
@@ -365,8 +388,9 @@ void TIMER_SetGate2(bool in) {
 	if(gate2 == in) return;
 	Bit8u & mode=pit[2].mode;
 	switch(mode) {
+	//--Modified to time the counter in whole PIT clocks
 	case 0:
-		if(in) pit[2].start = PIC_FullIndex();
+		if(in) pit[2].start = PIT_Clock();
 		else {
 			//Fill readlatch and store it.
 			counter_latch(2);
@@ -377,15 +401,16 @@ void TIMER_SetGate2(bool in) {
 		// gate 1 on: reload counter; off: nothing
 		if(in) {
 			pit[2].counting = true;
-			pit[2].start = PIC_FullIndex();
+			pit[2].start = PIT_Clock();
 		}
 		break;
 	case 2:
 	case 3:
 		//If gate is enabled restart counting. If disable store the current read_latch
-		if(in) pit[2].start = PIC_FullIndex();
+		if(in) pit[2].start = PIT_Clock();
 		else counter_latch(2);
 		break;
+	//--End of modifications
 	case 4:
 	case 5:
 		LOG(LOG_MISC,LOG_WARN)("unsupported gate 2 mode %x",mode);
@@ -441,12 +466,34 @@ public:
 		pit[0].delay=(1000.0f/((float)PIT_TICK_RATE/(float)pit[0].cntr));
 		pit[1].delay=(1000.0f/((float)PIT_TICK_RATE/(float)pit[1].cntr));
 		pit[2].delay=(1000.0f/((float)PIT_TICK_RATE/(float)pit[2].cntr));
+		//--Added to time the counters in whole PIT clocks
+		for (Bitu i=0;i<3;i++) {
+			pit[i].start=PIT_Clock();
+			pit[i].period=pit[i].cntr;
+		}
+		//--End of modifications
 
 		latched_timerstatus_locked=false;
 		gate2 = false;
 		PIC_AddEvent(PIT0_Event,pit[0].delay);
+		SAVESTATE_Register("timer",this);	//--Added for save states
+	}
+	//--Added for save states. Timer 0's pending event is restored along with the PIC's queue.
+	void SaveState(std::ostream& stream) {
+		SAVESTATE_Write(stream,pit);
+		SAVESTATE_Write(stream,gate2);
+		SAVESTATE_Write(stream,latched_timerstatus);
+		SAVESTATE_Write(stream,latched_timerstatus_locked);
+	}
+	void LoadState(std::istream& stream) {
+		SAVESTATE_Read(stream,pit);
+		SAVESTATE_Read(stream,gate2);
+		SAVESTATE_Read(stream,latched_timerstatus);
+		SAVESTATE_Read(stream,latched_timerstatus_locked);
 	}
+	//--End of modifications
 	~TIMER(){
+		SAVESTATE_Unregister(this);	//--Added for save states
 		PIC_RemoveEvents(PIT0_Event);
 	}
 };
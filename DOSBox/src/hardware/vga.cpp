@@ -23,6 +23,8 @@
 #include "video.h"
 #include "pic.h"
 #include "vga.h"
+#include "mem.h"
+#include "savestate.h"	//--Added for save states
 
 #include <string.h>
 
@@ -173,6 +175,105 @@ void VGA_SetCGA4Table(Bit8u val0,Bit8u val1,Bit8u val2,Bit8u val3) {
 	}	
 }
 
+//--Added for save states. The VGA has no module of its own, so it registers this instead.
+//Only the registers and memory are restored: the drawing code's own state is rebuilt from
+//them by VGA_RestartDrawing, which starts a fresh frame.
+class VGA_SaveState: public SaveStateComponent {
+private:
+	// the Tandy and PCjr display from either system memory or video memory
+	static Bit32u BaseOffset(Bit8u * base) {
+		if (base>=MemBase && base<MemBase+MEM_TotalPages()*4096) return (Bit32u)(base-MemBase);
+		if (base>=vga.mem.linear && base<vga.mem.linear+LinearSize()) return 0x80000000|(Bit32u)(base-vga.mem.linear);
+		return 0xffffffff;
+	}
+	static Bit8u * BaseFromOffset(Bit32u offset) {
+		if (offset==0xffffffff) return 0;
+		if (offset & 0x80000000) return vga.mem.linear+(offset & 0x7fffffff);
+		return MemBase+offset;
+	}
+	// matches the allocation in VGA_SetupMemory, less its spare scan line
+	static Bitu LinearSize(void) {
+		return (vga.vmemsize<512*1024) ? 512*1024 : vga.vmemsize;
+	}
+public:
+	void SaveState(std::ostream& stream) {
+		SAVESTATE_Write(stream,vga.vmemsize);
+		SAVESTATE_Write(stream,vga.mode);
+		SAVESTATE_Write(stream,vga.misc_output);
+		SAVESTATE_Write(stream,vga.config);
+		SAVESTATE_Write(stream,vga.internal);
+		SAVESTATE_Write(stream,vga.seq);
+		SAVESTATE_Write(stream,vga.attr);
+		SAVESTATE_Write(stream,vga.crtc);
+		SAVESTATE_Write(stream,vga.gfx);
+		SAVESTATE_Write(stream,vga.dac);
+		SAVESTATE_Write(stream,vga.latch);
+		SAVESTATE_Write(stream,vga.s3);
+		SAVESTATE_Write(stream,vga.svga);
+		SAVESTATE_Write(stream,vga.herc);
+		SAVESTATE_Write(stream,vga.other);
+		VGA_TANDY tandy=vga.tandy;
+		tandy.draw_base=tandy.mem_base=0;
+		SAVESTATE_Write(stream,tandy);
+		SAVESTATE_Write(stream,BaseOffset(vga.tandy.draw_base));
+		SAVESTATE_Write(stream,BaseOffset(vga.tandy.mem_base));
+		SAVESTATE_Write(stream,vga.vmemwrap);
+		SAVESTATE_Write(stream,vga.draw.font);
+		for (Bitu i=0;i<2;i++) SAVESTATE_Write(stream,(Bit32u)(vga.draw.font_tables[i]-vga.draw.font));
+		SAVESTATE_Write(stream,vga.draw.blinking);
+		SAVESTATE_Write(stream,vga.draw.cursor);
+		SAVESTATE_WriteBlock(stream,vga.mem.linear,LinearSize());
+		SAVESTATE_WriteBlock(stream,vga.fastmem,vga.vmemsize<<1);
+	}
+	void LoadState(std::istream& stream) {
+		Bit32u vmemsize=0;
+		SAVESTATE_Read(stream,vmemsize);
+		if (vmemsize!=vga.vmemsize) {
+			stream.setstate(std::ios::failbit);
+			return;
+		}
+		SAVESTATE_Read(stream,vga.mode);
+		SAVESTATE_Read(stream,vga.misc_output);
+		SAVESTATE_Read(stream,vga.config);
+		SAVESTATE_Read(stream,vga.internal);
+		SAVESTATE_Read(stream,vga.seq);
+		SAVESTATE_Read(stream,vga.attr);
+		SAVESTATE_Read(stream,vga.crtc);
+		SAVESTATE_Read(stream,vga.gfx);
+		SAVESTATE_Read(stream,vga.dac);
+		SAVESTATE_Read(stream,vga.latch);
+		SAVESTATE_Read(stream,vga.s3);
+		SAVESTATE_Read(stream,vga.svga);
+		SAVESTATE_Read(stream,vga.herc);
+		SAVESTATE_Read(stream,vga.other);
+		Bit32u draw_base=0,mem_base=0;
+		SAVESTATE_Read(stream,vga.tandy);
+		SAVESTATE_Read(stream,draw_base);
+		SAVESTATE_Read(stream,mem_base);
+		vga.tandy.draw_base=BaseFromOffset(draw_base);
+		vga.tandy.mem_base=BaseFromOffset(mem_base);
+		SAVESTATE_Read(stream,vga.vmemwrap);
+		SAVESTATE_Read(stream,vga.draw.font);
+		for (Bitu i=0;i<2;i++) {
+			Bit32u offset=0;
+			SAVESTATE_Read(stream,offset);
+			vga.draw.font_tables[i]=&vga.draw.font[offset & 0xffff];
+		}
+		SAVESTATE_Read(stream,vga.draw.blinking);
+		SAVESTATE_Read(stream,vga.draw.cursor);
+		SAVESTATE_ReadBlock(stream,vga.mem.linear,LinearSize());
+		SAVESTATE_ReadBlock(stream,vga.fastmem,vga.vmemsize<<1);
+		if (!stream) return;
+
+		VGA_SetupHandlers();
+		VGA_DACSetEntirePalette();
+		VGA_RestartDrawing();
+	}
+};
+
+static VGA_SaveState vga_savestate;
+//--End of modifications
+
 void VGA_Init(Section* sec) {
 //	Section_prop * section=static_cast<Section_prop *>(sec);
 	vga.draw.resizing=false;
@@ -239,6 +340,7 @@ void VGA_Init(Section* sec) {
 #endif
 		}
 	}
+	SAVESTATE_Register("vga",&vga_savestate);	//--Added for save states
 }
 
 void SVGA_Setup_Driver(void) {
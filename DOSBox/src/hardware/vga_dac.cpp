@@ -56,6 +56,9 @@ static void VGA_DAC_SendColor( Bitu index, Bitu src ) {
 	const Bit8u blue = vga.dac.rgb[src].blue;
 	//Set entry in 16bit output lookup table
 	vga.dac.xlat16[index] = ((blue>>1)&0x1f) | (((green)&0x3f)<<5) | (((red>>1)&0x1f) << 11);
+	//--Added to invalidate cached text lines
+	vga.draw.text_generation++;
+	//--End of modifications
 	
 	RENDER_SetPal( index, (red << 2) | ( red >> 4 ), (green << 2) | ( green >> 4 ), (blue << 2) | ( blue >> 4 ) );
 }
@@ -195,6 +198,13 @@ void VGA_DAC_SetEntry(Bitu entry,Bit8u red,Bit8u green,Bit8u blue) {
 			VGA_DAC_SendColor( i, i );
 }
 
+//--Added to resend the whole palette to the renderer, for when a save state has been loaded
+void VGA_DACSetEntirePalette(void) {
+	for (Bitu i=0;i<256;i++) VGA_DAC_UpdateColor(i);
+	for (Bit8u i=0;i<16;i++) VGA_DAC_CombineColor(i,vga.dac.combine[i]);
+}
+//--End of modifications
+
 void VGA_SetupDAC(void) {
 	vga.dac.first_changed=256;
 	vga.dac.bits=6;
@@ -27,6 +27,14 @@
 #include "../gui/render_scalers.h"
 #include "vga.h"
 #include "pic.h"
+//--Added for the performance counters
+#include "perfcounters.h"
+//--End of modifications
+//--Added for pipelined drawing
+#include <stdlib.h>
+#include <unistd.h>
+#include <dispatch/dispatch.h>
+//--End of modifications
 
 //--Added 2011-04-18 by Alun Bestor to fix endianness issues in Tandy/CGA line-printing
 #import <CoreFoundation/CFByteOrder.h>
@@ -84,6 +92,18 @@ static Bitu temp[643]={0};
 static Bit8u * VGA_Draw_CGA16_Line(Bitu vidstart, Bitu line) {
 	const Bit8u *base = vga.tandy.draw_base + ((line & vga.tandy.line_mask) << vga.tandy.line_shift);
 	const Bit8u *reader = base + vidstart;
+	//--Added to hand Boxer the raw pixel bits of the line, one per byte, whenever they will reach it
+	//as 8-bit frames: Boxer's renderer decodes them as an NTSC signal, with the hue and color from
+	//boxer_CGACompositeSignal. With 32-bit output the artifact colors still have to be worked out here.
+	if (render.scale.outMode == scalerMode8) {
+		Bit8u * raw=TempLine;
+		for (Bitu x=0;x<vga.draw.blocks;x++) {
+			Bitu val = *reader++;
+			for (Bitu b=0;b<8;b++) *raw++ = (Bit8u)((val >> (7-b)) & 1);
+		}
+		return TempLine;
+	}
+	//--End of modifications
 	Bit32u * draw=(Bit32u *)TempLine;
 	//Generate a temporary bitline to calculate the avarage
 	//over bit-2  bit-1  bit  bit+1.
@@ -160,31 +180,29 @@ static Bit8u * VGA_Draw_4BPP_Line_Double(Bitu vidstart, Bitu line) {
 }
 
 #ifdef VGA_KEEP_CHANGES
+//--Modified to hand changed lines to the mode's own line handler, rather than always
+//drawing them as linear memory. An unchanged line returns 0, which tells the renderer
+//to leave it as it was.
+static VGA_Line_Handler VGA_Changes_Draw_Line;
+
 static Bit8u * VGA_Draw_Changes_Line(Bitu vidstart, Bitu line) {
 	Bitu checkMask = vga.changes.checkMask;
 	Bit8u *map = vga.changes.map;
-	Bitu start = (vidstart >> VGA_CHANGE_SHIFT);
-	Bitu end = ((vidstart + vga.draw.line_length ) >> VGA_CHANGE_SHIFT);
+	Bitu offset = vidstart & vga.draw.linear_mask;
+	// A line that wraps around also reads the start of memory: just draw it
+	if (GCC_UNLIKELY(vga.draw.linear_mask-offset < vga.changes.span))
+		return VGA_Changes_Draw_Line(vidstart, line);
+	Bitu start = (offset >> VGA_CHANGE_SHIFT);
+	Bitu end = ((offset + vga.changes.span - 1) >> VGA_CHANGE_SHIFT);
 	for (; start <= end;start++) {
-		if ( map[start] & checkMask ) {
-			Bitu offset = vidstart & vga.draw.linear_mask;
-			if(vga.draw.linear_mask-offset < vga.draw.line_length)
-				memcpy(vga.draw.linear_base+vga.draw.linear_mask+1, vga.draw.linear_base, vga.draw.line_length);
-			Bit8u *ret = &vga.draw.linear_base[ offset ];
-#if !defined(C_UNALIGNED_MEMORY)
-			if (GCC_UNLIKELY( ((Bitu)ret) & (sizeof(Bitu)-1)) ) {
-				memcpy( TempLine, ret, vga.draw.line_length );
-				return TempLine;
-			}
-#endif
-			return ret;
-		}
+		if ( map[start] & checkMask )
+			return VGA_Changes_Draw_Line(vidstart, line);
 	}
 //	memset( TempLine, 0x30, vga.changes.lineWidth );
 //	return TempLine;
 	return 0;
 }
-
+//--End of modifications
 #endif
 
 static Bit8u * VGA_Draw_Linear_Line(Bitu vidstart, Bitu /*line*/) {
@@ -622,19 +640,98 @@ skip_cursor:
 	return TempLine;
 }
 
+//--Added to cache rendered text lines between frames
+// Text lines are rebuilt from font data on every frame, even though the screen is
+// usually static. Each output line remembers the character/attribute bytes and the
+// drawing state it was rendered with, and is only redrawn when one of those changes.
+// vga.draw.text_generation is bumped whenever font data or colours are modified.
+#define TEXT_CACHE_MAXLINES		SCALER_MAXHEIGHT
+#define TEXT_CACHE_MAXCOLUMNS	160
+
+typedef struct {
+	VGA_Line_Handler handler;
+	Bitu generation;
+	Bitu line;
+	Bitu blocks;
+	Bitu line_length;
+	Bit8u * font_tables[2];
+	Bit32u blink_mask;
+	Bitu panning;
+	Bitu split;
+	Bit8u mode_control;
+	Bit8u underline_location;
+	Bit8u cursor_attr;
+	Bits cursor_column;
+} TextLineKey;
+
+typedef struct {
+	Bit32u pixels[SCALER_MAXWIDTH / 2];
+	Bit8u text[TEXT_CACHE_MAXCOLUMNS * 2 + 2];
+	TextLineKey key;
+} TextLineCache;
+
+static TextLineCache TextCache[TEXT_CACHE_MAXLINES];
+static VGA_Line_Handler VGA_TEXT_Uncached_Draw_Line;
+
+static Bit8u * VGA_TEXT_Cached_Draw_Line(Bitu vidstart, Bitu line) {
+	Bitu index = vga.draw.lines_done;
+	if (GCC_UNLIKELY(index >= TEXT_CACHE_MAXLINES || vga.draw.blocks > TEXT_CACHE_MAXCOLUMNS ||
+		vga.draw.line_length > sizeof(TextCache[0].pixels)))
+		return VGA_TEXT_Uncached_Draw_Line(vidstart, line);
+
+	TextLineKey key;
+	memset(&key, 0, sizeof(key));
+	key.handler = VGA_TEXT_Uncached_Draw_Line;
+	key.generation = vga.draw.text_generation;
+	key.line = line;
+	key.blocks = vga.draw.blocks;
+	key.line_length = vga.draw.line_length;
+	key.font_tables[0] = vga.draw.font_tables[0];
+	key.font_tables[1] = vga.draw.font_tables[1];
+	key.blink_mask = FontMask[1];
+	key.panning = vga.draw.panning;
+	key.split = (vga.draw.lines_done >= vga.draw.split_line);
+	key.mode_control = vga.attr.mode_control;
+	key.underline_location = vga.crtc.underline_location;
+	key.cursor_column = -1;
+	if (vga.draw.cursor.enabled && (vga.draw.cursor.count&0x8) &&
+		line >= vga.draw.cursor.sline && line <= vga.draw.cursor.eline) {
+		Bits font_addr = (vga.draw.cursor.address-vidstart) >> 1;
+		if (font_addr>=0 && font_addr<(Bits)vga.draw.blocks) {
+			key.cursor_column = font_addr;
+			key.cursor_attr = vga.tandy.draw_base[vga.draw.cursor.address+1];
+		}
+	}
+
+	// The 9-pixel panning variant also reads the character after the last block
+	const Bit8u* vidmem = VGA_Text_Memwrap(vidstart);
+	Bitu text_length = vga.draw.blocks*2 + 2;
+	TextLineCache * cached = &TextCache[index];
+	if (memcmp(&cached->key, &key, sizeof(key)) == 0 && memcmp(cached->text, vidmem, text_length) == 0)
+		return (Bit8u *)cached->pixels;
+
+	memcpy(cached->text, vidmem, text_length);
+	memcpy(&cached->key, &key, sizeof(key));
+	memcpy(cached->pixels, VGA_TEXT_Uncached_Draw_Line(vidstart, line), vga.draw.line_length);
+	return (Bit8u *)cached->pixels;
+}
+//--End of modifications
+
 #ifdef VGA_KEEP_CHANGES
 static INLINE void VGA_ChangesEnd(void ) {
 	if ( vga.changes.active ) {
 //		vga.changes.active = false;
-		Bitu end = vga.draw.address >> VGA_CHANGE_SHIFT;
-		Bitu total = 4 + end - vga.changes.start;
+		//--Modified to clear this frame's bit across the whole map. The address can wrap
+		//or jump at the split line, which left blocks behind when only the range from
+		//the start address to the end address was cleared.
+		Bitu total = vga.changes.mapSize >> 2;
 		Bit32u clearMask = vga.changes.clearMask;
-		total >>= 2;
-		Bit32u *clear = (Bit32u *)&vga.changes.map[  vga.changes.start & ~3 ];
+		Bit32u *clear = (Bit32u *)vga.changes.map;
 		while ( total-- ) {
 			clear[0] &= clearMask;
 			clear++;
 		}
+		//--End of modifications
 	}
 }
 #endif
@@ -654,13 +751,22 @@ static void VGA_ProcessSplit() {
 }
 
 static void VGA_DrawSingleLine(Bitu /*blah*/) {
+	//--Added for the performance counters
+	PerfScope perf(PERF_VGA);
+	//--End of modifications
 	if (GCC_UNLIKELY(vga.attr.disabled)) {
 		// draw blanked line (DoWhackaDo, Alien Carnage, TV sports Football)
 		memset(TempLine, 0, sizeof(TempLine));
+		//--Modified to time the scaler separately for the performance counters
+		PerfScope render_perf(PERF_RENDER);
 		RENDER_DrawLine(TempLine);
+		//--End of modifications
 	} else {
 		Bit8u * data=VGA_DrawLine( vga.draw.address, vga.draw.address_line );	
+		//--Modified to time the scaler separately for the performance counters
+		PerfScope render_perf(PERF_RENDER);
 		RENDER_DrawLine(data);
+		//--End of modifications
 	}
 
 	vga.draw.address_line++;
@@ -672,28 +778,33 @@ static void VGA_DrawSingleLine(Bitu /*blah*/) {
 	if (vga.draw.split_line==vga.draw.lines_done) VGA_ProcessSplit();
 	if (vga.draw.lines_done < vga.draw.lines_total) {
 		PIC_AddEvent(VGA_DrawSingleLine,(float)vga.draw.delay.htotal);
-	} else RENDER_EndUpdate(false);
+	} else {
+#ifdef VGA_KEEP_CHANGES
+		VGA_ChangesEnd();
+#endif
+		RENDER_EndUpdate(false);
+	}
 }
 
 static void VGA_DrawPart(Bitu lines) {
+	//--Added for the performance counters
+	PerfScope perf(PERF_VGA);
+	//--End of modifications
 	while (lines--) {
 		Bit8u * data=VGA_DrawLine( vga.draw.address, vga.draw.address_line );
-		RENDER_DrawLine(data);
+		//--Modified to time the scaler separately for the performance counters
+		{
+			PerfScope render_perf(PERF_RENDER);
+			RENDER_DrawLine(data);
+		}
+		//--End of modifications
 		vga.draw.address_line++;
 		if (vga.draw.address_line>=vga.draw.address_line_total) {
 			vga.draw.address_line=0;
 			vga.draw.address+=vga.draw.address_add;
 		}
 		vga.draw.lines_done++;
-		if (vga.draw.split_line==vga.draw.lines_done) {
-#ifdef VGA_KEEP_CHANGES
-			VGA_ChangesEnd( );
-#endif
-			VGA_ProcessSplit();
-#ifdef VGA_KEEP_CHANGES
-			vga.changes.start = vga.draw.address >> VGA_CHANGE_SHIFT;
-#endif
-		}
+		if (vga.draw.split_line==vga.draw.lines_done) VGA_ProcessSplit();
 	}
 	if (--vga.draw.parts_left) {
 		PIC_AddEvent(VGA_DrawPart,(float)vga.draw.delay.parts,
@@ -719,23 +830,77 @@ void VGA_SetBlinking(Bitu enabled) {
 		vga.tandy.mode_control&=~0x20;
 	}
 	for (Bitu i=0;i<8;i++) TXT_BG_Table[i+8]=(b+i) | ((b+i) << 8)| ((b+i) <<16) | ((b+i) << 24);
+	//--Added to invalidate cached text lines
+	vga.draw.text_generation++;
+	//--End of modifications
 }
 
 #ifdef VGA_KEEP_CHANGES
+//--Added to catch everything besides video memory that decides what a frame looks like.
+//Only memory writes are tracked, so a frame is drawn in full whenever any of this differs
+//from the last frame that was drawn.
+typedef struct {
+	VGA_Line_Handler handler;
+	Bit8u * linear_base;
+	Bitu linear_mask;
+	Bitu address;
+	Bitu address_add;
+	Bitu address_line;
+	Bitu split_line;
+	Bitu panning;
+	Bitu generation;
+	Bit32u blink_mask;
+	Bitu cursor_address;
+	Bitu cursor_sline;
+	Bitu cursor_eline;
+	bool cursor_visible;
+	Bit8u mode_control;
+	Bit8u underline_location;
+	Bit8u disabled;
+} ChangesFrameKey;
+
+static ChangesFrameKey VGA_ChangesLastFrame;
+//--End of modifications
+
 static void INLINE VGA_ChangesStart( void ) {
-	vga.changes.start = vga.draw.address >> VGA_CHANGE_SHIFT;
-	vga.changes.last = vga.changes.start;
-	if ( vga.changes.lastAddress != vga.draw.address ) {
+	//--Modified to compare everything the frame depends on, not just the start address,
+	//and to draw full frames with the mode's own line handler
+	ChangesFrameKey key;
+	memset(&key, 0, sizeof(key));
+	key.handler = VGA_Changes_Draw_Line;
+	key.linear_base = vga.draw.linear_base;
+	key.linear_mask = vga.draw.linear_mask;
+	key.address = vga.draw.address;
+	key.address_add = vga.draw.address_add;
+	key.address_line = vga.draw.address_line;
+	key.split_line = vga.draw.split_line;
+	key.panning = vga.draw.panning;
+	key.generation = vga.draw.text_generation;
+	key.mode_control = vga.attr.mode_control;
+	key.disabled = vga.attr.disabled;
+	if (vga.mode == M_TEXT) {
+		key.blink_mask = FontMask[1];
+		key.cursor_address = vga.draw.cursor.address;
+		key.cursor_sline = vga.draw.cursor.sline;
+		key.cursor_eline = vga.draw.cursor.eline;
+		key.cursor_visible = vga.draw.cursor.enabled && (vga.draw.cursor.count&0x8);
+		key.underline_location = vga.crtc.underline_location;
+	}
+	// The S3 hardware cursor moves without touching video memory
+	bool hwcursor_active = svga.hardware_cursor_active && svga.hardware_cursor_active();
+
+	if ( memcmp(&VGA_ChangesLastFrame, &key, sizeof(key)) != 0 ) {
 //		LOG_MSG("Address");
-		VGA_DrawLine = VGA_Draw_Linear_Line;
-		vga.changes.lastAddress = vga.draw.address;
-	} else if ( render.fullFrame ) {
+		VGA_DrawLine = VGA_Changes_Draw_Line;
+		memcpy(&VGA_ChangesLastFrame, &key, sizeof(key));
+	} else if ( render.fullFrame || hwcursor_active ) {
 //		LOG_MSG("Full Frame");
-		VGA_DrawLine = VGA_Draw_Linear_Line;
+		VGA_DrawLine = VGA_Changes_Draw_Line;
 	} else {
 //		LOG_MSG("Changes");
 		VGA_DrawLine = VGA_Draw_Changes_Line;
 	}
+	//--End of modifications
 	vga.changes.active = true;
 	vga.changes.checkMask = vga.changes.writeMask;
 	vga.changes.clearMask = ~( 0x01010101 << (vga.changes.frame & 7));
@@ -744,6 +909,145 @@ static void INLINE VGA_ChangesStart( void ) {
 }
 #endif
 
+#ifdef VGA_KEEP_CHANGES
+//--Added to draw SVGA frames on a worker thread while emulation carries on.
+//At the start of each frame the memory the frame is drawn from is brought up to date in a
+//shadow copy, using the change map to copy only the blocks written since the last frame.
+//The worker then draws every line of the frame from the shadow, and the frame is finished
+//on the emulation thread when its last part would have been drawn, so it reaches Boxer at
+//the same emulated time as before. The worker owns the line handlers and the renderer in the
+//meantime, so anything else that touches them waits for it first with VGA_WaitForPipelinedFrame.
+//Frames are only pipelined in the linear modes, and only without a split screen: everything
+//else, and anything that would differ part of the way down the frame, is drawn as usual.
+#define VGA_PIPELINE_MIN_CPUS	4
+
+typedef struct {
+	VGA_Line_Handler handler;
+	Bitu address;
+	Bitu address_line;
+	Bitu address_line_total;
+	Bitu address_add;
+	Bitu lines;
+} PipelinedFrame;
+
+static struct {
+	bool enabled;
+	bool pending;			// a frame has been handed to the worker and not yet finished
+	dispatch_queue_t queue;
+	Bit8u * shadow;
+	Bitu shadow_size;
+	bool shadow_valid;		// whether the shadow matches the source as of the last pipelined frame
+	Bit8u * source;			// the memory the shadow copies, and the draw address mask it was copied with
+	Bitu source_mask;
+} pipeline;
+
+static void VGA_DrawPipelinedFrame(PipelinedFrame frame) {
+	// Called on the worker: no performance counters here, as those belong to the emulation thread
+	for (Bitu i=0;i<frame.lines;i++) {
+		RENDER_DrawLine(frame.handler(frame.address,frame.address_line));
+		frame.address_line++;
+		if (frame.address_line>=frame.address_line_total) {
+			frame.address_line=0;
+			frame.address+=frame.address_add;
+		}
+	}
+}
+
+void VGA_WaitForPipelinedFrame(void) {
+	if (pipeline.pending) dispatch_sync(pipeline.queue,^{});
+}
+
+static void VGA_EndPipelinedFrame(bool abort) {
+	VGA_WaitForPipelinedFrame();
+	pipeline.pending=false;
+	if (vga.draw.linear_base==pipeline.shadow) vga.draw.linear_base=pipeline.source;
+	if (abort) {
+		pipeline.shadow_valid=false;
+	} else {
+		VGA_ChangesEnd();
+	}
+	RENDER_EndUpdate(abort);
+}
+
+static void VGA_FinishPipelinedFrame(Bitu /*val*/) {
+	PerfScope perf(PERF_VGA);
+	VGA_EndPipelinedFrame(false);
+}
+
+void VGA_SetPipelinedDrawing(bool enabled) {
+	pipeline.enabled=enabled && sysconf(_SC_NPROCESSORS_ONLN)>=VGA_PIPELINE_MIN_CPUS;
+}
+
+static bool VGA_CanPipelineFrame(void) {
+	if (!pipeline.enabled || vga.draw.mode!=PART || !vga.changes.active) return false;
+	switch (vga.mode) {
+	case M_VGA:
+	case M_LIN8:
+	case M_LIN15:
+	case M_LIN16:
+	case M_LIN32:
+		break;
+	default:
+		return false;
+	}
+	// Other handlers read registers or memory that may change while the worker draws
+	if (VGA_Changes_Draw_Line!=VGA_Draw_Linear_Line) return false;
+	// A split already processed at the top of the frame is fine, one partway down is not
+	return vga.draw.split_line==0 || vga.draw.split_line>=vga.draw.lines_total;
+}
+
+static void VGA_StartPipelinedFrame(float draw_skip) {
+	if (!pipeline.queue) {
+		pipeline.queue=dispatch_queue_create("com.boxer.vga",NULL);
+		dispatch_set_target_queue(pipeline.queue,dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH,0));
+	}
+	// The line handler may copy a line's worth past the end, as it does with video memory
+	Bitu size=vga.draw.linear_mask+1;
+	if (pipeline.shadow_size<size+sizeof(TempLine)) {
+		free(pipeline.shadow);
+		pipeline.shadow_size=size+sizeof(TempLine);
+		pipeline.shadow=(Bit8u *)malloc(pipeline.shadow_size);
+		if (!pipeline.shadow) E_Exit("Allocating the VGA pipeline buffer has failed");
+		pipeline.shadow_valid=false;
+	}
+	if (pipeline.source!=vga.draw.linear_base || pipeline.source_mask!=vga.draw.linear_mask)
+		pipeline.shadow_valid=false;
+
+	if (!pipeline.shadow_valid) {
+		memcpy(pipeline.shadow,vga.draw.linear_base,size);
+	} else {
+		Bitu blocks=size>>VGA_CHANGE_SHIFT;
+		if (blocks>vga.changes.mapSize) blocks=vga.changes.mapSize;
+		Bit8u checkMask=vga.changes.checkMask;
+		for (Bitu i=0;i<blocks;i++) {
+			if (vga.changes.map[i] & checkMask)
+				memcpy(pipeline.shadow+(i<<VGA_CHANGE_SHIFT),vga.draw.linear_base+(i<<VGA_CHANGE_SHIFT),1<<VGA_CHANGE_SHIFT);
+		}
+	}
+	pipeline.shadow_valid=true;
+	pipeline.source=vga.draw.linear_base;
+	pipeline.source_mask=vga.draw.linear_mask;
+	vga.draw.linear_base=pipeline.shadow;
+
+	PipelinedFrame frame;
+	frame.handler=VGA_DrawLine;
+	frame.address=vga.draw.address;
+	frame.address_line=vga.draw.address_line;
+	frame.address_line_total=vga.draw.address_line_total;
+	frame.address_add=vga.draw.address_add;
+	frame.lines=vga.draw.lines_total;
+	dispatch_async(pipeline.queue,^{
+		VGA_DrawPipelinedFrame(frame);
+	});
+	pipeline.pending=true;
+
+	vga.draw.parts_left=0;
+	vga.draw.lines_done=vga.draw.lines_total;
+	PIC_AddEvent(VGA_FinishPipelinedFrame,(float)(vga.draw.delay.parts*vga.draw.parts_total)+draw_skip);
+}
+//--End of modifications
+#endif
+
 static void VGA_VertInterrupt(Bitu /*val*/) {
 	if ((!vga.draw.vret_triggered) && ((vga.crtc.vertical_retrace_end&0x30)==0x10)) {
 		vga.draw.vret_triggered=true;
@@ -766,8 +1070,19 @@ static void VGA_PanningLatch(Bitu /*val*/) {
 }
 
 static void VGA_VerticalTimer(Bitu /*val*/) {
+	//--Added for the performance counters
+	PerfScope perf(PERF_VGA);
+	//--End of modifications
 	vga.draw.delay.framestart = PIC_FullIndex();
 	PIC_AddEvent( VGA_VerticalTimer, (float)vga.draw.delay.vtotal );
+#ifdef VGA_KEEP_CHANGES
+	//--Added to finish a pipelined frame that is still outstanding, as the last part would have been drawn
+	if (GCC_UNLIKELY(pipeline.pending)) {
+		PIC_RemoveEvents(VGA_FinishPipelinedFrame);
+		VGA_EndPipelinedFrame(false);
+	}
+	//--End of modifications
+#endif
 	
 	switch(machine) {
 	case MCH_PCJR:
@@ -852,6 +1167,11 @@ static void VGA_VerticalTimer(Bitu /*val*/) {
 	case M_TEXT:
 		vga.draw.byte_panning_shift = 2;
 		vga.draw.address += vga.draw.bytes_skip;
+		//--Added to skip unchanged text lines too
+#ifdef VGA_KEEP_CHANGES
+		startaddr_changed = IS_EGAVGA_ARCH;
+#endif
+		//--End of modifications
 		// fall-through
 	case M_TANDY_TEXT:
 	case M_HERC_TEXT:
@@ -897,6 +1217,16 @@ static void VGA_VerticalTimer(Bitu /*val*/) {
 			PIC_RemoveEvents(VGA_DrawPart);
 			RENDER_EndUpdate(true);
 		}
+#ifdef VGA_KEEP_CHANGES
+		//--Added to draw the frame on the worker when nothing will change part of the way down it
+		if (VGA_CanPipelineFrame()) {
+			VGA_StartPipelinedFrame(draw_skip);
+			break;
+		}
+		// This frame takes this frame's changes with it, so the shadow falls behind
+		pipeline.shadow_valid=false;
+		//--End of modifications
+#endif
 		vga.draw.lines_done = 0;
 		vga.draw.parts_left = vga.draw.parts_total;
 		PIC_AddEvent(VGA_DrawPart,(float)vga.draw.delay.parts + draw_skip,vga.draw.parts_lines);
@@ -961,11 +1291,20 @@ void VGA_CheckScanLength(void) {
 }
 
 void VGA_ActivateHardwareCursor(void) {
+#ifdef VGA_KEEP_CHANGES
+	//--Added so as not to swap line handlers under the worker
+	VGA_WaitForPipelinedFrame();
+	//--End of modifications
+#endif
 	bool hwcursor_active=false;
 	if (svga.hardware_cursor_active) {
 		if (svga.hardware_cursor_active()) hwcursor_active=true;
 	}
-	if (hwcursor_active) {
+	//--Modified to leave the cursor out of the lines when Boxer draws it over the frame itself:
+	//that way moving the cursor doesn't change any lines, so none have to be redrawn or uploaded.
+	//if (hwcursor_active) {
+	if (hwcursor_active && !boxer_drawsHardwareCursor()) {
+	//--End of modifications
 		switch(vga.mode) {
 		case M_LIN32:
 			VGA_DrawLine=VGA_Draw_LIN32_Line_HWMouse;
@@ -980,9 +1319,54 @@ void VGA_ActivateHardwareCursor(void) {
 	} else {
 		VGA_DrawLine=VGA_Draw_Linear_Line;
 	}
+#ifdef VGA_KEEP_CHANGES
+	//--Added so that change tracking draws with the new handler too
+	VGA_Changes_Draw_Line=VGA_DrawLine;
+	//--End of modifications
+#endif
+}
+
+//--Added to tell the renderer when the hardware cursor has moved or changed since this was last called,
+//so that it can hand on a frame for Boxer to draw the cursor over even if no lines have changed.
+bool VGA_HardwareCursorChanged(void) {
+	static bool last_active=false;
+	static VGA_HWCURSOR last_cursor;
+	static Bit8u last_pattern[64*64*2/8];
+
+	bool active=svga.hardware_cursor_active && svga.hardware_cursor_active();
+	if (!active) {
+		bool changed=last_active;
+		last_active=false;
+		return changed;
+	}
+
+	const Bit8u * pattern=&vga.mem.linear[((Bitu)vga.s3.hgc.startaddr)<<10];
+	bool changed=!last_active ||
+		last_cursor.originx!=vga.s3.hgc.originx || last_cursor.originy!=vga.s3.hgc.originy ||
+		last_cursor.posx!=vga.s3.hgc.posx || last_cursor.posy!=vga.s3.hgc.posy ||
+		memcmp(last_cursor.forestack,vga.s3.hgc.forestack,sizeof(last_cursor.forestack)) ||
+		memcmp(last_cursor.backstack,vga.s3.hgc.backstack,sizeof(last_cursor.backstack)) ||
+		memcmp(last_pattern,pattern,sizeof(last_pattern));
+	if (changed) {
+		last_active=true;
+		last_cursor.originx=vga.s3.hgc.originx;
+		last_cursor.originy=vga.s3.hgc.originy;
+		last_cursor.posx=vga.s3.hgc.posx;
+		last_cursor.posy=vga.s3.hgc.posy;
+		memcpy(last_cursor.forestack,vga.s3.hgc.forestack,sizeof(last_cursor.forestack));
+		memcpy(last_cursor.backstack,vga.s3.hgc.backstack,sizeof(last_cursor.backstack));
+		memcpy(last_pattern,pattern,sizeof(last_pattern));
+	}
+	return changed;
 }
+//--End of modifications
 
 void VGA_SetupDrawing(Bitu /*val*/) {
+#ifdef VGA_KEEP_CHANGES
+	//--Added so as not to change the drawing setup under the worker
+	VGA_WaitForPipelinedFrame();
+	//--End of modifications
+#endif
 	if (vga.mode==M_ERROR) {
 		PIC_RemoveEvents(VGA_VerticalTimer);
 		PIC_RemoveEvents(VGA_PanningLatch);
@@ -1418,6 +1802,12 @@ void VGA_SetupDrawing(Bitu /*val*/) {
 		LOG(LOG_VGA,LOG_ERROR)("Unhandled VGA mode %d while checking for resolution",vga.mode);
 		break;
 	}
+	//--Added to cache rendered text lines between frames
+	if (vga.mode==M_TEXT || vga.mode==M_TANDY_TEXT) {
+		VGA_TEXT_Uncached_Draw_Line=VGA_DrawLine;
+		VGA_DrawLine=VGA_TEXT_Cached_Draw_Line;
+	}
+	//--End of modifications
 	VGA_CheckScanLength();
 	if (vga.draw.double_scan) {
 		if (IS_VGA_ARCH) { 
@@ -1444,6 +1834,28 @@ void VGA_SetupDrawing(Bitu /*val*/) {
 	vga.changes.active = false;
 	vga.changes.frame = 0;
 	vga.changes.writeMask = 1;
+	//--Added to track changes with the mode's own line handler, and to draw the next frame in full
+	VGA_Changes_Draw_Line = VGA_DrawLine;
+	switch (vga.mode) {
+	case M_TEXT:
+		// The 9-pixel panning variant also reads the character after the last block
+		vga.changes.span = vga.draw.blocks*2 + 2;
+		break;
+	case M_EGA:
+	case M_LIN4:
+		// One byte of fastmem per pixel
+		vga.changes.span = vga.draw.blocks*8;
+		break;
+	case M_VGA:
+		// One byte per pixel, whatever the output depth
+		vga.changes.span = width;
+		break;
+	default:
+		vga.changes.span = vga.draw.line_length;
+		break;
+	}
+	memset(&VGA_ChangesLastFrame, 0, sizeof(VGA_ChangesLastFrame));
+	//--End of modifications
 #endif
     /* 
 	   Cheap hack to just make all > 640x480 modes have 4:3 aspect ratio
@@ -1503,9 +1915,36 @@ void VGA_SetupDrawing(Bitu /*val*/) {
 }
 
 void VGA_KillDrawing(void) {
+#ifdef VGA_KEEP_CHANGES
+	//--Added for pipelined drawing
+	if (pipeline.pending) {
+		PIC_RemoveEvents(VGA_FinishPipelinedFrame);
+		VGA_EndPipelinedFrame(true);
+	}
+	//--End of modifications
+#endif
 	PIC_RemoveEvents(VGA_DrawPart);
 	PIC_RemoveEvents(VGA_DrawSingleLine);
 	vga.draw.parts_left = 0;
 	vga.draw.lines_done = ~0;
 	RENDER_EndUpdate(true);
 }
+
+//--Added for save states. Rather than restoring the drawing code's progress through the
+//current frame, this discards it and starts a new frame with the restored registers.
+void VGA_RestartDrawing(void) {
+	VGA_KillDrawing();
+	PIC_RemoveEvents(VGA_Other_VertInterrupt);
+	PIC_RemoveEvents(VGA_VerticalTimer);
+	PIC_RemoveEvents(VGA_PanningLatch);
+	PIC_RemoveEvents(VGA_DisplayStartLatch);
+	PIC_RemoveEvents(VGA_VertInterrupt);
+	PIC_RemoveEvents(VGA_SetupDrawing);
+	vga.draw.resizing=false;
+	// force the timing and the output size to be set up again
+	vga.draw.delay.vtotal=0;
+	vga.draw.width=0;
+	vga.draw.text_generation++;
+	VGA_SetupDrawing(0);
+}
+//--End of modifications
@@ -23,6 +23,14 @@
 #include "vga.h"
 
 #define gfx(blah) vga.gfx.blah
+
+//--Added to let planar writes skip the parts of the write pipeline that aren't in use
+static void VGA_UpdatePlainWrite(void) {
+	if (!vga.config.data_rotate && !vga.config.raster_op && !vga.config.full_enable_set_reset &&
+		vga.config.full_bit_mask==0xffffffff) vga.config.mh_mask|=MH_PLAINWRITE;
+	else vga.config.mh_mask&=~MH_PLAINWRITE;
+}
+//--End of modifications
 static bool index9warned=false;
 
 static void write_p3ce(Bitu port,Bitu val,Bitu iolen) {
@@ -58,6 +66,7 @@ static void write_p3cf(Bitu port,Bitu val,Bitu iolen) {
 		vga.config.full_enable_and_set_reset=vga.config.full_set_reset &
 			vga.config.full_enable_set_reset;
 //		if (gfx(enable_set_reset)) vga.config.mh_mask|=MH_SETRESET else vga.config.mh_mask&=~MH_SETRESET;
+		VGA_UpdatePlainWrite();	//--Added for planar write fast paths
 		break;
 	case 2: /* Color Compare Register */
 		gfx(color_compare)=val & 0x0f;
@@ -75,6 +84,7 @@ static void write_p3cf(Bitu port,Bitu val,Bitu iolen) {
 		vga.config.data_rotate=val & 7;
 //		if (val) vga.config.mh_mask|=MH_ROTATEOP else vga.config.mh_mask&=~MH_ROTATEOP;
 		vga.config.raster_op=(val>>3) & 3;
+		VGA_UpdatePlainWrite();	//--Added for planar write fast paths
 		/* 
 			0-2	Number of positions to rotate data right before it is written to
 				display memory. Only active in Write Mode 0.
@@ -170,6 +180,7 @@ static void write_p3cf(Bitu port,Bitu val,Bitu iolen) {
 	case 8: /* Bit Mask Register */
 		gfx(bit_mask)=val;
 		vga.config.full_bit_mask=ExpandTable[val];
+		VGA_UpdatePlainWrite();	//--Added for planar write fast paths
 //		LOG_DEBUG("Bit mask %2X",val);
 		/*
 			0-7	Each bit if set enables writing to the corresponding bit of a byte in
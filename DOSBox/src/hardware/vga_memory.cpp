@@ -47,13 +47,6 @@
 #define CHECKED4(v) ((v)&((vga.vmemwrap>>2)-1))
 
 
-#ifdef VGA_KEEP_CHANGES
-#define MEM_CHANGED( _MEM ) vga.changes.map[ (_MEM) >> VGA_CHANGE_SHIFT ] |= vga.changes.writeMask;
-//#define MEM_CHANGED( _MEM ) vga.changes.map[ (_MEM) >> VGA_CHANGE_SHIFT ] = 1;
-#else
-#define MEM_CHANGED( _MEM ) 
-#endif
-
 #define TANDY_VIDBASE(_X_)  &MemBase[ 0x80000 + (_X_)]
 
 template <class Size>
@@ -125,6 +118,16 @@ INLINE static Bit32u ModeOperation(Bit8u val) {
 	return full;
 }
 
+//--Added to skip ModeOperation's switches for the most common planar writes.
+//Write mode 0 with nothing but the map mask in use is how Mode X and most EGA games draw,
+//and write mode 1 is how they copy around video memory.
+INLINE static Bit32u FastModeOperation(Bit8u val) {
+	if (vga.config.write_mode==0 && (vga.config.mh_mask & MH_PLAINWRITE)) return ExpandTable[val];
+	if (vga.config.write_mode==1) return vga.latch.d;
+	return ModeOperation(val);
+}
+//--End of modifications
+
 /* Gonna assume that whoever maps vga memory, maps it on 32/64kb boundary */
 
 #define VGA_PAGES		(128/4)
@@ -216,14 +219,19 @@ public:
 		addr = PAGING_GetPhysicalAddress(addr) & vgapages.mask;
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED(addr);
-		MEM_CHANGED( addr << 3);
+		//--Modified to mark the pixels this byte actually lands on in fastmem
+		MEM_CHANGED( (addr >> 2) << 3 );
+		//--End of modifications
 		writeHandler(addr+0,(Bit8u)(val >> 0));
 	}
 	void writew(PhysPt addr,Bitu val) {
 		addr = PAGING_GetPhysicalAddress(addr) & vgapages.mask;
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED(addr);
-		MEM_CHANGED( addr << 3);
+		//--Modified to mark the pixels these bytes actually land on in fastmem
+		MEM_CHANGED( (addr >> 2) << 3 );
+		MEM_CHANGED( ((addr+1) >> 2) << 3 );
+		//--End of modifications
 		writeHandler(addr+0,(Bit8u)(val >> 0));
 		writeHandler(addr+1,(Bit8u)(val >> 8));
 	}
@@ -231,7 +239,10 @@ public:
 		addr = PAGING_GetPhysicalAddress(addr) & vgapages.mask;
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED(addr);
-		MEM_CHANGED( addr << 3);
+		//--Modified to mark the pixels these bytes actually land on in fastmem
+		MEM_CHANGED( (addr >> 2) << 3 );
+		MEM_CHANGED( ((addr+3) >> 2) << 3 );
+		//--End of modifications
 		writeHandler(addr+0,(Bit8u)(val >> 0));
 		writeHandler(addr+1,(Bit8u)(val >> 8));
 		writeHandler(addr+2,(Bit8u)(val >> 16));
@@ -265,9 +276,13 @@ public:
 
 class VGA_UnchainedEGA_Handler : public VGA_UnchainedRead_Handler {
 public:
+	//--Modified to split storing the planes from working out what goes in them
 	template< bool wrapping>
 	void writeHandler(PhysPt start, Bit8u val) {
-		Bit32u data=ModeOperation(val);
+		storeHandler(start,FastModeOperation(val));
+	}
+	void storeHandler(PhysPt start, Bit32u data) {
+	//--End of modifications
 		/* Update video memory and the pixel buffer */
 		VGA_Latch pixels;
 		pixels.d=((Bit32u*)vga.mem.linear)[start];
@@ -292,6 +307,19 @@ public:
 			Expand16Table[3][temp.b[3]];
 		*(Bit32u *)(write_pixels+4)=colors4_7;
 	}
+	//--Added to write several bytes at once for writew and writed, working out
+	//what goes in the planes once for the whole lot where it doesn't depend on the data
+	void writeBlock(PhysPt start, Bitu val, Bitu count) {
+		if (vga.config.write_mode==1) {
+			Bit32u data=vga.latch.d;
+			for (Bitu i=0;i<count;i++) storeHandler(start+i,data);
+		} else if (vga.config.write_mode==0 && (vga.config.mh_mask & MH_PLAINWRITE)) {
+			for (Bitu i=0;i<count;i++,val>>=8) storeHandler(start+i,ExpandTable[val & 0xff]);
+		} else {
+			for (Bitu i=0;i<count;i++,val>>=8) storeHandler(start+i,ModeOperation((Bit8u)val));
+		}
+	}
+	//--End of modifications
 public:	
 	VGA_UnchainedEGA_Handler()  {
 		flags=PFLAG_NOCODE;
@@ -307,19 +335,25 @@ public:
 		addr = PAGING_GetPhysicalAddress(addr) & vgapages.mask;
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED2(addr);
-		MEM_CHANGED( addr << 3);
-		writeHandler<true>(addr+0,(Bit8u)(val >> 0));
-		writeHandler<true>(addr+1,(Bit8u)(val >> 8));
+		MEM_CHANGED_RANGE( addr << 3, 2 << 3 );	//--Modified to mark both ends of the write
+		//--Modified to write both bytes at once
+		//writeHandler<true>(addr+0,(Bit8u)(val >> 0));
+		//writeHandler<true>(addr+1,(Bit8u)(val >> 8));
+		writeBlock(addr,val,2);
+		//--End of modifications
 	}
 	void writed(PhysPt addr,Bitu val) {
 		addr = PAGING_GetPhysicalAddress(addr) & vgapages.mask;
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED2(addr);
-		MEM_CHANGED( addr << 3);
-		writeHandler<true>(addr+0,(Bit8u)(val >> 0));
-		writeHandler<true>(addr+1,(Bit8u)(val >> 8));
-		writeHandler<true>(addr+2,(Bit8u)(val >> 16));
-		writeHandler<true>(addr+3,(Bit8u)(val >> 24));
+		MEM_CHANGED_RANGE( addr << 3, 4 << 3 );	//--Modified to mark both ends of the write
+		//--Modified to write all four bytes at once
+		//writeHandler<true>(addr+0,(Bit8u)(val >> 0));
+		//writeHandler<true>(addr+1,(Bit8u)(val >> 8));
+		//writeHandler<true>(addr+2,(Bit8u)(val >> 16));
+		//writeHandler<true>(addr+3,(Bit8u)(val >> 24));
+		writeBlock(addr,val,4);
+		//--End of modifications
 	}
 };
 
@@ -388,8 +422,11 @@ public:
 		addr = PAGING_GetPhysicalAddress(addr) & vgapages.mask;
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED(addr);
-		MEM_CHANGED( addr );
+		//--Modified to mark both ends of the write
+		//MEM_CHANGED( addr );
 //		MEM_CHANGED( addr + 1);
+		MEM_CHANGED_RANGE( addr, 2 );
+		//--End of modifications
 		if (GCC_UNLIKELY(addr & 1)) {
 			writeHandler<Bit8u>( addr+0, val >> 0 );
 			writeHandler<Bit8u>( addr+1, val >> 8 );
@@ -402,8 +439,11 @@ public:
 		addr = PAGING_GetPhysicalAddress(addr) & vgapages.mask;
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED(addr);
-		MEM_CHANGED( addr );
+		//--Modified to mark both ends of the write
+		//MEM_CHANGED( addr );
 //		MEM_CHANGED( addr + 3);
+		MEM_CHANGED_RANGE( addr, 4 );
+		//--End of modifications
 		if (GCC_UNLIKELY(addr & 3)) {
 			writeHandler<Bit8u>( addr+0, val >> 0 );
 			writeHandler<Bit8u>( addr+1, val >> 8 );
@@ -419,7 +459,7 @@ public:
 class VGA_UnchainedVGA_Handler : public VGA_UnchainedRead_Handler {
 public:
 	void writeHandler( PhysPt addr, Bit8u val ) {
-		Bit32u data=ModeOperation(val);
+		Bit32u data=FastModeOperation(val);	//--Modified for planar write fast paths
 		VGA_Latch pixels;
 		pixels.d=((Bit32u*)vga.mem.linear)[addr];
 		pixels.d&=vga.config.full_not_map_mask;
@@ -428,6 +468,24 @@ public:
 //		if(vga.config.compatible_chain4)
 //			((Bit32u*)vga.mem.linear)[CHECKED2(addr+64*1024)]=pixels.d; 
 	}
+	//--Added to write several bytes at once for writew and writed. This is what Mode X
+	//games spend their time in, so the common cases go straight to the planes.
+	void writeBlock(PhysPt addr, Bitu val, Bitu count) {
+		Bit32u * planes=&((Bit32u*)vga.mem.linear)[addr];
+		Bit32u map_mask=vga.config.full_map_mask;
+		Bit32u not_map_mask=vga.config.full_not_map_mask;
+		if (vga.config.write_mode==1) {
+			// latch copy: the same for every byte
+			Bit32u data=vga.latch.d & map_mask;
+			for (Bitu i=0;i<count;i++) planes[i]=(planes[i] & not_map_mask) | data;
+		} else if (vga.config.write_mode==0 && (vga.config.mh_mask & MH_PLAINWRITE)) {
+			for (Bitu i=0;i<count;i++,val>>=8)
+				planes[i]=(planes[i] & not_map_mask) | (ExpandTable[val & 0xff] & map_mask);
+		} else {
+			for (Bitu i=0;i<count;i++,val>>=8) writeHandler(addr+i,(Bit8u)val);
+		}
+	}
+	//--End of modifications
 public:
 	VGA_UnchainedVGA_Handler()  {
 		flags=PFLAG_NOCODE;
@@ -443,19 +501,25 @@ public:
 		addr = PAGING_GetPhysicalAddress(addr) & vgapages.mask;
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED2(addr);
-		MEM_CHANGED( addr << 2);
-		writeHandler(addr+0,(Bit8u)(val >> 0));
-		writeHandler(addr+1,(Bit8u)(val >> 8));
+		MEM_CHANGED_RANGE( addr << 2, 2 << 2 );	//--Modified to mark both ends of the write
+		//--Modified to write both bytes at once
+		//writeHandler(addr+0,(Bit8u)(val >> 0));
+		//writeHandler(addr+1,(Bit8u)(val >> 8));
+		writeBlock(addr,val,2);
+		//--End of modifications
 	}
 	void writed(PhysPt addr,Bitu val) {
 		addr = PAGING_GetPhysicalAddress(addr) & vgapages.mask;
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED2(addr);
-		MEM_CHANGED( addr << 2);
-		writeHandler(addr+0,(Bit8u)(val >> 0));
-		writeHandler(addr+1,(Bit8u)(val >> 8));
-		writeHandler(addr+2,(Bit8u)(val >> 16));
-		writeHandler(addr+3,(Bit8u)(val >> 24));
+		MEM_CHANGED_RANGE( addr << 2, 4 << 2 );	//--Modified to mark both ends of the write
+		//--Modified to write all four bytes at once
+		//writeHandler(addr+0,(Bit8u)(val >> 0));
+		//writeHandler(addr+1,(Bit8u)(val >> 8));
+		//writeHandler(addr+2,(Bit8u)(val >> 16));
+		//writeHandler(addr+3,(Bit8u)(val >> 24));
+		writeBlock(addr,val,4);
+		//--End of modifications
 	}
 };
 
@@ -472,6 +536,9 @@ public:
 		addr = PAGING_GetPhysicalAddress(addr) & vgapages.mask;
 		if (vga.seq.map_mask & 0x4) {
 			vga.draw.font[addr]=(Bit8u)val;
+			//--Added to invalidate cached text lines
+			vga.draw.text_generation++;
+			//--End of modifications
 		}
 	}
 };
@@ -525,14 +592,14 @@ public:
 		addr = PAGING_GetPhysicalAddress(addr) & vgapages.mask;
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED(addr);
-		MEM_CHANGED( addr );
+		MEM_CHANGED_RANGE( addr, 2 );	//--Modified to mark both ends of the write
 		hostWrite<Bit16u>( &vga.mem.linear[addr], val );
 	}
 	void writed(PhysPt addr,Bitu val) {
 		addr = PAGING_GetPhysicalAddress(addr) & vgapages.mask;
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED(addr);
-		MEM_CHANGED( addr );	
+		MEM_CHANGED_RANGE( addr, 4 );	//--Modified to mark both ends of the write
 		hostWrite<Bit32u>( &vga.mem.linear[addr], val );
 	}
 };
@@ -551,14 +618,14 @@ public:
 	void writew(PhysPt addr,Bitu val) {
 		addr = vga.svga.bank_write_full + (PAGING_GetPhysicalAddress(addr) & 0xffff);
 		addr = CHECKED4(addr);
-		MEM_CHANGED( addr << 3 );
+		MEM_CHANGED_RANGE( addr << 3, 2 << 3 );	//--Modified to mark both ends of the write
 		writeHandler<false>(addr+0,(Bit8u)(val >> 0));
 		writeHandler<false>(addr+1,(Bit8u)(val >> 8));
 	}
 	void writed(PhysPt addr,Bitu val) {
 		addr = vga.svga.bank_write_full + (PAGING_GetPhysicalAddress(addr) & 0xffff);
 		addr = CHECKED4(addr);
-		MEM_CHANGED( addr << 3 );
+		MEM_CHANGED_RANGE( addr << 3, 4 << 3 );	//--Modified to mark both ends of the write
 		writeHandler<false>(addr+0,(Bit8u)(val >> 0));
 		writeHandler<false>(addr+1,(Bit8u)(val >> 8));
 		writeHandler<false>(addr+2,(Bit8u)(val >> 16));
@@ -618,13 +685,13 @@ public:
 		addr = PAGING_GetPhysicalAddress(addr) - vga.lfb.addr;
 		addr = CHECKED(addr);
 		hostWrite<Bit16u>( &vga.mem.linear[addr], val );
-		MEM_CHANGED( addr );
+		MEM_CHANGED_RANGE( addr, 2 );	//--Modified to mark both ends of the write
 	}
 	void writed(PhysPt addr,Bitu val) {
 		addr = PAGING_GetPhysicalAddress(addr) - vga.lfb.addr;
 		addr = CHECKED(addr);
 		hostWrite<Bit32u>( &vga.mem.linear[addr], val );
-		MEM_CHANGED( addr );
+		MEM_CHANGED_RANGE( addr, 4 );	//--Modified to mark both ends of the write
 	}
 };
 
@@ -748,6 +815,10 @@ void VGA_ChangedBank(void) {
 #ifndef VGA_LFB_MAPPED
 	//If the mode is accurate than the correct mapper must have been installed already
 	if ( vga.mode >= M_LIN4 && vga.mode <= M_LIN32 ) {
+		//--Added: those handlers still read the bank offsets from here
+		vga.svga.bank_read_full = vga.svga.bank_read*vga.svga.bank_size;
+		vga.svga.bank_write_full = vga.svga.bank_write*vga.svga.bank_size;
+		//--End of modifications
 		return;
 	}
 #endif
@@ -840,7 +911,13 @@ void VGA_SetupHandlers(void) {
 		break;	
 	case M_TEXT:
 		/* Check if we're not in odd/even mode */
+		//--Modified so that text writes are recorded for the change tracking too
+#ifdef VGA_KEEP_CHANGES
+		if (vga.gfx.miscellaneous & 0x2) newHandler = &vgaph.changes;
+#else
 		if (vga.gfx.miscellaneous & 0x2) newHandler = &vgaph.map;
+#endif
+		//--End of modifications
 		else newHandler = &vgaph.text;
 		break;
 	case M_CGA4:
@@ -887,7 +964,9 @@ void VGA_SetupHandlers(void) {
 	if(svgaCard == SVGA_S3Trio && (vga.s3.ext_mem_ctrl & 0x10))
 		MEM_SetPageHandler(VGA_PAGE_A0, 16, &vgaph.mmio);
 range_done:
-	PAGING_ClearTLB();
+	//--Modified to only drop the TLB entries for the VGA window when paging is disabled
+	PAGING_UnlinkPhysPages(VGA_PAGE_A0,32);
+	//--End of modifications
 }
 
 void VGA_StartUpdateLFB(void) {
@@ -931,9 +1010,11 @@ void VGA_SetupMemory(Section* sec) {
 
 #ifdef VGA_KEEP_CHANGES
 	memset( &vga.changes, 0, sizeof( vga.changes ));
-	int changesMapSize = (vga.vmemsize >> VGA_CHANGE_SHIFT) + 32;
-	vga.changes.map = new Bit8u[changesMapSize];
-	memset(vga.changes.map, 0, changesMapSize);
+	//--Modified to cover fastmem, which the planar modes are drawn from
+	vga.changes.mapSize = ((vga.vmemsize << 1) >> VGA_CHANGE_SHIFT) + 32;
+	vga.changes.map = new Bit8u[vga.changes.mapSize];
+	memset(vga.changes.map, 0, vga.changes.mapSize);
+	//--End of modifications
 #endif
 	vga.svga.bank_read = vga.svga.bank_write = 0;
 	vga.svga.bank_read_full = vga.svga.bank_write_full = 0;
@@ -669,9 +669,30 @@ void boxer_setCGACompositeHueOffset(double offset)
         hue_offset = offset;
         if (machine == MCH_CGA)
         {
+            //Besides updating the palette for 32-bit output, this makes DOSBox hand Boxer
+            //a new frame to carry the new hue for 8-bit output.
             update_cga16_color();
         }
     }
 }
+
+//Gives the hue in degrees (including the user's hue offset) and the foreground color
+//with which to decode the raw bits that VGA_Draw_CGA16_Line produces for 8-bit output.
+//These match the artifact colors that update_cga16_color works out for 32-bit output.
+void boxer_CGACompositeSignal(double *hue, Bit8u *red, Bit8u *green, Bit8u *blue)
+{
+    int baseR=0, baseG=0, baseB=0;
+    double basehue = 50.0;
+    if (cga16_val & 0x01) baseB += 0xa8;
+    if (cga16_val & 0x02) baseG += 0xa8;
+    if (cga16_val & 0x04) baseR += 0xa8;
+    if (cga16_val & 0x08) { baseR += 0x57; baseG += 0x57; baseB += 0x57; }
+    if (cga16_val & 0x20) basehue = 35.0;
+    
+    *hue = basehue + hue_offset;
+    *red = (Bit8u)baseR;
+    *green = (Bit8u)baseG;
+    *blue = (Bit8u)baseB;
+}
 //--End of modifications
 
@@ -145,18 +145,22 @@ void XGA_DrawPoint(Bitu x, Bitu y, Bitu c) {
 		case M_LIN8:
 			if (GCC_UNLIKELY(memaddr >= vga.vmemsize)) break;
 			vga.mem.linear[memaddr] = c;
+			MEM_CHANGED( memaddr );	//--Added for change tracking
 			break;
 		case M_LIN15:
 			if (GCC_UNLIKELY(memaddr*2 >= vga.vmemsize)) break;
 			((Bit16u*)(vga.mem.linear))[memaddr] = (Bit16u)(c&0x7fff);
+			MEM_CHANGED( memaddr*2 );	//--Added for change tracking
 			break;
 		case M_LIN16:
 			if (GCC_UNLIKELY(memaddr*2 >= vga.vmemsize)) break;
 			((Bit16u*)(vga.mem.linear))[memaddr] = (Bit16u)(c&0xffff);
+			MEM_CHANGED( memaddr*2 );	//--Added for change tracking
 			break;
 		case M_LIN32:
 			if (GCC_UNLIKELY(memaddr*4 >= vga.vmemsize)) break;
 			((Bit32u*)(vga.mem.linear))[memaddr] = c;
+			MEM_CHANGED( memaddr*4 );	//--Added for change tracking
 			break;
 		default:
 			break;
@@ -243,6 +247,236 @@ Bitu XGA_GetMixResult(Bitu mixmode, Bitu srcval, Bitu dstdata) {
 	return destval;
 }
 
+//--Added to draw rectangles, blits and patterns a row at a time instead of a pixel at a time.
+//The pixel by pixel path goes through XGA_GetPoint, XGA_GetMixResult and XGA_DrawPoint for
+//every pixel, switching on the colour depth and the mix each time. Here both are chosen once
+//per row, and each mix gets a loop of its own.
+
+// Rows can't be any wider than this, since coordinates are 12 bits
+#define XGA_MAX_SPAN 4096
+
+template <Bitu mix>
+static INLINE Bitu XGA_Mix(Bitu srcval, Bitu dstdata) {
+	switch (mix) {
+		case 0x00: return ~dstdata;
+		case 0x01: return 0;
+		case 0x02: return 0xffffffff;
+		case 0x03: return dstdata;
+		case 0x04: return ~srcval;
+		case 0x05: return srcval ^ dstdata;
+		case 0x06: return ~(srcval ^ dstdata);
+		case 0x07: return srcval;
+		case 0x08: return ~(srcval & dstdata);
+		case 0x09: return (~srcval) | dstdata;
+		case 0x0a: return srcval | (~dstdata);
+		case 0x0b: return srcval | dstdata;
+		case 0x0c: return srcval & dstdata;
+		case 0x0d: return srcval & (~dstdata);
+		case 0x0e: return (~srcval) & dstdata;
+		default:   return ~(srcval | dstdata);
+	}
+}
+
+// Mixes a row of pixels in place. src points at the source pixels, or is 0 to use srcval
+// for all of them. Overlapping rows are walked the way memmove would.
+template <class Pixel, Bitu mix>
+static void XGA_MixSpanMode(Pixel * dst, const Pixel * src, Bitu srcval, Bitu count, Bitu mask) {
+	if (!src) {
+		for (Bitu i = 0; i < count; i++)
+			dst[i] = (Pixel)(XGA_Mix<mix>(srcval, dst[i]) & mask);
+	} else if (dst <= src) {
+		for (Bitu i = 0; i < count; i++)
+			dst[i] = (Pixel)(XGA_Mix<mix>(src[i], dst[i]) & mask);
+	} else {
+		for (Bitu i = count; i-- > 0;)
+			dst[i] = (Pixel)(XGA_Mix<mix>(src[i], dst[i]) & mask);
+	}
+}
+
+template <class Pixel>
+static void XGA_MixSpan(Pixel * dst, const Pixel * src, Bitu srcval, Bitu count, Bitu mixmode, Bitu mask) {
+	bool fullmask = (mask == (Bitu)(Pixel)~0);
+	switch (mixmode & 0xf) {
+		case 0x00: XGA_MixSpanMode<Pixel, 0x00>(dst, src, srcval, count, mask); break;
+		case 0x01: XGA_MixSpanMode<Pixel, 0x01>(dst, src, srcval, count, mask); break;
+		case 0x02: XGA_MixSpanMode<Pixel, 0x02>(dst, src, srcval, count, mask); break;
+		case 0x03: XGA_MixSpanMode<Pixel, 0x03>(dst, src, srcval, count, mask); break;
+		case 0x04: XGA_MixSpanMode<Pixel, 0x04>(dst, src, srcval, count, mask); break;
+		case 0x05: XGA_MixSpanMode<Pixel, 0x05>(dst, src, srcval, count, mask); break;
+		case 0x06: XGA_MixSpanMode<Pixel, 0x06>(dst, src, srcval, count, mask); break;
+		case 0x07:
+			// Plain copies and fills, the bulk of what Windows asks for
+			if (src && fullmask) memmove(dst, src, count * sizeof(Pixel));
+			else if (!src && sizeof(Pixel) == 1) memset(dst, (Bit8u)srcval, count);
+			else XGA_MixSpanMode<Pixel, 0x07>(dst, src, srcval, count, mask);
+			break;
+		case 0x08: XGA_MixSpanMode<Pixel, 0x08>(dst, src, srcval, count, mask); break;
+		case 0x09: XGA_MixSpanMode<Pixel, 0x09>(dst, src, srcval, count, mask); break;
+		case 0x0a: XGA_MixSpanMode<Pixel, 0x0a>(dst, src, srcval, count, mask); break;
+		case 0x0b: XGA_MixSpanMode<Pixel, 0x0b>(dst, src, srcval, count, mask); break;
+		case 0x0c: XGA_MixSpanMode<Pixel, 0x0c>(dst, src, srcval, count, mask); break;
+		case 0x0d: XGA_MixSpanMode<Pixel, 0x0d>(dst, src, srcval, count, mask); break;
+		case 0x0e: XGA_MixSpanMode<Pixel, 0x0e>(dst, src, srcval, count, mask); break;
+		case 0x0f: XGA_MixSpanMode<Pixel, 0x0f>(dst, src, srcval, count, mask); break;
+	}
+}
+
+// Bytes per pixel in the current mode, or 0 if the blitter can't draw in it
+static Bitu XGA_PixelSize(void) {
+	switch(XGA_COLOR_MODE) {
+	case M_LIN8: return 1;
+	case M_LIN15:
+	case M_LIN16: return 2;
+	case M_LIN32: return 4;
+	default: return 0;
+	}
+}
+
+// Mixes count pixels from (x,y) rightwards. src points at source pixels in the current
+// depth, or is 0 to use srcval for all of them.
+static void XGA_MixRow(Bitu x, Bitu y, Bitu count, const Bit8u * src, Bitu srcval, Bitu mixmode) {
+	Bitu memaddr = (y * XGA_SCREEN_WIDTH) + x;
+	switch(XGA_COLOR_MODE) {
+	case M_LIN8:
+		XGA_MixSpan<Bit8u>(&vga.mem.linear[memaddr], src, srcval, count, mixmode, 0xff);
+		break;
+	case M_LIN15:
+		memaddr *= 2;
+		XGA_MixSpan<Bit16u>((Bit16u*)&vga.mem.linear[memaddr], (const Bit16u*)src, srcval, count, mixmode, 0x7fff);
+		break;
+	case M_LIN16:
+		memaddr *= 2;
+		XGA_MixSpan<Bit16u>((Bit16u*)&vga.mem.linear[memaddr], (const Bit16u*)src, srcval, count, mixmode, 0xffff);
+		break;
+	case M_LIN32:
+		memaddr *= 4;
+		XGA_MixSpan<Bit32u>((Bit32u*)&vga.mem.linear[memaddr], (const Bit32u*)src, srcval, count, mixmode, 0xffffffff);
+		break;
+	default:
+		return;
+	}
+#ifdef VGA_KEEP_CHANGES
+	Bitu end = memaddr + count * XGA_PixelSize();
+	for (Bitu addr = memaddr & ~((1 << VGA_CHANGE_SHIFT) - 1); addr < end; addr += 1 << VGA_CHANGE_SHIFT) {
+		MEM_CHANGED( addr );
+	}
+#endif
+}
+
+// Checks that a rectangle sits within the screen width and video memory
+static bool XGA_InScreen(Bits left, Bits top, Bits right, Bits bottom) {
+	if (left < 0 || top < 0 || right >= (Bits)XGA_SCREEN_WIDTH) return false;
+	if (right - left + 1 > XGA_MAX_SPAN) return false;
+	return ((bottom * XGA_SCREEN_WIDTH) + right + 1) * XGA_PixelSize() <= vga.vmemsize;
+}
+
+// Clips a rectangle to the scissors. Returns false if what is left isn't on screen: the
+// pixel by pixel path wraps those pixels onto the next line or drops them, so it is left
+// to handle them.
+static bool XGA_ClipRect(Bits &left, Bits &top, Bits &right, Bits &bottom) {
+	if (left < xga.scissors.x1) left = xga.scissors.x1;
+	if (top < xga.scissors.y1) top = xga.scissors.y1;
+	if (right > xga.scissors.x2) right = xga.scissors.x2;
+	if (bottom > xga.scissors.y2) bottom = xga.scissors.y2;
+	if (left > right || top > bottom) return true;
+	return XGA_InScreen(left, top, right, bottom);
+}
+
+// Works out the source of a solid fill, which is how most rectangles get drawn.
+// Returns false if the pixels depend on anything but the foreground mix.
+static bool XGA_SolidSource(Bitu &mixmode, Bitu &srcval) {
+	if (((xga.pix_cntl >> 6) & 0x3) != 0) return false;
+	if ((xga.curcommand & 0x11) != 0x11 || !XGA_PixelSize()) return false;
+	mixmode = xga.foremix;
+	switch((mixmode >> 5) & 0x03) {
+		case 0x00: srcval = xga.backcolor; return true;
+		case 0x01: srcval = xga.forecolor; return true;
+		default: return false;
+	}
+}
+
+// Fills MAPcount+1 by MIPcount+1 pixels from (x,y), going in the directions given
+static bool XGA_FastFill(Bits x, Bits y, Bits dx, Bits dy) {
+	Bitu mixmode, srcval;
+	if (!XGA_SolidSource(mixmode, srcval)) return false;
+	Bits left = (dx > 0) ? x : x - xga.MAPcount;
+	Bits top = (dy > 0) ? y : y - xga.MIPcount;
+	Bits right = left + xga.MAPcount;
+	Bits bottom = top + xga.MIPcount;
+	if (!XGA_ClipRect(left, top, right, bottom)) return false;
+	for (Bits row = top; row <= bottom; row++)
+		XGA_MixRow(left, row, right - left + 1, 0, srcval, mixmode);
+	return true;
+}
+// Copies MAPcount+1 by MIPcount+1 pixels from (curx,cury) to (destx,desty)
+static bool XGA_FastBlit(Bits dx, Bits dy) {
+	// Blits from a solid colour are just fills
+	if (XGA_FastFill(xga.destx, xga.desty, dx, dy)) return true;
+	if (((xga.pix_cntl >> 6) & 0x3) != 0) return false;
+	if ((xga.curcommand & 0x11) != 0x11 || !XGA_PixelSize()) return false;
+	Bitu mixmode = xga.foremix;
+	if (((mixmode >> 5) & 0x03) != 0x03) return false;
+
+	Bits left = (dx > 0) ? xga.destx : xga.destx - xga.MAPcount;
+	Bits top = (dy > 0) ? xga.desty : xga.desty - xga.MIPcount;
+	Bits right = left + xga.MAPcount;
+	Bits bottom = top + xga.MIPcount;
+	Bits offx = (Bits)xga.curx - (Bits)xga.destx;
+	Bits offy = (Bits)xga.cury - (Bits)xga.desty;
+	// The source isn't clipped, so all of it has to be on screen
+	if (!XGA_InScreen(left + offx, top + offy, right + offx, bottom + offy)) return false;
+	// A row copied against the direction it overlaps in reads back pixels it has
+	// just written. memmove won't do that, so leave it to the pixel by pixel path.
+	if (offy == 0 && offx != 0 && ((offx < 0) == (dx > 0)) && (offx < 0 ? -offx : offx) <= xga.MAPcount) return false;
+	if (!XGA_ClipRect(left, top, right, bottom)) return false;
+	if (left > right || top > bottom) return true;
+
+	Bitu size = XGA_PixelSize();
+	for (Bits i = 0; i <= bottom - top; i++) {
+		Bits row = (dy > 0) ? top + i : bottom - i;
+		const Bit8u * src = &vga.mem.linear[(((row + offy) * XGA_SCREEN_WIDTH) + left + offx) * size];
+		XGA_MixRow(left, row, right - left + 1, src, 0, mixmode);
+	}
+	return true;
+}
+
+static Bit8u XGA_PatternRow[XGA_MAX_SPAN * 4];
+
+// Tiles the 8x8 pattern at (curx,cury) over MAPcount+1 by MIPcount+1 pixels from (destx,desty)
+static bool XGA_FastPattern(Bits dx, Bits dy) {
+	// Patterns drawn from a solid colour are just fills
+	if (XGA_FastFill(xga.destx, xga.desty, dx, dy)) return true;
+	if (((xga.pix_cntl >> 6) & 0x3) != 0) return false;
+	if ((xga.curcommand & 0x11) != 0x11 || !XGA_PixelSize()) return false;
+	Bitu mixmode = xga.foremix;
+	if (((mixmode >> 5) & 0x03) != 0x03) return false;
+
+	Bits left = (dx > 0) ? xga.destx : xga.destx - xga.MAPcount;
+	Bits top = (dy > 0) ? xga.desty : xga.desty - xga.MIPcount;
+	Bits right = left + xga.MAPcount;
+	Bits bottom = top + xga.MIPcount;
+	Bits px = xga.curx, py = xga.cury;
+	if (!XGA_InScreen(px, py, px + 7, py + 7)) return false;
+	if (!XGA_ClipRect(left, top, right, bottom)) return false;
+	if (left > right || top > bottom) return true;
+	// Drawing over the pattern would change it part way through
+	if (px <= right && px + 7 >= left && py <= bottom && py + 7 >= top) return false;
+
+	Bitu size = XGA_PixelSize();
+	Bitu count = right - left + 1;
+	for (Bits row = top; row <= bottom; row++) {
+		// Lay the pattern row out from the column the span starts on, then repeat it
+		const Bit8u * pattern = &vga.mem.linear[(((py + (row & 7)) * XGA_SCREEN_WIDTH) + px) * size];
+		for (Bitu i = 0; i < 8; i++)
+			memcpy(&XGA_PatternRow[i * size], &pattern[((left + i) & 7) * size], size);
+		for (Bitu i = 8 * size; i < count * size; i++)
+			XGA_PatternRow[i] = XGA_PatternRow[i - 8 * size];
+		XGA_MixRow(left, row, count, XGA_PatternRow, 0, mixmode);
+	}
+	return true;
+}
+//--End of modifications
+
 void XGA_DrawLineVector(Bitu val) {
 	Bits xat, yat;
 	Bitu srcval;
@@ -467,6 +701,14 @@ void XGA_DrawRectangle(Bitu val) {
 	if(((val >> 5) & 0x01) != 0) dx = 1;
 	if(((val >> 7) & 0x01) != 0) dy = 1;
 
+	//--Added to fill a row at a time where possible
+	if (XGA_FastFill(xga.curx, xga.cury, dx, dy)) {
+		xga.curx = (Bit16u)(xga.curx + dx * (xga.MAPcount + 1));
+		xga.cury = (Bit16u)(xga.cury + dy * (xga.MIPcount + 1));
+		return;
+	}
+	//--End of modifications
+
 	srcy = xga.cury;
 
 	for(yat=0;yat<=xga.MIPcount;yat++) {
@@ -732,6 +974,10 @@ void XGA_BlitRect(Bitu val) {
 	if(((val >> 5) & 0x01) != 0) dx = 1;
 	if(((val >> 7) & 0x01) != 0) dy = 1;
 
+	//--Added to copy a row at a time where possible
+	if (XGA_FastBlit(dx, dy)) return;
+	//--End of modifications
+
 	srcx = xga.curx;
 	srcy = xga.cury;
 	tarx = xga.destx;
@@ -824,6 +1070,10 @@ void XGA_DrawPattern(Bitu val) {
 	if(((val >> 5) & 0x01) != 0) dx = 1;
 	if(((val >> 7) & 0x01) != 0) dy = 1;
 
+	//--Added to draw a row at a time where possible
+	if (XGA_FastPattern(dx, dy)) return;
+	//--End of modifications
+
 	srcx = xga.curx;
 	srcy = xga.cury;
 
@@ -364,6 +364,14 @@ static Bitu INT1A_Handler(void) {
 	return CBRET_NONE;
 }	
 
+//--Added to let the dynamic core answer timer polls without leaving the current block
+static bool INT1A_FastHandler(void) {
+	if (reg_ah!=0x00) return false;	/* Get System time */
+	INT1A_Handler();
+	return true;
+}
+//--End of modifications
+
 static Bitu INT11_Handler(void) {
 	reg_ax=mem_readw(BIOS_CONFIGURATION);
 	return CBRET_NONE;
@@ -915,6 +923,7 @@ public:
 		/* INT 1A TIME and some other functions */
 		callback[6].Install(&INT1A_Handler,CB_IRET_STI,"Int 1a Time");
 		callback[6].Set_RealVec(0x1A);
+		callback[6].Set_FastHandler(&INT1A_FastHandler); //--Added for in-block timer polls
 
 		/* INT 1C System Timer tick called from INT 8 */
 		callback[7].Install(&INT1C_Handler,CB_IRET,"Int 1c Timer");
@@ -26,9 +26,36 @@
 #include "dos_inc.h" /* for Drives[] */
 #include "../dos/drives.h"
 #include "mapper.h"
+//--Added for flushing disk images when idle
+#include "pic.h"
+#include "timer.h"
+//--End of modifications
+//--Added for mappedImageDisk
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+//--End of modifications
 
 #define MAX_DISK_IMAGES 4
 
+//--Added for imageDisk's sector cache
+// how many sectors each disk image keeps in memory: 256KB worth of 512-byte sectors
+#define IMAGEDISK_CACHE_SECTORS	512
+// how long a disk image must go without writes before its deferred writes are flushed, in ms
+#define IMAGEDISK_FLUSH_DELAY	1000
+#define IMAGEDISK_NO_SECTOR		0xffffffff
+
+// every open disk image, so that idle ones can be flushed
+static std::vector<imageDisk *> openImageDisks;
+//--End of modifications
+
+//--Added for mappedImageDisk's overlay files: these record changed blocks of the image
+//as a 4-byte little-endian block number followed by the block's contents.
+#define IMAGEDISK_OVERLAY_BLOCK			512
+#define IMAGEDISK_OVERLAY_MAGIC			"BXDISKOV"
+#define IMAGEDISK_OVERLAY_MAGIC_SIZE	8
+//--End of modifications
+
 diskGeo DiskGeometryList[] = {
 	{ 160,  8, 1, 40, 0},
 	{ 180,  9, 1, 40, 0},
@@ -146,12 +173,26 @@ Bit8u imageDisk::Read_Sector(Bit32u head,Bit32u cylinder,Bit32u sector,void * da
 }
 
 Bit8u imageDisk::Read_AbsoluteSector(Bit32u sectnum, void * data) {
+	//--Modified to read through the sector cache
+	/*
 	Bit32u bytenum;
 
 	bytenum = sectnum * sector_size;
 
 	fseek(diskimg,bytenum,SEEK_SET);
 	fread(data, 1, sector_size, diskimg);
+	*/
+	CachedSector *cached = cacheLookup(sectnum);
+	if (!cached) {
+		cached = cacheAllocate(sectnum);
+		fseek(diskimg,sectnum * sector_size,SEEK_SET);
+		size_t bytes = fread(cached->data, 1, sector_size, diskimg);
+		// past the end of the image: the original left the caller's buffer as it was,
+		// but a sector of zeroes is the least surprising thing to hand back repeatedly
+		if (bytes < sector_size) memset(cached->data + bytes, 0, sector_size - bytes);
+	}
+	memcpy(data, cached->data, sector_size);
+	//--End of modifications
 
 	return 0x00;
 }
@@ -167,6 +208,8 @@ Bit8u imageDisk::Write_Sector(Bit32u head,Bit32u cylinder,Bit32u sector,void * d
 
 
 Bit8u imageDisk::Write_AbsoluteSector(Bit32u sectnum, void *data) {
+	//--Modified to write into the sector cache, leaving it to Flush to write the sector out
+	/*
 	Bit32u bytenum;
 
 	bytenum = sectnum * sector_size;
@@ -177,15 +220,178 @@ Bit8u imageDisk::Write_AbsoluteSector(Bit32u sectnum, void *data) {
 	size_t ret=fwrite(data, sector_size, 1, diskimg);
 
 	return ((ret>0)?0x00:0x05);
+	*/
+	CachedSector *cached = cacheLookup(sectnum);
+	if (!cached) cached = cacheAllocate(sectnum);
+	memcpy(cached->data, data, sector_size);
+	if (!cached->dirty) {
+		cached->dirty = true;
+		dirtySectors++;
+	}
+	lastWriteTicks = PIC_Ticks;
+	return 0x00;
+	//--End of modifications
+}
+
+//--Added for transferring several consecutive sectors at once
+Bit8u imageDisk::Read_AbsoluteSectors(Bit32u sectnum, Bit32u count, void * data) {
+	//--Modified to read each run of sectors that aren't in the cache with a single fread,
+	//straight into the caller's buffer, and only then copy them into the cache
+	/*
+	for (Bit32u i = 0; i < count; i++) {
+		Bit8u status = Read_AbsoluteSector(sectnum + i, (Bit8u *)data + i * sector_size);
+		if (status != 0x00) return status;
+	}
+	*/
+	Bit8u *dest = (Bit8u *)data;
+	Bit32u i = 0;
+	while (i < count) {
+		CachedSector *cached = cacheLookup(sectnum + i);
+		if (cached) {
+			memcpy(dest + i * sector_size, cached->data, sector_size);
+			i++;
+			continue;
+		}
+
+		Bit32u run = 1;
+		while (i + run < count && cachedSectors.find(sectnum + i + run) == cachedSectors.end()) run++;
 
+		Bit8u *runData = dest + i * sector_size;
+		size_t runSize = run * sector_size;
+		fseek(diskimg, (sectnum + i) * sector_size, SEEK_SET);
+		size_t bytes = fread(runData, 1, runSize, diskimg);
+		// as with single sectors, anything past the end of the image reads as zeroes
+		if (bytes < runSize) memset(runData + bytes, 0, runSize - bytes);
+
+		// none of these sectors were cached, so none were dirty: any flush that allocating
+		// their slots triggers can only write out other sectors
+		for (Bit32u j = 0; j < run; j++) {
+			memcpy(cacheAllocate(sectnum + i + j)->data, runData + j * sector_size, sector_size);
+		}
+		i += run;
+	}
+	//--End of modifications
+	return 0x00;
 }
 
+Bit8u imageDisk::Write_AbsoluteSectors(Bit32u sectnum, Bit32u count, void * data) {
+	for (Bit32u i = 0; i < count; i++) {
+		Bit8u status = Write_AbsoluteSector(sectnum + i, (Bit8u *)data + i * sector_size);
+		if (status != 0x00) return status;
+	}
+	return 0x00;
+}
+//--End of modifications
+
+//--Added for the sector cache
+imageDisk::CachedSector *imageDisk::cacheLookup(Bit32u sectnum) {
+	std::map<Bit32u, Bitu>::iterator found = cachedSectors.find(sectnum);
+	if (found == cachedSectors.end()) return NULL;
+	CachedSector *cached = &cacheSlots[found->second];
+	cached->lastUsed = ++cacheClock;
+	return cached;
+}
+
+// Takes over the least recently used slot for the specified sector, whose contents are left for the caller to fill in.
+imageDisk::CachedSector *imageDisk::cacheAllocate(Bit32u sectnum) {
+	if (cacheSlots.empty()) {
+		cacheSlots.resize(IMAGEDISK_CACHE_SECTORS);
+		for (Bitu i = 0; i < cacheSlots.size(); i++) {
+			cacheSlots[i].sectnum = IMAGEDISK_NO_SECTOR;
+			cacheSlots[i].lastUsed = 0;
+			cacheSlots[i].dirty = false;
+			cacheSlots[i].data = new Bit8u[sector_size];
+		}
+	}
+
+	Bitu oldest = 0;
+	for (Bitu i = 1; i < cacheSlots.size(); i++) {
+		if (cacheSlots[i].lastUsed < cacheSlots[oldest].lastUsed) oldest = i;
+	}
+	CachedSector *cached = &cacheSlots[oldest];
+	// writing out everything that's dirty rather than just this sector keeps the writes in order and coalesced
+	if (cached->dirty) Flush();
+	if (cached->sectnum != IMAGEDISK_NO_SECTOR) cachedSectors.erase(cached->sectnum);
+
+	cached->sectnum = sectnum;
+	cached->lastUsed = ++cacheClock;
+	cachedSectors[sectnum] = oldest;
+	return cached;
+}
+
+void imageDisk::cacheClear(void) {
+	Flush();
+	for (Bitu i = 0; i < cacheSlots.size(); i++) delete[] cacheSlots[i].data;
+	cacheSlots.clear();
+	cachedSectors.clear();
+}
+
+void imageDisk::Flush(void) {
+	if (!dirtySectors || !diskimg) return;
+
+	// the map is ordered by sector number, so runs of consecutive dirty sectors can be gathered up as we go
+	std::vector<Bit8u> run;
+	Bit32u runStart = 0;
+	bool failed = false;
+	std::map<Bit32u, Bitu>::iterator i = cachedSectors.begin();
+	while (true) {
+		CachedSector *cached = NULL;
+		if (i != cachedSectors.end()) {
+			cached = &cacheSlots[i->second];
+			i++;
+			if (!cached->dirty) continue;
+		}
+		bool extendsRun = cached && !run.empty() && cached->sectnum == runStart + run.size() / sector_size;
+		if (!run.empty() && !extendsRun) {
+			fseek(diskimg, runStart * sector_size, SEEK_SET);
+			if (fwrite(&run[0], run.size(), 1, diskimg) != 1) failed = true;
+			run.clear();
+		}
+		if (!cached) break;
+		if (run.empty()) runStart = cached->sectnum;
+		run.insert(run.end(), cached->data, cached->data + sector_size);
+		cached->dirty = false;
+	}
+	fflush(diskimg);
+	dirtySectors = 0;
+
+	// the sectors stay in the cache as they are, so a read-only image still reads back what was written to it
+	if (failed) LOG_MSG("Could not write to disk image \"%s\": changes to it will be lost", diskname);
+}
+
+static void IMAGEDISK_TickHandler(void) {
+	// no need to check on every tick
+	if (PIC_Ticks % 100) return;
+	for (Bitu i = 0; i < openImageDisks.size(); i++) {
+		imageDisk *disk = openImageDisks[i];
+		if (disk->hasUnflushedWrites() && PIC_Ticks - disk->lastWriteTicks >= IMAGEDISK_FLUSH_DELAY) disk->Flush();
+	}
+}
+
+imageDisk::~imageDisk() {
+	cacheClear();
+	for (Bitu i = 0; i < openImageDisks.size(); i++) {
+		if (openImageDisks[i] == this) {
+			openImageDisks.erase(openImageDisks.begin() + i);
+			break;
+		}
+	}
+	if(diskimg != NULL) { fclose(diskimg); }
+}
+//--End of modifications
+
 imageDisk::imageDisk(FILE *imgFile, Bit8u *imgName, Bit32u imgSizeK, bool isHardDisk) {
 	heads = 0;
 	cylinders = 0;
 	sectors = 0;
 	sector_size = 512;
 	diskimg = imgFile;
+	//--Added for the sector cache
+	cacheClock = 0;
+	dirtySectors = 0;
+	lastWriteTicks = 0;
+	openImageDisks.push_back(this);
+	//--End of modifications
 	
 	memset(diskname,0,512);
 	if(strlen((const char *)imgName) > 511) {
@@ -235,6 +441,9 @@ void imageDisk::Set_Geometry(Bit32u setHeads, Bit32u setCyl, Bit32u setSect, Bit
 	heads = setHeads;
 	cylinders = setCyl;
 	sectors = setSect;
+	//--Added to start the sector cache afresh if the sector size changes
+	if (setSectSize != sector_size) cacheClear();
+	//--End of modifications
 	sector_size = setSectSize;
 	active = true;
 }
@@ -256,6 +465,197 @@ Bit32u imageDisk::getSectSize(void) {
 	return sector_size;
 }
 
+//--Added for mappedImageDisk
+mappedImageDisk::mappedImageDisk(FILE *imgFile, Bit8u *imgName, Bit32u imgSizeK, bool isHardDisk, const char *overlayPath) :
+	imageDisk(imgFile, imgName, imgSizeK, isHardDisk),
+	mapping(NULL), mappingSize(0), sharedMapping(false), dirtyStart(0), dirtyEnd(0), overlay(NULL) {
+
+	if (overlayPath) this->overlayPath = overlayPath;
+
+	struct stat status;
+	if (!imgFile || fstat(fileno(imgFile), &status) != 0 || status.st_size <= 0) return;
+	mappingSize = (size_t)status.st_size;
+
+	void *mapped = MAP_FAILED;
+	if (this->overlayPath.empty()) {
+		mapped = mmap(NULL, mappingSize, PROT_READ | PROT_WRITE, MAP_SHARED, fileno(imgFile), 0);
+		sharedMapping = (mapped != MAP_FAILED);
+	}
+	// With an overlay we never want to touch the image; without one, this is an image we were
+	// only able to open for reading. Either way a private mapping can still be written to.
+	if (mapped == MAP_FAILED) {
+		mapped = mmap(NULL, mappingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno(imgFile), 0);
+	}
+	if (mapped == MAP_FAILED) {
+		LOG_MSG("Could not map disk image \"%s\" into memory, reading it through the sector cache instead", diskname);
+		mappingSize = 0;
+		return;
+	}
+	mapping = (Bit8u *)mapped;
+
+	if (!this->overlayPath.empty()) {
+		dirtyBlocks.resize((mappingSize + IMAGEDISK_OVERLAY_BLOCK - 1) / IMAGEDISK_OVERLAY_BLOCK, false);
+		loadOverlay();
+	}
+}
+
+mappedImageDisk::~mappedImageDisk() {
+	if (mapping) {
+		Flush();
+		// make sure everything has reached the image before it's closed
+		if (sharedMapping) msync(mapping, mappingSize, MS_SYNC);
+		munmap(mapping, mappingSize);
+		mapping = NULL;
+	}
+	if (overlay) fclose(overlay);
+}
+
+Bit8u mappedImageDisk::Read_AbsoluteSector(Bit32u sectnum, void * data) {
+	if (!mapping) return imageDisk::Read_AbsoluteSector(sectnum, data);
+	return Read_AbsoluteSectors(sectnum, 1, data);
+}
+
+Bit8u mappedImageDisk::Write_AbsoluteSector(Bit32u sectnum, void * data) {
+	if (!mapping) return imageDisk::Write_AbsoluteSector(sectnum, data);
+	return Write_AbsoluteSectors(sectnum, 1, data);
+}
+
+Bit8u mappedImageDisk::Read_AbsoluteSectors(Bit32u sectnum, Bit32u count, void * data) {
+	if (!mapping) return imageDisk::Read_AbsoluteSectors(sectnum, count, data);
+
+	Bit64u start = (Bit64u)sectnum * sector_size;
+	Bit64u length = (Bit64u)count * sector_size;
+	Bit64u available = 0;
+	if (start < mappingSize) available = (length < mappingSize - start) ? length : mappingSize - start;
+
+	if (available) memcpy(data, mapping + start, (size_t)available);
+	// as with the sector cache, anything past the end of the image reads as zeroes
+	if (available < length) memset((Bit8u *)data + available, 0, (size_t)(length - available));
+	return 0x00;
+}
+
+Bit8u mappedImageDisk::Write_AbsoluteSectors(Bit32u sectnum, Bit32u count, void * data) {
+	if (!mapping) return imageDisk::Write_AbsoluteSectors(sectnum, count, data);
+
+	Bit64u start = (Bit64u)sectnum * sector_size;
+	Bit64u length = (Bit64u)count * sector_size;
+	if (!length) return 0x00;
+	// a mapping can't grow the image the way fwrite could
+	if (start + length > mappingSize) return 0x05;
+
+	memcpy(mapping + start, data, (size_t)length);
+
+	if (!overlayPath.empty()) {
+		Bit64u lastBlock = (start + length - 1) / IMAGEDISK_OVERLAY_BLOCK;
+		for (Bit64u block = start / IMAGEDISK_OVERLAY_BLOCK; block <= lastBlock; block++) dirtyBlocks[(size_t)block] = true;
+	} else if (dirtyStart == dirtyEnd) {
+		dirtyStart = (size_t)start;
+		dirtyEnd = (size_t)(start + length);
+	} else {
+		if (start < dirtyStart) dirtyStart = (size_t)start;
+		if (start + length > dirtyEnd) dirtyEnd = (size_t)(start + length);
+	}
+	dirtySectors += count;
+	lastWriteTicks = PIC_Ticks;
+	return 0x00;
+}
+
+void mappedImageDisk::Flush(void) {
+	if (!mapping) {
+		imageDisk::Flush();
+		return;
+	}
+	if (!dirtySectors) return;
+
+	if (!overlayPath.empty()) {
+		flushOverlay();
+	} else if (sharedMapping) {
+		// msync wants a page-aligned start; the writes themselves are already in the file's pages,
+		// so this just gets the whole dirty range on its way to disk at once
+		size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+		size_t syncStart = dirtyStart - (dirtyStart % pageSize);
+		if (msync(mapping + syncStart, dirtyEnd - syncStart, MS_ASYNC) != 0)
+			LOG_MSG("Could not write to disk image \"%s\": changes to it may be lost", diskname);
+	} else {
+		LOG_MSG("Could not write to disk image \"%s\": changes to it will be lost", diskname);
+	}
+	dirtyStart = dirtyEnd = 0;
+	dirtySectors = 0;
+}
+
+void mappedImageDisk::loadOverlay(void) {
+	// if there's no overlay yet, it'll be created the first time something is written
+	overlay = fopen(overlayPath.c_str(), "rb+");
+	if (!overlay) return;
+
+	char magic[IMAGEDISK_OVERLAY_MAGIC_SIZE];
+	if (fread(magic, IMAGEDISK_OVERLAY_MAGIC_SIZE, 1, overlay) != 1 || memcmp(magic, IMAGEDISK_OVERLAY_MAGIC, IMAGEDISK_OVERLAY_MAGIC_SIZE) != 0) {
+		LOG_MSG("Disk overlay \"%s\" was not recognised and will be replaced", overlayPath.c_str());
+		fclose(overlay);
+		overlay = NULL;
+		return;
+	}
+
+	Bit8u record[4 + IMAGEDISK_OVERLAY_BLOCK];
+	long offset = IMAGEDISK_OVERLAY_MAGIC_SIZE;
+	while (fread(record, sizeof(record), 1, overlay) == 1) {
+		Bit32u block = host_readd(record);
+		size_t start = (size_t)block * IMAGEDISK_OVERLAY_BLOCK;
+		if (start < mappingSize) {
+			size_t length = (mappingSize - start < IMAGEDISK_OVERLAY_BLOCK) ? mappingSize - start : IMAGEDISK_OVERLAY_BLOCK;
+			memcpy(mapping + start, &record[4], length);
+		}
+		overlayBlocks[block] = offset;
+		offset += sizeof(record);
+	}
+}
+
+void mappedImageDisk::flushOverlay(void) {
+	if (!overlay) {
+		overlay = fopen(overlayPath.c_str(), "wb+");
+		if (!overlay || fwrite(IMAGEDISK_OVERLAY_MAGIC, IMAGEDISK_OVERLAY_MAGIC_SIZE, 1, overlay) != 1) {
+			// keep the changes marked as dirty, so they're tried again next time
+			LOG_MSG("Could not create disk overlay \"%s\"", overlayPath.c_str());
+			if (overlay) {
+				fclose(overlay);
+				overlay = NULL;
+			}
+			return;
+		}
+	}
+
+	Bit8u record[4 + IMAGEDISK_OVERLAY_BLOCK];
+	bool failed = false;
+	for (size_t block = 0; block < dirtyBlocks.size(); block++) {
+		if (!dirtyBlocks[block]) continue;
+		dirtyBlocks[block] = false;
+
+		// blocks that are already in the overlay are rewritten in place, new ones go on the end
+		long offset;
+		std::map<Bit32u, long>::iterator found = overlayBlocks.find((Bit32u)block);
+		if (found != overlayBlocks.end()) {
+			offset = found->second;
+		} else {
+			fseek(overlay, 0, SEEK_END);
+			offset = ftell(overlay);
+			overlayBlocks[(Bit32u)block] = offset;
+		}
+
+		size_t start = block * IMAGEDISK_OVERLAY_BLOCK;
+		size_t length = (mappingSize - start < IMAGEDISK_OVERLAY_BLOCK) ? mappingSize - start : IMAGEDISK_OVERLAY_BLOCK;
+		host_writed(record, (Bit32u)block);
+		memcpy(&record[4], mapping + start, length);
+		if (length < IMAGEDISK_OVERLAY_BLOCK) memset(&record[4 + length], 0, IMAGEDISK_OVERLAY_BLOCK - length);
+
+		fseek(overlay, offset, SEEK_SET);
+		if (fwrite(record, sizeof(record), 1, overlay) != 1) failed = true;
+	}
+	fflush(overlay);
+
+	if (failed) LOG_MSG("Could not write to disk overlay \"%s\": changes to the disk may be lost", overlayPath.c_str());
+}
+//--End of modifications
+
 static Bitu GetDosDriveNumber(Bitu biosNum) {
 	switch(biosNum) {
 		case 0x0:
@@ -298,9 +698,36 @@ static bool driveInactive(Bitu driveNum) {
 }
 
 
+//--Added to copy sector data to and from DOS memory a block at a time. Like the BIOS,
+//the transfer wraps around to the start of the segment if it runs past the end.
+static void INT13_CopyToGuest(Bit16u seg, Bit16u off, Bit8u const *data, Bitu size) {
+	while (size) {
+		Bitu chunk = 0x10000 - off;
+		if (chunk > size) chunk = size;
+		MEM_BlockWrite(PhysMake(seg, off), data, chunk);
+		data += chunk;
+		size -= chunk;
+		off = (Bit16u)(off + chunk);
+	}
+}
+
+static void INT13_CopyFromGuest(Bit16u seg, Bit16u off, Bit8u *data, Bitu size) {
+	while (size) {
+		Bitu chunk = 0x10000 - off;
+		if (chunk > size) chunk = size;
+		MEM_BlockRead(PhysMake(seg, off), data, chunk);
+		data += chunk;
+		size -= chunk;
+		off = (Bit16u)(off + chunk);
+	}
+}
+//--End of modifications
+
 static Bitu INT13_DiskHandler(void) {
 	Bit16u segat, bufptr;
-	Bit8u sectbuf[512];
+	//--Removed now that sector reads and writes go through a buffer of their own
+	//Bit8u sectbuf[512];
+	//--End of modifications
 	Bitu  drivenum;
 	Bitu  i,t;
 	last_drive = reg_dl;
@@ -369,6 +796,12 @@ static Bitu INT13_DiskHandler(void) {
 
 		segat = SegValue(es);
 		bufptr = reg_bx;
+		//--Modified to read all the requested sectors from the disk in one go. If they fit within
+		//the segment and the buffer is contiguous host RAM, they're read straight into it:
+		//otherwise they're read into a buffer of our own and copied into DOS memory a block
+		//at a time. Read_Sector just counts on from the starting sector, so the sectors are
+		//consecutive.
+		/*
 		for(i=0;i<reg_al;i++) {
 			last_status = imageDiskList[drivenum]->Read_Sector((Bit32u)reg_dh, (Bit32u)(reg_ch | ((reg_cl & 0xc0)<< 2)), (Bit32u)((reg_cl & 63)+i), sectbuf);
 			if((last_status != 0x00) || (killRead)) {
@@ -383,6 +816,25 @@ static Bitu INT13_DiskHandler(void) {
 				bufptr++;
 			}
 		}
+		*/
+		{
+			imageDisk *disk = imageDiskList[drivenum];
+			Bit32u sectnum = ((((Bit32u)(reg_ch | ((reg_cl & 0xc0)<< 2))) * disk->heads + reg_dh) * disk->sectors) + (reg_cl & 63) - 1;
+			Bitu size = reg_al * disk->getSectSize();
+			HostPt direct = 0;
+			if ((Bitu)bufptr + size <= 0x10000) direct = MEM_GetBlockHostPt(PhysMake(segat, bufptr), size, true);
+			std::vector<Bit8u> buffer(direct ? 0 : size);
+			last_status = disk->Read_AbsoluteSectors(sectnum, reg_al, direct ? direct : &buffer[0]);
+			if((last_status != 0x00) || (killRead)) {
+				LOG_MSG("Error in disk read");
+				killRead = false;
+				reg_ah = 0x04;
+				CALLBACK_SCF(true);
+				return CBRET_NONE;
+			}
+			if (!direct) INT13_CopyToGuest(segat, bufptr, &buffer[0], size);
+		}
+		//--End of modifications
 		reg_ah = 0x00;
 		CALLBACK_SCF(false);
 		break;
@@ -396,6 +848,9 @@ static Bitu INT13_DiskHandler(void) {
 
 
 		bufptr = reg_bx;
+		//--Modified to write all the sectors to the disk in one go, straight from DOS memory
+		//if they fit within the segment and the buffer is contiguous host RAM
+		/*
 		for(i=0;i<reg_al;i++) {
 			for(t=0;t<imageDiskList[drivenum]->getSectSize();t++) {
 				sectbuf[t] = real_readb(SegValue(es),bufptr);
@@ -408,6 +863,24 @@ static Bitu INT13_DiskHandler(void) {
 				return CBRET_NONE;
 			}
         }
+		*/
+		{
+			imageDisk *disk = imageDiskList[drivenum];
+			Bit32u sectnum = ((((Bit32u)(reg_ch | ((reg_cl & 0xc0)<< 2))) * disk->heads + reg_dh) * disk->sectors) + (reg_cl & 63) - 1;
+			Bitu size = reg_al * disk->getSectSize();
+			if (size) {
+				HostPt direct = 0;
+				if ((Bitu)bufptr + size <= 0x10000) direct = MEM_GetBlockHostPt(PhysMake(SegValue(es), bufptr), size, false);
+				std::vector<Bit8u> buffer(direct ? 0 : size);
+				if (!direct) INT13_CopyFromGuest(SegValue(es), bufptr, &buffer[0], size);
+				last_status = disk->Write_AbsoluteSectors(sectnum, reg_al, direct ? direct : &buffer[0]);
+				if(last_status != 0x00) {
+					CALLBACK_SCF(true);
+					return CBRET_NONE;
+				}
+			}
+		}
+		//--End of modifications
 		reg_ah = 0x00;
 		CALLBACK_SCF(false);
         break;
@@ -525,6 +998,9 @@ void BIOS_SetupDisks(void) {
 	mem_writeb(BIOS_HARDDISK_COUNT,2);
 
 	MAPPER_AddHandler(swapInNextDisk,MK_f4,MMOD1,"swapimg","Swap Image");
+	//--Added to flush deferred writes to disk images once they've been idle for a while
+	TIMER_AddTickHandler(&IMAGEDISK_TickHandler);
+	//--End of modifications
 	killRead = false;
 	swapping_requested = false;
 }
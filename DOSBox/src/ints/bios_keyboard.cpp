@@ -26,6 +26,9 @@
 #include "regs.h"
 #include "inout.h"
 #include "dos_inc.h"
+//--Added for guest idle detection
+#include "cpu.h"
+//--End of modifications
 #include "SDL.h"
 
 /* SDL by default treats numlock and scrolllock different from all other keys.
@@ -167,10 +170,38 @@ static void add_key(Bit16u code) {
 	if (code!=0) BIOS_AddKeyToBuffer(code);
 }
 
+//--Added to top up the BIOS keyboard buffer from Boxer's paste buffer whenever it is polled,
+//so that a paste arrives as fast as the program can read it, and programs that read the
+//buffer themselves after checking it see pasted keys too.
+static void fill_from_paste_buffer() {
+	Bit16u start,end,head,tail;
+	if (machine==MCH_PCJR) {
+		start=0x1e;
+		end=0x3e;
+	} else {
+		start=mem_readw(BIOS_KEYBOARD_BUFFER_START);
+		end	 =mem_readw(BIOS_KEYBOARD_BUFFER_END);
+	}
+	head =mem_readw(BIOS_KEYBOARD_BUFFER_HEAD);
+	tail =mem_readw(BIOS_KEYBOARD_BUFFER_TAIL);
+
+	// one slot is always left empty to tell a full buffer from an empty one
+	Bitu slots=(end-start)/2;
+	Bitu used=((tail>=head) ? (tail-head) : (end-start)-(head-tail))/2;
+	Bit16u codes[64];
+	Bitu wanted=slots-1-used;
+	if (wanted>64) wanted=64;
+	Bitu taken=boxer_takeKeyCodesFromPasteBuffer(codes,wanted);
+	for (Bitu i=0;i<taken;i++) BIOS_AddKeyToBuffer(codes[i]);
+}
+//--End of modifications
+
 static bool get_key(Bit16u &code) {
-    //--Added 2012-04-15 to let Boxer insert its own keys
-    if (boxer_getNextKeyCodeInPasteBuffer(&code, true))
-        return true;
+    //--Added 2012-04-15 to let Boxer insert its own keys, and since modified to top up the
+    //BIOS buffer instead of bypassing it
+    //if (boxer_getNextKeyCodeInPasteBuffer(&code, true))
+    //    return true;
+    fill_from_paste_buffer();
     //--End of modifications
     
 	Bit16u start,end,head,tail,thead;
@@ -190,14 +221,17 @@ static bool get_key(Bit16u &code) {
 	if (thead>=end) thead=start;
 	mem_writew(BIOS_KEYBOARD_BUFFER_HEAD,thead);
 	code = real_readw(0x40,head);
+	boxer_programDidReadInput(); //--Added for input latency measurement
     
 	return true;
 }
 
 static bool check_key(Bit16u &code) {
-    //--Added 2012-04-15 to let Boxer insert its own keys
-    if (boxer_getNextKeyCodeInPasteBuffer(&code, false))
-        return true;
+    //--Added 2012-04-15 to let Boxer insert its own keys, and since modified to top up the
+    //BIOS buffer instead of bypassing it
+    //if (boxer_getNextKeyCodeInPasteBuffer(&code, false))
+    //    return true;
+    fill_from_paste_buffer();
     //--End of modifications
     
 	Bit16u head,tail;
@@ -205,6 +239,7 @@ static bool check_key(Bit16u &code) {
 	tail =mem_readw(BIOS_KEYBOARD_BUFFER_TAIL);
 	if (head==tail) return false;
 	code = real_readw(0x40,head);
+	boxer_programDidReadInput(); //--Added for input latency measurement
 	return true;
 }
 
@@ -550,6 +585,9 @@ static Bitu INT16_Handler(void) {
 		} else {
 			/* enter small idle loop to allow for irqs to happen */
 			reg_ip+=1;
+			//--Added to rest until the next interrupt rather than spinning
+			CPU_Idle();
+			//--End of modifications
 		}
 		break;
 	case 0x10: /* GET KEYSTROKE (enhanced keyboards only) */
@@ -562,6 +600,9 @@ static Bitu INT16_Handler(void) {
 		} else {
 			/* enter small idle loop to allow for irqs to happen */
 			reg_ip+=1;
+			//--Added to rest until the next interrupt rather than spinning
+			CPU_Idle();
+			//--End of modifications
 		}
 		break;
 	case 0x01: /* CHECK FOR KEYSTROKE */
@@ -581,6 +622,9 @@ static Bitu INT16_Handler(void) {
 			} else {
 				/* no key available */
 				CALLBACK_SZF(true);
+				//--Added to detect programs sitting in a keyboard polling loop
+				CPU_IdlePoll();
+				//--End of modifications
 				break;
 			}
 //			CALLBACK_Idle();
@@ -589,6 +633,9 @@ static Bitu INT16_Handler(void) {
 	case 0x11: /* CHECK FOR KEYSTROKE (enhanced keyboards only) */
 		if (!check_key(temp)) {
 			CALLBACK_SZF(true);
+			//--Added to detect programs sitting in a keyboard polling loop
+			CPU_IdlePoll();
+			//--End of modifications
 		} else {
 			CALLBACK_SZF(false);
 			if (((temp&0xff)==0xf0) && (temp>>8)) {
@@ -655,6 +702,18 @@ static void InitBiosSegment(void) {
 	mem_writeb(BIOS_KEYBOARD_LEDS,leds);
 }
 
+//--Added to let the dynamic core answer keyboard polls without leaving the current block
+static bool INT16_FastHandler(void) {
+	switch (reg_ah) {
+	case 0x01: /* CHECK FOR KEYSTROKE */
+	case 0x11: /* CHECK FOR KEYSTROKE (enhanced keyboards only) */
+		return (INT16_Handler()==CBRET_NONE);
+	default:
+		return false;
+	}
+}
+//--End of modifications
+
 void BIOS_SetupKeyboard(void) {
 	/* Init the variables */
 	InitBiosSegment();
@@ -662,6 +721,7 @@ void BIOS_SetupKeyboard(void) {
 	/* Allocate/setup a callback for int 0x16 and for standard IRQ 1 handler */
 	call_int16=CALLBACK_Allocate();	
 	CALLBACK_Setup(call_int16,&INT16_Handler,CB_INT16,"Keyboard");
+	CallBack_FastHandlers[call_int16]=&INT16_FastHandler; //--Added for in-block keyboard polls
 	RealSetVec(0x16,CALLBACK_RealPointer(call_int16));
 
 	call_irq1=CALLBACK_Allocate();	
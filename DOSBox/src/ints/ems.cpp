@@ -284,6 +284,15 @@ static Bit8u EMM_ReallocatePages(Bit16u handle,Bit16u & pages) {
 	return EMM_NO_ERROR;
 }
 
+//--Added to stop every EMS mapping change from flushing the whole TLB.
+//PAGING_MapPage already drops the TLB entries of the pages it remaps, and while paging is
+//off nothing else can point at them. With paging on, any linear page can reach the frame
+//through the page tables, so that case still flushes everything.
+static void EMM_FlushMapping(void) {
+	if (paging.enabled) PAGING_ClearTLB();
+}
+//--End of modifications
+
 static Bit8u EMM_MapPage(Bitu phys_page,Bit16u handle,Bit16u log_page) {
 //	LOG_MSG("EMS MapPage handle %d phys %d log %d",handle,phys_page,log_page);
 	/* Check for too high physical page */
@@ -296,7 +305,7 @@ static Bit8u EMM_MapPage(Bitu phys_page,Bit16u handle,Bit16u log_page) {
 		emm_mappings[phys_page].page=NULL_PAGE;
 		for (Bitu i=0;i<4;i++) 
 			PAGING_MapPage(EMM_PAGEFRAME4K+phys_page*4+i,EMM_PAGEFRAME4K+phys_page*4+i);
-		PAGING_ClearTLB();
+		EMM_FlushMapping();
 		return EMM_NO_ERROR;
 	}
 	/* Check for valid handle */
@@ -312,7 +321,7 @@ static Bit8u EMM_MapPage(Bitu phys_page,Bit16u handle,Bit16u log_page) {
 			PAGING_MapPage(EMM_PAGEFRAME4K+phys_page*4+i,memh);
 			memh=MEM_NextHandle(memh);
 		}
-		PAGING_ClearTLB();
+		EMM_FlushMapping();
 		return EMM_NO_ERROR;
 	} else  {
 		/* Illegal logical page it is */
@@ -338,7 +347,7 @@ static Bit8u EMM_MapSegment(Bitu segment,Bit16u handle,Bit16u log_page) {
 			}
 			for (Bitu i=0;i<4;i++) 
 				PAGING_MapPage(segment*16/4096+i,segment*16/4096+i);
-			PAGING_ClearTLB();
+			EMM_FlushMapping();
 			return EMM_NO_ERROR;
 		}
 		/* Check for valid handle */
@@ -359,7 +368,7 @@ static Bit8u EMM_MapSegment(Bitu segment,Bit16u handle,Bit16u log_page) {
 				PAGING_MapPage(segment*16/4096+i,memh);
 				memh=MEM_NextHandle(memh);
 			}
-			PAGING_ClearTLB();
+			EMM_FlushMapping();
 			return EMM_NO_ERROR;
 		} else  {
 			/* Illegal logical page it is */
@@ -1322,6 +1331,7 @@ public:
 		}
 
 		EMM_AllocateSystemHandle(8);	// allocate OS-dedicated handle (ems handle zero, 128kb)
+		SAVESTATE_Register("ems",this);	//--Added for save states
 
 
 		if (!ENABLE_VCPI) return;
@@ -1368,7 +1378,26 @@ public:
 		}
 	}
 	
+	//--Added for save states. The handles' memory and the page frame mappings themselves
+	//are restored with the memory and paging modules; only EMM's own tables are kept here.
+	void SaveState(std::ostream& stream) {
+		SAVESTATE_Write(stream,emm_handles);
+		SAVESTATE_Write(stream,emm_mappings);
+		SAVESTATE_Write(stream,emm_segmentmappings);
+		SAVESTATE_WriteBlock(stream,&vcpi,sizeof(vcpi));
+		SAVESTATE_Write(stream,GEMMIS_seg);
+	}
+	void LoadState(std::istream& stream) {
+		SAVESTATE_Read(stream,emm_handles);
+		SAVESTATE_Read(stream,emm_mappings);
+		SAVESTATE_Read(stream,emm_segmentmappings);
+		SAVESTATE_ReadBlock(stream,&vcpi,sizeof(vcpi));
+		SAVESTATE_Read(stream,GEMMIS_seg);
+	}
+	//--End of modifications
+
 	~EMS() {
+		SAVESTATE_Unregister(this);	//--Added for save states
 		Section_prop * section=static_cast<Section_prop *>(m_configuration);
 		if (!section->Get_bool("ems")) return;
 
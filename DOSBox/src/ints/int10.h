@@ -165,6 +165,11 @@ void INT10_SetCursorShape(Bit8u first,Bit8u last);
 void INT10_SetCursorPos(Bit8u row,Bit8u col,Bit8u page);
 void INT10_TeletypeOutput(Bit8u chr,Bit8u attr);
 void INT10_TeletypeOutputAttr(Bit8u chr,Bit8u attr,bool useattr);
+//--Added to write a run of characters to the current page in one go. Only works in text modes:
+//returns how many characters were written, stopping at the first one that needs handling
+//as a control character, or 0 if the caller should fall back on INT10_TeletypeOutputAttr.
+Bitu INT10_TeletypeOutputString(Bit8u const * data,Bitu count,Bit8u attr,bool useattr);
+//--End of modifications
 void INT10_ReadCharAttr(Bit16u * result,Bit8u page);
 void INT10_WriteChar(Bit8u chr,Bit8u attr,Bit8u page,Bit16u count,bool showattr);
 void INT10_WriteString(Bit8u row,Bit8u col,Bit8u flag,Bit8u attr,PhysPt string,Bit16u count,Bit8u page);
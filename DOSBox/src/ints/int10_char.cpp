@@ -20,6 +20,9 @@
 
 /* Character displaying moving functions */
 
+//--Added for memmove
+#include <string.h>
+//--End of modifications
 #include "dosbox.h"
 #include "bios.h"
 #include "mem.h"
@@ -191,6 +194,48 @@ static void TEXT_FillRow(Bit8u cleft,Bit8u cright,Bit8u row,PhysPt base,Bit8u at
 	}
 }
 
+//--Added to scroll text windows that span whole rows a block at a time: the rows being kept
+//are then one contiguous run of text memory, and so are the rows being cleared.
+//Returns false if the rows have to be copied one by one after all.
+static bool TEXT_CopyRows(Bit8u rfirst,Bit8u rcount,Bits nlines,PhysPt base) {
+	Bitu rowsize=CurMode->twidth*2;
+	Bitu size=rcount*rowsize;
+	PhysPt src=base+rfirst*rowsize;
+	PhysPt dest=base+(rfirst+nlines)*rowsize;
+	// plain text memory can be moved in one go, whichever direction it's going
+	HostPt from=MEM_GetBlockHostPt(src,size,false);
+	HostPt to=from ? MEM_GetBlockHostPt(dest,size,true) : 0;
+	if (from && to) {
+		memmove(to,from,size);
+		return true;
+	}
+	// otherwise only copying towards the start is safe as one block,
+	// since block copies go forwards a byte at a time
+	if (dest<src) {
+		MEM_BlockCopy(dest,src,size);
+		return true;
+	}
+	return false;
+}
+
+static void TEXT_FillRows(Bit8u row,Bit8u rcount,PhysPt base,Bit8u attr) {
+	Bitu cells=rcount*CurMode->twidth;
+	Bit16u fill=(attr<<8)+' ';
+	Bit8u buffer[2*256];
+	PhysPt dest=base+row*CurMode->twidth*2;
+	// fill a row's worth at a time, since a page can be larger than our buffer
+	for (Bitu i=0;i<CurMode->twidth;i++) {
+		buffer[i*2]=(Bit8u)fill;
+		buffer[i*2+1]=(Bit8u)(fill>>8);
+	}
+	while (cells) {
+		Bitu todo=(cells<CurMode->twidth) ? cells : CurMode->twidth;
+		MEM_BlockWrite(dest,buffer,todo*2);
+		dest+=todo*2;
+		cells-=todo;
+	}
+}
+//--End of modifications
 
 void INT10_ScrollWindow(Bit8u rul,Bit8u cul,Bit8u rlr,Bit8u clr,Bit8s nlines,Bit8u attr,Bit8u page) {
 /* Do some range checking */
@@ -208,6 +253,15 @@ void INT10_ScrollWindow(Bit8u rul,Bit8u cul,Bit8u rlr,Bit8u clr,Bit8s nlines,Bit
 
 	/* See how much lines need to be copied */
 	Bit8u start,end;Bits next;
+	//--Added to scroll whole text rows in one go
+	bool whole_rows=(CurMode->type==M_TEXT) && (cul==0) && (clr==CurMode->twidth) && (CurMode->twidth<=256);
+	Bits height=rlr-rul+1;
+	if (whole_rows && nlines!=0 && nlines>-height && nlines<height) {
+		Bit8u keep=(Bit8u)(height-((nlines>0) ? nlines : -nlines));
+		Bit8u first=(nlines>0) ? rul : (Bit8u)(rul-nlines);
+		if (TEXT_CopyRows(first,keep,nlines,base)) goto filling;
+	}
+	//--End of modifications
 	/* Copy some lines */
 	if (nlines>0) {
 		start=rlr-nlines+1;
@@ -255,6 +309,12 @@ filling:
 		nlines=-nlines;
 		start=rlr-nlines+1;
 	}
+	//--Added to clear whole text rows in one go
+	if (whole_rows && start+nlines<=rlr+1) {
+		TEXT_FillRows(start,(Bit8u)nlines,base,attr);
+		return;
+	}
+	//--End of modifications
 	for (;nlines>0;nlines--) {
 		switch (CurMode->type) {
 		case M_TEXT:
@@ -617,6 +677,55 @@ void INT10_TeletypeOutputAttr(Bit8u chr,Bit8u attr,bool useattr) {
 	INT10_TeletypeOutputAttr(chr,attr,useattr,real_readb(BIOSMEM_SEG,BIOSMEM_CURRENT_PAGE));
 }
 
+//--Added to write runs of ordinary characters straight into text memory a row at a time,
+//moving the cursor once at the end instead of after every character
+Bitu INT10_TeletypeOutputString(Bit8u const * data,Bitu count,Bit8u attr,bool useattr) {
+	if (CurMode->type!=M_TEXT) return 0;
+	Bit8u page=real_readb(BIOSMEM_SEG,BIOSMEM_CURRENT_PAGE);
+	BIOS_NCOLS;BIOS_NROWS;
+	if (ncols==0 || ncols>256) return 0;
+	Bitu cur_row=CURSOR_POS_ROW(page);
+	Bitu cur_col=CURSOR_POS_COL(page);
+	if (cur_row>=nrows || cur_col>=ncols) return 0;
+
+	PhysPt base=CurMode->pstart+page*real_readw(BIOSMEM_SEG,BIOSMEM_PAGE_SIZE);
+	Bit8u cells[2*256];
+	Bitu done=0;
+	while (done<count) {
+		// take as much of the run as fits on the rest of the row,
+		// stopping at anything the teletype handles specially
+		Bitu span=0;
+		while (done+span<count && cur_col+span<ncols) {
+			Bit8u chr=data[done+span];
+			if (chr==7 || chr==8 || chr=='\t' || chr=='\n' || chr=='\r') break;
+			span++;
+		}
+		if (!span) break;
+
+		PhysPt where=base+(cur_row*ncols+cur_col)*2;
+		if (!useattr) MEM_BlockRead(where,cells,span*2);
+		for (Bitu i=0;i<span;i++) {
+			cells[i*2]=data[done+i];
+			if (useattr) cells[i*2+1]=attr;
+		}
+		MEM_BlockWrite(where,cells,span*2);
+		done+=span;
+		cur_col+=span;
+
+		if (cur_col==ncols) {
+			cur_col=0;
+			cur_row++;
+			if (cur_row==nrows) {
+				INT10_ScrollWindow(0,0,(Bit8u)(nrows-1),(Bit8u)(ncols-1),-1,0x7,page);
+				cur_row--;
+			}
+		}
+	}
+	if (done) INT10_SetCursorPos((Bit8u)cur_row,(Bit8u)cur_col,page);
+	return done;
+}
+//--End of modifications
+
 void INT10_TeletypeOutput(Bit8u chr,Bit8u attr) {
 	INT10_TeletypeOutputAttr(chr,attr,CurMode->type!=M_TEXT);
 }
@@ -33,6 +33,9 @@
 #include "int10.h"
 #include "bios.h"
 #include "dos_inc.h"
+//--Added to record and play back input for benchmarks
+#include "inputreplay.h"
+//--End of modifications
 
 
 
@@ -202,6 +205,9 @@ Bitu PS2_Handler(void) {
 #define MOUSE_MIDDLE_PRESSED 32
 #define MOUSE_MIDDLE_RELEASED 64
 #define MOUSE_DELAY 5.0f
+//--Added to collect relative motion from Boxer at the PS/2 mouse's default rate of 100 samples per second
+#define MOUSE_SAMPLE_INTERVAL 10.0f
+//--End of modifications
 
 void MOUSE_Limit_Events(Bitu /*val*/) {
 	mouse.timer_in_progress = false;
@@ -449,6 +455,10 @@ void DrawCursor() {
 }
 
 void Mouse_CursorMoved(float xrel,float yrel,float x,float y,bool emulate) {
+	//--Added to record and play back input for benchmarks
+	if (!REPLAY_Input(REPLAY_MOUSE_MOVE,0,emulate,0,xrel,yrel,x,y)) return;
+	//--End of modifications
+	boxer_inputDidReachEmulation(); //--Added for input latency measurement
 	float dx = xrel * mouse.pixelPerMickey_x;
 	float dy = yrel * mouse.pixelPerMickey_y;
 
@@ -496,6 +506,15 @@ void Mouse_CursorMoved(float xrel,float yrel,float x,float y,bool emulate) {
 	//--End of modifications
 }
 
+//--Added to apply the relative motion that Boxer has accumulated since the last sample,
+//so that games see motion at the emulated mouse's rate rather than whenever the host's events arrive.
+static void MOUSE_SampleMotion(Bitu /*val*/) {
+	float xrel,yrel;
+	if (boxer_takeMouseMotion(&xrel,&yrel)) Mouse_CursorMoved(xrel,yrel,0,0,true);
+	PIC_AddEvent(MOUSE_SampleMotion,MOUSE_SAMPLE_INTERVAL);
+}
+//--End of modifications
+
 void Mouse_CursorSet(float x,float y) {
 	mouse.x=x;
 	mouse.y=y;
@@ -508,6 +527,10 @@ void Mouse_CursorSet(float x,float y) {
 }
 
 void Mouse_ButtonPressed(Bit8u button) {
+	//--Added to record and play back input for benchmarks
+	if (!REPLAY_Input(REPLAY_MOUSE_BUTTON,0,true,button)) return;
+	//--End of modifications
+	boxer_inputDidReachEmulation(); //--Added for input latency measurement
 	switch (button) {
 #if (MOUSE_BUTTONS >= 1)
 	case 0:
@@ -536,6 +559,10 @@ void Mouse_ButtonPressed(Bit8u button) {
 }
 
 void Mouse_ButtonReleased(Bit8u button) {
+	//--Added to record and play back input for benchmarks
+	if (!REPLAY_Input(REPLAY_MOUSE_BUTTON,0,false,button)) return;
+	//--End of modifications
+	boxer_inputDidReachEmulation(); //--Added for input latency measurement
 	switch (button) {
 #if (MOUSE_BUTTONS >= 1)
 	case 0:
@@ -713,6 +740,7 @@ static Bitu INT33_Handler(void) {
 		}
 		break;
 	case 0x03:	/* Return position and Button Status */
+		boxer_programDidReadInput(); //--Added for input latency measurement
 		reg_bx=mouse.buttons;
 		reg_cx=POS_X;
 		reg_dx=POS_Y;
@@ -739,6 +767,7 @@ static Bitu INT33_Handler(void) {
 		break;
 	case 0x05:	/* Return Button Press Data */
 		{
+			boxer_programDidReadInput(); //--Added for input latency measurement
 			Bit16u but=reg_bx;
 			reg_ax=mouse.buttons;
 			if (but>=MOUSE_BUTTONS) but = MOUSE_BUTTONS - 1;
@@ -750,6 +779,7 @@ static Bitu INT33_Handler(void) {
 		}
 	case 0x06:	/* Return Button Release Data */
 		{
+			boxer_programDidReadInput(); //--Added for input latency measurement
 			Bit16u but=reg_bx;
 			reg_ax=mouse.buttons;
 			if (but>=MOUSE_BUTTONS) but = MOUSE_BUTTONS - 1;
@@ -812,6 +842,7 @@ static Bitu INT33_Handler(void) {
 		mouse.textXorMask = reg_dx;
 		break;
 	case 0x0b:	/* Read Motion Data */
+		boxer_programDidReadInput(); //--Added for input latency measurement
 		reg_cx=(Bit16s)(mouse.mickey_x*mouse.mickeysPerPixel_x);
 		reg_dx=(Bit16s)(mouse.mickey_y*mouse.mickeysPerPixel_y);
 		mouse.mickey_x=0;
@@ -948,6 +979,14 @@ static Bitu INT33_Handler(void) {
 	return CBRET_NONE;
 }
 
+//--Added to let the dynamic core answer mouse polls without leaving the current block
+static bool INT33_FastHandler(void) {
+	if (reg_ax!=0x03) return false;	/* Return position and Button Status */
+	INT33_Handler();
+	return true;
+}
+//--End of modifications
+
 static Bitu MOUSE_BD_Handler(void) {
 	// the stack contains offsets to register values
 	Bit16u raxpt=real_readw(SegValue(ss),reg_sp+0x0a);
@@ -1012,6 +1051,7 @@ static Bitu INT74_Handler(void) {
 		mouse.events--;
 		/* Check for an active Interrupt Handler that will get called */
 		if (mouse.sub_mask & mouse.event_queue[mouse.events].type) {
+			boxer_programDidReadInput(); //--Added for input latency measurement
 			reg_ax=mouse.event_queue[mouse.events].type;
 			reg_bx=mouse.event_queue[mouse.events].buttons;
 			reg_cx=POS_X;
@@ -1027,6 +1067,7 @@ static Bitu INT74_Handler(void) {
 		} else if (useps2callback) {
 			CPU_Push16(RealSeg(CALLBACK_RealPointer(int74_ret_callback)));
 			CPU_Push16(RealOff(CALLBACK_RealPointer(int74_ret_callback)));
+			boxer_programDidReadInput(); //--Added for input latency measurement
 			DoPS2Callback(mouse.event_queue[mouse.events].buttons, POS_X, POS_Y);
 		} else {
 			SegSet16(cs, RealSeg(CALLBACK_RealPointer(int74_ret_callback)));
@@ -1056,6 +1097,7 @@ void MOUSE_Init(Section* /*sec*/) {
 //	RealPt i33loc=RealMake(CB_SEG+1,(call_int33*CB_SIZE)-0x10);
 	RealPt i33loc=RealMake(DOS_GetMemory(0x1)-1,0x10);
 	CALLBACK_Setup(call_int33,&INT33_Handler,CB_MOUSE,Real2Phys(i33loc),"Mouse");
+	CallBack_FastHandlers[call_int33]=&INT33_FastHandler; //--Added for in-block mouse polls
 	// Wasteland needs low(seg(int33))!=0 and low(ofs(int33))!=0
 	real_writed(0,0x33<<2,i33loc);
 
@@ -1117,4 +1159,6 @@ void MOUSE_Init(Section* /*sec*/) {
 	Mouse_ResetHardware();
 	Mouse_Reset();
 	Mouse_SetSensitivity(50,50,50);
+	
+	PIC_AddEvent(MOUSE_SampleMotion,MOUSE_SAMPLE_INTERVAL); //--Added for sampling Boxer's relative motion
 }
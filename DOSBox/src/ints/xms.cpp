@@ -442,13 +442,24 @@ public:
 		}
 		/* Disable the 0 handle */
 		xms_handles[0].free	= false;
+		SAVESTATE_Register("xms",this);	//--Added for save states
 
 		/* Set up UMB chain */
 		umb_available=section->Get_bool("umb");
 		DOS_BuildUMBChain(section->Get_bool("umb"),section->Get_bool("ems"));
 	}
 
+	//--Added for save states. The handles' memory is restored with the memory module.
+	void SaveState(std::ostream& stream) {
+		SAVESTATE_Write(stream,xms_handles);
+	}
+	void LoadState(std::istream& stream) {
+		SAVESTATE_Read(stream,xms_handles);
+	}
+	//--End of modifications
+
 	~XMS(){
+		SAVESTATE_Unregister(this);	//--Added for save states
 		Section_prop * section = static_cast<Section_prop *>(m_configuration);
 		/* Remove upper memory information */
 		dos_infoblock.SetStartOfUMBChain(0xffff);
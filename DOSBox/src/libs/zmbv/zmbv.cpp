@@ -21,6 +21,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <dispatch/dispatch.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include "zmbv.h"
 
@@ -146,13 +150,62 @@ void VideoCodec::CreateVectorTable(void) {
 	}
 }
 
+//--Added to compare blocks 16 pixels at a time with SSE2
+//Returns a bitmask of which of the 16 pixels starting at pold differ from those starting at pnew.
+//Like the comparisons below, only the low 24 bits of each pixel are considered.
+template<class P>
+static INLINE int ChangedPixelMask(const P * pold,const P * pnew) {
+	int mask=0;
+	for (int x=0;x<16;x++) {
+		if ((pold[x]-pnew[x])&0x00ffffff) mask|=(1<<x);
+	}
+	return mask;
+}
+
+#if defined(__SSE2__)
+template<>
+INLINE int ChangedPixelMask<char>(const char * pold,const char * pnew) {
+	__m128i same=_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)pold),_mm_loadu_si128((const __m128i *)pnew));
+	return ~_mm_movemask_epi8(same) & 0xffff;
+}
+
+template<>
+INLINE int ChangedPixelMask<short>(const short * pold,const short * pnew) {
+	__m128i same0=_mm_cmpeq_epi16(_mm_loadu_si128((const __m128i *)pold),_mm_loadu_si128((const __m128i *)pnew));
+	__m128i same1=_mm_cmpeq_epi16(_mm_loadu_si128((const __m128i *)(pold+8)),_mm_loadu_si128((const __m128i *)(pnew+8)));
+	return ~_mm_movemask_epi8(_mm_packs_epi16(same0,same1)) & 0xffff;
+}
+
+#if !defined(__LP64__)
+//32bpp frames are handled as longs, which are only 32 bits wide on 32-bit builds.
+template<>
+INLINE int ChangedPixelMask<long>(const long * pold,const long * pnew) {
+	const __m128i rgb=_mm_set1_epi32(0x00ffffff);
+	const __m128i zero=_mm_setzero_si128();
+	__m128i same[4];
+	for (int i=0;i<4;i++) {
+		__m128i diff=_mm_xor_si128(_mm_loadu_si128((const __m128i *)(pold+i*4)),_mm_loadu_si128((const __m128i *)(pnew+i*4)));
+		same[i]=_mm_cmpeq_epi32(_mm_and_si128(diff,rgb),zero);
+	}
+	__m128i packed=_mm_packs_epi16(_mm_packs_epi32(same[0],same[1]),_mm_packs_epi32(same[2],same[3]));
+	return ~_mm_movemask_epi8(packed) & 0xffff;
+}
+#endif
+#endif
+//--End of modifications
+
 template<class P>
 INLINE int VideoCodec::PossibleBlock(int vx,int vy,FrameBlock * block) {
 	int ret=0;
 	P * pold=((P*)oldframe)+block->start+(vy*pitch)+vx;
 	P * pnew=((P*)newframe)+block->start;;	
 	for (int y=0;y<block->dy;y+=4) {
-		for (int x=0;x<block->dx;x+=4) {
+		int x=0;
+		/* Only every 4th pixel is sampled */
+		for (;x+16<=block->dx;x+=16) {
+			ret+=__builtin_popcount(ChangedPixelMask<P>(pold+x,pnew+x) & 0x1111);
+		}
+		for (;x<block->dx;x+=4) {
 			int test=0-((pold[x]-pnew[x])&0x00ffffff);
 			ret-=(test>>31);
 		}
@@ -168,7 +221,11 @@ INLINE int VideoCodec::CompareBlock(int vx,int vy,FrameBlock * block) {
 	P * pold=((P*)oldframe)+block->start+(vy*pitch)+vx;
 	P * pnew=((P*)newframe)+block->start;;	
 	for (int y=0;y<block->dy;y++) {
-		for (int x=0;x<block->dx;x++) {
+		int x=0;
+		for (;x+16<=block->dx;x+=16) {
+			ret+=__builtin_popcount(ChangedPixelMask<P>(pold+x,pnew+x));
+		}
+		for (;x<block->dx;x++) {
 			int test=0-((pold[x]-pnew[x])&0x00ffffff);
 			ret-=(test>>31);
 		}
@@ -182,53 +239,68 @@ template<class P>
 INLINE void VideoCodec::AddXorBlock(int vx,int vy,FrameBlock * block) {
 	P * pold=((P*)oldframe)+block->start+(vy*pitch)+vx;
 	P * pnew=((P*)newframe)+block->start;
+	P * pwork=(P*)&work[block->workStart];
 	for (int y=0;y<block->dy;y++) {
 		for (int x=0;x<block->dx;x++) {
-			*((P*)&work[workUsed])=pnew[x] ^ pold[x];
-			workUsed+=sizeof(P);
+			*pwork++=pnew[x] ^ pold[x];
 		}
 		pold+=pitch;
 		pnew+=pitch;
 	}
 }
 
+template<class P>
+INLINE void VideoCodec::FindBlockVector(FrameBlock * block,signed char * vector) {
+	int bestvx = 0;
+	int bestvy = 0;
+	int bestchange=CompareBlock<P>(0,0, block);
+	int possibles=64;
+	for (int v=0;v<VectorCount && possibles;v++) {
+		if (bestchange<4) break;
+		int vx = VectorTable[v].x;
+		int vy = VectorTable[v].y;
+		if (PossibleBlock<P>(vx, vy, block) < 4) {
+			possibles--;
+//			if (!possibles) Msg("Ran out of possibles, at %d of %d best %d\n",v,VectorCount,bestchange);
+			int testchange=CompareBlock<P>(vx,vy, block);
+			if (testchange<bestchange) {
+				bestchange=testchange;
+				bestvx = vx;
+				bestvy = vy;
+			}
+		}
+	}
+	vector[0]=(bestvx << 1);
+	vector[1]=(bestvy << 1);
+	if (bestchange) vector[0]|=1;
+}
+
 template<class P>
 void VideoCodec::AddXorFrame(void) {
-	int written=0;
-	int lastvector=0;
 	signed char * vectors=(signed char*)&work[workUsed];
 	/* Align the following xor data on 4 byte boundary*/
 	workUsed=(workUsed + blockcount*2 +3) & ~3;
-	int totalx=0;
-	int totaly=0;
+
+	//--Modified to search for and xor blocks in parallel
+	dispatch_queue_t queue=dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT,0);
+
+	/* Each block's motion search only reads the old and new frames, so blocks can be searched in parallel */
+	dispatch_apply(blockcount,queue,^(size_t b) {
+		FindBlockVector<P>(&blocks[b],&vectors[b*2]);
+	});
+
+	/* Lay out the xor data of the changed blocks in block order, then fill it in parallel */
 	for (int b=0;b<blockcount;b++) {
-		FrameBlock * block=&blocks[b];
-		int bestvx = 0;
-		int bestvy = 0;
-		int bestchange=CompareBlock<P>(0,0, block);
-		int possibles=64;
-		for (int v=0;v<VectorCount && possibles;v++) {
-			if (bestchange<4) break;
-			int vx = VectorTable[v].x;
-			int vy = VectorTable[v].y;
-			if (PossibleBlock<P>(vx, vy, block) < 4) {
-				possibles--;
-//				if (!possibles) Msg("Ran out of possibles, at %d of %d best %d\n",v,VectorCount,bestchange);
-				int testchange=CompareBlock<P>(vx,vy, block);
-				if (testchange<bestchange) {
-					bestchange=testchange;
-					bestvx = vx;
-					bestvy = vy;
-				}
-			}
-		}
-		vectors[b*2+0]=(bestvx << 1);
-		vectors[b*2+1]=(bestvy << 1);
-		if (bestchange) {
-			vectors[b*2+0]|=1;
-			AddXorBlock<P>(bestvx, bestvy, block);
+		if (vectors[b*2+0] & 1) {
+			blocks[b].workStart=workUsed;
+			workUsed+=blocks[b].dx*blocks[b].dy*sizeof(P);
 		}
 	}
+	dispatch_apply(blockcount,queue,^(size_t b) {
+		if (vectors[b*2+0] & 1)
+			AddXorBlock<P>(vectors[b*2+0] >> 1,vectors[b*2+1] >> 1,&blocks[b]);
+	});
+	//--End of modifications
 }
 
 bool VideoCodec::SetupCompress( int _width, int _height ) {
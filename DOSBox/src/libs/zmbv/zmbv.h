@@ -44,6 +44,7 @@ private:
 	struct FrameBlock {
 		int start;
 		int dx,dy;
+		int workStart;	/* Where this block's xor data goes in the work buffer when compressing */
 	};
 	struct CodecVector {
 		int x,y;
@@ -99,6 +100,8 @@ private:
 		INLINE int CompareBlock(int vx,int vy,FrameBlock * block);
 	template<class P>
 		INLINE void AddXorBlock(int vx,int vy,FrameBlock * block);
+	template<class P>
+		INLINE void FindBlockVector(FrameBlock * block,signed char * vector);
 	template<class P>
 		INLINE void UnXorBlock(int vx,int vy,FrameBlock * block);
 	template<class P>
@@ -0,0 +1,267 @@
+/*
+ *  Copyright (C) 2002-2010  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+//--Added to record and play back input for benchmarking: see inputreplay.h.
+//Recordings are a small header followed by the events in the order they were recorded,
+//in the host's byte order.
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "dosbox.h"
+#include "inputreplay.h"
+#include "netplay.h"
+#include "pic.h"
+#include "timer.h"
+#include "keyboard.h"
+#include "mouse.h"
+#include "joystick.h"
+
+#define REPLAY_MAGIC	0x42584952	// 'BXIR'
+#define REPLAY_VERSION	1
+
+struct ReplayEvent {
+	Bit32u tick;
+	Bit8u type;
+	Bit8u which;
+	Bit8u flag;
+	Bit8u reserved;
+	Bit32u code;
+	float values[4];
+};
+
+struct ReplayHeader {
+	Bit32u magic;
+	Bit32u version;
+	Bit32u duration;	// emulated milliseconds from the start to the end of recording
+	Bit32u count;
+};
+
+bool replay_active=false;
+
+static struct {
+	bool recording;
+	bool playing;
+	bool injecting;
+	bool netplay;
+	Bitu start_tick;
+	Bitu duration;
+	Bitu next;
+	std::vector<ReplayEvent> events;
+	Bitu frames;
+	Bit32u checksum;
+} replay;
+
+static void REPLAY_UpdateActive(void) {
+	replay_active=replay.recording || replay.playing || replay.netplay;
+}
+
+static void REPLAY_Reset(void) {
+	replay.start_tick=PIC_Ticks;
+	replay.next=0;
+	replay.frames=0;
+	replay.checksum=2166136261u;
+}
+
+Bitu REPLAY_ElapsedTicks(void) {
+	return replay_active ? PIC_Ticks-replay.start_tick : 0;
+}
+
+bool REPLAY_HandleInput(Bit8u type,Bit8u which,Bit8u flag,Bit32u code,float v0,float v1,float v2,float v3) {
+	// netplay holds live input back until its frame comes round, then applies it through here again
+	if (replay.netplay && !NETPLAY_HandleInput(type,which,flag,code,v0,v1,v2,v3)) return false;
+	if (replay.playing) return replay.injecting;
+	if (!replay.recording) return true;
+	ReplayEvent event;
+	event.tick=(Bit32u)(PIC_Ticks-replay.start_tick);
+	event.type=type;
+	event.which=which;
+	event.flag=flag;
+	event.reserved=0;
+	event.code=code;
+	event.values[0]=v0;
+	event.values[1]=v1;
+	event.values[2]=v2;
+	event.values[3]=v3;
+	replay.events.push_back(event);
+	return true;
+}
+
+void REPLAY_FrameDrawn(const Bit8u * lines,Bitu pitch,Bitu line_size,Bitu height) {
+	if (GCC_LIKELY(!replay_active)) return;
+	// FNV-1a over whole words, which is plenty to tell two runs apart
+	Bit32u hash=replay.checksum;
+	for (Bitu y=0;y<height;y++) {
+		const Bit8u * line=lines+y*pitch;
+		Bitu x=0;
+		for (;x+4<=line_size;x+=4) {
+			Bit32u word;
+			memcpy(&word,line+x,4);
+			hash=(hash^word)*16777619u;
+		}
+		for (;x<line_size;x++) hash=(hash^line[x])*16777619u;
+	}
+	replay.checksum=hash;
+	replay.frames++;
+}
+
+static void REPLAY_Apply(const ReplayEvent & event) {
+	switch (event.type) {
+	case REPLAY_KEY:
+		KEYBOARD_AddKey((KBD_KEYS)event.code,event.flag!=0);
+		break;
+	case REPLAY_MOUSE_MOVE:
+		Mouse_CursorMoved(event.values[0],event.values[1],event.values[2],event.values[3],event.flag!=0);
+		break;
+	case REPLAY_MOUSE_BUTTON:
+		if (event.flag) Mouse_ButtonPressed((Bit8u)event.code);
+		else Mouse_ButtonReleased((Bit8u)event.code);
+		break;
+	case REPLAY_JOYSTICK_ENABLE:
+		JOYSTICK_Enable(event.which,event.flag!=0);
+		break;
+	case REPLAY_JOYSTICK_BUTTON:
+		JOYSTICK_Button(event.which,event.code,event.flag!=0);
+		break;
+	case REPLAY_JOYSTICK_MOVE_X:
+		JOYSTICK_Move_X(event.which,event.values[0]);
+		break;
+	case REPLAY_JOYSTICK_MOVE_Y:
+		JOYSTICK_Move_Y(event.which,event.values[0]);
+		break;
+	}
+}
+
+void REPLAY_ApplyInput(Bit8u type,Bit8u which,Bit8u flag,Bit32u code,float v0,float v1,float v2,float v3) {
+	ReplayEvent event;
+	event.tick=0;
+	event.type=type;
+	event.which=which;
+	event.flag=flag;
+	event.reserved=0;
+	event.code=code;
+	event.values[0]=v0;
+	event.values[1]=v1;
+	event.values[2]=v2;
+	event.values[3]=v3;
+	REPLAY_Apply(event);
+}
+
+void REPLAY_SetNetplayActive(bool active) {
+	// input from a recording would only reach this player's machine
+	if (active) REPLAY_StopPlayback();
+	replay.netplay=active;
+	REPLAY_UpdateActive();
+}
+
+// runs at the start of every emulated millisecond during playback
+static void REPLAY_Tick(void) {
+	Bitu elapsed=PIC_Ticks-replay.start_tick;
+	replay.injecting=true;
+	while (replay.next<replay.events.size() && replay.events[replay.next].tick<=elapsed) {
+		REPLAY_Apply(replay.events[replay.next]);
+		replay.next++;
+	}
+	replay.injecting=false;
+}
+
+void REPLAY_StartRecording(void) {
+	REPLAY_StopPlayback();
+	replay.events.clear();
+	REPLAY_Reset();
+	replay.recording=true;
+	REPLAY_UpdateActive();
+}
+
+bool REPLAY_StopRecording(const char * path) {
+	if (!replay.recording) return false;
+	replay.recording=false;
+	REPLAY_UpdateActive();
+
+	ReplayHeader header;
+	header.magic=REPLAY_MAGIC;
+	header.version=REPLAY_VERSION;
+	header.duration=(Bit32u)(PIC_Ticks-replay.start_tick);
+	header.count=(Bit32u)replay.events.size();
+
+	FILE * file=fopen(path,"wb");
+	if (!file) return false;
+	bool written=fwrite(&header,sizeof(header),1,file)==1;
+	if (written && header.count)
+		written=fwrite(&replay.events[0],sizeof(ReplayEvent),header.count,file)==header.count;
+	if (fclose(file)) written=false;
+	replay.events.clear();
+	return written;
+}
+
+bool REPLAY_IsRecording(void) {
+	return replay.recording;
+}
+
+bool REPLAY_StartPlayback(const char * path) {
+	FILE * file=fopen(path,"rb");
+	if (!file) return false;
+	ReplayHeader header;
+	std::vector<ReplayEvent> events;
+	bool read=fread(&header,sizeof(header),1,file)==1 &&
+		header.magic==REPLAY_MAGIC && header.version==REPLAY_VERSION;
+	if (read && header.count) {
+		events.resize(header.count);
+		read=fread(&events[0],sizeof(ReplayEvent),header.count,file)==header.count;
+	}
+	fclose(file);
+	if (!read) return false;
+
+	if (replay.recording) {
+		replay.recording=false;
+		replay.events.clear();
+	}
+	REPLAY_StopPlayback();
+	replay.events.swap(events);
+	replay.duration=header.duration;
+	REPLAY_Reset();
+	replay.playing=true;
+	REPLAY_UpdateActive();
+	TIMER_AddTickHandler(REPLAY_Tick);
+	return true;
+}
+
+void REPLAY_StopPlayback(void) {
+	if (!replay.playing) return;
+	TIMER_DelTickHandler(REPLAY_Tick);
+	replay.playing=false;
+	REPLAY_UpdateActive();
+	replay.events.clear();
+}
+
+bool REPLAY_IsPlaying(void) {
+	return replay.playing;
+}
+
+bool REPLAY_PlaybackFinished(void) {
+	return replay.playing && (PIC_Ticks-replay.start_tick)>=replay.duration;
+}
+
+Bitu REPLAY_FrameCount(void) {
+	return replay.frames;
+}
+
+Bit32u REPLAY_FrameChecksum(void) {
+	return replay.checksum;
+}
+//--End of modifications
@@ -28,6 +28,7 @@
 #include "control.h"
 #include <list>
 #include <string>
+#include <vector>
 using namespace std;
 
 
@@ -44,7 +45,17 @@ struct MessageBlock {
 static list<MessageBlock> Lang;
 typedef list<MessageBlock>::iterator itmb;
 
-void MSG_Add(const char * _name, const char* _val) {
+//--Added to register messages lazily. Boxer looks messages up in its own localizations (see MSG_Get),
+//so the default texts are only needed when a language file is loaded over them or written out.
+//Until then MSG_Add just notes down the name and text, which are always string literals,
+//rather than copying them and searching the hundreds of messages before them for duplicates.
+struct PendingMessage {
+	const char * name;
+	const char * val;
+};
+static vector<PendingMessage> PendingLang;
+
+static void MSG_AddBlock(const char * _name, const char* _val) {
 	/* Find the message */
 	for(itmb tel=Lang.begin();tel!=Lang.end();tel++) {
 		if((*tel).name==_name) { 
@@ -56,7 +67,25 @@ void MSG_Add(const char * _name, const char* _val) {
 	Lang.push_back(MessageBlock(_name,_val));
 }
 
+static void MSG_AddPending(void) {
+	for(vector<PendingMessage>::iterator pend=PendingLang.begin();pend!=PendingLang.end();pend++)
+		MSG_AddBlock((*pend).name,(*pend).val);
+	PendingLang.clear();
+}
+
+void MSG_Add(const char * _name, const char* _val) {
+	PendingMessage message = { _name,_val };
+	PendingLang.push_back(message);
+}
+
+void MSG_AddCopy(const char * _name, const char* _val) {
+	MSG_AddPending();
+	MSG_AddBlock(_name,_val);
+}
+//--End of modifications
+
 void MSG_Replace(const char * _name, const char* _val) {
+	MSG_AddPending();	//--Added
 	/* Find the message */
 	for(itmb tel=Lang.begin();tel!=Lang.end();tel++) {
 		if((*tel).name==_name) { 
@@ -136,6 +165,15 @@ const char * MSG_Get(char const * msg) {
 void MSG_Write(const char * location) {
 	FILE* out=fopen(location,"w+t");
 	if(out==NULL) return;//maybe an error?
+	//--Added to include the configuration help, which is only registered when first asked for
+	for (int i=0;Section * sec=control->GetSection(i);i++) {
+		Section_prop * secprop=dynamic_cast<Section_prop *>(sec);
+		if (!secprop) continue;
+		Property * p;
+		for (int j=0;(p=secprop->Get_prop(j));j++) p->Get_help();
+	}
+	MSG_AddPending();
+	//--End of modifications
 	for(itmb tel=Lang.begin();tel!=Lang.end();tel++){
 		fprintf(out,":%s\n%s\n.\n",(*tel).name.c_str(),(*tel).val.c_str());
 	}
@@ -0,0 +1,865 @@
+/*
+ *  Copyright (C) 2002-2010  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+//--Added to play over the network in lockstep: see netplay.h.
+//Every packet starts with the same small header, and all values are sent in network byte order.
+//Input packets carry the sender's count of the frames it has received from each player, which
+//doubles as the acknowledgement that tells the recipient which frames it no longer has to repeat.
+//Only frames with input in them are stored: any frame before a player's count is otherwise empty.
+
+#include <string.h>
+#include <sstream>
+#include <map>
+#include <vector>
+#include "dosbox.h"
+#include "netplay.h"
+#include "inputreplay.h"
+#include "savestate.h"
+#include "timer.h"
+#include "pic.h"
+#include "mem.h"
+#include "regs.h"
+
+#if !defined(WIN32)
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#define NETPLAY_MAGIC			0x42584E50	// 'BXNP'
+#define NETPLAY_VERSION			1
+#define NETPLAY_PACKET_SIZE		1400
+#define NETPLAY_EVENT_SIZE		23
+#define NETPLAY_STATE_CHUNK		1200
+#define NETPLAY_STATE_WINDOW	64			// chunks sent ahead of the last acknowledgement
+#define NETPLAY_JOIN_INTERVAL	250			// host milliseconds between attempts to join
+#define NETPLAY_TIMEOUT			10000		// host milliseconds to wait on a quiet player before giving up
+#define NETPLAY_START_TIMEOUT	60000		// the same, before the first input arrives from the other players
+#define NETPLAY_HASH_SLICE		65536		// how much of main memory each state hash covers
+#define NETPLAY_HASH_HISTORY	8
+
+enum NetplayPacket {
+	NETPLAY_JOIN=1,			// build hash
+	NETPLAY_WELCOME,		// player index, settings
+	NETPLAY_BYE,			// reason
+	NETPLAY_STATE,			// total size, offset, length, whether the chunk is all zeroes, data
+	NETPLAY_STATE_ACK,		// how much of the snapshot has been received
+	NETPLAY_READY,			// the snapshot has been restored
+	NETPLAY_INPUT			// frame counts, state hash, then blocks of frames for each player
+};
+
+enum NetplayByeReason {
+	NETPLAY_BYE_LEFT=0,
+	NETPLAY_BYE_FULL,
+	NETPLAY_BYE_MISMATCH
+};
+
+struct NetplayEvent {
+	Bit8u type;
+	Bit8u which;
+	Bit8u flag;
+	Bit32u code;
+	float values[4];
+};
+
+typedef std::vector<NetplayEvent> NetplayFrame;
+
+static struct {
+	NetplayState state;
+	bool hosting;
+	bool injecting;
+	volatile bool interrupted;
+	int socket;
+	bool socket_open;
+	Bit32u build_hash;
+	std::string build;
+	std::string failure;
+	NetplaySettings settings;
+	Bitu me;
+	Bitu joined;
+	struct sockaddr_in addrs[NETPLAY_MAX_PLAYERS];	// the host, for players; everyone else, for the host
+	Bitu last_heard[NETPLAY_MAX_PLAYERS];
+
+	// snapshot transfer
+	std::string snapshot;
+	Bitu snapshot_acked[NETPLAY_MAX_PLAYERS];
+	bool ready[NETPLAY_MAX_PLAYERS];
+	Bitu snapshot_received;
+	bool welcomed;
+
+	// lockstep
+	Bitu start_tick;
+	Bitu frame;									// the frame most recently applied
+	bool heard_input;
+	NetplayFrame pending;						// local input for the frame in progress
+	std::map<Bitu,NetplayFrame> frames[NETPLAY_MAX_PLAYERS];
+	Bitu received[NETPLAY_MAX_PLAYERS];			// frames before this are known for each player
+	Bitu acked[NETPLAY_MAX_PLAYERS][NETPLAY_MAX_PLAYERS];	// each player's received counts, as last reported
+	Bitu last_sent;
+	Bitu hash_frames[NETPLAY_HASH_HISTORY];
+	Bit32u hashes[NETPLAY_HASH_HISTORY];
+	Bitu stall_ms;
+} netplay;
+
+static Bitu NETPLAY_Now(void) {
+	struct timeval now;
+	gettimeofday(&now,NULL);
+	return (Bitu)now.tv_sec*1000+now.tv_usec/1000;
+}
+
+static Bit32u NETPLAY_Hash(Bit32u hash,const void * data,Bitu size) {
+	const Bit8u * bytes=(const Bit8u *)data;
+	for (Bitu i=0;i<size;i++) hash=(hash^bytes[i])*16777619u;
+	return hash;
+}
+
+
+/* Packets */
+
+struct NetplayWriter {
+	Bit8u data[NETPLAY_PACKET_SIZE];
+	Bitu size;
+	NetplayWriter(Bit8u type) : size(0) {
+		put32(NETPLAY_MAGIC); put8(type); put8((Bit8u)netplay.me); put8(0); put8(0);
+	}
+	Bitu room(void) const { return NETPLAY_PACKET_SIZE-size; }
+	void put8(Bit8u value) { data[size++]=value; }
+	void put32(Bit32u value) { value=htonl(value); memcpy(data+size,&value,4); size+=4; }
+	void putFloat(float value) { Bit32u bits; memcpy(&bits,&value,4); put32(bits); }
+	void putBytes(const void * bytes,Bitu length) { memcpy(data+size,bytes,length); size+=length; }
+};
+
+struct NetplayReader {
+	const Bit8u * data;
+	Bitu size;
+	Bitu offset;
+	bool valid;
+	NetplayReader(const Bit8u * bytes,Bitu length) : data(bytes), size(length), offset(0), valid(true) {}
+	bool has(Bitu length) { if (offset+length>size) valid=false; return valid; }
+	Bit8u get8(void) { return has(1) ? data[offset++] : 0; }
+	Bit32u get32(void) {
+		if (!has(4)) return 0;
+		Bit32u value; memcpy(&value,data+offset,4); offset+=4;
+		return ntohl(value);
+	}
+	float getFloat(void) { Bit32u bits=get32(); float value; memcpy(&value,&bits,4); return value; }
+	const Bit8u * getBytes(Bitu length) {
+		if (!has(length)) return 0;
+		const Bit8u * bytes=data+offset; offset+=length;
+		return bytes;
+	}
+};
+
+static void NETPLAY_Send(Bitu player,const NetplayWriter& packet) {
+	sendto(netplay.socket,packet.data,packet.size,0,(struct sockaddr *)&netplay.addrs[player],sizeof(netplay.addrs[player]));
+}
+
+static bool NETPLAY_SameAddress(const struct sockaddr_in& a,const struct sockaddr_in& b) {
+	return a.sin_addr.s_addr==b.sin_addr.s_addr && a.sin_port==b.sin_port;
+}
+
+static void NETPLAY_SendWelcome(Bitu player) {
+	NetplayWriter packet(NETPLAY_WELCOME);
+	packet.put8((Bit8u)player);
+	packet.put8((Bit8u)netplay.settings.players);
+	packet.put32((Bit32u)netplay.settings.frame_ms);
+	packet.put32((Bit32u)netplay.settings.delay);
+	packet.put32((Bit32u)netplay.settings.hash_interval);
+	packet.put32((Bit32u)netplay.settings.cycles);
+	packet.put32((Bit32u)netplay.settings.core);
+	NETPLAY_Send(player,packet);
+}
+
+static void NETPLAY_SendBye(const struct sockaddr_in& addr,Bit8u reason) {
+	NetplayWriter packet(NETPLAY_BYE);
+	packet.put8(reason);
+	sendto(netplay.socket,packet.data,packet.size,0,(struct sockaddr *)&addr,sizeof(addr));
+}
+
+static void NETPLAY_Fail(const char * reason);
+
+
+/* Lockstep */
+
+static void NETPLAY_WriteEvent(NetplayWriter& packet,const NetplayEvent& event) {
+	packet.put8(event.type);
+	packet.put8(event.which);
+	packet.put8(event.flag);
+	packet.put32(event.code);
+	for (Bitu v=0;v<4;v++) packet.putFloat(event.values[v]);
+}
+
+// adds as many of the frames from origin the recipient hasn't acknowledged as will fit
+static void NETPLAY_WriteFrames(NetplayWriter& packet,Bitu recipient,Bitu origin) {
+	Bitu first=netplay.acked[recipient][origin];
+	Bitu last=netplay.received[origin];
+	if (first>=last || packet.room()<6) return;
+
+	Bitu countOffset=packet.size+1;
+	packet.put8((Bit8u)origin);
+	packet.put8(0);
+	packet.put32((Bit32u)first);
+
+	Bitu count=0;
+	for (Bitu f=first;f<last && count<255;f++) {
+		std::map<Bitu,NetplayFrame>::const_iterator found=netplay.frames[origin].find(f);
+		Bitu events=(found==netplay.frames[origin].end()) ? 0 : found->second.size();
+		if (events>255 || packet.room()<1+events*NETPLAY_EVENT_SIZE) break;
+		packet.put8((Bit8u)events);
+		for (Bitu e=0;e<events;e++) NETPLAY_WriteEvent(packet,found->second[e]);
+		count++;
+	}
+	packet.data[countOffset]=(Bit8u)count;
+}
+
+static void NETPLAY_SendInput(Bitu recipient) {
+	NetplayWriter packet(NETPLAY_INPUT);
+	for (Bitu p=0;p<NETPLAY_MAX_PLAYERS;p++) packet.put32((Bit32u)netplay.received[p]);
+
+	// our most recent state hash
+	Bitu newest=0;
+	for (Bitu h=1;h<NETPLAY_HASH_HISTORY;h++) {
+		if (netplay.hash_frames[h]>netplay.hash_frames[newest]) newest=h;
+	}
+	packet.put32((Bit32u)netplay.hash_frames[newest]);
+	packet.put32(netplay.hashes[newest]);
+
+	if (netplay.hosting) {
+		for (Bitu o=0;o<netplay.settings.players;o++) {
+			if (o!=recipient) NETPLAY_WriteFrames(packet,recipient,o);
+		}
+	} else {
+		NETPLAY_WriteFrames(packet,recipient,netplay.me);
+	}
+	NETPLAY_Send(recipient,packet);
+}
+
+static void NETPLAY_SendAllInput(void) {
+	if (netplay.hosting) {
+		for (Bitu p=1;p<netplay.settings.players;p++) NETPLAY_SendInput(p);
+	} else {
+		NETPLAY_SendInput(0);
+	}
+	netplay.last_sent=NETPLAY_Now();
+}
+
+static void NETPLAY_CompareHash(Bitu player,Bitu frame,Bit32u hash) {
+	if (!frame) return;
+	for (Bitu h=0;h<NETPLAY_HASH_HISTORY;h++) {
+		if (netplay.hash_frames[h]==frame && netplay.hashes[h]!=hash) {
+			LOG_MSG("NETPLAY: player %d's machine differs from ours at frame %d",(int)player,(int)frame);
+			NETPLAY_Fail("the machines are no longer in step");
+			return;
+		}
+	}
+}
+
+static void NETPLAY_ReadInput(Bitu sender,NetplayReader& reader) {
+	for (Bitu p=0;p<NETPLAY_MAX_PLAYERS;p++) {
+		Bitu count=reader.get32();
+		if (reader.valid && count>netplay.acked[sender][p]) netplay.acked[sender][p]=count;
+	}
+	Bitu hashFrame=reader.get32();
+	Bit32u hash=reader.get32();
+	if (!reader.valid) return;
+	NETPLAY_CompareHash(sender,hashFrame,hash);
+
+	while (reader.valid && reader.offset<reader.size) {
+		Bitu origin=reader.get8();
+		Bitu count=reader.get8();
+		Bitu first=reader.get32();
+		// only the host relays other players' input
+		bool accept=origin<netplay.settings.players && origin!=netplay.me && (origin==sender || sender==0);
+		for (Bitu i=0;i<count && reader.valid;i++) {
+			Bitu events=reader.get8();
+			NetplayFrame frame(events);
+			for (Bitu e=0;e<events;e++) {
+				frame[e].type=reader.get8();
+				frame[e].which=reader.get8();
+				frame[e].flag=reader.get8();
+				frame[e].code=reader.get32();
+				for (Bitu v=0;v<4;v++) frame[e].values[v]=reader.getFloat();
+			}
+			if (!reader.valid || !accept) continue;
+			// frames are only taken in order: anything after a gap will be sent again
+			if (first+i==netplay.received[origin]) {
+				if (events) netplay.frames[origin][first+i].swap(frame);
+				netplay.received[origin]++;
+				netplay.heard_input=true;
+			}
+		}
+	}
+}
+
+
+/* Receiving */
+
+static void NETPLAY_ReceiveState(NetplayReader& reader);
+
+static void NETPLAY_Receive(void) {
+	Bit8u buffer[NETPLAY_PACKET_SIZE];
+	for (;;) {
+		struct sockaddr_in from;
+		socklen_t fromLength=sizeof(from);
+		ssize_t length=recvfrom(netplay.socket,buffer,sizeof(buffer),0,(struct sockaddr *)&from,&fromLength);
+		if (length<0) return;	// EAGAIN: nothing more for now
+
+		NetplayReader reader(buffer,(Bitu)length);
+		Bit32u magic=reader.get32();
+		Bit8u type=reader.get8();
+		reader.get8(); reader.get8(); reader.get8();
+		if (!reader.valid || magic!=NETPLAY_MAGIC) continue;
+
+		// work out who it's from: players only listen to the host
+		Bitu sender=NETPLAY_MAX_PLAYERS;
+		if (netplay.hosting) {
+			for (Bitu p=1;p<netplay.joined;p++) {
+				if (NETPLAY_SameAddress(from,netplay.addrs[p])) sender=p;
+			}
+		} else if (NETPLAY_SameAddress(from,netplay.addrs[0])) {
+			sender=0;
+		}
+
+		if (netplay.hosting && type==NETPLAY_JOIN) {
+			if (sender<NETPLAY_MAX_PLAYERS) {
+				NETPLAY_SendWelcome(sender);
+			} else if (reader.get32()!=netplay.build_hash) {
+				NETPLAY_SendBye(from,NETPLAY_BYE_MISMATCH);
+			} else if (netplay.joined>=netplay.settings.players || netplay.state!=NETPLAY_WAITING) {
+				NETPLAY_SendBye(from,NETPLAY_BYE_FULL);
+			} else {
+				sender=netplay.joined++;
+				netplay.addrs[sender]=from;
+				netplay.last_heard[sender]=NETPLAY_Now();
+				NETPLAY_SendWelcome(sender);
+				LOG_MSG("NETPLAY: player %d joined",(int)sender);
+			}
+			continue;
+		}
+		if (sender>=NETPLAY_MAX_PLAYERS) continue;
+		netplay.last_heard[sender]=NETPLAY_Now();
+
+		switch (type) {
+		case NETPLAY_WELCOME:
+			if (netplay.hosting || netplay.welcomed) break;
+			netplay.me=reader.get8();
+			netplay.settings.players=reader.get8();
+			netplay.settings.frame_ms=reader.get32();
+			netplay.settings.delay=reader.get32();
+			netplay.settings.hash_interval=reader.get32();
+			netplay.settings.cycles=(Bit32s)reader.get32();
+			netplay.settings.core=reader.get32();
+			if (!reader.valid || netplay.me==0 || netplay.me>=netplay.settings.players ||
+				netplay.settings.players>NETPLAY_MAX_PLAYERS || !netplay.settings.frame_ms || !netplay.settings.delay) {
+				NETPLAY_Fail("the host sent settings we could not use");
+				return;
+			}
+			netplay.welcomed=true;
+			break;
+		case NETPLAY_BYE: {
+			Bit8u reason=reader.get8();
+			NETPLAY_Fail(reason==NETPLAY_BYE_MISMATCH ? "the host is running a different version of Boxer" :
+						 reason==NETPLAY_BYE_FULL ? "the game is already full" : "another player left the game");
+			return;
+		}
+		case NETPLAY_STATE:
+			if (!netplay.hosting && netplay.welcomed) NETPLAY_ReceiveState(reader);
+			break;
+		case NETPLAY_STATE_ACK: {
+			Bitu acked=reader.get32();
+			if (netplay.hosting && reader.valid && acked>netplay.snapshot_acked[sender])
+				netplay.snapshot_acked[sender]=acked;
+			break;
+		}
+		case NETPLAY_READY:
+			if (netplay.hosting) netplay.ready[sender]=true;
+			break;
+		case NETPLAY_INPUT:
+			if (netplay.state==NETPLAY_RUNNING) NETPLAY_ReadInput(sender,reader);
+			break;
+		}
+		if (netplay.state==NETPLAY_FAILED) return;
+	}
+}
+
+// waits up to timeout host milliseconds for a packet to arrive
+static void NETPLAY_Wait(Bitu timeout) {
+	struct pollfd descriptor;
+	descriptor.fd=netplay.socket;
+	descriptor.events=POLLIN;
+	descriptor.revents=0;
+	poll(&descriptor,1,(int)timeout);
+}
+
+
+/* Snapshot transfer */
+
+static void NETPLAY_ReceiveState(NetplayReader& reader) {
+	Bitu total=reader.get32();
+	Bitu offset=reader.get32();
+	Bitu length=reader.get32();
+	bool zero=reader.get8()!=0;
+	const Bit8u * data=zero ? 0 : reader.getBytes(length);
+	if (!reader.valid) return;
+
+	// we've already restored the snapshot: the host just hasn't heard yet
+	if (netplay.state==NETPLAY_RUNNING) {
+		NetplayWriter packet(NETPLAY_READY);
+		NETPLAY_Send(0,packet);
+		return;
+	}
+
+	if (netplay.snapshot.size()!=total) {
+		netplay.snapshot.assign(total,'\0');
+		netplay.snapshot_received=0;
+	}
+	if (offset==netplay.snapshot_received && offset+length<=total) {
+		if (data) memcpy(&netplay.snapshot[offset],data,length);
+		netplay.snapshot_received+=length;
+	}
+	NetplayWriter packet(NETPLAY_STATE_ACK);
+	packet.put32((Bit32u)netplay.snapshot_received);
+	NETPLAY_Send(0,packet);
+}
+
+static void NETPLAY_SendStateChunk(Bitu player,Bitu offset) {
+	Bitu total=netplay.snapshot.size();
+	Bitu length=total-offset;
+	if (length>NETPLAY_STATE_CHUNK) length=NETPLAY_STATE_CHUNK;
+
+	// main memory is mostly empty, so don't bother sending runs of zeroes
+	const char * data=netplay.snapshot.data()+offset;
+	bool zero=true;
+	for (Bitu i=0;i<length && zero;i++) zero=(data[i]==0);
+
+	NetplayWriter packet(NETPLAY_STATE);
+	packet.put32((Bit32u)total);
+	packet.put32((Bit32u)offset);
+	packet.put32((Bit32u)length);
+	packet.put8(zero);
+	if (!zero) packet.putBytes(data,length);
+	NETPLAY_Send(player,packet);
+}
+
+// sends the snapshot to everyone until they have all restored it
+static bool NETPLAY_SendState(void) {
+	Bitu total=netplay.snapshot.size();
+	Bitu lastProgress=NETPLAY_Now();
+	for (;;) {
+		bool everyoneReady=true;
+		for (Bitu p=1;p<netplay.settings.players;p++) {
+			if (netplay.ready[p]) continue;
+			everyoneReady=false;
+			Bitu acked=netplay.snapshot_acked[p];
+			// once it's all acknowledged, the last chunk doubles as a prompt to say it's been restored
+			if (acked>=total) acked=(total>NETPLAY_STATE_CHUNK) ? total-NETPLAY_STATE_CHUNK : 0;
+			for (Bitu c=0;c<NETPLAY_STATE_WINDOW && acked+c*NETPLAY_STATE_CHUNK<total;c++)
+				NETPLAY_SendStateChunk(p,acked+c*NETPLAY_STATE_CHUNK);
+		}
+		if (everyoneReady) return true;
+
+		Bitu before=0;
+		for (Bitu p=1;p<netplay.settings.players;p++) before+=netplay.snapshot_acked[p]+netplay.ready[p];
+		NETPLAY_Wait(20);
+		NETPLAY_Receive();
+		if (netplay.state==NETPLAY_FAILED) return false;
+		Bitu after=0;
+		for (Bitu p=1;p<netplay.settings.players;p++) after+=netplay.snapshot_acked[p]+netplay.ready[p];
+
+		Bitu now=NETPLAY_Now();
+		if (after!=before) lastProgress=now;
+		if (netplay.interrupted) { NETPLAY_Fail("netplay was cancelled"); return false; }
+		if (now-lastProgress>NETPLAY_TIMEOUT) { NETPLAY_Fail("a player stopped responding"); return false; }
+	}
+}
+
+// waits for the rest of the snapshot, once the host has started sending it
+static bool NETPLAY_AwaitState(void) {
+	Bitu lastProgress=NETPLAY_Now();
+	while (netplay.snapshot_received<netplay.snapshot.size()) {
+		Bitu before=netplay.snapshot_received;
+		NETPLAY_Wait(20);
+		NETPLAY_Receive();
+		if (netplay.state==NETPLAY_FAILED) return false;
+
+		Bitu now=NETPLAY_Now();
+		if (netplay.snapshot_received!=before) lastProgress=now;
+		if (netplay.interrupted) { NETPLAY_Fail("netplay was cancelled"); return false; }
+		if (now-lastProgress>NETPLAY_TIMEOUT) { NETPLAY_Fail("the host stopped responding"); return false; }
+	}
+	return true;
+}
+
+
+/* Playing in lockstep */
+
+static void NETPLAY_Apply(const NetplayEvent& event) {
+	// goes back through the input handlers, which will let it through while we're injecting
+	REPLAY_ApplyInput(event.type,event.which,event.flag,event.code,
+					  event.values[0],event.values[1],event.values[2],event.values[3]);
+}
+
+static void NETPLAY_HashState(Bitu frame) {
+	Bit32u hash=2166136261u;
+	hash=NETPLAY_Hash(hash,&cpu_regs,sizeof(cpu_regs));
+	hash=NETPLAY_Hash(hash,&PIC_Ticks,sizeof(PIC_Ticks));
+
+	// a different slice of main memory each time, to keep the cost down
+	Bitu slices=MEM_TotalPages()*MEM_PAGESIZE/NETPLAY_HASH_SLICE;
+	if (slices) {
+		Bitu slice=(frame/netplay.settings.hash_interval)%slices;
+		hash=NETPLAY_Hash(hash,MemBase+slice*NETPLAY_HASH_SLICE,NETPLAY_HASH_SLICE);
+	}
+
+	Bitu oldest=0;
+	for (Bitu h=1;h<NETPLAY_HASH_HISTORY;h++) {
+		if (netplay.hash_frames[h]<netplay.hash_frames[oldest]) oldest=h;
+	}
+	netplay.hash_frames[oldest]=frame;
+	netplay.hashes[oldest]=hash;
+}
+
+// forgets frames that have been applied here and that nobody needs us to send them any more
+static void NETPLAY_Prune(void) {
+	for (Bitu o=0;o<netplay.settings.players;o++) {
+		Bitu keepFrom=netplay.frame+1;
+		if (netplay.hosting) {
+			for (Bitu p=1;p<netplay.settings.players;p++) {
+				if (p!=o && netplay.acked[p][o]<keepFrom) keepFrom=netplay.acked[p][o];
+			}
+		} else if (o==netplay.me && netplay.acked[0][o]<keepFrom) {
+			keepFrom=netplay.acked[0][o];
+		}
+		std::map<Bitu,NetplayFrame>& frames=netplay.frames[o];
+		frames.erase(frames.begin(),frames.lower_bound(keepFrom));
+	}
+}
+
+static bool NETPLAY_HaveFrame(Bitu frame) {
+	for (Bitu p=0;p<netplay.settings.players;p++) {
+		if (netplay.received[p]<=frame) return false;
+	}
+	return true;
+}
+
+// runs at the start of every emulated millisecond while playing in lockstep
+static void NETPLAY_Tick(void) {
+	Bitu elapsed=PIC_Ticks-netplay.start_tick;
+	if (elapsed%netplay.settings.frame_ms) return;
+	Bitu frame=elapsed/netplay.settings.frame_ms;
+
+	// the input that arrived during the previous frame is due a few frames from now
+	Bitu sealed=frame-1+netplay.settings.delay;
+	if (netplay.received[netplay.me]==sealed) {
+		if (!netplay.pending.empty()) netplay.frames[netplay.me][sealed].swap(netplay.pending);
+		netplay.pending.clear();
+		netplay.received[netplay.me]=sealed+1;
+	}
+	NETPLAY_Receive();
+	if (netplay.state!=NETPLAY_RUNNING) return;
+	NETPLAY_SendAllInput();
+
+	// wait for everyone else's input for this frame
+	if (!NETPLAY_HaveFrame(frame)) {
+		Bitu started=NETPLAY_Now();
+		Bitu lastHeard=started;
+		while (!NETPLAY_HaveFrame(frame)) {
+			NETPLAY_Wait(netplay.settings.frame_ms);
+			Bitu before=0;
+			for (Bitu p=0;p<netplay.settings.players;p++) before+=netplay.received[p];
+			NETPLAY_Receive();
+			if (netplay.state!=NETPLAY_RUNNING) return;
+			Bitu after=0;
+			for (Bitu p=0;p<netplay.settings.players;p++) after+=netplay.received[p];
+
+			Bitu now=NETPLAY_Now();
+			if (after!=before) lastHeard=now;
+			if (now-netplay.last_sent>=netplay.settings.frame_ms) NETPLAY_SendAllInput();
+			if (netplay.interrupted) { NETPLAY_Fail("netplay was cancelled"); return; }
+			Bitu timeout=netplay.heard_input ? NETPLAY_TIMEOUT : NETPLAY_START_TIMEOUT;
+			if (now-lastHeard>timeout) { NETPLAY_Fail("another player stopped responding"); return; }
+		}
+		netplay.stall_ms+=NETPLAY_Now()-started;
+	}
+
+	// apply everyone's input in the same order on every machine
+	netplay.injecting=true;
+	for (Bitu p=0;p<netplay.settings.players;p++) {
+		std::map<Bitu,NetplayFrame>::const_iterator found=netplay.frames[p].find(frame);
+		if (found==netplay.frames[p].end()) continue;
+		for (Bitu e=0;e<found->second.size();e++) NETPLAY_Apply(found->second[e]);
+	}
+	netplay.injecting=false;
+	netplay.frame=frame;
+
+	if (frame%netplay.settings.hash_interval==0) NETPLAY_HashState(frame);
+	NETPLAY_Prune();
+}
+
+static void NETPLAY_BeginLockstep(void) {
+	netplay.start_tick=PIC_Ticks;
+	netplay.frame=0;
+	netplay.heard_input=false;
+	netplay.pending.clear();
+	for (Bitu p=0;p<NETPLAY_MAX_PLAYERS;p++) {
+		netplay.frames[p].clear();
+		// every frame before the first delayed one is empty
+		netplay.received[p]=netplay.settings.delay;
+		for (Bitu o=0;o<NETPLAY_MAX_PLAYERS;o++) netplay.acked[p][o]=netplay.settings.delay;
+	}
+	for (Bitu h=0;h<NETPLAY_HASH_HISTORY;h++) { netplay.hash_frames[h]=0; netplay.hashes[h]=0; }
+	netplay.stall_ms=0;
+	netplay.last_sent=0;
+
+	std::string().swap(netplay.snapshot);
+	netplay.state=NETPLAY_RUNNING;
+	REPLAY_SetNetplayActive(true);
+	TIMER_AddTickHandler(NETPLAY_Tick);
+}
+
+
+/* Starting and stopping */
+
+static bool NETPLAY_OpenSocket(Bit16u port) {
+	netplay.socket=socket(AF_INET,SOCK_DGRAM,IPPROTO_UDP);
+	if (netplay.socket<0) return false;
+
+	struct sockaddr_in addr;
+	memset(&addr,0,sizeof(addr));
+	addr.sin_len=sizeof(addr);
+	addr.sin_family=AF_INET;
+	addr.sin_addr.s_addr=htonl(INADDR_ANY);
+	addr.sin_port=htons(port);
+	if (bind(netplay.socket,(struct sockaddr *)&addr,sizeof(addr))<0 ||
+		fcntl(netplay.socket,F_SETFL,fcntl(netplay.socket,F_GETFL)|O_NONBLOCK)<0) {
+		LOG_MSG("NETPLAY: %s",strerror(errno));
+		close(netplay.socket);
+		netplay.socket_open=false;
+		return false;
+	}
+	return true;
+}
+
+static void NETPLAY_Reset(const char * build) {
+	NETPLAY_Stop();
+	netplay.hosting=false;
+	netplay.injecting=false;
+	netplay.interrupted=false;
+	netplay.build=build;
+	netplay.build_hash=NETPLAY_Hash(2166136261u,build,strlen(build));
+	netplay.failure.clear();
+	netplay.me=0;
+	netplay.joined=1;
+	netplay.welcomed=false;
+	netplay.snapshot.clear();
+	netplay.snapshot_received=0;
+	for (Bitu p=0;p<NETPLAY_MAX_PLAYERS;p++) {
+		netplay.snapshot_acked[p]=0;
+		netplay.ready[p]=false;
+		netplay.last_heard[p]=0;
+	}
+}
+
+bool NETPLAY_Host(Bit16u port,const NetplaySettings& settings,const char * build) {
+	NETPLAY_Reset(build);
+	if (settings.players<2 || settings.players>NETPLAY_MAX_PLAYERS || !settings.frame_ms || !settings.delay || !settings.hash_interval)
+		return false;
+	if (!NETPLAY_OpenSocket(port)) return false;
+	netplay.settings=settings;
+	netplay.hosting=true;
+	netplay.state=NETPLAY_WAITING;
+	return true;
+}
+
+bool NETPLAY_Join(const char * host,Bit16u port,const char * build) {
+	NETPLAY_Reset(build);
+
+	struct addrinfo hints,* result=0;
+	memset(&hints,0,sizeof(hints));
+	hints.ai_family=AF_INET;
+	hints.ai_socktype=SOCK_DGRAM;
+	if (getaddrinfo(host,NULL,&hints,&result) || !result) return false;
+	memcpy(&netplay.addrs[0],result->ai_addr,sizeof(netplay.addrs[0]));
+	netplay.addrs[0].sin_port=htons(port);
+	freeaddrinfo(result);
+
+	if (!NETPLAY_OpenSocket(0)) return false;
+	netplay.state=NETPLAY_WAITING;
+	return true;
+}
+
+void NETPLAY_Stop(void) {
+	if (netplay.state==NETPLAY_RUNNING) {
+		TIMER_DelTickHandler(NETPLAY_Tick);
+		REPLAY_SetNetplayActive(false);
+	}
+	if (netplay.socket_open) {
+		// let everyone else know straight away, rather than leaving them to time out
+		if (netplay.state==NETPLAY_RUNNING || netplay.state==NETPLAY_WAITING) {
+			if (netplay.hosting) {
+				for (Bitu p=1;p<netplay.joined;p++) NETPLAY_SendBye(netplay.addrs[p],NETPLAY_BYE_LEFT);
+			} else {
+				NETPLAY_SendBye(netplay.addrs[0],NETPLAY_BYE_LEFT);
+			}
+		}
+		close(netplay.socket);
+		netplay.socket_open=false;
+	}
+	for (Bitu p=0;p<NETPLAY_MAX_PLAYERS;p++) netplay.frames[p].clear();
+	std::string().swap(netplay.snapshot);
+	netplay.pending.clear();
+	if (netplay.state!=NETPLAY_FAILED) netplay.state=NETPLAY_INACTIVE;
+}
+
+static void NETPLAY_Fail(const char * reason) {
+	LOG_MSG("NETPLAY: stopping because %s",reason);
+	// don't send a goodbye to anyone if we're the one being left
+	if (netplay.state==NETPLAY_RUNNING) {
+		TIMER_DelTickHandler(NETPLAY_Tick);
+		REPLAY_SetNetplayActive(false);
+	}
+	netplay.state=NETPLAY_FAILED;
+	netplay.failure=reason;
+	netplay.injecting=false;
+	if (netplay.socket_open) {
+		if (netplay.hosting) {
+			for (Bitu p=1;p<netplay.joined;p++) NETPLAY_SendBye(netplay.addrs[p],NETPLAY_BYE_LEFT);
+		}
+		close(netplay.socket);
+		netplay.socket_open=false;
+	}
+}
+
+bool NETPLAY_Poll(void) {
+	if (netplay.state!=NETPLAY_WAITING) return false;
+	if (netplay.interrupted) {
+		NETPLAY_Fail("netplay was cancelled");
+		return false;
+	}
+
+	NETPLAY_Receive();
+	if (netplay.state!=NETPLAY_WAITING) return false;
+
+	if (netplay.hosting) {
+		if (netplay.joined<netplay.settings.players) return false;
+
+		// everyone's here: snapshot the machine and send it to them
+		std::ostringstream stream;
+		if (!SAVESTATE_Save(stream,netplay.build.c_str())) {
+			NETPLAY_Fail("the machine could not be snapshotted");
+			return false;
+		}
+		netplay.snapshot=stream.str();
+		if (!NETPLAY_SendState()) return false;
+		NETPLAY_BeginLockstep();
+		return true;
+	} else {
+		if (!netplay.welcomed) {
+			Bitu now=NETPLAY_Now();
+			if (now-netplay.last_sent>=NETPLAY_JOIN_INTERVAL) {
+				NetplayWriter packet(NETPLAY_JOIN);
+				packet.put32(netplay.build_hash);
+				NETPLAY_Send(0,packet);
+				netplay.last_sent=now;
+			}
+			return false;
+		}
+		// the host starts sending the snapshot once everyone has joined
+		if (netplay.snapshot.empty()) return false;
+		if (!NETPLAY_AwaitState()) return false;
+
+		std::istringstream stream(netplay.snapshot);
+		std::string reason;
+		SaveStateResult loaded=SAVESTATE_Load(stream,netplay.build.c_str(),reason);
+		if (loaded!=SAVESTATE_OK) {
+			LOG_MSG("NETPLAY: could not restore the host's snapshot: %s",reason.c_str());
+			NETPLAY_Fail("the host's machine could not be restored");
+			return false;
+		}
+		NETPLAY_BeginLockstep();
+		NetplayWriter packet(NETPLAY_READY);
+		NETPLAY_Send(0,packet);
+		return true;
+	}
+}
+
+void NETPLAY_Interrupt(void) {
+	netplay.interrupted=true;
+}
+
+NetplayState NETPLAY_State(void) {
+	return netplay.state;
+}
+
+const NetplaySettings& NETPLAY_Settings(void) {
+	return netplay.settings;
+}
+
+Bitu NETPLAY_PlayerIndex(void) {
+	return netplay.me;
+}
+
+Bitu NETPLAY_JoinedPlayers(void) {
+	return netplay.hosting ? netplay.joined : (netplay.welcomed ? netplay.settings.players : 0);
+}
+
+const char * NETPLAY_FailureReason(void) {
+	return netplay.failure.c_str();
+}
+
+Bitu NETPLAY_StallTime(void) {
+	return netplay.stall_ms;
+}
+
+bool NETPLAY_HandleInput(Bit8u type,Bit8u which,Bit8u flag,Bit32u code,float v0,float v1,float v2,float v3) {
+	if (netplay.state!=NETPLAY_RUNNING || netplay.injecting) return true;
+	NetplayEvent event;
+	event.type=type;
+	event.which=which;
+	event.flag=flag;
+	event.code=code;
+	event.values[0]=v0;
+	event.values[1]=v1;
+	event.values[2]=v2;
+	event.values[3]=v3;
+	netplay.pending.push_back(event);
+	return false;
+}
+
+#else
+
+bool NETPLAY_Host(Bit16u /*port*/,const NetplaySettings& /*settings*/,const char * /*build*/) { return false; }
+bool NETPLAY_Join(const char * /*host*/,Bit16u /*port*/,const char * /*build*/) { return false; }
+void NETPLAY_Stop(void) {}
+bool NETPLAY_Poll(void) { return false; }
+void NETPLAY_Interrupt(void) {}
+NetplayState NETPLAY_State(void) { return NETPLAY_INACTIVE; }
+const NetplaySettings& NETPLAY_Settings(void) { static NetplaySettings settings; return settings; }
+Bitu NETPLAY_PlayerIndex(void) { return 0; }
+Bitu NETPLAY_JoinedPlayers(void) { return 0; }
+const char * NETPLAY_FailureReason(void) { return ""; }
+Bitu NETPLAY_StallTime(void) { return 0; }
+bool NETPLAY_HandleInput(Bit8u,Bit8u,Bit8u,Bit32u,float,float,float,float) { return true; }
+
+#endif
+//--End of modifications
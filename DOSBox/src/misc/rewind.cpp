@@ -0,0 +1,316 @@
+/*
+ *  Copyright (C) 2002-2010  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+//--Added to let the emulated machine be wound back to recent points in time: see rewind.h.
+//The rest of the machine's state is diffed in fixed-size chunks against the previous frame's,
+//which keeps frames small without the save state components needing to track changes themselves.
+//A frame is rebuilt by starting from the keyframe before it and applying each frame in turn.
+
+#include <string.h>
+#include <sstream>
+#include <deque>
+#include <vector>
+#include "dosbox.h"
+#include "mem.h"
+#include "rewind.h"
+
+#if !defined(WIN32)
+
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define REWIND_BUILD		"rewind"
+#define REWIND_CHUNK_SIZE	4096
+
+struct RewindFrame {
+	bool keyframe;
+	Bitu state_size;
+	std::vector<Bit32u> pages;		// the main memory pages in data, for frames that are not keyframes
+	std::vector<Bit32u> chunks;		// the state chunks in data, after the pages
+	std::vector<Bit8u> data;
+};
+
+static struct {
+	HostPt base;
+	Bitu size;
+	Bitu page_size;
+	Bitu budget;
+	Bitu keyframe_interval;
+	Bitu since_keyframe;
+	Bitu used;
+	std::deque<RewindFrame *> frames;
+	std::string state;					// the newest frame's state, to diff the next one against
+
+	// written by the fault handler, so sized up front
+	std::vector<Bit8u> dirty;
+	std::vector<Bit32u> dirty_pages;
+	volatile Bitu dirty_count;
+
+	struct sigaction previous_segv;
+	struct sigaction previous_bus;
+} history;
+
+static void REWIND_FaultHandler(int sig,siginfo_t * info,void * context) {
+	HostPt address=(HostPt)info->si_addr;
+	if (history.base && address>=history.base && address<history.base+history.size) {
+		Bitu page=(Bitu)(address-history.base)/history.page_size;
+		if (!history.dirty[page]) {
+			history.dirty[page]=1;
+			history.dirty_pages[history.dirty_count++]=(Bit32u)page;
+		}
+		mprotect(history.base+page*history.page_size,history.page_size,PROT_READ|PROT_WRITE);
+		return;
+	}
+	// not ours: pass it on, or let it fault again with the default behaviour
+	struct sigaction * previous=(sig==SIGBUS) ? &history.previous_bus : &history.previous_segv;
+	if (previous->sa_flags & SA_SIGINFO) {
+		if (previous->sa_sigaction) {
+			previous->sa_sigaction(sig,info,context);
+			return;
+		}
+	} else if (previous->sa_handler!=SIG_DFL && previous->sa_handler!=SIG_IGN) {
+		previous->sa_handler(sig);
+		return;
+	}
+	signal(sig,SIG_DFL);
+}
+
+static void REWIND_Protect(void) {
+	for (Bitu i=0;i<history.dirty_count;i++) history.dirty[history.dirty_pages[i]]=0;
+	history.dirty_count=0;
+	mprotect(history.base,history.size,PROT_READ);
+}
+
+static Bitu REWIND_FrameSize(const RewindFrame * frame) {
+	return sizeof(RewindFrame)+frame->data.capacity()+
+		(frame->pages.capacity()+frame->chunks.capacity())*sizeof(Bit32u);
+}
+
+static void REWIND_DropOldest(void) {
+	RewindFrame * frame=history.frames.front();
+	history.used-=REWIND_FrameSize(frame);
+	history.frames.pop_front();
+	delete frame;
+}
+
+static void REWIND_DropNewest(void) {
+	RewindFrame * frame=history.frames.back();
+	history.used-=REWIND_FrameSize(frame);
+	history.frames.pop_back();
+	delete frame;
+}
+
+// drops the oldest keyframe and the frames that depend on it, for as long as there is another
+static void REWIND_Trim(void) {
+	while (history.used>history.budget) {
+		Bitu next=1;
+		while (next<history.frames.size() && !history.frames[next]->keyframe) next++;
+		if (next>=history.frames.size()) break;
+		for (Bitu i=0;i<next;i++) REWIND_DropOldest();
+	}
+}
+
+static void REWIND_ApplyFrame(const RewindFrame * frame,HostPt memory,std::string& state) {
+	const Bit8u * data=frame->data.empty() ? 0 : &frame->data[0];
+	if (frame->keyframe) {
+		memcpy(memory,data,history.size);
+		state.assign((const char *)data+history.size,frame->state_size);
+		return;
+	}
+	for (Bitu i=0;i<frame->pages.size();i++) {
+		memcpy(memory+frame->pages[i]*history.page_size,data,history.page_size);
+		data+=history.page_size;
+	}
+	state.resize(frame->state_size);
+	for (Bitu i=0;i<frame->chunks.size();i++) {
+		Bitu offset=frame->chunks[i]*REWIND_CHUNK_SIZE;
+		Bitu length=frame->state_size-offset;
+		if (length>REWIND_CHUNK_SIZE) length=REWIND_CHUNK_SIZE;
+		memcpy(&state[offset],data,length);
+		data+=length;
+	}
+}
+
+bool REWIND_Start(Bitu budget,Bitu keyframe_interval) {
+	REWIND_Stop();
+	HostPt base=GetMemBase();
+	Bitu size=MEM_TotalPages()*MEM_PAGESIZE;
+	Bitu page_size=(Bitu)getpagesize();
+	if (!base || !size || ((Bitu)base % page_size) || (size % page_size)) return false;
+
+	struct sigaction action;
+	memset(&action,0,sizeof(action));
+	action.sa_sigaction=REWIND_FaultHandler;
+	action.sa_flags=SA_SIGINFO|SA_RESTART;
+	sigemptyset(&action.sa_mask);
+	if (sigaction(SIGSEGV,&action,&history.previous_segv)!=0) return false;
+	if (sigaction(SIGBUS,&action,&history.previous_bus)!=0) {
+		sigaction(SIGSEGV,&history.previous_segv,0);
+		return false;
+	}
+
+	history.base=base;
+	history.size=size;
+	history.page_size=page_size;
+	history.budget=budget;
+	history.keyframe_interval=keyframe_interval ? keyframe_interval : 1;
+	history.since_keyframe=0;
+	history.used=0;
+	history.state.clear();
+	history.dirty.assign(size/page_size,0);
+	history.dirty_pages.assign(size/page_size,0);
+	history.dirty_count=0;
+	REWIND_Protect();
+	return true;
+}
+
+void REWIND_Stop(void) {
+	if (!history.base) return;
+	mprotect(history.base,history.size,PROT_READ|PROT_WRITE);
+	sigaction(SIGSEGV,&history.previous_segv,0);
+	sigaction(SIGBUS,&history.previous_bus,0);
+	REWIND_Clear();
+	history.base=0;
+	std::vector<Bit8u>().swap(history.dirty);
+	std::vector<Bit32u>().swap(history.dirty_pages);
+	history.dirty_count=0;
+}
+
+bool REWIND_IsActive(void) {
+	return history.base!=0;
+}
+
+void REWIND_Clear(void) {
+	while (!history.frames.empty()) REWIND_DropOldest();
+	history.used=0;
+	std::string().swap(history.state);
+}
+
+void REWIND_Shrink(Bitu budget) {
+	Bitu started_budget=history.budget;
+	history.budget=budget;
+	REWIND_Trim();
+	history.budget=started_budget;
+}
+
+bool REWIND_Capture(void) {
+	if (!history.base) return false;
+
+	std::ostringstream stream;
+	SAVESTATE_SetMainMemoryExcluded(true);
+	bool saved=SAVESTATE_Save(stream,REWIND_BUILD);
+	SAVESTATE_SetMainMemoryExcluded(false);
+	if (!saved) return false;
+	std::string state=stream.str();
+
+	RewindFrame * frame=new RewindFrame;
+	frame->state_size=state.size();
+	frame->keyframe=history.frames.empty() || history.since_keyframe+1>=history.keyframe_interval;
+	if (frame->keyframe) {
+		frame->data.resize(history.size+state.size());
+		memcpy(&frame->data[0],history.base,history.size);
+		if (!state.empty()) memcpy(&frame->data[history.size],state.data(),state.size());
+		history.since_keyframe=0;
+	} else {
+		Bitu length=0;
+		frame->pages.assign(history.dirty_pages.begin(),history.dirty_pages.begin()+history.dirty_count);
+		length+=frame->pages.size()*history.page_size;
+		for (Bitu offset=0;offset<state.size();offset+=REWIND_CHUNK_SIZE) {
+			Bitu chunk_length=state.size()-offset;
+			if (chunk_length>REWIND_CHUNK_SIZE) chunk_length=REWIND_CHUNK_SIZE;
+			if (offset+chunk_length<=history.state.size() &&
+				!memcmp(state.data()+offset,history.state.data()+offset,chunk_length)) continue;
+			frame->chunks.push_back((Bit32u)(offset/REWIND_CHUNK_SIZE));
+			length+=chunk_length;
+		}
+		frame->data.resize(length);
+		Bit8u * data=length ? &frame->data[0] : 0;
+		for (Bitu i=0;i<frame->pages.size();i++) {
+			memcpy(data,history.base+frame->pages[i]*history.page_size,history.page_size);
+			data+=history.page_size;
+		}
+		for (Bitu i=0;i<frame->chunks.size();i++) {
+			Bitu offset=frame->chunks[i]*REWIND_CHUNK_SIZE;
+			Bitu chunk_length=state.size()-offset;
+			if (chunk_length>REWIND_CHUNK_SIZE) chunk_length=REWIND_CHUNK_SIZE;
+			memcpy(data,state.data()+offset,chunk_length);
+			data+=chunk_length;
+		}
+		history.since_keyframe++;
+	}
+	history.frames.push_back(frame);
+	history.used+=REWIND_FrameSize(frame);
+	history.state.swap(state);
+	REWIND_Protect();
+	REWIND_Trim();
+	return true;
+}
+
+SaveStateResult REWIND_Restore(Bitu age,std::string& reason) {
+	if (!history.base || age>=history.frames.size()) {
+		reason="the rewind history does not go back that far";
+		return SAVESTATE_INCOMPATIBLE;
+	}
+	Bitu target=history.frames.size()-1-age;
+	Bitu key=target;
+	while (key>0 && !history.frames[key]->keyframe) key--;
+
+	std::vector<Bit8u> memory(history.size);
+	std::string state;
+	for (Bitu i=key;i<=target;i++) REWIND_ApplyFrame(history.frames[i],&memory[0],state);
+
+	std::istringstream stream(state);
+	SAVESTATE_SetMainMemoryExcluded(true);
+	SaveStateResult result=SAVESTATE_Load(stream,REWIND_BUILD,reason);
+	SAVESTATE_SetMainMemoryExcluded(false);
+	if (result!=SAVESTATE_OK) return result;
+
+	mprotect(history.base,history.size,PROT_READ|PROT_WRITE);
+	memcpy(history.base,&memory[0],history.size);
+	while (history.frames.size()>target+1) REWIND_DropNewest();
+	history.since_keyframe=target-key;
+	history.state.swap(state);
+	REWIND_Protect();
+	return SAVESTATE_OK;
+}
+
+Bitu REWIND_FrameCount(void) {
+	return history.frames.size();
+}
+
+Bitu REWIND_MemoryUsed(void) {
+	return history.used;
+}
+
+#else
+
+bool REWIND_Start(Bitu /*budget*/,Bitu /*keyframe_interval*/) { return false; }
+void REWIND_Stop(void) {}
+bool REWIND_IsActive(void) { return false; }
+void REWIND_Clear(void) {}
+void REWIND_Shrink(Bitu /*budget*/) {}
+bool REWIND_Capture(void) { return false; }
+SaveStateResult REWIND_Restore(Bitu /*age*/,std::string& reason) {
+	reason="rewinding is not available on this platform";
+	return SAVESTATE_INCOMPATIBLE;
+}
+Bitu REWIND_FrameCount(void) { return 0; }
+Bitu REWIND_MemoryUsed(void) { return 0; }
+
+#endif
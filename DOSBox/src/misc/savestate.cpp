@@ -0,0 +1,208 @@
+/*
+ *  Copyright (C) 2002-2010  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+//--Added to snapshot and restore the whole emulated machine: see savestate.h.
+//Loading is done in two passes: the header and component list are checked against the
+//running machine before anything is touched, so that an incompatible snapshot leaves the
+//machine as it was. Each component's state is followed by a marker, so that a component
+//which reads more or less than it wrote is caught before the next component goes astray.
+
+#include <string.h>
+#include <stdint.h>
+#include <vector>
+#include "dosbox.h"
+#include "savestate.h"
+#include "cpu.h"
+#include "mem.h"
+
+#define SAVESTATE_MAGIC		0x53534244	// 'DBSS'
+#define SAVESTATE_VERSION	2
+#define SAVESTATE_MARKER	0x444e4521	// '!END'
+
+struct SaveStateEntry {
+	std::string name;
+	SaveStateComponent * component;
+};
+
+// unregistered components leave their slot behind, so that a module which is
+// recreated after a configuration change keeps its place in the order
+static std::vector<SaveStateEntry> savestate_components;
+
+void SAVESTATE_Register(const char * name,SaveStateComponent * component) {
+	for (Bitu i=0;i<savestate_components.size();i++) {
+		if (savestate_components[i].name!=name) continue;
+		if (savestate_components[i].component) E_Exit("SAVESTATE:%s registered twice",name);
+		savestate_components[i].component=component;
+		return;
+	}
+	SaveStateEntry entry;
+	entry.name=name;
+	entry.component=component;
+	savestate_components.push_back(entry);
+}
+
+void SAVESTATE_Unregister(SaveStateComponent * component) {
+	for (Bitu i=0;i<savestate_components.size();i++) {
+		if (savestate_components[i].component==component) savestate_components[i].component=0;
+	}
+}
+
+static void SAVESTATE_ActiveComponents(std::vector<SaveStateEntry>& active) {
+	for (Bitu i=0;i<savestate_components.size();i++) {
+		if (savestate_components[i].component) active.push_back(savestate_components[i]);
+	}
+}
+
+static bool savestate_exclude_memory=false;
+
+void SAVESTATE_SetMainMemoryExcluded(bool excluded) {
+	savestate_exclude_memory=excluded;
+}
+
+bool SAVESTATE_MainMemoryExcluded(void) {
+	return savestate_exclude_memory;
+}
+
+void SAVESTATE_WriteString(std::ostream& stream,const std::string& value) {
+	Bit32u length=(Bit32u)value.size();
+	SAVESTATE_Write(stream,length);
+	stream.write(value.data(),length);
+}
+
+void SAVESTATE_ReadString(std::istream& stream,std::string& value) {
+	Bit32u length=0;
+	SAVESTATE_Read(stream,length);
+	// guard against allocating a nonsensical amount for a damaged snapshot
+	if (!stream || length>0x10000) {
+		stream.setstate(std::ios::failbit);
+		value.clear();
+		return;
+	}
+	value.resize(length);
+	if (length) stream.read(&value[0],length);
+}
+
+// any function in the executable will do as a reference point
+static INLINE Bit64s SAVESTATE_FunctionBase(void) {
+	return (Bit64s)reinterpret_cast<uintptr_t>(&SAVESTATE_Register);
+}
+
+void SAVESTATE_WriteFunction(std::ostream& stream,SaveStateFunction function) {
+	Bit8u present=(function!=0);
+	SAVESTATE_Write(stream,present);
+	if (!present) return;
+	Bit64s offset=(Bit64s)reinterpret_cast<uintptr_t>(function)-SAVESTATE_FunctionBase();
+	SAVESTATE_Write(stream,offset);
+}
+
+SaveStateFunction SAVESTATE_ReadFunction(std::istream& stream) {
+	Bit8u present=0;
+	SAVESTATE_Read(stream,present);
+	if (!present) return 0;
+	Bit64s offset=0;
+	SAVESTATE_Read(stream,offset);
+	return reinterpret_cast<SaveStateFunction>((uintptr_t)(SAVESTATE_FunctionBase()+offset));
+}
+
+bool SAVESTATE_Save(std::ostream& stream,const char * build) {
+	SAVESTATE_Write(stream,(Bit32u)SAVESTATE_MAGIC);
+	SAVESTATE_Write(stream,(Bit32u)SAVESTATE_VERSION);
+	SAVESTATE_WriteString(stream,build);
+	SAVESTATE_Write(stream,(Bit32u)machine);
+	SAVESTATE_Write(stream,(Bit32u)svgaCard);
+	SAVESTATE_Write(stream,(Bit32u)MEM_TotalPages());
+	SAVESTATE_Write(stream,(Bit32u)DOSBOX_RunMachineDepth());
+
+	std::vector<SaveStateEntry> active;
+	SAVESTATE_ActiveComponents(active);
+	Bit32u count=(Bit32u)active.size();
+	SAVESTATE_Write(stream,count);
+	for (Bitu i=0;i<count;i++) SAVESTATE_WriteString(stream,active[i].name);
+
+	for (Bitu i=0;i<count;i++) {
+		active[i].component->SaveState(stream);
+		SAVESTATE_Write(stream,(Bit32u)SAVESTATE_MARKER);
+		if (!stream) return false;
+	}
+	return true;
+}
+
+SaveStateResult SAVESTATE_Load(std::istream& stream,const char * build,std::string& reason) {
+	Bit32u magic=0,version=0,saved_machine=0,saved_svga=0,pages=0,depth=0,count=0;
+	std::string saved_build;
+	SAVESTATE_Read(stream,magic);
+	SAVESTATE_Read(stream,version);
+	if (!stream || magic!=SAVESTATE_MAGIC || version!=SAVESTATE_VERSION) {
+		reason="not a save state, or from an unsupported version";
+		return SAVESTATE_INCOMPATIBLE;
+	}
+	SAVESTATE_ReadString(stream,saved_build);
+	SAVESTATE_Read(stream,saved_machine);
+	SAVESTATE_Read(stream,saved_svga);
+	SAVESTATE_Read(stream,pages);
+	SAVESTATE_Read(stream,depth);
+	SAVESTATE_Read(stream,count);
+	if (!stream) {
+		reason="save state header is damaged";
+		return SAVESTATE_INCOMPATIBLE;
+	}
+	if (saved_build!=build) {
+		reason="save state was made by a different build";
+		return SAVESTATE_INCOMPATIBLE;
+	}
+	if (saved_machine!=(Bit32u)machine || saved_svga!=(Bit32u)svgaCard) {
+		reason="save state was made with a different machine type";
+		return SAVESTATE_INCOMPATIBLE;
+	}
+	if (pages!=MEM_TotalPages()) {
+		reason="save state was made with a different amount of memory";
+		return SAVESTATE_INCOMPATIBLE;
+	}
+	if (depth!=DOSBOX_RunMachineDepth()) {
+		reason="save state was made while the emulator was in a different state";
+		return SAVESTATE_INCOMPATIBLE;
+	}
+	std::vector<SaveStateEntry> active;
+	SAVESTATE_ActiveComponents(active);
+	if (count!=active.size()) {
+		reason="save state was made with different devices";
+		return SAVESTATE_INCOMPATIBLE;
+	}
+	for (Bitu i=0;i<count;i++) {
+		std::string name;
+		SAVESTATE_ReadString(stream,name);
+		if (!stream || name!=active[i].name) {
+			reason="save state was made with different devices";
+			return SAVESTATE_INCOMPATIBLE;
+		}
+	}
+
+	// translated code refers to the guest memory that is about to be replaced
+	CPU_FlushCodeCache();
+
+	for (Bitu i=0;i<count;i++) {
+		active[i].component->LoadState(stream);
+		Bit32u marker=0;
+		SAVESTATE_Read(stream,marker);
+		if (!stream || marker!=SAVESTATE_MARKER) {
+			reason="save state is damaged ("+active[i].name+")";
+			return SAVESTATE_DAMAGED;
+		}
+	}
+	return SAVESTATE_OK;
+}
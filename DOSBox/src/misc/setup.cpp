@@ -217,17 +217,23 @@ bool Property::CheckValue(Value const& in, bool warn){
 	return false;
 }
 
+//--Modified to hold onto the help text and only add it as a message the first time it is asked for,
+//since DOSBOX_Init sets help for every property at startup and it is rarely shown.
 void Property::Set_help(string const& in) {
-	string result = string("CONFIG_") + propname;
-	upcase(result);
-	MSG_Add(result.c_str(),in.c_str());
+	help = in;
+	help_registered = false;
 }
 
 char const* Property::Get_help() {
 	string result = string("CONFIG_") + propname;
 	upcase(result);
+	if (!help_registered) {
+		MSG_AddCopy(result.c_str(),help.c_str());
+		help_registered = true;
+	}
 	return MSG_Get(result.c_str());
 }
+//--End of modifications
 
 
 bool Prop_int::CheckValue(Value const& in, bool warn) {
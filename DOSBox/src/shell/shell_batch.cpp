@@ -37,6 +37,10 @@ BatchFile::BatchFile(DOS_Shell * host,char const * const resolved_name,char cons
 	DOS_Canonicalize(resolved_name,totalname); // Get fullname including drive specificiation
 	cmd = new CommandLine(entered_name,cmd_line);
 	filename = totalname;
+	contents_loaded = false;			//--Added
+	contents_generation = 0;			//--Added
+	contents_drive = 0;					//--Added
+	in_memory = false;					//--Added
 
 	//Test if file is openable
 	if (!DOS_OpenFile(totalname,128,&file_handle)) {
@@ -46,33 +50,81 @@ BatchFile::BatchFile(DOS_Shell * host,char const * const resolved_name,char cons
 	DOS_CloseFile(file_handle);
 }
 
+//--Added to let Boxer run a series of its own commands as a batch file held only in memory
+BatchFile::BatchFile(DOS_Shell * host,char const * const name,std::string const& lines) {
+	location = 0;
+	file_handle = 0;
+	prev=host->bf;
+	echo=host->echo;
+	shell=host;
+	cmd = new CommandLine(name,"");
+	filename = name;
+	contents = lines;
+	contents_loaded = true;
+	contents_generation = 0;
+	contents_drive = 0;
+	in_memory = true;
+}
+
+void BatchFile::AppendLines(std::string const& lines) {
+	if (in_memory) contents.append(lines);
+}
+//--End of modifications
+
 BatchFile::~BatchFile() {
 	delete cmd;
 	shell->bf=prev;
 	shell->echo=echo;
     
     //--Added 2013-09-22 by Alun Bestor to let Boxer track the lifecycle of the batch file
-    boxer_shellDidEndBatchFile(shell, filename.c_str());
+    if (!in_memory) boxer_shellDidEndBatchFile(shell, filename.c_str());
     //--End of modifications
 }
 
+//--Added to read the whole batch file into memory once, rather than reopening it and reading it
+//a byte at a time through DOS for every line. The copy is read again if any file has been written
+//to, created, deleted or renamed since, or if the batch file's drive has been swapped out, since
+//batch files may rewrite themselves (or each other) as they go.
+bool BatchFile::LoadContents(void) {
+	if (in_memory) return true;
+	DOS_Drive * drive = Drives[toupper(filename[0])-'A'];
+	if (contents_loaded && contents_generation==dos_files_generation && contents_drive==drive) return true;
+
+	if (!DOS_OpenFile(filename.c_str(),128,&file_handle)) return false;
+	contents.clear();
+	Bit8u buffer[4096];Bit16u n;
+	do {
+		n=sizeof(buffer);
+		if (!DOS_ReadFile(file_handle,buffer,&n)) break;
+		contents.append((char *)buffer,n);
+	} while (n);
+	DOS_CloseFile(file_handle);
+
+	contents_loaded = true;
+	contents_generation = dos_files_generation;
+	contents_drive = drive;
+	return true;
+}
+//--End of modifications
+
 bool BatchFile::ReadLine(char * line) {
-	//Open the batchfile and seek to stored postion
-	if (!DOS_OpenFile(filename.c_str(),128,&file_handle)) {
+	//--Modified to read the line from the copy of the batch file in memory
+	if (!LoadContents()) {
 		LOG(LOG_MISC,LOG_ERROR)("ReadLine Can't open BatchFile %s",filename.c_str());
 		delete this;
 		return false;
 	}
-	DOS_SeekFile(file_handle,&(this->location),DOS_SEEK_SET);
+	const char * data=contents.data();
+	Bit32u size=(Bit32u)contents.size();
 
-	Bit8u c=0;Bit16u n=1;
+	Bit8u c=0;bool n=true;
 	char temp[CMD_MAXLINE];
 emptyline:
 	char * cmd_write=temp;
 	do {
-		n=1;
-		DOS_ReadFile(file_handle,&c,&n);
-		if (n>0) {
+		n=(this->location<size);
+		if (n) {
+			c=data[this->location++];
 			/* Why are we filtering this ?
 			 * Exclusion list: tab for batch files 
 			 * escape for ansi
@@ -83,11 +135,11 @@ emptyline:
 	} while (c!='\n' && n);
 	*cmd_write=0;
 	if (!n && cmd_write==temp) {
-		//Close file and delete bat file
-		DOS_CloseFile(file_handle);
+		//Delete bat file
 		delete this;
 		return false;	
 	}
+	//--End of modifications
 	if (!strlen(temp)) goto emptyline;
 	if (temp[0]==':') goto emptyline;
 
@@ -143,36 +195,36 @@ emptyline:
 		}
 	}
 	*cmd_write=0;
-	//Store current location and close bat file
-	this->location = 0;
-	DOS_SeekFile(file_handle,&(this->location),DOS_SEEK_CUR);
-	DOS_CloseFile(file_handle);
 	return true;	
 }
 
 bool BatchFile::Goto(char * where) {
-	//Open bat file and search for the where string
-	if (!DOS_OpenFile(filename.c_str(),128,&file_handle)) {
+	//--Modified to search the copy of the batch file in memory for the where string
+	if (!LoadContents()) {
 		LOG(LOG_MISC,LOG_ERROR)("SHELL:Goto Can't open BatchFile %s",filename.c_str());
 		delete this;
 		return false;
 	}
+	const char * data=contents.data();
+	Bit32u size=(Bit32u)contents.size();
+	Bit32u pos=0;
 
 	char cmd_buffer[CMD_MAXLINE];
 	char * cmd_write;
 
 	/* Scan till we have a match or return false */
-	Bit8u c;Bit16u n;
+	Bit8u c=0;bool n;
 again:
 	cmd_write=cmd_buffer;
 	do {
-		n=1;
-		DOS_ReadFile(file_handle,&c,&n);
-		if (n>0) {
+		n=(pos<size);
+		if (n) {
+			c=data[pos++];
 			if (c>31)
 				*cmd_write++=c;
 		}
 	} while (c!='\n' && n);
+	//--End of modifications
 	*cmd_write++ = 0;
 	char *nospace = trim(cmd_buffer);
 	if (nospace[0] == ':') {
@@ -189,15 +241,12 @@ again:
 		*nospace = 0;
 		if (strcasecmp(beginlabel,where)==0) {
 		//Found it! Store location and continue
-			this->location = 0;
-			DOS_SeekFile(file_handle,&(this->location),DOS_SEEK_CUR);
-			DOS_CloseFile(file_handle);
+			this->location = pos;	//--Modified
 			return true;
 		}
 	   
 	}
 	if (!n) {
-		DOS_CloseFile(file_handle);
 		delete this;
 		return false;	
 	}
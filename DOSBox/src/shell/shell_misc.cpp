@@ -477,7 +477,9 @@ bool DOS_Shell::Execute(char * name,char * args) {
 	{	/* Run the .bat file */
 		/* delete old batch file if call is not active*/
 		bool temp_echo=echo; /*keep the current echostate (as delete bf might change it )*/
-		if(bf && !call) delete bf;
+		//--Modified to keep Boxer's in-memory batch file around until it has run the rest of its lines
+		if(bf && !call && !bf->in_memory) delete bf;
+		//--End of modifications
 		
 		//--Added 2010-01-21 by Alun Bestor to let Boxer track the launched batch file
 		boxer_shellWillBeginBatchFile(this, canonicalPath, args);
@@ -0,0 +1,107 @@
+/*
+ *  Copyright (c) 2013, Alun Bestor (alun.bestor@gmail.com)
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without modification,
+ *  are permitted provided that the following conditions are met:
+ *
+ *		Redistributions of source code must retain the above copyright notice, this
+ *	    list of conditions and the following disclaimer.
+ *
+ *		Redistributions in binary form must reproduce the above copyright notice,
+ *	    this list of conditions and the following disclaimer in the documentation
+ *      and/or other materials provided with the distribution.
+ *
+ *	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ *	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ *	WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ *	IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ *	INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *	BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ *	OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ *	WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *	POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+//ADBBulkDirectoryWalker walks a directory tree using getattrlistbulk(), which reads the names
+//and attributes of a whole directory's worth of entries per call instead of one stat() per file.
+//Directories are read concurrently by a pool of workers: each worker keeps its own stack of
+//directories still to read, and takes from the bottom of another worker's stack when its own
+//runs dry. This keeps many reads in flight at once, which is what matters most on network volumes
+//where each read is a round trip.
+
+//Entries are handed to the caller as plain C structs, so that the caller can reject most of them
+//without ever creating an NSString or NSURL. getattrlistbulk() is only available from OS X 10.10:
+//check +isAvailable and fall back on NSDirectoryEnumerator if it returns NO.
+
+
+#import <Foundation/Foundation.h>
+#import <sys/attr.h>
+
+
+#pragma mark - Constants
+
+typedef struct {
+    const char *name;           //The filename of the entry.
+    const char *parentPath;     //The path of the entry's directory relative to the root of the walk,
+                                //without a trailing slash: an empty string for the root itself.
+    NSUInteger depth;           //0 for entries directly within the root, 1 for their children, etc.
+    fsobj_type_t type;          //The entry's vnode type: VREG for files, VDIR for directories, VLNK for symlinks.
+    off_t size;                 //The logical size of files. 0 for anything else.
+    struct timespec modificationTime;
+    uint64_t fileID;
+} ADBBulkDirectoryEntry;
+
+typedef NS_OPTIONS(NSUInteger, ADBBulkDirectoryWalkerResponse) {
+    //Carry on with the walk, without descending into the entry.
+    ADBBulkDirectoryWalkerContinue  = 0,
+    
+    //Queue the entry's contents to be walked. Ignored for anything but directories:
+    //symlinks to directories are never followed.
+    ADBBulkDirectoryWalkerDescend   = 1 << 0,
+    
+    //Stop the walk as soon as possible. Other workers may still deliver a few more entries.
+    ADBBulkDirectoryWalkerStop      = 1 << 1,
+};
+
+//Called for each entry found by the walk. This is called concurrently from several threads and
+//must be thread-safe. The entry and its strings are only valid for the duration of the call.
+typedef ADBBulkDirectoryWalkerResponse (^ADBBulkDirectoryWalkerHandler)(const ADBBulkDirectoryEntry *entry);
+
+
+#pragma mark - Interface declaration
+
+@interface ADBBulkDirectoryWalker : NSObject
+{
+    NSString *_path;
+    NSUInteger _maxConcurrentReads;
+    volatile int32_t _stopped;
+}
+
+//The directory whose contents will be walked.
+@property (readonly, copy, nonatomic) NSString *path;
+
+//How many directories may be read at once. Defaults to twice the number of active processors,
+//since workers spend most of their time waiting on the filesystem.
+@property (assign, nonatomic) NSUInteger maxConcurrentReads;
+
+//Whether getattrlistbulk() is available on this system.
++ (BOOL) isAvailable;
+
+//Returns the path of the specified entry relative to the root of the walk.
+//Intended for use within a handler, once an entry is known to be wanted.
++ (NSString *) relativePathForEntry: (const ADBBulkDirectoryEntry *)entry;
+
+- (id) initWithPath: (NSString *)path;
+
+//Walks the directory, calling the handler for every entry found, and returns once the walk has
+//finished or been stopped. Directories within the walk that cannot be read are skipped.
+//Returns NO and populates outError if the root directory itself could not be read.
+- (BOOL) walkWithHandler: (ADBBulkDirectoryWalkerHandler)handler error: (out NSError **)outError;
+
+//Stops a walk in progress as soon as possible. Can be called from any thread.
+- (void) stop;
+
+@end
@@ -0,0 +1,485 @@
+/*
+ *  Copyright (c) 2013, Alun Bestor (alun.bestor@gmail.com)
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without modification,
+ *  are permitted provided that the following conditions are met:
+ *
+ *		Redistributions of source code must retain the above copyright notice, this
+ *	    list of conditions and the following disclaimer.
+ *
+ *		Redistributions in binary form must reproduce the above copyright notice,
+ *	    this list of conditions and the following disclaimer in the documentation
+ *      and/or other materials provided with the distribution.
+ *
+ *	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ *	ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ *	WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ *	IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ *	INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *	BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ *	OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ *	WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *	POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import "ADBBulkDirectoryWalker.h"
+#import <dlfcn.h>
+#import <fcntl.h>
+#import <unistd.h>
+#import <pthread.h>
+#import <libkern/OSAtomic.h>
+#import <sys/param.h>
+
+
+#pragma mark - Constants
+
+//Missing from SDKs older than 10.10, along with getattrlistbulk() itself.
+#ifndef ATTR_CMN_ERROR
+#define ATTR_CMN_ERROR 0x20000000
+#endif
+
+//The size of the buffer each worker reads entries into. Each call fills as much of it as it can,
+//so a larger buffer means fewer calls (and fewer round trips on network volumes) per directory.
+#define ADBBulkDirectoryReadBufferSize (128 * 1024)
+
+//How long an idle worker waits before checking again whether the walk has been stopped.
+#define ADBBulkDirectoryIdleWaitNanoseconds (10 * NSEC_PER_MSEC)
+
+//The attributes we request for every entry. Their order in the returned buffer is fixed:
+//see ADBBulkDirectoryWalkerReadDirectory below.
+#define ADBBulkDirectoryCommonAttributes (ATTR_CMN_RETURNED_ATTRS | ATTR_CMN_NAME | ATTR_CMN_ERROR | ATTR_CMN_OBJTYPE | ATTR_CMN_MODTIME | ATTR_CMN_FILEID)
+#define ADBBulkDirectoryFileAttributes (ATTR_FILE_DATALENGTH)
+
+
+typedef int (*ADBGetAttrListBulkFunction)(int dirfd, struct attrlist *attrList, void *attrBuf, size_t attrBufSize, uint64_t options);
+
+//Looked up at runtime, since getattrlistbulk() is not present before 10.10.
+static ADBGetAttrListBulkFunction ADBGetAttrListBulk()
+{
+    static ADBGetAttrListBulkFunction function = NULL;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        function = (ADBGetAttrListBulkFunction)dlsym(RTLD_DEFAULT, "getattrlistbulk");
+    });
+    return function;
+}
+
+
+#pragma mark - Private types
+
+//A directory waiting to be read.
+typedef struct {
+    char *relativePath;     //Allocated with malloc(): freed once the directory has been read.
+    NSUInteger depth;       //The depth of the directory's own entries.
+} ADBBulkDirectoryJob;
+
+//A worker's stack of directories waiting to be read. The worker pushes and pops at the top,
+//so that it works depth-first through the directories it found itself. Idle workers steal from
+//the bottom, where the shallowest directories - and so usually the largest subtrees - are waiting.
+typedef struct {
+    pthread_mutex_t lock;
+    ADBBulkDirectoryJob *jobs;
+    NSUInteger bottom;
+    NSUInteger top;
+    NSUInteger capacity;
+} ADBBulkDirectoryStack;
+
+//The state shared by all the workers of a walk.
+typedef struct {
+    ADBGetAttrListBulkFunction getAttrListBulk;
+    const char *rootPath;
+    volatile int32_t *stopped;
+    
+    ADBBulkDirectoryStack *stacks;
+    NSUInteger numStacks;
+    
+    //How many directories are waiting to be read or being read. The walk is over once this reaches 0.
+    volatile int64_t pendingJobs;
+    
+    //Idle workers wait on this condition for more directories to be queued.
+    //The generation is bumped whenever a directory is queued or the walk ends,
+    //so that a worker can tell whether it missed a signal while it was looking for work.
+    pthread_mutex_t idleLock;
+    pthread_cond_t idleCondition;
+    uint64_t generation;
+} ADBBulkDirectoryWalk;
+
+
+#pragma mark - Work stacks
+
+static void ADBBulkDirectoryStackPush(ADBBulkDirectoryStack *stack, ADBBulkDirectoryJob job)
+{
+    pthread_mutex_lock(&stack->lock);
+    if (stack->top == stack->capacity)
+    {
+        //Reclaim the space left at the bottom by stolen jobs before growing the stack.
+        if (stack->bottom > 0)
+        {
+            memmove(stack->jobs, stack->jobs + stack->bottom, (stack->top - stack->bottom) * sizeof(ADBBulkDirectoryJob));
+            stack->top -= stack->bottom;
+            stack->bottom = 0;
+        }
+        else
+        {
+            stack->capacity = MAX(stack->capacity * 2, 64U);
+            stack->jobs = realloc(stack->jobs, stack->capacity * sizeof(ADBBulkDirectoryJob));
+        }
+    }
+    stack->jobs[stack->top++] = job;
+    pthread_mutex_unlock(&stack->lock);
+}
+
+static BOOL ADBBulkDirectoryStackTake(ADBBulkDirectoryStack *stack, ADBBulkDirectoryJob *job, BOOL fromTop)
+{
+    BOOL found = NO;
+    pthread_mutex_lock(&stack->lock);
+    if (stack->top > stack->bottom)
+    {
+        *job = (fromTop) ? stack->jobs[--stack->top] : stack->jobs[stack->bottom++];
+        if (stack->top == stack->bottom)
+            stack->top = stack->bottom = 0;
+        found = YES;
+    }
+    pthread_mutex_unlock(&stack->lock);
+    return found;
+}
+
+static void ADBBulkDirectoryWalkWakeWorkers(ADBBulkDirectoryWalk *walk)
+{
+    pthread_mutex_lock(&walk->idleLock);
+    walk->generation++;
+    pthread_cond_broadcast(&walk->idleCondition);
+    pthread_mutex_unlock(&walk->idleLock);
+}
+
+
+#pragma mark - Workers
+
+static void ADBBulkDirectoryWalkerReadDirectory(ADBBulkDirectoryWalk *walk,
+                                                NSUInteger workerIndex,
+                                                const ADBBulkDirectoryJob *job,
+                                                char *buffer,
+                                                ADBBulkDirectoryWalkerHandler handler)
+{
+    char fullPath[PATH_MAX];
+    int pathLength;
+    if (job->relativePath[0])
+        pathLength = snprintf(fullPath, sizeof(fullPath), "%s/%s", walk->rootPath, job->relativePath);
+    else
+        pathLength = snprintf(fullPath, sizeof(fullPath), "%s", walk->rootPath);
+    
+    if (pathLength < 0 || pathLength >= (int)sizeof(fullPath))
+        return;
+    
+    int directory = open(fullPath, O_RDONLY);
+    if (directory == -1)
+        return;
+    
+    struct attrlist attributes;
+    memset(&attributes, 0, sizeof(attributes));
+    attributes.bitmapcount = ATTR_BIT_MAP_COUNT;
+    attributes.commonattr = ADBBulkDirectoryCommonAttributes;
+    attributes.fileattr = ADBBulkDirectoryFileAttributes;
+    
+    while (!*walk->stopped)
+    {
+        int numEntries = walk->getAttrListBulk(directory, &attributes, buffer, ADBBulkDirectoryReadBufferSize, 0);
+        if (numEntries == -1 && errno == EINTR)
+            continue;
+    
+        //0 means we've read every entry; -1 that the rest of the directory can't be read.
+        if (numEntries <= 0)
+            break;
+    
+        char *entryStart = buffer;
+        for (int i = 0; i < numEntries && !*walk->stopped; i++)
+        {
+            //Each entry begins with its own length, then the set of attributes that were actually
+            //returned for it, then those attributes in the order of their bits: except that the
+            //error attribute always comes first. Fields aren't guaranteed to be aligned.
+            char *field = entryStart;
+            uint32_t entryLength;
+            memcpy(&entryLength, field, sizeof(entryLength));
+            field += sizeof(entryLength);
+    
+            char *nextEntry = entryStart + entryLength;
+            entryStart = nextEntry;
+    
+            attribute_set_t returned;
+            memcpy(&returned, field, sizeof(returned));
+            field += sizeof(returned);
+    
+            if (returned.commonattr & ATTR_CMN_ERROR)
+            {
+                uint32_t entryError;
+                memcpy(&entryError, field, sizeof(entryError));
+                field += sizeof(entryError);
+    
+                //Skip entries whose attributes couldn't be read.
+                if (entryError != 0)
+                    continue;
+            }
+    
+            ADBBulkDirectoryEntry entry;
+            memset(&entry, 0, sizeof(entry));
+            entry.parentPath = job->relativePath;
+            entry.depth = job->depth;
+            entry.type = VNON;
+    
+            if (returned.commonattr & ATTR_CMN_NAME)
+            {
+                attrreference_t nameReference;
+                memcpy(&nameReference, field, sizeof(nameReference));
+                entry.name = field + nameReference.attr_dataoffset;
+                field += sizeof(nameReference);
+            }
+            if (returned.commonattr & ATTR_CMN_OBJTYPE)
+            {
+                memcpy(&entry.type, field, sizeof(entry.type));
+                field += sizeof(entry.type);
+            }
+            if (returned.commonattr & ATTR_CMN_MODTIME)
+            {
+                memcpy(&entry.modificationTime, field, sizeof(entry.modificationTime));
+                field += sizeof(entry.modificationTime);
+            }
+            if (returned.commonattr & ATTR_CMN_FILEID)
+            {
+                memcpy(&entry.fileID, field, sizeof(entry.fileID));
+                field += sizeof(entry.fileID);
+            }
+            if (returned.fileattr & ATTR_FILE_DATALENGTH)
+            {
+                memcpy(&entry.size, field, sizeof(entry.size));
+                field += sizeof(entry.size);
+            }
+    
+            if (!entry.name)
+                continue;
+    
+            ADBBulkDirectoryWalkerResponse response = handler(&entry);
+    
+            if (response & ADBBulkDirectoryWalkerStop)
+            {
+                OSAtomicCompareAndSwap32Barrier(0, 1, walk->stopped);
+                ADBBulkDirectoryWalkWakeWorkers(walk);
+                break;
+            }
+    
+            if ((response & ADBBulkDirectoryWalkerDescend) && entry.type == VDIR)
+            {
+                ADBBulkDirectoryJob child;
+                child.depth = job->depth + 1;
+                if (job->relativePath[0])
+                {
+                    if (asprintf(&child.relativePath, "%s/%s", job->relativePath, entry.name) == -1)
+                        child.relativePath = NULL;
+                }
+                else
+                    child.relativePath = strdup(entry.name);
+    
+                if (child.relativePath)
+                {
+                    OSAtomicIncrement64Barrier(&walk->pendingJobs);
+                    ADBBulkDirectoryStackPush(&walk->stacks[workerIndex], child);
+                    ADBBulkDirectoryWalkWakeWorkers(walk);
+                }
+            }
+        }
+    }
+    
+    close(directory);
+}
+
+static void ADBBulkDirectoryWalkerRunWorker(ADBBulkDirectoryWalk *walk,
+                                            NSUInteger workerIndex,
+                                            ADBBulkDirectoryWalkerHandler handler)
+{
+    char *buffer = malloc(ADBBulkDirectoryReadBufferSize);
+    if (!buffer)
+        return;
+    
+    while (!*walk->stopped)
+    {
+        pthread_mutex_lock(&walk->idleLock);
+        uint64_t generation = walk->generation;
+        pthread_mutex_unlock(&walk->idleLock);
+    
+        //Work through our own directories first, then try to steal from the other workers.
+        ADBBulkDirectoryJob job;
+        BOOL foundJob = ADBBulkDirectoryStackTake(&walk->stacks[workerIndex], &job, YES);
+        for (NSUInteger i = 1; !foundJob && i < walk->numStacks; i++)
+        {
+            NSUInteger victimIndex = (workerIndex + i) % walk->numStacks;
+            foundJob = ADBBulkDirectoryStackTake(&walk->stacks[victimIndex], &job, NO);
+        }
+    
+        if (foundJob)
+        {
+            @autoreleasepool
+            {
+                ADBBulkDirectoryWalkerReadDirectory(walk, workerIndex, &job, buffer, handler);
+            }
+            free(job.relativePath);
+    
+            //Any subdirectories were queued before this, so the walk is only over
+            //once the last directory has been read.
+            if (OSAtomicDecrement64Barrier(&walk->pendingJobs) == 0)
+                ADBBulkDirectoryWalkWakeWorkers(walk);
+        }
+        else
+        {
+            pthread_mutex_lock(&walk->idleLock);
+            BOOL finished = (walk->pendingJobs == 0);
+            if (!finished && walk->generation == generation && !*walk->stopped)
+            {
+                struct timespec timeout = { 0, ADBBulkDirectoryIdleWaitNanoseconds };
+                pthread_cond_timedwait_relative_np(&walk->idleCondition, &walk->idleLock, &timeout);
+            }
+            pthread_mutex_unlock(&walk->idleLock);
+    
+            if (finished)
+                break;
+        }
+    }
+    
+    free(buffer);
+}
+
+
+#pragma mark - Implementation
+
+@interface ADBBulkDirectoryWalker ()
+@property (readwrite, copy, nonatomic) NSString *path;
+@end
+
+@implementation ADBBulkDirectoryWalker
+@synthesize path = _path;
+@synthesize maxConcurrentReads = _maxConcurrentReads;
+
++ (BOOL) isAvailable
+{
+    return ADBGetAttrListBulk() != NULL;
+}
+
++ (NSString *) relativePathForEntry: (const ADBBulkDirectoryEntry *)entry
+{
+    char relativePath[PATH_MAX];
+    int length;
+    if (entry->parentPath[0])
+        length = snprintf(relativePath, sizeof(relativePath), "%s/%s", entry->parentPath, entry->name);
+    else
+        length = snprintf(relativePath, sizeof(relativePath), "%s", entry->name);
+    
+    if (length < 0 || length >= (int)sizeof(relativePath))
+        return nil;
+    
+    return [[NSFileManager defaultManager] stringWithFileSystemRepresentation: relativePath length: length];
+}
+
+- (id) initWithPath: (NSString *)path
+{
+    if ((self = [self init]))
+    {
+        self.path = path;
+        self.maxConcurrentReads = [NSProcessInfo processInfo].activeProcessorCount * 2;
+    }
+    return self;
+}
+
+- (void) dealloc
+{
+    self.path = nil;
+    
+    [super dealloc];
+}
+
+- (void) stop
+{
+    OSAtomicCompareAndSwap32Barrier(0, 1, &_stopped);
+}
+
+- (BOOL) walkWithHandler: (ADBBulkDirectoryWalkerHandler)handler error: (out NSError **)outError
+{
+    NSAssert(self.path != nil, @"No path provided to walk.");
+    
+    ADBGetAttrListBulkFunction getAttrListBulk = ADBGetAttrListBulk();
+    if (!getAttrListBulk)
+    {
+        if (outError)
+        {
+            *outError = [NSError errorWithDomain: NSPOSIXErrorDomain
+                                            code: ENOTSUP
+                                        userInfo: @{ NSFilePathErrorKey: self.path }];
+        }
+        return NO;
+    }
+    
+    //Check up front that the root can be read, since unreadable directories
+    //within the walk are otherwise skipped silently.
+    const char *rootPath = self.path.fileSystemRepresentation;
+    int root = open(rootPath, O_RDONLY);
+    if (root == -1)
+    {
+        if (outError)
+        {
+            *outError = [NSError errorWithDomain: NSPOSIXErrorDomain
+                                            code: errno
+                                        userInfo: @{ NSFilePathErrorKey: self.path }];
+        }
+        return NO;
+    }
+    close(root);
+    
+    _stopped = 0;
+    
+    ADBBulkDirectoryWalk walk;
+    memset(&walk, 0, sizeof(walk));
+    walk.getAttrListBulk = getAttrListBulk;
+    walk.rootPath = rootPath;
+    walk.stopped = &_stopped;
+    walk.numStacks = MAX(self.maxConcurrentReads, 1U);
+    walk.stacks = calloc(walk.numStacks, sizeof(ADBBulkDirectoryStack));
+    pthread_mutex_init(&walk.idleLock, NULL);
+    pthread_cond_init(&walk.idleCondition, NULL);
+    
+    for (NSUInteger i = 0; i < walk.numStacks; i++)
+        pthread_mutex_init(&walk.stacks[i].lock, NULL);
+    
+    ADBBulkDirectoryJob rootJob = { strdup(""), 0 };
+    walk.pendingJobs = 1;
+    ADBBulkDirectoryStackPush(&walk.stacks[0], rootJob);
+    
+    //The workers spend most of their time blocked on the filesystem, so they're dispatched
+    //separately rather than with dispatch_apply(), which would limit them to one per processor.
+    ADBBulkDirectoryWalk *sharedWalk = &walk;
+    dispatch_group_t workers = dispatch_group_create();
+    dispatch_queue_t queue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+    for (NSUInteger i = 0; i < walk.numStacks; i++)
+    {
+        dispatch_group_async(workers, queue, ^{
+            ADBBulkDirectoryWalkerRunWorker(sharedWalk, i, handler);
+        });
+    }
+    dispatch_group_wait(workers, DISPATCH_TIME_FOREVER);
+    dispatch_release(workers);
+    
+    //Clean up any directories left unread if the walk was stopped.
+    for (NSUInteger i = 0; i < walk.numStacks; i++)
+    {
+        ADBBulkDirectoryStack *stack = &walk.stacks[i];
+        for (NSUInteger j = stack->bottom; j < stack->top; j++)
+            free(stack->jobs[j].relativePath);
+        free(stack->jobs);
+        pthread_mutex_destroy(&stack->lock);
+    }
+    free(walk.stacks);
+    pthread_cond_destroy(&walk.idleCondition);
+    pthread_mutex_destroy(&walk.idleLock);
+    
+    return YES;
+}
+
+@end
@@ -26,11 +26,19 @@
 
 
 //ADBDigest is a tool for generating hashes for sets of files.
+//Digests are cached against the inode, size and modification date of each file in the set,
+//so that asking again for the digest of unchanged files doesn't reread them.
 
 #import <Foundation/Foundation.h>
 
 @interface ADBDigest : NSObject
 
+//The location of the file in which digests will be persisted between launches.
+//If nil (the default), digests will only be cached for the lifetime of the process.
+//Setting this will load any digests previously saved at that location.
++ (NSURL *) cacheURL;
++ (void) setCacheURL: (NSURL *)URL;
+
 //Returns an SHA1 digest built from every file in the specified list.
 //Returns nil and populates outError on failure.
 + (NSData *) SHA1DigestForURLs: (NSArray *)fileURLs error: (out NSError **)outError;
@@ -27,12 +27,132 @@
 
 #import "ADBDigest.h"
 #import <CommonCrypto/CommonDigest.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+//Stub lengths are rounded up to a multiple of this, for compatibility with digests generated
+//by earlier versions which read files in 4096-byte chunks and stopped after the chunk that
+//crossed the requested length.
+#define ADBDigestStubGranularity 4096
+
+//File contents will be read and hashed in chunks of this size.
+#define ADBDigestChunkSize (1024 * 1024)
+
+//The maximum number of digests to keep in the cache. If the cache grows past this,
+//it is emptied and rebuilt from scratch as new digests are requested.
+#define ADBDigestMaxCachedDigests 2000
+
+
+@interface ADBDigest ()
+
+//The serial queue on which the digest cache is accessed and persisted.
++ (dispatch_queue_t) _cacheQueue;
+
+//The in-memory digest cache, mapping cache keys to digests. Must only be accessed on _cacheQueue.
++ (NSMutableDictionary *) _cachedDigests;
+
+//Returns a key identifying the current state of the specified set of files when read
+//up to the specified length, or nil if any of the files could not be stat'd.
++ (NSString *) _cacheKeyForURLs: (NSArray *)fileURLs
+                     upToLength: (NSUInteger)readLength
+                          error: (out NSError **)outError;
+
+//Hashes the contents of the specified files without consulting the cache.
++ (NSData *) _SHA1DigestForURLs: (NSArray *)fileURLs
+                     upToLength: (NSUInteger)readLength
+                          error: (out NSError **)outError;
+
+@end
 
-//File contents will be read in at 4096-byte chunks
-#define ADBDigestChunkSize 4096
 
 @implementation ADBDigest
 
+static NSURL *_cacheURL = nil;
+
+#pragma mark - Cache management
+
++ (dispatch_queue_t) _cacheQueue
+{
+    static dispatch_queue_t queue;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        queue = dispatch_queue_create("com.alunbestor.ADBDigest.cacheQueue", DISPATCH_QUEUE_SERIAL);
+    });
+    return queue;
+}
+
++ (NSMutableDictionary *) _cachedDigests
+{
+    static NSMutableDictionary *digests;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        digests = [[NSMutableDictionary alloc] init];
+    });
+    return digests;
+}
+
++ (NSURL *) cacheURL
+{
+    __block NSURL *URL;
+    dispatch_sync([self _cacheQueue], ^{
+        URL = [_cacheURL retain];
+    });
+    return [URL autorelease];
+}
+
++ (void) setCacheURL: (NSURL *)URL
+{
+    dispatch_sync([self _cacheQueue], ^{
+        if (![URL isEqual: _cacheURL])
+        {
+            [_cacheURL release];
+            _cacheURL = [URL copy];
+            
+            NSMutableDictionary *digests = [self _cachedDigests];
+            [digests removeAllObjects];
+            
+            if (_cacheURL)
+            {
+                NSDictionary *savedDigests = [NSDictionary dictionaryWithContentsOfURL: _cacheURL];
+                if (savedDigests)
+                    [digests addEntriesFromDictionary: savedDigests];
+            }
+        }
+    });
+}
+
++ (NSString *) _cacheKeyForURLs: (NSArray *)fileURLs
+                     upToLength: (NSUInteger)readLength
+                          error: (out NSError **)outError
+{
+    NSMutableString *key = [NSMutableString stringWithFormat: @"%lu", (unsigned long)readLength];
+    for (NSURL *fileURL in fileURLs)
+    {
+        struct stat info;
+        if (stat(fileURL.path.fileSystemRepresentation, &info) != 0)
+        {
+            if (outError)
+            {
+                NSDictionary *userInfo = @{ NSURLErrorKey: fileURL };
+                *outError = [NSError errorWithDomain: NSPOSIXErrorDomain code: errno userInfo: userInfo];
+            }
+            return nil;
+        }
+        
+        [key appendFormat: @"|%d:%llu:%lld:%ld.%ld",
+         info.st_dev,
+         (unsigned long long)info.st_ino,
+         (long long)info.st_size,
+         (long)info.st_mtimespec.tv_sec,
+         (long)info.st_mtimespec.tv_nsec];
+    }
+    return key;
+}
+
+
+#pragma mark - Digest generation
+
 + (NSData *) SHA1DigestForURLs: (NSArray *)fileURLs error: (out NSError **)outError
 {
 	return [self SHA1DigestForURLs: fileURLs upToLength: 0 error: outError];
@@ -40,40 +160,171 @@
 
 + (NSData *) SHA1DigestForURLs: (NSArray *)fileURLs upToLength: (NSUInteger)readLength error: (out NSError **)outError
 {
+    NSString *key = [self _cacheKeyForURLs: fileURLs upToLength: readLength error: outError];
+    if (!key)
+        return nil;
+    
+    __block NSData *digest;
+    dispatch_sync([self _cacheQueue], ^{
+        digest = [[[self _cachedDigests] objectForKey: key] retain];
+    });
+    
+    if (digest)
+        return [digest autorelease];
+    
+    digest = [self _SHA1DigestForURLs: fileURLs upToLength: readLength error: outError];
+    if (digest)
+    {
+        dispatch_async([self _cacheQueue], ^{
+            NSMutableDictionary *digests = [self _cachedDigests];
+            if (digests.count >= ADBDigestMaxCachedDigests)
+                [digests removeAllObjects];
+            
+            [digests setObject: digest forKey: key];
+            
+            if (_cacheURL)
+                [digests writeToURL: _cacheURL atomically: YES];
+        });
+    }
+    
+    return digest;
+}
+
++ (NSData *) _SHA1DigestForURLs: (NSArray *)fileURLs upToLength: (NSUInteger)readLength error: (out NSError **)outError
+{
+    NSUInteger numFiles = fileURLs.count;
+    
+    //The digest is a single hash of the files' contents in order, so the hashing itself can't
+    //be split between threads. When only hashing the start of each file though, we can read
+    //all the stubs concurrently and then hash them in order.
+    BOOL readsStubs = (readLength > 0);
+    if (readsStubs)
+        readLength = ((readLength + ADBDigestStubGranularity - 1) / ADBDigestStubGranularity) * ADBDigestStubGranularity;
+    
+    NSUInteger chunkSize = readsStubs ? MIN(readLength, (NSUInteger)ADBDigestChunkSize) : ADBDigestChunkSize;
+    
+    __block NSError *readError = nil;
+    __block NSMutableArray *stubs = nil;
+    if (readsStubs && readLength <= ADBDigestChunkSize)
+    {
+        stubs = [NSMutableArray arrayWithCapacity: numFiles];
+        for (NSUInteger i=0; i<numFiles; i++)
+            [stubs addObject: [NSNull null]];
+        
+        NSLock *lock = [[NSLock alloc] init];
+        dispatch_apply(numFiles, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t i) {
+            NSURL *fileURL = [fileURLs objectAtIndex: i];
+            NSMutableData *stub = [[NSMutableData alloc] initWithLength: readLength];
+            ssize_t bytesRead = -1;
+            
+            int fd = open(fileURL.path.fileSystemRepresentation, O_RDONLY);
+            if (fd != -1)
+            {
+                bytesRead = 0;
+                while ((NSUInteger)bytesRead < readLength)
+                {
+                    ssize_t result = read(fd, (char *)stub.mutableBytes + bytesRead, readLength - bytesRead);
+                    if (result < 0 && errno == EINTR) continue;
+                    if (result <= 0)
+                    {
+                        if (result < 0) bytesRead = -1;
+                        break;
+                    }
+                    bytesRead += result;
+                }
+            }
+            int readErrno = errno;
+            if (fd != -1) close(fd);
+            
+            [lock lock];
+            if (bytesRead < 0)
+            {
+                if (!readError)
+                    readError = [[NSError alloc] initWithDomain: NSPOSIXErrorDomain
+                                                           code: readErrno
+                                                       userInfo: @{ NSURLErrorKey: fileURL }];
+            }
+            else
+            {
+                stub.length = bytesRead;
+                [stubs replaceObjectAtIndex: i withObject: stub];
+            }
+            [lock unlock];
+            [stub release];
+        });
+        [lock release];
+        
+        if (readError)
+        {
+            if (outError) *outError = [readError autorelease];
+            else [readError release];
+            return nil;
+        }
+    }
+    
 	CC_SHA1_CTX	context;
-	
-	NSMutableData *hash = [[NSMutableData alloc] initWithLength: CC_SHA1_DIGEST_LENGTH];
-	
 	CC_SHA1_Init(&context);
 	
-	for (NSURL *fileURL in fileURLs)
-	{
-		NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
-		NSFileHandle *file		= [NSFileHandle fileHandleForReadingFromURL: fileURL error: outError];
-        
-        //If there was an error opening the file, bail out.
-        if (!file)
+    if (stubs)
+    {
+        for (NSData *stub in stubs)
+            CC_SHA1_Update(&context, stub.bytes, (CC_LONG)stub.length);
+    }
+    else
+    {
+        void *buffer = malloc(chunkSize);
+        for (NSURL *fileURL in fileURLs)
         {
-            [hash release];
-            return nil;
-		}
-        
-		NSData *chunk = nil;
-		//Read the file in as chunks of ADBDigestChunkSize length
-		while ((chunk = [file readDataOfLength: ADBDigestChunkSize]) && chunk.length)
-		{
-			CC_SHA1_Update(&context, chunk.bytes, (CC_LONG)chunk.length);
-			
-			//Stop reading if we go over the desired length for this file 
-			if (readLength && file.offsetInFile >= readLength) break;
-		}
-			   
-		[file closeFile];
-		[pool release];
-	}
+            int fd = open(fileURL.path.fileSystemRepresentation, O_RDONLY);
+            int readErrno = errno;
+            BOOL failed = (fd == -1);
+            
+            if (!failed)
+            {
+                //We'll be streaming the whole file through once, so don't let it crowd out the disk cache.
+                if (!readsStubs)
+                    fcntl(fd, F_NOCACHE, 1);
+                
+                NSUInteger totalRead = 0;
+                while (!readsStubs || totalRead < readLength)
+                {
+                    NSUInteger bytesToRead = readsStubs ? MIN(chunkSize, readLength - totalRead) : chunkSize;
+                    ssize_t bytesRead = read(fd, buffer, bytesToRead);
+                    if (bytesRead < 0 && errno == EINTR) continue;
+                    if (bytesRead < 0)
+                    {
+                        readErrno = errno;
+                        failed = YES;
+                    }
+                    if (bytesRead <= 0) break;
+                    
+                    CC_SHA1_Update(&context, buffer, (CC_LONG)bytesRead);
+                    totalRead += bytesRead;
+                }
+            }
+            
+            //If there was an error reading the file, bail out.
+            if (failed)
+            {
+                if (outError)
+                {
+                    *outError = [NSError errorWithDomain: NSPOSIXErrorDomain
+                                                    code: readErrno
+                                                userInfo: @{ NSURLErrorKey: fileURL }];
+                }
+                if (fd != -1) close(fd);
+                free(buffer);
+                return nil;
+            }
+            close(fd);
+        }
+        free(buffer);
+    }
+    
+	NSMutableData *hash = [NSMutableData dataWithLength: CC_SHA1_DIGEST_LENGTH];
 	CC_SHA1_Final(hash.mutableBytes, &context);
 	
-	return [hash autorelease];
+	return hash;
 }
 
-@end
\ No newline at end of file
+@end
@@ -293,12 +293,18 @@ typedef NS_ENUM(int, ADBHandleSeekLocation) {
 //original handle.
 //Note that the base class supports reading only. It must be subclassed to
 //implement writing of block lead-in and lead-out areas.
+//Reads from the source are made a run of whole blocks at a time, and the last run
+//read is kept so that small reads from the same blocks don't go back to the source.
 @interface ADBBlockHandle : ADBSeekableAbstractHandle <ADBReadable>
 {
     id <ADBReadable, ADBSeekable> _sourceHandle;
     NSUInteger _blockSize;
     NSUInteger _blockLeadIn;
     NSUInteger _blockLeadOut;
+    
+    uint8_t *_blockCache;
+    unsigned long long _firstCachedBlock;
+    NSUInteger _cachedLength;
 }
 
 //Returns a new padded file handle with the specified logical block size, lead-in
@@ -777,6 +777,10 @@ int _ADBHandleClose(void *cookie)
 
 #pragma mark -
 
+//The most blocks ADBBlockHandle will read from its source at once.
+//For CD sectors this is a little over 70KB per read.
+#define ADBBlockHandleMaxBlocksPerRead 32
+
 @interface ADBBlockHandle ()
 
 @property (retain, nonatomic) id <ADBReadable, ADBSeekable> sourceHandle;
@@ -785,6 +789,10 @@ int _ADBHandleClose(void *cookie)
 @property (assign, nonatomic) NSUInteger blockLeadOut;
 @property (readonly, nonatomic) NSUInteger rawBlockSize;
 
+- (BOOL) _loadBlocksFrom: (unsigned long long)firstBlock
+                forBytes: (NSUInteger)numLogicalBytes
+                   error: (out NSError **)outError;
+
 @end
 
 @implementation ADBBlockHandle
@@ -827,11 +835,16 @@ int _ADBHandleClose(void *cookie)
     [super close];
     //TODO: should we close the source handle as well?
     self.sourceHandle = nil;
+    
+    free(_blockCache);
+    _blockCache = NULL;
+    _cachedLength = 0;
 }
 
 - (void) dealloc
 {
     self.sourceHandle = nil;
+    free(_blockCache);
     [super dealloc];
 }
 
@@ -902,48 +915,97 @@ int _ADBHandleClose(void *cookie)
     NSUInteger bytesRead = 0;
     *outBytesRead = 0;
     
+    NSUInteger rawBlockSize = self.rawBlockSize;
+    
     @synchronized(self.sourceHandle)
     {
         while (bytesRead < numBytes)
         {
-            unsigned long long sourceOffset = [self sourceOffsetForLogicalOffset: self.offset];
-            BOOL sought = [self.sourceHandle seekToOffset: sourceOffset relativeTo: ADBSeekFromStart error: outError];
-            if (!sought)
-            {
-                return NO;
-            }
-            
-            //Read until the end of the block or until we've got all the bytes we wanted, whichever comes first.
+            unsigned long long block = self.offset / self.blockSize;
             NSUInteger offsetWithinBlock = self.offset % self.blockSize;
-            NSUInteger chunkSize = MIN(numBytes - bytesRead, self.blockSize - offsetWithinBlock);
             
-            void *bufferOffset = &buffer[bytesRead];
+            //If the block isn't in the cache, read it in along with as many of the following blocks
+            //as the rest of the request needs: so that a long read takes a few large reads from the
+            //source, rather than a seek and a read for every block.
+            BOOL blockIsCached = (_cachedLength > 0 && block >= _firstCachedBlock &&
+                                  (block - _firstCachedBlock) * rawBlockSize < _cachedLength);
             
-            NSUInteger bytesReadInChunk;
-            BOOL readBytes = [self.sourceHandle readBytes: bufferOffset
-                                                maxLength: chunkSize
-                                                bytesRead: &bytesReadInChunk
-                                                    error: outError];
-            
-            if (readBytes)
+            if (!blockIsCached)
             {
-                self.offset += bytesReadInChunk;
-                bytesRead += bytesReadInChunk;
-                *outBytesRead = bytesRead;
+                BOOL loaded = [self _loadBlocksFrom: block
+                                           forBytes: offsetWithinBlock + (numBytes - bytesRead)
+                                              error: outError];
+                if (!loaded)
+                    return NO;
                 
-                //Reading finished without getting all the bytes we expected, meaning we've hit the end of the file.
-                if (bytesReadInChunk < chunkSize)
+                //We've hit the end of the source.
+                if (_cachedLength == 0)
                     break;
             }
-            else
-            {
-                return NO;
-            }
+            
+            //Copy out whatever's wanted from this block, skipping its lead-in and lead-out.
+            NSUInteger blockStart = (NSUInteger)(block - _firstCachedBlock) * rawBlockSize + self.blockLeadIn;
+            NSUInteger availableInBlock = 0;
+            if (_cachedLength > blockStart)
+                availableInBlock = MIN(self.blockSize, _cachedLength - blockStart);
+            
+            //The source ended partway through this block.
+            if (availableInBlock <= offsetWithinBlock)
+                break;
+            
+            NSUInteger chunkSize = MIN(numBytes - bytesRead, availableInBlock - offsetWithinBlock);
+            memcpy(&buffer[bytesRead], &_blockCache[blockStart + offsetWithinBlock], chunkSize);
+            
+            self.offset += chunkSize;
+            bytesRead += chunkSize;
+            *outBytesRead = bytesRead;
         }
     }
     return YES;
 }
 
+//Reads a run of raw blocks from the source into the cache, starting at the specified block and
+//covering at least the specified number of logical bytes if the cache is big enough.
+//Leaves the cache empty if the block lies beyond the end of the source.
+- (BOOL) _loadBlocksFrom: (unsigned long long)firstBlock
+                forBytes: (NSUInteger)numLogicalBytes
+                   error: (out NSError **)outError
+{
+    NSUInteger rawBlockSize = self.rawBlockSize;
+    
+    if (!_blockCache)
+    {
+        _blockCache = (uint8_t *)malloc(rawBlockSize * ADBBlockHandleMaxBlocksPerRead);
+        if (!_blockCache)
+        {
+            if (outError)
+                *outError = [NSError errorWithDomain: NSPOSIXErrorDomain code: ENOMEM userInfo: nil];
+            return NO;
+        }
+    }
+    
+    NSUInteger numBlocks = (numLogicalBytes + self.blockSize - 1) / self.blockSize;
+    numBlocks = MAX(1U, MIN(numBlocks, (NSUInteger)ADBBlockHandleMaxBlocksPerRead));
+    
+    _cachedLength = 0;
+    _firstCachedBlock = firstBlock;
+    
+    BOOL sought = [self.sourceHandle seekToOffset: firstBlock * rawBlockSize relativeTo: ADBSeekFromStart error: outError];
+    if (!sought)
+        return NO;
+    
+    NSUInteger bytesRead = 0;
+    BOOL read = [self.sourceHandle readBytes: _blockCache
+                                   maxLength: numBlocks * rawBlockSize
+                                   bytesRead: &bytesRead
+                                       error: outError];
+    if (!read)
+        return NO;
+    
+    _cachedLength = bytesRead;
+    return YES;
+}
+
 - (long long) maxOffset
 {
     return [self logicalOffsetForSourceOffset: self.sourceHandle.maxOffset];
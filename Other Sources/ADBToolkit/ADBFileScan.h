@@ -103,10 +103,17 @@ extern NSString * const ADBFileScanLastMatchKey;
 //Returns an autoreleased file scan operation with the specified base path.
 + (id) scanWithBasePath: (NSString *)basePath;
 
+//Returns the filesystem path whose contents the scan walks.
+//By default this returns basePath, but can be overridden by subclasses
+//to scan a different path than the base.
+- (NSString *) enumerationPath;
+
 //Returns a new autoreleased instance of the enumerator to scan with.
 //By default this returns an NSDirectoryEnumerator instance configured
-//to scan basePath, but can be overridden by subclasses to scan a different
-//path than the base.
+//to scan enumerationPath.
+//The enumerator is only used on systems without getattrlistbulk(), or if a subclass
+//overrides this method: otherwise the scan walks enumerationPath with an
+//ADBBulkDirectoryWalker, reading several directories at once.
 //TODO: reimplement to use the ADBFilesystemEnumerator protocol.
 - (NSDirectoryEnumerator *) enumerator;
 
@@ -116,6 +123,8 @@ extern NSString * const ADBFileScanLastMatchKey;
 //Returns NO if skipSubdirectories is enabled, or if skipPackageContents is enabled
 //and the path represents a file package. Can be overridden by subclasses to perform
 //custom subfolder filtering.
+//NOTE: when walking with an ADBBulkDirectoryWalker, this is called concurrently
+//from the walker's threads and must be thread-safe.
 - (BOOL) shouldScanSubpath: (NSString *)relativePath;
 
 //Called for every file found during the scan. By default, this checks the file with
@@ -134,6 +143,9 @@ extern NSString * const ADBFileScanLastMatchKey;
 //our search criteria.
 //Returns YES if filePath matches fileTypes and predicate, NO otherwise.
 //Can be overridden by subclasses to implement custom filtering.
+//NOTE: if neither this nor matchAgainstPath: is overridden, the scan calls this concurrently
+//from the threads of an ADBBulkDirectoryWalker, skipping hidden files without asking.
+//matchAgainstPath: and addMatchingPath: are always called on the operation's own thread.
 - (BOOL) isMatchingPath: (NSString *)relativePath;
 
 //Adds the specified path (relative to basePath) into the set of matched paths.
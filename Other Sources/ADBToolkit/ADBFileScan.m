@@ -26,6 +26,7 @@
 
 #import "ADBFileScan.h"
 #import "ADBPathEnumerator.h"
+#import "ADBBulkDirectoryWalker.h"
 #import "NSWorkspace+ADBFileTypes.h"
 
 
@@ -35,6 +36,28 @@
 NSString * const ADBFileScanLastMatchKey = @"ADBFileScanLastMatch";
 
 
+#pragma mark -
+#pragma mark Private method declarations
+
+@interface ADBFileScan ()
+
+//Adds a path that is already known to match, and posts a notification about it.
+//Returns NO if the scan has found enough matches.
+- (BOOL) _acceptMatchingPath: (NSString *)relativePath;
+
+//Whether the class of this scan overrides ADBFileScan's implementation of the specified method.
+- (BOOL) _overridesMethod: (SEL)selector;
+
+//Walks enumerationPath with an ADBBulkDirectoryWalker. Returns NO if the walk could not
+//be started, in which case the scan should fall back on enumerator.
+- (BOOL) _performBulkScan;
+
+//Walks the directory enumerator returned by enumerator.
+- (void) _performEnumeratorScan;
+
+@end
+
+
 #pragma mark -
 #pragma mark Implementation
 
@@ -107,17 +130,22 @@ NSString * const ADBFileScanLastMatchKey = @"ADBFileScanLastMatch";
 - (BOOL) matchAgainstPath: (NSString *)relativePath
 {
     if ([self isMatchingPath: relativePath])
-    {
-        [self addMatchingPath: relativePath];
-        
-        NSDictionary *userInfo = [NSDictionary dictionaryWithObject: self.lastMatch
-                                                             forKey: ADBFileScanLastMatchKey];
-        
-        [self _sendInProgressNotificationWithInfo: userInfo];
-        
-        //Check if we have enough matches now: if so, stop scanning.
-        if (self.maxMatches && _matchingPaths.count >= self.maxMatches) return NO;
-    }
+        return [self _acceptMatchingPath: relativePath];
+    
+    return YES;
+}
+
+- (BOOL) _acceptMatchingPath: (NSString *)relativePath
+{
+    [self addMatchingPath: relativePath];
+    
+    NSDictionary *userInfo = [NSDictionary dictionaryWithObject: self.lastMatch
+                                                         forKey: ADBFileScanLastMatchKey];
+    
+    [self _sendInProgressNotificationWithInfo: userInfo];
+    
+    //Check if we have enough matches now: if so, stop scanning.
+    if (self.maxMatches && _matchingPaths.count >= self.maxMatches) return NO;
     
     return YES;
 }
@@ -156,9 +184,19 @@ NSString * const ADBFileScanLastMatchKey = @"ADBFileScanLastMatch";
 	[[self mutableArrayValueForKey: @"matchingPaths"] addObject: relativePath];
 }
 
+- (NSString *) enumerationPath
+{
+    return self.basePath;
+}
+
 - (NSDirectoryEnumerator *) enumerator
 {
-    return [_manager enumeratorAtPath: self.basePath];
+    return [_manager enumeratorAtPath: self.enumerationPath];
+}
+
+- (BOOL) _overridesMethod: (SEL)selector
+{
+    return [self methodForSelector: selector] != [ADBFileScan instanceMethodForSelector: selector];
 }
 
 - (void) main
@@ -169,6 +207,138 @@ NSString * const ADBFileScanLastMatchKey = @"ADBFileScanLastMatch";
     
     [_matchingPaths removeAllObjects];
     
+    //The bulk walker can't stand in for a subclass's own enumerator.
+    BOOL canWalkInBulk = [ADBBulkDirectoryWalker isAvailable] && ![self _overridesMethod: @selector(enumerator)];
+    
+    if (!canWalkInBulk || ![self _performBulkScan])
+        [self _performEnumeratorScan];
+}
+
+- (BOOL) _performBulkScan
+{
+    //If subclasses customise matching then they get to see every path, in which case all the
+    //walker can spare us is the stat() per file. But if our own matching is in effect then most
+    //entries can be ruled out on the walker's threads, without creating strings for them.
+    BOOL usesDefaultMatching = !([self _overridesMethod: @selector(matchAgainstPath:)] || [self _overridesMethod: @selector(isMatchingPath:)]);
+    BOOL usesDefaultSubpathChecks = ![self _overridesMethod: @selector(shouldScanSubpath:)];
+    BOOL skipHiddenFiles = self.skipHiddenFiles;
+    BOOL skipSubdirectories = self.skipSubdirectories;
+    BOOL skipPackageContents = self.skipPackageContents;
+    
+    ADBBulkDirectoryWalker *walker = [[ADBBulkDirectoryWalker alloc] initWithPath: self.enumerationPath];
+    
+    //Paths found by the walker, waiting to be matched on this thread.
+    NSMutableArray *foundPaths = [[NSMutableArray alloc] init];
+    NSCondition *condition = [[NSCondition alloc] init];
+    __block BOOL walkFinished = NO;
+    __block BOOL walkStarted = NO;
+    
+    ADBBulkDirectoryWalkerHandler handler = ^ADBBulkDirectoryWalkerResponse(const ADBBulkDirectoryEntry *entry) {
+        if (self.isCancelled)
+            return ADBBulkDirectoryWalkerStop;
+        
+        ADBBulkDirectoryWalkerResponse response = ADBBulkDirectoryWalkerContinue;
+        NSString *relativePath = nil;
+        
+        if (entry->type == VDIR)
+        {
+            //Package checks need a path to go on, but plain subdirectories don't.
+            if (usesDefaultSubpathChecks && (skipSubdirectories || !skipPackageContents))
+            {
+                if (!skipSubdirectories)
+                    response |= ADBBulkDirectoryWalkerDescend;
+            }
+            else
+            {
+                relativePath = [ADBBulkDirectoryWalker relativePathForEntry: entry];
+                if (relativePath && [self shouldScanSubpath: relativePath])
+                    response |= ADBBulkDirectoryWalkerDescend;
+            }
+        }
+        
+        if (usesDefaultMatching && skipHiddenFiles && entry->name[0] == '.')
+            return response;
+        
+        if (!relativePath)
+            relativePath = [ADBBulkDirectoryWalker relativePathForEntry: entry];
+        
+        if (!relativePath)
+            return response;
+        
+        if (usesDefaultMatching && ![self isMatchingPath: relativePath])
+            return response;
+        
+        [condition lock];
+        [foundPaths addObject: relativePath];
+        [condition signal];
+        [condition unlock];
+        
+        return response;
+    };
+    
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        BOOL started = [walker walkWithHandler: handler error: NULL];
+        
+        [condition lock];
+        walkStarted = started;
+        walkFinished = YES;
+        [condition signal];
+        [condition unlock];
+    });
+    
+    BOOL keepScanning = YES;
+    while (keepScanning)
+    {
+        [condition lock];
+        while (!foundPaths.count && !walkFinished)
+            [condition wait];
+        
+        NSArray *paths = [foundPaths copy];
+        [foundPaths removeAllObjects];
+        BOOL finished = walkFinished && !paths.count;
+        [condition unlock];
+        
+        for (NSString *relativePath in paths)
+        {
+            if (self.isCancelled)
+            {
+                keepScanning = NO;
+                break;
+            }
+            
+            NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+            
+            if (usesDefaultMatching)
+                keepScanning = [self _acceptMatchingPath: relativePath];
+            else
+                keepScanning = [self matchAgainstPath: relativePath];
+            
+            [pool drain];
+            
+            if (!keepScanning) break;
+        }
+        [paths release];
+        
+        if (finished || self.isCancelled) break;
+    }
+    
+    //Wait for the walk to wind down, since its handler refers to us.
+    [walker stop];
+    [condition lock];
+    while (!walkFinished)
+        [condition wait];
+    BOOL started = walkStarted;
+    [condition unlock];
+    
+    [walker release];
+    [foundPaths release];
+    [condition release];
+    
+    return started;
+}
+
+- (void) _performEnumeratorScan
+{
     NSDirectoryEnumerator *enumerator = self.enumerator;
     
     for (NSString *relativePath in enumerator)
@@ -50,6 +50,7 @@
     ADBISOFormat _format;
     
     NSMutableDictionary *_pathCache;
+    BOOL _pathCacheIsComplete;
 }
 
 //The name of the image volume.
@@ -475,9 +475,76 @@ int extdate_to_int(uint8_t *digits, int length)
     
     self.pathCache = [NSMutableDictionary dictionaryWithObject: rootDirectory forKey: @"/"];
     
+    //Then read in the rest of the tree while we're here, since scanning the image
+    //will want all of it anyway.
+    if (rootDirectory.isDirectory)
+        [self _indexDirectoryTreeFromRoot: (ADBISODirectoryEntry *)rootDirectory];
+    
     return YES;
 }
 
+- (void) _indexDirectoryTreeFromRoot: (ADBISODirectoryEntry *)rootDirectory
+{
+    BOOL indexedAllDirectories = YES;
+    
+    //Track which extents we've read, so that a malformed image whose directories
+    //refer back to their ancestors can't send us round in circles.
+    NSMutableIndexSet *visitedLocations = [NSMutableIndexSet indexSetWithIndex: rootDirectory.dataRange.location];
+    
+    NSArray *directoryPaths = @[@"/"];
+    while (directoryPaths.count)
+    {
+        //Mastering tools lay out each level of the tree in path table order, so reading
+        //a level in order of location reads its directories one after another.
+        NSComparator sortByLocation = ^NSComparisonResult(NSString *path1, NSString *path2) {
+            NSUInteger location1 = [(ADBISOFileEntry *)[self.pathCache objectForKey: path1] dataRange].location;
+            NSUInteger location2 = [(ADBISOFileEntry *)[self.pathCache objectForKey: path2] dataRange].location;
+            
+            if (location1 < location2)
+                return NSOrderedAscending;
+            else if (location1 > location2)
+                return NSOrderedDescending;
+            else
+                return NSOrderedSame;
+        };
+        directoryPaths = [directoryPaths sortedArrayUsingComparator: sortByLocation];
+        
+        NSMutableArray *subdirectoryPaths = [NSMutableArray array];
+        for (NSString *directoryPath in directoryPaths)
+        {
+            NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+            
+            ADBISODirectoryEntry *directory = [self.pathCache objectForKey: directoryPath];
+            NSArray *subentries = [directory subentriesWithError: NULL];
+            if (subentries)
+            {
+                for (ADBISOFileEntry *subentry in subentries)
+                {
+                    NSString *subentryPath = [directoryPath stringByAppendingPathComponent: subentry.fileName];
+                    [self.pathCache setObject: subentry forKey: subentryPath];
+                    
+                    if (subentry.isDirectory && ![visitedLocations containsIndex: subentry.dataRange.location])
+                    {
+                        [visitedLocations addIndex: subentry.dataRange.location];
+                        [subdirectoryPaths addObject: subentryPath];
+                    }
+                }
+            }
+            else
+            {
+                indexedAllDirectories = NO;
+            }
+            
+            [pool drain];
+        }
+        
+        directoryPaths = subdirectoryPaths;
+    }
+    
+    //If we've read everything, then a path that isn't in the cache isn't in the image.
+    _pathCacheIsComplete = indexedAllDirectories;
+}
+
 - (BOOL) _getPrimaryVolumeDescriptor: (ADBISOPrimaryVolumeDescriptor *)descriptor
                                error: (NSError **)outError
 {
@@ -545,6 +612,17 @@ int extdate_to_int(uint8_t *digits, int length)
     //If we have a matching entry for this path, return it immediately.
     ADBISOFileEntry *matchingEntry = [self.pathCache objectForKey: path];
     
+    //If the whole tree has been read in, then a path that isn't in the cache doesn't exist.
+    if (!matchingEntry && _pathCacheIsComplete)
+    {
+        if (outError)
+        {
+            NSDictionary *info = @{ NSFilePathErrorKey: path };
+            *outError = [NSError errorWithDomain: NSCocoaErrorDomain code: NSFileNoSuchFileError userInfo: info];
+        }
+        return nil;
+    }
+    
     //Otherwise, walk backwards through the parent directories looking for one that is in the cache.
     //Once we find one, add its children to the cache under their respective paths: and so on back up
     //to the originally requsted path.
@@ -74,6 +74,13 @@
 - (BOOL) _getPrimaryVolumeDescriptor: (ADBISOPrimaryVolumeDescriptor *)descriptor
                                error: (out NSError **)outError;
 
+//Reads every directory in the image into the path cache, starting from the specified root.
+//Directories are read a level at a time, in the order in which they're laid out in the image,
+//so that reading the whole tree takes one pass through the directory area of the disc.
+//Called by _loadImageAtURL:error:. If any directory can't be read, the lookups that need it
+//fall back on reading it on demand and report the error then.
+- (void) _indexDirectoryTreeFromRoot: (ADBISODirectoryEntry *)rootDirectory;
+
 //Returns a file entry which can be used for reading file data
 //(or, in the case of directory entries, reading subpaths.)
 - (ADBISOFileEntry *) _fileEntryAtPath: (NSString *)path
@@ -58,11 +58,11 @@
 }
 
 //If we have a mounted volume path for an image, enumerate that instead of the original base path
-- (NSDirectoryEnumerator *) enumerator
+- (NSString *) enumerationPath
 {
     if (self.mountedVolumePath)
-        return [_manager enumeratorAtPath: self.mountedVolumePath];
-    else return [super enumerator];
+        return self.mountedVolumePath;
+    else return [super enumerationPath];
 }
 
 //Split the work up into separate stages for easier overriding in subclasses.
@@ -28,6 +28,13 @@
 #import "ADBOperation.h"
 #import "ADBOperationDelegate.h"
 
+#if defined(__has_include)
+#if __has_include(<os/signpost.h>)
+#import <os/signpost.h>
+#define ADBOperationSignposts 1
+#endif
+#endif
+
 #pragma mark -
 #pragma mark Notification constants and keys
 
@@ -78,9 +85,39 @@ NSString * const ADBOperationIndeterminateKey	= @"ADBOperationIndeterminateKey";
 
 - (void) start
 {
+#if ADBOperationSignposts
+    //Mark out each operation as a signpost interval, so that imports and other long-running
+    //operations can be lined up in Instruments against whatever else was going on at the time.
+    os_log_t log = NULL;
+    os_signpost_id_t signpost = 0;
+    if (@available(macOS 10.14, *))
+    {
+        static os_log_t operationLog = NULL;
+        static dispatch_once_t onceToken;
+        dispatch_once(&onceToken, ^{
+            operationLog = os_log_create("net.washboardabs.boxer", "Operations");
+        });
+        
+        if (os_signpost_enabled(operationLog))
+        {
+            log = operationLog;
+            signpost = os_signpost_id_make_with_pointer(log, self);
+            os_signpost_interval_begin(log, signpost, "Operation", "%{public}s", NSStringFromClass(self.class).UTF8String);
+        }
+    }
+#endif
+    
     [self _sendWillStartNotificationWithInfo: nil];
     [super start];
     [self _sendDidFinishNotificationWithInfo: nil];
+    
+#if ADBOperationSignposts
+    if (@available(macOS 10.14, *))
+    {
+        if (log)
+            os_signpost_interval_end(log, signpost, "Operation", "%{public}s", self.succeeded ? "succeeded" : "failed");
+    }
+#endif
 }
 
 - (void) cancel
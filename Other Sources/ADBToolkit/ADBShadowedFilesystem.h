@@ -40,6 +40,11 @@ extern NSString * const ADBShadowedDeletionMarkerExtension;
 @interface ADBShadowedFilesystem : ADBLocalFilesystem
 {
     NSURL *_shadowURL;
+    
+    //An index of everything in the shadow location, so that lookups of paths that
+    //haven't been shadowed can skip checking the shadow location altogether.
+    //Built the first time it's needed and kept up to date as we write to the shadow.
+    NSMutableSet *_shadowIndex;
 }
 
 #pragma mark -
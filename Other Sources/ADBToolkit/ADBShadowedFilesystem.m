@@ -48,6 +48,28 @@ NSString * const ADBShadowedDeletionMarkerExtension = @"deleted";
 //Create a 0-byte deletion marker at the specified shadow URL.
 - (void) _createDeletionMarkerAtURL: (NSURL *)markerURL;
 
+//The index of items in the shadow location, built from the shadow location's contents if needed.
+//Its entries are lowercased logical paths, so that a path missing from the index is certain
+//not to exist in the shadow location regardless of the case-sensitivity of the filesystem.
+@property (readonly, nonatomic) NSMutableSet *shadowIndex;
+
+//Returns the key for the specified shadowed URL in the shadow index.
+- (NSString *) _shadowIndexKeyForShadowedURL: (NSURL *)URL;
+
+//Returns NO if the specified shadowed URL is definitely absent, or YES if it may exist.
+//Only a YES answer needs to be confirmed against the filesystem.
+- (BOOL) _shadowIndexMayContainURL: (NSURL *)URL;
+
+//Returns whether a shadowed item exists at the specified URL, consulting the shadow index first.
+- (BOOL) _shadowedItemExistsAtURL: (NSURL *)URL;
+
+//Records the specified shadowed URL in the shadow index, along with its parent directories
+//and, if it's a directory, any contents it has.
+- (void) _indexShadowedURL: (NSURL *)URL;
+
+//Discards the shadow index, so that it will be rebuilt next time it's needed.
+- (void) _invalidateShadowIndex;
+
 //Used internally by mergeContentsOfURL:error: to merge each item back into the source.
 - (BOOL) _mergeItemAtShadowURL: (NSURL *)shadowedURL
                    toSourceURL: (NSURL *)sourceURL
@@ -119,6 +141,7 @@ includingPropertiesForKeys: (NSArray *)keys
 - (void) dealloc
 {
     self.shadowURL = nil;
+    [self _invalidateShadowIndex];
     
     [super dealloc];
 }
@@ -141,6 +164,8 @@ includingPropertiesForKeys: (NSArray *)keys
         [_shadowURL release];
         _shadowURL = [URL copy];
         
+        [self _invalidateShadowIndex];
+        
         if (_shadowURL)
             [self addRepresentedURL: _shadowURL];
     }
@@ -189,8 +214,8 @@ includingPropertiesForKeys: (NSArray *)keys
         
         //If the file has been shadowed, and hasn't been flagged as deleted in the shadow,
         //return the shadow URL.
-        if ([shadowURL checkResourceIsReachableAndReturnError: NULL] &&
-            ![deletionMarkerURL checkResourceIsReachableAndReturnError: NULL])
+        if ([self _shadowedItemExistsAtURL: shadowURL] &&
+            ![self _shadowedItemExistsAtURL: deletionMarkerURL])
             return shadowURL.URLByStandardizingPath;
         
         //Otherwise, use the original source URL to resolve the path.
@@ -262,7 +287,7 @@ includingPropertiesForKeys: (NSArray *)keys
         NSURL *deletionMarkerURL = [shadowedURL URLByAppendingPathExtension: ADBShadowedDeletionMarkerExtension];
         
         //If the file is flagged as deleted, pretend it doesn't exist.
-        if ([deletionMarkerURL checkResourceIsReachableAndReturnError: NULL])
+        if ([self _shadowedItemExistsAtURL: deletionMarkerURL])
         {
             if (isDirectory)
                 *isDirectory = NO;
@@ -270,7 +295,8 @@ includingPropertiesForKeys: (NSArray *)keys
         }
         
         //Otherwise, if either the source or a shadow exist, treat the file as existing.
-        else if ([self.manager fileExistsAtPath: shadowedURL.path isDirectory: isDirectory])
+        else if ([self _shadowIndexMayContainURL: shadowedURL] &&
+                 [self.manager fileExistsAtPath: shadowedURL.path isDirectory: isDirectory])
         {
             return YES;
         }
@@ -306,6 +332,10 @@ includingPropertiesForKeys: (NSArray *)keys
         else
             wrappedHandler = nil;
         
+        //If nothing under this path has been shadowed, we can enumerate the source alone.
+        if (![self _shadowIndexMayContainURL: shadowedURL])
+            shadowedURL = nil;
+        
         return [[[ADBShadowedDirectoryEnumerator alloc] initWithLocalURL: sourceURL
                                                              shadowedURL: shadowedURL
                                                              inFilesytem: self
@@ -337,7 +367,7 @@ includingPropertiesForKeys: (NSArray *)keys
             //If the original has been marked as deleted, then remove the marker
             //*but mark all the files inside that directory as deleted*,
             //since the 'new' directory should appear empty.
-            if ([deletionMarkerURL checkResourceIsReachableAndReturnError: NULL])
+            if ([self _shadowedItemExistsAtURL: deletionMarkerURL])
             {
                 [self.manager removeItemAtURL: deletionMarkerURL error: NULL];
                 
@@ -383,6 +413,8 @@ includingPropertiesForKeys: (NSArray *)keys
             
             if (createdDirectory)
             {
+                [self _indexShadowedURL: shadowedURL];
+                
                 //Remove any old deletion marker for this directory
                 [self.manager removeItemAtURL: deletionMarkerURL error: NULL];
             }
@@ -410,8 +442,8 @@ includingPropertiesForKeys: (NSArray *)keys
         
         BOOL createIfMissing = (options & ADBCreateIfMissing) == ADBCreateIfMissing;
         
-        BOOL deletionMarkerExists = [deletionMarkerURL checkResourceIsReachableAndReturnError: NULL];
-        BOOL shadowExists = [shadowedURL checkResourceIsReachableAndReturnError: NULL];
+        BOOL deletionMarkerExists = [self _shadowedItemExistsAtURL: deletionMarkerURL];
+        BOOL shadowExists = [self _shadowedItemExistsAtURL: shadowedURL];
         
         //If the file has been marked as deleted in the shadow...
         if (deletionMarkerExists)
@@ -424,6 +456,7 @@ includingPropertiesForKeys: (NSArray *)keys
                 [self.manager removeItemAtURL: deletionMarkerURL error: NULL];
                 [self.manager removeItemAtURL: shadowedURL error: NULL];
                 
+                [self _indexShadowedURL: shadowedURL];
                 return [ADBFileHandle handleForURL: shadowedURL options: options error: outError];
             }
             //Otherwise, pretend we can't open the file at all.
@@ -484,6 +517,9 @@ includingPropertiesForKeys: (NSArray *)keys
                 }
             }
             
+            //IMPLEMENTATION NOTE: this is indexed before the file is created, since having
+            //an index entry for something that doesn't exist only costs us a later stat.
+            [self _indexShadowedURL: shadowedURL];
             return [ADBFileHandle handleForURL: shadowedURL options: options error: outError];
         }
         
@@ -520,7 +556,7 @@ includingPropertiesForKeys: (NSArray *)keys
         NSURL *deletionMarkerURL = [shadowedURL URLByAppendingPathExtension: ADBShadowedDeletionMarkerExtension];
         
         BOOL originalExists = [sourceURL checkResourceIsReachableAndReturnError: NULL];
-        BOOL deletionMarkerExists = [deletionMarkerURL checkResourceIsReachableAndReturnError: NULL];
+        BOOL deletionMarkerExists = [self _shadowedItemExistsAtURL: deletionMarkerURL];
         
         //If this file has already been marked as deleted, pretend to fail
         //since we cannot delete an already-deleted file.
@@ -579,6 +615,9 @@ includingPropertiesForKeys: (NSArray *)keys
             NSURL *sourceURL = [self _sourceURLForLogicalPath: path];
             NSURL *shadowedURL = [self _shadowedURLForLogicalPath: path];
             
+            if (![self _shadowIndexMayContainURL: shadowedURL])
+                shadowedURL = nil;
+            
             return [[[ADBShadowedDirectoryEnumerator alloc] initWithLocalURL: sourceURL
                                                                  shadowedURL: shadowedURL
                                                                  inFilesytem: self
@@ -624,6 +663,8 @@ includingPropertiesForKeys: (NSArray *)keys
     [self.manager createFileAtPath: markerURL.path
                           contents: [NSData data]
                         attributes: nil];
+    
+    [self _indexShadowedURL: markerURL];
 }
 
 - (BOOL) _transferItemAtPath: (NSString *)fromPath
@@ -641,7 +682,7 @@ includingPropertiesForKeys: (NSArray *)keys
         NSURL *toDeletionMarkerURL = [shadowedToURL URLByAppendingPathExtension: ADBShadowedDeletionMarkerExtension];
         
         //If the source path has been marked as deleted, then the operation should fail.
-        if ([fromDeletionMarkerURL checkResourceIsReachableAndReturnError: NULL])
+        if ([self _shadowedItemExistsAtURL: fromDeletionMarkerURL])
         {
             if (outError)
             {
@@ -684,7 +725,8 @@ includingPropertiesForKeys: (NSArray *)keys
         
         //If the source file has a shadow, try using that as the source initially,
         //falling back on the original source if that fails.
-        BOOL succeeded = [self.manager copyItemAtURL: shadowedFromURL
+        BOOL succeeded = [self _shadowIndexMayContainURL: shadowedFromURL] &&
+                         [self.manager copyItemAtURL: shadowedFromURL
                                                toURL: shadowedToURL
                                                error: NULL];
         
@@ -698,6 +740,9 @@ includingPropertiesForKeys: (NSArray *)keys
         
         if (succeeded)
         {
+            //This will also pick up the contents of any directory that was copied.
+            [self _indexShadowedURL: shadowedToURL];
+            
             //If the initial copy succeeded, then remove any shadowed source and flag
             //the original source as deleted (since it has ostensibly been moved.)
             if (!copy)
@@ -732,6 +777,109 @@ includingPropertiesForKeys: (NSArray *)keys
 }
 
 
+#pragma mark - Shadow index
+
+//IMPLEMENTATION NOTE: the filesystem is used from both the emulation thread and the main thread,
+//so all access to the index is synchronized.
+- (NSMutableSet *) shadowIndex
+{
+    @synchronized(self)
+    {
+        if (!_shadowIndex && self.shadowURL)
+        {
+            _shadowIndex = [[NSMutableSet alloc] init];
+            
+            if ([self.shadowURL checkResourceIsReachableAndReturnError: NULL])
+            {
+                [_shadowIndex addObject: [self _shadowIndexKeyForShadowedURL: self.shadowURL]];
+                
+                NSDirectoryEnumerator *enumerator = [self.manager enumeratorAtURL: self.shadowURL
+                                                       includingPropertiesForKeys: nil
+                                                                          options: 0
+                                                                     errorHandler: nil];
+                
+                for (NSURL *shadowedURL in enumerator)
+                {
+                    [_shadowIndex addObject: [self _shadowIndexKeyForShadowedURL: shadowedURL]];
+                }
+            }
+        }
+        return [[_shadowIndex retain] autorelease];
+    }
+}
+
+- (NSString *) _shadowIndexKeyForShadowedURL: (NSURL *)URL
+{
+    NSString *relativePath = [URL pathRelativeToURL: self.shadowURL];
+    return [@"/" stringByAppendingPathComponent: relativePath].lowercaseString;
+}
+
+- (BOOL) _shadowIndexMayContainURL: (NSURL *)URL
+{
+    //We can't vouch for anything outside the shadow location.
+    if (![URL isBasedInURL: self.shadowURL])
+        return YES;
+    
+    NSString *key = [self _shadowIndexKeyForShadowedURL: URL];
+    @synchronized(self)
+    {
+        return [self.shadowIndex containsObject: key];
+    }
+}
+
+- (BOOL) _shadowedItemExistsAtURL: (NSURL *)URL
+{
+    return [self _shadowIndexMayContainURL: URL] && [URL checkResourceIsReachableAndReturnError: NULL];
+}
+
+- (void) _indexShadowedURL: (NSURL *)URL
+{
+    if (![URL isBasedInURL: self.shadowURL])
+        return;
+    
+    //Add the URL and all the directories leading up to it within the shadow location.
+    NSMutableArray *keys = [NSMutableArray arrayWithCapacity: 10];
+    NSString *key = [self _shadowIndexKeyForShadowedURL: URL];
+    while (key.length)
+    {
+        [keys addObject: key];
+        if ([key isEqualToString: @"/"])
+            break;
+        key = key.stringByDeletingLastPathComponent;
+    }
+    
+    //If this was a directory that was copied wholesale into the shadow,
+    //then its contents need indexing too.
+    NSNumber *isDirFlag = nil;
+    [URL getResourceValue: &isDirFlag forKey: NSURLIsDirectoryKey error: NULL];
+    if (isDirFlag.boolValue)
+    {
+        NSDirectoryEnumerator *enumerator = [self.manager enumeratorAtURL: URL
+                                               includingPropertiesForKeys: nil
+                                                                  options: 0
+                                                             errorHandler: nil];
+        for (NSURL *subURL in enumerator)
+        {
+            [keys addObject: [self _shadowIndexKeyForShadowedURL: subURL]];
+        }
+    }
+    
+    @synchronized(self)
+    {
+        [self.shadowIndex addObjectsFromArray: keys];
+    }
+}
+
+- (void) _invalidateShadowIndex
+{
+    @synchronized(self)
+    {
+        [_shadowIndex release];
+        _shadowIndex = nil;
+    }
+}
+
+
 #pragma mark - Housekeeping
 
 - (BOOL) tidyShadowContentsForPath: (NSString *)path
@@ -825,6 +973,8 @@ includingPropertiesForKeys: (NSArray *)keys
         NSError *removalError;
         BOOL removedShadow = [self.manager removeItemAtURL: baseShadowURL error: &removalError];
         
+        [self _invalidateShadowIndex];
+        
         //Ignore failure if the shadow simply didn't exist.
         if (!removedShadow)
         {
@@ -996,6 +1146,8 @@ includingPropertiesForKeys: (NSArray *)keys
         //Remove the base shadow URL altogether.
         [self.manager removeItemAtURL: baseShadowedURL error: NULL];
         
+        [self _invalidateShadowIndex];
+        
         return YES;
     }
     else
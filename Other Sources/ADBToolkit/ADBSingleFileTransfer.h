@@ -29,6 +29,13 @@
 //ADBFileTransfer transfers only a single file/directory to a single destination: see also
 //ADBFileTransferSet for a batch transfer operation.
 
+//Moves are performed by FSFileOperation. Copies are performed by our own engine instead:
+//when the source and destination are on the same volume and the filesystem supports it,
+//the source is cloned in a single step; otherwise the files within it are copied several
+//at a time, which keeps fast disks busy when copying lots of small files. Files that are at
+//least streamingBufferSize in size can be streamed through a buffer instead of being handed
+//to copyfile(), which suits large files that will only be read once, such as disc images.
+
 
 #import "ADBOperation.h"
 #import "ADBFileTransfer.h"
@@ -36,6 +43,9 @@
 //The default interval in seconds at which to poll the progress of the file transfer.
 #define ADBFileTransferDefaultPollInterval 0.5
 
+//The maximum number of files that a single transfer will copy at once.
+#define ADBFileTransferMaxConcurrentCopies 4
+
 @interface ADBSingleFileTransfer : ADBOperation <ADBFileTransfer>
 {
 	BOOL _copyFiles;
@@ -55,6 +65,11 @@
 	NSTimeInterval _pollInterval;
 	
 	BOOL _hasCreatedFiles;
+    NSUInteger _streamingBufferSize;
+    
+    //Running totals updated by the worker threads of a copy.
+    volatile int64_t _bytesCopied;
+    volatile int32_t _filesCopied;
 }
 
 #pragma mark -
@@ -74,6 +89,11 @@
 //Whether to copy or move the file(s) in the transfer.
 @property (assign) BOOL copyFiles;
 
+//If non-zero, files at least this many bytes in size that cannot be cloned are copied
+//by reading them in page-aligned chunks of this size, bypassing the page cache for the
+//source file, rather than by copyfile(). Defaults to 0.
+@property (assign) NSUInteger streamingBufferSize;
+
 #pragma mark -
 #pragma mark Initialization
 
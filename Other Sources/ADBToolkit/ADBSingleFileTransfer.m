@@ -26,6 +26,10 @@
 
 
 #import "ADBSingleFileTransfer.h"
+#import <copyfile.h>
+#import <dlfcn.h>
+#import <sys/stat.h>
+#import <fcntl.h>
 
 #pragma mark -
 #pragma mark Notification constants and keys
@@ -38,6 +42,48 @@ NSString * const ADBFileTransferCurrentPathKey		= @"ADBFileTransferCurrentPathKe
 
 
 
+#pragma mark -
+#pragma mark Cloning and copying helpers
+
+//clonefile() only exists on 10.12 and above, so we look it up at runtime rather than linking to it.
+typedef int (*ADBCloneFileFunction)(const char *src, const char *dst, uint32_t flags);
+#define ADBCloneNoFollow 0x0001 //CLONE_NOFOLLOW
+
+static ADBCloneFileFunction _ADBCloneFile(void)
+{
+    static ADBCloneFileFunction cloneFile = NULL;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        cloneFile = (ADBCloneFileFunction)dlsym(RTLD_DEFAULT, "clonefile");
+    });
+    return cloneFile;
+}
+
+//Tracks how much of a single file copyfile() has copied so far,
+//so that each progress callback only adds what's new to the transfer's total.
+typedef struct {
+    ADBSingleFileTransfer *transfer;
+    volatile int64_t *totalBytes;
+    off_t bytesCounted;
+} ADBCopyProgress;
+
+static int _ADBCopyProgressCallback(int what, int stage, copyfile_state_t state,
+                                    const char *src, const char *dst, void *context)
+{
+    ADBCopyProgress *progress = (ADBCopyProgress *)context;
+    if (what == COPYFILE_COPY_DATA && stage == COPYFILE_PROGRESS)
+    {
+        off_t copied = 0;
+        if (copyfile_state_get(state, COPYFILE_STATE_COPIED, &copied) == 0 && copied > progress->bytesCounted)
+        {
+            __sync_add_and_fetch(progress->totalBytes, (int64_t)(copied - progress->bytesCounted));
+            progress->bytesCounted = copied;
+        }
+    }
+    return progress->transfer.isCancelled ? COPYFILE_QUIT : COPYFILE_CONTINUE;
+}
+
+
 #pragma mark -
 #pragma mark Private method declarations
 
@@ -52,6 +98,29 @@ NSString * const ADBFileTransferCurrentPathKey		= @"ADBFileTransferCurrentPathKe
 //Start up the FSFileOperation. Returns NO and populates @error if the transfer could not be started.
 - (BOOL) _beginTransfer;
 
+//Creates the folder that the destination will go into, if it doesn't exist yet.
+//Returns NO and populates @error if the folder could not be created.
+- (BOOL) _prepareDestinationFolder;
+
+//Copies the source to the destination, cloning it if possible and copying its files concurrently otherwise.
+//Used in place of FSFileOperation for copies.
+- (void) _performCopy;
+
+//Attempts to clone the source to the destination. Returns NO if cloning isn't possible,
+//in which case the caller should fall back on copying: or populates @error if it failed outright.
+- (BOOL) _cloneSource;
+
+//Copies a single file or symlink, adding its bytes to our running totals as they're copied.
+//Called from worker threads.
+- (void) _copyItemAtPath: (NSString *)sourcePath toPath: (NSString *)destinationPath size: (unsigned long long)size;
+
+//Copies a regular file by streaming it through a buffer of streamingBufferSize bytes, then copies
+//its metadata. Returns 0 on success or an errno value on failure. Called from worker threads.
+- (int) _streamFileAtPath: (NSString *)sourcePath toPath: (NSString *)destinationPath progress: (ADBCopyProgress *)progress;
+
+//Publishes the worker threads' running totals and sends a progress notification.
+- (void) _reportCopyProgress;
+
 //Called periodically by a timer, to check the progress of the FSFileOperation.
 - (void) _checkTransferProgress;
 
@@ -63,6 +132,7 @@ NSString * const ADBFileTransferCurrentPathKey		= @"ADBFileTransferCurrentPathKe
 
 @implementation ADBSingleFileTransfer
 @synthesize copyFiles = _copyFiles, pollInterval = _pollInterval;
+@synthesize streamingBufferSize = _streamingBufferSize;
 @synthesize sourcePath = _sourcePath, destinationPath = _destinationPath, currentPath = _currentPath;
 @synthesize numFiles = _numFiles, filesTransferred = _filesTransferred;
 @synthesize numBytes = _numBytes, bytesTransferred = _bytesTransferred;
@@ -154,6 +224,13 @@ NSString * const ADBFileTransferCurrentPathKey		= @"ADBFileTransferCurrentPathKe
     //of the destination path before beginning, but this was redundant (the file operation would fail
     //under these circumstances anyway) and would lead to race conditions.
     
+    //Copies go through our own engine, which can clone and copy in parallel where FSFileOperation can't.
+    if (self.copyFiles)
+    {
+        [self _performCopy];
+        return;
+    }
+    
 	//Start up the file transfer, bailing out if it could not be started
 	if ([self _beginTransfer])
     {
@@ -188,24 +265,8 @@ NSString * const ADBFileTransferCurrentPathKey		= @"ADBFileTransferCurrentPathKe
 	
 	NSString *destinationBase = self.destinationPath.stringByDeletingLastPathComponent;
 	
-	//If the destination base folder does not yet exist, create it and any intermediate directories
-	if (![_manager fileExistsAtPath: destinationBase])
-	{
-		NSError *dirError = nil;
-		BOOL created = [_manager createDirectoryAtPath: destinationBase
-						   withIntermediateDirectories: YES
-											attributes: nil
-												 error: &dirError];
-		if (created)
-		{
-			_hasCreatedFiles = YES;
-		}
-		else
-		{
-			self.error = dirError;
-			return NO;
-		}
-	}
+	if (![self _prepareDestinationFolder])
+        return NO;
 	
 	const char *srcPath = self.sourcePath.fileSystemRepresentation;
 	//FSPathCopyObjectAsync expects the destination base path and filename to be provided separately
@@ -252,6 +313,331 @@ NSString * const ADBFileTransferCurrentPathKey		= @"ADBFileTransferCurrentPathKe
 	return YES;
 }
 
+- (BOOL) _prepareDestinationFolder
+{
+	NSString *destinationBase = self.destinationPath.stringByDeletingLastPathComponent;
+	
+	//If the destination base folder does not yet exist, create it and any intermediate directories
+	if (![_manager fileExistsAtPath: destinationBase])
+	{
+		NSError *dirError = nil;
+		BOOL created = [_manager createDirectoryAtPath: destinationBase
+						   withIntermediateDirectories: YES
+											attributes: nil
+												 error: &dirError];
+		if (created)
+		{
+			_hasCreatedFiles = YES;
+		}
+		else
+		{
+			self.error = dirError;
+			return NO;
+		}
+	}
+    return YES;
+}
+
+- (void) _performCopy
+{
+    if (![self _prepareDestinationFolder])
+        return;
+    
+    //Tally up everything we'll be copying first, so that progress can be reported in bytes from the start.
+    NSMutableArray *folders = [NSMutableArray array];
+    NSMutableArray *files = [NSMutableArray array];
+    NSMutableArray *fileSizes = [NSMutableArray array];
+    unsigned long long totalBytes = 0;
+    
+    NSDictionary *sourceAttrs = [_manager attributesOfItemAtPath: self.sourcePath error: NULL];
+    if ([sourceAttrs.fileType isEqualToString: NSFileTypeDirectory])
+    {
+        [folders addObject: @""];
+        NSDirectoryEnumerator *enumerator = [_manager enumeratorAtPath: self.sourcePath];
+        for (NSString *relativePath in enumerator)
+        {
+            NSDictionary *attrs = enumerator.fileAttributes;
+            if ([attrs.fileType isEqualToString: NSFileTypeDirectory])
+            {
+                [folders addObject: relativePath];
+            }
+            else
+            {
+                [files addObject: relativePath];
+                [fileSizes addObject: @(attrs.fileSize)];
+                totalBytes += attrs.fileSize;
+            }
+        }
+    }
+    else
+    {
+        [files addObject: @""];
+        [fileSizes addObject: @(sourceAttrs.fileSize)];
+        totalBytes += sourceAttrs.fileSize;
+    }
+    
+    self.numFiles = files.count;
+    self.numBytes = totalBytes;
+    
+    //Try cloning the whole thing in one go first: this costs next to nothing on filesystems that support it.
+    if ([self _cloneSource])
+    {
+        _hasCreatedFiles = YES;
+        self.filesTransferred = self.numFiles;
+        self.bytesTransferred = self.numBytes;
+        return;
+    }
+    else if (self.error)
+    {
+        return;
+    }
+    
+    //Otherwise, recreate the folder structure up front and then copy files into it several at a time.
+    for (NSString *relativePath in folders)
+    {
+        NSString *destinationFolder = [self.destinationPath stringByAppendingPathComponent: relativePath];
+        NSError *dirError = nil;
+        if (![_manager createDirectoryAtPath: destinationFolder
+                 withIntermediateDirectories: YES
+                                  attributes: nil
+                                       error: &dirError])
+        {
+            self.error = dirError;
+            return;
+        }
+        _hasCreatedFiles = YES;
+    }
+    
+    _bytesCopied = 0;
+    _filesCopied = 0;
+    
+    dispatch_queue_t queue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+    dispatch_group_t group = dispatch_group_create();
+    dispatch_semaphore_t slots = dispatch_semaphore_create(ADBFileTransferMaxConcurrentCopies);
+    int64_t pollNanoseconds = (int64_t)(self.pollInterval * NSEC_PER_SEC);
+    
+    NSUInteger i, numFiles = files.count;
+    for (i=0; i<numFiles; i++)
+    {
+        //Report on progress while we wait for a free worker.
+        while (dispatch_semaphore_wait(slots, dispatch_time(DISPATCH_TIME_NOW, pollNanoseconds)) != 0)
+            [self _reportCopyProgress];
+        
+        if (self.isCancelled || self.error)
+        {
+            dispatch_semaphore_signal(slots);
+            break;
+        }
+        
+        NSString *relativePath = [files objectAtIndex: i];
+        NSString *sourcePath = [self.sourcePath stringByAppendingPathComponent: relativePath];
+        NSString *destinationPath = [self.destinationPath stringByAppendingPathComponent: relativePath];
+        unsigned long long size = [[fileSizes objectAtIndex: i] unsignedLongLongValue];
+        
+        self.currentPath = sourcePath;
+        _hasCreatedFiles = YES;
+        
+        dispatch_group_async(group, queue, ^{
+            [self _copyItemAtPath: sourcePath toPath: destinationPath size: size];
+            dispatch_semaphore_signal(slots);
+        });
+    }
+    
+    while (dispatch_group_wait(group, dispatch_time(DISPATCH_TIME_NOW, pollNanoseconds)) != 0)
+        [self _reportCopyProgress];
+    
+    dispatch_release(group);
+    dispatch_release(slots);
+    
+    [self _reportCopyProgress];
+    
+    //Copy each folder's own attributes once its contents are in place, so that its modification date sticks.
+    //Go deepest-first for the same reason.
+    if (!self.isCancelled && !self.error)
+    {
+        for (NSString *relativePath in folders.reverseObjectEnumerator)
+        {
+            NSString *sourceFolder = [self.sourcePath stringByAppendingPathComponent: relativePath];
+            NSString *destinationFolder = [self.destinationPath stringByAppendingPathComponent: relativePath];
+            copyfile(sourceFolder.fileSystemRepresentation, destinationFolder.fileSystemRepresentation, NULL, COPYFILE_METADATA);
+        }
+    }
+}
+
+- (BOOL) _cloneSource
+{
+    ADBCloneFileFunction cloneFile = _ADBCloneFile();
+    if (!cloneFile)
+        return NO;
+    
+    //Clones can only be made within the same volume.
+    NSString *destinationBase = self.destinationPath.stringByDeletingLastPathComponent;
+    struct stat sourceStatus, destinationStatus;
+    if (lstat(self.sourcePath.fileSystemRepresentation, &sourceStatus) != 0 ||
+        stat(destinationBase.fileSystemRepresentation, &destinationStatus) != 0 ||
+        sourceStatus.st_dev != destinationStatus.st_dev)
+        return NO;
+    
+    if (cloneFile(self.sourcePath.fileSystemRepresentation, self.destinationPath.fileSystemRepresentation, ADBCloneNoFollow) == 0)
+        return YES;
+    
+    //If the filesystem just doesn't support cloning, let the caller copy instead.
+    if (errno == ENOTSUP || errno == EXDEV)
+        return NO;
+    
+    self.error = [NSError errorWithDomain: NSPOSIXErrorDomain
+                                     code: errno
+                                 userInfo: @{ NSFilePathErrorKey: self.sourcePath }];
+    return NO;
+}
+
+- (void) _copyItemAtPath: (NSString *)sourcePath toPath: (NSString *)destinationPath size: (unsigned long long)size
+{
+    ADBCopyProgress progress = { self, &_bytesCopied, 0 };
+    int result, copyError;
+    
+    if (self.streamingBufferSize && size >= self.streamingBufferSize)
+    {
+        copyError = [self _streamFileAtPath: sourcePath toPath: destinationPath progress: &progress];
+        result = copyError ? -1 : 0;
+    }
+    else
+    {
+        copyfile_state_t state = copyfile_state_alloc();
+        copyfile_state_set(state, COPYFILE_STATE_STATUS_CB, (const void *)&_ADBCopyProgressCallback);
+        copyfile_state_set(state, COPYFILE_STATE_STATUS_CTX, &progress);
+        
+        result = copyfile(sourcePath.fileSystemRepresentation,
+                          destinationPath.fileSystemRepresentation,
+                          state,
+                          COPYFILE_ALL | COPYFILE_NOFOLLOW | COPYFILE_EXCL);
+        copyError = errno;
+        
+        copyfile_state_free(state);
+    }
+    
+    if (result == 0)
+    {
+        //Make up any difference between what the callbacks reported and the file's actual size,
+        //so that the totals come out exact (symlinks and empty files get no callbacks at all.)
+        if ((unsigned long long)progress.bytesCounted < size)
+            __sync_add_and_fetch(&_bytesCopied, (int64_t)(size - progress.bytesCounted));
+        __sync_add_and_fetch(&_filesCopied, 1);
+    }
+    else if (!self.isCancelled)
+    {
+        @synchronized(self)
+        {
+            if (!self.error)
+            {
+                self.error = [NSError errorWithDomain: NSPOSIXErrorDomain
+                                                 code: copyError
+                                             userInfo: @{ NSFilePathErrorKey: sourcePath }];
+            }
+        }
+    }
+}
+
+- (int) _streamFileAtPath: (NSString *)sourcePath toPath: (NSString *)destinationPath progress: (ADBCopyProgress *)progress
+{
+    int source = open(sourcePath.fileSystemRepresentation, O_RDONLY | O_NOFOLLOW);
+    if (source < 0)
+        return errno;
+    
+    struct stat sourceStatus;
+    if (fstat(source, &sourceStatus) != 0)
+    {
+        int statError = errno;
+        close(source);
+        return statError;
+    }
+    
+    int destination = open(destinationPath.fileSystemRepresentation, O_WRONLY | O_CREAT | O_EXCL, (sourceStatus.st_mode & 0777) | S_IWUSR);
+    if (destination < 0)
+    {
+        int openError = errno;
+        close(source);
+        return openError;
+    }
+    
+    //The source is only read once, so keep it from pushing everything else out of the page cache.
+    fcntl(source, F_NOCACHE, 1);
+    
+    //Reserve the destination's space up front, in one piece if the filesystem can manage it.
+    fstore_t store = { F_ALLOCATECONTIG | F_ALLOCATEALL, F_PEOFPOSMODE, 0, sourceStatus.st_size, 0 };
+    if (fcntl(destination, F_PREALLOCATE, &store) == -1)
+    {
+        store.fst_flags = F_ALLOCATEALL;
+        fcntl(destination, F_PREALLOCATE, &store);
+    }
+    
+    //Reads straight from disk need a page-aligned buffer.
+    NSUInteger bufferSize = self.streamingBufferSize;
+    void *buffer = NULL;
+    int streamError = posix_memalign(&buffer, (size_t)getpagesize(), bufferSize);
+    
+    while (!streamError)
+    {
+        ssize_t bytesRead = read(source, buffer, bufferSize);
+        if (bytesRead < 0)
+        {
+            if (errno != EINTR)
+                streamError = errno;
+            continue;
+        }
+        if (bytesRead == 0)
+            break;
+        
+        ssize_t bytesWritten = 0;
+        while (bytesWritten < bytesRead)
+        {
+            ssize_t written = write(destination, (char *)buffer + bytesWritten, bytesRead - bytesWritten);
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                streamError = errno;
+                break;
+            }
+            bytesWritten += written;
+        }
+        
+        __sync_add_and_fetch(progress->totalBytes, (int64_t)bytesWritten);
+        progress->bytesCounted += bytesWritten;
+        
+        if (self.isCancelled)
+            streamError = ECANCELED;
+    }
+    
+    free(buffer);
+    close(source);
+    if (close(destination) != 0 && !streamError)
+        streamError = errno;
+    
+    //Bring across everything but the data, now that the data's in place: this also sets the modification date.
+    if (!streamError && copyfile(sourcePath.fileSystemRepresentation, destinationPath.fileSystemRepresentation, NULL, COPYFILE_METADATA) != 0)
+        streamError = errno;
+    
+    return streamError;
+}
+
+- (void) _reportCopyProgress
+{
+    self.bytesTransferred = (unsigned long long)_bytesCopied;
+    self.filesTransferred = (NSUInteger)_filesCopied;
+    
+    NSMutableDictionary *info = [NSMutableDictionary dictionaryWithDictionary: @{
+        ADBFileTransferFilesTransferredKey: @(self.filesTransferred),
+        ADBFileTransferBytesTransferredKey: @(self.bytesTransferred),
+        ADBFileTransferFilesTotalKey:       @(self.numFiles),
+        ADBFileTransferBytesTotalKey:       @(self.numBytes),
+    }];
+    if (self.currentPath)
+        [info setObject: self.currentPath forKey: ADBFileTransferCurrentPathKey];
+    
+    [self _sendInProgressNotificationWithInfo: info];
+}
+
 - (BOOL) undoTransfer
 {
 	//Delete the destination path to clean up
@@ -27,8 +27,14 @@
 //The ADBMountedVolumes category adds methods to NSWorkspace to retrieve all volumes of a certain type,
 //and to determine the source image for a mounted volume using HDIUtil.
 
-//Note that many of these methods may block for a long time if a mounted network volume is unavailable:
-//NSWorkspace and/or HDIUtil have to wait for network volume connections to time out.
+//The mounted volumes, their filesystem details and the images they were mounted from are kept in
+//a shared table, which is kept up to date from DiskArbitration and NSWorkspace mount notifications:
+//so most of these methods are answered from memory rather than by asking the system (or HDIUtil).
+//The table is gathered again in the background whenever volumes change.
+
+//Note that many of these methods may still block for a long time if a mounted network volume is
+//unavailable, while the table is being gathered: NSWorkspace and/or HDIUtil have to wait for
+//network volume connections to time out.
 
 #import <Cocoa/Cocoa.h>
 
@@ -105,6 +111,7 @@ typedef NS_OPTIONS(NSUInteger, ADBImageMountingOptions) {
                         error: (out NSError **)outError;
 
 //Returns structured plist info from hdiutil about mounted images and their volumes.
+//This is gathered once per change in the mounted volumes, rather than on every call.
 //Returns nil and populates outError if the information could not be retrieved.
 - (NSArray *) mountedImageInfoWithError: (out NSError **)outError;
 
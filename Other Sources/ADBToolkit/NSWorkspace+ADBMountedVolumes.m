@@ -28,6 +28,7 @@
 #import "NSWorkspace+ADBFileTypes.h"
 #import "NSString+ADBPaths.h"
 #import "NSURL+ADBFilesystemHelpers.h"
+#import <DiskArbitration/DiskArbitration.h>
 #include <sys/mount.h>
 
 
@@ -41,6 +42,10 @@ NSString * const ADBHFSVolumeType		= @"hfs";
 //FAT volumes smaller than 2MB will be treated as floppy drives by isFloppyDriveAtPath.
 #define ADBFloppySizeCutoff 2 * 1024 * 1024
 
+//How long the volume table waits after a volume change before gathering volumes again,
+//so that a burst of changes (such as the partitions of a newly-inserted disk) is handled at once.
+#define ADBMountedVolumeTableRefreshDelay 0.25
+
 
 #pragma mark - Error helper classes
 
@@ -56,15 +61,66 @@ NSString * const ADBMountedVolumesErrorDomain = @"ADBMountedVolumesErrorDomain";
 @end
 
 
+#pragma mark - Volume table
+
+//Keys for the details ADBMountedVolumeTable records for each volume.
+static NSString * const ADBVolumeTypeKey        = @"type";
+static NSString * const ADBVolumeDeviceNameKey  = @"deviceName";
+static NSString * const ADBVolumeRemovableKey   = @"removable";
+static NSString * const ADBVolumeWritableKey    = @"writable";
+
+//ADBMountedVolumeTable keeps a live record of the mounted volumes, their filesystem details,
+//and which disk images they were mounted from, so that the methods below can answer from memory
+//instead of asking NSFileManager, statfs and hdiutil each time. It listens to DiskArbitration and
+//NSWorkspace for volumes appearing, disappearing and being renamed: any of these clears the table
+//and schedules it to be gathered again in the background. A query made while the table is being
+//gathered waits for it to finish.
+@interface ADBMountedVolumeTable : NSObject
+{
+    dispatch_queue_t _queue;
+    DASessionRef _session;
+    BOOL _refreshScheduled;
+
+    //Everything below is only accessed on _queue, and is nil until it has been gathered.
+    NSArray *_volumeURLs;
+    NSArray *_visibleVolumeURLs;
+    NSDictionary *_volumeDetails;       //Volume details keyed by the volume's path.
+    NSArray *_imageInfo;                //As returned by hdiutil info.
+}
+
++ (ADBMountedVolumeTable *) sharedTable;
+
+- (NSArray *) volumeURLsIncludingHidden: (BOOL)hidden;
+
+//Returns the recorded details of the volume mounted at the specified URL,
+//or nil if the URL is not the root of a mounted volume.
+- (NSDictionary *) detailsOfVolumeAtURL: (NSURL *)volumeURL;
+
+//Returns hdiutil's information about mounted images, or nil and populates outError
+//if it could not be retrieved.
+- (NSArray *) imageInfoWithError: (out NSError **)outError;
+
+//Discards everything the table knows and schedules it to be gathered again.
+- (void) invalidate;
+
+@end
+
+
+@interface NSWorkspace (ADBMountedVolumesPrivate)
+
+//Asks hdiutil for information about the currently-mounted images. Used by ADBMountedVolumeTable.
+- (NSArray *) _mountedImageInfoFromHDIUtilWithError: (out NSError **)outError;
+
+@end
+
+
 #pragma mark - Implementation
 
 @implementation NSWorkspace (ADBMountedVolumes)
 
 - (NSArray *) mountedVolumeURLsIncludingHidden: (BOOL)hidden
 {
-    NSVolumeEnumerationOptions options = (hidden) ? 0 : NSVolumeEnumerationSkipHiddenVolumes;
-    return [[NSFileManager defaultManager] mountedVolumeURLsIncludingResourceValuesForKeys: nil
-                                                                                   options: options];
+    return [[ADBMountedVolumeTable sharedTable] volumeURLsIncludingHidden: hidden];
 }
 
 - (NSArray *) mountedVolumeURLsOfType: (NSString *)requiredType includingHidden: (BOOL)hidden
@@ -110,6 +166,11 @@ NSString * const ADBMountedVolumesErrorDomain = @"ADBMountedVolumesErrorDomain";
 {
     NSAssert(URL != nil, @"No URL provided!");
     
+    //Volumes we already know about can be answered from the volume table.
+    NSDictionary *volumeDetails = [[ADBMountedVolumeTable sharedTable] detailsOfVolumeAtURL: URL];
+    if (volumeDetails)
+        return [volumeDetails objectForKey: ADBVolumeTypeKey];
+
     //IMPLEMENTATION NOTE: we stick with the NSWorkspace API for this because as of 10.7, the patchy NSURL API
     //does not provide any way to get for the volume type (just the volume's localized format description).
 	NSString *volumeType;
@@ -219,6 +280,10 @@ NSString * const ADBMountedVolumesErrorDomain = @"ADBMountedVolumesErrorDomain";
         if (!hdiInfo)
             return nil;
         
+        //Don't wait for DiskArbitration to tell the volume table about the new volumes,
+        //since our caller is likely to ask about them straight away.
+        [[ADBMountedVolumeTable sharedTable] invalidate];
+
 		NSArray *mountPoints = [hdiInfo objectForKey: @"system-entities"];
         NSMutableArray *mountedVolumeURLs = [NSMutableArray arrayWithCapacity: mountPoints.count];
 		for (NSDictionary *mountPoint in mountPoints)
@@ -234,9 +299,14 @@ NSString * const ADBMountedVolumesErrorDomain = @"ADBMountedVolumesErrorDomain";
 	}
 }
 
+- (NSArray *) mountedImageInfoWithError: (out NSError **)outError
+{
+    return [[ADBMountedVolumeTable sharedTable] imageInfoWithError: outError];
+}
+
 //Return the currently-mounted images as reported by hdiutil in plist format.
 //Returns nil and populates outError if the data could not be retrieved.
-- (NSArray *) mountedImageInfoWithError: (out NSError **)outError
+- (NSArray *) _mountedImageInfoFromHDIUtilWithError: (out NSError **)outError
 {
 	NSTask *hdiutil = [[NSTask alloc] init];
 	NSPipe *outputPipe = [NSPipe pipe];
@@ -292,18 +362,10 @@ NSString * const ADBMountedVolumesErrorDomain = @"ADBMountedVolumesErrorDomain";
 - (NSURL *) sourceImageForVolumeAtURL: (NSURL *)volumeURL
 {
     NSURL *resolvedURL = volumeURL.URLByResolvingSymlinksInPath;
-    
-    //Preflight checks: if the URL doesn't exist or doesn't represent
-    //the root of a volume, don't bother checking further.
-    //(This is important because scanning for image mounts can be time-consuming and will block.)
-    if (![resolvedURL checkResourceIsReachableAndReturnError: NULL])
-        return nil;
 
-    NSNumber *isVolumeFlag = nil;
-    BOOL checkedVolume = [resolvedURL getResourceValue: &isVolumeFlag
-                                                forKey: NSURLIsVolumeKey
-                                                 error: NULL];
-    if (!checkedVolume || !isVolumeFlag.boolValue)
+    //Preflight check: if the URL doesn't represent the root of a mounted volume,
+    //don't bother checking further.
+    if (![[ADBMountedVolumeTable sharedTable] detailsOfVolumeAtURL: resolvedURL])
         return nil;
     
     NSString *resolvedPath = resolvedURL.path;
@@ -362,6 +424,10 @@ NSString * const ADBMountedVolumesErrorDomain = @"ADBMountedVolumesErrorDomain";
 //Returns nil if no matching device name could be determined.
 - (NSString *) BSDDeviceNameForVolumeAtURL: (NSURL *)volumeURL
 {
+    NSDictionary *volumeDetails = [[ADBMountedVolumeTable sharedTable] detailsOfVolumeAtURL: volumeURL];
+    if (volumeDetails)
+        return [volumeDetails objectForKey: ADBVolumeDeviceNameKey];
+
 	NSString *deviceName = nil;
 	struct statfs fs;
 	
@@ -418,12 +484,19 @@ NSString * const ADBMountedVolumesErrorDomain = @"ADBMountedVolumesErrorDomain";
     BOOL isRemovable, isWriteable;
     NSString *fsType;
     
-    if (![self getFileSystemInfoForPath: volumeURL.path
-                            isRemovable: &isRemovable
-                             isWritable: &isWriteable
-                          isUnmountable: NULL
-                            description: NULL
-                                   type: &fsType])
+    NSDictionary *volumeDetails = [[ADBMountedVolumeTable sharedTable] detailsOfVolumeAtURL: volumeURL];
+    if (volumeDetails)
+    {
+        isRemovable = [[volumeDetails objectForKey: ADBVolumeRemovableKey] boolValue];
+        isWriteable = [[volumeDetails objectForKey: ADBVolumeWritableKey] boolValue];
+        fsType = [volumeDetails objectForKey: ADBVolumeTypeKey];
+    }
+    else if (![self getFileSystemInfoForPath: volumeURL.path
+                                 isRemovable: &isRemovable
+                                  isWritable: &isWriteable
+                               isUnmountable: NULL
+                                 description: NULL
+                                        type: &fsType])
         return nil;
     
     //The Mac part of the hybrid CD is expected to be removable,
@@ -572,6 +645,180 @@ NSString * const ADBMountedVolumesErrorDomain = @"ADBMountedVolumesErrorDomain";
 @end
 
 
+@implementation ADBMountedVolumeTable
+
++ (ADBMountedVolumeTable *) sharedTable
+{
+    static ADBMountedVolumeTable *table;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        table = [[self alloc] init];
+    });
+    return table;
+}
+
+static void _ADBMountedVolumeTableDiskDidChange(DADiskRef disk, void *context)
+{
+    [(ADBMountedVolumeTable *)context invalidate];
+}
+
+static void _ADBMountedVolumeTableDiskDescriptionDidChange(DADiskRef disk, CFArrayRef keys, void *context)
+{
+    [(ADBMountedVolumeTable *)context invalidate];
+}
+
+- (id) init
+{
+    self = [super init];
+    if (self)
+    {
+        _queue = dispatch_queue_create("com.adbtoolkit.mountedvolumes", DISPATCH_QUEUE_SERIAL);
+
+        //DiskArbitration tells us about disks appearing and disappearing, and about volumes being
+        //mounted and unmounted on them. The table is only ever shared, so is never torn down.
+        _session = DASessionCreate(kCFAllocatorDefault);
+        if (_session)
+        {
+            DARegisterDiskAppearedCallback(_session, NULL, _ADBMountedVolumeTableDiskDidChange, self);
+            DARegisterDiskDisappearedCallback(_session, NULL, _ADBMountedVolumeTableDiskDidChange, self);
+            DARegisterDiskDescriptionChangedCallback(_session, NULL, kDADiskDescriptionWatchVolumePath,
+                                                     _ADBMountedVolumeTableDiskDescriptionDidChange, self);
+            DASessionSetDispatchQueue(_session, _queue);
+        }
+
+        //NSWorkspace covers what DiskArbitration doesn't, such as network volumes and renames.
+        NSNotificationCenter *center = [[NSWorkspace sharedWorkspace] notificationCenter];
+        for (NSString *name in @[NSWorkspaceDidMountNotification, NSWorkspaceDidUnmountNotification, NSWorkspaceDidRenameVolumeNotification])
+        {
+            [center addObserver: self
+                       selector: @selector(_volumesDidChange:)
+                           name: name
+                         object: nil];
+        }
+    }
+    return self;
+}
+
+- (void) _volumesDidChange: (NSNotification *)notification
+{
+    [self invalidate];
+}
+
+- (void) invalidate
+{
+    dispatch_async(_queue, ^{
+        [_volumeURLs release], _volumeURLs = nil;
+        [_visibleVolumeURLs release], _visibleVolumeURLs = nil;
+        [_volumeDetails release], _volumeDetails = nil;
+        [_imageInfo release], _imageInfo = nil;
+
+        if (!_refreshScheduled)
+        {
+            _refreshScheduled = YES;
+            dispatch_time_t refreshTime = dispatch_time(DISPATCH_TIME_NOW, (int64_t)(ADBMountedVolumeTableRefreshDelay * NSEC_PER_SEC));
+            dispatch_after(refreshTime, _queue, ^{
+                _refreshScheduled = NO;
+                [self _gatherVolumes];
+                [self _gatherImageInfoWithError: NULL];
+            });
+        }
+    });
+}
+
+//Must be called on _queue.
+- (void) _gatherVolumes
+{
+    if (_volumeURLs) return;
+
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+
+    NSFileManager *manager = [NSFileManager defaultManager];
+    _volumeURLs = [[manager mountedVolumeURLsIncludingResourceValuesForKeys: @[NSURLVolumeIsRemovableKey]
+                                                                    options: 0] retain];
+    _visibleVolumeURLs = [[manager mountedVolumeURLsIncludingResourceValuesForKeys: nil
+                                                                           options: NSVolumeEnumerationSkipHiddenVolumes] retain];
+
+    NSMutableDictionary *volumeDetails = [NSMutableDictionary dictionaryWithCapacity: _volumeURLs.count];
+    for (NSURL *volumeURL in _volumeURLs)
+    {
+        struct statfs fs;
+        if (statfs(volumeURL.fileSystemRepresentation, &fs) != ERR_SUCCESS)
+            continue;
+
+        NSNumber *removableFlag = nil;
+        [volumeURL getResourceValue: &removableFlag forKey: NSURLVolumeIsRemovableKey error: NULL];
+
+        NSDictionary *details = @{
+            ADBVolumeTypeKey: [manager stringWithFileSystemRepresentation: fs.f_fstypename length: strlen(fs.f_fstypename)],
+            ADBVolumeDeviceNameKey: [manager stringWithFileSystemRepresentation: fs.f_mntfromname length: strlen(fs.f_mntfromname)],
+            ADBVolumeRemovableKey: @(removableFlag.boolValue),
+            ADBVolumeWritableKey: @((fs.f_flags & MNT_RDONLY) == 0),
+        };
+
+        [volumeDetails setObject: details forKey: volumeURL.path];
+    }
+    _volumeDetails = [volumeDetails copy];
+
+    [pool drain];
+}
+
+//Must be called on _queue.
+- (BOOL) _gatherImageInfoWithError: (out NSError **)outError
+{
+    if (_imageInfo) return YES;
+
+    _imageInfo = [[[NSWorkspace sharedWorkspace] _mountedImageInfoFromHDIUtilWithError: outError] retain];
+    return (_imageInfo != nil);
+}
+
+- (NSArray *) volumeURLsIncludingHidden: (BOOL)hidden
+{
+    __block NSArray *volumeURLs;
+    dispatch_sync(_queue, ^{
+        [self _gatherVolumes];
+        volumeURLs = [(hidden ? _volumeURLs : _visibleVolumeURLs) retain];
+    });
+    return [volumeURLs autorelease];
+}
+
+- (NSDictionary *) detailsOfVolumeAtURL: (NSURL *)volumeURL
+{
+    NSString *volumePath = volumeURL.path.stringByStandardizingPath;
+    __block NSDictionary *details;
+    dispatch_sync(_queue, ^{
+        [self _gatherVolumes];
+        details = [[_volumeDetails objectForKey: volumePath] retain];
+    });
+    return [details autorelease];
+}
+
+- (NSArray *) imageInfoWithError: (out NSError **)outError
+{
+    __block NSArray *imageInfo;
+    __block NSError *imageInfoError = nil;
+    dispatch_sync(_queue, ^{
+        if ([self _gatherImageInfoWithError: &imageInfoError])
+        {
+            imageInfo = [_imageInfo retain];
+        }
+        else
+        {
+            imageInfo = nil;
+            [imageInfoError retain];
+        }
+    });
+
+    if (!imageInfo && outError)
+        *outError = [imageInfoError autorelease];
+    else
+        [imageInfoError release];
+
+    return [imageInfo autorelease];
+}
+
+@end
+
+
 @implementation ADBMountedVolumesError
 @end
 
@@ -124,6 +124,26 @@ extern NSString * const ADBShaderUniformSizeKey;
                                         error: (NSError **)outError;
 
 
+#pragma mark -
+#pragma mark Program caching
+
+//Shader programs created by initWithVertexShader:fragmentShaders:inContext:error: are cached
+//per context, keyed by a digest of their source code, so that creating another shader from the
+//same sources in the same context reuses the already-linked program instead of recompiling it.
+//Cached programs are owned by the cache and not by the shaders that use them.
+
+//Returns a previously-cached program linked from the specified sources in the specified context,
+//or NULL if no such program has been cached.
++ (GLhandleARB) cachedProgramWithVertexShader: (NSString *)vertexSource
+                              fragmentShaders: (NSArray *)fragmentSources
+                                    inContext: (CGLContextObj)context;
+
+//Deletes all cached programs for the specified context and releases the cache's hold on it.
+//This must be called before the context is destroyed: any shaders still using cached programs
+//from that context should not be used afterwards.
++ (void) purgeCachedProgramsInContext: (CGLContextObj)context;
+
+
 #pragma mark -
 #pragma mark Initialization
 
@@ -140,6 +160,8 @@ extern NSString * const ADBShaderUniformSizeKey;
 
 //Returns a new shader compiled from the specified vertex shader and/or fragment shaders,
 //passed as source code. Returns nil and populates outError if the shader could not be compiled.
+//If a program with the same sources has already been compiled in the same context, the cached
+//program will be used instead of compiling a new one.
 - (id) initWithVertexShader: (NSString *)vertexSource
             fragmentShaders: (NSArray *)fragmentSources
                   inContext: (CGLContextObj)context
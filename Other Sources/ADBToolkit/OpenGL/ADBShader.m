@@ -28,6 +28,7 @@
 #import "ADBShader.h"
 #import <OpenGL/gl.h>
 #import <OpenGL/CGLMacro.h>
+#import <CommonCrypto/CommonDigest.h>
 
 
 NSString * const ADBShaderErrorDomain = @"ADBShaderErrorDomain";
@@ -53,8 +54,23 @@ NSString * const ADBShaderUniformSizeKey = @"Size";
 
 @interface ADBShader ()
 @property (readwrite, nonatomic) GLhandleARB shaderProgram;
+
+//Returns the key under which a program linked from the specified sources is cached.
++ (NSString *) _cacheKeyForVertexShader: (NSString *)vertexSource
+                        fragmentShaders: (NSArray *)fragmentSources;
+
+//Adds the specified program to the cache for the specified context.
++ (void) _cacheProgram: (GLhandleARB)program
+       forVertexShader: (NSString *)vertexSource
+       fragmentShaders: (NSArray *)fragmentSources
+             inContext: (CGLContextObj)context;
 @end
 
+
+//Cached shader programs, keyed by context. Each entry is a dictionary
+//of program handles keyed by a digest of the sources they were linked from.
+static NSMutableDictionary *_programsByContext = nil;
+
 @implementation ADBShader
 @synthesize shaderProgram = _shaderProgram;
 @synthesize context = _context;
@@ -302,6 +318,103 @@ NSString * const ADBShaderUniformSizeKey = @"Size";
 }
 
 
+#pragma mark -
+#pragma mark Program caching
+
++ (NSString *) _cacheKeyForVertexShader: (NSString *)vertexSource
+                        fragmentShaders: (NSArray *)fragmentSources
+{
+    CC_SHA1_CTX context;
+    CC_SHA1_Init(&context);
+    
+    //Include a separator after each source, so that the same code split differently
+    //between the vertex and fragment shaders does not produce the same digest.
+    const char separator = '\0';
+    NSArray *sources = [NSArray arrayWithObject: (vertexSource ? vertexSource : @"")];
+    sources = [sources arrayByAddingObjectsFromArray: fragmentSources];
+    for (NSString *source in sources)
+    {
+        NSData *sourceData = [source dataUsingEncoding: NSASCIIStringEncoding allowLossyConversion: YES];
+        CC_SHA1_Update(&context, sourceData.bytes, (CC_LONG)sourceData.length);
+        CC_SHA1_Update(&context, &separator, 1);
+    }
+    
+    unsigned char digest[CC_SHA1_DIGEST_LENGTH];
+    CC_SHA1_Final(digest, &context);
+    
+    NSMutableString *key = [NSMutableString stringWithCapacity: CC_SHA1_DIGEST_LENGTH * 2];
+    NSUInteger i;
+    for (i=0; i<CC_SHA1_DIGEST_LENGTH; i++)
+        [key appendFormat: @"%02x", digest[i]];
+    
+    return key;
+}
+
++ (GLhandleARB) cachedProgramWithVertexShader: (NSString *)vertexSource
+                              fragmentShaders: (NSArray *)fragmentSources
+                                    inContext: (CGLContextObj)context
+{
+    NSString *key = [self _cacheKeyForVertexShader: vertexSource fragmentShaders: fragmentSources];
+    
+    @synchronized([ADBShader class])
+    {
+        NSDictionary *programs = [_programsByContext objectForKey: [NSValue valueWithPointer: context]];
+        NSValue *program = [programs objectForKey: key];
+        if (program)
+            return (GLhandleARB)(uintptr_t)program.pointerValue;
+    }
+    return NULL;
+}
+
++ (void) _cacheProgram: (GLhandleARB)program
+       forVertexShader: (NSString *)vertexSource
+       fragmentShaders: (NSArray *)fragmentSources
+             inContext: (CGLContextObj)context
+{
+    NSString *key = [self _cacheKeyForVertexShader: vertexSource fragmentShaders: fragmentSources];
+    NSValue *contextKey = [NSValue valueWithPointer: context];
+    
+    @synchronized([ADBShader class])
+    {
+        if (!_programsByContext)
+            _programsByContext = [[NSMutableDictionary alloc] initWithCapacity: 1];
+        
+        NSMutableDictionary *programs = [_programsByContext objectForKey: contextKey];
+        if (!programs)
+        {
+            //Keep the context alive for as long as we have programs cached in it,
+            //so that another context cannot turn up at the same address in the meantime.
+            CGLRetainContext(context);
+            programs = [NSMutableDictionary dictionaryWithCapacity: 1];
+            [_programsByContext setObject: programs forKey: contextKey];
+        }
+        
+        [programs setObject: [NSValue valueWithPointer: (const void *)(uintptr_t)program] forKey: key];
+    }
+}
+
++ (void) purgeCachedProgramsInContext: (CGLContextObj)context
+{
+    NSValue *contextKey = [NSValue valueWithPointer: context];
+    
+    @synchronized([ADBShader class])
+    {
+        NSDictionary *programs = [_programsByContext objectForKey: contextKey];
+        if (programs)
+        {
+            CGLContextObj cgl_ctx = context;
+            for (NSValue *program in programs.objectEnumerator)
+            {
+                glDeleteObjectARB((GLhandleARB)(uintptr_t)program.pointerValue);
+            }
+            
+            [_programsByContext removeObjectForKey: contextKey];
+            CGLReleaseContext(context);
+        }
+    }
+}
+
+
 #pragma mark -
 #pragma mark Initialization and deallocation
 
@@ -388,12 +501,30 @@ NSString * const ADBShaderUniformSizeKey = @"Size";
         _context = context;
         CGLRetainContext(context);
         
-        self.shaderProgram = [self.class createProgramWithVertexShader: vertexSource
-                                                       fragmentShaders: fragmentSources
-                                                             inContext: context
-                                                                 error: outError];
+        //Reuse an identical program if we've already compiled one in this context:
+        //otherwise, compile a new one and cache it for next time. Either way the program
+        //belongs to the cache, which will delete it once the context is purged.
+        GLhandleARB program = [self.class cachedProgramWithVertexShader: vertexSource
+                                                        fragmentShaders: fragmentSources
+                                                              inContext: context];
+        
+        if (!program)
+        {
+            program = [self.class createProgramWithVertexShader: vertexSource
+                                                fragmentShaders: fragmentSources
+                                                      inContext: context
+                                                          error: outError];
+            
+            if (program)
+            {
+                [self.class _cacheProgram: program
+                          forVertexShader: vertexSource
+                          fragmentShaders: fragmentSources
+                                inContext: context];
+            }
+        }
         
-        _freeProgramWhenDone = YES;
+        [self setShaderProgram: program freeWhenDone: NO];
         
         //If we couldn't compile a shader program from the specified sources,
         //pack up and go home.
@@ -39,6 +39,9 @@
     CGLContextObj _context;
     GLuint _texture;
     GLenum _type;
+    GLenum _internalFormat;
+    GLenum _pixelFormat;
+    GLenum _pixelType;
     CGSize _textureSize;
     CGRect _contentRegion;
     
@@ -59,6 +62,16 @@
 //The type of this texture: one of GL_TEXTURE_2D or GL_TEXTURE_RECTANGLE.
 @property (readonly, nonatomic) GLenum type;
 
+//The format in which the texture stores its texels, and the format and packing in which
+//its texel data is uploaded. By default these are GL_RGBA8, GL_BGRA and GL_UNSIGNED_INT_8_8_8_8_REV.
+@property (readonly, nonatomic) GLenum internalFormat;
+@property (readonly, nonatomic) GLenum pixelFormat;
+@property (readonly, nonatomic) GLenum pixelType;
+
+//The number of bytes that each texel takes up in uploaded texel data.
+//This is 4 for the default formats, or 1 for single-channel byte formats like GL_RED.
+@property (readonly, nonatomic) NSUInteger bytesPerTexel;
+
 //The size in texels of this texture.
 @property (readonly, nonatomic) CGSize textureSize;
 
@@ -106,16 +119,41 @@
         inGLContext: (CGLContextObj)context
               error: (NSError **)outError;
 
+//As above, but applying the specified GL_TEXTURE_STORAGE_HINT_APPLE value to the texture
+//before its storage is allocated. Pass GL_STORAGE_SHARED_APPLE for textures whose contents will
+//be replaced every frame: the GPU will then read them in place from shared memory instead of
+//waiting for them to be copied into video memory. Pass 0 to use the default storage.
+//The hint is ignored if the context does not support GL_APPLE_texture_range.
+- (id) initWithType: (GLenum)type
+        contentSize: (CGSize)size
+              bytes: (const GLvoid *)bytes
+        storageHint: (GLenum)storageHint
+        inGLContext: (CGLContextObj)context
+              error: (NSError **)outError;
+
+//As above, but storing texels in the specified internal format, and taking bytes (both here
+//and in fillRegion:withBytes:error:) in the specified pixel format and type. Only 4-byte
+//and 1-byte texel formats are supported. Rows of texel data are assumed to be tightly packed.
+- (id) initWithType: (GLenum)type
+        contentSize: (CGSize)size
+              bytes: (const GLvoid *)bytes
+     internalFormat: (GLenum)internalFormat
+        pixelFormat: (GLenum)pixelFormat
+          pixelType: (GLenum)pixelType
+        storageHint: (GLenum)storageHint
+        inGLContext: (CGLContextObj)context
+              error: (NSError **)outError;
+
 //Fills the specified region of the texture (expressed in texels)
-//with the specified bytes, assumed to be in the format GL_BGRA
-//and GL_UNSIGNED_INT_8_8_8_8_REV.
+//with the specified bytes, assumed to be in the texture's pixel format
+//and type: by default GL_BGRA and GL_UNSIGNED_INT_8_8_8_8_REV.
 //Returns NO and populates outError if there was an error and outError was provided.
 - (BOOL) fillRegion: (CGRect)region
           withBytes: (const GLvoid *)bytes
               error: (NSError **)outError;
 
 //Fills the specified region of the texture with the specified color values (ranging from 0 to 1).
-//Mostly used for blanking the texture.
+//Mostly used for blanking the texture. Single-channel textures are filled with the red value.
 - (BOOL) fillRegion: (CGRect)region
             withRed: (CGFloat)red
               green: (CGFloat)green
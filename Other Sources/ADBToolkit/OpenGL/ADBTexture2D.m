@@ -38,6 +38,9 @@
 @synthesize type = _type;
 @synthesize contentRegion = _contentRegion;
 @synthesize textureSize = _textureSize;
+@synthesize internalFormat = _internalFormat;
+@synthesize pixelFormat = _pixelFormat;
+@synthesize pixelType = _pixelType;
 @synthesize usesNormalizedTextureCoordinates = _usesNormalizedTextureCoordinates;
 
 @synthesize horizontalWrapping = _horizontalWrapping;
@@ -61,6 +64,11 @@
     }
 }
 
+- (NSUInteger) bytesPerTexel
+{
+    return (_pixelType == GL_UNSIGNED_BYTE && (_pixelFormat == GL_RED || _pixelFormat == GL_LUMINANCE || _pixelFormat == GL_ALPHA)) ? 1 : 4;
+}
+
 - (BOOL) _checkForGLError: (NSError **)outError
 {
     if (outError)
@@ -92,6 +100,42 @@
               bytes: (const GLvoid *)bytes
         inGLContext: (CGLContextObj)context
               error: (NSError **)outError
+{
+    return [self initWithType: type
+                  contentSize: contentSize
+                        bytes: bytes
+                  storageHint: 0
+                  inGLContext: context
+                        error: outError];
+}
+
+- (id) initWithType: (GLenum)type
+        contentSize: (CGSize)contentSize
+              bytes: (const GLvoid *)bytes
+        storageHint: (GLenum)storageHint
+        inGLContext: (CGLContextObj)context
+              error: (NSError **)outError
+{
+    return [self initWithType: type
+                  contentSize: contentSize
+                        bytes: bytes
+               internalFormat: GL_RGBA8
+                  pixelFormat: GL_BGRA
+                    pixelType: GL_UNSIGNED_INT_8_8_8_8_REV
+                  storageHint: storageHint
+                  inGLContext: context
+                        error: outError];
+}
+
+- (id) initWithType: (GLenum)type
+        contentSize: (CGSize)contentSize
+              bytes: (const GLvoid *)bytes
+     internalFormat: (GLenum)internalFormat
+        pixelFormat: (GLenum)pixelFormat
+          pixelType: (GLenum)pixelType
+        storageHint: (GLenum)storageHint
+        inGLContext: (CGLContextObj)context
+              error: (NSError **)outError
 {
     NSAssert(contentSize.width > 0 && contentSize.height > 0, @"Invalid content size provided: %@", NSStringFromCGSize(contentSize));
     
@@ -104,6 +148,9 @@
         CGLContextObj cgl_ctx = _context;
         
         _type = type;
+        _internalFormat = internalFormat;
+        _pixelFormat = pixelFormat;
+        _pixelType = pixelType;
         _contentRegion = CGRectMake(0, 0, contentSize.width, contentSize.height);
         
         //Choose suitable default wrapping modes based on the texture type,
@@ -138,7 +185,11 @@
         glTexParameteri(_type, GL_TEXTURE_MIN_FILTER, _minFilter);
         glTexParameteri(_type, GL_TEXTURE_MAG_FILTER, _magFilter);
         
-        
+        //The storage hint must be applied before the texture's storage is allocated below.
+        if (storageHint && gluCheckExtension((const GLubyte *)"GL_APPLE_texture_range", glGetString(GL_EXTENSIONS)))
+        {
+            glTexParameteri(_type, GL_TEXTURE_STORAGE_HINT_APPLE, storageHint);
+        }
         
         //If the texture size is the same as the content size, then we can provide the texture
         //data in the initial call already. Otherwise, we'll have to fill it in a separate pass.
@@ -154,7 +205,7 @@
         //then fill the texture initially with pure black.
         else
         {
-            size_t numBytes = _textureSize.width * _textureSize.height * 4;
+            size_t numBytes = _textureSize.width * _textureSize.height * self.bytesPerTexel;
             initialData = (GLvoid *)malloc(numBytes);
             if (initialData)
             {
@@ -163,16 +214,23 @@
             }
         }
         
+        //Rows of single-byte texels won't be padded out to 4-byte boundaries.
+        if (self.bytesPerTexel != 4)
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        
         glTexImage2D(_type,                         //Texture target
                      0,								//Mipmap level
-                     GL_RGBA8,						//Internal texture format
+                     _internalFormat,				//Internal texture format
                      _textureSize.width,			//Width
                      _textureSize.height,			//Height
                      0,								//Border (unused)
-                     GL_BGRA,						//Byte ordering
-                     GL_UNSIGNED_INT_8_8_8_8_REV,	//Byte packing
+                     _pixelFormat,					//Byte ordering
+                     _pixelType,					//Byte packing
                      initialData);                  //Texture data
         
+        if (self.bytesPerTexel != 4)
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        
         if (createdOwnData)
         {
             free(initialData);
@@ -239,16 +297,22 @@
     
     glBindTexture(_type, _texture);
     
+    if (self.bytesPerTexel != 4)
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    
     glTexSubImage2D(_type,
                     0,                              //Mipmap level
                     region.origin.x,                //X offset
                     region.origin.y,                //Y offset
                     region.size.width,              //Width
                     region.size.height,             //Height
-                    GL_BGRA,                        //Byte ordering
-                    GL_UNSIGNED_INT_8_8_8_8_REV,	//Byte packing
+                    _pixelFormat,                   //Byte ordering
+                    _pixelType,                     //Byte packing
                     bytes);                         //Texture data
     
+    if (self.bytesPerTexel != 4)
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    
     BOOL succeeded = [self _checkForGLError: outError];
     return succeeded;
 }
@@ -268,13 +332,16 @@
         alpha * 255
     };
     
-    size_t numBytes = _textureSize.width * _textureSize.height * 4;
+    size_t numBytes = _textureSize.width * _textureSize.height * self.bytesPerTexel;
     GLvoid *colorData = (GLvoid *)malloc(numBytes);
     BOOL succeeded = NO;
     if (colorData)
     {
         //Write the color data in stripes into the buffer
-        memset_pattern4(colorData, components, numBytes);
+        if (self.bytesPerTexel == 4)
+            memset_pattern4(colorData, components, numBytes);
+        else
+            memset(colorData, components[2], numBytes);
         
         succeeded = [self fillRegion: region withBytes: colorData error: outError];
         free(colorData);
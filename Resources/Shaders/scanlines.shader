@@ -0,0 +1,38 @@
+<?xml version="1.0" encoding="UTF-8"?>
+<!--
+    Scanlines shader
+
+    Copyright (c) 2013 Alun Bestor and contributors. All rights reserved.
+    This source file is released under the GNU General Public License 2.0. A full copy of this license
+    can be found in this XCode project at Resources/English.lproj/BoxerHelp/pages/legalese.html, or read
+    online at [http://www.gnu.org/licenses/gpl-2.0.txt].
+
+    A lightweight GPU replacement for DOSBox's TV scanline scaler, used for the CRT rendering style
+    on GPUs that are too slow for the full CRT shader. Each source line is drawn at full brightness
+    in its upper half and dimmed in its lower half.
+-->
+<shader language="GLSL">
+  <vertex><![CDATA[
+    void main() {
+      gl_Position = gl_ModelViewProjectionMatrix * gl_Vertex;
+      gl_TexCoord[0] = gl_MultiTexCoord0;
+    }
+  ]]></vertex>
+
+  <fragment filter="nearest"><![CDATA[
+    uniform sampler2D rubyTexture;
+    uniform vec2 rubyTextureSize;
+
+    //How bright the dimmed half of each line should be, relative to the lit half.
+    //This matches the 5/8 used by DOSBox's TV scaler.
+    const float scanlineBrightness = 0.625;
+
+    void main() {
+      vec3 color = texture2D(rubyTexture, gl_TexCoord[0].xy).rgb;
+      float linePosition = fract(gl_TexCoord[0].y * rubyTextureSize.y);
+
+      gl_FragColor.rgb = (linePosition < 0.5) ? color : color * scanlineBrightness;
+      gl_FragColor.a = 1.0;
+    }
+  ]]></fragment>
+</shader>
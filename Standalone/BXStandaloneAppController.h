@@ -11,6 +11,13 @@
 
 #import "BXBaseAppController.h"
 
+//The name of the launch manifest inside a standalone app's resources.
+extern NSString * const BXLaunchManifestName;
+
+//When a standalone app is launched with this argument followed by a path,
+//it writes a launch manifest for its bundled gamebox to that path and exits.
+extern NSString * const BXWriteLaunchManifestArgument;
+
 @interface BXStandaloneAppController : BXBaseAppController
 
 //The name and website address of the organization producing the standalone app bundles.
@@ -18,8 +25,20 @@
 + (NSURL *) organizationWebsiteURL;
 
 //The URL to the bundled gamebox resource. Will be nil if no bundled gamebox is present.
++ (NSURL *) bundledGameboxURL;
 - (NSURL *) bundledGameboxURL;
 
+//The launch manifest that was generated for the bundled gamebox when the app was exported,
+//describing its drives and game profile. Will be nil if the app has no launch manifest.
+- (NSDictionary *) bundledLaunchManifest;
+
+//Detects the drives and game profile of the specified gamebox, and writes them as a launch manifest
+//to the specified location. Returns NO and populates outError if the manifest could not be written.
+//Boxer Bundler runs exported apps with BXWriteLaunchManifestArgument to call this.
++ (BOOL) writeLaunchManifestForGameboxAtURL: (NSURL *)gameboxURL
+                                      toURL: (NSURL *)manifestURL
+                                      error: (NSError **)outError;
+
 //Launches the gamebox bundled in the application and returns the resulting session.
 //Returns nil and populates outError if the bundled gamebox could not be launched.
 - (id) openBundledGameAndDisplay: (BOOL)display error: (NSError **)outError;
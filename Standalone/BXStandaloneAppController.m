@@ -12,6 +12,8 @@
 #import "BXStandaloneAboutController.h"
 #import "BXBaseAppController+BXHotKeys.h"
 #import "BXFileTypes.h"
+#import "BXGamebox.h"
+#import "BXGameProfile.h"
 
 #pragma mark -
 #pragma mark App-menu replacement constants
@@ -42,6 +44,9 @@ NSString * const BXOrganizationNameInfoPlistKey = @"BXOrganizationName";
 NSString * const BXBundledGameboxNameInfoPlistKey = @"BXBundledGameboxName";
 NSString * const BXOrganizationWebsiteURLInfoPlistKey = @"BXOrganizationWebsiteURL";
 
+NSString * const BXLaunchManifestName = @"Launch Manifest.plist";
+NSString * const BXWriteLaunchManifestArgument = @"--write-launch-manifest";
+
 
 #pragma mark -
 #pragma mark Private method declarations
@@ -172,6 +177,11 @@ NSString * const BXOrganizationWebsiteURLInfoPlistKey = @"BXOrganizationWebsiteU
 }
 
 - (NSURL *) bundledGameboxURL
+{
+    return [self.class bundledGameboxURL];
+}
+
++ (NSURL *) bundledGameboxURL
 {
     NSString *bundledGameboxName = [[NSBundle mainBundle] objectForInfoDictionaryKey: BXBundledGameboxNameInfoPlistKey];
     
@@ -184,6 +194,44 @@ NSString * const BXOrganizationWebsiteURLInfoPlistKey = @"BXOrganizationWebsiteU
     return bundledGameboxURL;
 }
 
+- (NSDictionary *) bundledLaunchManifest
+{
+    NSURL *manifestURL = [[NSBundle mainBundle] URLForResource: BXLaunchManifestName withExtension: nil];
+    if (manifestURL)
+        return [NSDictionary dictionaryWithContentsOfURL: manifestURL];
+    else
+        return nil;
+}
+
++ (BOOL) writeLaunchManifestForGameboxAtURL: (NSURL *)gameboxURL
+                                      toURL: (NSURL *)manifestURL
+                                      error: (NSError **)outError
+{
+    BXGamebox *gamebox = [BXGamebox bundleWithURL: gameboxURL];
+    if (!gamebox)
+    {
+        if (outError)
+            *outError = [NSError errorWithDomain: NSCocoaErrorDomain
+                                            code: NSFileReadNoSuchFileError
+                                        userInfo: @{ NSURLErrorKey: gameboxURL }];
+        return NO;
+    }
+    
+    BXGameProfile *profile = [BXSession profileForGameAtURL: gamebox.bundleURL];
+    if (!profile)
+        profile = [BXGameProfile genericProfile];
+    
+    NSDictionary *manifest = [gamebox generatedLaunchManifestWithProfileIdentifier: profile.identifier
+                                                                    profileVersion: [BXGameProfile catalogueVersion]];
+    
+    NSData *manifestData = [NSPropertyListSerialization dataWithPropertyList: manifest
+                                                                      format: NSPropertyListXMLFormat_v1_0
+                                                                     options: 0
+                                                                       error: outError];
+    
+    return manifestData && [manifestData writeToURL: manifestURL options: NSDataWritingAtomic error: outError];
+}
+
 - (id) makeDocumentWithContentsOfURL: (NSURL *)absoluteURL
                               ofType: (NSString *)typeName
                                error: (NSError **)outError
@@ -219,6 +267,11 @@ NSString * const BXOrganizationWebsiteURLInfoPlistKey = @"BXOrganizationWebsiteU
             BXSession *session = [[BXSession alloc] initWithContentsOfURL: gameboxURL
                                                                    ofType: typeName
                                                                     error: outError];
+            
+            //Let the session use the drives and profile that were detected when we were exported,
+            //instead of scanning the gamebox for them at startup.
+            session.gamebox.launchManifest = self.bundledLaunchManifest;
+            
             return [session autorelease];
         }
         else